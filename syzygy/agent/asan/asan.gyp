@@ -29,6 +29,8 @@
         'asan_crt_interceptors.h',
         'asan_logger.cc',
         'asan_logger.h',
+        'asan_metrics.cc',
+        'asan_metrics.h',
         'asan_rtl_impl.cc',
         'asan_rtl_impl.h',
         'asan_rtl_utils.cc',
@@ -52,14 +54,20 @@
         'heap_checker.cc',
         'heap_checker.h',
         'heap_manager.h',
+        'lockfree_circular_queue_impl.h',
+        'lockfree_circular_queue.h',
         'memory_interceptors.cc',
         'memory_interceptors.h',
+        'memory_interceptors_patcher.cc',
+        'memory_interceptors_patcher.h',
         'memory_notifier.h',
         'page_allocator.h',
         'page_allocator_impl.h',
         'page_protection_helpers.cc',
         'page_protection_helpers.h',
         'quarantine.h',
+        'redzone_tuner.cc',
+        'redzone_tuner.h',
         'shadow.cc',
         'shadow.h',
         'shadow_impl.h',
@@ -92,6 +100,8 @@
         'quarantines/sharded_quarantine_impl.h',
         'quarantines/size_limited_quarantine.h',
         'quarantines/size_limited_quarantine_impl.h',
+        'quarantines/thread_local_quarantine_cache.h',
+        'quarantines/thread_local_quarantine_cache_impl.h',
       ],
       'dependencies': [
         'system_interceptors_generator',
@@ -203,6 +213,38 @@
         },
       ],
     },
+    {
+      'target_name': 'asan_benchmark_lib',
+      'type': 'static_library',
+      'sources': [
+        'benchmarks/asan_benchmark_app.cc',
+        'benchmarks/asan_benchmark_app.h',
+      ],
+      'dependencies': [
+        'syzyasan_rtl_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/agent/common/common.gyp:agent_common_lib',
+        '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+      ],
+    },
+    {
+      'target_name': 'asan_benchmark',
+      'type': 'executable',
+      'sources': [
+        'benchmarks/asan_benchmark_main.cc',
+      ],
+      'dependencies': [
+        'asan_benchmark_lib',
+        '<(src)/base/base.gyp:base',
+      ],
+      'run_as': {
+        'action': [
+          '$(TargetPath)',
+          '--pretty-print',
+        ]
+      },
+    },
     {
       'target_name': 'syzyasan_rtl_unittests',
       'type': 'executable',
@@ -210,6 +252,7 @@
         'allocators_unittest.cc',
         'asan_crt_interceptors_unittest.cc',
         'asan_logger_unittest.cc',
+        'asan_metrics_unittest.cc',
         'asan_runtime_unittest.cc',
         'asan_rtl_impl_unittest.cc',
         'asan_rtl_unittest.cc',
@@ -220,9 +263,12 @@
         'circular_queue_unittest.cc',
         'error_info_unittest.cc',
         'heap_checker_unittest.cc',
+        'lockfree_circular_queue_unittest.cc',
+        'memory_interceptors_patcher_unittest.cc',
         'memory_interceptors_unittest.cc',
         'page_allocator_unittest.cc',
         'page_protection_helpers_unittest.cc',
+        'redzone_tuner_unittest.cc',
         'shadow_marker_unittest.cc',
         'shadow_unittest.cc',
         'stack_capture_cache_unittest.cc',
@@ -230,6 +276,7 @@
         'unittest_util.cc',
         'unittest_util.h',
         'windows_heap_adapter_unittest.cc',
+        'benchmarks/asan_benchmark_app_unittest.cc',
         'heaps/ctmalloc_heap_unittest.cc',
         'heaps/internal_heap_unittest.cc',
         'heaps/large_block_heap_unittest.cc',
@@ -240,9 +287,11 @@
         'memory_notifiers/shadow_memory_notifier_unittest.cc',
         'quarantines/sharded_quarantine_unittest.cc',
         'quarantines/size_limited_quarantine_unittest.cc',
+        'quarantines/thread_local_quarantine_cache_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
       ],
       'dependencies': [
+        'asan_benchmark_lib',
         'syzyasan_rtl_lib',
         'syzyasan_rtl',
         '<(src)/base/base.gyp:base',
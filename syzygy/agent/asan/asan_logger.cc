@@ -88,18 +88,20 @@ void AsanLogger::Stop() {
   }
 }
 
-void AsanLogger::Write(const std::string& message) {
+void AsanLogger::Write(const char* message) {
+  DCHECK_NE(reinterpret_cast<const char*>(NULL), message);
   // If we're bound to a logging endpoint, log the message there.
   if (rpc_binding_.Get() != NULL) {
     common::rpc::InvokeRpc(
         &LoggerClient_Write,
         rpc_binding_.Get(),
-        reinterpret_cast<const unsigned char*>(message.c_str()));
+        reinterpret_cast<const unsigned char*>(message));
   }
 }
 
-void AsanLogger::WriteWithContext(const std::string& message,
+void AsanLogger::WriteWithContext(const char* message,
                                   const CONTEXT& context) {
+  DCHECK_NE(reinterpret_cast<const char*>(NULL), message);
   // If we're bound to a logging endpoint, log the message there.
   if (rpc_binding_.Get() != NULL) {
     ExecutionContext exec_context = {};
@@ -107,20 +109,21 @@ void AsanLogger::WriteWithContext(const std::string& message,
     common::rpc::InvokeRpc(
         &LoggerClient_WriteWithContext,
         rpc_binding_.Get(),
-        reinterpret_cast<const unsigned char*>(message.c_str()),
+        reinterpret_cast<const unsigned char*>(message),
         &exec_context);
   }
 }
 
-void AsanLogger::WriteWithStackTrace(const std::string& message,
+void AsanLogger::WriteWithStackTrace(const char* message,
                                      const void * const * trace_data,
                                      size_t trace_length) {
+  DCHECK_NE(reinterpret_cast<const char*>(NULL), message);
   // If we're bound to a logging endpoint, log the message there.
   if (rpc_binding_.Get() != NULL) {
     common::rpc::InvokeRpc(
         &LoggerClient_WriteWithTrace,
         rpc_binding_.Get(),
-        reinterpret_cast<const unsigned char*>(message.c_str()),
+        reinterpret_cast<const unsigned char*>(message),
         reinterpret_cast<const DWORD*>(trace_data),
         trace_length);
   }
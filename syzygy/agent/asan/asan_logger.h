@@ -52,19 +52,32 @@ class AsanLogger {
   // Stop the logger.
   void Stop();
 
-  // Write a @p message to the logger.
-  void Write(const std::string& message);
+  // Write a @p message to the logger. The |const char*| variants of the
+  // write functions perform no allocations, and are safe to use while an
+  // error is being reported.
+  void Write(const char* message);
+  void Write(const std::string& message) {
+    Write(message.c_str());
+  }
 
   // Write a @p message to the logger, and have the logger include the most
   // detailed and accurate stack trace it can derive given the execution
   // @p context .
-  void WriteWithContext(const std::string& message, const CONTEXT& context);
+  void WriteWithContext(const char* message, const CONTEXT& context);
+  void WriteWithContext(const std::string& message, const CONTEXT& context) {
+    WriteWithContext(message.c_str(), context);
+  }
 
   // Write a @p message to the logger, with an optional stack @p trace
   // containing @p trace_length elements.
-  void WriteWithStackTrace(const std::string& message,
+  void WriteWithStackTrace(const char* message,
                            const void* const* trace_data,
                            size_t trace_length);
+  void WriteWithStackTrace(const std::string& message,
+                           const void* const* trace_data,
+                           size_t trace_length) {
+    WriteWithStackTrace(message.c_str(), trace_data, trace_length);
+  }
 
   // Ask the logger to capture a minidump of the process for the given
   // @p context and @p error_info.
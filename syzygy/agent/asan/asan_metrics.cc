@@ -0,0 +1,178 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/asan_metrics.h"
+
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/common/com_utils.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// The magic and version identifying a valid metrics page.
+const uint32 kMetricsPageMagic = 0x504d5341;  // 'ASMP'.
+const uint32 kMetricsPageVersion = 1;
+
+// The number of 64-bit counter slots per shard. One cache line worth, so
+// that shards never share a line.
+const size_t kSlotsPerShard = 8;
+
+}  // namespace
+
+// The layout of the shared-memory metrics page. The header lets samplers
+// validate that they are looking at a page they understand, and the counters
+// give each shard its own cache line.
+struct AsanMetrics::MetricsPage {
+  uint32 magic;
+  uint32 version;
+  uint32 process_id;
+  uint32 shard_count;
+  uint32 metric_count;
+  uint32 reserved[11];
+  volatile LONGLONG counters[kShardCount][kSlotsPerShard];
+};
+
+COMPILE_ASSERT(kMetricCount <= kSlotsPerShard,
+               too_many_metrics_for_one_cache_line_per_shard);
+COMPILE_ASSERT((AsanMetrics::kShardCount &
+                (AsanMetrics::kShardCount - 1)) == 0,
+               shard_count_must_be_a_power_of_two);
+COMPILE_ASSERT(sizeof(AsanMetrics::MetricsPage) <= 4096,
+               metrics_page_does_not_fit_in_a_page);
+
+AsanMetrics* AsanMetrics::instance_ = NULL;
+
+AsanMetrics::AsanMetrics() : mapping_(NULL), page_(NULL) {
+}
+
+AsanMetrics::~AsanMetrics() {
+  if (instance_ == this)
+    instance_ = NULL;
+  if (page_ != NULL)
+    ::UnmapViewOfFile(page_);
+  if (mapping_ != NULL)
+    ::CloseHandle(mapping_);
+}
+
+bool AsanMetrics::Init() {
+  DCHECK(page_ == NULL);
+
+  std::wstring name = GetMappingName(::GetCurrentProcessId());
+  mapping_ = ::CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                 0, sizeof(MetricsPage), name.c_str());
+  if (mapping_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create metrics page mapping: "
+               << ::common::LogWe(error);
+    return false;
+  }
+
+  page_ = reinterpret_cast<MetricsPage*>(::MapViewOfFile(
+      mapping_, FILE_MAP_WRITE, 0, 0, sizeof(MetricsPage)));
+  if (page_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map metrics page: " << ::common::LogWe(error);
+    ::CloseHandle(mapping_);
+    mapping_ = NULL;
+    return false;
+  }
+
+  // The mapping is freshly created and zero-filled; only the header needs
+  // writing.
+  page_->magic = kMetricsPageMagic;
+  page_->version = kMetricsPageVersion;
+  page_->process_id = ::GetCurrentProcessId();
+  page_->shard_count = kShardCount;
+  page_->metric_count = kMetricCount;
+
+  instance_ = this;
+
+  return true;
+}
+
+void AsanMetrics::Record(AsanMetricId metric) {
+  Add(metric, 1);
+}
+
+void AsanMetrics::Add(AsanMetricId metric, size_t amount) {
+  DCHECK_LE(0, metric);
+  DCHECK_GT(kMetricCount, metric);
+
+  AsanMetrics* self = instance_;
+  if (self == NULL)
+    return;
+
+  // Shard by thread ID. The low two bits of a thread ID are always zero, so
+  // shift them out before taking the modulus.
+  size_t shard = (::GetCurrentThreadId() >> 2) & (kShardCount - 1);
+  ::InterlockedExchangeAdd64(&self->page_->counters[shard][metric],
+                             static_cast<LONGLONG>(amount));
+}
+
+uint64 AsanMetrics::Get(AsanMetricId metric) const {
+  DCHECK_LE(0, metric);
+  DCHECK_GT(kMetricCount, metric);
+  DCHECK(page_ != NULL);
+  return SumShards(page_, metric);
+}
+
+bool AsanMetrics::Sample(uint32 process_id, uint64 totals[kMetricCount]) {
+  DCHECK(totals != NULL);
+
+  std::wstring name = GetMappingName(process_id);
+  base::win::ScopedHandle mapping(
+      ::OpenFileMapping(FILE_MAP_READ, FALSE, name.c_str()));
+  if (!mapping.IsValid())
+    return false;
+
+  const MetricsPage* page = reinterpret_cast<const MetricsPage*>(
+      ::MapViewOfFile(mapping.Get(), FILE_MAP_READ, 0, 0,
+                      sizeof(MetricsPage)));
+  if (page == NULL)
+    return false;
+
+  bool valid = page->magic == kMetricsPageMagic &&
+      page->version == kMetricsPageVersion &&
+      page->process_id == process_id &&
+      page->shard_count == kShardCount &&
+      page->metric_count == kMetricCount;
+
+  if (valid) {
+    for (size_t i = 0; i < kMetricCount; ++i)
+      totals[i] = SumShards(page, static_cast<AsanMetricId>(i));
+  }
+
+  ::UnmapViewOfFile(const_cast<MetricsPage*>(page));
+
+  return valid;
+}
+
+std::wstring AsanMetrics::GetMappingName(uint32 process_id) {
+  return base::StringPrintf(L"syzygy-asan-metrics-%u", process_id);
+}
+
+uint64 AsanMetrics::SumShards(const MetricsPage* page, AsanMetricId metric) {
+  DCHECK(page != NULL);
+  uint64 total = 0;
+  for (size_t i = 0; i < kShardCount; ++i)
+    total += page->counters[i][metric];
+  return total;
+}
+
+}  // namespace asan
+}  // namespace agent
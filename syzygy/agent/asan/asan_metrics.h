@@ -0,0 +1,120 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares AsanMetrics, a small set of always-on runtime counters that the
+// ASAN runtime keeps in a named shared-memory page. External tools can open
+// the page by name and sample the counters without suspending or attaching
+// to the instrumented process.
+
+#ifndef SYZYGY_AGENT_ASAN_ASAN_METRICS_H_
+#define SYZYGY_AGENT_ASAN_ASAN_METRICS_H_
+
+#include <windows.h>
+
+#include <string>
+
+#include "base/basictypes.h"
+
+namespace agent {
+namespace asan {
+
+// The counters tracked by the ASAN runtime.
+enum AsanMetricId {
+  // Invocations of the CRT and system function interceptors.
+  kMetricInterceptorHits,
+  // Memory accesses flagged as bad by the shadow memory.
+  kMetricShadowFaults,
+  // Blocks entering a quarantine.
+  kMetricQuarantinePushes,
+  // Blocks evicted from a quarantine by trimming.
+  kMetricQuarantineTrims,
+  // This must be last.
+  kMetricCount,
+};
+
+// Maintains the shared-memory metrics page for the current process.
+//
+// Counter updates are meant for instrumented hot paths: each counter is
+// sharded by thread ID, with every shard on its own cache line, and an
+// update is a single interlocked increment of the calling thread's shard.
+// No locks are taken anywhere, so counters may be bumped from any context,
+// including under the heap manager's locks.
+//
+// Reads simply sum the shards without synchronization; a sampled total may
+// miss in-flight increments, which is fine for monitoring purposes.
+class AsanMetrics {
+ public:
+  // The number of counter shards. Must be a power of two.
+  static const size_t kShardCount = 8;
+
+  AsanMetrics();
+  ~AsanMetrics();
+
+  // Creates and maps the metrics page for the current process and installs
+  // this instance as the one that Record updates. The page is zeroed by the
+  // kernel, so all counters start at zero.
+  // @returns true on success, false otherwise.
+  bool Init();
+
+  // Bumps @p metric by one. Does nothing if no AsanMetrics instance has
+  // been initialized.
+  // @param metric the counter to increment.
+  static void Record(AsanMetricId metric);
+
+  // Bumps @p metric by @p amount. Does nothing if no AsanMetrics instance
+  // has been initialized.
+  // @param metric the counter to increment.
+  // @param amount the amount to add.
+  static void Add(AsanMetricId metric, size_t amount);
+
+  // Returns the current total of @p metric, summed across all shards.
+  // @param metric the counter to read.
+  // @returns the counter total.
+  uint64 Get(AsanMetricId metric) const;
+
+  // Samples the metrics page of another process. This is the interface
+  // meant for external tools; it opens the page by name and never touches
+  // the target process itself.
+  // @param process_id the ID of the process to sample.
+  // @param totals receives the counter totals, indexed by AsanMetricId.
+  // @returns true if the page was found and is valid, false otherwise.
+  static bool Sample(uint32 process_id, uint64 totals[kMetricCount]);
+
+  // Returns the name of the metrics page mapping of a process.
+  // @param process_id the ID of the process.
+  // @returns the mapping name.
+  static std::wstring GetMappingName(uint32 process_id);
+
+  // The layout of the metrics page. Defined in the implementation file.
+  struct MetricsPage;
+
+ private:
+  // Sums the shards of @p metric in @p page.
+  static uint64 SumShards(const MetricsPage* page, AsanMetricId metric);
+
+  // The instance that Record updates. Installed by Init and cleared by the
+  // destructor.
+  static AsanMetrics* instance_;
+
+  // The shared-memory mapping backing the page, and the mapped page itself.
+  HANDLE mapping_;
+  MetricsPage* page_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsanMetrics);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_ASAN_METRICS_H_
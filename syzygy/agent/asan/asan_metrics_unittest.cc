@@ -0,0 +1,114 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/asan_metrics.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// A worker that bumps a metric a fixed number of times.
+class RecordWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  RecordWorker(AsanMetricId metric, size_t count)
+      : metric_(metric), count_(count) {
+  }
+
+  virtual void Run() {
+    for (size_t i = 0; i < count_; ++i)
+      AsanMetrics::Record(metric_);
+  }
+
+ private:
+  AsanMetricId metric_;
+  size_t count_;
+};
+
+}  // namespace
+
+TEST(AsanMetricsTest, RecordWithoutInstanceIsANop) {
+  // No instance has been initialized; this must simply not crash.
+  AsanMetrics::Record(kMetricInterceptorHits);
+  AsanMetrics::Add(kMetricQuarantineTrims, 42);
+}
+
+TEST(AsanMetricsTest, RecordAndGet) {
+  AsanMetrics metrics;
+  ASSERT_TRUE(metrics.Init());
+
+  EXPECT_EQ(0u, metrics.Get(kMetricInterceptorHits));
+  EXPECT_EQ(0u, metrics.Get(kMetricShadowFaults));
+
+  AsanMetrics::Record(kMetricInterceptorHits);
+  AsanMetrics::Record(kMetricInterceptorHits);
+  AsanMetrics::Add(kMetricQuarantinePushes, 10);
+
+  EXPECT_EQ(2u, metrics.Get(kMetricInterceptorHits));
+  EXPECT_EQ(10u, metrics.Get(kMetricQuarantinePushes));
+  EXPECT_EQ(0u, metrics.Get(kMetricShadowFaults));
+}
+
+TEST(AsanMetricsTest, RecordsFromMultipleThreads) {
+  AsanMetrics metrics;
+  ASSERT_TRUE(metrics.Init());
+
+  const size_t kThreadCount = 4;
+  const size_t kRecordsPerThread = 10000;
+  RecordWorker worker(kMetricInterceptorHits, kRecordsPerThread);
+  std::vector<base::DelegateSimpleThread*> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads.push_back(new base::DelegateSimpleThread(&worker, "worker"));
+    threads.back()->Start();
+  }
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads[i]->Join();
+    delete threads[i];
+  }
+
+  EXPECT_EQ(kThreadCount * kRecordsPerThread,
+            metrics.Get(kMetricInterceptorHits));
+}
+
+TEST(AsanMetricsTest, SampleOwnProcess) {
+  AsanMetrics metrics;
+  ASSERT_TRUE(metrics.Init());
+
+  AsanMetrics::Record(kMetricShadowFaults);
+  AsanMetrics::Add(kMetricQuarantineTrims, 3);
+
+  // Sampling goes through the named mapping, exactly as an external tool
+  // would.
+  uint64 totals[kMetricCount] = {};
+  ASSERT_TRUE(AsanMetrics::Sample(::GetCurrentProcessId(), totals));
+  EXPECT_EQ(metrics.Get(kMetricInterceptorHits),
+            totals[kMetricInterceptorHits]);
+  EXPECT_EQ(1u, totals[kMetricShadowFaults]);
+  EXPECT_EQ(3u, totals[kMetricQuarantineTrims]);
+}
+
+TEST(AsanMetricsTest, SampleMissingProcessFails) {
+  uint64 totals[kMetricCount] = {};
+  // A process ID no process can have.
+  EXPECT_FALSE(AsanMetrics::Sample(1, totals));
+}
+
+}  // namespace asan
+}  // namespace agent
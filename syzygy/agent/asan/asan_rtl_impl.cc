@@ -22,6 +22,8 @@
 #include "syzygy/agent/asan/asan_rtl_utils.h"
 #include "syzygy/agent/asan/asan_runtime.h"
 #include "syzygy/agent/asan/heap_manager.h"
+#include "syzygy/agent/asan/memory_interceptors.h"
+#include "syzygy/agent/asan/memory_interceptors_patcher.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/agent/asan/windows_heap_adapter.h"
 #include "syzygy/agent/asan/heap_managers/block_heap_manager.h"
@@ -248,4 +250,25 @@ int asan_CrashForException(EXCEPTION_POINTERS* exception) {
   return agent::asan::AsanRuntime::CrashForException(exception);
 }
 
+BOOL WINAPI asan_SetInterceptorTier(HMODULE module, DWORD tier) {
+  if (module == NULL || tier >= agent::asan::kInterceptorTierCount)
+    return FALSE;
+  if (!agent::asan::SetMemoryInterceptorTier(
+          module, static_cast<agent::asan::MemoryInterceptorTier>(tier))) {
+    return FALSE;
+  }
+  return TRUE;
+}
+
+DWORD WINAPI asan_GetMemoryAccessCount() {
+  return asan_memory_access_count;
+}
+
+void WINAPI asan_SetInterceptorSamplingInterval(DWORD interval) {
+  if (interval == 0)
+    interval = 1;
+  asan_sampling_interval = interval;
+  asan_sampling_countdown = interval;
+}
+
 }  // extern "C"
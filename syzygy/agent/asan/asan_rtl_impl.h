@@ -89,6 +89,19 @@ void WINAPI asan_SetCallBack(AsanErrorCallBack callback);
 
 int asan_CrashForException(EXCEPTION_POINTERS* exception);
 
+// Switches all the memory interceptor calls of @p module to the given tier
+// (a MemoryInterceptorTier value). Returns FALSE on an invalid tier or if
+// patching failed.
+BOOL WINAPI asan_SetInterceptorTier(HMODULE module, DWORD tier);
+
+// Returns the number of memory accesses observed by the count-only
+// interceptor tier.
+DWORD WINAPI asan_GetMemoryAccessCount();
+
+// Sets the period of the sampled interceptor tier: one access out of
+// @p interval is checked. An interval of zero is treated as one.
+void WINAPI asan_SetInterceptorSamplingInterval(DWORD interval);
+
 }  // extern "C"
 
 #endif  // SYZYGY_AGENT_ASAN_ASAN_RTL_IMPL_H_
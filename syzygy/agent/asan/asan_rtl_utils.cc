@@ -19,6 +19,7 @@
 #include "base/logging.h"
 #include "base/debug/alias.h"
 #include "base/memory/scoped_ptr.h"
+#include "syzygy/agent/asan/asan_metrics.h"
 #include "syzygy/agent/asan/asan_runtime.h"
 #include "syzygy/agent/asan/heap_checker.h"
 #include "syzygy/agent/asan/shadow.h"
@@ -43,6 +44,8 @@ void ReportBadMemoryAccess(void* location,
                            AccessMode access_mode,
                            size_t access_size,
                            const AsanContext& asan_context) {
+  AsanMetrics::Record(kMetricShadowFaults);
+
   // Capture the context and restore the value of the register as before calling
   // the asan hook.
 
@@ -135,22 +138,25 @@ void ReportBadAccess(const uint8* location, AccessMode access_mode) {
 void TestMemoryRange(const uint8* memory,
                      size_t size,
                      AccessMode access_mode) {
+  AsanMetrics::Record(kMetricInterceptorHits);
+
   if (size == 0U)
     return;
-  // TODO(sebmarchand): This approach is pretty limited because it only checks
-  //     if the first and the last elements are accessible. Once we have the
-  //     plumbing in place we should benchmark a check that looks at each
-  //     address to be touched (via the shadow memory, 8 bytes at a time).
-  if (!Shadow::IsAccessible(memory) ||
-      !Shadow::IsAccessible(memory + size - 1)) {
-    const uint8* location = NULL;
-    if (!Shadow::IsAccessible(memory)) {
-      location = memory;
-    } else {
-      location = memory + size - 1;
-    }
-    ReportBadAccess(location, access_mode);
-  }
+
+  // This validates every byte of the range, not just its endpoints. The
+  // interior of the range is checked via the shadow memory using the wide
+  // (vectorized) scanning kernel, so even very large memcpy/memset ranges
+  // only cost a linear scan over one byte of shadow per 8 bytes of memory.
+  if (Shadow::IsRangeAccessible(memory, size))
+    return;
+
+  // The range is bad. Pin down the first offending byte for the report; this
+  // is off the hot path, so a simple byte-wise walk does fine.
+  const uint8* location = memory;
+  while (Shadow::IsAccessible(location))
+    ++location;
+  DCHECK_LT(location, memory + size);
+  ReportBadAccess(location, access_mode);
 }
 
 }  // namespace asan
@@ -130,11 +130,35 @@ TEST(AsanRtlUtilsTest, TestMemoryRange) {
   TestMemoryRange(test_buffer.get(), kTestBufferSize / 2, access_mode);
   EXPECT_FALSE(memory_error_detected);
 
-  // Test the second half of the buffer, we should get an invalid access on its
-  // last byte.
+  // Test the whole buffer, we should get an invalid access on the first byte
+  // of the poisoned half.
   TestMemoryRange(test_buffer.get(), kTestBufferSize, access_mode);
   EXPECT_TRUE(memory_error_detected);
-  EXPECT_EQ(test_buffer.get() + kTestBufferSize - 1, last_error_info.location);
+  EXPECT_EQ(test_buffer.get() + kTestBufferSize / 2, last_error_info.location);
+  EXPECT_EQ(access_mode, last_error_info.access_mode);
+
+  Shadow::Unpoison(test_buffer.get(), kTestBufferSize);
+}
+
+TEST(AsanRtlUtilsTest, TestMemoryRangeDetectsInteriorRedzone) {
+  TestAsanRuntime runtime;
+  SetAsanRuntimeInstance(&runtime);
+  AccessMode access_mode = ASAN_WRITE_ACCESS;
+  const size_t kTestBufferSize = 256;
+  scoped_ptr<uint8> test_buffer(new uint8[kTestBufferSize]);
+
+  // Poison a handful of bytes in the middle of the buffer. Both endpoints of
+  // the range remain accessible, so only a full walk of the shadow interval
+  // can catch this.
+  const size_t kRedzoneOffset = 128;
+  const size_t kRedzoneSize = 8;
+  Shadow::Poison(test_buffer.get() + kRedzoneOffset,
+                 kRedzoneSize,
+                 kUserRedzoneMarker);
+
+  TestMemoryRange(test_buffer.get(), kTestBufferSize, access_mode);
+  EXPECT_TRUE(memory_error_detected);
+  EXPECT_EQ(test_buffer.get() + kRedzoneOffset, last_error_info.location);
   EXPECT_EQ(access_mode, last_error_info.access_mode);
 
   Shadow::Unpoison(test_buffer.get(), kTestBufferSize);
@@ -21,12 +21,14 @@
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/logging.h"
+#include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/sys_string_conversions.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/win/pe_image.h"
 #include "base/win/wrapped_window_proc.h"
 #include "syzygy/agent/asan/asan_logger.h"
+#include "syzygy/agent/asan/asan_metrics.h"
 #include "syzygy/agent/asan/block.h"
 #include "syzygy/agent/asan/heap_checker.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
@@ -174,10 +176,17 @@ void SetCrashKeyValuePair(const BreakpadFunctions& breakpad_functions,
   }
 
   if (breakpad_functions.set_crash_key_value_impl_ptr != NULL) {
-    std::wstring wkey = base::UTF8ToWide(key);
-    std::wstring wvalue = base::UTF8ToWide(value);
-    breakpad_functions.set_crash_key_value_impl_ptr(wkey.c_str(),
-                                                    wvalue.c_str());
+    // Breakpad only exports the wide-character implementation. The keys and
+    // values set here are ASCII, so widen them into fixed-size stack buffers
+    // rather than allocating strings; this runs while an error is being
+    // reported and must not touch the heap.
+    wchar_t wkey[64] = {};
+    wchar_t wvalue[256] = {};
+    for (size_t i = 0; i < arraysize(wkey) - 1 && key[i] != '\0'; ++i)
+      wkey[i] = key[i];
+    for (size_t i = 0; i < arraysize(wvalue) - 1 && value[i] != '\0'; ++i)
+      wvalue[i] = value[i];
+    breakpad_functions.set_crash_key_value_impl_ptr(wkey, wvalue);
     return;
   }
 
@@ -385,7 +394,8 @@ LPTOP_LEVEL_EXCEPTION_FILTER AsanRuntime::previous_uef_ = NULL;
 bool AsanRuntime::uef_installed_ = false;
 
 AsanRuntime::AsanRuntime()
-    : logger_(), stack_cache_(), asan_error_callback_(), heap_manager_() {
+    : logger_(), stack_cache_(), asan_error_callback_(), heap_manager_(),
+      next_error_record_(0) {
   ::common::SetDefaultAsanParameters(&params_);
   starting_ticks_ = ::GetTickCount();
 }
@@ -410,6 +420,10 @@ void AsanRuntime::SetUp(const std::wstring& flags_command_line) {
 
   Shadow::SetUp();
 
+  // Preallocate the error records so that no allocation is needed when an
+  // error is being reported.
+  error_records_.reset(new AsanErrorRecord[kErrorRecordCount]);
+
   // Setup the "global" state.
   common::StackCapture::Init();
   StackCaptureCache::Init();
@@ -418,10 +432,26 @@ void AsanRuntime::SetUp(const std::wstring& flags_command_line) {
   SetUpHeapManager();
   WindowsHeapAdapter::SetUp(heap_manager_.get());
 
+  // Set up the shared-memory metrics page. This is purely an observability
+  // aid, so failing to create it is not fatal; metric updates simply become
+  // no-ops.
+  metrics_.reset(new AsanMetrics());
+  if (!metrics_->Init()) {
+    LOG(WARNING) << "Failed to set up the metrics page; runtime metrics "
+                 << "will not be available.";
+    metrics_.reset();
+  }
+
   // Parse and propagate any flags set via the environment variable. This logs
-  // failure for us.
-  if (!::common::ParseAsanParameters(flags_command_line, &params_))
+  // failure for us. If the parameters baked into the image at instrumentation
+  // time are marked as final the parsing is skipped entirely, keeping
+  // short-lived processes off this path.
+  if (params_.params_are_final) {
+    VLOG(1) << "Baked-in Asan parameters are final; ignoring environment "
+            << "overrides.";
+  } else if (!::common::ParseAsanParameters(flags_command_line, &params_)) {
     return;
+  }
 
   // Propagates the flags values to the different modules.
   PropagateParams();
@@ -454,6 +484,7 @@ void AsanRuntime::SetUp(const std::wstring& flags_command_line) {
 void AsanRuntime::TearDown() {
   base::AutoLock auto_lock(lock_);
 
+  metrics_.reset();
   WindowsHeapAdapter::TearDown();
   TearDownHeapManager();
   TearDownStackCache();
@@ -579,15 +610,17 @@ bool AsanRuntime::GetAsanFlagsEnvVar(std::wstring* env_var_wstr) {
 void AsanRuntime::PropagateParams() {
   // This function has to be kept in sync with the AsanParameters struct. These
   // checks will ensure that this is the case.
-  COMPILE_ASSERT(sizeof(::common::AsanParameters) == 56,
+  COMPILE_ASSERT(sizeof(::common::AsanParameters) == 68,
                  must_update_propagate_params);
-  COMPILE_ASSERT(::common::kAsanParametersVersion == 7,
+  COMPILE_ASSERT(::common::kAsanParametersVersion == 12,
                  must_update_parameters_version);
 
   // Push the configured parameter values to the appropriate endpoints.
   heap_manager_->set_parameters(params_);
   StackCaptureCache::set_compression_reporting_period(
       params_.reporting_period);
+  StackCaptureCache::set_stack_sampling_threshold(
+      params_.stack_sampling_threshold);
   common::StackCapture::set_bottom_frames_to_skip(
       params_.bottom_frames_to_skip);
   stack_cache_->set_max_num_frames(params_.max_num_frames);
@@ -685,29 +718,55 @@ void AsanRuntime::WriteCorruptHeapInfo(
   return;
 }
 
+AsanRuntime::AsanErrorRecord* AsanRuntime::AcquireErrorRecord(
+    const AsanErrorInfo& error_info) {
+  DCHECK_NE(reinterpret_cast<AsanErrorRecord*>(NULL), error_records_.get());
+
+  AsanErrorRecord* record = NULL;
+  {
+    base::AutoLock lock(error_records_lock_);
+    record = error_records_.get() + (next_error_record_ % kErrorRecordCount);
+    ++next_error_record_;
+  }
+  record->info = error_info;
+  record->text[0] = '\0';
+  return record;
+}
+
 void AsanRuntime::LogAsanErrorInfo(AsanErrorInfo* error_info) {
   DCHECK_NE(reinterpret_cast<AsanErrorInfo*>(NULL), error_info);
 
+  // Copy the error into a preallocated record and serialize the report into
+  // its fixed-size text buffer. This keeps error reporting free of heap
+  // allocations, which matters when errors arrive in storms (e.g. when
+  // fuzzing); symbolization of the context and stack traces that accompany
+  // the report is entirely the business of the logger process.
+  AsanErrorRecord* record = AcquireErrorRecord(*error_info);
+
   const char* bug_descr = ErrorInfoAccessTypeToStr(error_info->error_type);
   if (logger_->log_as_text()) {
-    std::string output(base::StringPrintf(
+    size_t cursor = base::snprintf(
+        record->text, arraysize(record->text),
         "SyzyASAN error: %s on address 0x%08X (stack_id=0x%08X)\n",
-        bug_descr, error_info->location, error_info->crash_stack_id));
+        bug_descr, error_info->location, error_info->crash_stack_id);
+    if (cursor >= arraysize(record->text))
+      cursor = arraysize(record->text) - 1;
     if (error_info->access_mode != agent::asan::ASAN_UNKNOWN_ACCESS) {
       const char* access_mode_str = NULL;
       if (error_info->access_mode == agent::asan::ASAN_READ_ACCESS)
         access_mode_str = "READ";
       else
         access_mode_str = "WRITE";
-      base::StringAppendF(&output,
-                          "%s of size %d at 0x%08X\n",
-                          access_mode_str,
-                          error_info->access_size,
-                          error_info->location);
+      base::snprintf(record->text + cursor,
+                     arraysize(record->text) - cursor,
+                     "%s of size %d at 0x%08X\n",
+                     access_mode_str,
+                     error_info->access_size,
+                     error_info->location);
     }
 
     // Log the failure and stack.
-    logger_->WriteWithContext(output, error_info->context);
+    logger_->WriteWithContext(record->text, error_info->context);
 
     logger_->Write(error_info->shadow_info);
     if (error_info->free_stack_size != 0U) {
@@ -721,15 +780,18 @@ void AsanRuntime::LogAsanErrorInfo(AsanErrorInfo* error_info) {
                                    error_info->alloc_stack_size);
     }
     if (error_info->error_type >= USE_AFTER_FREE) {
-      std::string shadow_text;
-      Shadow::AppendShadowMemoryText(error_info->location, &shadow_text);
-      logger_->Write(shadow_text);
+      // The report text has already been sent, so the record's buffer can
+      // be reused for the shadow memory description.
+      Shadow::WriteShadowMemoryText(error_info->location,
+                                    record->text,
+                                    arraysize(record->text));
+      logger_->Write(record->text);
     }
   }
 
   // Print the base of the Windbg help message.
-  ASANDbgMessage(L"An Asan error has been found (%ls), here are the details:",
-                 base::SysUTF8ToWide(bug_descr).c_str());
+  ASANDbgMessage(L"An Asan error has been found (%hs), here are the details:",
+                 bug_descr);
 
   // Print the Windbg information to display the allocation stack if present.
   if (error_info->alloc_stack_size != NULL) {
@@ -773,6 +835,20 @@ void AsanRuntime::set_allocation_filter_flag(bool value) {
   heap_manager_->set_allocation_filter_flag(value);
 }
 
+float AsanRuntime::allocation_guard_rate() const {
+  return params_.allocation_guard_rate;
+}
+
+void AsanRuntime::set_allocation_guard_rate(float allocation_guard_rate) {
+  DCHECK_LE(0.0f, allocation_guard_rate);
+  DCHECK_GE(1.0f, allocation_guard_rate);
+  params_.allocation_guard_rate = allocation_guard_rate;
+
+  // The heap manager samples its own copy of the parameters on each
+  // allocation, so the new rate has to be pushed to it.
+  heap_manager_->set_parameters(params_);
+}
+
 void AsanRuntime::AddThreadId(uint32 thread_id) {
   DCHECK_NE(0u, thread_id);
   base::AutoLock lock(thread_ids_lock_);
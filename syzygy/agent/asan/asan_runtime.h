@@ -34,6 +34,7 @@ namespace asan {
 
 // Forward declarations.
 class AsanLogger;
+class AsanMetrics;
 
 // An Asan Runtime manager.
 // This class takes care of initializing the different modules (stack cache,
@@ -73,6 +74,10 @@ class AsanRuntime {
     DCHECK(stack_cache_.get() != NULL);
     return stack_cache_.get();
   }
+  // May return NULL if the metrics page could not be created.
+  AsanMetrics* metrics() {
+    return metrics_.get();
+  }
   // @}
 
   // Initialize asan runtime library.
@@ -146,6 +151,19 @@ class AsanRuntime {
   //     share the same flag.
   void set_allocation_filter_flag(bool value);
 
+  // Returns the rate at which allocations get full guarded block treatment.
+  // @returns the allocation guard rate, in the range [0, 1].
+  float allocation_guard_rate() const;
+
+  // Sets the rate at which allocations get full guarded block treatment.
+  // Allocations that are not guarded pass straight through to the underlying
+  // heap, trading detection probability for overhead. This may be called at
+  // any time after SetUp(), allowing the sampling rate to be adjusted while
+  // the process runs.
+  // @param allocation_guard_rate the new allocation guard rate, in the range
+  //     [0, 1].
+  void set_allocation_guard_rate(float allocation_guard_rate);
+
   // Observes a given thread ID, adding it to thread ID set.
   // @param thread_id The thread ID that has been observed.
   void AddThreadId(uint32 thread_id);
@@ -190,6 +208,27 @@ class AsanRuntime {
       void* buffer,
       AsanErrorInfo* error_info);
 
+  // A preallocated error record. Error reports are serialized into the
+  // fixed-size |text| buffer of one of these records rather than into
+  // freshly allocated strings, so reporting an error performs no heap
+  // allocations. The records are recycled round-robin, thus the most
+  // recent few reports also remain available to any minidump that is
+  // subsequently taken.
+  struct AsanErrorRecord {
+    // A copy of the information about the error.
+    AsanErrorInfo info;
+    // The serialized report text for the error.
+    char text[4096];
+  };
+
+  // The number of preallocated error records.
+  static const size_t kErrorRecordCount = 8;
+
+  // Returns the next preallocated error record, round-robin, with
+  // @p error_info copied into it and its text buffer cleared. This never
+  // allocates and never fails.
+  AsanErrorRecord* AcquireErrorRecord(const AsanErrorInfo& error_info);
+
   // Logs information about an ASAN error.
   void LogAsanErrorInfo(AsanErrorInfo* error_info);
 
@@ -245,6 +284,10 @@ class AsanRuntime {
   // The shared stack cache instance that will be used by all the heaps.
   scoped_ptr<StackCaptureCache> stack_cache_;
 
+  // The shared-memory metrics page. NULL if it could not be created, in
+  // which case metric updates are silently dropped.
+  scoped_ptr<AsanMetrics> metrics_;
+
   // The asan error callback functor.
   AsanOnErrorCallBack asan_error_callback_;
 
@@ -260,6 +303,11 @@ class AsanRuntime {
   base::Lock thread_ids_lock_;
   std::hash_set<uint32> thread_ids_;  // Under thread_ids_lock_.
 
+  // The ring of preallocated error records, allocated by SetUp.
+  scoped_ptr<AsanErrorRecord[]> error_records_;
+  base::Lock error_records_lock_;
+  size_t next_error_record_;  // Under error_records_lock_.
+
   DISALLOW_COPY_AND_ASSIGN(AsanRuntime);
 };
 
@@ -36,6 +36,7 @@ using agent::asan::AsanErrorInfo;
 class TestAsanRuntime : public AsanRuntime {
  public:
   using AsanRuntime::PropagateParams;
+  using AsanRuntime::heap_manager_;
 };
 
 class AsanRuntimeTest : public testing::TestWithAsanLogger {
@@ -156,6 +157,24 @@ TEST_F(AsanRuntimeTest, SetBottomFramesToSkip) {
   ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
 }
 
+TEST_F(AsanRuntimeTest, SetAllocationGuardRate) {
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+
+  // By default every allocation is guarded.
+  EXPECT_EQ(::common::kDefaultAllocationGuardRate,
+            asan_runtime_.allocation_guard_rate());
+
+  // Dial the rate down and ensure that it makes its way to the heap manager,
+  // which does the actual sampling.
+  asan_runtime_.set_allocation_guard_rate(0.25f);
+  EXPECT_EQ(0.25f, asan_runtime_.allocation_guard_rate());
+  EXPECT_EQ(0.25f,
+            asan_runtime_.heap_manager_->parameters().allocation_guard_rate);
+
+  ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
+}
+
 TEST_F(AsanRuntimeTest, SetDisableBreakpad) {
   current_command_line_.AppendSwitch(::common::kParamDisableBreakpadReporting);
 
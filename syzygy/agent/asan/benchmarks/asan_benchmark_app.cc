@@ -0,0 +1,538 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Benchmarks the hot primitives of the SyzyAsan runtime.
+
+#include "syzygy/agent/asan/benchmarks/asan_benchmark_app.h"
+
+#include <windows.h>  // NOLINT
+#include <intrin.h>
+
+#include "base/file_util.h"
+#include "base/memory/scoped_vector.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "syzygy/agent/asan/block.h"
+#include "syzygy/agent/asan/constants.h"
+#include "syzygy/agent/asan/quarantines/sharded_quarantine.h"
+#include "syzygy/agent/asan/shadow.h"
+#include "syzygy/agent/asan/shadow_marker.h"
+#include "syzygy/agent/common/stack_capture.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace agent {
+namespace asan {
+namespace benchmarks {
+
+namespace {
+
+const char kUsageFormatStr[] =
+    "Usage: %ls [options]\n"
+    "\n"
+    "  Benchmarks the hot primitives of the SyzyAsan runtime in tight\n"
+    "  loops and reports per-scenario wall and CPU time. The following\n"
+    "  scenarios are measured:\n"
+    "\n"
+    "    shadow-poison   Poisoning and unpoisoning of a 4 KB memory range\n"
+    "                    in the shadow memory.\n"
+    "    shadow-query    Shadow memory accessibility queries against a\n"
+    "                    half-poisoned 4 KB memory range.\n"
+    "    stack-capture   Stack trace captures via StackCapture.\n"
+    "    block-checksum  Checksum calculations over a block with a 4 KB\n"
+    "                    body.\n"
+    "    quarantine      Pushes to (and invariant-restoring pops from) a\n"
+    "                    sharded quarantine shared by all threads.\n"
+    "\n"
+    "  Each scenario is also run in a multithreaded variant (suffixed\n"
+    "  '-mt') that splits the same total number of operations evenly\n"
+    "  across the worker threads. The shadow and checksum kernels\n"
+    "  dispatch on CPU features at runtime; the detected features are\n"
+    "  included in the report so that results gathered on different\n"
+    "  machines can be compared meaningfully.\n"
+    "\n"
+    "Optional parameters:\n"
+    "  --iterations=NUM     The number of samples to gather per scenario.\n"
+    "                       Defaults to 1.\n"
+    "  --operations=NUM     The number of operations to perform per\n"
+    "                       sample. Defaults to 100000.\n"
+    "  --threads=NUM        The number of worker threads used by the\n"
+    "                       multithreaded variants. Defaults to 4. A\n"
+    "                       value of 1 disables the multithreaded\n"
+    "                       variants.\n"
+    "  --json=PATH          The path to which the JSON report should be\n"
+    "                       written. If not specified the report is\n"
+    "                       written to stdout.\n"
+    "  --pretty-print       Enables pretty printing of the JSON report.\n";
+
+// The size of the memory range the shadow scenarios operate on.
+const size_t kShadowBufferSize = 4096;
+
+// The body size of the block the checksum scenario operates on.
+const size_t kChecksumBodySize = 4096;
+
+// The size of the dummy objects pushed to the quarantine, and the size
+// at which the quarantine is capped. The cap keeps the quarantine in the
+// steady state of the heap manager's quarantine: every push beyond it is
+// paid for by a pop.
+const size_t kQuarantineObjectSize = 64;
+const size_t kQuarantineMaxSize = 1024 * kQuarantineObjectSize;
+
+// Returns the CPU time (user plus kernel) consumed so far by the current
+// process, in seconds. Returns a negative value on failure.
+double GetProcessCpuTime() {
+  FILETIME creation_time = {};
+  FILETIME exit_time = {};
+  FILETIME kernel_time = {};
+  FILETIME user_time = {};
+  if (!::GetProcessTimes(::GetCurrentProcess(), &creation_time, &exit_time,
+                         &kernel_time, &user_time)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "GetProcessTimes failed: " << ::common::LogWe(error) << ".";
+    return -1.0;
+  }
+
+  ULARGE_INTEGER kernel = {};
+  kernel.LowPart = kernel_time.dwLowDateTime;
+  kernel.HighPart = kernel_time.dwHighDateTime;
+  ULARGE_INTEGER user = {};
+  user.LowPart = user_time.dwLowDateTime;
+  user.HighPart = user_time.dwHighDateTime;
+
+  // FILETIMEs are expressed in 100ns intervals.
+  return (kernel.QuadPart + user.QuadPart) * 1e-7;
+}
+
+// @returns true if the CPU supports the SSE2 instruction set.
+bool CpuSupportsSse2() {
+  int cpu_info[4] = {};
+  __cpuid(cpu_info, 1);
+  return (cpu_info[3] & (1 << 26)) != 0;
+}
+
+// @returns true if the CPU supports the SSE4.2 instruction set.
+bool CpuSupportsSse42() {
+  int cpu_info[4] = {};
+  __cpuid(cpu_info, 1);
+  return (cpu_info[2] & (1 << 20)) != 0;
+}
+
+// A simple timer that measures the wall and CPU time elapsed between its
+// construction and the call to Stop.
+class ScenarioTimer {
+ public:
+  ScenarioTimer()
+      : start_wall_(base::TimeTicks::HighResNow()),
+        start_cpu_(GetProcessCpuTime()) {
+  }
+
+  // Stops the timer and records the measurements to @p sample.
+  void Stop(BenchmarkSample* sample) {
+    DCHECK(sample != NULL);
+    base::TimeDelta wall = base::TimeTicks::HighResNow() - start_wall_;
+    sample->wall_seconds = wall.InSecondsF();
+    sample->cpu_seconds = GetProcessCpuTime() - start_cpu_;
+  }
+
+ private:
+  base::TimeTicks start_wall_;
+  double start_cpu_;
+};
+
+// Repeatedly poisons and unpoisons a page-aligned memory range. Each
+// runner owns its own range, so concurrent runners touch disjoint shadow
+// memory.
+class ShadowPoisonRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit ShadowPoisonRunner(size_t num_operations)
+      : num_operations_(num_operations) {
+    buffer_ = reinterpret_cast<uint8*>(::VirtualAlloc(
+        NULL, kShadowBufferSize, MEM_COMMIT, PAGE_READWRITE));
+    CHECK(buffer_ != NULL);
+  }
+
+  ~ShadowPoisonRunner() {
+    CHECK_EQ(TRUE, ::VirtualFree(buffer_, 0, MEM_RELEASE));
+  }
+
+  virtual void Run() {
+    for (size_t i = 0; i < num_operations_; ++i) {
+      Shadow::Poison(buffer_, kShadowBufferSize, kUserRedzoneMarker);
+      Shadow::Unpoison(buffer_, kShadowBufferSize);
+    }
+  }
+
+ private:
+  size_t num_operations_;
+  uint8* buffer_;
+};
+
+// Repeatedly queries the accessibility of addresses in a half-poisoned
+// memory range, so both the poisoned and the unpoisoned paths of the
+// query get exercised.
+class ShadowQueryRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit ShadowQueryRunner(size_t num_operations)
+      : num_operations_(num_operations), sink_(false) {
+    buffer_ = reinterpret_cast<uint8*>(::VirtualAlloc(
+        NULL, kShadowBufferSize, MEM_COMMIT, PAGE_READWRITE));
+    CHECK(buffer_ != NULL);
+    Shadow::Poison(buffer_ + kShadowBufferSize / 2, kShadowBufferSize / 2,
+                   kUserRedzoneMarker);
+  }
+
+  ~ShadowQueryRunner() {
+    Shadow::Unpoison(buffer_, kShadowBufferSize);
+    CHECK_EQ(TRUE, ::VirtualFree(buffer_, 0, MEM_RELEASE));
+  }
+
+  virtual void Run() {
+    bool sink = false;
+    for (size_t i = 0; i < num_operations_; ++i) {
+      size_t offset = (i * kShadowRatio) % kShadowBufferSize;
+      sink ^= Shadow::IsAccessible(buffer_ + offset);
+    }
+    // Keep the compiler from eliminating the queries.
+    sink_ = sink;
+  }
+
+ private:
+  size_t num_operations_;
+  uint8* buffer_;
+  volatile bool sink_;
+};
+
+// Repeatedly captures the stack of the calling thread.
+class StackCaptureRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit StackCaptureRunner(size_t num_operations)
+      : num_operations_(num_operations) {
+  }
+
+  virtual void Run() {
+    common::StackCapture capture;
+    for (size_t i = 0; i < num_operations_; ++i)
+      capture.InitFromStack();
+  }
+
+ private:
+  size_t num_operations_;
+};
+
+// Repeatedly calculates the checksum of a block. Each runner owns its own
+// block.
+class BlockChecksumRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit BlockChecksumRunner(size_t num_operations)
+      : num_operations_(num_operations), sink_(0) {
+    BlockLayout layout = {};
+    CHECK(BlockPlanLayout(kShadowRatio, kShadowRatio, kChecksumBodySize, 0, 0,
+                          &layout));
+    alloc_ = ::VirtualAlloc(NULL, layout.block_size, MEM_COMMIT,
+                            PAGE_READWRITE);
+    CHECK(alloc_ != NULL);
+    BlockInitialize(layout, alloc_, false, &block_info_);
+    ::memset(block_info_.body, 0xAB, block_info_.body_size);
+  }
+
+  ~BlockChecksumRunner() {
+    CHECK_EQ(TRUE, ::VirtualFree(alloc_, 0, MEM_RELEASE));
+  }
+
+  virtual void Run() {
+    uint32 sink = 0;
+    for (size_t i = 0; i < num_operations_; ++i)
+      sink ^= BlockCalculateChecksum(block_info_);
+    // Keep the compiler from eliminating the checksums.
+    sink_ = sink;
+  }
+
+ private:
+  size_t num_operations_;
+  void* alloc_;
+  BlockInfo block_info_;
+  volatile uint32 sink_;
+};
+
+// A dummy object to be pushed to the quarantine, and the functors the
+// quarantine needs to size and shard it.
+struct BenchmarkObject {
+  size_t size;
+  uint32 hash;
+
+  BenchmarkObject() : size(0), hash(0) { }
+};
+
+struct BenchmarkObjectSizeFunctor {
+  size_t operator()(const BenchmarkObject& o) {
+    return o.size;
+  }
+};
+
+struct BenchmarkObjectHashFunctor {
+  uint32 operator()(const BenchmarkObject& o) {
+    return o.hash;
+  }
+};
+
+typedef quarantines::ShardedQuarantine<BenchmarkObject,
+                                       BenchmarkObjectSizeFunctor,
+                                       BenchmarkObjectHashFunctor,
+                                       kQuarantineDefaultShardingFactor>
+    BenchmarkQuarantine;
+
+// Repeatedly pushes objects to a capped quarantine shared by all runners,
+// popping as needed to restore the size invariant. This matches how the
+// heap manager uses its quarantine: one shared instance, contended by
+// every thread that frees.
+class QuarantineRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit QuarantineRunner(size_t num_operations)
+      : num_operations_(num_operations) {
+    quarantine_.set_max_object_size(BenchmarkQuarantine::kUnboundedSize);
+    quarantine_.set_max_quarantine_size(kQuarantineMaxSize);
+  }
+
+  virtual void Run() {
+    BenchmarkObject object;
+    object.size = kQuarantineObjectSize;
+    // Seed the hash per runner so that concurrent runners spread across
+    // the shards, as blocks do in the heap manager.
+    object.hash = reinterpret_cast<uint32>(this);
+    BenchmarkObject popped;
+    for (size_t i = 0; i < num_operations_; ++i) {
+      quarantine_.Push(object);
+      ++object.hash;
+      while (quarantine_.Pop(&popped)) { }
+    }
+  }
+
+ private:
+  // The quarantine instance shared by all runners.
+  static BenchmarkQuarantine quarantine_;
+
+  size_t num_operations_;
+};
+
+BenchmarkQuarantine QuarantineRunner::quarantine_;
+
+}  // namespace
+
+AsanBenchmarkApp::AsanBenchmarkApp()
+    : common::AppImplBase("Asan Benchmark"),
+      num_iterations_(1),
+      num_operations_(100000),
+      num_threads_(4),
+      pretty_print_(false) {
+}
+
+void AsanBenchmarkApp::PrintUsage(const base::FilePath& program,
+                                  const base::StringPiece& message) {
+  if (!message.empty()) {
+    ::fwrite(message.data(), 1, message.length(), out());
+    ::fprintf(out(), "\n\n");
+  }
+
+  ::fprintf(out(), kUsageFormatStr, program.BaseName().value().c_str());
+}
+
+bool AsanBenchmarkApp::ParseCommandLine(const CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help")) {
+    PrintUsage(cmd_line->GetProgram(), "");
+    return false;
+  }
+
+  if (cmd_line->HasSwitch("iterations")) {
+    if (!base::StringToInt(
+            cmd_line->GetSwitchValueNative("iterations"), &num_iterations_) ||
+        num_iterations_ <= 0) {
+      PrintUsage(cmd_line->GetProgram(), "Must specify '--iterations' >= 1!");
+      return false;
+    }
+  }
+
+  if (cmd_line->HasSwitch("operations")) {
+    if (!base::StringToInt(
+            cmd_line->GetSwitchValueNative("operations"), &num_operations_) ||
+        num_operations_ <= 0) {
+      PrintUsage(cmd_line->GetProgram(), "Must specify '--operations' >= 1!");
+      return false;
+    }
+  }
+
+  if (cmd_line->HasSwitch("threads")) {
+    if (!base::StringToInt(
+            cmd_line->GetSwitchValueNative("threads"), &num_threads_) ||
+        num_threads_ <= 0) {
+      PrintUsage(cmd_line->GetProgram(), "Must specify '--threads' >= 1!");
+      return false;
+    }
+  }
+
+  json_path_ = cmd_line->GetSwitchValuePath("json");
+  pretty_print_ = cmd_line->HasSwitch("pretty-print");
+
+  return true;
+}
+
+int AsanBenchmarkApp::Run() {
+  Shadow::SetUp();
+  common::StackCapture::Init();
+
+  for (int i = 0; i < num_iterations_; ++i) {
+    LOG(INFO) << "Starting iteration " << (i + 1) << " of "
+              << num_iterations_ << ".";
+    RunOneIteration();
+  }
+
+  Shadow::TearDown();
+
+  if (json_path_.empty()) {
+    if (!WriteJsonReport(out()))
+      return 1;
+  } else {
+    LOG(INFO) << "Writing JSON report to '" << json_path_.value() << "'.";
+    base::ScopedFILE json_file(base::OpenFile(json_path_, "wb"));
+    if (json_file.get() == NULL) {
+      LOG(ERROR) << "Failed to open '" << json_path_.value()
+                 << "' for writing.";
+      return 1;
+    }
+    if (!WriteJsonReport(json_file.get()))
+      return 1;
+  }
+
+  return 0;
+}
+
+void AsanBenchmarkApp::RunOneIteration() {
+  RunBenchmark<ShadowPoisonRunner>("shadow-poison");
+  RunBenchmark<ShadowQueryRunner>("shadow-query");
+  RunBenchmark<StackCaptureRunner>("stack-capture");
+  RunBenchmark<BlockChecksumRunner>("block-checksum");
+  RunBenchmark<QuarantineRunner>("quarantine");
+}
+
+template <typename RunnerType>
+void AsanBenchmarkApp::RunBenchmark(const base::StringPiece& name) {
+  // The single-threaded variant.
+  {
+    RunnerType runner(num_operations_);
+    std::vector<base::DelegateSimpleThread::Delegate*> runners(1, &runner);
+    RunScenario(name, num_operations_, runners);
+  }
+
+  if (num_threads_ < 2)
+    return;
+
+  // The multithreaded variant: the same total number of operations, split
+  // evenly across the worker threads.
+  {
+    size_t ops_per_thread = num_operations_ / num_threads_;
+    ScopedVector<RunnerType> owned_runners;
+    std::vector<base::DelegateSimpleThread::Delegate*> runners;
+    for (int i = 0; i < num_threads_; ++i) {
+      owned_runners.push_back(new RunnerType(ops_per_thread));
+      runners.push_back(owned_runners.back());
+    }
+    RunScenario(name.as_string() + "-mt", ops_per_thread * num_threads_,
+                runners);
+  }
+}
+
+void AsanBenchmarkApp::RunScenario(
+    const base::StringPiece& name,
+    uint64 num_operations,
+    const std::vector<base::DelegateSimpleThread::Delegate*>& runners) {
+  DCHECK(!runners.empty());
+
+  ScenarioTimer timer;
+  if (runners.size() == 1) {
+    runners[0]->Run();
+  } else {
+    ScopedVector<base::DelegateSimpleThread> threads;
+    for (size_t i = 0; i < runners.size(); ++i) {
+      threads.push_back(
+          new base::DelegateSimpleThread(runners[i], "asan-benchmark"));
+      threads.back()->Start();
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Join();
+  }
+
+  BenchmarkSample sample;
+  timer.Stop(&sample);
+  sample.num_operations = num_operations;
+  samples_[name.as_string()].push_back(sample);
+}
+
+bool AsanBenchmarkApp::WriteJsonReport(FILE* file) {
+  DCHECK(file != NULL);
+
+  core::JSONFileWriter json(file, pretty_print_);
+  if (!json.OpenDict() ||
+      !json.OutputKey("iterations") ||
+      !json.OutputInteger(num_iterations_) ||
+      !json.OutputKey("operations") ||
+      !json.OutputInteger(num_operations_) ||
+      !json.OutputKey("threads") ||
+      !json.OutputInteger(num_threads_) ||
+      !json.OutputKey("cpu_features") ||
+      !json.OpenDict() ||
+      !json.OutputKey("sse2") ||
+      !json.OutputBoolean(CpuSupportsSse2()) ||
+      !json.OutputKey("sse4_2") ||
+      !json.OutputBoolean(CpuSupportsSse42()) ||
+      !json.CloseDict() ||
+      !json.OutputKey("scenarios") ||
+      !json.OpenDict()) {
+    return false;
+  }
+
+  SampleMap::const_iterator scenario_it = samples_.begin();
+  for (; scenario_it != samples_.end(); ++scenario_it) {
+    if (!json.OutputKey(scenario_it->first) || !json.OpenList())
+      return false;
+
+    const std::vector<BenchmarkSample>& samples = scenario_it->second;
+    for (size_t i = 0; i < samples.size(); ++i) {
+      if (!json.OpenDict() ||
+          !json.OutputKey("wall_seconds") ||
+          !json.OutputDouble(samples[i].wall_seconds) ||
+          !json.OutputKey("cpu_seconds") ||
+          !json.OutputDouble(samples[i].cpu_seconds) ||
+          !json.OutputKey("num_operations") ||
+          !json.OutputDouble(
+              static_cast<double>(samples[i].num_operations)) ||
+          !json.CloseDict()) {
+        return false;
+      }
+    }
+
+    if (!json.CloseList())
+      return false;
+  }
+
+  if (!json.CloseDict() || !json.CloseDict() || !json.Flush())
+    return false;
+  ::fprintf(file, "\n");
+
+  return true;
+}
+
+}  // namespace benchmarks
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,126 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A command line application that benchmarks the hot primitives of the
+// SyzyAsan runtime (shadow memory updates and queries, quarantine pushes
+// and pops, stack captures and block checksums) in tight single-threaded
+// and multithreaded loops, and reports per-scenario timing statistics,
+// optionally as JSON for trend tracking.
+
+#ifndef SYZYGY_AGENT_ASAN_BENCHMARKS_ASAN_BENCHMARK_APP_H_
+#define SYZYGY_AGENT_ASAN_BENCHMARKS_ASAN_BENCHMARK_APP_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/common/application.h"
+
+namespace agent {
+namespace asan {
+namespace benchmarks {
+
+// Measurements taken for a single run of a single benchmark scenario.
+struct BenchmarkSample {
+  BenchmarkSample() : wall_seconds(0.0), cpu_seconds(0.0), num_operations(0) {
+  }
+
+  // The wall clock time elapsed during the scenario, in seconds.
+  double wall_seconds;
+  // The CPU time (user plus kernel) consumed during the scenario, in
+  // seconds.
+  double cpu_seconds;
+  // The total number of operations performed across all threads of the
+  // scenario.
+  uint64 num_operations;
+};
+
+// This class implements the asan_benchmark command-line utility.
+//
+// See the description given in AsanBenchmarkApp:::PrintUsage() for
+// information about running this utility.
+class AsanBenchmarkApp : public common::AppImplBase {
+ public:
+  // A map from scenario name to the samples gathered for that scenario, one
+  // per iteration.
+  typedef std::map<std::string, std::vector<BenchmarkSample>> SampleMap;
+
+  AsanBenchmarkApp();
+
+  // @name Implementation of the AppImplBase interface.
+  // @{
+  bool ParseCommandLine(const CommandLine* command_line);
+
+  int Run();
+  // @}
+
+ protected:
+  // Print the app's usage information.
+  void PrintUsage(const base::FilePath& program,
+                  const base::StringPiece& message);
+
+  // Runs a single iteration of every benchmark scenario, appending one
+  // sample per scenario to samples_.
+  void RunOneIteration();
+
+  // Runs the single-threaded and multithreaded variants of a single
+  // scenario. RunnerType must be constructible from the number of
+  // operations the runner is to perform.
+  // @param name the name under which the samples should be recorded. The
+  //     multithreaded variant is recorded under this name suffixed with
+  //     '-mt'.
+  template <typename RunnerType>
+  void RunBenchmark(const base::StringPiece& name);
+
+  // Runs @p runners to completion, on the calling thread if there is a
+  // single runner and on one worker thread each otherwise, and appends the
+  // resulting sample to samples_ under @p name.
+  // @param name the name under which the sample should be recorded.
+  // @param num_operations the total number of operations performed by the
+  //     runners.
+  // @param runners the benchmark bodies to run.
+  void RunScenario(
+      const base::StringPiece& name,
+      uint64 num_operations,
+      const std::vector<base::DelegateSimpleThread::Delegate*>& runners);
+
+  // Writes the gathered samples as JSON to @p file.
+  // @param file the file to write to.
+  // @returns true on success, false otherwise.
+  bool WriteJsonReport(FILE* file);
+
+  // @name Command-line options.
+  // @{
+  base::FilePath json_path_;
+  int num_iterations_;
+  int num_operations_;
+  int num_threads_;
+  bool pretty_print_;
+  // @}
+
+  // The samples gathered so far, keyed by scenario name.
+  SampleMap samples_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AsanBenchmarkApp);
+};
+
+}  // namespace benchmarks
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_BENCHMARKS_ASAN_BENCHMARK_APP_H_
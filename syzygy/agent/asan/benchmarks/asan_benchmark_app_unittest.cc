@@ -0,0 +1,86 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/benchmarks/asan_benchmark_app.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+namespace benchmarks {
+
+namespace {
+
+class TestAsanBenchmarkApp : public AsanBenchmarkApp {
+ public:
+  using AsanBenchmarkApp::json_path_;
+  using AsanBenchmarkApp::num_iterations_;
+  using AsanBenchmarkApp::num_operations_;
+  using AsanBenchmarkApp::num_threads_;
+  using AsanBenchmarkApp::pretty_print_;
+};
+
+class AsanBenchmarkAppTest : public testing::Test {
+ public:
+  AsanBenchmarkAppTest()
+      : cmd_line_(base::FilePath(L"asan_benchmark.exe")) {
+  }
+
+  CommandLine cmd_line_;
+  TestAsanBenchmarkApp app_;
+};
+
+}  // namespace
+
+TEST_F(AsanBenchmarkAppTest, ParseCommandLineMinimal) {
+  EXPECT_TRUE(app_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(app_.json_path_.empty());
+  EXPECT_EQ(1, app_.num_iterations_);
+  EXPECT_EQ(100000, app_.num_operations_);
+  EXPECT_EQ(4, app_.num_threads_);
+  EXPECT_FALSE(app_.pretty_print_);
+}
+
+TEST_F(AsanBenchmarkAppTest, ParseCommandLineMaximal) {
+  cmd_line_.AppendSwitchASCII("iterations", "10");
+  cmd_line_.AppendSwitchASCII("operations", "500");
+  cmd_line_.AppendSwitchASCII("threads", "2");
+  cmd_line_.AppendSwitchPath("json", base::FilePath(L"report.json"));
+  cmd_line_.AppendSwitch("pretty-print");
+  EXPECT_TRUE(app_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(L"report.json", app_.json_path_.value());
+  EXPECT_EQ(10, app_.num_iterations_);
+  EXPECT_EQ(500, app_.num_operations_);
+  EXPECT_EQ(2, app_.num_threads_);
+  EXPECT_TRUE(app_.pretty_print_);
+}
+
+TEST_F(AsanBenchmarkAppTest, ParseCommandLineFailsWithBadIterations) {
+  cmd_line_.AppendSwitchASCII("iterations", "0");
+  EXPECT_FALSE(app_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(AsanBenchmarkAppTest, ParseCommandLineFailsWithBadOperations) {
+  cmd_line_.AppendSwitchASCII("operations", "foo");
+  EXPECT_FALSE(app_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(AsanBenchmarkAppTest, ParseCommandLineFailsWithBadThreads) {
+  cmd_line_.AppendSwitchASCII("threads", "-1");
+  EXPECT_FALSE(app_.ParseCommandLine(&cmd_line_));
+}
+
+}  // namespace benchmarks
+}  // namespace asan
+}  // namespace agent
@@ -112,17 +112,14 @@ void GetAddressInformation(BlockHeader* header,
       block_info.body,
       block_info.trailer_padding);
 
-  std::string shadow_memory;
-  Shadow::AppendShadowArrayText(bad_access_info->location, &shadow_memory);
-  size_t shadow_mem_bytes = base::snprintf(
-      bad_access_info->shadow_memory,
-      arraysize(bad_access_info->shadow_memory) - 1,
-      "%s",
-      shadow_memory.c_str());
+  // Write the shadow memory description directly into the fixed buffer;
+  // this runs at error-reporting time and must not allocate.
+  Shadow::WriteShadowArrayText(bad_access_info->location,
+                               bad_access_info->shadow_memory,
+                               arraysize(bad_access_info->shadow_memory));
 
   // Ensure that we had enough space to store the full shadow information.
   DCHECK_LE(shadow_info_bytes, arraysize(bad_access_info->shadow_info) - 1);
-  DCHECK_LE(shadow_mem_bytes, arraysize(bad_access_info->shadow_memory) - 1);
 }
 
 }  // namespace
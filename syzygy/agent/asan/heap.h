@@ -73,6 +73,12 @@ class HeapInterface {
     // the allocation, not the actual initially requested amount. Can only be
     // set in conjunction with kHeapSupportsGetAllocationSize.
     kHeapGetAllocationSizeIsUpperBound = 1 << 3,
+
+    // If this bit is set then every block of this heap spans dedicated pages,
+    // so each block state transition implies page protection changes. The
+    // heap manager may apply the page protections of freshly quarantined
+    // blocks lazily, in batches, off the critical path of a free.
+    kHeapSupportsDeferredProtection = 1 << 4,
   };
 
   // The return value of GetAllocationSize if the heap does not support it.
@@ -17,10 +17,50 @@
 #include "syzygy/agent/asan/asan_runtime.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
 #include "syzygy/agent/asan/shadow.h"
+#include "syzygy/common/align.h"
 
 namespace agent {
 namespace asan {
 
+namespace {
+
+// The number of block descriptors a sweep requests from the shadow walker at
+// a time. Batching lets the walker prefetch the shadow memory ahead of the
+// scan.
+const size_t kSweepBatchSize = 64;
+
+// Returns the address of the first non-nested block start marker in
+// @p cursor (inclusive) to @p upper_bound (exclusive), or @p upper_bound if
+// there is none. Nested block start markers are skipped as they always lie
+// inside an enclosing block; a non-nested block start is therefore a safe
+// position to split a range at without splitting a block.
+// @param cursor The kShadowRatio aligned address to search from.
+// @param upper_bound The upper bound of the search.
+// @returns the address of the first non-nested block start marker, or
+//     @p upper_bound.
+const uint8* FindNextOuterBlockStart(const uint8* cursor,
+                                     const uint8* upper_bound) {
+  for (; cursor < upper_bound; cursor += kShadowRatio) {
+    uint8 marker = Shadow::GetShadowMarkerForAddress(cursor);
+
+    // Green (fully addressable) markers carry no block structure; skip over
+    // entire runs of them at once.
+    if (marker == kHeapAddressableMarker) {
+      cursor = Shadow::FindFirstNonGreenAddress(cursor, upper_bound) -
+          kShadowRatio;
+      continue;
+    }
+
+    if (ShadowMarkerHelper::IsBlockStart(marker) &&
+        !ShadowMarkerHelper::IsNestedBlockStart(marker)) {
+      return cursor;
+    }
+  }
+  return upper_bound;
+}
+
+}  // namespace
+
 bool HeapChecker::IsHeapCorrupt(CorruptRangesVector* corrupt_ranges) {
   DCHECK_NE(reinterpret_cast<CorruptRangesVector*>(NULL), corrupt_ranges);
 
@@ -28,68 +68,201 @@ bool HeapChecker::IsHeapCorrupt(CorruptRangesVector* corrupt_ranges) {
 
   // Grab the page protection lock. This prevents multiple heap checkers from
   // running simultaneously, and also prevents page protections from being
-  // modified from underneath us.
+  // modified from underneath us. The sweep worker threads rely on this
+  // exclusion.
   ::common::AutoRecursiveLock scoped_lock(block_protect_lock);
 
+  const uint8* lower_bound =
+      reinterpret_cast<const uint8*>(Shadow::kAddressLowerBound);
+  const uint8* upper_bound = lower_bound +
+      (Shadow::kAddressUpperBound - Shadow::kAddressLowerBound - 1);
+
   // Walk over all of the addressable memory to find the corrupt blocks.
   // TODO(sebmarchand): Iterates over the heap slabs once we have switched to
   //     a new memory allocator.
-  GetCorruptRangesInSlab(
-      reinterpret_cast<const uint8*>(Shadow::kAddressLowerBound),
-      Shadow::kAddressUpperBound - Shadow::kAddressLowerBound - 1,
-      corrupt_ranges);
+  if (max_bytes_per_check_ == 0) {
+    GetCorruptRanges(lower_bound, upper_bound, corrupt_ranges);
+    return !corrupt_ranges->empty();
+  }
+
+  // In bounded mode only a window of the address space is checked, resuming
+  // where the previous check stopped and wrapping around at the end.
+  if (resume_cursor_ == NULL || resume_cursor_ <= lower_bound ||
+      resume_cursor_ >= upper_bound) {
+    resume_cursor_ = lower_bound;
+  }
+  const uint8* window_lower = resume_cursor_;
+  const uint8* window_upper = upper_bound;
+  size_t remaining = upper_bound - window_lower;
+  if (max_bytes_per_check_ < remaining) {
+    // Extend the window to the next non-nested block start so that no block
+    // straddles its end.
+    window_upper = FindNextOuterBlockStart(
+        window_lower + ::common::AlignUp(max_bytes_per_check_, kShadowRatio),
+        upper_bound);
+  }
+  GetCorruptRanges(window_lower, window_upper, corrupt_ranges);
+  resume_cursor_ = window_upper < upper_bound ? window_upper : lower_bound;
 
   return !corrupt_ranges->empty();
 }
 
-void HeapChecker::GetCorruptRangesInSlab(const uint8* lower_bound,
-                                         size_t length,
-                                         CorruptRangesVector* corrupt_ranges) {
+void HeapChecker::GetCorruptRanges(const uint8* lower_bound,
+                                   const uint8* upper_bound,
+                                   CorruptRangesVector* corrupt_ranges) {
   DCHECK_NE(reinterpret_cast<const uint8*>(NULL), lower_bound);
-  DCHECK_NE(0U, length);
   DCHECK_NE(reinterpret_cast<CorruptRangesVector*>(NULL), corrupt_ranges);
+  block_protect_lock.AssertAcquired();
 
-  ShadowWalker shadow_walker(false, lower_bound, lower_bound + length);
+  if (lower_bound >= upper_bound)
+    return;
 
-  AsanCorruptBlockRange* current_corrupt_range = NULL;
+  // Carve the range into one partition per thread. Nominal partition
+  // boundaries are moved forward to the next non-nested block start so that
+  // no block straddles two partitions.
+  size_t stride = ::common::AlignUp(
+      (upper_bound - lower_bound) / max_num_threads_, kShadowRatio);
+  std::vector<SweepPartition> partitions;
+  partitions.reserve(max_num_threads_);
+  const uint8* cursor = lower_bound;
+  for (size_t i = 0; i < max_num_threads_ && cursor < upper_bound; ++i) {
+    SweepPartition partition;
+    partition.lower_bound = cursor;
+    partition.upper_bound = upper_bound;
+    partition.any_blocks = false;
+    partition.first_block_corrupt = false;
+    partition.last_block_corrupt = false;
+    if (i + 1 < max_num_threads_ && stride <
+            static_cast<size_t>(upper_bound - cursor)) {
+      partition.upper_bound = FindNextOuterBlockStart(cursor + stride,
+                                                      upper_bound);
+    }
+    cursor = partition.upper_bound;
+    partitions.push_back(partition);
+  }
 
-  // Iterates over the blocks.
-  BlockInfo block_info = {};
-  while (shadow_walker.Next(&block_info)) {
-    // Remove the protections on this block so its checksum can be safely
-    // validated. We leave the protections permanently removed so that the
-    // minidump generation has free access to block contents.
-    BlockProtectNone(block_info);
-
-    bool current_block_is_corrupt = IsBlockCorrupt(block_info.block, NULL);
-    // If the current block is corrupt and |current_corrupt_range| is NULL
-    // then this means that the current block is at the beginning of a corrupt
-    // range.
-    if (current_block_is_corrupt && current_corrupt_range == NULL) {
-      AsanCorruptBlockRange corrupt_range;
-      corrupt_range.address = block_info.block;
-      corrupt_range.length = 0;
-      corrupt_range.block_count = 0;
-      corrupt_range.block_info = NULL;
-      corrupt_range.block_info_count = 0;
-      corrupt_ranges->push_back(corrupt_range);
-      current_corrupt_range = &corrupt_ranges->back();
-    } else if (!current_block_is_corrupt && current_corrupt_range != NULL) {
-      current_corrupt_range = NULL;
+  if (partitions.size() == 1) {
+    SweepPartitionBlocks(&partitions[0]);
+  } else {
+    // Sweep the other partitions on worker threads while this thread sweeps
+    // the first one. A partition whose thread can't be created is simply
+    // swept inline.
+    std::vector<HANDLE> threads;
+    threads.reserve(partitions.size() - 1);
+    for (size_t i = 1; i < partitions.size(); ++i) {
+      HANDLE thread = ::CreateThread(NULL, 0, &SweepPartitionThreadProc,
+                                     &partitions[i], 0, NULL);
+      if (thread == NULL) {
+        SweepPartitionBlocks(&partitions[i]);
+      } else {
+        threads.push_back(thread);
+      }
     }
+    SweepPartitionBlocks(&partitions[0]);
+    for (size_t i = 0; i < threads.size(); ++i) {
+      ::WaitForSingleObject(threads[i], INFINITE);
+      ::CloseHandle(threads[i]);
+    }
+  }
 
-    if (current_block_is_corrupt) {
-      // If the current block is corrupt then we need to update the size of the
-      // current range.
-      DCHECK_NE(reinterpret_cast<AsanCorruptBlockRange*>(NULL),
-                current_corrupt_range);
-      current_corrupt_range->block_count++;
-      const uint8* current_block_end = block_info.block + block_info.block_size;
-      current_corrupt_range->length = current_block_end -
-          reinterpret_cast<const uint8*>(current_corrupt_range->address);
+  // Stitch the partition results together in address order. A run of corrupt
+  // blocks crossing a partition boundary has been reported as two ranges;
+  // merge them so that the output matches that of a single-threaded sweep.
+  bool previous_block_corrupt = false;
+  for (size_t i = 0; i < partitions.size(); ++i) {
+    SweepPartition* partition = &partitions[i];
+    CorruptRangesVector::const_iterator it =
+        partition->corrupt_ranges.begin();
+    if (previous_block_corrupt && partition->first_block_corrupt) {
+      DCHECK(!corrupt_ranges->empty());
+      DCHECK(it != partition->corrupt_ranges.end());
+      AsanCorruptBlockRange* previous_range = &corrupt_ranges->back();
+      const uint8* range_end =
+          reinterpret_cast<const uint8*>(it->address) + it->length;
+      previous_range->length = range_end -
+          reinterpret_cast<const uint8*>(previous_range->address);
+      previous_range->block_count += it->block_count;
+      ++it;
     }
+    for (; it != partition->corrupt_ranges.end(); ++it)
+      corrupt_ranges->push_back(*it);
+
+    // A partition without any blocks doesn't break a run of corrupt blocks.
+    if (partition->any_blocks)
+      previous_block_corrupt = partition->last_block_corrupt;
   }
 }
 
+void HeapChecker::SweepPartitionBlocks(SweepPartition* partition) {
+  DCHECK_NE(reinterpret_cast<SweepPartition*>(NULL), partition);
+  DCHECK_NE(reinterpret_cast<const uint8*>(NULL), partition->lower_bound);
+  DCHECK_LT(partition->lower_bound, partition->upper_bound);
+
+  ShadowWalker shadow_walker(false, partition->lower_bound,
+                             partition->upper_bound);
+
+  CorruptRangesVector* corrupt_ranges = &partition->corrupt_ranges;
+  AsanCorruptBlockRange* current_corrupt_range = NULL;
+
+  // Iterates over the blocks, in batches so that the walker can prefetch the
+  // shadow memory ahead of the scan.
+  BlockInfo block_infos[kSweepBatchSize];
+  size_t batch_size = 0;
+  while ((batch_size = shadow_walker.NextBatch(
+              block_infos, arraysize(block_infos))) != 0) {
+    for (size_t i = 0; i < batch_size; ++i) {
+      const BlockInfo& block_info = block_infos[i];
+
+      // Remove the protections on this block so its checksum can be safely
+      // validated. We leave the protections permanently removed so that the
+      // minidump generation has free access to block contents. The
+      // coordinating thread holds block_protect_lock, so the unlocked variant
+      // is safe here.
+      BlockProtectNoneUnlocked(block_info);
+
+      bool current_block_is_corrupt = IsBlockCorrupt(block_info.block, NULL);
+      if (!partition->any_blocks) {
+        partition->any_blocks = true;
+        partition->first_block_corrupt = current_block_is_corrupt;
+      }
+      partition->last_block_corrupt = current_block_is_corrupt;
+
+      // If the current block is corrupt and |current_corrupt_range| is NULL
+      // then this means that the current block is at the beginning of a
+      // corrupt range.
+      if (current_block_is_corrupt && current_corrupt_range == NULL) {
+        AsanCorruptBlockRange corrupt_range;
+        corrupt_range.address = block_info.block;
+        corrupt_range.length = 0;
+        corrupt_range.block_count = 0;
+        corrupt_range.block_info = NULL;
+        corrupt_range.block_info_count = 0;
+        corrupt_ranges->push_back(corrupt_range);
+        current_corrupt_range = &corrupt_ranges->back();
+      } else if (!current_block_is_corrupt && current_corrupt_range != NULL) {
+        current_corrupt_range = NULL;
+      }
+
+      if (current_block_is_corrupt) {
+        // If the current block is corrupt then we need to update the size of
+        // the current range.
+        DCHECK_NE(reinterpret_cast<AsanCorruptBlockRange*>(NULL),
+                  current_corrupt_range);
+        current_corrupt_range->block_count++;
+        const uint8* current_block_end =
+            block_info.block + block_info.block_size;
+        current_corrupt_range->length = current_block_end -
+            reinterpret_cast<const uint8*>(current_corrupt_range->address);
+      }
+    }
+  }
+}
+
+DWORD WINAPI HeapChecker::SweepPartitionThreadProc(void* partition) {
+  DCHECK_NE(reinterpret_cast<void*>(NULL), partition);
+  SweepPartitionBlocks(reinterpret_cast<SweepPartition*>(partition));
+  return 0;
+}
+
 }  // namespace asan
 }  // namespace agent
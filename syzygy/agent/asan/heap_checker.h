@@ -17,6 +17,8 @@
 #ifndef SYZYGY_AGENT_ASAN_HEAP_CHECKER_H_
 #define SYZYGY_AGENT_ASAN_HEAP_CHECKER_H_
 
+#include <windows.h>
+
 #include <vector>
 
 #include "base/logging.h"
@@ -35,7 +37,9 @@ class HeapChecker {
   typedef std::vector<AsanCorruptBlockRange> CorruptRangesVector;
 
   // Constructor.
-  HeapChecker() { }
+  HeapChecker()
+      : max_num_threads_(1), max_bytes_per_check_(0), resume_cursor_(NULL) {
+  }
 
   // Checks if the heap is corrupt and returns the information about the
   // corrupt ranges. This permanently removes all page protections as it
@@ -45,19 +49,82 @@ class HeapChecker {
   // @returns true if the heap is corrupt, false otherwise.
   bool IsHeapCorrupt(CorruptRangesVector* corrupt_ranges);
 
+  // @name Accessors and mutators.
+  // @{
+  // The maximum number of threads used to sweep the address space. When
+  // greater than one the range under check is partitioned at block
+  // boundaries and the partitions are swept concurrently. Defaults to 1.
+  size_t max_num_threads() const { return max_num_threads_; }
+  void set_max_num_threads(size_t max_num_threads) {
+    DCHECK_LT(0u, max_num_threads);
+    max_num_threads_ = max_num_threads;
+  }
+
+  // The maximum number of bytes of address space swept by a single call to
+  // IsHeapCorrupt. When non-zero each call checks one window of the address
+  // space and the next call resumes where the previous one stopped, wrapping
+  // around at the end; corruption outside of the window being checked goes
+  // undetected until the sweep comes back around to it. When zero the whole
+  // address space is checked in a single call. Defaults to 0.
+  size_t max_bytes_per_check() const { return max_bytes_per_check_; }
+  void set_max_bytes_per_check(size_t max_bytes_per_check) {
+    max_bytes_per_check_ = max_bytes_per_check;
+  }
+  // @}
+
   // TODO(sebmarchand): Add a testing seam that controls the range of memory
   //     that is walked by HeapChecker to keep unittest times to something
   //     reasonable.
 
  private:
-  // Get the information about the corrupt ranges in a heap slab.
-  // @param lower_bound The lower bound for this slab.
-  // @param length The length of this slab.
-  // @param corrupt_ranges Will receive the information about the corrupt ranges
-  //     in this slab.
-  void GetCorruptRangesInSlab(const uint8* lower_bound,
-                              size_t length,
-                              CorruptRangesVector* corrupt_ranges);
+  // A partition of the address space to be swept, and the result of sweeping
+  // it. The bounds are chosen such that no block straddles two partitions.
+  struct SweepPartition {
+    // The bounds of the partition.
+    const uint8* lower_bound;
+    const uint8* upper_bound;
+    // The corrupt ranges that were found in this partition.
+    CorruptRangesVector corrupt_ranges;
+    // True if at least one block was encountered in this partition.
+    bool any_blocks;
+    // The corruption state of the first and last blocks encountered. These
+    // are used to merge corrupt ranges that cross a partition boundary.
+    bool first_block_corrupt;
+    bool last_block_corrupt;
+  };
+
+  // Gets the information about the corrupt ranges in a range of memory,
+  // sweeping it on up to max_num_threads_ threads. Must be called under
+  // block_protect_lock.
+  // @param lower_bound The lower bound of the range.
+  // @param upper_bound The upper bound of the range.
+  // @param corrupt_ranges Will receive the information about the corrupt
+  //     ranges in this range.
+  void GetCorruptRanges(const uint8* lower_bound,
+                        const uint8* upper_bound,
+                        CorruptRangesVector* corrupt_ranges);
+
+  // Walks the blocks of a partition and collects the corrupt ranges in it.
+  // The coordinating thread must hold block_protect_lock; this makes it safe
+  // for several partitions to be swept concurrently.
+  // @param partition The partition to sweep.
+  static void SweepPartitionBlocks(SweepPartition* partition);
+
+  // The entry point of a sweep worker thread.
+  // @param partition The SweepPartition to sweep.
+  // @returns 0.
+  static DWORD WINAPI SweepPartitionThreadProc(void* partition);
+
+  // The maximum number of threads used to sweep the address space.
+  size_t max_num_threads_;
+
+  // The maximum number of bytes of address space checked per call to
+  // IsHeapCorrupt, or 0 for no limit.
+  size_t max_bytes_per_check_;
+
+  // The address at which the next bounded check resumes. This is NULL before
+  // the first bounded check.
+  const uint8* resume_cursor_;
 };
 
 }  // namespace asan
@@ -202,5 +202,91 @@ TEST_F(HeapCheckerTest, IsHeapCorrupt) {
   ::free(global_alloc);
 }
 
+TEST_F(HeapCheckerTest, IsHeapCorruptConcurrent) {
+  const size_t kAllocSize = 100;
+
+  BlockLayout block_layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, kAllocSize, 0, 0,
+                              &block_layout));
+
+  const size_t kNumberOfBlocks = 4;
+  size_t total_alloc_size = block_layout.block_size * kNumberOfBlocks;
+  uint8* global_alloc = reinterpret_cast<uint8*>(::malloc(total_alloc_size));
+
+  uint8* blocks[kNumberOfBlocks];
+  BlockHeader* block_headers[kNumberOfBlocks];
+
+  for (size_t i = 0; i < kNumberOfBlocks; ++i) {
+    blocks[i] = global_alloc + i * block_layout.block_size;
+    BlockInfo block_info = {};
+    BlockInitialize(block_layout, blocks[i], false, &block_info);
+    Shadow::PoisonAllocatedBlock(block_info);
+    BlockSetChecksum(block_info);
+    block_headers[i] = block_info.header;
+  }
+
+  // Corrupt the header of the first two blocks and of the last one, then
+  // sweep the address space on several threads. The results should be
+  // identical to those of a single-threaded sweep.
+  block_headers[0]->magic++;
+  block_headers[1]->magic++;
+  block_headers[kNumberOfBlocks - 1]->magic++;
+
+  HeapChecker heap_checker;
+  heap_checker.set_max_num_threads(4);
+  HeapChecker::CorruptRangesVector corrupt_ranges;
+  EXPECT_TRUE(heap_checker.IsHeapCorrupt(&corrupt_ranges));
+
+  ASSERT_EQ(2, corrupt_ranges.size());
+  EXPECT_EQ(2, corrupt_ranges[0].block_count);
+  EXPECT_EQ(blocks[0], corrupt_ranges[0].address);
+  EXPECT_EQ(1, corrupt_ranges[1].block_count);
+  EXPECT_EQ(blocks[kNumberOfBlocks - 1], corrupt_ranges[1].address);
+
+  // Restore the headers of the blocks.
+  block_headers[0]->magic--;
+  block_headers[1]->magic--;
+  block_headers[kNumberOfBlocks - 1]->magic--;
+
+  Shadow::Unpoison(global_alloc, total_alloc_size);
+  ::free(global_alloc);
+}
+
+TEST_F(HeapCheckerTest, IsHeapCorruptBounded) {
+  const size_t kAllocSize = 100;
+  FakeAsanBlock fake_block(kShadowRatioLog, runtime_->stack_cache());
+
+  fake_block.InitializeBlock(kAllocSize);
+  base::RandBytes(fake_block.block_info.body, kAllocSize);
+
+  // Corrupt the header of the block.
+  fake_block.block_info.header->magic = ~fake_block.block_info.header->magic;
+
+  // Check the address space in bounded increments. A full cycle of
+  // invocations covers the whole address space, so the corrupt block must be
+  // reported within one cycle.
+  const size_t kMaxBytesPerCheck = 64 * 1024 * 1024;
+  HeapChecker heap_checker;
+  heap_checker.set_max_bytes_per_check(kMaxBytesPerCheck);
+
+  size_t address_space_size =
+      Shadow::kAddressUpperBound - Shadow::kAddressLowerBound;
+  size_t max_num_checks = address_space_size / kMaxBytesPerCheck + 2;
+  bool found_corruption = false;
+  HeapChecker::CorruptRangesVector corrupt_ranges;
+  for (size_t i = 0; i < max_num_checks && !found_corruption; ++i) {
+    if (heap_checker.IsHeapCorrupt(&corrupt_ranges)) {
+      found_corruption = true;
+      ASSERT_EQ(1, corrupt_ranges.size());
+      EXPECT_EQ(1, corrupt_ranges[0].block_count);
+      EXPECT_EQ(fake_block.block_info.block, corrupt_ranges[0].address);
+    }
+  }
+  EXPECT_TRUE(found_corruption);
+
+  fake_block.block_info.header->magic = ~fake_block.block_info.header->magic;
+  EXPECT_FALSE(heap_checker.IsHeapCorrupt(&corrupt_ranges));
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -14,10 +14,12 @@
 
 #include "syzygy/agent/asan/heap_managers/block_heap_manager.h"
 
+#include <algorithm>
 #include <utility>
 
 #include "base/bind.h"
 #include "base/rand_util.h"
+#include "syzygy/agent/asan/asan_metrics.h"
 #include "syzygy/agent/asan/asan_runtime.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
 #include "syzygy/agent/asan/shadow.h"
@@ -51,7 +53,10 @@ BlockHeapManager::BlockHeapManager(StackCaptureCache* stack_cache)
       zebra_block_heap_(nullptr),
       zebra_block_heap_id_(0),
       large_block_heap_id_(0),
-      locked_heaps_(nullptr) {
+      locked_heaps_(nullptr),
+      trimmer_thread_(nullptr),
+      trimmer_event_(nullptr),
+      trimmer_stopping_(false) {
   DCHECK_NE(static_cast<StackCaptureCache*>(nullptr), stack_cache);
   SetDefaultAsanParameters(&parameters_);
 
@@ -63,6 +68,15 @@ BlockHeapManager::BlockHeapManager(StackCaptureCache* stack_cache)
 }
 
 BlockHeapManager::~BlockHeapManager() {
+  // Stop the background trimmer thread, if any. This drains any blocks that
+  // it still holds, and must happen before the heaps are destroyed.
+  DisableBackgroundTrimming();
+
+  // Report the tuned redzone configuration so that it can be carried over
+  // to the next run.
+  if (parameters_.enable_adaptive_redzones)
+    redzone_tuner_.LogTunedParameters();
+
   base::AutoLock lock(lock_);
 
   // This would indicate that we have outstanding heap locks being
@@ -134,15 +148,25 @@ bool BlockHeapManager::DestroyHeap(HeapId heap_id) {
   DCHECK(IsValidHeapId(heap_id));
   BlockHeapInterface* heap = GetHeapFromId(heap_id);
 
-  base::AutoLock lock(lock_);
-  HeapQuarantineMap::iterator iter = heaps_.find(heap);
-  // We should always be able to retrieve a heap that we previously passed to
-  // the user.
-  CHECK(iter != heaps_.end());
-  // Destroy the heap and flush its quarantine.
-  DestroyHeapUnlocked(iter->first, iter->second);
-
-  heaps_.erase(iter);
+  // Blocks held by the background trimmer thread may belong to this heap, so
+  // drain it before the heap goes away.
+  DisableBackgroundTrimming();
+
+  {
+    base::AutoLock lock(lock_);
+    HeapQuarantineMap::iterator iter = heaps_.find(heap);
+    // We should always be able to retrieve a heap that we previously passed to
+    // the user.
+    CHECK(iter != heaps_.end());
+    // Destroy the heap and flush its quarantine.
+    DestroyHeapUnlocked(iter->first, iter->second);
+
+    heaps_.erase(iter);
+  }
+
+  if (parameters_.enable_background_trimming)
+    EnableBackgroundTrimming();
+
   return true;
 }
 
@@ -179,6 +203,12 @@ void* BlockHeapManager::Allocate(HeapId heap_id, size_t bytes) {
     heaps[heap_count++] = zebra_block_heap_id_;
   }
 
+  // Determine the trailer padding of the allocation. In adaptive mode the
+  // redzone tuner picks it from the allocation's size class.
+  size_t trailer_padding_size = parameters_.trailer_padding_size;
+  if (parameters_.enable_adaptive_redzones)
+    trailer_padding_size = redzone_tuner_.OnAllocation(bytes);
+
   // Use the selected heaps to try to satisfy the allocation.
   void* alloc = nullptr;
   BlockLayout block_layout = {};
@@ -187,7 +217,7 @@ void* BlockHeapManager::Allocate(HeapId heap_id, size_t bytes) {
     alloc = heap->AllocateBlock(
         bytes,
         0,
-        parameters_.trailer_padding_size + sizeof(BlockTrailer),
+        trailer_padding_size + sizeof(BlockTrailer),
         &block_layout);
     if (alloc != nullptr) {
       heap_id = heaps[i];
@@ -281,13 +311,22 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
         quarantine, compact);
     if (!quarantine->Push(compact))
       return FreePristineBlock(&block_info);
+    AsanMetrics::Record(kMetricQuarantinePushes);
 
     // The recently pushed block can be popped out in TrimQuarantine if the
     // quarantine size is 0, in that case TrimQuarantine takes care of properly
     // unprotecting and freeing the block. If the protection is set blindly
     // after TrimQuarantine we could end up protecting a free (not quarantined,
     // not allocated) block.
-    BlockProtectAll(block_info);
+    //
+    // Heaps whose blocks span dedicated pages hand the protection call off to
+    // the background trimmer thread when it is running, batching the kernel
+    // transitions off the free path.
+    if ((GetHeapFromId(heap_id)->GetHeapFeatures() &
+            HeapInterface::kHeapSupportsDeferredProtection) == 0 ||
+        !DeferBlockProtection(compact)) {
+      BlockProtectAll(block_info);
+    }
   }
   TrimQuarantine(quarantine);
   return true;
@@ -443,9 +482,14 @@ void BlockHeapManager::PropagateParameters() {
   // The internal heap should already be setup.
   DCHECK_NE(static_cast<HeapInterface*>(nullptr), internal_heap_.get());
 
+  redzone_tuner_.SetParameters(parameters_.adaptive_redzone_target_percent,
+                               parameters_.trailer_padding_size);
+
   size_t quarantine_size = shared_quarantine_.max_quarantine_size();
   shared_quarantine_.set_max_quarantine_size(parameters_.quarantine_size);
   shared_quarantine_.set_max_object_size(parameters_.quarantine_block_size);
+  shared_quarantine_.set_flush_threshold(
+      std::max(1u, parameters_.quarantine_flush_threshold));
 
   // Trim the quarantine if its maximum size has decreased.
   if (initialized_ && quarantine_size > parameters_.quarantine_size)
@@ -479,6 +523,13 @@ void BlockHeapManager::PropagateParameters() {
     large_block_heap_id_ = GetHeapId(result);
   }
 
+  // Start or stop the background trimmer thread as requested.
+  if (parameters_.enable_background_trimming) {
+    EnableBackgroundTrimming();
+  } else {
+    DisableBackgroundTrimming();
+  }
+
   // TODO(chrisha|sebmarchand): Clean up existing blocks that exceed the
   //     maximum block size? This will require an entirely new TrimQuarantine
   //     function. Since this is never changed at runtime except in our
@@ -578,6 +629,24 @@ void BlockHeapManager::TrimQuarantine(BlockQuarantineInterface* quarantine) {
       blocks_to_free.push_back(compact);
   }
 
+  if (blocks_to_free.empty())
+    return;
+
+  AsanMetrics::Add(kMetricQuarantineTrims, blocks_to_free.size());
+
+  // If the background trimmer thread is running then hand the blocks off to
+  // it rather than freeing them on the caller's critical path.
+  {
+    base::AutoLock lock(trimmer_lock_);
+    if (trimmer_thread_ != nullptr) {
+      pending_trimmed_blocks_.insert(pending_trimmed_blocks_.end(),
+                                     blocks_to_free.begin(),
+                                     blocks_to_free.end());
+      ::SetEvent(trimmer_event_);
+      return;
+    }
+  }
+
   BlockQuarantineInterface::ObjectVector::iterator iter_block =
       blocks_to_free.begin();
   for (; iter_block != blocks_to_free.end(); ++iter_block) {
@@ -615,28 +684,38 @@ bool BlockHeapManager::FreePristineBlock(BlockInfo* block_info) {
   DCHECK_NE(static_cast<BlockInfo*>(nullptr), block_info);
   BlockHeapInterface* heap = GetHeapFromId(block_info->trailer->heap_id);
 
-  // Remove block protections so the redzones may be modified.
-  BlockProtectNone(*block_info);
-
-  // Return pointers to the stacks for reference counting purposes.
-  if (block_info->header->alloc_stack != nullptr) {
-    stack_cache_->ReleaseStackTrace(block_info->header->alloc_stack);
-    block_info->header->alloc_stack = nullptr;
-  }
-  if (block_info->header->free_stack != nullptr) {
-    stack_cache_->ReleaseStackTrace(block_info->header->free_stack);
-    block_info->header->free_stack = nullptr;
-  }
+  {
+    // The transition out of the quarantined state is made under
+    // block_protect_lock so that it is atomic with respect to the deferred
+    // protection of quarantined blocks (see ApplyDeferredProtection). The
+    // lock is released before the block is returned to its heap, as the heap
+    // takes its own locks.
+    ::common::AutoRecursiveLock lock(block_protect_lock);
+
+    // Remove block protections so the redzones may be modified.
+    BlockProtectNone(*block_info);
+
+    // Return pointers to the stacks for reference counting purposes.
+    if (block_info->header->alloc_stack != nullptr) {
+      stack_cache_->ReleaseStackTrace(block_info->header->alloc_stack);
+      block_info->header->alloc_stack = nullptr;
+    }
+    if (block_info->header->free_stack != nullptr) {
+      stack_cache_->ReleaseStackTrace(block_info->header->free_stack);
+      block_info->header->free_stack = nullptr;
+    }
 
-  block_info->header->state = FREED_BLOCK;
+    block_info->header->state = FREED_BLOCK;
 
-  if ((heap->GetHeapFeatures() &
-       HeapInterface::kHeapReportsReservations) != 0) {
-    Shadow::Poison(block_info->block, block_info->block_size,
-                   kAsanReservedMarker);
-  } else {
-    Shadow::Unpoison(block_info->block, block_info->block_size);
+    if ((heap->GetHeapFeatures() &
+         HeapInterface::kHeapReportsReservations) != 0) {
+      Shadow::Poison(block_info->block, block_info->block_size,
+                     kAsanReservedMarker);
+    } else {
+      Shadow::Unpoison(block_info->block, block_info->block_size);
+    }
   }
+
   return heap->FreeBlock(*block_info);
 }
 
@@ -740,6 +819,139 @@ void BlockHeapManager::InitProcessHeap() {
   process_heap_id_ = GetHeapId(result);
 }
 
+void BlockHeapManager::EnableBackgroundTrimming() {
+  base::AutoLock lock(trimmer_lock_);
+  if (trimmer_thread_ != nullptr)
+    return;
+
+  trimmer_event_ = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
+  CHECK_NE(static_cast<HANDLE>(nullptr), trimmer_event_);
+  trimmer_thread_ = ::CreateThread(
+      nullptr, 0, &BlockHeapManager::BackgroundTrimmerThunk, this, 0, nullptr);
+  CHECK_NE(static_cast<HANDLE>(nullptr), trimmer_thread_);
+}
+
+void BlockHeapManager::DisableBackgroundTrimming() {
+  HANDLE trimmer_thread = nullptr;
+  HANDLE trimmer_event = nullptr;
+  {
+    base::AutoLock lock(trimmer_lock_);
+    if (trimmer_thread_ == nullptr)
+      return;
+
+    // Claim the handles so that TrimQuarantine stops handing off blocks, then
+    // ask the thread to drain what it holds and exit.
+    trimmer_stopping_ = true;
+    trimmer_thread = trimmer_thread_;
+    trimmer_event = trimmer_event_;
+    trimmer_thread_ = nullptr;
+    trimmer_event_ = nullptr;
+  }
+
+  ::SetEvent(trimmer_event);
+  CHECK_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(trimmer_thread, INFINITE));
+  ::CloseHandle(trimmer_thread);
+  ::CloseHandle(trimmer_event);
+
+  base::AutoLock lock(trimmer_lock_);
+  DCHECK(pending_trimmed_blocks_.empty());
+  DCHECK(pending_protect_blocks_.empty());
+  trimmer_stopping_ = false;
+}
+
+bool BlockHeapManager::DeferBlockProtection(
+    const CompactBlockInfo& block_info) {
+  base::AutoLock lock(trimmer_lock_);
+  if (trimmer_thread_ == nullptr)
+    return false;
+  pending_protect_blocks_.push_back(block_info);
+  ::SetEvent(trimmer_event_);
+  return true;
+}
+
+void BlockHeapManager::ApplyDeferredProtection(
+    const CompactBlockInfo& block_info) {
+  // Holding block_protect_lock makes the validation and the protection change
+  // atomic with respect to FreePristineBlock, which transitions blocks out of
+  // the quarantined state under the same lock.
+  ::common::AutoRecursiveLock lock(block_protect_lock);
+
+  // The block may have been popped from the quarantine, freed, and even
+  // reallocated since it was handed off. Only apply the protections if the
+  // shadow still describes the very same block and it is still quarantined.
+  CompactBlockInfo current = {};
+  if (!Shadow::BlockInfoFromShadow(block_info.block, &current))
+    return;
+  if (current.block != block_info.block ||
+      current.block_size != block_info.block_size) {
+    return;
+  }
+
+  BlockInfo expanded = {};
+  ConvertBlockInfo(block_info, &expanded);
+  if (Shadow::PageIsProtected(expanded.block))
+    return;
+  if (expanded.header->state != QUARANTINED_BLOCK)
+    return;
+  BlockProtectAll(expanded);
+}
+
+void BlockHeapManager::BackgroundTrimmerMain() {
+  // Take a local copy of the event handle, as DisableBackgroundTrimming
+  // clears the member while this thread is still running.
+  HANDLE trimmer_event = nullptr;
+  {
+    base::AutoLock lock(trimmer_lock_);
+    trimmer_event = trimmer_event_;
+  }
+
+  while (true) {
+    // The event handle is already gone if DisableBackgroundTrimming won the
+    // race with this thread's startup. In that case trimmer_stopping_ is set,
+    // so fall through, drain whatever is pending and exit.
+    if (trimmer_event != nullptr)
+      ::WaitForSingleObject(trimmer_event, INFINITE);
+
+    bool stopping = false;
+    BlockQuarantineInterface::ObjectVector blocks_to_protect;
+    BlockQuarantineInterface::ObjectVector blocks_to_free;
+    do {
+      blocks_to_protect.clear();
+      blocks_to_free.clear();
+      {
+        base::AutoLock lock(trimmer_lock_);
+        blocks_to_protect.swap(pending_protect_blocks_);
+        blocks_to_free.swap(pending_trimmed_blocks_);
+        stopping = trimmer_stopping_;
+      }
+
+      // Apply the deferred page protections in a batch. Blocks that have
+      // since left the quarantine are recognized and skipped.
+      BlockQuarantineInterface::ObjectVector::iterator iter_block =
+          blocks_to_protect.begin();
+      for (; iter_block != blocks_to_protect.end(); ++iter_block)
+        ApplyDeferredProtection(*iter_block);
+
+      iter_block = blocks_to_free.begin();
+      for (; iter_block != blocks_to_free.end(); ++iter_block) {
+        const CompactBlockInfo& compact = *iter_block;
+        BlockInfo expanded = {};
+        ConvertBlockInfo(compact, &expanded);
+        CHECK(FreePotentiallyCorruptBlock(&expanded));
+      }
+    } while (!blocks_to_free.empty() || !blocks_to_protect.empty());
+
+    if (stopping)
+      return;
+  }
+}
+
+DWORD WINAPI BlockHeapManager::BackgroundTrimmerThunk(LPVOID self) {
+  DCHECK_NE(static_cast<LPVOID>(nullptr), self);
+  reinterpret_cast<BlockHeapManager*>(self)->BackgroundTrimmerMain();
+  return 0;
+}
+
 bool BlockHeapManager::MayUseLargeBlockHeap(size_t bytes) const {
   DCHECK(initialized_);
   if (!parameters_.enable_large_block_heap)
@@ -28,9 +28,11 @@
 #include "syzygy/agent/asan/heap.h"
 #include "syzygy/agent/asan/heap_manager.h"
 #include "syzygy/agent/asan/quarantine.h"
+#include "syzygy/agent/asan/redzone_tuner.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
 #include "syzygy/agent/asan/memory_notifiers/shadow_memory_notifier.h"
 #include "syzygy/agent/asan/quarantines/sharded_quarantine.h"
+#include "syzygy/agent/asan/quarantines/thread_local_quarantine_cache.h"
 #include "syzygy/common/asan_parameters.h"
 
 namespace agent {
@@ -128,6 +130,11 @@ class BlockHeapManager : public HeapManagerInterface {
                                          kQuarantineDefaultShardingFactor>
       ShardedBlockQuarantine;
 
+  // The sharded quarantine fronted by a thread-local cache that batches
+  // pushes, amortizing the cost of taking the shard locks.
+  typedef quarantines::ThreadLocalQuarantineCache<ShardedBlockQuarantine>
+      CachedBlockQuarantine;
+
   // A map associating a block heap with its underlying heap.
   typedef std::unordered_map<BlockHeapInterface*, HeapInterface*>
       UnderlyingHeapMap;
@@ -241,6 +248,41 @@ class BlockHeapManager : public HeapManagerInterface {
   // Exposed for unittesting.
   void InitProcessHeap();
 
+  // Starts the background trimmer thread, if it isn't already running. Once
+  // started, blocks trimmed from an overflowing quarantine are handed off to
+  // the trimmer thread rather than being verified and freed synchronously in
+  // TrimQuarantine.
+  void EnableBackgroundTrimming();
+
+  // Stops the background trimmer thread, if it is running. Any blocks still
+  // pending are verified and freed before this returns.
+  void DisableBackgroundTrimming();
+
+  // Attempts to hand off the application of the page protections of a freshly
+  // quarantined block to the background trimmer thread. This is only done for
+  // heaps with the kHeapSupportsDeferredProtection feature, and batches the
+  // protection calls off the critical path of Free.
+  // @param block_info The quarantined block whose protections are to be
+  //     applied.
+  // @returns true if the block was handed off, false if the protections must
+  //     be applied synchronously by the caller.
+  bool DeferBlockProtection(const CompactBlockInfo& block_info);
+
+  // Applies the page protections of a block handed off via
+  // DeferBlockProtection. The block may have left the quarantine, or even
+  // have been reallocated, in the meantime; in that case this does nothing.
+  // @param block_info The block whose protections are to be applied.
+  void ApplyDeferredProtection(const CompactBlockInfo& block_info);
+
+  // Body of the background trimmer thread. Waits for blocks handed off by
+  // TrimQuarantine and frees them, and applies deferred block protections.
+  void BackgroundTrimmerMain();
+
+  // Trampoline that ::CreateThread can invoke.
+  // @param self The BlockHeapManager owning the thread.
+  // @returns 0.
+  static DWORD WINAPI BackgroundTrimmerThunk(LPVOID self);
+
   // Determines if the large block heap should be used for an allocation of
   // the given size.
   // @param bytes The allocation size.
@@ -265,7 +307,7 @@ class BlockHeapManager : public HeapManagerInterface {
 
   // The quarantine shared by the heaps created by this manager. This is also
   // used by the LargeBlockHeap.
-  ShardedBlockQuarantine shared_quarantine_;
+  CachedBlockQuarantine shared_quarantine_;
 
   // Map the block heaps to their underlying heap.
   UnderlyingHeapMap underlying_heaps_map_;  // Under lock_.
@@ -273,6 +315,10 @@ class BlockHeapManager : public HeapManagerInterface {
   // The parameters of this heap manager.
   ::common::AsanParameters parameters_;
 
+  // Sizes the trailer padding of instrumented allocations when adaptive
+  // redzones are enabled.
+  RedzoneTuner redzone_tuner_;
+
   // The callback this manager uses to expose internal state errors. These are
   // caused by uninstrumented code (system libraries, etc), thus aren't caught
   // at their source. Catching their side effect as early as possible allows the
@@ -312,6 +358,27 @@ class BlockHeapManager : public HeapManagerInterface {
   // Under lock_.
   HeapInterface** locked_heaps_;
 
+  // Protects the handoff of trimmed blocks to the background trimmer thread.
+  // This lock is only briefly held, and never while freeing blocks.
+  base::Lock trimmer_lock_;
+
+  // The background trimmer thread and the event used to wake it. Both are
+  // null when background trimming is disabled. Under trimmer_lock_.
+  HANDLE trimmer_thread_;
+  HANDLE trimmer_event_;
+
+  // Indicates that the background trimmer thread should exit once it has
+  // drained the pending blocks. Under trimmer_lock_.
+  bool trimmer_stopping_;
+
+  // Blocks trimmed from a quarantine, awaiting verification and release by
+  // the background trimmer thread. Under trimmer_lock_.
+  BlockQuarantineInterface::ObjectVector pending_trimmed_blocks_;
+
+  // Quarantined blocks whose page protections are still to be applied by the
+  // background trimmer thread. Under trimmer_lock_.
+  BlockQuarantineInterface::ObjectVector pending_protect_blocks_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(BlockHeapManager);
 };
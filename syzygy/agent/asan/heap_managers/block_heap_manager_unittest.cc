@@ -125,6 +125,7 @@ class TestBlockHeapManager : public BlockHeapManager {
   using BlockHeapManager::HeapQuarantineMap;
   using BlockHeapManager::SetHeapErrorCallback;
   using BlockHeapManager::ShardedBlockQuarantine;
+  using BlockHeapManager::CachedBlockQuarantine;
   using BlockHeapManager::TrimQuarantine;
 
   using BlockHeapManager::heaps_;
@@ -136,16 +137,19 @@ class TestBlockHeapManager : public BlockHeapManager {
   using BlockHeapManager::locked_heaps_;
 
   // A derived class to expose protected members for unit-testing. This has to
-  // be nested into this one because ShardedBlockQuarantine accesses some
+  // be nested into this one because CachedBlockQuarantine accesses some
   // protected fields of BlockHeapManager.
   //
   // This class should only expose some members or expose new functions, no new
   // member should be added.
-  class TestQuarantine : public ShardedBlockQuarantine {
+  class TestQuarantine : public CachedBlockQuarantine {
    public:
     using ShardedBlockQuarantine::Node;
     using ShardedBlockQuarantine::kShardingFactor;
     using ShardedBlockQuarantine::heads_;
+    using CachedBlockQuarantine::ThreadCache;
+    using CachedBlockQuarantine::caches_;
+    using CachedBlockQuarantine::caches_lock_;
   };
 
   // Constructor.
@@ -288,7 +292,7 @@ class ScopedHeap {
     // act as an interface allowing to access some private fields.
     COMPILE_ASSERT(
         sizeof(TestQuarantine) ==
-            sizeof(TestBlockHeapManager::ShardedBlockQuarantine),
+            sizeof(TestBlockHeapManager::CachedBlockQuarantine),
         test_quarantine_is_not_an_interface);
     TestQuarantine* test_quarantine =
         reinterpret_cast<TestQuarantine*>(GetQuarantine());
@@ -298,21 +302,39 @@ class ScopedHeap {
       // Search through all blocks in each shard.
       TestQuarantine::Node* current_node = test_quarantine->heads_[i];
       while (current_node != nullptr) {
-        const uint8* body = current_node->object.block +
-            current_node->object.header_size;
-        if (body == mem) {
-          const BlockHeader* header = reinterpret_cast<BlockHeader*>(
-              current_node->object.block);
-          EXPECT_EQ(QUARANTINED_BLOCK, header->state);
+        if (BlockBodyMatches(current_node->object, mem))
           return true;
-        }
         current_node = current_node->next;
       }
     }
 
+    // Search through the thread-local caches of blocks that haven't yet been
+    // flushed to the shards.
+    base::AutoLock caches_lock(test_quarantine->caches_lock_);
+    for (size_t i = 0; i < test_quarantine->caches_.size(); ++i) {
+      TestQuarantine::ThreadCache* cache = test_quarantine->caches_[i];
+      base::AutoLock cache_lock(cache->lock);
+      for (size_t j = 0; j < cache->objects.size(); ++j) {
+        if (BlockBodyMatches(cache->objects[j], mem))
+          return true;
+      }
+    }
+
     return false;
   }
 
+  // Determines if @p mem is the body of the quarantined block @p object.
+  static bool BlockBodyMatches(const CompactBlockInfo& object,
+                               const void* mem) {
+    const uint8* body = object.block + object.header_size;
+    if (body != mem)
+      return false;
+    const BlockHeader* header =
+        reinterpret_cast<const BlockHeader*>(object.block);
+    EXPECT_EQ(QUARANTINED_BLOCK, header->state);
+    return true;
+  }
+
   // Returns the heap supported features.
   uint32 GetHeapFeatures() {
     return heap_manager_->GetHeapFromId(heap_id_)->GetHeapFeatures();
@@ -510,6 +532,35 @@ TEST_P(BlockHeapManagerTest, PopOnSetQuarantineMaxSize) {
   ASSERT_FALSE(heap.InQuarantine(mem));
 }
 
+TEST_P(BlockHeapManagerTest, BackgroundQuarantineTrimming) {
+  const size_t kAllocSize = 100;
+  size_t real_alloc_size = GetAllocSize(kAllocSize);
+  ScopedHeap heap(heap_manager_);
+
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.quarantine_size = real_alloc_size;
+  parameters.quarantine_flush_threshold = 1;
+  parameters.enable_background_trimming = true;
+  heap_manager_->set_parameters(parameters);
+
+  void* mem = heap.Allocate(kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), mem);
+  ASSERT_TRUE(heap.Free(mem));
+  ASSERT_TRUE(heap.InQuarantine(mem));
+
+  // Shrinking the quarantine trims the block out of it. The block is handed
+  // off to the background trimmer thread rather than being freed here.
+  parameters.quarantine_size = real_alloc_size - 1;
+  heap_manager_->set_parameters(parameters);
+  EXPECT_FALSE(heap.InQuarantine(mem));
+
+  // Turning background trimming off drains the trimmer thread, after which
+  // the block must have been fully freed.
+  parameters.enable_background_trimming = false;
+  heap_manager_->set_parameters(parameters);
+  EXPECT_NE(kHeapFreedMarker, Shadow::GetShadowMarkerForAddress(mem));
+}
+
 TEST_P(BlockHeapManagerTest, Quarantine) {
   const size_t kAllocSize = 100;
   size_t real_alloc_size = GetAllocSize(kAllocSize);
@@ -1239,6 +1290,45 @@ TEST_P(BlockHeapManagerTest, QuarantinedBlockIsProtected) {
   }
 }
 
+TEST_P(BlockHeapManagerTest, QuarantinedBlockIsProtectedInBackground) {
+  EnableTestZebraBlockHeap();
+  ScopedHeap heap(heap_manager_);
+  // Always quarantine if possible.
+  test_zebra_block_heap_->set_quarantine_ratio(1.0);
+
+  // The zebra heap supports deferred protection, so with background trimming
+  // enabled the page protections of quarantined blocks are applied by the
+  // background trimmer thread.
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.enable_background_trimming = true;
+  heap_manager_->set_parameters(parameters);
+
+  const size_t kAllocSize = 0xFF;
+  void* alloc = heap.Allocate(kAllocSize);
+  EXPECT_NE(static_cast<void*>(nullptr), alloc);
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(alloc, kAllocSize));
+
+  BlockInfo block_info = {};
+  EXPECT_TRUE(Shadow::BlockInfoFromShadow(alloc, &block_info));
+
+  // The block is freed and quarantined.
+  EXPECT_TRUE(heap.Free(alloc));
+
+  // Turning background trimming off drains the trimmer thread, after which
+  // the deferred protections must be in place.
+  parameters.enable_background_trimming = false;
+  heap_manager_->set_parameters(parameters);
+
+  // The whole block should be page-protected.
+  for (size_t i = 0; i < block_info.block_pages_size; ++i)
+    EXPECT_TRUE(IsNotAccessible(block_info.block_pages + i));
+
+  {
+    ScopedBlockAccess block_access(block_info);
+    EXPECT_EQ(QUARANTINED_BLOCK, block_info.header->state);
+  }
+}
+
 TEST_P(BlockHeapManagerTest, NonQuarantinedBlockIsMarkedAsFreed) {
   EnableTestZebraBlockHeap();
   ScopedHeap heap(heap_manager_);
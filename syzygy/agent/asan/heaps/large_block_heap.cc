@@ -26,7 +26,11 @@ namespace asan {
 namespace heaps {
 
 LargeBlockHeap::LargeBlockHeap(HeapInterface* internal_heap)
-    : allocs_(HeapAllocator<void*>(internal_heap)) {
+    : allocs_(HeapAllocator<void*>(internal_heap)),
+      free_spans_(FreeSpanMap::key_compare(),
+                  HeapAllocator<void*>(internal_heap)),
+      free_spans_bytes_(0),
+      span_pool_watermark_(kDefaultSpanPoolWatermark) {
 }
 
 LargeBlockHeap::~LargeBlockHeap() {
@@ -35,6 +39,7 @@ LargeBlockHeap::~LargeBlockHeap() {
   for (; it != allocs_.end(); ++it)
     ::VirtualFree(const_cast<void*>(it->address), 0, MEM_RELEASE);
   allocs_.clear();
+  DrainSpanPool();
 }
 
 HeapType LargeBlockHeap::GetHeapType() const {
@@ -50,7 +55,24 @@ void* LargeBlockHeap::Allocate(size_t bytes) {
   // allocations get an actual distinct address each time.
   size_t size = std::max(bytes, 1u);
   size = ::common::AlignUp(size, GetPageSize());
-  void* alloc = ::VirtualAlloc(NULL, size, MEM_COMMIT, PAGE_READWRITE);
+
+  // Preferentially serve the allocation from the pool of recently freed
+  // spans, avoiding a kernel call. The contents of a reused span are
+  // undefined, as per the usual heap semantics.
+  void* alloc = NULL;
+  {
+    ::common::AutoRecursiveLock lock(lock_);
+    FreeSpanMap::iterator it = free_spans_.find(size);
+    if (it != free_spans_.end()) {
+      alloc = it->second;
+      free_spans_.erase(it);
+      DCHECK_LE(size, free_spans_bytes_);
+      free_spans_bytes_ -= size;
+    }
+  }
+
+  if (alloc == NULL)
+    alloc = ::VirtualAlloc(NULL, size, MEM_COMMIT, PAGE_READWRITE);
   Allocation allocation = { alloc, bytes };
 
   if (alloc != NULL) {
@@ -64,16 +86,25 @@ void* LargeBlockHeap::Allocate(size_t bytes) {
 bool LargeBlockHeap::Free(void* alloc) {
   Allocation allocation = { alloc, 0 };
 
-  {
-    // First lookup the allocation to ensure it was made by us.
-    ::common::AutoRecursiveLock lock(lock_);
-    AllocationSet::iterator it = allocs_.find(allocation);
-    if (it == allocs_.end())
-      return false;
-    allocs_.erase(it);
-  }
+  // First lookup the allocation to ensure it was made by us.
+  ::common::AutoRecursiveLock lock(lock_);
+  AllocationSet::iterator it = allocs_.find(allocation);
+  if (it == allocs_.end())
+    return false;
+  size_t size = ::common::AlignUp(std::max(it->size, 1u), GetPageSize());
+  allocs_.erase(it);
+
+  // Retain the span in the pool rather than releasing it immediately; a
+  // subsequent allocation of the same size will be able to reuse it
+  // without a round trip through the kernel.
+  free_spans_.insert(std::make_pair(size, alloc));
+  free_spans_bytes_ += size;
+
+  // Once the pool grows past the watermark release it back to the OS in a
+  // single batch.
+  if (free_spans_bytes_ > span_pool_watermark_)
+    DrainSpanPool();
 
-  ::VirtualFree(alloc, 0, MEM_RELEASE);
   return true;
 }
 
@@ -137,6 +168,14 @@ bool LargeBlockHeap::FreeBlock(const BlockInfo& block_info) {
   return Free(block_info.block);
 }
 
+void LargeBlockHeap::DrainSpanPool() {
+  FreeSpanMap::iterator it = free_spans_.begin();
+  for (; it != free_spans_.end(); ++it)
+    ::VirtualFree(it->second, 0, MEM_RELEASE);
+  free_spans_.clear();
+  free_spans_bytes_ = 0;
+}
+
 }  // namespace heaps
 }  // namespace asan
 }  // namespace agent
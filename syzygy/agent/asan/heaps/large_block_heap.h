@@ -27,6 +27,7 @@
 #ifndef SYZYGY_AGENT_ASAN_HEAPS_LARGE_BLOCK_HEAP_H_
 #define SYZYGY_AGENT_ASAN_HEAPS_LARGE_BLOCK_HEAP_H_
 
+#include <map>
 #include <unordered_set>
 
 #include "syzygy/agent/asan/allocators.h"
@@ -72,7 +73,28 @@ class LargeBlockHeap : public BlockHeapInterface {
   // @returns the number of active allocations in this heap.
   size_t size() const { return allocs_.size(); }
 
+  // @name Accessors and mutators for the free span pool watermark. Freed
+  //     spans are retained in a pool and reused to serve subsequent
+  //     allocations of the same size; once the pool grows past the
+  //     watermark it is released back to the OS in a single batch.
+  // @{
+  size_t span_pool_watermark() const { return span_pool_watermark_; }
+  void set_span_pool_watermark(size_t span_pool_watermark) {
+    span_pool_watermark_ = span_pool_watermark;
+  }
+  // @}
+
+  // @returns the total size of the spans currently retained in the free
+  //     span pool.
+  size_t span_pool_bytes() const { return free_spans_bytes_; }
+
+  // The default watermark of the free span pool, in bytes.
+  static const size_t kDefaultSpanPoolWatermark = 16 * 1024 * 1024;
+
  protected:
+  // Releases all of the spans retained in the free span pool back to the
+  // OS. Must be called under lock_.
+  void DrainSpanPool();
   // Information about an allocation made by this allocator.
   struct Allocation {
     const void* address;
@@ -106,6 +128,23 @@ class LargeBlockHeap : public BlockHeapInterface {
       HeapAllocator<Allocation>> AllocationSet;
   AllocationSet allocs_;  // Under lock_.
 
+  // The pool of recently freed spans, keyed by their page-aligned size.
+  // These are still committed and are preferentially used to serve new
+  // allocations, avoiding a pair of kernel calls for size-stable
+  // allocation churn.
+  typedef std::multimap<size_t,
+                        void*,
+                        std::less<size_t>,
+                        HeapAllocator<std::pair<const size_t, void*>>>
+      FreeSpanMap;
+  FreeSpanMap free_spans_;  // Under lock_.
+
+  // The total size of the spans in free_spans_. Under lock_.
+  size_t free_spans_bytes_;
+
+  // The size past which the free span pool is drained. Under lock_.
+  size_t span_pool_watermark_;
+
   // The global lock for this allocator.
   ::common::RecursiveLock lock_;
 
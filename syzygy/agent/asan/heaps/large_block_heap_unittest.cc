@@ -143,6 +143,46 @@ TEST(LargeBlockHeapTest, GetAllocationSize) {
   EXPECT_EQ(67u, h.GetAllocationSize(alloc));
 }
 
+TEST(LargeBlockHeapTest, FreedSpansAreReused) {
+  TestLargeBlockHeap h;
+  EXPECT_EQ(0u, h.span_pool_bytes());
+
+  void* a1 = h.Allocate(10000);
+  ASSERT_TRUE(a1 != NULL);
+  EXPECT_TRUE(h.Free(a1));
+  EXPECT_LT(0u, h.span_pool_bytes());
+
+  // An allocation of the same page-aligned size should be served from the
+  // free span pool, reusing the span that was just freed.
+  void* a2 = h.Allocate(10000);
+  EXPECT_EQ(a1, a2);
+  EXPECT_EQ(0u, h.span_pool_bytes());
+  EXPECT_TRUE(h.Free(a2));
+}
+
+TEST(LargeBlockHeapTest, SpanPoolDrainsAtWatermark) {
+  TestLargeBlockHeap h;
+  EXPECT_EQ(LargeBlockHeap::kDefaultSpanPoolWatermark,
+            h.span_pool_watermark());
+  h.set_span_pool_watermark(2 * GetPageSize());
+
+  void* a1 = h.Allocate(1);
+  void* a2 = h.Allocate(1);
+  void* a3 = h.Allocate(1);
+  ASSERT_TRUE(a1 != NULL);
+  ASSERT_TRUE(a2 != NULL);
+  ASSERT_TRUE(a3 != NULL);
+
+  EXPECT_TRUE(h.Free(a1));
+  EXPECT_EQ(GetPageSize(), h.span_pool_bytes());
+  EXPECT_TRUE(h.Free(a2));
+  EXPECT_EQ(2 * GetPageSize(), h.span_pool_bytes());
+
+  // This free pushes the pool past the watermark, draining it entirely.
+  EXPECT_TRUE(h.Free(a3));
+  EXPECT_EQ(0u, h.span_pool_bytes());
+}
+
 TEST(LargeBlockHeapTest, Lock) {
   TestLargeBlockHeap h;
 
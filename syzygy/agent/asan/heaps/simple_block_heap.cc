@@ -15,6 +15,7 @@
 #include "syzygy/agent/asan/heaps/simple_block_heap.h"
 
 #include "base/logging.h"
+#include "syzygy/common/align.h"
 
 namespace agent {
 namespace asan {
@@ -78,6 +79,33 @@ void* SimpleBlockHeap::AllocateBlock(size_t size,
   // Allocate space for the block. If the allocation fails heap_ will
   // return NULL and we'll simply pass it on.
   void* alloc = heap_->Allocate(layout->block_size);
+  if (alloc == nullptr)
+    return nullptr;
+
+  // If the underlying heap reports the size class its allocations were
+  // rounded up to then any slack beyond the planned block can be folded
+  // into the right redzone, recovering it for redzone coverage at no
+  // additional memory cost.
+  static const uint32 kSizeClassFeatures = kHeapSupportsGetAllocationSize |
+      kHeapGetAllocationSizeIsUpperBound;
+  if ((heap_->GetHeapFeatures() & kSizeClassFeatures) == kSizeClassFeatures) {
+    size_t alloc_size = heap_->GetAllocationSize(alloc);
+    if (alloc_size != kUnknownSize) {
+      size_t usable_size = ::common::AlignDown(alloc_size, kShadowRatio);
+      if (usable_size > layout->block_size) {
+        // Replan the layout with the slack rolled into the right redzone.
+        // The left redzone and body inputs are unchanged so only the right
+        // redzone grows, by exactly the (shadow granular) slack.
+        size_t right_redzone_size = layout->trailer_padding_size +
+            layout->trailer_size + usable_size - layout->block_size;
+        CHECK(BlockPlanLayout(kShadowRatio, kShadowRatio, size,
+                              min_left_redzone_size, right_redzone_size,
+                              layout));
+        DCHECK_EQ(usable_size, layout->block_size);
+      }
+    }
+  }
+
   DCHECK_EQ(0u, reinterpret_cast<uintptr_t>(alloc) % kShadowRatio);
   return alloc;
 }
@@ -15,7 +15,10 @@
 #include "syzygy/agent/asan/heaps/simple_block_heap.h"
 
 #include "gtest/gtest.h"
+#include "syzygy/agent/asan/unittest_util.h"
+#include "syzygy/agent/asan/heaps/ctmalloc_heap.h"
 #include "syzygy/agent/asan/heaps/win_heap.h"
+#include "syzygy/common/align.h"
 
 namespace agent {
 namespace asan {
@@ -73,6 +76,27 @@ TEST(SimpleBlockHeapTest, EndToEnd) {
     EXPECT_TRUE(h.FreeBlock(*it));
 }
 
+TEST(SimpleBlockHeapTest, SizeClassSlackBecomesRedzone) {
+  testing::NullMemoryNotifier n;
+  CtMallocHeap ctmalloc_heap(&n);
+  SimpleBlockHeap h(&ctmalloc_heap);
+
+  // CtMalloc reports the size class its allocations were rounded up to, so
+  // the layout of every block should cover the entire allocation.
+  for (size_t i = 1; i < 1024 * 1024; i += i / 2 + 1) {
+    BlockLayout layout = {};
+    BlockInfo block = {};
+    void* alloc = h.AllocateBlock(i, 0, 0, &layout);
+    ASSERT_TRUE(alloc != NULL);
+    EXPECT_EQ(i, layout.body_size);
+    size_t alloc_size = ctmalloc_heap.GetAllocationSize(alloc);
+    EXPECT_EQ(::common::AlignDown(alloc_size, kShadowRatio),
+              layout.block_size);
+    BlockInitialize(layout, alloc, false, &block);
+    EXPECT_TRUE(h.FreeBlock(block));
+  }
+}
+
 TEST(SimpleBlockHeap, IsAllocated) {
   WinHeap win_heap;
   SimpleBlockHeap h(&win_heap);
@@ -79,7 +79,7 @@ HeapType ZebraBlockHeap::GetHeapType() const {
 
 uint32 ZebraBlockHeap::GetHeapFeatures() const {
   return kHeapSupportsIsAllocated | kHeapReportsReservations |
-      kHeapSupportsGetAllocationSize;
+      kHeapSupportsGetAllocationSize | kHeapSupportsDeferredProtection;
 }
 
 void* ZebraBlockHeap::Allocate(size_t bytes) {
@@ -67,6 +67,10 @@ namespace heaps {
 // |-header-|                |-body-|                            |-trailer-|
 //
 // Calling Free on a quarantined address is an invalid operation.
+//
+// Since every block spans an entire slab the heap reports the
+// kHeapSupportsDeferredProtection feature, allowing the heap manager to
+// batch the page protection calls off the critical path.
 class ZebraBlockHeap : public BlockHeapInterface,
                        public BlockQuarantineInterface {
  public:
@@ -82,7 +82,8 @@ TEST(ZebraBlockHeapTest, FeaturesAreValid) {
   TestZebraBlockHeap h;
   EXPECT_EQ(HeapInterface::kHeapSupportsIsAllocated |
                 HeapInterface::kHeapReportsReservations |
-                HeapInterface::kHeapSupportsGetAllocationSize,
+                HeapInterface::kHeapSupportsGetAllocationSize |
+                HeapInterface::kHeapSupportsDeferredProtection,
             h.GetHeapFeatures());
 }
 
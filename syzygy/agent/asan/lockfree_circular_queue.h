@@ -0,0 +1,122 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A lock-free variant of the circular queue, for handing work off between
+// threads without ever blocking. Multiple producers may push concurrently,
+// but only a single consumer may pop at any given time (MPSC). Producers and
+// the consumer coordinate via interlocked operations on per-slot sequence
+// numbers, so a push never takes a lock; when the queue is full the push
+// simply fails and the caller is expected to fall back to processing the
+// work synchronously. This makes the queue usable from hot paths that must
+// not contend on a lock.
+//
+// As with CircularQueue, the underlying container reserves its memory only
+// once, and the constructor taking an allocator allows the storage to be
+// tracked by a MemoryNotifierInterface via MemoryNotifierAllocator.
+
+#ifndef SYZYGY_AGENT_ASAN_LOCKFREE_CIRCULAR_QUEUE_H_
+#define SYZYGY_AGENT_ASAN_LOCKFREE_CIRCULAR_QUEUE_H_
+
+#include <memory>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "syzygy/agent/asan/memory_notifier.h"
+
+namespace agent {
+namespace asan {
+
+// A lock-free multiple-producer single-consumer circular queue. This is an
+// implementation of Dmitry Vyukov's bounded MPMC queue, restricted to a
+// single consumer.
+// @tparam T the type of the elements.
+// @tparam Alloc the type of the allocator used by the underlying container.
+template<typename T, typename Alloc = std::allocator<T>>
+class LockFreeCircularQueue {
+ public:
+  // Constructor.
+  // @param max_capacity Maximum number of elements the queue can store. This
+  //     is rounded up to a power of two.
+  explicit LockFreeCircularQueue(size_t max_capacity);
+
+  // Constructor.
+  // @param max_capacity Maximum number of elements the queue can store. This
+  //     is rounded up to a power of two.
+  // @param alloc The allocator to use with this container.
+  LockFreeCircularQueue(size_t max_capacity, const Alloc& alloc);
+
+  // Inserts an element in the back/tail of the queue if possible. This is
+  // safe to call concurrently from multiple threads and never blocks.
+  // @param elem the element to be inserted.
+  // @returns true if the operation succeeded and the element was inserted,
+  //     false if the queue is full.
+  bool push(const T& elem);
+
+  // Removes the element at the front/head of the queue if possible. Only a
+  // single thread may pop at any given time.
+  // @param elem receives the popped element.
+  // @returns true if an element was popped from the front/head, false if the
+  //     queue is empty.
+  bool pop(T* elem);
+
+  // Gives the current number of elements in the queue. This is a snapshot
+  // that may be stale by the time it is observed if producers are active.
+  // @returns the number of elements currently stored in the queue.
+  size_t size() const;
+
+  // Tests if the queue is empty. Subject to the same caveat as size().
+  // @returns true if the queue is empty, false otherwise.
+  bool empty() const;
+
+  // @returns the maximum number of elements the queue can handle.
+  size_t max_capacity() const;
+
+ private:
+  // A slot of the ring. The sequence number encodes the state of the slot:
+  // it is equal to the position of the next push into the slot when the slot
+  // is free, and to that position plus one once the value is in place. See
+  // the implementation for the full invariant.
+  struct Slot {
+    base::subtle::Atomic32 sequence;
+    T value;
+  };
+
+  typedef typename Alloc::template rebind<Slot>::other SlotAlloc;
+  typedef typename std::vector<Slot, SlotAlloc> Container;
+
+  // Sizes the buffer and initializes the slot sequence numbers.
+  // @param max_capacity Maximum number of elements the queue can store.
+  void InitSlots(size_t max_capacity);
+
+  // The queue underlying container.
+  Container buffer_;
+
+  // A mask for mapping queue positions to slot indices. This is the buffer
+  // size minus one, the buffer size being a power of two.
+  size_t mask_;
+
+  // The position of the next push. Positions increase monotonically and are
+  // mapped to slots via mask_.
+  base::subtle::Atomic32 enqueue_pos_;
+
+  // The position of the next pop.
+  base::subtle::Atomic32 dequeue_pos_;
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#include "syzygy/agent/asan/lockfree_circular_queue_impl.h"
+
+#endif  // SYZYGY_AGENT_ASAN_LOCKFREE_CIRCULAR_QUEUE_H_
@@ -0,0 +1,144 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Internal implementation details for lockfree_circular_queue.h. Not meant
+// to be included directly.
+//
+// The queue maintains the following invariant on slot sequence numbers: a
+// slot whose sequence number equals a position P is free to receive the push
+// at position P, and a slot whose sequence number equals P + 1 holds the
+// value pushed at position P. After a pop the sequence number is set one
+// full lap ahead, making the slot free for the push that will next map to
+// it. Sequence numbers and positions are 32-bit values whose differences are
+// computed in signed arithmetic, so lapping behaves correctly across
+// wraparound.
+
+#ifndef SYZYGY_AGENT_ASAN_LOCKFREE_CIRCULAR_QUEUE_IMPL_H_
+#define SYZYGY_AGENT_ASAN_LOCKFREE_CIRCULAR_QUEUE_IMPL_H_
+
+#include "base/logging.h"
+#include "syzygy/agent/asan/memory_notifier.h"
+
+namespace agent {
+namespace asan {
+
+template<typename T, typename Alloc>
+LockFreeCircularQueue<T, Alloc>::LockFreeCircularQueue(size_t max_capacity)
+    : mask_(0u), enqueue_pos_(0), dequeue_pos_(0) {
+  InitSlots(max_capacity);
+}
+
+template<typename T, typename Alloc>
+LockFreeCircularQueue<T, Alloc>::LockFreeCircularQueue(
+    size_t max_capacity, const Alloc& alloc)
+    : buffer_(SlotAlloc(alloc)),
+      mask_(0u),
+      enqueue_pos_(0),
+      dequeue_pos_(0) {
+  InitSlots(max_capacity);
+}
+
+template<typename T, typename Alloc>
+void LockFreeCircularQueue<T, Alloc>::InitSlots(size_t max_capacity) {
+  DCHECK_LT(0u, max_capacity);
+
+  // Round the capacity up to a power of two so that positions map to slot
+  // indices with a simple mask.
+  size_t capacity = 1;
+  while (capacity < max_capacity)
+    capacity <<= 1;
+
+  buffer_.resize(capacity);
+  mask_ = capacity - 1;
+  for (size_t i = 0; i < capacity; ++i) {
+    base::subtle::NoBarrier_Store(
+        &buffer_[i].sequence, static_cast<base::subtle::Atomic32>(i));
+  }
+}
+
+template<typename T, typename Alloc>
+bool LockFreeCircularQueue<T, Alloc>::push(const T& elem) {
+  base::subtle::Atomic32 pos = base::subtle::NoBarrier_Load(&enqueue_pos_);
+  for (;;) {
+    Slot* slot = &buffer_[pos & mask_];
+    base::subtle::Atomic32 seq = base::subtle::Acquire_Load(&slot->sequence);
+    base::subtle::Atomic32 dif = seq - pos;
+    if (dif == 0) {
+      // The slot is free. Try to claim it by advancing the enqueue position;
+      // another producer may beat us to it.
+      if (base::subtle::NoBarrier_CompareAndSwap(
+              &enqueue_pos_, pos, pos + 1) == pos) {
+        slot->value = elem;
+        // Publish the value to the consumer.
+        base::subtle::Release_Store(&slot->sequence, pos + 1);
+        return true;
+      }
+    } else if (dif < 0) {
+      // The slot is still holding the value pushed one lap earlier: the
+      // queue is full.
+      return false;
+    }
+    // Either we lost the race to claim the slot or another producer claimed
+    // it before we looked at it. Reload the position and try again.
+    pos = base::subtle::NoBarrier_Load(&enqueue_pos_);
+  }
+}
+
+template<typename T, typename Alloc>
+bool LockFreeCircularQueue<T, Alloc>::pop(T* elem) {
+  DCHECK_NE(static_cast<T*>(NULL), elem);
+
+  base::subtle::Atomic32 pos = base::subtle::NoBarrier_Load(&dequeue_pos_);
+  Slot* slot = &buffer_[pos & mask_];
+  base::subtle::Atomic32 seq = base::subtle::Acquire_Load(&slot->sequence);
+
+  // The slot only holds a value once its sequence number has been advanced
+  // past the position of the push that filled it.
+  if (seq - (pos + 1) < 0)
+    return false;
+
+  *elem = slot->value;
+
+  // Mark the slot free for the push that will map to it one lap from now.
+  base::subtle::Release_Store(
+      &slot->sequence,
+      pos + static_cast<base::subtle::Atomic32>(buffer_.size()));
+  base::subtle::NoBarrier_Store(&dequeue_pos_, pos + 1);
+  return true;
+}
+
+template<typename T, typename Alloc>
+size_t LockFreeCircularQueue<T, Alloc>::size() const {
+  base::subtle::Atomic32 head = base::subtle::Acquire_Load(&dequeue_pos_);
+  base::subtle::Atomic32 tail = base::subtle::Acquire_Load(&enqueue_pos_);
+  base::subtle::Atomic32 dif = tail - head;
+  if (dif < 0)
+    return 0;
+  return static_cast<size_t>(dif);
+}
+
+template<typename T, typename Alloc>
+bool LockFreeCircularQueue<T, Alloc>::empty() const {
+  return size() == 0;
+}
+
+template<typename T, typename Alloc>
+size_t LockFreeCircularQueue<T, Alloc>::max_capacity() const {
+  return buffer_.size();
+}
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_LOCKFREE_CIRCULAR_QUEUE_IMPL_H_
@@ -0,0 +1,204 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/lockfree_circular_queue.h"
+
+#include "base/memory/scoped_vector.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/allocators.h"
+#include "syzygy/agent/asan/unittest_util.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+  using testing::MockMemoryNotifier;
+
+  using ::testing::_;
+  using ::testing::AtLeast;
+
+  // A producer that pushes an increasing sequence of values tagged with its
+  // ID into a queue, retrying whenever the queue is full.
+  class Producer : public base::DelegateSimpleThread::Delegate {
+   public:
+    typedef LockFreeCircularQueue<uint32> Queue;
+
+    Producer(uint32 id, size_t count, Queue* queue)
+        : id_(id), count_(count), queue_(queue) {
+    }
+
+    virtual void Run() {
+      for (size_t i = 0; i < count_; ++i) {
+        uint32 value = (id_ << 24) | static_cast<uint32>(i);
+        while (!queue_->push(value))
+          ::Sleep(0);
+      }
+    }
+
+   private:
+    uint32 id_;
+    size_t count_;
+    Queue* queue_;
+  };
+}
+
+TEST(LockFreeCircularQueue, MaxCapacity) {
+  size_t capacity = 128;
+  LockFreeCircularQueue<int> q(capacity);
+  EXPECT_EQ(capacity, q.max_capacity());
+}
+
+TEST(LockFreeCircularQueue, MaxCapacityIsRoundedUp) {
+  LockFreeCircularQueue<int> q(100);
+  EXPECT_EQ(128u, q.max_capacity());
+}
+
+TEST(LockFreeCircularQueue, PushIncreasesSize) {
+  size_t capacity = 128;
+  LockFreeCircularQueue<int> q(capacity);
+
+  for (size_t i = 0; i < capacity; ++i) {
+    EXPECT_EQ(i, q.size());
+    q.push(i);
+    EXPECT_EQ(i + 1, q.size());
+  }
+}
+
+TEST(LockFreeCircularQueue, ComplyWithFIFO) {
+  size_t capacity = 128;
+  LockFreeCircularQueue<int> q(capacity);
+
+  size_t initial = 10;
+  for (size_t i = 0; i < initial; ++i)
+    EXPECT_TRUE(q.push(i));
+
+  for (size_t i = initial; i < 1000 * capacity; ++i) {
+    EXPECT_TRUE(q.push(i));
+    int popped = 0;
+    EXPECT_TRUE(q.pop(&popped));
+    EXPECT_EQ(static_cast<int>(i - initial), popped);
+  }
+}
+
+TEST(LockFreeCircularQueue, PushWhenFull) {
+  size_t capacity = 128;
+  LockFreeCircularQueue<int> q(capacity);
+  EXPECT_TRUE(q.empty());
+
+  for (size_t i = 0; i < capacity; ++i) {
+    EXPECT_TRUE(q.push(i));
+    EXPECT_FALSE(q.empty());
+  }
+
+  EXPECT_EQ(capacity, q.size());
+
+  EXPECT_FALSE(q.push(1));
+  EXPECT_FALSE(q.push(2));
+  EXPECT_FALSE(q.push(3));
+
+  EXPECT_EQ(capacity, q.size());
+}
+
+TEST(LockFreeCircularQueue, PopWhenEmpty) {
+  size_t capacity = 128;
+  LockFreeCircularQueue<int> q(capacity);
+  int popped = 0;
+  EXPECT_FALSE(q.pop(&popped));
+  EXPECT_TRUE(q.push(42));
+  EXPECT_TRUE(q.pop(&popped));
+  EXPECT_EQ(42, popped);
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(LockFreeCircularQueue, PopUntilEmpty) {
+  size_t capacity = 128;
+  LockFreeCircularQueue<int> q(capacity);
+
+  for (size_t i = 0; i < capacity; ++i) {
+    EXPECT_TRUE(q.push(i));
+    EXPECT_FALSE(q.empty());
+  }
+
+  int popped = 0;
+  while (q.pop(&popped)) { }
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(0u, q.size());
+}
+
+TEST(LockFreeCircularQueue, ConcurrentProducersComplyWithFIFO) {
+  const uint32 kNumProducers = 4;
+  const size_t kPushesPerProducer = 100000;
+  Producer::Queue q(128);
+
+  ScopedVector<Producer> producers;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (uint32 i = 0; i < kNumProducers; ++i) {
+    producers.push_back(new Producer(i, kPushesPerProducer, &q));
+    threads.push_back(new base::DelegateSimpleThread(
+        producers.back(), base::StringPrintf("producer-%u", i)));
+  }
+
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Start();
+
+  // Drain the queue from this thread, checking that the values of each
+  // producer arrive in the order in which they were pushed.
+  uint32 expected[kNumProducers] = {};
+  size_t popped_count = 0;
+  while (popped_count < kNumProducers * kPushesPerProducer) {
+    uint32 value = 0;
+    if (!q.pop(&value))
+      continue;
+    uint32 id = value >> 24;
+    ASSERT_LT(id, kNumProducers);
+    EXPECT_EQ(expected[id], value & 0x00FFFFFF);
+    ++expected[id];
+    ++popped_count;
+  }
+
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Join();
+
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(LockFreeCircularQueue, MemoryNotifierIsCalled) {
+  MockMemoryNotifier mock_notifier;
+
+  // Should be called by the underlying container.
+  EXPECT_CALL(mock_notifier,
+    NotifyInternalUse(_, _))
+    .Times(AtLeast(1));
+
+  // Ensure no calls to NotifyFutureHeapUse.
+  EXPECT_CALL(mock_notifier,
+    NotifyFutureHeapUse(_, _))
+    .Times(0);
+
+  // Should be called by the underlying container.
+  EXPECT_CALL(mock_notifier,
+    NotifyReturnedToOS(_, _))
+    .Times(AtLeast(1));
+
+  size_t capacity = 65536;
+  LockFreeCircularQueue<int, MemoryNotifierAllocator<int>> q(
+      capacity,
+      MemoryNotifierAllocator<int>(&mock_notifier));
+}
+
+}  // namespace asan
+}  // namespace agent
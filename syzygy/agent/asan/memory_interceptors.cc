@@ -53,14 +53,42 @@ void CheckStringsMemoryAccesses(
     const AsanContext& context) {
   int32 offset = 0;
 
+  // The shadow index of the last fully accessible granule validated for each
+  // pointer. String instructions make several consecutive accesses to the
+  // same group of kShadowRatio bytes, so a single compare against the
+  // previously validated shadow index skips the full check for all but the
+  // first access to each granule. Only fully accessible granules (a shadow
+  // byte of zero) may be cached: partially accessible granules only address
+  // a prefix of their bytes and must be re-checked on every access. No valid
+  // access can have a shadow index of zero, so it serves as the empty cache
+  // value.
+  uintptr_t src_valid_index = 0;
+  uintptr_t dst_valid_index = 0;
+
   for (uint32 i = 0; i < length; ++i) {
     // Check next memory location at src[offset].
-    if (src_access_mode != agent::asan::ASAN_UNKNOWN_ACCESS)
-      CheckMemoryAccess(&src[offset], src_access_mode, access_size, context);
+    if (src_access_mode != agent::asan::ASAN_UNKNOWN_ACCESS) {
+      uintptr_t index = Shadow::AddressToIndex(&src[offset]);
+      if (index != src_valid_index) {
+        CheckMemoryAccess(&src[offset], src_access_mode, access_size, context);
+        if (Shadow::GetShadowMarkerForAddress(&src[offset]) ==
+                kHeapAddressableMarker) {
+          src_valid_index = index;
+        }
+      }
+    }
 
     // Check next memory location at dst[offset].
-    if (dst_access_mode != agent::asan::ASAN_UNKNOWN_ACCESS)
-      CheckMemoryAccess(&dst[offset], dst_access_mode, access_size, context);
+    if (dst_access_mode != agent::asan::ASAN_UNKNOWN_ACCESS) {
+      uintptr_t index = Shadow::AddressToIndex(&dst[offset]);
+      if (index != dst_valid_index) {
+        CheckMemoryAccess(&dst[offset], dst_access_mode, access_size, context);
+        if (Shadow::GetShadowMarkerForAddress(&dst[offset]) ==
+                kHeapAddressableMarker) {
+          dst_valid_index = index;
+        }
+      }
+    }
 
     // For CMPS instructions, we shortcut the execution of prefix REPZ when
     // memory contents differ.
@@ -270,6 +298,14 @@ enum AccessMode {
 COMPILE_ASSERT((agent::asan::kHeapNonAccessibleMarkerMask & (1 << 7)) != 0,
                asan_shadow_mask_upper_bit_is_0);
 
+// The fast path statically specializes the shadow offset computation for the
+// default 1/8 shadow ratio ("sar edx, 3" above), so there's no runtime
+// arithmetic on the ratio. Other ratios must regenerate these probes; the
+// C++ code paths pick up a changed ratio automatically through
+// kShadowRatioLog.
+COMPILE_ASSERT(agent::asan::kShadowRatioLog == 3,
+               asm_probes_assume_a_shadow_ratio_of_8);
+
 // Generate the flag-saving memory access intercept functions.
 ASAN_MEM_INTERCEPT_FUNCTIONS(ASAN_CHECK_FUNCTION)
 
@@ -285,6 +321,92 @@ ASAN_MEM_INTERCEPT_FUNCTIONS(ASAN_CHECK_FUNCTION_NO_FLAGS)
 #undef ASAN_SLOW_PATH
 #undef ASAN_ERROR_PATH
 
+// State shared by the sampled and count-only interceptor variants. See the
+// header for details.
+extern "C" {
+uint32 asan_memory_access_count = 0;
+uint32 asan_sampling_interval = 4096;
+uint32 asan_sampling_countdown = 4096;
+}
+
+// Generates the sampled variant of a flag-saving memory interceptor. The
+// countdown is decremented on every access; when it reaches zero it is
+// rearmed from the interval and the access is forwarded to the full check,
+// which sees an unmodified stack and EDX. All other accesses return
+// unchecked. The decrement/rearm pair is not atomic, which is benign: a race
+// merely shifts the sampling phase.
+#define ASAN_CHECK_FUNCTION_SAMPLED(access_size,  \
+                                    access_mode_str,  \
+                                    access_mode_value)  \
+  extern "C" __declspec(naked)  \
+      void asan_check_sampled_ ## access_size ## _byte_ ##  \
+          access_mode_str ## () {  \
+    __asm {  \
+      __asm pushfd  \
+      __asm lock dec DWORD PTR[asan_sampling_countdown]  \
+      __asm jz sampled_check  \
+      __asm popfd  \
+      /* Restore original EDX. */  \
+      __asm mov edx, DWORD PTR[esp + 4]  \
+      __asm ret 4  \
+    __asm sampled_check:  \
+      /* Rearm the countdown and forward to the full check. */  \
+      __asm push eax  \
+      __asm mov eax, DWORD PTR[asan_sampling_interval]  \
+      __asm mov DWORD PTR[asan_sampling_countdown], eax  \
+      __asm pop eax  \
+      __asm popfd  \
+      __asm jmp asan_check_ ## access_size ## _byte_ ## access_mode_str  \
+    }  \
+  }
+
+// As above, for the non-flag saving variants. These may alter EFLAGS, so no
+// save/restore is needed around the countdown update.
+#define ASAN_CHECK_FUNCTION_SAMPLED_NO_FLAGS(access_size,  \
+                                             access_mode_str,  \
+                                             access_mode_value)  \
+  extern "C" __declspec(naked)  \
+      void asan_check_sampled_ ## access_size ## _byte_ ##  \
+          access_mode_str ## _no_flags() {  \
+    __asm {  \
+      __asm lock dec DWORD PTR[asan_sampling_countdown]  \
+      __asm jz sampled_check  \
+      /* Restore original EDX. */  \
+      __asm mov edx, DWORD PTR[esp + 4]  \
+      __asm ret 4  \
+    __asm sampled_check:  \
+      /* Rearm the countdown and forward to the full check. */  \
+      __asm push eax  \
+      __asm mov eax, DWORD PTR[asan_sampling_interval]  \
+      __asm mov DWORD PTR[asan_sampling_countdown], eax  \
+      __asm pop eax  \
+      __asm jmp asan_check_ ## access_size ## _byte_ ## access_mode_str ##  \
+          _no_flags  \
+    }  \
+  }
+
+// Generate the sampled memory access intercept functions.
+ASAN_MEM_INTERCEPT_FUNCTIONS(ASAN_CHECK_FUNCTION_SAMPLED)
+ASAN_MEM_INTERCEPT_FUNCTIONS(ASAN_CHECK_FUNCTION_SAMPLED_NO_FLAGS)
+
+#undef ASAN_CHECK_FUNCTION_SAMPLED
+#undef ASAN_CHECK_FUNCTION_SAMPLED_NO_FLAGS
+
+// The count-only variant serving all the memory interceptors. It observes
+// the same calling convention as the checks it replaces and preserves
+// EFLAGS, so it can stand in for both the flag-saving and non-flag saving
+// variants.
+extern "C" __declspec(naked) void asan_count_only_check() {
+  __asm {
+    pushfd
+    lock inc DWORD PTR[asan_memory_access_count]
+    popfd
+    // Restore original EDX.
+    mov edx, DWORD PTR[esp + 4]
+    ret 4
+  }
+}
+
 // Generates the asan check access functions for a string instruction.
 // The name of the generated method will be
 // asan_check_(@p prefix)(@p access_size)_byte_(@p inst)_access().
@@ -350,3 +472,44 @@ ASAN_MEM_INTERCEPT_FUNCTIONS(ASAN_CHECK_FUNCTION_NO_FLAGS)
 ASAN_STRING_INTERCEPT_FUNCTIONS(ASAN_CHECK_STRINGS)
 
 #undef ASAN_CHECK_STRINGS
+
+// Generates the sampled variant of a string instruction interceptor. Same
+// countdown scheme as the sampled memory interceptors; a forwarded access
+// reaches the full check with all registers and the stack unmodified.
+#define ASAN_CHECK_STRINGS_SAMPLED(func, prefix, counter, dst_mode,  \
+    src_mode, access_size, compare)  \
+  extern "C" __declspec(naked)  \
+  void asan_check_sampled ## prefix ## access_size ## _byte_ ## func ##  \
+      _access() {  \
+    __asm {  \
+      __asm pushfd  \
+      __asm lock dec DWORD PTR[asan_sampling_countdown]  \
+      __asm jz sampled_check  \
+      __asm popfd  \
+      __asm ret  \
+    __asm sampled_check:  \
+      /* Rearm the countdown and forward to the full check. */  \
+      __asm push eax  \
+      __asm mov eax, DWORD PTR[asan_sampling_interval]  \
+      __asm mov DWORD PTR[asan_sampling_countdown], eax  \
+      __asm pop eax  \
+      __asm popfd  \
+      __asm jmp asan_check ## prefix ## access_size ## _byte_ ## func ##  \
+          _access  \
+    }  \
+  }
+
+// Generate the sampled string instruction intercept functions.
+ASAN_STRING_INTERCEPT_FUNCTIONS(ASAN_CHECK_STRINGS_SAMPLED)
+
+#undef ASAN_CHECK_STRINGS_SAMPLED
+
+// The count-only variant serving all the string instruction interceptors.
+extern "C" __declspec(naked) void asan_count_only_string_check() {
+  __asm {
+    pushfd
+    lock inc DWORD PTR[asan_memory_access_count]
+    popfd
+    ret
+  }
+}
@@ -16,6 +16,8 @@
 #ifndef SYZYGY_AGENT_ASAN_MEMORY_INTERCEPTORS_H_
 #define SYZYGY_AGENT_ASAN_MEMORY_INTERCEPTORS_H_
 
+#include "base/basictypes.h"
+
 namespace agent {
 namespace asan {
 
@@ -83,6 +85,48 @@ ASAN_STRING_INTERCEPT_FUNCTIONS(DECLARE_STRING_INTERCEPT_FUNCTIONS)
 
 #undef DECLARE_STRING_INTERCEPT_FUNCTIONS
 
+#define DECLARE_SAMPLED_MEM_INTERCEPT_FUNCTIONS(access_size, \
+                                                access_mode_str, \
+                                                access_mode_value) \
+    void asan_check_sampled_ ## access_size ## _byte_ ## access_mode_str(); \
+    void asan_check_sampled_ ## access_size ## _byte_ ## access_mode_str ## \
+        _no_flags();
+
+// Declare the sampled variants of the memory interceptor functions. These
+// forward one access out of asan_sampling_interval to the corresponding full
+// check and let the others through unchecked. Same calling convention as the
+// full checks; can't be invoked directly.
+ASAN_MEM_INTERCEPT_FUNCTIONS(DECLARE_SAMPLED_MEM_INTERCEPT_FUNCTIONS)
+
+#undef DECLARE_SAMPLED_MEM_INTERCEPT_FUNCTIONS
+
+#define DECLARE_SAMPLED_STRING_INTERCEPT_FUNCTIONS(func, prefix, counter, \
+                                                   dst_mode, src_mode, \
+                                                   access_size, compare) \
+  void asan_check_sampled ## prefix ## access_size ## _byte_ ## func ## \
+      _access();
+
+// Declare the sampled variants of the string instruction interceptor
+// functions.
+ASAN_STRING_INTERCEPT_FUNCTIONS(DECLARE_SAMPLED_STRING_INTERCEPT_FUNCTIONS)
+
+#undef DECLARE_SAMPLED_STRING_INTERCEPT_FUNCTIONS
+
+// The count-only interceptor variants. These perform no validation at all;
+// they only increment asan_memory_access_count. The first serves any of the
+// memory interceptors, the second any of the string interceptors.
+void asan_count_only_check();
+void asan_count_only_string_check();
+
+// The number of memory accesses observed by the count-only interceptors.
+extern uint32 asan_memory_access_count;
+
+// The period of the sampled interceptors: one access out of this many is
+// forwarded to the full check. The countdown is the shared state the probes
+// decrement; races on it are benign and only perturb the sampling phase.
+extern uint32 asan_sampling_interval;
+extern uint32 asan_sampling_countdown;
+
 }
 
 #endif  // SYZYGY_AGENT_ASAN_MEMORY_INTERCEPTORS_H_
@@ -0,0 +1,150 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/memory_interceptors_patcher.h"
+
+#include <map>
+#include <string>
+
+#include "base/logging.h"
+#include "base/win/pe_image.h"
+#include "syzygy/agent/asan/memory_interceptors.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+typedef std::map<std::string, const MemoryInterceptorVariants*> VariantMap;
+
+// The context threaded through the import enumeration below.
+struct PatchImportsContext {
+  const VariantMap* variants;
+  MemoryInterceptorTier tier;
+  size_t num_patched;
+  bool success;
+};
+
+// Overwrites the import address table entry at @p iat with @p entry_point,
+// temporarily lifting the page protection. The write itself is a naturally
+// aligned 32-bit store, so probe calls racing with the patch see either the
+// old or the new entry point, both of which are valid.
+bool PatchIatEntry(IMAGE_THUNK_DATA* iat, void (*entry_point)()) {
+  DCHECK_NE(static_cast<IMAGE_THUNK_DATA*>(NULL), iat);
+
+  DWORD old_protect = 0;
+  if (!::VirtualProtect(iat, sizeof(*iat), PAGE_READWRITE, &old_protect))
+    return false;
+  iat->u1.Function = reinterpret_cast<DWORD>(entry_point);
+  DWORD unused = 0;
+  ::VirtualProtect(iat, sizeof(*iat), old_protect, &unused);
+  return true;
+}
+
+bool PatchImportsCallback(const base::win::PEImage& image,
+                          const char* module,
+                          DWORD ordinal,
+                          const char* name,
+                          DWORD hint,
+                          IMAGE_THUNK_DATA* iat,
+                          void* cookie) {
+  DCHECK_NE(static_cast<IMAGE_THUNK_DATA*>(NULL), iat);
+  DCHECK_NE(static_cast<void*>(NULL), cookie);
+
+  PatchImportsContext* context = static_cast<PatchImportsContext*>(cookie);
+
+  // Imports by ordinal have no name and are never memory interceptors.
+  if (name == NULL)
+    return true;
+
+  VariantMap::const_iterator it = context->variants->find(name);
+  if (it == context->variants->end())
+    return true;
+
+  if (!PatchIatEntry(iat, it->second->tiers[context->tier])) {
+    LOG(ERROR) << "Failed to patch import entry for \"" << name << "\".";
+    context->success = false;
+    // Stop the enumeration.
+    return false;
+  }
+
+  ++context->num_patched;
+  return true;
+}
+
+// Generates the table entries for the two variants (flag-saving and not) of
+// a memory interceptor.
+#define DEFINE_MEM_INTERCEPT_VARIANTS(access_size, access_mode_str,  \
+                                      access_mode_value)  \
+    { "asan_check_" #access_size "_byte_" #access_mode_str,  \
+      { &asan_check_ ## access_size ## _byte_ ## access_mode_str,  \
+        &asan_check_sampled_ ## access_size ## _byte_ ## access_mode_str,  \
+        &asan_count_only_check } },  \
+    { "asan_check_" #access_size "_byte_" #access_mode_str "_no_flags",  \
+      { &asan_check_ ## access_size ## _byte_ ## access_mode_str ##  \
+            _no_flags,  \
+        &asan_check_sampled_ ## access_size ## _byte_ ## access_mode_str ##  \
+            _no_flags,  \
+        &asan_count_only_check } },
+
+// Generates the table entry for a string instruction interceptor.
+#define DEFINE_STRING_INTERCEPT_VARIANTS(func, prefix, counter, dst_mode,  \
+                                         src_mode, access_size, compare)  \
+    { "asan_check" #prefix #access_size "_byte_" #func "_access",  \
+      { &asan_check ## prefix ## access_size ## _byte_ ## func ## _access,  \
+        &asan_check_sampled ## prefix ## access_size ## _byte_ ## func ##  \
+            _access,  \
+        &asan_count_only_string_check } },
+
+}  // namespace
+
+const MemoryInterceptorVariants kMemoryInterceptorVariants[] = {
+    ASAN_MEM_INTERCEPT_FUNCTIONS(DEFINE_MEM_INTERCEPT_VARIANTS)
+    ASAN_STRING_INTERCEPT_FUNCTIONS(DEFINE_STRING_INTERCEPT_VARIANTS)
+};
+
+#undef DEFINE_MEM_INTERCEPT_VARIANTS
+#undef DEFINE_STRING_INTERCEPT_VARIANTS
+
+const size_t kMemoryInterceptorVariantCount =
+    arraysize(kMemoryInterceptorVariants);
+
+bool SetMemoryInterceptorTier(HMODULE module, MemoryInterceptorTier tier) {
+  DCHECK_NE(static_cast<HMODULE>(NULL), module);
+  DCHECK_LT(tier, kInterceptorTierCount);
+
+  VariantMap variants;
+  for (size_t i = 0; i < kMemoryInterceptorVariantCount; ++i) {
+    variants[kMemoryInterceptorVariants[i].name] =
+        &kMemoryInterceptorVariants[i];
+  }
+
+  base::win::PEImage image(module);
+  if (!image.VerifyMagic()) {
+    LOG(ERROR) << "Unable to parse module for interceptor patching.";
+    return false;
+  }
+
+  PatchImportsContext context = { &variants, tier, 0, true };
+  image.EnumAllImports(&PatchImportsCallback, &context);
+  if (!context.success)
+    return false;
+
+  LOG(INFO) << "Patched " << context.num_patched
+            << " memory interceptor import(s).";
+  return true;
+}
+
+}  // namespace asan
+}  // namespace agent
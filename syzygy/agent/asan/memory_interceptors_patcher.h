@@ -0,0 +1,73 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declarations for switching the memory interceptors of an instrumented
+// module between tiers at runtime. The instrumenter brings the interceptors
+// in as imports, so every probe call in an instrumented module goes through
+// its import address table. Rewriting those entries redirects all probe
+// calls of that module to another tier, without a restart and without
+// touching the instrumented code itself.
+
+#ifndef SYZYGY_AGENT_ASAN_MEMORY_INTERCEPTORS_PATCHER_H_
+#define SYZYGY_AGENT_ASAN_MEMORY_INTERCEPTORS_PATCHER_H_
+
+#include <windows.h>
+
+#include "base/basictypes.h"
+
+namespace agent {
+namespace asan {
+
+// The interceptor tiers that may be selected per instrumented module.
+enum MemoryInterceptorTier {
+  // The full checks the instrumenter wires up by default.
+  kFullCheckTier,
+
+  // One access out of asan_sampling_interval is forwarded to the full
+  // check; the others go unchecked.
+  kSampledTier,
+
+  // No validation at all; accesses are only counted.
+  kCountOnlyTier,
+
+  // Must be last.
+  kInterceptorTierCount,
+};
+
+// Describes the tier variants of one memory interceptor export.
+struct MemoryInterceptorVariants {
+  // The name under which the instrumenter imports the interceptor.
+  const char* name;
+
+  // The entry point implementing each tier of this interceptor.
+  void (*tiers[kInterceptorTierCount])();
+};
+
+// The variants of every memory interceptor the RTL exports.
+extern const MemoryInterceptorVariants kMemoryInterceptorVariants[];
+extern const size_t kMemoryInterceptorVariantCount;
+
+// Rewrites the import address table of @p module so that all of its memory
+// interceptor calls dispatch to the entry points of @p tier. Modules that
+// import no memory interceptors are left unchanged. May be called any
+// number of times to dial the instrumentation cost up and down.
+// @param module The instrumented module to patch.
+// @param tier The tier to dispatch to.
+// @returns true on success, false if an import entry could not be patched.
+bool SetMemoryInterceptorTier(HMODULE module, MemoryInterceptorTier tier);
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_MEMORY_INTERCEPTORS_PATCHER_H_
@@ -0,0 +1,59 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/memory_interceptors_patcher.h"
+
+#include <set>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/memory_interceptors.h"
+
+namespace agent {
+namespace asan {
+
+TEST(MemoryInterceptorsPatcherTest, VariantTableIsWellFormed) {
+  std::set<std::string> names;
+  for (size_t i = 0; i < kMemoryInterceptorVariantCount; ++i) {
+    const MemoryInterceptorVariants& variants = kMemoryInterceptorVariants[i];
+    ASSERT_TRUE(variants.name != NULL);
+
+    // Every entry carries the import name the instrumenter uses, and the
+    // names are unique.
+    EXPECT_EQ(0u, std::string(variants.name).find("asan_check"));
+    EXPECT_TRUE(names.insert(variants.name).second);
+
+    // Every tier has an entry point, and the cheap tiers actually differ
+    // from the full check.
+    for (size_t tier = 0; tier < kInterceptorTierCount; ++tier)
+      EXPECT_TRUE(variants.tiers[tier] != NULL);
+    EXPECT_NE(variants.tiers[kFullCheckTier], variants.tiers[kSampledTier]);
+    EXPECT_NE(variants.tiers[kFullCheckTier],
+              variants.tiers[kCountOnlyTier]);
+  }
+}
+
+TEST(MemoryInterceptorsPatcherTest, PatchModuleWithoutInterceptors) {
+  // The test executable imports no memory interceptors, so patching it is a
+  // no-op that must succeed for every tier.
+  HMODULE self = ::GetModuleHandle(NULL);
+  ASSERT_TRUE(self != NULL);
+  for (size_t tier = 0; tier < kInterceptorTierCount; ++tier) {
+    EXPECT_TRUE(SetMemoryInterceptorTier(
+        self, static_cast<MemoryInterceptorTier>(tier)));
+  }
+}
+
+}  // namespace asan
+}  // namespace agent
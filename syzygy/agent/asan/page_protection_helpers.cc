@@ -22,6 +22,37 @@ namespace asan {
 
 ::common::RecursiveLock block_protect_lock;
 
+namespace {
+
+// Returns true if any page in the given range is marked as protected in the
+// shadow page bits. The page bits exactly mirror the protections applied by
+// the BlockProtect* functions, so they can be used to elide redundant
+// VirtualProtect calls. The caller must exclude concurrent protection
+// changes, typically by holding block_protect_lock.
+bool AnyPagesProtected(const uint8* addr, size_t size) {
+  const uint8* page = addr;
+  const uint8* page_end = addr + size;
+  for (; page < page_end; page += GetPageSize()) {
+    if (Shadow::PageIsProtected(page))
+      return true;
+  }
+  return false;
+}
+
+// Returns true if every page in the given range is marked as protected in the
+// shadow page bits. Must be called under block_protect_lock.
+bool AllPagesProtected(const uint8* addr, size_t size) {
+  const uint8* page = addr;
+  const uint8* page_end = addr + size;
+  for (; page < page_end; page += GetPageSize()) {
+    if (!Shadow::PageIsProtected(page))
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
 bool GetBlockInfo(const void* raw_body, CompactBlockInfo* block_info) {
   DCHECK_NE(static_cast<void*>(NULL), raw_body);
   DCHECK_NE(static_cast<CompactBlockInfo*>(NULL), block_info);
@@ -58,7 +89,20 @@ void BlockProtectNone(const BlockInfo& block_info) {
     return;
 
   ::common::AutoRecursiveLock lock(block_protect_lock);
+  BlockProtectNoneUnlocked(block_info);
+}
+
+void BlockProtectNoneUnlocked(const BlockInfo& block_info) {
+  if (block_info.block_pages_size == 0)
+    return;
+
   DCHECK_NE(static_cast<uint8*>(NULL), block_info.block_pages);
+
+  // Heaps that pool their blocks recycle them with no protections in place,
+  // making this a frequent no-op. Skip the kernel transition in that case.
+  if (!AnyPagesProtected(block_info.block_pages, block_info.block_pages_size))
+    return;
+
   DWORD old_protection = 0;
   DWORD ret = ::VirtualProtect(block_info.block_pages,
                                block_info.block_pages_size,
@@ -106,6 +150,11 @@ void BlockProtectAll(const BlockInfo& block_info) {
 
   ::common::AutoRecursiveLock lock(block_protect_lock);
   DCHECK_NE(static_cast<uint8*>(NULL), block_info.block_pages);
+
+  // Skip the kernel transition if the pages are already fully protected.
+  if (AllPagesProtected(block_info.block_pages, block_info.block_pages_size))
+    return;
+
   DWORD old_protection = 0;
   DWORD ret = ::VirtualProtect(block_info.block_pages,
                                block_info.block_pages_size,
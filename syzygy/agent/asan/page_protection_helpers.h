@@ -49,6 +49,14 @@ bool GetBlockInfo(const void* raw_block, BlockInfo* block_info);
 // @note Under block_protect_lock.
 void BlockProtectNone(const BlockInfo& block_info);
 
+// As BlockProtectNone, but does not acquire block_protect_lock. This is for
+// use by workers of a sweep whose coordinating thread already holds
+// block_protect_lock, which excludes all other protection changes; the
+// shadow page bits are internally synchronized so concurrent workers may
+// safely use this on disjoint blocks.
+// @param block_info The block whose protections are to be modified.
+void BlockProtectNoneUnlocked(const BlockInfo& block_info);
+
 // Protects all entire pages that are spanned by the redzones of the
 // block. All pages intersecting the body of the block will be explicitly
 // unprotected. All pages not intersecting the body but only partially
@@ -0,0 +1,130 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implements a thread-local cache that sits in front of another quarantine.
+
+#ifndef SYZYGY_AGENT_ASAN_QUARANTINES_THREAD_LOCAL_QUARANTINE_CACHE_H_
+#define SYZYGY_AGENT_ASAN_QUARANTINES_THREAD_LOCAL_QUARANTINE_CACHE_H_
+
+#include <vector>
+
+#include "base/synchronization/lock.h"
+#include "base/threading/thread_local.h"
+#include "syzygy/agent/asan/quarantines/size_limited_quarantine.h"
+
+namespace agent {
+namespace asan {
+namespace quarantines {
+
+// A thread-local cache layered in front of another quarantine. Pushed objects
+// accumulate in a small per-thread buffer and are transferred to the
+// underlying quarantine in batches, grouped by lock ID. This amortizes the
+// cost of acquiring the underlying quarantine's locks, which otherwise must
+// be taken once per push and are heavily contended on many-core machines.
+//
+// The lock exposed via GetLockId/Lock/Unlock is that of the calling thread's
+// cache. Since the cache is private to the thread this lock is effectively
+// uncontended; it only serves to synchronize against another thread draining
+// the caches via 'Empty'. Objects are invisible to other threads until they
+// have been flushed; in particular an object pushed under the quarantine lock
+// cannot be popped before the lock has been released, as the flush of a full
+// cache happens before the new object is added to it.
+//
+// Objects cached by a thread that stops freeing (or dies) remain in its cache
+// until 'Empty' is called; caches are never reclaimed before the quarantine
+// itself is destroyed.
+//
+// @tparam QuarantineType The type of the underlying quarantine. This must be
+//     derived from SizeLimitedQuarantineImpl.
+template<typename QuarantineType>
+class ThreadLocalQuarantineCache : public QuarantineType {
+ public:
+  typedef typename QuarantineType::Object Object;
+  typedef typename QuarantineType::ObjectVector ObjectVector;
+
+  // The default number of objects a thread accumulates before flushing.
+  static const size_t kDefaultFlushThreshold = 16;
+
+  // Constructor.
+  ThreadLocalQuarantineCache();
+
+  // Virtual destructor. Frees the per-thread caches.
+  virtual ~ThreadLocalQuarantineCache();
+
+  // Sets the number of objects a thread may accumulate locally before they
+  // are flushed to the underlying quarantine.
+  // @param flush_threshold The new flush threshold. Must be at least 1.
+  void set_flush_threshold(size_t flush_threshold) {
+    DCHECK_LT(0u, flush_threshold);
+    flush_threshold_ = flush_threshold;
+  }
+
+  // @returns the flush threshold.
+  size_t flush_threshold() const { return flush_threshold_; }
+
+ protected:
+  // A per-thread buffer of objects pending insertion into the underlying
+  // quarantine.
+  struct ThreadCache {
+    // The lock protecting this cache. Acquired by the owning thread around
+    // pushes, and by any thread draining the caches via 'Empty'.
+    base::Lock lock;
+    // The cached objects. Under lock.
+    ObjectVector objects;
+  };
+
+  // @name SizeLimitedQuarantineImpl implementation.
+  // @{
+  virtual bool PushImpl(const Object& object);
+  virtual bool PopImpl(Object* object);
+  virtual void EmptyImpl(ObjectVector* objects);
+  virtual size_t GetLockIdImpl(const Object& object);
+  virtual void LockImpl(size_t id);
+  virtual void UnlockImpl(size_t id);
+  // @}
+
+  // Returns the calling thread's cache, creating and registering it on first
+  // use.
+  ThreadCache* GetOrCreateThreadCache();
+
+  // Transfers the contents of the given cache to the underlying quarantine,
+  // taking each of its locks once per batch of objects sharing it. Objects
+  // refused by the underlying quarantine are retained in the cache and will
+  // be retried by a later flush. This must only be called by the thread
+  // owning the cache, or under its lock.
+  // @param cache The cache to flush.
+  void FlushThreadCache(ThreadCache* cache);
+
+  // The number of objects a thread accumulates before flushing.
+  size_t flush_threshold_;
+
+  // The calling thread's cache. Lazily initialized.
+  base::ThreadLocalPointer<ThreadCache> tls_cache_;
+
+  // All of the caches that have been created, so that 'Empty' can drain
+  // them. Under caches_lock_.
+  std::vector<ThreadCache*> caches_;
+  base::Lock caches_lock_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ThreadLocalQuarantineCache);
+};
+
+}  // namespace quarantines
+}  // namespace asan
+}  // namespace agent
+
+#include "syzygy/agent/asan/quarantines/thread_local_quarantine_cache_impl.h"
+
+#endif  // SYZYGY_AGENT_ASAN_QUARANTINES_THREAD_LOCAL_QUARANTINE_CACHE_H_
@@ -0,0 +1,165 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Internal implementation of a thread-local quarantine cache. This file is
+// not meant to be included directly.
+
+#ifndef SYZYGY_AGENT_ASAN_QUARANTINES_THREAD_LOCAL_QUARANTINE_CACHE_IMPL_H_
+#define SYZYGY_AGENT_ASAN_QUARANTINES_THREAD_LOCAL_QUARANTINE_CACHE_IMPL_H_
+
+namespace agent {
+namespace asan {
+namespace quarantines {
+
+template<typename QT>
+ThreadLocalQuarantineCache<QT>::ThreadLocalQuarantineCache()
+    : flush_threshold_(kDefaultFlushThreshold) {
+}
+
+template<typename QT>
+ThreadLocalQuarantineCache<QT>::~ThreadLocalQuarantineCache() {
+  base::AutoLock auto_lock(caches_lock_);
+  for (size_t i = 0; i < caches_.size(); ++i)
+    delete caches_[i];
+  caches_.clear();
+}
+
+template<typename QT>
+bool ThreadLocalQuarantineCache<QT>::PushImpl(const Object& object) {
+  ThreadCache* cache = GetOrCreateThreadCache();
+
+  // Flush pending objects before adding the new one. This keeps |object|
+  // invisible to other threads until the caller releases the quarantine
+  // lock, which is this thread's cache lock rather than a lock covering
+  // the underlying quarantine.
+  if (cache->objects.size() >= flush_threshold_)
+    FlushThreadCache(cache);
+
+  cache->objects.push_back(object);
+  return true;
+}
+
+template<typename QT>
+bool ThreadLocalQuarantineCache<QT>::PopImpl(Object* object) {
+  DCHECK_NE(static_cast<Object*>(NULL), object);
+  if (QT::PopImpl(object))
+    return true;
+
+  // The underlying quarantine has run dry but the size invariant is still
+  // violated, so the outstanding objects must be sitting in thread-local
+  // caches. Flush the calling thread's cache and try again; objects cached
+  // by other threads will be flushed by those threads.
+  ThreadCache* cache = tls_cache_.Get();
+  if (cache == NULL)
+    return false;
+  {
+    base::AutoLock auto_lock(cache->lock);
+    if (cache->objects.empty())
+      return false;
+    FlushThreadCache(cache);
+  }
+  return QT::PopImpl(object);
+}
+
+template<typename QT>
+void ThreadLocalQuarantineCache<QT>::EmptyImpl(ObjectVector* objects) {
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
+
+  // Drain every thread's cache, including those of threads that have died.
+  {
+    base::AutoLock auto_lock(caches_lock_);
+    for (size_t i = 0; i < caches_.size(); ++i) {
+      base::AutoLock cache_lock(caches_[i]->lock);
+      objects->insert(objects->end(),
+                      caches_[i]->objects.begin(),
+                      caches_[i]->objects.end());
+      caches_[i]->objects.clear();
+    }
+  }
+
+  QT::EmptyImpl(objects);
+}
+
+template<typename QT>
+size_t ThreadLocalQuarantineCache<QT>::GetLockIdImpl(const Object& object) {
+  return reinterpret_cast<size_t>(GetOrCreateThreadCache());
+}
+
+template<typename QT>
+void ThreadLocalQuarantineCache<QT>::LockImpl(size_t id) {
+  DCHECK_NE(0u, id);
+  reinterpret_cast<ThreadCache*>(id)->lock.Acquire();
+}
+
+template<typename QT>
+void ThreadLocalQuarantineCache<QT>::UnlockImpl(size_t id) {
+  DCHECK_NE(0u, id);
+  reinterpret_cast<ThreadCache*>(id)->lock.AssertAcquired();
+  reinterpret_cast<ThreadCache*>(id)->lock.Release();
+}
+
+template<typename QT>
+typename ThreadLocalQuarantineCache<QT>::ThreadCache*
+ThreadLocalQuarantineCache<QT>::GetOrCreateThreadCache() {
+  ThreadCache* cache = tls_cache_.Get();
+  if (cache != NULL)
+    return cache;
+
+  cache = new ThreadCache();
+  {
+    base::AutoLock auto_lock(caches_lock_);
+    caches_.push_back(cache);
+  }
+  tls_cache_.Set(cache);
+  return cache;
+}
+
+template<typename QT>
+void ThreadLocalQuarantineCache<QT>::FlushThreadCache(ThreadCache* cache) {
+  DCHECK_NE(static_cast<ThreadCache*>(NULL), cache);
+
+  ObjectVector& objects = cache->objects;
+
+  // Precompute the lock IDs so the hash of each object is only taken once.
+  std::vector<size_t> lock_ids(objects.size());
+  for (size_t i = 0; i < objects.size(); ++i)
+    lock_ids[i] = QT::GetLockIdImpl(objects[i]);
+
+  // Push the objects a lock at a time, transferring every object sharing a
+  // lock while it is held. Objects the underlying quarantine refuses are
+  // retained so that a later flush can retry them.
+  ObjectVector retained;
+  std::vector<bool> handled(objects.size(), false);
+  for (size_t i = 0; i < objects.size(); ++i) {
+    if (handled[i])
+      continue;
+    QT::LockImpl(lock_ids[i]);
+    for (size_t j = i; j < objects.size(); ++j) {
+      if (handled[j] || lock_ids[j] != lock_ids[i])
+        continue;
+      if (!QT::PushImpl(objects[j]))
+        retained.push_back(objects[j]);
+      handled[j] = true;
+    }
+    QT::UnlockImpl(lock_ids[i]);
+  }
+
+  objects.swap(retained);
+}
+
+}  // namespace quarantines
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_QUARANTINES_THREAD_LOCAL_QUARANTINE_CACHE_IMPL_H_
@@ -0,0 +1,209 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/quarantines/thread_local_quarantine_cache.h"
+
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/quarantines/sharded_quarantine.h"
+
+namespace agent {
+namespace asan {
+namespace quarantines {
+
+namespace {
+
+struct DummyObject {
+  size_t size;
+  size_t hash;
+
+  DummyObject() : size(0), hash(0) { }
+  explicit DummyObject(size_t size) : size(size), hash(0) { }
+};
+
+struct DummyObjectSizeFunctor {
+  size_t operator()(const DummyObject& o) {
+    return o.size;
+  }
+};
+
+struct DummyObjectHashFunctor {
+  uint32 operator()(const DummyObject& o) {
+    return o.hash;
+  }
+};
+
+typedef ShardedQuarantine<DummyObject,
+                          DummyObjectSizeFunctor,
+                          DummyObjectHashFunctor,
+                          8> DummyShardedQuarantine;
+
+class TestQuarantineCache
+    : public ThreadLocalQuarantineCache<DummyShardedQuarantine> {
+ public:
+  typedef ThreadLocalQuarantineCache<DummyShardedQuarantine> Super;
+
+  // Counts the objects sitting in the underlying sharded quarantine,
+  // excluding those still held in thread-local caches.
+  size_t FlushedCount() {
+    size_t count = 0;
+    for (size_t i = 0; i < kShardingFactor; ++i) {
+      Node* node = heads_[i];
+      while (node) {
+        ++count;
+        node = node->next;
+      }
+    }
+    return count;
+  }
+};
+
+// Pushes a fixed number of objects into the given quarantine, using the
+// quarantine lock as a real consumer would.
+class PushingThread : public base::DelegateSimpleThread::Delegate {
+ public:
+  PushingThread(TestQuarantineCache* q, size_t count)
+      : q_(q), count_(count) {
+  }
+
+  virtual void Run() OVERRIDE {
+    DummyObject d(1);
+    for (size_t i = 0; i < count_; ++i) {
+      d.hash = i;
+      TestQuarantineCache::AutoQuarantineLock lock(q_, d);
+      EXPECT_TRUE(q_->Push(d));
+    }
+  }
+
+ private:
+  TestQuarantineCache* q_;
+  size_t count_;
+};
+
+}  // namespace
+
+TEST(ThreadLocalQuarantineCacheTest, PushesAreBatched) {
+  TestQuarantineCache q;
+  q.set_flush_threshold(10);
+  q.set_max_quarantine_size(10000);
+
+  // The first |flush_threshold| objects accumulate in this thread's cache
+  // without reaching the underlying quarantine. They are still accounted
+  // for in the quarantine size and count.
+  DummyObject d(1);
+  for (size_t i = 0; i < 10; ++i) {
+    d.hash = i;
+    EXPECT_TRUE(q.Push(d));
+    EXPECT_EQ(i + 1, q.size());
+    EXPECT_EQ(i + 1, q.GetCount());
+    EXPECT_EQ(0u, q.FlushedCount());
+  }
+
+  // The next push flushes the cached objects, but itself stays cached.
+  EXPECT_TRUE(q.Push(d));
+  EXPECT_EQ(11u, q.size());
+  EXPECT_EQ(10u, q.FlushedCount());
+}
+
+TEST(ThreadLocalQuarantineCacheTest, EmptyDrainsCaches) {
+  TestQuarantineCache q;
+  q.set_flush_threshold(100);
+
+  // Push some objects; with such a high threshold they all stay cached.
+  DummyObject d(1);
+  for (size_t i = 0; i < 20; ++i) {
+    d.hash = i;
+    EXPECT_TRUE(q.Push(d));
+  }
+  EXPECT_EQ(0u, q.FlushedCount());
+
+  // Empty must return the cached objects as well.
+  TestQuarantineCache::ObjectVector objects;
+  q.Empty(&objects);
+  EXPECT_EQ(20u, objects.size());
+  EXPECT_EQ(0u, q.size());
+  EXPECT_EQ(0u, q.GetCount());
+}
+
+TEST(ThreadLocalQuarantineCacheTest, PopReachesFlushedObjects) {
+  TestQuarantineCache q;
+  q.set_flush_threshold(5);
+  q.set_max_quarantine_size(10);
+
+  // Saturate the quarantine well past its maximum size so that flushed
+  // objects are available to pop.
+  DummyObject d(1);
+  for (size_t i = 0; i < 30; ++i) {
+    d.hash = i;
+    EXPECT_TRUE(q.Push(d));
+  }
+
+  DummyObject popped;
+  while (q.size() > q.max_quarantine_size())
+    EXPECT_TRUE(q.Pop(&popped));
+  EXPECT_FALSE(q.Pop(&popped));
+}
+
+TEST(ThreadLocalQuarantineCacheTest, PopFlushesCallingThreadCache) {
+  TestQuarantineCache q;
+  q.set_flush_threshold(100);
+
+  // All of these stay in the calling thread's cache.
+  DummyObject d(1);
+  for (size_t i = 0; i < 20; ++i) {
+    d.hash = i;
+    EXPECT_TRUE(q.Push(d));
+  }
+  EXPECT_EQ(0u, q.FlushedCount());
+
+  // Invalidate the size invariant; popping must flush the calling thread's
+  // cache to get at the objects.
+  q.set_max_quarantine_size(10);
+  DummyObject popped;
+  while (q.size() > q.max_quarantine_size())
+    EXPECT_TRUE(q.Pop(&popped));
+  EXPECT_EQ(10u, q.size());
+}
+
+TEST(ThreadLocalQuarantineCacheTest, ConcurrentPushes) {
+  TestQuarantineCache q;
+  q.set_flush_threshold(8);
+  q.set_max_quarantine_size(TestQuarantineCache::kUnboundedSize);
+
+  static const size_t kThreadCount = 8;
+  static const size_t kPushesPerThread = 1000;
+
+  ScopedVector<PushingThread> delegates;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    delegates.push_back(new PushingThread(&q, kPushesPerThread));
+    threads.push_back(
+        new base::DelegateSimpleThread(delegates.back(), "pushing thread"));
+    threads.back()->Start();
+  }
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Join();
+
+  // All of the objects must be accounted for between the underlying
+  // quarantine and the per-thread caches. The size and count bookkeeping is
+  // best-effort under concurrency, so only the actual contents are checked.
+  TestQuarantineCache::ObjectVector objects;
+  q.Empty(&objects);
+  EXPECT_EQ(kThreadCount * kPushesPerThread, objects.size());
+}
+
+}  // namespace quarantines
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,155 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/redzone_tuner.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "syzygy/common/asan_parameters.h"
+
+namespace agent {
+namespace asan {
+
+RedzoneTuner::RedzoneTuner()
+    : target_percent_(::common::kDefaultAdaptiveRedzoneTargetPercent),
+      default_padding_(::common::kDefaultTrailerPaddingSize),
+      allocations_since_retune_(0) {
+  ::memset(const_cast<LONG*>(counts_), 0, sizeof(counts_));
+  SetParameters(target_percent_, default_padding_);
+}
+
+void RedzoneTuner::SetParameters(uint32 target_percent,
+                                 uint32 default_padding) {
+  target_percent_ = target_percent;
+  default_padding_ = default_padding;
+  for (size_t i = 0; i < kSizeClassCount; ++i)
+    paddings_[i] = default_padding;
+}
+
+uint32 RedzoneTuner::OnAllocation(size_t bytes) {
+  size_t size_class = SizeClass(bytes);
+  ::InterlockedIncrement(&counts_[size_class]);
+
+  // Exactly one thread observes the interval boundary, and retunes. The
+  // other threads race past, which at worst delays the next retuning by a
+  // handful of allocations.
+  if (::InterlockedIncrement(&allocations_since_retune_) ==
+          static_cast<LONG>(kTuningInterval)) {
+    ::InterlockedExchange(&allocations_since_retune_, 0);
+    Retune();
+  }
+
+  return static_cast<uint32>(paddings_[size_class]);
+}
+
+uint32 RedzoneTuner::trailer_padding(size_t bytes) const {
+  return static_cast<uint32>(paddings_[SizeClass(bytes)]);
+}
+
+void RedzoneTuner::LogTunedParameters() const {
+  uint64 total_count = 0;
+  uint64 weighted_padding = 0;
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    total_count += counts_[i];
+    weighted_padding += static_cast<uint64>(counts_[i]) * paddings_[i];
+  }
+  if (total_count == 0)
+    return;
+
+  LOG(INFO) << "Learned trailer padding sizes, by allocation size class:";
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    if (counts_[i] == 0)
+      continue;
+    LOG(INFO) << "  <= 2^" << i << " bytes: " << paddings_[i]
+              << " bytes of padding (" << counts_[i] << " allocation(s)).";
+  }
+
+  // The nearest fixed configuration, expressed in the parameter string
+  // syntax understood by the SYZYGY_ASAN_OPTIONS environment variable and
+  // by --asan-rtl-options at instrumentation time.
+  uint32 recommended = static_cast<uint32>(weighted_padding / total_count);
+  recommended &= ~(static_cast<uint32>(kShadowRatio) - 1);
+  recommended = std::max(recommended, kMinimumTrailerPadding);
+  LOG(INFO) << "To pin the equivalent fixed configuration on the next run "
+            << "use: --" << ::common::kParamTrailerPaddingSize << "="
+            << recommended;
+}
+
+size_t RedzoneTuner::SizeClass(size_t bytes) {
+  size_t size_class = 0;
+  while ((bytes >> size_class) != 0 && size_class < kSizeClassCount - 1)
+    ++size_class;
+  return size_class;
+}
+
+void RedzoneTuner::Retune() {
+  // Snapshot the histogram. Concurrent updates may be missed, which is
+  // acceptable.
+  LONG counts[kSizeClassCount] = {};
+  uint64 total_count = 0;
+  uint64 total_bytes = 0;
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    counts[i] = counts_[i];
+    total_count += counts[i];
+    // Use the upper bound of a class as its representative size.
+    total_bytes += static_cast<uint64>(counts[i]) << i;
+  }
+  if (total_count == 0)
+    return;
+
+  // The padding budget for the sampled allocations.
+  uint64 budget = total_bytes * target_percent_ / 100;
+
+  // Water-fill the budget: hand every class the same per-allocation
+  // padding, capped by the class's own allocation size (a redzone much
+  // larger than the body it guards stops paying for itself) and by the
+  // global bounds. The second pass spreads the budget that the capped
+  // classes left unspent over the remaining classes.
+  uint64 per_alloc = budget / total_count;
+  for (size_t pass = 0; pass < 2; ++pass) {
+    uint64 spent = 0;
+    uint64 uncapped_count = 0;
+    for (size_t i = 0; i < kSizeClassCount; ++i) {
+      // Classes without samples keep their current padding.
+      if (counts[i] == 0)
+        continue;
+      uint64 cap = std::min(static_cast<uint64>(kMaximumTrailerPadding),
+                            static_cast<uint64>(1) << i);
+      uint64 padding = per_alloc;
+      if (padding >= cap) {
+        padding = cap;
+        spent += padding * counts[i];
+      } else {
+        uncapped_count += counts[i];
+      }
+      // Round down to a shadow granule, then apply the safety floor. The
+      // floor wins over the budget.
+      padding &= ~(static_cast<uint64>(kShadowRatio) - 1);
+      padding = std::max(padding,
+                         static_cast<uint64>(kMinimumTrailerPadding));
+      paddings_[i] = static_cast<LONG>(padding);
+    }
+    if (uncapped_count == 0 || spent >= budget)
+      break;
+    per_alloc = (budget - spent) / uncapped_count;
+  }
+
+  // Decay the histogram.
+  for (size_t i = 0; i < kSizeClassCount; ++i)
+    counts_[i] = counts[i] / 2;
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,117 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares RedzoneTuner, which adaptively sizes the trailer padding of
+// instrumented allocations. The tuner maintains a histogram of allocation
+// sizes, bucketed by power-of-two size class, and periodically derives a
+// per-size-class trailer padding table whose aggregate memory overhead
+// meets a configured target. Hot size classes converge towards the safety
+// floor while rare classes receive larger redzones, which keeps the
+// overhead at the target even on heavily skewed allocation-size
+// distributions that a single fixed padding size would overcharge.
+
+#ifndef SYZYGY_AGENT_ASAN_REDZONE_TUNER_H_
+#define SYZYGY_AGENT_ASAN_REDZONE_TUNER_H_
+
+#include <windows.h>
+
+#include "base/basictypes.h"
+#include "syzygy/agent/asan/constants.h"
+
+namespace agent {
+namespace asan {
+
+// Tunes trailer padding sizes from an allocation-size histogram. All of the
+// member functions are thread safe; the histogram counters are updated with
+// interlocked operations and the padding table is read without locks.
+class RedzoneTuner {
+ public:
+  // The number of power-of-two size classes tracked. Class i holds the
+  // allocations whose size is representable in i bits.
+  static const size_t kSizeClassCount = 32;
+
+  // The number of recorded allocations between retunings of the padding
+  // table.
+  static const uint32 kTuningInterval = 64 * 1024;
+
+  // The safety floor: no size class is ever tuned below one shadow granule
+  // of trailer padding.
+  static const uint32 kMinimumTrailerPadding = kShadowRatio;
+
+  // The largest trailer padding the tuner will hand out.
+  static const uint32 kMaximumTrailerPadding = 4096;
+
+  RedzoneTuner();
+
+  // Configures the tuner. May be called again when the runtime parameters
+  // change; the histogram is retained but the padding table is reset to
+  // @p default_padding until the next retuning.
+  // @param target_percent The target trailer padding overhead, expressed as
+  //     a percentage of instrumented allocation bytes.
+  // @param default_padding The padding handed out before the first
+  //     retuning, typically the configured trailer_padding_size.
+  void SetParameters(uint32 target_percent, uint32 default_padding);
+
+  // Records an allocation and returns the trailer padding to use for it.
+  // This is meant for the hot allocation path: it costs two interlocked
+  // increments, except for the one call per tuning interval that recomputes
+  // the padding table.
+  // @param bytes The size of the allocation.
+  // @returns the trailer padding size to use, in bytes.
+  uint32 OnAllocation(size_t bytes);
+
+  // Returns the current padding of the size class of @p bytes, without
+  // recording anything.
+  // @param bytes The size of the allocation.
+  // @returns the trailer padding size, in bytes.
+  uint32 trailer_padding(size_t bytes) const;
+
+  // Logs the learned padding table, and the parameter string that pins an
+  // equivalent fixed configuration for a subsequent run.
+  void LogTunedParameters() const;
+
+ protected:
+  // Returns the size class of an allocation of @p bytes.
+  static size_t SizeClass(size_t bytes);
+
+  // Recomputes the padding table from the current histogram, then decays
+  // the histogram so that the table tracks phase changes and the counters
+  // can not overflow. Racy reads of the counters are acceptable, as they
+  // only feed a heuristic.
+  void Retune();
+
+  // The target trailer padding overhead, as a percentage of allocated
+  // bytes.
+  uint32 target_percent_;
+
+  // The padding of size classes that have not yet been tuned.
+  uint32 default_padding_;
+
+  // The number of allocations recorded since the last retuning.
+  volatile LONG allocations_since_retune_;
+
+  // The allocation-size histogram, indexed by size class.
+  volatile LONG counts_[kSizeClassCount];
+
+  // The tuned per-size-class trailer padding, indexed by size class.
+  volatile LONG paddings_[kSizeClassCount];
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RedzoneTuner);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_REDZONE_TUNER_H_
@@ -0,0 +1,96 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/redzone_tuner.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// Exposes the internals of the tuner for testing.
+class TestRedzoneTuner : public RedzoneTuner {
+ public:
+  using RedzoneTuner::SizeClass;
+  using RedzoneTuner::Retune;
+};
+
+}  // namespace
+
+TEST(RedzoneTunerTest, SizeClass) {
+  EXPECT_EQ(0u, TestRedzoneTuner::SizeClass(0));
+  EXPECT_EQ(1u, TestRedzoneTuner::SizeClass(1));
+  EXPECT_EQ(2u, TestRedzoneTuner::SizeClass(2));
+  EXPECT_EQ(2u, TestRedzoneTuner::SizeClass(3));
+  EXPECT_EQ(3u, TestRedzoneTuner::SizeClass(4));
+  EXPECT_EQ(8u, TestRedzoneTuner::SizeClass(255));
+  EXPECT_EQ(9u, TestRedzoneTuner::SizeClass(256));
+  EXPECT_EQ(RedzoneTuner::kSizeClassCount - 1,
+            TestRedzoneTuner::SizeClass(0xFFFFFFFF));
+}
+
+TEST(RedzoneTunerTest, DefaultPaddingBeforeTuning) {
+  TestRedzoneTuner tuner;
+  tuner.SetParameters(25, 32);
+  EXPECT_EQ(32u, tuner.OnAllocation(100));
+  EXPECT_EQ(32u, tuner.trailer_padding(1024 * 1024));
+}
+
+TEST(RedzoneTunerTest, HotClassesConvergeToTheFloor) {
+  TestRedzoneTuner tuner;
+  tuner.SetParameters(10, 4096);
+
+  // A distribution dominated by tiny allocations can't afford more than
+  // the safety floor per allocation at a 10% overhead target.
+  for (size_t i = 0; i < 1000; ++i)
+    tuner.OnAllocation(16);
+  tuner.Retune();
+
+  EXPECT_EQ(RedzoneTuner::kMinimumTrailerPadding, tuner.trailer_padding(16));
+}
+
+TEST(RedzoneTunerTest, RareLargeClassesGetLargeRedzones) {
+  TestRedzoneTuner tuner;
+  tuner.SetParameters(25, 32);
+
+  // Mostly small allocations, with a few large outliers. The budget that
+  // the small classes can't use (they are capped at their own size) flows
+  // to the large class.
+  for (size_t i = 0; i < 1000; ++i)
+    tuner.OnAllocation(16);
+  for (size_t i = 0; i < 10; ++i)
+    tuner.OnAllocation(64 * 1024);
+  tuner.Retune();
+
+  EXPECT_EQ(32u, tuner.trailer_padding(16));
+  EXPECT_EQ(RedzoneTuner::kMaximumTrailerPadding,
+            tuner.trailer_padding(64 * 1024));
+}
+
+TEST(RedzoneTunerTest, UntouchedClassesKeepTheDefault) {
+  TestRedzoneTuner tuner;
+  tuner.SetParameters(25, 64);
+
+  for (size_t i = 0; i < 1000; ++i)
+    tuner.OnAllocation(16);
+  tuner.Retune();
+
+  // No 1MB allocation has been seen, so its class is left alone.
+  EXPECT_EQ(64u, tuner.trailer_padding(1024 * 1024));
+}
+
+}  // namespace asan
+}  // namespace agent
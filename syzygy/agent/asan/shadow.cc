@@ -14,28 +14,156 @@
 
 #include "syzygy/agent/asan/shadow.h"
 
+#include <emmintrin.h>
+
 #include <algorithm>
 
-#include "base/strings/stringprintf.h"
+#include "base/cpu.h"
+#include "base/strings/string_util.h"
 #include "syzygy/common/align.h"
 
 namespace agent {
 namespace asan {
 
+namespace {
+
+// The page granularity at which lazily poisoned shadow ranges are
+// materialized. The shadow already assumes 4KB pages for its protection
+// bits.
+const size_t kLazyPageSize = 4096;
+
+// Appends a printf-formatted string to @p buffer at @p *cursor, never
+// writing more than @p buffer_size bytes in total. The buffer is always
+// zero terminated and @p *cursor is advanced past the characters written.
+// This performs no heap allocations.
+void WriteToBuffer(char* buffer,
+                   size_t buffer_size,
+                   size_t* cursor,
+                   const char* format,
+                   ...) {
+  DCHECK_NE(reinterpret_cast<char*>(NULL), buffer);
+  DCHECK_NE(reinterpret_cast<size_t*>(NULL), cursor);
+  DCHECK_LT(*cursor, buffer_size);
+
+  va_list args;
+  va_start(args, format);
+  int written = base::vsnprintf(
+      buffer + *cursor, buffer_size - *cursor, format, args);
+  va_end(args);
+
+  // On truncation vsnprintf returns the length the output would have had,
+  // but guarantees zero termination; pin the cursor to the terminator.
+  if (written < 0 || *cursor + written >= buffer_size) {
+    *cursor = buffer_size - 1;
+  } else {
+    *cursor += written;
+  }
+}
+
+// Returns true iff SSE2 is available on this machine. Evaluated once.
+bool HaveSse2() {
+  static bool have_sse2 = base::CPU().has_sse2();
+  return have_sse2;
+}
+
+// Scalar implementation of FindFirstNonZeroShadowByte. Reads word at a time
+// where alignment permits.
+const uint8* FindFirstNonZeroShadowByteImpl(const uint8* cursor,
+                                            const uint8* cursor_end) {
+  // Head: get aligned.
+  while (cursor < cursor_end &&
+         !::common::IsAligned(cursor, sizeof(uintptr_t))) {
+    if (*cursor != 0)
+      return cursor;
+    ++cursor;
+  }
+
+  // Body: word at a time.
+  while (cursor + sizeof(uintptr_t) <= cursor_end) {
+    if (*reinterpret_cast<const uintptr_t*>(cursor) != 0)
+      break;
+    cursor += sizeof(uintptr_t);
+  }
+
+  // Tail (or the mixed word the body stopped on): byte at a time.
+  while (cursor < cursor_end && *cursor == 0)
+    ++cursor;
+
+  return cursor;
+}
+
+// SSE2 implementation of FindFirstNonZeroShadowByte. Compares 16 shadow
+// bytes (covering 128 application bytes) per iteration.
+const uint8* FindFirstNonZeroShadowByteSse2(const uint8* cursor,
+                                            const uint8* cursor_end) {
+  const __m128i zero = _mm_setzero_si128();
+  while (cursor + sizeof(__m128i) <= cursor_end) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero));
+    if (mask != 0xFFFF)
+      break;
+    cursor += sizeof(__m128i);
+  }
+  return FindFirstNonZeroShadowByteImpl(cursor, cursor_end);
+}
+
+// Scans the range of shadow bytes [cursor, cursor_end) and returns a pointer
+// to the first non-zero (that is, not fully addressable) byte, or
+// @p cursor_end if there is none. Dispatches to a vectorized kernel when the
+// CPU supports it.
+const uint8* FindFirstNonZeroShadowByte(const uint8* cursor,
+                                        const uint8* cursor_end) {
+  DCHECK_LE(cursor, cursor_end);
+  if (HaveSse2())
+    return FindFirstNonZeroShadowByteSse2(cursor, cursor_end);
+  return FindFirstNonZeroShadowByteImpl(cursor, cursor_end);
+}
+
+}  // namespace
+
 uint8 Shadow::shadow_[kShadowSize] = {};
 uint8 Shadow::page_bits_[kPageBitsSize] = {};
 base::Lock Shadow::page_bits_lock_;
+Shadow::LazyRange Shadow::lazy_ranges_[3] = {};
+size_t Shadow::lazy_range_count_ = 0;
+base::Lock Shadow::lazy_ranges_lock_;
+void* Shadow::lazy_commit_handler_ = NULL;
 
 void Shadow::SetUp() {
-  // Poison the shadow memory.
-  Poison(shadow_, kShadowSize, kAsanMemoryMarker);
+  // Install the handler that materializes lazily poisoned shadow pages on
+  // first touch. It is registered first in the handler chain so that it
+  // sees the fault before the runtime's own error handling does.
+  DCHECK(lazy_commit_handler_ == NULL);
+  lazy_commit_handler_ =
+      ::AddVectoredExceptionHandler(TRUE, &LazyCommitHandler);
+  CHECK(lazy_commit_handler_ != NULL);
+
+  // Poison the shadow memory. This and the protection bits below span tens
+  // of megabytes of shadow that most processes never look at, so the pages
+  // are materialized on first touch rather than written eagerly.
+  PoisonLazy(shadow_, kShadowSize, kAsanMemoryMarker);
   // Poison the first 64k of the memory as they're not addressable.
-  Poison(0, kAddressLowerBound, kInvalidAddressMarker);
+  PoisonLazy(0, kAddressLowerBound, kInvalidAddressMarker);
   // Poison the protection bits array.
-  Poison(page_bits_, kPageBitsSize, kAsanMemoryMarker);
+  PoisonLazy(page_bits_, kPageBitsSize, kAsanMemoryMarker);
 }
 
 void Shadow::TearDown() {
+  // Unprotect any lazily poisoned pages that were never touched, and remove
+  // the handler. The untouched pages are still demand-zero, so unprotecting
+  // them does not bring them into the working set.
+  for (size_t i = 0; i < lazy_range_count_; ++i) {
+    DWORD old_protection = 0;
+    CHECK(::VirtualProtect(lazy_ranges_[i].begin,
+                           lazy_ranges_[i].end - lazy_ranges_[i].begin,
+                           PAGE_READWRITE,
+                           &old_protection) != FALSE);
+  }
+  lazy_range_count_ = 0;
+  DCHECK(lazy_commit_handler_ != NULL);
+  CHECK(::RemoveVectoredExceptionHandler(lazy_commit_handler_) != 0);
+  lazy_commit_handler_ = NULL;
+
   // Unpoison the shadow memory.
   Unpoison(shadow_, kShadowSize);
   // Unpoison the first 64k of the memory.
@@ -51,25 +179,25 @@ void Shadow::Reset() {
 
 void Shadow::Poison(const void* addr, size_t size, ShadowMarker shadow_val) {
   uintptr_t index = reinterpret_cast<uintptr_t>(addr);
-  uintptr_t start = index & 0x7;
-  DCHECK_EQ(0U, (index + size) & 0x7);
+  uintptr_t start = index & (kShadowRatio - 1);
+  DCHECK_EQ(0U, (index + size) & (kShadowRatio - 1));
 
-  index >>= 3;
+  index >>= kShadowRatioLog;
   if (start)
     shadow_[index++] = start;
 
-  size >>= 3;
+  size >>= kShadowRatioLog;
   DCHECK_GT(arraysize(shadow_), index + size);
   ::memset(shadow_ + index, shadow_val, size);
 }
 
 void Shadow::Unpoison(const void* addr, size_t size) {
   uintptr_t index = reinterpret_cast<uintptr_t>(addr);
-  DCHECK_EQ(0U, index & 0x7);
+  DCHECK_EQ(0U, index & (kShadowRatio - 1));
 
-  uint8 remainder = size & 0x7;
-  index >>= 3;
-  size >>= 3;
+  uint8 remainder = size & (kShadowRatio - 1);
+  index >>= kShadowRatioLog;
+  size >>= kShadowRatioLog;
   DCHECK_GT(arraysize(shadow_), index + size);
   ::memset(shadow_ + index, kHeapAddressableMarker, size);
 
@@ -77,6 +205,93 @@ void Shadow::Unpoison(const void* addr, size_t size) {
     shadow_[index + size] = remainder;
 }
 
+void Shadow::PoisonLazy(const void* addr, size_t size,
+                        ShadowMarker shadow_val) {
+  uintptr_t index = reinterpret_cast<uintptr_t>(addr);
+  uintptr_t start = index & (kShadowRatio - 1);
+  DCHECK_EQ(0U, (index + size) & (kShadowRatio - 1));
+
+  index >>= kShadowRatioLog;
+  if (start)
+    shadow_[index++] = start;
+  size >>= kShadowRatioLog;
+  DCHECK_GT(arraysize(shadow_), index + size);
+
+  uint8* begin = shadow_ + index;
+  uint8* end = begin + size;
+  uint8* interior_begin = ::common::AlignUp(begin, kLazyPageSize);
+  uint8* interior_end = ::common::AlignDown(end, kLazyPageSize);
+
+  // If there's nothing page sized to defer then poison eagerly.
+  if (interior_begin >= interior_end) {
+    ::memset(begin, shadow_val, end - begin);
+    return;
+  }
+
+  // Poison the partial edge pages eagerly, and leave the interior access
+  // protected; LazyCommitHandler fills it in on first touch.
+  ::memset(begin, shadow_val, interior_begin - begin);
+  ::memset(interior_end, shadow_val, end - interior_end);
+
+  DCHECK_GT(arraysize(lazy_ranges_), lazy_range_count_);
+  LazyRange* range = &lazy_ranges_[lazy_range_count_++];
+  range->begin = interior_begin;
+  range->end = interior_end;
+  range->marker = shadow_val;
+
+  DWORD old_protection = 0;
+  CHECK(::VirtualProtect(interior_begin,
+                         interior_end - interior_begin,
+                         PAGE_NOACCESS,
+                         &old_protection) != FALSE);
+}
+
+LONG WINAPI Shadow::LazyCommitHandler(
+    struct _EXCEPTION_POINTERS* exception) {
+  const EXCEPTION_RECORD* record = exception->ExceptionRecord;
+  if (record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION ||
+      record->NumberParameters < 2) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+
+  // Both reads and writes of a lazily poisoned page are materializing
+  // touches, so only the faulting address matters.
+  uint8* addr = reinterpret_cast<uint8*>(record->ExceptionInformation[1]);
+  uint8 marker = 0;
+  bool found = false;
+  for (size_t i = 0; i < lazy_range_count_; ++i) {
+    if (addr >= lazy_ranges_[i].begin && addr < lazy_ranges_[i].end) {
+      marker = lazy_ranges_[i].marker;
+      found = true;
+      break;
+    }
+  }
+  if (!found)
+    return EXCEPTION_CONTINUE_SEARCH;
+
+  uint8* page = ::common::AlignDown(addr, kLazyPageSize);
+
+  // Serialize materialization so that a page racily faulted on by two
+  // threads is only filled once; the second thread would otherwise wipe out
+  // shadow updates made after the first thread's fault was resolved.
+  base::AutoLock lock(lazy_ranges_lock_);
+  MEMORY_BASIC_INFORMATION memory_info = {};
+  if (::VirtualQuery(page, &memory_info, sizeof(memory_info)) !=
+      sizeof(memory_info)) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+  if (memory_info.Protect == PAGE_NOACCESS) {
+    DWORD old_protection = 0;
+    if (::VirtualProtect(page, kLazyPageSize, PAGE_READWRITE,
+                         &old_protection) == FALSE) {
+      return EXCEPTION_CONTINUE_SEARCH;
+    }
+    ::memset(page, marker, kLazyPageSize);
+  }
+
+  return EXCEPTION_CONTINUE_EXECUTION;
+}
+
 namespace {
 
 // An array of kFreedMarkers. This is used for constructing uint16, uint32 and
@@ -162,21 +377,54 @@ void Shadow::MarkAsFreed(const void* addr, size_t size) {
   MarkAsFreedImpl64(cursor, cursor_end);
 }
 
-bool Shadow::IsAccessible(const void* addr) {
-  uintptr_t index = reinterpret_cast<uintptr_t>(addr);
-  uintptr_t start = index & 0x7;
+bool Shadow::IsRangeAccessible(const void* addr, size_t size) {
+  if (size == 0)
+    return true;
 
-  index >>= 3;
+  uintptr_t begin = reinterpret_cast<uintptr_t>(addr);
+  uintptr_t end = begin + size;  // Exclusive.
 
-  DCHECK_GT(arraysize(shadow_), index);
-  uint8 shadow = shadow_[index];
-  if (shadow == 0)
+  // Within a shadow cell accessibility is monotone decreasing: if a byte is
+  // accessible then so are those below it. Checking a cell's last covered
+  // byte therefore checks all of them, and every fully covered interior cell
+  // simply has to carry a green (fully addressable) marker.
+  uintptr_t first_cell_last_byte =
+      std::min(begin | (kShadowRatio - 1), end - 1);
+  if (!IsAccessible(reinterpret_cast<const void*>(first_cell_last_byte)))
+    return false;
+  if (!IsAccessible(reinterpret_cast<const void*>(end - 1)))
+    return false;
+
+  // Scan the fully covered interior cells with the vectorized kernel.
+  uintptr_t interior_begin = (begin + kShadowRatio - 1) >> kShadowRatioLog;
+  uintptr_t interior_end = end >> kShadowRatioLog;  // Exclusive.
+  if (interior_begin >= interior_end)
     return true;
+  DCHECK_GT(arraysize(shadow_), interior_end - 1);
+  const uint8* cursor = shadow_ + interior_begin;
+  const uint8* cursor_end = shadow_ + interior_end;
+  return FindFirstNonZeroShadowByte(cursor, cursor_end) == cursor_end;
+}
 
-  if (ShadowMarkerHelper::IsRedzone(shadow))
-    return false;
+const uint8* Shadow::FindFirstNonGreenAddress(const uint8* addr,
+                                              const uint8* upper) {
+  DCHECK(::common::IsAligned(addr, kShadowRatio));
+  DCHECK(::common::IsAligned(upper, kShadowRatio));
+  DCHECK_LE(addr, upper);
 
-  return start < shadow;
+  uintptr_t index = reinterpret_cast<uintptr_t>(addr) >> kShadowRatioLog;
+  uintptr_t index_end = reinterpret_cast<uintptr_t>(upper) >> kShadowRatioLog;
+  DCHECK_GE(arraysize(shadow_), index_end);
+
+  const uint8* found =
+      FindFirstNonZeroShadowByte(shadow_ + index, shadow_ + index_end);
+  return addr + ((found - (shadow_ + index)) << kShadowRatioLog);
+}
+
+void Shadow::PrefetchShadowForAddress(const void* address) {
+  uintptr_t index = reinterpret_cast<uintptr_t>(address) >> kShadowRatioLog;
+  DCHECK_GT(arraysize(shadow_), index);
+  _mm_prefetch(reinterpret_cast<const char*>(shadow_ + index), _MM_HINT_T0);
 }
 
 bool Shadow::IsLeftRedzone(const void* address) {
@@ -186,9 +434,9 @@ bool Shadow::IsLeftRedzone(const void* address) {
 
 bool Shadow::IsRightRedzone(const void* address) {
   uintptr_t index = reinterpret_cast<uintptr_t>(address);
-  uintptr_t start = index & 0x7;
+  uintptr_t start = index & (kShadowRatio - 1);
 
-  index >>= 3;
+  index >>= kShadowRatioLog;
 
   DCHECK_GT(arraysize(shadow_), index);
   uint8 marker = shadow_[index];
@@ -212,9 +460,9 @@ bool Shadow::IsRightRedzone(const void* address) {
 
 bool Shadow::IsBlockStartByte(const void* address) {
   uintptr_t index = reinterpret_cast<uintptr_t>(address);
-  uintptr_t start = index & 0x7;
+  uintptr_t start = index & (kShadowRatio - 1);
 
-  index >>= 3;
+  index >>= kShadowRatioLog;
 
   DCHECK_GT(arraysize(shadow_), index);
   uint8 marker = shadow_[index];
@@ -227,14 +475,6 @@ bool Shadow::IsBlockStartByte(const void* address) {
   return true;
 }
 
-ShadowMarker Shadow::GetShadowMarkerForAddress(const void* addr) {
-  uintptr_t index = reinterpret_cast<uintptr_t>(addr);
-  index >>= 3;
-
-  DCHECK_GT(arraysize(shadow_), index);
-  return static_cast<ShadowMarker>(shadow_[index]);
-}
-
 void Shadow::PoisonAllocatedBlock(const BlockInfo& info) {
   COMPILE_ASSERT((sizeof(BlockHeader) % kShadowRatio) == 0, bad_header_size);
   DCHECK(info.header->state == ALLOCATED_BLOCK);
@@ -408,85 +648,122 @@ void Shadow::MarkPagesUnprotected(const void* addr, size_t size) {
 void Shadow::CloneShadowRange(const void* src_pointer,
                               void* dst_pointer,
                               size_t size) {
-  DCHECK_EQ(0U, size & 0x7);
+  DCHECK_EQ(0U, size & (kShadowRatio - 1));
 
   uintptr_t src_index = reinterpret_cast<uintptr_t>(src_pointer);
-  DCHECK_EQ(0U, src_index & 0x7);
-  src_index >>= 3;
+  DCHECK_EQ(0U, src_index & (kShadowRatio - 1));
+  src_index >>= kShadowRatioLog;
 
   uintptr_t dst_index = reinterpret_cast<uintptr_t>(dst_pointer);
-  DCHECK_EQ(0U, dst_index & 0x7);
-  dst_index >>= 3;
+  DCHECK_EQ(0U, dst_index & (kShadowRatio - 1));
+  dst_index >>= kShadowRatioLog;
 
-  size_t size_shadow = size >> 3;
+  size_t size_shadow = size >> kShadowRatioLog;
 
   memcpy(shadow_ + dst_index, shadow_ + src_index, size_shadow);
 }
 
-void Shadow::AppendShadowByteText(const char *prefix,
-                                  uintptr_t index,
-                                  std::string* output,
-                                  size_t bug_index) {
-  base::StringAppendF(
-      output, "%s0x%08x:", prefix, reinterpret_cast<void*>(index << 3));
+void Shadow::WriteShadowByteText(const char* prefix,
+                                 uintptr_t index,
+                                 char* buffer,
+                                 size_t buffer_size,
+                                 size_t* cursor,
+                                 size_t bug_index) {
+  WriteToBuffer(buffer, buffer_size, cursor, "%s0x%08x:", prefix,
+                reinterpret_cast<void*>(index << kShadowRatioLog));
   char separator = ' ';
   for (uint32 i = 0; i < 8; i++) {
     if (index + i == bug_index)
       separator = '[';
     uint8 shadow_value = shadow_[index + i];
-    base::StringAppendF(
-        output, "%c%x%x", separator, shadow_value >> 4, shadow_value & 15);
+    WriteToBuffer(buffer, buffer_size, cursor, "%c%x%x", separator,
+                  shadow_value >> 4, shadow_value & 15);
     if (separator == '[')
       separator = ']';
     else if (separator == ']')
       separator = ' ';
   }
   if (separator == ']')
-    base::StringAppendF(output, "]");
-  base::StringAppendF(output, "\n");
+    WriteToBuffer(buffer, buffer_size, cursor, "]");
+  WriteToBuffer(buffer, buffer_size, cursor, "\n");
 }
 
-void Shadow::AppendShadowArrayText(const void* addr, std::string* output) {
+void Shadow::WriteShadowArrayText(const void* addr,
+                                  char* buffer,
+                                  size_t buffer_size) {
+  DCHECK_NE(reinterpret_cast<char*>(NULL), buffer);
+  DCHECK_LT(0u, buffer_size);
+
+  buffer[0] = '\0';
+  size_t cursor = 0;
   uintptr_t index = reinterpret_cast<uintptr_t>(addr);
-  index >>= 3;
+  index >>= kShadowRatioLog;
   size_t index_start = index;
   index_start &= ~0x7;
   for (int i = -4; i <= 4; i++) {
     const char * const prefix = (i == 0) ? "=>" : "  ";
-    AppendShadowByteText(prefix, (index_start + i * 8), output, index);
+    WriteShadowByteText(prefix, (index_start + i * 8), buffer, buffer_size,
+                        &cursor, index);
   }
 }
 
+void Shadow::WriteShadowMemoryText(const void* addr,
+                                   char* buffer,
+                                   size_t buffer_size) {
+  DCHECK_NE(reinterpret_cast<char*>(NULL), buffer);
+  DCHECK_LT(0u, buffer_size);
+
+  buffer[0] = '\0';
+  size_t cursor = 0;
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "Shadow bytes around the buggy address:\n");
+  WriteShadowArrayText(addr, buffer + cursor, buffer_size - cursor);
+  cursor += ::strlen(buffer + cursor);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "Shadow byte legend (one shadow byte represents "
+                "8 application bytes):\n");
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  Addressable:           00\n");
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  Partially addressable: 01 - 07\n");
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  Block start redzone:   %02x - %02x\n",
+                kHeapBlockStartMarker0, kHeapBlockStartMarker7);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  Nested block start:    %02x - %02x\n",
+                kHeapNestedBlockStartMarker0, kHeapNestedBlockStartMarker7);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  ASan memory byte:      %02x\n", kAsanMemoryMarker);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  Invalid address:       %02x\n", kInvalidAddressMarker);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  User redzone:          %02x\n", kUserRedzoneMarker);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  Block end redzone:     %02x\n", kHeapBlockEndMarker);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  Nested block end:      %02x\n", kHeapNestedBlockEndMarker);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  Heap left redzone:     %02x\n", kHeapLeftPaddingMarker);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  Heap right redzone:    %02x\n", kHeapRightPaddingMarker);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  ASan reserved byte:    %02x\n", kAsanReservedMarker);
+  WriteToBuffer(buffer, buffer_size, &cursor,
+                "  Freed heap region:     %02x\n", kHeapFreedMarker);
+}
+
+void Shadow::AppendShadowArrayText(const void* addr, std::string* output) {
+  // Large enough for the 9 lines of shadow byte text.
+  char buffer[512] = {};
+  WriteShadowArrayText(addr, buffer, sizeof(buffer));
+  output->append(buffer);
+}
+
 void Shadow::AppendShadowMemoryText(const void* addr, std::string* output) {
-  base::StringAppendF(output, "Shadow bytes around the buggy address:\n");
-  AppendShadowArrayText(addr, output);
-  base::StringAppendF(output, "Shadow byte legend (one shadow byte represents "
-                              "8 application bytes):\n");
-  base::StringAppendF(output, "  Addressable:           00\n");
-  base::StringAppendF(output, "  Partially addressable: 01 - 07\n");
-  base::StringAppendF(output, "  Block start redzone:   %02x - %02x\n",
-                      kHeapBlockStartMarker0, kHeapBlockStartMarker7);
-  base::StringAppendF(output, "  Nested block start:    %02x - %02x\n",
-                      kHeapNestedBlockStartMarker0,
-                      kHeapNestedBlockStartMarker7);
-  base::StringAppendF(output, "  ASan memory byte:      %02x\n",
-                      kAsanMemoryMarker);
-  base::StringAppendF(output, "  Invalid address:       %02x\n",
-                      kInvalidAddressMarker);
-  base::StringAppendF(output, "  User redzone:          %02x\n",
-                      kUserRedzoneMarker);
-  base::StringAppendF(output, "  Block end redzone:     %02x\n",
-                      kHeapBlockEndMarker);
-  base::StringAppendF(output, "  Nested block end:      %02x\n",
-                      kHeapNestedBlockEndMarker);
-  base::StringAppendF(output, "  Heap left redzone:     %02x\n",
-                      kHeapLeftPaddingMarker);
-  base::StringAppendF(output, "  Heap right redzone:    %02x\n",
-                      kHeapRightPaddingMarker);
-  base::StringAppendF(output, "  ASan reserved byte:    %02x\n",
-                      kAsanReservedMarker);
-  base::StringAppendF(output, "  Freed heap region:     %02x\n",
-                      kHeapFreedMarker);
+  // Large enough for the shadow byte text and the legend.
+  char buffer[2048] = {};
+  WriteShadowMemoryText(addr, buffer, sizeof(buffer));
+  output->append(buffer);
 }
 
 size_t Shadow::GetAllocSize(const uint8* mem) {
@@ -548,7 +825,7 @@ inline const uint8* ScanRightForPotentialHeaderBytes(
   // it is already 8-byte aligned and we'll simply fall through to the end.
   // This is a kind of Duffy's device that takes bytes 'as large as possible'
   // until we reach an 8 byte alignment.
-  switch (reinterpret_cast<uintptr_t>(pos) & 0x7) {
+  switch (reinterpret_cast<uintptr_t>(pos) & (kShadowRatio - 1)) {
     case 1:
       if (*pos != 0 && *pos != kFreedMarker8)
         return pos;
@@ -727,6 +1004,15 @@ void ShadowWalker::Reset() {
   for (cursor_ = lower_bound_; cursor_ != upper_bound_;
        cursor_ += kShadowRatio) {
     uint8 marker = Shadow::GetShadowMarkerForAddress(cursor_);
+
+    // Green (fully addressable) markers carry no block structure; skip over
+    // entire runs of them at once.
+    if (marker == kHeapAddressableMarker) {
+      cursor_ = Shadow::FindFirstNonGreenAddress(cursor_, upper_bound_) -
+          kShadowRatio;
+      continue;
+    }
+
     if (ShadowMarkerHelper::IsBlockStart(marker) &&
         !ShadowMarkerHelper::IsNestedBlockStart(marker)) {
       break;
@@ -741,6 +1027,14 @@ bool ShadowWalker::Next(BlockInfo* info) {
   for (; cursor_ != upper_bound_; cursor_ += kShadowRatio) {
     uint8 marker = Shadow::GetShadowMarkerForAddress(cursor_);
 
+    // Green (fully addressable) markers are neither block starts nor block
+    // ends; skip over entire runs of them at once.
+    if (marker == kHeapAddressableMarker) {
+      cursor_ = Shadow::FindFirstNonGreenAddress(cursor_, upper_bound_) -
+          kShadowRatio;
+      continue;
+    }
+
     // Update the nesting depth when block end markers are encountered.
     if (ShadowMarkerHelper::IsBlockEnd(marker)) {
       DCHECK_LE(0, nesting_depth_);
@@ -780,5 +1074,24 @@ bool ShadowWalker::Next(BlockInfo* info) {
   return false;
 }
 
+size_t ShadowWalker::NextBatch(BlockInfo* infos, size_t max_count) {
+  DCHECK_NE(static_cast<BlockInfo*>(NULL), infos);
+  DCHECK_LT(0u, max_count);
+
+  // One shadow cache line describes 64 * kShadowRatio bytes of application
+  // memory. Keep a couple of lines in flight ahead of the cursor.
+  const size_t kPrefetchDistance = 2 * 64 * kShadowRatio;
+
+  size_t count = 0;
+  while (count < max_count) {
+    if (cursor_ + kPrefetchDistance < upper_bound_)
+      Shadow::PrefetchShadowForAddress(cursor_ + kPrefetchDistance);
+    if (!Next(infos + count))
+      break;
+    ++count;
+  }
+  return count;
+}
+
 }  // namespace asan
 }  // namespace agent
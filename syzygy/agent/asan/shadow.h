@@ -67,6 +67,8 @@
 #ifndef SYZYGY_AGENT_ASAN_SHADOW_H_
 #define SYZYGY_AGENT_ASAN_SHADOW_H_
 
+#include <windows.h>
+
 #include <string>
 
 #include "base/basictypes.h"
@@ -126,8 +128,36 @@ class Shadow {
   // Returns true iff the byte at @p addr is not poisoned.
   // @param addr The address that we want to check.
   // @returns true if this address is accessible, false otherwise.
+  // @note This is inlined and the shadow offset computation folds to
+  //     compile-time constants, as this sits on the path of every
+  //     instrumented memory access.
   static bool IsAccessible(const void* addr);
 
+  // Returns true iff every byte in the range [addr, addr + size) is
+  // accessible. Equivalent to calling IsAccessible on every byte of the
+  // range, but scans the shadow with vectorized compares where the CPU
+  // allows, making it appropriate for large range checks.
+  // @param addr The first address of the range to check.
+  // @param size The size of the range to check.
+  // @returns true if the entire range is accessible, false otherwise.
+  static bool IsRangeAccessible(const void* addr, size_t size);
+
+  // Returns the first address in the range [addr, upper) whose shadow
+  // marker is not kHeapAddressableMarker, or @p upper if every marker in
+  // the range is green. Both addresses must be kShadowRatio aligned. This
+  // lets shadow walkers skip over runs of addressable memory wholesale.
+  // @param addr The first address of the range to scan.
+  // @param upper The end of the range to scan.
+  // @returns the first non-green address, or @p upper.
+  static const uint8* FindFirstNonGreenAddress(const uint8* addr,
+                                               const uint8* upper);
+
+  // Issues a software prefetch for the shadow cache line describing
+  // @p address. Used by heap-wide scans to hide the latency of the marker
+  // loads for memory they are about to walk.
+  // @param address The address whose shadow memory should be prefetched.
+  static void PrefetchShadowForAddress(const void* address);
+
   // @param address The address that we want to check.
   // @returns true if the byte at @p address is an active left redzone.
   static bool IsLeftRedzone(const void* address);
@@ -143,6 +173,7 @@ class Shadow {
   // Returns the ShadowMarker value for the byte at @p addr.
   // @param addr The address for which we want the ShadowMarker value.
   // @returns the ShadowMarker value for this address.
+  // @note This is inlined as it's heavily used by the interceptors.
   static ShadowMarker GetShadowMarkerForAddress(const void* addr);
 
   // Appends a textual description of the shadow memory for @p addr to
@@ -158,6 +189,28 @@ class Shadow {
   //     information.
   static void AppendShadowArrayText(const void* addr, std::string* output);
 
+  // As AppendShadowMemoryText, but writes the description into the fixed
+  // size buffer @p buffer without performing any heap allocations. The
+  // output is truncated if the buffer is too small, and is always zero
+  // terminated. This is safe to use while reporting an error.
+  // @param addr The address for which we want to get the textual description.
+  // @param buffer The buffer receiving the description.
+  // @param buffer_size The size of @p buffer, in bytes.
+  static void WriteShadowMemoryText(const void* addr,
+                                    char* buffer,
+                                    size_t buffer_size);
+
+  // As AppendShadowArrayText, but writes the description into the fixed
+  // size buffer @p buffer without performing any heap allocations. The
+  // output is truncated if the buffer is too small, and is always zero
+  // terminated. This is safe to use while reporting an error.
+  // @param addr The address whose shadow memory is to be described.
+  // @param buffer The buffer receiving the description.
+  // @param buffer_size The size of @p buffer, in bytes.
+  static void WriteShadowArrayText(const void* addr,
+                                   char* buffer,
+                                   size_t buffer_size);
+
   // Returns true iff the array starting at @p addr is terminated with
   // sizeof(@p type) null bytes within a contiguous accessible region of memory.
   // When returning true the length of the null-terminated array (including the
@@ -263,14 +316,26 @@ class Shadow {
   // Reset the shadow memory.
   static void Reset();
 
-  // Appends a line of shadow byte text for the bytes ranging from
-  // shadow_[index] to shadow_[index + 7], prefixed by @p prefix. If the index
-  // @p bug_index is present in this range then its value will be surrounded by
-  // brackets.
-  static void AppendShadowByteText(const char *prefix,
-                                   uintptr_t index,
-                                   std::string* output,
-                                   size_t bug_index);
+  // Converts an address to an index into the shadow memory. The shift
+  // amount is a compile-time constant so the common 1/8 shadow ratio
+  // compiles to a single shift.
+  // @param addr The address to convert.
+  // @returns the index of the shadow byte covering @p addr.
+  static uintptr_t AddressToIndex(const void* addr);
+
+  // Writes a line of shadow byte text for the bytes ranging from
+  // shadow_[index] to shadow_[index + 7], prefixed by @p prefix, into
+  // @p buffer at @p *cursor without allocating, advancing @p *cursor past
+  // the characters written. If the index @p bug_index is present in this
+  // range then its value will be surrounded by brackets. The output is
+  // truncated at @p buffer_size - 1 characters and is always zero
+  // terminated.
+  static void WriteShadowByteText(const char* prefix,
+                                  uintptr_t index,
+                                  char* buffer,
+                                  size_t buffer_size,
+                                  size_t* cursor,
+                                  size_t bug_index);
 
   // Scans to the left of the provided cursor, looking for the presence of a
   // block start marker that brackets the cursor.
@@ -304,6 +369,46 @@ class Shadow {
   static bool BlockInfoFromShadowImpl(
       size_t initial_nesting_depth, const void* addr, CompactBlockInfo* info);
 
+  // Poisons the shadow of the range [addr, addr + size) like Poison, but
+  // leaves the page-aligned interior of the affected shadow bytes access
+  // protected instead of writing it; the protected pages are unprotected
+  // and filled with @p shadow_val on first touch by LazyCommitHandler. This
+  // keeps the large ranges poisoned at start-up - chiefly the shadow of the
+  // shadow itself - out of the working set of processes that never look at
+  // them.
+  // @param addr The starting address.
+  // @param size The size of the memory to poison.
+  // @param shadow_val The poison marker value.
+  static void PoisonLazy(const void* addr, size_t size,
+                         ShadowMarker shadow_val);
+
+  // The vectored exception handler that materializes lazily poisoned shadow
+  // pages on first touch.
+  // @param exception The exception being dispatched.
+  // @returns EXCEPTION_CONTINUE_EXECUTION if the fault was on a lazily
+  //     poisoned shadow page, EXCEPTION_CONTINUE_SEARCH otherwise.
+  static LONG WINAPI LazyCommitHandler(
+      struct _EXCEPTION_POINTERS* exception);
+
+  // A range of shadow bytes whose pages are materialized on first touch.
+  struct LazyRange {
+    uint8* begin;  // Page aligned.
+    uint8* end;    // Page aligned.
+    uint8 marker;
+  };
+
+  // The lazily poisoned shadow ranges, registered by PoisonLazy. The fixed
+  // capacity covers the ranges poisoned by SetUp.
+  static LazyRange lazy_ranges_[3];
+  static size_t lazy_range_count_;
+
+  // Serializes page materialization in LazyCommitHandler.
+  static base::Lock lazy_ranges_lock_;
+
+  // The registration cookie of LazyCommitHandler; NULL when the handler is
+  // not installed.
+  static void* lazy_commit_handler_;
+
   // The shadow memory.
   static uint8 shadow_[kShadowSize];
 
@@ -336,6 +441,16 @@ class ShadowWalker {
   // @return true if a block was found, false otherwise.
   bool Next(BlockInfo* info);
 
+  // Returns the next batch of blocks in this memory region. This is
+  // equivalent to repeated calls to Next, but prefetches the shadow memory
+  // ahead of the walk so that heap-wide scans are not dominated by marker
+  // load latency.
+  // @param infos The array of block descriptors to be populated.
+  // @param max_count The capacity of @p infos.
+  // @returns the number of descriptors populated. A return value of 0
+  //     indicates that the walk is complete.
+  size_t NextBatch(BlockInfo* infos, size_t max_count);
+
   // Reset the walker to its initial state.
   void Reset();
 
@@ -18,6 +18,36 @@
 #ifndef SYZYGY_AGENT_ASAN_SHADOW_IMPL_H_
 #define SYZYGY_AGENT_ASAN_SHADOW_IMPL_H_
 
+inline uintptr_t Shadow::AddressToIndex(const void* addr) {
+  // kShadowRatioLog is a compile-time constant, so for the default 1/8
+  // shadow ratio this is a single shift with no runtime dispatch.
+  return reinterpret_cast<uintptr_t>(addr) >> kShadowRatioLog;
+}
+
+inline bool Shadow::IsAccessible(const void* addr) {
+  uintptr_t index = reinterpret_cast<uintptr_t>(addr);
+  uintptr_t start = index & (kShadowRatio - 1);
+
+  index >>= kShadowRatioLog;
+
+  DCHECK_GT(arraysize(shadow_), index);
+  uint8 shadow = shadow_[index];
+  if (shadow == 0)
+    return true;
+
+  if (ShadowMarkerHelper::IsRedzone(shadow))
+    return false;
+
+  return start < shadow;
+}
+
+inline ShadowMarker Shadow::GetShadowMarkerForAddress(const void* addr) {
+  uintptr_t index = AddressToIndex(addr);
+
+  DCHECK_GT(arraysize(shadow_), index);
+  return static_cast<ShadowMarker>(shadow_[index]);
+}
+
 template<typename type>
 bool Shadow::GetNullTerminatedArraySize(const void* addr,
                                         size_t max_size,
@@ -25,9 +55,8 @@ bool Shadow::GetNullTerminatedArraySize(const void* addr,
   DCHECK_NE(reinterpret_cast<const void*>(NULL), addr);
   DCHECK_NE(reinterpret_cast<size_t*>(NULL), size);
 
-  uintptr_t index = reinterpret_cast<uintptr_t>(addr);
+  uintptr_t index = AddressToIndex(addr);
   const type* addr_value = reinterpret_cast<const type*>(addr);
-  index >>= 3;
   *size = 0;
 
   // Scan the input array 8 bytes at a time until we've found a NULL value or
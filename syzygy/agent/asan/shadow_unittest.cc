@@ -65,6 +65,60 @@ TEST(ShadowTest, PoisonUnpoisonAccess) {
   }
 }
 
+TEST(ShadowTest, IsRangeAccessible) {
+  // Reset the shadow memory.
+  TestShadow::Reset();
+
+  // Use ranges large enough to exercise the vectorized scanning kernels,
+  // with unaligned endpoints so the partial cells at both ends get checked.
+  const uint8* addr = reinterpret_cast<const uint8*>(0x30000000 + 3);
+  const size_t kSize = 1037;
+
+  EXPECT_TRUE(Shadow::IsRangeAccessible(addr, kSize));
+
+  // Poisoning any single byte of the range must make the whole range
+  // inaccessible. Sample a handful of positions, including both ends.
+  const size_t kOffsets[] = { 0, 1, 13, kSize / 2, kSize - 2, kSize - 1 };
+  for (size_t i = 0; i < arraysize(kOffsets); ++i) {
+    const uint8* byte = addr + kOffsets[i];
+    const uint8* aligned_byte = reinterpret_cast<const uint8*>(
+        ::common::AlignDown(reinterpret_cast<size_t>(byte), kShadowRatio));
+    Shadow::Poison(aligned_byte, kShadowRatio, kAsanReservedMarker);
+    EXPECT_FALSE(Shadow::IsRangeAccessible(addr, kSize));
+    Shadow::Unpoison(aligned_byte, kShadowRatio);
+    EXPECT_TRUE(Shadow::IsRangeAccessible(addr, kSize));
+  }
+
+  // A partially accessible trailing cell is handled byte-accurately.
+  const uint8* end_cell = reinterpret_cast<const uint8*>(0x30001000);
+  Shadow::Poison(end_cell - 3, 3, kHeapRightRedzoneMarker);
+  EXPECT_TRUE(Shadow::IsRangeAccessible(end_cell - 8, 5));
+  EXPECT_FALSE(Shadow::IsRangeAccessible(end_cell - 8, 6));
+  EXPECT_FALSE(Shadow::IsRangeAccessible(end_cell - 8, 8));
+  Shadow::Unpoison(end_cell - 8, 8);
+}
+
+TEST(ShadowTest, FindFirstNonGreenAddress) {
+  // Reset the shadow memory.
+  TestShadow::Reset();
+
+  const uint8* lower = reinterpret_cast<const uint8*>(0x30000000);
+  const uint8* upper = lower + 4096;
+
+  // An all-green range scans through to the upper bound.
+  EXPECT_EQ(upper, Shadow::FindFirstNonGreenAddress(lower, upper));
+
+  // A poisoned cell anywhere in the range is found exactly, including at
+  // positions that land in the unaligned head or tail of the scan kernels.
+  const size_t kOffsets[] = { 0, 8, 24, 1032, 2048, 4088 };
+  for (size_t i = 0; i < arraysize(kOffsets); ++i) {
+    const uint8* poisoned = lower + kOffsets[i];
+    Shadow::Poison(poisoned, kShadowRatio, kAsanReservedMarker);
+    EXPECT_EQ(poisoned, Shadow::FindFirstNonGreenAddress(lower, upper));
+    Shadow::Unpoison(poisoned, kShadowRatio);
+  }
+}
+
 TEST(ShadowTest, SetUpAndTearDown) {
   // Reset the shadow memory.
   TestShadow::Reset();
@@ -554,6 +608,39 @@ TEST(ShadowTest, PageBits) {
   EXPECT_FALSE(Shadow::PageIsProtected(addr2 + 4096));
 }
 
+TEST(ShadowTest, WriteShadowMemoryText) {
+  // Reset the shadow memory.
+  TestShadow::Reset();
+  const uint8* addr = reinterpret_cast<const uint8*>(0x30000000);
+  Shadow::Poison(addr, kShadowRatio, kHeapFreedMarker);
+
+  // The fixed-buffer writer must produce the same text as the string based
+  // variant.
+  std::string expected;
+  Shadow::AppendShadowMemoryText(addr, &expected);
+  char buffer[2048] = {};
+  Shadow::WriteShadowMemoryText(addr, buffer, sizeof(buffer));
+  EXPECT_EQ(expected, buffer);
+
+  // The faulty address must be pointed at in the shadow byte array.
+  EXPECT_NE(std::string::npos, expected.find("=>"));
+
+  // Truncation must leave a zero terminated prefix of the full text.
+  char small_buffer[32];
+  ::memset(small_buffer, 0xFF, sizeof(small_buffer));
+  Shadow::WriteShadowMemoryText(addr, small_buffer, sizeof(small_buffer));
+  EXPECT_EQ('\0', small_buffer[sizeof(small_buffer) - 1]);
+  EXPECT_EQ(expected.substr(0, sizeof(small_buffer) - 1), small_buffer);
+
+  char array_buffer[512] = {};
+  Shadow::WriteShadowArrayText(addr, array_buffer, sizeof(array_buffer));
+  std::string expected_array;
+  Shadow::AppendShadowArrayText(addr, &expected_array);
+  EXPECT_EQ(expected_array, array_buffer);
+
+  Shadow::Unpoison(addr, kShadowRatio);
+}
+
 TEST(ShadowWalkerTest, WalksNonNestedBlocks) {
   BlockLayout l = {};
   EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 7, 0, 0, &l));
@@ -608,6 +695,49 @@ TEST(ShadowWalkerTest, WalksNonNestedBlocks) {
   delete [] data;
 }
 
+TEST(ShadowWalkerTest, NextBatchMatchesNext) {
+  BlockLayout l = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 7, 0, 0, &l));
+
+  size_t data_size = l.block_size * 3 + kShadowRatio;
+  uint8* data = new uint8[data_size];
+  uint8* data0 = data;
+  uint8* data1 = data0 + l.block_size + kShadowRatio;
+  uint8* data2 = data1 + l.block_size;
+
+  BlockInfo i0 = {}, i1 = {}, i2 = {};
+  BlockInitialize(l, data0, false, &i0);
+  BlockInitialize(l, data1, false, &i1);
+  BlockInitialize(l, data2, false, &i2);
+
+  Shadow::PoisonAllocatedBlock(i0);
+  Shadow::PoisonAllocatedBlock(i1);
+  Shadow::PoisonAllocatedBlock(i2);
+
+  // A batch bigger than the number of blocks returns them all at once, and
+  // the next call reports that the walk is complete.
+  BlockInfo infos[4] = {};
+  ShadowWalker w0(false, data, data + data_size);
+  EXPECT_EQ(3u, w0.NextBatch(infos, arraysize(infos)));
+  EXPECT_EQ(0, ::memcmp(&infos[0], &i0, sizeof(i0)));
+  EXPECT_EQ(0, ::memcmp(&infos[1], &i1, sizeof(i1)));
+  EXPECT_EQ(0, ::memcmp(&infos[2], &i2, sizeof(i2)));
+  EXPECT_EQ(0u, w0.NextBatch(infos, arraysize(infos)));
+
+  // A smaller batch capacity splits the walk across calls without skipping
+  // or repeating blocks.
+  ShadowWalker w1(false, data, data + data_size);
+  EXPECT_EQ(2u, w1.NextBatch(infos, 2));
+  EXPECT_EQ(0, ::memcmp(&infos[0], &i0, sizeof(i0)));
+  EXPECT_EQ(0, ::memcmp(&infos[1], &i1, sizeof(i1)));
+  EXPECT_EQ(1u, w1.NextBatch(infos, 2));
+  EXPECT_EQ(0, ::memcmp(&infos[0], &i2, sizeof(i2)));
+  EXPECT_EQ(0u, w1.NextBatch(infos, 2));
+
+  Shadow::Unpoison(data, data_size);
+  delete [] data;
+}
+
 TEST(ShadowWalkerTest, WalksNestedBlocks) {
   BlockLayout b0 = {}, b1 = {}, b2 = {}, b00 = {}, b01 = {}, b10 = {},
       b100 = {};
@@ -42,6 +42,9 @@ common::StackCapture** GetFirstFrameAsLink(
 size_t StackCaptureCache::compression_reporting_period_ =
     ::common::kDefaultReportingPeriod;
 
+size_t StackCaptureCache::stack_sampling_threshold_ =
+    ::common::kDefaultStackSamplingThreshold;
+
 StackCaptureCache::CachePage::~CachePage() {
   // It's our parent StackCaptureCache's responsibility to clean up the linked
   // list of cache pages. We balk if we're being deleted and haven't been
@@ -86,9 +89,9 @@ StackCaptureCache::StackCaptureCache(AsanLogger* logger)
       current_page_(new CachePage(NULL)) {
   CHECK(current_page_ != NULL);
   DCHECK(logger_ != NULL);
-  ::memset(&statistics_, 0, sizeof(statistics_));
+  ::memset(statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
-  statistics_.size = sizeof(CachePage);
+  statistics_[0].size = sizeof(CachePage);
 }
 
 StackCaptureCache::StackCaptureCache(AsanLogger* logger, size_t max_num_frames)
@@ -100,9 +103,9 @@ StackCaptureCache::StackCaptureCache(AsanLogger* logger, size_t max_num_frames)
   DCHECK_LT(0u, max_num_frames);
   max_num_frames_ = static_cast<uint8>(
       std::min(max_num_frames, common::StackCapture::kMaxNumFrames));
-  ::memset(&statistics_, 0, sizeof(statistics_));
+  ::memset(statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
-  statistics_.size = sizeof(CachePage);
+  statistics_[0].size = sizeof(CachePage);
 }
 
 StackCaptureCache::~StackCaptureCache() {
@@ -117,6 +120,7 @@ StackCaptureCache::~StackCaptureCache() {
 
 void StackCaptureCache::Init() {
   compression_reporting_period_ = ::common::kDefaultReportingPeriod;
+  stack_sampling_threshold_ = ::common::kDefaultStackSamplingThreshold;
 }
 
 const common::StackCapture* StackCaptureCache::SaveStackTrace(
@@ -128,9 +132,9 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
   bool already_cached = false;
   common::StackCapture* stack_trace = NULL;
   bool saturated = false;
+  size_t known_stack_shard = stack_id % kKnownStacksSharding;
 
   {
-    size_t known_stack_shard = stack_id % kKnownStacksSharding;
     // Get or insert the current stack trace while under the lock for this
     // bucket.
     base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
@@ -143,7 +147,7 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
     // If this capture has not already been cached then we have to initialize
     // the data.
     if (result == known_stacks_[known_stack_shard].end()) {
-      stack_trace = GetStackCapture(num_frames);
+      stack_trace = GetStackCapture(known_stack_shard, num_frames);
       DCHECK(stack_trace != NULL);
       stack_trace->InitFromBuffer(stack_id, frames, num_frames);
       std::pair<StackSet::iterator, bool> it =
@@ -157,6 +161,15 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
     // Increment the reference count for this stack trace.
     if (!stack_trace->RefCountIsSaturated()) {
       stack_trace->AddRef();
+
+      // In sampling mode saturate the reference count of hot stacks once
+      // they have been seen often enough. This pins them in the cache and
+      // lets subsequent saves and releases of them skip the reference
+      // bookkeeping entirely.
+      if (stack_sampling_threshold_ != 0 &&
+          stack_trace->ref_count() >= stack_sampling_threshold_) {
+        stack_trace->MarkAsSaturated();
+      }
     } else {
       saturated = true;
     }
@@ -164,37 +177,42 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
   DCHECK(stack_trace != NULL);
 
   bool must_log = false;
-  Statistics statistics = {};
-  // Update the statistics.
+  // Update the statistics for this shard.
   if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
+    base::AutoLock stats_lock(stats_locks_[known_stack_shard]);
+    Statistics* statistics = &statistics_[known_stack_shard];
     if (already_cached) {
       // If the existing stack capture is previously unreferenced and becoming
       // referenced again, then decrement the unreferenced counter.
       if (stack_trace->HasNoRefs()) {
-        DCHECK_LT(0u, statistics_.unreferenced);
-        --statistics_.unreferenced;
+        DCHECK_LT(0u, statistics->unreferenced);
+        --statistics->unreferenced;
       }
     } else {
-      ++statistics_.cached;
-      statistics_.frames_alive += num_frames;
-      ++statistics_.allocated;
+      ++statistics->cached;
+      statistics->frames_alive += num_frames;
+      ++statistics->allocated;
     }
     if (!saturated && stack_trace->RefCountIsSaturated()) {
       saturated = true;
-      ++statistics_.saturated;
+      ++statistics->saturated;
     }
-    ++statistics_.requested;
-    ++statistics_.references;
-    statistics_.frames_stored += num_frames;
-    if (statistics_.requested % compression_reporting_period_ == 0) {
+    ++statistics->requested;
+    ++statistics->references;
+    statistics->frames_stored += num_frames;
+
+    // Each shard sees roughly 1/kKnownStacksSharding of the traffic, so
+    // triggering on the shard-local counter reports at approximately the
+    // configured global rate.
+    if (statistics->requested % compression_reporting_period_ == 0)
       must_log = true;
-      GetStatisticsUnlocked(&statistics);
-    }
   }
 
-  if (must_log)
+  if (must_log) {
+    Statistics statistics = {};
+    GetStatistics(&statistics);
     LogStatisticsImpl(statistics);
+  }
 
   // Return the stack trace pointer that is now in the cache.
   return stack_trace;
@@ -213,13 +231,19 @@ void StackCaptureCache::ReleaseStackTrace(
 
   size_t known_stack_shard = stack_capture->stack_id() % kKnownStacksSharding;
   bool add_to_reclaimed_list = false;
-  common::StackCapture* stack = NULL;
-  {
+
+  // We own the stack so its fine to remove the const. We double check this
+  // is the case in debug builds with the DCHECK.
+  common::StackCapture* stack =
+      const_cast<common::StackCapture*>(stack_capture);
+
+  // Saturated stack captures have a frozen reference count and can never be
+  // reclaimed, so the known-stacks lock need not be taken for them at all.
+  // Once saturated a stack capture stays saturated, so this check is safe
+  // without the lock.
+  if (!stack->RefCountIsSaturated()) {
     base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
 
-    // We own the stack so its fine to remove the const. We double check this
-    // is the case in debug builds with the DCHECK.
-    stack = const_cast<common::StackCapture*>(stack_capture);
     DCHECK(known_stacks_[known_stack_shard].find(stack) !=
         known_stacks_[known_stack_shard].end());
 
@@ -234,17 +258,18 @@ void StackCaptureCache::ReleaseStackTrace(
     }
   }
 
-  // Update the statistics.
+  // Update the statistics for this shard.
   if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    DCHECK_LT(0u, statistics_.references);
-    --statistics_.references;
-    statistics_.frames_stored -= stack->num_frames();
+    base::AutoLock stats_lock(stats_locks_[known_stack_shard]);
+    Statistics* statistics = &statistics_[known_stack_shard];
+    DCHECK_LT(0u, statistics->references);
+    --statistics->references;
+    statistics->frames_stored -= stack->num_frames();
     if (add_to_reclaimed_list) {
-      --statistics_.cached;
-      ++statistics_.unreferenced;
+      --statistics->cached;
+      ++statistics->unreferenced;
       // The frames in this stack capture are no longer alive.
-      statistics_.frames_alive -= stack->num_frames();
+      statistics->frames_alive -= stack->num_frames();
     }
   }
 
@@ -252,7 +277,7 @@ void StackCaptureCache::ReleaseStackTrace(
   // must come after the statistics updating, as we modify the |num_frames|
   // parameter in place.
   if (add_to_reclaimed_list)
-    AddStackCaptureToReclaimedList(stack);
+    AddStackCaptureToReclaimedList(known_stack_shard, stack);
 }
 
 bool StackCaptureCache::StackCapturePointerIsValid(
@@ -289,22 +314,28 @@ bool StackCaptureCache::StackCapturePointerIsValid(
 
 void StackCaptureCache::LogStatistics()  {
   Statistics statistics = {};
-
-  {
-    base::AutoLock auto_lock(stats_lock_);
-    GetStatisticsUnlocked(&statistics);
-  }
-
+  GetStatistics(&statistics);
   LogStatisticsImpl(statistics);
 }
 
-void StackCaptureCache::GetStatisticsUnlocked(Statistics* statistics) const {
-#ifndef NDEBUG
-  stats_lock_.AssertAcquired();
-#endif
-
+void StackCaptureCache::GetStatistics(Statistics* statistics) const {
   DCHECK(statistics != NULL);
-  *statistics = statistics_;
+  ::memset(statistics, 0, sizeof(*statistics));
+
+  // Merge the per-shard statistics, each sampled under its own lock.
+  for (size_t i = 0; i < kKnownStacksSharding; ++i) {
+    base::AutoLock auto_lock(stats_locks_[i]);
+    statistics->cached += statistics_[i].cached;
+    statistics->size += statistics_[i].size;
+    statistics->saturated += statistics_[i].saturated;
+    statistics->unreferenced += statistics_[i].unreferenced;
+    statistics->requested += statistics_[i].requested;
+    statistics->allocated += statistics_[i].allocated;
+    statistics->references += statistics_[i].references;
+    statistics->frames_stored += statistics_[i].frames_stored;
+    statistics->frames_alive += statistics_[i].frames_alive;
+    statistics->frames_dead += statistics_[i].frames_dead;
+  }
 }
 
 void StackCaptureCache::LogStatisticsImpl(const Statistics& statistics) const {
@@ -341,7 +372,8 @@ void StackCaptureCache::LogStatisticsImpl(const Statistics& statistics) const {
       statistics.cached));
 }
 
-common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
+common::StackCapture* StackCaptureCache::GetStackCapture(
+    size_t known_stack_shard, size_t num_frames) {
   common::StackCapture* stack_capture = NULL;
 
   // First look to the reclaimed stacks and try to use one of those. We'll use
@@ -360,10 +392,11 @@ common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
 
   if (stack_capture != NULL) {
     if (compression_reporting_period_ != 0) {
-      base::AutoLock stats_lock(stats_lock_);
+      base::AutoLock stats_lock(stats_locks_[known_stack_shard]);
       // These frames are no longer dead, but in limbo. If the stack capture
       // is used they'll be added to frames_alive and frames_stored.
-      statistics_.frames_dead -= stack_capture->max_num_frames();
+      statistics_[known_stack_shard].frames_dead -=
+          stack_capture->max_num_frames();
     }
     return stack_capture;
   }
@@ -397,19 +430,22 @@ common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
     // allocate a new stack capture.
     current_page_ = new CachePage(current_page_);
     CHECK(current_page_ != NULL);
-    statistics_.size += sizeof(CachePage);
+    {
+      base::AutoLock stats_lock(stats_locks_[known_stack_shard]);
+      statistics_[known_stack_shard].size += sizeof(CachePage);
+    }
     stack_capture = current_page_->GetNextStackCapture(num_frames);
   }
 
   if (unused_stack_capture != NULL) {
     // We're creating an unreferenced stack capture.
-    AddStackCaptureToReclaimedList(unused_stack_capture);
+    AddStackCaptureToReclaimedList(known_stack_shard, unused_stack_capture);
   }
 
   // Update the statistics.
   if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    ++statistics_.unreferenced;
+    base::AutoLock stats_lock(stats_locks_[known_stack_shard]);
+    ++statistics_[known_stack_shard].unreferenced;
   }
 
   DCHECK(stack_capture != NULL);
@@ -428,7 +464,7 @@ class PrivateStackCapture : public common::StackCapture {
 }
 
 void StackCaptureCache::AddStackCaptureToReclaimedList(
-    common::StackCapture* stack_capture) {
+    size_t known_stack_shard, common::StackCapture* stack_capture) {
   DCHECK(stack_capture != NULL);
 
   // Make the stack capture internally inconsistent so that it can't be
@@ -447,8 +483,9 @@ void StackCaptureCache::AddStackCaptureToReclaimedList(
 
   // Update the statistics.
   if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    statistics_.frames_dead += stack_capture->max_num_frames();
+    base::AutoLock stats_lock(stats_locks_[known_stack_shard]);
+    statistics_[known_stack_shard].frames_dead +=
+        stack_capture->max_num_frames();
   }
 }
 
@@ -86,6 +86,22 @@ class StackCaptureCache {
     return compression_reporting_period_;
   }
 
+  // Sets a new (global) stack sampling threshold. Once a stack has been saved
+  // this many times its reference count is saturated, pinning it in the cache
+  // and letting subsequent saves and releases of it skip the reference
+  // bookkeeping entirely. Zero (the default) disables the sampling. Note that
+  // this method is not thread safe. It is expected to be called once at
+  // startup, or not at all.
+  static void set_stack_sampling_threshold(size_t threshold) {
+    stack_sampling_threshold_ = threshold;
+  }
+
+  // @returns the current (global) stack sampling threshold. It is expected
+  //     that this value is a constant after initialization.
+  static size_t stack_sampling_threshold() {
+    return stack_sampling_threshold_;
+  }
+
   // Save (or retrieve) the stack capture (the first @p num_frames elements
   // from  @p frames) into the cache using @p stack_id as the key.
   // @param stack_id a unique identifier for this stack trace. It is expected
@@ -166,24 +182,31 @@ class StackCaptureCache {
     // @}
   };
 
-  // Gets the current cache statistics. This must be called under lock_.
+  // Gets the current cache statistics by merging the per-shard statistics.
+  // Each shard is sampled under its own lock; the shards are not sampled
+  // atomically with respect to one another, which is fine for reporting
+  // purposes.
   // @param statistics Will be populated with current cache statistics.
-  void GetStatisticsUnlocked(Statistics* statistics) const;
+  void GetStatistics(Statistics* statistics) const;
 
   // Implementation function for logging statistics.
   // @param report The statistics to be reported.
   void LogStatisticsImpl(const Statistics& statistics) const;
 
   // Grabs a temporary StackCapture from reclaimed_ or the current CachePage.
-  // Must be called under lock_. Takes care of updating frames_dead.
+  // Takes care of updating frames_dead.
+  // @param known_stack_shard The shard whose statistics are to be updated.
   // @param num_frames The minimum number of frames that are required.
-  common::StackCapture* GetStackCapture(size_t num_frames);
+  common::StackCapture* GetStackCapture(size_t known_stack_shard,
+                                        size_t num_frames);
 
   // Links a stack capture into the reclaimed_ list. Meant to be called by
-  // ReturnStackCapture only. Must be called under lock_. Takes care of
-  // updating frames_dead (on behalf of ReturnStackCapture).
+  // ReturnStackCapture only. Takes care of updating frames_dead (on behalf
+  // of ReturnStackCapture).
+  // @param known_stack_shard The shard whose statistics are to be updated.
   // @param stack_capture The stack capture to be linked into reclaimed_.
-  void AddStackCaptureToReclaimedList(common::StackCapture* stack_capture);
+  void AddStackCaptureToReclaimedList(size_t known_stack_shard,
+                                      common::StackCapture* stack_capture);
 
   // The default number of known stacks sets that we keep.
   static const size_t kKnownStacksSharding = 16;
@@ -193,6 +216,11 @@ class StackCaptureCache {
   // seem to be pretty good with Chrome.
   static size_t compression_reporting_period_;
 
+  // The number of times a stack may be saved before its reference count is
+  // saturated, pinning it in the cache. Zero (0) means that stacks are never
+  // artificially saturated.
+  static size_t stack_sampling_threshold_;
+
   // Logger instance to which to report the compression ratio.
   AsanLogger* const logger_;
 
@@ -213,11 +241,14 @@ class StackCaptureCache {
   // Accessed under current_page_lock_.
   CachePage* current_page_;
 
-  // A lock protecting access to statistics_.
-  mutable base::Lock stats_lock_;
+  // Locks to protect the per-shard statistics from concurrent access. These
+  // are sharded the same way as the known stacks so that the statistics
+  // updates of different buckets do not contend on a single lock.
+  mutable base::Lock stats_locks_[kKnownStacksSharding];
 
-  // Aggregate statistics about the cache. Accessed under stats_lock_.
-  Statistics statistics_;
+  // Per-shard statistics about the cache, merged lazily by GetStatistics.
+  // Each entry is accessed under the corresponding lock in stats_locks_.
+  Statistics statistics_[kKnownStacksSharding];
 
   // Locks to protect each reclaimed list from concurrent access.
   base::Lock reclaimed_locks_[common::StackCapture::kMaxNumFrames + 1];
@@ -35,12 +35,7 @@ class TestStackCaptureCache : public StackCaptureCache {
   }
 
   using StackCaptureCache::Statistics;
-
-  void GetStatistics(Statistics* s) {
-    DCHECK(s != NULL);
-    base::AutoLock auto_lock(stats_lock_);
-    GetStatisticsUnlocked(s);
-  }
+  using StackCaptureCache::GetStatistics;
 
   CachePage* current_page() { return current_page_; }
 
@@ -55,6 +50,12 @@ class StackCaptureCacheTest : public testing::Test {
     StackCapture::Init();
     StackCaptureCache::Init();
   }
+
+  void TearDown() OVERRIDE {
+    // Restore the "global" state.
+    StackCapture::Init();
+    StackCaptureCache::Init();
+  }
 };
 
 }  // namespace
@@ -325,6 +326,42 @@ TEST_F(StackCaptureCacheTest, Statistics) {
   EXPECT_EQ(s1_frames, s.frames_dead);
 }
 
+TEST_F(StackCaptureCacheTest, StackSamplingThresholdSaturatesHotStacks) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  cache.set_compression_reporting_period(1U);
+  static const size_t kSamplingThreshold = 4;
+  StackCaptureCache::set_stack_sampling_threshold(kSamplingThreshold);
+
+  // Grab a stack capture and insert it.
+  StackCapture stack_capture;
+  stack_capture.InitFromStack();
+  const StackCapture* s1 = cache.SaveStackTrace(stack_capture);
+  ASSERT_TRUE(s1 != NULL);
+  EXPECT_FALSE(s1->RefCountIsSaturated());
+
+  // Save the same stack until it crosses the sampling threshold. It should
+  // saturate long before the reference count itself would.
+  for (size_t i = 1; i < kSamplingThreshold; ++i)
+    EXPECT_EQ(s1, cache.SaveStackTrace(stack_capture));
+  EXPECT_TRUE(s1->RefCountIsSaturated());
+
+  TestStackCaptureCache::Statistics s = {};
+  cache.GetStatistics(&s);
+  EXPECT_EQ(1u, s.cached);
+  EXPECT_EQ(1u, s.saturated);
+  EXPECT_EQ(kSamplingThreshold, s.requested);
+
+  // Releasing a saturated stack leaves it pinned in the cache.
+  for (size_t i = 0; i < kSamplingThreshold; ++i)
+    cache.ReleaseStackTrace(s1);
+  EXPECT_TRUE(s1->RefCountIsSaturated());
+  cache.GetStatistics(&s);
+  EXPECT_EQ(1u, s.cached);
+  EXPECT_EQ(0u, s.unreferenced);
+  EXPECT_EQ(0u, s.references);
+}
+
 TEST_F(StackCaptureCacheTest, CachePagesArePoisoned) {
   scoped_ptr<TestStackCaptureCache::CachePage> page(
       new TestStackCaptureCache::CachePage(NULL));
@@ -215,9 +215,11 @@ void SetUpAsanRuntime() {
     LOG(ERROR) << "Failed to inflate embedded Asan parameters.";
   }
 
-  // Get the flags string from the environment.
+  // Get the flags string from the environment. This can be skipped entirely
+  // if the embedded parameters are marked as final.
   std::wstring asan_flags_str;
-  if (!AsanRuntime::GetAsanFlagsEnvVar(&asan_flags_str)) {
+  if (!asan_runtime->params().params_are_final &&
+      !AsanRuntime::GetAsanFlagsEnvVar(&asan_flags_str)) {
     LOG(ERROR) << "Error while trying to read Asan command line.";
   }
 
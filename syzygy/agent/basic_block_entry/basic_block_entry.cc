@@ -57,12 +57,18 @@
 //    metrics. The trace segment with be dump to a file for post-processing.
 //
 //    There are two mechanisms to collect metrics:
-//    - Basic mode: In the basic mode, the hook acquires a lock and updates a
-//      process-wide segment shared by all threads. In this mode, no events can
-//      be lost.
+//    - Basic mode: Each thread increments counters in a private page owned by
+//      its thread state. The pages are summed into the process-wide segment,
+//      under a lock, when the thread detaches. This avoids contention on the
+//      shared counters between threads. When no private page is available
+//      (e.g. tracing is disabled) the hook falls back to updating the shared
+//      counters under the lock. In this mode, no events can be lost.
 //    - Buffered mode: A per-thread buffer is used to collect execution
-//      information. A batch commit is done when the buffer is full. In this
-//      mode, under a non-standard execution (crash, force exit, ...) pending
+//      information. When the buffer is full it is handed off, through a
+//      lock-free queue, to a background thread that replays the events and
+//      publishes the counters, while collection continues into a fresh
+//      buffer. The instrumented path never takes a lock. In this mode,
+//      under a non-standard execution (crash, force exit, ...) pending
 //      events may be lost.
 //
 //    The agent keeps a ThreadState for each running thread. The thread state
@@ -81,6 +87,8 @@
 
 #include "syzygy/agent/basic_block_entry/basic_block_entry.h"
 
+#include <algorithm>
+
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/environment.h"
@@ -88,6 +96,7 @@
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "syzygy/agent/asan/lockfree_circular_queue.h"
 #include "syzygy/agent/common/agent.h"
 #include "syzygy/agent/common/process_utils.h"
 #include "syzygy/agent/common/scoped_last_error_keeper.h"
@@ -237,6 +246,11 @@ BOOL WINAPI DllMain(HMODULE instance, DWORD reason, LPVOID reserved) {
       break;
 
     case DLL_THREAD_DETACH:
+      // Commit and retire the thread state of the detaching thread. This is
+      // how per-thread counter pages get committed for threads that terminate
+      // without the instrumented module observing a detach event (e.g. in an
+      // instrumented EXE).
+      agent::basic_block_entry::BasicBlockEntry::Instance()->OnThreadDetach();
       break;
 
     case DLL_PROCESS_DETACH:
@@ -267,6 +281,21 @@ const uint32 kUserApplicationSlot = 0x700;
 const uint32 kNumSlots = 4U;
 const uint32 kInvalidBasicBlockId = ~0U;
 
+// The number of spill buffers each thread cycles through. One is actively
+// collecting events; the others are queued to or being returned by the
+// drain thread.
+const uint32 kNumSpillBuffers = 4U;
+
+// The capacity of the queue handing spill buffers to the drain thread.
+const size_t kSpillQueueCapacity = 256;
+
+// The number of times to yield when waiting on the drain thread before
+// giving up and dropping events.
+const size_t kSpillWaitIterations = 10000;
+
+// How often the drain thread polls for newly spilled buffers.
+const DWORD kDrainPollIntervalMs = 50;
+
 // The indexed_frequency_data for the bbentry instrumentation mode has 1 column.
 struct BBEntryFrequency {
   uint32 frequency;
@@ -289,13 +318,24 @@ struct BranchBufferEntry {
 base::LazyInstance<BasicBlockEntry> static_bbentry_instance =
     LAZY_INSTANCE_INITIALIZER;
 
-// Increment and saturate a 32-bit value.
+// Increment and saturate a 32-bit value. This is branch free: on overflow
+// the increment wraps the value to zero, and subtracting the wrap indicator
+// restores it to the saturated value.
 inline uint32 IncrementAndSaturate(uint32 value) {
-  if (value != ~0U)
-    ++value;
+  ++value;
+  value -= (value == 0);
   return value;
 }
 
+// Add and saturate a 32-bit value. This is branch free: on overflow the sum
+// wraps around, and or-ing in the all-ones mask derived from the wrap
+// indicator saturates it.
+inline uint32 AddAndSaturate(uint32 value, uint32 increment) {
+  uint32 result = value + increment;
+  result |= -static_cast<int32>(result < value);
+  return result;
+}
+
 // Get the address of the module containing @p addr. We do this by querying
 // for the allocation that contains @p addr. This must lie within the
 // instrumented module, and be part of the single allocation in which the
@@ -386,6 +426,32 @@ struct BasicBlockEntry::ExeMainEntryFrame {
 };
 COMPILE_ASSERT_IS_POD_OF_SIZE(BasicBlockEntry::ExeMainEntryFrame, 12);
 
+// A buffer of spilled branch events. The storage is owned by the thread
+// state that allocated it; the buffer cycles between its owner, which fills
+// it, and the drain thread, which replays it and hands it back.
+struct BasicBlockEntry::SpillBuffer {
+  // The thread state the events belong to. The drain thread replays the
+  // events against this state's counters and branch predictor.
+  ThreadState* owner;
+
+  // The number of valid entries in the buffer.
+  uint32 num_entries;
+
+  // The buffered branch events.
+  BranchBufferEntry entries[kBufferSize];
+};
+
+// The lock-free queue used to hand full spill buffers to the drain thread.
+// This reuses the MPSC queue of the ASan agent: the instrumented threads
+// push concurrently and the drain thread is the single consumer.
+class BasicBlockEntry::SpillQueue
+    : public asan::LockFreeCircularQueue<SpillBuffer*> {
+ public:
+  SpillQueue()
+      : asan::LockFreeCircularQueue<SpillBuffer*>(kSpillQueueCapacity) {
+  }
+};
+
 // The per-thread-per-instrumented-module state managed by this agent.
 class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
  public:
@@ -407,6 +473,19 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // Allocate temporary space to simulate a branch predictor.
   void AllocatePredictorCache();
 
+  // Allocate a private counter page for this thread. Subsequent counter
+  // updates are made to the private page, without any locking, and must be
+  // committed with CommitFrequencyPage() before this thread state is torn
+  // down.
+  void AllocateFrequencyPage();
+
+  // Sum the private counter page into the shared frequency data and reset the
+  // page. This is called from Flush() and acquires trace_lock() internally.
+  void CommitFrequencyPage();
+
+  // Returns true iff this thread updates a private counter page.
+  bool has_frequency_page() const { return !thread_frequency_data_.empty(); }
+
   // Saturation increment the frequency record for @p index. Note that in
   // Release mode, no range checking is performed on index.
   // @param basic_block_id the basic block index.
@@ -429,7 +508,27 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   //     entry, false otherwise.
   bool Push(uint32 basic_block_id);
 
-  // Flush pending values in the basic block ids buffer.
+  // Takes the full active buffer out of collection, installing a drained
+  // buffer in its place and accounting for the spill. Yields (but never
+  // locks) while the drain thread is behind.
+  // @returns the full buffer, or NULL if no drained buffer became available.
+  SpillBuffer* StartSpill();
+
+  // Returns @p buffer to this thread's pool once its events have been
+  // replayed (or abandoned) and accounts for the completed spill. Called
+  // from the drain thread, or from the owner when a spill is aborted.
+  void FinishSpill(SpillBuffer* buffer);
+
+  // Discards the events collected in the active buffer.
+  void DropActiveBuffer();
+
+  // Waits for the drain thread to finish with this thread's outstanding
+  // buffers.
+  // @returns true if no buffers remain outstanding, false on timeout.
+  bool WaitForOutstandingSpills();
+
+  // Flush pending values in the basic block ids buffer and commit the private
+  // counter page, if any.
   void Flush();
 
   // Return the id of the most recent basic block executed.
@@ -460,11 +559,12 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
 
  protected:
   // As a shortcut, this points to the beginning of the array of basic-block
-  // entry frequency values. With tracing enabled, this is equivalent to:
-  //     reinterpret_cast<uint32*>(this->trace_data->frequency_data)
-  // If tracing is not enabled, this will be set to point to a static
-  // allocation of IndexedFrequencyData::frequency_data.
-  uint32* frequency_data_;  // Under trace_lock_.
+  // entry frequency values. With tracing enabled, this points to this
+  // thread's private counter page (see thread_frequency_data_) and may be
+  // updated without holding trace_lock_. If tracing is not enabled, this will
+  // be set to point to a static allocation of
+  // IndexedFrequencyData::frequency_data, updated under trace_lock_.
+  uint32* frequency_data_;
 
   // Module information this thread state is gathering information on.
   const IndexedFrequencyData* module_data_;
@@ -472,12 +572,30 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // Lock corresponding to 'frequency_data_'.
   base::Lock* trace_lock_;
 
-  // Buffer used to queue basic block ids for later processing in batches.
-  std::vector<BranchBufferEntry> basic_block_id_buffer_;
+  // The buffer branch events are currently being collected into. Part of
+  // buffer_pool_.
+  SpillBuffer* active_buffer_;
+
+  // The spill buffers owned by this thread state.
+  std::vector<SpillBuffer*> buffer_pool_;
+
+  // Buffers handed back by the drain thread, awaiting reuse. The drain
+  // thread produces and this thread is the single consumer.
+  asan::LockFreeCircularQueue<SpillBuffer*> returned_buffers_;
+
+  // The number of this thread's buffers currently queued to or being
+  // replayed by the drain thread. Updated with interlocked operations.
+  volatile LONG outstanding_spills_;
 
   // Current offset of the next available entry in the basic block id buffer.
   uint32 basic_block_id_buffer_offset_;
 
+  // The private counter page for this thread. When non-empty, counter updates
+  // accumulate here and are summed into the shared frequency data when the
+  // thread detaches. The page is owned by this thread state, which is itself
+  // registered with the agent's thread state manager.
+  std::vector<uint32> thread_frequency_data_;
+
   // The branch predictor state (2-bit saturating counter).
   std::vector<uint8> predictor_data_;
 
@@ -494,14 +612,20 @@ BasicBlockEntry::ThreadState::ThreadState(IndexedFrequencyData* module_data,
     : frequency_data_(static_cast<uint32*>(frequency_data)),
       module_data_(module_data),
       trace_lock_(lock),
+      active_buffer_(NULL),
+      returned_buffers_(kNumSpillBuffers),
+      outstanding_spills_(0),
       basic_block_id_buffer_offset_(0),
       last_basic_block_id_(kInvalidBasicBlockId) {
 }
 
 BasicBlockEntry::ThreadState::~ThreadState() {
-  if (!basic_block_id_buffer_.empty())
+  if (active_buffer_ != NULL || has_frequency_page())
     Flush();
 
+  for (size_t i = 0; i < buffer_pool_.size(); ++i)
+    delete buffer_pool_[i];
+
   uint32 slot = GetBasicBlockData()->fs_slot;
   if (slot != 0) {
     uint32 address = kUserApplicationSlot + 4 * (slot - 1);
@@ -510,8 +634,22 @@ BasicBlockEntry::ThreadState::~ThreadState() {
 }
 
 void BasicBlockEntry::ThreadState::AllocateBasicBlockIdBuffer() {
-  DCHECK(basic_block_id_buffer_.empty());
-  basic_block_id_buffer_.resize(kBufferSize * sizeof(BranchBufferEntry));
+  DCHECK(active_buffer_ == NULL);
+  DCHECK(buffer_pool_.empty());
+
+  buffer_pool_.resize(kNumSpillBuffers);
+  for (size_t i = 0; i < buffer_pool_.size(); ++i) {
+    buffer_pool_[i] = new SpillBuffer();
+    buffer_pool_[i]->owner = this;
+  }
+
+  // One buffer starts out collecting events; the rest are spares for the
+  // drain thread to cycle through.
+  active_buffer_ = buffer_pool_[0];
+  for (size_t i = 1; i < buffer_pool_.size(); ++i) {
+    bool pushed = returned_buffers_.push(buffer_pool_[i]);
+    DCHECK(pushed);
+  }
 }
 
 void BasicBlockEntry::ThreadState::AllocatePredictorCache() {
@@ -519,6 +657,38 @@ void BasicBlockEntry::ThreadState::AllocatePredictorCache() {
   predictor_data_.resize(kPredictorCacheSize);
 }
 
+void BasicBlockEntry::ThreadState::AllocateFrequencyPage() {
+  DCHECK(thread_frequency_data_.empty());
+  DCHECK(module_data_ != NULL);
+  DCHECK_LT(0U, module_data_->num_entries);
+
+  size_t num_values = module_data_->num_entries * module_data_->num_columns;
+  thread_frequency_data_.resize(num_values);
+
+  // Redirect counter updates to the private page.
+  frequency_data_ = &thread_frequency_data_[0];
+}
+
+void BasicBlockEntry::ThreadState::CommitFrequencyPage() {
+  DCHECK(!thread_frequency_data_.empty());
+  DCHECK(module_data_ != NULL);
+
+  uint32* shared_data = static_cast<uint32*>(module_data_->frequency_data);
+  DCHECK(shared_data != NULL);
+
+  size_t num_values = module_data_->num_entries * module_data_->num_columns;
+  DCHECK_EQ(num_values, thread_frequency_data_.size());
+
+  base::AutoLock scoped_lock(*trace_lock_);
+  for (size_t offset = 0; offset < num_values; ++offset) {
+    uint32 value = thread_frequency_data_[offset];
+    if (value == 0)
+      continue;
+    shared_data[offset] = AddAndSaturate(shared_data[offset], value);
+    thread_frequency_data_[offset] = 0;
+  }
+}
+
 void BasicBlockEntry::ThreadState::reset_last_basic_block_id() {
   last_basic_block_id_ = kInvalidBasicBlockId;
 }
@@ -615,11 +785,12 @@ inline void BasicBlockEntry::ThreadState::Leave(uint32 basic_block_id) {
 bool BasicBlockEntry::ThreadState::Push(uint32 basic_block_id) {
   DCHECK(module_data_ != NULL);
   DCHECK(basic_block_id < module_data_->num_entries);
+  DCHECK(active_buffer_ != NULL);
 
   uint32 last_offset = basic_block_id_buffer_offset_;
-  DCHECK_LT(last_offset, basic_block_id_buffer_.size());
+  DCHECK_LT(last_offset, kBufferSize);
 
-  BranchBufferEntry* entry = &basic_block_id_buffer_[last_offset];
+  BranchBufferEntry* entry = &active_buffer_->entries[last_offset];
   entry->basic_block_id = basic_block_id;
   entry->last_basic_block_id = last_basic_block_id_;
 
@@ -628,28 +799,223 @@ bool BasicBlockEntry::ThreadState::Push(uint32 basic_block_id) {
   return basic_block_id_buffer_offset_ == kBufferSize;
 }
 
+BasicBlockEntry::SpillBuffer* BasicBlockEntry::ThreadState::StartSpill() {
+  DCHECK(active_buffer_ != NULL);
+
+  // Grab a drained buffer to take over collection. The drain thread hands
+  // buffers back as it replays them; yield briefly if it is behind.
+  SpillBuffer* spare = NULL;
+  size_t attempts = 0;
+  while (!returned_buffers_.pop(&spare)) {
+    if (++attempts > kSpillWaitIterations)
+      return NULL;
+    ::Sleep(0);
+  }
+
+  SpillBuffer* full = active_buffer_;
+  full->num_entries = basic_block_id_buffer_offset_;
+  active_buffer_ = spare;
+  basic_block_id_buffer_offset_ = 0;
+
+  ::InterlockedIncrement(&outstanding_spills_);
+  return full;
+}
+
+void BasicBlockEntry::ThreadState::FinishSpill(SpillBuffer* buffer) {
+  DCHECK(buffer != NULL);
+  DCHECK_EQ(this, buffer->owner);
+
+  buffer->num_entries = 0;
+  bool pushed = returned_buffers_.push(buffer);
+  DCHECK(pushed);
+
+  ::InterlockedDecrement(&outstanding_spills_);
+}
+
+void BasicBlockEntry::ThreadState::DropActiveBuffer() {
+  basic_block_id_buffer_offset_ = 0;
+}
+
+bool BasicBlockEntry::ThreadState::WaitForOutstandingSpills() {
+  size_t attempts = 0;
+  while (outstanding_spills_ != 0) {
+    if (++attempts > kSpillWaitIterations)
+      return false;
+    ::Sleep(0);
+  }
+  return true;
+}
+
 void BasicBlockEntry::ThreadState::Flush() {
-  uint32 last_offset = basic_block_id_buffer_offset_;
+  // Wait for the drain thread to finish with this thread's outstanding
+  // buffers; replaying concurrently with it would race on the counters and
+  // the predictor state. On timeout the pending events are abandoned, as
+  // documented for buffered mode.
+  if (!WaitForOutstandingSpills()) {
+    LOG(WARNING) << "Timed out waiting for spilled branch events to drain; "
+                 << "dropping pending events.";
+    DropActiveBuffer();
+    return;
+  }
+
+  if (active_buffer_ != NULL) {
+    uint32 last_offset = basic_block_id_buffer_offset_;
+
+    for (size_t offset = 0; offset < last_offset; ++offset) {
+      BranchBufferEntry* entry = &active_buffer_->entries[offset];
+      Enter(entry->basic_block_id, entry->last_basic_block_id);
+    }
 
-  for (size_t offset = 0; offset < last_offset; ++offset) {
-    BranchBufferEntry* entry = &basic_block_id_buffer_[offset];
-    Enter(entry->basic_block_id, entry->last_basic_block_id);
+    // Reset buffer.
+    basic_block_id_buffer_offset_ = 0;
   }
 
-  // Reset buffer.
-  basic_block_id_buffer_offset_ = 0;
+  // Publish the counters accumulated in the private page, if any.
+  if (has_frequency_page())
+    CommitFrequencyPage();
 }
 
 BasicBlockEntry* BasicBlockEntry::Instance() {
   return static_bbentry_instance.Pointer();
 }
 
-BasicBlockEntry::BasicBlockEntry() : registered_slots_() {
+BasicBlockEntry::BasicBlockEntry()
+    : registered_slots_(),
+      drain_thread_(NULL),
+      drain_stop_event_(NULL) {
   // Create a session.
   trace::client::InitializeRpcSession(&session_, &segment_);
 }
 
 BasicBlockEntry::~BasicBlockEntry() {
+  StopDrainThread();
+}
+
+bool BasicBlockEntry::StartDrainThread() {
+  // We expect this to be called from process attach events, which are
+  // serialized by the loader, so there is no need to lock.
+  if (drain_thread_ != NULL)
+    return true;
+
+  DCHECK(spill_queue_.get() == NULL);
+  spill_queue_.reset(new SpillQueue());
+
+  drain_stop_event_ = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (drain_stop_event_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CreateEvent failed: " << ::common::LogWe(error) << ".";
+    spill_queue_.reset();
+    return false;
+  }
+
+  drain_thread_ = ::CreateThread(NULL, 0, &DrainThreadProc, this, 0, NULL);
+  if (drain_thread_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CreateThread failed: " << ::common::LogWe(error) << ".";
+    ::CloseHandle(drain_stop_event_);
+    drain_stop_event_ = NULL;
+    spill_queue_.reset();
+    return false;
+  }
+
+  return true;
+}
+
+void BasicBlockEntry::StopDrainThread() {
+  if (drain_thread_ == NULL)
+    return;
+
+  ::SetEvent(drain_stop_event_);
+  ::WaitForSingleObject(drain_thread_, INFINITE);
+
+  ::CloseHandle(drain_thread_);
+  drain_thread_ = NULL;
+  ::CloseHandle(drain_stop_event_);
+  drain_stop_event_ = NULL;
+}
+
+DWORD WINAPI BasicBlockEntry::DrainThreadProc(void* self) {
+  DCHECK(self != NULL);
+  reinterpret_cast<BasicBlockEntry*>(self)->DrainThreadMain();
+  return 0;
+}
+
+void BasicBlockEntry::DrainThreadMain() {
+  DCHECK(spill_queue_.get() != NULL);
+
+  while (true) {
+    SpillBuffer* buffer = NULL;
+    while (spill_queue_->pop(&buffer))
+      ReplaySpillBuffer(buffer);
+
+    // The queue is empty; wait for more work or for the stop signal.
+    DWORD status = ::WaitForSingleObject(drain_stop_event_,
+                                         kDrainPollIntervalMs);
+    if (status == WAIT_OBJECT_0) {
+      // Replay any late spills before exiting.
+      while (spill_queue_->pop(&buffer))
+        ReplaySpillBuffer(buffer);
+      return;
+    }
+  }
+}
+
+void BasicBlockEntry::ReplaySpillBuffer(SpillBuffer* buffer) {
+  DCHECK(buffer != NULL);
+
+  ThreadState* owner = buffer->owner;
+  DCHECK(owner != NULL);
+
+  for (uint32 i = 0; i < buffer->num_entries; ++i) {
+    BranchBufferEntry* entry = &buffer->entries[i];
+    owner->Enter(entry->basic_block_id, entry->last_basic_block_id);
+  }
+
+  // Publish the counters so that the events become visible in the shared
+  // frequency data. Buffers are only ever spilled by threads updating a
+  // private counter page.
+  DCHECK(owner->has_frequency_page());
+  owner->CommitFrequencyPage();
+
+  owner->FinishSpill(buffer);
+}
+
+void BasicBlockEntry::SpillBasicBlockIdBuffer(ThreadState* state) {
+  DCHECK(state != NULL);
+
+  // Without a drain thread, fall back to replaying the buffer in place.
+  if (drain_thread_ == NULL) {
+    if (state->has_frequency_page()) {
+      // The flush replays into this thread's private counter page.
+      state->Flush();
+    } else {
+      base::AutoLock scoped_lock(*state->trace_lock());
+      state->Flush();
+    }
+    return;
+  }
+
+  SpillBuffer* buffer = state->StartSpill();
+  if (buffer == NULL) {
+    // The drain thread has fallen pathologically far behind; drop the
+    // events rather than blocking or racing the replay.
+    LOG(WARNING) << "No drained spill buffer available; dropping buffered "
+                 << "branch events.";
+    state->DropActiveBuffer();
+    return;
+  }
+
+  // Hand the buffer to the drain thread, yielding briefly if the spill
+  // queue is full.
+  size_t attempts = 0;
+  while (!spill_queue_->push(buffer)) {
+    if (++attempts > kSpillWaitIterations) {
+      LOG(WARNING) << "Spill queue full; dropping buffered branch events.";
+      state->FinishSpill(buffer);
+      return;
+    }
+    ::Sleep(0);
+  }
 }
 
 bool BasicBlockEntry::InitializeFrequencyData(IndexedFrequencyData* data) {
@@ -766,6 +1132,11 @@ BasicBlockEntry::ThreadState* BasicBlockEntry::CreateThreadState(
   // Allocate buffer to which basic block id are pushed before being committed.
   state->AllocateBasicBlockIdBuffer();
 
+  // Allocate a private counter page for this thread. Counters accumulate in
+  // the page without locking and are summed into the shared frequency data
+  // when the thread detaches.
+  state->AllocateFrequencyPage();
+
   return state;
 }
 
@@ -804,8 +1175,13 @@ void WINAPI BasicBlockEntry::IncrementIndexedFreqDataHook(
     state = Instance()->CreateThreadState(entry_frame->module_data);
   }
 
-  base::AutoLock scoped_lock(*state->trace_lock());
-  state->Increment(entry_frame->index);
+  if (state->has_frequency_page()) {
+    // The update goes to this thread's private counter page; no lock needed.
+    state->Increment(entry_frame->index);
+  } else {
+    base::AutoLock scoped_lock(*state->trace_lock());
+    state->Increment(entry_frame->index);
+  }
 }
 
 void WINAPI BasicBlockEntry::BranchEnterHook(
@@ -820,9 +1196,12 @@ void WINAPI BasicBlockEntry::BranchEnterHook(
     state = Instance()->CreateThreadState(entry_frame->module_data);
   }
 
-  base::AutoLock scoped_lock(*state->trace_lock());
-  uint32 last_basic_block_id = state->last_basic_block_id();
-  state->Enter(entry_frame->index, last_basic_block_id);
+  if (state->has_frequency_page()) {
+    state->Enter(entry_frame->index, state->last_basic_block_id());
+  } else {
+    base::AutoLock scoped_lock(*state->trace_lock());
+    state->Enter(entry_frame->index, state->last_basic_block_id());
+  }
   state->reset_last_basic_block_id();
 }
 
@@ -838,10 +1217,8 @@ void WINAPI BasicBlockEntry::BranchEnterBufferedHook(
     state = Instance()->CreateThreadState(entry_frame->module_data);
   }
 
-  if (state->Push(entry_frame->index)) {
-    base::AutoLock scoped_lock(*state->trace_lock());
-    state->Flush();
-  }
+  if (state->Push(entry_frame->index))
+    Instance()->SpillBasicBlockIdBuffer(state);
   state->reset_last_basic_block_id();
 }
 
@@ -869,9 +1246,12 @@ void __fastcall BasicBlockEntry::BranchEnterHookSlot(uint32 index) {
   if (state == NULL)
     return;
 
-  base::AutoLock scoped_lock(*state->trace_lock());
-  uint32 last_basic_block_id = state->last_basic_block_id();
-  state->Enter(index, last_basic_block_id);
+  if (state->has_frequency_page()) {
+    state->Enter(index, state->last_basic_block_id());
+  } else {
+    base::AutoLock scoped_lock(*state->trace_lock());
+    state->Enter(index, state->last_basic_block_id());
+  }
   state->reset_last_basic_block_id();
 }
 
@@ -881,10 +1261,8 @@ void __fastcall BasicBlockEntry::BranchEnterBufferedHookSlot(uint32 index) {
   if (state == NULL)
     return;
 
-  if (state->Push(index)) {
-    base::AutoLock scoped_lock(*state->trace_lock());
-    state->Flush();
-  }
+  if (state->Push(index))
+    Instance()->SpillBasicBlockIdBuffer(state);
   state->reset_last_basic_block_id();
 }
 
@@ -929,6 +1307,9 @@ void WINAPI BasicBlockEntry::DllMainEntryHook(DllMainEntryFrame* entry_frame) {
       break;
 
     case DLL_PROCESS_DETACH:
+      Instance()->OnProcessDetach(entry_frame->module_data);
+      break;
+
     case DLL_THREAD_DETACH:
       Instance()->OnThreadDetach(entry_frame->module_data);
       break;
@@ -1018,6 +1399,13 @@ void BasicBlockEntry::OnProcessAttach(IndexedFrequencyData* module_data) {
   if (basicblock_data->fs_slot != 0)
     RegisterFastPathSlot(module_data, basicblock_data->fs_slot);
 
+  // Keep track of the module so that the thread states of detaching threads
+  // can be retired from the agent's thread detach notification.
+  {
+    base::AutoLock scoped_lock(lock_);
+    registered_modules_.push_back(module_data);
+  }
+
   // Register this module with the call_trace if the session is not disabled.
   // Note that we expect module_data to be statically defined within the
   // module of interest, so we can use its address to lookup the module.
@@ -1033,9 +1421,44 @@ void BasicBlockEntry::OnProcessAttach(IndexedFrequencyData* module_data) {
 
   RegisterModule(module_data);
 
+  // Branch profiling in buffered mode hands full event buffers off to a
+  // background thread; make sure it is running.
+  if (module_data->data_type == IndexedFrequencyData::BRANCH &&
+      !StartDrainThread()) {
+    LOG(ERROR) << "Failed to start the spill drain thread, falling back to "
+               << "synchronous flushes.";
+  }
+
   LOG(INFO) << "BBEntry client initialized.";
 }
 
+void BasicBlockEntry::OnThreadDetach() {
+  // Grab a copy of the registered modules so that we don't hold lock_ while
+  // committing counter pages, which acquires it.
+  std::vector<IndexedFrequencyData*> modules;
+  {
+    base::AutoLock scoped_lock(lock_);
+    modules = registered_modules_;
+  }
+
+  for (size_t i = 0; i < modules.size(); ++i)
+    OnThreadDetach(modules[i]);
+}
+
+void BasicBlockEntry::OnProcessDetach(IndexedFrequencyData* module_data) {
+  DCHECK(module_data != NULL);
+
+  OnThreadDetach(module_data);
+
+  // Unregister the module; it may be unloaded after this event and must no
+  // longer be visited on thread detach.
+  base::AutoLock scoped_lock(lock_);
+  std::vector<IndexedFrequencyData*>::iterator it = std::find(
+      registered_modules_.begin(), registered_modules_.end(), module_data);
+  if (it != registered_modules_.end())
+    registered_modules_.erase(it);
+}
+
 void BasicBlockEntry::OnThreadDetach(IndexedFrequencyData* module_data) {
   DCHECK(module_data != NULL);
   DCHECK_EQ(1U, module_data->initialization_attempted);
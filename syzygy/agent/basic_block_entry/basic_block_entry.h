@@ -29,6 +29,7 @@
 #include <vector>
 
 #include "base/lazy_instance.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/win/pe_image.h"
 #include "syzygy/agent/common/thread_state.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -113,12 +114,27 @@ class BasicBlockEntry {
   // Called from _indirect_penter_exemain.
   static void WINAPI ExeMainEntryHook(ExeMainEntryFrame* entry_frame);
 
+  // Called on DLL_THREAD_DETACH of the agent DLL itself. Commits and retires
+  // the detaching thread's thread state for every registered module. This
+  // ensures per-thread counter pages are committed even for threads that
+  // terminate without the instrumented module observing a detach event.
+  void OnThreadDetach();
+
  protected:
   // This class defines the per-thread-per-instrumented-module state managed
   // by this agent.
   class ThreadState;
   friend class ThreadState;
 
+  // A buffer of branch events spilled by a thread for asynchronous
+  // draining, along with the thread state the events belong to. Defined in
+  // basic_block_entry.cc.
+  struct SpillBuffer;
+
+  // The lock-free queue used to hand full spill buffers to the drain
+  // thread. Defined in basic_block_entry.cc.
+  class SpillQueue;
+
   // Make sure the LazyInstance can be created.
   friend struct base::DefaultLazyInstanceTraits<BasicBlockEntry>;
 
@@ -132,8 +148,11 @@ class BasicBlockEntry {
   // received by DllMainEntryHook().
   void OnProcessAttach(IndexedFrequencyData* module_data);
 
-  // Handles DLL_THREAD_DETACH and DLL_PROCESS_DETACH messages received by
-  // DllMainEntryHook().
+  // Handles DLL_PROCESS_DETACH messages received by DllMainEntryHook().
+  // Commits the detaching thread's state and unregisters @p module_data.
+  void OnProcessDetach(IndexedFrequencyData* module_data);
+
+  // Handles DLL_THREAD_DETACH messages received by DllMainEntryHook().
   void OnThreadDetach(IndexedFrequencyData* module_data);
 
   // Registers the module containing @p addr with the call_trace_service.
@@ -160,9 +179,34 @@ class BasicBlockEntry {
   template<int S>
   static ThreadState* GetThreadStateSlot();
 
+  // Starts the background thread that drains spilled branch event buffers,
+  // if it is not already running.
+  // @returns true if the drain thread is running.
+  bool StartDrainThread();
+
+  // Stops the drain thread, replaying any buffers still queued.
+  void StopDrainThread();
+
+  // Hands the full branch event buffer of @p state off to the drain thread
+  // and installs a fresh buffer for collection. Never takes a lock; if no
+  // drain thread is running this falls back to replaying the buffer in
+  // place, as before.
+  void SpillBasicBlockIdBuffer(ThreadState* state);
+
+  // The entry point and main loop of the drain thread.
+  static DWORD WINAPI DrainThreadProc(void* self);
+  void DrainThreadMain();
+
+  // Replays @p buffer against the counters of its owning thread state,
+  // publishes the counters and returns the buffer to the owner.
+  void ReplaySpillBuffer(SpillBuffer* buffer);
+
   // Registered thread local specific slot.
   uint32 registered_slots_;
 
+  // The module data of the instrumented modules registered with this agent.
+  std::vector<IndexedFrequencyData*> registered_modules_;  // Under lock_.
+
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
@@ -177,6 +221,15 @@ class BasicBlockEntry {
 
   // Global lock to avoid concurrent segment_ update.
   base::Lock lock_;
+
+  // The queue of full spill buffers awaiting the drain thread. Created by
+  // StartDrainThread.
+  scoped_ptr<SpillQueue> spill_queue_;
+
+  // The drain thread and the event used to stop it. Valid while the drain
+  // thread is running.
+  HANDLE drain_thread_;
+  HANDLE drain_stop_event_;
 };
 
 // This structure contains the BasicBlockEntry IndexedFrequencyData specifics
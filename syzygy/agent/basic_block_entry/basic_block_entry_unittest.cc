@@ -173,6 +173,9 @@ class BasicBlockEntryTest : public testing::Test {
         SimulateModuleEvent(DLL_PROCESS_DETACH);
         break;
       case kExeMain:
+        // An EXE has no detach event. Simulate the main thread detaching so
+        // that its private counter page gets committed.
+        SimulateModuleEvent(DLL_THREAD_DETACH);
         break;
       default:
         NOTREACHED();
@@ -896,6 +899,14 @@ TEST_F(BasicBlockEntryTest, BranchWithBufferingEvents) {
     SimulateBranchExit(0);
   }
 
+  // The spilled buffer is drained asynchronously; wait for the events to
+  // become visible.
+  int attempts = 0;
+  while (frequency_data[1 * kNumBranchColumns] == 0 && attempts < 1000) {
+    ::Sleep(10);
+    ++attempts;
+  }
+
   // Validate some events are committed.
   EXPECT_NE(0U, frequency_data[0 * kNumBranchColumns]);
   // Entering basic block 1 must be committed.
@@ -908,6 +919,13 @@ TEST_F(BasicBlockEntryTest, BranchWithBufferingEvents) {
     SimulateBranchExit(0);
   }
 
+  // Again, wait for the drain thread to commit the events.
+  attempts = 0;
+  while (frequency_data[0] <= old_count && attempts < 1000) {
+    ::Sleep(10);
+    ++attempts;
+  }
+
   // Expect to have increasing values.
   uint32 new_count = frequency_data[0];
   EXPECT_LT(old_count, new_count);
@@ -178,6 +178,12 @@ class Client::ThreadLocalData {
   // Allocates a new enter event.
   TraceEnterEventData* AllocateEnterEvent();
 
+  // Records a function entry as a counted enter event. If the last entry of
+  // the current counted batch describes the same call site its count is
+  // bumped in place; otherwise a new entry is appended.
+  TraceCountedEnterEventData* AllocateCountedEnterEvent(RetAddr retaddr,
+                                                        FuncAddr function);
+
   // Flushes the current trace file segment.
   bool FlushSegment();
 
@@ -191,9 +197,16 @@ class Client::ThreadLocalData {
   // The current batch record we're extending, if any.
   // This will point into the associated trace file segment's buffer.
   TraceBatchEnterData* batch;
+
+  // The current counted batch record we're extending, if any. Only one of
+  // batch and counted_batch is ever in use, depending on whether entry
+  // coalescing is enabled.
+  TraceBatchCountedEnterData* counted_batch;
 };
 
-Client::Client() {
+Client::Client()
+    : coalesce_entries_(
+          trace::client::IsEntryCoalescingEnabledForThisModule()) {
 }
 
 Client::~Client() {
@@ -362,6 +375,11 @@ void Client::LogEvent_FunctionEntry(EntryFrame *entry_frame,
   //     this event to the buffer in order to guarantee precision.
 
   // Capture the basic call info and timestamp.
+  if (coalesce_entries_) {
+    data->AllocateCountedEnterEvent(entry_frame->retaddr, function);
+    return;
+  }
+
   TraceEnterEventData* enter = data->AllocateEnterEvent();
   if (enter != NULL) {
     enter->retaddr = entry_frame->retaddr;
@@ -401,7 +419,8 @@ void Client::FreeThreadData() {
     FreeThreadData(data);
 }
 
-Client::ThreadLocalData::ThreadLocalData(Client* c) : client(c), batch(NULL) {
+Client::ThreadLocalData::ThreadLocalData(Client* c)
+    : client(c), batch(NULL), counted_batch(NULL) {
 }
 
 TraceEnterEventData* Client::ThreadLocalData::AllocateEnterEvent() {
@@ -451,10 +470,84 @@ TraceEnterEventData* Client::ThreadLocalData::AllocateEnterEvent() {
   return &batch->calls[0];
 }
 
+TraceCountedEnterEventData* Client::ThreadLocalData::AllocateCountedEnterEvent(
+    RetAddr retaddr, FuncAddr function) {
+  // If the last entry of the current batch describes the same call site, the
+  // new call coalesces onto it. The entry stays fully formed throughout, so
+  // bumping the count in place is safe even if this thread is terminated
+  // mid-update.
+  if (counted_batch != NULL) {
+    DCHECK_LT(0u, counted_batch->num_entries);
+    TraceCountedEnterEventData* last =
+        &counted_batch->entries[counted_batch->num_entries - 1];
+    // A saturated count never coalesces; the call starts a new entry below.
+    if (last->retaddr == retaddr && last->function == function &&
+        last->count != ~0U) {
+      last->count += 1;
+      return last;
+    }
+  }
+
+  // The call site differs from the current run, so a new entry is appended.
+  // Do we have a batch record that we can grow?
+  if (counted_batch != NULL &&
+      segment.CanAllocateRaw(sizeof(TraceCountedEnterEventData))) {
+    TraceCountedEnterEventData* entry =
+        reinterpret_cast<TraceCountedEnterEventData*>(segment.write_ptr);
+    // See AllocateEnterEvent for why the order of operations here matters:
+    // the new record is initialized first, then the enclosures are grown
+    // from the outermost inward, which keeps the shared memory buffer
+    // self-consistent if this thread is terminated part-way through.
+
+    // Initialize the new record.
+    memset(entry, 0, sizeof(*entry));
+
+    // Update the file segment size.
+    segment.write_ptr += sizeof(TraceCountedEnterEventData);
+    segment.header->segment_length += sizeof(TraceCountedEnterEventData);
+
+    // Extend the record enclosure.
+    RecordPrefix* prefix = trace::client::GetRecordPrefix(counted_batch);
+    prefix->size += sizeof(TraceCountedEnterEventData);
+
+    // Update the inner counter.
+    DCHECK(entry == counted_batch->entries + counted_batch->num_entries);
+    counted_batch->num_entries += 1;
+
+    // And lastly fill in the record, function last: the parser discards a
+    // trailing entry whose function is NULL.
+    entry->count = 1;
+    entry->retaddr = retaddr;
+    entry->function = function;
+
+    return entry;
+  }
+
+  // Do we need to scarf a new buffer?
+  if (counted_batch != NULL ||
+      !segment.CanAllocate(sizeof(TraceBatchCountedEnterData))) {
+    if (!client->session_.ExchangeBuffer(&segment)) {
+      return NULL;
+    }
+  }
+
+  counted_batch = segment.AllocateTraceRecord<TraceBatchCountedEnterData>();
+  counted_batch->thread_id = segment.header->thread_id;
+  counted_batch->num_entries = 1;
+
+  TraceCountedEnterEventData* entry = &counted_batch->entries[0];
+  entry->count = 1;
+  entry->retaddr = retaddr;
+  entry->function = function;
+
+  return entry;
+}
+
 bool Client::ThreadLocalData::FlushSegment() {
   DCHECK(IsInitialized());
 
   batch = NULL;
+  counted_batch = NULL;
   return client->session_.ExchangeBuffer(&segment);
 }
 
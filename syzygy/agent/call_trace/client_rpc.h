@@ -124,6 +124,11 @@ class Client {
   // Our RPC session state.
   trace::client::RpcSession session_;
 
+  // If true, back-to-back entries to the same function from the same call
+  // site are coalesced into counted entry records. Configured via the
+  // SYZYGY_COALESCE_ENTRIES environment variable.
+  bool coalesce_entries_;
+
   // This points to our per-thread state.
   mutable base::ThreadLocalPointer<ThreadLocalData> tls_;
 };
@@ -95,6 +95,10 @@ class StackCapture {
   //     RemoveRef will be nops, and HasNoRefs will always return false.
   bool RefCountIsSaturated() const { return ref_count_ == kMaxRefCount; }
 
+  // Saturates the reference count of this stack capture, making it permanent.
+  // Further calls to AddRef and RemoveRef will be nops.
+  void MarkAsSaturated() { ref_count_ = kMaxRefCount; }
+
   // @returns true if this stack capture is not referenced, false otherwise.
   bool HasNoRefs() const { return ref_count_ == 0; }
 
@@ -259,7 +259,18 @@ bool Coverage::InitializeCoverageData(void* module_base,
   trace_coverage_data->num_columns = 1;
   trace_coverage_data->num_entries = coverage_data->num_entries;
 
+  // Seed the shared buffer with any hits already recorded in the image's
+  // static frequency buffer. Instrumented code may run before this session
+  // is established (threads racing the initialization under the loader
+  // lock); without this those early hits would be dropped.
+  ::memcpy(trace_coverage_data->frequency_data,
+           coverage_data->frequency_data,
+           coverage_data->num_entries * coverage_data->frequency_size);
+
   // Hook up the newly allocated buffer to the call-trace instrumentation.
+  // From here on the instrumentation records directly into the shared
+  // call-trace segment, which the service snapshots at flush points; no
+  // client-side copy of the coverage data is ever made.
   coverage_data->frequency_data =
       trace_coverage_data->frequency_data;
 
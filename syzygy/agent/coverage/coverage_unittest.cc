@@ -261,5 +261,45 @@ TEST_F(CoverageClientTest, VisitOneBB) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
 }
 
+TEST_F(CoverageClientTest, PreInitializationHitsArePreserved) {
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  HMODULE self = ::GetModuleHandle(NULL);
+  DWORD process_id = ::GetCurrentProcessId();
+  DWORD thread_id = ::GetCurrentThreadId();
+
+  // Visit a block before the client is initialized. This hit lands in the
+  // static frequency buffer and must be carried over to the shared buffer.
+  VisitBlock(1);
+
+  void* data = coverage_data.frequency_data;
+  EXPECT_TRUE(DllMainThunk(self, DLL_PROCESS_ATTACH, NULL));
+  ASSERT_NE(data, coverage_data.frequency_data);
+
+  VisitBlock(0);
+
+  // Unload the DLL and stop the service.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+  const uint8 kExpectedCoverageData[kBasicBlockCount] = { 1, 1 };
+
+  // Set up expectations for what should be in the trace.
+  EXPECT_CALL(handler_, OnProcessStarted(_, process_id, _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        process_id,
+                                        thread_id,
+                                        ModuleAtAddress(self)));
+  EXPECT_CALL(handler_, OnIndexedFrequency(
+      _,
+      process_id,
+      thread_id,
+      CoverageDataMatches(self, kBasicBlockCount, kExpectedCoverageData)));
+  EXPECT_CALL(handler_, OnProcessEnded(_, process_id));
+
+  // Replay the log.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
+}
+
 }  // namespace coverage
 }  // namespace agent
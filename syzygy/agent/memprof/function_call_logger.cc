@@ -19,12 +19,27 @@
 namespace agent {
 namespace memprof {
 
+namespace {
+
+// The number of slots in the call-site summary table. Must be a power of
+// two. At 32 bytes a slot this is 128KB of agent memory.
+const size_t kCallSummaryTableSize = 4096;
+
+// The maximum number of occupied slots before pending summaries are
+// emitted and the table is reset. Past this load factor the linear probe
+// chains start to degrade.
+const size_t kCallSummaryTableMaxLoad = kCallSummaryTableSize / 2;
+
+}  // namespace
+
 FunctionCallLogger::FunctionCallLogger(
     trace::client::RpcSession* session)
     : session_(session),
       stack_trace_tracking_(kTrackingNone),
       serialize_timestamps_(false),
+      aggregate_function_calls_(false),
       call_counter_(0),
+      call_summary_count_(0),
       serial_(0) {
   DCHECK_NE(static_cast<trace::client::RpcSession*>(nullptr), session);
 
@@ -106,6 +121,86 @@ uint32 FunctionCallLogger::GetStackTraceId(TraceFileSegment* segment) {
   return stack.stack_id();
 }
 
+void FunctionCallLogger::RecordFunctionCall(TraceFileSegment* segment,
+                                            uint32 function_id,
+                                            uint32 stack_trace_id,
+                                            uint64 bytes) {
+  DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
+  base::AutoLock lock(lock_);
+
+  // The table is lazily allocated so that non-aggregating sessions don't
+  // pay for it.
+  if (call_summaries_.empty())
+    call_summaries_.resize(kCallSummaryTableSize);
+
+  // Emit pending summaries and start afresh if the table is getting
+  // crowded.
+  if (call_summary_count_ >= kCallSummaryTableMaxLoad)
+    EmitCallSummariesImpl(segment);
+
+  // Open addressing with linear probing. The table is kept at most half
+  // full so the probe always terminates.
+  size_t slot = (function_id * 0x9E3779B9 + stack_trace_id * 0x85EBCA6B) &
+      (kCallSummaryTableSize - 1);
+  while (true) {
+    CallSummary* summary = &call_summaries_[slot];
+    if (summary->call_count == 0) {
+      summary->function_id = function_id;
+      summary->stack_trace_id = stack_trace_id;
+      summary->call_count = 1;
+      summary->total_bytes = bytes;
+      summary->max_bytes = bytes;
+      ++call_summary_count_;
+      return;
+    }
+    if (summary->function_id == function_id &&
+        summary->stack_trace_id == stack_trace_id) {
+      ++summary->call_count;
+      summary->total_bytes += bytes;
+      if (bytes > summary->max_bytes)
+        summary->max_bytes = bytes;
+      return;
+    }
+    slot = (slot + 1) & (kCallSummaryTableSize - 1);
+  }
+}
+
+void FunctionCallLogger::EmitCallSummaries(TraceFileSegment* segment) {
+  DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
+  base::AutoLock lock(lock_);
+  EmitCallSummariesImpl(segment);
+}
+
+void FunctionCallLogger::EmitCallSummariesImpl(TraceFileSegment* segment) {
+  DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
+  lock_.AssertAcquired();
+
+  for (size_t i = 0; i < call_summaries_.size(); ++i) {
+    CallSummary* summary = &call_summaries_[i];
+    if (summary->call_count == 0)
+      continue;
+
+    if (!segment->CanAllocate(sizeof(TraceFunctionCallSummary)) &&
+        !FlushSegment(segment)) {
+      break;
+    }
+    DCHECK(segment->CanAllocate(sizeof(TraceFunctionCallSummary)));
+
+    TraceFunctionCallSummary* data =
+        segment->AllocateTraceRecord<TraceFunctionCallSummary>();
+    DCHECK_NE(static_cast<TraceFunctionCallSummary*>(nullptr), data);
+    data->function_id = summary->function_id;
+    data->stack_trace_id = summary->stack_trace_id;
+    data->call_count = summary->call_count;
+    data->total_bytes = summary->total_bytes;
+    data->max_bytes = summary->max_bytes;
+
+    summary->call_count = 0;
+  }
+
+  call_summary_count_ = 0;
+}
+
 bool FunctionCallLogger::FlushSegment(TraceFileSegment* segment) {
   DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
   return session_->ExchangeBuffer(segment);
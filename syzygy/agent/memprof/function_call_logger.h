@@ -19,6 +19,7 @@
 #define SYZYGY_AGENT_MEMPROF_FUNCTION_CALL_LOGGER_H_
 
 #include <set>
+#include <vector>
 
 #include "syzygy/agent/memprof/parameters.h"
 #include "syzygy/trace/client/rpc_session.h"
@@ -30,7 +31,9 @@ class FunctionCallLogger {
  public:
   // Forward declarations.
   struct NoArgument;
+  struct ByteCount;
   template<typename ArgType> struct ArgumentSerializer;
+  template<typename ArgType> struct ArgumentByteCount;
 
   typedef trace::client::TraceFileSegment TraceFileSegment;
 
@@ -76,6 +79,24 @@ class FunctionCallLogger {
                                 ArgType4 arg4 = NoArgument(),
                                 ArgType5 arg5 = NoArgument());
 
+  // Records a function call for per-call-site aggregation. This updates the
+  // call site's running totals in memory rather than emitting a record;
+  // summaries are emitted when the table fills up and via EmitCallSummaries.
+  // @param segment The segment to write to if summaries must be emitted.
+  // @param function_id The ID of the function that was called.
+  // @param stack_trace_id The ID of the stack trace of the call site.
+  // @param bytes The byte count associated with this call, or zero for
+  //     functions without a size-like argument.
+  void RecordFunctionCall(TraceFileSegment* segment,
+                          uint32 function_id,
+                          uint32 stack_trace_id,
+                          uint64 bytes);
+
+  // Emits a TraceFunctionCallSummary record for every call site with
+  // pending totals, and resets the table.
+  // @param segment The segment to write to.
+  void EmitCallSummaries(TraceFileSegment* segment);
+
   // @name Accessors and mutators.
   // @{
   StackTraceTracking stack_trace_tracking() const {
@@ -90,6 +111,12 @@ class FunctionCallLogger {
   void set_serialize_timestamps(bool serialize_timestamps) {
     serialize_timestamps_ = serialize_timestamps;
   }
+  bool aggregate_function_calls() const {
+    return aggregate_function_calls_;
+  }
+  void set_aggregate_function_calls(bool aggregate_function_calls) {
+    aggregate_function_calls_ = aggregate_function_calls;
+  }
   // @}
 
   // @returns a unique serial number for this function call logger.
@@ -100,12 +127,21 @@ class FunctionCallLogger {
   // Flushes the provided segment, and gets a new one.
   bool FlushSegment(TraceFileSegment* segment);
 
+  // Emits pending call summaries and resets the table. Must be called
+  // under lock_.
+  // @param segment The segment to write to.
+  void EmitCallSummariesImpl(TraceFileSegment* segment);
+
   // The stack-trace tracking mode. Default to kTrackingNone.
   StackTraceTracking stack_trace_tracking_;
 
   // Whether or not timestamps are being serialized.
   bool serialize_timestamps_;
 
+  // Whether or not function calls are aggregated per call site rather than
+  // emitted individually. Defaults to false.
+  bool aggregate_function_calls_;
+
   // The RPC session events are being written to.
   trace::client::RpcSession* session_;
 
@@ -126,6 +162,27 @@ class FunctionCallLogger {
   typedef std::set<uint32> StackIdSet;
   StackIdSet emitted_stack_ids_;  // Under lock_.
 
+  // Running totals for a single call site, keyed by function and stack
+  // trace ID. A |call_count| of zero marks an empty slot.
+  struct CallSummary {
+    uint32 function_id;
+    uint32 stack_trace_id;
+    uint64 call_count;
+    uint64 total_bytes;
+    uint64 max_bytes;
+  };
+
+  // The call-site summary table, used when aggregate_function_calls_ is
+  // enabled. This is a flat open-addressed hash table with linear probing,
+  // lazily allocated on first use. It is kept at most half full; when the
+  // load limit is reached pending summaries are emitted and the table is
+  // reset.
+  typedef std::vector<CallSummary> CallSummaryTable;
+  CallSummaryTable call_summaries_;  // Under lock_.
+
+  // The number of occupied slots in |call_summaries_|.
+  size_t call_summary_count_;  // Under lock_.
+
   // A unique serial number generated at construction time. For unittesting.
   uint32 serial_;
 
@@ -137,6 +194,30 @@ class FunctionCallLogger {
 // function call reporting helper.
 struct FunctionCallLogger::NoArgument {};
 
+// Tags an argument as a byte count. In detailed mode this serializes
+// exactly like the underlying size_t; in aggregating mode it contributes
+// to the call site's running byte totals.
+struct FunctionCallLogger::ByteCount {
+  explicit ByteCount(size_t value) : value(value) {}
+  size_t value;
+};
+
+// Helper for extracting the byte count of an argument in aggregating mode.
+// Only ByteCount arguments contribute.
+template<typename ArgType>
+struct FunctionCallLogger::ArgumentByteCount {
+  uint64 Get(const ArgType& argument) {
+    return 0;
+  }
+};
+
+template<> struct FunctionCallLogger::ArgumentByteCount<
+    FunctionCallLogger::ByteCount> {
+  uint64 Get(const ByteCount& argument) {
+    return argument.value;
+  }
+};
+
 // Helper for serializing argument contents.
 template<typename ArgType>
 struct FunctionCallLogger::ArgumentSerializer {
@@ -159,6 +240,19 @@ template<> struct FunctionCallLogger::ArgumentSerializer<
   }
 };
 
+// A serializer for byte-count arguments. These serialize exactly like the
+// underlying size_t, so tagging an argument doesn't change the format of
+// emitted TraceDetailedFunctionCall records.
+template<> struct FunctionCallLogger::ArgumentSerializer<
+    FunctionCallLogger::ByteCount> {
+  size_t size() const {
+    return sizeof(size_t);
+  }
+  void serialize(ByteCount argument, uint8* buffer) {
+    ::memcpy(buffer, &argument.value, sizeof(argument.value));
+  }
+};
+
 // Implementation off the detailed function call logger. Populates a
 // TraceDetailedFunctionCall buffer with variable length encodings of
 // the arguments. Arguments are serialized using the ArgumentSerializer
@@ -179,6 +273,21 @@ void FunctionCallLogger::EmitDetailedFunctionCall(TraceFileSegment* segment,
                                                   ArgType4 arg4,
                                                   ArgType5 arg5) {
   DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
+
+  // In aggregating mode update the call site's running totals instead of
+  // emitting a detailed record.
+  if (aggregate_function_calls_) {
+    uint64 bytes = 0;
+    bytes += ArgumentByteCount<ArgType0>().Get(arg0);
+    bytes += ArgumentByteCount<ArgType1>().Get(arg1);
+    bytes += ArgumentByteCount<ArgType2>().Get(arg2);
+    bytes += ArgumentByteCount<ArgType3>().Get(arg3);
+    bytes += ArgumentByteCount<ArgType4>().Get(arg4);
+    bytes += ArgumentByteCount<ArgType5>().Get(arg5);
+    RecordFunctionCall(segment, function_id, stack_trace_id, bytes);
+    return;
+  }
+
   size_t args_count = 0;
   size_t args_size = 0;
 
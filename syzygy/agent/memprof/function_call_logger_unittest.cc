@@ -137,6 +137,13 @@ void TestEmitDetailedFunctionCall(TestFunctionCallLogger* fcl) {
   EMIT_DETAILED_FUNCTION_CALL(fcl, &fcl->test_segment_, fcl);
 }
 
+void TestEmitFunctionCallWithBytes(TestFunctionCallLogger* fcl,
+                                   size_t bytes) {
+  ASSERT_NE(static_cast<TestFunctionCallLogger*>(nullptr), fcl);
+  EMIT_DETAILED_FUNCTION_CALL(fcl, &fcl->test_segment_,
+                              FunctionCallLogger::ByteCount(bytes));
+}
+
 }  // namespace
 
 TEST(FunctionCallLoggerTest, TraceFunctionNameTableEntry) {
@@ -307,5 +314,40 @@ TEST(FunctionCallLoggerTest, TraceDetailedFunctionCallSerializeTimestamps) {
   }
 }
 
+TEST(FunctionCallLoggerTest, TraceFunctionCallSummary) {
+  TestFunctionCallLogger fcl;
+  fcl.set_stack_trace_tracking(kTrackingNone);
+  fcl.set_aggregate_function_calls(true);
+
+  TestEmitFunctionCallWithBytes(&fcl, 100);
+  TestEmitFunctionCallWithBytes(&fcl, 300);
+  TestEmitFunctionCallWithBytes(&fcl, 200);
+
+  // Only the function name record should have been emitted so far; the
+  // calls themselves have been aggregated in memory.
+  EXPECT_EQ(1u, fcl.function_id_map_.size());
+  ASSERT_EQ(1u, fcl.allocation_infos.size());
+  EXPECT_EQ(TraceFunctionNameTableEntry::kTypeId,
+            fcl.allocation_infos[0].record_type);
+
+  fcl.EmitCallSummaries(&fcl.test_segment_);
+  ASSERT_EQ(2u, fcl.allocation_infos.size());
+  const auto& info = fcl.allocation_infos[1];
+  EXPECT_EQ(TraceFunctionCallSummary::kTypeId, info.record_type);
+  EXPECT_TRUE(info.record != nullptr);
+  TraceFunctionCallSummary* data =
+      reinterpret_cast<TraceFunctionCallSummary*>(info.record);
+  EXPECT_EQ(0u, data->function_id);
+  EXPECT_EQ(0u, data->stack_trace_id);
+  EXPECT_EQ(3u, data->call_count);
+  EXPECT_EQ(600u, data->total_bytes);
+  EXPECT_EQ(300u, data->max_bytes);
+
+  // The table was reset by the emission, so emitting again should produce
+  // nothing.
+  fcl.EmitCallSummaries(&fcl.test_segment_);
+  EXPECT_EQ(2u, fcl.allocation_infos.size());
+}
+
 }  // namespace memprof
 }  // namespace agent
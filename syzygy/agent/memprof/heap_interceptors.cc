@@ -21,6 +21,11 @@
 #include "base/hash.h"
 #include "syzygy/agent/memprof/memprof.h"
 
+// Tags an allocation size argument so that it feeds the per-call-site byte
+// totals when function call aggregation is enabled. Serializes identically
+// to the raw SIZE_T in detailed mode.
+typedef agent::memprof::FunctionCallLogger::ByteCount ByteCount;
+
 // A wrapper to EMIT_DETAILED_FUNCTION_CALL that provides the MemoryProfiler
 // FunctionCallLogger instance.
 #define EMIT_DETAILED_HEAP_FUNCTION_CALL(...)  \
@@ -58,7 +63,7 @@ LPVOID WINAPI asan_HeapAlloc(HANDLE heap,
                              DWORD flags,
                              SIZE_T bytes) {
   LPVOID ret = ::HeapAlloc(heap, flags, bytes);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, bytes, ret);
+  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, ByteCount(bytes), ret);
   return ret;
 }
 
@@ -67,7 +72,7 @@ LPVOID WINAPI asan_HeapReAlloc(HANDLE heap,
                                LPVOID mem,
                                SIZE_T bytes) {
   LPVOID ret = ::HeapReAlloc(heap, flags, mem, bytes);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, bytes, ret);
+  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ByteCount(bytes), ret);
   return ret;
 }
 
@@ -25,6 +25,19 @@ MemoryProfiler::MemoryProfiler()
   SetDefaultParameters(&parameters_);
 }
 
+MemoryProfiler::~MemoryProfiler() {
+  // Emit the accumulated call-site summaries before the trace session goes
+  // away. Individual call records have deliberately not been emitted while
+  // aggregating.
+  if (parameters_.aggregate_function_calls && session_.IsTracing()) {
+    ThreadState* state = GetOrAllocateThreadState();
+    if (state != nullptr) {
+      function_call_logger_.EmitCallSummaries(state->segment());
+      state->FlushSegment();
+    }
+  }
+}
+
 bool MemoryProfiler::Init() {
   // We don't care if parameter parsing fails at runtime; such parameters will
   // simply be ignored.
@@ -66,6 +79,8 @@ void MemoryProfiler::PropagateParameters() {
       parameters_.stack_trace_tracking);
   function_call_logger_.set_serialize_timestamps(
       parameters_.serialize_timestamps);
+  function_call_logger_.set_aggregate_function_calls(
+      parameters_.aggregate_function_calls);
 }
 
 MemoryProfiler::ThreadState* MemoryProfiler::GetOrAllocateThreadStateImpl() {
@@ -36,6 +36,10 @@ class MemoryProfiler {
  public:
   MemoryProfiler();
 
+  // Tears down this memory profiler. If function call aggregation is
+  // enabled this emits the accumulated call summaries.
+  ~MemoryProfiler();
+
   // Initializes this memory profiler.
   // @returns true for success, false otherwise.
   bool Init();
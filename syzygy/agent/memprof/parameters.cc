@@ -36,17 +36,20 @@ const char kParametersEnvVar[] = "SYZYGY_MEMPROF_OPTIONS";
 StackTraceTracking kDefaultStackTraceTracking = kTrackingNone;
 bool kDefaultSerializeTimestamps = false;
 bool kDefaultHashContentsAtFree = false;
+bool kDefaultAggregateFunctionCalls = false;
 
 // Parameter names for parsing.
 const char kParamStackTraceTracking[] = "stack-trace-tracking";
 const char kParamSerializeTimestamps[] = "serialize-timestamps";
 const char kParamHashContentsAtFree[] = "hash-contents-at-free";
+const char kParamAggregateFunctionCalls[] = "aggregate-function-calls";
 
 void SetDefaultParameters(Parameters* parameters) {
   DCHECK_NE(static_cast<Parameters*>(nullptr), parameters);
   parameters->stack_trace_tracking = kDefaultStackTraceTracking;
   parameters->serialize_timestamps = false;
   parameters->hash_contents_at_free = false;
+  parameters->aggregate_function_calls = kDefaultAggregateFunctionCalls;
 }
 
 bool ParseParameters(const base::StringPiece& param_string,
@@ -86,6 +89,9 @@ bool ParseParameters(const base::StringPiece& param_string,
   if (cmd_line.HasSwitch(kParamHashContentsAtFree))
     parameters->hash_contents_at_free = true;
 
+  if (cmd_line.HasSwitch(kParamAggregateFunctionCalls))
+    parameters->aggregate_function_calls = true;
+
   return success;
 }
 
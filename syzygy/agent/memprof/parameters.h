@@ -50,6 +50,11 @@ struct Parameters {
   // the hash value stored as an additional parameter to the heap free
   // function.
   bool hash_contents_at_free;
+  // If this is enabled then individual function call records are not
+  // emitted; instead, running per-call-site totals are kept in agent
+  // memory and emitted as compact summary records. This drastically
+  // reduces trace volume on allocation-heavy workloads.
+  bool aggregate_function_calls;
 };
 
 // The environment variable that is used for extracting parameters.
@@ -62,11 +67,13 @@ extern const char* kStackTraceTrackingValues[];
 extern StackTraceTracking kDefaultStackTraceTracking;
 extern bool kDefaultSerializeTimestamps;
 extern bool kDefaultHashContentsAtFree;
+extern bool kDefaultAggregateFunctionCalls;
 
 // Parameter names for parsing.
 extern const char kParamStackTraceTracking[];
 extern const char kParamSerializeTimestamps[];
 extern const char kParamHashContentsAtFree[];
+extern const char kParamAggregateFunctionCalls[];
 
 // Initializes a Parameters struct with default values.
 // @param parameters The Parameters struct to be initialized.
@@ -462,6 +462,15 @@ void Profiler::ThreadState::OnFunctionEntry(EntryFrame* entry_frame,
   if (profiler_->session_.IsDisabled())
     return;
 
+  // In entry-count-only mode the invocation is tallied immediately with a
+  // zero duration. No thunk is created and the return address is left
+  // untouched, so there will be no corresponding exit event, and no overhead
+  // accounting is necessary as the cycle timings are never consulted.
+  if (profiler_->count_only_) {
+    RecordInvocation(entry_frame->retaddr, function, 0);
+    return;
+  }
+
   // Record the details of the entry.
   // Note that on tail-recursion and tail-call elimination, the caller recorded
   // here will be a thunk. We cater for this case on exit as best we can.
@@ -482,6 +491,12 @@ void Profiler::ThreadState::OnV8FunctionEntry(FuncAddr function,
   if (profiler_->session_.IsDisabled())
     return;
 
+  // See OnFunctionEntry for a description of entry-count-only mode.
+  if (profiler_->count_only_) {
+    RecordInvocation(*return_address_location, function, 0);
+    return;
+  }
+
   // Record the details of the entry.
 
   // TODO(siggi): Note that we want to do different exit processing here,
@@ -697,7 +712,13 @@ void Profiler::OnThreadDetach() {
 }
 
 RetAddr* Profiler::ResolveReturnAddressLocation(RetAddr* pc_location) {
-  base::AutoLock lock(lock_);
+  // Grab the current page snapshot. The snapshot is immutable once
+  // published, so we can search it without taking lock_. This keeps the
+  // resolution off the profiler lock, as e.g. V8 calls here for every
+  // stack frame it traverses during garbage collection.
+  const PageVector* pages = reinterpret_cast<const PageVector*>(
+      base::subtle::Acquire_Load(&pages_));
+  DCHECK(pages != NULL);
 
   // In case of tail-call and tail recursion elimination, we can get chained
   // thunks, so we loop around here until we resolve to a non-thunk.
@@ -708,7 +729,7 @@ RetAddr* Profiler::ResolveReturnAddressLocation(RetAddr* pc_location) {
     // Compute the page this return address lives in.
     const void* page = reinterpret_cast<const void*>(
         reinterpret_cast<uintptr_t>(ret_addr) & ~0xFFF);
-    if (!std::binary_search(pages_.begin(), pages_.end(), page))
+    if (!std::binary_search(pages->begin(), pages->end(), page))
       return pc_location;
 
     // It's one of our own, redirect to the thunk's stash.
@@ -773,21 +794,45 @@ void Profiler::OnModuleEntry(EntryFrame* entry_frame,
 void Profiler::OnPageAdded(const void* page) {
   base::AutoLock lock(lock_);
 
+  const PageVector* current = reinterpret_cast<const PageVector*>(
+      base::subtle::NoBarrier_Load(&pages_));
+  scoped_ptr<PageVector> new_pages(new PageVector(*current));
   PageVector::iterator it =
-      std::lower_bound(pages_.begin(), pages_.end(), page);
-  DCHECK(it == pages_.end() || *it != page);
-  pages_.insert(it, page);
+      std::lower_bound(new_pages->begin(), new_pages->end(), page);
+  DCHECK(it == new_pages->end() || *it != page);
+  new_pages->insert(it, page);
+
+  PublishPages(new_pages.release());
 }
 
 void Profiler::OnPageRemoved(const void* page) {
   base::AutoLock lock(lock_);
 
+  const PageVector* current = reinterpret_cast<const PageVector*>(
+      base::subtle::NoBarrier_Load(&pages_));
+  scoped_ptr<PageVector> new_pages(new PageVector(*current));
   PageVector::iterator it =
-      std::lower_bound(pages_.begin(), pages_.end(), page);
+      std::lower_bound(new_pages->begin(), new_pages->end(), page);
   // The page must be in our list.
-  DCHECK(it != pages_.end());
+  DCHECK(it != new_pages->end());
   DCHECK_EQ(page, *it);
-  pages_.erase(it);
+  new_pages->erase(it);
+
+  PublishPages(new_pages.release());
+}
+
+void Profiler::PublishPages(PageVector* new_pages) {
+  DCHECK(new_pages != NULL);
+  lock_.AssertAcquired();
+
+  // Retire the outgoing snapshot, as a reader may still be searching it.
+  PageVector* old_pages = reinterpret_cast<PageVector*>(
+      base::subtle::NoBarrier_Load(&pages_));
+  if (old_pages != NULL)
+    retired_pages_.push_back(old_pages);
+
+  base::subtle::Release_Store(
+      &pages_, reinterpret_cast<base::subtle::AtomicWord>(new_pages));
 }
 
 void Profiler::OnThreadName(const base::StringPiece& thread_name) {
@@ -832,7 +877,13 @@ void Profiler::OnDllEvent(agent::common::DllNotificationWatcher::EventType type,
   }
 }
 
-Profiler::Profiler() : handler_registration_(NULL) {
+Profiler::Profiler()
+    : count_only_(trace::client::IsProfileCountOnlyEnabledForThisModule()),
+      handler_registration_(NULL) {
+  // Publish an empty page snapshot so readers never see a NULL vector.
+  base::subtle::NoBarrier_Store(
+      &pages_, reinterpret_cast<base::subtle::AtomicWord>(new PageVector()));
+
   // Create our RPC session and allocate our initial trace segment on creation,
   // aka at load time.
   ThreadState* data = CreateFirstThreadStateAndSession();
@@ -859,6 +910,10 @@ Profiler::~Profiler() {
     ::RemoveVectoredExceptionHandler(handler_registration_);
     handler_registration_ = NULL;
   }
+
+  // Free the current page snapshot, retired snapshots are owned by
+  // retired_pages_.
+  delete reinterpret_cast<PageVector*>(base::subtle::NoBarrier_Load(&pages_));
 }
 
 Profiler::ThreadState* Profiler::CreateFirstThreadStateAndSession() {
@@ -15,7 +15,9 @@
 // A hierarchical profiler, indended for use with the Syzygy function level
 // instrumenter. The Syzygy instrumented provides a function entry hook, and
 // this implementation uses a shadow stack with return address swizzling to
-// get an exit hook.
+// get an exit hook. An entry-count-only mode is also available (see
+// kSyzygyProfileCountOnlyEnvVar), which forgoes the exit hook and cycle
+// timings, recording only per-function call counts.
 // The profiler uses RDTSC as wall clock, which makes it unsuitable for
 // profiling on systems with CPUs prior to AMD Barcelona/Phenom, or older
 // Intel processors, see e.g. http://en.wikipedia.org/wiki/Time_Stamp_Counter
@@ -28,6 +30,8 @@
 #include <winnt.h>
 #include <vector>
 
+#include "base/atomicops.h"
+#include "base/memory/scoped_vector.h"
 #include "base/synchronization/lock.h"
 #include "base/threading/thread_local.h"
 #include "syzygy/agent/common/dll_notifications.h"
@@ -114,10 +118,17 @@ class Profiler {
                      FuncAddr function,
                      uint64 cycles);
 
+  typedef std::vector<const void*> PageVector;
+
   // Callbacks from ThreadState.
   void OnPageAdded(const void* page);
   void OnPageRemoved(const void* page);
 
+  // Publishes @p new_pages as the current page snapshot and retires the
+  // previously published snapshot. Must be called under lock_, takes
+  // ownership of @p new_pages.
+  void PublishPages(PageVector* new_pages);
+
   // Called on a first chance exception declaring thread name.
   void OnThreadName(const base::StringPiece& thread_name);
 
@@ -143,15 +154,31 @@ class Profiler {
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
-  // Protects pages_ and logged_modules_.
+  // If true, the profiler only tallies the number of calls to each function.
+  // No cycle timings are recorded and return addresses are not swizzled, so
+  // entries cost a single hash lookup and increment. Initialized from the
+  // environment at creation (see kSyzygyProfileCountOnlyEnvVar) and constant
+  // thereafter.
+  bool count_only_;
+
+  // Protects updates to pages_, retired_pages_ and logged_modules_.
   base::Lock lock_;
 
   // The dynamic symbol map.
   SymbolMap symbol_map_;
 
-  // Contains the thunk pages in lexical order.
-  typedef std::vector<const void*> PageVector;
-  PageVector pages_;  // Under lock_.
+  // Points to the current PageVector, which contains the thunk pages in
+  // lexical order. Page vectors are immutable once published; OnPageAdded
+  // and OnPageRemoved swap in a fresh copy under lock_, which allows
+  // ResolveReturnAddressLocation to search the current snapshot without
+  // taking the lock. Written under lock_, read with an acquiring load.
+  base::subtle::AtomicWord pages_;
+
+  // Previously published page vectors. A stack walker on another thread may
+  // still be searching a snapshot as it's being replaced, so retired
+  // snapshots are kept until the profiler is destroyed. Page churn is rare
+  // and the vectors are small, so this is cheaper than reader registration.
+  ScopedVector<PageVector> retired_pages_;  // Under lock_.
 
   // Contains the set of modules we've seen and logged.
   typedef base::hash_set<HMODULE> ModuleSet;
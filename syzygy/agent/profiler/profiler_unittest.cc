@@ -19,10 +19,12 @@
 #include <psapi.h>
 
 #include "base/bind.h"
+#include "base/environment.h"
 #include "base/file_util.h"
 #include "base/scoped_native_library.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/message_loop/message_loop.h"
 #include "base/threading/platform_thread.h"
 #include "base/threading/thread.h"
@@ -289,6 +291,8 @@ class ProfilerTest : public testing::Test {
   static int TestResolutionFuncThunk(ResolveReturnAddressLocationFunc resolver);
   static int TestResolutionFuncNestedThunk(
       ResolveReturnAddressLocationFunc resolver);
+  static int TestCountOnlyResolutionFuncThunk(
+      ResolveReturnAddressLocationFunc resolver);
 
  protected:
   // The directory where trace file output will be written.
@@ -425,6 +429,23 @@ int __declspec(naked) ProfilerTest::TestResolutionFuncNestedThunk(
   }
 }
 
+void TestCountOnlyResolutionFunc(ResolveReturnAddressLocationFunc resolver) {
+  uintptr_t pc_location =
+      reinterpret_cast<uintptr_t>(_AddressOfReturnAddress());
+
+  // In entry-count-only mode the return address is not swizzled, so
+  // resolution is the identity function.
+  ASSERT_EQ(pc_location, resolver(pc_location));
+}
+
+int __declspec(naked) ProfilerTest::TestCountOnlyResolutionFuncThunk(
+    ResolveReturnAddressLocationFunc resolver) {
+  __asm {
+    push TestCountOnlyResolutionFunc
+    jmp _indirect_penter_
+  }
+}
+
 }  // namespace
 
 TEST_F(ProfilerTest, NoServerNoCrash) {
@@ -563,6 +584,48 @@ TEST_F(ProfilerTest, RecordsOneEntryPerModuleAndFunction) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs());
 }
 
+TEST_F(ProfilerTest, CountOnlyModeRecordsInvocationCounts) {
+  // Spin up the RPC service.
+  ASSERT_NO_FATAL_FAILURE(StartService());
+
+  // Request entry-count-only mode. This has to be in place before the
+  // profiler DLL loads, as the mode is latched at that point.
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env->SetVar(::kSyzygyProfileCountOnlyEnvVar, "1"));
+
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  ASSERT_TRUE(env->UnSetVar(::kSyzygyProfileCountOnlyEnvVar));
+
+  // Make sure return addresses aren't swizzled in this mode.
+  ASSERT_NO_FATAL_FAILURE(TestCountOnlyResolutionFuncThunk(resolution_func_));
+
+  // Invoke function A twice, which should tally into a single record.
+  ASSERT_NO_FATAL_FAILURE(InvokeFunctionAThunk());
+  ASSERT_NO_FATAL_FAILURE(InvokeFunctionAThunk());
+
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+  EXPECT_CALL(handler_, OnProcessStarted(_, ::GetCurrentProcessId(), _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        ::GetCurrentProcessId(),
+                                        ::GetCurrentThreadId(),
+                                        _))
+      .Times(testing::AnyNumber());
+
+  // We should see a single batch with two distinct invocation records, one
+  // for the resolution function and one for function A.
+  EXPECT_CALL(handler_, OnInvocationBatch(_,
+                                          ::GetCurrentProcessId(),
+                                          ::GetCurrentThreadId(),
+                                          2,
+                                          _));
+  EXPECT_CALL(handler_, OnProcessEnded(_, ::GetCurrentProcessId()));
+
+  // Replay the log.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs());
+}
+
 TEST_F(ProfilerTest, RecordsThreadName) {
   if (::IsDebuggerPresent()) {
     LOG(WARNING) << "This test fails under debugging.";
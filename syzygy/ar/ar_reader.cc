@@ -402,6 +402,31 @@ bool ArReader::Extract(size_t index,
   return true;
 }
 
+bool ArReader::FindSymbol(const base::StringPiece& symbol_name,
+                          size_t* index) const {
+  SymbolIndexMap::const_iterator it = symbols_.find(symbol_name.as_string());
+  if (it == symbols_.end())
+    return false;
+
+  if (index != NULL)
+    *index = it->second;
+  return true;
+}
+
+bool ArReader::ExtractBySymbol(const base::StringPiece& symbol_name,
+                               ParsedArFileHeader* header,
+                               DataBuffer* data) {
+  DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
+
+  size_t index = 0;
+  if (!FindSymbol(symbol_name, &index)) {
+    LOG(ERROR) << "Symbol not found in archive: " << symbol_name;
+    return false;
+  }
+
+  return Extract(index, header, data);
+}
+
 bool ArReader::ReadNextFile(ParsedArFileHeader* header,
                             DataBuffer* data) {
   DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
@@ -84,12 +84,14 @@
 
 #include "base/file_util.h"
 #include "base/files/file_path.h"
+#include "base/strings/string_piece.h"
 #include "syzygy/ar/ar_common.h"
 
 namespace ar {
 
-// Class for extracting files from archive files. This currently does not
-// expose the parsed symbol information in any meaningful way.
+// Class for extracting files from archive files. The parsed symbol table
+// permits direct seek-and-extract of the file defining a named symbol,
+// without streaming the rest of the archive.
 class ArReader {
  public:
   // Stores the offsets of each file object, by their index.
@@ -159,12 +161,35 @@ class ArReader {
   // at the next file in the archive.
   // @param index The index of the file to be extracted.
   // @param header The header to be populated.
-  // @param data The buffer to be populated.
+  // @param data The buffer to be populated. May be NULL, in which case
+  //     only the header will be filled in.
   // @returns true on success, false otherwise.
   bool Extract(size_t index,
                ParsedArFileHeader* header,
                DataBuffer* data);
 
+  // Looks up the file containing the given symbol in the symbol table.
+  // This does not incur any disk access.
+  // @param symbol_name The name of the symbol to look up.
+  // @param index The index of the file containing the symbol. May be NULL,
+  //     in which case this simply tests for the presence of the symbol.
+  // @returns true if the symbol is defined by a file in the archive, false
+  //     otherwise.
+  bool FindSymbol(const base::StringPiece& symbol_name, size_t* index) const;
+
+  // Extracts the file containing the given symbol, seeking directly to it
+  // without touching the intervening files. Leaves the cursor pointing at the
+  // next file in the archive.
+  // @param symbol_name The name of the symbol whose file is to be extracted.
+  // @param header The header to be populated.
+  // @param data The buffer to be populated. May be NULL, in which case
+  //     only the header will be filled in.
+  // @returns true on success, false if the symbol was not found or the
+  //     extraction failed.
+  bool ExtractBySymbol(const base::StringPiece& symbol_name,
+                       ParsedArFileHeader* header,
+                       DataBuffer* data);
+
  protected:
   // Reads the next file from the archive, advancing the cursor. Returns true
   // on success, false otherwise. Does not translate the internal name to an
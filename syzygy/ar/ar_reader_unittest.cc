@@ -135,6 +135,34 @@ TEST_F(ArReaderTest, InitAndBuildFileIndex) {
   EXPECT_TRUE(reader.HasNext());
 }
 
+TEST_F(ArReaderTest, FindSymbolAndExtractBySymbol) {
+  ArReader reader;
+  EXPECT_TRUE(reader.Init(lib_path_));
+
+  // Look up a symbol that is known to be in the archive.
+  size_t index = 0;
+  EXPECT_TRUE(reader.FindSymbol("_MOZ_Z_crc32", &index));
+  EXPECT_EQ(12u, index);
+  EXPECT_TRUE(reader.FindSymbol("_MOZ_Z_crc32", NULL));
+  EXPECT_FALSE(reader.FindSymbol("_NoSuchSymbol", &index));
+
+  // A header-only probe shouldn't read the file contents.
+  ParsedArFileHeader header;
+  EXPECT_TRUE(reader.ExtractBySymbol("_MOZ_Z_crc32", &header, NULL));
+  EXPECT_EQ("..\\..\\build\\Debug\\obj\\zlib\\crc32.obj", header.name);
+  EXPECT_EQ(21713u, header.size);
+
+  // Extracting the contents should yield the same data as a direct read of
+  // the file by index.
+  DataBuffer data, expected_data;
+  EXPECT_TRUE(reader.ExtractBySymbol("_MOZ_Z_crc32", &header, &data));
+  EXPECT_EQ(header.size, data.size());
+  EXPECT_TRUE(reader.Extract(12, &header, &expected_data));
+  EXPECT_EQ(expected_data, data);
+
+  EXPECT_FALSE(reader.ExtractBySymbol("_NoSuchSymbol", &header, &data));
+}
+
 TEST_F(ArReaderTest, NoFilenameTable) {
   base::FilePath lib = testing::GetSrcRelativePath(
       testing::kWeakSymbolArchiveFile);
@@ -535,6 +535,29 @@ bool ArWriter::AddFile(const base::StringPiece& filename,
     return false;
   }
 
+  // Try to parse the symbols from the file. This happens before any state is
+  // modified so that a failed add leaves the writer untouched.
+  SymbolIndexMap symbols;
+  SymbolIndexMap weak_symbols;
+  if (!ExtractSymbols(filename, contents, &symbols, &weak_symbols))
+    return false;
+
+  return AddFile(filename, timestamp, mode, contents, symbols, weak_symbols);
+}
+
+bool ArWriter::AddFile(const base::StringPiece& filename,
+                       const base::Time& timestamp,
+                       uint32 mode,
+                       const DataBuffer* contents,
+                       const SymbolIndexMap& symbols,
+                       const SymbolIndexMap& weak_symbols) {
+  DCHECK_NE(reinterpret_cast<DataBuffer*>(NULL), contents);
+
+  if (contents->size() == 0) {
+    LOG(ERROR) << "Unable to add empty file to archive: " << filename;
+    return false;
+  }
+
   // Try to insert the file into the map. If this fails then there's a
   // collision.
   std::string name = filename.as_string();
@@ -550,18 +573,23 @@ bool ArWriter::AddFile(const base::StringPiece& filename,
   header.mode = mode;
   header.size = contents->size();
 
-  // Try to parse the symbols from the file. We keep a copy of the
-  // symbol tables so as not to corrupt them if the operation fails.
-  SymbolIndexMap symbols = symbols_;
-  SymbolIndexMap weak_symbols = weak_symbols_;
-  if (!ExtractSymbols(files_.size(), header, *contents, &symbols,
-                      &weak_symbols)) {
-    return false;
+  // Merge the pre-extracted symbols into the archive-wide tables, remapping
+  // them to the index of this file. The merge itself can't fail; duplicates
+  // are resolved in favour of the earliest definition, as lib.exe does.
+  size_t duplicate_symbols = 0;
+  SymbolIndexMap::const_iterator sym_it = symbols.begin();
+  for (; sym_it != symbols.end(); ++sym_it) {
+    bool is_weak = weak_symbols.count(sym_it->first) != 0;
+    if (UpdateSymbolTable(files_.size(), sym_it->first, is_weak, &symbols_,
+                          &weak_symbols_)) {
+      ++duplicate_symbols;
+    }
+  }
+  if (duplicate_symbols) {
+    LOG(INFO) << "Ignored " << duplicate_symbols
+              << " duplicate symbols in object file: " << name;
   }
 
-  // If all goes well then commit the file to the archive.
-  std::swap(symbols_, symbols);
-  std::swap(weak_symbols_, weak_symbols);
   files_.push_back(std::make_pair(header, contents));
   return true;
 }
@@ -601,6 +629,22 @@ bool ArWriter::AddFile(const base::FilePath& path) {
   return true;
 }
 
+bool ArWriter::ExtractSymbols(const base::StringPiece& filename,
+                              const DataBuffer* contents,
+                              SymbolIndexMap* symbols,
+                              SymbolIndexMap* weak_symbols) {
+  DCHECK_NE(reinterpret_cast<DataBuffer*>(NULL), contents);
+  DCHECK_NE(reinterpret_cast<SymbolIndexMap*>(NULL), symbols);
+  DCHECK_NE(reinterpret_cast<SymbolIndexMap*>(NULL), weak_symbols);
+
+  // Only the name of this header is consulted during extraction, for log
+  // messages.
+  ParsedArFileHeader header;
+  header.name = filename.as_string();
+
+  return ar::ExtractSymbols(0, header, *contents, symbols, weak_symbols);
+}
+
 bool ArWriter::Write(const base::FilePath& path) {
   if (files_.empty()) {
     LOG(ERROR) << "Unable to write an empty archive.";
@@ -636,8 +680,36 @@ bool ArWriter::Write(const base::FilePath& path) {
       return false;
   }
 
+  // Lay out the archive before anything is written. The size of every member
+  // is already known, including those of the symbol tables, so the offset of
+  // each object file can be computed up front. This lets the symbol tables
+  // be emitted correctly the first time and the whole archive be written in
+  // a single sequential pass, with no seeking.
+  size_t symbol_names_size = 0;
+  SymbolIndexMap::const_iterator sym_it = symbols_.begin();
+  for (; sym_it != symbols_.end(); ++sym_it)
+    symbol_names_size += sym_it->first.size() + 1;
+  uint32 symbols1_size = sizeof(uint32) * (1 + symbols_.size()) +
+      symbol_names_size;
+  uint32 symbols2_size = sizeof(uint32) * (2 + files_.size()) +
+      sizeof(uint16) * symbols_.size() + symbol_names_size;
+
+  uint32 pos = sizeof(ArGlobalHeader);
+  pos = common::AlignUp(pos, kArFileAlignment) +
+      sizeof(ArFileHeader) + symbols1_size;
+  pos = common::AlignUp(pos, kArFileAlignment) +
+      sizeof(ArFileHeader) + symbols2_size;
+  pos = common::AlignUp(pos, kArFileAlignment) +
+      sizeof(ArFileHeader) + names.size();
+
+  FileOffsets offsets(files_.size());
+  for (size_t i = 0; i < files_.size(); ++i) {
+    offsets[i] = common::AlignUp(pos, kArFileAlignment);
+    pos = offsets[i] + sizeof(ArFileHeader) + files_[i].second->size();
+  }
+
   // Open the file and write the global header.
-  base::ScopedFILE file(base::OpenFile(path, "w+b"));
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
   if (file.get() == NULL) {
     LOG(ERROR) << "Unable to open file for writing: " << path.value();
     return false;
@@ -647,15 +719,12 @@ bool ArWriter::Write(const base::FilePath& path) {
     return false;
   }
 
-  // Write the symbol tables. We initially use a set of dummy offsets, and
-  // reach back and write the actual offsets once we've laid out the object
-  // files.
-  FileOffsets offsets(files_.size());
+  // Write the symbol tables, using the final file offsets.
   base::Time timestamp = base::Time::Now();
-  uint32 symbols1_pos = AlignAndGetPosition(file.get());
+  AlignAndGetPosition(file.get());
   if (!WritePrimarySymbolTable(timestamp, symbols_, offsets, file.get()))
     return false;
-  uint32 symbols2_pos = AlignAndGetPosition(file.get());
+  AlignAndGetPosition(file.get());
   if (!WriteSecondarySymbolTable(timestamp, symbols_, offsets, file.get()))
     return false;
 
@@ -664,30 +733,17 @@ bool ArWriter::Write(const base::FilePath& path) {
   if (!WriteNameTable(timestamp, names, file.get()))
     return false;
 
-  // Write the files, keeping track of their offsets.
+  // Write the files at the offsets computed during layout.
   for (size_t i = 0; i < files_.size(); ++i) {
     const DataBuffer& buffer = *files_[i].second;
     const ArFileHeader& raw_header = raw_headers[i];
 
-    offsets[i] = AlignAndGetPosition(file.get());
+    uint32 file_pos = AlignAndGetPosition(file.get());
+    DCHECK_EQ(offsets[i], file_pos);
     if (!WriteFile(raw_header, buffer, file.get()))
       return false;
   }
 
-  // Rewrite the symbol streams using the actual file offsets this time around.
-  if (::fseek(file.get(), symbols1_pos, SEEK_SET) != 0) {
-    LOG(ERROR) << "Failed to seek to primary symbol stream.";
-    return false;
-  }
-  if (!WritePrimarySymbolTable(timestamp, symbols_, offsets, file.get()))
-    return false;
-  if (::fseek(file.get(), symbols2_pos, SEEK_SET) != 0) {
-    LOG(ERROR) << "Failed to seek to secondary symbol stream.";
-    return false;
-  }
-  if (!WriteSecondarySymbolTable(timestamp, symbols_, offsets, file.get()))
-    return false;
-
   return true;
 }
 
@@ -49,6 +49,10 @@ class ArWriter {
   //     as ST_MODE from _wstat.
   // @param contents The contents of the file. The lifetime of this object
   //     must exceed the lifetime of the writer.
+  // @param symbols The symbols exported by the file, as previously extracted
+  //     by ExtractSymbols. When provided the file contents will not be
+  //     parsed again.
+  // @param weak_symbols The weak subset of @p symbols.
   // @param path The file to be added; the filename as specified in @p path
   //     will be used, and the contents read from disk. Uses the timestamp and
   //     mode of the file on disk.
@@ -57,9 +61,34 @@ class ArWriter {
                const base::Time& timestamp,
                uint32 mode,
                const DataBuffer* contents);
+  bool AddFile(const base::StringPiece& filename,
+               const base::Time& timestamp,
+               uint32 mode,
+               const DataBuffer* contents,
+               const SymbolIndexMap& symbols,
+               const SymbolIndexMap& weak_symbols);
   bool AddFile(const base::FilePath& path);
 
+  // Extracts the symbols exported by a single file, without adding the file
+  // to any archive. The extracted symbols are indexed relative to the file
+  // itself, which is given index 0. This touches no writer state and may be
+  // called from multiple threads concurrently, allowing the symbol table of
+  // a large archive to be computed in parallel and the files committed
+  // afterwards via the AddFile overload accepting pre-extracted symbols.
+  // @param filename The filename associated with the content, used in log
+  //     messages.
+  // @param contents The contents of the file.
+  // @param symbols The symbol table to be populated.
+  // @param weak_symbols The weak symbol table to be populated.
+  // @returns true on success, false otherwise.
+  static bool ExtractSymbols(const base::StringPiece& filename,
+                             const DataBuffer* contents,
+                             SymbolIndexMap* symbols,
+                             SymbolIndexMap* weak_symbols);
+
   // Writes the current set of files to an archive at the specified @p path.
+  // The layout of the archive is computed up front so the contents are
+  // emitted in a single sequential pass, with no seeking.
   // @param path The path of the archive file to be written.
   // @returns true on success, false otherwise.
   bool Write(const base::FilePath& path);
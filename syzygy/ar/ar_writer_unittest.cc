@@ -133,6 +133,42 @@ TEST_F(ArWriterTest, AddRepeatedFiles) {
   EXPECT_EQ(kSymbolCounts[0], writer_.symbols().size());
 }
 
+TEST_F(ArWriterTest, ExtractSymbols) {
+  int64 size = 0;
+  ASSERT_TRUE(base::GetFileSize(object_files_[0], &size));
+  contents_.resize(size);
+  ASSERT_TRUE(base::ReadFile(object_files_[0],
+                             reinterpret_cast<char*>(contents_.data()),
+                             contents_.size()));
+
+  SymbolIndexMap symbols;
+  SymbolIndexMap weak_symbols;
+  EXPECT_TRUE(ArWriter::ExtractSymbols("adler32.obj", &contents_, &symbols,
+                                       &weak_symbols));
+  EXPECT_EQ(kSymbolCounts[0], symbols.size());
+
+  // Extracted symbols are indexed relative to the file itself.
+  SymbolIndexMap::const_iterator sym_it = symbols.begin();
+  for (; sym_it != symbols.end(); ++sym_it)
+    EXPECT_EQ(0u, sym_it->second);
+
+  // Adding the file with its pre-extracted symbols must be equivalent to
+  // having the writer extract them itself.
+  ArWriter writer;
+  EXPECT_TRUE(writer.AddFile("adler32.obj", base::Time::Now(), 0,
+                             &contents_));
+  EXPECT_TRUE(writer_.AddFile("adler32.obj", base::Time::Now(), 0,
+                              &contents_, symbols, weak_symbols));
+  EXPECT_THAT(writer_.symbols(), testing::ContainerEq(writer.symbols()));
+
+  // Extraction of unrecognized content fails.
+  DataBuffer garbage(16, 0xCC);
+  symbols.clear();
+  weak_symbols.clear();
+  EXPECT_FALSE(ArWriter::ExtractSymbols("garbage.obj", &garbage, &symbols,
+                                        &weak_symbols));
+}
+
 TEST_F(ArWriterTest, TestArWriterRoundTrip) {
   EXPECT_NO_FATAL_FAILURE(AddObjectFiles());
 
@@ -196,6 +232,38 @@ TEST_F(ArWriterTest, TestArWriterRoundTripWeakSymbols) {
   EXPECT_THAT(reader2.symbols(), testing::ContainerEq(reader1.symbols()));
 }
 
+TEST_F(ArWriterTest, TestArWriterRoundTripPreExtractedSymbols) {
+  base::FilePath lib1 = testing::GetSrcRelativePath(
+      testing::kWeakSymbolArchiveFile);
+  ArReader reader1;
+  ASSERT_TRUE(reader1.Init(lib1));
+
+  base::FilePath lib2 = temp_dir_.Append(L"weak.lib");
+  ArWriter writer;
+  ScopedVector<DataBuffer> buffers;
+  while (reader1.HasNext()) {
+    ParsedArFileHeader header;
+    scoped_ptr<DataBuffer> contents(new DataBuffer);
+    ASSERT_TRUE(reader1.ExtractNext(&header, contents.get()));
+
+    // Extract the symbols up front, as a parallel producer would, and commit
+    // the member along with them.
+    SymbolIndexMap symbols;
+    SymbolIndexMap weak_symbols;
+    ASSERT_TRUE(ArWriter::ExtractSymbols(header.name, contents.get(),
+                                         &symbols, &weak_symbols));
+    EXPECT_TRUE(writer.AddFile(header.name, header.timestamp, header.mode,
+                               contents.get(), symbols, weak_symbols));
+    buffers.push_back(contents.release());
+  }
+  EXPECT_THAT(writer.symbols(), testing::ContainerEq(reader1.symbols()));
+  EXPECT_TRUE(writer.Write(lib2));
+
+  ArReader reader2;
+  EXPECT_TRUE(reader2.Init(lib2));
+  EXPECT_THAT(reader2.symbols(), testing::ContainerEq(reader1.symbols()));
+}
+
 TEST_F(ArWriterTest, TestArWriterRoundTripRepeatedFileNames) {
   base::FilePath lib1 = testing::GetSrcRelativePath(
       testing::kDuplicatesArchiveFile);
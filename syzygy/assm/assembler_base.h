@@ -22,6 +22,7 @@
 #include "syzygy/assm/cond.h"
 #include "syzygy/assm/operand_base.h"
 #include "syzygy/assm/register.h"
+#include "syzygy/assm/const.h"
 #include "syzygy/assm/value_base.h"
 
 namespace assm {
@@ -179,6 +180,15 @@ class AssemblerBase {
   void sub(const Operand& dst, const Register32& src);
   void sub(const Register32& dst, const Immediate& src);
   void sub(const Operand& dst, const Immediate& src);
+
+  void sbb(const Register8& dst, const Register8& src);
+  void sbb(const Register8& dst, const Immediate& src);
+
+  void sbb(const Register32& dst, const Register32& src);
+  void sbb(const Register32& dst, const Operand& src);
+  void sbb(const Operand& dst, const Register32& src);
+  void sbb(const Register32& dst, const Immediate& src);
+  void sbb(const Operand& dst, const Immediate& src);
   // @}
 
   // @name Shifting operations.
@@ -210,6 +220,20 @@ class AssemblerBase {
  private:
   class InstructionBuffer;
 
+  // @name Arithmetic-family emission helpers.
+  // These emit the instruction identified by @p op with its opcode bytes and
+  // ModR/M opcode extension looked up in kArithmeticEncodings, so emission
+  // is a table lookup followed by the operand bytes.
+  // @{
+  void arith(ArithmeticOp op, const Register8& dst, const Register8& src);
+  void arith(ArithmeticOp op, const Register8& dst, const Immediate& src);
+  void arith(ArithmeticOp op, const Register32& dst, const Register32& src);
+  void arith(ArithmeticOp op, const Register32& dst, const Operand& src);
+  void arith(ArithmeticOp op, const Operand& dst, const Register32& src);
+  void arith(ArithmeticOp op, const Register32& dst, const Immediate& src);
+  void arith(ArithmeticOp op, const Operand& dst, const Immediate& src);
+  // @}
+
   // @name Nop instruction helpers.
   // @{
   // Each of these corresponds to a basic suggested NOP sequence. They
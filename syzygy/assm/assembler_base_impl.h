@@ -899,25 +899,89 @@ void AssemblerBase<ReferenceType>::sahf() {
   instr.EmitOpCodeByte(0x9E);
 }
 
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::arith(ArithmeticOp op,
+                                         const Register8& dst,
+                                         const Register8& src) {
+  InstructionBuffer instr(this);
+  instr.EmitArithmeticInstruction(
+      kArithmeticEncodings[op].op_reg8_rm8, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::arith(ArithmeticOp op,
+                                         const Register8& dst,
+                                         const Immediate& src) {
+  const ArithmeticEncoding& enc = kArithmeticEncodings[op];
+  InstructionBuffer instr(this);
+  instr.EmitArithmeticInstructionToRegister8(
+      enc.op_eax_imm8, enc.op_rm8_imm8, enc.sub_op, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::arith(ArithmeticOp op,
+                                         const Register32& dst,
+                                         const Register32& src) {
+  InstructionBuffer instr(this);
+  instr.EmitArithmeticInstruction(
+      kArithmeticEncodings[op].op_reg32_rm32, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::arith(ArithmeticOp op,
+                                         const Register32& dst,
+                                         const Operand& src) {
+  InstructionBuffer instr(this);
+  instr.EmitArithmeticInstruction(
+      kArithmeticEncodings[op].op_reg32_rm32, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::arith(ArithmeticOp op,
+                                         const Operand& dst,
+                                         const Register32& src) {
+  InstructionBuffer instr(this);
+  instr.EmitArithmeticInstruction(
+      kArithmeticEncodings[op].op_rm32_reg32, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::arith(ArithmeticOp op,
+                                         const Register32& dst,
+                                         const Immediate& src) {
+  const ArithmeticEncoding& enc = kArithmeticEncodings[op];
+  InstructionBuffer instr(this);
+  instr.EmitArithmeticInstructionToRegister32(
+      enc.op_eax_imm32, enc.op_rm32_imm8, enc.op_rm32_imm32, enc.sub_op,
+      dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::arith(ArithmeticOp op,
+                                         const Operand& dst,
+                                         const Immediate& src) {
+  const ArithmeticEncoding& enc = kArithmeticEncodings[op];
+  InstructionBuffer instr(this);
+  instr.EmitArithmeticInstructionToOperand(
+      enc.op_rm32_imm8, enc.op_rm32_imm32, enc.sub_op, dst, src);
+}
+
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::test(const Register8& dst,
                                         const Register8& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x84, dst, src);
+  arith(kArithmeticTest, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::test(const Register8& dst,
                                         const Immediate& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstructionToRegister8(0xA8, 0xF6, 0, dst, src);
+  arith(kArithmeticTest, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::test(const Register32& dst,
                                         const Register32& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x85, dst, src);
+  arith(kArithmeticTest, dst, src);
 }
 
 template <class ReferenceType>
@@ -930,8 +994,7 @@ void AssemblerBase<ReferenceType>::test(const Register32& dst,
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::test(const Operand& dst,
                                         const Register32& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x85, dst, src);
+  arith(kArithmeticTest, dst, src);
 }
 
 template <class ReferenceType>
@@ -941,8 +1004,7 @@ void AssemblerBase<ReferenceType>::test(const Register32& dst,
     // note: There is no encoding for a 8-bit immediate with 32-bit register.
     test(dst, Immediate(src.value(), kSize32Bit));
   } else {
-    InstructionBuffer instr(this);
-    instr.EmitArithmeticInstructionToRegister32(0xA9, 0xF7, 0xF7, 0, dst, src);
+    arith(kArithmeticTest, dst, src);
   }
 }
 
@@ -953,156 +1015,176 @@ void AssemblerBase<ReferenceType>::test(const Operand& dst,
     // note: There is no encoding for a 8-bit immediate with 32-bit register.
     test(dst, Immediate(src.value(), kSize32Bit));
   } else {
-    InstructionBuffer instr(this);
-    instr.EmitArithmeticInstructionToOperand(0xF7, 0xF7, 0, dst, src);
+    arith(kArithmeticTest, dst, src);
   }
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::cmp(const Register8& dst,
                                        const Register8& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x3A, dst, src);
+  arith(kArithmeticCmp, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::cmp(const Register8& dst,
                                        const Immediate& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstructionToRegister8(0x3C, 0x80, 7, dst, src);
+  arith(kArithmeticCmp, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::cmp(const Register32& dst,
                                        const Register32& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x3B, dst, src);
+  arith(kArithmeticCmp, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::cmp(const Register32& dst,
                                        const Operand& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x3B, dst, src);
+  arith(kArithmeticCmp, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::cmp(const Operand& dst,
                                        const Register32& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x39, dst, src);
+  arith(kArithmeticCmp, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::cmp(const Register32& dst,
                                        const Immediate& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstructionToRegister32(0x3D, 0x83, 0x81, 7, dst, src);
+  arith(kArithmeticCmp, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::cmp(const Operand& dst,
                                        const Immediate& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstructionToOperand(0x83, 0x81, 7, dst, src);
+  arith(kArithmeticCmp, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::add(const Register8& dst,
                                        const Register8& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x02, dst, src);
+  arith(kArithmeticAdd, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::add(const Register8& dst,
                                        const Immediate& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstructionToRegister8(0x04, 0x80, 0, dst, src);
+  arith(kArithmeticAdd, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::add(const Register32& dst,
                                        const Register32& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x03, dst, src);
+  arith(kArithmeticAdd, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::add(const Register32& dst,
                                        const Operand& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x03, dst, src);
+  arith(kArithmeticAdd, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::add(const Operand& dst,
                                        const Register32& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x01, dst, src);
+  arith(kArithmeticAdd, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::add(const Register32& dst,
                                        const Immediate& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstructionToRegister32(0x05, 0x83, 0x81, 0, dst, src);
+  arith(kArithmeticAdd, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::add(const Operand& dst,
                                        const Immediate& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstructionToOperand(0x83, 0x81, 0, dst, src);
+  arith(kArithmeticAdd, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::sub(const Register8& dst,
                                        const Register8& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x2A, dst, src);
+  arith(kArithmeticSub, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::sub(const Register8& dst,
                                        const Immediate& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstructionToRegister8(0x2C, 0x80, 5, dst, src);
+  arith(kArithmeticSub, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::sub(const Register32& dst,
                                        const Register32& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x2B, dst, src);
+  arith(kArithmeticSub, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::sub(const Register32& dst,
                                        const Operand& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x2B, dst, src);
+  arith(kArithmeticSub, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::sub(const Operand&  dst,
                                        const Register32& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstruction(0x29, dst, src);
+  arith(kArithmeticSub, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::sub(const Register32& dst,
                                        const Immediate& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstructionToRegister32(0x2D, 0x83, 0x81, 5, dst, src);
+  arith(kArithmeticSub, dst, src);
 }
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::sub(const Operand&  dst,
                                        const Immediate& src) {
-  InstructionBuffer instr(this);
-  instr.EmitArithmeticInstructionToOperand(0x83, 0x81, 5, dst, src);
+  arith(kArithmeticSub, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::sbb(const Register8& dst,
+                                       const Register8& src) {
+  arith(kArithmeticSbb, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::sbb(const Register8& dst,
+                                       const Immediate& src) {
+  arith(kArithmeticSbb, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::sbb(const Register32& dst,
+                                       const Register32& src) {
+  arith(kArithmeticSbb, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::sbb(const Register32& dst,
+                                       const Operand& src) {
+  arith(kArithmeticSbb, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::sbb(const Operand&  dst,
+                                       const Register32& src) {
+  arith(kArithmeticSbb, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::sbb(const Register32& dst,
+                                       const Immediate& src) {
+  arith(kArithmeticSbb, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::sbb(const Operand&  dst,
+                                       const Immediate& src) {
+  arith(kArithmeticSbb, dst, src);
 }
 
 template <class ReferenceType>
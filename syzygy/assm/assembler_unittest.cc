@@ -1029,6 +1029,69 @@ TEST_F(AssemblerTest, Sub) {
   EXPECT_BYTES(0x2D, 0xEF, 0xBE, 0xAD, 0xDE);
 }
 
+TEST_F(AssemblerTest, SbbByte) {
+  asm_.sbb(al, bl);
+  EXPECT_BYTES(0x1A, 0xC3);
+  asm_.sbb(bh, al);
+  EXPECT_BYTES(0x1A, 0xF8);
+
+  asm_.sbb(al, Immediate(0x0A, kSize8Bit));
+  EXPECT_BYTES(0x1C, 0x0A);
+  asm_.sbb(bh, Immediate(0x0A, kSize8Bit));
+  EXPECT_BYTES(0x80, 0xDF, 0x0A);
+}
+
+TEST_F(AssemblerTest, Sbb) {
+  asm_.sbb(eax, eax);
+  EXPECT_BYTES(0x1B, 0xC0);
+  asm_.sbb(eax, Operand(eax));
+  EXPECT_BYTES(0x1B, 0x00);
+  asm_.sbb(eax, Operand(eax, Displacement(10, kSize8Bit)));
+  EXPECT_BYTES(0x1B, 0x40, 0x0A);
+  asm_.sbb(eax, Operand(eax, Displacement(10, kSize32Bit)));
+  EXPECT_BYTES(0x1B, 0x80, 0x0A, 0x00, 0x00, 0x00);
+
+  asm_.sbb(ecx, eax);
+  EXPECT_BYTES(0x1B, 0xC8);
+  asm_.sbb(ecx, Operand(eax));
+  EXPECT_BYTES(0x1B, 0x08);
+  asm_.sbb(ecx, Operand(eax, Displacement(10, kSize8Bit)));
+  EXPECT_BYTES(0x1B, 0x48, 0x0A);
+  asm_.sbb(ecx, Operand(eax, Displacement(10, kSize32Bit)));
+  EXPECT_BYTES(0x1B, 0x88, 0x0A, 0x00, 0x00, 0x00);
+
+  asm_.sbb(eax, ecx);
+  EXPECT_BYTES(0x1B, 0xC1);
+  asm_.sbb(Operand(eax), ecx);
+  EXPECT_BYTES(0x19, 0x08);
+  asm_.sbb(Operand(eax, Displacement(10, kSize8Bit)), ecx);
+  EXPECT_BYTES(0x19, 0x48, 0x0A);
+  asm_.sbb(Operand(eax, Displacement(10, kSize32Bit)), ecx);
+  EXPECT_BYTES(0x19, 0x88, 0x0A, 0x00, 0x00, 0x00);
+
+  asm_.sbb(eax, Immediate(0x0A, kSize8Bit));
+  EXPECT_BYTES(0x83, 0xD8, 0x0A);
+  asm_.sbb(ecx, Immediate(0x0A, kSize8Bit));
+  EXPECT_BYTES(0x83, 0xD9, 0x0A);
+  asm_.sbb(ecx, Immediate(0xDEADBEEF, kSize32Bit));
+  EXPECT_BYTES(0x81, 0xD9, 0xEF, 0xBE, 0xAD, 0xDE);
+
+  asm_.sbb(Operand(eax), Immediate(0x1, kSize8Bit));
+  EXPECT_BYTES(0x83, 0x18, 0x01);
+  asm_.sbb(Operand(eax), Immediate(0xDEADBEEF, kSize32Bit));
+  EXPECT_BYTES(0x81, 0x18, 0xEF, 0xBE, 0xAD, 0xDE);
+  asm_.sbb(Operand(eax, Displacement(10, kSize8Bit)),
+           Immediate(0xDEADBEEF, kSize32Bit));
+  EXPECT_BYTES(0x81, 0x58, 0x0A, 0xEF, 0xBE, 0xAD, 0xDE);
+  asm_.sbb(Operand(eax, Displacement(10, kSize32Bit)),
+           Immediate(0xDEADBEEF, kSize32Bit));
+  EXPECT_BYTES(0x81, 0x98, 0x0A, 0x00, 0x00, 0x00, 0xEF, 0xBE, 0xAD, 0xDE);
+
+  // Special EAX mode + immediate.
+  asm_.sbb(eax, Immediate(0xDEADBEEF, kSize32Bit));
+  EXPECT_BYTES(0x1D, 0xEF, 0xBE, 0xAD, 0xDE);
+}
+
 TEST_F(AssemblerTest, Shl) {
   asm_.shl(eax, Immediate(0x1, kSize8Bit));
   EXPECT_BYTES(0xD1, 0xE0);
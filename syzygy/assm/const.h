@@ -37,6 +37,44 @@ const uint8 kOperandSizePrefix = 0x66;
 // Some opcodes that are used repeatedly.
 const uint8 kNopOpCode = 0x1F;
 
+// Identifies the instructions of the arithmetic family, which all share the
+// same operand encodings and differ only in their opcode bytes and ModR/M
+// opcode extension. Used to index kArithmeticEncodings.
+enum ArithmeticOp {
+  kArithmeticAdd = 0,
+  kArithmeticSbb,
+  kArithmeticSub,
+  kArithmeticCmp,
+  kArithmeticTest,
+  kArithmeticOpCount,
+};
+
+// The fixed-form opcodes of an arithmetic-family instruction. With these
+// tabulated, emitting such an instruction reduces to a table lookup followed
+// by the operand bytes.
+struct ArithmeticEncoding {
+  uint8 op_reg8_rm8;  // 8-bit register destination, register source.
+  uint8 op_reg32_rm32;  // 32-bit register destination.
+  uint8 op_rm32_reg32;  // 32-bit memory destination, register source.
+  uint8 op_eax_imm8;  // Short form for an immediate to AL.
+  uint8 op_eax_imm32;  // Short form for an immediate to EAX.
+  uint8 op_rm8_imm8;  // 8-bit immediate to 8-bit destination.
+  uint8 op_rm32_imm8;  // Sign-extended 8-bit immediate to 32-bit destination.
+  uint8 op_rm32_imm32;  // 32-bit immediate to 32-bit destination.
+  uint8 sub_op;  // The ModR/M opcode extension for immediate forms.
+};
+
+// The encodings of the arithmetic-family instructions, indexed by
+// ArithmeticOp. Note that TEST has no sign-extended 8-bit immediate form;
+// its emitters widen 8-bit immediates to 32 bit before using this table.
+static const ArithmeticEncoding kArithmeticEncodings[kArithmeticOpCount] = {
+    { 0x02, 0x03, 0x01, 0x04, 0x05, 0x80, 0x83, 0x81, 0 },  // kArithmeticAdd.
+    { 0x1A, 0x1B, 0x19, 0x1C, 0x1D, 0x80, 0x83, 0x81, 3 },  // kArithmeticSbb.
+    { 0x2A, 0x2B, 0x29, 0x2C, 0x2D, 0x80, 0x83, 0x81, 5 },  // kArithmeticSub.
+    { 0x3A, 0x3B, 0x39, 0x3C, 0x3D, 0x80, 0x83, 0x81, 7 },  // kArithmeticCmp.
+    { 0x84, 0x85, 0x85, 0xA8, 0xA9, 0xF6, 0xF7, 0xF7, 0 },  // kArithmeticTest.
+};
+
 const size_t kShortBranchOpcodeSize = 1;
 const size_t kShortBranchSize = kShortBranchOpcodeSize + 1;
 
@@ -0,0 +1,98 @@
+# Copyright 2014 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+{
+  'variables': {
+    'chromium_code': 1,
+  },
+  'targets': [
+    {
+      'target_name': 'benchmarks_lib',
+      'type': 'static_library',
+      'sources': [
+        'instrument_benchmark_app.cc',
+        'instrument_benchmark_app.h',
+      ],
+      'dependencies': [
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/block_graph/block_graph.gyp:block_graph_lib',
+        '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+        '<(src)/syzygy/instrument/instrument.gyp:instrument_lib',
+        '<(src)/syzygy/pe/pe.gyp:pe_lib',
+      ],
+    },
+    {
+      'target_name': 'instrument_benchmark',
+      'type': 'executable',
+      'sources': [
+        'instrument_benchmark_main.cc',
+      ],
+      'dependencies': [
+        'benchmarks_lib',
+        '<(src)/base/base.gyp:base',
+      ],
+      'run_as': {
+        'action': [
+          '$(TargetPath)',
+          '--image=$(OutDir)\\test_dll.dll',
+          '--pretty-print',
+        ]
+      },
+    },
+    {
+      'target_name': 'heap_replay_benchmark_lib',
+      'type': 'static_library',
+      'sources': [
+        'heap_replay_benchmark_app.cc',
+        'heap_replay_benchmark_app.h',
+      ],
+      'dependencies': [
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/agent/asan/asan.gyp:syzyasan_rtl_lib',
+        '<(src)/syzygy/agent/common/common.gyp:agent_common_lib',
+        '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+        '<(src)/syzygy/trace/parse/parse.gyp:parse_lib',
+      ],
+    },
+    {
+      'target_name': 'heap_replay_benchmark',
+      'type': 'executable',
+      'sources': [
+        'heap_replay_benchmark_main.cc',
+      ],
+      'dependencies': [
+        'heap_replay_benchmark_lib',
+        '<(src)/base/base.gyp:base',
+      ],
+    },
+    {
+      'target_name': 'benchmarks_unittests',
+      'type': 'executable',
+      'sources': [
+        'heap_replay_benchmark_app_unittest.cc',
+        'instrument_benchmark_app_unittest.cc',
+        '<(src)/base/test/run_all_unittests.cc',
+      ],
+      'dependencies': [
+        'benchmarks_lib',
+        'heap_replay_benchmark_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/base/base.gyp:test_support_base',
+        '<(src)/testing/gtest.gyp:gtest',
+      ],
+    },
+  ],
+}
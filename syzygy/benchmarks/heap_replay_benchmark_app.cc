@@ -0,0 +1,661 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Replays the heap operations of a memprof trace against the SyzyAsan heap
+// manager.
+
+#include "syzygy/benchmarks/heap_replay_benchmark_app.h"
+
+#include <windows.h>  // NOLINT
+
+#include <algorithm>
+#include <map>
+
+#include "base/file_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "syzygy/agent/asan/asan_runtime.h"
+#include "syzygy/agent/asan/windows_heap_adapter.h"
+#include "syzygy/core/json_file_writer.h"
+#include "syzygy/trace/parse/parser.h"
+
+namespace benchmarks {
+
+namespace {
+
+using agent::asan::AsanRuntime;
+using agent::asan::WindowsHeapAdapter;
+using trace::parser::Parser;
+
+const char kUsageFormatStr[] =
+    "Usage: %ls [options]\n"
+    "\n"
+    "  Replays the heap operations recorded in a memprof trace file against\n"
+    "  the SyzyAsan heap manager and reports the latency distribution of\n"
+    "  each operation. The trace must have been recorded with detailed\n"
+    "  function call logging (the memprof default); traces recorded with\n"
+    "  --aggregate-function-calls only contain per call site summaries and\n"
+    "  cannot be replayed.\n"
+    "\n"
+    "  Events from all threads of the traced process are replayed serially,\n"
+    "  in timestamp order, so the reported latencies exclude lock\n"
+    "  contention. Record the trace with --serialize-timestamps for a\n"
+    "  faithful interleaving.\n"
+    "\n"
+    "Required parameters:\n"
+    "  --trace=TRACE_FILE    The memprof trace file to replay.\n"
+    "\n"
+    "Optional parameters:\n"
+    "  --asan-parameters=PARAMS\n"
+    "                        The Asan parameters to run the heap manager\n"
+    "                        with, in the same format as the\n"
+    "                        SYZYGY_ASAN_OPTIONS environment variable, eg.\n"
+    "                        \"--quarantine_size=1048576\". Defaults to the\n"
+    "                        default runtime configuration.\n"
+    "  --iterations=NUM      The number of times to replay the trace.\n"
+    "                        Samples accumulate across iterations, and the\n"
+    "                        heap manager is reused, so later iterations\n"
+    "                        measure a warmed-up quarantine. Defaults to 1.\n"
+    "  --json=PATH           The path to which the JSON report should be\n"
+    "                        written. If not specified the report is\n"
+    "                        written to stdout.\n"
+    "  --pretty-print        Enables pretty printing of the JSON report.\n";
+
+// The operation names under which latency samples are recorded.
+const char kCreateOp[] = "create";
+const char kDestroyOp[] = "destroy";
+const char kAllocOp[] = "alloc";
+const char kReAllocOp[] = "realloc";
+const char kFreeOp[] = "free";
+
+// Returns the current value of the performance counter.
+int64 Now() {
+  LARGE_INTEGER now = {};
+  ::QueryPerformanceCounter(&now);
+  return now.QuadPart;
+}
+
+// Returns the factor that converts performance counter ticks to
+// microseconds.
+double GetTicksToMicroseconds() {
+  LARGE_INTEGER frequency = {};
+  ::QueryPerformanceFrequency(&frequency);
+  DCHECK_LT(0, frequency.QuadPart);
+  return 1e6 / frequency.QuadPart;
+}
+
+// Returns the value at the given fraction of a sorted sample vector.
+double Percentile(const std::vector<double>& sorted_samples, double fraction) {
+  DCHECK(!sorted_samples.empty());
+  DCHECK_LE(0.0, fraction);
+  DCHECK_LE(fraction, 1.0);
+  size_t index = static_cast<size_t>(
+      fraction * (sorted_samples.size() - 1) + 0.5);
+  return sorted_samples[index];
+}
+
+// Orders heap events by timestamp.
+bool HeapEventLess(const HeapEvent& lhs, const HeapEvent& rhs) {
+  return lhs.timestamp < rhs.timestamp;
+}
+
+// Accumulates the function name table and detailed function call records of
+// a memprof trace. Name table entries may arrive in any order relative to
+// the calls that use them, so calls are kept raw and only translated to heap
+// events once parsing has completed.
+class MemprofTraceCollector : public trace::parser::ParseEventHandlerImpl {
+ public:
+  MemprofTraceCollector() : failed_(false) {
+  }
+
+  // @name ParseEventHandler overrides.
+  // @{
+  virtual void OnFunctionNameTableEntry(
+      base::Time time,
+      DWORD process_id,
+      const TraceFunctionNameTableEntry* data) OVERRIDE {
+    DCHECK(data != NULL);
+    function_names_[std::make_pair(process_id, data->function_id)] =
+        std::string(data->name, data->name_length);
+  }
+
+  virtual void OnDetailedFunctionCall(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceDetailedFunctionCall* data) OVERRIDE {
+    DCHECK(data != NULL);
+    raw_calls_.push_back(RawCall());
+    RawCall& call = raw_calls_.back();
+    call.process_id = process_id;
+    call.function_id = data->function_id;
+    call.timestamp = data->timestamp;
+    if (!HeapReplayBenchmarkApp::DecodeArguments(data, &call.args)) {
+      LOG(ERROR) << "Encountered a malformed detailed function call record.";
+      failed_ = true;
+    }
+  }
+  // @}
+
+  // Translates the collected records to heap events, sorted by timestamp.
+  // Calls to functions that don't get replayed are dropped.
+  // @param events receives the translated events.
+  void GetHeapEvents(HeapReplayBenchmarkApp::HeapEventVector* events) const {
+    DCHECK(events != NULL);
+    events->clear();
+    events->reserve(raw_calls_.size());
+    RawCalls::const_iterator call_it = raw_calls_.begin();
+    for (; call_it != raw_calls_.end(); ++call_it) {
+      FunctionNameMap::const_iterator name_it = function_names_.find(
+          std::make_pair(call_it->process_id, call_it->function_id));
+      if (name_it == function_names_.end())
+        continue;
+      HeapEvent event = {};
+      if (HeapReplayBenchmarkApp::TranslateFunctionCall(
+              name_it->second, call_it->args, call_it->timestamp, &event)) {
+        events->push_back(event);
+      }
+    }
+    std::stable_sort(events->begin(), events->end(), &HeapEventLess);
+  }
+
+  // @returns true if a malformed record was encountered.
+  bool failed() const { return failed_; }
+
+ protected:
+  // A detailed function call record, pending translation.
+  struct RawCall {
+    uint32 process_id;
+    uint32 function_id;
+    uint64 timestamp;
+    std::vector<uint64> args;
+  };
+  typedef std::vector<RawCall> RawCalls;
+
+  // The function name table, keyed by process ID and function ID.
+  typedef std::map<std::pair<uint32, uint32>, std::string> FunctionNameMap;
+
+  FunctionNameMap function_names_;
+  RawCalls raw_calls_;
+  bool failed_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MemprofTraceCollector);
+};
+
+}  // namespace
+
+HeapReplayBenchmarkApp::HeapReplayBenchmarkApp()
+    : common::AppImplBase("Heap Replay Benchmark"),
+      num_iterations_(1),
+      pretty_print_(false),
+      skipped_events_(0),
+      failed_operations_(0) {
+}
+
+void HeapReplayBenchmarkApp::PrintUsage(const base::FilePath& program,
+                                        const base::StringPiece& message) {
+  if (!message.empty()) {
+    ::fwrite(message.data(), 1, message.length(), out());
+    ::fprintf(out(), "\n\n");
+  }
+
+  ::fprintf(out(), kUsageFormatStr, program.BaseName().value().c_str());
+}
+
+bool HeapReplayBenchmarkApp::ParseCommandLine(const CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help")) {
+    PrintUsage(cmd_line->GetProgram(), "");
+    return false;
+  }
+
+  trace_path_ = cmd_line->GetSwitchValuePath("trace");
+  if (trace_path_.empty()) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify '--trace' parameter!");
+    return false;
+  }
+
+  asan_parameters_ = cmd_line->GetSwitchValueNative("asan-parameters");
+
+  if (cmd_line->HasSwitch("iterations")) {
+    if (!base::StringToInt(
+            cmd_line->GetSwitchValueNative("iterations"), &num_iterations_) ||
+        num_iterations_ <= 0) {
+      PrintUsage(cmd_line->GetProgram(), "Must specify '--iterations' >= 1!");
+      return false;
+    }
+  }
+
+  json_path_ = cmd_line->GetSwitchValuePath("json");
+  pretty_print_ = cmd_line->HasSwitch("pretty-print");
+
+  return true;
+}
+
+int HeapReplayBenchmarkApp::Run() {
+  DCHECK(!trace_path_.empty());
+
+  if (!base::PathExists(trace_path_)) {
+    LOG(ERROR) << "File not found: " << trace_path_.value();
+    return 1;
+  }
+
+  if (!LoadTrace())
+    return 1;
+
+  if (events_.empty()) {
+    LOG(ERROR) << "The trace contains no replayable heap events.";
+    return 1;
+  }
+  LOG(INFO) << "Loaded " << events_.size() << " heap events.";
+
+  // Stand up the Asan runtime with the requested parameters. This
+  // initializes the shadow memory and the heap manager exactly as the
+  // runtime library does in an instrumented process.
+  AsanRuntime runtime;
+  runtime.SetUp(asan_parameters_);
+
+  bool success = true;
+  for (int i = 0; i < num_iterations_ && success; ++i) {
+    LOG(INFO) << "Starting iteration " << (i + 1) << " of "
+              << num_iterations_ << ".";
+    success = ReplayEvents(&runtime);
+  }
+
+  if (success) {
+    if (json_path_.empty()) {
+      success = WriteJsonReport(out());
+    } else {
+      LOG(INFO) << "Writing JSON report to '" << json_path_.value() << "'.";
+      base::ScopedFILE json_file(base::OpenFile(json_path_, "wb"));
+      if (json_file.get() == NULL) {
+        LOG(ERROR) << "Failed to open '" << json_path_.value()
+                   << "' for writing.";
+        success = false;
+      } else {
+        success = WriteJsonReport(json_file.get());
+      }
+    }
+  }
+
+  runtime.TearDown();
+
+  return success ? 0 : 1;
+}
+
+bool HeapReplayBenchmarkApp::DecodeArguments(
+    const TraceDetailedFunctionCall* data, std::vector<uint64>* args) {
+  DCHECK(data != NULL);
+  DCHECK(args != NULL);
+
+  args->clear();
+  if (data->argument_data_size == 0)
+    return true;
+  if (data->argument_data_size < sizeof(uint32))
+    return false;
+
+  const uint32* arg_sizes = reinterpret_cast<const uint32*>(
+      data->argument_data);
+  uint32 arg_count = *(arg_sizes++);
+  if (arg_count > data->argument_data_size / sizeof(uint32))
+    return false;
+  size_t header_size = (arg_count + 1) * sizeof(uint32);
+  if (data->argument_data_size < header_size)
+    return false;
+
+  const uint8* arg_data = data->argument_data + header_size;
+  size_t data_left = data->argument_data_size - header_size;
+  for (uint32 i = 0; i < arg_count; ++i) {
+    uint32 arg_size = arg_sizes[i];
+    if (arg_size == 0 || arg_size > sizeof(uint64) || arg_size > data_left)
+      return false;
+    uint64 value = 0;
+    ::memcpy(&value, arg_data, arg_size);
+    args->push_back(value);
+    arg_data += arg_size;
+    data_left -= arg_size;
+  }
+
+  return true;
+}
+
+bool HeapReplayBenchmarkApp::TranslateFunctionCall(
+    const base::StringPiece& function_name,
+    const std::vector<uint64>& args,
+    uint64 timestamp,
+    HeapEvent* event) {
+  DCHECK(event != NULL);
+
+  // The expected argument layouts below mirror the calls to
+  // EMIT_DETAILED_HEAP_FUNCTION_CALL made by the memprof heap interceptors.
+  HeapEvent result = {};
+  result.timestamp = timestamp;
+
+  if (function_name == "asan_GetProcessHeap") {
+    // (ret).
+    if (args.size() != 1)
+      return false;
+    result.type = HeapEvent::kGetProcessHeap;
+    result.ret = static_cast<uint32>(args[0]);
+  } else if (function_name == "asan_HeapCreate") {
+    // (options, initial_size, maximum_size, ret).
+    if (args.size() != 4)
+      return false;
+    result.type = HeapEvent::kHeapCreate;
+    result.flags = static_cast<uint32>(args[0]);
+    result.size = static_cast<uint32>(args[1]);
+    result.max_size = static_cast<uint32>(args[2]);
+    result.ret = static_cast<uint32>(args[3]);
+  } else if (function_name == "asan_HeapDestroy") {
+    // (heap, ret).
+    if (args.size() != 2)
+      return false;
+    result.type = HeapEvent::kHeapDestroy;
+    result.heap = static_cast<uint32>(args[0]);
+    result.ret = static_cast<uint32>(args[1]);
+  } else if (function_name == "asan_HeapAlloc") {
+    // (heap, flags, bytes, ret).
+    if (args.size() != 4)
+      return false;
+    result.type = HeapEvent::kHeapAlloc;
+    result.heap = static_cast<uint32>(args[0]);
+    result.flags = static_cast<uint32>(args[1]);
+    result.size = static_cast<uint32>(args[2]);
+    result.ret = static_cast<uint32>(args[3]);
+  } else if (function_name == "asan_HeapReAlloc") {
+    // (heap, flags, mem, bytes, ret).
+    if (args.size() != 5)
+      return false;
+    result.type = HeapEvent::kHeapReAlloc;
+    result.heap = static_cast<uint32>(args[0]);
+    result.flags = static_cast<uint32>(args[1]);
+    result.mem = static_cast<uint32>(args[2]);
+    result.size = static_cast<uint32>(args[3]);
+    result.ret = static_cast<uint32>(args[4]);
+  } else if (function_name == "asan_HeapFree") {
+    // (heap, flags, mem, ret, hash). The content hash is ignored.
+    if (args.size() != 5)
+      return false;
+    result.type = HeapEvent::kHeapFree;
+    result.heap = static_cast<uint32>(args[0]);
+    result.flags = static_cast<uint32>(args[1]);
+    result.mem = static_cast<uint32>(args[2]);
+    result.ret = static_cast<uint32>(args[3]);
+  } else {
+    return false;
+  }
+
+  *event = result;
+  return true;
+}
+
+bool HeapReplayBenchmarkApp::LoadTrace() {
+  MemprofTraceCollector collector;
+  Parser parser;
+  if (!parser.Init(&collector)) {
+    LOG(ERROR) << "Failed to initialize the trace parser.";
+    return false;
+  }
+  if (!parser.OpenTraceFile(trace_path_)) {
+    LOG(ERROR) << "Failed to open trace file: " << trace_path_.value() << ".";
+    return false;
+  }
+  if (!parser.Consume() || collector.failed()) {
+    LOG(ERROR) << "Failed to parse trace file: " << trace_path_.value() << ".";
+    return false;
+  }
+
+  collector.GetHeapEvents(&events_);
+  return true;
+}
+
+bool HeapReplayBenchmarkApp::ReplayEvents(AsanRuntime* runtime) {
+  DCHECK(runtime != NULL);
+
+  HANDLE process_heap = reinterpret_cast<HANDLE>(runtime->GetProcessHeap());
+
+  // Maps traced heap handles and allocations to their live counterparts. An
+  // allocation remembers its heap so that it can be freed against the heap
+  // it was made from even if the traced process used a stale handle.
+  struct Allocation {
+    HANDLE heap;
+    LPVOID alloc;
+  };
+  typedef std::map<uint32, HANDLE> HeapMap;
+  typedef std::map<uint32, Allocation> AllocationMap;
+  HeapMap heaps;
+  AllocationMap allocations;
+
+  const double ticks_to_us = GetTicksToMicroseconds();
+
+  HeapEventVector::const_iterator event_it = events_.begin();
+  for (; event_it != events_.end(); ++event_it) {
+    const HeapEvent& event = *event_it;
+
+    // Operations that failed in the traced process are not replayed, as
+    // doing so would take the replayed heap state out of sync with the
+    // remainder of the trace.
+    if (event.ret == 0) {
+      ++skipped_events_;
+      continue;
+    }
+
+    switch (event.type) {
+      case HeapEvent::kGetProcessHeap: {
+        heaps[event.ret] = process_heap;
+        break;
+      }
+
+      case HeapEvent::kHeapCreate: {
+        int64 start = Now();
+        HANDLE heap = WindowsHeapAdapter::HeapCreate(
+            event.flags, event.size, event.max_size);
+        samples_[kCreateOp].push_back((Now() - start) * ticks_to_us);
+        if (heap == NULL) {
+          ++failed_operations_;
+        } else {
+          heaps[event.ret] = heap;
+        }
+        break;
+      }
+
+      case HeapEvent::kHeapDestroy: {
+        HeapMap::iterator heap_it = heaps.find(event.heap);
+        if (heap_it == heaps.end() || heap_it->second == process_heap) {
+          ++skipped_events_;
+          break;
+        }
+        HANDLE heap = heap_it->second;
+
+        // Forget the allocations made from the heap; destroying it frees
+        // them.
+        AllocationMap::iterator alloc_it = allocations.begin();
+        while (alloc_it != allocations.end()) {
+          if (alloc_it->second.heap == heap) {
+            allocations.erase(alloc_it++);
+          } else {
+            ++alloc_it;
+          }
+        }
+        heaps.erase(heap_it);
+
+        int64 start = Now();
+        BOOL destroyed = WindowsHeapAdapter::HeapDestroy(heap);
+        samples_[kDestroyOp].push_back((Now() - start) * ticks_to_us);
+        if (!destroyed)
+          ++failed_operations_;
+        break;
+      }
+
+      case HeapEvent::kHeapAlloc: {
+        // Allocations against a heap whose creation predates the trace get
+        // a lazily created stand-in heap.
+        HeapMap::iterator heap_it = heaps.find(event.heap);
+        if (heap_it == heaps.end()) {
+          HANDLE heap = WindowsHeapAdapter::HeapCreate(0, 0, 0);
+          if (heap == NULL) {
+            ++failed_operations_;
+            break;
+          }
+          heap_it = heaps.insert(std::make_pair(event.heap, heap)).first;
+        }
+
+        int64 start = Now();
+        LPVOID alloc = WindowsHeapAdapter::HeapAlloc(
+            heap_it->second, event.flags, event.size);
+        samples_[kAllocOp].push_back((Now() - start) * ticks_to_us);
+        if (alloc == NULL) {
+          ++failed_operations_;
+          break;
+        }
+
+        // If the traced address is still mapped then a free was missed;
+        // release the stale allocation before overwriting the mapping.
+        AllocationMap::iterator alloc_it = allocations.find(event.ret);
+        if (alloc_it != allocations.end()) {
+          WindowsHeapAdapter::HeapFree(
+              alloc_it->second.heap, 0, alloc_it->second.alloc);
+          allocations.erase(alloc_it);
+        }
+        Allocation allocation = { heap_it->second, alloc };
+        allocations[event.ret] = allocation;
+        break;
+      }
+
+      case HeapEvent::kHeapReAlloc: {
+        AllocationMap::iterator alloc_it = allocations.find(event.mem);
+        if (alloc_it == allocations.end()) {
+          ++skipped_events_;
+          break;
+        }
+        Allocation allocation = alloc_it->second;
+        allocations.erase(alloc_it);
+
+        int64 start = Now();
+        LPVOID alloc = WindowsHeapAdapter::HeapReAlloc(
+            allocation.heap, event.flags, allocation.alloc, event.size);
+        samples_[kReAllocOp].push_back((Now() - start) * ticks_to_us);
+        if (alloc == NULL) {
+          // A failed HeapReAlloc leaves the original allocation intact, so
+          // the mapping is restored under the traced address that the rest
+          // of the trace will keep using.
+          ++failed_operations_;
+          alloc = allocation.alloc;
+        }
+
+        allocation.alloc = alloc;
+        allocations[event.ret] = allocation;
+        break;
+      }
+
+      case HeapEvent::kHeapFree: {
+        AllocationMap::iterator alloc_it = allocations.find(event.mem);
+        if (event.mem == 0 || alloc_it == allocations.end()) {
+          ++skipped_events_;
+          break;
+        }
+        Allocation allocation = alloc_it->second;
+        allocations.erase(alloc_it);
+
+        int64 start = Now();
+        BOOL freed = WindowsHeapAdapter::HeapFree(
+            allocation.heap, event.flags, allocation.alloc);
+        samples_[kFreeOp].push_back((Now() - start) * ticks_to_us);
+        if (!freed)
+          ++failed_operations_;
+        break;
+      }
+
+      default:
+        NOTREACHED();
+        break;
+    }
+  }
+
+  // Release anything the trace leaked so that the heap manager is left
+  // clean for the next iteration. These operations are not timed.
+  AllocationMap::const_iterator alloc_it = allocations.begin();
+  for (; alloc_it != allocations.end(); ++alloc_it) {
+    WindowsHeapAdapter::HeapFree(
+        alloc_it->second.heap, 0, alloc_it->second.alloc);
+  }
+  HeapMap::const_iterator heap_it = heaps.begin();
+  for (; heap_it != heaps.end(); ++heap_it) {
+    if (heap_it->second != process_heap)
+      WindowsHeapAdapter::HeapDestroy(heap_it->second);
+  }
+
+  return true;
+}
+
+bool HeapReplayBenchmarkApp::WriteJsonReport(FILE* file) {
+  DCHECK(file != NULL);
+
+  core::JSONFileWriter json(file, pretty_print_);
+  if (!json.OpenDict() ||
+      !json.OutputKey("trace") ||
+      !json.OutputString(trace_path_.value()) ||
+      !json.OutputKey("asan_parameters") ||
+      !json.OutputString(asan_parameters_) ||
+      !json.OutputKey("iterations") ||
+      !json.OutputInteger(num_iterations_) ||
+      !json.OutputKey("events") ||
+      !json.OutputDouble(static_cast<double>(events_.size())) ||
+      !json.OutputKey("skipped_events") ||
+      !json.OutputDouble(static_cast<double>(skipped_events_)) ||
+      !json.OutputKey("failed_operations") ||
+      !json.OutputDouble(static_cast<double>(failed_operations_)) ||
+      !json.OutputKey("operations") ||
+      !json.OpenDict()) {
+    return false;
+  }
+
+  SampleMap::iterator op_it = samples_.begin();
+  for (; op_it != samples_.end(); ++op_it) {
+    std::vector<double>& samples = op_it->second;
+    DCHECK(!samples.empty());
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0.0;
+    for (size_t i = 0; i < samples.size(); ++i)
+      sum += samples[i];
+
+    if (!json.OutputKey(op_it->first) ||
+        !json.OpenDict() ||
+        !json.OutputKey("count") ||
+        !json.OutputDouble(static_cast<double>(samples.size())) ||
+        !json.OutputKey("mean_us") ||
+        !json.OutputDouble(sum / samples.size()) ||
+        !json.OutputKey("p50_us") ||
+        !json.OutputDouble(Percentile(samples, 0.50)) ||
+        !json.OutputKey("p90_us") ||
+        !json.OutputDouble(Percentile(samples, 0.90)) ||
+        !json.OutputKey("p99_us") ||
+        !json.OutputDouble(Percentile(samples, 0.99)) ||
+        !json.OutputKey("max_us") ||
+        !json.OutputDouble(samples.back()) ||
+        !json.CloseDict()) {
+      return false;
+    }
+  }
+
+  if (!json.CloseDict() || !json.CloseDict() || !json.Flush())
+    return false;
+  ::fprintf(file, "\n");
+
+  return true;
+}
+
+}  // namespace benchmarks
@@ -0,0 +1,179 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A command line application that replays the heap operations recorded in a
+// memprof trace file against the SyzyAsan heap manager and reports per
+// operation latency percentiles. This allows quarantine and redzone
+// parameter changes to be evaluated against real allocation workloads
+// rather than synthetic loops.
+
+#ifndef SYZYGY_BENCHMARKS_HEAP_REPLAY_BENCHMARK_APP_H_
+#define SYZYGY_BENCHMARKS_HEAP_REPLAY_BENCHMARK_APP_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "syzygy/common/application.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace agent {
+namespace asan {
+
+// Forward declaration.
+class AsanRuntime;
+
+}  // namespace asan
+}  // namespace agent
+
+namespace benchmarks {
+
+// A single heap operation reconstructed from a memprof trace. Handles,
+// pointers and sizes are those observed in the traced process; the replay
+// engine maps them onto their live counterparts as it goes.
+struct HeapEvent {
+  // The heap functions that affect heap state and thus get replayed. Events
+  // for the other intercepted functions (HeapSize, HeapValidate, etc) are
+  // ignored.
+  enum EventType {
+    kGetProcessHeap,
+    kHeapCreate,
+    kHeapDestroy,
+    kHeapAlloc,
+    kHeapReAlloc,
+    kHeapFree,
+  };
+
+  // The type of heap function that was called.
+  EventType type;
+  // The timestamp of the call, used to order events. Depending on the
+  // memprof configuration this is either a TSC reading or a global call
+  // counter; either way it increases over the lifetime of a trace.
+  uint64 timestamp;
+  // The traced heap handle argument, or 0 for functions without one.
+  uint32 heap;
+  // The traced allocation argument (the |mem| parameter of HeapFree and
+  // HeapReAlloc), or 0 for functions without one.
+  uint32 mem;
+  // The traced size argument (allocation size, or the initial size of
+  // HeapCreate), or 0 for functions without one.
+  uint32 size;
+  // The maximum size argument of HeapCreate events.
+  uint32 max_size;
+  // The traced flags argument (HeapCreate options or heap function flags),
+  // or 0 for functions without one.
+  uint32 flags;
+  // The traced return value.
+  uint32 ret;
+};
+
+// This class implements the heap_replay_benchmark command-line utility.
+//
+// See the description given in HeapReplayBenchmarkApp:::PrintUsage() for
+// information about running this utility.
+class HeapReplayBenchmarkApp : public common::AppImplBase {
+ public:
+  typedef std::vector<HeapEvent> HeapEventVector;
+
+  // A map from operation name to the latency samples gathered for that
+  // operation, in microseconds.
+  typedef std::map<std::string, std::vector<double>> SampleMap;
+
+  HeapReplayBenchmarkApp();
+
+  // @name Implementation of the AppImplBase interface.
+  // @{
+  bool ParseCommandLine(const CommandLine* command_line);
+
+  int Run();
+  // @}
+
+  // Decodes the argument blob of a detailed function call record into its
+  // individual argument values, zero-extended to 64 bits.
+  // @param data the record whose arguments are to be decoded.
+  // @param args receives the decoded argument values.
+  // @returns true on success, false if the blob is malformed.
+  static bool DecodeArguments(const TraceDetailedFunctionCall* data,
+                              std::vector<uint64>* args);
+
+  // Translates a decoded detailed function call into a heap event.
+  // @param function_name the name of the intercepted function, as recorded
+  //     in the trace's function name table.
+  // @param args the decoded argument values of the call.
+  // @param timestamp the timestamp of the call.
+  // @param event receives the translated event.
+  // @returns true if the function is one that gets replayed and its
+  //     arguments match the layout emitted by the memprof interceptors,
+  //     false otherwise.
+  static bool TranslateFunctionCall(const base::StringPiece& function_name,
+                                    const std::vector<uint64>& args,
+                                    uint64 timestamp,
+                                    HeapEvent* event);
+
+ protected:
+  // Print the app's usage information.
+  void PrintUsage(const base::FilePath& program,
+                  const base::StringPiece& message);
+
+  // Parses the input trace file and populates events_ with the replayable
+  // heap events it contains, in timestamp order.
+  // @returns true on success, false otherwise.
+  bool LoadTrace();
+
+  // Replays events_ once against the heap manager stood up by @p runtime,
+  // appending one latency sample per timed operation to samples_. Any heaps
+  // and allocations still live once the replay completes are released
+  // before returning, without being timed.
+  // @param runtime the initialized Asan runtime to replay against.
+  // @returns true on success, false otherwise.
+  bool ReplayEvents(agent::asan::AsanRuntime* runtime);
+
+  // Writes the gathered latency statistics as JSON to @p file.
+  // @param file the file to write to.
+  // @returns true on success, false otherwise.
+  bool WriteJsonReport(FILE* file);
+
+  // @name Command-line options.
+  // @{
+  base::FilePath trace_path_;
+  base::FilePath json_path_;
+  std::wstring asan_parameters_;
+  int num_iterations_;
+  bool pretty_print_;
+  // @}
+
+  // The recorded heap operations, in replay order.
+  HeapEventVector events_;
+
+  // The latency samples gathered so far, keyed by operation name.
+  SampleMap samples_;
+
+  // The number of events that could not be replayed: operations that failed
+  // in the traced process, and frees and reallocations of allocations that
+  // predate the start of the trace.
+  size_t skipped_events_;
+
+  // The number of replayed operations that failed against the replay heap
+  // manager even though they succeeded in the traced process.
+  size_t failed_operations_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HeapReplayBenchmarkApp);
+};
+
+}  // namespace benchmarks
+
+#endif  // SYZYGY_BENCHMARKS_HEAP_REPLAY_BENCHMARK_APP_H_
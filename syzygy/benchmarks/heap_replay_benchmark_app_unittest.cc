@@ -0,0 +1,209 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/benchmarks/heap_replay_benchmark_app.h"
+
+#include <windows.h>  // NOLINT
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace benchmarks {
+
+namespace {
+
+class TestHeapReplayBenchmarkApp : public HeapReplayBenchmarkApp {
+ public:
+  using HeapReplayBenchmarkApp::trace_path_;
+  using HeapReplayBenchmarkApp::json_path_;
+  using HeapReplayBenchmarkApp::asan_parameters_;
+  using HeapReplayBenchmarkApp::num_iterations_;
+  using HeapReplayBenchmarkApp::pretty_print_;
+};
+
+class HeapReplayBenchmarkAppTest : public testing::Test {
+ public:
+  HeapReplayBenchmarkAppTest()
+      : cmd_line_(base::FilePath(L"heap_replay_benchmark.exe")) {
+  }
+
+  // Builds a TraceDetailedFunctionCall record whose argument blob encodes
+  // @p args, each serialized with 4 bytes, as the memprof interceptors do
+  // for 32-bit processes.
+  void BuildDetailedFunctionCall(const std::vector<uint32>& args) {
+    size_t args_size = 0;
+    if (!args.empty())
+      args_size = (2 * args.size() + 1) * sizeof(uint32);
+    buffer_.resize(
+        FIELD_OFFSET(TraceDetailedFunctionCall, argument_data) + args_size);
+
+    TraceDetailedFunctionCall* data =
+        reinterpret_cast<TraceDetailedFunctionCall*>(&buffer_[0]);
+    data->timestamp = 0;
+    data->function_id = 0;
+    data->stack_trace_id = 0;
+    data->argument_data_size = args_size;
+    if (args.empty())
+      return;
+
+    uint32* cursor = reinterpret_cast<uint32*>(data->argument_data);
+    *(cursor++) = args.size();
+    for (size_t i = 0; i < args.size(); ++i)
+      *(cursor++) = sizeof(uint32);
+    for (size_t i = 0; i < args.size(); ++i)
+      *(cursor++) = args[i];
+  }
+
+  const TraceDetailedFunctionCall* call() const {
+    return reinterpret_cast<const TraceDetailedFunctionCall*>(&buffer_[0]);
+  }
+
+  CommandLine cmd_line_;
+  TestHeapReplayBenchmarkApp app_;
+  std::vector<uint8> buffer_;
+};
+
+}  // namespace
+
+TEST_F(HeapReplayBenchmarkAppTest, ParseCommandLineFailsWithNoTrace) {
+  EXPECT_FALSE(app_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(HeapReplayBenchmarkAppTest, ParseCommandLineMinimal) {
+  cmd_line_.AppendSwitchPath("trace", base::FilePath(L"trace.bin"));
+  EXPECT_TRUE(app_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(L"trace.bin", app_.trace_path_.value());
+  EXPECT_TRUE(app_.json_path_.empty());
+  EXPECT_TRUE(app_.asan_parameters_.empty());
+  EXPECT_EQ(1, app_.num_iterations_);
+  EXPECT_FALSE(app_.pretty_print_);
+}
+
+TEST_F(HeapReplayBenchmarkAppTest, ParseCommandLineMaximal) {
+  cmd_line_.AppendSwitchPath("trace", base::FilePath(L"trace.bin"));
+  cmd_line_.AppendSwitchASCII("asan-parameters", "--quarantine_size=1024");
+  cmd_line_.AppendSwitchASCII("iterations", "5");
+  cmd_line_.AppendSwitchPath("json", base::FilePath(L"report.json"));
+  cmd_line_.AppendSwitch("pretty-print");
+  EXPECT_TRUE(app_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(L"trace.bin", app_.trace_path_.value());
+  EXPECT_EQ(L"report.json", app_.json_path_.value());
+  EXPECT_EQ(L"--quarantine_size=1024", app_.asan_parameters_);
+  EXPECT_EQ(5, app_.num_iterations_);
+  EXPECT_TRUE(app_.pretty_print_);
+}
+
+TEST_F(HeapReplayBenchmarkAppTest, ParseCommandLineFailsWithBadIterations) {
+  cmd_line_.AppendSwitchPath("trace", base::FilePath(L"trace.bin"));
+  cmd_line_.AppendSwitchASCII("iterations", "0");
+  EXPECT_FALSE(app_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(HeapReplayBenchmarkAppTest, DecodeArguments) {
+  std::vector<uint32> args;
+  args.push_back(0xDEADBEEF);
+  args.push_back(8);
+  args.push_back(0);
+  BuildDetailedFunctionCall(args);
+
+  std::vector<uint64> decoded;
+  ASSERT_TRUE(HeapReplayBenchmarkApp::DecodeArguments(call(), &decoded));
+  ASSERT_EQ(3u, decoded.size());
+  EXPECT_EQ(0xDEADBEEF, decoded[0]);
+  EXPECT_EQ(8u, decoded[1]);
+  EXPECT_EQ(0u, decoded[2]);
+}
+
+TEST_F(HeapReplayBenchmarkAppTest, DecodeArgumentsEmpty) {
+  BuildDetailedFunctionCall(std::vector<uint32>());
+  std::vector<uint64> decoded;
+  ASSERT_TRUE(HeapReplayBenchmarkApp::DecodeArguments(call(), &decoded));
+  EXPECT_TRUE(decoded.empty());
+}
+
+TEST_F(HeapReplayBenchmarkAppTest, DecodeArgumentsFailsWhenTruncated) {
+  std::vector<uint32> args;
+  args.push_back(1);
+  args.push_back(2);
+  BuildDetailedFunctionCall(args);
+
+  // Claim more argument data than the record actually holds.
+  TraceDetailedFunctionCall* data =
+      reinterpret_cast<TraceDetailedFunctionCall*>(&buffer_[0]);
+  data->argument_data_size += sizeof(uint32);
+
+  std::vector<uint64> decoded;
+  EXPECT_FALSE(HeapReplayBenchmarkApp::DecodeArguments(call(), &decoded));
+}
+
+TEST_F(HeapReplayBenchmarkAppTest, TranslateHeapAlloc) {
+  std::vector<uint64> args;
+  args.push_back(0x1000);  // heap.
+  args.push_back(HEAP_ZERO_MEMORY);  // flags.
+  args.push_back(37);  // bytes.
+  args.push_back(0x2000);  // ret.
+
+  HeapEvent event = {};
+  ASSERT_TRUE(HeapReplayBenchmarkApp::TranslateFunctionCall(
+      "asan_HeapAlloc", args, 42, &event));
+  EXPECT_EQ(HeapEvent::kHeapAlloc, event.type);
+  EXPECT_EQ(42u, event.timestamp);
+  EXPECT_EQ(0x1000u, event.heap);
+  EXPECT_EQ(static_cast<uint32>(HEAP_ZERO_MEMORY), event.flags);
+  EXPECT_EQ(37u, event.size);
+  EXPECT_EQ(0x2000u, event.ret);
+}
+
+TEST_F(HeapReplayBenchmarkAppTest, TranslateHeapFree) {
+  std::vector<uint64> args;
+  args.push_back(0x1000);  // heap.
+  args.push_back(0);  // flags.
+  args.push_back(0x2000);  // mem.
+  args.push_back(1);  // ret.
+  args.push_back(0xABCD);  // hash, ignored.
+
+  HeapEvent event = {};
+  ASSERT_TRUE(HeapReplayBenchmarkApp::TranslateFunctionCall(
+      "asan_HeapFree", args, 43, &event));
+  EXPECT_EQ(HeapEvent::kHeapFree, event.type);
+  EXPECT_EQ(0x1000u, event.heap);
+  EXPECT_EQ(0x2000u, event.mem);
+  EXPECT_EQ(1u, event.ret);
+}
+
+TEST_F(HeapReplayBenchmarkAppTest, TranslateRejectsWrongArity) {
+  std::vector<uint64> args;
+  args.push_back(0x1000);
+
+  HeapEvent event = {};
+  EXPECT_FALSE(HeapReplayBenchmarkApp::TranslateFunctionCall(
+      "asan_HeapAlloc", args, 0, &event));
+}
+
+TEST_F(HeapReplayBenchmarkAppTest, TranslateRejectsUnknownFunctions) {
+  std::vector<uint64> args;
+  args.push_back(0x1000);
+  args.push_back(0);
+  args.push_back(0x2000);
+  args.push_back(16);
+
+  HeapEvent event = {};
+  EXPECT_FALSE(HeapReplayBenchmarkApp::TranslateFunctionCall(
+      "asan_HeapSize", args, 0, &event));
+  EXPECT_FALSE(HeapReplayBenchmarkApp::TranslateFunctionCall(
+      "foo", args, 0, &event));
+}
+
+}  // namespace benchmarks
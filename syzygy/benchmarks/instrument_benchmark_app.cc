@@ -0,0 +1,338 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Benchmarks the instrumentation pipeline over a given input image.
+
+#include "syzygy/benchmarks/instrument_benchmark_app.h"
+
+#include <windows.h>  // NOLINT
+#include <psapi.h>
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/transform.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/core/json_file_writer.h"
+#include "syzygy/instrument/transforms/asan_transform.h"
+#include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/image_layout.h"
+#include "syzygy/pe/pe_file.h"
+#include "syzygy/pe/pe_relinker.h"
+#include "syzygy/pe/pe_transform_policy.h"
+
+namespace benchmarks {
+
+namespace {
+
+const char kUsageFormatStr[] =
+    "Usage: %ls [options]\n"
+    "\n"
+    "  Benchmarks the instrumentation pipeline over a given input image and\n"
+    "  reports per-phase wall time, CPU time and peak working set. The\n"
+    "  following phases are measured:\n"
+    "\n"
+    "    decompose  Decomposition of the input image to a block graph.\n"
+    "    transform  Application of the Asan transform to the decomposed\n"
+    "               image.\n"
+    "    relink     The full pipeline as run by instrument.exe, via the PE\n"
+    "               relinker. This includes its own decomposition and\n"
+    "               transformation, so it is an end-to-end measurement and\n"
+    "               not the sum of the preceding phases.\n"
+    "\n"
+    "  Note that the peak working set is a process-wide high watermark, so\n"
+    "  it increases monotonically across phases and iterations.\n"
+    "\n"
+    "Required parameters:\n"
+    "  --image=IMAGE_FILE   The EXE or DLL to push through the pipeline.\n"
+    "\n"
+    "Optional parameters:\n"
+    "  --iterations=NUM     The number of times to run the pipeline.\n"
+    "                       Defaults to 1.\n"
+    "  --json=PATH          The path to which the JSON report should be\n"
+    "                       written. If not specified the report is written\n"
+    "                       to stdout.\n"
+    "  --pretty-print       Enables pretty printing of the JSON report.\n";
+
+// Returns the CPU time (user plus kernel) consumed so far by the current
+// process, in seconds. Returns a negative value on failure.
+double GetProcessCpuTime() {
+  FILETIME creation_time = {};
+  FILETIME exit_time = {};
+  FILETIME kernel_time = {};
+  FILETIME user_time = {};
+  if (!::GetProcessTimes(::GetCurrentProcess(), &creation_time, &exit_time,
+                         &kernel_time, &user_time)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "GetProcessTimes failed: " << ::common::LogWe(error) << ".";
+    return -1.0;
+  }
+
+  ULARGE_INTEGER kernel = {};
+  kernel.LowPart = kernel_time.dwLowDateTime;
+  kernel.HighPart = kernel_time.dwHighDateTime;
+  ULARGE_INTEGER user = {};
+  user.LowPart = user_time.dwLowDateTime;
+  user.HighPart = user_time.dwHighDateTime;
+
+  // FILETIMEs are expressed in 100ns intervals.
+  return (kernel.QuadPart + user.QuadPart) * 1e-7;
+}
+
+// Returns the peak working set of the current process, in bytes. Returns 0
+// on failure.
+uint64 GetProcessPeakWorkingSet() {
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "GetProcessMemoryInfo failed: " << ::common::LogWe(error)
+               << ".";
+    return 0;
+  }
+  return counters.PeakWorkingSetSize;
+}
+
+// A simple timer that measures the wall and CPU time elapsed between its
+// construction and the call to Stop, as well as the peak working set
+// observed by the end of the measured interval.
+class PhaseTimer {
+ public:
+  PhaseTimer()
+      : start_wall_(base::TimeTicks::HighResNow()),
+        start_cpu_(GetProcessCpuTime()) {
+  }
+
+  // Stops the timer and records the measurements to @p sample.
+  void Stop(PhaseSample* sample) {
+    DCHECK(sample != NULL);
+    base::TimeDelta wall = base::TimeTicks::HighResNow() - start_wall_;
+    sample->wall_seconds = wall.InSecondsF();
+    sample->cpu_seconds = GetProcessCpuTime() - start_cpu_;
+    sample->peak_working_set = GetProcessPeakWorkingSet();
+  }
+
+ private:
+  base::TimeTicks start_wall_;
+  double start_cpu_;
+};
+
+}  // namespace
+
+InstrumentBenchmarkApp::InstrumentBenchmarkApp()
+    : common::AppImplBase("Instrumentation Benchmark"),
+      num_iterations_(1),
+      pretty_print_(false) {
+}
+
+void InstrumentBenchmarkApp::PrintUsage(const base::FilePath& program,
+                                        const base::StringPiece& message) {
+  if (!message.empty()) {
+    ::fwrite(message.data(), 1, message.length(), out());
+    ::fprintf(out(), "\n\n");
+  }
+
+  ::fprintf(out(), kUsageFormatStr, program.BaseName().value().c_str());
+}
+
+bool InstrumentBenchmarkApp::ParseCommandLine(const CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help")) {
+    PrintUsage(cmd_line->GetProgram(), "");
+    return false;
+  }
+
+  image_path_ = cmd_line->GetSwitchValuePath("image");
+  if (image_path_.empty()) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify '--image' parameter!");
+    return false;
+  }
+
+  if (cmd_line->HasSwitch("iterations")) {
+    if (!base::StringToInt(
+            cmd_line->GetSwitchValueNative("iterations"), &num_iterations_) ||
+        num_iterations_ <= 0) {
+      PrintUsage(cmd_line->GetProgram(), "Must specify '--iterations' >= 1!");
+      return false;
+    }
+  }
+
+  json_path_ = cmd_line->GetSwitchValuePath("json");
+  pretty_print_ = cmd_line->HasSwitch("pretty-print");
+
+  return true;
+}
+
+int InstrumentBenchmarkApp::Run() {
+  DCHECK(!image_path_.empty());
+
+  if (!base::PathExists(image_path_)) {
+    LOG(ERROR) << "File not found: " << image_path_.value();
+    return 1;
+  }
+
+  for (int i = 0; i < num_iterations_; ++i) {
+    LOG(INFO) << "Starting iteration " << (i + 1) << " of "
+              << num_iterations_ << ".";
+    if (!RunOneIteration())
+      return 1;
+  }
+
+  if (json_path_.empty()) {
+    if (!WriteJsonReport(out()))
+      return 1;
+  } else {
+    LOG(INFO) << "Writing JSON report to '" << json_path_.value() << "'.";
+    base::ScopedFILE json_file(base::OpenFile(json_path_, "wb"));
+    if (json_file.get() == NULL) {
+      LOG(ERROR) << "Failed to open '" << json_path_.value()
+                 << "' for writing.";
+      return 1;
+    }
+    if (!WriteJsonReport(json_file.get()))
+      return 1;
+  }
+
+  return 0;
+}
+
+bool InstrumentBenchmarkApp::RunOneIteration() {
+  // Phase 1: decompose the image.
+  pe::PEFile pe_file;
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  {
+    PhaseTimer timer;
+    if (!pe_file.Init(image_path_)) {
+      LOG(ERROR) << "Failed to parse PE file: " << image_path_.value();
+      return false;
+    }
+    pe::Decomposer decomposer(pe_file);
+    if (!decomposer.Decompose(&image_layout)) {
+      LOG(ERROR) << "Failed to decompose image: " << image_path_.value();
+      return false;
+    }
+    PhaseSample sample;
+    timer.Stop(&sample);
+    samples_["decompose"].push_back(sample);
+  }
+
+  // Phase 2: apply the Asan transform to the decomposed image.
+  {
+    block_graph::BlockGraph::Block* header_block =
+        image_layout.blocks.GetBlockByAddress(core::RelativeAddress(0));
+    if (header_block == NULL) {
+      LOG(ERROR) << "Unable to find the header block.";
+      return false;
+    }
+
+    pe::PETransformPolicy policy;
+    instrument::transforms::AsanTransform transform;
+    PhaseTimer timer;
+    if (!block_graph::ApplyBlockGraphTransform(
+            &transform, &policy, &block_graph, header_block)) {
+      LOG(ERROR) << "Failed to apply the Asan transform.";
+      return false;
+    }
+    PhaseSample sample;
+    timer.Stop(&sample);
+    samples_["transform"].push_back(sample);
+  }
+
+  // Phase 3: the full pipeline via the PE relinker, writing to a temporary
+  // directory. This is an end-to-end measurement, and includes its own
+  // decomposition and transformation.
+  {
+    base::ScopedTempDir temp_dir;
+    if (!temp_dir.CreateUniqueTempDir()) {
+      LOG(ERROR) << "Failed to create temporary directory.";
+      return false;
+    }
+
+    pe::PETransformPolicy policy;
+    pe::PERelinker relinker(&policy);
+    relinker.set_input_path(image_path_);
+    relinker.set_output_path(temp_dir.path().Append(image_path_.BaseName()));
+
+    instrument::transforms::AsanTransform transform;
+    PhaseTimer timer;
+    if (!relinker.Init()) {
+      LOG(ERROR) << "Failed to initialize the relinker.";
+      return false;
+    }
+    if (!relinker.AppendTransform(&transform)) {
+      LOG(ERROR) << "Failed to append the Asan transform.";
+      return false;
+    }
+    if (!relinker.Relink()) {
+      LOG(ERROR) << "Failed to relink the image.";
+      return false;
+    }
+    PhaseSample sample;
+    timer.Stop(&sample);
+    samples_["relink"].push_back(sample);
+  }
+
+  return true;
+}
+
+bool InstrumentBenchmarkApp::WriteJsonReport(FILE* file) {
+  DCHECK(file != NULL);
+
+  core::JSONFileWriter json(file, pretty_print_);
+  if (!json.OpenDict() ||
+      !json.OutputKey("image") ||
+      !json.OutputString(image_path_.value()) ||
+      !json.OutputKey("iterations") ||
+      !json.OutputInteger(num_iterations_) ||
+      !json.OutputKey("phases") ||
+      !json.OpenDict()) {
+    return false;
+  }
+
+  SampleMap::const_iterator phase_it = samples_.begin();
+  for (; phase_it != samples_.end(); ++phase_it) {
+    if (!json.OutputKey(phase_it->first) || !json.OpenList())
+      return false;
+
+    const std::vector<PhaseSample>& samples = phase_it->second;
+    for (size_t i = 0; i < samples.size(); ++i) {
+      if (!json.OpenDict() ||
+          !json.OutputKey("wall_seconds") ||
+          !json.OutputDouble(samples[i].wall_seconds) ||
+          !json.OutputKey("cpu_seconds") ||
+          !json.OutputDouble(samples[i].cpu_seconds) ||
+          !json.OutputKey("peak_working_set") ||
+          !json.OutputDouble(
+              static_cast<double>(samples[i].peak_working_set)) ||
+          !json.CloseDict()) {
+        return false;
+      }
+    }
+
+    if (!json.CloseList())
+      return false;
+  }
+
+  if (!json.CloseDict() || !json.CloseDict() || !json.Flush())
+    return false;
+  ::fprintf(file, "\n");
+
+  return true;
+}
+
+}  // namespace benchmarks
@@ -0,0 +1,99 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A command line application that benchmarks the instrumentation pipeline
+// (decomposition, Asan transformation and relinking) over a given input
+// image and reports per-phase timing and memory statistics, optionally as
+// JSON for trend tracking.
+
+#ifndef SYZYGY_BENCHMARKS_INSTRUMENT_BENCHMARK_APP_H_
+#define SYZYGY_BENCHMARKS_INSTRUMENT_BENCHMARK_APP_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "syzygy/common/application.h"
+
+namespace benchmarks {
+
+// Measurements taken for a single run of a single pipeline phase.
+struct PhaseSample {
+  PhaseSample() : wall_seconds(0.0), cpu_seconds(0.0), peak_working_set(0) {
+  }
+
+  // The wall clock time elapsed during the phase, in seconds.
+  double wall_seconds;
+  // The CPU time (user plus kernel) consumed during the phase, in seconds.
+  double cpu_seconds;
+  // The peak working set of the process at the end of the phase, in bytes.
+  // This is a process-wide high watermark, thus is monotonically increasing
+  // across phases.
+  uint64 peak_working_set;
+};
+
+// This class implements the instrument_benchmark command-line utility.
+//
+// See the description given in InstrumentBenchmarkApp:::PrintUsage() for
+// information about running this utility.
+class InstrumentBenchmarkApp : public common::AppImplBase {
+ public:
+  // A map from phase name to the samples gathered for that phase, one per
+  // iteration.
+  typedef std::map<std::string, std::vector<PhaseSample>> SampleMap;
+
+  InstrumentBenchmarkApp();
+
+  // @name Implementation of the AppImplBase interface.
+  // @{
+  bool ParseCommandLine(const CommandLine* command_line);
+
+  int Run();
+  // @}
+
+ protected:
+  // Print the app's usage information.
+  void PrintUsage(const base::FilePath& program,
+                  const base::StringPiece& message);
+
+  // Runs a single iteration of the benchmark, appending one sample per
+  // phase to samples_.
+  // @returns true on success, false otherwise.
+  bool RunOneIteration();
+
+  // Writes the gathered samples as JSON to @p file.
+  // @param file the file to write to.
+  // @returns true on success, false otherwise.
+  bool WriteJsonReport(FILE* file);
+
+  // @name Command-line options.
+  // @{
+  base::FilePath image_path_;
+  base::FilePath json_path_;
+  int num_iterations_;
+  bool pretty_print_;
+  // @}
+
+  // The samples gathered so far, keyed by phase name.
+  SampleMap samples_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(InstrumentBenchmarkApp);
+};
+
+}  // namespace benchmarks
+
+#endif  // SYZYGY_BENCHMARKS_INSTRUMENT_BENCHMARK_APP_H_
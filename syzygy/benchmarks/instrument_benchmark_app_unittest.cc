@@ -0,0 +1,74 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/benchmarks/instrument_benchmark_app.h"
+
+#include "gtest/gtest.h"
+
+namespace benchmarks {
+
+namespace {
+
+class TestInstrumentBenchmarkApp : public InstrumentBenchmarkApp {
+ public:
+  using InstrumentBenchmarkApp::image_path_;
+  using InstrumentBenchmarkApp::json_path_;
+  using InstrumentBenchmarkApp::num_iterations_;
+  using InstrumentBenchmarkApp::pretty_print_;
+};
+
+class InstrumentBenchmarkAppTest : public testing::Test {
+ public:
+  InstrumentBenchmarkAppTest()
+      : cmd_line_(base::FilePath(L"instrument_benchmark.exe")) {
+  }
+
+  CommandLine cmd_line_;
+  TestInstrumentBenchmarkApp app_;
+};
+
+}  // namespace
+
+TEST_F(InstrumentBenchmarkAppTest, ParseCommandLineFailsWithNoImage) {
+  EXPECT_FALSE(app_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(InstrumentBenchmarkAppTest, ParseCommandLineMinimal) {
+  cmd_line_.AppendSwitchPath("image", base::FilePath(L"foo.dll"));
+  EXPECT_TRUE(app_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(L"foo.dll", app_.image_path_.value());
+  EXPECT_TRUE(app_.json_path_.empty());
+  EXPECT_EQ(1, app_.num_iterations_);
+  EXPECT_FALSE(app_.pretty_print_);
+}
+
+TEST_F(InstrumentBenchmarkAppTest, ParseCommandLineMaximal) {
+  cmd_line_.AppendSwitchPath("image", base::FilePath(L"foo.dll"));
+  cmd_line_.AppendSwitchASCII("iterations", "10");
+  cmd_line_.AppendSwitchPath("json", base::FilePath(L"report.json"));
+  cmd_line_.AppendSwitch("pretty-print");
+  EXPECT_TRUE(app_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(L"foo.dll", app_.image_path_.value());
+  EXPECT_EQ(L"report.json", app_.json_path_.value());
+  EXPECT_EQ(10, app_.num_iterations_);
+  EXPECT_TRUE(app_.pretty_print_);
+}
+
+TEST_F(InstrumentBenchmarkAppTest, ParseCommandLineFailsWithBadIterations) {
+  cmd_line_.AppendSwitchPath("image", base::FilePath(L"foo.dll"));
+  cmd_line_.AppendSwitchASCII("iterations", "0");
+  EXPECT_FALSE(app_.ParseCommandLine(&cmd_line_));
+}
+
+}  // namespace benchmarks
@@ -23,6 +23,10 @@
       'sources': [
         'control_flow_analysis.cc',
         'control_flow_analysis.h',
+        'dominator_analysis.cc',
+        'dominator_analysis.h',
+        'image_liveness_analysis.cc',
+        'image_liveness_analysis.h',
         'liveness_analysis.cc',
         'liveness_analysis.h',
         'liveness_analysis_internal.h',
@@ -41,6 +45,8 @@
       'type': 'executable',
       'sources': [
         'control_flow_analysis_unittest.cc',
+        'dominator_analysis_unittest.cc',
+        'image_liveness_analysis_unittest.cc',
         'liveness_analysis_unittest.cc',
         'memory_access_analysis_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
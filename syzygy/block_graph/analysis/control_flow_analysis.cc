@@ -67,6 +67,8 @@
 #include <sstream>
 #include <stack>
 
+#include "syzygy/block_graph/basic_block_successor_index.h"
+
 namespace block_graph {
 namespace analysis {
 namespace {
@@ -804,38 +806,39 @@ void ControlFlowAnalysis::FlattenBasicBlocksInPostOrder(
 
   // Build a reverse post-order (RPO) ordering of basic blocks. This is needed
   // for faster fix-point convergence, but works with any ordering.
-  std::set<BasicBlock*> marked;
-  std::stack<BasicBlock*> working;
+
+  // The traversal runs over a compact successor index rather than the
+  // per-block successor lists, which keeps it on flat arrays. Data basic
+  // blocks carry no control flow and are not indexed, so they are skipped
+  // implicitly.
+  typedef BasicBlockSuccessorIndex::Ordinal Ordinal;
+  BasicBlockSuccessorIndex index;
+  index.Build(basic_blocks);
+
+  std::vector<bool> marked(index.num_blocks(), false);
+  std::stack<Ordinal> working;
 
   // For each basic block, flatten its reachable sub-tree in post-order.
-  BBCollection::const_iterator iter_end = basic_blocks.end();
-  for (BBCollection::const_iterator iter = basic_blocks.begin();
-       iter != iter_end; ++iter) {
+  for (size_t i = 0; i < index.num_blocks(); ++i) {
     // When not marked, mark it and add it to working stack.
-    if (marked.insert(*iter).second)
-      working.push(*iter);
+    if (marked[i])
+      continue;
+    marked[i] = true;
+    working.push(static_cast<Ordinal>(i));
 
     // Flatten this tree without following back edges, push them in post-order.
     while (!working.empty()) {
-      const BasicBlock* top = working.top();
-
-      // Skip data basic block.
-      const BasicCodeBlock* bb = BasicCodeBlock::Cast(top);
-      if (bb == NULL) {
-        working.pop();
-        continue;
-      }
+      Ordinal top = working.top();
 
       // Add unvisited child to the working stack.
       bool has_unvisited_child = false;
-      const BasicBlock::Successors& successors = bb->successors();
-      Successors::const_iterator succ_end = successors.end();
-      for (Successors::const_iterator succ = successors.begin();
-           succ != succ_end;  ++succ) {
-        BasicBlock* basic_block = succ->reference().basic_block();
+      const Ordinal* succ = index.successors_begin(top);
+      const Ordinal* succ_end = index.successors_end(top);
+      for (; succ != succ_end; ++succ) {
         // When not marked, mark it and add it to working stack.
-        if (marked.insert(basic_block).second) {
-          working.push(basic_block);
+        if (!marked[*succ]) {
+          marked[*succ] = true;
+          working.push(*succ);
           has_unvisited_child = true;
           break;
         }
@@ -843,7 +846,7 @@ void ControlFlowAnalysis::FlattenBasicBlocksInPostOrder(
 
       if (!has_unvisited_child) {
         // Push this basic block in post-order in the ordering.
-        order->push_back(bb);
+        order->push_back(index.block(top));
         working.pop();
       }
     }
@@ -0,0 +1,312 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// The dominator analysis is computed with the iterative algorithm of Cooper,
+// Harvey and Kennedy. Basic blocks are numbered in reverse post-order and a
+// data-flow iteration refines the immediate dominator of each block until a
+// fixed point is reached; the intersection of two dominator chains only ever
+// walks towards the entry so convergence is fast in practice (typically two
+// passes over a flow graph). A virtual root fronting all the entry blocks
+// deals with functions that have several entry points, and the same routine
+// run on the reversed flow graph rooted at the exit blocks produces the
+// post-dominator tree.
+//
+// See: "A Simple, Fast Dominance Algorithm", by Keith D. Cooper,
+//      Timothy J. Harvey and Ken Kennedy.
+
+#include "syzygy/block_graph/analysis/dominator_analysis.h"
+
+#include <set>
+#include <stack>
+#include <utility>
+
+namespace block_graph {
+namespace analysis {
+
+namespace {
+
+typedef block_graph::BasicBlockSubGraph::BasicBlock::Successors Successors;
+typedef block_graph::BasicBlockSubGraph::BBCollection BBCollection;
+typedef block_graph::BasicBlockSubGraph::BlockDescriptionList
+    BlockDescriptionList;
+
+// The index of the virtual root fronting the entry blocks.
+const size_t kVirtualRoot = 0;
+
+// The index of a block whose immediate dominator is not yet known.
+const size_t kUndefined = static_cast<size_t>(-1);
+
+// Walks up the two dominator chains in @p idoms until they meet, which is
+// the nearest common dominator of @p node1 and @p node2. Blocks are numbered
+// in reverse post-order, so a dominator always has a smaller index than the
+// blocks it dominates.
+size_t Intersect(const std::vector<size_t>& idoms,
+                 size_t node1,
+                 size_t node2) {
+  while (node1 != node2) {
+    while (node1 > node2)
+      node1 = idoms[node1];
+    while (node2 > node1)
+      node2 = idoms[node2];
+  }
+  return node1;
+}
+
+}  // namespace
+
+void DominatorAnalysis::BuildTree(const BasicBlockVector& entries,
+                                  const EdgeMap& successors,
+                                  const EdgeMap& predecessors,
+                                  DominatorTree* tree) {
+  DCHECK_NE(reinterpret_cast<DominatorTree*>(NULL), tree);
+
+  tree->clear();
+  if (entries.empty())
+    return;
+
+  // Flatten the part of the graph reachable from the entries in post-order.
+  std::set<const BasicCodeBlock*> marked;
+  std::stack<const BasicCodeBlock*> working;
+  BasicBlockVector post_order;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    // When not marked, mark it and add it to working stack.
+    if (marked.insert(entries[i]).second)
+      working.push(entries[i]);
+
+    while (!working.empty()) {
+      const BasicCodeBlock* top = working.top();
+
+      // Add unvisited child to the working stack.
+      bool has_unvisited_child = false;
+      EdgeMap::const_iterator look = successors.find(top);
+      if (look != successors.end()) {
+        const BasicBlockVector& children = look->second;
+        for (size_t child = 0; child < children.size(); ++child) {
+          if (marked.insert(children[child]).second) {
+            working.push(children[child]);
+            has_unvisited_child = true;
+            break;
+          }
+        }
+      }
+
+      if (!has_unvisited_child) {
+        post_order.push_back(top);
+        working.pop();
+      }
+    }
+  }
+
+  // Number the reachable blocks in reverse post-order, reserving index 0 for
+  // the virtual root. The algorithm below identifies blocks by this number.
+  std::vector<const BasicCodeBlock*> nodes(post_order.size() + 1);
+  std::map<const BasicCodeBlock*, size_t> indices;
+  nodes[kVirtualRoot] = NULL;
+  for (size_t i = 0; i < post_order.size(); ++i) {
+    size_t index = post_order.size() - i;
+    nodes[index] = post_order[i];
+    indices[post_order[i]] = index;
+  }
+
+  // The entries are fronted by the virtual root, which is its own dominator.
+  std::vector<size_t> idoms(nodes.size(), kUndefined);
+  std::set<size_t> entry_indices;
+  idoms[kVirtualRoot] = kVirtualRoot;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    idoms[indices[entries[i]]] = kVirtualRoot;
+    entry_indices.insert(indices[entries[i]]);
+  }
+
+  // Refine the immediate dominators until a fixed point is reached. Each
+  // pass visits the blocks in reverse post-order, so the dominator of at
+  // least one predecessor of a block is always known when the block is
+  // visited.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (size_t index = 1; index < nodes.size(); ++index) {
+      if (entry_indices.find(index) != entry_indices.end())
+        continue;
+
+      // The new dominator is the nearest common dominator of the
+      // predecessors processed so far.
+      size_t new_idom = kUndefined;
+      EdgeMap::const_iterator look = predecessors.find(nodes[index]);
+      DCHECK(look != predecessors.end());
+      const BasicBlockVector& preds = look->second;
+      for (size_t pred = 0; pred < preds.size(); ++pred) {
+        std::map<const BasicCodeBlock*, size_t>::const_iterator pred_it =
+            indices.find(preds[pred]);
+        // Skip unreachable predecessors and those not yet processed.
+        if (pred_it == indices.end() || idoms[pred_it->second] == kUndefined)
+          continue;
+        if (new_idom == kUndefined) {
+          new_idom = pred_it->second;
+        } else {
+          new_idom = Intersect(idoms, new_idom, pred_it->second);
+        }
+      }
+      DCHECK_NE(kUndefined, new_idom);
+
+      if (new_idom != idoms[index]) {
+        idoms[index] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  // Record the immediate dominators and build the children lists of the
+  // tree, rooted at the virtual root.
+  std::vector<std::vector<size_t> > children(nodes.size());
+  for (size_t index = 1; index < nodes.size(); ++index) {
+    TreeNode& node = (*tree)[nodes[index]];
+    if (idoms[index] != kVirtualRoot)
+      node.idom = nodes[idoms[index]];
+    children[idoms[index]].push_back(index);
+  }
+
+  // Number the tree depth-first so that the interval of a node encloses the
+  // intervals of exactly the nodes it dominates.
+  size_t counter = 0;
+  std::stack<std::pair<size_t, size_t> > visit;
+  visit.push(std::make_pair(kVirtualRoot, 0));
+  while (!visit.empty()) {
+    size_t index = visit.top().first;
+    size_t next_child = visit.top().second;
+
+    if (next_child == 0 && index != kVirtualRoot)
+      (*tree)[nodes[index]].dfs_in = ++counter;
+
+    if (next_child < children[index].size()) {
+      ++visit.top().second;
+      visit.push(std::make_pair(children[index][next_child], 0));
+    } else {
+      if (index != kVirtualRoot)
+        (*tree)[nodes[index]].dfs_out = ++counter;
+      visit.pop();
+    }
+  }
+}
+
+void DominatorAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(reinterpret_cast<const BasicBlockSubGraph*>(NULL), subgraph);
+
+  dominator_tree_.clear();
+  post_dominator_tree_.clear();
+
+  // Build the forward and backward edges between the code basic blocks of
+  // the subgraph.
+  EdgeMap successors;
+  EdgeMap predecessors;
+  BasicBlockVector exits;
+  const BBCollection& basic_blocks = subgraph->basic_blocks();
+  BBCollection::const_iterator it = basic_blocks.begin();
+  for (; it != basic_blocks.end(); ++it) {
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    if (bb == NULL)
+      continue;
+
+    size_t num_successors = 0;
+    const Successors& bb_successors = bb->successors();
+    Successors::const_iterator succ = bb_successors.begin();
+    for (; succ != bb_successors.end(); ++succ) {
+      const BasicCodeBlock* next =
+          BasicCodeBlock::Cast(succ->reference().basic_block());
+      if (next == NULL)
+        continue;
+      successors[bb].push_back(next);
+      predecessors[next].push_back(bb);
+      ++num_successors;
+    }
+
+    // Blocks without a successor inside the subgraph (e.g. blocks ending
+    // with a return) are the exits of the flow graph.
+    if (num_successors == 0)
+      exits.push_back(bb);
+  }
+
+  // The entries of the flow graph come from the block descriptions.
+  BasicBlockVector entries;
+  const BlockDescriptionList& descriptions = subgraph->block_descriptions();
+  BlockDescriptionList::const_iterator description = descriptions.begin();
+  for (; description != descriptions.end(); ++description) {
+    if (description->basic_block_order.empty())
+      continue;
+    const BasicCodeBlock* bb =
+        BasicCodeBlock::Cast(description->basic_block_order.front());
+    if (bb != NULL)
+      entries.push_back(bb);
+  }
+
+  BuildTree(entries, successors, predecessors, &dominator_tree_);
+  BuildTree(exits, predecessors, successors, &post_dominator_tree_);
+}
+
+const BasicCodeBlock* DominatorAnalysis::GetImmediateDominator(
+    const BasicCodeBlock* bb) const {
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), bb);
+  DominatorTree::const_iterator look = dominator_tree_.find(bb);
+  if (look == dominator_tree_.end())
+    return NULL;
+  return look->second.idom;
+}
+
+const BasicCodeBlock* DominatorAnalysis::GetImmediatePostDominator(
+    const BasicCodeBlock* bb) const {
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), bb);
+  DominatorTree::const_iterator look = post_dominator_tree_.find(bb);
+  if (look == post_dominator_tree_.end())
+    return NULL;
+  return look->second.idom;
+}
+
+bool DominatorAnalysis::Dominates(const BasicCodeBlock* dominator,
+                                  const BasicCodeBlock* bb) const {
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), dominator);
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), bb);
+
+  DominatorTree::const_iterator look1 = dominator_tree_.find(dominator);
+  DominatorTree::const_iterator look2 = dominator_tree_.find(bb);
+  if (look1 == dominator_tree_.end() || look2 == dominator_tree_.end())
+    return false;
+
+  return look1->second.dfs_in <= look2->second.dfs_in &&
+         look2->second.dfs_out <= look1->second.dfs_out;
+}
+
+bool DominatorAnalysis::PostDominates(const BasicCodeBlock* post_dominator,
+                                      const BasicCodeBlock* bb) const {
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), post_dominator);
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), bb);
+
+  DominatorTree::const_iterator look1 =
+      post_dominator_tree_.find(post_dominator);
+  DominatorTree::const_iterator look2 = post_dominator_tree_.find(bb);
+  if (look1 == post_dominator_tree_.end() ||
+      look2 == post_dominator_tree_.end()) {
+    return false;
+  }
+
+  return look1->second.dfs_in <= look2->second.dfs_in &&
+         look2->second.dfs_out <= look1->second.dfs_out;
+}
+
+bool DominatorAnalysis::IsReachable(const BasicCodeBlock* bb) const {
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), bb);
+  return dominator_tree_.find(bb) != dominator_tree_.end();
+}
+
+}  // namespace analysis
+}  // namespace block_graph
@@ -0,0 +1,147 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A class that computes the dominator and post-dominator trees of a subgraph.
+//
+// A basic block D dominates a basic block B when every path from the entry of
+// the flow graph to B passes through D. Conversely, P post-dominates B when
+// every path from B to an exit of the flow graph passes through P. The
+// immediate (post-)dominator of B is the unique closest strict
+// (post-)dominator of B; the immediate dominator relation forms a tree rooted
+// at the flow graph entry.
+//
+// See: http://en.wikipedia.org/wiki/Dominator_(graph_theory)
+
+#ifndef SYZYGY_BLOCK_GRAPH_ANALYSIS_DOMINATOR_ANALYSIS_H_
+#define SYZYGY_BLOCK_GRAPH_ANALYSIS_DOMINATOR_ANALYSIS_H_
+
+#include <map>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
+
+namespace block_graph {
+namespace analysis {
+
+// This class implements a dominator analysis on a subgraph.
+//
+// The analysis builds both the dominator tree and the post-dominator tree in
+// a single pre-computation pass. The trees are cached inside the analysis
+// instance along with a depth-first numbering of each tree, so that after the
+// pre-computation every dominance query is answered in constant time. The
+// cached results are only valid as long as the control flow of the analyzed
+// subgraph is left unmodified.
+//
+// Example:
+//
+//  DominatorAnalysis dominators;
+//  dominators.Analyze(subgraph);
+//
+//  if (dominators.Dominates(bb1, bb2)) {
+//    // Every path from the entry to |bb2| passes through |bb1|.
+//  }
+//  if (!dominators.IsReachable(bb)) {
+//    // |bb| is unreachable from the entry and may be removed.
+//  }
+
+class DominatorAnalysis {
+ public:
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+
+  DominatorAnalysis() { }
+
+  // Performs the analysis and caches the resulting dominator and
+  // post-dominator trees in this instance. Any previously cached results are
+  // discarded.
+  // @param subgraph Subgraph to analyze.
+  void Analyze(const BasicBlockSubGraph* subgraph);
+
+  // @param bb Basic block to query.
+  // @returns the immediate dominator of @p bb, or NULL when @p bb is an
+  //     entry of the flow graph or is unreachable from an entry.
+  const BasicCodeBlock* GetImmediateDominator(const BasicCodeBlock* bb) const;
+
+  // @param bb Basic block to query.
+  // @returns the immediate post-dominator of @p bb, or NULL when @p bb is an
+  //     exit of the flow graph or cannot reach an exit.
+  const BasicCodeBlock* GetImmediatePostDominator(
+      const BasicCodeBlock* bb) const;
+
+  // @param dominator Candidate dominator.
+  // @param bb Basic block to query.
+  // @returns true when @p dominator dominates @p bb. A basic block dominates
+  //     itself. Returns false when either block is unreachable.
+  bool Dominates(const BasicCodeBlock* dominator,
+                 const BasicCodeBlock* bb) const;
+
+  // @param post_dominator Candidate post-dominator.
+  // @param bb Basic block to query.
+  // @returns true when @p post_dominator post-dominates @p bb. A basic block
+  //     post-dominates itself. Returns false when either block cannot reach
+  //     an exit.
+  bool PostDominates(const BasicCodeBlock* post_dominator,
+                     const BasicCodeBlock* bb) const;
+
+  // @param bb Basic block to query.
+  // @returns true when @p bb is reachable from an entry of the flow graph.
+  bool IsReachable(const BasicCodeBlock* bb) const;
+
+ private:
+  // A node of a dominator tree. The depth-first interval [dfs_in, dfs_out]
+  // of a node encloses the intervals of all the nodes it dominates, which
+  // makes dominance queries a pair of comparisons.
+  struct TreeNode {
+    TreeNode() : idom(NULL), dfs_in(0), dfs_out(0) {
+    }
+
+    // The immediate dominator, NULL for roots of the tree.
+    const BasicCodeBlock* idom;
+
+    // The depth-first interval of this node in the tree.
+    size_t dfs_in;
+    size_t dfs_out;
+  };
+
+  typedef std::map<const BasicCodeBlock*, TreeNode> DominatorTree;
+  typedef std::vector<const BasicCodeBlock*> BasicBlockVector;
+  typedef std::map<const BasicCodeBlock*, BasicBlockVector> EdgeMap;
+
+  // Builds the dominator tree of the graph induced by @p successors and
+  // @p predecessors, rooted at the blocks in @p entries. The post-dominator
+  // tree is built with the same routine by passing the reversed graph and
+  // the exits as entries.
+  // @param entries the roots of the flow graph.
+  // @param successors the forward edges of the flow graph.
+  // @param predecessors the backward edges of the flow graph.
+  // @param tree receives the resulting tree.
+  static void BuildTree(const BasicBlockVector& entries,
+                        const EdgeMap& successors,
+                        const EdgeMap& predecessors,
+                        DominatorTree* tree);
+
+  // The cached dominator and post-dominator trees. Basic blocks that are
+  // unreachable (respectively, cannot reach an exit) have no node in the
+  // corresponding tree.
+  DominatorTree dominator_tree_;
+  DominatorTree post_dominator_tree_;
+
+  DISALLOW_COPY_AND_ASSIGN(DominatorAnalysis);
+};
+
+}  // namespace analysis
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_ANALYSIS_DOMINATOR_ANALYSIS_H_
@@ -0,0 +1,214 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Unittests for dominator analysis.
+
+#include "syzygy/block_graph/analysis/dominator_analysis.h"
+
+#include "gtest/gtest.h"
+
+namespace block_graph {
+namespace analysis {
+
+namespace {
+
+typedef block_graph::BasicBlockSubGraph::BasicCodeBlock BasicCodeBlock;
+
+class DominatorAnalysisTest : public testing::Test {
+ public:
+  DominatorAnalysisTest() {}
+
+ protected:
+  void Analyze(BasicCodeBlock* entry);
+
+  void AddSuccessorBetween(Successor::Condition condition,
+                           BasicCodeBlock* from,
+                           BasicCodeBlock* to);
+
+  void Connect(BasicCodeBlock* from,
+               BasicCodeBlock* to);
+
+  void MakeIf(BasicCodeBlock* root,
+              BasicCodeBlock* true_stm,
+              BasicCodeBlock* end_stm);
+
+  BasicBlockSubGraph subgraph_;
+  DominatorAnalysis dominators_;
+};
+
+void DominatorAnalysisTest::Analyze(BasicCodeBlock* entry) {
+  // Add the entry block in the block description.
+  BasicBlockSubGraph::BlockDescription* description =
+      subgraph_.AddBlockDescription("bb1", "test.obj", BlockGraph::CODE_BLOCK,
+                                    7, 2, 42);
+  description->basic_block_order.push_back(entry);
+
+  // Analyze the subgraph.
+  dominators_.Analyze(&subgraph_);
+}
+
+void DominatorAnalysisTest::AddSuccessorBetween(
+    Successor::Condition condition,
+    BasicCodeBlock* from,
+    BasicCodeBlock* to) {
+  DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), from);
+  DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), to);
+  DCHECK_LT(from->successors().size(), 2U);
+
+  from->successors().push_back(
+      Successor(condition,
+                BasicBlockReference(BlockGraph::RELATIVE_REF,
+                                    BlockGraph::Reference::kMaximumSize,
+                                    to),
+                0));
+}
+
+void DominatorAnalysisTest::Connect(BasicCodeBlock* from,
+                                    BasicCodeBlock* to) {
+  DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), from);
+  DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), to);
+  DCHECK_LT(from->successors().size(), 1U);
+
+  AddSuccessorBetween(Successor::kConditionTrue, from, to);
+}
+
+void DominatorAnalysisTest::MakeIf(
+    BasicCodeBlock* root,
+    BasicCodeBlock* true_stm,
+    BasicCodeBlock* false_stm) {
+  DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), root);
+  DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), true_stm);
+  DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), false_stm);
+
+  Successor::Condition condition = Successor::kConditionAbove;
+  AddSuccessorBetween(condition, root, true_stm);
+  AddSuccessorBetween(Successor::InvertCondition(condition), root, false_stm);
+}
+
+}  // namespace
+
+TEST_F(DominatorAnalysisTest, SequenceDominators) {
+  BasicCodeBlock* seq1 = subgraph_.AddBasicCodeBlock("seq1");
+  BasicCodeBlock* seq2 = subgraph_.AddBasicCodeBlock("seq2");
+  BasicCodeBlock* seq3 = subgraph_.AddBasicCodeBlock("seq3");
+
+  Connect(seq1, seq2);
+  Connect(seq2, seq3);
+
+  ASSERT_NO_FATAL_FAILURE(Analyze(seq1));
+
+  // In a straight sequence each block is dominated by all its predecessors.
+  EXPECT_EQ(NULL, dominators_.GetImmediateDominator(seq1));
+  EXPECT_EQ(seq1, dominators_.GetImmediateDominator(seq2));
+  EXPECT_EQ(seq2, dominators_.GetImmediateDominator(seq3));
+
+  EXPECT_TRUE(dominators_.Dominates(seq1, seq1));
+  EXPECT_TRUE(dominators_.Dominates(seq1, seq2));
+  EXPECT_TRUE(dominators_.Dominates(seq1, seq3));
+  EXPECT_TRUE(dominators_.Dominates(seq2, seq3));
+  EXPECT_FALSE(dominators_.Dominates(seq2, seq1));
+  EXPECT_FALSE(dominators_.Dominates(seq3, seq2));
+
+  // And post-dominated by all its successors.
+  EXPECT_EQ(seq3, dominators_.GetImmediatePostDominator(seq2));
+  EXPECT_EQ(seq2, dominators_.GetImmediatePostDominator(seq1));
+  EXPECT_EQ(NULL, dominators_.GetImmediatePostDominator(seq3));
+  EXPECT_TRUE(dominators_.PostDominates(seq3, seq1));
+  EXPECT_FALSE(dominators_.PostDominates(seq1, seq3));
+}
+
+TEST_F(DominatorAnalysisTest, DiamondDominators) {
+  BasicCodeBlock* if1 = subgraph_.AddBasicCodeBlock("if1");
+  BasicCodeBlock* true1 = subgraph_.AddBasicCodeBlock("true1");
+  BasicCodeBlock* false1 = subgraph_.AddBasicCodeBlock("false1");
+  BasicCodeBlock* end1 = subgraph_.AddBasicCodeBlock("end1");
+
+  MakeIf(if1, true1, false1);
+  Connect(true1, end1);
+  Connect(false1, end1);
+
+  ASSERT_NO_FATAL_FAILURE(Analyze(if1));
+
+  // Neither branch dominates the join block, only the condition does.
+  EXPECT_EQ(if1, dominators_.GetImmediateDominator(true1));
+  EXPECT_EQ(if1, dominators_.GetImmediateDominator(false1));
+  EXPECT_EQ(if1, dominators_.GetImmediateDominator(end1));
+
+  EXPECT_TRUE(dominators_.Dominates(if1, end1));
+  EXPECT_FALSE(dominators_.Dominates(true1, end1));
+  EXPECT_FALSE(dominators_.Dominates(false1, end1));
+  EXPECT_FALSE(dominators_.Dominates(true1, false1));
+
+  // Symmetrically, the join block post-dominates both branches and the
+  // condition, but the branches post-dominate nothing.
+  EXPECT_EQ(end1, dominators_.GetImmediatePostDominator(true1));
+  EXPECT_EQ(end1, dominators_.GetImmediatePostDominator(false1));
+  EXPECT_EQ(end1, dominators_.GetImmediatePostDominator(if1));
+
+  EXPECT_TRUE(dominators_.PostDominates(end1, if1));
+  EXPECT_FALSE(dominators_.PostDominates(true1, if1));
+  EXPECT_FALSE(dominators_.PostDominates(false1, if1));
+}
+
+TEST_F(DominatorAnalysisTest, LoopDominators) {
+  BasicCodeBlock* test = subgraph_.AddBasicCodeBlock("test");
+  BasicCodeBlock* body = subgraph_.AddBasicCodeBlock("body");
+  BasicCodeBlock* end = subgraph_.AddBasicCodeBlock("end");
+
+  MakeIf(test, body, end);
+  Connect(body, test);
+
+  ASSERT_NO_FATAL_FAILURE(Analyze(test));
+
+  // The back edge does not make the body dominate the loop test.
+  EXPECT_EQ(NULL, dominators_.GetImmediateDominator(test));
+  EXPECT_EQ(test, dominators_.GetImmediateDominator(body));
+  EXPECT_EQ(test, dominators_.GetImmediateDominator(end));
+
+  EXPECT_TRUE(dominators_.Dominates(test, body));
+  EXPECT_TRUE(dominators_.Dominates(test, end));
+  EXPECT_FALSE(dominators_.Dominates(body, test));
+  EXPECT_FALSE(dominators_.Dominates(body, end));
+
+  // The loop exit post-dominates the whole loop, the body does not
+  // post-dominate the test.
+  EXPECT_TRUE(dominators_.PostDominates(end, test));
+  EXPECT_TRUE(dominators_.PostDominates(end, body));
+  EXPECT_FALSE(dominators_.PostDominates(body, test));
+}
+
+TEST_F(DominatorAnalysisTest, UnreachableCode) {
+  BasicCodeBlock* entry = subgraph_.AddBasicCodeBlock("entry");
+  BasicCodeBlock* next = subgraph_.AddBasicCodeBlock("next");
+  BasicCodeBlock* orphan = subgraph_.AddBasicCodeBlock("orphan");
+
+  Connect(entry, next);
+  Connect(orphan, next);
+
+  ASSERT_NO_FATAL_FAILURE(Analyze(entry));
+
+  EXPECT_TRUE(dominators_.IsReachable(entry));
+  EXPECT_TRUE(dominators_.IsReachable(next));
+  EXPECT_FALSE(dominators_.IsReachable(orphan));
+
+  // Unreachable blocks have no dominator and dominate nothing, and the
+  // unreachable edge into |next| does not perturb its dominators.
+  EXPECT_EQ(NULL, dominators_.GetImmediateDominator(orphan));
+  EXPECT_FALSE(dominators_.Dominates(orphan, next));
+  EXPECT_FALSE(dominators_.Dominates(entry, orphan));
+  EXPECT_EQ(entry, dominators_.GetImmediateDominator(next));
+}
+
+}  // namespace analysis
+}  // namespace block_graph
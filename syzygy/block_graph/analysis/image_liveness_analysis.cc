@@ -0,0 +1,323 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/analysis/image_liveness_analysis.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/memory/scoped_vector.h"
+#include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/block_graph/analysis/liveness_analysis_internal.h"
+#include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
+
+namespace block_graph {
+namespace analysis {
+
+namespace {
+
+typedef BlockGraph::Block Block;
+typedef BlockGraph::Offset Offset;
+typedef LivenessAnalysis::BlockStateMap BlockStateMap;
+typedef LivenessAnalysis::State State;
+typedef LivenessAnalysis::StateHelper StateHelper;
+typedef std::set<const Block*> BlockSet;
+typedef std::vector<const Block*> BlockVector;
+
+// Determines whether @p block may be analyzed. Only code blocks that the
+// policy allows to decompose to basic blocks are analyzed; the others keep
+// the conservative all-alive assumption.
+bool BlockCanBeAnalyzed(const Block* block,
+                        const TransformPolicyInterface* policy) {
+  DCHECK(block != NULL);
+  DCHECK(policy != NULL);
+  if (block->type() != BlockGraph::CODE_BLOCK)
+    return false;
+  // The decomposer has nothing to work with for an empty block.
+  if (block->data() == NULL || block->data_size() == 0)
+    return false;
+  return policy->BlockIsSafeToBasicBlockDecompose(block);
+}
+
+// Finds the offsets at which control may enter @p block from the outside:
+// the start of the block and the target of every inbound reference from
+// another block. Self-references (jump tables, internal branches) are
+// internal control flow, which the analysis of the block already models.
+// The basic-block decomposer starts a basic block at each inbound code
+// reference target, so these offsets always fall on basic-block boundaries.
+// @param block Block to inspect.
+// @param offsets Receives the entry offsets of @p block.
+void GetEntryOffsets(const Block* block, std::set<Offset>* offsets) {
+  DCHECK(block != NULL);
+  DCHECK(offsets != NULL);
+
+  offsets->insert(0);
+  Block::ReferrerSet::const_iterator it = block->referrers().begin();
+  for (; it != block->referrers().end(); ++it) {
+    if (it->first == block)
+      continue;
+    BlockGraph::Reference ref;
+    if (!it->first->GetReference(it->second, &ref))
+      continue;
+    DCHECK_EQ(block, ref.referenced());
+    offsets->insert(ref.base());
+  }
+}
+
+// Analyzes a slice of mutually independent blocks. Each worker has its own
+// liveness analysis and writes its results to a private state map, which
+// the driver merges once the worker has been joined.
+class AnalyzeWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param blocks The blocks of the level being analyzed, of which this
+  //     worker analyzes the range [@p begin, @p end).
+  // @param begin Index of the first block to analyze.
+  // @param end Index just past the last block to analyze.
+  // @param block_states The states computed for the previous levels. Not
+  //     owned, and not modified while the worker runs.
+  AnalyzeWorker(const BlockVector& blocks,
+                size_t begin,
+                size_t end,
+                const BlockStateMap* block_states)
+      : blocks_(blocks), begin_(begin), end_(end),
+        block_states_(block_states) {
+    DCHECK_LE(begin, end);
+    DCHECK_LE(end, blocks.size());
+    DCHECK(block_states != NULL);
+  }
+
+  virtual void Run() OVERRIDE {
+    for (size_t i = begin_; i < end_; ++i)
+      AnalyzeBlock(blocks_[i]);
+  }
+
+  // The states computed by this worker.
+  const BlockStateMap& states() const { return states_; }
+
+ private:
+  // Computes the state at entry of @p block and records it in states_.
+  void AnalyzeBlock(const Block* block);
+
+  // The blocks of the level being analyzed.
+  const BlockVector& blocks_;
+  // This worker analyzes blocks_[begin_, end_).
+  size_t begin_;
+  size_t end_;
+
+  // The states computed for the previous levels. Not owned.
+  const BlockStateMap* block_states_;
+
+  // The states computed by this worker.
+  BlockStateMap states_;
+
+  DISALLOW_COPY_AND_ASSIGN(AnalyzeWorker);
+};
+
+void AnalyzeWorker::AnalyzeBlock(const Block* block) {
+  DCHECK(block != NULL);
+
+  BasicBlockSubGraph subgraph;
+  BasicBlockDecomposer decomposer(block, &subgraph);
+  if (!decomposer.Decompose()) {
+    // Leave the block without a state; consumers fall back to the
+    // conservative all-alive assumption for it.
+    LOG(WARNING) << "Unable to decompose block \"" << block->name() << "\".";
+    return;
+  }
+
+  // Perform a global analysis of the subgraph, using the states of the
+  // already analyzed blocks as boundary conditions.
+  LivenessAnalysis liveness;
+  liveness.set_external_states(block_states_);
+  liveness.Analyze(&subgraph);
+
+  // The state of the block is the union of the states at entry of the basic
+  // blocks where control may enter the block.
+  std::set<Offset> entry_offsets;
+  GetEntryOffsets(block, &entry_offsets);
+
+  State block_state;
+  StateHelper::Clear(&block_state);
+  BasicBlockSubGraph::BBCollection::const_iterator bb =
+      subgraph.basic_blocks().begin();
+  for (; bb != subgraph.basic_blocks().end(); ++bb) {
+    const BasicCodeBlock* code = BasicCodeBlock::Cast(*bb);
+    if (code == NULL)
+      continue;
+    if (entry_offsets.find(code->offset()) == entry_offsets.end())
+      continue;
+    State state;
+    liveness.GetStateAtEntryOf(code, &state);
+    StateHelper::Union(state, &block_state);
+  }
+
+  StateHelper::Copy(block_state, &states_[block]);
+}
+
+}  // namespace
+
+ImageLivenessAnalysis::ImageLivenessAnalysis()
+    : max_workers_(base::SysInfo::NumberOfProcessors()) {
+}
+
+bool ImageLivenessAnalysis::Analyze(const BlockGraph* block_graph,
+                                    const TransformPolicyInterface* policy) {
+  DCHECK(block_graph != NULL);
+  DCHECK(policy != NULL);
+  block_states_.clear();
+
+  // Gather the blocks to analyze.
+  BlockSet candidates;
+  BlockGraph::BlockMap::const_iterator block_it =
+      block_graph->blocks().begin();
+  for (; block_it != block_graph->blocks().end(); ++block_it) {
+    const Block* block = &block_it->second;
+    if (BlockCanBeAnalyzed(block, policy))
+      candidates.insert(block);
+  }
+
+  // Build the dependencies between the candidate blocks: a block depends on
+  // every other candidate block it references, whether by a call, a jump or
+  // a data reference.
+  typedef std::map<const Block*, BlockVector> DependentsMap;
+  typedef std::map<const Block*, size_t> BlockCountMap;
+  DependentsMap dependents;
+  BlockCountMap pending;
+  BlockSet::const_iterator candidate_it = candidates.begin();
+  for (; candidate_it != candidates.end(); ++candidate_it) {
+    const Block* block = *candidate_it;
+    BlockSet dependencies;
+    Block::ReferenceMap::const_iterator ref_it = block->references().begin();
+    for (; ref_it != block->references().end(); ++ref_it) {
+      const Block* referenced = ref_it->second.referenced();
+      if (referenced == block)
+        continue;
+      if (candidates.find(referenced) != candidates.end())
+        dependencies.insert(referenced);
+    }
+    pending[block] = dependencies.size();
+    BlockSet::const_iterator dep_it = dependencies.begin();
+    for (; dep_it != dependencies.end(); ++dep_it)
+      dependents[*dep_it].push_back(block);
+  }
+
+  // Peel the dependency graph bottom-up, scheduling each block one level
+  // after the deepest of its dependencies. Blocks caught on a dependency
+  // cycle never peel; they are scheduled together on a final level and keep
+  // the conservative assumption for the other blocks of their cycle.
+  std::vector<BlockVector> levels;
+  BlockCountMap level_of;
+  std::deque<const Block*> ready;
+  size_t scheduled = 0;
+  BlockCountMap::const_iterator pending_it = pending.begin();
+  for (; pending_it != pending.end(); ++pending_it) {
+    if (pending_it->second == 0)
+      ready.push_back(pending_it->first);
+  }
+  while (!ready.empty()) {
+    const Block* block = ready.front();
+    ready.pop_front();
+    size_t level = level_of[block];
+    if (levels.size() <= level)
+      levels.resize(level + 1);
+    levels[level].push_back(block);
+    ++scheduled;
+
+    const BlockVector& users = dependents[block];
+    for (size_t i = 0; i < users.size(); ++i) {
+      const Block* user = users[i];
+      level_of[user] = std::max(level_of[user], level + 1);
+      DCHECK_LT(0u, pending[user]);
+      if (--pending[user] == 0)
+        ready.push_back(user);
+    }
+  }
+  if (scheduled < candidates.size()) {
+    levels.resize(levels.size() + 1);
+    for (candidate_it = candidates.begin(); candidate_it != candidates.end();
+         ++candidate_it) {
+      if (pending[*candidate_it] != 0)
+        levels.back().push_back(*candidate_it);
+    }
+  }
+
+  // Analyze the levels in order. The blocks of a level only depend on blocks
+  // of previous levels, so they may be analyzed concurrently.
+  for (size_t level = 0; level < levels.size(); ++level) {
+    const BlockVector& blocks = levels[level];
+    size_t num_workers = std::min(max_workers_, blocks.size());
+    DCHECK_LT(0u, num_workers);
+
+    // Split the level evenly among the workers.
+    ScopedVector<AnalyzeWorker> workers;
+    size_t begin = 0;
+    for (size_t i = 0; i < num_workers; ++i) {
+      size_t end = begin + (blocks.size() - begin) / (num_workers - i);
+      workers.push_back(
+          new AnalyzeWorker(blocks, begin, end, &block_states_));
+      begin = end;
+    }
+    DCHECK_EQ(blocks.size(), begin);
+
+    if (num_workers == 1) {
+      workers[0]->Run();
+    } else {
+      ScopedVector<base::DelegateSimpleThread> threads;
+      for (size_t i = 0; i < num_workers; ++i) {
+        std::string name = base::StringPrintf(
+            "image-liveness-%u", static_cast<unsigned>(i));
+        threads.push_back(new base::DelegateSimpleThread(workers[i], name));
+        threads.back()->Start();
+      }
+      for (size_t i = 0; i < threads.size(); ++i)
+        threads[i]->Join();
+    }
+
+    // Merge the states computed by the workers. The levels are disjoint so
+    // the insertions never collide with previous levels.
+    for (size_t i = 0; i < num_workers; ++i) {
+      block_states_.insert(workers[i]->states().begin(),
+                           workers[i]->states().end());
+    }
+  }
+
+  return true;
+}
+
+void ImageLivenessAnalysis::GetStateAtEntryOf(const BlockGraph::Block* block,
+                                              State* state) const {
+  // This function accepts a NULL block and returns a safe state with all
+  // registers alive.
+  DCHECK(state != NULL);
+
+  if (block != NULL) {
+    BlockStateMap::const_iterator look = block_states_.find(block);
+    if (look != block_states_.end()) {
+      StateHelper::Copy(look->second, state);
+      return;
+    }
+  }
+
+  StateHelper::SetAll(state);
+}
+
+}  // namespace analysis
+}  // namespace block_graph
@@ -0,0 +1,108 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A whole-image driver for the liveness analysis. For each code block of a
+// block graph it computes the registers and flags possibly live at the
+// block's entry points. The computed states may be fed back to
+// LivenessAnalysis as boundary conditions (see
+// LivenessAnalysis::set_external_states), so that a per-subgraph analysis no
+// longer needs to assume all registers alive when control leaves the
+// subgraph.
+
+#ifndef SYZYGY_BLOCK_GRAPH_ANALYSIS_IMAGE_LIVENESS_ANALYSIS_H_
+#define SYZYGY_BLOCK_GRAPH_ANALYSIS_IMAGE_LIVENESS_ANALYSIS_H_
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "syzygy/block_graph/analysis/liveness_analysis.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/transform_policy.h"
+
+namespace block_graph {
+namespace analysis {
+
+// This class computes, for every decomposable code block of a block graph,
+// the registers and flags possibly live at the entry points of the block.
+//
+// Blocks are processed bottom-up over the call graph: a block is analyzed
+// after the blocks it references, so that the states of its jump targets are
+// already available when it is analyzed. Blocks on a dependency cycle
+// (mutual recursion) are analyzed last and keep the conservative all-alive
+// assumption for the other blocks of their cycle. Blocks at the same depth
+// in the call graph are independent of each other and are analyzed
+// concurrently on a pool of worker threads.
+//
+// Example:
+//
+//  ImageLivenessAnalysis image_liveness;
+//  image_liveness.Analyze(block_graph, policy);
+//
+//  LivenessAnalysis liveness;
+//  liveness.set_external_states(&image_liveness.block_states());
+//  liveness.Analyze(subgraph);
+//  [states at subgraph exits now reflect the referenced blocks...]
+class ImageLivenessAnalysis {
+ public:
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef LivenessAnalysis::BlockStateMap BlockStateMap;
+  typedef LivenessAnalysis::State State;
+
+  ImageLivenessAnalysis();
+
+  // @name Accessors and mutators.
+  // @{
+  // The maximum number of worker threads used to analyze independent blocks.
+  // Defaults to the number of processors.
+  size_t max_workers() const { return max_workers_; }
+  void set_max_workers(size_t max_workers) {
+    DCHECK_LT(0u, max_workers);
+    max_workers_ = max_workers;
+  }
+  // @}
+
+  // Analyzes the code blocks of @p block_graph and computes their entry
+  // states. Blocks that @p policy deems unsafe to decompose to basic blocks
+  // are not analyzed, which leaves them with the conservative all-alive
+  // assumption.
+  // @param block_graph The block graph to analyze.
+  // @param policy The policy used to decide which blocks may be decomposed.
+  // @returns true on success, false otherwise.
+  bool Analyze(const BlockGraph* block_graph,
+               const TransformPolicyInterface* policy);
+
+  // The computed per-block entry states, suitable for
+  // LivenessAnalysis::set_external_states. Only valid until the next call to
+  // Analyze.
+  const BlockStateMap& block_states() const { return block_states_; }
+
+  // Get the registers alive at the entry of a block. Blocks for which no
+  // state has been computed are reported with all registers alive.
+  // @param block Block to query.
+  // @param state Receives registers alive at entry of the block.
+  void GetStateAtEntryOf(const BlockGraph::Block* block, State* state) const;
+
+ private:
+  // The maximum number of concurrent analysis workers.
+  size_t max_workers_;
+
+  // Contains the registers alive at entry of each analyzed block.
+  BlockStateMap block_states_;
+
+  DISALLOW_COPY_AND_ASSIGN(ImageLivenessAnalysis);
+};
+
+}  // namespace analysis
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_ANALYSIS_IMAGE_LIVENESS_ANALYSIS_H_
@@ -0,0 +1,148 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Unittests for the whole-image liveness analysis.
+
+#include "syzygy/block_graph/analysis/image_liveness_analysis.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/analysis/liveness_analysis_internal.h"
+#include "syzygy/block_graph/basic_block_test_util.h"
+
+namespace block_graph {
+namespace analysis {
+
+namespace {
+
+typedef ImageLivenessAnalysis::State State;
+typedef LivenessAnalysis::StateHelper StateHelper;
+
+// The registers a state may track liveness of.
+const assm::Register32* kRegisters[] = {
+    &assm::eax, &assm::ebx, &assm::ecx, &assm::edx,
+    &assm::esi, &assm::edi, &assm::esp, &assm::ebp };
+
+class ImageLivenessAnalysisTest : public testing::BasicBlockTest {
+};
+
+// Compares two states by their observable liveness information.
+bool StatesAreEqual(const State& state1, const State& state2) {
+  for (size_t i = 0; i < arraysize(kRegisters); ++i) {
+    if (state1.IsLive(*kRegisters[i]) != state2.IsLive(*kRegisters[i]))
+      return false;
+  }
+  return state1.AreArithmeticFlagsLive() == state2.AreArithmeticFlagsLive();
+}
+
+}  // namespace
+
+TEST_F(ImageLivenessAnalysisTest, UnknownBlocksAssumeAllAlive) {
+  ImageLivenessAnalysis image_liveness;
+  State state;
+  image_liveness.GetStateAtEntryOf(NULL, &state);
+  for (size_t i = 0; i < arraysize(kRegisters); ++i)
+    EXPECT_TRUE(state.IsLive(*kRegisters[i]));
+  EXPECT_TRUE(state.AreArithmeticFlagsLive());
+}
+
+TEST_F(ImageLivenessAnalysisTest, AnalyzeComputesStatesForCodeBlocks) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+
+  ImageLivenessAnalysis image_liveness;
+  ASSERT_TRUE(image_liveness.Analyze(&block_graph_, &policy_));
+
+  // The assembly function has been analyzed; func1 and func2 have no data
+  // and the data block is not code, so none of them received a state.
+  EXPECT_EQ(1u, image_liveness.block_states().size());
+  EXPECT_TRUE(image_liveness.block_states().find(assembly_func_) !=
+      image_liveness.block_states().end());
+
+  // The assembly function reads its first argument from the stack and later
+  // jumps through a jump table, so esp must be live at its entry while the
+  // arithmetic flags are defined before being used.
+  State state;
+  image_liveness.GetStateAtEntryOf(assembly_func_, &state);
+  EXPECT_TRUE(state.IsLive(assm::esp));
+  EXPECT_FALSE(state.AreArithmeticFlagsLive());
+
+  // Blocks without a computed state keep the all-alive assumption.
+  image_liveness.GetStateAtEntryOf(func1_, &state);
+  for (size_t i = 0; i < arraysize(kRegisters); ++i)
+    EXPECT_TRUE(state.IsLive(*kRegisters[i]));
+  EXPECT_TRUE(state.AreArithmeticFlagsLive());
+}
+
+TEST_F(ImageLivenessAnalysisTest, AnalyzeIsDeterministicAcrossWorkerCounts) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+
+  ImageLivenessAnalysis serial_liveness;
+  serial_liveness.set_max_workers(1);
+  ASSERT_TRUE(serial_liveness.Analyze(&block_graph_, &policy_));
+
+  ImageLivenessAnalysis parallel_liveness;
+  parallel_liveness.set_max_workers(4);
+  ASSERT_TRUE(parallel_liveness.Analyze(&block_graph_, &policy_));
+
+  EXPECT_EQ(serial_liveness.block_states().size(),
+            parallel_liveness.block_states().size());
+  State serial_state;
+  State parallel_state;
+  serial_liveness.GetStateAtEntryOf(assembly_func_, &serial_state);
+  parallel_liveness.GetStateAtEntryOf(assembly_func_, &parallel_state);
+  EXPECT_TRUE(StatesAreEqual(serial_state, parallel_state));
+}
+
+TEST_F(ImageLivenessAnalysisTest, ExternalStatesProvideBoundaryConditions) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+
+  // Build a basic block whose single successor jumps out of the subgraph,
+  // to func1.
+  BasicBlockSubGraph subgraph;
+  BasicCodeBlock* bb = subgraph.AddBasicCodeBlock("bb");
+  ASSERT_TRUE(bb != NULL);
+  bb->successors().push_back(
+      Successor(Successor::kConditionTrue,
+                BasicBlockReference(BlockGraph::RELATIVE_REF, 4, func1_, 0, 0),
+                5));
+
+  // Without external states the exit state is conservative.
+  LivenessAnalysis liveness;
+  State state;
+  liveness.GetStateAtExitOf(bb, &state);
+  EXPECT_TRUE(state.IsLive(assm::eax));
+  EXPECT_TRUE(state.IsLive(assm::esi));
+  EXPECT_TRUE(state.AreArithmeticFlagsLive());
+
+  // Provide a state for func1 in which only esi is live.
+  LivenessAnalysis::BlockStateMap external_states;
+  State& func1_state = external_states[func1_];
+  StateHelper::Clear(&func1_state);
+  StateHelper::Set(StateHelper::REGBITS_ESI, &func1_state);
+  liveness.set_external_states(&external_states);
+
+  // The exit state now reflects the boundary condition.
+  liveness.GetStateAtExitOf(bb, &state);
+  EXPECT_FALSE(state.IsLive(assm::eax));
+  EXPECT_TRUE(state.IsLive(assm::esi));
+  EXPECT_FALSE(state.AreArithmeticFlagsLive());
+
+  // Blocks absent from the map keep the conservative assumption.
+  external_states.clear();
+  liveness.GetStateAtExitOf(bb, &state);
+  EXPECT_TRUE(state.IsLive(assm::eax));
+  EXPECT_TRUE(state.AreArithmeticFlagsLive());
+}
+
+}  // namespace analysis
+}  // namespace block_graph
@@ -14,6 +14,7 @@
 
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
 
+#include <map>
 #include <set>
 #include <stack>
 #include <vector>
@@ -61,7 +62,14 @@ bool State::AreArithmeticFlagsLive() const {
   return StateHelper::AreArithmeticFlagsLive(*this);
 }
 
-LivenessAnalysis::LivenessAnalysis() : live_in_() {
+LivenessAnalysis::StateTransfer::StateTransfer()
+    : registers_kept_(StateHelper::REGBITS_ALL),
+      flags_kept_(StateHelper::REGBITS_ALL),
+      registers_used_(0),
+      flags_used_(0) {
+}
+
+LivenessAnalysis::LivenessAnalysis() : live_in_(), external_states_(NULL) {
 }
 
 void LivenessAnalysis::GetStateAtEntryOf(const BasicBlock* bb,
@@ -104,15 +112,30 @@ void LivenessAnalysis::GetStateAtExitOf(const BasicBlock* bb,
   for (Successors::const_iterator succ = successors.begin();
        succ != succ_end; ++succ) {
     BasicBlock* successor_basic_block = succ->reference().basic_block();
-    if (successor_basic_block == NULL) {
-      // Successor is not a BasicBlock. Assume all registers are alive.
-      StateHelper::SetAll(state);
-      return;
+    State successor_state;
+    if (successor_basic_block != NULL) {
+      GetStateAtEntryOf(successor_basic_block, &successor_state);
+    } else {
+      // Successor is not a BasicBlock; control leaves the subgraph. Use the
+      // whole-image boundary condition for the referenced block when one is
+      // available, otherwise assume all registers are alive.
+      bool has_external_state = false;
+      const BlockGraph::Block* successor_block = succ->reference().block();
+      if (external_states_ != NULL && successor_block != NULL) {
+        BlockStateMap::const_iterator look =
+            external_states_->find(successor_block);
+        if (look != external_states_->end()) {
+          StateHelper::Copy(look->second, &successor_state);
+          has_external_state = true;
+        }
+      }
+      if (!has_external_state) {
+        StateHelper::SetAll(state);
+        return;
+      }
     }
 
     // Merge successor state into current state.
-    State successor_state;
-    GetStateAtEntryOf(successor_basic_block, &successor_state);
     StateHelper::Union(successor_state, state);
 
     // Merge liveness information from the implicit instruction in successor.
@@ -167,10 +190,16 @@ void LivenessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
   std::vector<const BasicCodeBlock*> order;
   ControlFlowAnalysis::FlattenBasicBlocksInPostOrder(basic_blocks, &order);
 
-  // Initialize liveness information of each basic block (empty set).
+  // Initialize liveness information of each basic block (empty set) and
+  // precompute its transfer function, so the fix-point below only performs
+  // bitset operations.
+  transfers_.clear();
   BasicBlockOrdering::const_iterator fw_iter = order.begin();
-  for (; fw_iter != order.end(); ++fw_iter)
+  for (; fw_iter != order.end(); ++fw_iter) {
     StateHelper::Clear(&live_in_[*fw_iter]);
+    StateHelper::GetTransferOf((*fw_iter)->instructions(),
+                               &transfers_[*fw_iter]);
+  }
 
   // Propagate liveness information until stable (fix-point). Each set may only
   // grow, thus we have a halting condition.
@@ -186,11 +215,108 @@ void LivenessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
       State state;
       GetStateAtExitOf(bb, &state);
 
-      // Propagate liveness information backward until the basic block entry.
-      const Instructions& instructions = bb->instructions();
-      Instructions::const_reverse_iterator instr_iter = instructions.rbegin();
-      for (; instr_iter != instructions.rend(); ++instr_iter)
-        PropagateBackward(*instr_iter, &state);
+      // Propagate liveness information backward until the basic block entry,
+      // through the precomputed transfer function.
+      StateHelper::Apply(transfers_[bb], &state);
+
+      // Commit liveness information to the global state.
+      if (StateHelper::Union(state, &live_in_[bb]))
+        changed = true;
+    }
+  }
+}
+
+void LivenessAnalysis::AnalyzeModified(const BasicBlockSubGraph* subgraph,
+                                       const BasicBlockSet& modified) {
+  DCHECK(subgraph != NULL);
+
+  // Without previous results to reuse this degenerates to a full analysis.
+  if (live_in_.empty()) {
+    Analyze(subgraph);
+    return;
+  }
+
+  if (modified.empty())
+    return;
+
+  // Build the predecessor relation of the subgraph. Liveness is a backward
+  // analysis, thus the information of a basic block feeds into the
+  // information of its predecessors.
+  typedef std::map<const BasicBlock*, std::vector<const BasicCodeBlock*> >
+      PredecessorMap;
+  PredecessorMap predecessors;
+  const BBCollection& basic_blocks = subgraph->basic_blocks();
+  BBCollection::const_iterator bb_iter = basic_blocks.begin();
+  for (; bb_iter != basic_blocks.end(); ++bb_iter) {
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
+    if (bb == NULL)
+      continue;
+    const Successors& successors = bb->successors();
+    Successors::const_iterator succ = successors.begin();
+    for (; succ != successors.end(); ++succ) {
+      const BasicBlock* successor_basic_block = succ->reference().basic_block();
+      if (successor_basic_block != NULL)
+        predecessors[successor_basic_block].push_back(bb);
+    }
+  }
+
+  // Collect the affected region: the modified basic blocks and all their
+  // transitive predecessors, whose liveness information may depend on them.
+  BasicBlockSet affected;
+  std::stack<const BasicBlock*> worklist;
+  BasicBlockSet::const_iterator mod_iter = modified.begin();
+  for (; mod_iter != modified.end(); ++mod_iter)
+    worklist.push(*mod_iter);
+  while (!worklist.empty()) {
+    const BasicBlock* bb = worklist.top();
+    worklist.pop();
+    if (!affected.insert(bb).second)
+      continue;
+    PredecessorMap::const_iterator preds = predecessors.find(bb);
+    if (preds == predecessors.end())
+      continue;
+    for (size_t i = 0; i < preds->second.size(); ++i)
+      worklist.push(preds->second[i]);
+  }
+
+  // Reset the liveness information of the affected region. The basic blocks
+  // outside of the region keep their previous results, which the fix-point
+  // below reads back at the region frontier. Recompute the transfer
+  // functions of the modified basic blocks and of the basic blocks
+  // introduced since the previous analysis; the others still summarize the
+  // instructions they were computed from.
+  BasicBlockSet::const_iterator affected_iter = affected.begin();
+  for (; affected_iter != affected.end(); ++affected_iter) {
+    StateHelper::Clear(&live_in_[*affected_iter]);
+
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*affected_iter);
+    if (bb == NULL)
+      continue;
+    if (modified.count(*affected_iter) != 0 ||
+        transfers_.find(bb) == transfers_.end()) {
+      StateHelper::GetTransferOf(bb->instructions(), &transfers_[bb]);
+    }
+  }
+
+  // Propagate liveness information over the affected region until stable,
+  // as in Analyze. Each set may only grow, thus we have a halting condition.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    affected_iter = affected.begin();
+    for (; affected_iter != affected.end(); ++affected_iter) {
+      const BasicCodeBlock* bb = BasicCodeBlock::Cast(*affected_iter);
+      if (bb == NULL)
+        continue;
+
+      // Merge current liveness information with every successor information.
+      State state;
+      GetStateAtExitOf(bb, &state);
+
+      // Propagate liveness information backward until the basic block entry,
+      // through the precomputed transfer function.
+      StateHelper::Apply(transfers_[bb], &state);
 
       // Commit liveness information to the global state.
       if (StateHelper::Union(state, &live_in_[bb]))
@@ -744,5 +870,71 @@ bool LivenessAnalysis::StateHelper::GetUsesOf(
   NOTREACHED();
 }
 
+void LivenessAnalysis::StateHelper::Compose(
+    const Instruction& instr, StateTransfer* transfer) {
+  DCHECK(transfer != NULL);
+
+  // Skip 'nop' instructions, as PropagateBackward does.
+  if (instr.IsNop())
+    return;
+
+  // Build the transfer function of this instruction alone, mirroring
+  // PropagateBackward: the instruction keeps alive what it does not define,
+  // and adds what it uses.
+  RegisterMask registers_kept = REGBITS_ALL;
+  FlagsMask flags_kept = REGBITS_ALL;
+  RegisterMask registers_used = 0;
+  FlagsMask flags_used = 0;
+
+  State defs;
+  if (GetDefsOf(instr, &defs)) {
+    registers_kept = ~defs.registers_;
+    flags_kept = ~defs.flags_;
+  }
+
+  State uses;
+  if (instr.IsCall() || instr.IsReturn() ||
+      instr.IsBranch() || instr.IsInterrupt() || instr.IsControlFlow() ||
+      !GetUsesOf(instr, &uses)) {
+    // The instruction conservatively makes every register and flag alive.
+    registers_kept = 0;
+    flags_kept = 0;
+    registers_used = REGBITS_ALL;
+    flags_used = REGBITS_ALL;
+  } else {
+    registers_used = uses.registers_;
+    flags_used = uses.flags_;
+  }
+
+  // Compose with the transfer accumulated so far. Backward propagation
+  // applies |transfer| first and this instruction second, thus the result
+  // keeps what both keep, and uses what this instruction uses plus what
+  // |transfer| uses and this instruction does not define.
+  transfer->registers_used_ =
+      (transfer->registers_used_ & registers_kept) | registers_used;
+  transfer->flags_used_ = (transfer->flags_used_ & flags_kept) | flags_used;
+  transfer->registers_kept_ &= registers_kept;
+  transfer->flags_kept_ &= flags_kept;
+}
+
+void LivenessAnalysis::StateHelper::GetTransferOf(
+    const BasicBlock::Instructions& instructions, StateTransfer* transfer) {
+  DCHECK(transfer != NULL);
+
+  *transfer = StateTransfer();
+  Instructions::const_reverse_iterator instr_iter = instructions.rbegin();
+  for (; instr_iter != instructions.rend(); ++instr_iter)
+    Compose(*instr_iter, transfer);
+}
+
+void LivenessAnalysis::StateHelper::Apply(
+    const StateTransfer& transfer, State* state) {
+  DCHECK(state != NULL);
+  state->registers_ = (state->registers_ & transfer.registers_kept_) |
+      transfer.registers_used_;
+  state->flags_ = (state->flags_ & transfer.flags_kept_) |
+      transfer.flags_used_;
+}
+
 }  // namespace analysis
 }  // namespace block_graph
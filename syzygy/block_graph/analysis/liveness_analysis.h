@@ -28,6 +28,7 @@
 #define SYZYGY_BLOCK_GRAPH_ANALYSIS_LIVENESS_ANALYSIS_H_
 
 #include <map>
+#include <set>
 
 #include "base/basictypes.h"
 #include "syzygy/block_graph/basic_block.h"
@@ -92,7 +93,9 @@ namespace analysis {
 //
 // The global liveness analysis needs a pre-computation pass before any use.
 // The analysis internally keeps track of all alive registers at the beginning
-// of each basic block.
+// of each basic block. The pre-computation pass summarizes each basic block
+// into a transfer function (see StateTransfer) so that the fix-point
+// iteration performs only bitset operations and never revisits instructions.
 //
 // Local modifications inside a basic block do not invalidate the global
 // analysis except if a new live range escapes the scope of the basic block. In
@@ -114,13 +117,51 @@ namespace analysis {
 //    liveness.PropagateBackward(&instr, &state);
 //    [do something with liveness information in state...]
 //  }
+//
+// Incremental update
+// ------------------
+//
+// A transform that repeatedly mutates and re-analyzes the same subgraph may
+// avoid full re-computations by reporting the basic blocks it modified.
+// Only those blocks and the blocks whose liveness information depends on
+// them (their transitive predecessors) are then re-solved; the rest of the
+// subgraph keeps its previous results.
+//
+// Example:
+//
+//  LivenessAnalysis liveness;
+//  LivenessAnalysis::BasicBlockSet modified;
+//
+//  liveness.Analyze(subgraph);
+//  [mutate some basic blocks, inserting them into modified...]
+//  liveness.AnalyzeModified(subgraph, modified);
+//
+// Whole-image boundary conditions
+// -------------------------------
+//
+// When a successor leaves the subgraph the analysis normally assumes all
+// registers alive at the transfer. A whole-image analysis (see
+// ImageLivenessAnalysis) may provide the registers actually live at the
+// entry of each block of the image; these states are then used as boundary
+// conditions for the successors that reference those blocks.
+//
+// Example:
+//
+//  LivenessAnalysis liveness;
+//  liveness.set_external_states(&image_liveness.block_states());
+//  liveness.Analyze(subgraph);
 
 class LivenessAnalysis {
  public:
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef std::set<const BasicBlock*> BasicBlockSet;
 
   class State;
   class StateHelper;
+  class StateTransfer;
+
+  // Maps a block to the registers and flags possibly live at its entry.
+  typedef std::map<const BlockGraph::Block*, State> BlockStateMap;
 
   LivenessAnalysis();
 
@@ -148,11 +189,41 @@ class LivenessAnalysis {
   // @param subgraph Subgraph to apply the analysis.
   void Analyze(const BasicBlockSubGraph* subgraph);
 
+  // Incrementally update a previous global analysis after some basic blocks
+  // have been mutated. Only the modified blocks and their transitive
+  // predecessors are re-solved; the results for the other basic blocks are
+  // reused as-is. Performs a full analysis when none has been done yet.
+  // @param subgraph Subgraph to apply the analysis.
+  // @param modified The basic blocks mutated since the previous analysis.
+  void AnalyzeModified(const BasicBlockSubGraph* subgraph,
+                       const BasicBlockSet& modified);
+
+  // @name Whole-image boundary conditions.
+  // @{
+  // When set, a successor leaving the subgraph uses the state recorded for
+  // the referenced block instead of assuming all registers alive. Blocks
+  // absent from the map keep the conservative assumption. The map is not
+  // owned and must outlive this analysis; NULL (the default) disables the
+  // feature.
+  const BlockStateMap* external_states() const { return external_states_; }
+  void set_external_states(const BlockStateMap* external_states) {
+    external_states_ = external_states;
+  }
+  // @}
+
  private:
   // Contains the registers alive at entry of each basic block.
   typedef std::map<const BasicBlock*, State> LiveMap;
   LiveMap live_in_;
 
+  // Contains the precomputed transfer function of each basic block.
+  typedef std::map<const BasicBlock*, StateTransfer> TransferMap;
+  TransferMap transfers_;
+
+  // Contains the registers alive at entry of each block of the image, as
+  // computed by a whole-image analysis. Not owned, may be NULL.
+  const BlockStateMap* external_states_;
+
   DISALLOW_COPY_AND_ASSIGN(LivenessAnalysis);
 };
 
@@ -187,6 +258,31 @@ class LivenessAnalysis::State {
   FlagsMask flags_;
 };
 
+// This class summarizes the effect a straight-line sequence of instructions
+// has on a liveness state during backward propagation. A transfer is
+// precomputed from the per-instruction defs and uses masks, and applying it
+// is a single mask-and-merge on each bitset, regardless of the number of
+// instructions summarized. The global analysis precomputes one transfer per
+// basic block so its fix-point iteration performs only word-wide bitset
+// operations.
+class LivenessAnalysis::StateTransfer {
+ public:
+  // On creation, a transfer is the identity function.
+  StateTransfer();
+
+ private:
+  friend class LivenessAnalysis::StateHelper;
+
+  // Registers and flags whose liveness survives the summarized instructions
+  // (the complement of the registers and flags they define).
+  State::RegisterMask registers_kept_;
+  State::FlagsMask flags_kept_;
+
+  // Registers and flags the summarized instructions use.
+  State::RegisterMask registers_used_;
+  State::FlagsMask flags_used_;
+};
+
 }  // namespace analysis
 }  // namespace block_graph
 
@@ -176,6 +176,27 @@ class LivenessAnalysis::StateHelper {
   // @param state On success, receives registers used by the instruction.
   // @returns true if we are able to analyze this successor, false otherwise.
   static bool GetUsesOf(const Successor& successor, State* state);
+
+  // Compose the transfer function of @p instr with @p transfer. The
+  // resulting transfer has the same effect as applying @p transfer and then
+  // propagating backward through @p instr. An instruction the analysis
+  // cannot handle composes as the constant all-alive function.
+  // @param instr Instruction to compose.
+  // @param transfer Transfer to apply modifications.
+  static void Compose(const Instruction& instr, StateTransfer* transfer);
+
+  // Get the transfer function summarizing the backward propagation through
+  // @p instructions.
+  // @param instructions Instructions to summarize.
+  // @param transfer Receives the resulting transfer.
+  static void GetTransferOf(const BasicBlock::Instructions& instructions,
+                            StateTransfer* transfer);
+
+  // Apply the transfer function @p transfer to @p state, yielding the same
+  // state as propagating backward through the summarized instructions.
+  // @param transfer Transfer to apply.
+  // @param state State to apply modifications.
+  static void Apply(const StateTransfer& transfer, State* state);
 };
 
 }  // namespace analysis
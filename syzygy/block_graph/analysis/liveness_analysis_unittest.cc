@@ -32,6 +32,7 @@ namespace {
 typedef BasicBlockSubGraph::BBCollection BBCollection;
 typedef block_graph::analysis::LivenessAnalysis::State State;
 typedef block_graph::analysis::LivenessAnalysis::StateHelper StateHelper;
+typedef block_graph::analysis::LivenessAnalysis::StateTransfer StateTransfer;
 typedef block_graph::BasicBlockSubGraph::BasicBlock BasicBlock;
 typedef block_graph::BasicBlockSubGraph::BasicBlock::Instructions Instructions;
 typedef block_graph::BasicBlockSubGraph::BasicBlock::Successors Successors;
@@ -1591,6 +1592,80 @@ TEST_F(LivenessAnalysisTest, NopInstructionSpecialCase) {
   EXPECT_FALSE(is_live(assm::eax));
 }
 
+TEST_F(LivenessAnalysisTest, StateTransferIsIdentityByDefault) {
+  StateHelper::Clear(&state_);
+  StateHelper::Set(StateHelper::REGBITS_ECX, &state_);
+  StateHelper::SetFlags(D_CF, &state_);
+
+  StateTransfer transfer;
+  StateHelper::Apply(transfer, &state_);
+  EXPECT_TRUE(is_live(assm::ecx));
+  EXPECT_FALSE(is_live(assm::eax));
+  EXPECT_TRUE(are_arithmetic_flags_live());
+}
+
+TEST_F(LivenessAnalysisTest, StateTransferMatchesPropagateBackward) {
+  // _asm mov esi, edi
+  static const uint8 kMovEsiEdi[] = { 0x8B, 0xF7 };
+  AddInstructionFromBuffer(kMovEsiEdi);
+  AddInstructionFromBuffer(kCmpEaxEbx);
+  AddInstructionFromBuffer(kMovEcxZero);
+
+  StateTransfer transfer;
+  StateHelper::GetTransferOf(instructions_, &transfer);
+
+  // Propagate backward through the instructions from an all-alive state.
+  AnalyzeInstructions();
+  EXPECT_TRUE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+  EXPECT_TRUE(is_live(assm::edx));
+  EXPECT_TRUE(is_live(assm::edi));
+  EXPECT_FALSE(is_live(assm::ecx));
+  EXPECT_FALSE(is_live(assm::esi));
+  EXPECT_FALSE(are_arithmetic_flags_live());
+
+  // Applying the precomputed transfer to the same initial state must yield
+  // the same result.
+  StateHelper::SetAll(&state_);
+  StateHelper::Apply(transfer, &state_);
+  EXPECT_TRUE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+  EXPECT_TRUE(is_live(assm::edx));
+  EXPECT_TRUE(is_live(assm::edi));
+  EXPECT_FALSE(is_live(assm::ecx));
+  EXPECT_FALSE(is_live(assm::esi));
+  EXPECT_FALSE(are_arithmetic_flags_live());
+
+  // From an empty state only the used registers become live.
+  StateHelper::Clear(&state_);
+  StateHelper::Apply(transfer, &state_);
+  EXPECT_TRUE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+  EXPECT_FALSE(is_live(assm::edx));
+  EXPECT_TRUE(is_live(assm::edi));
+  EXPECT_FALSE(is_live(assm::ecx));
+  EXPECT_FALSE(is_live(assm::esi));
+  EXPECT_FALSE(are_arithmetic_flags_live());
+}
+
+TEST_F(LivenessAnalysisTest, StateTransferOverUnanalyzableInstruction) {
+  // A 'ret' conservatively makes every register and flag alive; the
+  // instructions before it still take effect during backward propagation.
+  static const uint8 kRet[] = { 0xC3 };
+  AddInstructionFromBuffer(kMovEcxZero);
+  AddInstructionFromBuffer(kRet);
+
+  StateTransfer transfer;
+  StateHelper::GetTransferOf(instructions_, &transfer);
+
+  StateHelper::Clear(&state_);
+  StateHelper::Apply(transfer, &state_);
+  EXPECT_TRUE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::esp));
+  EXPECT_FALSE(is_live(assm::ecx));
+  EXPECT_TRUE(are_arithmetic_flags_live());
+}
+
 TEST_F(LivenessAnalysisTest, GetStateAtEntryOfWithNull) {
   // It is valid to pass a NULL pointer to get a state.
   liveness_.GetStateAtEntryOf(NULL, &state_);
@@ -1749,6 +1824,155 @@ TEST_F(LivenessAnalysisTest, LivenessAnalysisOverControlFlow) {
   EXPECT_FALSE(is_live(assm::ebp));
 }
 
+TEST_F(LivenessAnalysisTest, AnalyzeModifiedOverControlFlow) {
+  BasicBlockSubGraph subgraph;
+
+  // Build and analyze the same flow graph as in
+  // LivenessAnalysisOverControlFlow, then mutate [true1] and incrementally
+  // update the analysis. Only [true1] and its transitive predecessor [if1]
+  // are affected; the results of the other basic blocks must be reused.
+
+  // Create the control flow graph.
+  BasicCodeBlock* if1 = subgraph.AddBasicCodeBlock("if1");
+  BasicCodeBlock* true1 = subgraph.AddBasicCodeBlock("true1");
+  BasicCodeBlock* false1 = subgraph.AddBasicCodeBlock("false1");
+  BasicCodeBlock* if2 = subgraph.AddBasicCodeBlock("if2");
+  BasicCodeBlock* true2 = subgraph.AddBasicCodeBlock("true2");
+  BasicCodeBlock* false2 = subgraph.AddBasicCodeBlock("false2");
+  BasicCodeBlock* end2 = subgraph.AddBasicCodeBlock("end2");
+
+  ASSERT_TRUE(if1 != NULL);
+  ASSERT_TRUE(true1 != NULL);
+  ASSERT_TRUE(false1 != NULL);
+  ASSERT_TRUE(if2 != NULL);
+  ASSERT_TRUE(true2 != NULL);
+  ASSERT_TRUE(false2 != NULL);
+  ASSERT_TRUE(end2 != NULL);
+
+  AddSuccessorBetween(Successor::kConditionEqual, if1, true1);
+  AddSuccessorBetween(Successor::kConditionNotEqual, if1, false1);
+  AddSuccessorBetween(Successor::kConditionTrue, true1, if2);
+  AddSuccessorBetween(Successor::kConditionTrue, false1, if2);
+
+  AddSuccessorBetween(Successor::kConditionOverflow, if2, true2);
+  AddSuccessorBetween(Successor::kConditionNotOverflow, if2, false2);
+  AddSuccessorBetween(Successor::kConditionLess, true2, end2);
+  AddSuccessorBetween(Successor::kConditionLess, false2, end2);
+
+  AddSuccessorBetween(Successor::kConditionTrue, end2, if2);
+
+  // Insert instructions into basic blocks.
+  BasicBlockAssembler asm_end2(end2->instructions().end(),
+                               &end2->instructions());
+  asm_end2.mov(assm::ecx, assm::eax);
+
+  BasicBlockAssembler asm_true2(true2->instructions().end(),
+                                &true2->instructions());
+  asm_true2.mov(assm::eax, assm::ebx);
+
+  BasicBlockAssembler asm_false2(false2->instructions().end(),
+                                 &false2->instructions());
+  asm_false2.mov(assm::ebp, assm::esi);
+  asm_false2.mov(assm::esi, assm::edi);
+  asm_false2.mov(assm::edi, assm::ebp);
+  asm_false2.mov(assm::eax, Operand(assm::esi));
+
+  BasicBlockAssembler asm_true1(true1->instructions().end(),
+                                &true1->instructions());
+  asm_true1.mov(assm::esi, Immediate(1));
+
+  BasicBlockAssembler asm_false1(false1->instructions().end(),
+                                 &false1->instructions());
+  asm_false1.mov(assm::esi, Immediate(2));
+  asm_false1.mov(assm::edi, Immediate(2));
+
+  // Perform the initial global liveness analysis.
+  liveness_.Analyze(&subgraph);
+
+  liveness_.GetStateAtEntryOf(true1, &state_);
+  EXPECT_FALSE(is_live(assm::ecx));
+
+  liveness_.GetStateAtEntryOf(if1, &state_);
+  EXPECT_FALSE(is_live(assm::ecx));
+
+  // Mutate [true1] so that it now uses register ecx, and incrementally
+  // update the analysis.
+  true1->instructions().clear();
+  BasicBlockAssembler asm_true1b(true1->instructions().end(),
+                                 &true1->instructions());
+  asm_true1b.mov(assm::esi, assm::ecx);
+
+  LivenessAnalysis::BasicBlockSet modified;
+  modified.insert(true1);
+  liveness_.AnalyzeModified(&subgraph, modified);
+
+  // The new use of ecx must have been propagated to [true1] and [if1].
+  liveness_.GetStateAtEntryOf(true1, &state_);
+  EXPECT_FALSE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+  EXPECT_TRUE(is_live(assm::ecx));
+  EXPECT_FALSE(is_live(assm::esi));
+  EXPECT_TRUE(is_live(assm::edi));
+  EXPECT_FALSE(is_live(assm::ebp));
+
+  liveness_.GetStateAtEntryOf(if1, &state_);
+  EXPECT_FALSE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+  EXPECT_TRUE(is_live(assm::ecx));
+  EXPECT_FALSE(is_live(assm::esi));
+  EXPECT_TRUE(is_live(assm::edi));
+  EXPECT_FALSE(is_live(assm::ebp));
+
+  // The basic blocks outside of the affected region are unchanged.
+  liveness_.GetStateAtEntryOf(false1, &state_);
+  EXPECT_FALSE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+  EXPECT_FALSE(is_live(assm::ecx));
+  EXPECT_FALSE(is_live(assm::esi));
+  EXPECT_FALSE(is_live(assm::edi));
+  EXPECT_FALSE(is_live(assm::ebp));
+
+  liveness_.GetStateAtEntryOf(if2, &state_);
+  EXPECT_FALSE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+  EXPECT_FALSE(is_live(assm::ecx));
+  EXPECT_TRUE(is_live(assm::esi));
+  EXPECT_TRUE(is_live(assm::edi));
+  EXPECT_FALSE(is_live(assm::ebp));
+
+  liveness_.GetStateAtEntryOf(end2, &state_);
+  EXPECT_TRUE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+  EXPECT_FALSE(is_live(assm::ecx));
+  EXPECT_TRUE(is_live(assm::esi));
+  EXPECT_TRUE(is_live(assm::edi));
+  EXPECT_FALSE(is_live(assm::ebp));
+}
+
+TEST_F(LivenessAnalysisTest, AnalyzeModifiedWithoutPreviousAnalysis) {
+  BasicBlockSubGraph subgraph;
+
+  BasicCodeBlock* bb1 = subgraph.AddBasicCodeBlock("bb1");
+  BasicCodeBlock* bb2 = subgraph.AddBasicCodeBlock("bb2");
+  ASSERT_TRUE(bb1 != NULL);
+  ASSERT_TRUE(bb2 != NULL);
+
+  AddSuccessorBetween(Successor::kConditionTrue, bb1, bb2);
+  AddSuccessorBetween(Successor::kConditionTrue, bb2, bb1);
+
+  BasicBlockAssembler asm_bb1(bb1->instructions().end(),
+                              &bb1->instructions());
+  asm_bb1.mov(assm::eax, assm::ebx);
+
+  // Without a previous analysis this is equivalent to a full analysis.
+  LivenessAnalysis::BasicBlockSet modified;
+  liveness_.AnalyzeModified(&subgraph, modified);
+
+  liveness_.GetStateAtEntryOf(bb1, &state_);
+  EXPECT_FALSE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+}
+
 TEST_F(LivenessAnalysisTest, AnalyzeWithData) {
   BasicBlockSubGraph subgraph;
   const uint8 raw_data[] = { 0, 1, 2, 3, 4 };
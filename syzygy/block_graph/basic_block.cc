@@ -846,4 +846,88 @@ bool BasicEndBlock::IsValid() const {
   return true;
 }
 
+CompactInstructions::CompactInstructions() {
+}
+
+CompactInstructions::~CompactInstructions() {
+}
+
+void CompactInstructions::Pack(const std::list<Instruction>& instructions) {
+  instructions_.clear();
+  bytes_.clear();
+  side_data_.clear();
+
+  instructions_.reserve(instructions.size());
+  std::list<Instruction>::const_iterator it = instructions.begin();
+  for (; it != instructions.end(); ++it) {
+    const Instruction& inst = *it;
+
+    PackedInstruction packed = {};
+    packed.data_offset = static_cast<uint32>(bytes_.size());
+    packed.offset = inst.offset();
+    packed.opcode = inst.opcode();
+    packed.size = static_cast<uint8>(inst.size());
+    bytes_.insert(bytes_.end(), inst.data(), inst.data() + inst.size());
+
+    if (!inst.references().empty() || inst.has_label() ||
+        inst.source_range().size() != 0 || !inst.tags().empty()) {
+      SideData& side = side_data_[instructions_.size()];
+      side.references = inst.references();
+      side.label = inst.label();
+      side.source_range = inst.source_range();
+      side.tags = inst.tags();
+    }
+
+    instructions_.push_back(packed);
+  }
+}
+
+bool CompactInstructions::GetInstruction(size_t index,
+                                         Instruction* instruction) const {
+  DCHECK_LT(index, instructions_.size());
+  DCHECK(instruction != NULL);
+
+  const PackedInstruction& packed = instructions_[index];
+  if (!Instruction::FromBuffer(&bytes_[packed.data_offset], packed.size,
+                               instruction)) {
+    return false;
+  }
+  DCHECK_EQ(packed.opcode, instruction->opcode());
+  DCHECK_EQ(static_cast<Size>(packed.size), instruction->size());
+  instruction->set_offset(packed.offset);
+
+  SideDataMap::const_iterator side = side_data_.find(index);
+  if (side != side_data_.end()) {
+    instruction->set_label(side->second.label);
+    instruction->set_source_range(side->second.source_range);
+    instruction->tags() = side->second.tags;
+
+    // Restore the references through SetReference so that the referred
+    // basic blocks' referrer sets are kept up to date.
+    Instruction::BasicBlockReferenceMap::const_iterator ref =
+        side->second.references.begin();
+    for (; ref != side->second.references.end(); ++ref) {
+      if (!instruction->SetReference(ref->first, ref->second))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+bool CompactInstructions::Unpack(
+    std::list<Instruction>* instructions) const {
+  DCHECK(instructions != NULL);
+
+  for (size_t i = 0; i < instructions_.size(); ++i) {
+    // GetInstruction is applied to the already appended instruction, as the
+    // Instruction copy constructor does not preserve the offset.
+    instructions->push_back(Instruction());
+    if (!GetInstruction(i, &instructions->back()))
+      return false;
+  }
+
+  return true;
+}
+
 }  // namespace block_graph
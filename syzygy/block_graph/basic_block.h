@@ -254,6 +254,15 @@ class Instruction {
   // Copy constructor.
   Instruction(const Instruction& other);
 
+  // Constructs an instruction from its parsed representation and underlying
+  // memory buffer. This is useful for code paths that have already decoded
+  // the instruction, as it avoids the redundant decode that going through
+  // FromBuffer would incur.
+  // @param repr the parsed representation of the instruction.
+  // @param data the data comprising the instruction. This must be at least
+  //     @p repr.size bytes in length.
+  Instruction(const _DInst& repr, const uint8* data);
+
   // Factory to construct an initialized Instruction instance from a buffer.
   // @param buf the data comprising the instruction.
   // @param len the maximum length (in bytes) of @p buf to consume
@@ -350,10 +359,6 @@ class Instruction {
   const TagSet& tags() const { return tags_; }
 
  protected:
-  // Construct an instruction from its parsed representation and underlying
-  // memory buffer.
-  Instruction(const _DInst& repr, const uint8* data);
-
   // The internal representation of this instruction.
   Representation representation_;
 
@@ -815,6 +820,104 @@ class BasicEndBlock : public BasicBlock {
   DISALLOW_COPY_AND_ASSIGN(BasicEndBlock);
 };
 
+// A compact, read-only representation of a sequence of instructions. The
+// instruction bytes are stored contiguously in a single buffer and each
+// instruction is described by a small packed record; the rarely populated
+// fields (references, label, source range and tags) are kept in a side
+// table keyed by instruction index. For a typical instruction this is an
+// order of magnitude smaller than a full Instruction, and iterating the
+// sequence is cache friendly. This is intended for analysis-only passes
+// over large functions; an instruction is converted back to its full form
+// on demand when it is to be mutated.
+class CompactInstructions {
+ public:
+  typedef BlockGraph::Offset Offset;
+  typedef BlockGraph::Size Size;
+
+  CompactInstructions();
+  ~CompactInstructions();
+
+  // Packs @p instructions into this object, replacing any previous
+  // contents.
+  // @param instructions the instructions to pack.
+  void Pack(const std::list<Instruction>& instructions);
+
+  // Reconstitutes the instruction at @p index in its full form, re-decoding
+  // it from the packed bytes and restoring any side-table fields. Any
+  // references are restored via Instruction::SetReference, so the referred
+  // basic blocks' referrer sets are kept up to date.
+  // @param index the index of the instruction. Must be less than size().
+  // @param instruction receives the instruction.
+  // @returns true on success, false if the packed bytes fail to decode.
+  bool GetInstruction(size_t index, Instruction* instruction) const;
+
+  // Reconstitutes the entire sequence, appending to @p instructions.
+  // @param instructions receives the instructions.
+  // @returns true on success, false if any instruction fails to decode. On
+  //     failure @p instructions may have been partially appended to.
+  bool Unpack(std::list<Instruction>* instructions) const;
+
+  // @returns the number of packed instructions.
+  size_t size() const { return instructions_.size(); }
+
+  // @name Cheap per-instruction accessors. These do not require a decode.
+  // @{
+  uint16 opcode(size_t index) const {
+    DCHECK_LT(index, instructions_.size());
+    return instructions_[index].opcode;
+  }
+  Size instruction_size(size_t index) const {
+    DCHECK_LT(index, instructions_.size());
+    return instructions_[index].size;
+  }
+  const uint8* instruction_data(size_t index) const {
+    DCHECK_LT(index, instructions_.size());
+    return &bytes_[instructions_[index].data_offset];
+  }
+  Offset instruction_offset(size_t index) const {
+    DCHECK_LT(index, instructions_.size());
+    return instructions_[index].offset;
+  }
+  bool has_side_data(size_t index) const {
+    DCHECK_LT(index, instructions_.size());
+    return side_data_.find(index) != side_data_.end();
+  }
+  // @}
+
+ private:
+  // The packed per-instruction record: where the instruction's bytes live
+  // in bytes_, its (deprecated) source offset, its opcode and its length.
+  // This weighs in at a dozen bytes versus the several hundred bytes of a
+  // full Instruction.
+  struct PackedInstruction {
+    uint32 data_offset;
+    Offset offset;
+    uint16 opcode;
+    uint8 size;
+  };
+
+  // The rarely populated per-instruction fields, stored out of line.
+  struct SideData {
+    Instruction::BasicBlockReferenceMap references;
+    BlockGraph::Label label;
+    Instruction::SourceRange source_range;
+    TagSet tags;
+  };
+  typedef std::map<size_t, SideData> SideDataMap;
+
+  // The packed instruction records, in program order.
+  std::vector<PackedInstruction> instructions_;
+
+  // The instruction bytes, stored contiguously.
+  std::vector<uint8> bytes_;
+
+  // Side data for the (typically few) instructions that carry any, keyed
+  // by instruction index.
+  SideDataMap side_data_;
+
+  DISALLOW_COPY_AND_ASSIGN(CompactInstructions);
+};
+
 // Less-than comparator. Useful to keep ordered set stable.
 struct BasicBlockIdLess {
   bool operator()(const BasicBlock* lhs,
@@ -127,9 +127,24 @@ bool SplitInstructionListAt(Offset offset,
 
 }  // namespace
 
+const InstructionDecodeCache::Entry* InstructionDecodeCache::Find(
+    const BlockHash& block_hash) const {
+  EntryMap::const_iterator it = entries_.find(block_hash);
+  if (it == entries_.end())
+    return NULL;
+  return &it->second;
+}
+
+void InstructionDecodeCache::Insert(const BlockHash& block_hash,
+                                    const Entry& entry) {
+  entries_[block_hash] = entry;
+}
+
 BasicBlockDecomposer::BasicBlockDecomposer(const BlockGraph::Block* block,
                                            BasicBlockSubGraph* subgraph)
     : block_(block),
+      code_end_offset_(0),
+      decode_cache_(NULL),
       subgraph_(subgraph),
       current_block_start_(0),
       check_decomposition_results_(true) {
@@ -145,6 +160,26 @@ BasicBlockDecomposer::BasicBlockDecomposer(const BlockGraph::Block* block,
   }
 }
 
+BasicBlockDecomposer::BasicBlockDecomposer(
+    const BlockGraph::Block* block,
+    const BasicBlockCallback& on_basic_block)
+    : block_(block),
+      on_basic_block_(on_basic_block),
+      code_end_offset_(0),
+      decode_cache_(NULL),
+      subgraph_(NULL),
+      current_block_start_(0),
+      check_decomposition_results_(true) {
+  DCHECK(block != NULL);
+  DCHECK(block->type() == BlockGraph::CODE_BLOCK);
+  DCHECK(!on_basic_block.is_null());
+
+  // Streaming mode never materializes basic blocks, but a scratch subgraph
+  // is still used to carry the original block for internal book-keeping.
+  scratch_subgraph_.reset(new BasicBlockSubGraph());
+  subgraph_ = scratch_subgraph_.get();
+}
+
 bool BasicBlockDecomposer::Decompose() {
   DCHECK(subgraph_->basic_blocks().empty());
   DCHECK(subgraph_->block_descriptions().empty());
@@ -222,6 +257,13 @@ bool BasicBlockDecomposer::DecodeInstruction(Offset offset,
           << " instruction (" << instruction->size()
           << " bytes) at offset " << offset << ".";
 
+  return true;
+}
+
+void BasicBlockDecomposer::AnnotateInstruction(
+    Offset offset, Instruction* instruction) const {
+  DCHECK(instruction != NULL);
+
   // Track the source range.
   instruction->set_source_range(
       GetSourceRange(offset, instruction->size()));
@@ -235,8 +277,6 @@ bool BasicBlockDecomposer::DecodeInstruction(Offset offset,
         << block_->name() << ".";
     instruction->set_label(label);
   }
-
-  return true;
 }
 
 BasicBlockDecomposer::SourceRange BasicBlockDecomposer::GetSourceRange(
@@ -534,21 +574,49 @@ bool BasicBlockDecomposer::GetCodeRangeAndCreateDataBasicBlocks(Offset* end) {
 
 bool BasicBlockDecomposer::ParseInstructions() {
   // Find the beginning and ending offsets of code bytes within the block.
-  Offset code_end_offset = 0;
-  if (!GetCodeRangeAndCreateDataBasicBlocks(&code_end_offset))
+  if (!GetCodeRangeAndCreateDataBasicBlocks(&code_end_offset_))
     return false;
 
   // Initialize jump_targets_ to include un-discoverable targets.
-  InitJumpTargets(code_end_offset);
+  InitJumpTargets(code_end_offset_);
+
+  // Consult the decode cache, if one has been provided. A cached decode is
+  // only reusable if it covers the same code range, as the range is derived
+  // from the block's labels which the hash does not cover.
+  const InstructionDecodeCache::Entry* cached_entry = NULL;
+  BlockHash block_hash;
+  if (decode_cache_ != NULL) {
+    block_hash.Hash(block_);
+    cached_entry = decode_cache_->Find(block_hash);
+    if (cached_entry != NULL &&
+        cached_entry->code_end_offset != code_end_offset_) {
+      cached_entry = NULL;
+    }
+  }
 
   // Disassemble the instruction stream into rudimentary basic blocks.
+  InstructionDecodeCache::Entry new_entry;
+  size_t cached_index = 0;
   Offset offset = 0;
   current_block_start_ = offset;
-  while (offset < code_end_offset) {
-    // Decode the next instruction.
+  while (offset < code_end_offset_) {
+    // Get the next instruction, either from the cache or by decoding the
+    // block data.
     Instruction instruction;
-    if (!DecodeInstruction(offset, code_end_offset, &instruction))
-      return false;
+    if (cached_entry != NULL) {
+      DCHECK_LT(cached_index, cached_entry->instructions.size());
+      instruction = cached_entry->instructions[cached_index];
+      ++cached_index;
+    } else {
+      if (!DecodeInstruction(offset, code_end_offset_, &instruction))
+        return false;
+      if (decode_cache_ != NULL)
+        new_entry.instructions.push_back(instruction);
+    }
+
+    // Apply the source range and label. These aren't covered by the block
+    // hash, so they are never taken from the cache.
+    AnnotateInstruction(offset, &instruction);
 
     // Handle the decoded instruction.
     if (!HandleInstruction(instruction, offset))
@@ -560,13 +628,20 @@ bool BasicBlockDecomposer::ParseInstructions() {
 
   // If we get here then we must have successfully consumed the entire code
   // range; otherwise, we should have failed to decode a partial instruction.
-  CHECK_EQ(offset, code_end_offset);
+  CHECK_EQ(offset, code_end_offset_);
+
+  // Remember the decoded instructions for subsequent decompositions of
+  // content-identical blocks.
+  if (decode_cache_ != NULL && cached_entry == NULL) {
+    new_entry.code_end_offset = code_end_offset_;
+    decode_cache_->Insert(block_hash, new_entry);
+  }
 
   // If the last bb we were working on didn't end with a RET or branch then
   // we need to close it now. We can detect this if the current_block_start_
   // does not match the current (end) offset.
-  if (current_block_start_ != code_end_offset)
-    EndCurrentBasicBlock(code_end_offset);
+  if (current_block_start_ != code_end_offset_)
+    EndCurrentBasicBlock(code_end_offset_);
 
   return true;
 }
@@ -576,6 +651,13 @@ bool BasicBlockDecomposer::Disassemble() {
   if (!ParseInstructions())
     return false;
 
+  // In streaming mode all that remains is to split the rudimentary ranges at
+  // branch targets and report them to the callback.
+  if (!on_basic_block_.is_null()) {
+    StreamBasicBlocks();
+    return true;
+  }
+
   // Everything below this point is simply book-keeping that can't fail. These
   // can safely be skipped in a dry-run.
   if (scratch_subgraph_.get() != NULL)
@@ -843,6 +925,20 @@ bool BasicBlockDecomposer::InsertBasicBlockRange(Offset offset,
   DCHECK(type == BasicBlock::BASIC_CODE_BLOCK || current_instructions_.empty());
   DCHECK(type == BasicBlock::BASIC_CODE_BLOCK || current_successors_.empty());
 
+  // In streaming mode no basic blocks are materialized; only the byte ranges
+  // are tracked, so that they can be split at branch targets and reported to
+  // the callback once disassembly is complete.
+  if (!on_basic_block_.is_null()) {
+    DCHECK_NE(BasicBlock::BASIC_END_BLOCK, type);
+    current_instructions_.clear();
+    current_successors_.clear();
+    if (!original_address_space_.Insert(Range(offset, size), NULL)) {
+      LOG(ERROR) << "Attempted to insert overlapping basic block.";
+      return false;
+    }
+    return true;
+  }
+
   // Find or create a name for this basic block. Reserve the label, if any,
   // to propagate to the basic block if there are no instructions in the
   // block to carry the label(s).
@@ -985,6 +1081,50 @@ void BasicBlockDecomposer::SplitCodeBlocksAtBranchTargets() {
   }
 }
 
+void BasicBlockDecomposer::StreamBasicBlocks() {
+  DCHECK(!on_basic_block_.is_null());
+
+  // Split the rudimentary basic-block ranges at branch targets. The ranges
+  // carry no instructions in streaming mode, so unlike
+  // SplitCodeBlocksAtBranchTargets this is a pure address-space manipulation.
+  JumpTargets::const_iterator jump_target_iter(jump_targets_.begin());
+  for (; jump_target_iter != jump_targets_.end(); ++jump_target_iter) {
+    // Resolve the range containing the target.
+    Offset target_offset = *jump_target_iter;
+    BasicBlock* target_bb = NULL;
+    Range target_bb_range;
+    CHECK(FindBasicBlock(target_offset, &target_bb, &target_bb_range));
+
+    // If we're jumping to the start of a basic block, there isn't any work
+    // to do.
+    if (target_offset == target_bb_range.start())
+      continue;
+
+    // Jump targets always land in code.
+    DCHECK_LT(target_offset, code_end_offset_);
+
+    // Replace the range with the two halves on either side of the target.
+    bool removed = original_address_space_.Remove(target_bb_range);
+    DCHECK(removed);
+    size_t left_split_size = target_offset - target_bb_range.start();
+    bool inserted = original_address_space_.Insert(
+        Range(target_bb_range.start(), left_split_size), NULL);
+    DCHECK(inserted);
+    inserted = original_address_space_.Insert(
+        Range(target_offset, target_bb_range.size() - left_split_size), NULL);
+    DCHECK(inserted);
+  }
+
+  // Report each range to the callback. Ranges at or beyond the end of the
+  // code bytes were carved out as data basic blocks.
+  RangeMapConstIter it = original_address_space_.begin();
+  for (; it != original_address_space_.end(); ++it) {
+    BasicBlockType type = it->first.start() < code_end_offset_ ?
+        BasicBlock::BASIC_CODE_BLOCK : BasicBlock::BASIC_DATA_BLOCK;
+    on_basic_block_.Run(it->first.start(), it->first.size(), type);
+  }
+}
+
 void BasicBlockDecomposer::CopyExternalReferrers() {
   const BlockGraph::Block::ReferrerSet& referrers = block_->referrers();
   BlockGraph::Block::ReferrerSet::const_iterator iter = referrers.begin();
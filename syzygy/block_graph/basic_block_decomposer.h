@@ -24,8 +24,10 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_DECOMPOSER_H_
 #define SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_DECOMPOSER_H_
 
+#include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "base/callback.h"
@@ -33,12 +35,52 @@
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/block_hash.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/disassembler.h"
 #include "distorm.h"  // NOLINT
 
 namespace block_graph {
 
+// A cache of decoded instruction lists, keyed by block content hash. When
+// provided to a BasicBlockDecomposer this allows repeated decompositions of
+// unmodified blocks - across a chain of transforms, for example - to reuse
+// the previously decoded instructions rather than re-decoding the same bytes.
+// Per-block annotations (source ranges and labels) are not cached; they are
+// reapplied on each use. This class is not thread-safe.
+class InstructionDecodeCache {
+ public:
+  typedef BlockGraph::Offset Offset;
+
+  // A cached decode of the code range of a single block.
+  struct Entry {
+    // The end of the code range that was decoded. The code range is derived
+    // from the block's labels, which the block hash does not cover, so an
+    // entry is only reusable if this matches.
+    Offset code_end_offset;
+    // The decoded instructions, in order of increasing offset.
+    std::vector<Instruction> instructions;
+  };
+
+  // Looks up the cache entry for a block.
+  // @param block_hash The content hash of the block.
+  // @returns the matching entry, or NULL if there is none. The returned
+  //     entry remains owned by the cache.
+  const Entry* Find(const BlockHash& block_hash) const;
+
+  // Inserts an entry into the cache, replacing any previous entry with the
+  // same hash.
+  // @param block_hash The content hash of the decoded block.
+  // @param entry The entry to be cached.
+  void Insert(const BlockHash& block_hash, const Entry& entry);
+
+ private:
+  typedef std::map<BlockHash, Entry> EntryMap;
+
+  // The cached entries.
+  EntryMap entries_;
+};
+
 // This class re-disassembles an already-processed code block (referred to
 // herein as a macro block) and breaks it up into basic blocks.
 //
@@ -74,6 +116,12 @@ class BasicBlockDecomposer {
   typedef BlockGraph::Offset Offset;
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
 
+  // The type of callback that is invoked for each basic block discovered
+  // during a streaming decomposition. The arguments are the offset of the
+  // basic block in the original block, its size in bytes, and its type.
+  typedef base::Callback<void(Offset, BlockGraph::Size, BasicBlockType)>
+      BasicBlockCallback;
+
   // Initialize the BasicBlockDecomposer instance.
   // @param block The block to be decomposed
   // @param subgraph The basic-block sub-graph data structure to populate.
@@ -82,6 +130,16 @@ class BasicBlockDecomposer {
   BasicBlockDecomposer(const BlockGraph::Block* block,
                        BasicBlockSubGraph* subgraph);
 
+  // Initialize the BasicBlockDecomposer instance in streaming mode. In this
+  // mode no basic blocks are materialized; instead @p on_basic_block is
+  // invoked once per basic block with its boundaries. This is considerably
+  // cheaper than a full decomposition and is intended for analyses that only
+  // need the basic-block layout of a block.
+  // @param block The block to be decomposed.
+  // @param on_basic_block The callback to invoke for each basic block.
+  BasicBlockDecomposer(const BlockGraph::Block* block,
+                       const BasicBlockCallback& on_basic_block);
+
   // Decomposes a function macro block into its constituent basic blocks.
   //
   // Immediately following a successful decomposition of a block to
@@ -94,6 +152,16 @@ class BasicBlockDecomposer {
   // which the original block came.
   bool Decompose();
 
+  // Sets the instruction-decode cache to be consulted during decomposition.
+  // The cache may be shared across decomposers so that repeated
+  // decompositions of content-identical blocks skip instruction decoding.
+  // Ownership remains with the caller.
+  // @param decode_cache The cache to use. May be NULL (the default), which
+  //     disables caching.
+  void set_decode_cache(InstructionDecodeCache* decode_cache) {
+    decode_cache_ = decode_cache;
+  }
+
  protected:
   typedef std::map<Offset, BasicBlockReference> BasicBlockReferenceMap;
   typedef core::AddressSpace<Offset, size_t, BasicBlock*> BBAddressSpace;
@@ -165,6 +233,15 @@ class BasicBlockDecomposer {
                          Offset code_end_offset,
                          Instruction* instruction) const;
 
+  // Applies the per-block annotations to @p instruction: the source range
+  // and, if the block is labeled at @p offset, the label. These depend on
+  // more than the block content, so they are applied to both freshly decoded
+  // and cached instructions.
+  // @param offset The offset at which @p instruction occurs in the block.
+  // @param instruction The instruction to annotate.
+  // @note Used by ParseInstructions().
+  void AnnotateInstruction(Offset offset, Instruction* instruction) const;
+
   // Called for each instruction, this creates the Instruction object
   // corresponding to @p instruction, or terminates the current basic block
   // if @p instruction is a branch point.
@@ -202,6 +279,12 @@ class BasicBlockDecomposer {
   // has a reference that it not to its head.
   void SplitCodeBlocksAtBranchTargets();
 
+  // Splits the rudimentary basic-block ranges at branch targets and reports
+  // each resulting range to on_basic_block_. Only used in streaming mode,
+  // where the ranges carry no instructions and splitting them is a simple
+  // address-space manipulation.
+  void StreamBasicBlocks();
+
   // Propagate the referrers from the original block into the basic blocks
   // so that referrers can be tracked as the basic blocks are manipulated.
   void CopyExternalReferrers();
@@ -230,6 +313,18 @@ class BasicBlockDecomposer {
   // The block being disassembled.
   const BlockGraph::Block* const block_;
 
+  // The callback to invoke per basic block in streaming mode. If this is
+  // null then a full decomposition is performed.
+  BasicBlockCallback on_basic_block_;
+
+  // The offset at which the code bytes of the block end. Calculated during
+  // ParseInstructions and used in streaming mode to distinguish code from
+  // data basic blocks.
+  Offset code_end_offset_;
+
+  // The instruction-decode cache to consult, if any. Not owned.
+  InstructionDecodeCache* decode_cache_;
+
   // The basic-block sub-graph to which the block will be decomposed.
   BasicBlockSubGraph* subgraph_;
 
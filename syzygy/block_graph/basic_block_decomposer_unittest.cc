@@ -155,6 +155,24 @@ size_t GetNetBBSize(const BasicBlockSubGraph& bbsg) {
   return net_bb_size;
 }
 
+// The offset, size and type of a basic block reported by a streaming
+// decomposition.
+struct StreamedBasicBlock {
+  Offset offset;
+  Size size;
+  BasicBlock::BasicBlockType type;
+};
+
+// A callback that appends each reported basic block to @p basic_blocks.
+void AppendBasicBlock(std::vector<StreamedBasicBlock>* basic_blocks,
+                      Offset offset,
+                      Size size,
+                      BasicBlock::BasicBlockType type) {
+  DCHECK(basic_blocks != NULL);
+  StreamedBasicBlock bb = { offset, size, type };
+  basic_blocks->push_back(bb);
+}
+
 struct BasicBlockOffsetComparator {
   bool operator()(const BasicBlock* bb0, const BasicBlock* bb1) {
     DCHECK_NE(reinterpret_cast<const BasicBlock*>(NULL), bb0);
@@ -247,6 +265,69 @@ TEST_F(BasicBlockDecomposerTest, DecomposeNoSubGraph) {
   EXPECT_TRUE(bbd.Decompose());
 }
 
+TEST_F(BasicBlockDecomposerTest, DecomposeStreaming) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+
+  std::vector<StreamedBasicBlock> bbs;
+  BasicBlockDecomposer bbd(
+      assembly_func_, base::Bind(&AppendBasicBlock, base::Unretained(&bbs)));
+  ASSERT_TRUE(bbd.Decompose());
+
+  // We expect the same boundaries as a full decomposition, but no end basic
+  // block is reported in streaming mode.
+  ASSERT_EQ(kNumCodeBasicBlocks + kNumDataBasicBlocks, bbs.size());
+
+  // The basic blocks should be reported in order, cover the entire block,
+  // and consist of code followed by data.
+  size_t num_code_blocks = 0;
+  size_t num_data_blocks = 0;
+  Offset next_offset = 0;
+  for (size_t i = 0; i < bbs.size(); ++i) {
+    EXPECT_EQ(next_offset, bbs[i].offset);
+    next_offset += bbs[i].size;
+
+    if (bbs[i].type == BasicBlock::BASIC_CODE_BLOCK) {
+      EXPECT_EQ(0u, num_data_blocks);
+      ++num_code_blocks;
+    } else {
+      EXPECT_EQ(BasicBlock::BASIC_DATA_BLOCK, bbs[i].type);
+      ++num_data_blocks;
+    }
+  }
+  EXPECT_EQ(assembly_func_->size(), static_cast<size_t>(next_offset));
+  EXPECT_EQ(kNumCodeBasicBlocks, num_code_blocks);
+  EXPECT_EQ(kNumDataBasicBlocks, num_data_blocks);
+}
+
+TEST_F(BasicBlockDecomposerTest, DecomposeWithDecodeCache) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+
+  // The first decomposition populates the cache.
+  InstructionDecodeCache decode_cache;
+  BasicBlockSubGraph subgraph1;
+  BasicBlockDecomposer bbd1(assembly_func_, &subgraph1);
+  bbd1.set_decode_cache(&decode_cache);
+  ASSERT_TRUE(bbd1.Decompose());
+
+  BlockHash block_hash(assembly_func_);
+  const InstructionDecodeCache::Entry* entry = decode_cache.Find(block_hash);
+  ASSERT_TRUE(entry != NULL);
+  EXPECT_FALSE(entry->instructions.empty());
+
+  // A second decomposition of the unmodified block is served from the cache
+  // and must produce an equivalent decomposition.
+  BasicBlockSubGraph subgraph2;
+  BasicBlockDecomposer bbd2(assembly_func_, &subgraph2);
+  bbd2.set_decode_cache(&decode_cache);
+  ASSERT_TRUE(bbd2.Decompose());
+
+  EXPECT_EQ(subgraph1.basic_blocks().size(), subgraph2.basic_blocks().size());
+  EXPECT_EQ(CountBasicBlocks(subgraph1, BasicBlock::BASIC_CODE_BLOCK),
+            CountBasicBlocks(subgraph2, BasicBlock::BASIC_CODE_BLOCK));
+  EXPECT_EQ(CountBasicBlocks(subgraph1, BasicBlock::BASIC_DATA_BLOCK),
+            CountBasicBlocks(subgraph2, BasicBlock::BASIC_DATA_BLOCK));
+}
+
 TEST_F(BasicBlockDecomposerTest, Decompose) {
   ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
   ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
@@ -0,0 +1,93 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implementation of BasicBlockSuccessorIndex.
+
+#include "syzygy/block_graph/basic_block_successor_index.h"
+
+namespace block_graph {
+
+const BasicBlockSuccessorIndex::Ordinal
+    BasicBlockSuccessorIndex::kInvalidOrdinal =
+        static_cast<BasicBlockSuccessorIndex::Ordinal>(-1);
+
+BasicBlockSuccessorIndex::BasicBlockSuccessorIndex() {
+}
+
+void BasicBlockSuccessorIndex::Build(const BBCollection& basic_blocks) {
+  blocks_.clear();
+  ordinals_.clear();
+  successor_starts_.clear();
+  successors_.clear();
+
+  // Assign an ordinal to each basic code block. The collection is ordered by
+  // basic-block ID, so the assignment is deterministic.
+  BBCollection::const_iterator it = basic_blocks.begin();
+  for (; it != basic_blocks.end(); ++it) {
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    if (bb == NULL)
+      continue;
+    ordinals_[bb] = static_cast<Ordinal>(blocks_.size());
+    blocks_.push_back(bb);
+  }
+
+  // Pack the code-to-code edges into the flat successor array.
+  successor_starts_.reserve(blocks_.size() + 1);
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    successor_starts_.push_back(static_cast<uint32>(successors_.size()));
+
+    const BasicBlock::Successors& successors = blocks_[i]->successors();
+    BasicBlock::Successors::const_iterator succ = successors.begin();
+    for (; succ != successors.end(); ++succ) {
+      const BasicCodeBlock* target =
+          BasicCodeBlock::Cast(succ->reference().basic_block());
+      if (target == NULL)
+        continue;
+
+      // Successor references to basic blocks always stay within the
+      // subgraph the referring block belongs to.
+      OrdinalMap::const_iterator look = ordinals_.find(target);
+      DCHECK(look != ordinals_.end());
+      successors_.push_back(look->second);
+    }
+  }
+  successor_starts_.push_back(static_cast<uint32>(successors_.size()));
+}
+
+BasicBlockSuccessorIndex::Ordinal BasicBlockSuccessorIndex::GetOrdinal(
+    const BasicCodeBlock* basic_block) const {
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), basic_block);
+  OrdinalMap::const_iterator look = ordinals_.find(basic_block);
+  if (look == ordinals_.end())
+    return kInvalidOrdinal;
+  return look->second;
+}
+
+const BasicBlockSuccessorIndex::Ordinal*
+BasicBlockSuccessorIndex::successors_begin(Ordinal ordinal) const {
+  DCHECK_LT(ordinal, blocks_.size());
+  if (successors_.empty())
+    return NULL;
+  return &successors_[0] + successor_starts_[ordinal];
+}
+
+const BasicBlockSuccessorIndex::Ordinal*
+BasicBlockSuccessorIndex::successors_end(Ordinal ordinal) const {
+  DCHECK_LT(ordinal, blocks_.size());
+  if (successors_.empty())
+    return NULL;
+  return &successors_[0] + successor_starts_[ordinal + 1];
+}
+
+}  // namespace block_graph
@@ -0,0 +1,121 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declaration of BasicBlockSuccessorIndex, a compact structure-of-arrays
+// view of the control-flow edges of a basic-block subgraph.
+
+#ifndef SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_SUCCESSOR_INDEX_H_
+#define SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_SUCCESSOR_INDEX_H_
+
+#include <hash_map>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
+
+namespace block_graph {
+
+// A read-only index over the successor edges of a basic-block subgraph. The
+// subgraph itself stores successors as per-block lists of Successor objects,
+// which is convenient while the graph is being mutated but costs a pointer
+// chase per edge when traversing. The index assigns each basic code block a
+// dense ordinal and packs all code-to-code edges into a single flat array,
+// so traversals touch two contiguous arrays rather than a list per block.
+//
+// The index is a snapshot: it is built once the subgraph has stabilized and
+// is not updated as the subgraph changes. It must be rebuilt after any
+// mutation of the subgraph.
+//
+// Only basic code blocks are indexed, and only successors that resolve to a
+// basic code block in the subgraph appear as edges; successors referring to
+// data blocks or to blocks outside the subgraph are omitted, as they carry
+// no intra-subgraph control flow.
+class BasicBlockSuccessorIndex {
+ public:
+  typedef BasicBlockSubGraph::BBCollection BBCollection;
+
+  // The dense identifier assigned to each indexed basic code block.
+  typedef uint32 Ordinal;
+
+  // The value returned by GetOrdinal for basic blocks not in the index.
+  static const Ordinal kInvalidOrdinal;
+
+  BasicBlockSuccessorIndex();
+
+  // Builds the index over @p basic_blocks. Any previously built index is
+  // discarded. Ordinals are assigned in increasing basic-block ID order,
+  // making them deterministic for a given subgraph.
+  // @param basic_blocks the basic blocks to index.
+  void Build(const BBCollection& basic_blocks);
+
+  // @returns the number of basic code blocks in the index.
+  size_t num_blocks() const { return blocks_.size(); }
+
+  // @param ordinal the ordinal of a basic block in the index.
+  // @returns the basic code block with the given ordinal.
+  const BasicCodeBlock* block(Ordinal ordinal) const {
+    DCHECK_LT(ordinal, blocks_.size());
+    return blocks_[ordinal];
+  }
+
+  // @param basic_block a basic code block.
+  // @returns the ordinal of @p basic_block, or kInvalidOrdinal if it is not
+  //     in the index.
+  Ordinal GetOrdinal(const BasicCodeBlock* basic_block) const;
+
+  // @name Successor edge accessors. The successors of a basic block occupy
+  //     a contiguous range of the flat edge array, in the order in which
+  //     they occur in the block's successor list.
+  // @{
+  // @param ordinal the ordinal of a basic block in the index.
+  // @returns the number of indexed successors of the given basic block.
+  size_t num_successors(Ordinal ordinal) const {
+    DCHECK_LT(ordinal, blocks_.size());
+    return successor_starts_[ordinal + 1] - successor_starts_[ordinal];
+  }
+
+  // @param ordinal the ordinal of a basic block in the index.
+  // @returns a pointer to the first successor ordinal of the given basic
+  //     block.
+  const Ordinal* successors_begin(Ordinal ordinal) const;
+
+  // @param ordinal the ordinal of a basic block in the index.
+  // @returns a pointer one past the last successor ordinal of the given
+  //     basic block.
+  const Ordinal* successors_end(Ordinal ordinal) const;
+  // @}
+
+ private:
+  typedef stdext::hash_map<const BasicCodeBlock*, Ordinal> OrdinalMap;
+
+  // The indexed basic blocks, by ordinal.
+  std::vector<const BasicCodeBlock*> blocks_;
+
+  // Maps each indexed basic block back to its ordinal.
+  OrdinalMap ordinals_;
+
+  // The successor edges in compressed sparse row form: the successors of the
+  // block with ordinal i are the entries of successors_ in the range
+  // [successor_starts_[i], successor_starts_[i + 1]). successor_starts_ has
+  // num_blocks() + 1 entries.
+  std::vector<uint32> successor_starts_;
+  std::vector<Ordinal> successors_;
+
+  DISALLOW_COPY_AND_ASSIGN(BasicBlockSuccessorIndex);
+};
+
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_SUCCESSOR_INDEX_H_
@@ -0,0 +1,143 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Tests for BasicBlockSuccessorIndex.
+
+#include "syzygy/block_graph/basic_block_successor_index.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/block_graph.h"
+
+namespace block_graph {
+
+namespace {
+
+typedef BasicBlockSuccessorIndex::Ordinal Ordinal;
+
+const size_t kDataSize = 32;
+const uint8 kData[kDataSize] = {0};
+
+class BasicBlockSuccessorIndexTest : public testing::Test {
+ protected:
+  void AddSuccessorBetween(BasicCodeBlock* from, BasicBlock* to) {
+    DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), from);
+    DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), to);
+    DCHECK_LT(from->successors().size(), 2U);
+
+    from->successors().push_back(
+        Successor(Successor::kConditionTrue,
+                  BasicBlockReference(BlockGraph::RELATIVE_REF,
+                                      BlockGraph::Reference::kMaximumSize,
+                                      to),
+                  0));
+  }
+
+  BasicBlockSubGraph subgraph_;
+  BasicBlockSuccessorIndex index_;
+};
+
+}  // namespace
+
+TEST_F(BasicBlockSuccessorIndexTest, BuildEmpty) {
+  index_.Build(subgraph_.basic_blocks());
+  EXPECT_EQ(0u, index_.num_blocks());
+}
+
+TEST_F(BasicBlockSuccessorIndexTest, Build) {
+  // Build a diamond: bb1 -> bb2, bb1 -> bb3, bb2 -> bb4, bb3 -> bb4. The
+  // data block takes no part in control flow.
+  BasicCodeBlock* bb1 = subgraph_.AddBasicCodeBlock("bb1");
+  BasicCodeBlock* bb2 = subgraph_.AddBasicCodeBlock("bb2");
+  BasicCodeBlock* bb3 = subgraph_.AddBasicCodeBlock("bb3");
+  BasicCodeBlock* bb4 = subgraph_.AddBasicCodeBlock("bb4");
+  BasicDataBlock* data =
+      subgraph_.AddBasicDataBlock("data", kDataSize, kData);
+  ASSERT_TRUE(data != NULL);
+
+  AddSuccessorBetween(bb1, bb2);
+  AddSuccessorBetween(bb1, bb3);
+  AddSuccessorBetween(bb2, bb4);
+  AddSuccessorBetween(bb3, bb4);
+
+  index_.Build(subgraph_.basic_blocks());
+
+  // Only the code blocks are indexed, with ordinals in ID order.
+  ASSERT_EQ(4u, index_.num_blocks());
+  EXPECT_EQ(bb1, index_.block(0));
+  EXPECT_EQ(bb2, index_.block(1));
+  EXPECT_EQ(bb3, index_.block(2));
+  EXPECT_EQ(bb4, index_.block(3));
+  EXPECT_EQ(0u, index_.GetOrdinal(bb1));
+  EXPECT_EQ(1u, index_.GetOrdinal(bb2));
+  EXPECT_EQ(2u, index_.GetOrdinal(bb3));
+  EXPECT_EQ(3u, index_.GetOrdinal(bb4));
+
+  // The successors of each block occupy a contiguous range, in successor
+  // list order.
+  ASSERT_EQ(2u, index_.num_successors(0));
+  EXPECT_EQ(1u, index_.successors_begin(0)[0]);
+  EXPECT_EQ(2u, index_.successors_begin(0)[1]);
+  ASSERT_EQ(1u, index_.num_successors(1));
+  EXPECT_EQ(3u, index_.successors_begin(1)[0]);
+  ASSERT_EQ(1u, index_.num_successors(2));
+  EXPECT_EQ(3u, index_.successors_begin(2)[0]);
+  EXPECT_EQ(0u, index_.num_successors(3));
+  EXPECT_EQ(index_.successors_begin(3), index_.successors_end(3));
+}
+
+TEST_F(BasicBlockSuccessorIndexTest, BuildSkipsNonCodeEdges) {
+  BasicCodeBlock* bb1 = subgraph_.AddBasicCodeBlock("bb1");
+  BasicDataBlock* data =
+      subgraph_.AddBasicDataBlock("data", kDataSize, kData);
+  ASSERT_TRUE(data != NULL);
+
+  // A successor referring to a data block carries no intra-subgraph control
+  // flow and is not indexed.
+  AddSuccessorBetween(bb1, data);
+
+  index_.Build(subgraph_.basic_blocks());
+
+  ASSERT_EQ(1u, index_.num_blocks());
+  EXPECT_EQ(0u, index_.num_successors(0));
+}
+
+TEST_F(BasicBlockSuccessorIndexTest, GetOrdinalOfForeignBlock) {
+  subgraph_.AddBasicCodeBlock("bb1");
+  index_.Build(subgraph_.basic_blocks());
+
+  // A basic block from another subgraph is not in the index.
+  BasicBlockSubGraph other_subgraph;
+  BasicCodeBlock* other_bb = other_subgraph.AddBasicCodeBlock("other");
+  EXPECT_EQ(BasicBlockSuccessorIndex::kInvalidOrdinal,
+            index_.GetOrdinal(other_bb));
+}
+
+TEST_F(BasicBlockSuccessorIndexTest, RebuildDiscardsPreviousIndex) {
+  BasicCodeBlock* bb1 = subgraph_.AddBasicCodeBlock("bb1");
+  BasicCodeBlock* bb2 = subgraph_.AddBasicCodeBlock("bb2");
+  AddSuccessorBetween(bb1, bb2);
+
+  index_.Build(subgraph_.basic_blocks());
+  ASSERT_EQ(2u, index_.num_blocks());
+  ASSERT_EQ(1u, index_.num_successors(0));
+
+  // Mutating the subgraph and rebuilding yields a fresh snapshot.
+  bb1->successors().clear();
+  index_.Build(subgraph_.basic_blocks());
+  EXPECT_EQ(2u, index_.num_blocks());
+  EXPECT_EQ(0u, index_.num_successors(0));
+}
+
+}  // namespace block_graph
@@ -806,4 +806,56 @@ TEST_F(InstructionTest, FindOperandReference) {
   }
 }
 
+typedef BasicBlockTest CompactInstructionsTest;
+
+TEST_F(CompactInstructionsTest, PackAndUnpack) {
+  BasicBlock::Instructions instructions;
+
+  // A plain return carrying no side data.
+  instructions.push_back(CreateRet());
+
+  // A call carrying a reference, a label, a source range and an offset.
+  BasicBlockReference ref(
+      BlockGraph::RELATIVE_REF, kRefSize, macro_block_, 0, 0);
+  instructions.push_back(CreateCall(ref));
+  Instruction& call = instructions.back();
+  call.set_source_range(
+      Instruction::SourceRange(core::RelativeAddress(16), call.size()));
+  call.set_offset(10);
+
+  CompactInstructions compact;
+  compact.Pack(instructions);
+  ASSERT_EQ(2u, compact.size());
+
+  // The cheap accessors should report on both instructions without a decode.
+  EXPECT_EQ(I_RET, compact.opcode(0));
+  EXPECT_EQ(1u, compact.instruction_size(0));
+  EXPECT_FALSE(compact.has_side_data(0));
+  EXPECT_EQ(I_CALL, compact.opcode(1));
+  EXPECT_EQ(call.size(), compact.instruction_size(1));
+  EXPECT_EQ(0,
+            ::memcmp(call.data(), compact.instruction_data(1), call.size()));
+  EXPECT_EQ(10, compact.instruction_offset(1));
+  EXPECT_TRUE(compact.has_side_data(1));
+
+  // Round-trip the sequence back to its full form.
+  BasicBlock::Instructions unpacked;
+  ASSERT_TRUE(compact.Unpack(&unpacked));
+  ASSERT_EQ(2u, unpacked.size());
+
+  const Instruction& ret_copy = unpacked.front();
+  EXPECT_EQ(I_RET, ret_copy.opcode());
+  EXPECT_FALSE(ret_copy.has_label());
+  EXPECT_TRUE(ret_copy.references().empty());
+
+  const Instruction& call_copy = unpacked.back();
+  EXPECT_EQ(call.opcode(), call_copy.opcode());
+  EXPECT_EQ(call.size(), call_copy.size());
+  EXPECT_EQ(0, ::memcmp(call.data(), call_copy.data(), call.size()));
+  EXPECT_EQ(call.references(), call_copy.references());
+  EXPECT_EQ(call.label(), call_copy.label());
+  EXPECT_EQ(call.source_range(), call_copy.source_range());
+  EXPECT_EQ(call.offset(), call_copy.offset());
+}
+
 }  // namespace block_graph
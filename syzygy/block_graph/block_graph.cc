@@ -134,36 +134,32 @@ void ShiftReferrers(BlockGraph::Block* self,
   typedef BlockGraph::Block::ReferrerSet ReferrerSet;
   typedef BlockGraph::Reference Reference;
 
-  ReferrerSet::iterator ref_it = referrers->begin();
-  while (ref_it != referrers->end()) {
-    // We need to keep around the next iterator as 'ref_it' will be invalidated
-    // if we need to update the reference. (It will be deleted and then
-    // recreated.)
-    ReferrerSet::iterator next_ref_it = ref_it;
-    ++next_ref_it;
-
+  // Updating a reference (via SetReference) erases and re-inserts the
+  // referrer's unchanged key, which invalidates iterators into the set, so
+  // iterate over a copy.
+  ReferrerSet local_referrers(*referrers);
+  ReferrerSet::const_iterator ref_it = local_referrers.begin();
+  for (; ref_it != local_referrers.end(); ++ref_it) {
     BlockGraph::Block* ref_block = ref_it->first;
     // Our own references will have been moved already.
-    if (ref_block != self) {
-      BlockGraph::Offset ref_offset = ref_it->second;
-
-      Reference ref;
-      bool ref_found = ref_block->GetReference(ref_offset, &ref);
-      DCHECK(ref_found);
-
-      // Shift the reference if need be.
-      if (ref.offset() >= offset) {
-        Reference new_ref(ref.type(),
-                          ref.size(),
-                          ref.referenced(),
-                          ref.offset() + distance,
-                          ref.base() + distance);
-        bool inserted = ref_block->SetReference(ref_offset, new_ref);
-        DCHECK(!inserted);
-      }
-    }
+    if (ref_block == self)
+      continue;
+    BlockGraph::Offset ref_offset = ref_it->second;
 
-    ref_it = next_ref_it;
+    Reference ref;
+    bool ref_found = ref_block->GetReference(ref_offset, &ref);
+    DCHECK(ref_found);
+
+    // Shift the reference if need be.
+    if (ref.offset() >= offset) {
+      Reference new_ref(ref.type(),
+                        ref.size(),
+                        ref.referenced(),
+                        ref.offset() + distance,
+                        ref.base() + distance);
+      bool inserted = ref_block->SetReference(ref_offset, new_ref);
+      DCHECK(!inserted);
+    }
   }
 }
 
@@ -180,6 +176,56 @@ const char* BlockAttributeToString(BlockGraph::BlockAttributeEnum attr) {
 
 }  // namespace
 
+void PolicyDecisionCache::SetConfiguration(uint32 configuration) {
+  base::AutoLock lock(lock_);
+  if (configuration == configuration_)
+    return;
+  configuration_ = configuration;
+  known_.clear();
+  decisions_.clear();
+}
+
+bool PolicyDecisionCache::Lookup(size_t id, bool* decision) const {
+  DCHECK(decision != NULL);
+  size_t word = id / 32;
+  uint32 mask = 1u << (id % 32);
+  base::AutoLock lock(lock_);
+  if (word >= known_.size() || (known_[word] & mask) == 0)
+    return false;
+  *decision = (decisions_[word] & mask) != 0;
+  return true;
+}
+
+void PolicyDecisionCache::Store(size_t id, bool decision) {
+  size_t word = id / 32;
+  uint32 mask = 1u << (id % 32);
+  base::AutoLock lock(lock_);
+  if (word >= known_.size()) {
+    known_.resize(word + 1, 0);
+    decisions_.resize(word + 1, 0);
+  }
+  known_[word] |= mask;
+  if (decision) {
+    decisions_[word] |= mask;
+  } else {
+    decisions_[word] &= ~mask;
+  }
+}
+
+void PolicyDecisionCache::Invalidate(size_t id) {
+  size_t word = id / 32;
+  base::AutoLock lock(lock_);
+  if (word >= known_.size())
+    return;
+  known_[word] &= ~(1u << (id % 32));
+}
+
+void PolicyDecisionCache::Clear() {
+  base::AutoLock lock(lock_);
+  known_.clear();
+  decisions_.clear();
+}
+
 const char* BlockGraph::ImageFormatToString(ImageFormat format) {
   DCHECK_LE(BlockGraph::PE_IMAGE, format);
   DCHECK_GT(BlockGraph::IMAGE_FORMAT_MAX, format);
@@ -235,6 +281,14 @@ BlockGraph::BlockGraph()
 BlockGraph::~BlockGraph() {
 }
 
+void BlockGraph::EnableDataArena() {
+  // Switching modes with live blocks would mix heap and arena buffers, so
+  // this must happen before any blocks exist.
+  DCHECK(blocks_.empty());
+  DCHECK(data_arena_.get() == NULL);
+  data_arena_.reset(new core::BumpArena());
+}
+
 BlockGraph::Section* BlockGraph::AddSection(const base::StringPiece& name,
                                             uint32 characteristics) {
   Section new_section(next_section_id_++, name, characteristics);
@@ -324,6 +378,66 @@ bool BlockGraph::RemoveBlockById(BlockId id) {
   return RemoveBlockByIterator(it);
 }
 
+void BlockGraph::Fork(BlockGraph* child) const {
+  DCHECK(child != NULL);
+  DCHECK(child->sections_.empty());
+  DCHECK(child->blocks_.empty());
+
+  child->sections_ = sections_;
+  child->next_section_id_ = next_section_id_;
+  child->next_block_id_ = next_block_id_;
+  child->image_format_ = image_format_;
+
+  // Copy the block metadata. The data buffers themselves are shared with
+  // this graph; a child block only materializes a private copy when its
+  // data is first mutated.
+  BlockMap::const_iterator it = blocks_.begin();
+  for (; it != blocks_.end(); ++it) {
+    const Block& block = it->second;
+    BlockMap::iterator child_it = child->blocks_.insert(std::make_pair(
+        it->first,
+        Block(block.id_, block.type_, block.size_, *block.name_,
+              child))).first;
+    Block& child_block = child_it->second;
+
+    child_block.alignment_ = block.alignment_;
+    child_block.addr_ = block.addr_;
+    child_block.section_ = block.section_;
+    child_block.attributes_ = block.attributes_;
+    child_block.source_ranges_ = block.source_ranges_;
+    child_block.labels_ = block.labels_;
+    if (block.compiland_name_ != NULL)
+      child_block.set_compiland_name(*block.compiland_name_);
+
+    // Alias the parent's data without taking ownership. Deferred data
+    // extents stay deferred.
+    child_block.owns_data_ = false;
+    child_block.data_ = block.data_;
+    child_block.data_size_ = block.data_size_;
+    child_block.data_source_ = block.data_source_;
+    child_block.data_source_offset_ = block.data_source_offset_;
+  }
+
+  // Now that all of the child blocks exist, recreate the references against
+  // them. This also rebuilds the referrer sets.
+  for (it = blocks_.begin(); it != blocks_.end(); ++it) {
+    Block* child_block = child->GetBlockById(it->first);
+    DCHECK(child_block != NULL);
+
+    Block::ReferenceMap::const_iterator ref_it =
+        it->second.references_.begin();
+    for (; ref_it != it->second.references_.end(); ++ref_it) {
+      const Reference& ref = ref_it->second;
+      Block* referenced = child->GetBlockById(ref.referenced()->id());
+      DCHECK(referenced != NULL);
+      child_block->SetReference(
+          ref_it->first,
+          Reference(ref.type(), ref.size(), referenced, ref.offset(),
+                    ref.base()));
+    }
+  }
+}
+
 BlockGraph::Section* BlockGraph::GetSectionById(SectionId id) {
   SectionMap::iterator it(sections_.find(id));
 
@@ -442,8 +556,12 @@ bool BlockGraph::AddressSpace::ResizeBlock(Block* block, size_t size) {
 
   // Reinsert the block with its new range if its not empty. If the block is
   // empty it won't be added back to the address space.
-  if (size > 0)
+  if (size > 0) {
     address_space_.Insert(Range(block_it->second, size), block, &range_it);
+    block_starts_[block_it->second.value()] = block;
+  } else {
+    block_starts_.erase(block_it->second.value());
+  }
 
   // Update the block with its new size.
   block->set_size(size);
@@ -455,6 +573,38 @@ bool BlockGraph::AddressSpace::InsertBlock(RelativeAddress addr, Block* block) {
   return InsertImpl(addr, block);
 }
 
+bool BlockGraph::AddressSpace::InsertBlocks(
+    const std::vector<std::pair<RelativeAddress, Block*>>& blocks) {
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    RelativeAddress addr = blocks[i].first;
+    Block* block = blocks[i].second;
+    DCHECK(block != NULL);
+
+    // Only insert the block in the address-space if it has non-zero size.
+    if (block->size() > 0) {
+      if (!address_space_.Append(Range(addr, block->size()), block)) {
+        LOG(ERROR) << "Failed to insert block \"" << block->name()
+                   << "\" at " << addr << ".";
+        return false;
+      }
+      block_starts_[addr.value()] = block;
+    }
+
+    bool inserted = block_addresses_.insert(std::make_pair(block, addr)).second;
+    DCHECK(inserted);
+    // Update the address stored in the block.
+    block->set_addr(addr);
+  }
+
+  return true;
+}
+
+void BlockGraph::AddressSpace::Clear() {
+  address_space_.Clear();
+  block_addresses_.clear();
+  block_starts_.clear();
+}
+
 BlockGraph::Block* BlockGraph::AddressSpace::GetBlockByAddress(
     RelativeAddress addr) const {
   return GetContainingBlock(addr, 1);
@@ -462,6 +612,12 @@ BlockGraph::Block* BlockGraph::AddressSpace::GetBlockByAddress(
 
 BlockGraph::Block* BlockGraph::AddressSpace::GetContainingBlock(
     RelativeAddress addr, Size size) const {
+  // Service exact-start lookups from the hash index before falling back to
+  // the ordered map.
+  BlockStartMap::const_iterator start_it = block_starts_.find(addr.value());
+  if (start_it != block_starts_.end() && size <= start_it->second->size())
+    return start_it->second;
+
   AddressSpaceImpl::Range range(addr, size);
   AddressSpaceImpl::RangeMap::const_iterator it =
       address_space_.FindContaining(range);
@@ -514,6 +670,7 @@ bool BlockGraph::AddressSpace::InsertImpl(RelativeAddress addr, Block* block) {
     bool inserted = address_space_.Insert(range, block);
     if (!inserted)
       return false;
+    block_starts_[addr.value()] = block;
   }
 
   bool inserted = block_addresses_.insert(std::make_pair(block, addr)).second;
@@ -622,6 +779,7 @@ BlockGraph::Block* BlockGraph::AddressSpace::MergeIntersectingBlocks(
 
     bool removed = address_space_.Remove(Range(addr, block->size()));
     DCHECK(removed);
+    block_starts_.erase(addr.value());
     size_t num_removed = block_addresses_.erase(intersecting[i].second);
     DCHECK_EQ(1U, num_removed);
   }
@@ -801,7 +959,9 @@ BlockGraph::Block::Block(BlockGraph* block_graph)
       attributes_(0),
       owns_data_(false),
       data_(NULL),
-      data_size_(0) {
+      data_size_(0),
+      data_source_(NULL),
+      data_source_offset_(0) {
   DCHECK(block_graph != NULL);
 }
 
@@ -822,7 +982,9 @@ BlockGraph::Block::Block(BlockId id,
       attributes_(0),
       owns_data_(false),
       data_(NULL),
-      data_size_(0) {
+      data_size_(0),
+      data_source_(NULL),
+      data_source_offset_(0) {
   DCHECK(block_graph != NULL);
   set_name(name);
 }
@@ -830,7 +992,7 @@ BlockGraph::Block::Block(BlockId id,
 BlockGraph::Block::~Block() {
   DCHECK(block_graph_ != NULL);
   if (owns_data_)
-    delete [] data_;
+    FreeDataBuffer(data_);
 }
 
 void BlockGraph::Block::set_name(const base::StringPiece& name) {
@@ -858,22 +1020,42 @@ uint8* BlockGraph::Block::AllocateRawData(size_t data_size) {
   DCHECK_GT(data_size, 0u);
   DCHECK_LE(data_size, size_);
 
-  uint8* new_data = new uint8[data_size];
+  InvalidateCachedDecisions();
+
+  uint8* new_data = AllocateDataBuffer(data_size);
   if (!new_data)
     return NULL;
 
   if (owns_data()) {
     DCHECK(data_ != NULL);
-    delete [] data_;
+    FreeDataBuffer(data_);
   }
 
   data_ = new_data;
   data_size_ = data_size;
+  data_source_ = NULL;
   owns_data_ = true;
 
   return new_data;
 }
 
+uint8* BlockGraph::Block::AllocateDataBuffer(size_t size) {
+  DCHECK(block_graph_ != NULL);
+  if (block_graph_->data_arena() != NULL) {
+    return reinterpret_cast<uint8*>(
+        block_graph_->data_arena()->Allocate(size));
+  }
+  return new uint8[size];
+}
+
+void BlockGraph::Block::FreeDataBuffer(const uint8* data) {
+  DCHECK(block_graph_ != NULL);
+  // Arena memory is freed wholesale when the graph is destroyed.
+  if (block_graph_->data_arena() != NULL)
+    return;
+  delete [] data;
+}
+
 void BlockGraph::Block::InsertData(Offset offset,
                                    Size size,
                                    bool always_allocate_data) {
@@ -882,6 +1064,7 @@ void BlockGraph::Block::InsertData(Offset offset,
 
   if (size > 0) {
     // Patch up the block.
+    InvalidateCachedDecisions();
     size_ += size;
     ShiftOffsetItemMap(offset, size, &labels_);
     ShiftReferences(this, offset, size);
@@ -913,6 +1096,8 @@ bool BlockGraph::Block::RemoveData(Offset offset, Size size) {
   if (size == 0)
     return true;
 
+  InvalidateCachedDecisions();
+
   // Ensure there are no labels in this range.
   if (labels_.lower_bound(offset) != labels_.lower_bound(offset + size))
     return false;
@@ -1004,12 +1189,45 @@ void BlockGraph::Block::SetData(const uint8* data, size_t data_size) {
          (data_size != 0 && data != NULL));
   DCHECK(data_size <= size_);
 
+  InvalidateCachedDecisions();
+
   if (owns_data_)
-    delete [] data_;
+    FreeDataBuffer(data_);
 
   owns_data_ = false;
   data_ = data;
   data_size_ = data_size;
+  data_source_ = NULL;
+}
+
+void BlockGraph::Block::SetDeferredData(BlockDataSource* data_source,
+                                        size_t offset,
+                                        size_t data_size) {
+  DCHECK((data_size == 0 && data_source == NULL) ||
+         (data_size != 0 && data_source != NULL));
+  DCHECK(data_size <= size_);
+
+  InvalidateCachedDecisions();
+
+  if (owns_data_)
+    FreeDataBuffer(data_);
+
+  owns_data_ = false;
+  data_ = NULL;
+  data_size_ = data_size;
+  data_source_ = data_source;
+  data_source_offset_ = offset;
+}
+
+const uint8* BlockGraph::Block::ResolveDeferredData() const {
+  DCHECK(data_source_ != NULL);
+  DCHECK(data_ == NULL);
+  DCHECK(!owns_data_);
+
+  data_ = data_source_->GetData(data_source_offset_, data_size_);
+  CHECK(data_ != NULL);
+
+  return data_;
 }
 
 uint8* BlockGraph::Block::AllocateData(size_t size) {
@@ -1032,10 +1250,13 @@ uint8* BlockGraph::Block::CopyData(size_t size, const void* data) {
 
 const uint8* BlockGraph::Block::ResizeData(size_t new_size) {
   if (new_size == data_size_)
-    return data_;
+    return data();
+
+  InvalidateCachedDecisions();
 
   if (!owns_data() && new_size < data_size_) {
     // Not in our ownership and shrinking. We only need to adjust our length.
+    // A deferred data extent simply shrinks with it.
     data_size_ = new_size;
   } else {
     // Either our own data, or it's growing (or both).
@@ -1043,11 +1264,11 @@ const uint8* BlockGraph::Block::ResizeData(size_t new_size) {
 
     // If the new size is non-zero we need to reallocate.
     if (new_size > 0) {
-      new_data = new uint8[new_size];
+      new_data = AllocateDataBuffer(new_size);
       CHECK(new_data);
 
-      // Copy the (head of the) old data.
-      memcpy(new_data, data_, std::min(data_size_, new_size));
+      // Copy the (head of the) old data, resolving any deferred extent.
+      memcpy(new_data, data(), std::min(data_size_, new_size));
       if (new_size > data_size_) {
         // Zero the tail.
         memset(new_data + data_size_, 0, new_size - data_size_);
@@ -1055,11 +1276,12 @@ const uint8* BlockGraph::Block::ResizeData(size_t new_size) {
     }
 
     if (owns_data())
-      delete [] data_;
+      FreeDataBuffer(data_);
 
     owns_data_ = true;
     data_ = new_data;
     data_size_ = new_size;
+    data_source_ = NULL;
   }
 
   return data_;
@@ -1067,15 +1289,23 @@ const uint8* BlockGraph::Block::ResizeData(size_t new_size) {
 
 uint8* BlockGraph::Block::GetMutableData() {
   DCHECK_NE(0U, data_size_);
-  DCHECK(data_ != NULL);
+
+  // The caller receives a writable pointer to the block contents, so assume
+  // the contents change.
+  InvalidateCachedDecisions();
+
+  // Resolve any deferred data extent so that there are bytes to copy.
+  const uint8* source_data = data();
+  DCHECK(source_data != NULL);
 
   // Make a copy if we don't already own the data.
   if (!owns_data()) {
-    uint8* new_data = new uint8[data_size_];
+    uint8* new_data = AllocateDataBuffer(data_size_);
     if (new_data == NULL)
       return NULL;
-    memcpy(new_data, data_, data_size_);
+    memcpy(new_data, source_data, data_size_);
     data_ = new_data;
+    data_source_ = NULL;
     owns_data_ = true;
   }
   DCHECK(owns_data_);
@@ -1138,6 +1368,11 @@ bool BlockGraph::Block::SetReference(Offset offset, const Reference& ref) {
   }
 #endif
 
+  // Our references and the referrer sets of the involved blocks are about
+  // to change.
+  InvalidateCachedDecisions();
+  ref.referenced()->InvalidateCachedDecisions();
+
   // Did we have an earlier reference at this location?
   ReferenceMap::iterator it(references_.find(offset));
   bool inserted = false;
@@ -1147,6 +1382,7 @@ bool BlockGraph::Block::SetReference(Offset offset, const Reference& ref) {
     Referrer referrer(this, offset);
     size_t removed = referenced->referrers_.erase(referrer);
     DCHECK_EQ(1U, removed);
+    referenced->InvalidateCachedDecisions();
 
     // Lastly switch the reference.
     it->second = ref;
@@ -1185,14 +1421,15 @@ bool BlockGraph::Block::RemoveReference(Offset offset) {
   DCHECK_EQ(1U, removed);
   references_.erase(it);
 
+  InvalidateCachedDecisions();
+  referenced->InvalidateCachedDecisions();
+
   return true;
 }
 
 bool BlockGraph::Block::RemoveAllReferences() {
-  ReferenceMap::iterator it = references_.begin();
-  while (it != references_.end()) {
-    ReferenceMap::iterator to_remove = it;
-    ++it;
+  while (!references_.empty()) {
+    ReferenceMap::iterator it = references_.begin();
 
     // TODO(rogerm): As an optimization, we don't need to drop intra-block
     //     references when disconnecting from the block_graph. Consider having
@@ -1201,11 +1438,14 @@ bool BlockGraph::Block::RemoveAllReferences() {
     //     block.
 
     // Unregister this reference from the referred block then erase it.
-    BlockGraph::Block* referenced = to_remove->second.referenced();
-    Referrer referrer(this, to_remove->first);
+    BlockGraph::Block* referenced = it->second.referenced();
+    Referrer referrer(this, it->first);
     size_t removed = referenced->referrers_.erase(referrer);
     DCHECK_EQ(1U, removed);
-    references_.erase(to_remove);
+    references_.erase(it);
+
+    InvalidateCachedDecisions();
+    referenced->InvalidateCachedDecisions();
   }
 
   return true;
@@ -1224,8 +1464,10 @@ bool BlockGraph::Block::SetLabel(Offset offset, const Label& label) {
       labels_.insert(std::make_pair(offset, label)));
 
   // If it was freshly inserted then we're done.
-  if (result.second)
+  if (result.second) {
+    InvalidateCachedDecisions();
     return true;
+  }
 
   return false;
 }
@@ -1245,7 +1487,11 @@ bool BlockGraph::Block::GetLabel(Offset offset, Label* label) const {
 bool BlockGraph::Block::RemoveLabel(Offset offset) {
   DCHECK(offset >= 0 && static_cast<size_t>(offset) <= size_);
 
-  return labels_.erase(offset) == 1;
+  if (labels_.erase(offset) != 1)
+    return false;
+
+  InvalidateCachedDecisions();
+  return true;
 }
 
 bool BlockGraph::Block::HasLabel(Offset offset) const {
@@ -1256,21 +1502,37 @@ bool BlockGraph::Block::HasLabel(Offset offset) const {
 
 bool BlockGraph::Block::TransferReferrers(Offset offset,
     Block* new_block, TransferReferrersFlags flags) {
-  // Redirect all referrers to the new block, we copy the referrer set
-  // because it is otherwise mutated during iteration.
-  BlockGraph::Block::ReferrerSet referrers = referrers_;
-  BlockGraph::Block::ReferrerSet::const_iterator referrer_it(referrers.begin());
+  DCHECK_NE(reinterpret_cast<Block*>(NULL), new_block);
+
+  // Both referrer sets change, and the references of every referring block
+  // are retargeted below.
+  InvalidateCachedDecisions();
+  new_block->InvalidateCachedDecisions();
+
+  // Rebind all references to this block in a single pass over the referrer
+  // set. A referrer key is the (referring block, source offset) pair, which
+  // is unchanged by the transfer, so the entries that move are bulk-inserted
+  // into the new block's referrer set - deferred insertions make this cheap -
+  // and the entries that stay are collected and swapped back in rather than
+  // erased one by one. The references themselves are updated in place in the
+  // referring blocks, sidestepping the per-reference erase/insert bookkeeping
+  // that SetReference would otherwise repeat for each referrer.
+  ReferrerSet kept_referrers;
+  ReferrerSet::const_iterator referrer_it = referrers_.begin();
+  for (; referrer_it != referrers_.end(); ++referrer_it) {
+    Block* referring_block = referrer_it->first;
+    Offset referring_offset = referrer_it->second;
+
+    if ((flags & kSkipInternalReferences) != 0 && referring_block == this) {
+      kept_referrers.insert(*referrer_it);
+      continue;
+    }
 
-  for (; referrer_it != referrers.end(); ++referrer_it) {
     // Get the original reference.
-    BlockGraph::Block::Referrer referrer = *referrer_it;
-    BlockGraph::Block::ReferenceMap::const_iterator found_ref(
-        referrer.first->references().find(referrer.second));
-    DCHECK(found_ref != referrer.first->references().end());
-    BlockGraph::Reference ref(found_ref->second);
-
-    if ((flags & kSkipInternalReferences) != 0 && referrer.first == this)
-      continue;
+    ReferenceMap::iterator found_ref(
+        referring_block->references_.find(referring_offset));
+    DCHECK(found_ref != referring_block->references_.end());
+    const Reference& ref = found_ref->second;
 
     Offset new_offset = ref.offset() + offset;
     Offset new_base = ref.base() + offset;
@@ -1286,13 +1548,23 @@ bool BlockGraph::Block::TransferReferrers(Offset offset,
     }
 
     // Redirect the reference to the new block with the adjusted offset.
-    BlockGraph::Reference new_ref(ref.type(),
+    found_ref->second = Reference(ref.type(),
                                   ref.size(),
                                   new_block,
                                   new_offset,
                                   new_base);
-    referrer.first->SetReference(referrer.second, new_ref);
+    referring_block->InvalidateCachedDecisions();
+
+    // Record the back-reference in its new home. If the transfer is to this
+    // very block it is already in place.
+    if (new_block != this) {
+      new_block->referrers_.insert(
+          std::make_pair(referring_block, referring_offset));
+    } else {
+      kept_referrers.insert(*referrer_it);
+    }
   }
+  referrers_.swap(kept_referrers);
 
   return true;
 }
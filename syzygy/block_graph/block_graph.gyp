@@ -29,6 +29,8 @@
         'basic_block_decomposer.h',
         'basic_block_subgraph.cc',
         'basic_block_subgraph.h',
+        'basic_block_successor_index.cc',
+        'basic_block_successor_index.h',
         'block_builder.cc',
         'block_builder.h',
         'block_graph.cc',
@@ -90,6 +92,7 @@
         'basic_block_decomposer_unittest.cc',
         'basic_block_unittest.cc',
         'basic_block_subgraph_unittest.cc',
+        'basic_block_successor_index_unittest.cc',
         'block_graph_serializer_unittest.cc',
         'block_builder_unittest.cc',
         'block_graph_unittest.cc',
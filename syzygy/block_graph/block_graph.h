@@ -32,10 +32,15 @@
 
 #include "base/basictypes.h"
 #include "base/file_util.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/strings/string_piece.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/common/align.h"
+#include "syzygy/common/flat_map.h"
+#include "syzygy/common/flat_set.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/core/bump_arena.h"
 #include "syzygy/core/string_table.h"
 
 namespace block_graph {
@@ -100,6 +105,63 @@ class BlockGraphSerializer;
     /* This always needs to be set to the next available attribute bit. */ \
     F(BLOCK_ATTRIBUTES_MAX)
 
+// A cache of boolean policy decisions for the blocks of a BlockGraph. The
+// cache is attached to the graph so that all pipeline stages operating on
+// it (decomposition, instrumentation, optimization) share one set of
+// decisions rather than re-running the same analyses per stage. Decisions
+// are keyed by block ID; IDs are unique and never reused, so a pair of bit
+// vectors (decision known, decision value) suffices, costing two bits per
+// block. A block's cached decision is dropped whenever the block is
+// structurally mutated.
+//
+// The cache is internally locked: policies consult it from the concurrent
+// phases of multi-threaded pipeline stages, so lookups and stores may race.
+class PolicyDecisionCache {
+ public:
+  PolicyDecisionCache() : configuration_(0) {
+  }
+
+  // Sets the policy configuration the cached decisions belong to. If this
+  // differs from the current configuration all cached decisions are
+  // dropped, as they were made under different rules.
+  // @param configuration an opaque value identifying the policy
+  //     configuration.
+  void SetConfiguration(uint32 configuration);
+
+  // Looks up the cached decision for the block with @p id.
+  // @param id the ID of the block.
+  // @param decision receives the cached decision on success.
+  // @returns true iff a decision for the block is cached.
+  bool Lookup(size_t id, bool* decision) const;
+
+  // Caches @p decision for the block with @p id.
+  // @param id the ID of the block.
+  // @param decision the decision to cache.
+  void Store(size_t id, bool decision);
+
+  // Drops the cached decision for the block with @p id, if any.
+  // @param id the ID of the block.
+  void Invalidate(size_t id);
+
+  // Drops all cached decisions.
+  void Clear();
+
+ private:
+  // Serializes access to the members below. Mutable so that Lookup may take
+  // it.
+  mutable base::Lock lock_;
+
+  // Bit vectors keyed by block ID, holding respectively whether a decision
+  // is cached for a block and what that decision is. Under lock_.
+  std::vector<uint32> known_;
+  std::vector<uint32> decisions_;
+
+  // The configuration the cached decisions were made under. Under lock_.
+  uint32 configuration_;
+
+  DISALLOW_COPY_AND_ASSIGN(PolicyDecisionCache);
+};
+
 // The BlockGraph is a top-level container for Blocks.
 class BlockGraph {
  public:
@@ -233,6 +295,7 @@ class BlockGraph {
   // Forward declarations.
   class AddressSpace;
   class Block;
+  class BlockDataSource;
   class Label;
   class Reference;
 
@@ -305,6 +368,21 @@ class BlockGraph {
   // changed.
   bool RemoveBlockById(BlockId id);
 
+  // Forks this block-graph into @p child, which must be empty. The child
+  // gets private copies of all sections and block metadata (references,
+  // referrers, labels and source ranges), but shares the block data buffers
+  // with this graph: child blocks do not own their data, and a private copy
+  // is only materialized if and when a child block's data is first mutated
+  // via GetMutableData. As the data buffers dominate the memory footprint of
+  // a graph this makes a fork cheap compared to a deep copy, letting a
+  // single decomposition serve several independently transformed copies.
+  //
+  // This graph must outlive the child, and its block data must not be
+  // mutated while forked children are alive, as the children alias it.
+  //
+  // @param child The empty graph to fork into.
+  void Fork(BlockGraph* child) const;
+
   // Accessors.
   const SectionMap& sections() const { return sections_; }
   SectionMap& sections_mutable() { return sections_; }
@@ -331,6 +409,19 @@ class BlockGraph {
   // @returns the string table of this BlockGraph.
   core::StringTable& string_table() { return string_table_; }
 
+  // Switches the block-graph to arena allocation mode. Block data buffers
+  // are subsequently carved from a bump arena owned by the graph and freed
+  // wholesale when the graph is destroyed, eliminating both per-buffer heap
+  // overhead and the storm of free() calls when a large graph is torn down.
+  // Must be called before any blocks are added. Only appropriate for graphs
+  // with typical build-and-discard lifetimes; resized or discarded buffers
+  // are not returned to the system until the graph dies.
+  void EnableDataArena();
+
+  // @returns the arena backing block data allocations, or NULL if arena
+  //     mode is not enabled.
+  core::BumpArena* data_arena() { return data_arena_.get(); }
+
   // Sets the image format.
   // @param image_format The format of the image.
   void set_image_format(ImageFormat image_format) {
@@ -339,6 +430,13 @@ class BlockGraph {
   // @returns the image format.
   ImageFormat image_format() const { return image_format_; }
 
+  // @returns the cache of per-block policy decisions attached to this
+  //     graph. The cache holds only derived data, so it is accessible
+  //     through a const graph.
+  PolicyDecisionCache& policy_decision_cache() const {
+    return policy_decision_cache_;
+  }
+
  private:
   // Give BlockGraphSerializer access to our innards for serialization.
   friend BlockGraphSerializer;
@@ -346,6 +444,11 @@ class BlockGraph {
   // Removes a block by the iterator to it. The iterator must be valid.
   bool RemoveBlockByIterator(BlockMap::iterator it);
 
+  // The arena backing block data allocations when arena mode is enabled,
+  // NULL otherwise. Declared first so that it outlives blocks_, whose
+  // destructors consult it.
+  scoped_ptr<core::BumpArena> data_arena_;
+
   // All sections we contain.
   SectionMap sections_;
 
@@ -365,6 +468,10 @@ class BlockGraph {
   // UNKNOWN_IMAGE_FORMAT. Usually initialized by the appropriate decomposer.
   ImageFormat image_format_;
 
+  // The cache of per-block policy decisions. Mutable because it holds only
+  // derived data, and policies answer queries through const blocks.
+  mutable PolicyDecisionCache policy_decision_cache_;
+
   DISALLOW_COPY_AND_ASSIGN(BlockGraph);
 };
 
@@ -524,6 +631,122 @@ class BlockGraph::Label {
   LabelAttributes attributes_;
 };
 
+// Represents a reference from one block to another. References may be offset.
+// That is, they may refer to an object at a given location, but actually point
+// to a location that is some fixed distance away from that object. This allows,
+// for example, non-zero based indexing into a table. The object that is
+// intended to be dereferenced is called the 'base' of the offset.
+//
+// BlockGraph references are from a location (offset) in one block, to some
+// location in another block. The referenced block itself plays the role of the
+// 'base' of the reference, with the offset of the reference being stored as
+// an integer from the beginning of the block. However, basic block
+// decomposition requires breaking the block into smaller pieces and thus we
+// need to carry around an explicit base value, indicating which byte in the
+// block is intended to be referenced.
+//
+// A direct reference to a location will have the same value for 'base' and
+// 'offset'.
+//
+// Here is an example:
+//
+//        /----------\
+//        +---------------------------+
+//  O     |          B                | <--- Referenced block
+//        +---------------------------+      B = base
+//  \-----/                                  O = offset
+//
+class BlockGraph::Reference {
+ public:
+  Reference() :
+      type_(RELATIVE_REF), size_(0), referenced_(NULL), offset_(0), base_(0) {
+  }
+
+  // @param type type of reference.
+  // @param size size of reference.
+  // @param referenced the referenced block.
+  // @param offset offset from the beginning of the block of the location to be
+  //     explicitly referred to.
+  // @param base offset into the block of the location actually being
+  //     referenced. This must be strictly within @p referenced.
+  Reference(ReferenceType type,
+            Size size,
+            Block* referenced,
+            Offset offset,
+            Offset base)
+      : type_(type),
+        size_(size),
+        referenced_(referenced),
+        offset_(offset),
+        base_(base) {
+    DCHECK(IsValid());
+  }
+
+  // Copy constructor.
+  Reference(const Reference& other)
+      : type_(other.type_),
+        size_(other.size_),
+        referenced_(other.referenced_),
+        offset_(other.offset_),
+        base_(other.base_) {
+  }
+
+  // Accessors.
+  ReferenceType type() const { return type_; }
+  Size size() const { return size_; }
+  Block* referenced() const { return referenced_; }
+  Offset offset() const { return offset_; }
+  Offset base() const { return base_; }
+
+  // Determines if this is a direct reference. That is, if the actual location
+  // being referenced (offset) and the intended location being referenced (base)
+  // are the same.
+  //
+  // @returns true if the reference is direct, false otherwise.
+  bool IsDirect() const { return base_ == offset_; }
+
+  // Determines if this is a valid reference, by imposing size constraints on
+  // reference types, and determining if the base address of the reference is
+  // strictly contained within the referenced block.
+  //
+  // @returns true if valid, false otherwise.
+  bool IsValid() const;
+
+  bool operator==(const Reference& other) const {
+    return type_ == other.type_ &&
+        size_ == other.size_ &&
+        referenced_ == other.referenced_ &&
+        offset_ == other.offset_ &&
+        base_ == other.base_;
+  }
+
+  // The maximum size that a reference may have. This needs to be kept in sync
+  // with the expectations of IsValid().
+  static const size_t kMaximumSize = 4;
+
+  // Returns true if the given reference type and size combination is valid.
+  static bool IsValidTypeSize(ReferenceType type, Size size);
+
+ private:
+  // Type of this reference.
+  ReferenceType type_;
+
+  // Size of this reference.
+  // Absolute references are always pointer wide, but PC-relative
+  // references can be 1, 2 or 4 bytes wide, which affects their range.
+  Size size_;
+
+  // The block referenced.
+  Block* referenced_;
+
+  // Offset into the referenced block.
+  Offset offset_;
+
+  // The base of the reference, as in offset in the block. This must be a
+  // location strictly within the block.
+  Offset base_;
+};
+
 // A block represents a block of either code or data.
 //
 // Since blocks may be split and up and glued together in arbitrary ways, each
@@ -542,12 +765,21 @@ class BlockGraph::Block {
   // Set of the blocks that have a reference to this block.
   // This is keyed on block and source offset (not destination offset),
   // to allow one to easily locate and remove the backreferences on change or
-  // deletion.
+  // deletion. Most blocks have only a couple of referrers, while popular
+  // blocks like import thunks accumulate hundreds of thousands, so the set
+  // is kept in a small-size-optimized flat container whose deferred
+  // insertions absorb the backreference churn of decomposition. Note that
+  // mutating the set invalidates outstanding iterators into it.
   typedef std::pair<Block*, Offset> Referrer;
-  typedef std::set<Referrer> ReferrerSet;
+  typedef common::FlatSet<Referrer, 2> ReferrerSet;
 
-  // Map of references that this block makes to other blocks.
-  typedef std::map<Offset, Reference> ReferenceMap;
+  // Map of references that this block makes to other blocks. Most blocks
+  // carry only a handful of references, so these are kept in a
+  // small-size-optimized flat container rather than a node-based map;
+  // iteration order is by increasing source offset, as before. Note that
+  // inserting or erasing a reference invalidates outstanding iterators
+  // into this map.
+  typedef common::FlatMap<Offset, Reference, 8> ReferenceMap;
 
   // Represents a range of data in this block.
   typedef core::AddressRange<Offset, Size> DataRange;
@@ -577,7 +809,10 @@ class BlockGraph::Block {
   // Accessors.
   BlockId id() const { return id_; }
   BlockType type() const { return type_; }
-  void set_type(BlockType type) { type_ = type; }
+  void set_type(BlockType type) {
+    type_ = type;
+    InvalidateCachedDecisions();
+  }
 
   Size size() const { return size_; }
 
@@ -586,6 +821,7 @@ class BlockGraph::Block {
   void set_size(Size size) {
     DCHECK_LE(data_size_, size);
     size_ = size;
+    InvalidateCachedDecisions();
   }
 
   const std::string& name() const {
@@ -617,14 +853,27 @@ class BlockGraph::Block {
   // The block attributes are a bitmask. You can set them wholesale,
   // or set and clear them individually by bitmasking.
   BlockAttributes attributes() const { return attributes_; }
-  void set_attributes(BlockAttributes attributes) { attributes_ = attributes; }
+  void set_attributes(BlockAttributes attributes) {
+    attributes_ = attributes;
+    InvalidateCachedDecisions();
+  }
 
   // Set or clear one or more attributes.
-  void set_attribute(BlockAttributes attribute) { attributes_ |= attribute; }
+  void set_attribute(BlockAttributes attribute) {
+    attributes_ |= attribute;
+    InvalidateCachedDecisions();
+  }
   void clear_attribute(BlockAttributes attribute) {
     attributes_ &= ~attribute;
+    InvalidateCachedDecisions();
   }
 
+  // @name The BlockGraph this block belongs to.
+  // @{
+  BlockGraph* block_graph() { return block_graph_; }
+  const BlockGraph* block_graph() const { return block_graph_; }
+  // @}
+
   // This is true iff data_ is in the ownership of the block.
   // Iff true, the block will delete [] data_ on destruction or when
   // data is overwritten.
@@ -680,6 +929,21 @@ class BlockGraph::Block {
   // @pre data_size <= size().
   void SetData(const uint8* data, size_t data_size);
 
+  // Sets the data the block refers to as an extent of an external data
+  // source, without touching the bytes themselves. The extent is resolved to
+  // a pointer on first access, and an owned copy is only materialized on
+  // first mutation via GetMutableData. Blocks that are carried through a
+  // transformation unmodified thus never cost more than the extent
+  // bookkeeping.
+  // @param data_source NULL or the source holding the bytes. Must outlive
+  //     any access to the block's data.
+  // @param offset the offset of the data within @p data_source.
+  // @param data_size the size of the data, or zero if data_source == NULL.
+  // @pre data_size <= size().
+  void SetDeferredData(BlockDataSource* data_source,
+                       size_t offset,
+                       size_t data_size);
+
   // Allocates and returns a new data buffer of the given size. The returned
   // data will have been initialized to zero.
   // @pre data_size > 0.
@@ -698,8 +962,13 @@ class BlockGraph::Block {
   // the data on entry, it'll be copied and the copy returned to the caller.
   uint8* GetMutableData();
 
-  // The data bytes the block refers to.
-  const uint8* data() const { return data_; }
+  // The data bytes the block refers to. If the data is a deferred extent of
+  // an external source it is resolved to a pointer on first access.
+  const uint8* data() const {
+    if (data_ == NULL && data_source_ != NULL)
+      return ResolveDeferredData();
+    return data_;
+  }
 
   // The data size may be smaller than the block size (see size()),
   // when the block e.g. refers to data that's all or part
@@ -809,6 +1078,28 @@ class BlockGraph::Block {
   // data buffer will not have been initialized in any way.
   uint8* AllocateRawData(size_t size);
 
+  // Drops any policy decisions cached for this block on the parent graph.
+  // Mutators call this, as cached decisions are only valid for as long as
+  // the block is unmodified.
+  void InvalidateCachedDecisions() {
+    block_graph_->policy_decision_cache().Invalidate(id_);
+  }
+
+  // Resolves a deferred data extent to a pointer, caching the result in
+  // data_. The block continues to not own the data.
+  // @returns the resolved data.
+  const uint8* ResolveDeferredData() const;
+
+  // @name Data buffer memory management. These dispatch to the graph's data
+  //     arena when arena mode is enabled, and to the heap otherwise.
+  // @{
+  // Allocates an uninitialized buffer of @p size bytes.
+  uint8* AllocateDataBuffer(size_t size);
+  // Releases a buffer previously returned by AllocateDataBuffer. Arena
+  // backed buffers are freed wholesale by the graph, making this a no-op.
+  void FreeDataBuffer(const uint8* data);
+  // @}
+
   BlockId id_;
   BlockType type_;
   Size size_;
@@ -832,10 +1123,32 @@ class BlockGraph::Block {
   // True iff data_ is ours to deallocate with delete [].
   // If this is false, data_ must be guaranteed to outlive the block.
   bool owns_data_;
-  // A pointer to the code or data we represent.
-  const uint8* data_;
+  // A pointer to the code or data we represent. This is mutable as deferred
+  // data extents are lazily resolved into it on first access via the const
+  // data() accessor.
+  mutable const uint8* data_;
   // Size of the above.
   size_t data_size_;
+  // When non-NULL the block's data is a deferred extent of this source,
+  // starting at data_source_offset_. Cleared when the data is replaced or an
+  // owned copy is materialized.
+  BlockDataSource* data_source_;
+  size_t data_source_offset_;
+};
+
+// An interface through which a block can lazily reference a range of bytes
+// held in some external store, typically the source image being transformed.
+// See Block::SetDeferredData.
+class BlockGraph::BlockDataSource {
+ public:
+  virtual ~BlockDataSource() {}
+
+  // Retrieves a pointer to @p size bytes at @p offset of the source. The
+  // returned pointer must remain valid for the lifetime of the source.
+  // @param offset the offset of the data within the source.
+  // @param size the number of bytes required.
+  // @returns a pointer to the bytes, or NULL if the range is invalid.
+  virtual const uint8* GetData(size_t offset, size_t size) = 0;
 };
 
 // A graph address space endows a graph with a non-overlapping ordering
@@ -854,6 +1167,7 @@ class BlockGraph::AddressSpace {
   typedef AddressSpaceImpl::RangeMapIterPair RangeMapIterPair;
   typedef AddressSpaceImpl::RangeMapConstIterPair RangeMapConstIterPair;
   typedef stdext::hash_map<const Block*, RelativeAddress> BlockAddressMap;
+  typedef stdext::hash_map<uint32, Block*> BlockStartMap;
 
   // Constructs a new empty address space.
   // @p start to @p start + @p size on @p graph.
@@ -889,6 +1203,22 @@ class BlockGraph::AddressSpace {
   //     an existing block.
   bool InsertBlock(RelativeAddress addr, Block* block);
 
+  // Inserts a run of existing blocks at their associated addresses. The run
+  // must be sorted by address, free of overlaps, and lie entirely beyond any
+  // blocks already in the address space. This builds the underlying
+  // structure in O(n) time, versus the O(n lg n) of repeated InsertBlock
+  // calls.
+  // @param blocks the blocks to insert, paired with their addresses.
+  // @returns true on success, or false if the run is not sorted or would
+  //     overlap an existing block. On failure a prefix of @p blocks may
+  //     already have been inserted.
+  bool InsertBlocks(
+      const std::vector<std::pair<RelativeAddress, Block*>>& blocks);
+
+  // Removes all blocks from the address space. The blocks themselves remain
+  // owned by the block-graph and are not modified.
+  void Clear();
+
   // Returns a pointer to the block containing address, or NULL
   // if no block contains address.
   Block* GetBlockByAddress(RelativeAddress addr) const;
@@ -957,125 +1287,14 @@ class BlockGraph::AddressSpace {
 
   AddressSpaceImpl address_space_;
   BlockAddressMap block_addresses_;
+  // A hash index over the start addresses of the non-empty blocks in
+  // address_space_, used to service exact-start lookups (by far the most
+  // common, as reference fixups overwhelmingly point at block heads) without
+  // an ordered map walk.
+  BlockStartMap block_starts_;
   BlockGraph* graph_;
 };
 
-// Represents a reference from one block to another. References may be offset.
-// That is, they may refer to an object at a given location, but actually point
-// to a location that is some fixed distance away from that object. This allows,
-// for example, non-zero based indexing into a table. The object that is
-// intended to be dereferenced is called the 'base' of the offset.
-//
-// BlockGraph references are from a location (offset) in one block, to some
-// location in another block. The referenced block itself plays the role of the
-// 'base' of the reference, with the offset of the reference being stored as
-// an integer from the beginning of the block. However, basic block
-// decomposition requires breaking the block into smaller pieces and thus we
-// need to carry around an explicit base value, indicating which byte in the
-// block is intended to be referenced.
-//
-// A direct reference to a location will have the same value for 'base' and
-// 'offset'.
-//
-// Here is an example:
-//
-//        /----------\
-//        +---------------------------+
-//  O     |          B                | <--- Referenced block
-//        +---------------------------+      B = base
-//  \-----/                                  O = offset
-//
-class BlockGraph::Reference {
- public:
-  Reference() :
-      type_(RELATIVE_REF), size_(0), referenced_(NULL), offset_(0), base_(0) {
-  }
-
-  // @param type type of reference.
-  // @param size size of reference.
-  // @param referenced the referenced block.
-  // @param offset offset from the beginning of the block of the location to be
-  //     explicitly referred to.
-  // @param base offset into the block of the location actually being
-  //     referenced. This must be strictly within @p referenced.
-  Reference(ReferenceType type,
-            Size size,
-            Block* referenced,
-            Offset offset,
-            Offset base)
-      : type_(type),
-        size_(size),
-        referenced_(referenced),
-        offset_(offset),
-        base_(base) {
-    DCHECK(IsValid());
-  }
-
-  // Copy constructor.
-  Reference(const Reference& other)
-      : type_(other.type_),
-        size_(other.size_),
-        referenced_(other.referenced_),
-        offset_(other.offset_),
-        base_(other.base_) {
-  }
-
-  // Accessors.
-  ReferenceType type() const { return type_; }
-  Size size() const { return size_; }
-  Block* referenced() const { return referenced_; }
-  Offset offset() const { return offset_; }
-  Offset base() const { return base_; }
-
-  // Determines if this is a direct reference. That is, if the actual location
-  // being referenced (offset) and the intended location being referenced (base)
-  // are the same.
-  //
-  // @returns true if the reference is direct, false otherwise.
-  bool IsDirect() const { return base_ == offset_; }
-
-  // Determines if this is a valid reference, by imposing size constraints on
-  // reference types, and determining if the base address of the reference is
-  // strictly contained within the referenced block.
-  //
-  // @returns true if valid, false otherwise.
-  bool IsValid() const;
-
-  bool operator==(const Reference& other) const {
-    return type_ == other.type_ &&
-        size_ == other.size_ &&
-        referenced_ == other.referenced_ &&
-        offset_ == other.offset_ &&
-        base_ == other.base_;
-  }
-
-  // The maximum size that a reference may have. This needs to be kept in sync
-  // with the expectations of IsValid().
-  static const size_t kMaximumSize = 4;
-
-  // Returns true if the given reference type and size combination is valid.
-  static bool IsValidTypeSize(ReferenceType type, Size size);
-
- private:
-  // Type of this reference.
-  ReferenceType type_;
-
-  // Size of this reference.
-  // Absolute references are always pointer wide, but PC-relative
-  // references can be 1, 2 or 4 bytes wide, which affects their range.
-  Size size_;
-
-  // The block referenced.
-  Block* referenced_;
-
-  // Offset into the referenced block.
-  Offset offset_;
-
-  // The base of the reference, as in offset in the block. This must be a
-  // location strictly within the block.
-  Offset base_;
-};
-
 // Commonly used container types.
 typedef std::vector<BlockGraph::Block*> BlockVector;
 typedef std::vector<const BlockGraph::Block*> ConstBlockVector;
@@ -14,7 +14,12 @@
 
 #include "syzygy/block_graph/block_graph_serializer.h"
 
+#include <iterator>
+
+#include "base/bind.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/core/zstream.h"
 
 namespace block_graph {
 
@@ -30,11 +35,14 @@ using core::OutArchive;
 //     representation.
 // Version 3: Added image_format_ block-graph property.
 // Version 4: Deprecated old decomposer attributes.
-static const uint32 kSerializedBlockGraphVersion = 4;
+// Version 5: Partitioned the blocks into separately encoded property, data
+//     and reference chunks.
+static const uint32 kSerializedBlockGraphVersion = 5;
 
 // Some constants for use in dealing with backwards compatibility.
 static const uint32 kMinSupportedSerializedBlockGraphVersion = 2;
 static const uint32 kImageFormatPropertyBlockGraphVersion = 3;
+static const uint32 kPartitionedBlockGraphVersion = 5;
 
 // Potentially saves a string, depending on whether or not OMIT_STRINGS is
 // enabled.
@@ -77,6 +85,146 @@ bool ValidAttributes(uint32 attributes, uint32 attributes_max) {
   return (attributes & ~(attributes_max - 1)) == 0;
 }
 
+// Rough per-element encoded-size estimates, used to pre-size the chunk
+// buffers before encoding.
+const size_t kBlockPropertiesSizeEstimate = 64;
+const size_t kReferenceSizeEstimate = 12;
+const size_t kBlockDataHeaderEstimate = 8;
+
+// The callbacks used to encode and decode one chunk of the partitioned
+// format.
+typedef base::Callback<bool(OutArchive*)> SaveChunkCallback;
+typedef base::Callback<bool(InArchive*)> LoadChunkCallback;
+
+// A worker that encodes one chunk of the partitioned format into a byte
+// vector, optionally compressing it. The chunks are independent of one
+// another, so multiple encoders can run in parallel.
+class ChunkEncoder : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param save_chunk the callback that encodes the chunk.
+  // @param compress true to compress the encoded chunk.
+  // @param size_hint an estimated upper bound for the encoded size, used to
+  //     pre-size the output buffer. This is purely an optimization; an
+  //     inaccurate hint costs either slack memory or reallocations.
+  ChunkEncoder(const SaveChunkCallback& save_chunk,
+               bool compress,
+               size_t size_hint)
+      : save_chunk_(save_chunk),
+        compress_(compress),
+        size_hint_(size_hint),
+        success_(false) {
+  }
+
+  virtual void Run() OVERRIDE {
+    core::VectorOutStream byte_stream(&bytes_);
+    byte_stream.Reserve(size_hint_);
+    core::OutStream* out_stream = &byte_stream;
+
+    scoped_ptr<core::ZOutStream> zip_stream;
+    if (compress_) {
+      zip_stream.reset(new core::ZOutStream(&byte_stream));
+      if (!zip_stream->Init()) {
+        LOG(ERROR) << "Failed to initialize zlib compressor.";
+        return;
+      }
+      out_stream = zip_stream.get();
+    }
+
+    OutArchive out_archive(out_stream);
+    if (!save_chunk_.Run(&out_archive))
+      return;
+    if (!out_archive.Flush() || !byte_stream.Flush())
+      return;
+
+    success_ = true;
+  }
+
+  // @returns true iff the chunk was encoded successfully.
+  bool success() const { return success_; }
+
+  // @returns the encoded chunk.
+  const core::ByteVector& bytes() const { return bytes_; }
+
+ private:
+  SaveChunkCallback save_chunk_;
+  bool compress_;
+  size_t size_hint_;
+  core::ByteVector bytes_;
+  bool success_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkEncoder);
+};
+
+// A worker that decodes one chunk of the partitioned format from a byte
+// vector, decompressing it if necessary.
+class ChunkDecoder : public base::DelegateSimpleThread::Delegate {
+ public:
+  ChunkDecoder(const LoadChunkCallback& load_chunk, bool compressed)
+      : load_chunk_(load_chunk), compressed_(compressed), success_(false) {
+  }
+
+  // @returns the byte vector to be populated with the encoded chunk.
+  core::ByteVector* mutable_bytes() { return &bytes_; }
+
+  virtual void Run() OVERRIDE {
+    core::ScopedInStreamPtr byte_stream(
+        core::CreateByteInStream(bytes_.begin(), bytes_.end()));
+    core::InStream* in_stream = byte_stream.get();
+
+    scoped_ptr<core::ZInStream> zip_stream;
+    if (compressed_) {
+      zip_stream.reset(new core::ZInStream(byte_stream.get()));
+      if (!zip_stream->Init()) {
+        LOG(ERROR) << "Failed to initialize zlib decompressor.";
+        return;
+      }
+      in_stream = zip_stream.get();
+    }
+
+    InArchive in_archive(in_stream);
+    if (!load_chunk_.Run(&in_archive))
+      return;
+
+    success_ = true;
+  }
+
+  // @returns true iff the chunk was decoded successfully.
+  bool success() const { return success_; }
+
+ private:
+  LoadChunkCallback load_chunk_;
+  bool compressed_;
+  core::ByteVector bytes_;
+  bool success_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkDecoder);
+};
+
+// Writes an encoded chunk to the provided archive, prefixed by its length.
+bool WriteChunk(const core::ByteVector& bytes, OutArchive* out_archive) {
+  DCHECK(out_archive != NULL);
+
+  if (!out_archive->Save(static_cast<uint32>(bytes.size())))
+    return false;
+  if (bytes.empty())
+    return true;
+  return out_archive->out_stream()->Write(bytes.size(), &bytes[0]);
+}
+
+// Reads an encoded chunk from the provided archive.
+bool ReadChunk(InArchive* in_archive, core::ByteVector* bytes) {
+  DCHECK(in_archive != NULL);
+  DCHECK(bytes != NULL);
+
+  uint32 size = 0;
+  if (!in_archive->Load(&size))
+    return false;
+  bytes->resize(size);
+  if (size == 0)
+    return true;
+  return in_archive->in_stream()->Read(size, &bytes->at(0));
+}
+
 }  // namespace
 
 bool BlockGraphSerializer::Save(const BlockGraph& block_graph,
@@ -100,16 +248,10 @@ bool BlockGraphSerializer::Save(const BlockGraph& block_graph,
   if (!SaveBlockGraphProperties(block_graph, out_archive))
     return false;
 
-  // Save the blocks, except for their references. We do that in a second pass
-  // so that when loading the referenced blocks will exist.
-  if (!SaveBlocks(block_graph, out_archive)) {
-    LOG(ERROR) << "Unable to save blocks.";
-    return false;
-  }
-
-  // Save all of the references. The referrers are implicitly saved by this.
-  if (!SaveBlockGraphReferences(block_graph, out_archive)) {
-    LOG(ERROR) << "Unable to save block graph references.";
+  // Save the blocks and their references as a set of independently encoded
+  // chunks.
+  if (!SavePartitionedBlocks(block_graph, out_archive)) {
+    LOG(ERROR) << "Unable to save partitioned blocks.";
     return false;
   }
 
@@ -155,6 +297,15 @@ bool BlockGraphSerializer::Load(BlockGraph* block_graph,
   if (!LoadBlockGraphProperties(version, block_graph, in_archive))
     return false;
 
+  // Version 5 partitioned the blocks into separately encoded chunks.
+  if (version >= kPartitionedBlockGraphVersion) {
+    if (!LoadPartitionedBlocks(block_graph, in_archive)) {
+      LOG(ERROR) << "Unable to load partitioned blocks.";
+      return false;
+    }
+    return true;
+  }
+
   // Load the blocks, except for their references.
   if (!LoadBlocks(block_graph, in_archive)) {
     LOG(ERROR) << "Unable to load blocks.";
@@ -222,32 +373,6 @@ bool BlockGraphSerializer::LoadBlockGraphProperties(
   return true;
 }
 
-bool BlockGraphSerializer::SaveBlocks(const BlockGraph& block_graph,
-                                      OutArchive* out_archive) const {
-  DCHECK(out_archive != NULL);
-
-  if (!out_archive->Save(block_graph.blocks().size())) {
-    LOG(ERROR) << "Unable to save block count.";
-    return false;
-  }
-
-  // Output the basic block properties first.
-  BlockGraph::BlockMap::const_iterator it = block_graph.blocks_.begin();
-  for (; it != block_graph.blocks_.end(); ++it) {
-    BlockGraph::BlockId block_id = it->first;
-    const BlockGraph::Block& block = it->second;
-    if (!out_archive->Save(block_id) ||
-        !SaveBlockProperties(block, out_archive) ||
-        !SaveBlockLabels(block, out_archive) ||
-        !SaveBlockData(block, out_archive)) {
-      LOG(ERROR) << "Unable to save block with id " << block_id << ".";
-      return false;
-    }
-  }
-
-  return true;
-}
-
 bool BlockGraphSerializer::LoadBlocks(BlockGraph* block_graph,
                                       InArchive* in_archive) const {
   DCHECK(block_graph != NULL);
@@ -325,6 +450,226 @@ bool BlockGraphSerializer::LoadBlockGraphReferences(
   return true;
 }
 
+bool BlockGraphSerializer::SavePartitionedBlocks(
+    const BlockGraph& block_graph, OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  if (!SaveUint32(block_graph.blocks().size(), out_archive)) {
+    LOG(ERROR) << "Unable to save block count.";
+    return false;
+  }
+
+  // Compute upper-bound estimates for the encoded chunk sizes, so that the
+  // chunk buffers can be pre-sized. For large graphs, growing the buffers
+  // while encoding costs a series of large reallocations.
+  size_t block_count = block_graph.blocks().size();
+  size_t total_data_size = 0;
+  size_t total_references = 0;
+  BlockGraph::BlockMap::const_iterator block_it =
+      block_graph.blocks().begin();
+  for (; block_it != block_graph.blocks().end(); ++block_it) {
+    total_data_size += block_it->second.data_size();
+    total_references += block_it->second.references().size();
+  }
+
+  // Encode the property and reference chunks on worker threads. The data
+  // chunk is encoded on the calling thread so that any save callback is
+  // invoked there.
+  ChunkEncoder properties_encoder(
+      base::Bind(&BlockGraphSerializer::SaveBlockPropertiesChunk,
+                 base::Unretained(this),
+                 base::ConstRef(block_graph)),
+      false,
+      block_count * kBlockPropertiesSizeEstimate);
+  ChunkEncoder references_encoder(
+      base::Bind(&BlockGraphSerializer::SaveBlockGraphReferences,
+                 base::Unretained(this),
+                 base::ConstRef(block_graph)),
+      false,
+      total_references * kReferenceSizeEstimate);
+  ChunkEncoder data_encoder(
+      base::Bind(&BlockGraphSerializer::SaveBlockDataChunk,
+                 base::Unretained(this),
+                 base::ConstRef(block_graph)),
+      has_attributes(COMPRESS_DATA),
+      total_data_size + block_count * kBlockDataHeaderEstimate);
+
+  base::DelegateSimpleThread properties_thread(&properties_encoder,
+                                               "PropertiesChunkEncoder");
+  base::DelegateSimpleThread references_thread(&references_encoder,
+                                               "ReferencesChunkEncoder");
+  properties_thread.Start();
+  references_thread.Start();
+  data_encoder.Run();
+  properties_thread.Join();
+  references_thread.Join();
+
+  if (!properties_encoder.success() || !data_encoder.success() ||
+      !references_encoder.success()) {
+    LOG(ERROR) << "Unable to encode block chunks.";
+    return false;
+  }
+
+  // The chunks must be written in the order they are consumed at load time.
+  if (!WriteChunk(properties_encoder.bytes(), out_archive) ||
+      !WriteChunk(data_encoder.bytes(), out_archive) ||
+      !WriteChunk(references_encoder.bytes(), out_archive)) {
+    LOG(ERROR) << "Unable to write block chunks.";
+    return false;
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::LoadPartitionedBlocks(
+    BlockGraph* block_graph, InArchive* in_archive) const {
+  DCHECK(block_graph != NULL);
+  DCHECK(in_archive != NULL);
+
+  uint32 block_count = 0;
+  if (!LoadUint32(&block_count, in_archive)) {
+    LOG(ERROR) << "Unable to load block count.";
+    return false;
+  }
+
+  // Read the encoded chunks off the underlying stream up front; decoding
+  // then no longer depends on the stream and can proceed in parallel.
+  core::ByteVector properties_bytes;
+  ChunkDecoder data_decoder(
+      base::Bind(&BlockGraphSerializer::LoadBlockDataChunk,
+                 base::Unretained(this),
+                 base::Unretained(block_graph)),
+      has_attributes(COMPRESS_DATA));
+  ChunkDecoder references_decoder(
+      base::Bind(&BlockGraphSerializer::LoadBlockGraphReferences,
+                 base::Unretained(this),
+                 base::Unretained(block_graph)),
+      false);
+  if (!ReadChunk(in_archive, &properties_bytes) ||
+      !ReadChunk(in_archive, data_decoder.mutable_bytes()) ||
+      !ReadChunk(in_archive, references_decoder.mutable_bytes())) {
+    LOG(ERROR) << "Unable to read block chunks.";
+    return false;
+  }
+
+  // The properties chunk creates the blocks, so it must be fully decoded
+  // before the other two chunks can be.
+  core::ScopedInStreamPtr properties_stream(core::CreateByteInStream(
+      properties_bytes.begin(), properties_bytes.end()));
+  InArchive properties_archive(properties_stream.get());
+  if (!LoadBlockPropertiesChunk(block_count, block_graph,
+                                &properties_archive)) {
+    LOG(ERROR) << "Unable to load block properties chunk.";
+    return false;
+  }
+
+  // The data and reference chunks touch disjoint parts of the blocks, so
+  // they can be decoded concurrently. The data chunk is decoded on the
+  // calling thread so that any load callback is invoked there.
+  base::DelegateSimpleThread references_thread(&references_decoder,
+                                               "ReferencesChunkDecoder");
+  references_thread.Start();
+  data_decoder.Run();
+  references_thread.Join();
+
+  if (!data_decoder.success() || !references_decoder.success()) {
+    LOG(ERROR) << "Unable to decode block chunks.";
+    return false;
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::SaveBlockPropertiesChunk(
+    const BlockGraph& block_graph, OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  BlockGraph::BlockMap::const_iterator it = block_graph.blocks_.begin();
+  for (; it != block_graph.blocks_.end(); ++it) {
+    BlockGraph::BlockId block_id = it->first;
+    const BlockGraph::Block& block = it->second;
+    if (!out_archive->Save(block_id) ||
+        !SaveBlockProperties(block, out_archive) ||
+        !SaveBlockLabels(block, out_archive)) {
+      LOG(ERROR) << "Unable to save properties of block with id "
+                 << block_id << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::LoadBlockPropertiesChunk(
+    size_t block_count, BlockGraph* block_graph, InArchive* in_archive) const {
+  DCHECK(block_graph != NULL);
+  DCHECK(in_archive != NULL);
+
+  DCHECK_EQ(0u, block_graph->blocks_.size());
+
+  for (size_t i = 0; i < block_count; ++i) {
+    BlockGraph::BlockId id = 0;
+    if (!in_archive->Load(&id)) {
+      LOG(ERROR) << "Unable to load id for block " << i << " of "
+                 << block_count << ".";
+      return false;
+    }
+
+    std::pair<BlockGraph::BlockMap::iterator, bool> result =
+        block_graph->blocks_.insert(
+            std::make_pair(id, BlockGraph::Block(block_graph)));
+    if (!result.second) {
+      LOG(ERROR) << "Unable to insert block with id " << id << ".";
+      return false;
+    }
+    BlockGraph::Block* block = &result.first->second;
+    block->id_ = id;
+
+    if (!LoadBlockProperties(block, in_archive) ||
+        !LoadBlockLabels(block, in_archive)) {
+      LOG(ERROR) << "Unable to load properties of block " << i << " of "
+                 << block_count << " with id " << id << ".";
+      return false;
+    }
+  }
+  DCHECK_EQ(block_count, block_graph->blocks_.size());
+
+  return true;
+}
+
+bool BlockGraphSerializer::SaveBlockDataChunk(const BlockGraph& block_graph,
+                                              OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  BlockGraph::BlockMap::const_iterator it = block_graph.blocks_.begin();
+  for (; it != block_graph.blocks_.end(); ++it) {
+    if (!SaveBlockData(it->second, out_archive)) {
+      LOG(ERROR) << "Unable to save data of block with id "
+                 << it->first << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::LoadBlockDataChunk(BlockGraph* block_graph,
+                                              InArchive* in_archive) const {
+  DCHECK(block_graph != NULL);
+  DCHECK(in_archive != NULL);
+
+  BlockGraph::BlockMap::iterator it = block_graph->blocks_mutable().begin();
+  for (; it != block_graph->blocks_mutable().end(); ++it) {
+    if (!LoadBlockData(&it->second, in_archive)) {
+      LOG(ERROR) << "Unable to load data of block with id "
+                 << it->first << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
 bool BlockGraphSerializer::SaveBlockProperties(const BlockGraph::Block& block,
                                                OutArchive* out_archive) const {
   DCHECK(out_archive != NULL);
@@ -71,8 +71,13 @@ class BlockGraphSerializer {
     // block disassembly impossible.
     OMIT_LABELS = (1 << 1),
 
+    // If specified then the block data chunk of the partitioned format will
+    // be zlib compressed. This trades CPU time for a smaller serialization,
+    // and only pays off in the OUTPUT_OWNED_DATA and OUTPUT_ALL_DATA modes.
+    COMPRESS_DATA = (1 << 2),
+
     // This needs to be last, and the next unused attributes enum bit.
-    ATTRIBUTES_MAX = (1 << 2),
+    ATTRIBUTES_MAX = (1 << 3),
   };
 
   // Defines the callback used to save data for a block. The callback is given
@@ -212,7 +217,9 @@ class BlockGraphSerializer {
                                 BlockGraph* block_graph,
                                 InArchive* in_archive) const;
 
-  bool SaveBlocks(const BlockGraph& block_graph, OutArchive* out_archive) const;
+  // Loads the blocks of a pre-partitioned (version 4 and earlier)
+  // serialization, in which each block's properties, labels and data are
+  // interleaved in a single stream.
   bool LoadBlocks(BlockGraph* block_graph, InArchive* in_archive) const;
 
   bool SaveBlockGraphReferences(const BlockGraph& block_graph,
@@ -220,6 +227,30 @@ class BlockGraphSerializer {
   bool LoadBlockGraphReferences(BlockGraph* block_graph,
                                 InArchive* in_archive) const;
 
+  // @{
+  // The partitioned format (serialization version 5 and up) stores the blocks
+  // as three independently encoded chunks: block properties and labels, block
+  // data, and references. The chunks are encoded and decoded in parallel,
+  // with the data chunk - and thus any block data callback - always being
+  // handled on the calling thread. The data chunk may additionally be zlib
+  // compressed (see COMPRESS_DATA).
+  bool SavePartitionedBlocks(const BlockGraph& block_graph,
+                             OutArchive* out_archive) const;
+  bool LoadPartitionedBlocks(BlockGraph* block_graph,
+                             InArchive* in_archive) const;
+
+  bool SaveBlockPropertiesChunk(const BlockGraph& block_graph,
+                                OutArchive* out_archive) const;
+  bool LoadBlockPropertiesChunk(size_t block_count,
+                                BlockGraph* block_graph,
+                                InArchive* in_archive) const;
+
+  bool SaveBlockDataChunk(const BlockGraph& block_graph,
+                          OutArchive* out_archive) const;
+  bool LoadBlockDataChunk(BlockGraph* block_graph,
+                          InArchive* in_archive) const;
+  // @}
+
   bool SaveBlockProperties(const BlockGraph::Block& block,
                            OutArchive* out_archive) const;
   bool LoadBlockProperties(BlockGraph::Block* block,
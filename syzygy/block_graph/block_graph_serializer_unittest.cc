@@ -521,6 +521,20 @@ TEST_F(BlockGraphSerializerTest, RoundTripAllData) {
       eNoBlockDataCallbacks, 0));
 }
 
+TEST_F(BlockGraphSerializerTest, RoundTripOwnedDataCompressed) {
+  ASSERT_NO_FATAL_FAILURE(TestRoundTrip(
+      BlockGraphSerializer::OUTPUT_OWNED_DATA,
+      BlockGraphSerializer::COMPRESS_DATA,
+      eInitBlockDataCallbacks1, 2));
+}
+
+TEST_F(BlockGraphSerializerTest, RoundTripAllDataCompressed) {
+  ASSERT_NO_FATAL_FAILURE(TestRoundTrip(
+      BlockGraphSerializer::OUTPUT_ALL_DATA,
+      BlockGraphSerializer::COMPRESS_DATA,
+      eNoBlockDataCallbacks, 0));
+}
+
 // TODO(chrisha): Do a heck of a lot more testing of protected member functions.
 
 }  // namespace block_graph
@@ -86,6 +86,24 @@ class BlockTest: public testing::Test {
 const char* BlockTest::kBlockName = "block";
 const uint8 BlockTest::kTestData[] = "who's your daddy?";
 
+// A block data source that hands out pointers into a static buffer and
+// counts how often it is asked for data.
+class TestBlockDataSource : public BlockGraph::BlockDataSource {
+ public:
+  TestBlockDataSource() : get_data_count_(0) {}
+
+  virtual const uint8* GetData(size_t offset, size_t size) OVERRIDE {
+    EXPECT_LE(offset + size, sizeof(kSourceData));
+    ++get_data_count_;
+    return kSourceData + offset;
+  }
+
+  static const uint8 kSourceData[];
+  size_t get_data_count_;
+};
+
+const uint8 TestBlockDataSource::kSourceData[] = "deferred source data";
+
 TEST(ReferenceTest, Initialization) {
   BlockGraph block_graph;
   BlockGraph::Block* block =
@@ -313,6 +331,46 @@ TEST_F(BlockTest, GetMutableData) {
   ASSERT_EQ(data, block_->GetMutableData());
 }
 
+TEST_F(BlockTest, SetDeferredData) {
+  TestBlockDataSource data_source;
+  static const size_t kOffset = 2;
+  static const size_t kDataSize =
+      sizeof(TestBlockDataSource::kSourceData) - kOffset;
+  block_->SetDeferredData(&data_source, kOffset, kDataSize);
+  ASSERT_FALSE(block_->owns_data());
+  ASSERT_EQ(kDataSize, block_->data_size());
+
+  // The source should not have been touched yet.
+  ASSERT_EQ(0u, data_source.get_data_count_);
+
+  // The extent should resolve on first access and the resolution should be
+  // cached.
+  ASSERT_EQ(TestBlockDataSource::kSourceData + kOffset, block_->data());
+  ASSERT_EQ(1u, data_source.get_data_count_);
+  ASSERT_EQ(TestBlockDataSource::kSourceData + kOffset, block_->data());
+  ASSERT_EQ(1u, data_source.get_data_count_);
+  ASSERT_FALSE(block_->owns_data());
+}
+
+TEST_F(BlockTest, GetMutableDataMaterializesDeferredData) {
+  TestBlockDataSource data_source;
+  static const size_t kDataSize = sizeof(TestBlockDataSource::kSourceData);
+  block_->SetDeferredData(&data_source, 0, kDataSize);
+
+  // Mutation should materialize an owned copy of the source bytes.
+  uint8* data = block_->GetMutableData();
+  ASSERT_TRUE(data != NULL);
+  ASSERT_TRUE(data != TestBlockDataSource::kSourceData);
+  ASSERT_TRUE(block_->owns_data());
+  ASSERT_EQ(kDataSize, block_->data_size());
+  ASSERT_EQ(0, memcmp(TestBlockDataSource::kSourceData, data, kDataSize));
+
+  // The source should not be consulted again once the copy is made.
+  ASSERT_EQ(1u, data_source.get_data_count_);
+  ASSERT_EQ(data, block_->GetMutableData());
+  ASSERT_EQ(1u, data_source.get_data_count_);
+}
+
 TEST_F(BlockTest, InsertData) {
   // Create a block with a labelled array of pointers. Explicitly initialize
   // the last one with some data and let the block be longer than its
@@ -906,6 +964,34 @@ TEST(BlockGraphTest, RemoveSection) {
   ASSERT_EQ(0u, image.sections().size());
 }
 
+TEST(BlockGraphTest, DataArena) {
+  const uint8 kData[] = "arena backed data";
+
+  BlockGraph image;
+  EXPECT_TRUE(image.data_arena() == NULL);
+  image.EnableDataArena();
+  ASSERT_TRUE(image.data_arena() != NULL);
+
+  BlockGraph::Block* block =
+      image.AddBlock(BlockGraph::DATA_BLOCK, 0x40, "arena");
+  uint8* data = block->CopyData(sizeof(kData), kData);
+  ASSERT_TRUE(data != NULL);
+  ASSERT_TRUE(block->owns_data());
+  EXPECT_EQ(0, ::memcmp(kData, block->data(), sizeof(kData)));
+
+  // Resizing and mutating must behave exactly as in heap mode.
+  const uint8* resized = block->ResizeData(0x40);
+  ASSERT_TRUE(resized != NULL);
+  EXPECT_EQ(0, ::memcmp(kData, resized, sizeof(kData)));
+  EXPECT_TRUE(block->GetMutableData() != NULL);
+
+  // All of the above came out of the graph's arena.
+  EXPECT_LE(0x40u + sizeof(kData), image.data_arena()->bytes_allocated());
+
+  // Removing a block while in arena mode must be safe.
+  EXPECT_TRUE(image.RemoveBlock(block));
+}
+
 TEST(BlockGraphTest, RemoveBlock) {
   BlockGraph image;
 
@@ -957,6 +1043,70 @@ TEST(BlockGraphTest, RemoveBlock) {
   EXPECT_EQ(2u, image.blocks().size());
 }
 
+TEST(BlockGraphTest, Fork) {
+  const uint8 kData[] = "forked data";
+
+  BlockGraph image;
+  image.set_image_format(BlockGraph::PE_IMAGE);
+  BlockGraph::Section* section = image.AddSection(".text", 0x12345678);
+  ASSERT_TRUE(section != NULL);
+
+  BlockGraph::Block* b1 = image.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "b1");
+  BlockGraph::Block* b2 = image.AddBlock(BlockGraph::DATA_BLOCK, 0x20, "b2");
+  ASSERT_TRUE(b1 != NULL);
+  ASSERT_TRUE(b2 != NULL);
+  b1->set_section(section->id());
+  b1->set_alignment(16);
+  b1->SetLabel(4, "label", BlockGraph::CODE_LABEL);
+  ASSERT_TRUE(b2->CopyData(sizeof(kData), kData) != NULL);
+  BlockGraph::Reference ref12(BlockGraph::ABSOLUTE_REF, 4, b2, 9, 9);
+  ASSERT_TRUE(b1->SetReference(0, ref12));
+
+  BlockGraph child;
+  image.Fork(&child);
+
+  // The sections and block metadata must have been copied.
+  EXPECT_EQ(BlockGraph::PE_IMAGE, child.image_format());
+  EXPECT_EQ(image.sections(), child.sections());
+  ASSERT_EQ(2u, child.blocks().size());
+  BlockGraph::Block* c1 = child.GetBlockById(b1->id());
+  BlockGraph::Block* c2 = child.GetBlockById(b2->id());
+  ASSERT_TRUE(c1 != NULL);
+  ASSERT_TRUE(c2 != NULL);
+  EXPECT_EQ(b1->name(), c1->name());
+  EXPECT_EQ(b1->section(), c1->section());
+  EXPECT_EQ(b1->alignment(), c1->alignment());
+  EXPECT_TRUE(c1->HasLabel(4));
+
+  // The references must point at the child's own blocks.
+  BlockGraph::Reference child_ref;
+  ASSERT_TRUE(c1->GetReference(0, &child_ref));
+  EXPECT_EQ(c2, child_ref.referenced());
+  EXPECT_EQ(ref12.offset(), child_ref.offset());
+  EXPECT_THAT(c2->referrers(), testing::Contains(std::make_pair(c1, 0)));
+
+  // The child aliases the parent's data without owning it.
+  EXPECT_FALSE(c2->owns_data());
+  EXPECT_EQ(b2->data(), c2->data());
+  EXPECT_EQ(b2->data_size(), c2->data_size());
+
+  // Mutating the child's data materializes a private copy and leaves the
+  // parent untouched.
+  uint8* mutable_data = c2->GetMutableData();
+  ASSERT_TRUE(mutable_data != NULL);
+  EXPECT_TRUE(c2->owns_data());
+  EXPECT_NE(b2->data(), c2->data());
+  mutable_data[0] = 'F';
+  EXPECT_EQ(0, ::memcmp(kData, b2->data(), sizeof(kData)));
+
+  // New blocks in the child must not collide with forked block ids.
+  BlockGraph::Block* c3 = child.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "c3");
+  ASSERT_TRUE(c3 != NULL);
+  EXPECT_TRUE(image.GetBlockById(c3->id()) == NULL);
+  EXPECT_NE(b1->id(), c3->id());
+  EXPECT_NE(b2->id(), c3->id());
+}
+
 TEST(BlockGraphTest, References) {
   BlockGraph image;
 
@@ -1062,6 +1212,38 @@ TEST(BlockGraphTest, References) {
   EXPECT_THAT(b2->referrers(), BlockGraph::Block::ReferrerSet());
 }
 
+TEST(BlockGraphTest, TransferReferrersSkipsInternalReferences) {
+  BlockGraph image;
+
+  BlockGraph::Block* b1 = image.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "b1");
+  BlockGraph::Block* b2 = image.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "b2");
+  BlockGraph::Block* b3 = image.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "b3");
+  ASSERT_TRUE(b1 != NULL);
+  ASSERT_TRUE(b2 != NULL);
+  ASSERT_TRUE(b3 != NULL);
+
+  // An external reference from b1 to b2, and an internal reference from b2
+  // to itself.
+  BlockGraph::Reference external(BlockGraph::ABSOLUTE_REF, 4, b2, 4, 4);
+  ASSERT_TRUE(b1->SetReference(0, external));
+  BlockGraph::Reference internal(BlockGraph::ABSOLUTE_REF, 4, b2, 8, 8);
+  ASSERT_TRUE(b2->SetReference(4, internal));
+
+  ASSERT_TRUE(b2->TransferReferrers(
+      0, b3, BlockGraph::Block::kSkipInternalReferences));
+
+  // The external reference has moved to b3 but the internal one stays put.
+  BlockGraph::Reference ref;
+  ASSERT_TRUE(b1->GetReference(0, &ref));
+  EXPECT_EQ(b3, ref.referenced());
+  ASSERT_TRUE(b2->GetReference(4, &ref));
+  EXPECT_EQ(b2, ref.referenced());
+  EXPECT_EQ(1u, b2->referrers().size());
+  EXPECT_THAT(b2->referrers(), testing::Contains(std::make_pair(b2, 4)));
+  EXPECT_EQ(1u, b3->referrers().size());
+  EXPECT_THAT(b3->referrers(), testing::Contains(std::make_pair(b1, 0)));
+}
+
 TEST(BlockGraphTest, Labels) {
   BlockGraph image;
 
@@ -1131,6 +1313,38 @@ TEST(BlockGraphTest, StringTable) {
   EXPECT_NE(&interned_str3, &interned_str4);
 }
 
+TEST(BlockGraphTest, PolicyDecisionCache) {
+  BlockGraph block_graph;
+  PolicyDecisionCache& cache = block_graph.policy_decision_cache();
+
+  BlockGraph::Block* block = block_graph.AddBlock(
+      BlockGraph::CODE_BLOCK, 0x20, "code");
+  ASSERT_TRUE(block != NULL);
+
+  // Nothing is known about the block initially.
+  bool decision = true;
+  EXPECT_FALSE(cache.Lookup(block->id(), &decision));
+
+  cache.Store(block->id(), false);
+  EXPECT_TRUE(cache.Lookup(block->id(), &decision));
+  EXPECT_FALSE(decision);
+
+  cache.Store(block->id(), true);
+  EXPECT_TRUE(cache.Lookup(block->id(), &decision));
+  EXPECT_TRUE(decision);
+
+  // Mutating the block drops its cached decision.
+  block->set_attribute(BlockGraph::HAS_INLINE_ASSEMBLY);
+  EXPECT_FALSE(cache.Lookup(block->id(), &decision));
+
+  // A change of configuration clears the whole cache.
+  cache.Store(block->id(), true);
+  cache.SetConfiguration(0);
+  EXPECT_TRUE(cache.Lookup(block->id(), &decision));
+  cache.SetConfiguration(1);
+  EXPECT_FALSE(cache.Lookup(block->id(), &decision));
+}
+
 namespace {
 
 class BlockGraphSerializationTest : public testing::Test {
@@ -1322,6 +1536,78 @@ TEST(BlockGraphAddressSpaceTest, InsertBlock) {
   EXPECT_EQ(0x2000, block1->addr().value());
 }
 
+TEST(BlockGraphAddressSpaceTest, InsertBlocks) {
+  BlockGraph image;
+  BlockGraph::AddressSpace address_space(&image);
+
+  BlockGraph::Block* block1 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "code");
+  BlockGraph::Block* block2 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "code");
+  BlockGraph::Block* block3 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0, "code");
+  BlockGraph::Block* block4 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "code");
+
+  std::vector<std::pair<RelativeAddress, BlockGraph::Block*>> blocks;
+  blocks.push_back(std::make_pair(RelativeAddress(0x1000), block1));
+  blocks.push_back(std::make_pair(RelativeAddress(0x1010), block2));
+  blocks.push_back(std::make_pair(RelativeAddress(0x1030), block3));
+  blocks.push_back(std::make_pair(RelativeAddress(0x1030), block4));
+  ASSERT_TRUE(address_space.InsertBlocks(blocks));
+  EXPECT_EQ(4u, address_space.size());
+  EXPECT_EQ(3u, address_space.address_space_impl().size());
+
+  RelativeAddress addr;
+  EXPECT_TRUE(address_space.GetAddressOf(block1, &addr));
+  EXPECT_EQ(0x1000, addr.value());
+  EXPECT_TRUE(address_space.GetAddressOf(block2, &addr));
+  EXPECT_EQ(0x1010, addr.value());
+  EXPECT_TRUE(address_space.GetAddressOf(block3, &addr));
+  EXPECT_EQ(0x1030, addr.value());
+  EXPECT_TRUE(address_space.GetAddressOf(block4, &addr));
+  EXPECT_EQ(0x1030, addr.value());
+
+  EXPECT_EQ(block1, address_space.GetBlockByAddress(RelativeAddress(0x1000)));
+  EXPECT_EQ(block2, address_space.GetBlockByAddress(RelativeAddress(0x101F)));
+  EXPECT_EQ(block4, address_space.GetBlockByAddress(RelativeAddress(0x1030)));
+
+  // A run that is not sorted with respect to the existing blocks should be
+  // rejected.
+  BlockGraph::Block* block5 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "code");
+  blocks.clear();
+  blocks.push_back(std::make_pair(RelativeAddress(0x1020), block5));
+  EXPECT_FALSE(address_space.InsertBlocks(blocks));
+}
+
+TEST(BlockGraphAddressSpaceTest, Clear) {
+  BlockGraph image;
+  BlockGraph::AddressSpace address_space(&image);
+
+  BlockGraph::Block* block1 = address_space.AddBlock(
+      BlockGraph::CODE_BLOCK, RelativeAddress(0x1000), 0x10, "code");
+  BlockGraph::Block* block2 = address_space.AddBlock(
+      BlockGraph::CODE_BLOCK, RelativeAddress(0x1010), 0x10, "code");
+  ASSERT_TRUE(block1 != NULL);
+  ASSERT_TRUE(block2 != NULL);
+  EXPECT_EQ(2u, address_space.size());
+
+  address_space.Clear();
+  EXPECT_EQ(0u, address_space.size());
+  EXPECT_EQ(0u, address_space.address_space_impl().size());
+  EXPECT_EQ(NULL, address_space.GetBlockByAddress(RelativeAddress(0x1000)));
+
+  // The blocks themselves must still be owned by the block-graph, and may
+  // be reinserted.
+  EXPECT_EQ(2u, image.blocks().size());
+  std::vector<std::pair<RelativeAddress, BlockGraph::Block*>> blocks;
+  blocks.push_back(std::make_pair(RelativeAddress(0x1000), block1));
+  blocks.push_back(std::make_pair(RelativeAddress(0x1010), block2));
+  EXPECT_TRUE(address_space.InsertBlocks(blocks));
+  EXPECT_EQ(2u, address_space.size());
+}
+
 TEST(BlockGraphAddressSpaceTest, GetBlockByAddress) {
   BlockGraph image;
   BlockGraph::AddressSpace address_space(&image);
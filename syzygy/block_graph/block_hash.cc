@@ -16,35 +16,209 @@
 
 namespace block_graph {
 
-using base::MD5Context;
-using base::MD5Final;
-using base::MD5Init;
-using base::MD5Update;
+namespace {
+
 using base::StringPiece;
 
-void BlockHash::Hash(const BlockGraph::Block* block) {
-  DCHECK(block != NULL);
+// Mixing constants for the fast hash, as used by the xxHash family.
+const uint64 kFastHashPrime1 = 11400714785074694791ULL;
+const uint64 kFastHashPrime2 = 14029467366897019727ULL;
+const uint64 kFastHashPrime3 = 1609587929392839161ULL;
+const uint64 kFastHashPrime4 = 9650029242287828579ULL;
+const uint64 kFastHashPrime5 = 2870177450012600261ULL;
+
+inline uint64 RotateLeft64(uint64 value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+// A streaming 64-bit non-cryptographic hash in the style of xxHash: input
+// is consumed in 32-byte stripes across four accumulators, each mixed with
+// a multiply and a rotate, and the accumulators are merged and avalanched
+// at finalization. Cheap enough that per-block state setup is negligible.
+class FastHash64 {
+ public:
+  explicit FastHash64(uint64 seed)
+      : v1_(seed + kFastHashPrime1 + kFastHashPrime2),
+        v2_(seed + kFastHashPrime2),
+        v3_(seed),
+        v4_(seed - kFastHashPrime1),
+        total_length_(0),
+        buffered_(0) {
+  }
+
+  void Update(const void* data, size_t length) {
+    const uint8* bytes = static_cast<const uint8*>(data);
+    total_length_ += length;
+
+    // Top up and consume the stripe buffer first.
+    if (buffered_ != 0) {
+      size_t to_copy = sizeof(buffer_) - buffered_;
+      if (to_copy > length)
+        to_copy = length;
+      ::memcpy(buffer_ + buffered_, bytes, to_copy);
+      buffered_ += to_copy;
+      bytes += to_copy;
+      length -= to_copy;
+      if (buffered_ < sizeof(buffer_))
+        return;
+      ConsumeStripe(buffer_);
+      buffered_ = 0;
+    }
+
+    // Consume whole stripes directly from the input.
+    while (length >= sizeof(buffer_)) {
+      ConsumeStripe(bytes);
+      bytes += sizeof(buffer_);
+      length -= sizeof(buffer_);
+    }
+
+    // Buffer any tail.
+    if (length != 0) {
+      ::memcpy(buffer_, bytes, length);
+      buffered_ = length;
+    }
+  }
+
+  uint64 Final() {
+    uint64 hash = 0;
+    if (total_length_ >= sizeof(buffer_)) {
+      hash = RotateLeft64(v1_, 1) + RotateLeft64(v2_, 7) +
+          RotateLeft64(v3_, 12) + RotateLeft64(v4_, 18);
+      hash = MergeAccumulator(hash, v1_);
+      hash = MergeAccumulator(hash, v2_);
+      hash = MergeAccumulator(hash, v3_);
+      hash = MergeAccumulator(hash, v4_);
+    } else {
+      hash = v3_ + kFastHashPrime5;
+    }
+    hash += total_length_;
+
+    // Mix in the buffered tail.
+    const uint8* bytes = buffer_;
+    size_t length = buffered_;
+    while (length >= sizeof(uint64)) {
+      uint64 chunk = 0;
+      ::memcpy(&chunk, bytes, sizeof(chunk));
+      hash ^= Round(0, chunk);
+      hash = RotateLeft64(hash, 27) * kFastHashPrime1 + kFastHashPrime4;
+      bytes += sizeof(uint64);
+      length -= sizeof(uint64);
+    }
+    if (length >= sizeof(uint32)) {
+      uint32 chunk = 0;
+      ::memcpy(&chunk, bytes, sizeof(chunk));
+      hash ^= chunk * kFastHashPrime1;
+      hash = RotateLeft64(hash, 23) * kFastHashPrime2 + kFastHashPrime3;
+      bytes += sizeof(uint32);
+      length -= sizeof(uint32);
+    }
+    while (length != 0) {
+      hash ^= *bytes * kFastHashPrime5;
+      hash = RotateLeft64(hash, 11) * kFastHashPrime1;
+      ++bytes;
+      --length;
+    }
+
+    // Final avalanche.
+    hash ^= hash >> 33;
+    hash *= kFastHashPrime2;
+    hash ^= hash >> 29;
+    hash *= kFastHashPrime3;
+    hash ^= hash >> 32;
+    return hash;
+  }
+
+ private:
+  static uint64 Round(uint64 accumulator, uint64 chunk) {
+    accumulator += chunk * kFastHashPrime2;
+    accumulator = RotateLeft64(accumulator, 31);
+    return accumulator * kFastHashPrime1;
+  }
+
+  static uint64 MergeAccumulator(uint64 hash, uint64 accumulator) {
+    hash ^= Round(0, accumulator);
+    return hash * kFastHashPrime1 + kFastHashPrime4;
+  }
 
-  MD5Context md5_context;
-  MD5Init(&md5_context);
+  void ConsumeStripe(const uint8* stripe) {
+    uint64 chunks[4];
+    ::memcpy(chunks, stripe, sizeof(chunks));
+    v1_ = Round(v1_, chunks[0]);
+    v2_ = Round(v2_, chunks[1]);
+    v3_ = Round(v3_, chunks[2]);
+    v4_ = Round(v4_, chunks[3]);
+  }
+
+  uint64 v1_;
+  uint64 v2_;
+  uint64 v3_;
+  uint64 v4_;
+  uint64 total_length_;
+  uint8 buffer_[32];
+  size_t buffered_;
+};
+
+// Adapts the MD5 digest to the updater interface StreamBlock expects.
+class Md5Updater {
+ public:
+  Md5Updater() {
+    base::MD5Init(&context_);
+  }
+
+  void Update(const void* data, size_t length) {
+    base::MD5Update(&context_,
+        StringPiece(static_cast<const char*>(data), length));
+  }
+
+  void Final(base::MD5Digest* digest) {
+    base::MD5Final(digest, &context_);
+  }
+
+ private:
+  base::MD5Context context_;
+};
+
+// Produces a 128-bit fast fingerprint by running two independently seeded
+// 64-bit hashes over the same stream.
+class FastUpdater {
+ public:
+  FastUpdater() : low_(0), high_(1) {
+  }
 
-  // Hash the block properties: type, size, data_size, reference count.
+  void Update(const void* data, size_t length) {
+    low_.Update(data, length);
+    high_.Update(data, length);
+  }
+
+  void Final(base::MD5Digest* digest) {
+    uint64 parts[2] = { low_.Final(), high_.Final() };
+    COMPILE_ASSERT(sizeof(digest->a) == sizeof(parts), digest_size_mismatch);
+    ::memcpy(digest->a, parts, sizeof(parts));
+  }
+
+ private:
+  FastHash64 low_;
+  FastHash64 high_;
+};
+
+// Streams the canonical serialization of @p block into @p updater. See
+// BlockHash::Hash for a description of the serialization.
+template <typename Updater>
+void StreamBlock(const BlockGraph::Block* block, Updater* updater) {
+  DCHECK(block != NULL);
+  DCHECK(updater != NULL);
+
+  // Stream the block properties: type, size, data_size, reference count.
   BlockGraph::BlockType type = block->type();
   BlockGraph::Size size = block->size();
   BlockGraph::Size data_size = block->data_size();
   size_t reference_count = block->references().size();
-  MD5Update(&md5_context,
-      StringPiece(reinterpret_cast<const char*>(&type), sizeof(type)));
-  MD5Update(&md5_context,
-      StringPiece(reinterpret_cast<const char*>(&size), sizeof(size)));
-  MD5Update(&md5_context,
-      StringPiece(reinterpret_cast<const char*>(&data_size),
-                  sizeof(data_size)));
-  MD5Update(&md5_context,
-      StringPiece(reinterpret_cast<const char*>(&reference_count),
-                        sizeof(data_size)));
-
-  // Hash the references in order of increasing source offset.
+  updater->Update(&type, sizeof(type));
+  updater->Update(&size, sizeof(size));
+  updater->Update(&data_size, sizeof(data_size));
+  updater->Update(&reference_count, sizeof(reference_count));
+
+  // Stream the references in order of increasing source offset.
   BlockGraph::Block::ReferenceMap::const_iterator ref =
       block->references().begin();
   BlockGraph::Offset last_source_offset = -1;
@@ -52,61 +226,74 @@ void BlockHash::Hash(const BlockGraph::Block* block) {
     CHECK_LT(last_source_offset, ref->first);
     last_source_offset = ref->first;
 
-    // Hash the reference: source offset, type, size.
+    // Stream the reference: source offset, type, size.
     BlockGraph::Offset offset = ref->first;
-    BlockGraph::ReferenceType type = ref->second.type();
-    BlockGraph::Size size = ref->second.size();
-    MD5Update(&md5_context,
-        StringPiece(reinterpret_cast<const char*>(&offset), sizeof(offset)));
-    MD5Update(&md5_context,
-        StringPiece(reinterpret_cast<const char*>(&type), sizeof(type)));
-    MD5Update(&md5_context,
-        StringPiece(reinterpret_cast<const char*>(&size), sizeof(size)));
+    BlockGraph::ReferenceType ref_type = ref->second.type();
+    BlockGraph::Size ref_size = ref->second.size();
+    updater->Update(&offset, sizeof(offset));
+    updater->Update(&ref_type, sizeof(ref_type));
+    updater->Update(&ref_size, sizeof(ref_size));
   }
 
-  // Hash the data, skipping locations of references.
+  // Stream the data, skipping locations of references.
   size_t data_index = 0;
   ref = block->references().begin();
   for (; ref != block->references().end(); ++ref) {
     DCHECK_LE(0, ref->first);
     size_t ref_offset = static_cast<size_t>(ref->first);
 
-    // Have data to hash before this reference?
+    // Have data to stream before this reference?
     if (data_index < block->data_size() && data_index < ref_offset) {
       size_t data_end = block->data_size();
       if (ref_offset < data_end)
         data_end = ref_offset;
 
-      MD5Update(&md5_context,
-          StringPiece(reinterpret_cast<const char*>(
-              block->data() + data_index), data_end - data_index));
+      updater->Update(block->data() + data_index, data_end - data_index);
     }
 
     // Skip past this reference.
     data_index = ref_offset + ref->second.size();
   }
 
-  // Hash any data after the last reference.
+  // Stream any data after the last reference.
   if (data_index < block->data_size()) {
-    MD5Update(&md5_context,
-        StringPiece(reinterpret_cast<const char*>(
-            block->data() + data_index), block->data_size() - data_index));
+    updater->Update(block->data() + data_index,
+                    block->data_size() - data_index);
     data_index = block->data_size();
   }
 
-  // Hash any trailing zero bytes in the block. The zeros are implied if the
-  // data size is less than the block size.
+  // Stream any trailing zero bytes in the block. The zeros are implied if
+  // the data size is less than the block size.
   while (data_index < block->size()) {
     static const char kZeros[32] = { 0 };
     size_t bytes = block->size() - data_index;
     if (bytes > sizeof(kZeros))
       bytes = sizeof(kZeros);
-    MD5Update(&md5_context, StringPiece(kZeros, bytes));
+    updater->Update(kZeros, bytes);
     data_index += bytes;
   }
+}
+
+}  // namespace
 
-  // Finalize the hash.
-  MD5Final(&md5_digest, &md5_context);
+void BlockHash::Hash(const BlockGraph::Block* block) {
+  Hash(block, kBlockHashMd5);
+}
+
+void BlockHash::Hash(const BlockGraph::Block* block,
+                     BlockHashAlgorithm algorithm) {
+  DCHECK(block != NULL);
+
+  if (algorithm == kBlockHashMd5) {
+    Md5Updater updater;
+    StreamBlock(block, &updater);
+    updater.Final(&md5_digest);
+  } else {
+    DCHECK_EQ(kBlockHashFast, algorithm);
+    FastUpdater updater;
+    StreamBlock(block, &updater);
+    updater.Final(&md5_digest);
+  }
 }
 
 }  // namespace block_graph
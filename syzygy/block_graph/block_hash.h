@@ -23,8 +23,21 @@ namespace block_graph {
 
 using block_graph::BlockGraph;
 
+// The hash algorithms available to BlockHash.
+enum BlockHashAlgorithm {
+  // A cryptographic-strength MD5 digest. This is the default.
+  kBlockHashMd5,
+
+  // A fast non-cryptographic 128-bit fingerprint, roughly an order of
+  // magnitude cheaper to compute than MD5. Appropriate for duplicate
+  // detection and cache lookups, where adversarial collisions are not a
+  // concern. Hashes computed with different algorithms must not be
+  // compared to one another.
+  kBlockHashFast,
+};
+
 // Represents a hash of the content of a block. Internally we store an 128-bit
-// MD5 digest, but this endows it with comparison operators. We explicitly
+// digest, but this endows it with comparison operators. We explicitly
 // provide copy and assignment operators to make this STL container compatible.
 struct BlockHash : public common::Comparable<BlockHash> {
  public:
@@ -36,6 +49,11 @@ struct BlockHash : public common::Comparable<BlockHash> {
     Hash(block);
   }
 
+  // Constructor from Block, with an explicit hash algorithm.
+  BlockHash(const BlockGraph::Block* block, BlockHashAlgorithm algorithm) {
+    Hash(block, algorithm);
+  }
+
   // General comparison function, required by Comparable.
   int Compare(const BlockHash& other) const {
     return memcmp(&md5_digest, &other.md5_digest, sizeof(md5_digest));
@@ -48,6 +66,11 @@ struct BlockHash : public common::Comparable<BlockHash> {
   //     Data (skipping references)
   void Hash(const BlockGraph::Block* block);
 
+  // As above, but hashing with the given algorithm.
+  void Hash(const BlockGraph::Block* block, BlockHashAlgorithm algorithm);
+
+  // The 128-bit digest. Named for the original MD5-only implementation;
+  // holds the digest of whichever algorithm was used to hash.
   base::MD5Digest md5_digest;
 };
 
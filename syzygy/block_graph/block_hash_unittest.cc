@@ -98,4 +98,41 @@ TEST(BlockHash, HashAndCompare) {
   EXPECT_NE(0, code_block_1_hash.Compare(BlockHash(test_block)));
 }
 
+TEST(BlockHash, FastHashAndCompare) {
+  BlockGraph block_graph;
+  const size_t kBlockSize = 0x20;
+  const uint8 kMagicValue = 0xAB;
+
+  BlockGraph::Block* block_1 = block_graph.AddBlock(BlockGraph::CODE_BLOCK,
+                                                    kBlockSize,
+                                                    "block 1");
+  EXPECT_NE(reinterpret_cast<uint8*>(NULL), block_1->ResizeData(kBlockSize));
+  ::memset(block_1->GetMutableData(), kMagicValue, kBlockSize);
+
+  BlockGraph::Block* block_2 = block_graph.AddBlock(BlockGraph::CODE_BLOCK,
+                                                    kBlockSize,
+                                                    "block 2");
+  EXPECT_NE(reinterpret_cast<uint8*>(NULL), block_2->ResizeData(kBlockSize));
+  ::memset(block_2->GetMutableData(), kMagicValue, kBlockSize);
+
+  // The fast hash must be deterministic and content-sensitive, just like
+  // the MD5 one.
+  BlockHash hash_1(block_1, kBlockHashFast);
+  EXPECT_EQ(0, hash_1.Compare(BlockHash(block_1, kBlockHashFast)));
+  EXPECT_EQ(0, hash_1.Compare(BlockHash(block_2, kBlockHashFast)));
+
+  block_2->GetMutableData()[0] = ~kMagicValue;
+  EXPECT_NE(0, hash_1.Compare(BlockHash(block_2, kBlockHashFast)));
+  block_2->GetMutableData()[0] = kMagicValue;
+  EXPECT_EQ(0, hash_1.Compare(BlockHash(block_2, kBlockHashFast)));
+
+  // The implied trailing zeros beyond data_size must be accounted for.
+  block_2->ResizeData(kBlockSize / 2);
+  EXPECT_NE(0, hash_1.Compare(BlockHash(block_2, kBlockHashFast)));
+
+  // The two algorithms must disagree about the digest of a block; a
+  // sanity check that the fast path is actually taken.
+  EXPECT_NE(0, hash_1.Compare(BlockHash(block_1)));
+}
+
 }  // namespace block_graph
@@ -33,7 +33,8 @@ typedef base::Callback<bool(BlockGraph* block_graph,
 //
 // The callback has freedom to modify any block in the block-graph, and to add
 // any number of blocks to the block-graph. It is constrained to be allowed
-// to delete only the current block being handled by the callback.
+// to delete only the current block being handled by the callback, or blocks
+// that have already been visited by the iteration.
 //
 // The iteration will only visit those blocks that were pre-existing in the
 // BlockGraph. That is, if the callback causes new blocks to be generated those
@@ -324,6 +324,47 @@ void OrderedBlockGraph::PlaceAfter(const BlockGraph::Block* anchored_block,
   DCHECK_EQ(*(moved->it), moved_block);
 }
 
+void OrderedBlockGraph::ReorderSection(const Section* section,
+                                       const BlockVector& blocks) {
+  SectionInfo* section_info = GetSectionInfo(section);
+  DCHECK(section_info != NULL);
+  OrderedSection* ordered_section = &section_info->ordered_section;
+
+  // Splice the blocks into a new list in the requested order. Splicing moves
+  // the list nodes themselves, so the iterators cached in the block index
+  // remain valid throughout.
+  BlockList ordered;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    Block* block = blocks[i];
+    DCHECK(block != NULL);
+
+    BlockInfo* block_info = GetBlockInfo(block);
+    DCHECK(block_info != NULL);
+
+    ordered.splice(ordered.end(),
+                   block_info->ordered_section->ordered_blocks_,
+                   block_info->it);
+    block_info->ordered_section = ordered_section;
+    block->set_section(section_info->id());
+  }
+
+  // The blocks of the section that were not explicitly mentioned keep their
+  // relative order, after the reordered blocks.
+  BlockList& section_blocks = ordered_section->ordered_blocks_;
+  ordered.splice(ordered.end(), section_blocks);
+  section_blocks.swap(ordered);
+
+  // Splice invalidates the iterators, so rebuild the cached iterators of the
+  // reordered section in a single pass.
+  BlockList::iterator block_it = section_blocks.begin();
+  for (; block_it != section_blocks.end(); ++block_it) {
+    BlockInfo* block_info = GetBlockInfo(*block_it);
+    DCHECK(block_info != NULL);
+    block_info->it = block_it;
+    DCHECK_EQ(*(block_info->it), *block_it);
+  }
+}
+
 const OrderedBlockGraph::SectionInfo* OrderedBlockGraph::GetSectionInfo(
     const Section* section) const {
   // Special case: the catch all section, which actually does not correspond
@@ -200,6 +200,21 @@ class OrderedBlockGraph {
   // @pre anchored_block != moved_block.
   void PlaceAfter(const Block* anchored_block, Block* moved_block);
 
+  // Reorders the blocks of the given section wholesale. The blocks in
+  // @p blocks are moved into @p section, having their section attribute
+  // updated if need be, and are placed at the head of the section in the
+  // given order. Blocks already in the section but not mentioned in
+  // @p blocks retain their relative order after them. This is equivalent to
+  // a sequence of PlaceAtHead/PlaceBefore calls, but performs a single
+  // index lookup per block and a single linear pass over the section.
+  //
+  // @param section the section whose blocks are to be reordered. May be
+  //     NULL, indicating the blocks that lie outside of all known sections.
+  // @param blocks the blocks to be placed at the head of the section, in
+  //     the desired order.
+  // @pre no block may appear more than once in @p blocks.
+  void ReorderSection(const Section* section, const BlockVector& blocks);
+
   // Allows for a direct sorting of the blocks in a section using the provided
   // comparison functor. The comparison functor must have a function with the
   // following signature:
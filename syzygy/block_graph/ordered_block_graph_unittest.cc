@@ -418,4 +418,37 @@ TEST_F(OrderedBlockGraphTest, BlockSort) {
   EXPECT_TRUE(ordered.IndicesAreValid());
 }
 
+TEST_F(OrderedBlockGraphTest, ReorderSectionEmpty) {
+  InitBlockGraph(1, 2, 0);
+  TestOrderedBlockGraph ordered(&block_graph_);
+  BlockGraph::Section* section0 = block_graph_.GetSectionById(0);
+  ordered.ReorderSection(section0, BlockVector());
+  EXPECT_SECTION_CONTAINS(ordered, 0, 1, 2);
+  EXPECT_TRUE(ordered.IndicesAreValid());
+}
+
+TEST_F(OrderedBlockGraphTest, ReorderSection) {
+  InitBlockGraph(2, 3, 0);
+  TestOrderedBlockGraph ordered(&block_graph_);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 1, 2, 3);
+  EXPECT_SECTION_CONTAINS(ordered, 1, 4, 5, 6);
+
+  BlockGraph::Section* section0 = block_graph_.GetSectionById(0);
+
+  // Reorder section 0 with an explicit order that also pulls in a block
+  // from section 1.
+  BlockVector blocks;
+  blocks.push_back(block_graph_.GetBlockById(3));
+  blocks.push_back(block_graph_.GetBlockById(5));
+  blocks.push_back(block_graph_.GetBlockById(1));
+  ordered.ReorderSection(section0, blocks);
+
+  // The unmentioned block 2 retains its position after the reordered blocks
+  // and block 5 has changed sections.
+  EXPECT_SECTION_CONTAINS(ordered, 0, 3, 5, 1, 2);
+  EXPECT_SECTION_CONTAINS(ordered, 1, 4, 6);
+  EXPECT_EQ(block_graph_.GetBlockById(5)->section(), 0);
+  EXPECT_TRUE(ordered.IndicesAreValid());
+}
+
 }  // namespace block_graph
@@ -117,6 +117,17 @@ bool ApplyBasicBlockSubGraphTransforms(
     BlockGraph* block_graph,
     BlockGraph::Block* block,
     BlockVector* new_blocks) {
+  return ApplyBasicBlockSubGraphTransforms(
+      transforms, policy, block_graph, block, NULL, new_blocks);
+}
+
+bool ApplyBasicBlockSubGraphTransforms(
+    const std::vector<BasicBlockSubGraphTransformInterface*>& transforms,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block,
+    InstructionDecodeCache* decode_cache,
+    BlockVector* new_blocks) {
   DCHECK(policy != NULL);
   DCHECK(block_graph != NULL);
   DCHECK(block != NULL);
@@ -126,6 +137,7 @@ bool ApplyBasicBlockSubGraphTransforms(
   // Decompose block to basic blocks.
   BasicBlockSubGraph subgraph;
   BasicBlockDecomposer bb_decomposer(block, &subgraph);
+  bb_decomposer.set_decode_cache(decode_cache);
   if (!bb_decomposer.Decompose())
     return false;
 
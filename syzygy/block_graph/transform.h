@@ -23,6 +23,9 @@
 
 namespace block_graph {
 
+// Forward declaration.
+class InstructionDecodeCache;
+
 // A BlockGraphTransform is a pure virtual base class defining the transform
 // API.
 class BlockGraphTransformInterface {
@@ -138,6 +141,31 @@ bool ApplyBasicBlockSubGraphTransforms(
     BlockGraph::Block* block,
     BlockVector* new_blocks);
 
+// Same as above, but consults @p decode_cache when decomposing the block so
+// that blocks whose content has already been decoded - a content-identical
+// block decomposed earlier through the same cache, for example - skip
+// instruction decoding.
+//
+// @param transforms the series of transform to apply.
+// @param policy The policy object restricting how the transform is applied.
+// @param block_graph the block containing the block to be transformed.
+// @param block the block to be transformed.
+// @param decode_cache the instruction-decode cache to use. May be NULL,
+//     which disables caching. The cache is not thread-safe; it must not be
+//     shared with concurrent decompositions.
+// @param new_blocks On success, any newly created blocks will be returned
+//     here. Note that this parameter may be NULL if you are not interested
+//     in retrieving the set of new blocks.
+// @pre block must be a code block.
+// @returns true on success, false otherwise.
+bool ApplyBasicBlockSubGraphTransforms(
+    const std::vector<BasicBlockSubGraphTransformInterface*>& transforms,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block,
+    InstructionDecodeCache* decode_cache,
+    BlockVector* new_blocks);
+
 }  // namespace block_graph
 
 #endif  // SYZYGY_BLOCK_GRAPH_TRANSFORM_H_
@@ -47,9 +47,10 @@ bool ChainedBasicBlockTransforms::OnBlock(
   if (!policy->BlockIsSafeToBasicBlockDecompose(block))
     return true;
 
-  // Apply the series of basic block transforms to this block.
+  // Apply the series of basic block transforms to this block, sharing the
+  // instruction-decode cache across the decompositions.
   if (!ApplyBasicBlockSubGraphTransforms(
-           transforms_, policy, block_graph, block, NULL)) {
+           transforms_, policy, block_graph, block, &decode_cache_, NULL)) {
     return false;
   }
 
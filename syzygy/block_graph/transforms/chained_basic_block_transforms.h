@@ -30,6 +30,7 @@
 #define SYZYGY_BLOCK_GRAPH_TRANSFORMS_CHAINED_BASIC_BLOCK_TRANSFORMS_H_
 
 #include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/transform_policy.h"
 #include "syzygy/block_graph/transforms/iterative_transform.h"
 
@@ -65,6 +66,12 @@ class ChainedBasicBlockTransforms
   // Transforms to be applied, in order.
   std::vector<BasicBlockSubGraphTransformInterface*> transforms_;
 
+  // The instruction-decode cache shared by the decompositions of all the
+  // blocks visited by this transform, so that content-identical blocks are
+  // only decoded once. The blocks are visited serially, as required by the
+  // cache.
+  InstructionDecodeCache decode_cache_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ChainedBasicBlockTransforms);
 };
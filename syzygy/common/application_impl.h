@@ -21,6 +21,7 @@
 #define SYZYGY_COMMON_APPLICATION_IMPL_H_
 
 #include "base/win/scoped_com_initializer.h"
+#include "syzygy/common/phase_profiler.h"
 #include "syzygy/common/syzygy_version.h"
 
 namespace common {
@@ -57,10 +58,17 @@ int Application<Impl, kInitLogging>::Run() {
   if (!implementation_.SetUp())
     return 1;
 
+  // Let the environment turn on phase profiling, uniformly across all of
+  // the applications. The gathered timings are reported once the
+  // implementation has finished.
+  PhaseProfiler::Instance()->EnableFromEnvironment();
+
   int result = implementation_.Run();
 
   implementation_.TearDown();
 
+  PhaseProfiler::Instance()->WriteReport();
+
   return result;
 }
 
@@ -149,6 +149,7 @@ const uint32 kDefaultMaxNumFrames = 62;
 const bool kDefaultExitOnFailure = false;
 const bool kDefaultCheckHeapOnFailure = true;
 const bool kDefaultDisableBreakpadReporting = false;
+const bool kDefaultParamsAreFinal = false;
 
 // Default values of AsanLogger parameters.
 const bool kDefaultMiniDumpOnFailure = false;
@@ -162,6 +163,7 @@ const float kDefaultZebraBlockHeapQuarantineRatio = 0.25f;
 const bool kDefaultEnableCtMalloc = true;
 const bool kDefaultEnableZebraBlockHeap = false;
 const bool kDefaultEnableAllocationFilter = false;
+const bool kDefaultEnableBackgroundTrimming = false;
 
 // Default values of LargeBlockHeap parameters.
 extern const bool kDefaultEnableLargeBlockHeap = true;
@@ -170,6 +172,21 @@ extern const bool kDefaultEnableLargeBlockHeap = true;
 // 2 / 0.45 = 4.44 < 5 page minimum.
 extern const size_t kDefaultLargeAllocationThreshold = 5 * 4096;
 
+// Default values of quarantine batching parameters. This is sized to amortize
+// the cost of the shared quarantine locks without letting too many freed
+// blocks linger in per-thread caches.
+const uint32 kDefaultQuarantineFlushThreshold = 16;
+
+// Default values of stack sampling parameters. Sampling is disabled by
+// default as it trades some reference count fidelity for speed.
+const uint32 kDefaultStackSamplingThreshold = 0;
+
+// Default values of redzone tuning parameters. Tuning is opt-in; the target
+// matches the overhead of the default trailer padding on a typical (not
+// skewed) allocation-size distribution.
+const bool kDefaultEnableAdaptiveRedzones = false;
+const uint32 kDefaultAdaptiveRedzoneTargetPercent = 25;
+
 // String names of HeapProxy parameters.
 const char kParamQuarantineSize[] = "quarantine_size";
 const char kParamQuarantineBlockSize[] = "quarantine_block_size";
@@ -188,6 +205,7 @@ const char kParamIgnoredStackIds[] = "ignored_stack_ids";
 const char kParamExitOnFailure[] = "exit_on_failure";
 const char kParamNoCheckHeapOnFailure[] = "no_check_heap_on_failure";
 const char kParamDisableBreakpadReporting[]  = "disable_breakpad";
+const char kParamParamsAreFinal[] = "params_are_final";
 
 // String names of AsanLogger parameters.
 const char kParamMiniDumpOnFailure[] = "minidump_on_failure";
@@ -202,11 +220,23 @@ const char kParamZebraBlockHeapQuarantineRatio[] =
 const char kParamDisableCtMalloc[] = "disable_ctmalloc";
 const char kParamEnableZebraBlockHeap[] = "enable_zebra_block_heap";
 const char kParamEnableAllocationFilter[] = "enable_allocation_filter";
+const char kParamEnableBackgroundTrimming[] = "enable_background_trimming";
 
 // String names of LargeBlockHeap parameters.
 const char kParamDisableLargeBlockHeap[] = "disable_large_block_heap";
 const char kParamLargeAllocationThreshold[] = "large_allocation_threshold";
 
+// String names of quarantine batching parameters.
+const char kParamQuarantineFlushThreshold[] = "quarantine_flush_threshold";
+
+// String names of stack sampling parameters.
+const char kParamStackSamplingThreshold[] = "stack_sampling_threshold";
+
+// String names of redzone tuning parameters.
+const char kParamEnableAdaptiveRedzones[] = "enable_adaptive_redzones";
+const char kParamAdaptiveRedzoneTargetPercent[] =
+    "adaptive_redzone_target_percent";
+
 InflatedAsanParameters::InflatedAsanParameters() {
   // Clear the AsanParameters portion of ourselves.
   ::memset(this, 0, sizeof(AsanParameters));
@@ -271,6 +301,7 @@ void SetDefaultAsanParameters(AsanParameters* asan_parameters) {
   asan_parameters->log_as_text = kDefaultLogAsText;
   asan_parameters->disable_breakpad_reporting =
       kDefaultDisableBreakpadReporting;
+  asan_parameters->params_are_final = kDefaultParamsAreFinal;
   asan_parameters->allocation_guard_rate = kDefaultAllocationGuardRate;
   asan_parameters->zebra_block_heap_size = kDefaultZebraBlockHeapSize;
   asan_parameters->zebra_block_heap_quarantine_ratio =
@@ -279,15 +310,23 @@ void SetDefaultAsanParameters(AsanParameters* asan_parameters) {
   asan_parameters->enable_zebra_block_heap = kDefaultEnableZebraBlockHeap;
   asan_parameters->enable_large_block_heap = kDefaultEnableLargeBlockHeap;
   asan_parameters->enable_allocation_filter = kDefaultEnableAllocationFilter;
+  asan_parameters->enable_background_trimming =
+      kDefaultEnableBackgroundTrimming;
   asan_parameters->large_allocation_threshold =
       kDefaultLargeAllocationThreshold;
+  asan_parameters->quarantine_flush_threshold =
+      kDefaultQuarantineFlushThreshold;
+  asan_parameters->stack_sampling_threshold = kDefaultStackSamplingThreshold;
+  asan_parameters->enable_adaptive_redzones = kDefaultEnableAdaptiveRedzones;
+  asan_parameters->adaptive_redzone_target_percent =
+      kDefaultAdaptiveRedzoneTargetPercent;
 }
 
 bool InflateAsanParameters(const AsanParameters* pod_params,
                            InflatedAsanParameters* inflated_params) {
   // This must be kept up to date with AsanParameters as it evolves.
   static const size_t kSizeOfAsanParametersByVersion[] =
-      { 40, 44, 48, 52, 52, 52, 56, 56 };
+      { 40, 44, 48, 52, 52, 52, 56, 56, 60, 60, 64, 64, 68 };
   COMPILE_ASSERT(arraysize(kSizeOfAsanParametersByVersion) ==
                      kAsanParametersVersion + 1,
                  kSizeOfAsanParametersByVersion_out_of_date);
@@ -419,6 +458,27 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
     return false;
   }
 
+  // Parse the quarantine flush threshold.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamQuarantineFlushThreshold,
+          &asan_parameters->quarantine_flush_threshold) == kFlagError) {
+    return false;
+  }
+
+  // Parse the stack sampling threshold.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamStackSamplingThreshold,
+          &asan_parameters->stack_sampling_threshold) == kFlagError) {
+    return false;
+  }
+
+  // Parse the adaptive redzone target overhead.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamAdaptiveRedzoneTargetPercent,
+          &asan_parameters->adaptive_redzone_target_percent) == kFlagError) {
+    return false;
+  }
+
   // Parse the other (boolean) flags.
   if (cmd_line.HasSwitch(kParamMiniDumpOnFailure))
     asan_parameters->minidump_on_failure = true;
@@ -438,6 +498,12 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
     asan_parameters->enable_large_block_heap = false;
   if (cmd_line.HasSwitch(kParamEnableAllocationFilter))
     asan_parameters->enable_allocation_filter = true;
+  if (cmd_line.HasSwitch(kParamEnableBackgroundTrimming))
+    asan_parameters->enable_background_trimming = true;
+  if (cmd_line.HasSwitch(kParamParamsAreFinal))
+    asan_parameters->params_are_final = true;
+  if (cmd_line.HasSwitch(kParamEnableAdaptiveRedzones))
+    asan_parameters->enable_adaptive_redzones = true;
 
   return true;
 }
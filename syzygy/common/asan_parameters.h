@@ -37,7 +37,7 @@ namespace common {
 // the StackCaptureCache.
 typedef uint32 AsanStackId;
 
-static const size_t kAsanParametersReserved1Bits = 23;
+static const size_t kAsanParametersReserved1Bits = 20;
 
 // This data structure is injected into an instrumented image in a read-only
 // section. It is initialized by the instrumenter, and will be looked up at
@@ -110,6 +110,20 @@ struct AsanParameters {
       // BlockHeapManager: Indictaes if the allocation filtering is enabled. If
       // so, only blocks from filtered sites can make it into the zebra heap.
       unsigned enable_allocation_filter : 1;
+      // BlockHeapManager: If true, blocks trimmed from an overflowing
+      // quarantine are verified and released by a background thread rather
+      // than synchronously on the caller's free() path.
+      unsigned enable_background_trimming : 1;
+      // AsanRuntime: If true the parameters baked into the instrumented
+      // image are final, and environment variable overrides are ignored.
+      // This lets short-lived processes skip command-line parsing entirely
+      // during runtime setup.
+      unsigned params_are_final : 1;
+      // BlockHeapManager: If true, trailer padding sizes are tuned at
+      // runtime, per size class, from an allocation-size histogram so that
+      // the aggregate padding overhead meets
+      // adaptive_redzone_target_percent.
+      unsigned enable_adaptive_redzones : 1;
 
       // Add new flags here!
 
@@ -132,23 +146,38 @@ struct AsanParameters {
   // the large block heap.
   uint32 large_allocation_threshold;
 
+  // BlockHeapManager: The number of freed blocks a thread accumulates locally
+  // before flushing them to the shared quarantine in a batch.
+  uint32 quarantine_flush_threshold;
+
+  // StackCaptureCache: The number of times a given stack may be saved before
+  // its reference count is saturated, pinning it in the cache and
+  // short-circuiting further reference bookkeeping for it. A value of zero
+  // disables the sampling entirely.
+  uint32 stack_sampling_threshold;
+
+  // RedzoneTuner: The target memory overhead of trailer padding, expressed
+  // as a percentage of instrumented allocation bytes. Only used when
+  // enable_adaptive_redzones is set.
+  uint32 adaptive_redzone_target_percent;
+
   // Add new parameters here!
 
   // When laid out in memory the ignored_stack_ids are present here as a NULL
   // terminated vector.
 };
-COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 56);
+COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 68);
 
 // The current version of the ASAN parameters structure. This must be updated
 // if any changes are made to the above structure! This is defined in the header
 // file to allow compile time assertions against this version number.
-const uint32 kAsanParametersVersion = 7u;
+const uint32 kAsanParametersVersion = 12u;
 
 // If the number of free bits in the parameters struct changes, then the
 // version has to change as well. This is simply here to make sure that
 // everything changes in lockstep.
-COMPILE_ASSERT(kAsanParametersReserved1Bits == 23 &&
-                   kAsanParametersVersion == 7,
+COMPILE_ASSERT(kAsanParametersReserved1Bits == 20 &&
+                   kAsanParametersVersion == 12,
                version_must_change_if_reserved_bits_changes);
 
 // The name of the section that will be injected into an instrumented image,
@@ -218,6 +247,7 @@ extern const uint32 kDefaultBottomFramesToSkip;
 extern const bool kDefaultExitOnFailure;
 extern const bool kDefaultCheckHeapOnFailure;
 extern const bool kDefaultDisableBreakpadReporting;
+extern const bool kDefaultParamsAreFinal;
 // Default values of AsanLogger parameters.
 extern const bool kDefaultMiniDumpOnFailure;
 extern const bool kDefaultLogAsText;
@@ -228,9 +258,17 @@ extern const float kDefaultZebraBlockHeapQuarantineRatio;
 extern const bool kDefaultEnableCtMalloc;
 extern const bool kDefaultEnableZebraBlockHeap;
 extern const bool kDefaultEnableAllocationFilter;
+extern const bool kDefaultEnableBackgroundTrimming;
 // Default values of LargeBlockHeap parameters.
 extern const bool kDefaultEnableLargeBlockHeap;
 extern const size_t kDefaultLargeAllocationThreshold;
+// Default values of quarantine batching parameters.
+extern const uint32 kDefaultQuarantineFlushThreshold;
+// Default values of stack sampling parameters.
+extern const uint32 kDefaultStackSamplingThreshold;
+// Default values of redzone tuning parameters.
+extern const bool kDefaultEnableAdaptiveRedzones;
+extern const uint32 kDefaultAdaptiveRedzoneTargetPercent;
 
 // String names of HeapProxy parameters.
 extern const char kParamQuarantineSize[];
@@ -246,6 +284,7 @@ extern const char kParamMaxNumFrames[];
 extern const char kParamIgnoredStackIds[];
 extern const char kParamExitOnFailure[];
 extern const char kParamDisableBreakpadReporting[];
+extern const char kParamParamsAreFinal[];
 // String names of AsanLogger parameters.
 extern const char kParamMiniDumpOnFailure[];
 extern const char kParamLogAsText[];
@@ -256,9 +295,17 @@ extern const char kParamZebraBlockHeapQuarantineRatio[];
 extern const char kParamDisableCtMalloc[];
 extern const char kParamEnableZebraBlockHeap[];
 extern const char kParamEnableAllocationFilter[];
+extern const char kParamEnableBackgroundTrimming[];
 // String names of LargeBlockHeap parameters.
 extern const char kParamDisableLargeBlockHeap[];
 extern const char kParamLargeAllocationThreshold[];
+// String names of quarantine batching parameters.
+extern const char kParamQuarantineFlushThreshold[];
+// String names of stack sampling parameters.
+extern const char kParamStackSamplingThreshold[];
+// String names of redzone tuning parameters.
+extern const char kParamEnableAdaptiveRedzones[];
+extern const char kParamAdaptiveRedzoneTargetPercent[];
 
 // Initializes an AsanParameters struct with default values.
 // @param asan_parameters The AsanParameters struct to be initialized.
@@ -86,8 +86,20 @@ TEST(AsanParametersTest, SetDefaultAsanParameters) {
             static_cast<bool>(aparams.enable_large_block_heap));
   EXPECT_EQ(kDefaultEnableAllocationFilter,
             static_cast<bool>(aparams.enable_allocation_filter));
+  EXPECT_EQ(kDefaultEnableBackgroundTrimming,
+            static_cast<bool>(aparams.enable_background_trimming));
+  EXPECT_EQ(kDefaultParamsAreFinal,
+            static_cast<bool>(aparams.params_are_final));
   EXPECT_EQ(kDefaultLargeAllocationThreshold,
             aparams.large_allocation_threshold);
+  EXPECT_EQ(kDefaultQuarantineFlushThreshold,
+            aparams.quarantine_flush_threshold);
+  EXPECT_EQ(kDefaultStackSamplingThreshold,
+            aparams.stack_sampling_threshold);
+  EXPECT_EQ(kDefaultEnableAdaptiveRedzones,
+            static_cast<bool>(aparams.enable_adaptive_redzones));
+  EXPECT_EQ(kDefaultAdaptiveRedzoneTargetPercent,
+            aparams.adaptive_redzone_target_percent);
 }
 
 TEST(AsanParametersTest, InflateAsanParametersStackIdsPastEnd) {
@@ -234,8 +246,20 @@ TEST(AsanParametersTest, ParseAsanParametersMinimal) {
             static_cast<bool>(iparams.enable_large_block_heap));
   EXPECT_EQ(kDefaultEnableAllocationFilter,
             static_cast<bool>(iparams.enable_allocation_filter));
+  EXPECT_EQ(kDefaultEnableBackgroundTrimming,
+            static_cast<bool>(iparams.enable_background_trimming));
+  EXPECT_EQ(kDefaultParamsAreFinal,
+            static_cast<bool>(iparams.params_are_final));
   EXPECT_EQ(kDefaultLargeAllocationThreshold,
             iparams.large_allocation_threshold);
+  EXPECT_EQ(kDefaultQuarantineFlushThreshold,
+            iparams.quarantine_flush_threshold);
+  EXPECT_EQ(kDefaultStackSamplingThreshold,
+            iparams.stack_sampling_threshold);
+  EXPECT_EQ(kDefaultEnableAdaptiveRedzones,
+            static_cast<bool>(iparams.enable_adaptive_redzones));
+  EXPECT_EQ(kDefaultAdaptiveRedzoneTargetPercent,
+            iparams.adaptive_redzone_target_percent);
 }
 
 TEST(AsanParametersTest, ParseAsanParametersMaximal) {
@@ -260,7 +284,13 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
       L"--enable_zebra_block_heap "
       L"--disable_large_block_heap "
       L"--enable_allocation_filter "
-      L"--large_allocation_threshold=4096";
+      L"--enable_background_trimming "
+      L"--params_are_final "
+      L"--large_allocation_threshold=4096 "
+      L"--quarantine_flush_threshold=32 "
+      L"--stack_sampling_threshold=1000 "
+      L"--enable_adaptive_redzones "
+      L"--adaptive_redzone_target_percent=10";
 
   InflatedAsanParameters iparams;
   SetDefaultAsanParameters(&iparams);
@@ -289,7 +319,13 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
   EXPECT_TRUE(static_cast<bool>(iparams.enable_zebra_block_heap));
   EXPECT_FALSE(static_cast<bool>(iparams.enable_large_block_heap));
   EXPECT_TRUE(static_cast<bool>(iparams.enable_allocation_filter));
+  EXPECT_TRUE(static_cast<bool>(iparams.enable_background_trimming));
+  EXPECT_TRUE(static_cast<bool>(iparams.params_are_final));
   EXPECT_EQ(4096, iparams.large_allocation_threshold);
+  EXPECT_EQ(32, iparams.quarantine_flush_threshold);
+  EXPECT_EQ(1000, iparams.stack_sampling_threshold);
+  EXPECT_TRUE(static_cast<bool>(iparams.enable_adaptive_redzones));
+  EXPECT_EQ(10, iparams.adaptive_redzone_target_percent);
 }
 
 }  // namespace common
@@ -40,6 +40,20 @@ bool GetStringAtImpl(BinaryBufferParser* parser, size_t pos,
   return false;
 }
 
+template <class StringPieceType>
+bool GetStringPieceAtImpl(BinaryBufferParser* parser, size_t pos,
+    StringPieceType* str) {
+  DCHECK(parser != NULL);
+  DCHECK(str != NULL);
+  const typename StringPieceType::value_type* ptr = NULL;
+  size_t len = 0;
+  if (!parser->GetStringAt(pos, &ptr, &len))
+    return false;
+
+  str->set(ptr, len);
+  return true;
+}
+
 }  // namespace
 
 BinaryBufferParser::BinaryBufferParser(const void* data, size_t data_len)
@@ -80,6 +94,15 @@ bool BinaryBufferParser::GetStringAt(size_t pos, const wchar_t** ptr,
   return GetStringAtImpl(this, pos, ptr, len);
 }
 
+bool BinaryBufferParser::GetStringPieceAt(size_t pos, base::StringPiece* str) {
+  return GetStringPieceAtImpl(this, pos, str);
+}
+
+bool BinaryBufferParser::GetStringPieceAt(size_t pos,
+    base::StringPiece16* str) {
+  return GetStringPieceAtImpl(this, pos, str);
+}
+
 
 BinaryBufferReader::BinaryBufferReader(const void* data, size_t data_len)
     : parser_(data, data_len), pos_(0) {
@@ -158,4 +181,30 @@ bool BinaryBufferReader::ReadString(const wchar_t** str, size_t* str_len) {
   return true;
 }
 
+bool BinaryBufferReader::PeekStringPiece(base::StringPiece* str) {
+  return parser_.GetStringPieceAt(pos_, str);
+}
+
+bool BinaryBufferReader::PeekStringPiece(base::StringPiece16* str) {
+  return parser_.GetStringPieceAt(pos_, str);
+}
+
+bool BinaryBufferReader::ReadStringPiece(base::StringPiece* str) {
+  if (!PeekStringPiece(str))
+    return false;
+
+  bool consumed = Consume(str->size() + 1);
+  DCHECK(consumed == true);
+  return true;
+}
+
+bool BinaryBufferReader::ReadStringPiece(base::StringPiece16* str) {
+  if (!PeekStringPiece(str))
+    return false;
+
+  bool consumed = Consume((str->size() + 1) * sizeof(*str->data()));
+  DCHECK(consumed == true);
+  return true;
+}
+
 }  // namespace common
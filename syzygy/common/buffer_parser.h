@@ -18,6 +18,7 @@
 #define SYZYGY_COMMON_BUFFER_PARSER_H_
 
 #include "base/basictypes.h"
+#include "base/strings/string_piece.h"
 
 namespace common {
 
@@ -72,6 +73,20 @@ class BinaryBufferParser {
   bool GetStringAt(size_t pos, const char** ptr, size_t* len);
   bool GetStringAt(size_t pos, const wchar_t** ptr, size_t* len);
 
+  // Get a zero-copy view of the zero terminated string starting at the byte
+  // offset @p pos. The view points directly into the parsed buffer, so it is
+  // only valid as long as the underlying buffer outlives it; no copy is
+  // made.
+  // @param pos the byte offset where the string starts.
+  // @param str on success receives a view of the string, not including the
+  //     zero terminator.
+  // @returns true on success, e.g. there's a zero terminator in the buffer
+  //    after @p pos, or false on failure, when @p pos is outside the buffer
+  //    or there is no zero terminator in the buffer after @p pos.
+  // @note this function does not check @pos for appropriate alignment.
+  bool GetStringPieceAt(size_t pos, base::StringPiece* str);
+  bool GetStringPieceAt(size_t pos, base::StringPiece16* str);
+
  protected:
   const int8* data_;
   size_t data_len_;
@@ -137,6 +152,18 @@ class BinaryBufferReader {
   bool ReadString(const char** str, size_t* str_len);
   bool ReadString(const wchar_t** str, size_t* str_len);
 
+  // Retrieve a zero-copy view of a zero-terminated string from our buffer
+  // without advancing the read position. The view is only valid as long as
+  // the underlying buffer outlives it.
+  bool PeekStringPiece(base::StringPiece* str);
+  bool PeekStringPiece(base::StringPiece16* str);
+
+  // Retrieve a zero-copy view of a zero-terminated string from our buffer
+  // and advance the read position past the zero terminator. The view is
+  // only valid as long as the underlying buffer outlives it.
+  bool ReadStringPiece(base::StringPiece* str);
+  bool ReadStringPiece(base::StringPiece16* str);
+
  private:
   // The buffer we read from.
   BinaryBufferParser parser_;
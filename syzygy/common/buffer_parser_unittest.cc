@@ -118,6 +118,46 @@ TEST(BinaryBufferParser, GetStringAtWideSucceeds) {
   TestGetStringAt<wchar_t>();
 }
 
+TEST(BinaryBufferParser, GetStringPieceAt) {
+  static const char kBuf[] = {
+      'a', 'b', 'c', 'd', '\0',
+      'e', 'f', 'g',
+  };
+
+  BinaryBufferParser parser(kBuf, sizeof(kBuf));
+  base::StringPiece str;
+  ASSERT_TRUE(parser.GetStringPieceAt(0, &str));
+  EXPECT_EQ("abcd", str);
+  // The view aliases the parsed buffer, no copy is made.
+  EXPECT_EQ(kBuf, str.data());
+
+  ASSERT_TRUE(parser.GetStringPieceAt(4, &str));
+  EXPECT_EQ(0u, str.size());
+
+  ASSERT_FALSE(parser.GetStringPieceAt(5, &str));
+  ASSERT_FALSE(parser.GetStringPieceAt(sizeof(kBuf), &str));
+}
+
+TEST(BinaryBufferParser, GetStringPieceAtWide) {
+  static const wchar_t kBuf[] = {
+      L'a', L'b', L'c', L'd', L'\0',
+      L'e', L'f', L'g',
+  };
+
+  BinaryBufferParser parser(kBuf, sizeof(kBuf));
+  base::StringPiece16 str;
+  ASSERT_TRUE(parser.GetStringPieceAt(0, &str));
+  EXPECT_EQ(base::StringPiece16(L"abcd"), str);
+  // The view aliases the parsed buffer, no copy is made.
+  EXPECT_EQ(kBuf, str.data());
+
+  ASSERT_TRUE(parser.GetStringPieceAt(4 * sizeof(kBuf[0]), &str));
+  EXPECT_EQ(0u, str.size());
+
+  ASSERT_FALSE(parser.GetStringPieceAt(5 * sizeof(kBuf[0]), &str));
+  ASSERT_FALSE(parser.GetStringPieceAt(sizeof(kBuf), &str));
+}
+
 TEST(BinaryBufferReader, IsAligned) {
   BinaryBufferReader reader(kDataBuffer, kDataBufferSize);
 
@@ -223,4 +263,34 @@ TEST(BinaryBufferReader, ReadWideString) {
   ASSERT_FALSE(reader.ReadString(&str, &str_len));
 }
 
+TEST(BinaryBufferReader, ReadCharStringPiece) {
+  static const char kBuf[] = {
+    'a', 'b', 'c', 'd', '\0', 'e', 'f', 'g', '\0', 'h', 'i'
+  };
+  BinaryBufferReader reader(kBuf, sizeof(kBuf));
+
+  base::StringPiece str;
+  ASSERT_TRUE(reader.ReadStringPiece(&str));
+  EXPECT_EQ("abcd", str);
+  // The view aliases the reader's buffer, no copy is made.
+  EXPECT_EQ(kBuf, str.data());
+  ASSERT_TRUE(reader.ReadStringPiece(&str));
+  EXPECT_EQ("efg", str);
+  ASSERT_FALSE(reader.ReadStringPiece(&str));
+}
+
+TEST(BinaryBufferReader, ReadWideStringPiece) {
+  static const wchar_t kBuf[] = {
+    L'a', L'b', L'c', L'd', L'\0', L'e', L'f', L'g', L'\0', L'h', L'i'
+  };
+  BinaryBufferReader reader(kBuf, sizeof(kBuf));
+
+  base::StringPiece16 str;
+  ASSERT_TRUE(reader.ReadStringPiece(&str));
+  EXPECT_EQ(base::StringPiece16(L"abcd"), str);
+  ASSERT_TRUE(reader.ReadStringPiece(&str));
+  EXPECT_EQ(base::StringPiece16(L"efg"), str);
+  ASSERT_FALSE(reader.ReadStringPiece(&str));
+}
+
 }  // namespace common
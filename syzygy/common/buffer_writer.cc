@@ -14,6 +14,8 @@
 
 #include "syzygy/common/buffer_writer.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "syzygy/common/align.h"
 
@@ -120,9 +122,13 @@ VectorBufferWriter::VectorBufferWriter(std::vector<uint8>* vector)
 }
 
 uint8* VectorBufferWriter::GrowBuffer(size_t new_length) {
-  // NOTE: While this may appear to be O(N^2), it's actually not. vector is
-  // smart enough to double the size of the allocation when a resize causes
-  // a reallocation, so it is amortized O(N).
+  // Grow the allocation exponentially so that a series of small appends is
+  // amortized O(N) regardless of the growth policy of the underlying vector,
+  // then size the vector to exactly the requested length. This keeps the
+  // invariant that the vector size reflects the bytes written, which callers
+  // depend on.
+  if (new_length > vector_->capacity())
+    vector_->reserve(std::max(new_length, 2 * vector_->capacity()));
   vector_->resize(new_length);
   return &(*vector_)[0];
 }
@@ -179,4 +179,19 @@ TEST_F(BufferWriterTest, WriteToVector) {
   EXPECT_EQ(0, ::memcmp(&kExpectedData, &vector_[0], sizeof(kExpectedData)));
 }
 
+TEST_F(BufferWriterTest, VectorGrowsWithManySmallWrites) {
+  VectorBufferWriter writer(&vector_);
+
+  // Append many small writes. The vector size must track the bytes written
+  // exactly even though the underlying allocation grows geometrically.
+  const uint32 kNumWrites = 1000;
+  for (uint32 i = 0; i < kNumWrites; ++i)
+    ASSERT_TRUE(writer.Write(i));
+
+  EXPECT_EQ(kNumWrites * sizeof(uint32), writer.pos());
+  EXPECT_EQ(kNumWrites * sizeof(uint32), vector_.size());
+  for (uint32 i = 0; i < kNumWrites; ++i)
+    EXPECT_EQ(i, *reinterpret_cast<uint32*>(&vector_[i * sizeof(uint32)]));
+}
+
 }  // namespace common
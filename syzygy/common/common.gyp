@@ -78,14 +78,20 @@
         'dbghelp_util.h',
         'defs.cc',
         'defs.h',
+        'flat_map.h',
+        'flat_set.h',
         'indexed_frequency_data.cc',
         'indexed_frequency_data.h',
         'logging.cc',
         'logging.h',
         'path_util.cc',
         'path_util.h',
+        'phase_profiler.cc',
+        'phase_profiler.h',
         'recursive_lock.cc',
         'recursive_lock.h',
+        'shared_symbol_cache.cc',
+        'shared_symbol_cache.h',
         'syzygy_version.cc',
         'syzygy_version.h',
       ],
@@ -123,8 +129,12 @@
         'buffer_writer_unittest.cc',
         'com_utils_unittest.cc',
         'comparable_unittest.cc',
+        'flat_map_unittest.cc',
+        'flat_set_unittest.cc',
         'path_util_unittest.cc',
+        'phase_profiler_unittest.cc',
         'recursive_lock_unittest.cc',
+        'shared_symbol_cache_unittest.cc',
         'syzygy_version_unittest.cc',
         'unittest_util_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
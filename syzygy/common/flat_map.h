@@ -0,0 +1,262 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares FlatMap, a small-size-optimized associative container. It keeps
+// its elements in a sorted array rather than in a node-based tree, with the
+// first few elements stored inline in the container itself. Small maps thus
+// make no heap allocations at all, and larger ones use a single contiguous
+// buffer instead of one node allocation per element.
+
+#ifndef SYZYGY_COMMON_FLAT_MAP_H_
+#define SYZYGY_COMMON_FLAT_MAP_H_
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+
+namespace common {
+
+// A map from Key to T that iterates in increasing key order, exactly as
+// std::map does, but stores its elements contiguously. Up to
+// @p kInlineCapacity elements are stored inline; beyond that the contents
+// spill to a single heap-allocated buffer.
+//
+// The value type must be default-constructible and assignable. Lookup is
+// O(lg n); insertion and erasure are O(n). Unlike std::map, insert() and
+// erase() invalidate all outstanding iterators. This container is intended
+// for maps that are usually small and are read far more often than they
+// are written.
+template <typename Key, typename T, size_t kInlineCapacity,
+          typename Compare = std::less<Key> >
+class FlatMap {
+ public:
+  typedef Key key_type;
+  typedef T mapped_type;
+  typedef std::pair<Key, T> value_type;
+  typedef Compare key_compare;
+  typedef size_t size_type;
+  typedef value_type* iterator;
+  typedef const value_type* const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  FlatMap() : size_(0) {
+  }
+
+  FlatMap(const FlatMap& other) : size_(0) {
+    *this = other;
+  }
+
+  FlatMap& operator=(const FlatMap& other) {
+    if (this == &other)
+      return *this;
+    spill_ = other.spill_;
+    if (other.size_ <= kInlineCapacity)
+      std::copy(other.inline_, other.inline_ + other.size_, inline_);
+    size_ = other.size_;
+    return *this;
+  }
+
+  // @name Iteration. Elements are visited in increasing key order.
+  // @{
+  iterator begin() { return data(); }
+  iterator end() { return data() + size_; }
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + size_; }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  // @}
+
+  // @name Capacity.
+  // @{
+  bool empty() const { return size_ == 0; }
+  size_type size() const { return size_; }
+  // @}
+
+  // Removes all elements from this map.
+  void clear() {
+    spill_.clear();
+    size_ = 0;
+  }
+
+  // @name Lookup.
+  // @{
+  iterator lower_bound(const Key& key) {
+    return std::lower_bound(begin(), end(), key, ValueKeyCompare(comp_));
+  }
+  const_iterator lower_bound(const Key& key) const {
+    return std::lower_bound(begin(), end(), key, ValueKeyCompare(comp_));
+  }
+  iterator upper_bound(const Key& key) {
+    return std::upper_bound(begin(), end(), key, ValueKeyCompare(comp_));
+  }
+  const_iterator upper_bound(const Key& key) const {
+    return std::upper_bound(begin(), end(), key, ValueKeyCompare(comp_));
+  }
+  iterator find(const Key& key) {
+    iterator it = lower_bound(key);
+    if (it != end() && !comp_(key, it->first))
+      return it;
+    return end();
+  }
+  const_iterator find(const Key& key) const {
+    const_iterator it = lower_bound(key);
+    if (it != end() && !comp_(key, it->first))
+      return it;
+    return end();
+  }
+  size_type count(const Key& key) const {
+    return find(key) == end() ? 0 : 1;
+  }
+  // @}
+
+  // Inserts @p value into this map if no element with the same key exists.
+  // All outstanding iterators are invalidated by a successful insertion.
+  // @param value the key-value pair to insert.
+  // @returns a pair of the iterator to the element with the given key, and
+  //     true iff the insertion took place.
+  std::pair<iterator, bool> insert(const value_type& value) {
+    iterator it = lower_bound(value.first);
+    if (it != end() && !comp_(value.first, it->first))
+      return std::make_pair(it, false);
+
+    size_t index = it - begin();
+    if (size_ < kInlineCapacity) {
+      for (size_t i = size_; i > index; --i)
+        inline_[i] = inline_[i - 1];
+      inline_[index] = value;
+    } else {
+      // Move the inline elements to the heap if this insertion is the one
+      // that exceeds the inline capacity.
+      if (size_ == kInlineCapacity)
+        spill_.assign(inline_, inline_ + size_);
+      spill_.insert(spill_.begin() + index, value);
+    }
+    ++size_;
+    return std::make_pair(begin() + index, true);
+  }
+
+  // Retrieves the value associated with @p key, default-constructing and
+  // inserting it if it is not already present.
+  // @param key the key to look up.
+  // @returns a reference to the value associated with @p key.
+  T& operator[](const Key& key) {
+    return insert(std::make_pair(key, T())).first->second;
+  }
+
+  // Erases the element @p it points to. All outstanding iterators are
+  // invalidated.
+  // @param it the element to erase. Must be a dereferenceable iterator into
+  //     this map.
+  // @returns an iterator to the element following the erased one.
+  iterator erase(iterator it) {
+    DCHECK(begin() <= it && it < end());
+    size_t index = it - begin();
+    if (size_ > kInlineCapacity) {
+      spill_.erase(spill_.begin() + index);
+      --size_;
+      // Move the elements back inline if they now fit.
+      if (size_ == kInlineCapacity) {
+        std::copy(spill_.begin(), spill_.end(), inline_);
+        spill_.clear();
+      }
+    } else {
+      for (size_t i = index; i + 1 < size_; ++i)
+        inline_[i] = inline_[i + 1];
+      --size_;
+    }
+    return begin() + index;
+  }
+
+  // Erases the element with the given key, if any.
+  // @param key the key to erase.
+  // @returns the number of elements erased (0 or 1).
+  size_type erase(const Key& key) {
+    iterator it = find(key);
+    if (it == end())
+      return 0;
+    erase(it);
+    return 1;
+  }
+
+ private:
+  // Orders elements and naked keys with respect to one another by key, for
+  // use with the standard binary search algorithms.
+  struct ValueKeyCompare {
+    explicit ValueKeyCompare(const Compare& comp) : comp(comp) {
+    }
+    bool operator()(const value_type& value, const Key& key) const {
+      return comp(value.first, key);
+    }
+    bool operator()(const Key& key, const value_type& value) const {
+      return comp(key, value.first);
+    }
+    Compare comp;
+  };
+
+  // @returns the element storage currently in use. The elements live inline
+  //     unless they exceed the inline capacity, in which case they all live
+  //     in spill_.
+  value_type* data() {
+    if (size_ > kInlineCapacity)
+      return &spill_[0];
+    return inline_;
+  }
+  const value_type* data() const {
+    if (size_ > kInlineCapacity)
+      return &spill_[0];
+    return inline_;
+  }
+
+  // The inline element storage. Only the first size_ elements are
+  // meaningful, and only while size_ <= kInlineCapacity.
+  value_type inline_[kInlineCapacity];
+
+  // The heap element storage, used only when size_ > kInlineCapacity.
+  std::vector<value_type> spill_;
+
+  // The number of elements in this map.
+  size_t size_;
+
+  // The key comparator.
+  Compare comp_;
+};
+
+// Element-wise equality, matching std::map semantics.
+template <typename Key, typename T, size_t kInlineCapacity, typename Compare>
+bool operator==(const FlatMap<Key, T, kInlineCapacity, Compare>& lhs,
+                const FlatMap<Key, T, kInlineCapacity, Compare>& rhs) {
+  return lhs.size() == rhs.size() &&
+      std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template <typename Key, typename T, size_t kInlineCapacity, typename Compare>
+bool operator!=(const FlatMap<Key, T, kInlineCapacity, Compare>& lhs,
+                const FlatMap<Key, T, kInlineCapacity, Compare>& rhs) {
+  return !(lhs == rhs);
+}
+
+}  // namespace common
+
+#endif  // SYZYGY_COMMON_FLAT_MAP_H_
@@ -0,0 +1,151 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/flat_map.h"
+
+#include "gtest/gtest.h"
+
+namespace common {
+
+namespace {
+
+typedef FlatMap<int, int, 4> TestMap;
+
+}  // namespace
+
+TEST(FlatMapTest, InsertFindAndIterate) {
+  TestMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(0u, map.size());
+
+  // Insert out of key order.
+  EXPECT_TRUE(map.insert(std::make_pair(3, 30)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(1, 10)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(2, 20)).second);
+  EXPECT_EQ(3u, map.size());
+
+  // A duplicate key must not be inserted.
+  std::pair<TestMap::iterator, bool> result =
+      map.insert(std::make_pair(2, 200));
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ(20, result.first->second);
+  EXPECT_EQ(3u, map.size());
+
+  // Iteration visits elements in increasing key order.
+  TestMap::const_iterator it = map.begin();
+  for (int key = 1; key <= 3; ++key, ++it) {
+    ASSERT_TRUE(it != map.end());
+    EXPECT_EQ(key, it->first);
+    EXPECT_EQ(key * 10, it->second);
+  }
+  EXPECT_TRUE(it == map.end());
+  EXPECT_EQ(3, map.rbegin()->first);
+
+  EXPECT_EQ(1u, map.count(2));
+  EXPECT_EQ(0u, map.count(4));
+  EXPECT_TRUE(map.find(4) == map.end());
+  ASSERT_TRUE(map.find(3) != map.end());
+  EXPECT_EQ(30, map.find(3)->second);
+}
+
+TEST(FlatMapTest, LowerAndUpperBound) {
+  TestMap map;
+  map.insert(std::make_pair(2, 20));
+  map.insert(std::make_pair(4, 40));
+  map.insert(std::make_pair(6, 60));
+
+  EXPECT_EQ(2, map.lower_bound(1)->first);
+  EXPECT_EQ(2, map.lower_bound(2)->first);
+  EXPECT_EQ(4, map.lower_bound(3)->first);
+  EXPECT_TRUE(map.lower_bound(7) == map.end());
+
+  EXPECT_EQ(4, map.upper_bound(2)->first);
+  EXPECT_EQ(6, map.upper_bound(5)->first);
+  EXPECT_TRUE(map.upper_bound(6) == map.end());
+}
+
+TEST(FlatMapTest, SpillsBeyondInlineCapacity) {
+  TestMap map;
+
+  // Insert well past the inline capacity of 4.
+  const int kElementCount = 20;
+  for (int key = kElementCount - 1; key >= 0; --key)
+    EXPECT_TRUE(map.insert(std::make_pair(key, key * 10)).second);
+  EXPECT_EQ(static_cast<size_t>(kElementCount), map.size());
+
+  // All elements are still found, in order.
+  int expected_key = 0;
+  TestMap::const_iterator it = map.begin();
+  for (; it != map.end(); ++it, ++expected_key) {
+    EXPECT_EQ(expected_key, it->first);
+    EXPECT_EQ(expected_key * 10, it->second);
+  }
+  EXPECT_EQ(kElementCount, expected_key);
+
+  // Erase back down below the inline capacity.
+  for (int key = 0; key < kElementCount - 2; ++key)
+    EXPECT_EQ(1u, map.erase(key));
+  EXPECT_EQ(2u, map.size());
+  EXPECT_EQ(kElementCount - 2, map.begin()->first);
+  ASSERT_TRUE(map.find(kElementCount - 1) != map.end());
+  EXPECT_EQ((kElementCount - 1) * 10, map.find(kElementCount - 1)->second);
+}
+
+TEST(FlatMapTest, EraseByIterator) {
+  TestMap map;
+  map.insert(std::make_pair(1, 10));
+  map.insert(std::make_pair(2, 20));
+  map.insert(std::make_pair(3, 30));
+
+  TestMap::iterator it = map.erase(map.find(2));
+  ASSERT_TRUE(it != map.end());
+  EXPECT_EQ(3, it->first);
+  EXPECT_EQ(2u, map.size());
+  EXPECT_TRUE(map.find(2) == map.end());
+
+  it = map.erase(map.find(3));
+  EXPECT_TRUE(it == map.end());
+}
+
+TEST(FlatMapTest, IndexOperator) {
+  TestMap map;
+  map[7] = 70;
+  EXPECT_EQ(1u, map.size());
+  EXPECT_EQ(70, map[7]);
+
+  // Accessing an absent key default-constructs it.
+  EXPECT_EQ(0, map[8]);
+  EXPECT_EQ(2u, map.size());
+}
+
+TEST(FlatMapTest, CopyAndCompare) {
+  TestMap map1;
+  for (int key = 0; key < 10; ++key)
+    map1.insert(std::make_pair(key, key * 10));
+
+  TestMap map2(map1);
+  EXPECT_TRUE(map1 == map2);
+
+  map2.erase(5);
+  EXPECT_TRUE(map1 != map2);
+
+  map2 = map1;
+  EXPECT_TRUE(map1 == map2);
+
+  map2.clear();
+  EXPECT_TRUE(map2.empty());
+  EXPECT_TRUE(map1 != map2);
+}
+
+}  // namespace common
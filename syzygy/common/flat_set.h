@@ -0,0 +1,306 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares FlatSet, the set counterpart of FlatMap. Like FlatMap it keeps
+// its elements in a sorted array rather than in a node-based tree, with the
+// first few elements stored inline in the container itself. In addition,
+// insertions are buffered and folded into the sorted storage in batches, so
+// that building a large set by repeated insertion costs a sort rather than
+// a quadratic series of array shifts.
+
+#ifndef SYZYGY_COMMON_FLAT_SET_H_
+#define SYZYGY_COMMON_FLAT_SET_H_
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+#include "base/logging.h"
+
+namespace common {
+
+// A set of T that iterates in increasing order, exactly as std::set does,
+// but stores its elements contiguously. Up to @p kInlineCapacity elements
+// are stored inline; beyond that the contents spill to heap-allocated
+// buffers.
+//
+// Insertions into sets beyond the inline capacity are deferred: they are
+// appended to a pending buffer which is sorted and merged into the element
+// storage by the next read. A burst of k insertions into a set of n
+// elements thus costs O(k lg k + n) in total rather than O(kn). The value
+// type must be default-constructible and assignable. Lookup is O(lg n);
+// erasure is O(n). Unlike std::set, insert() and erase() invalidate all
+// outstanding iterators, as does the first read following an insertion.
+// Also unlike std::set, a read may fold buffered insertions in, so
+// concurrent reads of a set with pending insertions are not safe. Call
+// Commit() after the last insertion to make subsequent concurrent reads
+// safe.
+template <typename T, size_t kInlineCapacity,
+          typename Compare = std::less<T> >
+class FlatSet {
+ public:
+  typedef T key_type;
+  typedef T value_type;
+  typedef Compare key_compare;
+  typedef size_t size_type;
+  // Set elements are immutable, so both reference and iterator flavors are
+  // const.
+  typedef const value_type& reference;
+  typedef const value_type& const_reference;
+  typedef const value_type* iterator;
+  typedef const value_type* const_iterator;
+  typedef std::reverse_iterator<const_iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  FlatSet() : size_(0) {
+  }
+
+  FlatSet(const FlatSet& other) : size_(0) {
+    *this = other;
+  }
+
+  FlatSet& operator=(const FlatSet& other) {
+    if (this == &other)
+      return *this;
+    other.Commit();
+    pending_.clear();
+    spill_ = other.spill_;
+    if (other.size_ <= kInlineCapacity)
+      std::copy(other.inline_, other.inline_ + other.size_, inline_);
+    size_ = other.size_;
+    return *this;
+  }
+
+  // @name Iteration. Elements are visited in increasing order.
+  // @{
+  const_iterator begin() const {
+    Commit();
+    return data();
+  }
+  const_iterator end() const {
+    Commit();
+    return data() + size_;
+  }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  // @}
+
+  // @name Capacity.
+  // @{
+  bool empty() const { return size_ == 0 && pending_.empty(); }
+  size_type size() const {
+    Commit();
+    return size_;
+  }
+  // @}
+
+  // Removes all elements from this set.
+  void clear() {
+    spill_.clear();
+    pending_.clear();
+    size_ = 0;
+  }
+
+  // Exchanges the contents of this set with those of @p other.
+  // @param other the set to exchange contents with.
+  void swap(FlatSet& other) {
+    std::swap_ranges(inline_, inline_ + kInlineCapacity, other.inline_);
+    spill_.swap(other.spill_);
+    pending_.swap(other.pending_);
+    std::swap(size_, other.size_);
+    std::swap(comp_, other.comp_);
+  }
+
+  // @name Lookup.
+  // @{
+  const_iterator lower_bound(const value_type& value) const {
+    return std::lower_bound(begin(), end(), value, comp_);
+  }
+  const_iterator upper_bound(const value_type& value) const {
+    return std::upper_bound(begin(), end(), value, comp_);
+  }
+  const_iterator find(const value_type& value) const {
+    const_iterator it = lower_bound(value);
+    if (it != end() && !comp_(value, *it))
+      return it;
+    return end();
+  }
+  size_type count(const value_type& value) const {
+    return find(value) == end() ? 0 : 1;
+  }
+  // @}
+
+  // Inserts @p value into this set. Sets within the inline capacity are
+  // kept sorted in place; larger sets buffer the insertion until the next
+  // read, so that bursts of insertions are sorted as a batch. A duplicate
+  // of an existing element is silently discarded, like std::set. All
+  // outstanding iterators are invalidated.
+  // @param value the element to insert.
+  void insert(const value_type& value) {
+    if (pending_.empty() && size_ < kInlineCapacity) {
+      value_type* it =
+          std::lower_bound(inline_, inline_ + size_, value, comp_);
+      if (it != inline_ + size_ && !comp_(value, *it))
+        return;
+      for (value_type* i = inline_ + size_; i > it; --i)
+        *i = *(i - 1);
+      *it = value;
+      ++size_;
+      return;
+    }
+    pending_.push_back(value);
+  }
+
+  // Inserts @p value into this set, ignoring the position hint. This
+  // overload exists so that the container works with std::inserter. It has
+  // to return an iterator to the inserted element and therefore commits any
+  // buffered insertions.
+  // @param hint ignored.
+  // @param value the element to insert.
+  // @returns an iterator to the element equivalent to @p value.
+  const_iterator insert(const_iterator hint, const value_type& value) {
+    insert(value);
+    return find(value);
+  }
+
+  // Erases the element @p it points to. All outstanding iterators are
+  // invalidated.
+  // @param it the element to erase. Must be a dereferenceable iterator into
+  //     this set.
+  // @returns an iterator to the element following the erased one.
+  const_iterator erase(const_iterator it) {
+    DCHECK(pending_.empty());
+    DCHECK(begin() <= it && it < end());
+    size_t index = it - begin();
+    if (size_ > kInlineCapacity) {
+      spill_.erase(spill_.begin() + index);
+      --size_;
+      // Move the elements back inline if they now fit.
+      if (size_ == kInlineCapacity) {
+        std::copy(spill_.begin(), spill_.end(), inline_);
+        spill_.clear();
+      }
+    } else {
+      for (size_t i = index; i + 1 < size_; ++i)
+        inline_[i] = inline_[i + 1];
+      --size_;
+    }
+    return begin() + index;
+  }
+
+  // Erases the element equivalent to @p value, if any.
+  // @param value the element to erase.
+  // @returns the number of elements erased (0 or 1).
+  size_type erase(const value_type& value) {
+    const_iterator it = find(value);
+    if (it == end())
+      return 0;
+    erase(it);
+    return 1;
+  }
+
+  // Folds the buffered insertions into the sorted element storage. This is
+  // conceptually const - it does not change the contents of the set - so it
+  // is callable on a const set and operates on mutable members. Any read
+  // calls this implicitly; it is public so that a set can be brought into
+  // its committed state at a well-defined point, after which concurrent
+  // reads are safe until the next mutation.
+  void Commit() const {
+    if (pending_.empty())
+      return;
+
+    std::sort(pending_.begin(), pending_.end(), comp_);
+
+    // Merge in the heap storage; conservatively move the inline elements
+    // there first, as the merged contents may no longer fit inline.
+    if (size_ <= kInlineCapacity)
+      spill_.assign(inline_, inline_ + size_);
+    size_t sorted_size = spill_.size();
+    spill_.insert(spill_.end(), pending_.begin(), pending_.end());
+    pending_.clear();
+    std::inplace_merge(spill_.begin(), spill_.begin() + sorted_size,
+                       spill_.end(), comp_);
+    spill_.erase(std::unique(spill_.begin(), spill_.end(),
+                             EqualFromCompare(comp_)),
+                 spill_.end());
+    size_ = spill_.size();
+
+    // Move the elements back inline if they fit.
+    if (size_ <= kInlineCapacity) {
+      std::copy(spill_.begin(), spill_.end(), inline_);
+      spill_.clear();
+    }
+  }
+
+ private:
+  // Derives element equality from the ordering, for use with std::unique.
+  struct EqualFromCompare {
+    explicit EqualFromCompare(const Compare& comp) : comp(comp) {
+    }
+    bool operator()(const value_type& lhs, const value_type& rhs) const {
+      return !comp(lhs, rhs) && !comp(rhs, lhs);
+    }
+    Compare comp;
+  };
+
+  // @returns the committed element storage currently in use. The elements
+  //     live inline unless they exceed the inline capacity, in which case
+  //     they all live in spill_.
+  const value_type* data() const {
+    DCHECK(pending_.empty());
+    if (size_ > kInlineCapacity)
+      return &spill_[0];
+    return inline_;
+  }
+
+  // The inline element storage. Only the first size_ elements are
+  // meaningful, and only while size_ <= kInlineCapacity. Mutable because
+  // Commit may shuffle elements between the storage buffers.
+  mutable value_type inline_[kInlineCapacity];
+
+  // The heap element storage, used only when size_ > kInlineCapacity.
+  mutable std::vector<value_type> spill_;
+
+  // The buffered insertions, in insertion order, awaiting the next Commit.
+  mutable std::vector<value_type> pending_;
+
+  // The number of committed elements in this set.
+  mutable size_t size_;
+
+  // The element comparator.
+  Compare comp_;
+};
+
+// Element-wise equality, matching std::set semantics.
+template <typename T, size_t kInlineCapacity, typename Compare>
+bool operator==(const FlatSet<T, kInlineCapacity, Compare>& lhs,
+                const FlatSet<T, kInlineCapacity, Compare>& rhs) {
+  return lhs.size() == rhs.size() &&
+      std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template <typename T, size_t kInlineCapacity, typename Compare>
+bool operator!=(const FlatSet<T, kInlineCapacity, Compare>& lhs,
+                const FlatSet<T, kInlineCapacity, Compare>& rhs) {
+  return !(lhs == rhs);
+}
+
+}  // namespace common
+
+#endif  // SYZYGY_COMMON_FLAT_SET_H_
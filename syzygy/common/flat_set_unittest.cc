@@ -0,0 +1,201 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/flat_set.h"
+
+#include <iterator>
+
+#include "base/basictypes.h"
+#include "gtest/gtest.h"
+
+namespace common {
+
+namespace {
+
+typedef FlatSet<int, 4> TestSet;
+
+}  // namespace
+
+TEST(FlatSetTest, InsertFindAndIterate) {
+  TestSet set;
+  EXPECT_TRUE(set.empty());
+  EXPECT_EQ(0u, set.size());
+
+  // Insert out of order, with a duplicate.
+  set.insert(3);
+  set.insert(1);
+  set.insert(2);
+  set.insert(2);
+  EXPECT_FALSE(set.empty());
+  EXPECT_EQ(3u, set.size());
+
+  // Iteration visits elements in increasing order.
+  TestSet::const_iterator it = set.begin();
+  for (int value = 1; value <= 3; ++value, ++it) {
+    ASSERT_TRUE(it != set.end());
+    EXPECT_EQ(value, *it);
+  }
+  EXPECT_TRUE(it == set.end());
+  EXPECT_EQ(3, *set.rbegin());
+
+  EXPECT_EQ(1u, set.count(2));
+  EXPECT_EQ(0u, set.count(4));
+  EXPECT_TRUE(set.find(4) == set.end());
+  ASSERT_TRUE(set.find(3) != set.end());
+  EXPECT_EQ(3, *set.find(3));
+}
+
+TEST(FlatSetTest, LowerAndUpperBound) {
+  TestSet set;
+  set.insert(2);
+  set.insert(4);
+  set.insert(6);
+
+  EXPECT_EQ(2, *set.lower_bound(1));
+  EXPECT_EQ(2, *set.lower_bound(2));
+  EXPECT_EQ(4, *set.lower_bound(3));
+  EXPECT_TRUE(set.lower_bound(7) == set.end());
+
+  EXPECT_EQ(4, *set.upper_bound(2));
+  EXPECT_EQ(6, *set.upper_bound(5));
+  EXPECT_TRUE(set.upper_bound(6) == set.end());
+}
+
+TEST(FlatSetTest, BatchedInsertionsCommitOnRead) {
+  TestSet set;
+
+  // Insert well past the inline capacity of 4, with every element
+  // duplicated, and without reading in between.
+  const int kElementCount = 20;
+  for (int value = kElementCount - 1; value >= 0; --value) {
+    set.insert(value);
+    set.insert(value);
+  }
+
+  // The first read folds the pending insertions in and collapses the
+  // duplicates.
+  EXPECT_EQ(static_cast<size_t>(kElementCount), set.size());
+  int expected_value = 0;
+  TestSet::const_iterator it = set.begin();
+  for (; it != set.end(); ++it, ++expected_value)
+    EXPECT_EQ(expected_value, *it);
+  EXPECT_EQ(kElementCount, expected_value);
+
+  // Inserting a duplicate of a committed element leaves the set unchanged.
+  set.insert(7);
+  EXPECT_EQ(static_cast<size_t>(kElementCount), set.size());
+
+  // Erase back down below the inline capacity.
+  for (int value = 0; value < kElementCount - 2; ++value)
+    EXPECT_EQ(1u, set.erase(value));
+  EXPECT_EQ(2u, set.size());
+  EXPECT_EQ(kElementCount - 2, *set.begin());
+  EXPECT_TRUE(set.find(kElementCount - 1) != set.end());
+}
+
+TEST(FlatSetTest, EraseByIterator) {
+  TestSet set;
+  set.insert(1);
+  set.insert(2);
+  set.insert(3);
+
+  TestSet::const_iterator it = set.erase(set.find(2));
+  ASSERT_TRUE(it != set.end());
+  EXPECT_EQ(3, *it);
+  EXPECT_EQ(2u, set.size());
+  EXPECT_TRUE(set.find(2) == set.end());
+
+  it = set.erase(set.find(3));
+  EXPECT_TRUE(it == set.end());
+}
+
+TEST(FlatSetTest, WorksWithStdInserter) {
+  TestSet set;
+  const int kValues[] = { 5, 3, 8, 3 };
+  std::copy(kValues, kValues + arraysize(kValues),
+            std::inserter(set, set.begin()));
+  EXPECT_EQ(3u, set.size());
+  EXPECT_EQ(3, *set.begin());
+  EXPECT_EQ(8, *set.rbegin());
+}
+
+TEST(FlatSetTest, Swap) {
+  TestSet set1;
+  set1.insert(1);
+  TestSet set2;
+  for (int value = 0; value < 10; ++value)
+    set2.insert(value);
+
+  set1.swap(set2);
+  EXPECT_EQ(10u, set1.size());
+  EXPECT_EQ(1u, set2.size());
+  EXPECT_EQ(1, *set2.begin());
+}
+
+TEST(FlatSetTest, AssignmentDiscardsPendingInsertions) {
+  // Grow a set past the inline capacity and commit it.
+  TestSet set1;
+  for (int value = 0; value < 8; ++value)
+    set1.insert(value);
+  EXPECT_EQ(8u, set1.size());
+
+  // This insertion is buffered, not committed.
+  set1.insert(100);
+
+  // Assigning over the set must discard the buffered insertion rather than
+  // folding it into the new contents on the next read.
+  TestSet set2;
+  set2.insert(1);
+  set1 = set2;
+  EXPECT_EQ(1u, set1.size());
+  EXPECT_EQ(1u, set1.count(1));
+  EXPECT_EQ(0u, set1.count(100));
+  EXPECT_TRUE(set1 == set2);
+}
+
+TEST(FlatSetTest, ExplicitCommit) {
+  TestSet set;
+  for (int value = 0; value < 8; ++value)
+    set.insert(value);
+
+  // Committing on a const reference folds the pending insertions in;
+  // committing again is a no-op.
+  const TestSet& const_set = set;
+  const_set.Commit();
+  const_set.Commit();
+  EXPECT_EQ(8u, const_set.size());
+  EXPECT_EQ(1u, const_set.count(7));
+}
+
+TEST(FlatSetTest, CopyAndCompare) {
+  TestSet set1;
+  for (int value = 0; value < 10; ++value)
+    set1.insert(value);
+
+  // Copying a set with pending insertions commits them first.
+  TestSet set2(set1);
+  EXPECT_TRUE(set1 == set2);
+
+  set2.erase(5);
+  EXPECT_TRUE(set1 != set2);
+
+  set2 = set1;
+  EXPECT_TRUE(set1 == set2);
+
+  set2.clear();
+  EXPECT_TRUE(set2.empty());
+  EXPECT_TRUE(set1 != set2);
+}
+
+}  // namespace common
@@ -0,0 +1,178 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/phase_profiler.h"
+
+#include "base/environment.h"
+#include "base/file_util.h"
+#include "base/json/json_writer.h"
+#include "base/logging.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/values.h"
+
+namespace common {
+
+namespace {
+
+// Builds the base::Value representation of @p phase and its children.
+base::DictionaryValue* PhaseToValue(const PhaseProfiler::Phase& phase) {
+  scoped_ptr<base::DictionaryValue> value(new base::DictionaryValue());
+  value->SetString("name", phase.name);
+  value->SetDouble("duration_ms", phase.duration.InMillisecondsF());
+  value->SetInteger("count", static_cast<int>(phase.count));
+  if (!phase.children.empty()) {
+    base::ListValue* children = new base::ListValue();
+    for (size_t i = 0; i < phase.children.size(); ++i)
+      children->Append(PhaseToValue(*phase.children[i]));
+    value->Set("children", children);
+  }
+  return value.release();
+}
+
+// Logs @p phase and its children, indented by nesting depth.
+void LogPhase(const PhaseProfiler::Phase& phase, size_t depth) {
+  LOG(INFO) << std::string(2 * depth, ' ') << phase.name << ": "
+            << phase.duration.InSecondsF() << "s (" << phase.count
+            << " run(s)).";
+  for (size_t i = 0; i < phase.children.size(); ++i)
+    LogPhase(*phase.children[i], depth + 1);
+}
+
+}  // namespace
+
+const char PhaseProfiler::kPhaseProfileEnvVar[] = "SYZYGY_PHASE_PROFILE";
+
+PhaseProfiler::Phase::Phase(const base::StringPiece& name)
+    : name(name.as_string()), count(0), parent(NULL) {
+}
+
+PhaseProfiler::Phase::~Phase() {
+}
+
+PhaseProfiler::Phase* PhaseProfiler::Phase::FindOrAddChild(
+    const base::StringPiece& name) {
+  for (size_t i = 0; i < children.size(); ++i) {
+    if (name == children[i]->name)
+      return children[i];
+  }
+
+  Phase* child = new Phase(name);
+  child->parent = this;
+  children.push_back(child);
+  return child;
+}
+
+PhaseProfiler::PhaseProfiler()
+    : enabled_(false), root_("root"), current_(&root_) {
+}
+
+PhaseProfiler* PhaseProfiler::Instance() {
+  // The tools are single-threaded at the point this is first called, early
+  // in Application::Run, so plain function-local static initialization is
+  // safe.
+  static PhaseProfiler instance;
+  return &instance;
+}
+
+void PhaseProfiler::EnableFromEnvironment() {
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  std::string value;
+  if (!env->GetVar(kPhaseProfileEnvVar, &value) || value == "0")
+    return;
+
+  // Any value other than an explicit toggle names the report file.
+  base::FilePath report_path;
+  if (!value.empty() && value != "1")
+    report_path = base::FilePath::FromUTF8Unsafe(value);
+
+  Enable(report_path);
+}
+
+void PhaseProfiler::Enable(const base::FilePath& report_path) {
+  enabled_ = true;
+  report_path_ = report_path;
+}
+
+void PhaseProfiler::Reset() {
+  enabled_ = false;
+  report_path_.clear();
+  root_.children.clear();
+  current_ = &root_;
+}
+
+void PhaseProfiler::EnterPhase(const base::StringPiece& name) {
+  DCHECK(enabled_);
+  Phase* phase = current_->FindOrAddChild(name);
+  phase->start = base::TimeTicks::Now();
+  current_ = phase;
+}
+
+void PhaseProfiler::ExitPhase() {
+  DCHECK(enabled_);
+  DCHECK(current_ != &root_);
+  current_->duration += base::TimeTicks::Now() - current_->start;
+  ++current_->count;
+  current_ = current_->parent;
+}
+
+std::string PhaseProfiler::ToJson(bool pretty_print) const {
+  base::ListValue phases;
+  for (size_t i = 0; i < root_.children.size(); ++i)
+    phases.Append(PhaseToValue(*root_.children[i]));
+
+  std::string json;
+  base::JSONWriter::WriteWithOptions(
+      &phases,
+      pretty_print ? base::JSONWriter::OPTIONS_PRETTY_PRINT : 0,
+      &json);
+  return json;
+}
+
+void PhaseProfiler::WriteReport() {
+  if (!enabled_ || root_.children.empty())
+    return;
+
+  if (report_path_.empty()) {
+    LOG(INFO) << "Phase timings:";
+    for (size_t i = 0; i < root_.children.size(); ++i)
+      LogPhase(*root_.children[i], 1);
+    return;
+  }
+
+  std::string json = ToJson(true);
+  if (base::WriteFile(report_path_, json.data(), json.size()) !=
+      static_cast<int>(json.size())) {
+    LOG(ERROR) << "Failed to write phase timing report to '"
+               << report_path_.value() << "'.";
+    return;
+  }
+  LOG(INFO) << "Wrote phase timing report to '" << report_path_.value()
+            << "'.";
+}
+
+ScopedPhaseTimer::ScopedPhaseTimer(const base::StringPiece& name)
+    : entered_(false) {
+  PhaseProfiler* profiler = PhaseProfiler::Instance();
+  if (!profiler->enabled())
+    return;
+  profiler->EnterPhase(name);
+  entered_ = true;
+}
+
+ScopedPhaseTimer::~ScopedPhaseTimer() {
+  if (entered_)
+    PhaseProfiler::Instance()->ExitPhase();
+}
+
+}  // namespace common
@@ -0,0 +1,168 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares PhaseProfiler, a lightweight hierarchical profiler for the major
+// phases of the Syzygy tools (decomposition, transformation, layout, image
+// writing, and so on). Profiling is disabled by default and costs a single
+// branch per phase, so the timers may be left in shipping code. It is
+// enabled through the SYZYGY_PHASE_PROFILE environment variable, and the
+// gathered timings are reported when the application exits (see
+// common::Application), uniformly across all of the tools.
+//
+// Phases are declared with a scoped timer and nest to form a tree:
+//
+//   {
+//     ScopedPhaseTimer phase("Decomposing image");
+//     ...
+//   }
+//
+// Environment variable:
+//
+//   set SYZYGY_PHASE_PROFILE=1       reports the timings through the log.
+//   set SYZYGY_PHASE_PROFILE=<path>  writes the timings to <path> as JSON.
+//
+// The profiler aggregates by phase name within the enclosing phase:
+// re-entering a phase accumulates its duration and bumps its count. Phases
+// must strictly nest, and must be entered and exited on a single thread.
+
+#ifndef SYZYGY_COMMON_PHASE_PROFILER_H_
+#define SYZYGY_COMMON_PHASE_PROFILER_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/files/file_path.h"
+#include "base/memory/scoped_vector.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+
+namespace common {
+
+// The process-wide registry of phase timings. Phases are typically declared
+// via ScopedPhaseTimer rather than by using this class directly.
+class PhaseProfiler {
+ public:
+  // The environment variable through which profiling is enabled.
+  static const char kPhaseProfileEnvVar[];
+
+  // A node of the phase tree.
+  struct Phase {
+    explicit Phase(const base::StringPiece& name);
+    ~Phase();
+
+    // Returns the child phase with the given name, creating it if
+    // necessary.
+    // @param name The name of the child phase.
+    // @returns the child phase.
+    Phase* FindOrAddChild(const base::StringPiece& name);
+
+    // The name of the phase.
+    std::string name;
+    // The accumulated duration of the phase.
+    base::TimeDelta duration;
+    // The number of times the phase has been entered and exited.
+    size_t count;
+    // The time at which the phase was last entered. Only meaningful while
+    // the phase is open.
+    base::TimeTicks start;
+    // The enclosing phase. NULL for the root.
+    Phase* parent;
+    // The nested phases, in order of first entry.
+    ScopedVector<Phase> children;
+  };
+
+  // @returns the process-wide profiler instance.
+  static PhaseProfiler* Instance();
+
+  // @returns true if profiling is enabled.
+  bool enabled() const { return enabled_; }
+
+  // Enables profiling if the SYZYGY_PHASE_PROFILE environment variable is
+  // set. A value of 1 reports the timings through the log; any other
+  // non-empty value names the file the timings are written to as JSON.
+  void EnableFromEnvironment();
+
+  // Enables profiling.
+  // @param report_path The file the timings are written to as JSON when the
+  //     report is made. If empty the timings are reported through the log.
+  void Enable(const base::FilePath& report_path);
+
+  // Discards any gathered timings and disables profiling.
+  void Reset();
+
+  // Opens a phase nested in the currently open phase.
+  // @param name The name of the phase.
+  // @pre enabled() is true.
+  void EnterPhase(const base::StringPiece& name);
+
+  // Closes the currently open phase, accumulating its duration.
+  // @pre enabled() is true and a phase is open.
+  void ExitPhase();
+
+  // Serializes the gathered timings to JSON: a list of phases, each a
+  // dictionary of name, duration_ms, count and (if any) children.
+  // @param pretty_print If true the output is indented for human
+  //     consumption.
+  // @returns the JSON representation of the phase tree.
+  std::string ToJson(bool pretty_print) const;
+
+  // Reports the gathered timings, to the report file as JSON if one was
+  // named, through the log otherwise. Does nothing if profiling is disabled
+  // or no phases were recorded.
+  void WriteReport();
+
+  // @returns the root of the phase tree, whose children are the outermost
+  //     phases.
+  const Phase& root() const { return root_; }
+
+ protected:
+  PhaseProfiler();
+
+  // Indicates whether profiling is enabled.
+  bool enabled_;
+
+  // The file the report is written to; empty to report through the log.
+  base::FilePath report_path_;
+
+  // The root of the phase tree. The root itself is never timed.
+  Phase root_;
+
+  // The currently open phase; the root when no phase is open.
+  Phase* current_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PhaseProfiler);
+};
+
+// A helper that brackets a phase within a scope. When profiling is disabled
+// this costs a single branch.
+class ScopedPhaseTimer {
+ public:
+  // Enters the named phase if profiling is enabled.
+  // @param name The name of the phase.
+  explicit ScopedPhaseTimer(const base::StringPiece& name);
+
+  // Exits the phase entered by the constructor, if any.
+  ~ScopedPhaseTimer();
+
+ private:
+  // Indicates whether a phase was entered and must be exited.
+  bool entered_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedPhaseTimer);
+};
+
+}  // namespace common
+
+#endif  // SYZYGY_COMMON_PHASE_PROFILER_H_
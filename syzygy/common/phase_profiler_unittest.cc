@@ -0,0 +1,140 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/phase_profiler.h"
+
+#include "base/environment.h"
+#include "base/memory/scoped_ptr.h"
+#include "gtest/gtest.h"
+
+namespace common {
+
+namespace {
+
+// Exposes the constructor so tests can run against their own instance
+// rather than the process-wide one.
+class TestPhaseProfiler : public PhaseProfiler {
+ public:
+  TestPhaseProfiler() {
+  }
+
+  using PhaseProfiler::report_path_;
+};
+
+}  // namespace
+
+TEST(PhaseProfilerTest, DisabledByDefault) {
+  TestPhaseProfiler profiler;
+  EXPECT_FALSE(profiler.enabled());
+  EXPECT_TRUE(profiler.root().children.empty());
+}
+
+TEST(PhaseProfilerTest, AggregatesHierarchically) {
+  TestPhaseProfiler profiler;
+  profiler.Enable(base::FilePath());
+  ASSERT_TRUE(profiler.enabled());
+
+  profiler.EnterPhase("outer");
+  profiler.EnterPhase("inner");
+  profiler.ExitPhase();
+  profiler.EnterPhase("inner");
+  profiler.ExitPhase();
+  profiler.ExitPhase();
+
+  const PhaseProfiler::Phase& root = profiler.root();
+  ASSERT_EQ(1u, root.children.size());
+  const PhaseProfiler::Phase* outer = root.children[0];
+  EXPECT_EQ("outer", outer->name);
+  EXPECT_EQ(1u, outer->count);
+
+  // Re-entering a phase aggregates into the same node.
+  ASSERT_EQ(1u, outer->children.size());
+  const PhaseProfiler::Phase* inner = outer->children[0];
+  EXPECT_EQ("inner", inner->name);
+  EXPECT_EQ(2u, inner->count);
+  EXPECT_LE(inner->duration, outer->duration);
+}
+
+TEST(PhaseProfilerTest, ToJson) {
+  TestPhaseProfiler profiler;
+  profiler.Enable(base::FilePath());
+  profiler.EnterPhase("outer");
+  profiler.EnterPhase("inner");
+  profiler.ExitPhase();
+  profiler.ExitPhase();
+
+  std::string json = profiler.ToJson(false);
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"outer\""));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"inner\""));
+  EXPECT_NE(std::string::npos, json.find("\"children\""));
+  EXPECT_NE(std::string::npos, json.find("\"duration_ms\""));
+  EXPECT_NE(std::string::npos, json.find("\"count\":1"));
+}
+
+TEST(PhaseProfilerTest, EnableFromEnvironment) {
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  std::string previous;
+  bool had_var = env->GetVar(PhaseProfiler::kPhaseProfileEnvVar, &previous);
+
+  env->UnSetVar(PhaseProfiler::kPhaseProfileEnvVar);
+  TestPhaseProfiler unset_profiler;
+  unset_profiler.EnableFromEnvironment();
+  EXPECT_FALSE(unset_profiler.enabled());
+
+  env->SetVar(PhaseProfiler::kPhaseProfileEnvVar, "0");
+  TestPhaseProfiler off_profiler;
+  off_profiler.EnableFromEnvironment();
+  EXPECT_FALSE(off_profiler.enabled());
+
+  env->SetVar(PhaseProfiler::kPhaseProfileEnvVar, "1");
+  TestPhaseProfiler log_profiler;
+  log_profiler.EnableFromEnvironment();
+  EXPECT_TRUE(log_profiler.enabled());
+  EXPECT_TRUE(log_profiler.report_path_.empty());
+
+  env->SetVar(PhaseProfiler::kPhaseProfileEnvVar, "report.json");
+  TestPhaseProfiler file_profiler;
+  file_profiler.EnableFromEnvironment();
+  EXPECT_TRUE(file_profiler.enabled());
+  EXPECT_EQ(L"report.json", file_profiler.report_path_.value());
+
+  if (had_var) {
+    env->SetVar(PhaseProfiler::kPhaseProfileEnvVar, previous);
+  } else {
+    env->UnSetVar(PhaseProfiler::kPhaseProfileEnvVar);
+  }
+}
+
+TEST(PhaseProfilerTest, ScopedPhaseTimer) {
+  PhaseProfiler* profiler = PhaseProfiler::Instance();
+  profiler->Reset();
+
+  // With profiling disabled the timer is a no-op.
+  {
+    ScopedPhaseTimer timer("ignored");
+  }
+  EXPECT_TRUE(profiler->root().children.empty());
+
+  profiler->Enable(base::FilePath());
+  {
+    ScopedPhaseTimer timer("phase");
+  }
+  ASSERT_EQ(1u, profiler->root().children.size());
+  EXPECT_EQ("phase", profiler->root().children[0]->name);
+  EXPECT_EQ(1u, profiler->root().children[0]->count);
+
+  profiler->Reset();
+}
+
+}  // namespace common
@@ -0,0 +1,225 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/shared_symbol_cache.h"
+
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "syzygy/common/com_utils.h"
+
+namespace common {
+
+namespace {
+
+const uint32 kCacheMagic = 0x43535953;  // 'SYSC'.
+
+// This must be bumped anytime the cache layout changes, so that tools built
+// from different versions of the toolchain never share a mapping.
+const uint32 kCacheVersion = 1;
+
+// The states an entry slot moves through. Slots only ever advance from free
+// to busy to published; a slot left busy by a writer that died is simply
+// never served.
+enum EntryState {
+  kEntryFree = 0,
+  kEntryBusy = 1,
+  kEntryPublished = 2,
+};
+
+uint32 HashKey(uint64 key) {
+  // A simple 64 to 32 bit mix; the key space is small and dense (tagged
+  // RVAs), so this needs only to spread consecutive addresses.
+  uint64 hash = key * 0x9E3779B97F4A7C15;
+  return static_cast<uint32>(hash >> 32);
+}
+
+}  // namespace
+
+// The header at the base of the mapping. The magic is published last, with
+// an interlocked store, so that a process attaching while the creator is
+// still initializing the header observes an invalid cache rather than a
+// half-initialized one.
+struct SharedSymbolCache::CacheHeader {
+  volatile LONG magic;
+  uint32 version;
+  uint32 capacity;
+  uint32 pool_size;
+  // The bump allocation cursor of the value pool.
+  volatile LONG pool_used;
+};
+
+// An entry slot. A writer claims a free slot with an interlocked exchange of
+// its state, fills in the key and value, and then publishes the slot with a
+// second interlocked exchange.
+struct SharedSymbolCache::CacheEntry {
+  volatile LONG state;
+  uint64 key;
+  uint32 value_offset;
+  uint32 value_length;
+};
+
+const uint32 SharedSymbolCache::kDefaultCapacity = 64 * 1024;
+const uint32 SharedSymbolCache::kDefaultPoolSize = 8 * 1024 * 1024;
+
+SharedSymbolCache::SharedSymbolCache() : mapping_(NULL), header_(NULL) {
+}
+
+SharedSymbolCache::~SharedSymbolCache() {
+  if (header_ != NULL)
+    ::UnmapViewOfFile(header_);
+  if (mapping_ != NULL)
+    ::CloseHandle(mapping_);
+}
+
+bool SharedSymbolCache::Init(const GUID& signature, uint32 age) {
+  return Init(signature, age, kDefaultCapacity, kDefaultPoolSize);
+}
+
+bool SharedSymbolCache::Init(const GUID& signature,
+                             uint32 age,
+                             uint32 capacity,
+                             uint32 pool_size) {
+  DCHECK(mapping_ == NULL);
+  DCHECK_LT(0u, capacity);
+  DCHECK_LT(0u, pool_size);
+
+  name_ = base::StringPrintf(
+      L"Local\\syzygy-symbol-cache-"
+      L"%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X-%u",
+      signature.Data1, signature.Data2, signature.Data3,
+      signature.Data4[0], signature.Data4[1], signature.Data4[2],
+      signature.Data4[3], signature.Data4[4], signature.Data4[5],
+      signature.Data4[6], signature.Data4[7],
+      age);
+
+  size_t size = sizeof(CacheHeader) + capacity * sizeof(CacheEntry) +
+      pool_size;
+  mapping_ = ::CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                 0, static_cast<DWORD>(size), name_.c_str());
+  if (mapping_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to create symbol cache mapping: "
+                 << ::common::LogWe(error) << ".";
+    return false;
+  }
+  bool created = ::GetLastError() != ERROR_ALREADY_EXISTS;
+
+  void* view = ::MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0);
+  if (view == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to map symbol cache: "
+                 << ::common::LogWe(error) << ".";
+    ::CloseHandle(mapping_);
+    mapping_ = NULL;
+    return false;
+  }
+
+  CacheHeader* header = reinterpret_cast<CacheHeader*>(view);
+  if (created) {
+    // The mapping is zero initialized by the OS; fill in the header and
+    // publish the magic last so that concurrent attachers never observe a
+    // half-initialized cache.
+    header->version = kCacheVersion;
+    header->capacity = capacity;
+    header->pool_size = pool_size;
+    ::InterlockedExchange(&header->magic, kCacheMagic);
+  } else if (header->magic != static_cast<LONG>(kCacheMagic) ||
+             header->version != kCacheVersion ||
+             header->capacity != capacity ||
+             header->pool_size != pool_size) {
+    // The existing mapping is incompatible (or its creator is mid
+    // initialization); leave it be and run uncached.
+    LOG(WARNING) << "Incompatible symbol cache \"" << name_ << "\".";
+    ::UnmapViewOfFile(view);
+    ::CloseHandle(mapping_);
+    mapping_ = NULL;
+    return false;
+  }
+
+  header_ = header;
+  return true;
+}
+
+bool SharedSymbolCache::Lookup(uint64 key, std::string* value) const {
+  DCHECK(header_ != NULL);
+  DCHECK(value != NULL);
+
+  const CacheEntry* table = entries();
+  uint32 slot = HashKey(key) % header_->capacity;
+  for (uint32 i = 0; i < header_->capacity; ++i) {
+    const CacheEntry* entry = table + (slot + i) % header_->capacity;
+    LONG state = entry->state;
+    if (state == kEntryFree)
+      return false;
+    // Skip busy slots: either their writer is about to publish them or it
+    // died mid-insertion. Either way their contents can't be trusted yet.
+    if (state != kEntryPublished || entry->key != key)
+      continue;
+    value->assign(reinterpret_cast<const char*>(pool() + entry->value_offset),
+                  entry->value_length);
+    return true;
+  }
+  return false;
+}
+
+void SharedSymbolCache::Insert(uint64 key, const base::StringPiece& value) {
+  DCHECK(header_ != NULL);
+  DCHECK_GE(static_cast<size_t>(kuint32max), value.size());
+
+  CacheEntry* table = entries();
+  uint32 slot = HashKey(key) % header_->capacity;
+  for (uint32 i = 0; i < header_->capacity; ++i) {
+    CacheEntry* entry = table + (slot + i) % header_->capacity;
+    LONG state = entry->state;
+    if (state == kEntryPublished && entry->key == key)
+      return;
+    if (state != kEntryFree)
+      continue;
+
+    // Try to claim the slot. On failure another writer got there first;
+    // reexamine the slot, as it may now hold this very key.
+    if (::InterlockedCompareExchange(&entry->state, kEntryBusy,
+                                     kEntryFree) != kEntryFree) {
+      --i;
+      continue;
+    }
+
+    // Carve the value out of the pool. If the pool is exhausted the slot is
+    // left busy, which parks it: leaving it free would let a later insertion
+    // terminate lookup probes short of entries published beyond it.
+    LONG value_offset = ::InterlockedExchangeAdd(
+        &header_->pool_used, static_cast<LONG>(value.size()));
+    if (static_cast<uint64>(value_offset) + value.size() > header_->pool_size)
+      return;
+
+    entry->key = key;
+    entry->value_offset = value_offset;
+    entry->value_length = static_cast<uint32>(value.size());
+    ::memcpy(pool() + value_offset, value.data(), value.size());
+    ::InterlockedExchange(&entry->state, kEntryPublished);
+    return;
+  }
+}
+
+SharedSymbolCache::CacheEntry* SharedSymbolCache::entries() const {
+  DCHECK(header_ != NULL);
+  return reinterpret_cast<CacheEntry*>(header_ + 1);
+}
+
+uint8* SharedSymbolCache::pool() const {
+  DCHECK(header_ != NULL);
+  return reinterpret_cast<uint8*>(entries() + header_->capacity);
+}
+
+}  // namespace common
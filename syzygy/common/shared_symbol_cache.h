@@ -0,0 +1,123 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares SharedSymbolCache, a memoization cache of symbol resolution
+// answers that is shared between the processes of a session through a named
+// file mapping. The cache for a given set of symbols is named after the GUID
+// and age of the module's PDB, so concurrently running tools that grind the
+// same modules (grinders, dumpers, logger symbolization) share one cache
+// rather than each paying to resolve the same addresses, and an answer can
+// never be served against the wrong symbols. The cache is best-effort: a
+// full table simply stops accepting entries, and tools fall back to
+// resolving symbols themselves.
+
+#ifndef SYZYGY_COMMON_SHARED_SYMBOL_CACHE_H_
+#define SYZYGY_COMMON_SHARED_SYMBOL_CACHE_H_
+
+#include <windows.h>
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+
+namespace common {
+
+// A cache of key to answer-blob mappings shared between processes, backed by
+// a named file mapping. The first process to use the cache for a given PDB
+// creates and initializes the mapping; subsequent processes attach to it.
+// The mapping persists for as long as any process holds it open.
+//
+// Entries are immutable once published, and both lookups and insertions are
+// safe from multiple threads and processes concurrently. Keys are 64-bit so
+// that callers can tag the address being resolved with the kind of question
+// being asked (enclosing function, name and line, etc.) and share one cache
+// between question kinds without collisions. The value format is up to the
+// caller; distinct kinds should be used for distinct formats.
+class SharedSymbolCache {
+ public:
+  // The default number of entry slots in a cache.
+  static const uint32 kDefaultCapacity;
+
+  // The default size of a cache's value pool, in bytes.
+  static const uint32 kDefaultPoolSize;
+
+  SharedSymbolCache();
+
+  // Detaches from the cache. The backing mapping is destroyed by the OS once
+  // the last process detaches.
+  ~SharedSymbolCache();
+
+  // Attaches this cache to the mapping named after @p signature and @p age,
+  // creating and initializing it if this is the first process to do so. If
+  // an existing mapping is incompatible (produced by a different version of
+  // the toolchain, or sized differently) this fails and the cache remains
+  // unusable; callers should simply resolve symbols themselves.
+  // @param signature the GUID of the module's PDB.
+  // @param age the age of the module's PDB.
+  // @param capacity the number of entry slots.
+  // @param pool_size the size of the value pool, in bytes.
+  // @returns true on success, false otherwise.
+  // @{
+  bool Init(const GUID& signature, uint32 age);
+  bool Init(const GUID& signature,
+            uint32 age,
+            uint32 capacity,
+            uint32 pool_size);
+  // @}
+
+  // Looks up the answer published under @p key.
+  // @param key the key to look up.
+  // @param value on success receives the answer blob.
+  // @returns true if the cache contains an entry for @p key.
+  // @pre Init has been successfully called.
+  bool Lookup(uint64 key, std::string* value) const;
+
+  // Publishes @p value under @p key. If the table or the value pool is full
+  // the entry is silently dropped; if another process has already published
+  // an entry for @p key this is a no-op.
+  // @param key the key to publish under.
+  // @param value the answer blob to publish.
+  // @pre Init has been successfully called.
+  void Insert(uint64 key, const base::StringPiece& value);
+
+  // @returns the name of the backing mapping.
+  // @pre Init has been successfully called.
+  const std::wstring& name() const { return name_; }
+
+ protected:
+  struct CacheHeader;
+  struct CacheEntry;
+
+  // @returns the entry table, which immediately follows the header.
+  CacheEntry* entries() const;
+
+  // @returns the value pool, which immediately follows the entry table.
+  uint8* pool() const;
+
+  // The name of the backing mapping.
+  std::wstring name_;
+
+  // The handle to the backing mapping.
+  HANDLE mapping_;
+
+  // The mapped view of the cache, or NULL if Init has not succeeded.
+  CacheHeader* header_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SharedSymbolCache);
+};
+
+}  // namespace common
+
+#endif  // SYZYGY_COMMON_SHARED_SYMBOL_CACHE_H_
@@ -0,0 +1,121 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/shared_symbol_cache.h"
+
+#include "gtest/gtest.h"
+
+namespace common {
+
+namespace {
+
+// A small capacity so that full-table behaviour can be exercised cheaply.
+const uint32 kTestCapacity = 16;
+const uint32 kTestPoolSize = 256;
+
+class SharedSymbolCacheTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    testing::Test::SetUp();
+    // Make the mapping name unique to this process so that concurrently
+    // running unittest instances don't share state.
+    ::memset(&signature_, 0, sizeof(signature_));
+    signature_.Data1 = ::GetCurrentProcessId();
+    signature_.Data2 = static_cast<uint16>(::GetTickCount());
+  }
+
+  GUID signature_;
+};
+
+}  // namespace
+
+TEST_F(SharedSymbolCacheTest, InitCreates) {
+  SharedSymbolCache cache;
+  EXPECT_TRUE(cache.Init(signature_, 1, kTestCapacity, kTestPoolSize));
+  EXPECT_FALSE(cache.name().empty());
+}
+
+TEST_F(SharedSymbolCacheTest, LookupAndInsert) {
+  SharedSymbolCache cache;
+  ASSERT_TRUE(cache.Init(signature_, 1, kTestCapacity, kTestPoolSize));
+
+  std::string value;
+  EXPECT_FALSE(cache.Lookup(42, &value));
+
+  cache.Insert(42, "foo");
+  ASSERT_TRUE(cache.Lookup(42, &value));
+  EXPECT_EQ("foo", value);
+
+  // Entries are immutable once published.
+  cache.Insert(42, "bar");
+  ASSERT_TRUE(cache.Lookup(42, &value));
+  EXPECT_EQ("foo", value);
+
+  // Keys with the same address but different tags are distinct.
+  uint64 tagged = (1ULL << 32) | 42;
+  EXPECT_FALSE(cache.Lookup(tagged, &value));
+  cache.Insert(tagged, "bar");
+  ASSERT_TRUE(cache.Lookup(tagged, &value));
+  EXPECT_EQ("bar", value);
+}
+
+TEST_F(SharedSymbolCacheTest, SecondAttachSeesEntries) {
+  SharedSymbolCache cache1;
+  ASSERT_TRUE(cache1.Init(signature_, 1, kTestCapacity, kTestPoolSize));
+  cache1.Insert(42, "foo");
+
+  SharedSymbolCache cache2;
+  ASSERT_TRUE(cache2.Init(signature_, 1, kTestCapacity, kTestPoolSize));
+  EXPECT_EQ(cache1.name(), cache2.name());
+
+  std::string value;
+  ASSERT_TRUE(cache2.Lookup(42, &value));
+  EXPECT_EQ("foo", value);
+
+  // A different age names a different cache.
+  SharedSymbolCache cache3;
+  ASSERT_TRUE(cache3.Init(signature_, 2, kTestCapacity, kTestPoolSize));
+  EXPECT_NE(cache1.name(), cache3.name());
+  EXPECT_FALSE(cache3.Lookup(42, &value));
+}
+
+TEST_F(SharedSymbolCacheTest, IncompatibleSizingFailsInit) {
+  SharedSymbolCache cache1;
+  ASSERT_TRUE(cache1.Init(signature_, 1, kTestCapacity, kTestPoolSize));
+
+  SharedSymbolCache cache2;
+  EXPECT_FALSE(cache2.Init(signature_, 1, 2 * kTestCapacity, kTestPoolSize));
+}
+
+TEST_F(SharedSymbolCacheTest, FullTableDropsInsertions) {
+  SharedSymbolCache cache;
+  ASSERT_TRUE(cache.Init(signature_, 1, kTestCapacity, kTestPoolSize));
+
+  // Overfill the table; the surplus insertions are silently dropped and
+  // lookups keep working for the entries that were published.
+  for (uint64 key = 0; key < 2 * kTestCapacity; ++key)
+    cache.Insert(key, "v");
+
+  size_t hits = 0;
+  std::string value;
+  for (uint64 key = 0; key < 2 * kTestCapacity; ++key) {
+    if (cache.Lookup(key, &value)) {
+      EXPECT_EQ("v", value);
+      ++hits;
+    }
+  }
+  EXPECT_EQ(kTestCapacity, hits);
+}
+
+}  // namespace common
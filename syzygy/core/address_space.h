@@ -71,6 +71,19 @@ class AddressSpace {
               const ItemType& item,
               typename RangeMap::iterator* ret_it = NULL);
 
+  // Insert @p range mapping to @p item, where @p range must start at or
+  // beyond the end of the highest existing range. This appends to the back
+  // of the range map in amortized constant time, allowing an address space
+  // to be built from a pre-sorted sequence of ranges in O(n) total time
+  // rather than the O(n lg n) of repeated calls to Insert.
+  // @param range the range to insert.
+  // @param item the item to associate with @p range.
+  // @param ret_it on success, returns an iterator to the inserted item.
+  // @returns true iff @p range was appended.
+  bool Append(const Range& range,
+              const ItemType& item,
+              typename RangeMap::iterator* ret_it = NULL);
+
   // Insert @p range mapping to @p item or return the existing item exactly
   // matching @p range.
   //
@@ -413,6 +426,11 @@ class AddressRangeMap {
   // The inversion is deterministic. When conflicting destination ranges are
   // found, earlier start addresses and shorter lengths have priority.
   //
+  // When the destination ranges are already in ascending order, as is the
+  // case for mappings built in layout order that preserve the relative order
+  // of the ranges they map, the inversion completes in a single pass without
+  // sorting.
+  //
   // @param inverted a pointer to the AddressRangeMap that will be populated
   //     with the inverted address range map.
   // @returns the number of conflicting address ranges that were unable to be
@@ -475,6 +493,11 @@ class AddressRangeMap {
   }
 
  private:
+  // Distinct instantiations are friends so that ComputeInverse can hand its
+  // result directly to the backing store of the inverted map.
+  template <typename InvSourceRangeType, typename InvDestinationRangeType>
+  friend class AddressRangeMap;
+
   // Runs a lower bound search with the provided src_range and a made up
   // destination range. The returned iterator either intersects src_range, is
   // strictly greater than it, or is 'end()'.
@@ -512,6 +535,28 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
   return true;
 }
 
+template <typename AddressType, typename SizeType, typename ItemType>
+bool AddressSpace<AddressType, SizeType, ItemType>::Append(
+    const Range& range,
+    const ItemType& item,
+    typename RangeMap::iterator* ret_it) {
+  // We can't insert empty ranges.
+  if (range.IsEmpty())
+    return false;
+
+  // The range must lie entirely beyond the last existing range.
+  if (!ranges_.empty() && range.start() < ranges_.rbegin()->first.end())
+    return false;
+
+  // Inserting with an end hint makes this amortized constant time.
+  RangeMap::iterator it =
+      ranges_.insert(ranges_.end(), std::make_pair(range, item));
+  if (ret_it != NULL)
+    *ret_it = it;
+
+  return true;
+}
+
 template <typename AddressType, typename SizeType, typename ItemType>
 bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
     const Range& range,
@@ -963,32 +1008,83 @@ size_t AddressRangeMap<SourceRangeType, DestinationRangeType>::ComputeInverse(
     AddressRangeMap<DestinationRangeType, SourceRangeType>* inverted) const {
   DCHECK(inverted != NULL);
 
-  // Get a list of inverted range pairs.
+  internal::CompleteAddressRangePairLess<DestinationRangeType,
+                                         SourceRangeType> less;
+
+  // Get a list of inverted range pairs, keeping track of whether they are
+  // emitted in ascending destination order. Mappings that are built in
+  // layout order and mostly preserve the relative order of the ranges they
+  // map (the common relink case) come out already sorted, making the
+  // inversion O(n) overall.
+  bool sorted = true;
   std::vector<std::pair<DestinationRangeType, SourceRangeType>>
       inverted_range_pairs;
   inverted_range_pairs.reserve(range_pairs_.size());
   for (size_t i = 0; i < range_pairs_.size(); ++i) {
     inverted_range_pairs.push_back(
         std::make_pair(range_pairs_[i].second, range_pairs_[i].first));
+    if (sorted && i > 0 &&
+        less(inverted_range_pairs[i], inverted_range_pairs[i - 1])) {
+      sorted = false;
+    }
   }
 
-  // We sort these with a custom sort functor so that a total ordering is
-  // defined rather than the default partial ordering defined by AddressRange.
-  std::sort(inverted_range_pairs.begin(),
-            inverted_range_pairs.end(),
-            internal::CompleteAddressRangePairLess<DestinationRangeType,
-                                                   SourceRangeType>());
+  // If need be we sort these with a custom sort functor so that a total
+  // ordering is defined rather than the default partial ordering defined by
+  // AddressRange.
+  if (!sorted) {
+    std::sort(inverted_range_pairs.begin(),
+              inverted_range_pairs.end(),
+              less);
+  }
 
-  // Push these back to the inverted address range map and count the conflicts.
+  // Merge the inverted range pairs in place, counting the conflicts, using
+  // the same logic as Push. The merged vector is then handed directly to
+  // the inverted map rather than pushing a duplicate copy of each pair.
   size_t conflicts = 0;
-  inverted->clear();
+  size_t merged = 0;
   for (size_t i = 0; i < inverted_range_pairs.size(); ++i) {
-    if (!inverted->Push(inverted_range_pairs[i].first,
-                        inverted_range_pairs[i].second)) {
+    const DestinationRangeType& src_range = inverted_range_pairs[i].first;
+    const SourceRangeType& dst_range = inverted_range_pairs[i].second;
+
+    // We can't insert empty ranges.
+    if (src_range.IsEmpty() || dst_range.IsEmpty()) {
       ++conflicts;
+      continue;
+    }
+
+    if (merged > 0) {
+      DestinationRangeType& last_src_range =
+          inverted_range_pairs[merged - 1].first;
+
+      // The new source range must be beyond the last one already merged.
+      if (!(last_src_range < src_range) ||
+          last_src_range.Intersects(src_range)) {
+        ++conflicts;
+        continue;
+      }
+
+      // Can we merge this new pair of ranges with the last merged pair of
+      // ranges?
+      SourceRangeType& last_dst_range =
+          inverted_range_pairs[merged - 1].second;
+      if (last_src_range.size() == last_dst_range.size() &&
+          src_range.size() == dst_range.size() &&
+          last_src_range.end() == src_range.start() &&
+          last_dst_range.end() == dst_range.start()) {
+        last_src_range = DestinationRangeType(
+            last_src_range.start(), last_src_range.size() + src_range.size());
+        last_dst_range = SourceRangeType(
+            last_dst_range.start(), last_dst_range.size() + dst_range.size());
+        continue;
+      }
     }
+
+    inverted_range_pairs[merged++] = inverted_range_pairs[i];
   }
+  inverted_range_pairs.resize(merged);
 
+  inverted->range_pairs_.swap(inverted_range_pairs);
   return conflicts;
 }
 
@@ -162,6 +162,26 @@ TEST(AddressSpaceTest, Insert) {
   EXPECT_FALSE(address_space.Insert(IntegerAddressSpace::Range(10, 0), item));
 }
 
+TEST(AddressSpaceTest, Append) {
+  IntegerAddressSpace address_space;
+  void* item = "Something to point at";
+
+  // In-order insertions should work.
+  EXPECT_TRUE(address_space.Append(IntegerAddressSpace::Range(100, 10), item));
+  EXPECT_TRUE(address_space.Append(IntegerAddressSpace::Range(110, 5), item));
+  EXPECT_TRUE(address_space.Append(IntegerAddressSpace::Range(120, 10), item));
+
+  // Insertions that do not lie beyond the last range should be rejected.
+  EXPECT_FALSE(address_space.Append(IntegerAddressSpace::Range(95, 10), item));
+  EXPECT_FALSE(address_space.Append(IntegerAddressSpace::Range(115, 10), item));
+  EXPECT_FALSE(address_space.Append(IntegerAddressSpace::Range(125, 10), item));
+
+  // Empty insertions should be rejected.
+  EXPECT_FALSE(address_space.Append(IntegerAddressSpace::Range(130, 0), item));
+
+  EXPECT_EQ(3u, address_space.size());
+}
+
 TEST(AddressSpaceTest, FindOrInsert) {
   IntegerAddressSpace address_space;
   void* item = "Something to point at";
@@ -796,6 +816,27 @@ TEST(AddressRangeMapTest, ComputeInverseWithConflicts) {
   EXPECT_THAT(expected, testing::ContainerEq(imap.range_pairs()));
 }
 
+TEST(AddressRangeMapTest, ComputeInverseOrderPreserving) {
+  // An order-preserving mapping is inverted in a single pass, without
+  // sorting.
+  IntegerRangeMap map;
+  ASSERT_TRUE(map.Push(IntegerRange(0, 10), IntegerRange(1000, 10)));
+  ASSERT_TRUE(map.Push(IntegerRange(20, 10), IntegerRange(1020, 5)));
+  ASSERT_TRUE(map.Push(IntegerRange(40, 10), IntegerRange(1040, 10)));
+
+  IntegerRangePairs expected;
+  expected.push_back(
+      IntegerRangePair(IntegerRange(1000, 10), IntegerRange(0, 10)));
+  expected.push_back(
+      IntegerRangePair(IntegerRange(1020, 5), IntegerRange(20, 10)));
+  expected.push_back(
+      IntegerRangePair(IntegerRange(1040, 10), IntegerRange(40, 10)));
+
+  IntegerRangeMap imap;
+  EXPECT_EQ(0u, map.ComputeInverse(&imap));
+  EXPECT_THAT(expected, testing::ContainerEq(imap.range_pairs()));
+}
+
 TEST(AddressRangeMapTest, InsertUnmappedAtStart) {
   IntegerRangeMap map;
   ASSERT_TRUE(map.Push(IntegerRange(0, 10), IntegerRange(1000, 10)));
@@ -0,0 +1,97 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/bump_arena.h"
+
+#include "base/logging.h"
+
+namespace core {
+
+namespace {
+
+// Rounds @p size up to the arena alignment.
+size_t AlignUp(size_t size) {
+  return (size + BumpArena::kAlignment - 1) & ~(BumpArena::kAlignment - 1);
+}
+
+}  // namespace
+
+BumpArena::BumpArena()
+    : chunk_size_(kDefaultChunkSize),
+      cursor_(NULL),
+      bytes_remaining_(0),
+      bytes_allocated_(0),
+      bytes_reserved_(0) {
+}
+
+BumpArena::BumpArena(size_t chunk_size)
+    : chunk_size_(chunk_size),
+      cursor_(NULL),
+      bytes_remaining_(0),
+      bytes_allocated_(0),
+      bytes_reserved_(0) {
+  DCHECK_LT(0u, chunk_size);
+}
+
+BumpArena::~BumpArena() {
+  Clear();
+}
+
+void* BumpArena::Allocate(size_t size) {
+  DCHECK_LT(0u, size);
+
+  size_t aligned_size = AlignUp(size);
+
+  // Oversized allocations get a dedicated chunk. The current chunk (and its
+  // remaining capacity) is left alone so that its tail isn't wasted.
+  if (aligned_size > chunk_size_) {
+    uint8* chunk = new uint8[aligned_size];
+    CHECK(chunk != NULL);
+    chunks_.push_back(chunk);
+    bytes_reserved_ += aligned_size;
+    bytes_allocated_ += size;
+    return chunk;
+  }
+
+  if (aligned_size > bytes_remaining_)
+    AllocateChunk();
+  DCHECK_LE(aligned_size, bytes_remaining_);
+
+  void* result = cursor_;
+  cursor_ += aligned_size;
+  bytes_remaining_ -= aligned_size;
+  bytes_allocated_ += size;
+  return result;
+}
+
+void BumpArena::Clear() {
+  for (size_t i = 0; i < chunks_.size(); ++i)
+    delete [] chunks_[i];
+  chunks_.clear();
+  cursor_ = NULL;
+  bytes_remaining_ = 0;
+  bytes_allocated_ = 0;
+  bytes_reserved_ = 0;
+}
+
+void BumpArena::AllocateChunk() {
+  uint8* chunk = new uint8[chunk_size_];
+  CHECK(chunk != NULL);
+  chunks_.push_back(chunk);
+  cursor_ = chunk;
+  bytes_remaining_ = chunk_size_;
+  bytes_reserved_ += chunk_size_;
+}
+
+}  // namespace core
@@ -0,0 +1,94 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares BumpArena, a simple chunked bump allocator. Allocations are
+// serviced by incrementing a cursor in the current chunk, and all memory is
+// released wholesale when the arena is destroyed (or Clear is called). This
+// is intended for workloads that make very large numbers of small
+// allocations with identical lifetimes, where per-allocation heap overhead
+// and the final storm of free() calls are pure overhead.
+
+#ifndef SYZYGY_CORE_BUMP_ARENA_H_
+#define SYZYGY_CORE_BUMP_ARENA_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+
+namespace core {
+
+// A chunked bump allocator. Not thread safe.
+class BumpArena {
+ public:
+  // The chunk size that is used if none is specified.
+  static const size_t kDefaultChunkSize = 1 << 20;  // 1 MB.
+
+  // The alignment guaranteed by Allocate.
+  static const size_t kAlignment = 8;
+
+  // Creates an arena with the default chunk size.
+  BumpArena();
+
+  // Creates an arena whose chunks are @p chunk_size bytes.
+  // @param chunk_size the chunk size to use. Must be > 0.
+  explicit BumpArena(size_t chunk_size);
+
+  // Frees all chunks owned by the arena.
+  ~BumpArena();
+
+  // Allocates @p size bytes of uninitialized memory, aligned to kAlignment.
+  // Allocations larger than the chunk size are serviced by a dedicated
+  // chunk. The memory remains valid until the arena is destroyed or cleared.
+  // @param size the number of bytes to allocate. Must be > 0.
+  // @returns a pointer to the allocated memory.
+  void* Allocate(size_t size);
+
+  // Frees all memory owned by the arena in one sweep. All outstanding
+  // allocations are invalidated.
+  void Clear();
+
+  // @returns the total number of bytes handed out by Allocate since the last
+  //     Clear.
+  size_t bytes_allocated() const { return bytes_allocated_; }
+
+  // @returns the total number of bytes reserved from the heap since the last
+  //     Clear. This is at least bytes_allocated.
+  size_t bytes_reserved() const { return bytes_reserved_; }
+
+ private:
+  // Allocates a fresh chunk of chunk_size_ bytes and makes it the current
+  // chunk.
+  void AllocateChunk();
+
+  // The configured chunk size.
+  size_t chunk_size_;
+
+  // The chunks owned by the arena. The last chunk is the one allocations are
+  // currently being carved from.
+  std::vector<uint8*> chunks_;
+
+  // The bump cursor and remaining capacity of the current chunk.
+  uint8* cursor_;
+  size_t bytes_remaining_;
+
+  // Statistics.
+  size_t bytes_allocated_;
+  size_t bytes_reserved_;
+
+  DISALLOW_COPY_AND_ASSIGN(BumpArena);
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_BUMP_ARENA_H_
@@ -0,0 +1,94 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/bump_arena.h"
+
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace core {
+
+TEST(BumpArenaTest, Create) {
+  BumpArena arena;
+  EXPECT_EQ(0u, arena.bytes_allocated());
+  EXPECT_EQ(0u, arena.bytes_reserved());
+}
+
+TEST(BumpArenaTest, AllocationsAreAlignedAndDistinct) {
+  BumpArena arena;
+
+  void* p1 = arena.Allocate(1);
+  void* p2 = arena.Allocate(13);
+  void* p3 = arena.Allocate(BumpArena::kAlignment);
+  ASSERT_TRUE(p1 != NULL);
+  ASSERT_TRUE(p2 != NULL);
+  ASSERT_TRUE(p3 != NULL);
+  EXPECT_NE(p1, p2);
+  EXPECT_NE(p2, p3);
+
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(p1) % BumpArena::kAlignment);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(p2) % BumpArena::kAlignment);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(p3) % BumpArena::kAlignment);
+
+  EXPECT_EQ(14u + BumpArena::kAlignment, arena.bytes_allocated());
+}
+
+TEST(BumpArenaTest, AllocationsAreWritable) {
+  BumpArena arena(64);
+
+  // Spill across several chunks and make sure every byte is independently
+  // addressable.
+  std::vector<uint8*> allocs;
+  for (size_t i = 0; i < 100; ++i) {
+    uint8* p = reinterpret_cast<uint8*>(arena.Allocate(24));
+    ASSERT_TRUE(p != NULL);
+    ::memset(p, static_cast<int>(i), 24);
+    allocs.push_back(p);
+  }
+  for (size_t i = 0; i < allocs.size(); ++i) {
+    for (size_t j = 0; j < 24; ++j)
+      ASSERT_EQ(static_cast<uint8>(i), allocs[i][j]);
+  }
+}
+
+TEST(BumpArenaTest, OversizedAllocation) {
+  BumpArena arena(64);
+
+  // An allocation larger than the chunk size gets a dedicated chunk, and
+  // must not disturb the current chunk's cursor.
+  uint8* p1 = reinterpret_cast<uint8*>(arena.Allocate(8));
+  uint8* big = reinterpret_cast<uint8*>(arena.Allocate(1024));
+  uint8* p2 = reinterpret_cast<uint8*>(arena.Allocate(8));
+  ASSERT_TRUE(big != NULL);
+  ::memset(big, 0xAB, 1024);
+  EXPECT_EQ(p1 + BumpArena::kAlignment, p2);
+}
+
+TEST(BumpArenaTest, Clear) {
+  BumpArena arena;
+  arena.Allocate(100);
+  EXPECT_LT(0u, arena.bytes_allocated());
+  EXPECT_LT(0u, arena.bytes_reserved());
+
+  arena.Clear();
+  EXPECT_EQ(0u, arena.bytes_allocated());
+  EXPECT_EQ(0u, arena.bytes_reserved());
+
+  // The arena is usable after a Clear.
+  EXPECT_TRUE(arena.Allocate(100) != NULL);
+}
+
+}  // namespace core
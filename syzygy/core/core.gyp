@@ -28,12 +28,16 @@
         'address_space.cc',
         'address_space.h',
         'address_space_internal.h',
+        'bump_arena.cc',
+        'bump_arena.h',
         'disassembler.cc',
         'disassembler.h',
         'disassembler_util.cc',
         'disassembler_util.h',
         'file_util.cc',
         'file_util.h',
+        'flat_address_filter.h',
+        'flat_address_space.h',
         'json_file_writer.cc',
         'json_file_writer.h',
         'random_number_generator.cc',
@@ -77,10 +81,13 @@
         'address_unittest.cc',
         'address_filter_unittest.cc',
         'address_space_unittest.cc',
+        'bump_arena_unittest.cc',
         'disassembler_test_code.asm',
         'disassembler_unittest.cc',
         'disassembler_util_unittest.cc',
         'file_util_unittest.cc',
+        'flat_address_filter_unittest.cc',
+        'flat_address_space_unittest.cc',
         'json_file_writer_unittest.cc',
         'section_offset_address_unittest.cc',
         'serialization_unittest.cc',
@@ -14,6 +14,8 @@
 
 #include "syzygy/core/disassembler_util.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "base/strings/stringprintf.h"
 #include "mnemonics.h"  // NOLINT
@@ -22,6 +24,15 @@ namespace core {
 
 namespace {
 
+// The number of code bytes per decoded instruction that a batch decode
+// initially budgets for. x86 code averages roughly 3 to 4 bytes per
+// instruction, so this slightly over-allocates for typical code.
+const size_t kEstimatedBytesPerInstruction = 3;
+
+// The minimum number of instruction slots a batch decode allocates, so that
+// pathological runs still make progress.
+const size_t kMinBatchCapacity = 16;
+
 // Handle improperly decoded instructions. Returns true if an instruction was
 // handled, false otherwise. If this returns false then none of the output
 // parameters will have been changed.
@@ -137,6 +148,105 @@ bool DecodeOneInstruction(
   return true;
 }
 
+InstructionBatch::InstructionBatch(BumpArena* arena)
+    : arena_(arena), size_(0) {
+  DCHECK(arena != NULL);
+}
+
+bool InstructionBatch::Decode(uint32 address, const uint8* buffer,
+                              size_t length, uint32 options) {
+  DCHECK(buffer != NULL);
+  DCHECK_LT(0u, length);
+  DCHECK_EQ(0u, size_);
+
+  size_t offset = 0;
+  while (offset < length) {
+    // Budget instruction slots for the remaining bytes and decode as much as
+    // fits. If the estimate falls short the loop simply resumes decoding
+    // where the previous segment left off.
+    size_t capacity = (length - offset) / kEstimatedBytesPerInstruction +
+        kMinBatchCapacity;
+    _DInst* instructions = reinterpret_cast<_DInst*>(
+        arena_->Allocate(capacity * sizeof(_DInst)));
+
+    _CodeInfo code = {};
+    code.dt = Decode32Bits;
+    code.features = DF_NONE;
+    code.codeOffset = address + offset;
+    code.codeLen = length - offset;
+    code.code = buffer + offset;
+
+    unsigned int decoded = 0;
+    _DecodeResult result = DistormDecompose(
+        &code, instructions, capacity, &decoded);
+    if (result != DECRES_MEMORYERR && result != DECRES_SUCCESS)
+      return false;
+
+    // An empty decode means the remaining bytes form at most a partial
+    // instruction. This mirrors DecodeOneInstruction.
+    if (decoded == 0)
+      return false;
+
+    // Stop at the first instruction the decoder could not make sense of,
+    // exactly as a per-instruction decode loop would.
+    size_t valid = 0;
+    while (valid < decoded && instructions[valid].flags != FLAG_NOT_DECODABLE)
+      ++valid;
+
+    if (valid > 0) {
+      Segment segment = { instructions, valid };
+      segments_.push_back(segment);
+      size_ += valid;
+
+      if ((options & kComputeBranchTargets) != 0) {
+        for (size_t i = 0; i < valid; ++i) {
+          const _DInst& instruction = instructions[i];
+          if (IsBranch(instruction) && HasPcRelativeOperand(instruction, 0)) {
+            branch_targets_.push_back(static_cast<uint32>(
+                instruction.addr + instruction.size + instruction.imm.addr));
+          }
+        }
+      }
+
+      const _DInst& last = instructions[valid - 1];
+      offset = static_cast<size_t>(last.addr - address) + last.size;
+    }
+
+    if (valid < decoded)
+      return false;
+  }
+
+  std::sort(branch_targets_.begin(), branch_targets_.end());
+  branch_targets_.erase(
+      std::unique(branch_targets_.begin(), branch_targets_.end()),
+      branch_targets_.end());
+
+  return true;
+}
+
+InstructionBatch::Cursor::Cursor(const InstructionBatch* batch)
+    : batch_(batch), segment_(0), index_(0) {
+  DCHECK(batch != NULL);
+}
+
+bool InstructionBatch::Cursor::AtEnd() const {
+  return segment_ >= batch_->segments_.size();
+}
+
+const _DInst& InstructionBatch::Cursor::instruction() const {
+  DCHECK(!AtEnd());
+  return batch_->segments_[segment_].instructions[index_];
+}
+
+void InstructionBatch::Cursor::Next() {
+  DCHECK(!AtEnd());
+  ++index_;
+  if (index_ >= batch_->segments_[segment_].count) {
+    ++segment_;
+    index_ = 0;
+  }
+}
+
 bool InstructionToString(
     const _DInst& instruction,
     const uint8_t* data,
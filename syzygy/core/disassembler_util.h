@@ -18,9 +18,11 @@
 #define SYZYGY_CORE_DISASSEMBLER_UTIL_H_
 
 #include <string>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "syzygy/assm/register.h"
+#include "syzygy/core/bump_arena.h"
 #include "distorm.h"  // NOLINT
 #include "mnemonics.h"  // NOLINT
 
@@ -59,6 +61,101 @@ bool DecodeOneInstruction(
 bool DecodeOneInstruction(
     const uint8* buffer, size_t length, _DInst* instruction);
 
+// A batch of instructions decoded by a single pass over an entire run of
+// code. Decoding a run in one pass amortizes the per-call decoder setup that
+// DecodeOneInstruction pays for every instruction, which adds up over the
+// millions of instructions a full-image decomposition decodes. The decoded
+// instructions are carved from a caller-provided arena, so that consecutive
+// batches share allocations and are released wholesale.
+class InstructionBatch {
+ public:
+  // Options controlling a batch decode.
+  enum Options {
+    kDefaultOptions = 0,
+
+    // If set, the targets of PC-relative branches encountered during the
+    // decode are recorded and exposed via branch_targets(). This feeds
+    // basic-block decomposition, which must split code at branch targets.
+    kComputeBranchTargets = (1 << 0),
+  };
+
+  // A cursor over the instructions of a batch, in decode order.
+  class Cursor;
+
+  // Constructs an empty batch.
+  // @param arena the arena to carve instruction storage from. The arena must
+  //     outlive any use of this batch.
+  explicit InstructionBatch(BumpArena* arena);
+
+  // Decodes an entire run of code in as few decoder invocations as possible.
+  // May only be called once per batch.
+  // @param address the address of the first instruction, as an absolute
+  //     address consistent with the image's base address.
+  // @param buffer the buffer containing the code to decode.
+  // @param length the length of the buffer.
+  // @param options a combination of Options flags.
+  // @returns true if the entire buffer was decoded, false if an undecodable
+  //     or partial instruction was encountered. Instructions decoded prior
+  //     to the failure remain accessible.
+  bool Decode(uint32 address, const uint8* buffer, size_t length,
+              uint32 options);
+
+  // @returns the number of instructions that were decoded.
+  size_t size() const { return size_; }
+
+  // @returns the targets of all PC-relative branches in the batch, sorted in
+  //     increasing order and without duplicates. Only populated if
+  //     kComputeBranchTargets was specified.
+  const std::vector<uint32>& branch_targets() const {
+    return branch_targets_;
+  }
+
+ private:
+  friend class Cursor;
+
+  // A contiguous run of decoded instructions. The batch grows a new segment
+  // each time the decoder outgrows its previous allocation, so that already
+  // decoded instructions never need to be copied.
+  struct Segment {
+    _DInst* instructions;
+    size_t count;
+  };
+
+  // The arena from which instruction storage is allocated.
+  BumpArena* arena_;
+
+  // The decoded instructions.
+  std::vector<Segment> segments_;
+  size_t size_;
+
+  // See branch_targets().
+  std::vector<uint32> branch_targets_;
+
+  DISALLOW_COPY_AND_ASSIGN(InstructionBatch);
+};
+
+// A cursor over the instructions of a batch, in decode order.
+class InstructionBatch::Cursor {
+ public:
+  // Constructs a cursor pointing at the first instruction of @p batch.
+  // @param batch the batch to iterate over. Must outlive the cursor.
+  explicit Cursor(const InstructionBatch* batch);
+
+  // @returns true if the cursor is past the last instruction.
+  bool AtEnd() const;
+
+  // @returns the instruction under the cursor.
+  const _DInst& instruction() const;
+
+  // Advances the cursor to the next instruction.
+  void Next();
+
+ private:
+  const InstructionBatch* batch_;
+  size_t segment_;
+  size_t index_;
+};
+
 // Dump text representation of exactly one instruction to a std::string.
 // @param instruction the instruction to dump.
 // @param data points to the raw byte sequences.
@@ -118,6 +118,15 @@ const uint8 kSysExit[] = { 0x0F, 0x35 };
 
 // Interrupts.
 const uint8 kInt2[] = { 0xCD, 0x02 };
+
+// A short run of code: a nop, a two-byte nop, a conditional branch back to
+// the start of the run, and a return.
+const uint8 kCodeRun[] = {
+    0x90,        // nop
+    0x8B, 0xFF,  // mov edi, edi
+    0x74, 0xFB,  // je start of run
+    0xC3,        // ret
+};
 const uint8 kInt3[] = { 0xCC };
 
 // Improperly handled instructions.
@@ -319,4 +328,71 @@ TEST(DisassemblerUtilTest, TestBadlyDecodedVpermd) {
       kVpermd, sizeof(kVpermd)));
 }
 
+TEST(DisassemblerUtilTest, InstructionBatchDecode) {
+  BumpArena arena;
+  InstructionBatch batch(&arena);
+  ASSERT_TRUE(batch.Decode(0x10000000, kCodeRun, sizeof(kCodeRun),
+                           InstructionBatch::kDefaultOptions));
+  EXPECT_EQ(4u, batch.size());
+  EXPECT_TRUE(batch.branch_targets().empty());
+
+  // The cursor walks the instructions in decode order, and the decoded
+  // stream matches a per-instruction decode of the same bytes.
+  InstructionBatch::Cursor cursor(&batch);
+  size_t offset = 0;
+  while (!cursor.AtEnd()) {
+    _DInst expected = {};
+    ASSERT_TRUE(DecodeOneInstruction(0x10000000 + offset, kCodeRun + offset,
+                                     sizeof(kCodeRun) - offset, &expected));
+    EXPECT_EQ(expected.addr, cursor.instruction().addr);
+    EXPECT_EQ(expected.size, cursor.instruction().size);
+    EXPECT_EQ(expected.opcode, cursor.instruction().opcode);
+    offset += expected.size;
+    cursor.Next();
+  }
+  EXPECT_EQ(sizeof(kCodeRun), offset);
+}
+
+TEST(DisassemblerUtilTest, InstructionBatchComputesBranchTargets) {
+  BumpArena arena;
+  InstructionBatch batch(&arena);
+  ASSERT_TRUE(batch.Decode(0x10000000, kCodeRun, sizeof(kCodeRun),
+                           InstructionBatch::kComputeBranchTargets));
+  ASSERT_EQ(1u, batch.branch_targets().size());
+  EXPECT_EQ(0x10000000u, batch.branch_targets()[0]);
+}
+
+TEST(DisassemblerUtilTest, InstructionBatchFailsOnPartialInstruction) {
+  BumpArena arena;
+  InstructionBatch batch(&arena);
+
+  // Clip the run in the middle of the conditional branch. The decode should
+  // fail, but the instructions preceding the failure remain accessible.
+  EXPECT_FALSE(batch.Decode(0x10000000, kCodeRun, sizeof(kCodeRun) - 2,
+                            InstructionBatch::kDefaultOptions));
+  EXPECT_EQ(2u, batch.size());
+}
+
+TEST(DisassemblerUtilTest, InstructionBatchSpansSegments) {
+  // A run of single-byte instructions dense enough to overflow the batch's
+  // initial allocation, forcing it to resume in a second segment.
+  uint8 nops[64];
+  ::memset(nops, 0x90, sizeof(nops));
+
+  BumpArena arena;
+  InstructionBatch batch(&arena);
+  ASSERT_TRUE(batch.Decode(0x10000000, nops, sizeof(nops),
+                           InstructionBatch::kDefaultOptions));
+  EXPECT_EQ(sizeof(nops), batch.size());
+
+  InstructionBatch::Cursor cursor(&batch);
+  for (size_t i = 0; i < sizeof(nops); ++i) {
+    ASSERT_FALSE(cursor.AtEnd());
+    EXPECT_EQ(0x10000000 + i, cursor.instruction().addr);
+    EXPECT_EQ(1, cursor.instruction().size);
+    cursor.Next();
+  }
+  EXPECT_TRUE(cursor.AtEnd());
+}
+
 }  // namespace core
@@ -221,6 +221,68 @@ bool GuessFileTypeImpl(size_t length, InStream* stream, FileType* file_type) {
 
 }  // namespace
 
+bool CompareFileContents(const base::FilePath& path1,
+                         const base::FilePath& path2,
+                         bool* identical) {
+  DCHECK(!path1.empty());
+  DCHECK(!path2.empty());
+  DCHECK(identical != NULL);
+
+  int64 size1 = 0;
+  if (!base::GetFileSize(path1, &size1)) {
+    LOG(ERROR) << "Unable to get file size: " << path1.value();
+    return false;
+  }
+  int64 size2 = 0;
+  if (!base::GetFileSize(path2, &size2)) {
+    LOG(ERROR) << "Unable to get file size: " << path2.value();
+    return false;
+  }
+
+  // Files of differing sizes can't have identical contents.
+  if (size1 != size2) {
+    *identical = false;
+    return true;
+  }
+
+  base::ScopedFILE file1(base::OpenFile(path1, "rb"));
+  if (file1.get() == NULL) {
+    LOG(ERROR) << "Unable to open file for reading: " << path1.value();
+    return false;
+  }
+  base::ScopedFILE file2(base::OpenFile(path2, "rb"));
+  if (file2.get() == NULL) {
+    LOG(ERROR) << "Unable to open file for reading: " << path2.value();
+    return false;
+  }
+
+  // Compare the contents one buffer's worth at a time.
+  uint8 buffer1[4096];
+  uint8 buffer2[sizeof(buffer1)];
+  int64 remaining = size1;
+  while (remaining > 0) {
+    size_t bytes_to_read = sizeof(buffer1);
+    if (remaining < static_cast<int64>(bytes_to_read))
+      bytes_to_read = static_cast<size_t>(remaining);
+
+    if (::fread(buffer1, 1, bytes_to_read, file1.get()) != bytes_to_read ||
+        ::fread(buffer2, 1, bytes_to_read, file2.get()) != bytes_to_read) {
+      LOG(ERROR) << "Unable to read files being compared.";
+      return false;
+    }
+
+    if (::memcmp(buffer1, buffer2, bytes_to_read) != 0) {
+      *identical = false;
+      return true;
+    }
+
+    remaining -= bytes_to_read;
+  }
+
+  *identical = true;
+  return true;
+}
+
 bool GuessFileType(const base::FilePath& path, FileType* file_type) {
   DCHECK(!path.empty());
   DCHECK(file_type != NULL);
@@ -59,6 +59,18 @@ enum FilePathCompareResult {
 FilePathCompareResult CompareFilePaths(const base::FilePath& path1,
                                        const base::FilePath& path2);
 
+// Compares the contents of two files, byte for byte.
+// @param path1 the first file to compare.
+// @param path2 the second file to compare.
+// @param identical will be set to true if both files have identical
+//     contents, false otherwise.
+// @returns true if the comparison was performed successfully, false on
+//     error (a file could not be read). On error @p identical is left
+//     untouched.
+bool CompareFileContents(const base::FilePath& path1,
+                         const base::FilePath& path2,
+                         bool* identical);
+
 // A list of known file types.
 enum FileType {
   kUnknownFileType,
@@ -129,6 +129,46 @@ TEST_F(CompareFilePathsTest, BothExistEquivalentPath) {
                              alternate_existing_path_));
 }
 
+TEST(CompareFileContentsTest, FailsForNonExistentFile) {
+  base::FilePath fake(L"C:\\this\\path\\should\\not\\exist-at.all");
+  base::FilePath existing = testing::GetSrcRelativePath(testing::kExamplePeDll);
+  bool identical = false;
+  EXPECT_FALSE(CompareFileContents(fake, existing, &identical));
+  EXPECT_FALSE(CompareFileContents(existing, fake, &identical));
+}
+
+TEST(CompareFileContentsTest, IdenticalContents) {
+  base::FilePath path = testing::GetSrcRelativePath(testing::kExamplePeDll);
+  bool identical = false;
+  EXPECT_TRUE(CompareFileContents(path, path, &identical));
+  EXPECT_TRUE(identical);
+}
+
+TEST(CompareFileContentsTest, DistinctContents) {
+  base::FilePath pe_dll = testing::GetSrcRelativePath(testing::kExamplePeDll);
+  base::FilePath pe_exe = testing::GetSrcRelativePath(testing::kExamplePeExe);
+  bool identical = true;
+  EXPECT_TRUE(CompareFileContents(pe_dll, pe_exe, &identical));
+  EXPECT_FALSE(identical);
+}
+
+TEST(CompareFileContentsTest, SameSizeDistinctContents) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  base::FilePath path1 = temp_dir.path().Append(L"file1.txt");
+  base::FilePath path2 = temp_dir.path().Append(L"file2.txt");
+  static const char kData1[] = "two files of equal length";
+  static const char kData2[] = "two files of equal len&th";
+  COMPILE_ASSERT(sizeof(kData1) == sizeof(kData2), data_sizes_must_match);
+  ASSERT_NE(-1, base::WriteFile(path1, kData1, sizeof(kData1)));
+  ASSERT_NE(-1, base::WriteFile(path2, kData2, sizeof(kData2)));
+
+  bool identical = true;
+  EXPECT_TRUE(CompareFileContents(path1, path2, &identical));
+  EXPECT_FALSE(identical);
+}
+
 TEST(GuessFileTypeTest, GuessFromInMemoryBuffer) {
   // Read a file into memory.
   base::FilePath path = testing::GetSrcRelativePath(
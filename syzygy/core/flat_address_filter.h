@@ -0,0 +1,221 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares FlatAddressFilter, a query-optimized companion to AddressFilter.
+// AddressFilter stores its marked ranges in a std::set, which is the right
+// structure while a filter is being built, but per-instruction lookups during
+// filtered instrumentation then chase red-black tree pointers on every query.
+// FlatAddressFilter snapshots the marked ranges into a sorted vector and
+// services IsMarked/IsUnmarked with a binary search over contiguous memory.
+// It additionally maintains a position hint, making the ascending-address
+// query pattern that instrumentation exhibits amortized O(1) per query.
+//
+// It also provides an Intersect operation that combines two flat filters in a
+// single linear merge pass, without round-tripping through the set-backed
+// representation.
+//
+// It is intended to be used as follows:
+//
+//   AddressFilter filter(...);   // Built/combined as usual.
+//   FlatAddressFilter flat(filter);
+//   foreach instruction {
+//     if (flat.IsUnmarked(instruction_range))
+//       ...
+//   }
+
+#ifndef SYZYGY_CORE_FLAT_ADDRESS_FILTER_H_
+#define SYZYGY_CORE_FLAT_ADDRESS_FILTER_H_
+
+#include <vector>
+
+#include "base/logging.h"
+#include "syzygy/core/address_filter.h"
+
+namespace core {
+
+template<typename AddressType, typename SizeType>
+class FlatAddressFilter {
+ public:
+  typedef AddressType Address;
+  typedef SizeType Size;
+  typedef AddressRange<AddressType, SizeType> Range;
+  typedef AddressFilter<AddressType, SizeType> Filter;
+  typedef std::vector<Range> RangeVector;
+
+  // Default constructor. Builds an empty filter with an empty extent.
+  FlatAddressFilter() : hint_(0) {
+  }
+
+  // Constructor. Builds a flat snapshot of the given address filter.
+  // @param filter The filter whose marked ranges are to be snapshot.
+  explicit FlatAddressFilter(const Filter& filter) : hint_(0) {
+    Assign(filter);
+  }
+
+  // Snapshots the marked ranges of the given address filter, replacing the
+  // current contents. This is O(n) in the number of marked ranges.
+  // @param filter The filter whose marked ranges are to be snapshot.
+  void Assign(const Filter& filter) {
+    extent_ = filter.extent();
+    marked_ranges_.assign(filter.marked_ranges().begin(),
+                          filter.marked_ranges().end());
+    hint_ = 0;
+  }
+
+  // Clears this FlatAddressFilter.
+  void Clear() {
+    marked_ranges_.clear();
+    hint_ = 0;
+  }
+
+  // Determines if the given address range is marked in its entirety.
+  // @param range The address range to check.
+  // @returns false if any locations in the range are not marked, or true if
+  //     they all are.
+  bool IsMarked(const Range& range) const {
+    // Anything that falls outside of the image extent is by definition not
+    // marked.
+    Range r;
+    if (!internal::Intersect(extent_, range, &r))
+      return false;
+
+    size_t i = FindFirstRangeAfter(r.start());
+    if (i == marked_ranges_.size())
+      return false;
+
+    // Contiguous ranges are merged when the source filter is built, so only
+    // this candidate needs to be examined.
+    return marked_ranges_[i].Contains(r);
+  }
+
+  // Determines if the given address range is not marked at all.
+  // @param range The address range to check.
+  // @returns false if any locations in the range are marked, or true if
+  //     they are all unmarked.
+  bool IsUnmarked(const Range& range) const {
+    // Anything that falls outside of the image extent is by definition not
+    // marked.
+    Range r;
+    if (!internal::Intersect(extent_, range, &r))
+      return true;
+
+    size_t i = FindFirstRangeAfter(r.start());
+    if (i == marked_ranges_.size())
+      return true;
+
+    return !r.Intersects(marked_ranges_[i]);
+  }
+
+  // Calculates the intersection of this filter and another as a single
+  // linear merge of the two sorted range vectors.
+  // @param other The filter to intersect with.
+  // @param filter The filter to populate with the intersection. This may
+  //     be |this|, allowing the operation to be done in place.
+  // @note The returned filter will have the same extent as this filter.
+  void Intersect(const FlatAddressFilter& other,
+                 FlatAddressFilter* filter) const {
+    DCHECK(filter != NULL);
+
+    // We work with a temporary RangeVector and swap its contents later,
+    // handling the case when 'filter == this'.
+    RangeVector ranges;
+
+    // Marked ranges never stray outside their filter's extent, so merging
+    // the two sorted vectors and keeping the pairwise intersections yields
+    // ranges lying in the intersection of the extents.
+    size_t i = 0;
+    size_t j = 0;
+    while (i < marked_ranges_.size() && j < other.marked_ranges_.size()) {
+      Range range;
+      int dir = internal::CompareAndIntersect(
+          marked_ranges_[i], other.marked_ranges_[j], &range);
+      if (dir < 0) {
+        ++i;
+      } else if (dir > 0) {
+        ++j;
+      } else {
+        ranges.push_back(range);
+
+        // Advance the iterator with the lesser interval endpoint, or both of
+        // them if they are equal.
+        if (marked_ranges_[i].end() < other.marked_ranges_[j].end()) {
+          ++i;
+        } else if (other.marked_ranges_[j].end() < marked_ranges_[i].end()) {
+          ++j;
+        } else {
+          ++i;
+          ++j;
+        }
+      }
+    }
+
+    filter->extent_ = extent_;
+    filter->marked_ranges_.swap(ranges);
+    filter->hint_ = 0;
+  }
+
+  // @name Accessors.
+  // @{
+  const Range& extent() const { return extent_; }
+  const RangeVector& marked_ranges() const { return marked_ranges_; }
+  size_t size() const { return marked_ranges_.size(); }
+  bool empty() const { return marked_ranges_.empty(); }
+  // @}
+
+ protected:
+  // Returns the index of the first marked range whose end is beyond
+  // @p address, or size() if there is none. This first consults (and then
+  // updates) a position hint, so a sequence of queries with ascending
+  // addresses degenerates to a pair of comparisons per query.
+  size_t FindFirstRangeAfter(Address address) const {
+    size_t n = marked_ranges_.size();
+
+    // Consult the hint: sequential queries typically resolve to the same
+    // range as the previous query, or to its successor.
+    for (size_t i = hint_; i < hint_ + 2 && i < n; ++i) {
+      if (address < marked_ranges_[i].end() &&
+          (i == 0 || !(address < marked_ranges_[i - 1].end()))) {
+        hint_ = i;
+        return i;
+      }
+    }
+
+    // Binary search for the first range whose end is beyond |address|.
+    size_t lo = 0;
+    size_t hi = n;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (address < marked_ranges_[mid].end())
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    hint_ = lo;
+    return lo;
+  }
+
+  // The extents of this filter.
+  Range extent_;
+
+  // The disjoint marked ranges, sorted by start address.
+  RangeVector marked_ranges_;
+
+  // The index at which the last query terminated. Purely a performance hint;
+  // always in [0, marked_ranges_.size()].
+  mutable size_t hint_;
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_FLAT_ADDRESS_FILTER_H_
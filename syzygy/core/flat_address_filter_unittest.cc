@@ -0,0 +1,145 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/flat_address_filter.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/address.h"
+
+namespace core {
+
+namespace {
+
+typedef AddressFilter<AbsoluteAddress, size_t> TestAddressFilter;
+typedef FlatAddressFilter<AbsoluteAddress, size_t> TestFlatAddressFilter;
+typedef TestAddressFilter::Range Range;
+
+// A handy little factory.
+Range MakeRange(size_t address, size_t size) {
+  return Range(AbsoluteAddress(address), size);
+}
+
+// Builds a filter over [0, 100) with marked ranges [10, 20), [30, 40) and
+// [60, 80).
+void BuildTestFilter(TestAddressFilter* filter) {
+  *filter = TestAddressFilter(MakeRange(0, 100));
+  filter->Mark(MakeRange(10, 10));
+  filter->Mark(MakeRange(30, 10));
+  filter->Mark(MakeRange(60, 20));
+}
+
+}  // namespace
+
+TEST(FlatAddressFilterTest, DefaultConstructor) {
+  TestFlatAddressFilter f;
+  EXPECT_EQ(Range(), f.extent());
+  EXPECT_EQ(0u, f.size());
+  EXPECT_TRUE(f.empty());
+  EXPECT_FALSE(f.IsMarked(MakeRange(0, 10)));
+}
+
+TEST(FlatAddressFilterTest, Assign) {
+  TestAddressFilter f;
+  BuildTestFilter(&f);
+
+  TestFlatAddressFilter flat(f);
+  EXPECT_EQ(f.extent(), flat.extent());
+  ASSERT_EQ(3u, flat.size());
+  EXPECT_EQ(MakeRange(10, 10), flat.marked_ranges()[0]);
+  EXPECT_EQ(MakeRange(30, 10), flat.marked_ranges()[1]);
+  EXPECT_EQ(MakeRange(60, 20), flat.marked_ranges()[2]);
+
+  flat.Clear();
+  EXPECT_TRUE(flat.empty());
+}
+
+TEST(FlatAddressFilterTest, MatchesAddressFilterQueries) {
+  TestAddressFilter f;
+  BuildTestFilter(&f);
+  TestFlatAddressFilter flat(f);
+
+  // Exhaustively compare both representations over single bytes and short
+  // ranges straddling every boundary of the filter.
+  for (size_t address = 0; address < 110; ++address) {
+    for (size_t size = 1; size < 4; ++size) {
+      Range range = MakeRange(address, size);
+      EXPECT_EQ(f.IsMarked(range), flat.IsMarked(range));
+      EXPECT_EQ(f.IsUnmarked(range), flat.IsUnmarked(range));
+    }
+  }
+}
+
+TEST(FlatAddressFilterTest, SequentialQueries) {
+  TestAddressFilter f;
+  BuildTestFilter(&f);
+  TestFlatAddressFilter flat(f);
+
+  // An ascending walk, as per-instruction lookups perform, is serviced by
+  // the hint.
+  for (size_t address = 0; address < 100; ++address) {
+    bool marked = (address >= 10 && address < 20) ||
+                  (address >= 30 && address < 40) ||
+                  (address >= 60 && address < 80);
+    EXPECT_EQ(marked, flat.IsMarked(MakeRange(address, 1)));
+  }
+
+  // A query that jumps backwards must still be answered correctly.
+  EXPECT_TRUE(flat.IsMarked(MakeRange(15, 5)));
+  EXPECT_TRUE(flat.IsUnmarked(MakeRange(0, 10)));
+}
+
+TEST(FlatAddressFilterTest, Intersect) {
+  TestAddressFilter f1(MakeRange(0, 100));
+  f1.Mark(MakeRange(10, 20));
+  f1.Mark(MakeRange(50, 30));
+
+  TestAddressFilter f2(MakeRange(0, 100));
+  f2.Mark(MakeRange(0, 15));
+  f2.Mark(MakeRange(25, 30));
+  f2.Mark(MakeRange(70, 5));
+
+  // The flat intersection must agree with the set-backed one.
+  TestAddressFilter expected(MakeRange(0, 100));
+  f1.Intersect(f2, &expected);
+
+  TestFlatAddressFilter flat1(f1);
+  TestFlatAddressFilter flat2(f2);
+  TestFlatAddressFilter result;
+  flat1.Intersect(flat2, &result);
+
+  EXPECT_EQ(f1.extent(), result.extent());
+  ASSERT_EQ(expected.size(), result.size());
+  TestAddressFilter::RangeSet::const_iterator it =
+      expected.marked_ranges().begin();
+  for (size_t i = 0; it != expected.marked_ranges().end(); ++it, ++i)
+    EXPECT_EQ(*it, result.marked_ranges()[i]);
+}
+
+TEST(FlatAddressFilterTest, IntersectInPlace) {
+  TestAddressFilter f1(MakeRange(0, 100));
+  f1.Mark(MakeRange(10, 20));
+
+  TestAddressFilter f2(MakeRange(0, 100));
+  f2.Mark(MakeRange(20, 20));
+
+  TestFlatAddressFilter flat1(f1);
+  TestFlatAddressFilter flat2(f2);
+  flat1.Intersect(flat2, &flat1);
+
+  ASSERT_EQ(1u, flat1.size());
+  EXPECT_EQ(MakeRange(20, 10), flat1.marked_ranges()[0]);
+}
+
+}  // namespace core
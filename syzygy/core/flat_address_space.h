@@ -0,0 +1,332 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares FlatAddressSpace, a cache-friendly alternative backend to
+// AddressSpace. Where AddressSpace stores its ranges in a std::map,
+// FlatAddressSpace keeps them in a sorted vector and services lookups with a
+// binary search, so lookups touch contiguous memory rather than chasing
+// red-black tree pointers. It mirrors the read-path API of AddressSpace
+// (FindFirstIntersection, FindIntersecting, FindContaining, Intersects,
+// Contains, ContainsExactly), so code that is templated on the address-space
+// type may select either backend. FindContaining additionally maintains a
+// position hint, making the sequential lookup pattern that decomposition
+// exhibits effectively O(1) per query.
+//
+// Mutation is deliberately more restricted than AddressSpace: Insert is
+// supported (O(n) worst case, amortized O(1) when ranges arrive in address
+// order, as they do when walking an image), as is a bulk Assign from an
+// already-sorted vector. Callers needing heavy random insert/remove churn
+// should stick with AddressSpace.
+
+#ifndef SYZYGY_CORE_FLAT_ADDRESS_SPACE_H_
+#define SYZYGY_CORE_FLAT_ADDRESS_SPACE_H_
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "syzygy/core/address_space.h"
+
+namespace core {
+
+// An address space that maps a set of non-overlapping address ranges, each of
+// non-zero size, to an ItemType, backed by a sorted flat vector.
+template <typename AddressType, typename SizeType, typename ItemType>
+class FlatAddressSpace {
+ public:
+  // Typedef we use for convenience throughout.
+  typedef AddressRange<AddressType, SizeType> Range;
+  typedef std::pair<Range, ItemType> RangeItemPair;
+  typedef std::vector<RangeItemPair> RangeVector;
+  typedef typename RangeVector::iterator RangeVectorIter;
+  typedef typename RangeVector::const_iterator RangeVectorConstIter;
+  typedef std::pair<RangeVectorConstIter, RangeVectorConstIter>
+      RangeVectorConstIterPair;
+  typedef std::pair<RangeVectorIter, RangeVectorIter> RangeVectorIterPair;
+
+  // STL-like type definitions.
+  // @{
+  typedef RangeVectorIter iterator;
+  typedef RangeVectorConstIter const_iterator;
+  typedef typename RangeVector::value_type value_type;
+  // @}
+
+  // Creates an empty address space.
+  FlatAddressSpace() : hint_(0) {
+  }
+
+  // Bulk-builds the address space from an already-sorted vector of range-item
+  // pairs. This is O(n), versus O(n log n) comparisons and n allocations for
+  // repeated Inserts into a map-backed AddressSpace.
+  // @param range_item_pairs the contents of the address space, sorted by
+  //     range start address, pairwise non-overlapping, all of non-zero size.
+  // @returns true if @p range_item_pairs satisfies the preconditions and the
+  //     address space was populated, false otherwise.
+  bool Assign(const RangeVector& range_item_pairs);
+
+  // Inserts @p range mapping to @p item unless @p range intersects an
+  // existing range. Inserting in ascending address order is amortized O(1);
+  // arbitrary order insertion is O(n) due to vector displacement.
+  // @param range the range to insert.
+  // @param item the item to associate with @p range.
+  // @param ret_it on success, returns an iterator to the inserted item.
+  // @returns true iff @p range inserted.
+  bool Insert(const Range& range,
+              const ItemType& item,
+              iterator* ret_it = NULL);
+
+  // Removes the range that exactly matches @p range.
+  // @returns true iff @p range is removed.
+  bool Remove(const Range& range);
+
+  // Removes all items from the address space.
+  void Clear() { ranges_.clear(); hint_ = 0; }
+
+  const RangeVector& ranges() const { return ranges_; }
+  bool empty() const { return ranges_.empty(); }
+  size_t size() const { return ranges_.size(); }
+
+  // Finds the first contained range that intersects @p range.
+  const_iterator FindFirstIntersection(const Range& range) const;
+  iterator FindFirstIntersection(const Range& range);
+
+  // Caution must be taken in using the non-const version of these! It is up
+  // to the user not to change the values of any underlying ranges so as to
+  // invalidate the non-overlapping range property of the address space.
+  // @{
+  const_iterator begin() const { return ranges_.begin(); }
+  iterator begin() { return ranges_.begin(); }
+  const_iterator end() const { return ranges_.end(); }
+  iterator end() { return ranges_.end(); }
+  // @}
+
+  // Returns a pair of iterators that iterate over all ranges intersecting
+  // @p range.
+  RangeVectorConstIterPair FindIntersecting(const Range& range) const;
+  RangeVectorIterPair FindIntersecting(const Range& range);
+
+  // Returns true if the given range intersects any range currently in the
+  // address space.
+  bool Intersects(const Range& range) const {
+    return FindFirstIntersection(range) != ranges_.end();
+  }
+  bool Intersects(AddressType address, SizeType size = 1) const {
+    return Intersects(Range(address, size));
+  }
+
+  // Returns true if the given range is contained exactly in the address
+  // space.
+  bool ContainsExactly(const Range& range) const {
+    const_iterator it = FindContaining(range);
+    if (it == ranges_.end())
+      return false;
+    return it->first == range;
+  }
+  bool ContainsExactly(AddressType address, SizeType size = 1) const {
+    return ContainsExactly(Range(address, size));
+  }
+
+  // Returns true if the given range is contained by exactly one range in the
+  // address space.
+  bool Contains(const Range& range) const {
+    return FindContaining(range) != ranges_.end();
+  }
+  bool Contains(AddressType address, SizeType size = 1) const {
+    return Contains(Range(address, size));
+  }
+
+  // Finds the range that contains @p range. This first consults (and then
+  // updates) a position hint, so a sequence of queries with ascending
+  // addresses degenerates to a pair of comparisons per query.
+  const_iterator FindContaining(const Range& range) const;
+  iterator FindContaining(const Range& range);
+
+ private:
+  // Returns an iterator to the first range whose start address is > that of
+  // @p range, as per std::upper_bound over the range start addresses.
+  const_iterator UpperBound(const Range& range) const;
+
+  // Our ranges and their associated items, sorted by range start address.
+  RangeVector ranges_;
+
+  // The index at which the last successful FindContaining terminated. Purely
+  // a performance hint; always in [0, ranges_.size()].
+  mutable size_t hint_;
+};
+
+template <typename AddressType, typename SizeType, typename ItemType>
+bool FlatAddressSpace<AddressType, SizeType, ItemType>::Assign(
+    const RangeVector& range_item_pairs) {
+  // Validate sortedness and non-overlap before committing to anything.
+  for (size_t i = 0; i < range_item_pairs.size(); ++i) {
+    if (range_item_pairs[i].first.size() == 0)
+      return false;
+    if (i > 0 && range_item_pairs[i].first.start() <
+            range_item_pairs[i - 1].first.start() +
+                range_item_pairs[i - 1].first.size()) {
+      return false;
+    }
+  }
+
+  ranges_ = range_item_pairs;
+  hint_ = 0;
+  return true;
+}
+
+template <typename AddressType, typename SizeType, typename ItemType>
+bool FlatAddressSpace<AddressType, SizeType, ItemType>::Insert(
+    const Range& range, const ItemType& item, iterator* ret_it) {
+  // Fast path: the range belongs at the end, which is where it lands when
+  // ranges are inserted in ascending address order.
+  if (ranges_.empty() ||
+      ranges_.back().first.start() + ranges_.back().first.size() <=
+          range.start()) {
+    ranges_.push_back(std::make_pair(range, item));
+    if (ret_it != NULL)
+      *ret_it = ranges_.end() - 1;
+    return true;
+  }
+
+  const_iterator const_it = UpperBound(range);
+  iterator it = ranges_.begin() + (const_it - ranges_.begin());
+
+  // The previous range must not run into the new one.
+  if (it != ranges_.begin()) {
+    const Range& prev = (it - 1)->first;
+    if (prev.start() + prev.size() > range.start())
+      return false;
+  }
+  // And the new one must not run into the next.
+  if (it != ranges_.end() && range.start() + range.size() > it->first.start())
+    return false;
+
+  it = ranges_.insert(it, std::make_pair(range, item));
+  if (ret_it != NULL)
+    *ret_it = it;
+  return true;
+}
+
+template <typename AddressType, typename SizeType, typename ItemType>
+bool FlatAddressSpace<AddressType, SizeType, ItemType>::Remove(
+    const Range& range) {
+  const_iterator const_it = FindContaining(range);
+  if (const_it == ranges_.end() || !(const_it->first == range))
+    return false;
+  ranges_.erase(ranges_.begin() + (const_it - ranges_.begin()));
+  hint_ = 0;
+  return true;
+}
+
+template <typename AddressType, typename SizeType, typename ItemType>
+typename FlatAddressSpace<AddressType, SizeType, ItemType>::const_iterator
+FlatAddressSpace<AddressType, SizeType, ItemType>::UpperBound(
+    const Range& range) const {
+  size_t lo = 0;
+  size_t hi = ranges_.size();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (range.start() < ranges_[mid].first.start())
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return ranges_.begin() + lo;
+}
+
+template <typename AddressType, typename SizeType, typename ItemType>
+typename FlatAddressSpace<AddressType, SizeType, ItemType>::const_iterator
+FlatAddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
+    const Range& range) const {
+  const_iterator it = UpperBound(range);
+  // The predecessor is the only candidate that starts at or before
+  // range.start().
+  if (it != ranges_.begin()) {
+    const_iterator prev = it - 1;
+    if (prev->first.Intersects(range))
+      return prev;
+  }
+  if (it != ranges_.end() && it->first.Intersects(range))
+    return it;
+  return ranges_.end();
+}
+
+template <typename AddressType, typename SizeType, typename ItemType>
+typename FlatAddressSpace<AddressType, SizeType, ItemType>::iterator
+FlatAddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
+    const Range& range) {
+  const_iterator it =
+      static_cast<const FlatAddressSpace*>(this)->FindFirstIntersection(range);
+  return ranges_.begin() + (it - ranges_.begin());
+}
+
+template <typename AddressType, typename SizeType, typename ItemType>
+typename FlatAddressSpace<AddressType, SizeType, ItemType>::
+    RangeVectorConstIterPair
+FlatAddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+    const Range& range) const {
+  const_iterator first = FindFirstIntersection(range);
+  if (first == ranges_.end())
+    return std::make_pair(ranges_.end(), ranges_.end());
+  const_iterator last = first;
+  while (last != ranges_.end() && last->first.Intersects(range))
+    ++last;
+  return std::make_pair(first, last);
+}
+
+template <typename AddressType, typename SizeType, typename ItemType>
+typename FlatAddressSpace<AddressType, SizeType, ItemType>::RangeVectorIterPair
+FlatAddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+    const Range& range) {
+  RangeVectorConstIterPair pair =
+      static_cast<const FlatAddressSpace*>(this)->FindIntersecting(range);
+  return std::make_pair(ranges_.begin() + (pair.first - ranges_.begin()),
+                        ranges_.begin() + (pair.second - ranges_.begin()));
+}
+
+template <typename AddressType, typename SizeType, typename ItemType>
+typename FlatAddressSpace<AddressType, SizeType, ItemType>::const_iterator
+FlatAddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+    const Range& range) const {
+  // Consult the hint first: sequential lookups typically land in the same
+  // range as the previous query, or in its successor.
+  for (size_t i = hint_; i < hint_ + 2 && i < ranges_.size(); ++i) {
+    if (ranges_[i].first.Contains(range)) {
+      hint_ = i;
+      return ranges_.begin() + i;
+    }
+  }
+
+  const_iterator it = UpperBound(range);
+  if (it == ranges_.begin())
+    return ranges_.end();
+  --it;
+  if (!it->first.Contains(range))
+    return ranges_.end();
+  hint_ = it - ranges_.begin();
+  return it;
+}
+
+template <typename AddressType, typename SizeType, typename ItemType>
+typename FlatAddressSpace<AddressType, SizeType, ItemType>::iterator
+FlatAddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+    const Range& range) {
+  const_iterator it =
+      static_cast<const FlatAddressSpace*>(this)->FindContaining(range);
+  return ranges_.begin() + (it - ranges_.begin());
+}
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_FLAT_ADDRESS_SPACE_H_
@@ -0,0 +1,206 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/flat_address_space.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace core {
+
+namespace {
+
+typedef FlatAddressSpace<size_t, size_t, void*> IntegerAddressSpace;
+typedef IntegerAddressSpace::Range Range;
+
+void* Item(unsigned int i) {
+  return reinterpret_cast<void*>(i);
+}
+
+}  // namespace
+
+TEST(FlatAddressSpaceTest, Create) {
+  IntegerAddressSpace address_space;
+  EXPECT_TRUE(address_space.empty());
+  EXPECT_EQ(0u, address_space.size());
+  EXPECT_TRUE(address_space.begin() == address_space.end());
+}
+
+TEST(FlatAddressSpaceTest, Insert) {
+  IntegerAddressSpace address_space;
+
+  // Insertions at the end are the fast path.
+  EXPECT_TRUE(address_space.Insert(Range(100, 10), Item(1)));
+  EXPECT_TRUE(address_space.Insert(Range(110, 5), Item(2)));
+  EXPECT_TRUE(address_space.Insert(Range(120, 10), Item(3)));
+
+  // An out-of-order insertion into a gap must also work.
+  EXPECT_TRUE(address_space.Insert(Range(0, 10), Item(0)));
+  EXPECT_EQ(4u, address_space.size());
+
+  // Overlapping insertions must fail without modifying the space.
+  EXPECT_FALSE(address_space.Insert(Range(105, 10), Item(4)));
+  EXPECT_FALSE(address_space.Insert(Range(95, 10), Item(4)));
+  EXPECT_FALSE(address_space.Insert(Range(100, 10), Item(4)));
+  EXPECT_EQ(4u, address_space.size());
+
+  // The ranges must come out in address order.
+  IntegerAddressSpace::const_iterator it = address_space.begin();
+  EXPECT_EQ(Range(0, 10), it->first);
+  ++it;
+  EXPECT_EQ(Range(100, 10), it->first);
+}
+
+TEST(FlatAddressSpaceTest, Assign) {
+  IntegerAddressSpace::RangeVector pairs;
+  pairs.push_back(std::make_pair(Range(0, 10), Item(0)));
+  pairs.push_back(std::make_pair(Range(10, 10), Item(1)));
+  pairs.push_back(std::make_pair(Range(30, 10), Item(2)));
+
+  IntegerAddressSpace address_space;
+  EXPECT_TRUE(address_space.Assign(pairs));
+  EXPECT_EQ(3u, address_space.size());
+
+  // An unsorted or overlapping input must be rejected.
+  pairs.push_back(std::make_pair(Range(20, 10), Item(3)));
+  IntegerAddressSpace address_space2;
+  EXPECT_FALSE(address_space2.Assign(pairs));
+
+  // As must a zero-sized range.
+  pairs.resize(3);
+  pairs.push_back(std::make_pair(Range(50, 0), Item(3)));
+  EXPECT_FALSE(address_space2.Assign(pairs));
+}
+
+TEST(FlatAddressSpaceTest, Remove) {
+  IntegerAddressSpace address_space;
+  ASSERT_TRUE(address_space.Insert(Range(100, 10), Item(1)));
+  ASSERT_TRUE(address_space.Insert(Range(110, 5), Item(2)));
+
+  // Only exact matches may be removed.
+  EXPECT_FALSE(address_space.Remove(Range(100, 5)));
+  EXPECT_TRUE(address_space.Remove(Range(100, 10)));
+  EXPECT_FALSE(address_space.Remove(Range(100, 10)));
+  EXPECT_EQ(1u, address_space.size());
+
+  // The freed range is insertable again.
+  EXPECT_TRUE(address_space.Insert(Range(100, 10), Item(3)));
+}
+
+TEST(FlatAddressSpaceTest, FindFirstIntersection) {
+  IntegerAddressSpace address_space;
+  ASSERT_TRUE(address_space.Insert(Range(100, 10), Item(1)));
+  ASSERT_TRUE(address_space.Insert(Range(110, 5), Item(2)));
+  ASSERT_TRUE(address_space.Insert(Range(120, 10), Item(3)));
+
+  IntegerAddressSpace::const_iterator it =
+      address_space.FindFirstIntersection(Range(0, 99));
+  EXPECT_TRUE(it == address_space.end());
+
+  it = address_space.FindFirstIntersection(Range(0, 100));
+  EXPECT_TRUE(it == address_space.end());
+
+  it = address_space.FindFirstIntersection(Range(0, 101));
+  ASSERT_TRUE(it != address_space.end());
+  EXPECT_EQ(100u, it->first.start());
+
+  it = address_space.FindFirstIntersection(Range(105, 30));
+  ASSERT_TRUE(it != address_space.end());
+  EXPECT_EQ(100u, it->first.start());
+
+  it = address_space.FindFirstIntersection(Range(115, 1));
+  EXPECT_TRUE(it == address_space.end());
+
+  it = address_space.FindFirstIntersection(Range(125, 1));
+  ASSERT_TRUE(it != address_space.end());
+  EXPECT_EQ(120u, it->first.start());
+
+  it = address_space.FindFirstIntersection(Range(130, 100));
+  EXPECT_TRUE(it == address_space.end());
+}
+
+TEST(FlatAddressSpaceTest, FindIntersecting) {
+  IntegerAddressSpace address_space;
+  ASSERT_TRUE(address_space.Insert(Range(100, 10), Item(1)));
+  ASSERT_TRUE(address_space.Insert(Range(110, 5), Item(2)));
+  ASSERT_TRUE(address_space.Insert(Range(120, 10), Item(3)));
+
+  IntegerAddressSpace::RangeVectorConstIterPair pair =
+      address_space.FindIntersecting(Range(0, 1000));
+  EXPECT_TRUE(pair.first == address_space.begin());
+  EXPECT_TRUE(pair.second == address_space.end());
+
+  pair = address_space.FindIntersecting(Range(105, 11));
+  ASSERT_TRUE(pair.first != address_space.end());
+  EXPECT_EQ(100u, pair.first->first.start());
+  EXPECT_EQ(2, pair.second - pair.first);
+
+  pair = address_space.FindIntersecting(Range(115, 2));
+  EXPECT_TRUE(pair.first == pair.second);
+}
+
+TEST(FlatAddressSpaceTest, FindContaining) {
+  IntegerAddressSpace address_space;
+  ASSERT_TRUE(address_space.Insert(Range(100, 10), Item(1)));
+  ASSERT_TRUE(address_space.Insert(Range(110, 5), Item(2)));
+  ASSERT_TRUE(address_space.Insert(Range(120, 10), Item(3)));
+
+  IntegerAddressSpace::const_iterator it =
+      address_space.FindContaining(Range(100, 10));
+  ASSERT_TRUE(it != address_space.end());
+  EXPECT_EQ(Item(1), it->second);
+
+  it = address_space.FindContaining(Range(102, 5));
+  ASSERT_TRUE(it != address_space.end());
+  EXPECT_EQ(Item(1), it->second);
+
+  // Straddling two ranges is not containment.
+  it = address_space.FindContaining(Range(105, 10));
+  EXPECT_TRUE(it == address_space.end());
+
+  it = address_space.FindContaining(Range(95, 10));
+  EXPECT_TRUE(it == address_space.end());
+
+  // Sequential queries exercise the hint fast path; results must be
+  // identical to cold queries.
+  for (size_t addr = 100; addr < 130; ++addr) {
+    if (addr < 115 || addr >= 120) {
+      EXPECT_TRUE(address_space.Contains(addr, 1)) << "address " << addr;
+    } else {
+      EXPECT_FALSE(address_space.Contains(addr, 1)) << "address " << addr;
+    }
+  }
+}
+
+TEST(FlatAddressSpaceTest, ContainsExactly) {
+  IntegerAddressSpace address_space;
+  ASSERT_TRUE(address_space.Insert(Range(100, 10), Item(1)));
+
+  EXPECT_TRUE(address_space.ContainsExactly(Range(100, 10)));
+  EXPECT_FALSE(address_space.ContainsExactly(Range(100, 5)));
+  EXPECT_FALSE(address_space.ContainsExactly(Range(102, 8)));
+  EXPECT_FALSE(address_space.ContainsExactly(Range(0, 10)));
+}
+
+TEST(FlatAddressSpaceTest, Intersects) {
+  IntegerAddressSpace address_space;
+  ASSERT_TRUE(address_space.Insert(Range(100, 10), Item(1)));
+
+  EXPECT_TRUE(address_space.Intersects(Range(105, 100)));
+  EXPECT_TRUE(address_space.Intersects(Range(0, 101)));
+  EXPECT_FALSE(address_space.Intersects(Range(0, 100)));
+  EXPECT_FALSE(address_space.Intersects(Range(110, 10)));
+}
+
+}  // namespace core
@@ -25,6 +25,7 @@
 #include "base/json/json_writer.h"
 #include "base/json/string_escape.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 
 namespace core {
@@ -43,6 +44,11 @@ static const char kCommentPrefix[] = "//";
 static const char* kStructureOpenings[] = { "[", "{", NULL };
 static const char* kStructureClosings[] = { "]", "}", NULL };
 
+// Once the output buffer exceeds this size it is written out to file. The
+// buffer is preallocated to this size, so individual values are typically
+// formatted without any allocation at all.
+static const size_t kBufferHighWaterMark = 64 * 1024;
+
 }  // namespace
 
 struct JSONFileWriter::Helper {
@@ -84,6 +90,12 @@ struct JSONFileWriter::Helper {
     if (!(json_file_writer->*print_function)(value))
       return false;
     json_file_writer->FlushValue(true);
+
+    // If this value finished the stream push the buffered output to disk, so
+    // that the file is complete the moment the last value is written.
+    if (json_file_writer->finished_ && !json_file_writer->FlushBuffer())
+      return false;
+
     return true;
   }
 };
@@ -95,10 +107,12 @@ JSONFileWriter::JSONFileWriter(FILE* file, bool pretty_print)
       at_col_zero_(true),
       indent_depth_(0) {
   DCHECK(file != NULL);
+  buffer_.reserve(kBufferHighWaterMark);
 }
 
 JSONFileWriter::~JSONFileWriter() {
   Flush();
+  FlushBuffer();
 }
 
 bool JSONFileWriter::OutputComment(const base::StringPiece& comment) {
@@ -119,7 +133,7 @@ bool JSONFileWriter::OutputComment(const base::StringPiece& comment) {
         !Printf(" %.*s", comment.length(), comment.data())) {
       return false;
     }
-    return true;
+    return FlushBuffer();
   }
 
   // Store the comment for output before the next value.
@@ -165,9 +179,10 @@ bool JSONFileWriter::OutputTrailingComment(const base::StringPiece& comment) {
 
   // Are we finished? Immediately write the comment, but leave
   // trailing_comment_ populated so that repeated calls will fail.
-  if (finished_ &&
-      !Printf("  %s %s", kCommentPrefix, trailing_comment_.c_str())) {
-    return false;
+  if (finished_) {
+    if (!Printf("  %s %s", kCommentPrefix, trailing_comment_.c_str()))
+      return false;
+    return FlushBuffer();
   }
 
   return true;
@@ -185,7 +200,23 @@ bool JSONFileWriter::PrintBoolean(bool value) {
 }
 
 bool JSONFileWriter::PrintInteger(int value) {
-  return Printf("%d", value);
+  // Integers dominate the output of order and profile files, so format them
+  // by hand rather than taking a trip through vsnprintf.
+  char digits[16];  // Enough for -2147483648.
+  char* end = digits + arraysize(digits);
+  char* cur = end;
+  uint32 remainder = value < 0 ? 0 - static_cast<uint32>(value) : value;
+  do {
+    *--cur = '0' + static_cast<char>(remainder % 10);
+    remainder /= 10;
+  } while (remainder != 0);
+  if (value < 0)
+    *--cur = '-';
+
+  buffer_.append(cur, end - cur);
+  at_col_zero_ = false;
+
+  return FlushBufferIfFull();
 }
 
 bool JSONFileWriter::PrintDouble(double value) {
@@ -194,6 +225,25 @@ bool JSONFileWriter::PrintDouble(double value) {
 }
 
 bool JSONFileWriter::PrintString(const base::StringPiece& value) {
+  // Most strings consist solely of printable ASCII with no characters that
+  // need escaping, and can be appended to the output buffer directly.
+  bool needs_escaping = false;
+  for (size_t i = 0; i < value.length(); ++i) {
+    unsigned char c = static_cast<unsigned char>(value[i]);
+    if (c < 0x20 || c >= 0x7F || c == '"' || c == '\\') {
+      needs_escaping = true;
+      break;
+    }
+  }
+
+  if (!needs_escaping) {
+    buffer_.push_back('"');
+    buffer_.append(value.data(), value.length());
+    buffer_.push_back('"');
+    at_col_zero_ = false;
+    return FlushBufferIfFull();
+  }
+
   return Printf("%s", base::GetQuotedJSONString(value.as_string()).c_str());
 }
 
@@ -232,22 +282,39 @@ bool JSONFileWriter::PrintValue(const Value* value) {
 }
 
 bool JSONFileWriter::Printf(const char* format, ...) {
+  size_t old_size = buffer_.size();
   va_list args;
   va_start(args, format);
-  int chars_written = vfprintf(file_, format, args);
+  base::StringAppendV(&buffer_, format, args);
   va_end(args);
-  if (chars_written > 0)
+  if (buffer_.size() > old_size)
     at_col_zero_ = false;
-  return chars_written >= 0;
+  return FlushBufferIfFull();
 }
 
 bool JSONFileWriter::PutChar(char c) {
-  if (fputc(c, file_) != c)
-    return false;
+  buffer_.push_back(c);
   at_col_zero_ = false;
+  return FlushBufferIfFull();
+}
+
+bool JSONFileWriter::FlushBuffer() {
+  if (buffer_.empty())
+    return true;
+  size_t bytes_written = fwrite(buffer_.data(), 1, buffer_.size(), file_);
+  if (bytes_written != buffer_.size())
+    return false;
+  // This keeps the allocation around for reuse.
+  buffer_.clear();
   return true;
 }
 
+bool JSONFileWriter::FlushBufferIfFull() {
+  if (buffer_.size() < kBufferHighWaterMark)
+    return true;
+  return FlushBuffer();
+}
+
 bool JSONFileWriter::OpenList() {
   return OpenStructure(kList);
 }
@@ -273,9 +340,10 @@ bool JSONFileWriter::OutputKey(const base::StringPiece16& key) {
 }
 
 bool JSONFileWriter::Flush() {
-  // Already finished? This is a no-op.
+  // Already finished? Simply make sure any buffered comments have hit the
+  // file.
   if (finished_)
-    return true;
+    return FlushBuffer();
 
   // Are we waiting on a required value?
   if (RequireKeyValue())
@@ -287,7 +355,7 @@ bool JSONFileWriter::Flush() {
       return false;
   }
 
-  return true;
+  return FlushBuffer();
 }
 
 bool JSONFileWriter::OutputBoolean(bool value) {
@@ -335,11 +403,9 @@ bool JSONFileWriter::OutputIndent() {
   // We bypass Printf and manually update at_col_zero_ here for efficiency.
   if (indent_depth_ > 0)
     at_col_zero_ = false;
-  for (size_t i = 0; i < indent_depth_; ++i) {
-    if (fprintf(file_, "%s", kIndent) < 0)
-      return false;
-  }
-  return true;
+  for (size_t i = 0; i < indent_depth_; ++i)
+    buffer_.append(kIndent, arraysize(kIndent) - 1);
+  return FlushBufferIfFull();
 }
 
 bool JSONFileWriter::OutputNewline() {
@@ -347,11 +413,10 @@ bool JSONFileWriter::OutputNewline() {
     return true;
 
   // Bypass Printf and manually at_col_zero_ for efficiency.
-  if (fprintf(file_, "%s", kNewline) < 0)
-    return false;
+  buffer_.append(kNewline, arraysize(kNewline) - 1);
   at_col_zero_ = true;
 
-  return true;
+  return FlushBufferIfFull();
 }
 
 bool JSONFileWriter::OutputComments() {
@@ -508,8 +573,11 @@ bool JSONFileWriter::CloseStructure(StructureType type) {
   }
 
   // If this closed the last open structure, then the JSON file is finished.
-  if (stack_.empty())
+  if (stack_.empty()) {
     finished_ = true;
+    if (!FlushBuffer())
+      return false;
+  }
 
   return true;
 }
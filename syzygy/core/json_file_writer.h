@@ -18,6 +18,7 @@
 #ifndef SYZYGY_CORE_JSON_FILE_WRITER_H_
 #define SYZYGY_CORE_JSON_FILE_WRITER_H_
 
+#include <string>
 #include <vector>
 #include "base/basictypes.h"
 #include "base/strings/string_piece.h"
@@ -124,12 +125,19 @@ class JSONFileWriter {
   bool PrintNull(int value_unused);
   bool PrintValue(const base::Value* value);
 
-  // The following group of functions act as pass-through for fprintf and fputc,
-  // but update internal state. No newline characters should be written using
-  // this mechanism. All newlines should be written using OutputNewline.
+  // The following group of functions append to the output buffer, updating
+  // internal state. No newline characters should be written using this
+  // mechanism. All newlines should be written using OutputNewline.
   bool Printf(const char* format, ...);
   bool PutChar(char c);
 
+  // Writes the contents of the output buffer to the underlying file. This is
+  // called automatically whenever the buffer fills up, whenever the stream
+  // is finished, and on destruction.
+  bool FlushBuffer();
+  // Flushes the output buffer only if it has exceeded its high-water mark.
+  bool FlushBufferIfFull();
+
   // Some state determination functions.
   bool FirstEntry() const;
   bool ReadyForKey() const;
@@ -148,6 +156,9 @@ class JSONFileWriter {
 
   // The file that is being written to.
   FILE* file_;
+  // The preallocated output buffer. Formatted output accumulates here and is
+  // written to file_ in large chunks, rather than a value at a time.
+  std::string buffer_;
   // Indicates whether or not we are pretty printing.
   bool pretty_print_;
   // This is set when the stream writer is finished. That is, a single value
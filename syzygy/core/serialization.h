@@ -123,6 +123,7 @@ namespace internal {
 // Forward declares of some utilities we need. These are defined in
 // serialization_impl.h.
 template<typename T> struct IsByteLike;
+template<typename T> struct IsSerializationPrimitive;
 template<typename IteratorTag> struct IteratorsAreEqualFunctor;
 
 }  // namespace internal
@@ -272,6 +273,39 @@ OutStream* CreateByteOutStream(OutputIterator iter, OutputIterator end) {
   return new ByteOutStream<OutputIterator>(iter, end);
 }
 
+// An OutStream that appends directly to a ByteVector. This is functionally
+// equivalent to a ByteOutStream over a back_inserter, but appends each write
+// as a single range insertion rather than byte by byte, and allows the
+// vector to be pre-sized when the caller can compute an upper bound for the
+// output.
+class VectorOutStream : public OutStream {
+ public:
+  // Constructor.
+  // @param bytes the vector to append output to. The vector must outlive
+  //     this stream. Existing contents are preserved.
+  explicit VectorOutStream(ByteVector* bytes) : bytes_(bytes) {
+    DCHECK(bytes != NULL);
+  }
+
+  virtual ~VectorOutStream() { }
+
+  // Reserves capacity for @p length bytes of output beyond what has already
+  // been written, saving reallocations when the caller knows an upper bound
+  // for the output size.
+  // @param length the number of further bytes expected to be written.
+  void Reserve(size_t length) {
+    bytes_->reserve(bytes_->size() + length);
+  }
+
+  virtual bool Write(size_t length, const Byte* bytes) {
+    bytes_->insert(bytes_->end(), bytes, bytes + length);
+    return true;
+  }
+
+ private:
+  ByteVector* bytes_;
+};
+
 // A simple InStream wrapper for containers of bytes. Uses a range of input
 // iterators to traverse a container. The value type of the iterator must be
 // 'byte-like' (integer type of size 1). Use with ScopedInStreamPtr.
@@ -344,6 +378,48 @@ class NativeBinaryOutArchive {
   NATIVE_BINARY_OUT_ARCHIVE_SAVE(unsigned long);
 #undef NATIVE_BINARY_OUT_ARCHIVE_SAVE
 
+  // Saves a contiguous run of primitive values with a single stream write.
+  // The encoding is identical to saving each element in turn, so the
+  // elements may be loaded individually or via LoadRepeated. Every
+  // OutArchive should implement this with the same guarantee; it is what
+  // makes bulk serialization of primitive containers cheap.
+  // @param elements the elements to save.
+  // @param count the number of elements to save.
+  template<typename Type> bool SaveRepeated(const Type* elements,
+                                            size_t count) {
+    COMPILE_ASSERT(internal::IsSerializationPrimitive<Type>::Value,
+                   type_must_be_a_serialization_primitive);
+    DCHECK(out_stream_ != NULL);
+    if (count == 0)
+      return true;
+    DCHECK(elements != NULL);
+    return out_stream_->Write(sizeof(Type) * count,
+                              reinterpret_cast<const Byte*>(elements));
+  }
+
+  // Saves an unsigned value using a variable-length encoding that stores 7
+  // bits per byte, low bits first, which is considerably smaller than the
+  // fixed-size encoding for typically small values. This is an alternate
+  // encoding: a value saved this way must be loaded with the matching
+  // LoadVarUint function.
+  // @param value the value to save.
+  bool SaveVarUint32(uint32 value) { return SaveVarUint64(value); }
+  bool SaveVarUint64(uint64 value) {
+    DCHECK(out_stream_ != NULL);
+    Byte bytes[10];
+    size_t count = 0;
+    for (;;) {
+      Byte byte = value & 0x7F;
+      value >>= 7;
+      if (value == 0) {
+        bytes[count++] = byte;
+        break;
+      }
+      bytes[count++] = byte | 0x80;
+    }
+    return out_stream_->Write(count, bytes);
+  }
+
   bool Flush() { return out_stream_->Flush(); }
 
   OutStream* out_stream() { return out_stream_; }
@@ -393,6 +469,54 @@ class NativeBinaryInArchive {
   NATIVE_BINARY_IN_ARCHIVE_LOAD(unsigned long);
 #undef NATIVE_BINARY_IN_ARCHIVE_LOAD
 
+  // Loads a contiguous run of primitive values with a single stream read,
+  // the bulk counterpart of SaveRepeated. The values may have been saved
+  // individually or via SaveRepeated.
+  // @param elements the buffer to receive the elements.
+  // @param count the number of elements to load.
+  template<typename Type> bool LoadRepeated(Type* elements, size_t count) {
+    COMPILE_ASSERT(internal::IsSerializationPrimitive<Type>::Value,
+                   type_must_be_a_serialization_primitive);
+    DCHECK(in_stream_ != NULL);
+    if (count == 0)
+      return true;
+    DCHECK(elements != NULL);
+    return in_stream_->Read(sizeof(Type) * count,
+                            reinterpret_cast<Byte*>(elements));
+  }
+
+  // Loads an unsigned value saved with the matching SaveVarUint function.
+  // @param value receives the value.
+  // @returns true on success, false if the stream is exhausted or the
+  //     encoding is invalid.
+  bool LoadVarUint32(uint32* value) {
+    DCHECK(value != NULL);
+    uint64 value64 = 0;
+    if (!LoadVarUint64(&value64) || value64 > 0xFFFFFFFF)
+      return false;
+    *value = static_cast<uint32>(value64);
+    return true;
+  }
+  bool LoadVarUint64(uint64* value) {
+    DCHECK(value != NULL);
+    DCHECK(in_stream_ != NULL);
+    uint64 temp = 0;
+    for (size_t i = 0; i < 10; ++i) {
+      Byte byte = 0;
+      if (!in_stream_->Read(1, &byte))
+        return false;
+      // The tenth byte may only contribute the single remaining bit.
+      if (i == 9 && (byte & 0xFE) != 0)
+        return false;
+      temp |= static_cast<uint64>(byte & 0x7F) << (7 * i);
+      if ((byte & 0x80) == 0) {
+        *value = temp;
+        return true;
+      }
+    }
+    return false;
+  }
+
   InStream* in_stream() { return in_stream_; }
 
  private:
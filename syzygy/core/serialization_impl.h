@@ -50,6 +50,46 @@ template<typename T> struct IsByteLike {
   };
 };
 
+// This tests that a given type is one of the primitive types that archives
+// are required to implement directly, and hence one that SaveRepeated and
+// LoadRepeated may be used with.
+template<typename T> struct IsSerializationPrimitive {
+  enum { Value = 0 };
+};
+#define DECLARE_SERIALIZATION_PRIMITIVE(Type) \
+template<> struct IsSerializationPrimitive<Type> { \
+  enum { Value = 1 }; \
+}
+DECLARE_SERIALIZATION_PRIMITIVE(bool);
+DECLARE_SERIALIZATION_PRIMITIVE(char);
+DECLARE_SERIALIZATION_PRIMITIVE(wchar_t);
+DECLARE_SERIALIZATION_PRIMITIVE(float);
+DECLARE_SERIALIZATION_PRIMITIVE(double);
+DECLARE_SERIALIZATION_PRIMITIVE(int8);
+DECLARE_SERIALIZATION_PRIMITIVE(int16);
+DECLARE_SERIALIZATION_PRIMITIVE(int32);
+DECLARE_SERIALIZATION_PRIMITIVE(int64);
+DECLARE_SERIALIZATION_PRIMITIVE(uint8);
+DECLARE_SERIALIZATION_PRIMITIVE(uint16);
+DECLARE_SERIALIZATION_PRIMITIVE(uint32);
+DECLARE_SERIALIZATION_PRIMITIVE(uint64);
+DECLARE_SERIALIZATION_PRIMITIVE(unsigned long);
+#undef DECLARE_SERIALIZATION_PRIMITIVE
+
+// This tests whether a std::vector of the given type may be serialized via
+// SaveRepeated and LoadRepeated. std::vector<bool> is excluded as it is a
+// packed specialization without contiguous elements.
+template<typename T> struct VectorIsBatchable {
+  enum {
+    Value = IsSerializationPrimitive<T>::Value &&
+        !TypesAreEqual<T, bool>::Value
+  };
+};
+
+// A type wrapper for dispatching to a batched or an element-wise
+// implementation at compile time.
+template<bool Value> struct BoolToType { };
+
 // This compares two iterators. It only does so if the iterator type is
 // not an output iterator.
 template<typename IteratorTag> struct IteratorsAreEqualFunctor {
@@ -149,6 +189,56 @@ bool LoadContainer(Container* container,
   return true;
 }
 
+// Batched serialization for contiguous containers of primitive values
+// (std::vector and std::basic_string). These move the container contents
+// with a single stream operation, but produce exactly the same encoding as
+// the element-wise SaveContainer/LoadContainer.
+template<class Container, class OutArchive> bool SaveRange(
+    const Container& container, OutArchive* out_archive) {
+  DCHECK(out_archive != NULL);
+
+  if (!out_archive->Save(container.size()))
+    return false;
+  if (container.empty())
+    return true;
+  return out_archive->SaveRepeated(&container[0], container.size());
+}
+
+template<class Container, class InArchive> bool LoadRange(
+    Container* container, InArchive* in_archive) {
+  DCHECK(container != NULL);
+  DCHECK(in_archive != NULL);
+
+  typename Container::size_type size = 0;
+  if (!in_archive->Load(&size))
+    return false;
+  container->resize(size);
+  if (size == 0)
+    return true;
+  return in_archive->LoadRepeated(&(*container)[0], size);
+}
+
+// These choose between the batched and the element-wise implementations at
+// compile time, based on the container's value type.
+template<class Container, class OutArchive> bool SaveSequence(
+    const Container& container, OutArchive* out_archive, BoolToType<true>) {
+  return SaveRange(container, out_archive);
+}
+template<class Container, class OutArchive> bool SaveSequence(
+    const Container& container, OutArchive* out_archive, BoolToType<false>) {
+  return SaveContainer(container, out_archive);
+}
+template<class Container, class InArchive> bool LoadSequence(
+    Container* container, InArchive* in_archive, BoolToType<true>) {
+  return LoadRange(container, in_archive);
+}
+template<class Container, class InArchive> bool LoadSequence(
+    Container* container, InArchive* in_archive, BoolToType<false>) {
+  DCHECK(container != NULL);
+  container->clear();
+  return LoadContainer(container, std::back_inserter(*container), in_archive);
+}
+
 }  // namespace internal
 
 template<typename OutputIterator> bool ByteOutStream<OutputIterator>::Write(
@@ -204,7 +294,10 @@ template<typename Char, typename Traits, typename Alloc, class OutArchive>
 bool Save(const std::basic_string<Char, Traits, Alloc>& string,
           OutArchive* out_archive) {
   DCHECK(out_archive != NULL);
-  return internal::SaveContainer(string, out_archive);
+  return internal::SaveSequence(
+      string, out_archive,
+      internal::BoolToType<
+          internal::IsSerializationPrimitive<Char>::Value != 0>());
 }
 
 template<typename Key, typename Data, typename Compare, typename Alloc,
@@ -233,7 +326,9 @@ template<typename Type, typename Alloc, class OutArchive>
 bool Save(const std::vector<Type, Alloc>& vector,
           OutArchive* out_archive) {
   DCHECK(out_archive != NULL);
-  return internal::SaveContainer(vector, out_archive);
+  return internal::SaveSequence(
+      vector, out_archive,
+      internal::BoolToType<internal::VectorIsBatchable<Type>::Value != 0>());
 }
 
 // Implementation of STL Load specializations.
@@ -243,10 +338,10 @@ bool Load(std::basic_string<Char, Traits, Alloc>* string,
           InArchive* in_archive) {
   DCHECK(string != NULL);
   DCHECK(in_archive != NULL);
-  string->clear();
-  return internal::LoadContainer(string,
-                                 std::back_inserter(*string),
-                                 in_archive);
+  return internal::LoadSequence(
+      string, in_archive,
+      internal::BoolToType<
+          internal::IsSerializationPrimitive<Char>::Value != 0>());
 }
 
 template<typename Key, typename Data, typename Compare, typename Alloc,
@@ -285,9 +380,9 @@ bool Load(std::vector<Type, Alloc>* vector,
           InArchive* in_archive) {
   DCHECK(vector != NULL);
   DCHECK(in_archive != NULL);
-  return internal::LoadContainer(vector,
-                                 std::back_inserter(*vector),
-                                 in_archive);
+  return internal::LoadSequence(
+      vector, in_archive,
+      internal::BoolToType<internal::VectorIsBatchable<Type>::Value != 0>());
 }
 
 // Implementation of serialization for C-style arrays.
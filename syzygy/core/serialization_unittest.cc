@@ -109,6 +109,85 @@ TEST_F(SerializationTest, IteratorInStream) {
   EXPECT_FALSE(in_stream->Read(sizeof(kTestData), buffer));
 }
 
+TEST_F(SerializationTest, VectorOutStream) {
+  ByteVector bytes;
+  VectorOutStream out_stream(&bytes);
+  out_stream.Reserve(sizeof(kTestData));
+
+  // Writing data should work, and should match the source data.
+  EXPECT_TRUE(out_stream.Write(2, kTestData));
+  EXPECT_TRUE(out_stream.Write(sizeof(kTestData) - 2, kTestData + 2));
+  EXPECT_EQ(sizeof(kTestData), bytes.size());
+  EXPECT_EQ(0, memcmp(&bytes[0], kTestData, sizeof(kTestData)));
+}
+
+TEST_F(SerializationTest, SaveRepeatedMatchesElementWiseEncoding) {
+  const uint32 kValues[] = { 0, 1, 0xFFFFFFFF, 42 };
+
+  // Save the values one at a time.
+  ByteVector expected;
+  {
+    VectorOutStream out_stream(&expected);
+    OutArchive out_archive(&out_stream);
+    for (size_t i = 0; i < arraysize(kValues); ++i)
+      ASSERT_TRUE(out_archive.Save(kValues[i]));
+  }
+
+  // Save them as a single run; the encoding must be identical.
+  ByteVector actual;
+  {
+    VectorOutStream out_stream(&actual);
+    OutArchive out_archive(&out_stream);
+    ASSERT_TRUE(out_archive.SaveRepeated(kValues, arraysize(kValues)));
+  }
+  EXPECT_EQ(expected, actual);
+
+  // And LoadRepeated must read them back.
+  ScopedInStreamPtr in_stream(
+      CreateByteInStream(actual.begin(), actual.end()));
+  InArchive in_archive(in_stream.get());
+  uint32 values[arraysize(kValues)] = {};
+  EXPECT_TRUE(in_archive.LoadRepeated(values, arraysize(values)));
+  EXPECT_EQ(0, memcmp(kValues, values, sizeof(kValues)));
+}
+
+TEST_F(SerializationTest, VarUintRoundTrip) {
+  const uint64 kValues[] = { 0, 1, 127, 128, 16383, 16384, 0xFFFFFFFF,
+                             0xFFFFFFFFFFFFFFFFULL };
+
+  ByteVector bytes;
+  VectorOutStream out_stream(&bytes);
+  OutArchive out_archive(&out_stream);
+  for (size_t i = 0; i < arraysize(kValues); ++i)
+    ASSERT_TRUE(out_archive.SaveVarUint64(kValues[i]));
+  ASSERT_TRUE(out_archive.SaveVarUint32(0xFFFFFFFF));
+
+  ScopedInStreamPtr in_stream(CreateByteInStream(bytes.begin(), bytes.end()));
+  InArchive in_archive(in_stream.get());
+  for (size_t i = 0; i < arraysize(kValues); ++i) {
+    uint64 value = 0;
+    EXPECT_TRUE(in_archive.LoadVarUint64(&value));
+    EXPECT_EQ(kValues[i], value);
+  }
+  uint32 value32 = 0;
+  EXPECT_TRUE(in_archive.LoadVarUint32(&value32));
+  EXPECT_EQ(0xFFFFFFFFu, value32);
+
+  // The stream is exhausted; a further load must fail.
+  EXPECT_FALSE(in_archive.LoadVarUint32(&value32));
+
+  // A value that does not fit in 32 bits must be rejected by the 32-bit
+  // load.
+  ByteVector big_bytes;
+  VectorOutStream big_out_stream(&big_bytes);
+  OutArchive big_out_archive(&big_out_stream);
+  ASSERT_TRUE(big_out_archive.SaveVarUint64(0x100000000ULL));
+  ScopedInStreamPtr big_in_stream(
+      CreateByteInStream(big_bytes.begin(), big_bytes.end()));
+  InArchive big_in_archive(big_in_stream.get());
+  EXPECT_FALSE(big_in_archive.LoadVarUint32(&value32));
+}
+
 TEST_F(SerializationTest, FileOutStream) {
   base::FilePath path;
   base::ScopedFILE file;
@@ -196,6 +275,21 @@ TEST_F(SerializationTest, StlTypesRoundTrip) {
   vector.push_back(3);
   vector.push_back(5);
   EXPECT_TRUE(TestRoundTrip(vector));
+
+  // This exercises the batched serialization path.
+  std::vector<uint8> byte_vector;
+  byte_vector.push_back(2);
+  byte_vector.push_back(4);
+  byte_vector.push_back(6);
+  EXPECT_TRUE(TestRoundTrip(byte_vector));
+
+  // std::vector<bool> is a packed specialization without contiguous
+  // elements, and must keep using the element-wise path.
+  std::vector<bool> bool_vector;
+  bool_vector.push_back(true);
+  bool_vector.push_back(false);
+  bool_vector.push_back(true);
+  EXPECT_TRUE(TestRoundTrip(bool_vector));
 }
 
 TEST_F(SerializationTest, CustomTypeRoundTrip) {
@@ -14,3 +14,102 @@
 
 // This is a simple wrapper to the automatically generated file.
 #include "syzygy/crashdata/crashdata.pb.cc"
+
+#include "syzygy/crashdata/crashdata.h"
+
+namespace crashdata {
+
+Leaf* ValueGetLeaf(Value* value) {
+  value->set_type(Value_Type_LEAF);
+  return value->mutable_leaf();
+}
+
+List* ValueGetList(Value* value) {
+  value->set_type(Value_Type_LIST);
+  return value->mutable_list();
+}
+
+Dictionary* ValueGetDict(Value* value) {
+  value->set_type(Value_Type_DICTIONARY);
+  return value->mutable_dictionary();
+}
+
+Value* DictAddValue(const char* key, Dictionary* dict) {
+  KeyValue* kv = dict->add_values();
+  kv->set_key(key);
+  return kv->mutable_value();
+}
+
+Value* DictAddValue(const std::string& key, Dictionary* dict) {
+  return DictAddValue(key.c_str(), dict);
+}
+
+Leaf* DictAddLeaf(const char* key, Dictionary* dict) {
+  return ValueGetLeaf(DictAddValue(key, dict));
+}
+
+Leaf* DictAddLeaf(const std::string& key, Dictionary* dict) {
+  return DictAddLeaf(key.c_str(), dict);
+}
+
+Dictionary* DictAddDict(const char* key, Dictionary* dict) {
+  return ValueGetDict(DictAddValue(key, dict));
+}
+
+Dictionary* DictAddDict(const std::string& key, Dictionary* dict) {
+  return DictAddDict(key.c_str(), dict);
+}
+
+void LeafSetInt(google::protobuf::int64 value, Leaf* leaf) {
+  leaf->set_type(Leaf_Type_INTEGER);
+  leaf->set_integer(value);
+}
+
+void LeafSetUInt(google::protobuf::uint64 value, Leaf* leaf) {
+  leaf->set_type(Leaf_Type_UNSIGNED_INTEGER);
+  leaf->set_unsigned_integer(value);
+}
+
+void LeafSetReal(double value, Leaf* leaf) {
+  leaf->set_type(Leaf_Type_REAL);
+  leaf->set_real(value);
+}
+
+std::string* LeafGetString(Leaf* leaf) {
+  leaf->set_type(Leaf_Type_STRING);
+  return leaf->mutable_string();
+}
+
+Address* LeafGetAddress(Leaf* leaf) {
+  leaf->set_type(Leaf_Type_ADDRESS);
+  return leaf->mutable_address();
+}
+
+StackTrace* LeafGetStackTrace(Leaf* leaf) {
+  leaf->set_type(Leaf_Type_STACK_TRACE);
+  return leaf->mutable_stack_trace();
+}
+
+Blob* LeafGetBlob(Leaf* leaf) {
+  leaf->set_type(Leaf_Type_BLOB);
+  return leaf->mutable_blob();
+}
+
+bool SerializeValueToBuffer(const Value& value,
+                            void* buffer,
+                            size_t buffer_size,
+                            size_t* bytes_written) {
+  // ByteSize also caches the sizes of all nested messages, as required by
+  // SerializeWithCachedSizesToArray. Neither performs any heap allocation.
+  size_t size = value.ByteSize();
+  if (size > buffer_size)
+    return false;
+  google::protobuf::uint8* cursor =
+      static_cast<google::protobuf::uint8*>(buffer);
+  cursor = value.SerializeWithCachedSizesToArray(cursor);
+  if (bytes_written != NULL)
+    *bytes_written = cursor - static_cast<google::protobuf::uint8*>(buffer);
+  return true;
+}
+
+}  // namespace crashdata
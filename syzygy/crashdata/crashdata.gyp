@@ -64,17 +64,18 @@
         '<(src)/third_party/protobuf/protobuf.gyp:protobuf_lite_lib',
       ],
     },
-    #{
-    #  'target_name': 'crashdata_unittests',
-    #  'type': 'executable',
-    #  'sources': [
-    #    '<(src)/base/test/run_all_unittests.cc',
-    #  ],
-    #  'dependencies': [
-    #    'crashdata_lib',
-    #    '<(src)/base/base.gyp:test_support_base',
-    #    '<(src)/testing/gtest.gyp:gtest',
-    #  ],
-    #},
+    {
+      'target_name': 'crashdata_unittests',
+      'type': 'executable',
+      'sources': [
+        'crashdata_unittest.cc',
+        '<(src)/base/test/run_all_unittests.cc',
+      ],
+      'dependencies': [
+        'crashdata_lib',
+        '<(src)/base/base.gyp:test_support_base',
+        '<(src)/testing/gtest.gyp:gtest',
+      ],
+    },
   ],
 }
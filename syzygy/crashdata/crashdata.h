@@ -17,11 +17,128 @@
 // type. Conceptually the entire structure is analogous to JSON, with a
 // few additional types for things that have special meaning in the context
 // of a crash.
+//
+// This also declares helper functions for building and serializing Value
+// trees. Crash data is typically collected in a compromised process, where
+// allocating from a potentially corrupt heap is both slow and dangerous.
+// The vendored protobuf runtime has no arena support, but protobuf messages
+// retain their allocations across Clear(): repeated fields keep their
+// cleared elements for reuse and strings keep their capacity. To collect
+// crash data without touching the heap at crash time, build a
+// maximally-sized tree with these helpers when reporting is initialized,
+// Clear() it, rebuild it in place on the crash path, and serialize it to a
+// preallocated buffer with SerializeValueToBuffer.
 
 #ifndef SYZYGY_CRASHDATA_CRASHDATA_H_
 #define SYZYGY_CRASHDATA_CRASHDATA_H_
 
+#include <string>
+
 // This is a simple wrapper to the automatically generated header file.
 #include "syzygy/crashdata/crashdata.pb.h"
 
+namespace crashdata {
+
+// @name Functions for initializing values.
+// @{
+
+// Makes the given value a leaf.
+// @param value the value to modify.
+// @returns the nested leaf object.
+Leaf* ValueGetLeaf(Value* value);
+
+// Makes the given value a list.
+// @param value the value to modify.
+// @returns the nested list object.
+List* ValueGetList(Value* value);
+
+// Makes the given value a dictionary.
+// @param value the value to modify.
+// @returns the nested dictionary object.
+Dictionary* ValueGetDict(Value* value);
+
+// @}
+
+// @name Functions for adding entries to a dictionary.
+// @{
+
+// Adds a value to a dictionary with the given key.
+// @param key the key of the value.
+// @param dict the dictionary to be modified.
+// @returns the added value.
+Value* DictAddValue(const char* key, Dictionary* dict);
+Value* DictAddValue(const std::string& key, Dictionary* dict);
+
+// Adds a value housing a leaf to a dictionary with the given key.
+// @param key the key of the value.
+// @param dict the dictionary to be modified.
+// @returns the leaf in the added value.
+Leaf* DictAddLeaf(const char* key, Dictionary* dict);
+Leaf* DictAddLeaf(const std::string& key, Dictionary* dict);
+
+// Adds a value housing a dictionary to a dictionary with the given key.
+// @param key the key of the value.
+// @param dict the dictionary to be modified.
+// @returns the dictionary in the added value.
+Dictionary* DictAddDict(const char* key, Dictionary* dict);
+Dictionary* DictAddDict(const std::string& key, Dictionary* dict);
+
+// @}
+
+// @name Functions for initializing leaves.
+// @{
+
+// Makes the given leaf an integer.
+// @param value the value of the integer.
+// @param leaf the leaf to modify.
+void LeafSetInt(google::protobuf::int64 value, Leaf* leaf);
+
+// Makes the given leaf an unsigned integer.
+// @param value the value of the unsigned integer.
+// @param leaf the leaf to modify.
+void LeafSetUInt(google::protobuf::uint64 value, Leaf* leaf);
+
+// Makes the given leaf a real.
+// @param value the value of the real.
+// @param leaf the leaf to modify.
+void LeafSetReal(double value, Leaf* leaf);
+
+// Makes the given leaf a string.
+// @param leaf the leaf to modify.
+// @returns the nested string object.
+std::string* LeafGetString(Leaf* leaf);
+
+// Makes the given leaf an address.
+// @param leaf the leaf to modify.
+// @returns the nested address object.
+Address* LeafGetAddress(Leaf* leaf);
+
+// Makes the given leaf a stack-trace.
+// @param leaf the leaf to modify.
+// @returns the nested stack-trace object.
+StackTrace* LeafGetStackTrace(Leaf* leaf);
+
+// Makes the given leaf a blob.
+// @param leaf the leaf to modify.
+// @returns the nested blob object.
+Blob* LeafGetBlob(Leaf* leaf);
+
+// @}
+
+// Serializes the given value to a preallocated buffer, performing no heap
+// allocations. Intended for use on the crash path, with a buffer that was
+// allocated when reporting was initialized.
+// @param value the value to serialize.
+// @param buffer the buffer to receive the serialized value.
+// @param buffer_size the size of @p buffer, in bytes.
+// @param bytes_written receives the number of bytes written to @p buffer.
+// @returns true on success, false if the serialized value does not fit in
+//     @p buffer.
+bool SerializeValueToBuffer(const Value& value,
+                            void* buffer,
+                            size_t buffer_size,
+                            size_t* bytes_written);
+
+}  // namespace crashdata
+
 #endif  // SYZYGY_CRASHDATA_CRASHDATA_H_
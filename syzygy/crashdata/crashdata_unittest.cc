@@ -0,0 +1,118 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/crashdata/crashdata.h"
+
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace crashdata {
+
+TEST(CrashDataTest, ValueGetLeaf) {
+  Value value;
+  Leaf* leaf = ValueGetLeaf(&value);
+  ASSERT_TRUE(leaf != NULL);
+  EXPECT_EQ(Value_Type_LEAF, value.type());
+  EXPECT_EQ(leaf, value.mutable_leaf());
+}
+
+TEST(CrashDataTest, ValueGetList) {
+  Value value;
+  List* list = ValueGetList(&value);
+  ASSERT_TRUE(list != NULL);
+  EXPECT_EQ(Value_Type_LIST, value.type());
+  EXPECT_EQ(list, value.mutable_list());
+}
+
+TEST(CrashDataTest, ValueGetDict) {
+  Value value;
+  Dictionary* dict = ValueGetDict(&value);
+  ASSERT_TRUE(dict != NULL);
+  EXPECT_EQ(Value_Type_DICTIONARY, value.type());
+  EXPECT_EQ(dict, value.mutable_dictionary());
+}
+
+TEST(CrashDataTest, BuildDictionary) {
+  Value value;
+  Dictionary* dict = ValueGetDict(&value);
+
+  LeafSetInt(-42, DictAddLeaf("int", dict));
+  LeafSetUInt(42, DictAddLeaf("uint", dict));
+  LeafSetReal(0.5, DictAddLeaf("real", dict));
+  *LeafGetString(DictAddLeaf("string", dict)) = "foo";
+  LeafGetAddress(DictAddLeaf("address", dict))->set_address(0xBAADF00D);
+  LeafGetStackTrace(DictAddLeaf("stack", dict))->add_frames(0xCAFEBABE);
+  Blob* blob = LeafGetBlob(DictAddLeaf("blob", dict));
+  blob->mutable_address()->set_address(0xAABBCCDD);
+  blob->set_size(1024);
+  DictAddDict("nested", dict);
+
+  ASSERT_EQ(8, dict->values_size());
+  EXPECT_EQ("int", dict->values(0).key());
+  EXPECT_EQ(-42, dict->values(0).value().leaf().integer());
+  EXPECT_EQ("string", dict->values(3).key());
+  EXPECT_EQ("foo", dict->values(3).value().leaf().string());
+  EXPECT_EQ(Value_Type_DICTIONARY, dict->values(7).value().type());
+}
+
+TEST(CrashDataTest, SerializeValueToBuffer) {
+  Value value;
+  Dictionary* dict = ValueGetDict(&value);
+  LeafSetUInt(42, DictAddLeaf("uint", dict));
+  *LeafGetString(DictAddLeaf("string", dict)) = "foo";
+
+  std::vector<char> buffer(1024);
+  size_t bytes_written = 0;
+  ASSERT_TRUE(SerializeValueToBuffer(value, &buffer[0], buffer.size(),
+                                     &bytes_written));
+  ASSERT_LT(0u, bytes_written);
+
+  // The serialized form should round-trip.
+  Value parsed;
+  ASSERT_TRUE(parsed.ParseFromArray(&buffer[0], bytes_written));
+  ASSERT_EQ(Value_Type_DICTIONARY, parsed.type());
+  ASSERT_EQ(2, parsed.dictionary().values_size());
+  EXPECT_EQ("foo", parsed.dictionary().values(1).value().leaf().string());
+}
+
+TEST(CrashDataTest, SerializeValueToBufferFailsWhenTooSmall) {
+  Value value;
+  *LeafGetString(ValueGetLeaf(&value)) = "a rather lengthy string";
+
+  char buffer[4] = {};
+  size_t bytes_written = 0;
+  EXPECT_FALSE(
+      SerializeValueToBuffer(value, buffer, sizeof(buffer), &bytes_written));
+}
+
+TEST(CrashDataTest, AllocationsAreReusedAfterClear) {
+  // The crash path relies on rebuilding a previously built (and cleared)
+  // tree without performing any heap allocations. Pointer stability of the
+  // nested messages across Clear() is what makes this possible.
+  Value value;
+  Dictionary* dict = ValueGetDict(&value);
+  Value* entry = DictAddValue("key", dict);
+  Leaf* leaf = ValueGetLeaf(entry);
+  std::string* string = LeafGetString(leaf);
+  *string = "a string of some significant length";
+
+  value.Clear();
+
+  EXPECT_EQ(dict, ValueGetDict(&value));
+  EXPECT_EQ(entry, DictAddValue("key", dict));
+  EXPECT_EQ(leaf, ValueGetLeaf(entry));
+  EXPECT_EQ(string, LeafGetString(leaf));
+}
+
+}  // namespace crashdata
@@ -53,10 +53,11 @@
 // enum has been changed and kEnumValueFoo now has value 1 and some other enum
 // kEnumValueBar has value 0. Then in terms of block content,
 // Foo<SomeEnum, Foo> and Foo<SomeEnum, Bar> will match across block-graphs.
-// However, in terms of decorated names they will not match. It is pretty
-// clear that in this case we prefer to match blocks by name. This pattern
-// is actually seen in WebKit code. This situation is handled if we give
-// priority to decorated names.
+// However, in terms of decorated names they will not match. Arguably we
+// would prefer to match blocks by name in this case; this pattern is
+// actually seen in WebKit code. Since exact content matches are resolved
+// first, the content match wins here. The mislabeling is benign for our
+// purposes: the matched blocks are bitwise identical.
 //
 // Similarly, the opposite situation is also possible. Imagine a templated
 // function that generates identical code regardless of the type that is
@@ -67,6 +68,13 @@
 // made the cut. In this case, a match will be made based on identical code
 // content. This situation is handled regardless of the feature that is
 // given priority.
+//
+// Matching runs in two phases. First, the blocks are hashed (the hashes are
+// computed on several worker threads) and all exact content matches are
+// resolved, propagating matches through the reference graph as they are
+// found. Only the blocks left unresolved by this phase - the changed
+// neighborhoods of the binary - are then indexed by the more expensive
+// similarity features.
 
 #include "syzygy/experimental/compare/compare.h"
 
@@ -74,6 +82,9 @@
 
 #include "base/logging.h"
 #include "base/md5.h"
+#include "base/memory/scoped_vector.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/block_hash.h"
 #include "syzygy/common/comparable.h"
 #include "syzygy/experimental/compare/block_compare.h"
@@ -92,11 +103,10 @@ const size_t kInvalidIndex = -1;
 // value for the given feature, the blocks are assumed to be the same. We
 // currently use two features: block hash, and block name.
 //
-// The order of these features indicates the order of priority for making
-// matches. For example, it is possible that feature 0 wants to match block
-// A with match B, but that feature 1 wants to match block A with block C. In
-// this case, A will be matched with B and an informational warning will be
-// printed about the conflicting A/C match.
+// The features are processed in phases: the hash feature runs first as an
+// exact-match pass, and later features only index the blocks the earlier
+// phases left unmapped. If a later feature wants to match a block that was
+// already matched by an earlier phase, the earlier match has precedence.
 enum BlockFeatures {
   kNameFeature,
   kHashFeature,
@@ -153,6 +163,45 @@ class BlockFeature {
   DISALLOW_COPY_AND_ASSIGN(BlockFeature);
 };
 
+// A worker that initializes the feature metadata of every stride'th block,
+// starting at block worker_index. The workers touch disjoint metadata
+// records, so no locking is required.
+class InitMetadataWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  InitMetadataWorker(const BlockFeature& block_feature,
+                     std::vector<BlockMetadata*>* metadata,
+                     size_t worker_index,
+                     size_t stride)
+      : block_feature_(block_feature),
+        metadata_(metadata),
+        worker_index_(worker_index),
+        stride_(stride),
+        success_(false) {
+    DCHECK(metadata != NULL);
+    DCHECK_LT(worker_index, stride);
+  }
+
+  virtual void Run() OVERRIDE {
+    for (size_t i = worker_index_; i < metadata_->size(); i += stride_) {
+      if (!block_feature_.InitMetadata(metadata_->at(i)))
+        return;
+    }
+    success_ = true;
+  }
+
+  // Returns true iff the worker initialized all of its metadata records.
+  bool success() const { return success_; }
+
+ private:
+  const BlockFeature& block_feature_;
+  std::vector<BlockMetadata*>* metadata_;
+  size_t worker_index_;
+  size_t stride_;
+  bool success_;
+
+  DISALLOW_COPY_AND_ASSIGN(InitMetadataWorker);
+};
+
 // This is the generic data structure for an index over some feature of a
 // block.
 class FeatureIndex {
@@ -163,10 +212,13 @@ class FeatureIndex {
   static const BlockGraph::BlockAttributes kIgnoredAttributes =
     BlockGraph::PADDING_BLOCK;
 
-  // Initializes this feature index over the provided block graphs.
+  // Initializes this feature index over the provided block graphs. If
+  // @p resolved is non-NULL, blocks that it has already mapped are excluded
+  // from this index.
   FeatureIndex(const BlockFeature& block_feature,
                const BlockGraph& block_graph0,
-               const BlockGraph& block_graph1);
+               const BlockGraph& block_graph1,
+               const FeatureIndex* resolved);
 
   // This returns the number of unique features in the graph. (The number of
   // unique buckets the blocks were able to be split up into.)
@@ -249,11 +301,13 @@ class FeatureIndex {
     size_t feature_bucket0 = MapBlock(block0, 0);
     size_t feature_bucket1 = MapBlock(block1, 1);
 
-    if (ExistUniqueBlocks(feature_bucket0)) {
+    if (feature_bucket0 != kInvalidFeatureBucket &&
+        ExistUniqueBlocks(feature_bucket0)) {
       *unique_feature_bucket0 = feature_bucket0;
     }
 
-    if (feature_bucket0 != feature_bucket1 &&
+    if (feature_bucket1 != kInvalidFeatureBucket &&
+        feature_bucket0 != feature_bucket1 &&
         ExistUniqueBlocks(feature_bucket1)) {
       *unique_feature_bucket1 = feature_bucket1;
     }
@@ -294,10 +348,11 @@ class FeatureIndex {
   }
 
   // Populates block_infos_ and block_metadata_ with the blocks from the
-  // given BlockGraph.
+  // given BlockGraph. Blocks already mapped in @p resolved are skipped.
   bool AddBlocks(const BlockFeature& block_feature,
                  size_t block_graph_index,
-                 const BlockGraph& block_graph) {
+                 const BlockGraph& block_graph,
+                 const FeatureIndex* resolved) {
     DCHECK(block_graph_index == 0 || block_graph_index == 1);
 
     BlockGraph::BlockMap::const_iterator block_it =
@@ -308,6 +363,11 @@ class FeatureIndex {
       if (block->attributes() & kIgnoredAttributes)
         continue;
 
+      // Blocks that an earlier phase has already resolved need not be
+      // indexed again.
+      if (resolved != NULL && resolved->BlockIsMapped(block))
+        continue;
+
       // Ensure that an entry exists in block_metadata_.
       BlockMetadataMap::iterator metadata_it = block_metadata_.find(block);
       if (metadata_it == block_metadata_.end()) {
@@ -317,11 +377,8 @@ class FeatureIndex {
             std::make_pair(block, metadata)).first;
       }
 
-      // Initialize any metadata for this feature.
-      if (!block_feature.InitMetadata(&metadata_it->second))
-        return false;
-
-      // Add this block to block_infos_.
+      // Add this block to block_infos_. The metadata for this feature is
+      // initialized later, in InitAllMetadata.
       BlockInfo block_info(&metadata_it->second,
                            block_graph_index,
                            block_feature.id());
@@ -331,6 +388,44 @@ class FeatureIndex {
     return true;
   }
 
+  // Initializes the feature metadata of every block in the index, fanning
+  // the CPU-bound work (hashing, name normalization) out across worker
+  // threads. With a single thread the work is done inline to avoid the
+  // thread start/join overhead.
+  bool InitAllMetadata(const BlockFeature& block_feature) {
+    std::vector<BlockMetadata*> metadata;
+    metadata.reserve(block_infos_.size());
+    for (size_t i = 0; i < block_infos_.size(); ++i)
+      metadata.push_back(block_infos_[i].metadata);
+
+    size_t num_workers = std::min(
+        static_cast<size_t>(base::SysInfo::NumberOfProcessors()),
+        metadata.size());
+    if (num_workers <= 1) {
+      for (size_t i = 0; i < metadata.size(); ++i) {
+        if (!block_feature.InitMetadata(metadata[i]))
+          return false;
+      }
+      return true;
+    }
+
+    ScopedVector<InitMetadataWorker> workers;
+    ScopedVector<base::DelegateSimpleThread> threads;
+    for (size_t i = 0; i < num_workers; ++i) {
+      workers.push_back(
+          new InitMetadataWorker(block_feature, &metadata, i, num_workers));
+      threads.push_back(new base::DelegateSimpleThread(
+          workers.back(), "CompareMetadataWorker"));
+      threads.back()->Start();
+    }
+    bool success = true;
+    for (size_t i = 0; i < num_workers; ++i) {
+      threads[i]->Join();
+      success = success && workers[i]->success();
+    }
+    return success;
+  }
+
   // Maps the given block, returning its feature bucket.
   size_t MapBlock(const BlockGraph::Block* block,
                   size_t block_graph_index) {
@@ -343,6 +438,11 @@ class FeatureIndex {
     DCHECK_EQ(block, metadata.block);
 
     size_t index = metadata.feature_index[feature_id_];
+    if (index == kInvalidIndex) {
+      // The block is not part of this index; an earlier phase resolved it
+      // before this index was built.
+      return kInvalidFeatureBucket;
+    }
     DCHECK_GT(block_infos_.size(), index);
     BlockInfo& block_info = block_infos_[index];
     DCHECK_EQ(&metadata, block_info.metadata);
@@ -435,18 +535,27 @@ FeatureIndex::BlockMetadataMap FeatureIndex::block_metadata_;
 
 FeatureIndex::FeatureIndex(const BlockFeature& block_feature,
                            const BlockGraph& block_graph0,
-                           const BlockGraph& block_graph1)
+                           const BlockGraph& block_graph1,
+                           const FeatureIndex* resolved)
     : feature_id_(block_feature.id()) {
   // Nothing to do if the block graphs are both empty!
   if (block_graph0.blocks().empty() && block_graph1.blocks().empty())
     return;
 
-  // Add the blocks to block_infos_, and initialize metadata.
+  // Add the blocks to block_infos_.
   block_infos_.reserve(block_graph0.blocks().size() +
       block_graph1.blocks().size());
-  if (!AddBlocks(block_feature, 0, block_graph0))
+  if (!AddBlocks(block_feature, 0, block_graph0, resolved))
+    return;
+  if (!AddBlocks(block_feature, 1, block_graph1, resolved))
     return;
-  if (!AddBlocks(block_feature, 1, block_graph1))
+
+  // An earlier phase may have resolved every block.
+  if (block_infos_.empty())
+    return;
+
+  // Initialize the metadata, using worker threads for the heavy lifting.
+  if (!InitAllMetadata(block_feature))
     return;
 
   // Sort block_infos_.
@@ -496,6 +605,9 @@ FeatureIndex::FeatureIndex(const BlockFeature& block_feature,
   BlockMetadataMap::const_iterator it = block_metadata_.begin();
   for (; it != block_metadata_.end(); ++it) {
     size_t index = it->second.feature_index[feature_id_];
+    // Blocks resolved by an earlier phase are not part of this index.
+    if (index == kInvalidIndex)
+      continue;
     DCHECK_GT(block_infos_.size(), index);
   }
 #endif
@@ -508,7 +620,10 @@ class BlockHashFeature : public BlockFeature {
 
   virtual bool InitMetadata(BlockMetadata* metadata) const {
     DCHECK(metadata != NULL);
-    metadata->block_hash.Hash(metadata->block);
+    // The fast fingerprint is an order of magnitude cheaper to compute than
+    // MD5, and collisions are benign here: ties are broken by a full content
+    // compare below.
+    metadata->block_hash.Hash(metadata->block, block_graph::kBlockHashFast);
     return true;
   }
 
@@ -607,6 +722,11 @@ class BlockGraphMapper {
   bool ScheduleMapping(const BlockGraph::Block* block0,
                        const BlockGraph::Block* block1);
 
+  // Schedules a mapping for every bucket of the given feature that holds a
+  // unique block from each block-graph, then drains the queue of pending
+  // mappings, propagating matches through the reference graph.
+  bool MapUniqueBuckets(size_t feature_id);
+
   // Maps the blocks in the given bucket of the given feature. They must be
   // unique.
   bool ScheduleUniqueBucketMapping(size_t feature_id,
@@ -644,27 +764,54 @@ bool BlockGraphMapper::BuildMapping(const BlockGraph& bg0,
   mapping_ = mapping;
   mapping_->clear();
 
-  // Build the feature indices.
+  // Phase 1: exact matching. Build the hash index (the hashes themselves
+  // are computed on worker threads) and resolve every bucket that pairs a
+  // unique block from each block-graph.
   BlockHashFeature hash_feature;
   feature_indices_[kHashFeature].reset(
-      new FeatureIndex(hash_feature, bg0, bg1));
+      new FeatureIndex(hash_feature, bg0, bg1, NULL));
+  if (!MapUniqueBuckets(kHashFeature))
+    return false;
+
 #ifdef USE_BLOCK_NAME_FEATURE
+  // Phase 2: similarity matching. Only the blocks left unresolved by the
+  // exact phase - the changed neighborhoods of the binary - are indexed by
+  // name, keeping the expensive feature small.
   BlockNameFeature name_feature;
   feature_indices_[kNameFeature].reset(
-      new FeatureIndex(name_feature, bg0, bg1));
+      new FeatureIndex(name_feature, bg0, bg1,
+                       feature_indices_[kHashFeature].get()));
+  if (!MapUniqueBuckets(kNameFeature))
+    return false;
 #endif
 
-  // Iterate through each index.
-  for (size_t i = 0; i < kFeatureCount; ++i) {
-    // Iterate through the unique feature values. For every feature value we
-    // find that contains only a single block per block-graph, we can infer that
-    // these blocks are identical. Use these as a root for matching up blocks.
-    for (size_t j = 0; j < feature_indices_[i]->size(); ++j) {
-      if (feature_indices_[i]->ExistUniqueBlocks(j)) {
-        if (!ScheduleUniqueBucketMapping(i, j)) {
-          return false;
-        }
-      }
+  DCHECK(pending_.empty());
+  DCHECK(pending_reverse_.empty());
+
+  // Forget the mapping output variable.
+  mapping_ = NULL;
+
+  // If provided, fill out the list of unmapped blocks. The hash index is
+  // used as it covers every block.
+  if (unmapped0 != NULL)
+    feature_indices_[kHashFeature]->GetUnmappedBlocks(0, unmapped0);
+  if (unmapped1 != NULL)
+    feature_indices_[kHashFeature]->GetUnmappedBlocks(1, unmapped1);
+
+  return true;
+}
+
+bool BlockGraphMapper::MapUniqueBuckets(size_t feature_id) {
+  DCHECK_GT(static_cast<size_t>(kFeatureCount), feature_id);
+  DCHECK(feature_indices_[feature_id].get() != NULL);
+
+  // Iterate through the unique feature values. For every feature value we
+  // find that contains only a single block per block-graph, we can infer that
+  // these blocks are identical. Use these as a root for matching up blocks.
+  for (size_t i = 0; i < feature_indices_[feature_id]->size(); ++i) {
+    if (feature_indices_[feature_id]->ExistUniqueBlocks(i)) {
+      if (!ScheduleUniqueBucketMapping(feature_id, i))
+        return false;
     }
   }
 
@@ -678,26 +825,16 @@ bool BlockGraphMapper::BuildMapping(const BlockGraph& bg0,
     if (!MapBlocks(block0, block1))
       return false;
   }
-  DCHECK(pending_.empty());
-  DCHECK(pending_reverse_.empty());
-
-  // Forget the mapping output variable.
-  mapping_ = NULL;
-
-  // If provided, fill out the list of unmapped blocks.
-  if (unmapped0 != NULL)
-    feature_indices_[0]->GetUnmappedBlocks(0, unmapped0);
-  if (unmapped1 != NULL)
-    feature_indices_[0]->GetUnmappedBlocks(1, unmapped1);
 
   return true;
 }
 
 bool BlockGraphMapper::ScheduleMapping(const BlockGraph::Block* block0,
                                        const BlockGraph::Block* block1) {
-  // Neither block should yet be mapped.
-  DCHECK(!feature_indices_[0]->BlockIsMapped(block0));
-  DCHECK(!feature_indices_[0]->BlockIsMapped(block1));
+  // Neither block should yet be mapped. The hash index is used for the
+  // check as it covers every block.
+  DCHECK(!feature_indices_[kHashFeature]->BlockIsMapped(block0));
+  DCHECK(!feature_indices_[kHashFeature]->BlockIsMapped(block1));
 
   // Use the pending_ and pending_reverse_ to ensure that neither of these
   // blocks are already scheduled for mapping. If they are, then we ignore
@@ -778,6 +915,10 @@ bool BlockGraphMapper::MapBlocks(const BlockGraph::Block* block0,
   // Map the blocks in each feature. If the mapping causes any other feature
   // buckets to become unique, pursue those as well.
   for (size_t i = 0; i < kFeatureCount; ++i) {
+    // Indices for later phases may not have been built yet.
+    if (feature_indices_[i].get() == NULL)
+      continue;
+
     size_t unique_bucket0 = FeatureIndex::kInvalidFeatureBucket;
     size_t unique_bucket1 = FeatureIndex::kInvalidFeatureBucket;
     feature_indices_[i]->MarkAsMapped(block0, block1,
@@ -884,8 +1025,8 @@ bool BlockGraphMapper::ScheduleReferrerMappings(const BlockGraph::Block* block0,
 bool BlockGraphMapper::ScheduleIfUnmapped(const BlockGraph::Block* block0,
                                           const BlockGraph::Block* block1) {
   // Schedule the blocks for mapping if they arent
-  if (feature_indices_[0]->BlockIsMapped(block0) ||
-      feature_indices_[0]->BlockIsMapped(block1))
+  if (feature_indices_[kHashFeature]->BlockIsMapped(block0) ||
+      feature_indices_[kHashFeature]->BlockIsMapped(block1))
     return true;
 
   return ScheduleMapping(block0, block1);
@@ -26,6 +26,8 @@
         'compare.cc',
         'compare.h',
         'compare.rc',
+        'image_patch.cc',
+        'image_patch.h',
         'compare_main.cc',
       ],
       'dependencies': [
@@ -26,6 +26,7 @@
 #include "syzygy/common/syzygy_version.h"
 #include "syzygy/core/serialization.h"
 #include "syzygy/experimental/compare/compare.h"
+#include "syzygy/experimental/compare/image_patch.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/pe/serialization.h"
@@ -48,7 +49,11 @@ int Usage(char** argv, const char* message) {
       "\n"
       "Required parameters\n"
       "  --from=<bg file>\n"
-      "  --to=<bg file>\n";
+      "  --to=<bg file>\n"
+      "Optional parameters\n"
+      "  --patch-output=<patch file>\n"
+      "    Writes a minimal patch transforming the 'from' image into the\n"
+      "    'to' image: changed blocks, moved blocks and reference fixups.\n";
 
   return 1;
 }
@@ -164,6 +169,43 @@ void GetMappingStats(const BlockGraphMapping& mapping,
   }
 }
 
+// Builds the patch transforming the 'from' image into the 'to' image and
+// writes it to the given path.
+bool WritePatch(const pe::ImageLayout& image_layout_from,
+                const pe::ImageLayout& image_layout_to,
+                const BlockGraphMapping& mapping,
+                const base::FilePath& patch_path) {
+  experimental::ImagePatch patch;
+  if (!patch.Build(image_layout_from, image_layout_to, mapping)) {
+    LOG(ERROR) << "Failed to build image patch.";
+    return false;
+  }
+
+  size_t data_bytes = 0;
+  for (size_t i = 0; i < patch.data().size(); ++i)
+    data_bytes += patch.data()[i].data.size();
+  LOG(INFO) << "Patch contains " << patch.data().size()
+            << " changed block(s) (" << data_bytes << " bytes), "
+            << patch.copies().size() << " moved block(s) and "
+            << patch.fixups().size() << " reference fixup(s).";
+
+  base::ScopedFILE patch_file(base::OpenFile(patch_path, "wb"));
+  if (patch_file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << patch_path.value()
+               << "\" for writing.";
+    return false;
+  }
+
+  core::FileOutStream out_stream(patch_file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  if (!out_archive.Save(patch) || !out_archive.Flush()) {
+    LOG(ERROR) << "Failed to write image patch.";
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -221,6 +263,13 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  base::FilePath patch_path = cmd_line->GetSwitchValuePath("patch-output");
+  if (!patch_path.empty()) {
+    LOG(INFO) << "Generating image patch.";
+    if (!WritePatch(image_layout_from, image_layout_to, mapping, patch_path))
+      return 1;
+  }
+
   LOG(INFO) << "Analyzing mapping.";
   BlockStats stats_from;
   BlockStats stats_to;
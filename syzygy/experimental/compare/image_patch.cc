@@ -0,0 +1,268 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/experimental/compare/image_patch.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace experimental {
+
+namespace {
+
+using block_graph::BlockGraph;
+using core::RelativeAddress;
+
+const uint32 kImagePatchMagic = 0x50415A53;  // Appears as "SZAP" on disk.
+const uint32 kImagePatchVersion = 1;
+
+// Determines whether two matched blocks have the same contents outside of
+// the bytes covered by their references. Reference bytes are excluded as
+// they are recomputed at write time and are patched via fixups; if the
+// reference layouts of the two blocks disagree the blocks are considered
+// changed wholesale.
+bool SameNonReferenceBytes(const BlockGraph::Block* from_block,
+                           const BlockGraph::Block* to_block) {
+  DCHECK(from_block != NULL);
+  DCHECK(to_block != NULL);
+
+  if (from_block->size() != to_block->size() ||
+      from_block->data_size() != to_block->data_size() ||
+      from_block->references().size() != to_block->references().size()) {
+    return false;
+  }
+
+  size_t data_size = to_block->data_size();
+  if (data_size == 0)
+    return true;
+
+  const uint8* from_data = from_block->data();
+  const uint8* to_data = to_block->data();
+  size_t pos = 0;
+
+  BlockGraph::Block::ReferenceMap::const_iterator from_it =
+      from_block->references().begin();
+  BlockGraph::Block::ReferenceMap::const_iterator to_it =
+      to_block->references().begin();
+  for (; to_it != to_block->references().end(); ++from_it, ++to_it) {
+    if (from_it->first != to_it->first ||
+        from_it->second.size() != to_it->second.size()) {
+      return false;
+    }
+
+    size_t ref_start = std::min(data_size, static_cast<size_t>(to_it->first));
+    if (pos < ref_start &&
+        ::memcmp(from_data + pos, to_data + pos, ref_start - pos) != 0) {
+      return false;
+    }
+    pos = std::min(data_size, ref_start + to_it->second.size());
+  }
+
+  if (pos < data_size &&
+      ::memcmp(from_data + pos, to_data + pos, data_size - pos) != 0) {
+    return false;
+  }
+
+  return true;
+}
+
+// Determines whether a reference encodes to the same bytes in both images.
+// PC-relative references encode the distance from the end of the reference
+// to the target, so they are only stable if that distance is preserved; all
+// other reference types encode some fixed function of the target address.
+bool ReferenceEncodingUnchanged(BlockGraph::ReferenceType type,
+                                RelativeAddress from_location,
+                                RelativeAddress from_target,
+                                RelativeAddress to_location,
+                                RelativeAddress to_target) {
+  if ((type & ~BlockGraph::RELOC_REF_BIT) == BlockGraph::PC_RELATIVE_REF)
+    return to_target - to_location == from_target - from_location;
+  return from_target == to_target;
+}
+
+}  // namespace
+
+bool PatchData::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(address) && out_archive->Save(data);
+}
+
+bool PatchData::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+  return in_archive->Load(&address) && in_archive->Load(&data);
+}
+
+bool PatchCopy::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(from_address) &&
+      out_archive->Save(to_address) &&
+      out_archive->Save(size);
+}
+
+bool PatchCopy::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+  return in_archive->Load(&from_address) &&
+      in_archive->Load(&to_address) &&
+      in_archive->Load(&size);
+}
+
+bool PatchReferenceFixup::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(address) &&
+      out_archive->Save(type) &&
+      out_archive->Save(size) &&
+      out_archive->Save(target);
+}
+
+bool PatchReferenceFixup::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+  return in_archive->Load(&address) &&
+      in_archive->Load(&type) &&
+      in_archive->Load(&size) &&
+      in_archive->Load(&target);
+}
+
+bool ImagePatch::Build(const pe::ImageLayout& from_layout,
+                       const pe::ImageLayout& to_layout,
+                       const BlockGraphMapping& mapping) {
+  data_.clear();
+  copies_.clear();
+  fixups_.clear();
+
+  // Map the blocks of the new image back to their counterparts in the old
+  // one.
+  BlockGraphMapping reverse_mapping;
+  if (!ReverseBlockGraphMapping(mapping, &reverse_mapping))
+    return false;
+
+  BlockGraph::AddressSpace::RangeMapConstIter block_it =
+      to_layout.blocks.begin();
+  for (; block_it != to_layout.blocks.end(); ++block_it) {
+    const BlockGraph::Block* to_block = block_it->second;
+    RelativeAddress to_addr = block_it->first.start();
+
+    // Look up the old-image counterpart of this block, if any.
+    const BlockGraph::Block* from_block = NULL;
+    RelativeAddress from_addr;
+    BlockGraphMapping::const_iterator mapped =
+        reverse_mapping.find(to_block);
+    if (mapped != reverse_mapping.end() &&
+        from_layout.blocks.GetAddressOf(mapped->second, &from_addr)) {
+      from_block = mapped->second;
+    }
+
+    // Decide how the block body travels. New and changed blocks are shipped
+    // wholesale; unchanged blocks that moved are copied from their old
+    // location; unchanged blocks in place need no bytes at all.
+    bool shipped = from_block == NULL ||
+        !SameNonReferenceBytes(from_block, to_block);
+    if (shipped) {
+      if (to_block->data_size() != 0) {
+        data_.push_back(PatchData());
+        data_.back().address = to_addr;
+        data_.back().data.assign(to_block->data(),
+                                 to_block->data() + to_block->data_size());
+      }
+    } else if (from_addr != to_addr && to_block->data_size() != 0) {
+      PatchCopy copy = {};
+      copy.from_address = from_addr;
+      copy.to_address = to_addr;
+      copy.size = to_block->data_size();
+      copies_.push_back(copy);
+    }
+
+    // Emit fixups for references. The raw bytes shipped above carry whatever
+    // reference encodings the decomposition held, which are not
+    // authoritative, so every reference of a shipped block is fixed up; for
+    // stable blocks only references whose encodings changed are.
+    BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+        to_block->references().begin();
+    for (; ref_it != to_block->references().end(); ++ref_it) {
+      const BlockGraph::Reference& to_ref = ref_it->second;
+      RelativeAddress to_target;
+      if (!to_layout.blocks.GetAddressOf(to_ref.referenced(), &to_target)) {
+        LOG(ERROR) << "Reference target block \""
+                   << to_ref.referenced()->name()
+                   << "\" has no address in the new image.";
+        return false;
+      }
+      to_target += to_ref.offset();
+      RelativeAddress to_location = to_addr + ref_it->first;
+
+      if (!shipped) {
+        // The reference layouts of stable blocks agree, so the old block has
+        // a reference of the same size at the same offset.
+        const BlockGraph::Reference& from_ref =
+            from_block->references().find(ref_it->first)->second;
+        RelativeAddress from_target;
+        if (from_ref.type() == to_ref.type() &&
+            from_layout.blocks.GetAddressOf(from_ref.referenced(),
+                                            &from_target)) {
+          from_target += from_ref.offset();
+          if (ReferenceEncodingUnchanged(to_ref.type(),
+                                         from_addr + ref_it->first,
+                                         from_target,
+                                         to_location,
+                                         to_target)) {
+            continue;
+          }
+        }
+      }
+
+      PatchReferenceFixup fixup = {};
+      fixup.address = to_location;
+      fixup.type = static_cast<uint8>(to_ref.type());
+      fixup.size = static_cast<uint8>(to_ref.size());
+      fixup.target = to_target;
+      fixups_.push_back(fixup);
+    }
+  }
+
+  return true;
+}
+
+bool ImagePatch::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(kImagePatchMagic) &&
+      out_archive->Save(kImagePatchVersion) &&
+      out_archive->Save(data_) &&
+      out_archive->Save(copies_) &&
+      out_archive->Save(fixups_);
+}
+
+bool ImagePatch::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+
+  uint32 magic = 0;
+  uint32 version = 0;
+  if (!in_archive->Load(&magic) || !in_archive->Load(&version)) {
+    LOG(ERROR) << "Failed to load image patch header.";
+    return false;
+  }
+  if (magic != kImagePatchMagic) {
+    LOG(ERROR) << "Not an image patch file.";
+    return false;
+  }
+  if (version != kImagePatchVersion) {
+    LOG(ERROR) << "Unsupported image patch version " << version << ".";
+    return false;
+  }
+
+  return in_archive->Load(&data_) &&
+      in_archive->Load(&copies_) &&
+      in_archive->Load(&fixups_);
+}
+
+}  // namespace experimental
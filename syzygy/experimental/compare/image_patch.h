@@ -0,0 +1,118 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares ImagePatch, a minimal-delta description of how to bring a
+// previously deployed image up to date with a newly produced one. The patch
+// is computed from a block graph mapping built by BuildBlockGraphMapping
+// over decompositions of the two images. Blocks whose contents changed (or
+// that are new) are shipped wholesale, blocks that only moved are expressed
+// as copies from the old image, and references whose encodings changed are
+// shipped as small fixups rather than dragging in their whole blocks.
+
+#ifndef SYZYGY_EXPERIMENTAL_COMPARE_IMAGE_PATCH_H_
+#define SYZYGY_EXPERIMENTAL_COMPARE_IMAGE_PATCH_H_
+
+#include <vector>
+
+#include "syzygy/core/serialization.h"
+#include "syzygy/experimental/compare/compare.h"
+#include "syzygy/pe/image_layout.h"
+
+namespace experimental {
+
+// A run of raw bytes to be written at a given address of the new image.
+struct PatchData {
+  // Serialization functions.
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+
+  // Where the bytes land in the new image.
+  core::RelativeAddress address;
+  // The bytes themselves.
+  std::vector<uint8> data;
+};
+
+// A run of bytes to be copied from the old image to the new image. These
+// express blocks whose contents are unchanged but that moved during layout.
+struct PatchCopy {
+  // Serialization functions.
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+
+  // Where the bytes come from in the old image.
+  core::RelativeAddress from_address;
+  // Where the bytes land in the new image.
+  core::RelativeAddress to_address;
+  // The number of bytes to copy.
+  uint32 size;
+};
+
+// A reference whose value must be recomputed in the new image. The applier
+// writes the encoding of @p target appropriate to the reference type (adding
+// the image base for absolute references, making the value relative to the
+// end of the reference for PC-relative ones, and so on) at @p address.
+struct PatchReferenceFixup {
+  // Serialization functions.
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+
+  // The address of the reference in the new image.
+  core::RelativeAddress address;
+  // The BlockGraph::ReferenceType of the reference.
+  uint8 type;
+  // The width of the reference, in bytes.
+  uint8 size;
+  // The address being referred to in the new image.
+  core::RelativeAddress target;
+};
+
+// Houses the minimal set of writes needed to transform one image into
+// another, as computed from decompositions of the two.
+class ImagePatch {
+ public:
+  // Builds this patch from the decompositions of the two images.
+  // @param from_layout the layout of the image being patched.
+  // @param to_layout the layout of the image to be produced.
+  // @param mapping the block graph mapping from the blocks of
+  //     @p from_layout to those of @p to_layout, as built by
+  //     BuildBlockGraphMapping.
+  // @returns true on success, false otherwise.
+  bool Build(const pe::ImageLayout& from_layout,
+             const pe::ImageLayout& to_layout,
+             const BlockGraphMapping& mapping);
+
+  // Serialization functions. These wrap the patch in a magic number and a
+  // version so that stale patch files are rejected on load.
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+
+  // Accessors.
+  // @{
+  const std::vector<PatchData>& data() const { return data_; }
+  const std::vector<PatchCopy>& copies() const { return copies_; }
+  const std::vector<PatchReferenceFixup>& fixups() const { return fixups_; }
+  // @}
+
+ private:
+  // The runs of new bytes to write.
+  std::vector<PatchData> data_;
+  // The runs of unchanged bytes that moved.
+  std::vector<PatchCopy> copies_;
+  // The references to recompute.
+  std::vector<PatchReferenceFixup> fixups_;
+};
+
+}  // namespace experimental
+
+#endif  // SYZYGY_EXPERIMENTAL_COMPARE_IMAGE_PATCH_H_
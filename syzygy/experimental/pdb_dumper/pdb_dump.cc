@@ -24,6 +24,7 @@
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
@@ -31,6 +32,7 @@
 #include "syzygy/experimental/pdb_dumper/pdb_dump_util.h"
 #include "syzygy/experimental/pdb_dumper/pdb_module_info_stream_dumper.h"
 #include "syzygy/experimental/pdb_dumper/pdb_symbol_record_dumper.h"
+#include "syzygy/experimental/pdb_dumper/pdb_type_info_index.h"
 #include "syzygy/experimental/pdb_dumper/pdb_type_info_stream_dumper.h"
 #include "syzygy/pdb/pdb_dbi_stream.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -55,6 +57,38 @@ bool ReadNameStream(PdbStream* stream, OffsetStringMap* index_strings) {
                          index_strings);
 }
 
+// Reads the single symbol record starting at @p offset of @p stream and
+// appends it to @p symbol_vector.
+bool ReadSymbolRecordAt(PdbStream* stream,
+                        size_t offset,
+                        SymbolRecordVector* symbol_vector) {
+  DCHECK(stream != NULL);
+  DCHECK(symbol_vector != NULL);
+
+  if (!stream->Seek(offset)) {
+    LOG(ERROR) << "Unable to seek to symbol record at offset "
+               << base::StringPrintf("0x%08X.", offset);
+    return false;
+  }
+  uint16 len = 0;
+  uint16 symbol_type = 0;
+  if (!stream->Read(&len, 1)) {
+    LOG(ERROR) << "Unable to read a symbol record length.";
+    return false;
+  }
+  if (!stream->Read(&symbol_type, 1)) {
+    LOG(ERROR) << "Unable to read a symbol record type.";
+    return false;
+  }
+  SymbolRecord sym_record;
+  sym_record.type = symbol_type;
+  sym_record.start_position = stream->pos();
+  sym_record.len = len - sizeof(symbol_type);
+  symbol_vector->push_back(sym_record);
+
+  return true;
+}
+
 bool WriteStreamToPath(PdbStream* pdb_stream,
                        const base::FilePath& output_file_name) {
   // Open the file for output.
@@ -201,7 +235,15 @@ const char kUsage[] =
     "       that this can take a long time as there may be many of these\n"
     "       streams.\n"
     "    --explode-streams if provided, each PDB file's streams will be\n"
-    "       exploded into a directory named '<PDB file>.streams'\n";
+    "       exploded into a directory named '<PDB file>.streams'\n"
+    "    --type-id=<id> if provided, only the type info record with this id\n"
+    "       will be dumped. Only the stream prefix up to that record is\n"
+    "       read. Implies --dump-type-info.\n"
+    "    --symbol-offset=<offset> if provided, only the symbol record at\n"
+    "       this offset of the symbol record stream will be dumped. Implies\n"
+    "       --dump-symbol-records.\n"
+    "    --module=<index> if provided, only the module stream with this\n"
+    "       index will be dumped. Implies --dump-modules.\n";
 
 }  // namespace
 
@@ -210,7 +252,13 @@ PdbDumpApp::PdbDumpApp()
       explode_streams_(false),
       dump_symbol_record_(false),
       dump_type_info_(false),
-      dump_modules_(false) {
+      dump_modules_(false),
+      dump_single_type_(false),
+      type_id_(0),
+      dump_single_symbol_(false),
+      symbol_offset_(0),
+      dump_single_module_(false),
+      module_index_(0) {
 }
 
 bool PdbDumpApp::ParseCommandLine(const CommandLine* command_line) {
@@ -221,6 +269,37 @@ bool PdbDumpApp::ParseCommandLine(const CommandLine* command_line) {
   dump_type_info_ = command_line->HasSwitch("dump-type-info");
   dump_modules_ = command_line->HasSwitch("dump-modules");
 
+  int value = 0;
+  if (command_line->HasSwitch("type-id")) {
+    if (!base::StringToInt(command_line->GetSwitchValueASCII("type-id"),
+                           &value) || value < 0) {
+      return Usage("Invalid value for --type-id.");
+    }
+    dump_single_type_ = true;
+    dump_type_info_ = true;
+    type_id_ = value;
+  }
+
+  if (command_line->HasSwitch("symbol-offset")) {
+    if (!base::StringToInt(command_line->GetSwitchValueASCII("symbol-offset"),
+                           &value) || value < 0) {
+      return Usage("Invalid value for --symbol-offset.");
+    }
+    dump_single_symbol_ = true;
+    dump_symbol_record_ = true;
+    symbol_offset_ = value;
+  }
+
+  if (command_line->HasSwitch("module")) {
+    if (!base::StringToInt(command_line->GetSwitchValueASCII("module"),
+                           &value) || value < 0) {
+      return Usage("Invalid value for --module.");
+    }
+    dump_single_module_ = true;
+    dump_modules_ = true;
+    module_index_ = value;
+  }
+
   CommandLine::StringVector args = command_line->GetArgs();
   if (args.empty())
     return Usage("You must provide at least one input file.");
@@ -278,48 +357,87 @@ int PdbDumpApp::Run() {
       return 1;
     }
 
-    // Read the type info stream.
+    // Read the type info stream. Only the header is read eagerly; the
+    // records themselves are indexed on demand so that targeted queries
+    // touch only the relevant pages of the stream.
     TypeInfoHeader type_info_header = {};
-    TypeInfoRecordMap type_info_records;
     stream = pdb_file.GetStream(pdb::kTpiStream);
-    if (stream != NULL && ReadTypeInfoStream(stream,
-                                             &type_info_header,
-                                             &type_info_records)) {
-      if (dump_type_info_)
-        DumpTypeInfoStream(out(), stream, type_info_header, type_info_records);
-    } else {
+    if (stream == NULL || !ReadTypeInfoHeader(stream, &type_info_header)) {
       LOG(ERROR) << "No type info stream.";
       return 1;
     }
+    TypeInfoIndex type_info_index(stream, type_info_header);
+    if (dump_single_type_) {
+      // Only the stream prefix up to the requested record is scanned; the
+      // records preceding it are indexed so that references from the
+      // requested record can be resolved.
+      TypeInfoRecord type_record;
+      if (!type_info_index.FindTypeRecord(type_id_, &type_record))
+        return 1;
+      if (!DumpTypeInfoRecord(out(), stream, type_info_index.records(),
+                              type_id_, type_record, 0)) {
+        return 1;
+      }
+    } else if (dump_type_info_) {
+      if (!type_info_index.IndexAll())
+        return 1;
+      DumpTypeInfoStream(out(), stream, type_info_header,
+                         type_info_index.records());
+    }
 
-    // Read the symbol record stream.
+    // Read the symbol record stream. The records are only materialized when
+    // they are actually dumped.
     if (dbi_stream.header().symbol_record_stream == -1) {
       LOG(ERROR) << "No symbol record stream.";
       return 1;
     }
     PdbStream* sym_record_stream = pdb_file.GetStream(
         dbi_stream.header().symbol_record_stream);
-    SymbolRecordVector symbol_vector;
-    if (sym_record_stream != NULL &&
-        ReadSymbolRecord(sym_record_stream,
-                         sym_record_stream->length(),
-                         &symbol_vector)) {
-      DumpIndentedText(out(), 0, "%d symbol records in the stream:\n",
-                       symbol_vector.size());
-      if (dump_symbol_record_)
-        DumpSymbolRecords(out(), sym_record_stream, symbol_vector, 1);
-    } else {
+    if (sym_record_stream == NULL) {
       LOG(ERROR) << "Unable to read the symbol record stream.";
       return 1;
     }
+    if (dump_single_symbol_) {
+      SymbolRecordVector symbol_vector;
+      if (!ReadSymbolRecordAt(sym_record_stream, symbol_offset_,
+                              &symbol_vector)) {
+        return 1;
+      }
+      DumpSymbolRecords(out(), sym_record_stream, symbol_vector, 1);
+    } else if (dump_symbol_record_) {
+      SymbolRecordVector symbol_vector;
+      if (!sym_record_stream->Seek(0) ||
+          !ReadSymbolRecord(sym_record_stream,
+                            sym_record_stream->length(),
+                            &symbol_vector)) {
+        LOG(ERROR) << "Unable to read the symbol record stream.";
+        return 1;
+      }
+      DumpIndentedText(out(), 0, "%d symbol records in the stream:\n",
+                       symbol_vector.size());
+      DumpSymbolRecords(out(), sym_record_stream, symbol_vector, 1);
+    }
 
     // Read the module info streams.
     if (dump_modules_) {
+      if (dump_single_module_ &&
+          module_index_ >= dbi_stream.modules().size()) {
+        LOG(ERROR) << "Module index " << module_index_ << " is out of range "
+                   << "(the PDB contains " << dbi_stream.modules().size()
+                   << " modules).";
+        return 1;
+      }
       DbiStream::DbiModuleVector::const_iterator iter_modules =
         dbi_stream.modules().begin();
-      ::fprintf(out(), "Module info, %d records:\n",
-                dbi_stream.modules().size());
-      for (; iter_modules != dbi_stream.modules().end(); ++iter_modules) {
+      if (!dump_single_module_) {
+        ::fprintf(out(), "Module info, %d records:\n",
+                  dbi_stream.modules().size());
+      }
+      size_t module_index = 0;
+      for (; iter_modules != dbi_stream.modules().end();
+           ++iter_modules, ++module_index) {
+        if (dump_single_module_ && module_index != module_index_)
+          continue;
         if (iter_modules->module_info_base().stream != -1) {
           PdbStream* module_stream =
               pdb_file.GetStream(iter_modules->module_info_base().stream);
@@ -18,6 +18,7 @@
 #include <utility>
 #include <vector>
 
+#include "base/basictypes.h"
 #include "base/files/file_path.h"
 #include "syzygy/common/application.h"
 #include "syzygy/pdb/pdb_util.h"
@@ -73,6 +74,21 @@ class PdbDumpApp : public common::AppImplBase {
 
   // Iff true, the module streams will be dumped. Default to false.
   bool dump_modules_;
+
+  // Iff true, only the type info record with id type_id_ will be dumped,
+  // rather than the whole type info stream. Default to false.
+  bool dump_single_type_;
+  uint32 type_id_;
+
+  // Iff true, only the symbol record at offset symbol_offset_ of the symbol
+  // record stream will be dumped. Default to false.
+  bool dump_single_symbol_;
+  size_t symbol_offset_;
+
+  // Iff true, only the module stream with index module_index_ will be
+  // dumped, rather than all of them. Default to false.
+  bool dump_single_module_;
+  size_t module_index_;
 };
 
 }  // namespace pdb
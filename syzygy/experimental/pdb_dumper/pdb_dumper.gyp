@@ -31,6 +31,8 @@
         'pdb_module_info_stream_dumper.h',
         'pdb_symbol_record_dumper.cc',
         'pdb_symbol_record_dumper.h',
+        'pdb_type_info_index.cc',
+        'pdb_type_info_index.h',
         'pdb_type_info_stream_dumper.cc',
         'pdb_type_info_stream_dumper.h',
       ],
@@ -0,0 +1,113 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/experimental/pdb_dumper/pdb_type_info_index.h"
+
+#include "base/logging.h"
+#include "syzygy/pdb/pdb_stream.h"
+
+namespace pdb {
+
+TypeInfoIndex::TypeInfoIndex(PdbStream* stream,
+                             const TypeInfoHeader& type_info_header)
+    : stream_(stream),
+      type_info_header_(type_info_header),
+      next_type_id_(type_info_header.type_min),
+      next_record_position_(type_info_header.len) {
+  DCHECK(stream != NULL);
+}
+
+bool TypeInfoIndex::FindTypeRecord(uint32 type_id,
+                                   TypeInfoRecord* type_record) {
+  DCHECK(type_record != NULL);
+
+  if (type_id < type_info_header_.type_min ||
+      type_id >= type_info_header_.type_max) {
+    LOG(ERROR) << "Type id " << type_id << " is out of range (expected "
+               << type_info_header_.type_min << " to "
+               << type_info_header_.type_max - 1 << ").";
+    return false;
+  }
+
+  if (!ScanTo(type_id))
+    return false;
+
+  TypeInfoRecordMap::const_iterator it = records_.find(type_id);
+  if (it == records_.end()) {
+    LOG(ERROR) << "Type id " << type_id << " is not present in the type info "
+               << "stream.";
+    return false;
+  }
+
+  *type_record = it->second;
+  return true;
+}
+
+bool TypeInfoIndex::IndexAll() {
+  if (type_info_header_.type_max == type_info_header_.type_min)
+    return true;
+
+  if (!ScanTo(type_info_header_.type_max - 1))
+    return false;
+
+  if (next_type_id_ != type_info_header_.type_max) {
+    LOG(ERROR) << "Unexpected number of type info records in the type info "
+               << "stream (expected " << type_info_header_.type_max
+               - type_info_header_.type_min << ", read " << next_type_id_
+               - type_info_header_.type_min << ").";
+  }
+
+  return true;
+}
+
+bool TypeInfoIndex::ScanTo(uint32 type_id) {
+  size_t type_info_data_end =
+      type_info_header_.len + type_info_header_.type_info_data_size;
+
+  // Scan records forward from where the last scan left off. Records already
+  // indexed are never re-read, so targeted queries only touch the prefix of
+  // the stream up to the requested record.
+  while (next_type_id_ <= type_id &&
+         next_record_position_ < type_info_data_end) {
+    if (!stream_->Seek(next_record_position_)) {
+      LOG(ERROR) << "Unable to seek to type info record at position "
+                 << next_record_position_ << ".";
+      return false;
+    }
+    uint16 len = 0;
+    uint16 record_type = 0;
+    if (!stream_->Read(&len, 1)) {
+      LOG(ERROR) << "Unable to read a type info record length.";
+      return false;
+    }
+    size_t record_start = stream_->pos();
+    if (!stream_->Read(&record_type, 1)) {
+      LOG(ERROR) << "Unable to read a type info record type.";
+      return false;
+    }
+
+    TypeInfoRecord type_record;
+    type_record.type = record_type;
+    type_record.start_position = stream_->pos();
+    type_record.len = len - sizeof(record_type);
+
+    records_.insert(std::make_pair(next_type_id_, type_record));
+    next_record_position_ = record_start + len;
+    ++next_type_id_;
+  }
+
+  return true;
+}
+
+}  // namespace pdb
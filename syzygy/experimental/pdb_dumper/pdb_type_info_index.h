@@ -0,0 +1,83 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares an on-demand index over the records of a PDB type info
+// stream.
+
+#ifndef SYZYGY_EXPERIMENTAL_PDB_DUMPER_PDB_TYPE_INFO_INDEX_H_
+#define SYZYGY_EXPERIMENTAL_PDB_DUMPER_PDB_TYPE_INFO_INDEX_H_
+
+#include "base/basictypes.h"
+#include "syzygy/pdb/pdb_data.h"
+#include "syzygy/pdb/pdb_data_types.h"
+
+namespace pdb {
+
+// Forward declarations.
+class PdbStream;
+
+// An on-demand index mapping type ids to record offsets in a type info
+// stream. Type ids are not stored in the stream; the records are simply
+// numbered sequentially from type_min, and a record may only refer to
+// records with lower ids. The index exploits this: records are scanned
+// lazily, so a query for type id N reads the stream only as far as record N,
+// and repeated queries are answered from the index without touching the
+// stream again. This makes targeted queries against large PDBs cheap, while
+// a full dump pays the same single pass as before.
+class TypeInfoIndex {
+ public:
+  // Creates an index over @p stream, whose header must already have been
+  // read and validated with ReadTypeInfoHeader. The stream must outlive this
+  // index.
+  TypeInfoIndex(PdbStream* stream, const TypeInfoHeader& type_info_header);
+
+  // Finds the record with the given type id, scanning the stream forward if
+  // the record has not been indexed yet.
+  // @param type_id the id of the type info record to find.
+  // @param type_record receives the record.
+  // @returns true if the record exists and could be indexed, false
+  //     otherwise.
+  bool FindTypeRecord(uint32 type_id, TypeInfoRecord* type_record);
+
+  // Indexes every record in the stream.
+  // @returns true on success, false otherwise.
+  bool IndexAll();
+
+  // @returns the records indexed so far, keyed by type id.
+  const TypeInfoRecordMap& records() const { return records_; }
+
+ private:
+  // Scans records forward until @p type_id has been indexed or the stream is
+  // exhausted.
+  // @returns false if a record could not be read, true otherwise.
+  bool ScanTo(uint32 type_id);
+
+  PdbStream* stream_;
+  TypeInfoHeader type_info_header_;
+
+  // The id that the next unscanned record will receive.
+  uint32 next_type_id_;
+
+  // The stream position of the next unscanned record.
+  size_t next_record_position_;
+
+  // The records indexed so far.
+  TypeInfoRecordMap records_;
+
+  DISALLOW_COPY_AND_ASSIGN(TypeInfoIndex);
+};
+
+}  // namespace pdb
+
+#endif  // SYZYGY_EXPERIMENTAL_PDB_DUMPER_PDB_TYPE_INFO_INDEX_H_
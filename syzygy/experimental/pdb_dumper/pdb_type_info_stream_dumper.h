@@ -35,6 +35,18 @@ void DumpTypeInfoStream(FILE* out,
                         const TypeInfoHeader& type_info_header,
                         const TypeInfoRecordMap& type_info_record_map);
 
+// Dump the single type info record @p type_record with id @p type_id from
+// @p stream to @p out. @p type_info_record_map is used to resolve references
+// to other type info records; it only needs to contain the records with ids
+// lower than @p type_id.
+// @returns true on success, false otherwise.
+bool DumpTypeInfoRecord(FILE* out,
+                        PdbStream* stream,
+                        const TypeInfoRecordMap& type_info_record_map,
+                        uint32 type_id,
+                        const TypeInfoRecord& type_record,
+                        uint8 indent_level);
+
 }  // namespace pdb
 
 #endif  // SYZYGY_EXPERIMENTAL_PDB_DUMPER_PDB_TYPE_INFO_STREAM_DUMPER_H_
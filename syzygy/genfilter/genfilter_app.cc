@@ -38,6 +38,10 @@ const char kUsageFormatStr[] =
     "    'invert', 'subtract' or 'union.\n"
     "\n"
     "Optional parameters:\n"
+    "  --binary\n"
+    "    If specified then the output will be written as a compiled binary\n"
+    "    filter rather than JSON. Binary filters load without parsing and\n"
+    "    are the preferred format for filters that are applied repeatedly.\n"
     "  --output-file=<path>\n"
     "    The path of the output file to produce. If none is specified this\n"
     "    will go to stdout. If the output file already exists it will not be\n"
@@ -49,16 +53,16 @@ const char kUsageFormatStr[] =
     "\n"
     "Actions:\n"
     "  compile    Compiles the rules in the filter description input files\n"
-    "             and produces a JSON encoded filter as output.\n"
-    "  intersect  Calculates the union of the inputs, which must all be JSON\n"
+    "             and produces an encoded filter as output.\n"
+    "  intersect  Calculates the union of the inputs, which must all be\n"
     "             encoded filters for the same module.\n"
-    "  invert     Inverts the given JSON encoded filter. Only one input\n"
-    "             should be provided.\n"
+    "  invert     Inverts the given encoded filter. Only one input should\n"
+    "             be provided.\n"
     "  subtract   Calculates the set difference of the inputs, subtracting\n"
-    "             subsequent inputs from the first. All inputs must be JSON\n"
+    "             subsequent inputs from the first. All inputs must be\n"
     "             encoded filters for the same module.\n"
     "  union      Calculates the union of the input filters, which must all\n"
-    "             be JSON encoded filters for the same module.\n"
+    "             be encoded filters for the same module.\n"
     "\n"
     "Parameters for 'compile' action:\n"
     "  --input-image=<path>                                        [REQUIRED]\n"
@@ -87,7 +91,8 @@ void ApplyBinarySetAction(GenFilterApp::Action action,
   }
 }
 
-bool OutputFilter(bool pretty_print,
+bool OutputFilter(bool binary,
+                  bool pretty_print,
                   const base::FilePath& path,
                   const ImageFilter& filter,
                   FILE* default_file) {
@@ -106,7 +111,9 @@ bool OutputFilter(bool pretty_print,
   }
 
   LOG(INFO) << "Writing filter to " << dest << ".";
-  if (!filter.SaveToJSON(pretty_print, file)) {
+  bool saved = binary ? filter.SaveToBinary(file)
+                      : filter.SaveToJSON(pretty_print, file);
+  if (!saved) {
     LOG(ERROR) << "Failed to write filter to " << dest << ".";
     return false;
   }
@@ -139,6 +146,7 @@ bool GenFilterApp::ParseCommandLine(const CommandLine* command_line) {
 
   // Parse the optional parameters.
   output_file_ = command_line->GetSwitchValuePath("output-file");
+  binary_ = command_line->HasSwitch("binary");
   pretty_print_ = command_line->HasSwitch("pretty-print");
   overwrite_ = command_line->HasSwitch("overwrite");
 
@@ -246,18 +254,18 @@ bool GenFilterApp::RunCompileAction() {
   if (!filter_compiler.Compile(&filter))
     return false;
 
-  if (!OutputFilter(pretty_print_, output_file_, filter, out()))
+  if (!OutputFilter(binary_, pretty_print_, output_file_, filter, out()))
     return false;
 
   return true;
 }
 
 bool GenFilterApp::RunSetAction() {
-  // At this point we're handling set operations on JSON encoded filters. Load
+  // At this point we're handling set operations on encoded filters. Load
   // them and make sure they're for the same module.
   std::vector<ImageFilter> filters(inputs_.size());
   for (size_t i = 0; i < inputs_.size(); ++i) {
-    if (!filters[i].LoadFromJSON(inputs_[i])) {
+    if (!filters[i].Load(inputs_[i])) {
       LOG(ERROR) << "Failed to load filter \"" << inputs_[i].value() << "\".";
       return false;
     }
@@ -282,7 +290,7 @@ bool GenFilterApp::RunSetAction() {
       ApplyBinarySetAction(action_, filters[0], filters[i], &filters[0]);
   }
 
-  if (!OutputFilter(pretty_print_, output_file_, filters[0], out()))
+  if (!OutputFilter(binary_, pretty_print_, output_file_, filters[0], out()))
     return false;
 
   return true;
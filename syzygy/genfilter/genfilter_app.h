@@ -42,6 +42,7 @@ class GenFilterApp : public common::AppImplBase {
   GenFilterApp()
       : common::AppImplBase("GenFilterApp"),
         action_(kCompile),
+        binary_(false),
         pretty_print_(false),
         overwrite_(false) {
   }
@@ -70,6 +71,7 @@ class GenFilterApp : public common::AppImplBase {
   base::FilePath input_pdb_;
   base::FilePath output_file_;
   std::vector<base::FilePath> inputs_;
+  bool binary_;
   bool overwrite_;
   bool pretty_print_;
 };
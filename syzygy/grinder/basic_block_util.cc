@@ -20,6 +20,9 @@
 #include <algorithm>
 #include <functional>
 
+#include "base/lazy_instance.h"
+#include "base/memory/scoped_vector.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -29,6 +32,113 @@
 namespace grinder {
 namespace basic_block_util {
 
+namespace {
+
+// An entry in the process-wide PDB information cache. The entries are heap
+// allocated so that cached PdbInfo structures have stable addresses. The
+// copies handed out to callers share the source file name strings of the
+// cached LineInfo; those remain valid because the cache is never destroyed.
+struct PdbInfoCacheEntry {
+  ModuleInformation module_info;
+  PdbInfo pdb_info;
+};
+
+// A process-wide cache of the PDB information resolved for each unique
+// module, indexed by the module signature hash. A multi-trace grind runs
+// several grinders over traces referencing the same modules; consulting this
+// cache ensures that each unique module is resolved from disk exactly once
+// per process. Entries with an empty pdb_path are cached failures.
+struct ProcessPdbInfoCache {
+  base::Lock lock;
+  // Owns the entries. Under lock.
+  ScopedVector<PdbInfoCacheEntry> entries;
+  // A fast-compare index from signature hash to entry. Hash collisions are
+  // resolved by signature consistency. Under lock.
+  std::multimap<size_t, PdbInfoCacheEntry*> index;
+};
+
+base::LazyInstance<ProcessPdbInfoCache>::Leaky process_pdb_info_cache =
+    LAZY_INSTANCE_INITIALIZER;
+
+// Looks up the cached entry for the module with the given |hash| and
+// |module_info|. The cache lock must be held. Returns NULL if the module has
+// not been resolved yet.
+PdbInfoCacheEntry* FindPdbInfoCacheEntry(
+    ProcessPdbInfoCache* cache,
+    size_t hash,
+    const ModuleInformation& module_info) {
+  typedef std::multimap<size_t, PdbInfoCacheEntry*>::const_iterator Iterator;
+  cache->lock.AssertAcquired();
+  std::pair<Iterator, Iterator> range = cache->index.equal_range(hash);
+  for (Iterator it = range.first; it != range.second; ++it) {
+    if (it->second->module_info.IsConsistent(module_info))
+      return it->second;
+  }
+  return NULL;
+}
+
+// Loads the PDB information for |module_info| from disk into |pdb_info|.
+// Logs verbosely on failure.
+bool LoadPdbInfoFromDisk(const ModuleInformation& module_info,
+                         PdbInfo* pdb_info) {
+  DCHECK(pdb_info != NULL);
+
+  // Find the PDB file for the module.
+  base::FilePath pdb_path;
+  base::FilePath module_path(module_info.path);
+  if (!pe::FindPdbForModule(module_path, &pdb_path) || pdb_path.empty()) {
+    LOG(ERROR) << "Failed to find PDB for module: " << module_path.value();
+    return false;
+  }
+
+  // Load the line information from the PDB.
+  if (!pdb_info->line_info.Init(pdb_path)) {
+    LOG(ERROR) << "Failed to extract line information from PDB file: "
+               << pdb_path.value();
+    return false;
+  }
+
+  // This logs verbosely for us.
+  if (!LoadBasicBlockRanges(pdb_path, &pdb_info->bb_ranges))
+    return false;
+
+  // The dense visit counts start at zero, one entry per basic block.
+  pdb_info->bb_visits.resize(pdb_info->bb_ranges.size());
+
+  // Populate the pdb_path field of pdb_info, which marks the entry as valid.
+  pdb_info->pdb_path = pdb_path;
+
+  return true;
+}
+
+// Resolves the PDB information for |module_info| through the process-wide
+// cache, reading it from disk at most once per process. Copies the result to
+// |pdb_info| and returns true on success. Failures are cached too.
+bool ResolvePdbInfo(const ModuleInformation& module_info, PdbInfo* pdb_info) {
+  DCHECK(pdb_info != NULL);
+
+  ProcessPdbInfoCache& cache = process_pdb_info_cache.Get();
+  size_t hash = module_info.GetHash();
+
+  base::AutoLock auto_lock(cache.lock);
+  PdbInfoCacheEntry* entry = FindPdbInfoCacheEntry(&cache, hash, module_info);
+  if (entry == NULL) {
+    // Not seen yet; load the module directly into a new cache entry. A
+    // failed load leaves the entry's pdb_path empty, caching the failure.
+    entry = new PdbInfoCacheEntry();
+    entry->module_info = module_info;
+    cache.entries.push_back(entry);
+    cache.index.insert(std::make_pair(hash, entry));
+    if (!LoadPdbInfoFromDisk(module_info, &entry->pdb_info))
+      entry->pdb_info = PdbInfo();
+  }
+
+  *pdb_info = entry->pdb_info;
+  return !entry->pdb_info.pdb_path.empty();
+}
+
+}  // namespace
+
 bool ModuleIdentityComparator::operator()(
     const ModuleInformation& lhs, const ModuleInformation& rhs) {
   if (lhs.module_size < rhs.module_size)
@@ -91,10 +201,11 @@ bool LoadBranchStatisticsFromFile(const base::FilePath& file,
   DCHECK(!file.empty());
   DCHECK_NE(reinterpret_cast<IndexedFrequencyMap*>(NULL), frequencies);
 
-  // Load profile information from JSON file.
+  // Load profile information from the file; either the JSON or the binary
+  // columnar format is accepted.
   ModuleIndexedFrequencyMap module_entry_count_map;
   IndexedFrequencyDataSerializer serializer;
-  if (!serializer.LoadFromJson(file, &module_entry_count_map)) {
+  if (!serializer.Load(file, &module_entry_count_map)) {
     LOG(ERROR) << "Failed to load profile information.";
     return false;
   }
@@ -186,33 +297,16 @@ bool LoadPdbInfo(PdbInfoMap* pdb_info_cache,
   }
 
   // Insert a new (empty) PdbInfo for module_info and keep a reference to it.
-  // If any of the operations below fail, the pdb_path in the PdbInfo structure
+  // If the resolution below fails, the pdb_path in the PdbInfo structure
   // will not have been populated.
   PdbInfo& pdb_info_ref = (*pdb_info_cache)[module_info];
 
-  // Find the PDB file for the module.
-  base::FilePath pdb_path;
-  base::FilePath module_path(module_info.path);
-  if (!pe::FindPdbForModule(module_path, &pdb_path) || pdb_path.empty()) {
-    LOG(ERROR) << "Failed to find PDB for module: " << module_path.value();
+  // Resolve the module through the process-wide cache, so that each unique
+  // module is read from disk only once no matter how many grinders or trace
+  // files refer to it. The local copy is the one this caller accumulates
+  // visit counts into.
+  if (!ResolvePdbInfo(module_info, &pdb_info_ref))
     return false;
-  }
-
-  // Load the line information from the PDB.
-  if (!pdb_info_ref.line_info.Init(pdb_path)) {
-    LOG(ERROR) << "Failed to extract line information from PDB file: "
-               << pdb_path.value();
-    return false;
-  }
-
-  // This logs verbosely for us.
-  if (!LoadBasicBlockRanges(pdb_path, &pdb_info_ref.bb_ranges)) {
-    return false;
-  }
-
-  // Populate the pdb_path field of pdb_info_ref, which marks the cached
-  // entry as valid.
-  pdb_info_ref.pdb_path = pdb_path;
 
   // Return a pointer to the pdb_info entry.
   *pdb_info = &pdb_info_ref;
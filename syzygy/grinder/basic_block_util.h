@@ -88,6 +88,11 @@ struct PdbInfo {
   // Basic-block addresses for the module associated with a particular PDB.
   // Used to transform basic-block frequency data to line visits via line_info.
   RelativeAddressRangeVector bb_ranges;
+
+  // Accumulated visit counts, one entry per basic block in bb_ranges.
+  // Trace records are tallied here with simple saturating additions; the
+  // counts are folded into line_info visits only once, at grind time.
+  std::vector<uint32> bb_visits;
 };
 
 typedef std::map<ModuleInformation,
@@ -117,7 +122,10 @@ bool LoadBasicBlockRanges(const base::FilePath& pdb_path,
 
 // Loads a new or retrieves the cached PDB info for the given module. This
 // also caches failures; it will not re-attempt to look up PDB information
-// if a previous attempt for the same module failed.
+// if a previous attempt for the same module failed. Modules are additionally
+// cached process-wide, keyed by their signature hash, so that a module
+// referenced from several grinders or trace files is only ever read from
+// disk once per process.
 // @param pdb_info_cache the cache of PDB info already seen.
 // @param module_info the info representing the module to find PDB info for.
 // @param pdb_info a pointer to the pdb info will be returned here.
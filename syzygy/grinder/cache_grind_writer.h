@@ -22,11 +22,81 @@
 #ifndef SYZYGY_GRINDER_CACHE_GRIND_WRITER_H_
 #define SYZYGY_GRINDER_CACHE_GRIND_WRITER_H_
 
+#include <map>
+#include <string>
+
+#include "base/basictypes.h"
 #include "base/files/file_path.h"
 #include "syzygy/grinder/coverage_data.h"
 
 namespace grinder {
 
+// A helper for emitting cachegrind files. Output accumulates in a buffer
+// that is flushed to the underlying file in large chunks, and file and
+// function names are emitted through the format's string table ("fl=(1)
+// name" on first use, "fl=(1)" on subsequent ones). This drastically
+// shrinks profiles that name the same functions over and over, and speeds
+// up both writing and loading them.
+//
+// Append failures are latched and reported by Flush, so a run of appends
+// only needs a single error check.
+class CacheGrindWriter {
+ public:
+  // Constructs a writer that outputs to @p file, which must outlive the
+  // writer.
+  explicit CacheGrindWriter(FILE* file);
+
+  // Flushes any remaining buffered output.
+  ~CacheGrindWriter();
+
+  // Appends printf-formatted text to the output.
+  // @param format the printf format string.
+  void AppendF(const char* format, ...);
+
+  // Appends a file name reference, defining the name in the string table on
+  // first use.
+  // @param tag the reference type, "fl" or "cfl".
+  // @param name the file name.
+  void AppendFileName(const char* tag, const std::wstring& name);
+
+  // Appends a function name reference, defining the name in the string
+  // table on first use.
+  // @param tag the reference type, "fn" or "cfn".
+  // @param name the function name.
+  void AppendFunctionName(const char* tag, const std::wstring& name);
+
+  // Writes any buffered output to the file.
+  // @returns true if all output so far has been written successfully,
+  //     false otherwise.
+  bool Flush();
+
+ private:
+  typedef std::map<std::wstring, size_t> NameIdMap;
+
+  // Appends a name reference of type @p tag, assigning it an identifier
+  // from @p ids on first use.
+  void AppendName(const char* tag, const std::wstring& name, NameIdMap* ids);
+
+  // Flushes the buffer if it has grown past the flush threshold.
+  void FlushIfNeeded();
+
+  // The file being written to.
+  FILE* file_;
+
+  // The buffered output yet to be written to the file.
+  std::string buffer_;
+
+  // The string tables. The format keeps file and function names in separate
+  // namespaces.
+  NameIdMap file_names_;
+  NameIdMap function_names_;
+
+  // Set when a write to the file fails; reported by Flush.
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(CacheGrindWriter);
+};
+
 // Dumps the provided @p coverage information to an CacheGrind file.
 // @param coverage the summarized coverage info to be written.
 // @param path the path to the file to be created or overwritten.
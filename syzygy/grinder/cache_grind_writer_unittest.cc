@@ -42,6 +42,37 @@ class TestCoverageData : public CoverageData {
 
 }  // namespace
 
+TEST(CacheGrindWriterTest, NameCompression) {
+  testing::ScopedTempFile temp;
+  base::ScopedFILE file(base::OpenFile(temp.path(), "wb"));
+  ASSERT_TRUE(file.get() != NULL);
+
+  CacheGrindWriter writer(file.get());
+  writer.AppendFileName("fl", L"C:/src/foo.cc");
+  writer.AppendFunctionName("fn", L"foo");
+  writer.AppendF("1 1\n");
+  // Repeated names are referred to by identifier, and file and function
+  // names live in separate namespaces.
+  writer.AppendFileName("cfl", L"C:/src/foo.cc");
+  writer.AppendFunctionName("cfn", L"bar");
+  writer.AppendFunctionName("fn", L"foo");
+  EXPECT_TRUE(writer.Flush());
+  file.reset();
+
+  std::string actual_contents;
+  EXPECT_TRUE(base::ReadFileToString(temp.path(), &actual_contents));
+
+  std::string expected_contents =
+      "fl=(1) C:/src/foo.cc\n"
+      "fn=(1) foo\n"
+      "1 1\n"
+      "cfl=(1)\n"
+      "cfn=(2) bar\n"
+      "fn=(1)\n";
+
+  EXPECT_EQ(expected_contents, actual_contents);
+}
+
 TEST(CacheGrindWriterTest, Write) {
   TestCoverageData coverage_data;
   ASSERT_NO_FATAL_FAILURE(coverage_data.InitDummyData());
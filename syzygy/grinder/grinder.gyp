@@ -46,6 +46,8 @@
         'grinders/indexed_frequency_data_grinder.h',
         'grinders/profile_grinder.cc',
         'grinders/profile_grinder.h',
+        'grinders/profile_symbol_cache.cc',
+        'grinders/profile_symbol_cache.h',
         'grinders/sample_grinder.cc',
         'grinders/sample_grinder.h',
       ],
@@ -71,6 +73,7 @@
         'line_info_unittest.cc',
         'grinders/coverage_grinder_unittest.cc',
         'grinders/profile_grinder_unittest.cc',
+        'grinders/profile_symbol_cache_unittest.cc',
         'grinders/sample_grinder_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
       ],
@@ -19,6 +19,7 @@
 #define SYZYGY_GRINDER_GRINDER_H_
 
 #include "base/command_line.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/trace/parse/parser.h"
 
 namespace grinder {
@@ -43,6 +44,48 @@ class GrinderInterface : public trace::parser::ParseEventHandlerImpl {
   //     handler.
   virtual void SetParser(Parser* parser) = 0;
 
+  // Merges the data aggregated by another grinder of the same type into this
+  // one. This allows independent trace files to be parsed in parallel by
+  // multiple grinder instances whose partial results are combined prior to
+  // grinding. This may only be called after all parse events have been
+  // handled by both grinders, and prior to calling Grind.
+  // @param other the grinder whose data is to be merged into this one. This
+  //     must be of the same type as this grinder, and is left in an
+  //     unspecified state.
+  // @returns true on success, false otherwise.
+  // @note The implementation should log on failure.
+  virtual bool Merge(GrinderInterface* other) = 0;
+
+  // @name Incremental grinding.
+  // Grinders that support incremental grinding can serialize their aggregate
+  // state after parsing and restore it at the beginning of a subsequent run,
+  // so that only new trace files need to be parsed. The default
+  // implementations decline to do either.
+  // @{
+
+  // Serializes the data aggregated by this grinder. This may only be called
+  // after all parse events have been handled, and prior to calling Grind.
+  // @param out_archive the archive to serialize to.
+  // @returns true on success, false if this grinder does not support
+  //     incremental grinding or if serialization fails.
+  // @note The implementation should log on failure.
+  virtual bool SaveState(core::OutArchive* out_archive) const {
+    return false;
+  }
+
+  // Restores aggregate state previously serialized with SaveState. This may
+  // only be called on a pristine grinder, prior to handling any parse
+  // events; subsequently parsed trace files aggregate on top of the
+  // restored state.
+  // @param in_archive the archive to deserialize from.
+  // @returns true on success, false if this grinder does not support
+  //     incremental grinding or if deserialization fails.
+  // @note The implementation should log on failure.
+  virtual bool LoadState(core::InArchive* in_archive) {
+    return false;
+  }
+  // @}
+
   // Performs any computation/aggregation/summarization that needs to be done
   // after having parsed trace files. This will only be called after a
   // successful call to ParseCommandLine and after all parse events have been
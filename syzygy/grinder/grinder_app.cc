@@ -14,10 +14,16 @@
 
 #include "syzygy/grinder/grinder_app.h"
 
+#include <algorithm>
+
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/grinder/grinders/coverage_grinder.h"
 #include "syzygy/grinder/grinders/indexed_frequency_data_grinder.h"
 #include "syzygy/grinder/grinders/profile_grinder.h"
@@ -48,13 +54,31 @@ const char kUsageFormatStr[] =
     "    'profile' or 'sample'.\n"
     "\n"
     "Optional parameters\n"
+    "  --incremental-state=<file>\n"
+    "    Persist aggregate state in the given file across runs, and fold\n"
+    "    only trace files that previous runs have not already ground into\n"
+    "    it. Only supported in 'coverage' and 'profile' modes.\n"
+    "  --num-threads=<N>\n"
+    "    Parse trace files on N worker threads, each aggregating into its\n"
+    "    own grinder, and merge the partial results prior to output.\n"
+    "    Defaults to 1.\n"
     "  --output-file=<output file>\n"
     "    The location of output file. If not specified, output is to stdout.\n"
+    "bbentry and branch mode optional parameters\n"
+    "  --binary\n"
+    "    Write the frequency data in the compact binary columnar format\n"
+    "    rather than as JSON. Binary files load faster, can be merged\n"
+    "    without re-parsing, and are accepted wherever the JSON files\n"
+    "    are.\n"
     "coverage mode optional parameters\n"
     "  --output-format=<output format>\n"
     "    Output format must be one of 'lcov' or 'cachegrind'. Defaults to\n"
     "    'lcov' if not explicitly specified.\n"
     "profile mode optional parameters\n"
+    "  --symbol-cache-dir=<dir>\n"
+    "    Cache symbol resolutions in per-PDB files in the given directory,\n"
+    "    and reuse them on subsequent grinds of traces against the same\n"
+    "    modules.\n"
     "  --thread-parts\n"
     "    Aggregate and output separate parts for each thread seen in the\n"
     "    trace files.\n"
@@ -72,9 +96,65 @@ const char kUsageFormatStr[] =
     "    only one module may be processed at a time in this mode.\n"
     "\n";
 
+// The version of the incremental state file format. The file holds this
+// version, the processing mode, the set of trace files already ground and
+// the grinder's serialized aggregate state.
+const uint32 kIncrementalStateVersion = 1;
+
+// A worker that parses a set of trace files into the grinder it is given.
+// Used to grind independent trace files in parallel. The worker owns the
+// parser so that it outlives the grinder's use of it.
+class GrindWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit GrindWorker(GrinderInterface* grinder)
+      : grinder_(grinder), succeeded_(false) {
+    DCHECK(grinder != NULL);
+  }
+
+  void AddTraceFile(const base::FilePath& trace_file) {
+    trace_files_.push_back(trace_file);
+  }
+
+  GrinderInterface* grinder() { return grinder_; }
+  bool succeeded() const { return succeeded_; }
+
+  virtual void Run() OVERRIDE {
+    grinder_->SetParser(&parser_);
+    if (!parser_.Init(grinder_))
+      return;
+
+    for (size_t i = 0; i < trace_files_.size(); ++i) {
+      if (!parser_.OpenTraceFile(trace_files_[i])) {
+        LOG(ERROR) << "Unable to open trace file \'"
+                   << trace_files_[i].value() << "'";
+        return;
+      }
+    }
+
+    if (!parser_.Consume()) {
+      LOG(ERROR) << "Error parsing trace files.";
+      return;
+    }
+
+    succeeded_ = true;
+  }
+
+ private:
+  GrinderInterface* grinder_;
+  trace::parser::Parser parser_;
+  std::vector<base::FilePath> trace_files_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(GrindWorker);
+};
+
 }  // namespace
 
-GrinderApp::GrinderApp() : common::AppImplBase("Grinder"), mode_(kProfile) {
+GrinderApp::GrinderApp()
+    : common::AppImplBase("Grinder"),
+      mode_(kProfile),
+      num_threads_(1),
+      command_line_(NULL) {
 }
 
 void GrinderApp::PrintUsage(const base::FilePath& program,
@@ -145,26 +225,223 @@ bool GrinderApp::ParseCommandLine(const CommandLine* command_line) {
 
   output_file_ = command_line->GetSwitchValuePath("output-file");
 
+  // Parse the number of worker threads to use.
+  if (command_line->HasSwitch("num-threads")) {
+    std::string value = command_line->GetSwitchValueASCII("num-threads");
+    int num_threads = 0;
+    if (!base::StringToInt(value, &num_threads) || num_threads < 1) {
+      PrintUsage(command_line->GetProgram(),
+                 base::StringPrintf("Invalid num-threads value: %s.",
+                                    value.c_str()));
+      return false;
+    }
+    num_threads_ = num_threads;
+  }
+
+  // Parse the incremental state file.
+  incremental_state_file_ =
+      command_line->GetSwitchValuePath("incremental-state");
+  if (!incremental_state_file_.empty() &&
+      mode_ != kProfile && mode_ != kCoverage) {
+    PrintUsage(command_line->GetProgram(),
+               "Incremental grinding is only supported in 'profile' and "
+               "'coverage' modes.");
+    return false;
+  }
+
+  // Keep a pointer to the command-line so that per-thread grinders may be
+  // configured from it.
+  command_line_ = command_line;
+
   return true;
 }
 
-int GrinderApp::Run() {
+GrinderInterface* GrinderApp::CreateGrinder() const {
+  DCHECK(command_line_ != NULL);
+
+  scoped_ptr<GrinderInterface> grinder;
+  switch (mode_) {
+    case kProfile:
+      grinder.reset(new grinders::ProfileGrinder());
+      break;
+    case kCoverage:
+      grinder.reset(new grinders::CoverageGrinder());
+      break;
+    case kBasicBlockEntry:
+    case kIndexedFrequencyData:
+      grinder.reset(new grinders::IndexedFrequencyDataGrinder());
+      break;
+    case kSample:
+      grinder.reset(new grinders::SampleGrinder());
+      break;
+    default:
+      NOTREACHED() << "Unknown mode.";
+      return NULL;
+  }
+
+  if (!grinder->ParseCommandLine(command_line_)) {
+    LOG(ERROR) << "Failed to configure grinder.";
+    return NULL;
+  }
+
+  return grinder.release();
+}
+
+bool GrinderApp::ParseTraceFilesInParallel(size_t num_workers) {
+  DCHECK_LT(1u, num_workers);
   DCHECK(grinder_.get() != NULL);
 
-  trace::parser::Parser parser;
-  grinder_->SetParser(&parser);
-  if (!parser.Init(grinder_.get()))
-    return 1;
+  // Create the workers. The first worker aggregates directly into our own
+  // grinder, the others each get their own instance whose partial results
+  // are merged below.
+  ScopedVector<GrinderInterface> extra_grinders;
+  ScopedVector<GrindWorker> workers;
+  workers.push_back(new GrindWorker(grinder_.get()));
+  for (size_t i = 1; i < num_workers; ++i) {
+    GrinderInterface* grinder = CreateGrinder();
+    if (grinder == NULL)
+      return false;
+    extra_grinders.push_back(grinder);
+    workers.push_back(new GrindWorker(grinder));
+  }
+
+  // Distribute the trace files across the workers.
+  for (size_t i = 0; i < trace_files_.size(); ++i)
+    workers[i % num_workers]->AddTraceFile(trace_files_[i]);
 
-  // Open the input files.
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (size_t i = 0; i < workers.size(); ++i) {
+    threads.push_back(new base::DelegateSimpleThread(
+        workers[i], base::StringPrintf("grinder-worker-%u", i)));
+    threads.back()->Start();
+  }
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Join();
+
+  // The workers log verbosely on failure.
+  for (size_t i = 0; i < workers.size(); ++i) {
+    if (!workers[i]->succeeded())
+      return false;
+  }
+
+  // Merge the partial results into our own grinder.
+  for (size_t i = 0; i < extra_grinders.size(); ++i) {
+    if (!grinder_->Merge(extra_grinders[i])) {
+      LOG(ERROR) << "Failed to merge partial grinder results.";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool GrinderApp::LoadIncrementalState() {
+  DCHECK(!incremental_state_file_.empty());
+  DCHECK(grinder_.get() != NULL);
+
+  if (!base::PathExists(incremental_state_file_)) {
+    LOG(INFO) << "Incremental state file does not exist yet; grinding from "
+              << "scratch.";
+    return true;
+  }
+
+  base::ScopedFILE file(base::OpenFile(incremental_state_file_, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open incremental state file \'"
+               << incremental_state_file_.value() << "'";
+    return false;
+  }
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+
+  uint32 version = 0;
+  uint32 mode = 0;
+  if (!in_archive.Load(&version) || version != kIncrementalStateVersion ||
+      !in_archive.Load(&mode) || mode != static_cast<uint32>(mode_)) {
+    LOG(ERROR) << "Incompatible incremental state file: "
+               << incremental_state_file_.value();
+    return false;
+  }
+
+  if (!in_archive.Load(&ground_trace_files_) ||
+      !grinder_->LoadState(&in_archive)) {
+    LOG(ERROR) << "Failed to load grinder state from: "
+               << incremental_state_file_.value();
+    return false;
+  }
+
+  // Drop the trace files that previous runs have already folded in.
+  std::vector<base::FilePath> new_trace_files;
   for (size_t i = 0; i < trace_files_.size(); ++i) {
-    if (!parser.OpenTraceFile(trace_files_[i])) {
-      LOG(ERROR) << "Unable to open trace file \'"
-                 << trace_files_[i].value() << "'";
-      return 1;
+    base::FilePath abs_path = base::MakeAbsoluteFilePath(trace_files_[i]);
+    if (abs_path.empty())
+      abs_path = trace_files_[i];
+    if (ground_trace_files_.count(abs_path.value()) == 0)
+      new_trace_files.push_back(trace_files_[i]);
+  }
+  LOG(INFO) << "Skipping " << trace_files_.size() - new_trace_files.size()
+            << " of " << trace_files_.size() << " trace file(s) already "
+            << "ground by previous runs.";
+  trace_files_.swap(new_trace_files);
+
+  return true;
+}
+
+bool GrinderApp::SaveIncrementalState() {
+  DCHECK(!incremental_state_file_.empty());
+  DCHECK(grinder_.get() != NULL);
+
+  // Account for the trace files this run has folded in.
+  for (size_t i = 0; i < trace_files_.size(); ++i) {
+    base::FilePath abs_path = base::MakeAbsoluteFilePath(trace_files_[i]);
+    if (abs_path.empty())
+      abs_path = trace_files_[i];
+    ground_trace_files_.insert(abs_path.value());
+  }
+
+  // Serialize to a temporary file and move it into place so that a failed
+  // run never leaves a partial state file behind.
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(incremental_state_file_.DirName(),
+                                      &temp_path)) {
+    LOG(ERROR) << "Failed to create temporary incremental state file.";
+    return false;
+  }
+
+  {
+    base::ScopedFILE file(base::OpenFile(temp_path, "wb"));
+    if (file.get() == NULL) {
+      LOG(ERROR) << "Failed to open temporary incremental state file: "
+                 << temp_path.value();
+      return false;
+    }
+    core::FileOutStream out_stream(file.get());
+    core::NativeBinaryOutArchive out_archive(&out_stream);
+    if (!out_archive.Save(kIncrementalStateVersion) ||
+        !out_archive.Save(static_cast<uint32>(mode_)) ||
+        !out_archive.Save(ground_trace_files_) ||
+        !grinder_->SaveState(&out_archive) ||
+        !out_archive.Flush()) {
+      LOG(ERROR) << "Failed to serialize grinder state.";
+      base::DeleteFile(temp_path, false);
+      return false;
     }
   }
 
+  if (!base::ReplaceFileW(temp_path, incremental_state_file_, NULL)) {
+    LOG(ERROR) << "Failed to commit incremental state file: "
+               << incremental_state_file_.value();
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  return true;
+}
+
+int GrinderApp::Run() {
+  DCHECK(grinder_.get() != NULL);
+
   // Open the output file. We do this early so as to fail before processing
   // the logs if the output is not able to be opened.
   FILE* output = out();
@@ -180,12 +457,47 @@ int GrinderApp::Run() {
     auto_close.reset(output);
   }
 
-  LOG(INFO) << "Parsing trace files.";
-  if (!parser.Consume()) {
-    LOG(ERROR) << "Error parsing trace files.";
+  // Restore the aggregate state of previous runs, if any. This also drops
+  // the trace files those runs have already ground from trace_files_.
+  if (!incremental_state_file_.empty() && !LoadIncrementalState())
     return 1;
+
+  trace::parser::Parser parser;
+  size_t num_workers = std::min(num_threads_, trace_files_.size());
+  if (trace_files_.empty()) {
+    LOG(INFO) << "No new trace files; grinding previous aggregate state.";
+  } else if (num_workers > 1) {
+    // Parse independent trace files on worker threads, each into its own
+    // grinder, and merge the partial aggregates into grinder_.
+    LOG(INFO) << "Parsing trace files on " << num_workers << " threads.";
+    if (!ParseTraceFilesInParallel(num_workers))
+      return 1;
+  } else {
+    grinder_->SetParser(&parser);
+    if (!parser.Init(grinder_.get()))
+      return 1;
+
+    // Open the input files.
+    for (size_t i = 0; i < trace_files_.size(); ++i) {
+      if (!parser.OpenTraceFile(trace_files_[i])) {
+        LOG(ERROR) << "Unable to open trace file \'"
+                   << trace_files_[i].value() << "'";
+        return 1;
+      }
+    }
+
+    LOG(INFO) << "Parsing trace files.";
+    if (!parser.Consume()) {
+      LOG(ERROR) << "Error parsing trace files.";
+      return 1;
+    }
   }
 
+  // Persist the updated aggregate state before grinding, as grinding
+  // consumes the parse-time aggregates.
+  if (!incremental_state_file_.empty() && !SaveIncrementalState())
+    return 1;
+
   LOG(INFO) << "Aggregating data.";
   if (!grinder_->Grind()) {
     LOG(ERROR) << "Failed to grind data.";
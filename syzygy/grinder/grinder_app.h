@@ -14,6 +14,8 @@
 #ifndef SYZYGY_GRINDER_GRINDER_APP_H_
 #define SYZYGY_GRINDER_GRINDER_APP_H_
 
+#include <set>
+
 #include "base/files/file_path.h"
 #include "syzygy/common/application.h"
 #include "syzygy/grinder/grinder.h"
@@ -49,10 +51,53 @@ class GrinderApp : public common::AppImplBase {
   // @}
 
  protected:
+  // Creates a fresh grinder for the current processing mode, configured from
+  // the command line. Only valid after a successful call to ParseCommandLine.
+  // @returns the new grinder, or NULL on failure.
+  GrinderInterface* CreateGrinder() const;
+
+  // Parses the trace files on @p num_workers worker threads, each
+  // aggregating into its own grinder, and merges the partial results into
+  // grinder_.
+  // @param num_workers the number of worker threads to use.
+  // @returns true on success, false otherwise.
+  bool ParseTraceFilesInParallel(size_t num_workers);
+
+  // @name Incremental grinding.
+  // @{
+  // Restores the grinder state serialized by a previous run from
+  // incremental_state_file_, and removes the trace files that run already
+  // folded in from trace_files_. A missing state file is not an error; it
+  // simply means this is the first run.
+  // @returns true on success, false otherwise.
+  bool LoadIncrementalState();
+
+  // Serializes the grinder's aggregate state and the set of trace files it
+  // covers to incremental_state_file_. This must be called after parsing and
+  // prior to grinding.
+  // @returns true on success, false otherwise.
+  bool SaveIncrementalState();
+  // @}
+
   std::vector<base::FilePath> trace_files_;
   base::FilePath output_file_;
   Mode mode_;
   scoped_ptr<GrinderInterface> grinder_;
+
+  // The number of worker threads to parse trace files with.
+  size_t num_threads_;
+
+  // The file holding serialized aggregate state across runs. Incremental
+  // grinding is disabled when empty.
+  base::FilePath incremental_state_file_;
+
+  // The trace files that have already been folded into the aggregate state,
+  // by this run or previous ones. Stored as absolute paths.
+  std::set<std::wstring> ground_trace_files_;
+
+  // The command line we were configured with. Used to configure the
+  // per-thread grinders in parallel mode.
+  const CommandLine* command_line_;
 };
 
 }  // namespace grinder
@@ -31,6 +31,7 @@ class TestGrinderApp : public GrinderApp {
   // Expose for testing.
   using GrinderApp::trace_files_;
   using GrinderApp::output_file_;
+  using GrinderApp::num_threads_;
 };
 
 class GrinderAppTest : public testing::PELibUnitTest {
@@ -122,6 +123,26 @@ TEST_F(GrinderAppTest, ParseCommandLineOutputFile) {
   ASSERT_EQ(L"output.txt", impl_.output_file_.value());
 }
 
+TEST_F(GrinderAppTest, ParseCommandLineNumThreads) {
+  ASSERT_EQ(1u, impl_.num_threads_);
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("num-threads", "4");
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kProfileTraceFiles[0]));
+
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  ASSERT_EQ(4u, impl_.num_threads_);
+}
+
+TEST_F(GrinderAppTest, ParseCommandLineFailsWithInvalidNumThreads) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("num-threads", "0");
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kProfileTraceFiles[0]));
+
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(GrinderAppTest, BasicBlockEntryEndToEnd) {
   cmd_line_.AppendSwitchASCII("mode", "bbentry");
   cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
@@ -177,6 +198,102 @@ TEST_F(GrinderAppTest, CoverageEndToEnd) {
   EXPECT_TRUE(base::PathExists(output_file));
 }
 
+TEST_F(GrinderAppTest, ParseCommandLineIncrementalStateUnsupportedMode) {
+  cmd_line_.AppendSwitchASCII("mode", "bbentry");
+  cmd_line_.AppendSwitchPath("incremental-state",
+                             temp_dir_.Append(L"incremental.state"));
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kBBEntryTraceFiles[0]));
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(GrinderAppTest, CoverageEndToEndIncremental) {
+  base::FilePath state_file = temp_dir_.Append(L"incremental.state");
+  base::FilePath output_file = temp_dir_.Append(L"coverage.lcov");
+
+  cmd_line_.AppendSwitchASCII("mode", "coverage");
+  cmd_line_.AppendSwitchASCII("output-format", "lcov");
+  cmd_line_.AppendSwitchPath("incremental-state", state_file);
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kCoverageTraceFiles[0]));
+
+  // The first run grinds from scratch and leaves the state file behind.
+  EXPECT_EQ(0, app_.Run());
+  EXPECT_TRUE(base::PathExists(state_file));
+  EXPECT_TRUE(base::PathExists(output_file));
+
+  // A second run over the same trace file folds nothing new in, and grinds
+  // from the persisted state alone.
+  ASSERT_TRUE(base::DeleteFile(output_file, false));
+  EXPECT_EQ(0, app_.Run());
+  EXPECT_TRUE(base::PathExists(output_file));
+}
+
+TEST_F(GrinderAppTest, BasicBlockEntryEndToEndParallel) {
+  cmd_line_.AppendSwitchASCII("mode", "bbentry");
+  cmd_line_.AppendSwitchASCII("num-threads", "2");
+  for (size_t i = 0; i < arraysize(testing::kBBEntryTraceFiles); ++i) {
+    cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+        testing::kBBEntryTraceFiles[i]));
+  }
+
+  base::FilePath output_file;
+  ASSERT_TRUE(base::CreateTemporaryFileInDir(temp_dir_, &output_file));
+  ASSERT_TRUE(base::DeleteFile(output_file, false));
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+
+  ASSERT_TRUE(!base::PathExists(output_file));
+
+  EXPECT_EQ(0, app_.Run());
+
+  // Verify that the output file was created.
+  EXPECT_TRUE(base::PathExists(output_file));
+}
+
+TEST_F(GrinderAppTest, ProfileEndToEndParallel) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("num-threads", "2");
+  for (size_t i = 0; i < arraysize(testing::kProfileTraceFiles); ++i) {
+    cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+        testing::kProfileTraceFiles[i]));
+  }
+
+  base::FilePath output_file;
+  ASSERT_TRUE(base::CreateTemporaryFileInDir(temp_dir_, &output_file));
+  ASSERT_TRUE(base::DeleteFile(output_file, false));
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+
+  ASSERT_TRUE(!base::PathExists(output_file));
+
+  EXPECT_EQ(0, app_.Run());
+
+  // Verify that the output file was created.
+  EXPECT_TRUE(base::PathExists(output_file));
+}
+
+TEST_F(GrinderAppTest, CoverageEndToEndParallel) {
+  cmd_line_.AppendSwitchASCII("mode", "coverage");
+  cmd_line_.AppendSwitchASCII("num-threads", "2");
+  for (size_t i = 0; i < arraysize(testing::kCoverageTraceFiles); ++i) {
+    cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+        testing::kCoverageTraceFiles[i]));
+  }
+
+  base::FilePath output_file;
+  ASSERT_TRUE(base::CreateTemporaryFileInDir(temp_dir_, &output_file));
+  ASSERT_TRUE(base::DeleteFile(output_file, false));
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+  cmd_line_.AppendSwitchASCII("output-format", "lcov");
+
+  ASSERT_TRUE(!base::PathExists(output_file));
+
+  EXPECT_EQ(0, app_.Run());
+
+  // Verify that the output file was created.
+  EXPECT_TRUE(base::PathExists(output_file));
+}
+
 TEST_F(GrinderAppTest, SampleEndToEnd) {
   base::FilePath trace_file = temp_dir_.Append(L"sampler.bin");
   ASSERT_NO_FATAL_FAILURE(testing::WriteDummySamplerTraceFile(trace_file));
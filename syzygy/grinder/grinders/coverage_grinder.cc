@@ -14,6 +14,9 @@
 
 #include "syzygy/grinder/grinders/coverage_grinder.h"
 
+#include <algorithm>
+#include <limits>
+
 #include "base/files/file_path.h"
 #include "base/strings/string_util.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -22,6 +25,7 @@
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pe/find.h"
+#include "syzygy/trace/parse/parse_engine.h"
 
 namespace grinder {
 namespace grinders {
@@ -37,6 +41,9 @@ using basic_block_util::PdbInfo;
 using basic_block_util::PdbInfoMap;
 using trace::parser::AbsoluteAddress64;
 
+// The version of the serialized grinder state, as written by SaveState.
+const uint32 kCoverageGrinderStateVersion = 1;
+
 }  // namespace
 
 CoverageGrinder::CoverageGrinder()
@@ -71,6 +78,143 @@ bool CoverageGrinder::ParseCommandLine(const CommandLine* command_line) {
 void CoverageGrinder::SetParser(Parser* parser) {
   DCHECK(parser != NULL);
   parser_ = parser;
+
+  // Coverage only consumes indexed frequency data, so have the parser skip
+  // everything else while scanning the trace buffers. Module events are
+  // always dispatched, irrespective of the mask.
+  parser->set_event_type_mask(
+      trace::parser::ParseEngine::EventTypeToMask(TRACE_INDEXED_FREQUENCY));
+}
+
+bool CoverageGrinder::Merge(GrinderInterface* other) {
+  DCHECK(other != NULL);
+
+  // We can only be merged with grinders of our own type.
+  CoverageGrinder* grinder = static_cast<CoverageGrinder*>(other);
+
+  PdbInfoMap::const_iterator it = grinder->pdb_info_cache_.begin();
+  for (; it != grinder->pdb_info_cache_.end(); ++it) {
+    PdbInfo& pdb_info = pdb_info_cache_[it->first];
+
+    // Modules seen only by the other grinder are adopted wholesale. This also
+    // propagates cached failures, which carry an empty pdb_path.
+    if (pdb_info.pdb_path.empty())
+      pdb_info.pdb_path = it->second.pdb_path;
+    if (pdb_info.bb_ranges.empty())
+      pdb_info.bb_ranges = it->second.bb_ranges;
+
+    // Bulk-merge the dense visit counts, with the same saturation
+    // arithmetic used when tallying them.
+    if (pdb_info.bb_visits.empty()) {
+      pdb_info.bb_visits = it->second.bb_visits;
+    } else if (!it->second.bb_visits.empty()) {
+      if (pdb_info.bb_visits.size() != it->second.bb_visits.size()) {
+        LOG(ERROR) << "Unable to merge inconsistent basic block visit counts "
+                   << "for PDB: " << it->first.path;
+        return false;
+      }
+      for (size_t i = 0; i < pdb_info.bb_visits.size(); ++i) {
+        uint32 other_visits = it->second.bb_visits[i];
+        uint32& visits = pdb_info.bb_visits[i];
+        visits = std::min(visits,
+                          std::numeric_limits<uint32>::max() - other_visits) +
+            other_visits;
+      }
+    }
+
+    if (!pdb_info.line_info.Merge(it->second.line_info)) {
+      LOG(ERROR) << "Failed to merge line information from PDB: "
+                 << it->first.path;
+      return false;
+    }
+  }
+
+  event_handler_errored_ |= grinder->event_handler_errored_;
+
+  return true;
+}
+
+bool CoverageGrinder::SaveState(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  // Only the accumulated visit counts are persisted, keyed by module
+  // signature. The line and basic-block range information the counts refer
+  // to is reloaded from the PDBs when the state is restored, which keeps the
+  // state file small. Cached failures (which carry an empty pdb_path) are
+  // not persisted; the next run re-probes, and re-logs, them.
+  if (!out_archive->Save(kCoverageGrinderStateVersion))
+    return false;
+
+  uint32 num_modules = 0;
+  PdbInfoMap::const_iterator it = pdb_info_cache_.begin();
+  for (; it != pdb_info_cache_.end(); ++it) {
+    if (!it->second.pdb_path.empty())
+      ++num_modules;
+  }
+  if (!out_archive->Save(num_modules))
+    return false;
+
+  for (it = pdb_info_cache_.begin(); it != pdb_info_cache_.end(); ++it) {
+    if (it->second.pdb_path.empty())
+      continue;
+    if (!it->first.Save(out_archive) ||
+        !out_archive->Save(it->second.bb_visits)) {
+      LOG(ERROR) << "Failed to serialize coverage data for module: "
+                 << it->first.path;
+      return false;
+    }
+  }
+
+  return out_archive->Save(event_handler_errored_);
+}
+
+bool CoverageGrinder::LoadState(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+  DCHECK(pdb_info_cache_.empty());
+
+  uint32 version = 0;
+  if (!in_archive->Load(&version) ||
+      version != kCoverageGrinderStateVersion) {
+    LOG(ERROR) << "Unsupported coverage grinder state version.";
+    return false;
+  }
+
+  uint32 num_modules = 0;
+  if (!in_archive->Load(&num_modules))
+    return false;
+
+  for (uint32 i = 0; i < num_modules; ++i) {
+    ModuleInformation module_info;
+    std::vector<uint32> bb_visits;
+    if (!module_info.Load(in_archive) || !in_archive->Load(&bb_visits)) {
+      LOG(ERROR) << "Failed to deserialize coverage grinder state.";
+      return false;
+    }
+
+    // Reload the PDB information the persisted counts refer to. This
+    // recreates the line and basic-block range data from the PDB on disk.
+    PdbInfo* pdb_info = NULL;
+    if (!LoadPdbInfo(&pdb_info_cache_, module_info, &pdb_info)) {
+      LOG(ERROR) << "Failed to reload PDB information for module: "
+                 << module_info.path;
+      return false;
+    }
+    DCHECK(pdb_info != NULL);
+
+    if (pdb_info->bb_visits.size() != bb_visits.size()) {
+      LOG(ERROR) << "Persisted visit counts are inconsistent with the PDB "
+                 << "for module: " << module_info.path;
+      return false;
+    }
+    pdb_info->bb_visits.swap(bb_visits);
+  }
+
+  bool event_handler_errored = false;
+  if (!in_archive->Load(&event_handler_errored))
+    return false;
+  event_handler_errored_ |= event_handler_errored;
+
+  return true;
 }
 
 bool CoverageGrinder::Grind() {
@@ -84,9 +228,27 @@ bool CoverageGrinder::Grind() {
     return false;
   }
 
-  PdbInfoMap::const_iterator it = pdb_info_cache_.begin();
+  PdbInfoMap::iterator it = pdb_info_cache_.begin();
   for (; it != pdb_info_cache_.end(); ++it) {
-    if (!coverage_data_.Add(it->second.line_info)) {
+    PdbInfo& pdb_info = it->second;
+
+    // Fold the accumulated visit counts into the line information. This
+    // maps each basic block to its source lines exactly once, no matter
+    // how many trace records were tallied into the counts.
+    DCHECK_EQ(pdb_info.bb_ranges.size(), pdb_info.bb_visits.size());
+    for (size_t i = 0; i < pdb_info.bb_visits.size(); ++i) {
+      uint32 bb_visits = pdb_info.bb_visits[i];
+      if (bb_visits == 0)
+        continue;
+      const RelativeAddressRange& bb_range = pdb_info.bb_ranges[i];
+      if (!pdb_info.line_info.Visit(bb_range.start(), bb_range.size(),
+                                    bb_visits)) {
+        LOG(ERROR) << "Failed to visit BB at " << bb_range << ".";
+        return false;
+      }
+    }
+
+    if (!coverage_data_.Add(pdb_info.line_info)) {
       LOG(ERROR) << "Failed to aggregate line information from PDB: "
                  << it->first.path;
       return false;
@@ -177,23 +339,22 @@ void CoverageGrinder::OnIndexedFrequency(
     return;
   }
 
-  // Run over the BB frequency data and mark non-zero frequency BBs as having
-  // been visited.
+  // Run over the BB frequency data and tally the visits into the dense
+  // per-module counts. Resolving the counts to source lines is deferred to
+  // grind time, saving the per-line lookups on every trace record.
+  DCHECK_EQ(pdb_info->bb_ranges.size(), pdb_info->bb_visits.size());
   for (size_t bb_index = 0; bb_index < data->num_entries; ++bb_index) {
     uint32 bb_freq = GetFrequency(data, bb_index, 0);
 
     if (bb_freq == 0)
       continue;
 
-    // Mark this basic-block as visited.
-    const RelativeAddressRange& bb_range = pdb_info->bb_ranges[bb_index];
-    if (!pdb_info->line_info.Visit(bb_range.start(),
-                                   bb_range.size(),
-                                   bb_freq)) {
-      LOG(ERROR) << "Failed to visit BB at " << bb_range << ".";
-      event_handler_errored_ = true;
-      return;
-    }
+    // The same saturation arithmetic as in LineInfo::Visit, as overflow is
+    // a real possibility in long trace files.
+    uint32& bb_visits = pdb_info->bb_visits[bb_index];
+    bb_visits = std::min(bb_visits,
+                         std::numeric_limits<uint32>::max() - bb_freq) +
+        bb_freq;
   }
 }
 
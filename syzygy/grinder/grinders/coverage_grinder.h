@@ -35,6 +35,9 @@ class CoverageGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool Merge(GrinderInterface* other) OVERRIDE;
+  virtual bool SaveState(core::OutArchive* out_archive) const OVERRIDE;
+  virtual bool LoadState(core::InArchive* in_archive) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
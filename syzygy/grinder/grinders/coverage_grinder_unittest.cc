@@ -14,8 +14,11 @@
 
 #include "syzygy/grinder/grinders/coverage_grinder.h"
 
+#include <iterator>
+
 #include "base/win/scoped_com_initializer.h"
 #include "gtest/gtest.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pe/unittest_util.h"
 
@@ -27,6 +30,7 @@ namespace {
 class TestCoverageGrinder : public CoverageGrinder {
  public:
   using CoverageGrinder::parser_;
+  using CoverageGrinder::pdb_info_cache_;
 };
 
 class CoverageGrinderTest : public testing::PELibUnitTest {
@@ -118,6 +122,44 @@ TEST_F(CoverageGrinderTest, GrindFailsOnNoCoverageEvents) {
   EXPECT_FALSE(grinder.Grind());
 }
 
+TEST_F(CoverageGrinderTest, SaveAndLoadStateRoundTrip) {
+  TestCoverageGrinder grinder;
+  grinder.ParseCommandLine(&cmd_line_);
+  ASSERT_NO_FATAL_FAILURE(InitParser(&grinder));
+  grinder.SetParser(&parser_);
+  ASSERT_TRUE(parser_.Consume());
+
+  // Serialize the grinder's aggregate state.
+  core::ByteVector bytes;
+  scoped_ptr<core::OutStream> out_stream(
+      core::CreateByteOutStream(std::back_inserter(bytes)));
+  core::NativeBinaryOutArchive out_archive(out_stream.get());
+  ASSERT_TRUE(grinder.SaveState(&out_archive));
+  ASSERT_TRUE(out_archive.Flush());
+
+  // Restore it into a pristine grinder.
+  TestCoverageGrinder other;
+  scoped_ptr<core::InStream> in_stream(
+      core::CreateByteInStream(bytes.begin(), bytes.end()));
+  core::NativeBinaryInArchive in_archive(in_stream.get());
+  ASSERT_TRUE(other.LoadState(&in_archive));
+
+  // The restored grinder must hold the same visit counts as the original.
+  basic_block_util::PdbInfoMap::const_iterator it =
+      grinder.pdb_info_cache_.begin();
+  for (; it != grinder.pdb_info_cache_.end(); ++it) {
+    if (it->second.pdb_path.empty())
+      continue;
+    basic_block_util::PdbInfoMap::const_iterator other_it =
+        other.pdb_info_cache_.find(it->first);
+    ASSERT_TRUE(other_it != other.pdb_info_cache_.end());
+    EXPECT_EQ(it->second.bb_visits, other_it->second.bb_visits);
+  }
+
+  // And it must grind successfully.
+  EXPECT_TRUE(other.Grind());
+}
+
 TEST_F(CoverageGrinderTest, GrindAndOutputLcovDataSucceeds) {
   cmd_line_.AppendSwitchASCII("output-format", "lcov");
   ASSERT_NO_FATAL_FAILURE(GrindAndOutputSucceeds(CoverageGrinder::kLcovFormat));
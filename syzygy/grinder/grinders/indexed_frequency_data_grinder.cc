@@ -14,6 +14,7 @@
 
 #include "syzygy/grinder/grinders/indexed_frequency_data_grinder.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "base/files/file_path.h"
@@ -31,13 +32,15 @@ namespace grinder {
 namespace grinders {
 
 IndexedFrequencyDataGrinder::IndexedFrequencyDataGrinder()
-    : parser_(NULL),
+    : output_binary_(false),
+      parser_(NULL),
       event_handler_errored_(false) {
 }
 
 bool IndexedFrequencyDataGrinder::ParseCommandLine(
     const CommandLine* command_line) {
   serializer_.set_pretty_print(command_line->HasSwitch("pretty-print"));
+  output_binary_ = command_line->HasSwitch("binary");
   return true;
 }
 
@@ -46,6 +49,49 @@ void IndexedFrequencyDataGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool IndexedFrequencyDataGrinder::Merge(GrinderInterface* other) {
+  DCHECK(other != NULL);
+
+  // We can only be merged with grinders of our own type.
+  IndexedFrequencyDataGrinder* grinder =
+      static_cast<IndexedFrequencyDataGrinder*>(other);
+
+  ModuleIndexedFrequencyMap::const_iterator mod_it =
+      grinder->frequency_data_map_.begin();
+  for (; mod_it != grinder->frequency_data_map_.end(); ++mod_it) {
+    ModuleIndexedFrequencyMap::iterator it =
+        frequency_data_map_.find(mod_it->first);
+
+    // Modules seen only by the other grinder are adopted wholesale.
+    if (it == frequency_data_map_.end()) {
+      frequency_data_map_.insert(*mod_it);
+      continue;
+    }
+
+    // Otherwise the metadata must agree, and the frequencies are summed.
+    basic_block_util::IndexedFrequencyInformation& info = it->second;
+    const basic_block_util::IndexedFrequencyInformation& other_info =
+        mod_it->second;
+    if (info.num_columns != other_info.num_columns ||
+        info.data_type != other_info.data_type ||
+        info.frequency_size != other_info.frequency_size) {
+      LOG(ERROR) << "Unable to merge inconsistent frequency data for module: "
+                 << mod_it->first.path << ".";
+      return false;
+    }
+    info.num_entries = std::max(info.num_entries, other_info.num_entries);
+
+    basic_block_util::IndexedFrequencyMap::const_iterator freq_it =
+        other_info.frequency_map.begin();
+    for (; freq_it != other_info.frequency_map.end(); ++freq_it)
+      info.frequency_map[freq_it->first] += freq_it->second;
+  }
+
+  event_handler_errored_ |= grinder->event_handler_errored_;
+
+  return true;
+}
+
 bool IndexedFrequencyDataGrinder::Grind() {
   if (frequency_data_map_.empty()) {
     LOG(ERROR) << "No basic-block frequency data was encountered.";
@@ -57,9 +103,9 @@ bool IndexedFrequencyDataGrinder::Grind() {
 
 bool IndexedFrequencyDataGrinder::OutputData(FILE* file) {
   DCHECK(file != NULL);
-  if (!serializer_.SaveAsJson(frequency_data_map_, file))
-    return false;
-  return true;
+  if (output_binary_)
+    return serializer_.SaveAsBinary(frequency_data_map_, file);
+  return serializer_.SaveAsJson(frequency_data_map_, file);
 }
 
 void IndexedFrequencyDataGrinder::OnIndexedFrequency(
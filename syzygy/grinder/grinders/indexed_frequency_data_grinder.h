@@ -29,11 +29,12 @@
 namespace grinder {
 namespace grinders {
 
-// This class processes trace files containing branch frequency data, populating
-// an IndexedFrequencyMap with summary frequencies, and generating a JSON
-// output file.
+// This class processes trace files containing branch frequency data,
+// populating an IndexedFrequencyMap with summary frequencies, and generating
+// a JSON output file, or a binary columnar output file if --binary is
+// included in the command line passed to ParseCommandLine().
 //
-// See indexed_frequency_data_serializer.h for the resulting JSON structure.
+// See indexed_frequency_data_serializer.h for both output structures.
 //
 // The JSON output will be pretty printed if --pretty-print is included in the
 // command line passed to ParseCommandLine().
@@ -47,6 +48,7 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool Merge(GrinderInterface* other) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -113,10 +115,14 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   // Stores the basic block ID maps for each module encountered.
   InstrumentedModuleMap instrumented_modules_;
 
-  // Used to save the JSON output to a file. Also tracks the pretty-printing
+  // Used to save the output to a file. Also tracks the pretty-printing
   // status of this grinder.
   IndexedFrequencyDataSerializer serializer_;
 
+  // If true the output is written in the binary columnar format rather
+  // than as JSON.
+  bool output_binary_;
+
   // Points to the parser that is feeding us events. Used to get module
   // information.
   Parser* parser_;
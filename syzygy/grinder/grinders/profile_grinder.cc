@@ -16,12 +16,15 @@
 
 #include "base/at_exit.h"
 #include "base/command_line.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/win/scoped_bstr.h"
 #include "syzygy/common/com_utils.h"
+#include "syzygy/grinder/cache_grind_writer.h"
 #include "syzygy/pe/find.h"
+#include "syzygy/pe/pdb_info.h"
 
 namespace grinder {
 namespace grinders {
@@ -57,6 +60,13 @@ bool ModuleInformationKeyLess(const ModuleInformation& a,
   return a.path < b.path;
 }
 
+// The version of the serialized grinder state, as written by SaveState.
+const uint32 kProfileGrinderStateVersion = 1;
+
+// The module index serialized for code locations without module
+// information.
+const uint32 kNoModuleIndex = 0xFFFFFFFF;
+
 }  // namespace
 
 ProfileGrinder::CodeLocation::CodeLocation()
@@ -142,6 +152,7 @@ ProfileGrinder::~ProfileGrinder() {
 
 bool ProfileGrinder::ParseCommandLine(const CommandLine* command_line) {
   thread_parts_ = command_line->HasSwitch("thread-parts");
+  symbol_cache_dir_ = command_line->GetSwitchValuePath("symbol-cache-dir");
   return true;
 }
 
@@ -150,6 +161,294 @@ void ProfileGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool ProfileGrinder::Merge(GrinderInterface* other) {
+  DCHECK(other != NULL);
+
+  // We can only be merged with grinders of our own type.
+  ProfileGrinder* grinder = static_cast<ProfileGrinder*>(other);
+
+  // Merging must happen before callers have been resolved, as resolution
+  // wires the nodes and edges up with raw pointers.
+  DCHECK(module_sessions_.empty());
+  DCHECK(grinder->module_sessions_.empty());
+
+  // Merge the dynamic symbols.
+  dynamic_symbols_.insert(grinder->dynamic_symbols_.begin(),
+                          grinder->dynamic_symbols_.end());
+
+  // Canonicalize the other grinder's modules into our own module set,
+  // remembering where each of its canonical pointers ended up.
+  ModulePointerMap module_map;
+  ModuleInformationSet::const_iterator mod_it = grinder->modules_.begin();
+  for (; mod_it != grinder->modules_.end(); ++mod_it) {
+    ModuleInformationSet::iterator it = modules_.insert(*mod_it).first;
+    module_map[&(*mod_it)] = &(*it);
+  }
+
+  // Merge the parts.
+  PartDataMap::const_iterator part_it = grinder->parts_.begin();
+  for (; part_it != grinder->parts_.end(); ++part_it) {
+    PartData* part = FindOrCreatePart(part_it->second.process_id_,
+                                      part_it->second.thread_id_);
+    if (part->thread_name_.empty())
+      part->thread_name_ = part_it->second.thread_name_;
+    MergePart(module_map, part_it->second, part);
+  }
+
+  return true;
+}
+
+bool ProfileGrinder::SaveCodeLocation(const ModuleIndexMap& module_indexes,
+                                      const CodeLocation& location,
+                                      core::OutArchive* out_archive) {
+  DCHECK(out_archive != NULL);
+
+  if (!out_archive->Save(location.is_symbol()))
+    return false;
+
+  if (location.is_symbol()) {
+    return out_archive->Save(location.process_id()) &&
+        out_archive->Save(location.symbol_id()) &&
+        out_archive->Save(static_cast<uint32>(location.symbol_offset()));
+  }
+
+  uint32 module_index = kNoModuleIndex;
+  if (location.module() != NULL) {
+    ModuleIndexMap::const_iterator it =
+        module_indexes.find(location.module());
+    DCHECK(it != module_indexes.end());
+    module_index = it->second;
+  }
+  return out_archive->Save(module_index) && out_archive->Save(location.rva());
+}
+
+bool ProfileGrinder::LoadCodeLocation(
+    const std::vector<const ModuleInformation*>& modules,
+    CodeLocation* location,
+    core::InArchive* in_archive) {
+  DCHECK(location != NULL);
+  DCHECK(in_archive != NULL);
+
+  bool is_symbol = false;
+  if (!in_archive->Load(&is_symbol))
+    return false;
+
+  if (is_symbol) {
+    uint32 process_id = 0;
+    uint32 symbol_id = 0;
+    uint32 symbol_offset = 0;
+    if (!in_archive->Load(&process_id) || !in_archive->Load(&symbol_id) ||
+        !in_archive->Load(&symbol_offset)) {
+      return false;
+    }
+    location->Set(process_id, symbol_id, symbol_offset);
+    return true;
+  }
+
+  uint32 module_index = 0;
+  RVA rva = 0;
+  if (!in_archive->Load(&module_index) || !in_archive->Load(&rva))
+    return false;
+
+  const ModuleInformation* module = NULL;
+  if (module_index != kNoModuleIndex) {
+    if (module_index >= modules.size())
+      return false;
+    module = modules[module_index];
+  }
+  location->Set(module, rva);
+  return true;
+}
+
+bool ProfileGrinder::SaveMetrics(const Metrics& metrics,
+                                 core::OutArchive* out_archive) {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(metrics.num_calls) &&
+      out_archive->Save(metrics.cycles_min) &&
+      out_archive->Save(metrics.cycles_max) &&
+      out_archive->Save(metrics.cycles_sum);
+}
+
+bool ProfileGrinder::LoadMetrics(Metrics* metrics,
+                                 core::InArchive* in_archive) {
+  DCHECK(metrics != NULL);
+  DCHECK(in_archive != NULL);
+  return in_archive->Load(&metrics->num_calls) &&
+      in_archive->Load(&metrics->cycles_min) &&
+      in_archive->Load(&metrics->cycles_max) &&
+      in_archive->Load(&metrics->cycles_sum);
+}
+
+bool ProfileGrinder::SaveState(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  // Serialization must happen before callers have been resolved, as
+  // resolution wires the nodes and edges up with raw pointers.
+  DCHECK(module_sessions_.empty());
+
+  if (!out_archive->Save(kProfileGrinderStateVersion))
+    return false;
+
+  // Serialize the modules, remembering the index each canonical module
+  // pointer is serialized at. Code locations refer to their module by that
+  // index.
+  if (!out_archive->Save(static_cast<uint32>(modules_.size())))
+    return false;
+  ModuleIndexMap module_indexes;
+  uint32 module_index = 0;
+  ModuleInformationSet::const_iterator mod_it = modules_.begin();
+  for (; mod_it != modules_.end(); ++mod_it, ++module_index) {
+    if (!mod_it->Save(out_archive))
+      return false;
+    module_indexes[&(*mod_it)] = module_index;
+  }
+
+  if (!out_archive->Save(dynamic_symbols_))
+    return false;
+
+  if (!out_archive->Save(static_cast<uint32>(parts_.size())))
+    return false;
+  PartDataMap::const_iterator part_it = parts_.begin();
+  for (; part_it != parts_.end(); ++part_it) {
+    const PartData& part = part_it->second;
+    if (!out_archive->Save(part.thread_name_) ||
+        !out_archive->Save(part.process_id_) ||
+        !out_archive->Save(part.thread_id_)) {
+      return false;
+    }
+
+    if (!out_archive->Save(static_cast<uint32>(part.nodes_.size())))
+      return false;
+    InvocationNodeMap::const_iterator node_it = part.nodes_.begin();
+    for (; node_it != part.nodes_.end(); ++node_it) {
+      DCHECK(node_it->second.first_call == NULL);
+      if (!SaveCodeLocation(module_indexes, node_it->second.function,
+                            out_archive) ||
+          !SaveMetrics(node_it->second.metrics, out_archive)) {
+        return false;
+      }
+    }
+
+    // Edge line numbers and caller links are not serialized; they are only
+    // computed during caller resolution, which happens at grind time.
+    if (!out_archive->Save(static_cast<uint32>(part.edges_.size())))
+      return false;
+    InvocationEdgeMap::const_iterator edge_it = part.edges_.begin();
+    for (; edge_it != part.edges_.end(); ++edge_it) {
+      DCHECK(edge_it->second.caller_function == NULL);
+      DCHECK(edge_it->second.next_call == NULL);
+      if (!SaveCodeLocation(module_indexes, edge_it->second.function,
+                            out_archive) ||
+          !SaveCodeLocation(module_indexes, edge_it->second.caller,
+                            out_archive) ||
+          !SaveMetrics(edge_it->second.metrics, out_archive)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool ProfileGrinder::LoadState(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+  DCHECK(modules_.empty());
+  DCHECK(dynamic_symbols_.empty());
+  DCHECK(parts_.empty());
+
+  uint32 version = 0;
+  if (!in_archive->Load(&version) ||
+      version != kProfileGrinderStateVersion) {
+    LOG(ERROR) << "Unsupported profile grinder state version.";
+    return false;
+  }
+
+  // Load the modules, recording the canonical pointer each serialized module
+  // index resolves to.
+  uint32 num_modules = 0;
+  if (!in_archive->Load(&num_modules))
+    return false;
+  std::vector<const ModuleInformation*> modules;
+  modules.reserve(num_modules);
+  for (uint32 i = 0; i < num_modules; ++i) {
+    ModuleInformation module_info;
+    if (!module_info.Load(in_archive))
+      return false;
+    modules.push_back(&(*modules_.insert(module_info).first));
+  }
+
+  if (!in_archive->Load(&dynamic_symbols_))
+    return false;
+
+  uint32 num_parts = 0;
+  if (!in_archive->Load(&num_parts))
+    return false;
+  for (uint32 i = 0; i < num_parts; ++i) {
+    std::string thread_name;
+    uint32 process_id = 0;
+    uint32 thread_id = 0;
+    if (!in_archive->Load(&thread_name) || !in_archive->Load(&process_id) ||
+        !in_archive->Load(&thread_id)) {
+      return false;
+    }
+
+    // The nodes and edges are folded in the same way MergePart folds the
+    // parts of another grinder, so that the loaded state need not have been
+    // produced with the same thread-parts configuration.
+    PartData* part = FindOrCreatePart(process_id, thread_id);
+    if (part->thread_name_.empty())
+      part->thread_name_ = thread_name;
+
+    uint32 num_nodes = 0;
+    if (!in_archive->Load(&num_nodes))
+      return false;
+    for (uint32 j = 0; j < num_nodes; ++j) {
+      FunctionLocation function;
+      Metrics metrics;
+      if (!LoadCodeLocation(modules, &function, in_archive) ||
+          !LoadMetrics(&metrics, in_archive)) {
+        return false;
+      }
+
+      InvocationNodeMap::iterator it = part->nodes_.find(function);
+      if (it == part->nodes_.end()) {
+        InvocationNode& node = part->nodes_[function];
+        node.function = function;
+        node.metrics = metrics;
+      } else {
+        MergeMetrics(metrics, &it->second.metrics);
+      }
+    }
+
+    uint32 num_edges = 0;
+    if (!in_archive->Load(&num_edges))
+      return false;
+    for (uint32 j = 0; j < num_edges; ++j) {
+      FunctionLocation function;
+      CallerLocation caller;
+      Metrics metrics;
+      if (!LoadCodeLocation(modules, &function, in_archive) ||
+          !LoadCodeLocation(modules, &caller, in_archive) ||
+          !LoadMetrics(&metrics, in_archive)) {
+        return false;
+      }
+
+      InvocationEdgeKey key(function, caller);
+      InvocationEdgeMap::iterator it = part->edges_.find(key);
+      if (it == part->edges_.end()) {
+        InvocationEdge& edge = part->edges_[key];
+        edge.function = function;
+        edge.caller = caller;
+        edge.metrics = metrics;
+      } else {
+        MergeMetrics(metrics, &it->second.metrics);
+      }
+    }
+  }
+
+  return true;
+}
+
 bool ProfileGrinder::Grind() {
   if (!ResolveCallers()) {
     LOG(ERROR) << "Error resolving callers.";
@@ -241,6 +540,41 @@ bool ProfileGrinder::GetSessionForModule(const ModuleInformation* module,
   return true;
 }
 
+ProfileSymbolCache* ProfileGrinder::GetCacheForModule(
+    const ModuleInformation* module) {
+  DCHECK(module != NULL);
+
+  if (symbol_cache_dir_.empty())
+    return NULL;
+
+  ModuleCacheMap::const_iterator it = module_caches_.find(module);
+  if (it != module_caches_.end())
+    return it->second;
+
+  // Failures are recorded as NULL entries so that each module is probed,
+  // and logged, only once.
+  ProfileSymbolCache* cache = NULL;
+
+  base::FilePath module_path;
+  pe::PdbInfo pdb_info;
+  if (!pe::FindModuleBySignature(*module, &module_path) ||
+      module_path.empty() ||
+      !pdb_info.Init(module_path)) {
+    LOG(WARNING) << "Unable to identify the PDB for module \""
+                 << module->path << "\"; not caching its symbols.";
+  } else {
+    scoped_ptr<ProfileSymbolCache> new_cache(new ProfileSymbolCache());
+    if (new_cache->Init(symbol_cache_dir_, pdb_info.signature(),
+                        pdb_info.pdb_age())) {
+      cache = new_cache.release();
+      symbol_caches_.push_back(cache);
+    }
+  }
+
+  module_caches_.insert(std::make_pair(module, cache));
+  return cache;
+}
+
 ProfileGrinder::PartData* ProfileGrinder::FindOrCreatePart(DWORD process_id,
                                                            DWORD thread_id) {
   if (!thread_parts_) {
@@ -314,6 +648,20 @@ bool ProfileGrinder::GetFunctionForCaller(const CallerLocation& caller,
     return true;
   }
 
+  // Consult the persistent symbol cache first, if enabled, so that repeated
+  // grinds against the same module can skip DIA entirely.
+  ProfileSymbolCache* cache = GetCacheForModule(caller.module());
+  if (cache != NULL) {
+    RVA function_rva = 0;
+    uint32 cached_line = 0;
+    if (cache->GetFunctionForCaller(caller.rva(), &function_rva,
+                                    &cached_line)) {
+      function->Set(caller.module(), function_rva);
+      *line = cached_line;
+      return true;
+    }
+  }
+
   ScopedComPtr<IDiaSession> session;
   if (!GetSessionForModule(caller.module(), session.Receive()))
     return false;
@@ -376,6 +724,9 @@ bool ProfileGrinder::GetFunctionForCaller(const CallerLocation& caller,
     }
   }
 
+  if (cache != NULL)
+    cache->SetFunctionForCaller(caller.rva(), rva, line_number);
+
   *line = line_number;
   return true;
 }
@@ -417,6 +768,17 @@ bool ProfileGrinder::GetInfoForFunction(const FunctionLocation& function,
     return true;
   }
 
+  // Consult the persistent symbol cache first, if enabled.
+  ProfileSymbolCache* cache = GetCacheForModule(function.module());
+  if (cache != NULL) {
+    uint32 cached_line = 0;
+    if (cache->GetInfoForFunction(function.rva(), function_name, file_name,
+                                  &cached_line)) {
+      *line = cached_line;
+      return true;
+    }
+  }
+
   ScopedComPtr<IDiaSession> session;
   if (!GetSessionForModule(function.module(), session.Receive()))
     return false;
@@ -489,6 +851,12 @@ bool ProfileGrinder::GetInfoForFunction(const FunctionLocation& function,
 
   *file_name = common::ToString(file_name_bstr);
   *line = line_number;
+
+  if (cache != NULL) {
+    cache->SetInfoForFunction(function.rva(), *function_name, *file_name,
+                              line_number);
+  }
+
   return true;
 }
 
@@ -553,27 +921,48 @@ bool ProfileGrinder::ResolveCallersForPart(PartData* part) {
 bool ProfileGrinder::OutputData(FILE* file) {
   // Output the file header.
 
+  // A single writer spans all the parts, as the name identifiers it hands
+  // out are scoped to the output file.
+  CacheGrindWriter writer(file);
+
   bool succeeded = true;
   PartDataMap::iterator it = parts_.begin();
   for (; it != parts_.end(); ++it) {
-    if (!OutputDataForPart(it->second, file)) {
+    if (!OutputDataForPart(it->second, &writer)) {
       // Keep going despite problems in output
       succeeded = false;
     }
   }
 
+  if (!writer.Flush())
+    succeeded = false;
+
+  // Persist any symbol resolutions added during this grind. Failure to do
+  // so costs a cache miss on the next grind, but doesn't affect the output.
+  ScopedVector<ProfileSymbolCache>::iterator cache_it =
+      symbol_caches_.begin();
+  for (; cache_it != symbol_caches_.end(); ++cache_it) {
+    if (!(*cache_it)->Save()) {
+      LOG(WARNING) << "Failed to save symbol cache '"
+                   << (*cache_it)->path().value() << "'.";
+    }
+  }
+
   return succeeded;
 }
 
-bool ProfileGrinder::OutputDataForPart(const PartData& part, FILE* file) {
+bool ProfileGrinder::OutputDataForPart(const PartData& part,
+                                       CacheGrindWriter* writer) {
+  DCHECK(writer != NULL);
+
   // TODO(siggi): Output command line here.
-  ::fprintf(file, "pid: %d\n", part.process_id_);
+  writer->AppendF("pid: %d\n", part.process_id_);
   if (part.thread_id_ != 0)
-    ::fprintf(file, "thread: %d\n", part.thread_id_);
-  ::fprintf(file, "events: Calls Cycles Cycles-Min Cycles-Max\n");
+    writer->AppendF("thread: %d\n", part.thread_id_);
+  writer->AppendF("events: Calls Cycles Cycles-Min Cycles-Max\n");
 
   if (!part.thread_name_.empty())
-    ::fprintf(file, "desc: Trigger: %s\n", part.thread_name_.c_str());
+    writer->AppendF("desc: Trigger: %s\n", part.thread_name_.c_str());
 
   // Walk the nodes and output the data.
   InvocationNodeMap::const_iterator node_it(part.nodes_.begin());
@@ -586,12 +975,14 @@ bool ProfileGrinder::OutputDataForPart(const PartData& part, FILE* file) {
       // Rewrite file path to use forward slashes instead of back slashes.
       base::ReplaceChars(file_name, L"\\", L"/", &file_name);
 
-      // Output the function information.
-      ::fprintf(file, "fl=%ws\n", file_name.c_str());
-      ::fprintf(file, "fn=%ws\n", function_name.c_str());
-      ::fprintf(file, "%d %I64d %I64d %I64d %I64d\n", line,
-                node.metrics.num_calls, node.metrics.cycles_sum,
-                node.metrics.cycles_min, node.metrics.cycles_max);
+      // Output the function information. Names are routed through the
+      // format's string table, as the same files and functions recur
+      // throughout the output.
+      writer->AppendFileName("fl", file_name);
+      writer->AppendFunctionName("fn", function_name);
+      writer->AppendF("%d %I64d %I64d %I64d %I64d\n", line,
+                      node.metrics.num_calls, node.metrics.cycles_sum,
+                      node.metrics.cycles_min, node.metrics.cycles_max);
 
       // Output the call information from this function.
       const InvocationEdge* call = node.first_call;
@@ -604,12 +995,12 @@ bool ProfileGrinder::OutputDataForPart(const PartData& part, FILE* file) {
           // Rewrite file path to use forward slashes instead of back slashes.
           base::ReplaceChars(file_name, L"\\", L"/", &file_name);
 
-          ::fprintf(file, "cfl=%ws\n", file_name.c_str());
-          ::fprintf(file, "cfn=%ws\n", function_name.c_str());
-          ::fprintf(file, "calls=%d %d\n", call->metrics.num_calls, line);
-          ::fprintf(file, "%d %I64d %I64d %I64d %I64d\n", call->line,
-                    call->metrics.num_calls, call->metrics.cycles_sum,
-                    call->metrics.cycles_min, call->metrics.cycles_max);
+          writer->AppendFileName("cfl", file_name);
+          writer->AppendFunctionName("cfn", function_name);
+          writer->AppendF("calls=%d %d\n", call->metrics.num_calls, line);
+          writer->AppendF("%d %I64d %I64d %I64d %I64d\n", call->line,
+                          call->metrics.num_calls, call->metrics.cycles_sum,
+                          call->metrics.cycles_min, call->metrics.cycles_max);
         }
       }
     } else {
@@ -737,6 +1128,74 @@ void ProfileGrinder::AggregateEntryToPart(const FunctionLocation& function,
   }
 }
 
+void ProfileGrinder::MergePart(const ModulePointerMap& module_map,
+                               const PartData& from,
+                               PartData* to) {
+  DCHECK(to != NULL);
+
+  // Merge the function nodes.
+  InvocationNodeMap::const_iterator node_it = from.nodes_.begin();
+  for (; node_it != from.nodes_.end(); ++node_it) {
+    DCHECK(node_it->second.first_call == NULL);
+
+    FunctionLocation function = node_it->second.function;
+    RemapCodeLocation(module_map, &function);
+
+    InvocationNodeMap::iterator it = to->nodes_.find(function);
+    if (it == to->nodes_.end()) {
+      InvocationNode& node = to->nodes_[function];
+      node.function = function;
+      node.metrics = node_it->second.metrics;
+    } else {
+      MergeMetrics(node_it->second.metrics, &it->second.metrics);
+    }
+  }
+
+  // Merge the caller/function edges.
+  InvocationEdgeMap::const_iterator edge_it = from.edges_.begin();
+  for (; edge_it != from.edges_.end(); ++edge_it) {
+    DCHECK(edge_it->second.caller_function == NULL);
+    DCHECK(edge_it->second.next_call == NULL);
+
+    FunctionLocation function = edge_it->second.function;
+    RemapCodeLocation(module_map, &function);
+    CallerLocation caller = edge_it->second.caller;
+    RemapCodeLocation(module_map, &caller);
+
+    InvocationEdgeKey key(function, caller);
+    InvocationEdgeMap::iterator it = to->edges_.find(key);
+    if (it == to->edges_.end()) {
+      InvocationEdge& edge = to->edges_[key];
+      edge.function = function;
+      edge.caller = caller;
+      edge.metrics = edge_it->second.metrics;
+    } else {
+      MergeMetrics(edge_it->second.metrics, &it->second.metrics);
+    }
+  }
+}
+
+void ProfileGrinder::RemapCodeLocation(const ModulePointerMap& module_map,
+                                       CodeLocation* location) {
+  DCHECK(location != NULL);
+
+  if (location->is_symbol() || location->module() == NULL)
+    return;
+
+  ModulePointerMap::const_iterator it = module_map.find(location->module());
+  DCHECK(it != module_map.end());
+  location->Set(it->second, location->rva());
+}
+
+void ProfileGrinder::MergeMetrics(const Metrics& metrics, Metrics* target) {
+  DCHECK(target != NULL);
+
+  target->num_calls += metrics.num_calls;
+  target->cycles_min = std::min(target->cycles_min, metrics.cycles_min);
+  target->cycles_max = std::max(target->cycles_max, metrics.cycles_max);
+  target->cycles_sum += metrics.cycles_sum;
+}
+
 void ProfileGrinder::ConvertToModuleRVA(uint32 process_id,
                                         AbsoluteAddress64 addr,
                                         CodeLocation* rva) {
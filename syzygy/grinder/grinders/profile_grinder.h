@@ -17,15 +17,20 @@
 #include <dia2.h>
 #include <iostream>
 #include <map>
+#include <vector>
 
 #include "base/files/file_path.h"
+#include "base/memory/scoped_vector.h"
 #include "base/win/scoped_comptr.h"
 #include "syzygy/grinder/grinder.h"
+#include "syzygy/grinder/grinders/profile_symbol_cache.h"
 
 namespace grinder {
-namespace grinders {
 
-typedef uint32 RVA;
+// Forward declaration.
+class CacheGrindWriter;
+
+namespace grinders {
 
 // A worker class to sink profile trace events and output the aggregate data in
 // KCacheGrind-compatible format.
@@ -69,12 +74,23 @@ class ProfileGrinder : public GrinderInterface {
   // separate parts for each thread seen in the trace file(s).
   bool thread_parts() const { return thread_parts_; }
   void set_thread_parts(bool thread_parts) { thread_parts_ = thread_parts; }
+
+  // If symbol_cache_dir is non-empty, symbol resolutions are cached in
+  // per-PDB files in that directory and reused by subsequent grinds of
+  // traces against the same modules.
+  const base::FilePath& symbol_cache_dir() const { return symbol_cache_dir_; }
+  void set_symbol_cache_dir(const base::FilePath& symbol_cache_dir) {
+    symbol_cache_dir_ = symbol_cache_dir;
+  }
   // @}
 
   // @name GrinderInterface implementation.
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool Merge(GrinderInterface* other) OVERRIDE;
+  virtual bool SaveState(core::OutArchive* out_archive) const OVERRIDE;
+  virtual bool LoadState(core::InArchive* in_archive) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -127,9 +143,41 @@ class ProfileGrinder : public GrinderInterface {
   typedef base::win::ScopedComPtr<IDiaSession> SessionPtr;
   typedef std::map<const ModuleInformation*, SessionPtr> ModuleSessionMap;
 
+  // Maps another grinder's canonical module pointers to our own. Used while
+  // merging the data of another grinder into this one.
+  typedef std::map<const ModuleInformation*, const ModuleInformation*>
+      ModulePointerMap;
+
+  // Maps canonical module pointers to the index their module information is
+  // serialized at. Used while serializing aggregate state.
+  typedef std::map<const ModuleInformation*, uint32> ModuleIndexMap;
+
+  // @name Helpers for serializing aggregate state. Code locations are
+  //     serialized with their module pointer replaced by the module's index
+  //     in the serialized module list, and resolved back to this grinder's
+  //     canonical pointers on load.
+  // @{
+  static bool SaveCodeLocation(const ModuleIndexMap& module_indexes,
+                               const CodeLocation& location,
+                               core::OutArchive* out_archive);
+  static bool LoadCodeLocation(
+      const std::vector<const ModuleInformation*>& modules,
+      CodeLocation* location,
+      core::InArchive* in_archive);
+  static bool SaveMetrics(const Metrics& metrics,
+                          core::OutArchive* out_archive);
+  static bool LoadMetrics(Metrics* metrics, core::InArchive* in_archive);
+  // @}
+
   bool GetSessionForModule(const ModuleInformation* module,
                            IDiaSession** session_out);
 
+  // Retrieves the persistent symbol cache for @p module, creating it on
+  // first use.
+  // @returns the cache, or NULL if symbol caching is disabled or the
+  //     module's PDB could not be identified.
+  ProfileSymbolCache* GetCacheForModule(const ModuleInformation* module);
+
   // Finds or creates the part data for the given @p thread_id.
   PartData* FindOrCreatePart(DWORD process_id, DWORD thread_id);
 
@@ -165,6 +213,22 @@ class ProfileGrinder : public GrinderInterface {
                             const InvocationInfo& info,
                             PartData* part);
 
+  // Merges the nodes and edges of @p from into @p to, remapping module
+  // pointers through @p module_map.
+  void MergePart(const ModulePointerMap& module_map,
+                 const PartData& from,
+                 PartData* to);
+
+  // Points @p location at this grinder's canonical module information, as
+  // given by @p module_map. Symbol locations and locations without module
+  // information are left untouched.
+  static void RemapCodeLocation(const ModulePointerMap& module_map,
+                                CodeLocation* location);
+
+  // Aggregates @p metrics into @p target, the same way repeated invocation
+  // records are aggregated.
+  static void MergeMetrics(const Metrics& metrics, Metrics* target);
+
   // This functions adds all caller edges to each function node's linked list of
   // callers. In so doing, it also computes each function node's inclusive cost.
   // @returns true on success, false on failure.
@@ -173,8 +237,10 @@ class ProfileGrinder : public GrinderInterface {
   // Resolves callers for @p part.
   bool ResolveCallersForPart(PartData* part);
 
-  // Outputs data for @p part to @p file.
-  bool OutputDataForPart(const PartData& part, FILE* file);
+  // Outputs data for @p part through @p writer. The writer is shared
+  // between parts, as the file format scopes name identifiers to the
+  // output file, not to a part.
+  bool OutputDataForPart(const PartData& part, CacheGrindWriter* writer);
 
   // Keeps track of the dynamic symbols seen.
   DynamicSymbolMap dynamic_symbols_;
@@ -185,6 +251,19 @@ class ProfileGrinder : public GrinderInterface {
   // Stores the DIA session objects we have going for each module.
   ModuleSessionMap module_sessions_;
 
+  // The directory holding the persistent symbol resolution caches. Caching
+  // is disabled when empty.
+  base::FilePath symbol_cache_dir_;
+
+  // Owns the symbol caches in use.
+  ScopedVector<ProfileSymbolCache> symbol_caches_;
+
+  // Maps modules to their symbol cache. Failures are recorded as NULL
+  // entries so that each module is probed only once.
+  typedef std::map<const ModuleInformation*, ProfileSymbolCache*>
+      ModuleCacheMap;
+  ModuleCacheMap module_caches_;
+
   // The parts we store. If thread_parts_ is false, we store only a single
   // part with id 0. The parts are keyed on process id/thread id.
   typedef std::pair<uint32, uint32> PartKey;
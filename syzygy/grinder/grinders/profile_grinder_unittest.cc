@@ -14,8 +14,11 @@
 
 #include "syzygy/grinder/grinders/profile_grinder.h"
 
+#include <iterator>
+
 #include "base/win/scoped_com_initializer.h"
 #include "gtest/gtest.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pe/unittest_util.h"
 
@@ -206,6 +209,46 @@ TEST_F(ProfileGrinderTest, GrindSymbolTestData) {
   EXPECT_EQ(kCallerSymbolId, it->first.symbol_id());
 }
 
+TEST_F(ProfileGrinderTest, SaveAndLoadStateRoundTrip) {
+  // Aggregate a symbol invocation event into a test grinder.
+  TestProfileGrinder grinder;
+  IssueSetupEvents(&grinder);
+  IssueSymbolInvocationEvent(&grinder);
+
+  // Serialize the grinder's aggregate state.
+  core::ByteVector bytes;
+  scoped_ptr<core::OutStream> out_stream(
+      core::CreateByteOutStream(std::back_inserter(bytes)));
+  core::NativeBinaryOutArchive out_archive(out_stream.get());
+  ASSERT_TRUE(grinder.SaveState(&out_archive));
+  ASSERT_TRUE(out_archive.Flush());
+
+  // Restore it into a pristine grinder.
+  TestProfileGrinder other;
+  scoped_ptr<core::InStream> in_stream(
+      core::CreateByteInStream(bytes.begin(), bytes.end()));
+  core::NativeBinaryInArchive in_archive(in_stream.get());
+  ASSERT_TRUE(other.LoadState(&in_archive));
+
+  // The restored grinder must contain the same aggregates.
+  ASSERT_EQ(1u, other.parts_.size());
+  TestProfileGrinder::PartData* part =
+      other.FindOrCreatePart(::GetCurrentProcessId(),
+                             ::GetCurrentThreadId());
+  ASSERT_TRUE(part != NULL);
+  EXPECT_EQ("TestThread", part->thread_name_);
+  EXPECT_EQ(2u, part->nodes_.size());
+  ASSERT_EQ(1u, part->edges_.size());
+  EXPECT_EQ(1000u, part->edges_.begin()->second.metrics.num_calls);
+
+  // Further events must aggregate on top of the restored state.
+  IssueSymbolInvocationEvent(&other);
+  EXPECT_EQ(2000u, part->edges_.begin()->second.metrics.num_calls);
+
+  // The restored state must grind successfully.
+  ASSERT_TRUE(other.Grind());
+}
+
 TEST_F(ProfileGrinderTest, ParseEmptyCommandLineSucceeds) {
   TestProfileGrinder grinder;
   EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
@@ -0,0 +1,232 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/grinders/profile_symbol_cache.h"
+
+#include "base/file_util.h"
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+#include "base/strings/stringprintf.h"
+#include "syzygy/core/serialization.h"
+
+namespace grinder {
+namespace grinders {
+
+namespace {
+
+// The version of the cache file format. Bump this whenever the serialized
+// contents change; old cache files are simply discarded.
+const uint32 kProfileSymbolCacheVersion = 1;
+
+// The tags mixed into shared symbol cache keys, distinguishing the kinds of
+// question (and value encodings) this cache publishes. The RVA occupies the
+// low 32 bits of the key.
+const uint64 kSharedCallerKeyTag = 1ULL << 32;
+const uint64 kSharedFunctionKeyTag = 2ULL << 32;
+
+// Encodes/decodes the value blob published under a function key.
+void EncodeFunctionInfo(const std::wstring& function_name,
+                        const std::wstring& file_name,
+                        uint32 line,
+                        std::string* value) {
+  DCHECK(value != NULL);
+  core::ByteVector bytes;
+  core::VectorOutStream out_stream(&bytes);
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  CHECK(out_archive.Save(function_name) &&
+        out_archive.Save(file_name) &&
+        out_archive.Save(line));
+  value->assign(bytes.begin(), bytes.end());
+}
+
+bool DecodeFunctionInfo(const std::string& value,
+                        std::wstring* function_name,
+                        std::wstring* file_name,
+                        uint32* line) {
+  DCHECK(function_name != NULL);
+  DCHECK(file_name != NULL);
+  DCHECK(line != NULL);
+  const core::Byte* data =
+      reinterpret_cast<const core::Byte*>(value.data());
+  core::ByteInStream<const core::Byte*> in_stream(data, data + value.size());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  return in_archive.Load(function_name) &&
+      in_archive.Load(file_name) &&
+      in_archive.Load(line);
+}
+
+}  // namespace
+
+ProfileSymbolCache::ProfileSymbolCache()
+    : shared_cache_usable_(false), dirty_(false) {
+}
+
+bool ProfileSymbolCache::Init(const base::FilePath& cache_dir,
+                              const GUID& signature,
+                              uint32 age) {
+  DCHECK(file_path_.empty());
+
+  if (!base::CreateDirectory(cache_dir)) {
+    LOG(ERROR) << "Failed to create symbol cache directory '"
+               << cache_dir.value() << "'.";
+    return false;
+  }
+
+  wchar_t guid_str[40] = {};
+  ::StringFromGUID2(signature, guid_str, arraysize(guid_str));
+  file_path_ = cache_dir.Append(
+      base::StringPrintf(L"%ls-%u.syms", guid_str, age));
+
+  // Load any previously saved contents. An unreadable or incompatible cache
+  // file is not an error; the cache simply starts out empty and the file is
+  // overwritten by the next save.
+  base::ScopedFILE file(base::OpenFile(file_path_, "rb"));
+  if (file.get() != NULL) {
+    core::FileInStream in_stream(file.get());
+    core::NativeBinaryInArchive in_archive(&in_stream);
+    uint32 version = 0;
+    if (!in_archive.Load(&version) ||
+        version != kProfileSymbolCacheVersion ||
+        !in_archive.Load(&callers_) ||
+        !in_archive.Load(&functions_)) {
+      LOG(WARNING) << "Ignoring incompatible symbol cache file '"
+                   << file_path_.value() << "'.";
+      callers_.clear();
+      functions_.clear();
+    }
+  }
+
+  // Attach to the machine-local cache shared with concurrently running
+  // tools. This is strictly an accelerator, so failing to attach is not an
+  // error; this cache simply runs on its own.
+  shared_cache_usable_ = shared_cache_.Init(signature, age);
+
+  return true;
+}
+
+bool ProfileSymbolCache::GetFunctionForCaller(RVA caller,
+                                              RVA* function_rva,
+                                              uint32* line) const {
+  DCHECK(function_rva != NULL);
+  DCHECK(line != NULL);
+
+  CallerInfoMap::const_iterator it = callers_.find(caller);
+  if (it != callers_.end()) {
+    *function_rva = it->second.first;
+    *line = it->second.second;
+    return true;
+  }
+
+  // On a local miss, try the resolutions published by other processes.
+  std::string value;
+  if (shared_cache_usable_ &&
+      shared_cache_.Lookup(kSharedCallerKeyTag | caller, &value) &&
+      value.size() == 2 * sizeof(uint32)) {
+    ::memcpy(function_rva, value.data(), sizeof(uint32));
+    ::memcpy(line, value.data() + sizeof(uint32), sizeof(uint32));
+    return true;
+  }
+
+  return false;
+}
+
+void ProfileSymbolCache::SetFunctionForCaller(RVA caller,
+                                              RVA function_rva,
+                                              uint32 line) {
+  callers_[caller] = CallerInfo(function_rva, line);
+  dirty_ = true;
+
+  if (shared_cache_usable_) {
+    uint32 packed[2] = { function_rva, line };
+    shared_cache_.Insert(
+        kSharedCallerKeyTag | caller,
+        base::StringPiece(reinterpret_cast<const char*>(packed),
+                          sizeof(packed)));
+  }
+}
+
+bool ProfileSymbolCache::GetInfoForFunction(RVA function,
+                                            std::wstring* function_name,
+                                            std::wstring* file_name,
+                                            uint32* line) const {
+  DCHECK(function_name != NULL);
+  DCHECK(file_name != NULL);
+  DCHECK(line != NULL);
+
+  FunctionInfoMap::const_iterator it = functions_.find(function);
+  if (it != functions_.end()) {
+    *function_name = it->second.function_name;
+    *file_name = it->second.file_name;
+    *line = it->second.line;
+    return true;
+  }
+
+  // On a local miss, try the resolutions published by other processes.
+  std::string value;
+  if (shared_cache_usable_ &&
+      shared_cache_.Lookup(kSharedFunctionKeyTag | function, &value) &&
+      DecodeFunctionInfo(value, function_name, file_name, line)) {
+    return true;
+  }
+
+  return false;
+}
+
+void ProfileSymbolCache::SetInfoForFunction(RVA function,
+                                            const std::wstring& function_name,
+                                            const std::wstring& file_name,
+                                            uint32 line) {
+  FunctionInfo& info = functions_[function];
+  info.function_name = function_name;
+  info.file_name = file_name;
+  info.line = line;
+  dirty_ = true;
+
+  if (shared_cache_usable_) {
+    std::string value;
+    EncodeFunctionInfo(function_name, file_name, line, &value);
+    shared_cache_.Insert(kSharedFunctionKeyTag | function, value);
+  }
+}
+
+bool ProfileSymbolCache::Save() {
+  DCHECK(!file_path_.empty());
+
+  if (!dirty_)
+    return true;
+
+  base::ScopedFILE file(base::OpenFile(file_path_, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open symbol cache file '" << file_path_.value()
+               << "' for writing.";
+    return false;
+  }
+
+  core::FileOutStream out_stream(file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  if (!out_archive.Save(kProfileSymbolCacheVersion) ||
+      !out_archive.Save(callers_) ||
+      !out_archive.Save(functions_) ||
+      !out_archive.Flush()) {
+    LOG(ERROR) << "Failed to write symbol cache file '" << file_path_.value()
+               << "'.";
+    return false;
+  }
+
+  dirty_ = false;
+  return true;
+}
+
+}  // namespace grinders
+}  // namespace grinder
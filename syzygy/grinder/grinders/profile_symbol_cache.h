@@ -0,0 +1,159 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares ProfileSymbolCache, a persistent cache of the symbol resolutions
+// ProfileGrinder performs against a single module's symbols. The cache is
+// backed by a file named after the GUID and age of the module's PDB, so a
+// cache entry can never be served against the wrong symbols; rebuilding a
+// module simply starts a fresh cache file. Repeated grinds of traces against
+// the same modules are served entirely from the cache, skipping DIA. The
+// cache also attaches to the machine-local shared symbol cache for the PDB,
+// so that concurrently running grinders share resolutions as they are made
+// rather than each holding a DIA session over the same symbols.
+
+#ifndef SYZYGY_GRINDER_GRINDERS_PROFILE_SYMBOL_CACHE_H_
+#define SYZYGY_GRINDER_GRINDERS_PROFILE_SYMBOL_CACHE_H_
+
+#include <windows.h>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "base/basictypes.h"
+#include "base/files/file_path.h"
+#include "syzygy/common/shared_symbol_cache.h"
+
+namespace grinder {
+namespace grinders {
+
+typedef uint32 RVA;
+
+// A persistent cache of RVA to function resolutions for a single module,
+// keyed by the GUID and age of the module's PDB. Usage:
+//
+//   ProfileSymbolCache cache;
+//   cache.Init(cache_dir, pdb_guid, pdb_age);  // Loads any previous cache.
+//   ... calls to GetFunctionForCaller/SetFunctionForCaller and
+//       GetInfoForFunction/SetInfoForFunction ...
+//   cache.Save();  // Persists any newly added entries.
+class ProfileSymbolCache {
+ public:
+  ProfileSymbolCache();
+
+  // Initializes this cache to be backed by a file in @p cache_dir named
+  // after @p signature and @p age, creating @p cache_dir if necessary. If a
+  // previous cache file exists its contents are loaded; an unreadable or
+  // incompatible file is ignored and will be overwritten by the next Save.
+  // @param cache_dir the directory holding the cache files.
+  // @param signature the GUID of the module's PDB.
+  // @param age the age of the module's PDB.
+  // @returns true on success, false if the cache directory can't be created.
+  bool Init(const base::FilePath& cache_dir,
+            const GUID& signature,
+            uint32 age);
+
+  // Looks up the function enclosing the caller address @p caller.
+  // @param caller the RVA of the call site.
+  // @param function_rva on success receives the RVA of the enclosing
+  //     function.
+  // @param line on success receives the line number of the call site.
+  // @returns true if the cache contains an entry for @p caller.
+  bool GetFunctionForCaller(RVA caller, RVA* function_rva, uint32* line) const;
+
+  // Records the resolution of the caller address @p caller.
+  void SetFunctionForCaller(RVA caller, RVA function_rva, uint32 line);
+
+  // Looks up the name, source file and line number of the function at
+  // @p function.
+  // @param function the RVA of the function.
+  // @param function_name on success receives the name of the function.
+  // @param file_name on success receives the function's source file.
+  // @param line on success receives the function's line number.
+  // @returns true if the cache contains an entry for @p function.
+  bool GetInfoForFunction(RVA function,
+                          std::wstring* function_name,
+                          std::wstring* file_name,
+                          uint32* line) const;
+
+  // Records the resolution of the function at @p function.
+  void SetInfoForFunction(RVA function,
+                          const std::wstring& function_name,
+                          const std::wstring& file_name,
+                          uint32 line);
+
+  // Writes the cache back to its backing file if any entries have been added
+  // since it was loaded.
+  // @returns true on success, false otherwise.
+  // @pre Init has been successfully called.
+  bool Save();
+
+  // @returns the path of the backing file.
+  // @pre Init has been successfully called.
+  const base::FilePath& path() const { return file_path_; }
+
+ protected:
+  // Maps a caller RVA to the RVA of the enclosing function and the line
+  // number of the call site.
+  typedef std::pair<RVA, uint32> CallerInfo;
+  typedef std::map<RVA, CallerInfo> CallerInfoMap;
+
+  // The name, source file and line number of a function.
+  struct FunctionInfo {
+    FunctionInfo() : line(0) {
+    }
+
+    std::wstring function_name;
+    std::wstring file_name;
+    uint32 line;
+
+    // @name Serialization support.
+    // @{
+    template<class OutArchive> bool Save(OutArchive* out_archive) const {
+      return out_archive->Save(function_name) &&
+          out_archive->Save(file_name) &&
+          out_archive->Save(line);
+    }
+    template<class InArchive> bool Load(InArchive* in_archive) {
+      return in_archive->Load(&function_name) &&
+          in_archive->Load(&file_name) &&
+          in_archive->Load(&line);
+    }
+    // @}
+  };
+  typedef std::map<RVA, FunctionInfo> FunctionInfoMap;
+
+  // The file backing this cache.
+  base::FilePath file_path_;
+
+  // The cached caller and function resolutions.
+  CallerInfoMap callers_;
+  FunctionInfoMap functions_;
+
+  // The machine-local cache shared with concurrently running tools. Probed
+  // on local misses and published to on insertions. Unusable if attaching
+  // failed, in which case this cache simply runs on its own.
+  ::common::SharedSymbolCache shared_cache_;
+  bool shared_cache_usable_;
+
+  // True if entries have been added since the cache was loaded.
+  bool dirty_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ProfileSymbolCache);
+};
+
+}  // namespace grinders
+}  // namespace grinder
+
+#endif  // SYZYGY_GRINDER_GRINDERS_PROFILE_SYMBOL_CACHE_H_
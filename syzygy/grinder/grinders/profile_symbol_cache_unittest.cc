@@ -0,0 +1,137 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/grinders/profile_symbol_cache.h"
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+
+namespace grinder {
+namespace grinders {
+
+namespace {
+
+const GUID kGuid = { 0x4FC77702, 0x550A, 0x4CC6,
+    { 0x84, 0x17, 0x56, 0xC3, 0x1C, 0xA1, 0x4E, 0x78 } };
+const uint32 kAge = 2;
+
+class ProfileSymbolCacheTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+  }
+
+  base::ScopedTempDir temp_dir_;
+};
+
+}  // namespace
+
+TEST_F(ProfileSymbolCacheTest, SetAndGet) {
+  ProfileSymbolCache cache;
+  ASSERT_TRUE(cache.Init(temp_dir_.path(), kGuid, kAge));
+
+  RVA function_rva = 0;
+  uint32 line = 0;
+  EXPECT_FALSE(cache.GetFunctionForCaller(0x1010, &function_rva, &line));
+
+  cache.SetFunctionForCaller(0x1010, 0x1000, 42);
+  EXPECT_TRUE(cache.GetFunctionForCaller(0x1010, &function_rva, &line));
+  EXPECT_EQ(0x1000u, function_rva);
+  EXPECT_EQ(42u, line);
+  EXPECT_FALSE(cache.GetFunctionForCaller(0x1014, &function_rva, &line));
+
+  std::wstring function_name;
+  std::wstring file_name;
+  EXPECT_FALSE(cache.GetInfoForFunction(0x1000, &function_name, &file_name,
+                                        &line));
+
+  cache.SetInfoForFunction(0x1000, L"foo", L"foo.cc", 40);
+  EXPECT_TRUE(cache.GetInfoForFunction(0x1000, &function_name, &file_name,
+                                       &line));
+  EXPECT_EQ(L"foo", function_name);
+  EXPECT_EQ(L"foo.cc", file_name);
+  EXPECT_EQ(40u, line);
+}
+
+TEST_F(ProfileSymbolCacheTest, SaveAndReload) {
+  base::FilePath cache_path;
+  {
+    ProfileSymbolCache cache;
+    ASSERT_TRUE(cache.Init(temp_dir_.path(), kGuid, kAge));
+    cache.SetFunctionForCaller(0x1010, 0x1000, 42);
+    cache.SetInfoForFunction(0x1000, L"foo", L"foo.cc", 40);
+    ASSERT_TRUE(cache.Save());
+    cache_path = cache.path();
+    EXPECT_TRUE(base::PathExists(cache_path));
+  }
+
+  // A cache initialized with the same GUID and age sees the saved entries.
+  {
+    ProfileSymbolCache cache;
+    ASSERT_TRUE(cache.Init(temp_dir_.path(), kGuid, kAge));
+    EXPECT_EQ(cache_path, cache.path());
+
+    RVA function_rva = 0;
+    uint32 line = 0;
+    EXPECT_TRUE(cache.GetFunctionForCaller(0x1010, &function_rva, &line));
+    EXPECT_EQ(0x1000u, function_rva);
+    EXPECT_EQ(42u, line);
+
+    std::wstring function_name;
+    std::wstring file_name;
+    EXPECT_TRUE(cache.GetInfoForFunction(0x1000, &function_name, &file_name,
+                                         &line));
+    EXPECT_EQ(L"foo", function_name);
+    EXPECT_EQ(L"foo.cc", file_name);
+    EXPECT_EQ(40u, line);
+  }
+
+  // A cache for another age of the same PDB is backed by a different file
+  // and starts out empty.
+  {
+    ProfileSymbolCache cache;
+    ASSERT_TRUE(cache.Init(temp_dir_.path(), kGuid, kAge + 1));
+    EXPECT_NE(cache_path, cache.path());
+
+    RVA function_rva = 0;
+    uint32 line = 0;
+    EXPECT_FALSE(cache.GetFunctionForCaller(0x1010, &function_rva, &line));
+  }
+}
+
+TEST_F(ProfileSymbolCacheTest, IgnoresCorruptCacheFile) {
+  base::FilePath cache_path;
+  {
+    ProfileSymbolCache cache;
+    ASSERT_TRUE(cache.Init(temp_dir_.path(), kGuid, kAge));
+    cache.SetFunctionForCaller(0x1010, 0x1000, 42);
+    ASSERT_TRUE(cache.Save());
+    cache_path = cache.path();
+  }
+
+  std::string garbage(16, '\xFF');
+  ASSERT_TRUE(base::WriteFile(cache_path, garbage.data(), garbage.size()) ==
+      static_cast<int>(garbage.size()));
+
+  ProfileSymbolCache cache;
+  ASSERT_TRUE(cache.Init(temp_dir_.path(), kGuid, kAge));
+
+  RVA function_rva = 0;
+  uint32 line = 0;
+  EXPECT_FALSE(cache.GetFunctionForCaller(0x1010, &function_rva, &line));
+}
+
+}  // namespace grinders
+}  // namespace grinder
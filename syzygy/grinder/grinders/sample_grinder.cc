@@ -14,8 +14,11 @@
 
 #include "syzygy/grinder/grinders/sample_grinder.h"
 
+#include "base/memory/scoped_vector.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/common/align.h"
@@ -61,16 +64,23 @@ bool BuildHeatMapForCodeBlock(const pe::PETransformPolicy& policy,
                               const Range& block_range,
                               const BlockGraph::Block* block,
                               core::StringTable* string_table,
+                              base::Lock* string_table_lock,
                               HeatMap* heat_map) {
   DCHECK(block != NULL);
   DCHECK(string_table != NULL);
+  DCHECK(string_table_lock != NULL);
   DCHECK(heat_map != NULL);
   DCHECK_EQ(BlockGraph::CODE_BLOCK, block->type());
 
-  const std::string* compiland = &string_table->InternString(
-      block->compiland_name());
-  const std::string* function = &string_table->InternString(
-      block->name());
+  // The string table is shared across modules that may be being ground in
+  // parallel, so serialize access to it.
+  const std::string* compiland = NULL;
+  const std::string* function = NULL;
+  {
+    base::AutoLock auto_lock(*string_table_lock);
+    compiland = &string_table->InternString(block->compiland_name());
+    function = &string_table->InternString(block->name());
+  }
   SampleGrinder::BasicBlockData data = { compiland, function, 0.0 };
 
   // If the code block is basic block decomposable then decompose it and
@@ -142,11 +152,14 @@ bool BuildHeatMapForCodeBlock(const pe::PETransformPolicy& policy,
 
 // Builds an empty heat map for the given module. One range is created per
 // basic-block. Non-decomposable code blocks are represented by a single range.
-bool BuildEmptyHeatMap(const SampleGrinder::ModuleKey& module_key,
-                       const SampleGrinder::ModuleData& module_data,
+// Accesses to @p string_table are serialized under @p string_table_lock, so
+// this may be invoked concurrently for distinct modules.
+bool BuildEmptyHeatMap(const SampleGrinder::ModuleData& module_data,
                        core::StringTable* string_table,
+                       base::Lock* string_table_lock,
                        HeatMap* heat_map) {
   DCHECK(string_table != NULL);
+  DCHECK(string_table_lock != NULL);
   DCHECK(heat_map != NULL);
 
   pe::PEFile image;
@@ -185,7 +198,7 @@ bool BuildEmptyHeatMap(const SampleGrinder::ModuleKey& module_key,
       continue;
 
     if (!BuildHeatMapForCodeBlock(policy, block_it->first, block, string_table,
-                                  heat_map)) {
+                                  string_table_lock, heat_map)) {
       return false;
     }
   }
@@ -332,6 +345,39 @@ bool OutputNameHeatMap(SampleGrinder::AggregationLevel aggregation_level,
   return true;
 }
 
+// A worker that grinds the aggregate sample data of a set of modules. Used
+// to grind independent modules in parallel; the grinder serializes access to
+// its shared output structures internally.
+class GrindModuleWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit GrindModuleWorker(SampleGrinder* grinder)
+      : grinder_(grinder), succeeded_(false) {
+    DCHECK(grinder != NULL);
+  }
+
+  void AddModuleData(const SampleGrinder::ModuleData* module_data) {
+    DCHECK(module_data != NULL);
+    module_data_.push_back(module_data);
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+  virtual void Run() OVERRIDE {
+    for (size_t i = 0; i < module_data_.size(); ++i) {
+      if (!grinder_->GrindModuleData(*module_data_[i]))
+        return;
+    }
+    succeeded_ = true;
+  }
+
+ private:
+  SampleGrinder* grinder_;
+  std::vector<const SampleGrinder::ModuleData*> module_data_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(GrindModuleWorker);
+};
+
 }  // namespace
 
 // NOTE: This must be kept in sync with SampleGrinder::AggregationLevel.
@@ -398,6 +444,26 @@ void SampleGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool SampleGrinder::Merge(GrinderInterface* other) {
+  DCHECK(other != NULL);
+
+  // We can only be merged with grinders of our own type.
+  SampleGrinder* grinder = static_cast<SampleGrinder*>(other);
+
+  ModuleDataMap::const_iterator it = grinder->module_data_.begin();
+  for (; it != grinder->module_data_.end(); ++it) {
+    ModuleData* module_data = &module_data_[it->first];
+    if (module_data->module_path.empty())
+      module_data->module_path = it->second.module_path;
+    if (!MergeModuleData(it->second, module_data))
+      return false;
+  }
+
+  event_handler_errored_ |= grinder->event_handler_errored_;
+
+  return true;
+}
+
 bool SampleGrinder::Grind() {
   if (event_handler_errored_) {
     LOG(WARNING) << "Failed to handle all TraceSampleData records, results "
@@ -416,53 +482,35 @@ bool SampleGrinder::Grind() {
     }
   }
 
-  // Process each module.
-  ModuleDataMap::const_iterator mod_it = module_data_.begin();
-  for (; mod_it != module_data_.end(); ++mod_it) {
-    LOG(INFO) << "Processing aggregate samples for module \""
-              << mod_it->second.module_path.value() << "\".";
-
-    // Build an empty heat map. How exactly we do this depends on the
-    // aggregation mode.
-    bool empty_heat_map_built = false;
-    if (aggregation_level_ == kLine) {
-      // In line aggregation mode we simply extract line info from the PDB.
-      empty_heat_map_built = BuildEmptyHeatMap(
-          mod_it->second.module_path, &line_info_, &heat_map_);
-    } else {
-      // In basic-block, function and compiland aggregation mode we decompose
-      // the image to get compilands, functions and basic blocks.
-      // TODO(chrisha): We shouldn't need full decomposition for this.
-      empty_heat_map_built = BuildEmptyHeatMap(
-          mod_it->first, mod_it->second, &string_table_, &heat_map_);
-    }
+  // In line aggregation mode all modules share line_info_, so they are
+  // processed serially.
+  if (aggregation_level_ == kLine) {
+    ModuleDataMap::const_iterator mod_it = module_data_.begin();
+    for (; mod_it != module_data_.end(); ++mod_it) {
+      LOG(INFO) << "Processing aggregate samples for module \""
+                << mod_it->second.module_path.value() << "\".";
 
-    if (!empty_heat_map_built) {
-      LOG(ERROR) << "Unable to build empty heat map for module \""
-                  << mod_it->second.module_path.value() << "\".";
-      return false;
-    }
+      // In line aggregation mode we simply extract line info from the PDB.
+      if (!BuildEmptyHeatMap(mod_it->second.module_path, &line_info_,
+                             &heat_map_)) {
+        LOG(ERROR) << "Unable to build empty heat map for module \""
+                   << mod_it->second.module_path.value() << "\".";
+        return false;
+      }
 
-    // Populate the heat map by pouring the sample data into it. If any samples
-    // did not map to code blocks then output a warning.
-    double total = 0.0;
-    double orphaned = IncrementHeatMapFromModuleData(
-        mod_it->second, &heat_map_, &total);
-    if (orphaned > 0) {
-      LOG(WARNING) << base::StringPrintf("%.2f%% (%.4f s) ",
-                                          orphaned / total,
-                                          orphaned)
-                    << "samples were orphaned for module \""
-                    << mod_it->second.module_path.value() << "\".";
-    }
+      // Populate the heat map by pouring the sample data into it. If any
+      // samples did not map to code blocks then output a warning.
+      double total = 0.0;
+      double orphaned = IncrementHeatMapFromModuleData(
+          mod_it->second, &heat_map_, &total);
+      if (orphaned > 0) {
+        LOG(WARNING) << base::StringPrintf("%.2f%% (%.4f s) ",
+                                            orphaned / total,
+                                            orphaned)
+                      << "samples were orphaned for module \""
+                      << mod_it->second.module_path.value() << "\".";
+      }
 
-    if (aggregation_level_ == kFunction || aggregation_level_ == kCompiland) {
-      LOG(INFO) << "Rolling up basic-block heat to \""
-                << kAggregationLevelNames[aggregation_level_] << "\" level.";
-      RollUpByName(aggregation_level_, heat_map_, &name_heat_map_);
-      // We can clear the heat map as it was only needed as an intermediate.
-      heat_map_.Clear();
-    } else if (aggregation_level_ == kLine) {
       LOG(INFO) << "Rolling up basic-block heat to lines.";
       if (!RollUpToLines(heat_map_, &line_info_)) {
         LOG(ERROR) << "Failed to roll-up heat to lines.";
@@ -471,6 +519,108 @@ bool SampleGrinder::Grind() {
       // We can clear the heat map as it was only needed as an intermediate.
       heat_map_.Clear();
     }
+
+    return true;
+  }
+
+  // In the other aggregation modes the expensive work for each module (the
+  // decomposition and the sweep of its sample buckets) only touches state
+  // local to that module, so the modules are ground in parallel, one worker
+  // per core.
+  std::vector<const ModuleData*> module_data;
+  module_data.reserve(module_data_.size());
+  ModuleDataMap::const_iterator mod_it = module_data_.begin();
+  for (; mod_it != module_data_.end(); ++mod_it)
+    module_data.push_back(&mod_it->second);
+
+  size_t num_workers = std::min(
+      module_data.size(),
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()));
+
+  // With a single worker there's no point spinning up a thread.
+  if (num_workers <= 1) {
+    for (size_t i = 0; i < module_data.size(); ++i) {
+      if (!GrindModuleData(*module_data[i]))
+        return false;
+    }
+    return true;
+  }
+
+  // Create the workers and distribute the modules across them.
+  ScopedVector<GrindModuleWorker> workers;
+  for (size_t i = 0; i < num_workers; ++i)
+    workers.push_back(new GrindModuleWorker(this));
+  for (size_t i = 0; i < module_data.size(); ++i)
+    workers[i % num_workers]->AddModuleData(module_data[i]);
+
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (size_t i = 0; i < workers.size(); ++i) {
+    threads.push_back(new base::DelegateSimpleThread(
+        workers[i], base::StringPrintf("sample-grinder-worker-%u", i)));
+    threads.back()->Start();
+  }
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Join();
+
+  // The workers log verbosely on failure.
+  for (size_t i = 0; i < workers.size(); ++i) {
+    if (!workers[i]->succeeded())
+      return false;
+  }
+
+  return true;
+}
+
+bool SampleGrinder::GrindModuleData(const ModuleData& module_data) {
+  DCHECK_NE(kLine, aggregation_level_);
+
+  LOG(INFO) << "Processing aggregate samples for module \""
+            << module_data.module_path.value() << "\".";
+
+  // Build an empty heat map for the module by decomposing the image to get
+  // compilands, functions and basic blocks. This is the expensive part of
+  // grinding a module and touches only local state.
+  // TODO(chrisha): We shouldn't need full decomposition for this.
+  HeatMap heat_map;
+  if (!BuildEmptyHeatMap(module_data, &string_table_, &grind_lock_,
+                         &heat_map)) {
+    LOG(ERROR) << "Unable to build empty heat map for module \""
+               << module_data.module_path.value() << "\".";
+    return false;
+  }
+
+  // Populate the heat map by pouring the sample data into it, walking the
+  // sorted buckets and basic-block ranges in a single merged sweep. If any
+  // samples did not map to code blocks then output a warning.
+  double total = 0.0;
+  double orphaned = IncrementHeatMapFromModuleData(
+      module_data, &heat_map, &total);
+  if (orphaned > 0) {
+    LOG(WARNING) << base::StringPrintf("%.2f%% (%.4f s) ",
+                                        orphaned / total,
+                                        orphaned)
+                  << "samples were orphaned for module \""
+                  << module_data.module_path.value() << "\".";
+  }
+
+  // Fold the module's results into the shared output structures.
+  base::AutoLock auto_lock(grind_lock_);
+  if (aggregation_level_ == kFunction || aggregation_level_ == kCompiland) {
+    LOG(INFO) << "Rolling up basic-block heat to \""
+              << kAggregationLevelNames[aggregation_level_] << "\" level.";
+    RollUpByName(aggregation_level_, heat_map, &name_heat_map_);
+  } else {
+    DCHECK_EQ(kBasicBlock, aggregation_level_);
+    // Adopt the module's ranges wholesale. Basic-block mode requires an
+    // --image filter, so only a single module is ever processed and the
+    // insertions cannot collide.
+    HeatMap::const_iterator it = heat_map.begin();
+    for (; it != heat_map.end(); ++it) {
+      if (!heat_map_.Insert(it->first, it->second)) {
+        LOG(ERROR) << "Failed to insert basic block range into heat map.";
+        return false;
+      }
+    }
   }
 
   return true;
@@ -688,6 +838,80 @@ bool SampleGrinder::IncrementModuleData(
   return true;
 }
 
+bool SampleGrinder::MergeModuleData(const SampleGrinder::ModuleData& from,
+                                    SampleGrinder::ModuleData* to) {
+  DCHECK(to != NULL);
+
+  if (from.bucket_size == 0)
+    return true;
+
+  // Special case: the destination is not yet initialized. Simply adopt the
+  // incoming data.
+  if (to->bucket_size == 0) {
+    to->bucket_size = from.bucket_size;
+    to->bucket_start = from.bucket_start;
+    to->buckets = from.buckets;
+    return true;
+  }
+
+  // The bucket starts need to be consistent.
+  if (from.bucket_start != to->bucket_start) {
+    LOG(ERROR) << "Module data has an inconsistent bucket start.";
+    return false;
+  }
+
+  DCHECK(common::IsPowerOfTwo(from.bucket_size));
+  DCHECK(common::IsPowerOfTwo(to->bucket_size));
+
+  // If the incoming data is at a finer resolution then upsample our own
+  // buckets to match, exactly as UpsampleModuleData does.
+  if (to->bucket_size > from.bucket_size) {
+    std::vector<double>& buckets = to->buckets;
+    size_t old_size = buckets.size();
+    size_t factor = to->bucket_size / from.bucket_size;
+    size_t new_size = old_size * factor;
+    buckets.resize(new_size);
+    for (size_t i = old_size, j = new_size; i > 0; ) {
+      --i;
+      double new_value = buckets[i] / factor;
+
+      for (size_t k = 0; k < factor; ++k) {
+        --j;
+        buckets[j] = new_value;
+      }
+    }
+    to->bucket_size = from.bucket_size;
+  }
+
+  // Calculate how many destination buckets are touched per incoming bucket,
+  // and check that the bucket counts are consistent.
+  size_t factor = from.bucket_size / to->bucket_size;
+  size_t equivalent_buckets =
+      from.bucket_size * from.buckets.size() / to->bucket_size;
+  DCHECK_GE(equivalent_buckets, to->buckets.size());
+  if (equivalent_buckets - to->buckets.size() >= factor) {
+    LOG(ERROR) << "Module data has an inconsistent bucket count.";
+    return false;
+  }
+
+  // Walk through the incoming buckets, distributing each bucket's weight
+  // over the destination buckets it covers.
+  std::vector<double>& agg_buckets = to->buckets;
+  for (size_t i = 0, j = 0; i < from.buckets.size(); ++i) {
+    // Special case: handle empty buckets explicitly, as they often occur.
+    if (from.buckets[i] == 0) {
+      j += factor;
+      continue;
+    }
+
+    double weight = from.buckets[i] / factor;
+    for (size_t k = 0; k < factor && j < agg_buckets.size(); ++k, ++j)
+      agg_buckets[j] += weight;
+  }
+
+  return true;
+}
+
 double SampleGrinder::IncrementHeatMapFromModuleData(
     const SampleGrinder::ModuleData& module_data,
     HeatMap* heat_map,
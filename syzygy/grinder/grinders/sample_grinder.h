@@ -20,6 +20,7 @@
 #ifndef SYZYGY_GRINDER_GRINDERS_SAMPLE_GRINDER_H_
 #define SYZYGY_GRINDER_GRINDERS_SAMPLE_GRINDER_H_
 
+#include "base/synchronization/lock.h"
 #include "syzygy/core/address_space.h"
 #include "syzygy/core/string_table.h"
 #include "syzygy/grinder/basic_block_util.h"
@@ -53,6 +54,7 @@ class SampleGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool Merge(GrinderInterface* other) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -100,6 +102,18 @@ class SampleGrinder : public GrinderInterface {
   // named objects (compilands or functions).
   typedef std::map<const std::string*, double> NameHeatMap;
 
+  // Grinds the aggregate sample data of a single module into the output
+  // structures. The expensive work (decomposing the module and sweeping its
+  // sample buckets) touches only state local to the module; the results are
+  // folded into the shared output structures under an internal lock. This
+  // makes it safe to invoke concurrently for distinct modules, which Grind()
+  // does via worker threads. This is public so that it is accessible by the
+  // anonymous worker class.
+  // @param module_data The aggregate sample data of the module to process.
+  // @returns true on success, false otherwise.
+  // @pre aggregation_level_ is not kLine.
+  bool GrindModuleData(const ModuleData& module_data);
+
  protected:
   // Finds or creates the sample data associated with the given module.
   ModuleData* GetModuleData(
@@ -129,6 +143,16 @@ class SampleGrinder : public GrinderInterface {
       const TraceSampleData* sample_data,
       SampleGrinder::ModuleData* module_data);
 
+  // Merges the samples of @p from into @p to, upsampling @p to as necessary
+  // so that it is at least at the resolution of @p from. This can fail if the
+  // two do not have consistent metadata.
+  // @param from The module data to be merged.
+  // @param to The module data to be incremented.
+  // @returns true on success, false otherwise.
+  // @note This is exposed for unit testing.
+  static bool MergeModuleData(const SampleGrinder::ModuleData& from,
+                              SampleGrinder::ModuleData* to);
+
   // Given a populated @p heat_map and aggregate @p module_data, estimates heat
   // for each range in the @p heat_map. The values represent an estimate of
   // amount of time spent in the range, in seconds.
@@ -189,6 +213,10 @@ class SampleGrinder : public GrinderInterface {
   // Used only in 'line' aggregation mode. Populated by Grind().
   LineInfo line_info_;
 
+  // Serializes access to string_table_ and the output structures above while
+  // modules are being ground in parallel.
+  base::Lock grind_lock_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SampleGrinder);
 };
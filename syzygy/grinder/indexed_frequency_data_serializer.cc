@@ -14,14 +14,19 @@
 
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
 
+#include <functional>
+#include <limits>
+#include <queue>
 #include <string>
 #include <utility>
 
 #include "base/files/file_path.h"
 #include "base/json/json_reader.h"
+#include "base/memory/scoped_vector.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/core/json_file_writer.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pe/find.h"
@@ -48,6 +53,172 @@ const char kNumColumnsKey[] = "num_columns";
 const char kDataTypeKey[] = "data_type";
 const char kFrequencySizeKey[] = "frequency_size";
 
+// The magic number and version of the binary columnar file format. The
+// magic reads as "SZFF" on disk.
+const uint32 kBinaryMagic = 0x46465A53;
+const uint32 kBinaryVersion = 1;
+
+// The sentinel byte preceding each module section of a binary file; a zero
+// byte marks the end of the file.
+const uint8 kModuleSectionSentinel = 1;
+
+// Adds @p amount to @p value with the saturation semantics used when
+// grinding: negative amounts represent overflowed uint32 counters.
+void SaturatingAdd(EntryCountType amount, EntryCountType* value) {
+  DCHECK(value != NULL);
+  if (amount < 0) {
+    *value = std::numeric_limits<EntryCountType>::max();
+  } else {
+    *value += std::min(
+        amount, std::numeric_limits<EntryCountType>::max() - *value);
+  }
+}
+
+// Writes one module section: the sentinel, the module signature and
+// description, and the three parallel row columns.
+bool WriteBinaryModule(core::OutArchive* out_archive,
+                       const ModuleInformation& module_information,
+                       const IndexedFrequencyInformation& info,
+                       const std::vector<uint32>& rvas,
+                       const std::vector<uint32>& columns,
+                       const std::vector<EntryCountType>& values) {
+  DCHECK(out_archive != NULL);
+  DCHECK_EQ(rvas.size(), columns.size());
+  DCHECK_EQ(rvas.size(), values.size());
+
+  if (!out_archive->Save(kModuleSectionSentinel) ||
+      !module_information.Save(out_archive) ||
+      !out_archive->Save(info.num_entries) ||
+      !out_archive->Save(info.num_columns) ||
+      !out_archive->Save(static_cast<uint32>(info.data_type)) ||
+      !out_archive->Save(info.frequency_size) ||
+      !out_archive->Save(static_cast<uint32>(rvas.size())) ||
+      !out_archive->SaveRepeated(rvas.empty() ? NULL : &rvas[0],
+                                 rvas.size()) ||
+      !out_archive->SaveRepeated(columns.empty() ? NULL : &columns[0],
+                                 columns.size()) ||
+      !out_archive->SaveRepeated(values.empty() ? NULL : &values[0],
+                                 values.size())) {
+    return false;
+  }
+
+  return true;
+}
+
+// Reads the module section following the sentinel, the counterpart of
+// WriteBinaryModule. The frequency map of @p info is left empty; the rows
+// are returned in the three parallel columns.
+bool ReadBinaryModule(core::InArchive* in_archive,
+                      ModuleInformation* module_information,
+                      IndexedFrequencyInformation* info,
+                      std::vector<uint32>* rvas,
+                      std::vector<uint32>* columns,
+                      std::vector<EntryCountType>* values) {
+  DCHECK(in_archive != NULL);
+  DCHECK(module_information != NULL);
+  DCHECK(info != NULL);
+  DCHECK(rvas != NULL);
+  DCHECK(columns != NULL);
+  DCHECK(values != NULL);
+
+  uint32 data_type = 0;
+  uint32 row_count = 0;
+  if (!module_information->Load(in_archive) ||
+      !in_archive->Load(&info->num_entries) ||
+      !in_archive->Load(&info->num_columns) ||
+      !in_archive->Load(&data_type) ||
+      !in_archive->Load(&info->frequency_size)) {
+    return false;
+  }
+  if (data_type >= common::IndexedFrequencyData::MAX_DATA_TYPE)
+    return false;
+  info->data_type =
+      static_cast<common::IndexedFrequencyData::DataType>(data_type);
+  info->frequency_map.clear();
+
+  if (!in_archive->Load(&row_count))
+    return false;
+  rvas->resize(row_count);
+  columns->resize(row_count);
+  values->resize(row_count);
+  if (!in_archive->LoadRepeated(rvas->empty() ? NULL : &(*rvas)[0],
+                                row_count) ||
+      !in_archive->LoadRepeated(columns->empty() ? NULL : &(*columns)[0],
+                                row_count) ||
+      !in_archive->LoadRepeated(values->empty() ? NULL : &(*values)[0],
+                                row_count)) {
+    return false;
+  }
+
+  return true;
+}
+
+// One input of a streaming binary merge: the file being read and the
+// decoded module section under the cursor, if any.
+class MergeInput {
+ public:
+  // Takes ownership of @p file, which must be open for reading.
+  explicit MergeInput(FILE* file)
+      : file_(file),
+        in_stream_(file),
+        in_archive_(&in_stream_),
+        has_module_(false) {
+    DCHECK(file != NULL);
+  }
+
+  // Validates the file header and reads the first module section.
+  bool Init() {
+    uint32 magic = 0;
+    uint32 version = 0;
+    if (!in_archive_.Load(&magic) || magic != kBinaryMagic ||
+        !in_archive_.Load(&version) || version != kBinaryVersion) {
+      return false;
+    }
+    return Advance();
+  }
+
+  // Reads the next module section, if any.
+  bool Advance() {
+    uint8 sentinel = 0;
+    if (!in_archive_.Load(&sentinel))
+      return false;
+    if (sentinel != kModuleSectionSentinel) {
+      has_module_ = false;
+      return sentinel == 0;
+    }
+    has_module_ = true;
+    return ReadBinaryModule(
+        &in_archive_, &module_, &info_, &rvas_, &columns_, &values_);
+  }
+
+  // @name Accessors for the module section under the cursor.
+  // @{
+  bool has_module() const { return has_module_; }
+  const ModuleInformation& module() const { return module_; }
+  const IndexedFrequencyInformation& info() const { return info_; }
+  const std::vector<uint32>& rvas() const { return rvas_; }
+  const std::vector<EntryCountType>& values() const { return values_; }
+  std::pair<uint32, uint32> row_key(size_t row) const {
+    DCHECK_LT(row, rvas_.size());
+    return std::make_pair(rvas_[row], columns_[row]);
+  }
+  // @}
+
+ private:
+  base::ScopedFILE file_;
+  core::FileInStream in_stream_;
+  core::NativeBinaryInArchive in_archive_;
+
+  bool has_module_;
+  ModuleInformation module_;
+  IndexedFrequencyInformation info_;
+  std::vector<uint32> rvas_;
+  std::vector<uint32> columns_;
+  std::vector<EntryCountType> values_;
+
+  DISALLOW_COPY_AND_ASSIGN(MergeInput);
+};
+
 bool OutputFrequencyData(
     JSONFileWriter* writer,
     const ModuleInformation& module_information,
@@ -297,6 +468,286 @@ bool IndexedFrequencyDataSerializer::SaveAsJson(
   return true;
 }
 
+bool IndexedFrequencyDataSerializer::SaveAsBinary(
+    const ModuleIndexedFrequencyMap& frequency_map, FILE* file) {
+  DCHECK(file != NULL);
+
+  core::FileOutStream out_stream(file);
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  if (!out_archive.Save(kBinaryMagic) || !out_archive.Save(kBinaryVersion))
+    return false;
+
+  std::vector<uint32> rvas;
+  std::vector<uint32> columns;
+  std::vector<EntryCountType> values;
+  ModuleIndexedFrequencyMap::const_iterator it = frequency_map.begin();
+  for (; it != frequency_map.end(); ++it) {
+    // Decompose the frequency map into the three parallel columns. Map
+    // iteration is in increasing (RVA, column) order, which both loading
+    // and merging rely on.
+    const IndexedFrequencyMap& frequencies = it->second.frequency_map;
+    rvas.clear();
+    columns.clear();
+    values.clear();
+    rvas.reserve(frequencies.size());
+    columns.reserve(frequencies.size());
+    values.reserve(frequencies.size());
+    IndexedFrequencyMap::const_iterator freq_it = frequencies.begin();
+    for (; freq_it != frequencies.end(); ++freq_it) {
+      rvas.push_back(freq_it->first.first.value());
+      columns.push_back(freq_it->first.second);
+      values.push_back(freq_it->second);
+    }
+
+    if (!WriteBinaryModule(&out_archive, it->first, it->second,
+                           rvas, columns, values)) {
+      return false;
+    }
+  }
+
+  // Terminate the module sections and flush.
+  if (!out_archive.Save(static_cast<uint8>(0)))
+    return false;
+  return out_archive.Flush();
+}
+
+bool IndexedFrequencyDataSerializer::SaveAsBinary(
+    const ModuleIndexedFrequencyMap& frequency_map,
+    const base::FilePath& path) {
+  DCHECK(!path.empty());
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open " << path.value() << " for writing.";
+    return false;
+  }
+
+  if (!SaveAsBinary(frequency_map, file.get())) {
+    LOG(ERROR) << "Failed to write binary data to " << path.value() << ".";
+    return false;
+  }
+
+  return true;
+}
+
+bool IndexedFrequencyDataSerializer::LoadFromBinary(
+    const base::FilePath& path,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(module_frequency_map != NULL);
+  DCHECK(!path.empty());
+
+  module_frequency_map->clear();
+
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open " << path.value() << " for reading.";
+    return false;
+  }
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  uint32 magic = 0;
+  uint32 version = 0;
+  if (!in_archive.Load(&magic) || magic != kBinaryMagic ||
+      !in_archive.Load(&version) || version != kBinaryVersion) {
+    LOG(ERROR) << "'" << path.value()
+               << "' is not a binary frequency data file.";
+    return false;
+  }
+
+  ModuleInformation module_information;
+  std::vector<uint32> rvas;
+  std::vector<uint32> columns;
+  std::vector<EntryCountType> values;
+  while (true) {
+    uint8 sentinel = 0;
+    if (!in_archive.Load(&sentinel)) {
+      LOG(ERROR) << "Truncated binary frequency data file: '"
+                 << path.value() << "'.";
+      return false;
+    }
+    if (sentinel != kModuleSectionSentinel)
+      break;
+
+    IndexedFrequencyInformation info = {};
+    if (!ReadBinaryModule(&in_archive, &module_information, &info,
+                          &rvas, &columns, &values)) {
+      LOG(ERROR) << "Invalid module section in binary frequency data "
+                 << "file: '" << path.value() << "'.";
+      return false;
+    }
+
+    std::pair<ModuleIndexedFrequencyMap::iterator, bool> result =
+        module_frequency_map->insert(
+            std::make_pair(module_information, info));
+    if (!result.second) {
+      LOG(ERROR) << "Found duplicate entries for " << module_information.path
+                 << ".";
+      return false;
+    }
+
+    // Rebuild the frequency map from the columns; the rows arrive in
+    // increasing key order, so insertion is hinted at the end.
+    IndexedFrequencyMap& frequencies = result.first->second.frequency_map;
+    for (size_t i = 0; i < rvas.size(); ++i) {
+      frequencies.insert(frequencies.end(), std::make_pair(
+          std::make_pair(core::RelativeAddress(rvas[i]), columns[i]),
+          values[i]));
+    }
+  }
+
+  return true;
+}
+
+bool IndexedFrequencyDataSerializer::Load(
+    const base::FilePath& path,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(module_frequency_map != NULL);
+  DCHECK(!path.empty());
+
+  // Sniff the format from the leading bytes of the file.
+  uint32 magic = 0;
+  {
+    base::ScopedFILE file(base::OpenFile(path, "rb"));
+    if (file.get() == NULL) {
+      LOG(ERROR) << "Failed to open " << path.value() << " for reading.";
+      return false;
+    }
+    if (::fread(&magic, sizeof(magic), 1, file.get()) != 1)
+      magic = 0;
+  }
+
+  if (magic == kBinaryMagic)
+    return LoadFromBinary(path, module_frequency_map);
+  return LoadFromJson(path, module_frequency_map);
+}
+
+bool IndexedFrequencyDataSerializer::MergeBinary(
+    const std::vector<base::FilePath>& input_paths,
+    const base::FilePath& output_path) {
+  DCHECK(!input_paths.empty());
+  DCHECK(!output_path.empty());
+
+  // Open and prime the inputs.
+  ScopedVector<MergeInput> inputs;
+  for (size_t i = 0; i < input_paths.size(); ++i) {
+    base::ScopedFILE file(base::OpenFile(input_paths[i], "rb"));
+    if (file.get() == NULL) {
+      LOG(ERROR) << "Failed to open " << input_paths[i].value()
+                 << " for reading.";
+      return false;
+    }
+    scoped_ptr<MergeInput> input(new MergeInput(file.release()));
+    if (!input->Init()) {
+      LOG(ERROR) << "'" << input_paths[i].value()
+                 << "' is not a valid binary frequency data file.";
+      return false;
+    }
+    inputs.push_back(input.release());
+  }
+
+  base::ScopedFILE out_file(base::OpenFile(output_path, "wb"));
+  if (out_file.get() == NULL) {
+    LOG(ERROR) << "Failed to open " << output_path.value()
+               << " for writing.";
+    return false;
+  }
+  core::FileOutStream out_stream(out_file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  if (!out_archive.Save(kBinaryMagic) || !out_archive.Save(kBinaryVersion))
+    return false;
+
+  basic_block_util::ModuleIdentityComparator comp;
+  while (true) {
+    // Find the smallest module signature among the input cursors. Module
+    // sections are written in increasing identity order, so all remaining
+    // occurrences of that module are at the cursors now.
+    MergeInput* best = NULL;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      if (!inputs[i]->has_module())
+        continue;
+      if (best == NULL || comp(inputs[i]->module(), best->module()))
+        best = inputs[i];
+    }
+    if (best == NULL)
+      break;
+
+    // Gather the inputs positioned on that module.
+    std::vector<MergeInput*> group;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      if (inputs[i]->has_module() &&
+          !comp(best->module(), inputs[i]->module())) {
+        group.push_back(inputs[i]);
+      }
+    }
+    DCHECK(!group.empty());
+
+    // The module descriptions must agree, exactly as when merging
+    // grinders.
+    IndexedFrequencyInformation info = group[0]->info();
+    for (size_t i = 1; i < group.size(); ++i) {
+      const IndexedFrequencyInformation& other = group[i]->info();
+      if (info.num_columns != other.num_columns ||
+          info.data_type != other.data_type ||
+          info.frequency_size != other.frequency_size) {
+        LOG(ERROR) << "Unable to merge inconsistent frequency data for "
+                   << "module: " << best->module().path << ".";
+        return false;
+      }
+      info.num_entries = std::max(info.num_entries, other.num_entries);
+    }
+
+    // K-way merge of the rows by (RVA, column) key, summing the values of
+    // equal keys.
+    typedef std::pair<uint32, uint32> RowKey;
+    typedef std::pair<RowKey, size_t> QueueEntry;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>,
+                        std::greater<QueueEntry> > queue;
+    std::vector<size_t> cursors(group.size(), 0);
+    for (size_t i = 0; i < group.size(); ++i) {
+      if (!group[i]->rvas().empty())
+        queue.push(std::make_pair(group[i]->row_key(0), i));
+    }
+
+    std::vector<uint32> rvas;
+    std::vector<uint32> columns;
+    std::vector<EntryCountType> values;
+    while (!queue.empty()) {
+      RowKey key = queue.top().first;
+      EntryCountType total = 0;
+      while (!queue.empty() && queue.top().first == key) {
+        size_t i = queue.top().second;
+        queue.pop();
+        SaturatingAdd(group[i]->values()[cursors[i]], &total);
+        if (++cursors[i] < group[i]->rvas().size())
+          queue.push(std::make_pair(group[i]->row_key(cursors[i]), i));
+      }
+      rvas.push_back(key.first);
+      columns.push_back(key.second);
+      values.push_back(total);
+    }
+
+    if (!WriteBinaryModule(&out_archive, best->module(), info,
+                           rvas, columns, values)) {
+      LOG(ERROR) << "Failed to write merged frequency data to '"
+                 << output_path.value() << "'.";
+      return false;
+    }
+
+    // Advance the merged inputs to their next module section.
+    for (size_t i = 0; i < group.size(); ++i) {
+      if (!group[i]->Advance()) {
+        LOG(ERROR) << "Truncated binary frequency data input.";
+        return false;
+      }
+    }
+  }
+
+  // Terminate the module sections and flush.
+  if (!out_archive.Save(static_cast<uint8>(0)))
+    return false;
+  return out_archive.Flush();
+}
+
 bool IndexedFrequencyDataSerializer::LoadFromJson(
     const base::FilePath& path,
     ModuleIndexedFrequencyMap* module_frequency_map) {
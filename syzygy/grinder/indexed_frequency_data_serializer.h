@@ -73,6 +73,15 @@ namespace grinder {
 //       // Basic-block frequencies list for module 2.
 //       ...
 //     ]
+//
+// In addition to JSON, the serializer reads and writes a compact binary
+// columnar format. The file holds a magic/version header followed by one
+// section per module, in increasing module identity order. Each section
+// holds the module signature and description followed by three parallel
+// arrays - basic-block RVAs, column indices and frequency values - sorted
+// by (RVA, column). Since both the sections and their rows are sorted,
+// any number of binary files can be merged in a single streaming pass,
+// without materializing the frequency maps; see MergeBinary.
 class IndexedFrequencyDataSerializer {
  public:
   typedef basic_block_util::ModuleIndexedFrequencyMap ModuleIndexedFrequencyMap;
@@ -90,10 +99,43 @@ class IndexedFrequencyDataSerializer {
   bool SaveAsJson(const ModuleIndexedFrequencyMap& frequency_map,
                   FILE* file);
 
+  // Saves the given frequency map in the binary columnar format to a file
+  // at @p file_path.
+  bool SaveAsBinary(const ModuleIndexedFrequencyMap& frequency_map,
+                    const base::FilePath& file_path);
+
+  // Saves the given frequency map in the binary columnar format to a file
+  // previously opened for writing.
+  bool SaveAsBinary(const ModuleIndexedFrequencyMap& frequency_map,
+                    FILE* file);
+
   // Populates a frequency map from a JSON file, given by @p file_path.
   bool LoadFromJson(const base::FilePath& file_path,
                     ModuleIndexedFrequencyMap* frequency_map);
 
+  // Populates a frequency map from a binary columnar file, given by
+  // @p file_path.
+  bool LoadFromBinary(const base::FilePath& file_path,
+                      ModuleIndexedFrequencyMap* frequency_map);
+
+  // Populates a frequency map from the file given by @p file_path, which
+  // may be in either the JSON or the binary columnar format; the format is
+  // sniffed from the file contents.
+  bool Load(const base::FilePath& file_path,
+            ModuleIndexedFrequencyMap* frequency_map);
+
+  // Merges any number of binary columnar files into a single one. The
+  // per-module sections are combined in one streaming pass, summing the
+  // frequency values of rows with equal (RVA, column) keys using
+  // saturation arithmetic; at no point is more than one section per input
+  // held in memory.
+  // @param input_paths the files to merge. These must all be in the binary
+  //     columnar format.
+  // @param output_path the file receiving the merged data.
+  // @returns true on success, false otherwise.
+  static bool MergeBinary(const std::vector<base::FilePath>& input_paths,
+                          const base::FilePath& output_path);
+
  protected:
   // Populates a frequency map from JSON data. Exposed for unit-testing
   // purposes.
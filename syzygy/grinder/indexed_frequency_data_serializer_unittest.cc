@@ -241,4 +241,139 @@ TEST_F(IndexedFrequencyDataSerializerTest, RoundTrip) {
   EXPECT_THAT(new_frequency_map, ContainerEq(frequency_map));
 }
 
+TEST_F(IndexedFrequencyDataSerializerTest, BinaryRoundTrip) {
+  ModuleInformation module_info;
+  ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+
+  size_t num_basic_blocks = 100;
+  size_t num_columns = 10;
+
+  ModuleIndexedFrequencyMap frequency_map;
+  IndexedFrequencyInformation& frequency_info = frequency_map[module_info];
+  frequency_info.num_entries = num_basic_blocks;
+  frequency_info.num_columns = num_columns;
+  frequency_info.data_type = common::IndexedFrequencyData::BRANCH;
+  frequency_info.frequency_size = 4;
+
+  IndexedFrequencyMap& counters = frequency_info.frequency_map;
+  for (size_t i = 0; i < num_basic_blocks; ++i) {
+    for (size_t c = 0; c < num_columns; ++c)
+      counters[std::make_pair(core::RelativeAddress(i * i), c)] = i + c + 1;
+  }
+
+  base::FilePath binary_path(temp_dir_.path().AppendASCII("test.bin"));
+
+  TestIndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.SaveAsBinary(frequency_map, binary_path));
+
+  ModuleIndexedFrequencyMap new_frequency_map;
+  ASSERT_TRUE(serializer.LoadFromBinary(binary_path, &new_frequency_map));
+  EXPECT_THAT(new_frequency_map, ContainerEq(frequency_map));
+
+  // A JSON file must be rejected by the binary loader.
+  base::FilePath json_path(temp_dir_.path().AppendASCII("test.json"));
+  ASSERT_TRUE(serializer.SaveAsJson(frequency_map, json_path));
+  EXPECT_FALSE(serializer.LoadFromBinary(json_path, &new_frequency_map));
+}
+
+TEST_F(IndexedFrequencyDataSerializerTest, LoadSniffsTheFormat) {
+  ModuleInformation module_info;
+  ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+
+  ModuleIndexedFrequencyMap frequency_map;
+  IndexedFrequencyInformation& frequency_info = frequency_map[module_info];
+  frequency_info.num_entries = 10;
+  frequency_info.num_columns = 1;
+  frequency_info.data_type = common::IndexedFrequencyData::BASIC_BLOCK_ENTRY;
+  frequency_info.frequency_size = 4;
+  frequency_info.frequency_map[
+      std::make_pair(core::RelativeAddress(0x100), 0)] = 42;
+
+  base::FilePath json_path(temp_dir_.path().AppendASCII("test.json"));
+  base::FilePath binary_path(temp_dir_.path().AppendASCII("test.bin"));
+
+  TestIndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.SaveAsJson(frequency_map, json_path));
+  ASSERT_TRUE(serializer.SaveAsBinary(frequency_map, binary_path));
+
+  // Both files load through the sniffing entry point.
+  ModuleIndexedFrequencyMap from_json;
+  EXPECT_TRUE(serializer.Load(json_path, &from_json));
+  EXPECT_THAT(from_json, ContainerEq(frequency_map));
+
+  ModuleIndexedFrequencyMap from_binary;
+  EXPECT_TRUE(serializer.Load(binary_path, &from_binary));
+  EXPECT_THAT(from_binary, ContainerEq(frequency_map));
+}
+
+TEST_F(IndexedFrequencyDataSerializerTest, MergeBinary) {
+  ModuleInformation module_info;
+  ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+
+  // A second module, seen by only one of the shards.
+  ModuleInformation other_module_info;
+  ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&other_module_info));
+  other_module_info.path = L"bar.dll";
+  other_module_info.base_address.set_value(kBaseAddress + 0x10000);
+  other_module_info.module_checksum = kImageChecksum + 1;
+
+  ModuleIndexedFrequencyMap shard1;
+  IndexedFrequencyInformation& info1 = shard1[module_info];
+  info1.num_entries = 10;
+  info1.num_columns = 2;
+  info1.data_type = common::IndexedFrequencyData::BRANCH;
+  info1.frequency_size = 4;
+  info1.frequency_map[std::make_pair(core::RelativeAddress(0x100), 0)] = 1;
+  info1.frequency_map[std::make_pair(core::RelativeAddress(0x100), 1)] = 2;
+  info1.frequency_map[std::make_pair(core::RelativeAddress(0x200), 0)] = 3;
+
+  ModuleIndexedFrequencyMap shard2;
+  IndexedFrequencyInformation& info2 = shard2[module_info];
+  info2 = info1;
+  info2.frequency_map.clear();
+  info2.frequency_map[std::make_pair(core::RelativeAddress(0x100), 0)] = 10;
+  info2.frequency_map[std::make_pair(core::RelativeAddress(0x300), 1)] = 20;
+
+  IndexedFrequencyInformation& other_info = shard2[other_module_info];
+  other_info.num_entries = 5;
+  other_info.num_columns = 1;
+  other_info.data_type = common::IndexedFrequencyData::BRANCH;
+  other_info.frequency_size = 4;
+  other_info.frequency_map[
+      std::make_pair(core::RelativeAddress(0x400), 0)] = 7;
+
+  base::FilePath shard1_path(temp_dir_.path().AppendASCII("shard1.bin"));
+  base::FilePath shard2_path(temp_dir_.path().AppendASCII("shard2.bin"));
+  base::FilePath merged_path(temp_dir_.path().AppendASCII("merged.bin"));
+
+  TestIndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.SaveAsBinary(shard1, shard1_path));
+  ASSERT_TRUE(serializer.SaveAsBinary(shard2, shard2_path));
+
+  std::vector<base::FilePath> inputs;
+  inputs.push_back(shard1_path);
+  inputs.push_back(shard2_path);
+  ASSERT_TRUE(IndexedFrequencyDataSerializer::MergeBinary(inputs,
+                                                          merged_path));
+
+  // The merged file holds the sum of the shards.
+  ModuleIndexedFrequencyMap expected;
+  IndexedFrequencyInformation& expected_info = expected[module_info];
+  expected_info = info1;
+  expected_info.frequency_map.clear();
+  expected_info.frequency_map[
+      std::make_pair(core::RelativeAddress(0x100), 0)] = 11;
+  expected_info.frequency_map[
+      std::make_pair(core::RelativeAddress(0x100), 1)] = 2;
+  expected_info.frequency_map[
+      std::make_pair(core::RelativeAddress(0x200), 0)] = 3;
+  expected_info.frequency_map[
+      std::make_pair(core::RelativeAddress(0x300), 1)] = 20;
+  expected[other_module_info] = other_info;
+
+  ModuleIndexedFrequencyMap merged;
+  ASSERT_TRUE(serializer.LoadFromBinary(merged_path, &merged));
+  EXPECT_THAT(merged, ContainerEq(expected));
+}
+
 }  // namespace grinder
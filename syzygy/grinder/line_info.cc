@@ -279,4 +279,45 @@ bool LineInfo::Visit(
   return true;
 }
 
+bool LineInfo::Merge(const LineInfo& other) {
+  // If we have no lines of our own adopt those of the other object. The
+  // source lines must be made to point at our own copies of the file names,
+  // as the other object's strings won't outlive it.
+  if (source_lines_.empty()) {
+    source_lines_.reserve(other.source_lines_.size());
+    for (size_t i = 0; i < other.source_lines_.size(); ++i) {
+      const SourceLine& line = other.source_lines_[i];
+      const std::string* file_name =
+          &(*source_files_.insert(*line.source_file_name).first);
+      source_lines_.push_back(SourceLine(file_name,
+                                         line.line_number,
+                                         line.address,
+                                         line.size));
+      source_lines_.back().visit_count = line.visit_count;
+    }
+    return true;
+  }
+
+  // Otherwise both objects must have been initialized from the same PDB, and
+  // thus hold the same lines in the same order.
+  if (source_lines_.size() != other.source_lines_.size()) {
+    LOG(ERROR) << "Unable to merge inconsistent line information.";
+    return false;
+  }
+
+  for (size_t i = 0; i < source_lines_.size(); ++i) {
+    SourceLine& line = source_lines_[i];
+    const SourceLine& other_line = other.source_lines_[i];
+    DCHECK(line.address == other_line.address);
+
+    // The same saturation arithmetic as in Visit.
+    line.visit_count =
+        std::min(line.visit_count,
+                 std::numeric_limits<uint32>::max() - other_line.visit_count) +
+        other_line.visit_count;
+  }
+
+  return true;
+}
+
 }  // namespace grinder
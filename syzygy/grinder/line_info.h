@@ -55,6 +55,15 @@ class LineInfo {
   // @param the number of times to visit this line.
   bool Visit(core::RelativeAddress address, size_t size, size_t count);
 
+  // Merges the visit counts from another LineInfo object into this one. If
+  // this object holds no line information it adopts the lines of @p other
+  // wholesale; otherwise both objects must have been initialized from the
+  // same PDB and the visit counts are summed line by line.
+  // @param other the LineInfo object whose visit counts are to be merged
+  //     into this one.
+  // @returns true on success, false otherwise.
+  bool Merge(const LineInfo& other);
+
   // @name Accessors.
   // @{
   const SourceFileSet& source_files() const { return source_files_; }
@@ -212,4 +212,51 @@ TEST_F(LineInfoTest, VisitCounterWorks) {
   EXPECT_EQ(0xffffffff, line_it->visit_count);
 }
 
+TEST_F(LineInfoTest, Merge) {
+  // Create a single dummy source file.
+  std::string source_file("foo.cc");
+
+  TestLineInfo line_info1;
+  PushBackSourceLine(&line_info1, &source_file, 1, 4096, 2);
+  PushBackSourceLine(&line_info1, &source_file, 2, 4098, 2);
+  EXPECT_TRUE(line_info1.Visit(core::RelativeAddress(4096), 2, 1));
+
+  TestLineInfo line_info2;
+  PushBackSourceLine(&line_info2, &source_file, 1, 4096, 2);
+  PushBackSourceLine(&line_info2, &source_file, 2, 4098, 2);
+  EXPECT_TRUE(line_info2.Visit(core::RelativeAddress(4096), 2, 2));
+  EXPECT_TRUE(line_info2.Visit(core::RelativeAddress(4098), 2, 3));
+
+  // Merging into an empty LineInfo adopts the lines, with the file names
+  // pointing into the adopting object's own file name set.
+  TestLineInfo merged;
+  EXPECT_TRUE(merged.Merge(line_info1));
+  ASSERT_EQ(2u, merged.source_lines().size());
+  EXPECT_EQ(1u, merged.source_lines()[0].visit_count);
+  EXPECT_EQ(0u, merged.source_lines()[1].visit_count);
+  ASSERT_EQ(1u, merged.source_files_.size());
+  EXPECT_EQ(&(*merged.source_files_.begin()),
+            merged.source_lines()[0].source_file_name);
+
+  // Merging a second object sums the visit counts line by line.
+  EXPECT_TRUE(merged.Merge(line_info2));
+  ASSERT_EQ(2u, merged.source_lines().size());
+  EXPECT_EQ(3u, merged.source_lines()[0].visit_count);
+  EXPECT_EQ(3u, merged.source_lines()[1].visit_count);
+}
+
+TEST_F(LineInfoTest, MergeFailsForInconsistentLineInfo) {
+  // Create a single dummy source file.
+  std::string source_file("foo.cc");
+
+  TestLineInfo line_info1;
+  PushBackSourceLine(&line_info1, &source_file, 1, 4096, 2);
+
+  TestLineInfo line_info2;
+  PushBackSourceLine(&line_info2, &source_file, 1, 4096, 2);
+  PushBackSourceLine(&line_info2, &source_file, 2, 4098, 2);
+
+  EXPECT_FALSE(line_info1.Merge(line_info2));
+}
+
 }  // namespace grinder
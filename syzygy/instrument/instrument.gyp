@@ -32,6 +32,8 @@
         'instrumenters/branch_instrumenter.h',
         'instrumenters/bbentry_instrumenter.cc',
         'instrumenters/bbentry_instrumenter.h',
+        'instrumenters/cache_instrumenter.cc',
+        'instrumenters/cache_instrumenter.h',
         'instrumenters/coverage_instrumenter.cc',
         'instrumenters/coverage_instrumenter.h',
         'instrumenters/entry_call_instrumenter.cc',
@@ -110,6 +112,7 @@
         'instrumenters/archive_instrumenter_unittest.cc',
         'instrumenters/asan_instrumenter_unittest.cc',
         'instrumenters/bbentry_instrumenter_unittest.cc',
+        'instrumenters/cache_instrumenter_unittest.cc',
         'instrumenters/branch_instrumenter_unittest.cc',
         'instrumenters/coverage_instrumenter_unittest.cc',
         'instrumenters/entry_call_instrumenter_unittest.cc',
@@ -25,6 +25,7 @@
 #include "syzygy/instrument/instrumenters/archive_instrumenter.h"
 #include "syzygy/instrument/instrumenters/asan_instrumenter.h"
 #include "syzygy/instrument/instrumenters/bbentry_instrumenter.h"
+#include "syzygy/instrument/instrumenters/cache_instrumenter.h"
 #include "syzygy/instrument/instrumenters/branch_instrumenter.h"
 #include "syzygy/instrument/instrumenters/coverage_instrumenter.h"
 #include "syzygy/instrument/instrumenters/entry_call_instrumenter.h"
@@ -60,6 +61,14 @@ static const char kUsageFormatStr[] =
     "                            use when instrumenting the provided module.\n"
     "                            If not specified a default agent library\n"
     "                            will be used. This is ignored in ASAN mode.\n"
+    "    --cache-dir=<path>      Points to a directory to be used as a\n"
+    "                            content-addressed cache of instrumentation\n"
+    "                            outputs, keyed on the input image contents\n"
+    "                            and the instrumenter configuration. On a\n"
+    "                            cache hit the cached image and PDB pair is\n"
+    "                            copied to the outputs and the\n"
+    "                            instrumentation pipeline is skipped. If\n"
+    "                            not specified no caching is performed.\n"
     "    --debug-friendly        Generate more debugger friendly output by\n"
     "                            making the thunks resolve to the original\n"
     "                            function's name. This is at the cost of the\n"
@@ -78,6 +87,9 @@ static const char kUsageFormatStr[] =
     "                            the strings when augmenting the PDB. They\n"
     "                            are stripped by default to keep PDB sizes\n"
     "                            down.\n"
+    "    --num-threads=K         When instrumenting an archive, instruments\n"
+    "                            up to K object files concurrently.\n"
+    "                            Defaults to 1.\n"
     "    --output-pdb=<path>     The PDB for the instrumented DLL. If not\n"
     "                            provided will attempt to generate one.\n"
     "    --overwrite             Allow output files to be overwritten.\n"
@@ -89,6 +101,16 @@ static const char kUsageFormatStr[] =
     "                            these options see common/asan_parameters. If\n"
     "                            not specified then the defaults of the RTL\n"
     "                            will be used.\n"
+    "    --hot-heat-fraction=DOUBLE\n"
+    "                            The fraction of the total heat of the\n"
+    "                            sample-heat-csv profile that is considered\n"
+    "                            hot, as a value in the range 0..1,\n"
+    "                            inclusive. Defaults to 0.9.\n"
+    "    --hot-instrumentation-rate=DOUBLE\n"
+    "                            The instrumentation rate to apply to the\n"
+    "                            hot code identified by the sample-heat-csv\n"
+    "                            profile, as a value in the range 0..1,\n"
+    "                            inclusive. Defaults to 0.1.\n"
     "    --instrumentation-rate=DOUBLE\n"
     "                            Specifies the fraction of instructions to\n"
     "                            be instrumented, as a value in the range\n"
@@ -100,6 +122,12 @@ static const char kUsageFormatStr[] =
     "                            analysis.\n"
     "    --no-redundancy-analysis\n"
     "                            Disables redundant memory access analysis.\n"
+    "    --sample-heat-csv=<path>\n"
+    "                            The path of a basic-block heat CSV file, as\n"
+    "                            produced by the sample grinder. If provided\n"
+    "                            then the hottest functions of the image are\n"
+    "                            instrumented at the hot instrumentation\n"
+    "                            rate rather than the regular one.\n"
     "  branch mode options:\n"
     "    --buffering             Enable per-thread buffering of events.\n"
     "    --fs-slot=<slot>        Specify which FS slot to use for thread\n"
@@ -189,6 +217,14 @@ bool InstrumentApp::ParseCommandLine(const CommandLine* cmd_line) {
   }
   DCHECK(instrumenter_.get() != NULL);
 
+  // If a cache directory has been provided then wrap the instrumenter with
+  // the output cache. This wraps the outermost instrumenter so that, for
+  // example, archive instrumentation is cached as a whole.
+  if (cmd_line->HasSwitch("cache-dir")) {
+    instrumenter_.reset(new instrumenters::CacheInstrumenter(
+        instrumenter_.release()));
+  }
+
   return instrumenter_->ParseCommandLine(cmd_line);
 }
 
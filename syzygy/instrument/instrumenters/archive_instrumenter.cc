@@ -19,9 +19,18 @@
 
 #include "syzygy/instrument/instrumenters/archive_instrumenter.h"
 
+#include <algorithm>
+
 #include "base/bind.h"
 #include "base/file_util.h"
+#include "base/memory/scoped_vector.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/ar/ar_reader.h"
 #include "syzygy/ar/ar_transform.h"
+#include "syzygy/ar/ar_writer.h"
 #include "syzygy/core/file_util.h"
 
 namespace instrument {
@@ -30,16 +39,168 @@ namespace instrumenters {
 namespace {
 
 const char kInputImage[] = "input-image";
+const char kNumThreads[] = "num-threads";
 const char kOutputImage[] = "output-image";
 
+typedef ArchiveInstrumenter::InstrumenterFactoryFunction
+    InstrumenterFactoryFunction;
+
+// Instruments a single object file by configuring and running a brand new
+// instrumenter instance produced by @p factory. This is safe to call from
+// multiple threads concurrently as each invocation works with its own
+// instrumenter and its own files.
+bool InstrumentObjectFile(
+    ArchiveInstrumenter::InstrumenterFactoryFunction factory,
+    const CommandLine* base_command_line,
+    const base::FilePath& input_path,
+    const base::FilePath& output_path) {
+  DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory);
+  DCHECK_NE(reinterpret_cast<const CommandLine*>(NULL), base_command_line);
+
+  // Create the command-line for the child instrumenter.
+  CommandLine command_line(*base_command_line);
+  command_line.AppendSwitchPath(kInputImage, input_path);
+  command_line.AppendSwitchPath(kOutputImage, output_path);
+
+  // Create, initialize and run an instrumenter.
+  scoped_ptr<InstrumenterInterface> instrumenter(factory());
+  DCHECK_NE(reinterpret_cast<InstrumenterInterface*>(NULL),
+            instrumenter.get());
+  if (!instrumenter->ParseCommandLine(&command_line))
+    return false;
+  if (!instrumenter->Instrument())
+    return false;
+
+  return true;
+}
+
+// A single file extracted from the input archive, and the bookkeeping needed
+// to instrument it and put it back.
+struct ArchiveMember {
+  ArchiveMember() : is_coff(false) {
+  }
+
+  ar::ParsedArFileHeader header;
+  ar::DataBuffer contents;
+  bool is_coff;
+
+  // Only set for COFF members, which are round-tripped through files on disk
+  // for the nested instrumenter.
+  base::FilePath input_path;
+  base::FilePath output_path;
+
+  // The symbols exported by the (instrumented) member, extracted on the
+  // worker threads so that assembling the output archive is a cheap merge.
+  ar::SymbolIndexMap symbols;
+  ar::SymbolIndexMap weak_symbols;
+};
+
+// Instruments the COFF members of an archive. Worker threads share a pool
+// instance and claim members one at a time, so the load is balanced across
+// members of varying sizes.
+class ArchiveMemberPool : public base::DelegateSimpleThread::Delegate {
+ public:
+  ArchiveMemberPool(ArchiveInstrumenter::InstrumenterFactoryFunction factory,
+                    const CommandLine* command_line,
+                    ScopedVector<ArchiveMember>* members)
+      : factory_(factory),
+        command_line_(command_line),
+        members_(members),
+        next_member_(0),
+        success_(true) {
+    DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory);
+    DCHECK_NE(reinterpret_cast<const CommandLine*>(NULL), command_line);
+    DCHECK_NE(reinterpret_cast<ScopedVector<ArchiveMember>*>(NULL), members);
+  }
+
+  virtual void Run() OVERRIDE {
+    while (true) {
+      ArchiveMember* member = ClaimMember();
+      if (member == NULL)
+        return;
+
+      if (!ProcessMember(member)) {
+        base::AutoLock lock(lock_);
+        success_ = false;
+        return;
+      }
+    }
+  }
+
+  // @returns true if all of the members processed so far were successfully
+  //     instrumented.
+  bool success() {
+    base::AutoLock lock(lock_);
+    return success_;
+  }
+
+ private:
+  // Processes a single member. COFF members are instrumented and their
+  // contents replaced with the instrumented object file; other members pass
+  // through the pipeline untouched. Either way the symbols exported by the
+  // member are extracted here, so that the main thread can assemble the
+  // output archive without parsing any member contents.
+  bool ProcessMember(ArchiveMember* member) {
+    DCHECK_NE(reinterpret_cast<ArchiveMember*>(NULL), member);
+
+    if (member->is_coff) {
+      if (!InstrumentObjectFile(factory_, command_line_,
+                                member->input_path, member->output_path)) {
+        return false;
+      }
+
+      // Read back the instrumented member.
+      int64 size = 0;
+      if (!base::GetFileSize(member->output_path, &size)) {
+        LOG(ERROR) << "Unable to read size of file: "
+                   << member->output_path.value();
+        return false;
+      }
+      member->contents.resize(size);
+      if (base::ReadFile(member->output_path,
+                         reinterpret_cast<char*>(member->contents.data()),
+                         member->contents.size()) !=
+          static_cast<int>(member->contents.size())) {
+        LOG(ERROR) << "Unable to read file: " << member->output_path.value();
+        return false;
+      }
+    }
+
+    if (!ar::ArWriter::ExtractSymbols(member->header.name, &member->contents,
+                                      &member->symbols,
+                                      &member->weak_symbols)) {
+      return false;
+    }
+
+    return true;
+  }
+
+  // Claims the next member to be processed. Returns NULL when the pool is
+  // exhausted or another worker has failed.
+  ArchiveMember* ClaimMember() {
+    base::AutoLock lock(lock_);
+    if (!success_ || next_member_ >= members_->size())
+      return NULL;
+    return (*members_)[next_member_++];
+  }
+
+  ArchiveInstrumenter::InstrumenterFactoryFunction factory_;
+  const CommandLine* command_line_;
+  ScopedVector<ArchiveMember>* members_;
+
+  base::Lock lock_;
+  size_t next_member_;  // Under lock_.
+  bool success_;  // Under lock_.
+};
+
 }  // namespace
 
 ArchiveInstrumenter::ArchiveInstrumenter()
-    : factory_(NULL), overwrite_(false) {
+    : factory_(NULL), overwrite_(false), max_num_threads_(1) {
 }
 
 ArchiveInstrumenter::ArchiveInstrumenter(InstrumenterFactoryFunction factory)
-    : factory_(factory), overwrite_(false) {
+    : factory_(factory), overwrite_(false), max_num_threads_(1) {
   DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory);
 }
 
@@ -54,6 +215,17 @@ bool ArchiveInstrumenter::ParseCommandLine(const CommandLine* command_line) {
   output_image_ = command_line_->GetSwitchValuePath(kOutputImage);
   overwrite_ = command_line_->HasSwitch("overwrite");
 
+  if (command_line_->HasSwitch(kNumThreads)) {
+    std::string value = command_line_->GetSwitchValueASCII(kNumThreads);
+    size_t num_threads = 0;
+    if (!base::StringToSizeT(value, &num_threads) || num_threads == 0) {
+      LOG(ERROR) << "Invalid value for --" << kNumThreads << ": "
+                 << value << ".";
+      return false;
+    }
+    max_num_threads_ = num_threads;
+  }
+
   return true;
 }
 
@@ -111,6 +283,9 @@ bool ArchiveInstrumenter::InstrumentArchive() {
     return false;
   }
 
+  if (max_num_threads_ > 1)
+    return InstrumentArchiveParallel();
+
   LOG(INFO) << "Instrumenting archive: " << input_image_.value();
 
   // Configure and run an archive transform.
@@ -127,6 +302,112 @@ bool ArchiveInstrumenter::InstrumentArchive() {
   return true;
 }
 
+bool ArchiveInstrumenter::InstrumentArchiveParallel() {
+  DCHECK_LT(1u, max_num_threads_);
+
+  LOG(INFO) << "Instrumenting archive: " << input_image_.value();
+
+  // Read the entire archive up front. Extraction has to be serial, but it is
+  // cheap compared to instrumentation.
+  ar::ArReader reader;
+  if (!reader.Init(input_image_))
+    return false;
+  LOG(INFO) << "Read " << reader.symbols().size() << " symbols.";
+
+  ScopedVector<ArchiveMember> members;
+  for (size_t i = 0; i < reader.offsets().size(); ++i) {
+    scoped_ptr<ArchiveMember> member(new ArchiveMember());
+    if (!reader.ExtractNext(&member->header, &member->contents))
+      return false;
+
+    // Filter anything that isn't a known and recognized COFF file; such
+    // members simply pass through to the output archive untouched.
+    core::FileType file_type = core::kUnknownFileType;
+    if (!core::GuessFileType(member->contents.data(), member->contents.size(),
+                             &file_type)) {
+      LOG(ERROR) << "Unable to determine file type.";
+      return false;
+    }
+    member->is_coff = (file_type == core::kCoffFileType);
+
+    members.push_back(member.release());
+  }
+
+  // Round-trip the COFF members through disk for the nested instrumenters.
+  base::FilePath temp_dir;
+  if (!base::CreateNewTempDirectory(L"ArchiveInstrumenter", &temp_dir)) {
+    LOG(ERROR) << "Unable to create temporary directory.";
+    return false;
+  }
+
+  bool success = true;
+  for (size_t i = 0; i < members.size(); ++i) {
+    ArchiveMember* member = members[i];
+    if (!member->is_coff)
+      continue;
+    member->input_path = temp_dir.Append(
+        base::StringPrintf(L"input-%04d.obj", i));
+    member->output_path = temp_dir.Append(
+        base::StringPrintf(L"output-%04d.obj", i));
+    if (base::WriteFile(member->input_path,
+                        reinterpret_cast<const char*>(member->contents.data()),
+                        member->contents.size()) !=
+            static_cast<int>(member->contents.size())) {
+      LOG(ERROR) << "Unable to write file: " << member->input_path.value();
+      success = false;
+      break;
+    }
+  }
+
+  if (success) {
+    // Instrument the members on a pool of worker threads. There's no need to
+    // spin up more threads than there are members.
+    ArchiveMemberPool pool(factory_, command_line_.get(), &members);
+    size_t num_threads = std::min(max_num_threads_, members.size());
+    ScopedVector<base::DelegateSimpleThread> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads.push_back(new base::DelegateSimpleThread(
+          &pool, "ArchiveInstrumenterWorker"));
+      threads.back()->Start();
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Join();
+    success = pool.success();
+  }
+
+  // Assemble the output archive in the original member order. The members
+  // were read back and their symbols extracted on the worker threads, so
+  // all that remains is a cheap merge of the symbol tables and a single
+  // sequential write.
+  if (success) {
+    ar::ArWriter writer;
+    for (size_t i = 0; i < members.size(); ++i) {
+      ArchiveMember* member = members[i];
+      if (!writer.AddFile(member->header.name, member->header.timestamp,
+                          member->header.mode, &member->contents,
+                          member->symbols, member->weak_symbols)) {
+        success = false;
+        break;
+      }
+    }
+
+    if (success) {
+      if (writer.Write(output_image_)) {
+        LOG(INFO) << "Wrote " << writer.symbols().size() << " symbols.";
+      } else {
+        success = false;
+      }
+    }
+  }
+
+  if (!base::DeleteFile(temp_dir, true)) {
+    LOG(WARNING) << "Unable to delete temporary directory: "
+                 << temp_dir.value();
+  }
+
+  return success;
+}
+
 bool ArchiveInstrumenter::InstrumentFile(const base::FilePath& input_path,
                                          const base::FilePath& output_path,
                                          ar::ParsedArFileHeader* header,
@@ -153,21 +434,8 @@ bool ArchiveInstrumenter::InstrumentFile(const base::FilePath& input_path,
     return true;
   }
 
-  // Create the command-line for the child instrumenter.
-  CommandLine command_line(*command_line_.get());
-  command_line.AppendSwitchPath(kInputImage, input_path);
-  command_line.AppendSwitchPath(kOutputImage, output_path);
-
-  // Create, initialize and run an instrumenter.
-  scoped_ptr<InstrumenterInterface> instrumenter(factory_());
-  DCHECK_NE(reinterpret_cast<InstrumenterInterface*>(NULL),
-            instrumenter.get());
-  if (!instrumenter->ParseCommandLine(&command_line))
-    return false;
-  if (!instrumenter->Instrument())
-    return false;
-
-  return true;
+  return InstrumentObjectFile(factory_, command_line_.get(),
+                              input_path, output_path);
 }
 
 }  // namespace instrumenters
@@ -45,6 +45,10 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   // @returns the factory function being used by this instrumenter
   //     adapter.
   InstrumenterFactoryFunction factory() const { return factory_; }
+
+  // @returns the maximum number of archive members that will be instrumented
+  //     concurrently.
+  size_t max_num_threads() const { return max_num_threads_; }
   // @}
 
   // @name Mutators.
@@ -53,6 +57,16 @@ class ArchiveInstrumenter : public InstrumenterInterface {
     DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory);
     factory_ = factory;
   }
+
+  // Sets the maximum number of archive members that will be instrumented
+  // concurrently. Each member is handled by its own instrumenter instance so
+  // they are entirely independent. Also settable on the command-line via
+  // --num-threads. Defaults to 1, which processes the archive serially.
+  // @param max_num_threads the maximum number of worker threads to use.
+  void set_max_num_threads(size_t max_num_threads) {
+    DCHECK_LT(0u, max_num_threads);
+    max_num_threads_ = max_num_threads;
+  }
   // @}
 
   // @name InstrumenterInterface implementation.
@@ -67,6 +81,9 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   bool InstrumentPassthrough();
   // Instruments an archive.
   bool InstrumentArchive();
+  // Instruments an archive using max_num_threads_ worker threads, with the
+  // results assembled into the output archive in their original order.
+  bool InstrumentArchiveParallel();
   // Callback for the ArTransform object. This is invoked for each file in an
   // archive.
   bool InstrumentFile(const base::FilePath& input_path,
@@ -85,6 +102,9 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   base::FilePath output_image_;
   bool overwrite_;
 
+  // The maximum number of archive members to instrument concurrently.
+  size_t max_num_threads_;
+
   DISALLOW_COPY_AND_ASSIGN(ArchiveInstrumenter);
 };
 
@@ -16,6 +16,7 @@
 
 #include "base/file_util.h"
 #include "gtest/gtest.h"
+#include "syzygy/ar/ar_reader.h"
 #include "syzygy/ar/unittest_util.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/instrument/instrumenters/asan_instrumenter.h"
@@ -138,6 +139,23 @@ TEST_F(ArchiveInstrumenterTest, IteratesOverArchiveFiles) {
   EXPECT_TRUE(base::PathExists(output_image_));
 }
 
+TEST_F(ArchiveInstrumenterTest, ParallelInstrumentArchive) {
+  ArchiveInstrumenter inst(&IdentityInstrumenterFactory);
+  command_line_->AppendSwitchPath("input-image", zlib_lib_);
+  command_line_->AppendSwitchASCII("num-threads", "4");
+
+  EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
+  EXPECT_EQ(4u, inst.max_num_threads());
+  EXPECT_TRUE(inst.Instrument());
+  EXPECT_TRUE(base::PathExists(output_image_));
+
+  // The global counters aren't thread safe, so instead validate that the
+  // output archive contains all of the original members.
+  ar::ArReader reader;
+  ASSERT_TRUE(reader.Init(output_image_));
+  EXPECT_EQ(testing::kArchiveFileCount, reader.offsets().size());
+}
+
 TEST_F(ArchiveInstrumenterTest, AsanInstrumentArchive) {
   ArchiveInstrumenter inst(&AsanInstrumenterFactory);
   command_line_->AppendSwitchPath("input-image", zlib_lib_);
@@ -15,9 +15,14 @@
 #include "syzygy/instrument/instrumenters/asan_instrumenter.h"
 
 #include <algorithm>
+#include <string>
+#include <vector>
 
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
 #include "syzygy/common/application.h"
 #include "syzygy/instrument/transforms/allocation_filter_transform.h"
 
@@ -28,6 +33,45 @@ namespace {
 namespace instrument {
 namespace instrumenters {
 
+namespace {
+
+// One row of a basic-block heat CSV file.
+struct HeatRow {
+  core::RelativeAddress rva;
+  size_t size;
+  double heat;
+};
+
+// Orders heat rows by decreasing heat.
+bool HeatRowGreater(const HeatRow& row1, const HeatRow& row2) {
+  return row1.heat > row2.heat;
+}
+
+// Parses the named floating point switch if it is present, capping the
+// value to the range of valid rates [0, 1].
+bool ParseOptionalRate(const CommandLine* command_line,
+                       const char* switch_name,
+                       double* rate) {
+  DCHECK(command_line != NULL);
+  DCHECK(switch_name != NULL);
+  DCHECK(rate != NULL);
+
+  if (!command_line->HasSwitch(switch_name))
+    return true;
+
+  std::string s = command_line->GetSwitchValueASCII(switch_name);
+  double d = 0;
+  if (!base::StringToDouble(s, &d)) {
+    LOG(ERROR) << "Failed to parse floating point value: " << s;
+    return false;
+  }
+
+  *rate = std::max(0.0, std::min(1.0, d));
+  return true;
+}
+
+}  // namespace
+
 const char AsanInstrumenter::kAgentDllAsan[] = "syzyasan_rtl.dll";
 
 AsanInstrumenter::AsanInstrumenter()
@@ -35,7 +79,9 @@ AsanInstrumenter::AsanInstrumenter()
       remove_redundant_checks_(true),
       use_liveness_analysis_(true),
       instrumentation_rate_(1.0),
-      asan_rtl_options_(false) {
+      asan_rtl_options_(false),
+      hot_heat_fraction_(0.9),
+      hot_instrumentation_rate_(0.1) {
   agent_dll_ = kAgentDllAsan;
 }
 
@@ -48,12 +94,13 @@ bool AsanInstrumenter::ImageFormatIsSupported(ImageFormat image_format) {
 }
 
 bool AsanInstrumenter::InstrumentImpl() {
-  // Parse the filter if one was provided.
+  // Load the filter if one was provided. This accepts both compiled binary
+  // and JSON encoded filters.
   scoped_ptr<pe::ImageFilter> filter;
   if (!filter_path_.empty()) {
     filter.reset(new pe::ImageFilter());
-    if (!filter->LoadFromJSON(filter_path_)) {
-      LOG(ERROR) << "Failed to parse filter file: " << filter_path_.value();
+    if (!filter->Load(filter_path_)) {
+      LOG(ERROR) << "Failed to load filter file: " << filter_path_.value();
       return false;
     }
 
@@ -77,6 +124,25 @@ bool AsanInstrumenter::InstrumentImpl() {
     asan_transform_->set_filter(&filter_->filter);
   }
 
+  // If a sample heat CSV was provided then derive a hot code filter from it
+  // and instrument the code it covers at the hot instrumentation rate.
+  if (!sample_heat_path_.empty()) {
+    heat_filter_.reset(new pe::ImageFilter());
+    if (!heat_filter_->Init(input_image_path_)) {
+      LOG(ERROR) << "Failed to initialize the hot code filter for image: "
+                 << input_image_path_.value();
+      return false;
+    }
+    if (!LoadSampleHeatCsv(sample_heat_path_, hot_heat_fraction_,
+                           &heat_filter_->filter)) {
+      LOG(ERROR) << "Failed to load sample heat CSV file: "
+                 << sample_heat_path_.value();
+      return false;
+    }
+    asan_transform_->set_hot_code_filter(&heat_filter_->filter);
+    asan_transform_->set_hot_instrumentation_rate(hot_instrumentation_rate_);
+  }
+
   // Set overwrite source range flag in the ASAN transform. The ASAN
   // transformation will overwrite the source range of created instructions to
   // the source range of corresponding instrumented instructions.
@@ -99,6 +165,93 @@ bool AsanInstrumenter::InstrumentImpl() {
   return true;
 }
 
+bool AsanInstrumenter::LoadSampleHeatCsv(
+    const base::FilePath& path,
+    double hot_fraction,
+    pe::ImageFilter::RelativeAddressFilter* filter) {
+  DCHECK(filter != NULL);
+
+  std::string contents;
+  if (!base::ReadFileToString(path, &contents)) {
+    LOG(ERROR) << "Unable to read heat CSV file: " << path.value();
+    return false;
+  }
+
+  // Each row holds the RVA and size of a basic block, the compiland and
+  // function names it belongs to and its heat. The names may themselves
+  // contain commas, so the fields of interest are extracted positionally
+  // from both ends of the row rather than by splitting it wholesale.
+  std::vector<std::string> lines;
+  base::SplitString(contents, '\n', &lines);
+  std::vector<HeatRow> rows;
+  double total_heat = 0.0;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    std::string line;
+    base::TrimWhitespace(lines[i], base::TRIM_ALL, &line);
+    if (line.empty())
+      continue;
+
+    // Skip the header row.
+    if (rows.empty() && line.compare(0, 3, "RVA") == 0)
+      continue;
+
+    size_t comma1 = line.find(',');
+    size_t comma2 = std::string::npos;
+    if (comma1 != std::string::npos)
+      comma2 = line.find(',', comma1 + 1);
+    size_t comma_last = line.rfind(',');
+    if (comma2 == std::string::npos || comma_last <= comma2) {
+      LOG(ERROR) << "Invalid heat CSV row: " << line;
+      return false;
+    }
+
+    std::string field;
+    int64 rva = 0;
+    base::TrimWhitespace(line.substr(0, comma1), base::TRIM_ALL, &field);
+    bool valid = base::HexStringToInt64(field, &rva);
+
+    size_t size = 0;
+    base::TrimWhitespace(line.substr(comma1 + 1, comma2 - comma1 - 1),
+                         base::TRIM_ALL, &field);
+    valid = valid && base::StringToSizeT(field, &size);
+
+    double heat = 0.0;
+    base::TrimWhitespace(line.substr(comma_last + 1), base::TRIM_ALL, &field);
+    valid = valid && base::StringToDouble(field, &heat);
+
+    if (!valid || rva < 0 || heat < 0.0) {
+      LOG(ERROR) << "Invalid heat CSV row: " << line;
+      return false;
+    }
+
+    HeatRow row = { core::RelativeAddress(static_cast<uint32>(rva)),
+                    size,
+                    heat };
+    total_heat += heat;
+    rows.push_back(row);
+  }
+
+  if (rows.empty()) {
+    LOG(ERROR) << "Heat CSV file contains no rows: " << path.value();
+    return false;
+  }
+
+  // Mark the hottest ranges until the requested fraction of the total heat
+  // of the module is covered. Ranges that were never sampled are never
+  // considered hot.
+  std::sort(rows.begin(), rows.end(), &HeatRowGreater);
+  double heat_covered = 0.0;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    if (rows[i].heat == 0.0 || heat_covered >= hot_fraction * total_heat)
+      break;
+    filter->Mark(pe::ImageFilter::RelativeAddressFilter::Range(
+        rows[i].rva, rows[i].size));
+    heat_covered += rows[i].heat;
+  }
+
+  return true;
+}
+
 bool AsanInstrumenter::ParseAdditionalCommandLineArguments(
     const CommandLine* command_line) {
   // Parse the additional command line arguments.
@@ -109,15 +262,26 @@ bool AsanInstrumenter::ParseAdditionalCommandLineArguments(
 
   // Parse the instrumentation rate if one has been provided.
   static const char kInstrumentationRate[] = "instrumentation-rate";
-  if (command_line->HasSwitch(kInstrumentationRate)) {
-    std::string s = command_line->GetSwitchValueASCII(kInstrumentationRate);
-    double d = 0;
-    if (!base::StringToDouble(s, &d)) {
-      LOG(ERROR) << "Failed to parse floating point value: " << s;
-      return false;
-    }
-    // Cap the rate to the range of valid values [0, 1].
-    instrumentation_rate_ = std::max(0.0, std::min(1.0, d));
+  if (!ParseOptionalRate(command_line, kInstrumentationRate,
+                         &instrumentation_rate_)) {
+    return false;
+  }
+
+  // Parse the sample heat profile parameters. The heat CSV is produced by
+  // the sample grinder with a basic-block aggregation level; if one is
+  // provided then the hottest functions of the image are instrumented at
+  // the hot instrumentation rate rather than the regular one.
+  static const char kSampleHeatCsv[] = "sample-heat-csv";
+  static const char kHotHeatFraction[] = "hot-heat-fraction";
+  static const char kHotInstrumentationRate[] = "hot-instrumentation-rate";
+  sample_heat_path_ = command_line->GetSwitchValuePath(kSampleHeatCsv);
+  if (!ParseOptionalRate(command_line, kHotHeatFraction,
+                         &hot_heat_fraction_)) {
+    return false;
+  }
+  if (!ParseOptionalRate(command_line, kHotInstrumentationRate,
+                         &hot_instrumentation_rate_)) {
+    return false;
   }
 
   // Parse ASAN RTL options if present.
@@ -138,9 +302,9 @@ bool AsanInstrumenter::ParseAdditionalCommandLineArguments(
   if (!allocation_filter_config_file_path_.empty()) {
     std::string json_string;
     AllocationFilterTransform::FunctionNameOffsetMap target_calls;
-    if (!AllocationFilterTransform::ReadFromJSON(
+    if (!AllocationFilterTransform::ReadFromFile(
       allocation_filter_config_file_path_, &target_calls)) {
-      LOG(ERROR) << "Failed to parse allocation-filter configuration file: "
+      LOG(ERROR) << "Failed to read allocation-filter configuration file: "
                  << allocation_filter_config_file_path_.value();
       return false;
     }
@@ -48,6 +48,22 @@ class AsanInstrumenter : public InstrumenterWithAgent {
       const CommandLine* command_line) OVERRIDE;
   // @}
 
+  // Loads a basic-block heat CSV file, as produced by the sample grinder
+  // with a basic-block aggregation level, and marks the hottest ranges in
+  // @p filter. The ranges are visited by decreasing heat and marked until
+  // @p hot_fraction of the total heat of the module has been covered;
+  // ranges that were never sampled are never marked.
+  // @param path the path of the heat CSV file to load.
+  // @param hot_fraction the fraction of the total heat to consider hot.
+  //     This is expected to be in the range [0, 1].
+  // @param filter the filter to mark. This must already have an extent
+  //     covering the module.
+  // @returns true on success, false otherwise.
+  static bool LoadSampleHeatCsv(
+      const base::FilePath& path,
+      double hot_fraction,
+      pe::ImageFilter::RelativeAddressFilter* filter);
+
   // @name Command-line parameters.
   // @{
   base::FilePath filter_path_;
@@ -56,6 +72,9 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   bool use_liveness_analysis_;
   double instrumentation_rate_;
   bool asan_rtl_options_;
+  base::FilePath sample_heat_path_;
+  double hot_heat_fraction_;
+  double hot_instrumentation_rate_;
   // @}
 
   // Valid if asan_rtl_options_ is true.
@@ -67,6 +86,9 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   // The image filter (optional).
   scoped_ptr<pe::ImageFilter> filter_;
 
+  // The hot code filter derived from the sample heat CSV (optional).
+  scoped_ptr<pe::ImageFilter> heat_filter_;
+
   // Path to the JSON configuration file for the AllocationFilter transform.
   // The AllocationFilter tranform is only applied if this config file is
   // specified.
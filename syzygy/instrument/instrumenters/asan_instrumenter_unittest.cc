@@ -15,6 +15,7 @@
 #include "syzygy/instrument/instrumenters/asan_instrumenter.h"
 
 #include "base/command_line.h"
+#include "base/file_util.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pe/image_filter.h"
@@ -40,10 +41,15 @@ class TestAsanInstrumenter : public AsanInstrumenter {
   using AsanInstrumenter::asan_rtl_options_;
   using AsanInstrumenter::debug_friendly_;
   using AsanInstrumenter::filter_path_;
+  using AsanInstrumenter::heat_filter_;
+  using AsanInstrumenter::hot_heat_fraction_;
+  using AsanInstrumenter::hot_instrumentation_rate_;
   using AsanInstrumenter::input_image_path_;
   using AsanInstrumenter::input_pdb_path_;
   using AsanInstrumenter::instrumentation_rate_;
   using AsanInstrumenter::kAgentDllAsan;
+  using AsanInstrumenter::LoadSampleHeatCsv;
+  using AsanInstrumenter::sample_heat_path_;
   using AsanInstrumenter::no_augment_pdb_;
   using AsanInstrumenter::no_strip_strings_;
   using AsanInstrumenter::output_image_path_;
@@ -91,6 +97,7 @@ class AsanInstrumenterTest : public testing::PELibUnitTest {
     output_pdb_path_ = temp_dir_.Append(input_pdb_path_.BaseName());
     test_dll_filter_path_ = temp_dir_.Append(L"test_dll_filter.json");
     dummy_filter_path_ = temp_dir_.Append(L"dummy_filter.json");
+    sample_heat_csv_path_ = temp_dir_.Append(L"heat.csv");
   }
 
   void SetUpValidCommandLine() {
@@ -113,6 +120,20 @@ class AsanInstrumenterTest : public testing::PELibUnitTest {
     ASSERT_TRUE(filter.SaveToJSON(true, dummy_filter_path_));
   }
 
+  // Creates a sample heat CSV file covering 4 fake basic blocks. The two
+  // hottest blocks account for 90% of the total heat, and the last one was
+  // never sampled at all.
+  void MakeSampleHeatCsv() {
+    static const char kHeatCsv[] =
+        "RVA, Size, Compiland, Function, Heat\n"
+        "0x00001000, 16, foo.obj, foo(), 6.0000000000e+001\n"
+        "0x00001010, 16, foo.obj, bar<int, int>(), 3.0000000000e+001\n"
+        "0x00001020, 16, foo.obj, baz(), 1.0000000000e+001\n"
+        "0x00001030, 16, foo.obj, qux(), 0.0000000000e+000\n";
+    ASSERT_NE(-1, base::WriteFile(sample_heat_csv_path_, kHeatCsv,
+                                  sizeof(kHeatCsv) - 1));
+  }
+
   base::FilePath temp_dir_;
 
   // @name The redirected streams paths.
@@ -131,6 +152,7 @@ class AsanInstrumenterTest : public testing::PELibUnitTest {
   base::FilePath output_pdb_path_;
   base::FilePath test_dll_filter_path_;
   base::FilePath dummy_filter_path_;
+  base::FilePath sample_heat_csv_path_;
   // @}
 
   // @name Expected final values of input parameters.
@@ -163,6 +185,9 @@ TEST_F(AsanInstrumenterTest, ParseMinimalAsan) {
   EXPECT_TRUE(instrumenter_.remove_redundant_checks_);
   EXPECT_EQ(1.0, instrumenter_.instrumentation_rate_);
   EXPECT_FALSE(instrumenter_.asan_rtl_options_);
+  EXPECT_TRUE(instrumenter_.sample_heat_path_.empty());
+  EXPECT_EQ(0.9, instrumenter_.hot_heat_fraction_);
+  EXPECT_EQ(0.1, instrumenter_.hot_instrumentation_rate_);
 }
 
 TEST_F(AsanInstrumenterTest, ParseFullAsan) {
@@ -181,6 +206,9 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   cmd_line_.AppendSwitchASCII("instrumentation-rate", "0.5");
   cmd_line_.AppendSwitchASCII("asan-rtl-options",
       "--quarantine_size=1024 --quarantine_block_size=512 --ignored");
+  cmd_line_.AppendSwitchPath("sample-heat-csv", sample_heat_csv_path_);
+  cmd_line_.AppendSwitchASCII("hot-heat-fraction", "0.8");
+  cmd_line_.AppendSwitchASCII("hot-instrumentation-rate", "0.25");
 
   EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
 
@@ -199,6 +227,9 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   EXPECT_FALSE(instrumenter_.remove_redundant_checks_);
   EXPECT_EQ(0.5, instrumenter_.instrumentation_rate_);
   EXPECT_TRUE(instrumenter_.asan_rtl_options_);
+  EXPECT_EQ(sample_heat_csv_path_, instrumenter_.sample_heat_path_);
+  EXPECT_EQ(0.8, instrumenter_.hot_heat_fraction_);
+  EXPECT_EQ(0.25, instrumenter_.hot_instrumentation_rate_);
 
   // We check that the requested RTL options were parsed, and that others are
   // left to their defaults. We don't check all the parameters as other
@@ -250,6 +281,63 @@ TEST_F(AsanInstrumenterTest, FailsWithInvalidInstrumentationRate) {
   EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(AsanInstrumenterTest, FailsWithInvalidHotInstrumentationRate) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("hot-instrumentation-rate", "hot");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(AsanInstrumenterTest, LoadSampleHeatCsv) {
+  typedef pe::ImageFilter::RelativeAddressFilter::Range Range;
+
+  ASSERT_NO_FATAL_FAILURE(MakeSampleHeatCsv());
+
+  pe::ImageFilter::RelativeAddressFilter filter(
+      Range(core::RelativeAddress(0), 0x2000));
+  EXPECT_TRUE(TestAsanInstrumenter::LoadSampleHeatCsv(
+      sample_heat_csv_path_, 0.9, &filter));
+
+  // The two hottest blocks cover 90% of the heat and should be marked; the
+  // colder blocks should be left alone, including the unsampled one.
+  EXPECT_TRUE(filter.IsMarked(Range(core::RelativeAddress(0x1000), 16)));
+  EXPECT_TRUE(filter.IsMarked(Range(core::RelativeAddress(0x1010), 16)));
+  EXPECT_FALSE(filter.IsMarked(Range(core::RelativeAddress(0x1020), 16)));
+  EXPECT_FALSE(filter.IsMarked(Range(core::RelativeAddress(0x1030), 16)));
+}
+
+TEST_F(AsanInstrumenterTest, LoadSampleHeatCsvFailsForBadInput) {
+  typedef pe::ImageFilter::RelativeAddressFilter::Range Range;
+
+  pe::ImageFilter::RelativeAddressFilter filter(
+      Range(core::RelativeAddress(0), 0x2000));
+
+  // A nonexistent file.
+  EXPECT_FALSE(TestAsanInstrumenter::LoadSampleHeatCsv(
+      sample_heat_csv_path_, 0.9, &filter));
+
+  // A malformed row.
+  static const char kBadCsv[] =
+      "RVA, Size, Compiland, Function, Heat\n"
+      "0x00001000, sixteen, foo.obj, foo(), 6.0000000000e+001\n";
+  ASSERT_NE(-1, base::WriteFile(sample_heat_csv_path_, kBadCsv,
+                                sizeof(kBadCsv) - 1));
+  EXPECT_FALSE(TestAsanInstrumenter::LoadSampleHeatCsv(
+      sample_heat_csv_path_, 0.9, &filter));
+}
+
+TEST_F(AsanInstrumenterTest, InstrumentImplWithSampleHeatCsv) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchPath("sample-heat-csv", sample_heat_csv_path_);
+
+  ASSERT_NO_FATAL_FAILURE(MakeSampleHeatCsv());
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_TRUE(instrumenter_.InstrumentImpl());
+  EXPECT_TRUE(instrumenter_.heat_filter_.get() != NULL);
+}
+
 TEST_F(AsanInstrumenterTest, FailsWithInvalidAsanRtlOptions) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
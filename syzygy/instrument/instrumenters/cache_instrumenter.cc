@@ -0,0 +1,331 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Instrumentation adapter that adds a content-addressed output cache to any
+// existing instrumenter.
+
+#include "syzygy/instrument/instrumenters/cache_instrumenter.h"
+
+#include "base/file_util.h"
+#include "base/md5.h"
+#include "base/strings/utf_string_conversions.h"
+#include "syzygy/common/syzygy_version.h"
+#include "syzygy/core/file_util.h"
+#include "syzygy/pe/find.h"
+
+namespace instrument {
+namespace instrumenters {
+
+namespace {
+
+// The extensions of the files making up a cache entry. The entry name itself
+// is the cache key.
+const wchar_t kCacheImageExtension[] = L"img";
+const wchar_t kCachePdbExtension[] = L"pdb";
+
+// Switches that do not influence the instrumented output and hence must not
+// contribute to the cache key. These are the switches naming the inputs and
+// outputs (the input contents are hashed directly), the cache configuration
+// itself, and knobs that only affect how the work is scheduled.
+const char* kUncachedSwitches[] = {
+  "cache-dir",
+  "input-dll",
+  "input-image",
+  "input-pdb",
+  "num-threads",
+  "output-dll",
+  "output-image",
+  "output-pdb",
+  "overwrite",
+};
+
+// Returns true if @p switch_name does not contribute to the cache key.
+bool IsUncachedSwitch(const std::string& switch_name) {
+  for (size_t i = 0; i < arraysize(kUncachedSwitches); ++i) {
+    if (switch_name == kUncachedSwitches[i])
+      return true;
+  }
+  return false;
+}
+
+// Feeds the contents of the file at @p path to @p context. Returns true on
+// success, false otherwise.
+bool Md5File(const base::FilePath& path, base::MD5Context* context) {
+  DCHECK_NE(reinterpret_cast<base::MD5Context*>(NULL), context);
+
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open file for hashing: " << path.value();
+    return false;
+  }
+
+  char buffer[64 * 1024];
+  while (true) {
+    size_t bytes_read = ::fread(buffer, 1, sizeof(buffer), file.get());
+    if (bytes_read == 0)
+      break;
+    base::MD5Update(context, base::StringPiece(buffer, bytes_read));
+  }
+
+  if (::ferror(file.get())) {
+    LOG(ERROR) << "Error reading file for hashing: " << path.value();
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+CacheInstrumenter::CacheInstrumenter(InstrumenterInterface* instrumenter)
+    : instrumenter_(instrumenter), overwrite_(false), input_is_pe_(false) {
+  DCHECK_NE(reinterpret_cast<InstrumenterInterface*>(NULL), instrumenter);
+}
+
+bool CacheInstrumenter::ParseCommandLine(const CommandLine* command_line) {
+  DCHECK_NE(reinterpret_cast<const CommandLine*>(NULL), command_line);
+
+  // Create a copy of the command-line.
+  command_line_.reset(new CommandLine(*command_line));
+
+  // Parse the few parameters that we care about.
+  cache_dir_ = command_line_->GetSwitchValuePath("cache-dir");
+  if (command_line_->HasSwitch("input-dll")) {
+    input_image_path_ = command_line_->GetSwitchValuePath("input-dll");
+  } else {
+    input_image_path_ = command_line_->GetSwitchValuePath("input-image");
+  }
+  if (command_line_->HasSwitch("output-dll")) {
+    output_image_path_ = command_line_->GetSwitchValuePath("output-dll");
+  } else {
+    output_image_path_ = command_line_->GetSwitchValuePath("output-image");
+  }
+  input_pdb_path_ = command_line_->GetSwitchValuePath("input-pdb");
+  output_pdb_path_ = command_line_->GetSwitchValuePath("output-pdb");
+  overwrite_ = command_line_->HasSwitch("overwrite");
+
+  return instrumenter_->ParseCommandLine(command_line);
+}
+
+bool CacheInstrumenter::Instrument() {
+  // With no cache directory configured this adapter is a pass-through.
+  if (cache_dir_.empty())
+    return instrumenter_->Instrument();
+
+  if (input_image_path_.empty() || output_image_path_.empty() ||
+      !base::PathExists(input_image_path_)) {
+    // Let the wrapped instrumenter produce its usual errors.
+    return instrumenter_->Instrument();
+  }
+
+  // Determine whether the cache entry is an image and PDB pair or an image
+  // alone. Only PE images carry a PDB; COFF files and archives do not.
+  core::FileType file_type = core::kUnknownFileType;
+  if (!core::GuessFileType(input_image_path_, &file_type)) {
+    LOG(WARNING) << "Unable to determine file type, not using cache.";
+    return instrumenter_->Instrument();
+  }
+  input_is_pe_ = (file_type == core::kPeFileType);
+
+  if (input_is_pe_ && !InferPdbPaths()) {
+    LOG(WARNING) << "Unable to infer PDB paths, not using cache.";
+    return instrumenter_->Instrument();
+  }
+
+  std::string digest;
+  if (!ComputeCacheKey(&digest)) {
+    LOG(WARNING) << "Unable to compute cache key, not using cache.";
+    return instrumenter_->Instrument();
+  }
+  LOG(INFO) << "Instrumentation cache key is " << digest << ".";
+
+  base::FilePath entry_path = cache_dir_.Append(base::ASCIIToWide(digest));
+  base::FilePath cached_image = entry_path.AddExtension(kCacheImageExtension);
+  base::FilePath cached_pdb = entry_path.AddExtension(kCachePdbExtension);
+
+  // Short-circuit to the cached outputs if a complete entry exists.
+  if (base::PathExists(cached_image) &&
+      (!input_is_pe_ || base::PathExists(cached_pdb))) {
+    return RestoreCacheEntry(digest);
+  }
+
+  // Cache miss. Run the instrumentation pipeline and file its outputs.
+  LOG(INFO) << "Instrumentation cache miss.";
+  if (!instrumenter_->Instrument())
+    return false;
+
+  // Failing to populate the cache costs a later rebuild but the requested
+  // outputs exist, so this is not a failure.
+  if (!WriteCacheEntry(digest))
+    LOG(WARNING) << "Unable to write to the instrumentation cache.";
+
+  return true;
+}
+
+bool CacheInstrumenter::ComputeCacheKey(std::string* digest) {
+  DCHECK_NE(reinterpret_cast<std::string*>(NULL), digest);
+
+  base::MD5Context context;
+  base::MD5Init(&context);
+
+  // The toolchain itself contributes to the key, so that entries written by
+  // a different version of the instrumenter are never reused.
+  base::MD5Update(&context, common::kSyzygyVersion.GetVersionString());
+
+  // Hash the input image, and its PDB for PE images.
+  if (!Md5File(input_image_path_, &context))
+    return false;
+  if (input_is_pe_ && !Md5File(input_pdb_path_, &context))
+    return false;
+
+  // Hash the instrumenter configuration. The switch map is sorted by name so
+  // this is insensitive to the ordering of the command-line. Switches that
+  // only name inputs and outputs are excluded; the input contents are hashed
+  // above and the output paths don't influence the produced bytes.
+  const CommandLine::SwitchMap& switches = command_line_->GetSwitches();
+  CommandLine::SwitchMap::const_iterator it = switches.begin();
+  for (; it != switches.end(); ++it) {
+    if (IsUncachedSwitch(it->first))
+      continue;
+    base::MD5Update(&context, it->first);
+    base::MD5Update(&context, "=");
+    base::MD5Update(&context, base::WideToUTF8(it->second));
+    base::MD5Update(&context, "\n");
+  }
+
+  base::MD5Digest md5_digest;
+  base::MD5Final(&md5_digest, &context);
+  *digest = base::MD5DigestToBase16(md5_digest);
+
+  return true;
+}
+
+bool CacheInstrumenter::InferPdbPaths() {
+  DCHECK(input_is_pe_);
+
+  // If no input PDB was specified then search for it, exactly as the
+  // relinker will.
+  if (input_pdb_path_.empty() &&
+      (!pe::FindPdbForModule(input_image_path_, &input_pdb_path_) ||
+       input_pdb_path_.empty())) {
+    LOG(WARNING) << "Unable to find PDB file for module: "
+                 << input_image_path_.value();
+    return false;
+  }
+
+  if (!base::PathExists(input_pdb_path_)) {
+    LOG(WARNING) << "Input PDB not found: " << input_pdb_path_.value();
+    return false;
+  }
+
+  // If no output PDB path is specified, infer one using the same rules as
+  // the relinker so that the cached PDB lands where the relinker would have
+  // written it.
+  if (output_pdb_path_.empty()) {
+    if (input_image_path_.BaseName() == output_image_path_.BaseName()) {
+      output_pdb_path_ =
+          output_image_path_.DirName().Append(input_pdb_path_.BaseName());
+    } else {
+      output_pdb_path_ = output_image_path_.AddExtension(L"pdb");
+    }
+  }
+
+  return true;
+}
+
+bool CacheInstrumenter::RestoreCacheEntry(const std::string& digest) {
+  base::FilePath entry_path = cache_dir_.Append(base::ASCIIToWide(digest));
+
+  // Enforce the same overwrite semantics as the instrumentation pipeline.
+  if (!overwrite_ && base::PathExists(output_image_path_)) {
+    LOG(ERROR) << "Output path exists. Did you want to specify --overwrite?";
+    return false;
+  }
+  if (input_is_pe_ && !overwrite_ && base::PathExists(output_pdb_path_)) {
+    LOG(ERROR) << "Output PDB exists. Did you want to specify --overwrite?";
+    return false;
+  }
+
+  LOG(INFO) << "Instrumentation cache hit, copying cached outputs.";
+
+  if (!base::CopyFile(entry_path.AddExtension(kCacheImageExtension),
+                      output_image_path_)) {
+    LOG(ERROR) << "Unable to write output file: "
+               << output_image_path_.value();
+    return false;
+  }
+
+  if (input_is_pe_ &&
+      !base::CopyFile(entry_path.AddExtension(kCachePdbExtension),
+                      output_pdb_path_)) {
+    LOG(ERROR) << "Unable to write output PDB: " << output_pdb_path_.value();
+    return false;
+  }
+
+  return true;
+}
+
+bool CacheInstrumenter::WriteCacheEntry(const std::string& digest) {
+  if (!base::CreateDirectory(cache_dir_)) {
+    LOG(WARNING) << "Unable to create cache directory: "
+                 << cache_dir_.value();
+    return false;
+  }
+
+  base::FilePath entry_path = cache_dir_.Append(base::ASCIIToWide(digest));
+
+  // Commit the PDB before the image; the presence of the image is what marks
+  // the entry as complete for non-PE inputs.
+  if (input_is_pe_ &&
+      !CommitCacheFile(output_pdb_path_,
+                       entry_path.AddExtension(kCachePdbExtension))) {
+    return false;
+  }
+
+  if (!CommitCacheFile(output_image_path_,
+                       entry_path.AddExtension(kCacheImageExtension))) {
+    return false;
+  }
+
+  return true;
+}
+
+bool CacheInstrumenter::CommitCacheFile(const base::FilePath& from,
+                                        const base::FilePath& to) {
+  // Stage the file under a temporary name and commit it with a rename so
+  // that concurrent instrumentations never observe a partial entry.
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(cache_dir_, &temp_path)) {
+    LOG(WARNING) << "Unable to create temporary file in cache directory: "
+                 << cache_dir_.value();
+    return false;
+  }
+
+  if (!base::CopyFile(from, temp_path)) {
+    LOG(WARNING) << "Unable to copy file to cache: " << from.value();
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  if (!base::Move(temp_path, to)) {
+    LOG(WARNING) << "Unable to commit cache entry: " << to.value();
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace instrumenters
+}  // namespace instrument
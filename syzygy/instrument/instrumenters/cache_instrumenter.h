@@ -0,0 +1,111 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Instrumentation adapter that adds a content-addressed output cache to any
+// existing instrumenter. Outputs are cached under a key derived from the
+// toolchain version, the contents of the input image (and its PDB, for PE
+// images) and the instrumenter configuration. When a cached output exists it
+// is copied to the output paths and the wrapped instrumenter is skipped
+// entirely; otherwise the instrumenter runs as usual and its outputs are
+// added to the cache.
+//
+// This presumes that the underlying instrumenter uses --input-image and
+// --output-image for configuring which files are operated on.
+
+#ifndef SYZYGY_INSTRUMENT_INSTRUMENTERS_CACHE_INSTRUMENTER_H_
+#define SYZYGY_INSTRUMENT_INSTRUMENTERS_CACHE_INSTRUMENTER_H_
+
+#include <string>
+
+#include "base/logging.h"
+#include "base/files/file_path.h"
+#include "base/memory/scoped_ptr.h"
+#include "syzygy/instrument/instrumenter.h"
+
+namespace instrument {
+namespace instrumenters {
+
+class CacheInstrumenter : public InstrumenterInterface {
+ public:
+  // Constructor.
+  // @param instrumenter the instrumenter whose outputs are to be cached.
+  //     Ownership is taken of the instrumenter.
+  explicit CacheInstrumenter(InstrumenterInterface* instrumenter);
+
+  // @name Accessors.
+  // @{
+  // @returns the root directory of the cache, as parsed from --cache-dir.
+  //     Empty if no cache directory was specified, in which case this
+  //     adapter is a simple pass-through.
+  const base::FilePath& cache_dir() const { return cache_dir_; }
+  // @}
+
+  // @name InstrumenterInterface implementation.
+  // @{
+  virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
+  virtual bool Instrument() OVERRIDE;
+  // @}
+
+ private:
+  // Computes the cache key for this instrumentation, returning it as a hex
+  // digest via @p digest. Returns true on success, false otherwise.
+  bool ComputeCacheKey(std::string* digest);
+
+  // For PE images infers the path the relinker will write the output PDB
+  // to, mirroring the inference the relinker itself performs. On success
+  // input_pdb_path_ and output_pdb_path_ are both non-empty. Returns true
+  // on success, false otherwise.
+  bool InferPdbPaths();
+
+  // Copies the cached outputs for @p digest to the output paths.
+  // @param digest the cache key of the entry to be restored.
+  // @returns true on success, false otherwise.
+  bool RestoreCacheEntry(const std::string& digest);
+
+  // Copies the instrumentation outputs into the cache under @p digest. The
+  // files are staged in the cache directory and committed with a rename so
+  // that concurrent instrumentations never observe partial entries.
+  // @param digest the cache key of the entry to be written.
+  // @returns true on success, false otherwise.
+  bool WriteCacheEntry(const std::string& digest);
+
+  // Copies @p from to the cache entry at @p to via a temporary file in the
+  // cache directory. Returns true on success, false otherwise.
+  bool CommitCacheFile(const base::FilePath& from, const base::FilePath& to);
+
+  // The instrumenter whose outputs are being cached.
+  scoped_ptr<InstrumenterInterface> instrumenter_;
+
+  // A copy of the command-line that we originally parsed.
+  scoped_ptr<CommandLine> command_line_;
+
+  // Bits of the command-line that we've parsed.
+  base::FilePath cache_dir_;
+  base::FilePath input_image_path_;
+  base::FilePath input_pdb_path_;
+  base::FilePath output_image_path_;
+  base::FilePath output_pdb_path_;
+  bool overwrite_;
+
+  // True if the input image is a PE file, in which case the cache entry
+  // consists of an image and PDB pair rather than the image alone.
+  bool input_is_pe_;
+
+  DISALLOW_COPY_AND_ASSIGN(CacheInstrumenter);
+};
+
+}  // namespace instrumenters
+}  // namespace instrument
+
+#endif  // SYZYGY_INSTRUMENT_INSTRUMENTERS_CACHE_INSTRUMENTER_H_
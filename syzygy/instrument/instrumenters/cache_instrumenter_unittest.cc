@@ -0,0 +1,148 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/instrument/instrumenters/cache_instrumenter.h"
+
+#include "base/file_util.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace instrument {
+namespace instrumenters {
+
+namespace {
+
+// Some global state that is updated by CountingInstrumenter.
+// NOTE: Because of these this unittest is not thread safe!
+size_t parse_count = 0;
+size_t instrument_count = 0;
+
+// An identity instrumenter that counts its invocations. Simply copies the
+// input-image to the output-image.
+class CountingInstrumenter : public InstrumenterInterface {
+ public:
+  virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE {
+    ++parse_count;
+    input_image_ = command_line->GetSwitchValuePath("input-image");
+    output_image_ = command_line->GetSwitchValuePath("output-image");
+    return true;
+  }
+
+  virtual bool Instrument() OVERRIDE {
+    ++instrument_count;
+    base::CopyFile(input_image_, output_image_);
+    return true;
+  }
+
+  base::FilePath input_image_;
+  base::FilePath output_image_;
+};
+
+class CacheInstrumenterTest : public testing::PELibUnitTest {
+ public:
+  virtual void SetUp() OVERRIDE {
+    testing::PELibUnitTest::SetUp();
+
+    CreateTemporaryDir(&temp_dir_);
+    cache_dir_ = temp_dir_.Append(L"cache");
+    input_image_ = temp_dir_.Append(L"input.dat");
+    output_image_ = temp_dir_.Append(L"output.dat");
+
+    // The input deliberately isn't a PE file, so no PDB pair is involved.
+    std::string contents = "not actually an image";
+    ASSERT_EQ(static_cast<int>(contents.size()),
+              base::WriteFile(input_image_, contents.data(),
+                              contents.size()));
+
+    command_line_.reset(new CommandLine(base::FilePath(L"instrumenter.exe")));
+    command_line_->AppendSwitchPath("input-image", input_image_);
+    command_line_->AppendSwitchPath("output-image", output_image_);
+    command_line_->AppendSwitch("overwrite");
+
+    // Reset function counts.
+    parse_count = 0;
+    instrument_count = 0;
+  }
+
+  // Runs a freshly constructed CacheInstrumenter over the current
+  // command-line.
+  void RunInstrumenter() {
+    CacheInstrumenter inst(new CountingInstrumenter());
+    ASSERT_TRUE(inst.ParseCommandLine(command_line_.get()));
+    ASSERT_TRUE(inst.Instrument());
+  }
+
+  base::FilePath temp_dir_;
+  base::FilePath cache_dir_;
+  base::FilePath input_image_;
+  base::FilePath output_image_;
+
+  scoped_ptr<CommandLine> command_line_;
+};
+
+}  // namespace
+
+TEST_F(CacheInstrumenterTest, PassthroughWithoutCacheDir) {
+  ASSERT_NO_FATAL_FAILURE(RunInstrumenter());
+  EXPECT_EQ(1u, parse_count);
+  EXPECT_EQ(1u, instrument_count);
+  EXPECT_TRUE(base::PathExists(output_image_));
+  EXPECT_FALSE(base::PathExists(cache_dir_));
+}
+
+TEST_F(CacheInstrumenterTest, MissThenHit) {
+  command_line_->AppendSwitchPath("cache-dir", cache_dir_);
+
+  // The first run misses the cache, instruments and populates it.
+  ASSERT_NO_FATAL_FAILURE(RunInstrumenter());
+  EXPECT_EQ(1u, instrument_count);
+  EXPECT_TRUE(base::PathExists(output_image_));
+  EXPECT_TRUE(base::PathExists(cache_dir_));
+
+  // The second run short-circuits to the cached output.
+  ASSERT_TRUE(base::DeleteFile(output_image_, false));
+  ASSERT_NO_FATAL_FAILURE(RunInstrumenter());
+  EXPECT_EQ(1u, instrument_count);
+  EXPECT_TRUE(base::PathExists(output_image_));
+  EXPECT_TRUE(base::ContentsEqual(input_image_, output_image_));
+}
+
+TEST_F(CacheInstrumenterTest, ConfigurationContributesToKey) {
+  command_line_->AppendSwitchPath("cache-dir", cache_dir_);
+  ASSERT_NO_FATAL_FAILURE(RunInstrumenter());
+  EXPECT_EQ(1u, instrument_count);
+
+  // Changing the configuration must miss the cache.
+  command_line_->AppendSwitchASCII("some-mode-switch", "on");
+  ASSERT_NO_FATAL_FAILURE(RunInstrumenter());
+  EXPECT_EQ(2u, instrument_count);
+}
+
+TEST_F(CacheInstrumenterTest, InputContentsContributeToKey) {
+  command_line_->AppendSwitchPath("cache-dir", cache_dir_);
+  ASSERT_NO_FATAL_FAILURE(RunInstrumenter());
+  EXPECT_EQ(1u, instrument_count);
+
+  // Changing the input contents must miss the cache.
+  std::string contents = "still not an image";
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            base::WriteFile(input_image_, contents.data(), contents.size()));
+  ASSERT_NO_FATAL_FAILURE(RunInstrumenter());
+  EXPECT_EQ(2u, instrument_count);
+  EXPECT_TRUE(base::ContentsEqual(input_image_, output_image_));
+}
+
+}  // namespace instrumenters
+}  // namespace instrument
@@ -15,7 +15,7 @@
 #include "syzygy/instrument/mutators/add_indexed_data_ranges_stream.h"
 
 #include "syzygy/common/indexed_frequency_data.h"
-#include "syzygy/pdb/pdb_byte_stream.h"
+#include "syzygy/pdb/pdb_view_stream.h"
 
 namespace instrument {
 namespace mutators {
@@ -30,8 +30,9 @@ bool AddIndexedDataRangesStreamPdbMutator::AddNamedStreams(
     return true;
   }
 
-  // Create the stream.
-  scoped_refptr<pdb::PdbByteStream> stream(new pdb::PdbByteStream);
+  // Create the stream. This is a view of the range vector rather than a copy
+  // of it, which is safe as the vector outlives the writing of the PDB.
+  scoped_refptr<pdb::PdbViewStream> stream(new pdb::PdbViewStream);
   CHECK(stream->Init(
       reinterpret_cast<const uint8*>(&indexed_data_ranges_.at(0)),
       indexed_data_ranges_.size() * sizeof(indexed_data_ranges_.at(0))));
@@ -36,8 +36,10 @@ class AddIndexedDataRangesStreamPdbMutator
   // Constructor.
   // @param indexed_data_ranges A reference to the vector that contains the
   //     relative addresses associated with the indexed data in an image. This
-  //     need not be populated at the time of construction, so long as it exists
-  //     before MutatePdb is called.
+  //     need not be populated at the time of construction, so long as it
+  //     exists before MutatePdb is called. The stream that is added to the
+  //     PDB refers to this vector rather than copying it, so it must not be
+  //     modified or destroyed until the PDB has been written.
   // @param stream_name The name to give to the stream we're adding.
   AddIndexedDataRangesStreamPdbMutator(
       const RelativeAddressRangeVector& indexed_data_ranges,
@@ -16,11 +16,15 @@
 
 #include "syzygy/instrument/transforms/allocation_filter_transform.h"
 
+#include <map>
+
+#include "base/file_util.h"
 #include "base/logging.h"
 #include "base/values.h"
 #include "base/json/json_reader.h"
 #include "syzygy/agent/basic_block_entry/basic_block_entry.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/pe/transforms/pe_add_imports_transform.h"
 
 namespace instrument {
@@ -50,6 +54,11 @@ typedef pe::transforms::ImportedModule ImportedModule;
 const char kPreCallFunctioName[] = "asan_SetAllocationFilterFlag";
 const char kPostCallFunctioName[] = "asan_ClearAllocationFilterFlag";
 
+// A compiled binary configuration file starts with this magic number and a
+// version, followed by the serialized function name and offset map.
+const uint32 kBinaryConfigMagic = 0x46415A53;  // Appears as "SZAF" on disk.
+const uint32 kBinaryConfigVersion = 1;
+
 // Sets up the pre-call and post-call hooks import.
 bool SetupEntryHooks(const TransformPolicyInterface* policy,
                      BlockGraph* block_graph,
@@ -170,8 +179,8 @@ bool AllocationFilterTransform::TransformBasicBlockSubGraph(
   DCHECK_EQ(1u, descriptions.size());
   const auto description = descriptions.begin();
   const std::string function_name = description->name;
-    FunctionNameOffsetMap::const_iterator target_iter =
-        targets_.find(function_name);
+  FunctionNameOffsetMap::const_iterator target_iter =
+      targets_.find(function_name);
 
   // Skip the block if the function name is not included in |targets_|.
   if (target_iter == targets_.end())
@@ -249,28 +258,23 @@ bool AllocationFilterTransform::TransformBasicBlockSubGraph(
     }
   }
 
-  // Report targeted but non-instrumented calls.
+  // Report targeted but non-instrumented calls. Note that |target_iter| is
+  // still valid as |targets_| has not been modified since the lookup above.
   if (enable_reporting_) {
-    FunctionNameOffsetMap::const_iterator targets_iter =
-        targets_.find(function_name);
-    if (targets_iter != targets_.end()) {
-      const OffsetSet& target_offsets = targets_iter->second;
-      std::vector<Offset> non_instrumented;
-
-      std::set_difference(target_offsets.begin(),
-                          target_offsets.end(),
-                          instrumented_[function_name].begin(),
-                          instrumented_[function_name].end(),
-                          std::back_inserter(non_instrumented));
-
-      // Warn about non-instrumented calls.
-      for (size_t i = 0; i < non_instrumented.size(); ++i) {
-        LOG(WARNING) << "Target call " << function_name << " + "
-                     << non_instrumented[i]
-                     << " not instrumented.";
-      }
-    } else {
-      DCHECK(instrumented_.empty());
+    const OffsetSet& target_offsets = target_iter->second;
+    std::vector<Offset> non_instrumented;
+
+    std::set_difference(target_offsets.begin(),
+                        target_offsets.end(),
+                        instrumented_[function_name].begin(),
+                        instrumented_[function_name].end(),
+                        std::back_inserter(non_instrumented));
+
+    // Warn about non-instrumented calls.
+    for (size_t i = 0; i < non_instrumented.size(); ++i) {
+      LOG(WARNING) << "Target call " << function_name << " + "
+                   << non_instrumented[i]
+                   << " not instrumented.";
     }
   }
 
@@ -343,6 +347,88 @@ bool AllocationFilterTransform::ReadFromJSON(const std::string& json,
   return true;
 }
 
+bool AllocationFilterTransform::ReadFromBinary(const base::FilePath& path,
+    FunctionNameOffsetMap* targets) {
+  DCHECK_NE(static_cast<FunctionNameOffsetMap*>(NULL), targets);
+
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\" for reading.";
+    return false;
+  }
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+
+  // Read and validate the header.
+  uint32 magic = 0;
+  uint32 version = 0;
+  if (!in_archive.Load(&magic) || magic != kBinaryConfigMagic) {
+    LOG(ERROR) << "Not a binary configuration file: " << path.value() << ".";
+    return false;
+  }
+  if (!in_archive.Load(&version) || version != kBinaryConfigVersion) {
+    LOG(ERROR) << "Unsupported binary configuration file version.";
+    return false;
+  }
+
+  // The body is a sorted map of function names to offset sets.
+  std::map<std::string, OffsetSet> sorted;
+  if (!in_archive.Load(&sorted)) {
+    LOG(ERROR) << "Failed to read binary configuration file body.";
+    return false;
+  }
+
+  targets->insert(sorted.begin(), sorted.end());
+  return true;
+}
+
+bool AllocationFilterTransform::WriteToBinary(
+    const FunctionNameOffsetMap& targets,
+    const base::FilePath& path) {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\" for writing.";
+    return false;
+  }
+
+  core::FileOutStream out_stream(file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+
+  // The body is stored as a sorted map so that the compiled form of a given
+  // configuration is canonical regardless of the order in which the targets
+  // were inserted.
+  std::map<std::string, OffsetSet> sorted(targets.begin(), targets.end());
+  if (!out_archive.Save(kBinaryConfigMagic) ||
+      !out_archive.Save(kBinaryConfigVersion) ||
+      !out_archive.Save(sorted)) {
+    return false;
+  }
+
+  return out_archive.Flush();
+}
+
+bool AllocationFilterTransform::ReadFromFile(const base::FilePath& path,
+    FunctionNameOffsetMap* targets) {
+  DCHECK_NE(static_cast<FunctionNameOffsetMap*>(NULL), targets);
+  if (IsBinaryConfigFile(path))
+    return ReadFromBinary(path, targets);
+  return ReadFromJSON(path, targets);
+}
+
+bool AllocationFilterTransform::IsBinaryConfigFile(
+    const base::FilePath& path) {
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL)
+    return false;
+
+  uint32 magic = 0;
+  if (::fread(&magic, sizeof(magic), 1, file.get()) != 1)
+    return false;
+
+  return magic == kBinaryConfigMagic;
+}
+
 bool AllocationFilterTransform::PostBlockGraphIteration(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
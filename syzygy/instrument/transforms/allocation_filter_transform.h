@@ -19,7 +19,7 @@
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_ALLOCATION_FILTER_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_ALLOCATION_FILTER_TRANSFORM_H_
 
-#include <map>
+#include <hash_map>
 #include <set>
 #include <string>
 #include <vector>
@@ -51,7 +51,9 @@ class AllocationFilterTransform
   typedef block_graph::Instruction::Offset Offset;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
   typedef std::set<Offset> OffsetSet;
-  typedef std::map<std::string, OffsetSet> FunctionNameOffsetMap;
+  // Maps function names to the offsets to hook within them. This is hashed
+  // rather than tree-based as it is queried once per decomposable block.
+  typedef stdext::hash_map<std::string, OffsetSet> FunctionNameOffsetMap;
 
   // Initialize a new AllocationFilterTransform instance with the target
   // addresses to hook.
@@ -100,6 +102,38 @@ class AllocationFilterTransform
       const base::FilePath& path,
       FunctionNameOffsetMap* targets);
 
+  // Loads target call addresses from a compiled binary configuration file,
+  // as produced by WriteToBinary. This avoids the cost of JSON parsing for
+  // large configurations.
+  // @param path Path to a binary configuration file.
+  // @param targets Output parameter, all the target calls in the file will
+  //     be dumped to |targets|.
+  // @returns true if the operation succeeded, false otherwise.
+  static bool ReadFromBinary(const base::FilePath& path,
+                             FunctionNameOffsetMap* targets);
+
+  // Compiles target call addresses to a binary configuration file. The
+  // compiled form of a given configuration is canonical.
+  // @param targets The target calls to write.
+  // @param path Path to the file to write.
+  // @returns true if the operation succeeded, false otherwise.
+  static bool WriteToBinary(const FunctionNameOffsetMap& targets,
+                            const base::FilePath& path);
+
+  // Loads target call addresses from a file, auto-detecting whether it is
+  // in the JSON or the binary format.
+  // @param path Path to a configuration file.
+  // @param targets Output parameter, all the target calls in the file will
+  //     be dumped to |targets|.
+  // @returns true if the operation succeeded, false otherwise.
+  static bool ReadFromFile(const base::FilePath& path,
+                           FunctionNameOffsetMap* targets);
+
+  // Determines whether the file at @p path is a binary configuration file.
+  // @param path Path to a configuration file.
+  // @returns true if the file exists and is in the binary format.
+  static bool IsBinaryConfigFile(const base::FilePath& path);
+
  protected:
   friend NamedBlockGraphTransformImpl<AllocationFilterTransform>;
   friend IterativeTransformImpl<AllocationFilterTransform>;
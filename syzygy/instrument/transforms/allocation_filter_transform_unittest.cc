@@ -16,6 +16,7 @@
 
 #include "syzygy/instrument/transforms/allocation_filter_transform.h"
 
+#include "base/file_util.h"
 #include "base/values.h"
 #include "base/json/json_writer.h"
 #include "gtest/gtest.h"
@@ -490,6 +491,38 @@ TEST_F(AllocationFilterTransformTest, JSONReadWrite) {
   ASSERT_EQ(original, output);
 }
 
+TEST_F(AllocationFilterTransformTest, BinaryReadWrite) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+  // This test compiles a valid target address map to the binary format,
+  // then loads a new map from the produced file and ensures that both (the
+  // original and the deserialized) are equal.
+
+  // Collect all call addresses.
+  FunctionNameOffsetMap original = CollectCalls();
+
+  // Compile them to a binary configuration file.
+  base::FilePath temp_file;
+  ASSERT_TRUE(base::CreateTemporaryFile(&temp_file));
+  EXPECT_TRUE(AllocationFilterTransform::WriteToBinary(original, temp_file));
+  EXPECT_TRUE(AllocationFilterTransform::IsBinaryConfigFile(temp_file));
+
+  // Load them back via the format detecting entry point.
+  FunctionNameOffsetMap output;
+  EXPECT_TRUE(AllocationFilterTransform::ReadFromFile(temp_file, &output));
+
+  ASSERT_EQ(original, output);
+
+  EXPECT_TRUE(base::DeleteFile(temp_file, false));
+}
+
+TEST_F(AllocationFilterTransformTest, ReadFromFileDetectsJSON) {
+  base::FilePath config_file = testing::GetSrcRelativePath(
+      kConfigGoodMinimal);
+  EXPECT_FALSE(AllocationFilterTransform::IsBinaryConfigFile(config_file));
+  FunctionNameOffsetMap output;
+  EXPECT_TRUE(AllocationFilterTransform::ReadFromFile(config_file, &output));
+}
+
 TEST_F(AllocationFilterTransformTest, JSONFailsPathDoesNotExists) {
   base::FilePath config_file = testing::GetSrcRelativePath(
       kConfigBadPathDoesNotExist);
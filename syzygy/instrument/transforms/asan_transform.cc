@@ -16,16 +16,20 @@
 
 #include <algorithm>
 #include <list>
+#include <set>
 #include <vector>
 
 #include "base/logging.h"
 #include "base/rand_util.h"
 #include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/memory/scoped_vector.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
 #include "syzygy/block_graph/typed_block.h"
@@ -46,7 +50,9 @@ using block_graph::BasicBlock;
 using block_graph::BasicCodeBlock;
 using block_graph::BasicBlockAssembler;
 using block_graph::BasicBlockSubGraph;
+using block_graph::BasicBlockDecomposer;
 using block_graph::BasicBlockReference;
+using block_graph::BasicBlockSubGraphTransformInterface;
 using block_graph::BlockBuilder;
 using block_graph::BlockGraph;
 using block_graph::Displacement;
@@ -763,8 +769,164 @@ bool PeGetRedirectsForStaticallyLinkedFunctions(
   return true;
 }
 
+// In parallel mode the queued blocks are instrumented in batches: the blocks
+// of a batch are decomposed and transformed concurrently while the
+// block-graph is read-only, then the transformed subgraphs are merged back
+// serially. This constant bounds the number of transformed subgraphs that
+// are held in memory at any one time, per worker thread.
+const size_t kParallelBatchSizePerWorker = 32;
+
+// The unit of work processed by an instrumentation worker thread.
+struct BlockInstrumentationTask {
+  explicit BlockInstrumentationTask(BlockGraph::Block* block)
+      : block(block), success(false) {
+  }
+
+  // The block to be instrumented.
+  BlockGraph::Block* block;
+
+  // The transformed subgraph of |block|. Only valid if |success| is true.
+  scoped_ptr<BasicBlockSubGraph> subgraph;
+
+  // The ids of the blocks that reference or are referenced by |block| as of
+  // its decomposition. If any of these blocks is merged before |block| then
+  // |subgraph| contains stale block pointers and must be rebuilt.
+  std::set<BlockGraph::BlockId> dependencies;
+
+  // True iff the block was successfully decomposed and transformed.
+  bool success;
+};
+
+// Decomposes and transforms a stripe of the tasks of a batch. The
+// block-graph is read-only while the workers are running; the transformed
+// subgraphs are merged back into the block-graph on the main thread.
+class AsanBlockInstrumentationWorker
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  AsanBlockInstrumentationWorker(
+      const AsanTransform* asan_transform,
+      AsanBasicBlockTransform::AsanHookMap* check_access_hooks,
+      RedundantChecksCache* redundant_checks_cache,
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      const std::vector<BlockInstrumentationTask*>* tasks,
+      size_t worker_index,
+      size_t num_workers)
+      : asan_transform_(asan_transform),
+        check_access_hooks_(check_access_hooks),
+        redundant_checks_cache_(redundant_checks_cache),
+        policy_(policy),
+        block_graph_(block_graph),
+        tasks_(tasks),
+        worker_index_(worker_index),
+        num_workers_(num_workers) {
+    DCHECK(asan_transform != NULL);
+    DCHECK(check_access_hooks != NULL);
+    DCHECK(redundant_checks_cache != NULL);
+    DCHECK(policy != NULL);
+    DCHECK(block_graph != NULL);
+    DCHECK(tasks != NULL);
+    DCHECK_LT(worker_index, num_workers);
+  }
+
+  virtual void Run() OVERRIDE {
+    for (size_t i = worker_index_; i < tasks_->size(); i += num_workers_)
+      ProcessTask((*tasks_)[i]);
+  }
+
+ private:
+  void ProcessTask(BlockInstrumentationTask* task) {
+    DCHECK(task != NULL);
+    BlockGraph::Block* block = task->block;
+
+    // Record the blocks whose merge would invalidate the subgraph produced
+    // below. This must be captured before any block of the batch is merged.
+    BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+        block->references().begin();
+    for (; ref_it != block->references().end(); ++ref_it) {
+      const BlockGraph::Block* referenced = ref_it->second.referenced();
+      if (referenced != block)
+        task->dependencies.insert(referenced->id());
+    }
+    BlockGraph::Block::ReferrerSet::const_iterator referrer_it =
+        block->referrers().begin();
+    for (; referrer_it != block->referrers().end(); ++referrer_it) {
+      if (referrer_it->first != block)
+        task->dependencies.insert(referrer_it->first->id());
+    }
+
+    // Decompose the block to basic blocks.
+    task->subgraph.reset(new BasicBlockSubGraph());
+    BasicBlockDecomposer decomposer(block, task->subgraph.get());
+    if (!decomposer.Decompose())
+      return;
+
+    // Apply the basic-block transform. Each task gets its own transform
+    // instance as the analyses it performs are stateful.
+    AsanBasicBlockTransform transform(check_access_hooks_);
+    transform.set_debug_friendly(asan_transform_->debug_friendly());
+    transform.set_use_liveness_analysis(
+        asan_transform_->use_liveness_analysis());
+    transform.set_remove_redundant_checks(
+        asan_transform_->remove_redundant_checks());
+    transform.set_redundant_checks_cache(redundant_checks_cache_);
+    transform.set_filter(asan_transform_->filter());
+    transform.set_instrumentation_rate(
+        asan_transform_->instrumentation_rate());
+
+    BasicBlockSubGraphTransformInterface* bb_transform = &transform;
+    if (!bb_transform->TransformBasicBlockSubGraph(policy_,
+                                                   block_graph_,
+                                                   task->subgraph.get())) {
+      return;
+    }
+
+    task->success = true;
+  }
+
+  // The transform on whose behalf the blocks are being instrumented.
+  const AsanTransform* asan_transform_;
+
+  // The hooks to the Asan check access functions.
+  AsanBasicBlockTransform::AsanHookMap* check_access_hooks_;
+
+  // The cache of redundant check decisions, shared by all the workers.
+  RedundantChecksCache* redundant_checks_cache_;
+
+  // The policy and the block-graph being transformed. Neither is modified
+  // by the worker.
+  const TransformPolicyInterface* policy_;
+  BlockGraph* block_graph_;
+
+  // The tasks of the current batch. This worker processes the tasks whose
+  // index is congruent to worker_index_ modulo num_workers_.
+  const std::vector<BlockInstrumentationTask*>* tasks_;
+  size_t worker_index_;
+  size_t num_workers_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsanBlockInstrumentationWorker);
+};
+
 }  // namespace
 
+bool RedundantChecksCache::Lookup(const block_graph::BlockHash& hash,
+                                  BlockChecks* checks) const {
+  DCHECK(checks != NULL);
+  base::AutoLock lock(lock_);
+  std::map<block_graph::BlockHash, BlockChecks>::const_iterator it =
+      cache_.find(hash);
+  if (it == cache_.end())
+    return false;
+  *checks = it->second;
+  return true;
+}
+
+void RedundantChecksCache::Store(const block_graph::BlockHash& hash,
+                                 const BlockChecks& checks) {
+  base::AutoLock lock(lock_);
+  cache_[hash] = checks;
+}
+
 const char AsanBasicBlockTransform::kTransformName[] =
     "SyzyAsanBasicBlockTransform";
 
@@ -796,10 +958,22 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
     DCHECK_EQ(states.size(), basic_block->instructions().size());
   }
 
-  // Get the memory accesses information for this basic block.
+  // Get the memory accesses information for this basic block. When replaying
+  // cached decisions the analysis state is not needed; identical content
+  // decomposes to identical basic blocks, so the decisions of the previously
+  // analyzed block are keyed by this basic block's offset.
   MemoryAccessAnalysis::State memory_state;
-  if (remove_redundant_checks_)
-    memory_accesses_.GetStateAtEntryOf(basic_block, &memory_state);
+  RedundantChecksCache::BasicBlockChecks* bb_checks = NULL;
+  size_t check_index = 0;
+  if (remove_redundant_checks_) {
+    if (replay_checks_ || record_checks_)
+      bb_checks = &block_checks_[basic_block->offset()];
+    if (replay_checks_) {
+      DCHECK_EQ(basic_block->instructions().size(), bb_checks->size());
+    } else {
+      memory_accesses_.GetStateAtEntryOf(basic_block, &memory_state);
+    }
+  }
 
   // Process each instruction and inject a call to Asan when we find an
   // instrumentable memory access.
@@ -826,11 +1000,20 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
     // When activated, skip redundant memory access check.
     if (remove_redundant_checks_) {
       bool need_memory_access_check = false;
-      if (memory_state.HasNonRedundantAccess(instr))
-        need_memory_access_check = true;
+      if (replay_checks_) {
+        DCHECK_LT(check_index, bb_checks->size());
+        need_memory_access_check = (*bb_checks)[check_index];
+      } else {
+        if (memory_state.HasNonRedundantAccess(instr))
+          need_memory_access_check = true;
+
+        // Update the memory accesses information for the current instruction.
+        memory_accesses_.PropagateForward(instr, &memory_state);
 
-      // Update the memory accesses information for the current instruction.
-      memory_accesses_.PropagateForward(instr, &memory_state);
+        if (record_checks_)
+          bb_checks->push_back(need_memory_access_check);
+      }
+      ++check_index;
 
       if (!need_memory_access_check)
         continue;
@@ -941,9 +1124,26 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
   if (use_liveness_analysis_)
     liveness_.Analyze(subgraph);
 
-  // Perform a redundant memory access analysis.
-  if (remove_redundant_checks_)
-    memory_accesses_.Analyze(subgraph);
+  // Perform a redundant memory access analysis. When an identical block has
+  // already been analyzed its per-instruction decisions are replayed instead
+  // of re-running the analysis; otherwise the decisions made below are
+  // recorded and stored in the cache.
+  replay_checks_ = false;
+  record_checks_ = false;
+  block_checks_.clear();
+  if (remove_redundant_checks_) {
+    if (redundant_checks_cache_ != NULL &&
+        subgraph->original_block() != NULL) {
+      subgraph_hash_.Hash(subgraph->original_block(),
+                          block_graph::kBlockHashFast);
+      if (redundant_checks_cache_->Lookup(subgraph_hash_, &block_checks_))
+        replay_checks_ = true;
+      else
+        record_checks_ = true;
+    }
+    if (!replay_checks_)
+      memory_accesses_.Analyze(subgraph);
+  }
 
   // Determines if this subgraph uses unconventional stack pointer
   // manipulations.
@@ -961,6 +1161,10 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
       return false;
     }
   }
+
+  if (record_checks_)
+    redundant_checks_cache_->Store(subgraph_hash_, block_checks_);
+
   return true;
 }
 
@@ -977,6 +1181,9 @@ AsanTransform::AsanTransform()
       remove_redundant_checks_(false),
       use_interceptors_(false),
       instrumentation_rate_(1.0),
+      hot_code_filter_(NULL),
+      hot_instrumentation_rate_(1.0),
+      num_threads_(1),
       asan_parameters_(NULL),
       check_access_hooks_ref_(),
       asan_parameters_block_(NULL) {
@@ -987,6 +1194,13 @@ void AsanTransform::set_instrumentation_rate(double instrumentation_rate) {
   instrumentation_rate_ = std::max(0.0, std::min(1.0, instrumentation_rate));
 }
 
+void AsanTransform::set_hot_instrumentation_rate(
+    double hot_instrumentation_rate) {
+  // Set the hot instrumentation rate, capping it between 0 and 1.
+  hot_instrumentation_rate_ =
+      std::max(0.0, std::min(1.0, hot_instrumentation_rate));
+}
+
 bool AsanTransform::PreBlockGraphIteration(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -1118,13 +1332,39 @@ bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
   if (!policy->BlockIsSafeToBasicBlockDecompose(block))
     return true;
 
+  // In parallel mode the eligible blocks are simply gathered here; they are
+  // instrumented by InstrumentBlocksInParallel once the iteration is done.
+  if (num_threads_ > 1) {
+    queued_blocks_.push_back(block);
+    return true;
+  }
+
+  return InstrumentBlock(policy, block_graph, block);
+}
+
+bool AsanTransform::InstrumentBlock(const TransformPolicyInterface* policy,
+                                    BlockGraph* block_graph,
+                                    BlockGraph::Block* block) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(block != NULL);
+
   // Use the filter that was passed to us for our child transform.
   AsanBasicBlockTransform transform(&check_access_hooks_ref_);
   transform.set_debug_friendly(debug_friendly());
   transform.set_use_liveness_analysis(use_liveness_analysis());
   transform.set_remove_redundant_checks(remove_redundant_checks());
+  transform.set_redundant_checks_cache(&redundant_checks_cache_);
   transform.set_filter(filter());
-  transform.set_instrumentation_rate(instrumentation_rate_);
+
+  // Blocks matching the hot code filter are instrumented at the hot rate,
+  // everything else at the regular rate.
+  double rate = instrumentation_rate_;
+  if (hot_code_filter_ != NULL &&
+      block_graph::IsFiltered(*hot_code_filter_, block)) {
+    rate = hot_instrumentation_rate_;
+  }
+  transform.set_instrumentation_rate(rate);
 
   if (!ApplyBasicBlockSubGraphTransform(
           &transform, policy, block_graph, block, NULL)) {
@@ -1134,6 +1374,93 @@ bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
   return true;
 }
 
+bool AsanTransform::InstrumentBlocksInParallel(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK_LT(1u, num_threads_);
+  DCHECK(!queued_blocks_.empty());
+
+  size_t num_workers = std::min(num_threads_, queued_blocks_.size());
+  size_t batch_size = num_workers * kParallelBatchSizePerWorker;
+  LOG(INFO) << "Instrumenting " << queued_blocks_.size() << " blocks on "
+            << num_workers << " threads.";
+
+  for (size_t batch_start = 0; batch_start < queued_blocks_.size();
+       batch_start += batch_size) {
+    size_t batch_end =
+        std::min(batch_start + batch_size, queued_blocks_.size());
+
+    // Build the tasks for this batch.
+    ScopedVector<BlockInstrumentationTask> tasks;
+    for (size_t i = batch_start; i < batch_end; ++i)
+      tasks.push_back(new BlockInstrumentationTask(queued_blocks_[i]));
+
+    // Decompose and transform the blocks of the batch in parallel. The
+    // block-graph is read-only for the duration of this phase.
+    ScopedVector<AsanBlockInstrumentationWorker> workers;
+    ScopedVector<base::DelegateSimpleThread> threads;
+    for (size_t i = 0; i < num_workers; ++i) {
+      workers.push_back(new AsanBlockInstrumentationWorker(
+          this, &check_access_hooks_ref_, &redundant_checks_cache_, policy,
+          block_graph, &tasks.get(), i, num_workers));
+      threads.push_back(new base::DelegateSimpleThread(
+          workers.back(), "AsanTransformWorker"));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Start();
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Join();
+
+    // Merge the transformed subgraphs back into the block-graph, in the
+    // original iteration order. This is the only phase that mutates the
+    // block-graph and it runs on this thread only.
+    std::set<BlockGraph::BlockId> merged_ids;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      BlockInstrumentationTask* task = tasks[i];
+      BlockGraph::BlockId block_id = task->block->id();
+
+      if (!task->success) {
+        LOG(ERROR) << "Failed to instrument block \"" << task->block->name()
+                   << "\".";
+        return false;
+      }
+
+      // If a block this one refers to (or is referred to by) has already
+      // been merged then the subgraph contains stale block pointers. Redo
+      // the work against the current block-graph; blocks of a batch rarely
+      // reference one another so this doesn't hurt the overall parallelism.
+      bool stale = false;
+      std::set<BlockGraph::BlockId>::const_iterator dep_it =
+          task->dependencies.begin();
+      for (; dep_it != task->dependencies.end(); ++dep_it) {
+        if (merged_ids.find(*dep_it) != merged_ids.end()) {
+          stale = true;
+          break;
+        }
+      }
+
+      if (stale) {
+        if (!InstrumentBlock(policy, block_graph, task->block))
+          return false;
+      } else {
+        BlockBuilder builder(block_graph);
+        if (!builder.Merge(task->subgraph.get())) {
+          LOG(ERROR) << "Failed to merge transformed block \""
+                     << task->block->name() << "\".";
+          return false;
+        }
+      }
+
+      merged_ids.insert(block_id);
+    }
+  }
+
+  queued_blocks_.clear();
+  return true;
+}
+
 bool AsanTransform::PostBlockGraphIteration(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -1142,6 +1469,13 @@ bool AsanTransform::PostBlockGraphIteration(
   DCHECK(block_graph != NULL);
   DCHECK(header_block != NULL);
 
+  // In parallel mode the per-block instrumentation was deferred by OnBlock;
+  // it has to be completed before the interception steps below.
+  if (!queued_blocks_.empty() &&
+      !InstrumentBlocksInParallel(policy, block_graph)) {
+    return false;
+  }
+
   if (block_graph->image_format() == BlockGraph::PE_IMAGE) {
     if (!PeInterceptFunctions(kAsanIntercepts, policy, block_graph,
                               header_block)) {
@@ -1268,7 +1602,7 @@ bool AsanTransform::PeInjectAsanParameters(
   params_block->CopyData(fparams.data().size(), fparams.data().data());
 
   // Wire up any references that are required.
-  COMPILE_ASSERT(7 == common::kAsanParametersVersion,
+  COMPILE_ASSERT(12 == common::kAsanParametersVersion,
                  pointers_in_the_params_must_be_linked_up_here);
   block_graph::TypedBlock<common::AsanParameters> params;
   CHECK(params.Init(0, params_block));
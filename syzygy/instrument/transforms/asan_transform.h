@@ -21,8 +21,11 @@
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "base/strings/string_piece.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/block_graph/block_hash.h"
 #include "syzygy/block_graph/filterable.h"
 #include "syzygy/block_graph/iterate.h"
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
@@ -36,6 +39,47 @@
 namespace instrument {
 namespace transforms {
 
+// A thread-safe cache of per-instruction redundant check decisions, keyed
+// by block content hash. Binaries contain many bitwise-identical code
+// blocks (COMDAT-folded template instantiations and the like). The
+// redundant memory access analysis is a pure function of a block's
+// instructions and references, both of which are covered by the hash, so
+// the decisions computed for one block can be replayed on any block with
+// the same content instead of re-running the analysis.
+class RedundantChecksCache {
+ public:
+  // The decisions for one basic block, in instruction order. An entry is
+  // true iff the corresponding instruction needs a memory access check.
+  typedef std::vector<bool> BasicBlockChecks;
+
+  // The decisions for a whole block, keyed by basic block offset.
+  typedef std::map<block_graph::BlockGraph::Offset, BasicBlockChecks>
+      BlockChecks;
+
+  RedundantChecksCache() { }
+
+  // Looks up the decisions previously stored for a block with the given
+  // content hash.
+  // @param hash The content hash of the block.
+  // @param checks Receives the cached decisions on success.
+  // @returns true iff decisions were found for @p hash.
+  bool Lookup(const block_graph::BlockHash& hash, BlockChecks* checks) const;
+
+  // Stores the decisions computed for a block with the given content hash.
+  // @param hash The content hash of the block.
+  // @param checks The decisions to store.
+  void Store(const block_graph::BlockHash& hash, const BlockChecks& checks);
+
+ private:
+  // Serializes accesses to the cache across instrumentation workers.
+  mutable base::Lock lock_;
+
+  // The cached decisions, keyed by block content hash.
+  std::map<block_graph::BlockHash, BlockChecks> cache_;
+
+  DISALLOW_COPY_AND_ASSIGN(RedundantChecksCache);
+};
+
 // This class implements the transformation applied to each basic block.
 class AsanBasicBlockTransform
     : public block_graph::transforms::NamedBasicBlockSubGraphTransformImpl<
@@ -83,6 +127,9 @@ class AsanBasicBlockTransform
       debug_friendly_(false),
       use_liveness_analysis_(false),
       remove_redundant_checks_(false),
+      redundant_checks_cache_(NULL),
+      replay_checks_(false),
+      record_checks_(false),
       instrumentation_rate_(1.0) {
     DCHECK(check_access_hooks != NULL);
   }
@@ -102,6 +149,16 @@ class AsanBasicBlockTransform
     remove_redundant_checks_ = remove_redundant_checks;
   }
 
+  // The cache of redundant check decisions to consult and populate, or
+  // NULL to analyze every subgraph from scratch. Only used when redundant
+  // check removal is enabled. Not owned by this class.
+  RedundantChecksCache* redundant_checks_cache() const {
+    return redundant_checks_cache_;
+  }
+  void set_redundant_checks_cache(RedundantChecksCache* cache) {
+    redundant_checks_cache_ = cache;
+  }
+
   // The instrumentation rate must be in the range [0, 1], inclusive.
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
@@ -151,6 +208,18 @@ class AsanBasicBlockTransform
   // memory checks added by this transform.
   bool remove_redundant_checks_;
 
+  // @name State of the redundant check decisions cache for the subgraph
+  //     currently being transformed. When replaying, block_checks_ holds the
+  //     decisions of a previously analyzed identical block; when recording,
+  //     it accumulates the decisions to store once the subgraph is done.
+  // @{
+  RedundantChecksCache* redundant_checks_cache_;
+  block_graph::BlockHash subgraph_hash_;
+  RedundantChecksCache::BlockChecks block_checks_;
+  bool replay_checks_;
+  bool record_checks_;
+  // @}
+
   // Controls the rate at which reads/writes are instrumented. This is
   // implemented using random sampling.
   double instrumentation_rate_;
@@ -214,6 +283,35 @@ class AsanTransform
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
 
+  // An optional filter describing the hot code in the image, as derived
+  // from sampling profiler data. Blocks that intersect the filter are
+  // instrumented at hot_instrumentation_rate instead of the regular
+  // instrumentation rate, trading coverage of the hottest functions for
+  // runtime overhead. The filter is not owned and must outlive the
+  // transform.
+  const block_graph::RelativeAddressFilter* hot_code_filter() const {
+    return hot_code_filter_;
+  }
+  void set_hot_code_filter(
+      const block_graph::RelativeAddressFilter* hot_code_filter) {
+    hot_code_filter_ = hot_code_filter;
+  }
+
+  // The instrumentation rate applied to blocks matching the hot code filter.
+  // This must be in the range [0, 1], inclusive.
+  double hot_instrumentation_rate() const { return hot_instrumentation_rate_; }
+  void set_hot_instrumentation_rate(double hot_instrumentation_rate);
+
+  // The number of threads to use for instrumenting basic blocks. When this
+  // is greater than one the eligible blocks are decomposed and transformed
+  // on that many worker threads, with only the block-graph mutations being
+  // applied serially. Defaults to 1.
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0u, num_threads);
+    num_threads_ = num_threads;
+  }
+
   // ASAN RTL parameters.
   const common::InflatedAsanParameters* asan_parameters() const {
     return asan_parameters_;
@@ -261,6 +359,28 @@ class AsanTransform
                               BlockGraph::Block* header_block);
   // @}
 
+  // Decomposes @p block, applies the basic-block transform to it and merges
+  // the result back into the block-graph. This is the serial per-block path;
+  // it is also used in parallel mode to redo any block whose transformed
+  // subgraph became stale before it could be merged.
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block_graph the block graph being transformed.
+  // @param block the block to instrument.
+  // @returns true on success, false otherwise.
+  bool InstrumentBlock(const TransformPolicyInterface* policy,
+                       BlockGraph* block_graph,
+                       BlockGraph::Block* block);
+
+  // Instruments the blocks gathered in queued_blocks_ on num_threads_ worker
+  // threads. The blocks are processed in batches: each batch is decomposed
+  // and transformed in parallel while the block-graph is read-only, then the
+  // transformed subgraphs are merged back serially on the calling thread.
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block_graph the block graph being transformed.
+  // @returns true on success, false otherwise.
+  bool InstrumentBlocksInParallel(const TransformPolicyInterface* policy,
+                                  BlockGraph* block_graph);
+
   // Name of the asan_rtl DLL we import. Defaults to "syzyasan_rtl.dll".
   std::string asan_dll_name_;
 
@@ -281,6 +401,27 @@ class AsanTransform
   // implemented using random sampling.
   double instrumentation_rate_;
 
+  // An optional filter describing hot code, typically built from sampling
+  // profiler data. Not owned. If NULL all blocks are instrumented at
+  // instrumentation_rate_.
+  const block_graph::RelativeAddressFilter* hot_code_filter_;
+
+  // The instrumentation rate applied to blocks matching hot_code_filter_.
+  double hot_instrumentation_rate_;
+
+  // The number of threads to instrument basic blocks with.
+  size_t num_threads_;
+
+  // The blocks that are awaiting instrumentation. Only used in parallel
+  // mode, where the blocks are gathered during the block-graph iteration and
+  // processed in InstrumentBlocksInParallel.
+  std::vector<BlockGraph::Block*> queued_blocks_;
+
+  // The redundant check decisions computed so far, shared by all the
+  // basic-block transforms this transform spawns so that identical blocks
+  // are only analyzed once.
+  RedundantChecksCache redundant_checks_cache_;
+
   // ASAN RTL parameters that will be injected into the instrumented image.
   // These will be found by the RTL and used to control its behaviour. Allows
   // for setting parameters at instrumentation time that vary from the defaults.
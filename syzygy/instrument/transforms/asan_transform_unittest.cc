@@ -276,6 +276,27 @@ TEST_F(AsanTransformTest, SetRemoveRedundantChecksFlag) {
   EXPECT_FALSE(bb_transform.remove_redundant_checks());
 }
 
+TEST_F(AsanTransformTest, RedundantChecksCacheStoreLookup) {
+  const uint8 kData[] = { 0x8B, 0x01, 0xC3 };  // mov eax, [ecx]; ret.
+  BlockGraph::Block* block =
+      block_graph_.AddBlock(BlockGraph::CODE_BLOCK, sizeof(kData), "code");
+  ASSERT_TRUE(block != NULL);
+  block->SetData(kData, sizeof(kData));
+  block_graph::BlockHash hash(block, block_graph::kBlockHashFast);
+
+  RedundantChecksCache cache;
+  RedundantChecksCache::BlockChecks checks;
+  EXPECT_FALSE(cache.Lookup(hash, &checks));
+
+  RedundantChecksCache::BlockChecks stored;
+  stored[0].push_back(true);
+  stored[0].push_back(false);
+  cache.Store(hash, stored);
+
+  EXPECT_TRUE(cache.Lookup(hash, &checks));
+  EXPECT_THAT(checks, ContainerEq(stored));
+}
+
 TEST_F(AsanTransformTest, SetInstrumentationRate) {
   EXPECT_EQ(1.0, asan_transform_.instrumentation_rate());
   asan_transform_.set_instrumentation_rate(1.2);
@@ -295,6 +316,30 @@ TEST_F(AsanTransformTest, SetInstrumentationRate) {
   EXPECT_EQ(0.5, bb_transform.instrumentation_rate());
 }
 
+TEST_F(AsanTransformTest, SetHotInstrumentationRate) {
+  EXPECT_TRUE(asan_transform_.hot_code_filter() == NULL);
+  EXPECT_EQ(1.0, asan_transform_.hot_instrumentation_rate());
+  asan_transform_.set_hot_instrumentation_rate(1.2);
+  EXPECT_EQ(1.0, asan_transform_.hot_instrumentation_rate());
+  asan_transform_.set_hot_instrumentation_rate(-0.2);
+  EXPECT_EQ(0.0, asan_transform_.hot_instrumentation_rate());
+  asan_transform_.set_hot_instrumentation_rate(0.5);
+  EXPECT_EQ(0.5, asan_transform_.hot_instrumentation_rate());
+
+  RelativeAddressFilter filter(
+      RelativeAddressFilter::Range(RelativeAddress(0), 100));
+  asan_transform_.set_hot_code_filter(&filter);
+  EXPECT_EQ(&filter, asan_transform_.hot_code_filter());
+}
+
+TEST_F(AsanTransformTest, SetNumThreads) {
+  EXPECT_EQ(1u, asan_transform_.num_threads());
+  asan_transform_.set_num_threads(4);
+  EXPECT_EQ(4u, asan_transform_.num_threads());
+  asan_transform_.set_num_threads(1);
+  EXPECT_EQ(1u, asan_transform_.num_threads());
+}
+
 TEST_F(AsanTransformTest, SetAsanParameters) {
   common::InflatedAsanParameters iparams;
   common::InflatedAsanParameters* null = NULL;
@@ -323,6 +368,24 @@ TEST_F(AsanTransformTest, ApplyAsanTransformCoff) {
       &asan_transform_, policy_, &block_graph_, header_block_));
 }
 
+TEST_F(AsanTransformTest, ApplyAsanTransformPERemoveRedundantChecks) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  asan_transform_.use_interceptors_ = true;
+  asan_transform_.set_remove_redundant_checks(true);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &asan_transform_, policy_, &block_graph_, header_block_));
+}
+
+TEST_F(AsanTransformTest, ApplyAsanTransformPEParallel) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  asan_transform_.use_interceptors_ = true;
+  asan_transform_.set_num_threads(4);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &asan_transform_, policy_, &block_graph_, header_block_));
+}
+
 TEST_F(AsanTransformTest, InjectAsanHooksPe) {
   // Add a read access to the memory.
   bb_asm_->mov(assm::eax, block_graph::Operand(assm::ebx));
@@ -1370,7 +1433,11 @@ TEST_F(AsanTransformTest, CoffInterceptFunctions) {
 
 namespace {
 
-void GetImageSizeSubsampledInstrumentation(double rate, size_t* size) {
+void GetImageSizeSubsampledInstrumentation(
+    double rate,
+    const RelativeAddressFilter* hot_filter,
+    double hot_rate,
+    size_t* size) {
   ASSERT_LE(0.0, rate);
   ASSERT_GE(1.0, rate);
   ASSERT_TRUE(size != NULL);
@@ -1392,6 +1459,10 @@ void GetImageSizeSubsampledInstrumentation(double rate, size_t* size) {
 
   AsanTransform tx;
   tx.set_instrumentation_rate(rate);
+  if (hot_filter != NULL) {
+    tx.set_hot_code_filter(hot_filter);
+    tx.set_hot_instrumentation_rate(hot_rate);
+  }
 
   pe::PETransformPolicy policy;
   ASSERT_TRUE(tx.TransformBlockGraph(&policy, &block_graph, header_block));
@@ -1407,13 +1478,16 @@ void GetImageSizeSubsampledInstrumentation(double rate, size_t* size) {
 
 TEST_F(AsanTransformTest, SubsampledInstrumentationTestDll) {
   size_t rate0 = 0;
-  ASSERT_NO_FATAL_FAILURE(GetImageSizeSubsampledInstrumentation(0.0, &rate0));
+  ASSERT_NO_FATAL_FAILURE(GetImageSizeSubsampledInstrumentation(
+      0.0, NULL, 1.0, &rate0));
 
   size_t rate50 = 0;
-  ASSERT_NO_FATAL_FAILURE(GetImageSizeSubsampledInstrumentation(0.5, &rate50));
+  ASSERT_NO_FATAL_FAILURE(GetImageSizeSubsampledInstrumentation(
+      0.5, NULL, 1.0, &rate50));
 
   size_t rate100 = 0;
-  ASSERT_NO_FATAL_FAILURE(GetImageSizeSubsampledInstrumentation(1.0, &rate100));
+  ASSERT_NO_FATAL_FAILURE(GetImageSizeSubsampledInstrumentation(
+      1.0, NULL, 1.0, &rate100));
 
   size_t size100 = rate100 - rate0;
   size_t size50 = rate50 - rate0;
@@ -1430,6 +1504,36 @@ TEST_F(AsanTransformTest, SubsampledInstrumentationTestDll) {
   EXPECT_GE(60 * size100 / 100, size50);
 }
 
+TEST_F(AsanTransformTest, HotCodeFilterInstrumentationTestDll) {
+  size_t rate0 = 0;
+  ASSERT_NO_FATAL_FAILURE(GetImageSizeSubsampledInstrumentation(
+      0.0, NULL, 1.0, &rate0));
+
+  size_t rate100 = 0;
+  ASSERT_NO_FATAL_FAILURE(GetImageSizeSubsampledInstrumentation(
+      1.0, NULL, 1.0, &rate100));
+
+  // A filter that marks the whole image as hot.
+  const RelativeAddressFilter::Range kEverything(RelativeAddress(0),
+                                                 0x10000000);
+  RelativeAddressFilter hot_everywhere(kEverything);
+  hot_everywhere.Mark(kEverything);
+
+  // With everything hot and a hot rate of 0 the instrumentation should be
+  // entirely suppressed, regardless of the regular rate.
+  size_t hot_rate0 = 0;
+  ASSERT_NO_FATAL_FAILURE(GetImageSizeSubsampledInstrumentation(
+      1.0, &hot_everywhere, 0.0, &hot_rate0));
+  EXPECT_EQ(rate0, hot_rate0);
+
+  // Conversely, with everything hot and a hot rate of 1 the image should be
+  // fully instrumented even though the regular rate is 0.
+  size_t hot_rate100 = 0;
+  ASSERT_NO_FATAL_FAILURE(GetImageSizeSubsampledInstrumentation(
+      0.0, &hot_everywhere, 1.0, &hot_rate100));
+  EXPECT_EQ(rate100, hot_rate100);
+}
+
 TEST_F(AsanTransformTest, PeInjectAsanParametersNoStackIds) {
   ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
 
@@ -34,6 +34,9 @@ namespace transforms {
 namespace {
 
 using agent::basic_block_entry::BasicBlockEntry;
+using assm::eax;
+using assm::edx;
+using assm::esp;
 using block_graph::BasicBlock;
 using block_graph::BasicBlockAssembler;
 using block_graph::BasicBlockReference;
@@ -56,6 +59,13 @@ typedef pe::transforms::ImportedModule ImportedModule;
 const char kDefaultModuleName[] = "basic_block_entry_client.dll";
 const char kBasicBlockEnter[] = "_increment_indexed_freq_data";
 
+// The offsets of the fields of the frequency data consulted by the fast
+// path thunk.
+const BlockGraph::Offset kFrequencyDataOffset =
+    offsetof(::common::IndexedFrequencyData, frequency_data);
+const BlockGraph::Offset kInitializationAttemptedOffset =
+    offsetof(::common::IndexedFrequencyData, initialization_attempted);
+
 // Compares two relative address ranges to see if they overlap. Assumes they
 // are already sorted. This is used to validate basic-block ranges.
 struct RelativeAddressRangesOverlapFunctor {
@@ -131,7 +141,8 @@ BasicBlockEntryHookTransform::BasicBlockEntryHookTransform()
     thunk_section_(NULL),
     instrument_dll_name_(kDefaultModuleName),
     set_src_ranges_for_thunks_(false),
-    set_inline_fast_path_(false) {
+    set_inline_fast_path_(false),
+    fast_path_block_(NULL) {
 }
 
 bool BasicBlockEntryHookTransform::PreBlockGraphIteration(
@@ -164,6 +175,14 @@ bool BasicBlockEntryHookTransform::PreBlockGraphIteration(
                                                  pe::kCodeCharacteristics);
   DCHECK(thunk_section_ != NULL);
 
+  // If requested, create the fast path thunk through which the basic-block
+  // entry events will be routed.
+  if (set_inline_fast_path_ &&
+      !CreateBasicBlockEntryThunk(block_graph, &fast_path_block_)) {
+    LOG(ERROR) << "Failed to create the basic-block entry fast path.";
+    return false;
+  }
+
   return true;
 }
 
@@ -235,12 +254,19 @@ bool BasicBlockEntryHookTransform::TransformBasicBlockSubGraph(
     auto bb_entry_hook(Operand(Displacement(bb_entry_hook_ref_.referenced(),
                                             bb_entry_hook_ref_.offset())));
 
-    // Assemble entry hook instrumentation into the instruction stream.
+    // Assemble entry hook instrumentation into the instruction stream. When
+    // the fast path is enabled the module data is pushed by the shared
+    // thunk, which keeps the per basic-block instrumentation down to two
+    // instructions.
     BasicBlockAssembler bb_asm(bb->instructions().begin(), &bb->instructions());
 
     bb_asm.push(basic_block_id);
-    bb_asm.push(module_data);
-    bb_asm.call(bb_entry_hook);
+    if (fast_path_block_ != NULL) {
+      bb_asm.call(Immediate(fast_path_block_, 0));
+    } else {
+      bb_asm.push(module_data);
+      bb_asm.call(bb_entry_hook);
+    }
 
     bb_ranges_.push_back(source_range);
   }
@@ -491,5 +517,109 @@ bool BasicBlockEntryHookTransform::FindOrCreateThunk(
   return true;
 }
 
+bool BasicBlockEntryHookTransform::CreateBasicBlockEntryThunk(
+    BlockGraph* block_graph,
+    BlockGraph::Block** fast_path_block) {
+  DCHECK(block_graph != NULL);
+  DCHECK(fast_path_block != NULL);
+  DCHECK(thunk_section_ != NULL);
+  DCHECK(bb_entry_hook_ref_.IsValid());
+
+  // The fast path is called with only the basic-block id on the stack, which
+  // is popped by the callee; the module data is known to the thunk and need
+  // not be passed by each call site. Once the module data has been
+  // initialized, the counter is updated in place with a branch-free
+  // saturating add. Until then, events are forwarded to the agent hook,
+  // which performs the setup.
+  //
+  // The counters are updated without any synchronization, so concurrent
+  // increments of the same counter may occasionally be lost. This is the
+  // same trade-off the coverage agent makes when writing to its shared
+  // buffer.
+  BlockGraph::Block* data_block = add_frequency_data_.frequency_data_block();
+  DCHECK(data_block != NULL);
+
+  BasicBlockSubGraph subgraph;
+  BasicCodeBlock* check_bb = subgraph.AddBasicCodeBlock("fast_path");
+  BasicCodeBlock* increment_bb =
+      subgraph.AddBasicCodeBlock("fast_path_increment");
+  BasicCodeBlock* hook_bb = subgraph.AddBasicCodeBlock("fast_path_hook");
+  BasicBlockSubGraph::BlockDescription* desc = subgraph.AddBlockDescription(
+      "basic_block_entry_fast_path",
+      NULL,
+      BlockGraph::CODE_BLOCK,
+      thunk_section_->id(),
+      1,
+      0);
+  desc->basic_block_order.push_back(check_bb);
+  desc->basic_block_order.push_back(increment_bb);
+  desc->basic_block_order.push_back(hook_bb);
+
+  // On entry the basic-block id is at [esp + 4]; the three pushes
+  // preserving the environment move it to [esp + 16].
+  auto basic_block_id(Operand(esp, Displacement(16)));
+  auto bb_entry_hook(Operand(Displacement(bb_entry_hook_ref_.referenced(),
+                                          bb_entry_hook_ref_.offset())));
+
+  // Preserve the registers and flags we touch, then check whether the
+  // module data has been initialized.
+  BasicBlockAssembler check_asm(check_bb->instructions().begin(),
+                                &check_bb->instructions());
+  check_asm.push(eax);
+  check_asm.push(edx);
+  check_asm.pushfd();
+  check_asm.movzx_b(
+      edx,
+      Operand(Displacement(data_block, kInitializationAttemptedOffset)));
+  check_asm.test(edx, edx);
+  AddSuccessorBetween(Successor::kConditionEqual, check_bb, hook_bb);
+  AddSuccessorBetween(Successor::kConditionNotEqual, check_bb, increment_bb);
+
+  // Update the basic-block counter with a branch-free saturating add: the
+  // add wraps a saturated counter to zero and sets the carry flag, and the
+  // sbb then takes the wrapped counter back to its saturated value.
+  BasicBlockAssembler increment_asm(increment_bb->instructions().begin(),
+                                    &increment_bb->instructions());
+  increment_asm.mov(eax, Operand(Displacement(data_block,
+                                              kFrequencyDataOffset)));
+  increment_asm.mov(edx, basic_block_id);
+  increment_asm.add(Operand(eax, edx, assm::kTimes4),
+                    Immediate(1, assm::kSize8Bit));
+  increment_asm.sbb(Operand(eax, edx, assm::kTimes4),
+                    Immediate(0, assm::kSize8Bit));
+  increment_asm.popfd();
+  increment_asm.pop(edx);
+  increment_asm.pop(eax);
+  increment_asm.ret(4);
+
+  // The module data has not yet been initialized; forward the event to the
+  // agent hook, which expects the module data and the basic-block id on the
+  // stack and cleans up its own frame. The hook preserves the registers and
+  // the flags, so the environment can be restored once it returns.
+  BasicBlockAssembler hook_asm(hook_bb->instructions().begin(),
+                               &hook_bb->instructions());
+  hook_asm.mov(edx, basic_block_id);
+  hook_asm.push(edx);
+  hook_asm.push(Immediate(data_block, 0));
+  hook_asm.call(bb_entry_hook);
+  hook_asm.popfd();
+  hook_asm.pop(edx);
+  hook_asm.pop(eax);
+  hook_asm.ret(4);
+
+  // Condense the whole mess into a block.
+  BlockBuilder block_builder(block_graph);
+  if (!block_builder.Merge(&subgraph)) {
+    LOG(ERROR) << "Failed to build fast path block.";
+    return false;
+  }
+
+  // Exactly one new block should have been created.
+  DCHECK_EQ(1u, block_builder.new_blocks().size());
+  *fast_path_block = block_builder.new_blocks().front();
+
+  return true;
+}
+
 }  // namespace transforms
 }  // namespace instrument
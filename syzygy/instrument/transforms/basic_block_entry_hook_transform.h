@@ -179,6 +179,11 @@ class BasicBlockEntryHookTransform
   // falling back to the hook in the agent.
   bool set_inline_fast_path_;
 
+  // The fast path thunk servicing basic-block entry events. This will only
+  // be non-NULL if the inline fast path has been requested and the transform
+  // has been successfully applied.
+  BlockGraph::Block* fast_path_block_;
+
   // The name of this transform.
   static const char kTransformName[];
 
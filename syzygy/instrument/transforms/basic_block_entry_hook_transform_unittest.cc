@@ -51,6 +51,7 @@ typedef BasicBlockEntry::BasicBlockIndexedFrequencyData
 class TestBasicBlockEntryHookTransform : public BasicBlockEntryHookTransform {
  public:
   using BasicBlockEntryHookTransform::bb_entry_hook_ref_;
+  using BasicBlockEntryHookTransform::fast_path_block_;
   using BasicBlockEntryHookTransform::thunk_section_;
 
   BlockGraph::Block* frequency_data_block() {
@@ -225,5 +226,38 @@ TEST_F(BasicBlockEntryHookTransformTest, ApplyAgentInstrumentation) {
   CheckBasicBlockInstrumentation(kAgentInstrumentation);
 }
 
+TEST_F(BasicBlockEntryHookTransformTest, ApplyFastPathInstrumentation) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  // Apply the transform with the inline fast path enabled.
+  tx_.set_inline_fast_path(true);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx_, policy_, &block_graph_, header_block_));
+  ASSERT_TRUE(tx_.frequency_data_block() != NULL);
+  ASSERT_TRUE(tx_.thunk_section_ != NULL);
+  ASSERT_TRUE(tx_.bb_entry_hook_ref_.IsValid());
+  ASSERT_LT(0u, tx_.bb_ranges().size());
+
+  // The fast path thunk should have been created in the thunk section, and
+  // it should reference both the frequency data and the agent hook.
+  ASSERT_TRUE(tx_.fast_path_block_ != NULL);
+  EXPECT_EQ(tx_.thunk_section_->id(), tx_.fast_path_block_->section());
+  bool references_frequency_data = false;
+  bool references_entry_hook = false;
+  BlockGraph::Block::ReferenceMap::const_iterator ref_iter =
+      tx_.fast_path_block_->references().begin();
+  for (; ref_iter != tx_.fast_path_block_->references().end(); ++ref_iter) {
+    if (ref_iter->second.referenced() == tx_.frequency_data_block())
+      references_frequency_data = true;
+    if (ref_iter->second.referenced() == tx_.bb_entry_hook_ref_.referenced())
+      references_entry_hook = true;
+  }
+  EXPECT_TRUE(references_frequency_data);
+  EXPECT_TRUE(references_entry_hook);
+
+  // Validate that all basic block have been instrumented.
+  CheckBasicBlockInstrumentation(kFastPathInstrumentation);
+}
+
 }  // namespace transforms
 }  // namespace instrument
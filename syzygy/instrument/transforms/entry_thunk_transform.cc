@@ -32,6 +32,7 @@ using block_graph::BasicBlockReference;
 using block_graph::BasicBlockSubGraph;
 using block_graph::BlockBuilder;
 using block_graph::BlockGraph;
+using block_graph::BlockVector;
 using block_graph::Displacement;
 using block_graph::Operand;
 using block_graph::TransformPolicyInterface;
@@ -180,22 +181,15 @@ bool EntryThunkTransform::InstrumentCodeBlock(
   DCHECK(block_graph != NULL);
   DCHECK(block != NULL);
 
-  // Typedef for the thunk block map. The key is the offset within the callee
-  // block and the value is the thunk block that forwards to the callee at that
-  // offset.
-  ThunkBlockMap thunk_block_map;
-
-  // Iterate through all the block's referrers, creating thunks as we go.
-  // We copy the referrer set for simplicity, as it's potentially mutated
-  // in the loop.
-  BlockGraph::Block::ReferrerSet referrers = block->referrers();
-  BlockGraph::Block::ReferrerSet::const_iterator referrer_it(referrers.begin());
-  for (; referrer_it != referrers.end(); ++referrer_it) {
+  // Iterate through all the block's referrers, scheduling thunks as we go.
+  // The referrers themselves are only redirected once the thunk blocks have
+  // been materialized, so the referrer set stays unchanged in the loop.
+  BlockGraph::Block::ReferrerSet::const_iterator referrer_it(
+      block->referrers().begin());
+  for (; referrer_it != block->referrers().end(); ++referrer_it) {
     const BlockGraph::Block::Referrer& referrer = *referrer_it;
-    if (!InstrumentCodeBlockReferrer(
-        referrer, block_graph, block, &thunk_block_map)) {
+    if (!InstrumentCodeBlockReferrer(referrer, block_graph, block))
       return false;
-    }
   }
 
   return true;
@@ -204,11 +198,9 @@ bool EntryThunkTransform::InstrumentCodeBlock(
 bool EntryThunkTransform::InstrumentCodeBlockReferrer(
     const BlockGraph::Block::Referrer& referrer,
     BlockGraph* block_graph,
-    BlockGraph::Block* block,
-    ThunkBlockMap* thunk_block_map) {
+    BlockGraph::Block* block) {
   DCHECK(block_graph != NULL);
   DCHECK(block != NULL);
-  DCHECK(thunk_block_map != NULL);
 
   // Get the reference.
   BlockGraph::Reference ref;
@@ -277,34 +269,30 @@ bool EntryThunkTransform::InstrumentCodeBlockReferrer(
     param = &function_thunk_parameter_;
   }
 
-  // Look for the reference in the thunk block map, and only create a new one
-  // if it does not already exist.
-  BlockGraph::Block* thunk_block = NULL;
-  ThunkBlockMap::const_iterator thunk_it = thunk_block_map->find(ref.offset());
-  if (thunk_it == thunk_block_map->end()) {
-    thunk_block = CreateOneThunk(block_graph, ref, *hook_ref, param);
-    if (thunk_block == NULL) {
-      LOG(ERROR) << "Unable to create thunk block.";
-      return false;
-    }
-    (*thunk_block_map)[ref.offset()] = thunk_block;
+  // Look for the destination in the thunk index map, and only create a new
+  // thunk if one does not already exist. All referrers to the same
+  // destination thereby share a single thunk body.
+  ThunkKey key(ref.referenced(), ref.offset());
+  size_t thunk_index = 0;
+  ThunkIndexMap::const_iterator thunk_it = thunk_index_map_.find(key);
+  if (thunk_it == thunk_index_map_.end()) {
+    thunk_index = AddOneThunk(ref, *hook_ref, param);
+    thunk_index_map_[key] = thunk_index;
   } else {
-    thunk_block = thunk_it->second;
+    thunk_index = thunk_it->second;
   }
-  DCHECK(thunk_block != NULL);
+  DCHECK_GT(thunk_destinations_.size(), thunk_index);
 
-  // Update the referrer to point to the thunk.
-  BlockGraph::Reference new_ref(ref.type(),
-                                ref.size(),
-                                thunk_block,
-                                0, 0);
-  referrer.first->SetReference(referrer.second, new_ref);
+  // Schedule the referrer for redirection to the thunk. The redirection is
+  // performed by PostBlockGraphIteration, once the thunk blocks exist.
+  PendingReferrer pending = { referrer.first, referrer.second,
+                              ref.type(), ref.size(), thunk_index };
+  pending_referrers_.push_back(pending);
 
   return true;
 }
 
-BlockGraph::Block* EntryThunkTransform::CreateOneThunk(
-    BlockGraph* block_graph,
+size_t EntryThunkTransform::AddOneThunk(
     const BlockGraph::Reference& destination,
     const BlockGraph::Reference& hook,
     const ImmediateType* parameter) {
@@ -320,20 +308,19 @@ BlockGraph::Block* EntryThunkTransform::CreateOneThunk(
                               destination.offset());
   }
 
-  // Set up a basic block subgraph containing a single block description, with
-  // that block description containing a single empty basic block, and get an
-  // assembler writing into that basic block.
+  // Add a block description containing a single empty basic block to the
+  // pending thunk graph, and get an assembler writing into that basic block.
   // TODO(chrisha): Make this reusable somehow. Creating a code block via an
   //     assembler is likely to be pretty common.
-  BasicBlockSubGraph bbsg;
-  BasicBlockSubGraph::BlockDescription* block_desc = bbsg.AddBlockDescription(
-      name,
-      NULL,
-      BlockGraph::CODE_BLOCK,
-      thunk_section_->id(),
-      1,
-      0);
-  BasicCodeBlock* bb = bbsg.AddBasicCodeBlock(name);
+  BasicBlockSubGraph::BlockDescription* block_desc =
+      thunk_graph_.AddBlockDescription(
+          name,
+          NULL,
+          BlockGraph::CODE_BLOCK,
+          thunk_section_->id(),
+          1,
+          0);
+  BasicCodeBlock* bb = thunk_graph_.AddBasicCodeBlock(name);
   block_desc->basic_block_order.push_back(bb);
   BasicBlockAssembler assm(bb->instructions().begin(),
                            &bb->instructions());
@@ -347,40 +334,76 @@ BlockGraph::Block* EntryThunkTransform::CreateOneThunk(
   assm.push(Immediate(destination.referenced(), destination.offset()));
   assm.jmp(Operand(Displacement(hook.referenced(), hook.offset())));
 
-  // Condense the whole mess into a block.
+  thunk_destinations_.push_back(destination);
+  return thunk_destinations_.size() - 1;
+}
+
+bool EntryThunkTransform::PostBlockGraphIteration(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  DCHECK_NE(reinterpret_cast<TransformPolicyInterface*>(NULL), policy);
+  DCHECK_NE(reinterpret_cast<BlockGraph*>(NULL), block_graph);
+  DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), header_block);
+
+  // Nothing to do if no thunks were requested.
+  if (thunk_destinations_.empty())
+    return true;
+
+  // Condense the pending thunks into blocks in a single pass. The block
+  // builder materializes one block per block description, in order of
+  // creation, so the thunks end up back to back in the thunk section.
   BlockBuilder block_builder(block_graph);
-  if (!block_builder.Merge(&bbsg)) {
-    LOG(ERROR) << "Failed to build thunk block.";
-    return NULL;
+  if (!block_builder.Merge(&thunk_graph_)) {
+    LOG(ERROR) << "Failed to build thunk blocks.";
+    return false;
   }
 
-  // Exactly one new block should have been created.
-  DCHECK_EQ(1u, block_builder.new_blocks().size());
-  BlockGraph::Block* thunk = block_builder.new_blocks().front();
+  const BlockVector& thunks = block_builder.new_blocks();
+  DCHECK_EQ(thunk_destinations_.size(), thunks.size());
 
   if (src_ranges_for_thunks_) {
-    // Give the thunk a source range synonymous with the destination.
-    // That way the debugger will resolve calls and jumps to the thunk to the
-    // destination function's name, which makes the assembly much easier to
-    // read. The downside to this is that the symbols are now no longer unique,
-    // and searching for a function by name may turn up either the function or
-    // the thunk.
-    const BlockGraph::Block::SourceRanges& source_ranges =
-        destination.referenced()->source_ranges();
-    const BlockGraph::Block::SourceRanges::RangePair* source =
-        source_ranges.FindRangePair(destination.offset(), thunk->size());
-    if (source != NULL) {
-      // Calculate the offset into the range.
-      size_t offs = destination.offset() - source->first.start();
-      BlockGraph::Block::DataRange data(0, thunk->size());
-      BlockGraph::Block::SourceRange src(source->second.start() + offs,
-                                          thunk->size());
-      bool pushed = thunk->source_ranges().Push(data, src);
-      DCHECK(pushed);
-    }
+    for (size_t i = 0; i < thunks.size(); ++i)
+      GiveThunkSourceRange(thunk_destinations_[i], thunks[i]);
+  }
+
+  // Update the referrers to point to the thunks.
+  for (size_t i = 0; i < pending_referrers_.size(); ++i) {
+    const PendingReferrer& pending = pending_referrers_[i];
+    BlockGraph::Reference new_ref(pending.type,
+                                  pending.size,
+                                  thunks[pending.thunk_index],
+                                  0, 0);
+    pending.block->SetReference(pending.offset, new_ref);
   }
 
-  return thunk;
+  return true;
+}
+
+void EntryThunkTransform::GiveThunkSourceRange(
+    const BlockGraph::Reference& destination,
+    BlockGraph::Block* thunk) {
+  DCHECK(thunk != NULL);
+
+  // Give the thunk a source range synonymous with the destination.
+  // That way the debugger will resolve calls and jumps to the thunk to the
+  // destination function's name, which makes the assembly much easier to
+  // read. The downside to this is that the symbols are now no longer unique,
+  // and searching for a function by name may turn up either the function or
+  // the thunk.
+  const BlockGraph::Block::SourceRanges& source_ranges =
+      destination.referenced()->source_ranges();
+  const BlockGraph::Block::SourceRanges::RangePair* source =
+      source_ranges.FindRangePair(destination.offset(), thunk->size());
+  if (source != NULL) {
+    // Calculate the offset into the range.
+    size_t offs = destination.offset() - source->first.start();
+    BlockGraph::Block::DataRange data(0, thunk->size());
+    BlockGraph::Block::SourceRange src(source->second.start() + offs,
+                                        thunk->size());
+    bool pushed = thunk->source_ranges().Push(data, src);
+    DCHECK(pushed);
+  }
 }
 
 bool EntryThunkTransform::GetEntryPoints(BlockGraph::Block* header_block) {
@@ -47,11 +47,15 @@
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_ENTRY_THUNK_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_ENTRY_THUNK_TRANSFORM_H_
 
+#include <map>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/iterate.h"
 #include "syzygy/block_graph/transforms/iterative_transform.h"
 #include "syzygy/pe/pe_utils.h"
@@ -137,7 +141,20 @@ class EntryThunkTransform
   static const char kDefaultInstrumentDll[];
 
  protected:
-  typedef std::map<BlockGraph::Offset, BlockGraph::Block*> ThunkBlockMap;
+  // The thunks are identified by the destination they forward to. Thunks are
+  // shared - a single thunk serves all of the referrers to its destination.
+  typedef std::pair<BlockGraph::Block*, BlockGraph::Offset> ThunkKey;
+  typedef std::map<ThunkKey, size_t> ThunkIndexMap;
+
+  // Records a referrer that is to be redirected to a pending thunk once the
+  // thunk blocks have been materialized.
+  struct PendingReferrer {
+    BlockGraph::Block* block;
+    BlockGraph::Offset offset;
+    BlockGraph::ReferenceType type;
+    BlockGraph::Size size;
+    size_t thunk_index;
+  };
 
   // @name IterativeTransformImpl implementation.
   // @{
@@ -147,6 +164,9 @@ class EntryThunkTransform
   bool OnBlock(const TransformPolicyInterface* policy,
                BlockGraph* block_graph,
                BlockGraph::Block* block);
+  bool PostBlockGraphIteration(const TransformPolicyInterface* policy,
+                               BlockGraph* block_graph,
+                               BlockGraph::Block* header_block);
   // @}
 
   // Instrument a single block.
@@ -155,19 +175,21 @@ class EntryThunkTransform
   // Instruments a single referrer to a code block.
   bool InstrumentCodeBlockReferrer(const BlockGraph::Block::Referrer& referrer,
                                    BlockGraph* block_graph,
-                                   BlockGraph::Block* block,
-                                   ThunkBlockMap* thunk_block_map);
+                                   BlockGraph::Block* block);
 
-  // Create a single thunk to destination.
-  // @param block_graph the block-graph being instrumented.
+  // Assembles a single thunk to destination into the pending thunk graph.
+  // The thunks accumulated over the iteration are materialized as blocks in
+  // a single batch by PostBlockGraphIteration, which lays them out back to
+  // back in the thunk section and is much cheaper than merging a one-block
+  // subgraph per thunk.
   // @param destination the destination reference.
   // @param hook a reference to the hook to use.
   // @param parameter the parameter to be passed to the thunk. If this is NULL
   //     then an unparameterized thunk will be created.
-  BlockGraph::Block* CreateOneThunk(BlockGraph* block_graph,
-                                    const BlockGraph::Reference& destination,
-                                    const BlockGraph::Reference& hook,
-                                    const ImmediateType* parameter);
+  // @returns the index of the new thunk.
+  size_t AddOneThunk(const BlockGraph::Reference& destination,
+                     const BlockGraph::Reference& hook,
+                     const ImmediateType* parameter);
 
  private:
   friend IterativeTransformImpl<EntryThunkTransform>;
@@ -175,6 +197,10 @@ class EntryThunkTransform
 
   bool GetEntryPoints(BlockGraph::Block* header_block);
 
+  // Gives @p thunk a source range synonymous with its @p destination.
+  void GiveThunkSourceRange(const BlockGraph::Reference& destination,
+                            BlockGraph::Block* thunk);
+
   // For NamedBlockGraphTransformImpl.
   static const char kTransformName[];
 
@@ -220,6 +246,21 @@ class EntryThunkTransform
   // EXE main entry point. Valid after successful call to GetEntryPoints.
   pe::EntryPoint exe_entry_point_;
 
+  // The subgraph the pending thunks are assembled into. Each thunk is a
+  // separate block description, and all of them are merged into the block
+  // graph in one pass by PostBlockGraphIteration.
+  block_graph::BasicBlockSubGraph thunk_graph_;
+
+  // Maps thunk destinations to indices into thunk_destinations_ and into
+  // the block descriptions of thunk_graph_, in order of creation.
+  ThunkIndexMap thunk_index_map_;
+
+  // The destination of each pending thunk, in order of creation.
+  std::vector<BlockGraph::Reference> thunk_destinations_;
+
+  // The referrers awaiting redirection to the pending thunks.
+  std::vector<PendingReferrer> pending_referrers_;
+
   DISALLOW_COPY_AND_ASSIGN(EntryThunkTransform);
 };
 
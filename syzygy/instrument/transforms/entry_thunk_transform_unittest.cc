@@ -442,6 +442,18 @@ TEST_F(EntryThunkTransformTest, InstrumentAll) {
   // and one for the middle of foo().
   ASSERT_NO_FATAL_FAILURE(VerifyThunks(3, 0, 3, 1));
 
+  // The referrers should have been redirected into the thunk section.
+  BlockGraph::Section* thunk_section =
+      bg_.FindSection(common::kThunkSectionName);
+  ASSERT_TRUE(thunk_section != NULL);
+  BlockGraph::Reference array_to_bar, foo_to_bar;
+  ASSERT_TRUE(array_->GetReference(4, &array_to_bar));
+  ASSERT_TRUE(foo_->GetReference(5, &foo_to_bar));
+  EXPECT_EQ(thunk_section->id(), array_to_bar.referenced()->section());
+
+  // Both referrers to the start of bar() should share a single thunk.
+  EXPECT_EQ(array_to_bar.referenced(), foo_to_bar.referenced());
+
   // The .thunks section should have been added.
   EXPECT_EQ(num_sections_pre_transform_ + 1, bg_.sections().size());
 }
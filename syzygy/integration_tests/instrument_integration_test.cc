@@ -13,8 +13,12 @@
 // limitations under the License.
 
 #include "base/environment.h"
+#include "base/file_util.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/lazy_instance.h"
+#include "base/md5.h"
 #include "base/process/kill.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
@@ -69,6 +73,67 @@ const char kAsanHeapBufferOverflow[] = "SyzyASAN error: heap-buffer-overflow ";
 const char kAsanCorruptHeap[] = "SyzyASAN error: corrupt-heap ";
 const char kAsanHeapUseAfterFree[] = "SyzyASAN error: heap-use-after-free ";
 
+// The environment variable pointing to a directory in which instrumented
+// images are cached between test invocations. If this is not set the cache
+// only lives for the duration of the test process.
+const char kCacheDirEnvVar[] = "SYZYGY_INTEGRATION_TESTS_CACHE_DIR";
+
+// Returns the root directory of the instrumented-image cache, creating it if
+// it does not yet exist. Returns an empty path if no cache directory can be
+// created, in which case caching is disabled.
+base::FilePath GetInstrumentedImageCacheRoot() {
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  std::string cache_dir_utf8;
+  if (env->GetVar(kCacheDirEnvVar, &cache_dir_utf8)) {
+    base::FilePath cache_dir(base::UTF8ToWide(cache_dir_utf8));
+    if (base::CreateDirectory(cache_dir))
+      return cache_dir;
+    LOG(WARNING) << "Unable to create image cache directory \""
+                 << cache_dir.value() << "\". Caching is disabled.";
+    return base::FilePath();
+  }
+
+  // Fall back to a temporary directory with process lifetime. This still
+  // saves the repeated instrumentation of identical inputs within a single
+  // test invocation.
+  static base::LazyInstance<base::ScopedTempDir> temp_dir =
+      LAZY_INSTANCE_INITIALIZER;
+  if (!temp_dir.Get().IsValid() && !temp_dir.Get().CreateUniqueTempDir())
+    return base::FilePath();
+  return temp_dir.Get().path();
+}
+
+// Computes the content-addressed key of an instrumentation run: a digest
+// over the contents of the input image and the instrumentation switches. The
+// input and output image paths themselves are excluded, as they vary from
+// test to test without influencing the instrumented image.
+bool ComputeInstrumentedImageCacheKey(const CommandLine& cmd_line,
+                                      const base::FilePath& input_dll_path,
+                                      std::string* key) {
+  DCHECK_NE(reinterpret_cast<std::string*>(NULL), key);
+
+  std::string contents;
+  if (!base::ReadFileToString(input_dll_path, &contents)) {
+    LOG(ERROR) << "Unable to read input image \"" << input_dll_path.value()
+               << "\".";
+    return false;
+  }
+
+  const CommandLine::SwitchMap& switches = cmd_line.GetSwitches();
+  CommandLine::SwitchMap::const_iterator it = switches.begin();
+  for (; it != switches.end(); ++it) {
+    if (it->first == "input-image" || it->first == "output-image")
+      continue;
+    contents.append(it->first);
+    contents.append("=");
+    contents.append(base::WideToUTF8(it->second));
+    contents.append(";");
+  }
+
+  *key = base::MD5String(contents);
+  return true;
+}
+
 // A convenience class for controlling an out of process agent_logger instance,
 // and getting the contents of its log file. Not thread safe.
 struct ScopedAgentLogger {
@@ -341,19 +406,70 @@ class InstrumentAppIntegrationTest : public testing::PELibUnitTest {
   }
 
   // Runs an instrumentation pass in the given mode and validates that the
-  // resulting output DLL loads.
+  // resulting output DLL loads. Many test cases instrument identical inputs
+  // with identical configurations, so instrumented images are produced once
+  // per configuration into a content-addressed cache and subsequently copied
+  // out of it rather than being rebuilt.
   void EndToEndTest(const std::string& mode) {
-    cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
-    cmd_line_.AppendSwitchPath("output-image", output_dll_path_);
     cmd_line_.AppendSwitchASCII("mode", mode);
 
-    // Create the instrumented DLL.
+    base::FilePath cache_root = GetInstrumentedImageCacheRoot();
+    std::string cache_key;
+    if (!cache_root.empty() &&
+        ComputeInstrumentedImageCacheKey(cmd_line_, input_dll_path_,
+                                         &cache_key)) {
+      base::FilePath entry_dir = cache_root.AppendASCII(cache_key);
+      if (!base::PathExists(entry_dir))
+        ASSERT_NO_FATAL_FAILURE(CreateCacheEntry(cache_root, entry_dir));
+      ASSERT_NO_FATAL_FAILURE(CopyCacheEntry(entry_dir));
+    } else {
+      // Caching is unavailable; instrument directly into the temporary
+      // directory.
+      ASSERT_NO_FATAL_FAILURE(Instrument(output_dll_path_));
+    }
+
+    // Validate that the test dll loads post instrumentation.
+    ASSERT_NO_FATAL_FAILURE(LoadTestDll(output_dll_path_, &module_));
+  }
+
+  // Runs the instrumenter with the current command-line, writing the
+  // instrumented image to @p output_dll_path.
+  void Instrument(const base::FilePath& output_dll_path) {
+    cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+    cmd_line_.AppendSwitchPath("output-image", output_dll_path);
+
     common::Application<instrument::InstrumentApp> app;
     ASSERT_NO_FATAL_FAILURE(ConfigureTestApp(&app));
     ASSERT_EQ(0, app.Run());
+  }
 
-    // Validate that the test dll loads post instrumentation.
-    ASSERT_NO_FATAL_FAILURE(LoadTestDll(output_dll_path_, &module_));
+  // Produces the cache entry @p entry_dir by instrumenting into a scratch
+  // directory and then committing it to the cache with a rename. The rename
+  // is atomic, which makes the cache safe to share between test processes
+  // running in parallel (e.g. under a sharding test driver); if another
+  // process commits the entry first its artifacts are used.
+  void CreateCacheEntry(const base::FilePath& cache_root,
+                        const base::FilePath& entry_dir) {
+    base::FilePath scratch_dir;
+    ASSERT_TRUE(base::CreateTemporaryDirInDir(cache_root, L"scratch-",
+                                              &scratch_dir));
+    ASSERT_NO_FATAL_FAILURE(
+        Instrument(scratch_dir.Append(input_dll_path_.BaseName())));
+    if (!base::Move(scratch_dir, entry_dir)) {
+      // Another process committed this entry while we were producing it.
+      ASSERT_TRUE(base::PathExists(entry_dir));
+      base::DeleteFile(scratch_dir, true);
+    }
+  }
+
+  // Copies the artifacts of the given cache entry (the instrumented image
+  // and its PDB) into the test's temporary directory.
+  void CopyCacheEntry(const base::FilePath& entry_dir) {
+    base::FileEnumerator files(entry_dir, false, base::FileEnumerator::FILES);
+    for (base::FilePath path = files.Next(); !path.empty();
+         path = files.Next()) {
+      ASSERT_TRUE(base::CopyFile(path, temp_dir_.Append(path.BaseName())));
+    }
   }
 
   // Invoke a test function inside test_dll by addressing it with a test id.
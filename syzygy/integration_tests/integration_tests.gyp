@@ -51,6 +51,32 @@
         },
       },
     },
+    {
+      # A verification harness that relinks a corpus of test images both
+      # serially and with the parallel pipeline modes enabled, and checks
+      # that the outputs are byte-for-byte identical once normalized.
+      'target_name': 'parallel_equivalence_tests',
+      'type': 'executable',
+      'sources': [
+        'parallel_equivalence_test.cc',
+        '<(src)/base/test/run_all_unittests.cc',
+      ],
+      'dependencies': [
+        '<(src)/base/base.gyp:base',
+        '<(src)/base/base.gyp:test_support_base',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+        '<(src)/syzygy/core/core.gyp:core_unittest_utils',
+        '<(src)/syzygy/instrument/instrument.gyp:instrument_lib',
+        '<(src)/syzygy/pe/pe.gyp:pe_lib',
+        '<(src)/syzygy/pe/pe.gyp:pe_unittest_utils',
+        '<(src)/syzygy/test_data/test_data.gyp:copy_test_dll',
+        '<(src)/syzygy/test_data/test_data.gyp:randomized_test_dll',
+        '<(src)/syzygy/testing/testing.gyp:testing_lib',
+        '<(src)/syzygy/zap_timestamp/zap_timestamp.gyp:zap_timestamp_lib',
+        '<(src)/testing/gmock.gyp:gmock',
+        '<(src)/testing/gtest.gyp:gtest',
+      ],
+    },
     {
       'target_name': 'integration_tests_dll',
       'type': 'loadable_module',
@@ -0,0 +1,182 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A verification harness for the parallel modes of the instrumentation
+// pipeline. This runs a full instrument-and-relink pass over a small corpus
+// of test images, both serially and with the parallel modes enabled, and
+// verifies that the two configurations produce byte-for-byte identical
+// outputs once normalized. The wall-clock time of each configuration is
+// emitted as a metric so that the speed-up can be tracked on the dashboard.
+
+#include "base/basictypes.h"
+#include "base/file_util.h"
+#include "base/files/file_path.h"
+#include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/time/time.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/file_util.h"
+#include "syzygy/instrument/transforms/asan_transform.h"
+#include "syzygy/pe/pe_relinker.h"
+#include "syzygy/pe/pe_transform_policy.h"
+#include "syzygy/pe/unittest_util.h"
+#include "syzygy/testing/metrics.h"
+#include "syzygy/zap_timestamp/zap_timestamp.h"
+
+namespace integration_tests {
+
+namespace {
+
+// A corpus image over which the serial and parallel pipelines are compared.
+struct CorpusImage {
+  // The label under which timings for this image are reported.
+  const char* label;
+  // The image and its PDB file, relative to the test_data directory.
+  const wchar_t* image_name;
+  const wchar_t* pdb_name;
+};
+
+const CorpusImage kCorpusImages[] = {
+  { "TestDll", testing::kTestDllName, testing::kTestDllPdbName },
+  { "RandomizedTestDll",
+    testing::kRandomizedTestDllName,
+    testing::kRandomizedTestDllPdbName },
+};
+
+class ParallelEquivalenceTest : public testing::PELibUnitTest {
+  typedef testing::PELibUnitTest Super;
+
+ public:
+  virtual void SetUp() {
+    Super::SetUp();
+    ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir_));
+  }
+
+  // Instruments @p image with the Asan transform on @p num_threads threads,
+  // writing the results to @p output_image and @p output_pdb. The elapsed
+  // wall-clock time of the relink is returned via @p elapsed.
+  bool Relink(const base::FilePath& image,
+              const base::FilePath& pdb,
+              const base::FilePath& output_image,
+              const base::FilePath& output_pdb,
+              size_t num_threads,
+              base::TimeDelta* elapsed) {
+    DCHECK(elapsed != NULL);
+
+    pe::PETransformPolicy policy;
+    pe::PERelinker relinker(&policy);
+    instrument::transforms::AsanTransform transform;
+    transform.set_num_threads(num_threads);
+
+    relinker.AppendTransform(&transform);
+    relinker.set_input_path(image);
+    relinker.set_input_pdb_path(pdb);
+    relinker.set_output_path(output_image);
+    relinker.set_output_pdb_path(output_pdb);
+    // The metadata embeds the command line and a creation time; leave it
+    // out so that the outputs can be meaningfully compared.
+    relinker.set_add_metadata(false);
+
+    base::TimeTicks start = base::TimeTicks::Now();
+    if (!relinker.Init())
+      return false;
+    if (!relinker.Relink())
+      return false;
+    *elapsed = base::TimeTicks::Now() - start;
+
+    return true;
+  }
+
+  // Normalizes @p image and @p pdb in place, zapping the timestamps, GUIDs
+  // and hashes that legitimately differ from one relink to the next.
+  bool Normalize(const base::FilePath& image, const base::FilePath& pdb) {
+    zap_timestamp::ZapTimestamp zap;
+    zap.set_input_image(image);
+    zap.set_input_pdb(pdb);
+    zap.set_write_image(true);
+    zap.set_write_pdb(true);
+    zap.set_overwrite(true);
+    if (!zap.Init())
+      return false;
+    return zap.Zap();
+  }
+
+  base::FilePath temp_dir_;
+};
+
+}  // namespace
+
+TEST_F(ParallelEquivalenceTest, SerialAndParallelRelinksAreIdentical) {
+  size_t num_threads = base::SysInfo::NumberOfProcessors();
+  if (num_threads < 2)
+    num_threads = 2;
+
+  base::FilePath serial_dir = temp_dir_.Append(L"serial");
+  base::FilePath parallel_dir = temp_dir_.Append(L"parallel");
+  ASSERT_TRUE(base::CreateDirectory(serial_dir));
+  ASSERT_TRUE(base::CreateDirectory(parallel_dir));
+
+  for (size_t i = 0; i < arraysize(kCorpusImages); ++i) {
+    const CorpusImage& corpus_image = kCorpusImages[i];
+    base::FilePath image =
+        testing::GetExeTestDataRelativePath(corpus_image.image_name);
+    base::FilePath pdb =
+        testing::GetExeTestDataRelativePath(corpus_image.pdb_name);
+    ASSERT_TRUE(base::PathExists(image));
+    ASSERT_TRUE(base::PathExists(pdb));
+
+    base::FilePath serial_image = serial_dir.Append(corpus_image.image_name);
+    base::FilePath serial_pdb = serial_dir.Append(corpus_image.pdb_name);
+    base::FilePath parallel_image =
+        parallel_dir.Append(corpus_image.image_name);
+    base::FilePath parallel_pdb = parallel_dir.Append(corpus_image.pdb_name);
+
+    base::TimeDelta serial_elapsed;
+    ASSERT_TRUE(Relink(image, pdb, serial_image, serial_pdb, 1,
+                       &serial_elapsed));
+    base::TimeDelta parallel_elapsed;
+    ASSERT_TRUE(Relink(image, pdb, parallel_image, parallel_pdb, num_threads,
+                       &parallel_elapsed));
+
+    testing::EmitMetric(
+        base::StringPrintf(
+            "Syzygy.IntegrationTests.ParallelEquivalence.%s.SerialRelinkMs",
+            corpus_image.label),
+        serial_elapsed.InMilliseconds());
+    testing::EmitMetric(
+        base::StringPrintf(
+            "Syzygy.IntegrationTests.ParallelEquivalence.%s.ParallelRelinkMs",
+            corpus_image.label),
+        parallel_elapsed.InMilliseconds());
+
+    // Normalize both outputs: the relinker stamps each relink with a fresh
+    // PDB GUID and timestamps, which legitimately differ between the runs.
+    ASSERT_TRUE(Normalize(serial_image, serial_pdb));
+    ASSERT_TRUE(Normalize(parallel_image, parallel_pdb));
+
+    bool identical = false;
+    ASSERT_TRUE(core::CompareFileContents(serial_image, parallel_image,
+                                          &identical));
+    EXPECT_TRUE(identical) << "Parallel relink of " << corpus_image.label
+                           << " differs from the serial relink.";
+
+    identical = false;
+    ASSERT_TRUE(core::CompareFileContents(serial_pdb, parallel_pdb,
+                                          &identical));
+    EXPECT_TRUE(identical) << "Parallel relink of the " << corpus_image.label
+                           << " PDB differs from the serial relink.";
+  }
+}
+
+}  // namespace integration_tests
@@ -0,0 +1,238 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/kasko/crash_staging_area.h"
+
+#include <string.h>
+
+#include "base/logging.h"
+#include "syzygy/common/com_utils.h"
+
+namespace kasko {
+
+namespace {
+
+// Identifies a mapping as a Kasko crash staging area.
+const uint32_t kStagingAreaMagic = 0x6F6B736B;  // 'ksko'.
+
+// The layout version of the staging area. Bump this whenever the header
+// layout changes; clients refuse to stage into an unknown version.
+const uint32_t kStagingAreaVersion = 1;
+
+// The states of the staging area. The area cycles free -> writing -> ready
+// as a client stages a report, and back to free when the service releases
+// it.
+const LONG kStagingAreaFree = 0;
+const LONG kStagingAreaWriting = 1;
+const LONG kStagingAreaReady = 2;
+
+// The header at the start of the shared mapping. The custom data stream
+// immediately follows the header.
+struct StagingAreaHeader {
+  uint32_t magic;
+  uint32_t version;
+  // One of kStagingAreaFree, kStagingAreaWriting or kStagingAreaReady.
+  // Transitioned using interlocked operations.
+  volatile LONG state;
+  uint32_t client_process_id;
+  uint32_t thread_id;
+  uint64_t exception_info_address;
+  uint32_t protobuf_length;
+};
+
+// Derives the kernel object names used for a staging area named @p name.
+base::string16 GetMappingName(const base::string16& name) {
+  return name + L"-mem";
+}
+
+base::string16 GetDoorbellName(const base::string16& name) {
+  return name + L"-doorbell";
+}
+
+}  // namespace
+
+// static
+scoped_ptr<CrashStagingArea> CrashStagingArea::Create(
+    const base::string16& name,
+    size_t size) {
+  DCHECK(!name.empty());
+  DCHECK_LT(sizeof(StagingAreaHeader), size);
+
+  base::win::ScopedHandle mapping(
+      ::CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                          static_cast<DWORD>(size),
+                          GetMappingName(name).c_str()));
+  if (!mapping.IsValid()) {
+    LOG(ERROR) << "Failed to create staging area mapping: "
+               << ::common::LogWe() << ".";
+    return scoped_ptr<CrashStagingArea>();
+  }
+
+  void* view = ::MapViewOfFile(mapping.Get(), FILE_MAP_WRITE, 0, 0, size);
+  if (!view) {
+    LOG(ERROR) << "Failed to map staging area view: " << ::common::LogWe()
+               << ".";
+    return scoped_ptr<CrashStagingArea>();
+  }
+
+  // The doorbell is auto-reset: each staged report wakes the service once.
+  base::win::ScopedHandle doorbell(
+      ::CreateEvent(NULL, FALSE, FALSE, GetDoorbellName(name).c_str()));
+  if (!doorbell.IsValid()) {
+    LOG(ERROR) << "Failed to create staging area doorbell: "
+               << ::common::LogWe() << ".";
+    ::UnmapViewOfFile(view);
+    return scoped_ptr<CrashStagingArea>();
+  }
+
+  // The mapping is zero-initialized by the system; in particular the state
+  // starts out free.
+  StagingAreaHeader* header = static_cast<StagingAreaHeader*>(view);
+  header->magic = kStagingAreaMagic;
+  header->version = kStagingAreaVersion;
+
+  return make_scoped_ptr(
+      new CrashStagingArea(mapping.Pass(), doorbell.Pass(), view, size));
+}
+
+// static
+scoped_ptr<CrashStagingArea> CrashStagingArea::Open(
+    const base::string16& name) {
+  DCHECK(!name.empty());
+
+  base::win::ScopedHandle mapping(
+      ::OpenFileMapping(FILE_MAP_WRITE, FALSE, GetMappingName(name).c_str()));
+  if (!mapping.IsValid()) {
+    LOG(ERROR) << "Failed to open staging area mapping: " << ::common::LogWe()
+               << ".";
+    return scoped_ptr<CrashStagingArea>();
+  }
+
+  void* view = ::MapViewOfFile(mapping.Get(), FILE_MAP_WRITE, 0, 0, 0);
+  if (!view) {
+    LOG(ERROR) << "Failed to map staging area view: " << ::common::LogWe()
+               << ".";
+    return scoped_ptr<CrashStagingArea>();
+  }
+
+  MEMORY_BASIC_INFORMATION info = {};
+  if (::VirtualQuery(view, &info, sizeof(info)) != sizeof(info)) {
+    LOG(ERROR) << "Failed to query staging area view: " << ::common::LogWe()
+               << ".";
+    ::UnmapViewOfFile(view);
+    return scoped_ptr<CrashStagingArea>();
+  }
+  size_t size = info.RegionSize;
+
+  base::win::ScopedHandle doorbell(
+      ::OpenEvent(EVENT_MODIFY_STATE, FALSE, GetDoorbellName(name).c_str()));
+  if (!doorbell.IsValid()) {
+    LOG(ERROR) << "Failed to open staging area doorbell: " << ::common::LogWe()
+               << ".";
+    ::UnmapViewOfFile(view);
+    return scoped_ptr<CrashStagingArea>();
+  }
+
+  const StagingAreaHeader* header = static_cast<StagingAreaHeader*>(view);
+  if (size <= sizeof(StagingAreaHeader) ||
+      header->magic != kStagingAreaMagic ||
+      header->version != kStagingAreaVersion) {
+    LOG(ERROR) << "Unrecognized staging area layout.";
+    ::UnmapViewOfFile(view);
+    return scoped_ptr<CrashStagingArea>();
+  }
+
+  return make_scoped_ptr(
+      new CrashStagingArea(mapping.Pass(), doorbell.Pass(), view, size));
+}
+
+CrashStagingArea::~CrashStagingArea() {
+  if (view_)
+    ::UnmapViewOfFile(view_);
+}
+
+bool CrashStagingArea::StageReport(uint64_t exception_info_address,
+                                   uint32_t thread_id,
+                                   const char* protobuf,
+                                   size_t protobuf_length) {
+  DCHECK(protobuf || protobuf_length == 0);
+
+  StagingAreaHeader* header = static_cast<StagingAreaHeader*>(view_);
+  if (protobuf_length > size_ - sizeof(StagingAreaHeader))
+    return false;
+
+  // Claim the staging area. If another report is being staged, or is staged
+  // and not yet consumed by the service, give up; the caller may fall back
+  // to the RPC transport.
+  if (::InterlockedCompareExchange(&header->state, kStagingAreaWriting,
+                                   kStagingAreaFree) != kStagingAreaFree) {
+    return false;
+  }
+
+  // Fill the staging area with a single forward sequence of writes.
+  header->client_process_id = ::GetCurrentProcessId();
+  header->thread_id = thread_id;
+  header->exception_info_address = exception_info_address;
+  header->protobuf_length = protobuf_length;
+  if (protobuf_length)
+    ::memcpy(header + 1, protobuf, protobuf_length);
+
+  // Publish the report. The interlocked exchange orders the writes above
+  // before the state becomes visible as ready.
+  ::InterlockedExchange(&header->state, kStagingAreaReady);
+  ::SetEvent(doorbell_.Get());
+  return true;
+}
+
+bool CrashStagingArea::ReadStagedReport(StagedReport* report) const {
+  DCHECK(report);
+
+  const StagingAreaHeader* header =
+      static_cast<const StagingAreaHeader*>(view_);
+  if (header->state != kStagingAreaReady)
+    return false;
+
+  // The length is validated against the mapping size: the client is not
+  // trusted.
+  if (header->protobuf_length > size_ - sizeof(StagingAreaHeader))
+    return false;
+
+  report->client_process_id = header->client_process_id;
+  report->thread_id = header->thread_id;
+  report->exception_info_address = header->exception_info_address;
+  report->protobuf = reinterpret_cast<const char*>(header + 1);
+  report->protobuf_length = header->protobuf_length;
+  return true;
+}
+
+void CrashStagingArea::ReleaseStagedReport() {
+  StagingAreaHeader* header = static_cast<StagingAreaHeader*>(view_);
+  ::InterlockedExchange(&header->state, kStagingAreaFree);
+}
+
+CrashStagingArea::CrashStagingArea(base::win::ScopedHandle mapping,
+                                   base::win::ScopedHandle doorbell,
+                                   void* view,
+                                   size_t size)
+    : mapping_(mapping.Pass()),
+      doorbell_(doorbell.Pass()),
+      view_(view),
+      size_(size) {
+  DCHECK(mapping_.IsValid());
+  DCHECK(doorbell_.IsValid());
+  DCHECK(view_);
+  DCHECK_LT(sizeof(StagingAreaHeader), size_);
+}
+
+}  // namespace kasko
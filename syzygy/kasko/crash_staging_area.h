@@ -0,0 +1,124 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SYZYGY_KASKO_CRASH_STAGING_AREA_H_
+#define SYZYGY_KASKO_CRASH_STAGING_AREA_H_
+
+#include <Windows.h>  // NOLINT
+#include <stdint.h>
+
+#include "base/macros.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string16.h"
+#include "base/win/scoped_handle.h"
+
+namespace kasko {
+
+// Provides a preestablished shared-memory area used to hand a crash report
+// context from a client process to the Kasko service without RPC marshaling.
+//
+// The service creates the staging area and the client opens it by name. To
+// stage a report the client claims the area, fills it with a single forward
+// sequence of writes (performing no allocations) and rings a doorbell event
+// that the service waits on. The service reads the staged data directly out
+// of the shared mapping, which remains valid even if the client is terminated
+// immediately after ringing the doorbell.
+//
+// Note that, unlike with the RPC transport, the staged client process ID is
+// provided by the (potentially compromised) client and is not authenticated.
+class CrashStagingArea {
+ public:
+  // Describes a report staged by a client.
+  struct StagedReport {
+    // The process ID reported by the client.
+    uint32_t client_process_id;
+    // The ID of the crashing thread.
+    uint32_t thread_id;
+    // The address of an EXCEPTION_POINTERS structure in the client process.
+    uint64_t exception_info_address;
+    // The client's custom data stream. Points into the shared mapping and is
+    // only valid until ReleaseStagedReport() is called.
+    const char* protobuf;
+    // The length of the custom data stream.
+    size_t protobuf_length;
+  };
+
+  // Creates a new staging area. Intended for use by the service.
+  // @param name The name of the staging area. Clients use the same name to
+  //     open it.
+  // @param size The size, in bytes, of the shared mapping. Bounds the length
+  //     of the staged custom data stream.
+  // @returns a CrashStagingArea instance, or NULL if an error occurs.
+  static scoped_ptr<CrashStagingArea> Create(const base::string16& name,
+                                             size_t size);
+
+  // Opens an existing staging area. Intended for use by clients.
+  // @param name The name the staging area was created with.
+  // @returns a CrashStagingArea instance, or NULL if an error occurs.
+  static scoped_ptr<CrashStagingArea> Open(const base::string16& name);
+
+  ~CrashStagingArea();
+
+  // Stages a report for the calling process and rings the doorbell. Performs
+  // a single forward sequence of writes into the shared mapping and no
+  // allocations, making it safe to call from a crashing process. Fails if the
+  // staging area is already occupied by a report that the service has not yet
+  // consumed, or if @p protobuf does not fit in the mapping.
+  // @param exception_info_address The address of an EXCEPTION_POINTERS
+  //     structure in the caller's address space. May be 0.
+  // @param thread_id The ID of the crashing thread.
+  // @param protobuf A custom data stream to include in the report.
+  // @param protobuf_length The length of @p protobuf.
+  // @returns true if the report was staged and the doorbell rung.
+  bool StageReport(uint64_t exception_info_address,
+                   uint32_t thread_id,
+                   const char* protobuf,
+                   size_t protobuf_length);
+
+  // The doorbell event, signaled by the client when a report has been staged.
+  // The service waits on this handle.
+  HANDLE doorbell() const { return doorbell_.Get(); }
+
+  // Reads the currently staged report, if any. The report data is not copied
+  // out of the shared mapping; it is only valid until ReleaseStagedReport()
+  // is called.
+  // @param report Receives the staged report.
+  // @returns true if a report was staged and is well-formed.
+  bool ReadStagedReport(StagedReport* report) const;
+
+  // Returns the staging area to the free state, allowing the next report to
+  // be staged.
+  void ReleaseStagedReport();
+
+ private:
+  CrashStagingArea(base::win::ScopedHandle mapping,
+                   base::win::ScopedHandle doorbell,
+                   void* view,
+                   size_t size);
+
+  // The shared file mapping backing the staging area.
+  base::win::ScopedHandle mapping_;
+  // The event rung by the client when a report has been staged.
+  base::win::ScopedHandle doorbell_;
+  // A mapped view of mapping_.
+  void* view_;
+  // The size, in bytes, of the mapped view.
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(CrashStagingArea);
+};
+
+}  // namespace kasko
+
+#endif  // SYZYGY_KASKO_CRASH_STAGING_AREA_H_
@@ -0,0 +1,87 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/kasko/crash_staging_area.h"
+
+#include <string>
+
+#include "base/strings/string_number_conversions.h"
+#include "gtest/gtest.h"
+
+namespace kasko {
+
+namespace {
+
+const size_t kTestStagingAreaSize = 4096;
+
+base::string16 GetTestStagingAreaName() {
+  return L"syzygy-kasko-test-staging-" +
+         base::UintToString16(::GetCurrentProcessId());
+}
+
+}  // namespace
+
+TEST(CrashStagingAreaTest, OpenFailsWithoutCreate) {
+  ASSERT_FALSE(CrashStagingArea::Open(GetTestStagingAreaName()).get());
+}
+
+TEST(CrashStagingAreaTest, StageAndReadRoundTrip) {
+  scoped_ptr<CrashStagingArea> service_end =
+      CrashStagingArea::Create(GetTestStagingAreaName(), kTestStagingAreaSize);
+  ASSERT_TRUE(service_end.get());
+
+  scoped_ptr<CrashStagingArea> client_end =
+      CrashStagingArea::Open(GetTestStagingAreaName());
+  ASSERT_TRUE(client_end.get());
+
+  // Nothing is staged yet.
+  CrashStagingArea::StagedReport report = {};
+  ASSERT_FALSE(service_end->ReadStagedReport(&report));
+  ASSERT_EQ(WAIT_TIMEOUT, ::WaitForSingleObject(service_end->doorbell(), 0));
+
+  std::string protobuf = "hello world";
+  ASSERT_TRUE(client_end->StageReport(
+      0xBAADF00D, 42, protobuf.data(), protobuf.length()));
+
+  // The doorbell has been rung and the staged report is readable.
+  ASSERT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(service_end->doorbell(), 0));
+  ASSERT_TRUE(service_end->ReadStagedReport(&report));
+  EXPECT_EQ(::GetCurrentProcessId(), report.client_process_id);
+  EXPECT_EQ(42u, report.thread_id);
+  EXPECT_EQ(0xBAADF00Du, report.exception_info_address);
+  EXPECT_EQ(protobuf, std::string(report.protobuf, report.protobuf_length));
+
+  // A second report may not be staged until the first is released.
+  ASSERT_FALSE(client_end->StageReport(0, 1, "x", 1));
+  service_end->ReleaseStagedReport();
+  ASSERT_FALSE(service_end->ReadStagedReport(&report));
+  ASSERT_TRUE(client_end->StageReport(0, 1, "x", 1));
+}
+
+TEST(CrashStagingAreaTest, RejectsOversizedReport) {
+  scoped_ptr<CrashStagingArea> service_end =
+      CrashStagingArea::Create(GetTestStagingAreaName(), kTestStagingAreaSize);
+  ASSERT_TRUE(service_end.get());
+
+  scoped_ptr<CrashStagingArea> client_end =
+      CrashStagingArea::Open(GetTestStagingAreaName());
+  ASSERT_TRUE(client_end.get());
+
+  std::string protobuf(kTestStagingAreaSize, 'x');
+  ASSERT_FALSE(client_end->StageReport(
+      0, 1, protobuf.data(), protobuf.length()));
+  ASSERT_EQ(WAIT_TIMEOUT, ::WaitForSingleObject(service_end->doorbell(), 0));
+}
+
+}  // namespace kasko
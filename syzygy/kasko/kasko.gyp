@@ -45,6 +45,8 @@
       'sources': [
         'crash_keys_serialization.cc',
         'crash_keys_serialization.h',
+        'crash_staging_area.cc',
+        'crash_staging_area.h',
         'http_agent.h',
         'http_agent_impl.cc',
         'http_agent_impl.h',
@@ -84,6 +86,7 @@
       'dependencies': [
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/common/rpc/rpc.gyp:common_rpc_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
         'kasko_rpc',
       ],
       'defines': [
@@ -140,6 +143,7 @@
       'sources': [
         '<(src)/base/test/run_all_unittests.cc',
         'crash_keys_serialization_unittest.cc',
+        'crash_staging_area_unittest.cc',
         'http_agent_impl_unittest.cc',
         'internet_helpers_unittest.cc',
         'internet_unittest_helpers.cc',
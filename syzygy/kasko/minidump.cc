@@ -16,19 +16,215 @@
 
 #include <Windows.h>  // NOLINT
 #include <DbgHelp.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
 
 #include "base/files/file.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/process/process_handle.h"
 #include "base/win/scoped_handle.h"
 
 #include "syzygy/common/com_utils.h"
+#include "syzygy/core/zstream.h"
 
 namespace kasko {
 
-bool GenerateMinidump(const base::FilePath& destination,
-                      base::ProcessId target_process_id,
-                      base::PlatformThreadId thread_id,
-                      unsigned long client_exception_pointers) {
+namespace {
+
+// The size of the staging buffer through which dump contents pass on their
+// way to the destination file when streaming. This bounds the memory overhead
+// of dump generation regardless of the size of the dump.
+const size_t kStagingBufferSize = 64 * 1024;
+
+// An OutStream that appends to a base::File. Serves as the sink for the
+// compressed dump byte stream.
+class FileOutStream : public core::OutStream {
+ public:
+  explicit FileOutStream(base::File* file) : file_(file) {
+    DCHECK(file != NULL);
+  }
+  ~FileOutStream() override { }
+
+  bool Write(size_t length, const core::Byte* bytes) override {
+    int written = file_->WriteAtCurrentPos(
+        reinterpret_cast<const char*>(bytes), static_cast<int>(length));
+    if (written < 0 || static_cast<size_t>(written) != length) {
+      LOG(ERROR) << "Failed to write to the destination file.";
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  base::File* file_;
+};
+
+// Receives the I/O callbacks issued by ::MiniDumpWriteDump and streams the
+// dump contents to the destination file through a fixed-size staging buffer,
+// optionally compressing them along the way.
+class MinidumpStreamer {
+ public:
+  MinidumpStreamer(base::File* destination, bool compress)
+      : destination_(destination),
+        compress_(compress),
+        file_stream_(destination),
+        buffer_(kStagingBufferSize),
+        buffer_used_(0),
+        position_(0) {
+    DCHECK(destination != NULL);
+  }
+
+  // Initializes the compressor, if one was requested. Must be called prior to
+  // handling any writes.
+  bool Init() {
+    if (!compress_)
+      return true;
+    zip_stream_.reset(new core::ZOutStream(&file_stream_));
+    if (!zip_stream_->Init()) {
+      LOG(ERROR) << "Failed to initialize the zlib compressor.";
+      return false;
+    }
+    return true;
+  }
+
+  // Handles an IoWriteAllCallback of @p size bytes at @p offset in the dump.
+  bool HandleWrite(uint64 offset, const void* buffer, size_t size) {
+    const uint8* data = reinterpret_cast<const uint8*>(buffer);
+
+    // Handle a write that is not contiguous with the bytes streamed so far.
+    // DbgHelp occasionally seeks backwards to fix up directory entries.
+    if (offset != position_ + buffer_used_) {
+      if (compress_) {
+        LOG(ERROR) << "Encountered a non-sequential write at offset " << offset
+                   << " while compressing; this cannot be compressed on the "
+                   << "fly.";
+        return false;
+      }
+      if (!FlushBuffer())
+        return false;
+      if (!WriteAt(offset, data, size))
+        return false;
+      position_ = offset + size;
+      return true;
+    }
+
+    // Append to the staging buffer, flushing it as it fills.
+    while (size > 0) {
+      size_t chunk = std::min(size, buffer_.size() - buffer_used_);
+      ::memcpy(&buffer_[buffer_used_], data, chunk);
+      buffer_used_ += chunk;
+      data += chunk;
+      size -= chunk;
+      if (buffer_used_ == buffer_.size() && !FlushBuffer())
+        return false;
+    }
+    return true;
+  }
+
+  // Flushes the staging buffer and finalizes the compressed stream. Must be
+  // called once all writes have been handled.
+  bool Finish() {
+    if (!FlushBuffer())
+      return false;
+    if (compress_ && !zip_stream_->Flush()) {
+      LOG(ERROR) << "Failed to finalize the compressed stream.";
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  // Drains the staging buffer to the destination.
+  bool FlushBuffer() {
+    if (buffer_used_ == 0)
+      return true;
+    if (compress_) {
+      if (!zip_stream_->Write(buffer_used_, &buffer_[0]))
+        return false;
+    } else {
+      if (!WriteAt(position_, &buffer_[0], buffer_used_))
+        return false;
+    }
+    position_ += buffer_used_;
+    buffer_used_ = 0;
+    return true;
+  }
+
+  // Writes @p size bytes at absolute file offset @p offset.
+  bool WriteAt(uint64 offset, const uint8* data, size_t size) {
+    int written = destination_->Write(static_cast<int64>(offset),
+                                      reinterpret_cast<const char*>(data),
+                                      static_cast<int>(size));
+    if (written < 0 || static_cast<size_t>(written) != size) {
+      LOG(ERROR) << "Failed to write to the destination file.";
+      return false;
+    }
+    return true;
+  }
+
+  // The file receiving the dump.
+  base::File* destination_;
+
+  // If true the dump contents are compressed on their way to the file.
+  bool compress_;
+
+  // Adapts destination_ to the OutStream interface for the compressor.
+  FileOutStream file_stream_;
+
+  // The compressor. Only initialized when compress_ is true.
+  scoped_ptr<core::ZOutStream> zip_stream_;
+
+  // The staging buffer, and the number of bytes currently accumulated in it.
+  std::vector<uint8> buffer_;
+  size_t buffer_used_;
+
+  // The offset in the dump at which the staging buffer starts.
+  uint64 position_;
+};
+
+// The callback routine handed to ::MiniDumpWriteDump. Routes the dump I/O to
+// the MinidumpStreamer passed via @p context.
+BOOL CALLBACK MinidumpWriteDumpCallback(
+    PVOID context,
+    const PMINIDUMP_CALLBACK_INPUT callback_input,
+    PMINIDUMP_CALLBACK_OUTPUT callback_output) {
+  MinidumpStreamer* streamer = reinterpret_cast<MinidumpStreamer*>(context);
+  DCHECK(streamer != NULL);
+
+  switch (callback_input->CallbackType) {
+    case IoStartCallback:
+      // Returning S_FALSE here informs DbgHelp that this callback takes
+      // responsibility for all of the dump I/O.
+      callback_output->Status = S_FALSE;
+      return TRUE;
+
+    case IoWriteAllCallback:
+      callback_output->Status =
+          streamer->HandleWrite(callback_input->Io.Offset,
+                                callback_input->Io.Buffer,
+                                callback_input->Io.BufferBytes) ? S_OK : E_FAIL;
+      return TRUE;
+
+    case IoFinishCallback:
+      callback_output->Status = S_OK;
+      return TRUE;
+
+    default:
+      return FALSE;
+  }
+}
+
+// Shared implementation of dump generation. If @p stream is false the dump is
+// written directly by DbgHelp; otherwise all I/O is routed through a
+// MinidumpStreamer, compressing if @p compress is true.
+bool GenerateMinidumpImpl(const base::FilePath& destination,
+                          base::ProcessId target_process_id,
+                          base::PlatformThreadId thread_id,
+                          unsigned long client_exception_pointers,
+                          bool stream,
+                          bool compress) {
   base::win::ScopedHandle target_process_handle(
       ::OpenProcess(GENERIC_ALL, FALSE, target_process_id));
   if (!target_process_handle) {
@@ -56,18 +252,57 @@ bool GenerateMinidump(const base::FilePath& destination,
     return false;
   }
 
-  if (::MiniDumpWriteDump(
-          target_process_handle, target_process_id,
-          destination_file.GetPlatformFile(),
-          static_cast<MINIDUMP_TYPE>(MiniDumpWithProcessThreadData |
-                                     MiniDumpWithUnloadedModules |
-                                     MiniDumpWithIndirectlyReferencedMemory),
-          dump_exception_pointers, NULL, NULL) == FALSE) {
+  MINIDUMP_TYPE dump_type =
+      static_cast<MINIDUMP_TYPE>(MiniDumpWithProcessThreadData |
+                                 MiniDumpWithUnloadedModules |
+                                 MiniDumpWithIndirectlyReferencedMemory);
+
+  if (!stream) {
+    if (::MiniDumpWriteDump(target_process_handle, target_process_id,
+                            destination_file.GetPlatformFile(), dump_type,
+                            dump_exception_pointers, NULL, NULL) == FALSE) {
+      LOG(ERROR) << "MiniDumpWriteDump failed: " << ::common::LogWe() << ".";
+      return false;
+    }
+    return true;
+  }
+
+  MinidumpStreamer streamer(&destination_file, compress);
+  if (!streamer.Init())
+    return false;
+
+  MINIDUMP_CALLBACK_INFORMATION callback_info = {};
+  callback_info.CallbackRoutine = &MinidumpWriteDumpCallback;
+  callback_info.CallbackParam = &streamer;
+
+  // No file handle is passed here; all of the I/O flows through the callback.
+  if (::MiniDumpWriteDump(target_process_handle, target_process_id, NULL,
+                          dump_type, dump_exception_pointers, NULL,
+                          &callback_info) == FALSE) {
     LOG(ERROR) << "MiniDumpWriteDump failed: " << ::common::LogWe() << ".";
     return false;
   }
 
-  return true;
+  return streamer.Finish();
+}
+
+}  // namespace
+
+bool GenerateMinidump(const base::FilePath& destination,
+                      base::ProcessId target_process_id,
+                      base::PlatformThreadId thread_id,
+                      unsigned long client_exception_pointers) {
+  return GenerateMinidumpImpl(destination, target_process_id, thread_id,
+                              client_exception_pointers, false, false);
+}
+
+bool GenerateStreamingMinidump(const base::FilePath& destination,
+                               base::ProcessId target_process_id,
+                               base::PlatformThreadId thread_id,
+                               unsigned long client_exception_pointers,
+                               bool compress) {
+  return GenerateMinidumpImpl(destination, target_process_id, thread_id,
+                              client_exception_pointers, true, compress);
 }
 
 }  // namespace kasko
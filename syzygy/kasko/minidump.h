@@ -37,6 +37,26 @@ bool GenerateMinidump(const base::FilePath& destination,
                       base::PlatformThreadId thread_id,
                       unsigned long client_exception_pointers);
 
+// Generates a minidump, streaming its contents to the destination through a
+// fixed-size staging buffer. This bounds the memory overhead of dump
+// generation independently of the size of the target process, and allows the
+// dump to optionally be compressed as it is produced.
+// @param destination The path where the dump should be generated.
+// @param target_process The ID of the process whose dump should be captured.
+// @param lient_exception_pointers The optional address of an EXCEPTION_POINTERS
+//     structure in the target process memory space.
+// @param thread_id The thread that threw the exception, or 0 in the absence of
+//     an exception.
+// @param compress If true the dump contents are zlib-compressed on the fly,
+//     and the destination will contain a zlib stream (decompressible with
+//     core::ZInStream) rather than a raw minidump.
+// @returns true if the operation is successful.
+bool GenerateStreamingMinidump(const base::FilePath& destination,
+                               base::ProcessId target_process,
+                               base::PlatformThreadId thread_id,
+                               unsigned long client_exception_pointers,
+                               bool compress);
+
 }  // namespace kasko
 
 #endif  // SYZYGY_KASKO_MINIDUMP_H_
@@ -17,11 +17,14 @@
 #include <Windows.h>  // NOLINT
 #include <Dbgeng.h>
 
+#include <vector>
+
 #include "base/bind.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/files/scoped_temp_dir.h"
 #include "gtest/gtest.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/kasko/testing/minidump_unittest_helpers.h"
 
 namespace kasko {
@@ -35,6 +38,29 @@ void ValidateMinidump(IDebugClient4* debug_client,
       debug_symbols->GetModuleByModuleName("kasko_unittests", 0, NULL, NULL));
 }
 
+// Decompresses the zlib stream at |compressed_path| into |decompressed_path|.
+void DecompressFile(const base::FilePath& compressed_path,
+                    const base::FilePath& decompressed_path) {
+  base::ScopedFILE in(base::OpenFile(compressed_path, "rb"));
+  ASSERT_TRUE(in.get() != NULL);
+  base::ScopedFILE out(base::OpenFile(decompressed_path, "wb"));
+  ASSERT_TRUE(out.get() != NULL);
+
+  core::FileInStream in_stream(in.get());
+  core::FileOutStream out_stream(out.get());
+  core::ZInStream zip_stream(&in_stream);
+  ASSERT_TRUE(zip_stream.Init());
+
+  std::vector<uint8> buffer(64 * 1024);
+  while (true) {
+    size_t bytes_read = 0;
+    ASSERT_TRUE(zip_stream.Read(buffer.size(), &buffer[0], &bytes_read));
+    if (bytes_read == 0)
+      break;
+    ASSERT_TRUE(out_stream.Write(bytes_read, &buffer[0]));
+  }
+}
+
 }  // namespace
 
 TEST(MinidumpTest, GenerateAndLoad) {
@@ -60,4 +86,40 @@ TEST(MinidumpTest, OverwriteExistingFile) {
       testing::VisitMinidump(dump_file_path, base::Bind(&ValidateMinidump)));
 }
 
+TEST(MinidumpTest, GenerateStreamingAndLoad) {
+  // Generate a streamed minidump for the current process.
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath dump_file_path = temp_dir.path().Append(L"test.dump");
+  ASSERT_TRUE(kasko::GenerateStreamingMinidump(
+      dump_file_path, ::GetCurrentProcessId(), 0, NULL, false));
+
+  ASSERT_HRESULT_SUCCEEDED(
+      testing::VisitMinidump(dump_file_path, base::Bind(&ValidateMinidump)));
+}
+
+TEST(MinidumpTest, GenerateCompressedAndLoad) {
+  // Generate a compressed minidump for the current process.
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath compressed_file_path =
+      temp_dir.path().Append(L"test.dump.z");
+  ASSERT_TRUE(kasko::GenerateStreamingMinidump(
+      compressed_file_path, ::GetCurrentProcessId(), 0, NULL, true));
+
+  // The decompressed contents should form a valid minidump.
+  base::FilePath dump_file_path = temp_dir.path().Append(L"test.dump");
+  ASSERT_NO_FATAL_FAILURE(
+      DecompressFile(compressed_file_path, dump_file_path));
+  ASSERT_HRESULT_SUCCEEDED(
+      testing::VisitMinidump(dump_file_path, base::Bind(&ValidateMinidump)));
+
+  // Compression should have bought us something.
+  int64 compressed_size = 0;
+  int64 dump_size = 0;
+  ASSERT_TRUE(base::GetFileSize(compressed_file_path, &compressed_size));
+  ASSERT_TRUE(base::GetFileSize(dump_file_path, &dump_size));
+  EXPECT_LT(compressed_size, dump_size);
+}
+
 }  // namespace kasko
@@ -51,9 +51,18 @@
 
 #include "syzygy/kasko/report_repository.h"
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "base/bind.h"
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/files/file_enumerator.h"
+#include "base/memory/scoped_vector.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/kasko/crash_keys_serialization.h"
 
 namespace kasko {
@@ -155,20 +164,24 @@ base::FilePath GetDumpFileForCrashKeysFile(
   return crash_keys_path.ReplaceExtension(kDumpFileExtension);
 }
 
-// Returns a minidump that is eligible for upload from the given directory, if
-// any are.
+// Collects minidumps that are eligible for upload from the given directory.
 // @param directory The directory to scan.
 // @param maximum_timestamp_for_retries The cutoff for the most most recent
 //     upload attempt of eligible minidumps. If null, there is no cutoff.
-// @returns The path to a minidump that is eligible for upload, if any.
-base::FilePath GetPendingReportFromDirectory(
+// @param max_reports The maximum size to which @p reports may grow.
+// @param reports Receives the paths of eligible minidumps.
+void GetPendingReportsFromDirectory(
     const base::FilePath& directory,
-    const base::Time& maximum_timestamp_for_retries) {
+    const base::Time& maximum_timestamp_for_retries,
+    size_t max_reports,
+    std::vector<base::FilePath>* reports) {
+  DCHECK(reports);
   base::FileEnumerator file_enumerator(
       directory, false, base::FileEnumerator::FILES,
       base::string16(L"*") + kDumpFileExtension);
-  // Visit all files in this directory until we find an eligible one.
-  for (base::FilePath candidate = file_enumerator.Next(); !candidate.empty();
+  // Visit all files in this directory until we have enough eligible ones.
+  for (base::FilePath candidate = file_enumerator.Next();
+       !candidate.empty() && reports->size() < max_reports;
        candidate = file_enumerator.Next()) {
     // Skip dumps with missing crash keys.
     if (!base::PathExists(GetCrashKeysFileForDumpFile(candidate))) {
@@ -177,15 +190,16 @@ base::FilePath GetPendingReportFromDirectory(
       LoggedDeleteFile(candidate);
       continue;
     }
-    if (maximum_timestamp_for_retries.is_null())
-      return candidate;
+    if (maximum_timestamp_for_retries.is_null()) {
+      reports->push_back(candidate);
+      continue;
+    }
 
     // Check if this file is eligible for retry.
     base::FileEnumerator::FileInfo file_info = file_enumerator.GetInfo();
     if (file_info.GetLastModifiedTime() <= maximum_timestamp_for_retries)
-      return candidate;
+      reports->push_back(candidate);
   }
-  return base::FilePath();
 }
 
 void CleanOrphanedCrashKeysFiles(
@@ -217,17 +231,21 @@ void CleanOrphanedCrashKeysFiles(
   }
 }
 
-// Returns a minidump that is eligible for upload, if any are.
+// Collects minidumps that are eligible for upload, if any are.
 // @param repository_path The directory where this repository stores reports.
 // @param now The current time.
 // @param retry_interval The minimum interval between upload attempts for a
 //     given report.
-// @returns A pair of mindump path (empty if none) and failure destination
+// @param max_reports The maximum number of reports to collect.
+// @param reports Receives pairs of minidump path and failure destination
 //     (empty if the next failure is permanent).
-std::pair<base::FilePath, base::FilePath> GetPendingReport(
+void GetPendingReports(
     const base::FilePath& repository_path,
     const base::Time& now,
-    const base::TimeDelta& retry_interval) {
+    const base::TimeDelta& retry_interval,
+    size_t max_reports,
+    std::vector<std::pair<base::FilePath, base::FilePath>>* reports) {
+  DCHECK(reports);
   struct {
     const base::char16* subdir;
     const base::char16* failure_subdir;
@@ -237,18 +255,39 @@ std::pair<base::FilePath, base::FilePath> GetPendingReport(
       {kFailedOnceSubdir, kFailedTwiceSubdir, now - retry_interval},
       {kFailedTwiceSubdir, nullptr, now - retry_interval}};
 
-  for (size_t i = 0; i < arraysize(directories); ++i) {
-    base::FilePath result = GetPendingReportFromDirectory(
+  for (size_t i = 0;
+       i < arraysize(directories) && reports->size() < max_reports; ++i) {
+    std::vector<base::FilePath> minidumps;
+    GetPendingReportsFromDirectory(
         repository_path.Append(directories[i].subdir),
-        directories[i].retry_cutoff);
-    if (result.empty())
-      continue;
-    if (!directories[i].failure_subdir)
-      return std::make_pair(result, base::FilePath());
-    return std::make_pair(
-        result, repository_path.Append(directories[i].failure_subdir));
+        directories[i].retry_cutoff, max_reports - reports->size(),
+        &minidumps);
+    base::FilePath failure_destination;
+    if (directories[i].failure_subdir) {
+      failure_destination =
+          repository_path.Append(directories[i].failure_subdir);
+    }
+    for (size_t j = 0; j < minidumps.size(); ++j)
+      reports->push_back(std::make_pair(minidumps[j], failure_destination));
   }
-  return std::pair<base::FilePath, base::FilePath>();
+}
+
+// Returns a minidump that is eligible for upload, if any are.
+// @param repository_path The directory where this repository stores reports.
+// @param now The current time.
+// @param retry_interval The minimum interval between upload attempts for a
+//     given report.
+// @returns A pair of mindump path (empty if none) and failure destination
+//     (empty if the next failure is permanent).
+std::pair<base::FilePath, base::FilePath> GetPendingReport(
+    const base::FilePath& repository_path,
+    const base::Time& now,
+    const base::TimeDelta& retry_interval) {
+  std::vector<std::pair<base::FilePath, base::FilePath>> reports;
+  GetPendingReports(repository_path, now, retry_interval, 1, &reports);
+  if (reports.empty())
+    return std::pair<base::FilePath, base::FilePath>();
+  return reports[0];
 }
 
 // Handles a non-permanent failure by moving the report files to a new queue.
@@ -295,6 +334,122 @@ void HandlePermanentFailure(const base::FilePath& minidump_path,
     LoggedDeleteFile(crash_keys_path);
 }
 
+// Renews the file timestamps of a report before an upload attempt. If the
+// timestamps cannot be renewed the report files are deleted, since attempting
+// an upload anyway would potentially lead to a hot loop of upload attempts.
+// @param minidump_path The path to the minidump file.
+// @param now The current time.
+// @returns true if the operation succeeds.
+bool RenewReportTimestamps(const base::FilePath& minidump_path,
+                           const base::Time& now) {
+  ScopedReportFile minidump_file(minidump_path);
+  ScopedReportFile crash_keys_file(GetCrashKeysFileForDumpFile(minidump_path));
+
+  if (!minidump_file.UpdateTimestamp(now))
+    return false;
+  if (!crash_keys_file.UpdateTimestamp(now))
+    return false;
+
+  // Prevent the files from being deleted.
+  minidump_file.Take();
+  crash_keys_file.Take();
+  return true;
+}
+
+// Uploads a batch of located reports using a bounded pool of worker threads,
+// optionally throttling the rate at which report bytes are handed to the
+// upload callback.
+class UploadWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  // Receives a minidump path and a failure destination, and returns true if
+  // the report was successfully uploaded.
+  typedef base::Callback<bool(const base::FilePath&, const base::FilePath&)>
+      UploadCallback;
+
+  // @param reports The batch of reports (minidump path and failure
+  //     destination) to upload.
+  // @param upload_callback Invoked once per report, possibly concurrently.
+  // @param max_bytes_per_second An approximate cap on the aggregate rate at
+  //     which report bytes are handed to @p upload_callback, or 0 for no
+  //     throttling.
+  UploadWorker(
+      const std::vector<std::pair<base::FilePath, base::FilePath>>& reports,
+      const UploadCallback& upload_callback,
+      size_t max_bytes_per_second)
+      : reports_(reports),
+        upload_callback_(upload_callback),
+        max_bytes_per_second_(max_bytes_per_second),
+        start_ticks_(base::TimeTicks::Now()),
+        next_report_(0),
+        bytes_dispatched_(0),
+        successes_(0) {}
+
+  ~UploadWorker() override {}
+
+  // base::DelegateSimpleThread::Delegate implementation. May run concurrently
+  // on several threads; each invocation draws reports from the shared batch
+  // until it is exhausted.
+  void Run() override {
+    while (true) {
+      size_t index = 0;
+      {
+        base::AutoLock auto_lock(lock_);
+        if (next_report_ == reports_.size())
+          return;
+        index = next_report_++;
+      }
+      Throttle(reports_[index].first);
+      if (upload_callback_.Run(reports_[index].first,
+                               reports_[index].second)) {
+        base::AutoLock auto_lock(lock_);
+        ++successes_;
+      }
+    }
+  }
+
+  // @returns the number of successfully uploaded reports.
+  size_t successes() {
+    base::AutoLock auto_lock(lock_);
+    return successes_;
+  }
+
+ private:
+  // Sleeps until dispatching the report at @p minidump_path keeps the
+  // aggregate dispatch rate under max_bytes_per_second_.
+  void Throttle(const base::FilePath& minidump_path) {
+    if (max_bytes_per_second_ == 0)
+      return;
+    int64 file_size = 0;
+    if (!base::GetFileSize(minidump_path, &file_size))
+      return;
+
+    base::TimeDelta earliest_start;
+    {
+      base::AutoLock auto_lock(lock_);
+      earliest_start = base::TimeDelta::FromSecondsD(
+          static_cast<double>(bytes_dispatched_) / max_bytes_per_second_);
+      bytes_dispatched_ += file_size;
+    }
+
+    base::TimeDelta elapsed = base::TimeTicks::Now() - start_ticks_;
+    if (earliest_start > elapsed)
+      base::PlatformThread::Sleep(earliest_start - elapsed);
+  }
+
+  const std::vector<std::pair<base::FilePath, base::FilePath>>& reports_;
+  UploadCallback upload_callback_;
+  size_t max_bytes_per_second_;
+  base::TimeTicks start_ticks_;
+
+  // Protects the fields below.
+  base::Lock lock_;
+  size_t next_report_;
+  int64 bytes_dispatched_;
+  size_t successes_;
+
+  DISALLOW_COPY_AND_ASSIGN(UploadWorker);
+};
+
 }  // namespace
 
 ReportRepository::ReportRepository(
@@ -358,23 +513,72 @@ bool ReportRepository::UploadPendingReport() {
 
   std::pair<base::FilePath, base::FilePath> entry =
       GetPendingReport(repository_path_, now, retry_interval_);
-  ScopedReportFile minidump_file(entry.first);
-  base::FilePath failure_destination = entry.second;
 
-  if (minidump_file.Get().empty())
+  if (entry.first.empty())
     return true;  // Successful no-op.
 
-  ScopedReportFile crash_keys_file(
-      GetCrashKeysFileForDumpFile(minidump_file.Get()));
-
-  // Renew the file timestamps before attempting upload. If we are unable to do
-  // this, make no upload attempt (since that would potentially lead to a hot
-  // loop of upload attempts).
-  if (!minidump_file.UpdateTimestamp(now))
-    return false;
-  if (!crash_keys_file.UpdateTimestamp(now))
+  // Renew the file timestamps before attempting upload. If we are unable to
+  // do this, make no upload attempt.
+  if (!RenewReportTimestamps(entry.first, now))
     return false;
 
+  return UploadLocatedReport(entry.first, entry.second);
+}
+
+size_t ReportRepository::UploadPendingReports(size_t max_reports,
+                                              size_t max_concurrency,
+                                              size_t max_bytes_per_second) {
+  DCHECK_LT(0u, max_concurrency);
+
+  base::Time now = time_source_.Run();
+
+  // Do a bit of opportunistic cleanup.
+  CleanOrphanedCrashKeysFiles(repository_path_, now);
+
+  std::vector<std::pair<base::FilePath, base::FilePath>> reports;
+  GetPendingReports(repository_path_, now, retry_interval_, max_reports,
+                    &reports);
+
+  // Renew the file timestamps before attempting the uploads. Reports whose
+  // timestamps cannot be renewed are dropped from the batch.
+  std::vector<std::pair<base::FilePath, base::FilePath>> batch;
+  for (size_t i = 0; i < reports.size(); ++i) {
+    if (RenewReportTimestamps(reports[i].first, now))
+      batch.push_back(reports[i]);
+  }
+
+  if (batch.empty())
+    return 0;
+
+  UploadWorker worker(
+      batch, base::Bind(&ReportRepository::UploadLocatedReport,
+                        base::Unretained(this)),
+      max_bytes_per_second);
+
+  size_t thread_count = std::min(max_concurrency, batch.size());
+  if (thread_count == 1) {
+    // No point in spinning up a pool for a single uploader.
+    worker.Run();
+  } else {
+    ScopedVector<base::DelegateSimpleThread> threads;
+    for (size_t i = 0; i < thread_count; ++i) {
+      threads.push_back(
+          new base::DelegateSimpleThread(&worker, "kasko_upload_worker"));
+      threads.back()->Start();
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Join();
+  }
+
+  return worker.successes();
+}
+
+bool ReportRepository::UploadLocatedReport(
+    const base::FilePath& minidump_path,
+    const base::FilePath& failure_destination) {
+  ScopedReportFile minidump_file(minidump_path);
+  ScopedReportFile crash_keys_file(GetCrashKeysFileForDumpFile(minidump_path));
+
   // Attempt the upload.
   std::map<base::string16, base::string16> crash_keys;
   if (ReadCrashKeysFromFile(crash_keys_file.Get(), &crash_keys)) {
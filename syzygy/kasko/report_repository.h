@@ -81,10 +81,39 @@ class ReportRepository {
   //     uploaded.
   bool UploadPendingReport();
 
+  // Attempts to upload a batch of pending reports. The repository is scanned
+  // once per invocation, so a large backlog drains in batches rather than at
+  // one directory scan per report. When @p max_concurrency exceeds 1 the
+  // uploads are performed by a pool of worker threads; the uploader and the
+  // permanent failure handler may then be invoked concurrently and must be
+  // thread-safe.
+  // @param max_reports The maximum number of reports to submit to an upload
+  //     attempt.
+  // @param max_concurrency The maximum number of simultaneous upload attempts.
+  //     Must be at least 1.
+  // @param max_bytes_per_second An approximate cap on the aggregate rate at
+  //     which report bytes (measured by minidump file size) are handed to the
+  //     uploader, or 0 for no throttling.
+  // @returns the number of reports that were successfully uploaded.
+  size_t UploadPendingReports(size_t max_reports,
+                              size_t max_concurrency,
+                              size_t max_bytes_per_second);
+
   // @returns true if UploadPendingReport would attempt to upload a report.
   bool HasPendingReports();
 
  private:
+  // Attempts to upload a report that has already been located (and had its
+  // file timestamps renewed). Handles a failed upload by advancing the report
+  // to the next retry queue or invoking the permanent failure handler. May be
+  // invoked concurrently by UploadPendingReports worker threads.
+  // @param minidump_path The path to the minidump file.
+  // @param failure_destination The directory the report files should be moved
+  //     to if the upload fails, or empty if the next failure is permanent.
+  // @returns true if the upload succeeds.
+  bool UploadLocatedReport(const base::FilePath& minidump_path,
+                           const base::FilePath& failure_destination);
+
   base::FilePath repository_path_;
   base::TimeDelta retry_interval_;
   TimeSource time_source_;
@@ -29,6 +29,7 @@
 #include "base/strings/string16.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/lock.h"
 #include "base/time/time.h"
 #include "gtest/gtest.h"
 #include "syzygy/kasko/crash_keys_serialization.h"
@@ -280,6 +281,24 @@ const uint16_t ReportRepositoryTest::kHalfRetryIntervalInSeconds = 10;
 const uint16_t ReportRepositoryTest::kRetryIntervalInSeconds =
     ReportRepositoryTest::kHalfRetryIntervalInSeconds * 2;
 
+// A thread-safe Uploader that counts its invocations and always succeeds.
+bool CountingUploader(base::Lock* lock,
+                      size_t* upload_count,
+                      const base::FilePath& minidump_path,
+                      const std::map<base::string16, base::string16>&
+                          crash_keys) {
+  base::AutoLock auto_lock(*lock);
+  ++*upload_count;
+  return true;
+}
+
+// A PermanentFailureHandler that is not expected to be invoked.
+void UnexpectedPermanentFailureHandler(const base::FilePath& minidump_path,
+                                       const base::FilePath& crash_keys_path) {
+  ADD_FAILURE() << "Unexpected permanent failure for "
+                << minidump_path.value();
+}
+
 }  // namespace
 
 TEST_F(ReportRepositoryTest, BasicTest) {
@@ -477,6 +496,72 @@ TEST_F(ReportRepositoryTest, MultipleInterleavedReports) {
   EXPECT_FALSE(repository()->HasPendingReports());
 }
 
+TEST_F(ReportRepositoryTest, BatchUploadTest) {
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(1);
+
+  // A single invocation drains the whole backlog.
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_EQ(2u, repository()->UploadPendingReports(10, 1, 0));
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  // The failed report becomes eligible again after the retry interval.
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_EQ(1u, repository()->UploadPendingReports(10, 1, 0));
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  EXPECT_EQ(0u, repository()->UploadPendingReports(10, 1, 0));  // No-op
+}
+
+TEST_F(ReportRepositoryTest, BatchUploadRespectsMaxReports) {
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+
+  EXPECT_EQ(2u, repository()->UploadPendingReports(2, 1, 0));
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_EQ(1u, repository()->UploadPendingReports(2, 1, 0));
+  EXPECT_FALSE(repository()->HasPendingReports());
+}
+
+TEST(ReportRepositoryParallelUploadTest, DrainsBacklogConcurrently) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  base::Lock lock;
+  size_t upload_count = 0;
+  ReportRepository repository(
+      temp_dir.path(), base::TimeDelta::FromSeconds(1),
+      base::Bind(&base::Time::Now),
+      base::Bind(&CountingUploader, &lock, &upload_count),
+      base::Bind(&UnexpectedPermanentFailureHandler));
+
+  for (size_t i = 0; i < 8; ++i) {
+    base::FilePath minidump_file;
+    ASSERT_TRUE(
+        base::CreateTemporaryFileInDir(temp_dir.path(), &minidump_file));
+    std::string contents = base::UintToString(i);
+    ASSERT_TRUE(
+        base::WriteFile(minidump_file, contents.data(), contents.length()));
+    std::map<base::string16, base::string16> crash_keys;
+    crash_keys[L"id"] = base::ASCIIToUTF16(contents);
+    repository.StoreReport(minidump_file, crash_keys);
+  }
+
+  // The throttle rate is generous enough that these tiny reports should not
+  // actually be delayed.
+  EXPECT_EQ(8u, repository.UploadPendingReports(8, 4, 1024 * 1024));
+  {
+    base::AutoLock auto_lock(lock);
+    EXPECT_EQ(8u, upload_count);
+  }
+  EXPECT_FALSE(repository.HasPendingReports());
+}
+
 TEST_F(ReportRepositoryTest, CorruptionTest) {
   // In order to avoid hard-coding extensions/paths, and having a bunch of
   // permutations, let's run this test a bunch of times and probabilistically
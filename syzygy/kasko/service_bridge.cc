@@ -15,14 +15,22 @@
 #include "syzygy/kasko/service_bridge.h"
 
 #include "base/logging.h"
+#include "base/macros.h"
 #include "base/process/process_handle.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/rpc/helpers.h"
+#include "syzygy/kasko/crash_staging_area.h"
 #include "syzygy/kasko/service.h"
 
 namespace kasko {
 namespace {
+
 ServiceBridge* g_service_bridge = NULL;
+
+// The size of the shared-memory crash staging area, which bounds the length
+// of a staged custom data stream.
+const size_t kStagingAreaSize = 64 * 1024;
+
 }  // namespace
 }  // namespace kasko
 
@@ -56,6 +64,39 @@ boolean KaskoService_SendDiagnosticReport(handle_t IDL_handle,
 
 namespace kasko {
 
+base::string16 GetStagingAreaName(const base::string16& endpoint) {
+  return L"kasko-staging-" + endpoint;
+}
+
+ServiceBridge::StagingWatchThread::StagingWatchThread(ServiceBridge* owner)
+    : base::SimpleThread("Kasko staging watch thread"), owner_(owner) {
+}
+
+ServiceBridge::StagingWatchThread::~StagingWatchThread() {}
+
+void ServiceBridge::StagingWatchThread::Run() {
+  HANDLE handles[] = {owner_->staging_stop_event_.Get(),
+                      owner_->staging_area_->doorbell()};
+  while (true) {
+    DWORD result = ::WaitForMultipleObjects(arraysize(handles), handles,
+                                            FALSE, INFINITE);
+    if (result != WAIT_OBJECT_0 + 1) {
+      LOG_IF(ERROR, result != WAIT_OBJECT_0)
+          << "Unexpected failure waiting on the staging area doorbell: "
+          << ::common::LogWe() << ".";
+      return;
+    }
+
+    CrashStagingArea::StagedReport report = {};
+    if (owner_->staging_area_->ReadStagedReport(&report)) {
+      owner_->service_->SendDiagnosticReport(
+          report.client_process_id, report.exception_info_address,
+          report.thread_id, report.protobuf, report.protobuf_length);
+      owner_->staging_area_->ReleaseStagedReport();
+    }
+  }
+}
+
 ServiceBridge::ServiceBridge(const base::string16& protocol,
                              const base::string16& endpoint,
                              scoped_ptr<Service> service)
@@ -109,6 +150,7 @@ bool ServiceBridge::Run() {
       } else {
         running_ = true;
         interface_registration_ = interface_registration.Pass();
+        StartStagingWatch();
       }
     }
   }
@@ -119,6 +161,10 @@ bool ServiceBridge::Run() {
 void ServiceBridge::Stop() {
   if (!running_) return;
 
+  // Stop forwarding staged reports. This blocks until a staged report that is
+  // currently being forwarded (if any) has been handled.
+  StopStagingWatch();
+
   // This call prevents new requests from being accepted.
   RPC_STATUS status = ::RpcMgmtStopServerListening(NULL);
   if (status != RPC_S_OK) {
@@ -139,4 +185,39 @@ void ServiceBridge::Stop() {
   running_ = false;
 }
 
+void ServiceBridge::StartStagingWatch() {
+  DCHECK(!staging_watch_thread_);
+
+  base::win::ScopedHandle stop_event(::CreateEvent(NULL, TRUE, FALSE, NULL));
+  if (!stop_event.IsValid()) {
+    LOG(WARNING) << "Failed to create the staging watch stop event: "
+                 << ::common::LogWe() << ". "
+                 << "Reports will only be accepted via RPC.";
+    return;
+  }
+
+  scoped_ptr<CrashStagingArea> staging_area = CrashStagingArea::Create(
+      GetStagingAreaName(endpoint_), kStagingAreaSize);
+  if (!staging_area) {
+    LOG(WARNING) << "Failed to create the crash staging area. "
+                 << "Reports will only be accepted via RPC.";
+    return;
+  }
+
+  staging_stop_event_ = stop_event.Pass();
+  staging_area_ = staging_area.Pass();
+  staging_watch_thread_.reset(new StagingWatchThread(this));
+  staging_watch_thread_->Start();
+}
+
+void ServiceBridge::StopStagingWatch() {
+  if (staging_watch_thread_) {
+    ::SetEvent(staging_stop_event_.Get());
+    staging_watch_thread_->Join();
+    staging_watch_thread_.reset();
+  }
+  staging_area_.reset();
+  staging_stop_event_.Close();
+}
+
 }  // namespace kasko
@@ -21,6 +21,8 @@
 #include "base/macros.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string16.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_handle.h"
 
 #include "syzygy/kasko/kasko_rpc.h"
 
@@ -34,11 +36,22 @@ class ScopedRpcInterfaceRegistration;
 
 namespace kasko {
 
+class CrashStagingArea;
 class Service;
 
+// Returns the name of the shared-memory crash staging area associated with
+// the service listening on |endpoint|. Clients open the staging area with
+// CrashStagingArea::Open, using this name.
+base::string16 GetStagingAreaName(const base::string16& endpoint);
+
 // Establishes an RPC service that forwards requests for the Kasko interface to
 // a Service implementation. The Service will be invoked on a worker thread.
 //
+// A shared-memory crash staging area is established alongside the RPC
+// endpoint (see CrashStagingArea). Reports staged there by clients are
+// forwarded to the Service from a background thread that waits on the
+// staging area doorbell, without any RPC marshaling.
+//
 // Only a single instance of this class may exist at a time in a given process.
 class ServiceBridge {
  public:
@@ -68,10 +81,37 @@ class ServiceBridge {
       unsigned long protobuf_length,
       const signed char* protobuf);
 
+  // Waits on the staging area doorbell and forwards staged reports to the
+  // Service.
+  class StagingWatchThread : public base::SimpleThread {
+   public:
+    explicit StagingWatchThread(ServiceBridge* owner);
+    ~StagingWatchThread() override;
+
+    // base::SimpleThread implementation.
+    void Run() override;
+
+   private:
+    ServiceBridge* owner_;
+
+    DISALLOW_COPY_AND_ASSIGN(StagingWatchThread);
+  };
+
+  // Creates the staging area and starts the watch thread. Failure is not
+  // fatal; the RPC transport remains available.
+  void StartStagingWatch();
+
+  // Stops the watch thread and tears down the staging area.
+  void StopStagingWatch();
+
   scoped_ptr<common::rpc::ScopedRpcInterfaceRegistration>
       interface_registration_;
   scoped_ptr<Service> service_;
 
+  scoped_ptr<CrashStagingArea> staging_area_;
+  scoped_ptr<StagingWatchThread> staging_watch_thread_;
+  base::win::ScopedHandle staging_stop_event_;
+
   base::string16 protocol_;
   base::string16 endpoint_;
   bool running_;
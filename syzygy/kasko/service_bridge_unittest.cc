@@ -32,6 +32,7 @@
 #include "base/threading/thread.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/rpc/helpers.h"
+#include "syzygy/kasko/crash_staging_area.h"
 #include "syzygy/kasko/kasko_rpc.h"
 #include "syzygy/kasko/service.h"
 
@@ -53,7 +54,9 @@ class MockService : public Service {
     const std::string protobuf;
   };
 
-  explicit MockService(std::vector<CallRecord>* call_log);
+  // If @p call_logged is non-NULL it is signaled after each recorded call.
+  explicit MockService(std::vector<CallRecord>* call_log,
+                       base::WaitableEvent* call_logged = NULL);
   virtual ~MockService();
 
   // Service implementation
@@ -65,11 +68,13 @@ class MockService : public Service {
 
  private:
   std::vector<CallRecord>* call_log_;
+  base::WaitableEvent* call_logged_;
   DISALLOW_COPY_AND_ASSIGN(MockService);
 };
 
-MockService::MockService(std::vector<CallRecord>* call_log)
-    : call_log_(call_log) {}
+MockService::MockService(std::vector<CallRecord>* call_log,
+                         base::WaitableEvent* call_logged)
+    : call_log_(call_log), call_logged_(call_logged) {}
 
 MockService::~MockService() {}
 
@@ -81,6 +86,8 @@ void MockService::SendDiagnosticReport(base::ProcessId client_process_id,
   CallRecord record = {client_process_id,
                        std::string(protobuf, protobuf_length)};
   call_log_->push_back(record);
+  if (call_logged_)
+    call_logged_->Signal();
 }
 
 class BlockingService : public Service {
@@ -217,6 +224,44 @@ TEST(KaskoServiceBridgeTest, InvokeService) {
 }
 
 
+TEST(KaskoServiceBridgeTest, InvokeServiceViaStagingArea) {
+  std::vector<MockService::CallRecord> call_log;
+  base::WaitableEvent call_logged(false, false);
+
+  base::string16 protocol = kValidRpcProtocol;
+  base::string16 endpoint = GetTestEndpoint();
+  ServiceBridge instance(
+      protocol, endpoint,
+      scoped_ptr<Service>(new MockService(&call_log, &call_logged)));
+  ASSERT_TRUE(instance.Run());
+
+  base::ScopedClosureRunner stop_service_bridge(
+      base::Bind(&ServiceBridge::Stop, base::Unretained(&instance)));
+
+  scoped_ptr<CrashStagingArea> client_end =
+      CrashStagingArea::Open(GetStagingAreaName(endpoint));
+  ASSERT_TRUE(client_end.get());
+
+  std::string protobuf = "hello world";
+  ASSERT_TRUE(client_end->StageReport(0, ::GetCurrentThreadId(),
+                                      protobuf.data(), protobuf.length()));
+
+  // The staged report is forwarded asynchronously by the watch thread.
+  call_logged.Wait();
+  ASSERT_EQ(1u, call_log.size());
+  ASSERT_EQ(::GetCurrentProcessId(), call_log[0].client_process_id);
+  ASSERT_EQ(protobuf, call_log[0].protobuf);
+
+  // The staging area becomes free again once the service has released the
+  // consumed report.
+  while (!client_end->StageReport(0, ::GetCurrentThreadId(), protobuf.data(),
+                                  protobuf.length())) {
+    ::Sleep(10);
+  }
+  call_logged.Wait();
+  ASSERT_EQ(2u, call_log.size());
+}
+
 TEST(KaskoServiceBridgeTest, StopBlocksUntilCallsComplete) {
   base::WaitableEvent release_call(false, false);
   base::WaitableEvent blocking(false, false);
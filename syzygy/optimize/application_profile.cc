@@ -17,6 +17,7 @@
 #include <map>
 #include <queue>
 
+#include "base/file_util.h"
 #include "syzygy/grinder/basic_block_util.h"
 
 namespace optimize {
@@ -43,6 +44,10 @@ const size_t kEntryCountColumn = 0;
 const size_t kBranchTakenColumn = 1;
 const size_t kMissPredColumn = 2;
 
+// The version of the profile cache file format. Bump this whenever the
+// serialized contents change; old cache files are simply rejected.
+const uint32 kProfileCacheVersion = 1;
+
 // Compare two profiles. Used by STL containers.
 struct BlockProfileCompare {
   bool operator()(const BlockProfile* a, const BlockProfile* b) const {
@@ -100,13 +105,37 @@ ApplicationProfile::ApplicationProfile(const ImageLayout* image_layout)
 
 const BlockProfile* ApplicationProfile::GetBlockProfile(
     const BlockGraph::Block* block) const {
-  ProfileMap::const_iterator it = profiles_.find(block->id());
-  if (it != profiles_.end())
-    return &it->second;
+  // The direct index is empty until the profiles are computed (or loaded);
+  // fall back on the profile map in that case.
+  if (profiles_by_id_.empty()) {
+    ProfileMap::const_iterator it = profiles_.find(block->id());
+    if (it != profiles_.end())
+      return &it->second;
+    return empty_profile_.get();
+  }
+
+  if (block->id() < profiles_by_id_.size()) {
+    const BlockProfile* profile = profiles_by_id_[block->id()];
+    if (profile != NULL)
+      return profile;
+  }
 
   return empty_profile_.get();
 }
 
+void ApplicationProfile::RebuildProfileIndex() {
+  profiles_by_id_.clear();
+  if (profiles_.empty())
+    return;
+
+  // The map is ordered by block id, so the last entry holds the largest id.
+  BlockGraph::BlockId max_id = profiles_.rbegin()->first;
+  profiles_by_id_.resize(max_id + 1);
+  ProfileMap::const_iterator it = profiles_.begin();
+  for (; it != profiles_.end(); ++it)
+    profiles_by_id_[it->first] = &it->second;
+}
+
 bool ApplicationProfile::ComputeGlobalProfile() {
   DCHECK_NE(reinterpret_cast<const ImageLayout*>(NULL), image_layout_);
   const BlockGraph* graph = image_layout_->blocks.graph();
@@ -186,6 +215,79 @@ bool ApplicationProfile::ComputeGlobalProfile() {
   // Force block never executed to be at the last percentile.
   empty_profile_->set_percentile(1.0);
 
+  RebuildProfileIndex();
+
+  return true;
+}
+
+bool ApplicationProfile::SaveCache(const pe::PEFile::Signature& signature,
+                                   const base::FilePath& path) const {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open profile cache file '" << path.value()
+               << "' for writing.";
+    return false;
+  }
+
+  core::FileOutStream out_stream(file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  if (!out_archive.Save(kProfileCacheVersion) ||
+      !out_archive.Save(signature) ||
+      !out_archive.Save(global_temperature_) ||
+      !out_archive.Save(frequencies_) ||
+      !out_archive.Save(profiles_) ||
+      !out_archive.Flush()) {
+    LOG(ERROR) << "Failed to write profile cache file '" << path.value()
+               << "'.";
+    return false;
+  }
+
+  return true;
+}
+
+bool ApplicationProfile::LoadCache(const pe::PEFile::Signature& signature,
+                                   const base::FilePath& path) {
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open profile cache file '" << path.value()
+               << "' for reading.";
+    return false;
+  }
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  uint32 version = 0;
+  if (!in_archive.Load(&version) || version != kProfileCacheVersion) {
+    LOG(ERROR) << "Unsupported version in profile cache file '"
+               << path.value() << "'.";
+    return false;
+  }
+
+  pe::PEFile::Signature cached_signature;
+  if (!in_archive.Load(&cached_signature)) {
+    LOG(ERROR) << "Failed to read profile cache file '" << path.value()
+               << "'.";
+    return false;
+  }
+  if (!cached_signature.IsConsistent(signature)) {
+    LOG(ERROR) << "Profile cache file '" << path.value()
+               << "' was saved for a different image.";
+    return false;
+  }
+
+  if (!in_archive.Load(&global_temperature_) ||
+      !in_archive.Load(&frequencies_) ||
+      !in_archive.Load(&profiles_)) {
+    LOG(ERROR) << "Failed to read profile cache file '" << path.value()
+               << "'.";
+    return false;
+  }
+
+  // The percentiles were computed before saving; restore the percentile of
+  // the never executed blocks and the direct-indexed lookup.
+  empty_profile_->set_percentile(1.0);
+  RebuildProfileIndex();
+
   return true;
 }
 
@@ -261,6 +363,21 @@ void ApplicationProfile::ComputeSubGraphProfile(
   }
 }
 
+bool ApplicationProfile::BlockProfile::Save(
+    core::OutArchive* out_archive) const {
+  DCHECK_NE(reinterpret_cast<core::OutArchive*>(NULL), out_archive);
+  return out_archive->Save(count_) &&
+      out_archive->Save(temperature_) &&
+      out_archive->Save(percentile_);
+}
+
+bool ApplicationProfile::BlockProfile::Load(core::InArchive* in_archive) {
+  DCHECK_NE(reinterpret_cast<core::InArchive*>(NULL), in_archive);
+  return in_archive->Load(&count_) &&
+      in_archive->Load(&temperature_) &&
+      in_archive->Load(&percentile_);
+}
+
 SubGraphProfile::SubGraphProfile() {
   empty_profile_.reset(new BasicBlockProfile());
 }
@@ -33,11 +33,14 @@
 #define SYZYGY_OPTIMIZE_APPLICATION_PROFILE_H_
 
 #include <map>
+#include <vector>
 
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/pe/image_layout.h"
+#include "syzygy/pe/pe_file.h"
 
 namespace optimize {
 
@@ -91,9 +94,34 @@ class ApplicationProfile {
   // TODO(etienneb): Support multiple importation.
   bool ImportFrequencies(const IndexedFrequencyMap& frequencies);
 
+  // Save the imported frequencies and the computed block profiles, with
+  // their percentiles, in a compact binary form. Subsequent runs over the
+  // same image may load the result and skip the frequency importation and
+  // the global profile computation.
+  // @param signature the signature of the image the profile applies to.
+  // @param path the file to save the profile to.
+  // @returns true on success, false otherwise.
+  // @note Invalid before the call to ComputeGlobalProfile.
+  bool SaveCache(const pe::PEFile::Signature& signature,
+                 const base::FilePath& path) const;
+
+  // Load a profile previously saved with SaveCache, replacing the imported
+  // frequencies and the computed block profiles. On success
+  // ComputeGlobalProfile need not be called.
+  // @param signature the signature of the image being optimized.
+  // @param path the file to load the profile from.
+  // @returns true on success, false if the file cannot be read or was
+  //     saved for a different image.
+  bool LoadCache(const pe::PEFile::Signature& signature,
+                 const base::FilePath& path);
+
  protected:
   // These are protected so that they can be accessed by unittests.
 
+  // Rebuild |profiles_by_id_| from |profiles_|. Must be called whenever
+  // |profiles_| is rebuilt.
+  void RebuildProfileIndex();
+
   // Frequency information for the whole block graph (includes basic block
   // information).
   IndexedFrequencyMap frequencies_;
@@ -107,6 +135,11 @@ class ApplicationProfile {
   // The profiles for blocks of the block_graph.
   ProfileMap profiles_;
 
+  // The profiles of |profiles_| indexed directly by block id, for constant
+  // time lookup. Entries are NULL for blocks without profile information.
+  // Block ids are allocated densely, so the vector stays compact.
+  std::vector<const BlockProfile*> profiles_by_id_;
+
   // A empty profile used for all block never executed.
   scoped_ptr<BlockProfile> empty_profile_;
 
@@ -139,6 +172,15 @@ class ApplicationProfile::BlockProfile {
   void set_percentile(double p) { percentile_ = p; }
   // @}
 
+  // Serialization.
+  // @param out_archive the archive to save this profile to.
+  // @param in_archive the archive to load this profile from.
+  // @returns true on success, false otherwise.
+  // @{
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+  // @}
+
  protected:
   // The entry count of the block.
   EntryCountType count_;
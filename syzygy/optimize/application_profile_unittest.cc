@@ -14,6 +14,7 @@
 
 #include "syzygy/optimize/application_profile.h"
 
+#include "base/files/scoped_temp_dir.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
@@ -247,6 +248,47 @@ TEST_F(ApplicationProfileTest, BuildApplicationProfile) {
   EXPECT_EQ(1.0, app.empty_profile_->percentile());
 }
 
+TEST_F(ApplicationProfileTest, SaveAndLoadCache) {
+  TestAplicationProfile app(&layout_);
+  IndexedFrequencyMap frequencies;
+  ASSERT_NO_FATAL_FAILURE(PopulateLayout());
+  ASSERT_NO_FATAL_FAILURE(PopulateFrequencies(&frequencies));
+  ASSERT_TRUE(app.ImportFrequencies(frequencies));
+  ASSERT_TRUE(app.ComputeGlobalProfile());
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath cache_path = temp_dir.path().Append(L"profile.cache");
+
+  pe::PEFile::Signature signature(L"image.dll",
+                                  core::AbsoluteAddress(0x10000000),
+                                  0x1000, 0xCAFEBABE, 0x12345678);
+  ASSERT_TRUE(app.SaveCache(signature, cache_path));
+
+  // Load into a fresh profile and validate the restored contents.
+  TestAplicationProfile loaded(&layout_);
+  ASSERT_TRUE(loaded.LoadCache(signature, cache_path));
+  EXPECT_THAT(app.frequencies_, ContainerEq(loaded.frequencies_));
+  EXPECT_EQ(app.global_temperature(), loaded.global_temperature());
+
+  const BlockProfile* expected = app.GetBlockProfile(block1_);
+  const BlockProfile* restored = loaded.GetBlockProfile(block1_);
+  ASSERT_NE(reinterpret_cast<const BlockProfile*>(NULL), restored);
+  EXPECT_EQ(expected->count(), restored->count());
+  EXPECT_EQ(expected->temperature(), restored->temperature());
+  EXPECT_EQ(expected->percentile(), restored->percentile());
+
+  // Blocks never executed still map to the empty profile.
+  EXPECT_EQ(loaded.empty_profile_.get(), loaded.GetBlockProfile(block3_));
+  EXPECT_EQ(1.0, loaded.empty_profile_->percentile());
+
+  // A cache saved for a different image must be rejected.
+  pe::PEFile::Signature other_signature(signature);
+  other_signature.module_size = 0x2000;
+  TestAplicationProfile other(&layout_);
+  EXPECT_FALSE(other.LoadCache(other_signature, cache_path));
+}
+
 TEST_F(ApplicationProfileTest, ComputeSubGraphProfile) {
   // Build global profile.
   TestAplicationProfile app(&layout_);
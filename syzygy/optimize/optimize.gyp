@@ -25,6 +25,8 @@
         'optimize_app.h',
         'application_profile.cc',
         'application_profile.h',
+        'reachability_cache.cc',
+        'reachability_cache.h',
         'transforms/basic_block_reordering_transform.cc',
         'transforms/basic_block_reordering_transform.h',
         'transforms/block_alignment_transform.cc',
@@ -64,6 +66,7 @@
       'sources': [
         'application_profile_unittest.cc',
         'optimize_app_unittest.cc',
+        'reachability_cache_unittest.cc',
         'transforms/basic_block_reordering_transform_unittest.cc',
         'transforms/block_alignment_transform_unittest.cc',
         'transforms/chained_subgraph_transforms_unittest.cc',
@@ -14,12 +14,14 @@
 
 #include "syzygy/optimize/optimize_app.h"
 
+#include "base/file_util.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/transforms/fuzzing_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/optimize/application_profile.h"
+#include "syzygy/optimize/reachability_cache.h"
 #include "syzygy/optimize/transforms/basic_block_reordering_transform.h"
 #include "syzygy/optimize/transforms/block_alignment_transform.h"
 #include "syzygy/optimize/transforms/chained_subgraph_transforms.h"
@@ -66,7 +68,16 @@ const char kUsageFormatStr[] =
     "    --basic-block-reorder Enable basic block reodering.\n"
     "    --block-alignment     Enable block realignment.\n"
     "    --inlining            Enable function inlining.\n"
+    "    --inlining-cache=<path>\n"
+    "                          Persist inlining analysis summaries between\n"
+    "                          runs. The file is loaded when it exists and\n"
+    "                          rewritten after a successful relink.\n"
     "    --peephole            Enable peephole optimization.\n"
+    "    --profile-cache=<path>\n"
+    "                          Persist the computed application profile\n"
+    "                          between runs. The file is loaded when it\n"
+    "                          exists and matches the input image, and\n"
+    "                          rewritten after the profile is recomputed.\n"
     "    --unreachable-block   Enable unreachable block optimization.\n"
     "\n"
     "  Unreachable block options:\n"
@@ -89,6 +100,10 @@ bool OptimizeApp::ParseCommandLine(const CommandLine* cmd_line) {
   input_pdb_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("input-pdb"));
   output_pdb_path_ = cmd_line->GetSwitchValuePath("output-pdb");
   branch_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("branch-file"));
+  inlining_cache_path_ =
+      AbsolutePath(cmd_line->GetSwitchValuePath("inlining-cache"));
+  profile_cache_path_ =
+      AbsolutePath(cmd_line->GetSwitchValuePath("profile-cache"));
 
   basic_block_reorder_ = cmd_line->HasSwitch("basic-block-reorder");
   block_alignment_ = cmd_line->HasSwitch("block-alignment");
@@ -149,32 +164,57 @@ int OptimizeApp::Run() {
   relinker.input_pe_file().GetSignature(&signature);
   const pe::ImageLayout& image_layout = relinker.input_image_layout();
 
-  // Load profile information from file.
+  // Load the profile saved by a previous run over the same image, if any.
+  // A stale or unreadable cache is simply recomputed and overwritten.
   ApplicationProfile profile(&image_layout);
-  if (!branch_file_path_.empty()) {
-    IndexedFrequencyMap frequencies;
-    if (!LoadBranchStatisticsFromFile(branch_file_path_,
-                                      signature,
-                                      &frequencies)) {
-      LOG(ERROR) << "Unable to load profile information.";
-      return 1;
+  bool profile_cached = false;
+  if (!profile_cache_path_.empty() &&
+      base::PathExists(profile_cache_path_) &&
+      profile.LoadCache(signature, profile_cache_path_)) {
+    profile_cached = true;
+  }
+
+  if (!profile_cached) {
+    // Load profile information from file.
+    if (!branch_file_path_.empty()) {
+      IndexedFrequencyMap frequencies;
+      if (!LoadBranchStatisticsFromFile(branch_file_path_,
+                                        signature,
+                                        &frequencies)) {
+        LOG(ERROR) << "Unable to load profile information.";
+        return 1;
+      }
+      if (!profile.ImportFrequencies(frequencies)) {
+        LOG(ERROR) << "Could not import metrics for '"
+                   << branch_file_path_.value() << "'.";
+        return false;
+      }
     }
-    if (!profile.ImportFrequencies(frequencies)) {
-      LOG(ERROR) << "Could not import metrics for '"
-                 << branch_file_path_.value() << "'.";
-      return false;
+
+    // Compute global profile information for the current block graph.
+    if (!profile.ComputeGlobalProfile()) {
+      LOG(ERROR) << "Unable to build profile information.";
+      return 1;
     }
-  }
 
-  // Compute global profile information for the current block graph.
-  if (!profile.ComputeGlobalProfile()) {
-    LOG(ERROR) << "Unable to build profile information.";
-    return 1;
+    if (!profile_cache_path_.empty() &&
+        !profile.SaveCache(signature, profile_cache_path_)) {
+      LOG(ERROR) << "Unable to save profile cache.";
+      return 1;
+    }
   }
 
   // Construct a chain of basic block transforms.
   ChainedSubgraphTransforms chains(&profile);
 
+  // When the unreachable-block transform is enabled, share a single
+  // reachability computation across the pipeline: the chain computes the
+  // cache, skips unreachable blocks, and the unreachable-block transform
+  // reuses the cache instead of recomputing the reachable set.
+  ReachabilityCache reachability_cache;
+  if (unreachable_block_)
+    chains.set_reachability_cache(&reachability_cache);
+
   // Declare transforms we may apply.
   scoped_ptr<BasicBlockReorderingTransform> basic_block_reordering_transform;
   scoped_ptr<BlockAlignmentTransform> block_alignment_transform;
@@ -192,6 +232,15 @@ int OptimizeApp::Run() {
   // If inlining is enabled, add it to the chain.
   if (inlining_) {
     inlining_transform.reset(new InliningTransform());
+
+    // Reuse the callee summaries saved by a previous run, when available.
+    if (!inlining_cache_path_.empty() &&
+        base::PathExists(inlining_cache_path_) &&
+        !inlining_transform->LoadSummaryCache(inlining_cache_path_)) {
+      LOG(ERROR) << "Unable to load inlining summary cache.";
+      return 1;
+    }
+
     chains.AppendTransform(inlining_transform.get());
   }
 
@@ -216,6 +265,7 @@ int OptimizeApp::Run() {
     unreachable_block_transform.reset(new UnreachableBlockTransform());
     unreachable_block_transform->set_unreachable_graph_path(
         unreachable_graph_path_);
+    unreachable_block_transform->set_reachability_cache(&reachability_cache);
     relinker.AppendTransform(unreachable_block_transform.get());
   }
 
@@ -231,6 +281,13 @@ int OptimizeApp::Run() {
     return 1;
   }
 
+  // Persist the callee summaries for the next run.
+  if (inlining_ && !inlining_cache_path_.empty() &&
+      !inlining_transform->SaveSummaryCache(inlining_cache_path_)) {
+    LOG(ERROR) << "Unable to save inlining summary cache.";
+    return 1;
+  }
+
   return 0;
 }
 
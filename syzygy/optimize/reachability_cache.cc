@@ -0,0 +1,121 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implementation of the ReachabilityCache class.
+
+#include "syzygy/optimize/reachability_cache.h"
+
+#include <stack>
+
+namespace optimize {
+
+namespace {
+
+using block_graph::BlockGraph;
+typedef BlockGraph::Block::ReferenceMap ReferenceMap;
+
+}  // namespace
+
+void ReachabilityCache::Compute(const BlockGraph& block_graph,
+                                const BlockGraph::Block* header_block) {
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), header_block);
+
+  // Size the bitset to cover every block currently allocated. Block ids are
+  // allocated in increasing order, so the last block has the largest id.
+  reachable_.clear();
+  const BlockGraph::BlockMap& blocks = block_graph.blocks();
+  if (!blocks.empty())
+    reachable_.resize(blocks.rbegin()->first + 1, false);
+  valid_ = true;
+
+  // Walk the reference graph from the roots.
+  MarkSubTree(header_block);
+  BlockGraph::BlockMap::const_iterator block_iter = blocks.begin();
+  for (; block_iter != blocks.end(); ++block_iter) {
+    const BlockGraph::Block* block = &block_iter->second;
+    if ((block->attributes() & BlockGraph::PE_PARSED) == 0)
+      continue;
+    MarkSubTree(block);
+  }
+}
+
+bool ReachabilityCache::IsReachable(const BlockGraph::Block* block) const {
+  DCHECK(valid_);
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), block);
+
+  // Blocks allocated after the computation are conservatively reachable.
+  if (block->id() >= reachable_.size())
+    return true;
+  return reachable_[block->id()];
+}
+
+void ReachabilityCache::OnBlockAdded(const BlockGraph::Block* block) {
+  DCHECK(valid_);
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), block);
+  Mark(block);
+}
+
+void ReachabilityCache::OnReferenceAdded(const BlockGraph::Block* referrer,
+                                         const BlockGraph::Block* referenced) {
+  DCHECK(valid_);
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), referrer);
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), referenced);
+
+  // A reference from an unreachable block doesn't make its target reachable.
+  if (!IsReachable(referrer))
+    return;
+  MarkSubTree(referenced);
+}
+
+bool ReachabilityCache::Mark(const BlockGraph::Block* block) {
+  DCHECK(valid_);
+
+  // Blocks beyond the end of the bitset were allocated after the
+  // computation and are already conservatively reachable. Growing the
+  // bitset with true bits keeps that invariant for ids between the old and
+  // the new size.
+  if (block->id() >= reachable_.size()) {
+    reachable_.resize(block->id() + 1, true);
+    return false;
+  }
+  if (reachable_[block->id()])
+    return false;
+  reachable_[block->id()] = true;
+  return true;
+}
+
+void ReachabilityCache::MarkSubTree(const BlockGraph::Block* root) {
+  DCHECK(valid_);
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), root);
+
+  // The working stack is allocated in the heap to avoid stack overflow.
+  std::stack<const BlockGraph::Block*> working;
+  if (Mark(root))
+    working.push(root);
+
+  while (!working.empty()) {
+    const BlockGraph::Block* block = working.top();
+    working.pop();
+
+    const ReferenceMap& references = block->references();
+    ReferenceMap::const_iterator reference = references.begin();
+    for (; reference != references.end(); ++reference) {
+      const BlockGraph::Block* referenced = reference->second.referenced();
+      if (Mark(referenced))
+        working.push(referenced);
+    }
+  }
+}
+
+}  // namespace optimize
@@ -0,0 +1,97 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the ReachabilityCache class, a cache of block-level reachability
+// shared by the passes of an optimize pipeline. Both the subgraph transform
+// pipeline and the unreachable-block transform need to know which blocks are
+// reachable from the image roots; this class computes the set once and keeps
+// it usable as transforms mutate the block-graph.
+//
+// The cache is a conservative over-approximation of the reachable set.
+// Blocks allocated after the computation are considered reachable, and
+// reference removals, which can only shrink the reachable set, are not
+// tracked. Consumers may therefore rely on a negative answer to skip or
+// remove work, but a positive answer does not prove a block is live. Call
+// Compute again to tighten the approximation.
+
+#ifndef SYZYGY_OPTIMIZE_REACHABILITY_CACHE_H_
+#define SYZYGY_OPTIMIZE_REACHABILITY_CACHE_H_
+
+#include <vector>
+
+#include "syzygy/block_graph/block_graph.h"
+
+namespace optimize {
+
+class ReachabilityCache {
+ public:
+  typedef block_graph::BlockGraph BlockGraph;
+
+  ReachabilityCache() : valid_(false) {
+  }
+
+  // @returns true once Compute has been called.
+  bool is_valid() const { return valid_; }
+
+  // Computes the set of blocks reachable from the roots of @p block_graph.
+  // The roots are @p header_block and every block marked with the PE_PARSED
+  // attribute.
+  // @param block_graph the block-graph to compute reachability over.
+  // @param header_block the header block of the image.
+  void Compute(const BlockGraph& block_graph,
+               const BlockGraph::Block* header_block);
+
+  // @param block the block to query.
+  // @returns true if @p block may be reachable from the roots.
+  // @note Invalid before the call to Compute.
+  bool IsReachable(const BlockGraph::Block* block) const;
+
+  // @name Incremental update hooks, to be invoked by transforms that mutate
+  //     the block-graph after the computation.
+  // @{
+  // Records a block newly added to the block-graph. The block is
+  // conservatively considered reachable.
+  // @param block the added block.
+  void OnBlockAdded(const BlockGraph::Block* block);
+
+  // Records a new reference from @p referrer to @p referenced. When the
+  // referrer is reachable, reachability is propagated to the referenced
+  // block and its closure.
+  // @param referrer the block the reference was added to.
+  // @param referenced the block the reference points to.
+  void OnReferenceAdded(const BlockGraph::Block* referrer,
+                        const BlockGraph::Block* referenced);
+  // @}
+
+ private:
+  // Marks @p block reachable.
+  // @returns true if the block was not already reachable.
+  bool Mark(const BlockGraph::Block* block);
+
+  // Marks @p root and every block transitively referenced by it reachable.
+  void MarkSubTree(const BlockGraph::Block* root);
+
+  // Whether Compute has been called.
+  bool valid_;
+
+  // Reachability indexed by block id. Block ids are allocated densely, so
+  // the bitset stays compact.
+  std::vector<bool> reachable_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReachabilityCache);
+};
+
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_REACHABILITY_CACHE_H_
@@ -0,0 +1,139 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/reachability_cache.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph.h"
+
+namespace optimize {
+
+namespace {
+
+using block_graph::BlockGraph;
+
+// Dummy code body.
+const uint8 kCodeBody[] = { 0x74, 0x02, 0x33, 0xC0, 0xC3 };
+
+class ReachabilityCacheTest : public testing::Test {
+ public:
+  ReachabilityCacheTest() : code1_(NULL), code2_(NULL), code3_(NULL) {
+  }
+
+  virtual void SetUp() {
+    code1_ = AddCodeBlock("code1");
+    code2_ = AddCodeBlock("code2");
+    code3_ = AddCodeBlock("code3");
+
+    // Add a reference so that code1 is calling code2. code3 is unreachable.
+    Connect(code1_, code2_);
+  }
+
+  BlockGraph::Block* AddCodeBlock(const char* name) {
+    BlockGraph::Block* block = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                                     sizeof(kCodeBody),
+                                                     name);
+    DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block);
+    block->SetData(kCodeBody, block->size());
+    return block;
+  }
+
+  void Connect(BlockGraph::Block* from, BlockGraph::Block* to) {
+    from->SetReference(1, BlockGraph::Reference(BlockGraph::RELATIVE_REF,
+                              BlockGraph::Reference::kMaximumSize,
+                              to, 0, 0));
+  }
+
+ protected:
+  BlockGraph block_graph_;
+  BlockGraph::Block* code1_;
+  BlockGraph::Block* code2_;
+  BlockGraph::Block* code3_;
+  ReachabilityCache cache_;
+};
+
+}  // namespace
+
+TEST_F(ReachabilityCacheTest, InvalidBeforeCompute) {
+  EXPECT_FALSE(cache_.is_valid());
+}
+
+TEST_F(ReachabilityCacheTest, ComputeMarksRootsAndClosure) {
+  cache_.Compute(block_graph_, code1_);
+  EXPECT_TRUE(cache_.is_valid());
+
+  EXPECT_TRUE(cache_.IsReachable(code1_));
+  EXPECT_TRUE(cache_.IsReachable(code2_));
+  EXPECT_FALSE(cache_.IsReachable(code3_));
+}
+
+TEST_F(ReachabilityCacheTest, PEParsedBlockIsRoot) {
+  code3_->set_attribute(BlockGraph::PE_PARSED);
+  cache_.Compute(block_graph_, code1_);
+
+  EXPECT_TRUE(cache_.IsReachable(code3_));
+}
+
+TEST_F(ReachabilityCacheTest, BlocksAddedAfterComputeAreReachable) {
+  cache_.Compute(block_graph_, code1_);
+
+  // Blocks allocated after the computation are conservatively reachable,
+  // whether or not they are recorded through the hook.
+  BlockGraph::Block* code4 = AddCodeBlock("code4");
+  EXPECT_TRUE(cache_.IsReachable(code4));
+
+  cache_.OnBlockAdded(code4);
+  EXPECT_TRUE(cache_.IsReachable(code4));
+}
+
+TEST_F(ReachabilityCacheTest, ReferenceAddedPropagatesReachability) {
+  // Build an unreachable chain: code3 -> code4.
+  BlockGraph::Block* code4 = AddCodeBlock("code4");
+  Connect(code3_, code4);
+  cache_.Compute(block_graph_, code1_);
+  EXPECT_FALSE(cache_.IsReachable(code3_));
+  EXPECT_FALSE(cache_.IsReachable(code4));
+
+  // A new reference from the reachable code2 makes the whole chain
+  // reachable.
+  Connect(code2_, code3_);
+  cache_.OnReferenceAdded(code2_, code3_);
+  EXPECT_TRUE(cache_.IsReachable(code3_));
+  EXPECT_TRUE(cache_.IsReachable(code4));
+}
+
+TEST_F(ReachabilityCacheTest, ReferenceFromUnreachableDoesNotPropagate) {
+  BlockGraph::Block* code4 = AddCodeBlock("code4");
+  cache_.Compute(block_graph_, code1_);
+
+  // A reference between two unreachable blocks changes nothing.
+  Connect(code3_, code4);
+  cache_.OnReferenceAdded(code3_, code4);
+  EXPECT_FALSE(cache_.IsReachable(code3_));
+  EXPECT_FALSE(cache_.IsReachable(code4));
+}
+
+TEST_F(ReachabilityCacheTest, RecomputeTightensApproximation) {
+  cache_.Compute(block_graph_, code1_);
+
+  // A block added after the computation is conservatively reachable until
+  // the cache is recomputed.
+  BlockGraph::Block* code4 = AddCodeBlock("code4");
+  EXPECT_TRUE(cache_.IsReachable(code4));
+
+  cache_.Compute(block_graph_, code1_);
+  EXPECT_FALSE(cache_.IsReachable(code4));
+}
+
+}  // namespace optimize
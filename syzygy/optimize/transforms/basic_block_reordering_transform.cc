@@ -15,6 +15,7 @@
 #include "syzygy/optimize/transforms/basic_block_reordering_transform.h"
 
 #include "syzygy/block_graph/block_graph.h"
+#include "syzygy/common/align.h"
 #include "syzygy/optimize/application_profile.h"
 
 namespace optimize {
@@ -34,6 +35,14 @@ typedef ControlFlowAnalysis::StructuralNode StructuralNode;
 typedef SubGraphProfile::BasicBlockProfile BasicBlockProfile;
 typedef grinder::basic_block_util::EntryCountType EntryCountType;
 
+// The size of a cache line on typical x86 processors. Hot basic blocks are
+// packed onto cache lines to reduce the number of lines the front-end must
+// fetch on the hot path.
+const size_t kCacheLineSize = 64;
+
+// The worst-case size of a manifested successor branch (jcc rel32).
+const size_t kMaxSuccessorSize = 6;
+
 // A helper to "cast" the given successor as a BasicCodeBlock.
 const BasicCodeBlock* GetSuccessorBB(const Successor& successor) {
   const BasicBlock* bb = successor.reference().basic_block();
@@ -49,6 +58,14 @@ const BasicCodeBlock* GetSuccessorBB(const Successor& successor) {
   return code_bb;
 }
 
+// Estimates the number of bytes @p bb will occupy once emitted, including
+// the branches manifested for its successors.
+size_t EstimateBasicBlockSize(const BasicCodeBlock* bb) {
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), bb);
+  return bb->GetInstructionSize() +
+      bb->successors().size() * kMaxSuccessorSize;
+}
+
 void FlattenStructuralTreeRecursive(const StructuralNode* tree,
                                     const SubGraphProfile* profile,
                                     BasicBlockOrdering* order,
@@ -192,6 +209,53 @@ void BasicBlockReorderingTransform::CommitOrdering(
   CHECK_EQ(previous_size, target->size());
 }
 
+void BasicBlockReorderingTransform::PackOrdering(
+    const BasicBlockOrdering& order,
+    const SubGraphProfile& profile) {
+  // Walk the ordering, simulating layout offsets, and align a hot basic
+  // block on a cache line when it would otherwise straddle a line boundary.
+  // The block builder materializes the alignment by inserting nops, which
+  // are executed when the preceding basic block falls through; padding is
+  // thus only requested for basic blocks that are mostly entered by taken
+  // branches (e.g. loop heads reached by their back-edge).
+  size_t offset = 0;
+  const BasicCodeBlock* previous_bb = NULL;
+  BasicBlockOrdering::const_iterator it = order.begin();
+  for (; it != order.end(); ++it) {
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    if (bb == NULL)
+      continue;
+
+    size_t size = EstimateBasicBlockSize(bb);
+    const BasicBlockProfile* bb_profile = profile.GetBasicBlockProfile(bb);
+    EntryCountType bb_count = bb_profile->count();
+
+    // Determine how often control falls through from the previous basic
+    // block; any padding inserted in front of this basic block is executed
+    // on that path.
+    EntryCountType fall_through_count = 0;
+    if (previous_bb != NULL) {
+      const BasicBlockProfile* previous_profile =
+          profile.GetBasicBlockProfile(previous_bb);
+      fall_through_count = previous_profile->GetSuccessorCount(bb);
+    }
+
+    size_t line_offset = offset % kCacheLineSize;
+    bool straddles_line = line_offset + size > kCacheLineSize;
+    if (bb_count > 0 && straddles_line && size <= kCacheLineSize &&
+        bb_count >= 2 * fall_through_count) {
+      // The basic block fits within a single cache line and is mostly
+      // entered by taken branches: aligning it saves a line fetch on every
+      // entry and the padding is only executed on a minority of them.
+      const_cast<BasicCodeBlock*>(bb)->set_alignment(kCacheLineSize);
+      offset = common::AlignUp(offset, kCacheLineSize);
+    }
+
+    offset += size;
+    previous_bb = bb;
+  }
+}
+
 bool BasicBlockReorderingTransform::TransformBasicBlockSubGraph(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -269,15 +333,21 @@ bool BasicBlockReorderingTransform::TransformBasicBlockSubGraph(
   bool reducible = FlattenStructuralTreeToAnOrder(subgraph,
                                                   subgraph_profile,
                                                   &flatten_order);
+  const BasicBlockOrdering* final_order = &original_order;
   if (reducible) {
     // Compute the number of jumps taken for the optimized ordering.
     uint64 flatten_cost = EvaluateCost(flatten_order, *subgraph_profile);
 
     // If the new basic block layout is better than the previous one, commit it.
-    if (flatten_cost < original_cost)
+    if (flatten_cost < original_cost) {
       CommitOrdering(flatten_order, end_block, &original_order_list);
+      final_order = &flatten_order;
+    }
   }
 
+  // Pack the hot path of the resulting ordering onto cache lines.
+  PackOrdering(*final_order, *subgraph_profile);
+
   return true;
 }
 
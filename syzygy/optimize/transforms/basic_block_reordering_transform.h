@@ -15,7 +15,10 @@
 // This class implements the basic block reordering transformation.
 //
 // The transformation reorders basic blocks to decrease the amount of taken and
-// mispredicted jumps.
+// mispredicted jumps. The resulting ordering is then packed onto cache lines:
+// a hot basic block that would straddle a cache line boundary is aligned on a
+// cache line when the padding this introduces is only executed on a minority
+// of its entries (i.e. the basic block is mostly entered by taken branches).
 //
 // see: K.Pettis, R.C.Hansen, Profile Guided Code Positioning,
 //     Proceedings of the ACM SIGPLAN 1990 Conference on Programming Language
@@ -70,6 +73,9 @@ class BasicBlockReorderingTransform : public SubGraphTransformInterface {
       const BasicBlockOrdering& order,
       block_graph::BasicEndBlock* basic_end_block,
       BasicBlockSubGraph::BasicBlockOrdering* target);
+
+  static void PackOrdering(const BasicBlockOrdering& order,
+                           const SubGraphProfile& profile);
   // @}
 
  private:
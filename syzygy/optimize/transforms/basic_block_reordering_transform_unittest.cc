@@ -33,6 +33,7 @@ using block_graph::BasicBlockSubGraph;
 using block_graph::BasicCodeBlock;
 using block_graph::BlockBuilder;
 using block_graph::BlockGraph;
+using block_graph::Instruction;
 using block_graph::Successor;
 using pe::ImageLayout;
 using testing::ElementsAre;
@@ -95,6 +96,7 @@ class TestBasicBlockReorderingTransform : public BasicBlockReorderingTransform {
   using BasicBlockReorderingTransform::EvaluateCost;
   using BasicBlockReorderingTransform::CommitOrdering;
   using BasicBlockReorderingTransform::FlattenStructuralTreeToAnOrder;
+  using BasicBlockReorderingTransform::PackOrdering;
 };
 
 class BasicBlockReorderingTransformTest : public testing::Test {
@@ -394,6 +396,64 @@ TEST_F(BasicBlockReorderingTransformTest, FlattenStructuralTreeToAnOrder) {
   EXPECT_THAT(order, ElementsAre(b1_, b2_, b3_, b4_, b5_));
 }
 
+TEST_F(BasicBlockReorderingTransformTest, PackOrderingSmallBlocksUntouched) {
+  // The whole ordering fits within a single cache line, so no basic block
+  // needs to be aligned.
+  BasicBlockOrdering order;
+  order.push_back(b1_);
+  order.push_back(b3_);
+  order.push_back(b4_);
+  order.push_back(b2_);
+  order.push_back(b5_);
+  TestBasicBlockReorderingTransform::PackOrdering(order, subgraph_profile_);
+
+  EXPECT_EQ(1U, b1_->alignment());
+  EXPECT_EQ(1U, b2_->alignment());
+  EXPECT_EQ(1U, b3_->alignment());
+  EXPECT_EQ(1U, b4_->alignment());
+  EXPECT_EQ(1U, b5_->alignment());
+}
+
+TEST_F(BasicBlockReorderingTransformTest, PackOrderingAlignsStraddlingBlock) {
+  // Grow b1 and b2 (with single byte nops) so that b4 straddles the second
+  // cache line boundary.
+  for (size_t i = 0; i < 60; ++i)
+    b1_->instructions().push_back(Instruction());
+  for (size_t i = 0; i < 48; ++i)
+    b2_->instructions().push_back(Instruction());
+
+  // b4 is entered 10 times but only falls through from b2 4 times, so the
+  // padding is executed on a minority of its entries and b4 gets aligned.
+  BasicBlockOrdering order;
+  order.push_back(b1_);
+  order.push_back(b2_);
+  order.push_back(b4_);
+  TestBasicBlockReorderingTransform::PackOrdering(order, subgraph_profile_);
+
+  EXPECT_EQ(64U, b4_->alignment());
+  EXPECT_EQ(1U, b1_->alignment());
+  EXPECT_EQ(1U, b2_->alignment());
+}
+
+TEST_F(BasicBlockReorderingTransformTest, PackOrderingSkipsFallThroughBlock) {
+  // Grow b1 and b3 so that b4 straddles the second cache line boundary.
+  for (size_t i = 0; i < 60; ++i)
+    b1_->instructions().push_back(Instruction());
+  for (size_t i = 0; i < 48; ++i)
+    b3_->instructions().push_back(Instruction());
+
+  // b4 straddles a cache line but is mostly entered by the fall-through
+  // from b3 (6 of its 10 entries): the padding would cost more than the
+  // avoided line fetch, so b4 must not be aligned.
+  BasicBlockOrdering order;
+  order.push_back(b1_);
+  order.push_back(b3_);
+  order.push_back(b4_);
+  TestBasicBlockReorderingTransform::PackOrdering(order, subgraph_profile_);
+
+  EXPECT_EQ(1U, b4_->alignment());
+}
+
 TEST_F(BasicBlockReorderingTransformTest, ApplyTransformWithoutProfile) {
   BlockGraph::Block* block =
       block_graph_.AddBlock(BlockGraph::CODE_BLOCK, sizeof(kCodeJump), "jump");
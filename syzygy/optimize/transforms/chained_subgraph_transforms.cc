@@ -16,8 +16,13 @@
 
 #include "syzygy/optimize/transforms/chained_subgraph_transforms.h"
 
+#include <algorithm>
 #include <stack>
+#include <vector>
 
+#include "base/memory/scoped_vector.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
@@ -28,13 +33,27 @@ namespace transforms {
 
 namespace {
 
+using block_graph::BasicBlock;
 using block_graph::BasicBlockDecomposer;
 using block_graph::BasicBlockSubGraph;
+using block_graph::BasicCodeBlock;
+using block_graph::BasicDataBlock;
+using block_graph::BasicEndBlock;
 using block_graph::BlockBuilder;
 using block_graph::BlockGraph;
 using block_graph::BlockVector;
+using block_graph::InstructionDecodeCache;
+using block_graph::TransformPolicyInterface;
 typedef BlockGraph::Block::ReferrerSet ReferrerSet;
 typedef std::list<BlockGraph::Block*> BlockOrdering;
+typedef ChainedSubgraphTransforms::TransformList TransformList;
+
+// The number of blocks handed to the worker threads between two serialized
+// block-graph commit phases. The subgraphs of a batch are all held in memory
+// until the batch is committed, so the batch size bounds peak memory usage.
+// It is kept large enough to smooth out the skew in per-block processing
+// cost.
+const size_t kParallelBatchSize = 64;
 
 // Traverse the call-graph in reverse call order (callee to caller) and push
 // blocks in post-order. The resulting ordering can be iterated to visit all
@@ -101,6 +120,234 @@ void FlattenCallgraphPostOrder(BlockGraph* block_graph, BlockOrdering* order) {
   }
 }
 
+// The decomposed subgraph and profile of a block, pending transformation and
+// reconstruction into the block-graph.
+struct TransformWorkItem {
+  explicit TransformWorkItem(BlockGraph::Block* block) : block(block) {
+    DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block);
+  }
+
+  BlockGraph::Block* block;
+  scoped_ptr<BasicBlockSubGraph> subgraph;
+  scoped_ptr<SubGraphProfile> subgraph_profile;
+
+  // The ids of the blocks that |subgraph| holds raw pointers to: the blocks
+  // it refers to and the referrers of |block|. If any of these blocks is
+  // rebuilt before |block| then |subgraph| carries dangling pointers and
+  // must be rebuilt against the current block-graph before being committed.
+  std::set<BlockGraph::BlockId> dependencies;
+};
+
+// Decomposes the block of |item| into a subgraph, computes the subgraph
+// profile and applies the series of |transforms|. The block-graph is not
+// mutated, which allows distinct work items to be processed concurrently.
+// |decode_cache| may be NULL, which disables instruction-decode caching; it
+// must be NULL when work items are processed concurrently as the cache is
+// not thread-safe.
+bool DecomposeAndTransformBlock(const TransformPolicyInterface* policy,
+                                BlockGraph* block_graph,
+                                ApplicationProfile* profile,
+                                const TransformList& transforms,
+                                InstructionDecodeCache* decode_cache,
+                                TransformWorkItem* item) {
+  DCHECK_NE(reinterpret_cast<TransformWorkItem*>(NULL), item);
+
+  // Decompose block to basic blocks.
+  item->subgraph.reset(new BasicBlockSubGraph());
+  BasicBlockDecomposer bb_decomposer(item->block, item->subgraph.get());
+  bb_decomposer.set_decode_cache(decode_cache);
+  if (!bb_decomposer.Decompose())
+    return false;
+
+  // Update subgraph profile.
+  profile->ComputeSubGraphProfile(item->subgraph.get(),
+                                  &item->subgraph_profile);
+
+  // Apply the series of basic block transforms to this block.
+  TransformList::const_iterator it = transforms.begin();
+  for (; it != transforms.end(); ++it) {
+    SubGraphTransformInterface* transform = *it;
+    DCHECK(transform != NULL);
+    if (!transform->TransformBasicBlockSubGraph(policy,
+                                                block_graph,
+                                                item->subgraph.get(),
+                                                profile,
+                                                item->subgraph_profile.get())) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Adds the ids of the blocks referred to by |references| to the dependencies
+// of |item|. References to basic blocks stay within the subgraph and are not
+// dependencies.
+void AddReferredBlockDependencies(
+    const BasicBlock::BasicBlockReferenceMap& references,
+    TransformWorkItem* item) {
+  DCHECK_NE(reinterpret_cast<TransformWorkItem*>(NULL), item);
+  BasicBlock::BasicBlockReferenceMap::const_iterator it = references.begin();
+  for (; it != references.end(); ++it) {
+    const BlockGraph::Block* referred = it->second.block();
+    if (referred != NULL && referred != item->block)
+      item->dependencies.insert(referred->id());
+  }
+}
+
+// Records the ids of the blocks whose reconstruction would leave the
+// transformed subgraph of |item| with dangling block pointers. These are the
+// blocks the subgraph refers to - the subgraph is walked rather than the
+// original block's reference map because transforms like inlining introduce
+// references the original block does not hold - and the referrers of the
+// original block, whose pointers the decomposer copied into the subgraph so
+// that the merge can rewrite the incoming references. This must run before
+// any block of the batch is rebuilt.
+void RecordWorkItemDependencies(TransformWorkItem* item) {
+  DCHECK_NE(reinterpret_cast<TransformWorkItem*>(NULL), item);
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), item->subgraph.get());
+
+  // Collect the blocks referred to by the transformed subgraph.
+  const BasicBlockSubGraph::BBCollection& basic_blocks =
+      item->subgraph->basic_blocks();
+  BasicBlockSubGraph::BBCollection::const_iterator bb_iter =
+      basic_blocks.begin();
+  for (; bb_iter != basic_blocks.end(); ++bb_iter) {
+    const BasicCodeBlock* code_block = BasicCodeBlock::Cast(*bb_iter);
+    if (code_block != NULL) {
+      BasicBlock::Instructions::const_iterator inst_iter =
+          code_block->instructions().begin();
+      for (; inst_iter != code_block->instructions().end(); ++inst_iter)
+        AddReferredBlockDependencies(inst_iter->references(), item);
+
+      BasicBlock::Successors::const_iterator succ_iter =
+          code_block->successors().begin();
+      for (; succ_iter != code_block->successors().end(); ++succ_iter) {
+        const BlockGraph::Block* referred = succ_iter->reference().block();
+        if (referred != NULL && referred != item->block)
+          item->dependencies.insert(referred->id());
+      }
+      continue;
+    }
+
+    const BasicDataBlock* data_block = BasicDataBlock::Cast(*bb_iter);
+    if (data_block != NULL) {
+      AddReferredBlockDependencies(data_block->references(), item);
+      continue;
+    }
+
+    const BasicEndBlock* end_block = BasicEndBlock::Cast(*bb_iter);
+    if (end_block != NULL)
+      AddReferredBlockDependencies(end_block->references(), item);
+  }
+
+  // Collect the referrers of the original block.
+  const ReferrerSet& referrers = item->block->referrers();
+  ReferrerSet::const_iterator referrer_it = referrers.begin();
+  for (; referrer_it != referrers.end(); ++referrer_it) {
+    if (referrer_it->first != item->block)
+      item->dependencies.insert(referrer_it->first->id());
+  }
+}
+
+// Rebuilds the transformed subgraph of |item| into the block-graph. The
+// rebuilt blocks are recorded in |reachability_cache| when one is in use.
+bool CommitWorkItem(BlockGraph* block_graph,
+                    ReachabilityCache* reachability_cache,
+                    TransformWorkItem* item) {
+  DCHECK_NE(reinterpret_cast<TransformWorkItem*>(NULL), item);
+
+  // Update the block-graph post transform.
+  BlockBuilder builder(block_graph);
+  if (!builder.Merge(item->subgraph.get()))
+    return false;
+
+  // TODO(etienneb): This is needed until the labels refactoring.
+  const BlockVector& blocks = builder.new_blocks();
+  BlockVector::const_iterator new_block = blocks.begin();
+  for (; new_block != blocks.end(); ++new_block) {
+    (*new_block)->set_attribute(BlockGraph::BUILT_BY_SYZYGY);
+    if (reachability_cache != NULL)
+      reachability_cache->OnBlockAdded(*new_block);
+  }
+
+  return true;
+}
+
+// Folds the pending insertions of every block's referrer set into the sets'
+// sorted storage. The worker threads read the referrer sets of arbitrary
+// blocks - the basic-block decomposer copies external referrers and the
+// transform policy walks them - and concurrent reads of a referrer set with
+// pending insertions are not safe, while reads of a committed one are.
+// Referrers are only inserted during the serial phases, so committing them
+// before the workers start keeps the sets read-only for the duration of a
+// parallel phase.
+void CommitPendingReferrers(const BlockGraph& block_graph) {
+  BlockGraph::BlockMap::const_iterator it = block_graph.blocks().begin();
+  for (; it != block_graph.blocks().end(); ++it)
+    it->second.referrers().Commit();
+}
+
+// Runs the transform pipeline over work items claimed from a shared queue. A
+// single pool is shared by every worker thread; items are claimed one at a
+// time so that the load balances dynamically, as per-block processing cost is
+// heavily skewed. The first failure stops all of the workers.
+class TransformWorkerPool : public base::DelegateSimpleThread::Delegate {
+ public:
+  TransformWorkerPool(const TransformPolicyInterface* policy,
+                      BlockGraph* block_graph,
+                      ApplicationProfile* profile,
+                      const TransformList* transforms,
+                      ScopedVector<TransformWorkItem>* work_items)
+      : policy_(policy), block_graph_(block_graph), profile_(profile),
+        transforms_(transforms), work_items_(work_items), next_item_(0),
+        success_(true) {
+  }
+
+  virtual void Run() OVERRIDE {
+    TransformWorkItem* item = NULL;
+    while ((item = ClaimWorkItem()) != NULL) {
+      // The instruction-decode cache is not thread-safe, so the workers run
+      // without one.
+      if (!DecomposeAndTransformBlock(policy_, block_graph_, profile_,
+                                      *transforms_, NULL, item)) {
+        base::AutoLock lock(lock_);
+        success_ = false;
+        return;
+      }
+      RecordWorkItemDependencies(item);
+    }
+  }
+
+  bool success() {
+    base::AutoLock lock(lock_);
+    return success_;
+  }
+
+ private:
+  // Claims the next unprocessed work item. Returns NULL when the queue is
+  // exhausted or when another worker has reported a failure.
+  TransformWorkItem* ClaimWorkItem() {
+    base::AutoLock lock(lock_);
+    if (!success_ || next_item_ == work_items_->size())
+      return NULL;
+    return (*work_items_)[next_item_++];
+  }
+
+  const TransformPolicyInterface* policy_;
+  BlockGraph* block_graph_;
+  ApplicationProfile* profile_;
+  const TransformList* transforms_;
+  ScopedVector<TransformWorkItem>* work_items_;
+
+  // Protects the members below.
+  base::Lock lock_;
+  size_t next_item_;
+  bool success_;
+
+  DISALLOW_COPY_AND_ASSIGN(TransformWorkerPool);
+};
+
 }  // namespace
 
 const char ChainedSubgraphTransforms::kTransformName[] =
@@ -121,52 +368,121 @@ bool ChainedSubgraphTransforms::TransformBlockGraph(
   if (transforms_.empty())
     return true;
 
+  // Compute the shared reachability cache once for the whole pipeline.
+  // Downstream passes, like the unreachable-block transform, reuse it
+  // instead of recomputing the reachable set.
+  if (reachability_cache_ != NULL && !reachability_cache_->is_valid())
+    reachability_cache_->Compute(*block_graph, header_block);
+
   BlockOrdering order;
   FlattenCallgraphPostOrder(block_graph, &order);
 
+  // Use the decomposition policy to skip blocks that aren't eligible for
+  // basic-block decomposition, as well as unreachable blocks: the
+  // unreachable-block transform will remove them, so transforming them is
+  // wasted work.
+  std::vector<BlockGraph::Block*> blocks;
   BlockOrdering::iterator block_iter = order.begin();
   for (; block_iter != order.end(); ++block_iter) {
-    BlockGraph::Block* block = *block_iter;
-
-    // Use the decomposition policy to skip blocks that aren't eligible for
-    // basic-block decomposition.
-    if (!policy->BlockIsSafeToBasicBlockDecompose(block))
+    if (!policy->BlockIsSafeToBasicBlockDecompose(*block_iter))
+      continue;
+    if (reachability_cache_ != NULL &&
+        !reachability_cache_->IsReachable(*block_iter)) {
       continue;
+    }
+    blocks.push_back(*block_iter);
+  }
 
-    // Decompose block to basic blocks.
-    BasicBlockSubGraph subgraph;
-    BasicBlockDecomposer bb_decomposer(block, &subgraph);
-    if (!bb_decomposer.Decompose())
-      return false;
+  // The instruction-decode cache is shared by all the decompositions
+  // performed on this thread, so that content-identical blocks are only
+  // decoded once. The parallel workers do not consult it as it is not
+  // thread-safe.
+  InstructionDecodeCache decode_cache;
 
-    // Update subgraph profile.
-    scoped_ptr<SubGraphProfile> subgraph_profile;
-    profile_->ComputeSubGraphProfile(&subgraph, &subgraph_profile);
-
-    // Apply the series of basic block transforms to this block.
-    TransformList::const_iterator it = transforms_.begin();
-    for (; it != transforms_.end(); ++it) {
-      SubGraphTransformInterface* transform = *it;
-      DCHECK(transform != NULL);
-      if (!transform->TransformBasicBlockSubGraph(policy,
-                                                  block_graph,
-                                                  &subgraph,
-                                                  profile_,
-                                                  subgraph_profile.get())) {
+  // With a single thread each block is carried from decomposition through
+  // reconstruction inline, which keeps at most one subgraph in memory.
+  if (max_num_threads_ <= 1) {
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      TransformWorkItem item(blocks[i]);
+      if (!DecomposeAndTransformBlock(policy, block_graph, profile_,
+                                      transforms_, &decode_cache, &item)) {
         return false;
       }
+      if (!CommitWorkItem(block_graph, reachability_cache_, &item))
+        return false;
     }
+    return true;
+  }
+
+  // Process the blocks in batches. Within a batch the worker threads claim
+  // blocks dynamically and run the transform pipeline concurrently on
+  // distinct subgraphs. The block-graph is not mutated during this phase -
+  // reads of other blocks are made safe by the referrer commit below, and
+  // transforms are required to serialize access to any state they share
+  // between invocations (see SubGraphTransformInterface). The transformed
+  // subgraphs are then rebuilt serially and in the original post-order, as
+  // BlockBuilder::Merge deletes blocks and rewrites the referrers of others.
+  for (size_t batch_begin = 0; batch_begin < blocks.size();
+       batch_begin += kParallelBatchSize) {
+    size_t batch_end =
+        std::min(batch_begin + kParallelBatchSize, blocks.size());
+
+    ScopedVector<TransformWorkItem> work_items;
+    for (size_t i = batch_begin; i < batch_end; ++i)
+      work_items.push_back(new TransformWorkItem(blocks[i]));
 
-    // Update the block-graph post transform.
-    BlockBuilder builder(block_graph);
-    if (!builder.Merge(&subgraph))
+    // Make the referrer sets safe for concurrent readers. The previous
+    // batch's commit phase (and, before the first batch, the passes that
+    // built the block-graph) may have left insertions pending.
+    CommitPendingReferrers(*block_graph);
+
+    // Transform the batch on a pool of worker threads.
+    TransformWorkerPool pool(
+        policy, block_graph, profile_, &transforms_, &work_items);
+    size_t num_threads = std::min(max_num_threads_, work_items.size());
+    ScopedVector<base::DelegateSimpleThread> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads.push_back(
+          new base::DelegateSimpleThread(&pool, "SubgraphTransformWorker"));
+      threads.back()->Start();
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Join();
+    if (!pool.success())
       return false;
 
-    // TODO(etienneb): This is needed until the labels refactoring.
-    const BlockVector& blocks = builder.new_blocks();
-    BlockVector::const_iterator new_block = blocks.begin();
-    for (; new_block != blocks.end(); ++new_block)
-      (*new_block)->set_attribute(BlockGraph::BUILT_BY_SYZYGY);
+    // Commit the batch to the block-graph. Each merge deletes the original
+    // block it rebuilds, but the pending subgraphs of the batch still hold
+    // raw pointers to the blocks they were decomposed against: an item that
+    // depends on an already rebuilt peer is stale and is redone here,
+    // against the current block-graph, before being committed. Post-order
+    // places callees right before their callers, so the stale items are
+    // typically callers whose in-batch callees were just rebuilt.
+    std::set<BlockGraph::BlockId> merged_ids;
+    for (size_t i = 0; i < work_items.size(); ++i) {
+      TransformWorkItem* item = work_items[i];
+      BlockGraph::BlockId block_id = item->block->id();
+
+      bool stale = false;
+      std::set<BlockGraph::BlockId>::const_iterator dep_it =
+          item->dependencies.begin();
+      for (; dep_it != item->dependencies.end(); ++dep_it) {
+        if (merged_ids.find(*dep_it) != merged_ids.end()) {
+          stale = true;
+          break;
+        }
+      }
+
+      if (stale &&
+          !DecomposeAndTransformBlock(policy, block_graph, profile_,
+                                      transforms_, &decode_cache, item)) {
+        return false;
+      }
+
+      if (!CommitWorkItem(block_graph, reachability_cache_, item))
+        return false;
+      merged_ids.insert(block_id);
+    }
   }
 
   return true;
@@ -33,6 +33,7 @@
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
 #include "syzygy/optimize/application_profile.h"
+#include "syzygy/optimize/reachability_cache.h"
 #include "syzygy/optimize/transforms/subgraph_transform.h"
 
 namespace optimize {
@@ -48,7 +49,7 @@ class ChainedSubgraphTransforms
 
   // Constructor.
   explicit ChainedSubgraphTransforms(ApplicationProfile* profile)
-      : profile_(profile) {
+      : profile_(profile), max_num_threads_(1), reachability_cache_(NULL) {
     DCHECK_NE(reinterpret_cast<ApplicationProfile*>(NULL), profile);
   }
 
@@ -68,6 +69,33 @@ class ChainedSubgraphTransforms
   // @param transform a transform to be applied.
   void AppendTransform(SubGraphTransformInterface* transform);
 
+  // @name Accessors and mutators.
+  // @{
+  // The maximum number of threads used to run the transform pipeline. When
+  // greater than one, worker threads claim blocks dynamically and apply the
+  // decomposition and the series of transforms concurrently on distinct
+  // subgraphs; rebuilding blocks into the block-graph remains serialized on
+  // the calling thread. The appended transforms must meet the thread-safety
+  // contract documented on
+  // SubGraphTransformInterface::TransformBasicBlockSubGraph. Defaults to 1.
+  size_t max_num_threads() const { return max_num_threads_; }
+  void set_max_num_threads(size_t max_num_threads) {
+    DCHECK_LT(0u, max_num_threads);
+    max_num_threads_ = max_num_threads;
+  }
+
+  // An optional reachability cache shared with the rest of the pipeline.
+  // When set, the cache is computed once before the pipeline runs, blocks
+  // that are unreachable from the image roots are skipped (their transformed
+  // form would be thrown away by the unreachable-block transform anyway) and
+  // the blocks rebuilt by the pipeline are recorded in the cache so that
+  // downstream passes may reuse the computation. The caller retains
+  // ownership and the cache must outlive the transform. Defaults to NULL.
+  void set_reachability_cache(ReachabilityCache* cache) {
+    reachability_cache_ = cache;
+  }
+  // @}
+
   // The transform name.
   static const char kTransformName[];
 
@@ -78,6 +106,12 @@ class ChainedSubgraphTransforms
   // Application profile information.
   ApplicationProfile* profile_;
 
+  // The maximum number of worker threads to use.
+  size_t max_num_threads_;
+
+  // The shared reachability cache, or NULL when reachability is not tracked.
+  ReachabilityCache* reachability_cache_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ChainedSubgraphTransforms);
 };
@@ -129,6 +129,7 @@ class ChainedSubgraphTransformsTest : public testing::Test {
 TEST_F(ChainedSubgraphTransformsTest, Constructor) {
   TestChainedBasicBlockTransforms tx(&profile_);
   EXPECT_EQ(&profile_, tx.profile_);
+  EXPECT_EQ(1U, tx.max_num_threads());
 }
 
 TEST_F(ChainedSubgraphTransformsTest, TransformBlockGraphWithoutTransforms) {
@@ -167,5 +168,37 @@ TEST_F(ChainedSubgraphTransformsTest, TransformBlockGraph) {
       ApplyBlockGraphTransform(&tx, &policy_, &block_graph_, block_header_));
 }
 
+TEST_F(ChainedSubgraphTransformsTest, TransformBlockGraphParallel) {
+  TestChainedBasicBlockTransforms tx(&profile_);
+  tx.set_max_num_threads(4);
+  MockSubGraphTransformInterface transform1;
+  MockSubGraphTransformInterface transform2;
+  tx.AppendTransform(&transform1);
+  tx.AppendTransform(&transform2);
+
+  // Expect each transform to be applied to each block. The blocks may be
+  // processed in any order across the worker threads.
+  BlockGraph::Block* blocks[] = { block1_, block2_, block3_ };
+  MockSubGraphTransformInterface* transforms[] = { &transform1, &transform2 };
+
+  for (size_t i = 0; i < arraysize(blocks); ++i) {
+    for (size_t j = 0; j < arraysize(transforms); ++j) {
+      EXPECT_CALL(
+          *transforms[j],
+          TransformBasicBlockSubGraph(&policy_,
+                                      &block_graph_,
+                                      Property(
+                                          &BasicBlockSubGraph::original_block,
+                                          blocks[i]),
+                                      &profile_,
+                                      NotNull()))
+          .WillOnce(Return(true));
+    }
+  }
+
+  ASSERT_TRUE(
+      ApplyBlockGraphTransform(&tx, &policy_, &block_graph_, block_header_));
+}
+
 }  // namespace transforms
 }  // namespace optimize
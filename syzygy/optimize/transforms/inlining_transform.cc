@@ -38,6 +38,11 @@
 
 #include "syzygy/optimize/transforms/inlining_transform.h"
 
+#include "base/file_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/synchronization/lock.h"
+#include "base/strings/string_split.h"
+#include "base/strings/stringprintf.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
@@ -61,6 +66,7 @@ using block_graph::BasicBlockReference;
 using block_graph::BasicBlockSubGraph;
 using block_graph::BasicCodeBlock;
 using block_graph::BlockGraph;
+using block_graph::BlockHash;
 using block_graph::Displacement;
 using block_graph::Immediate;
 using block_graph::Instruction;
@@ -543,7 +549,10 @@ bool InliningTransform::TransformBasicBlockSubGraph(
 
   // The current block will be rebuilt and erased from the block graph. To avoid
   // dangling pointers, the block is removed from the decomposed cache.
-  subgraph_cache_.erase(caller->id());
+  {
+    base::AutoLock lock(lock_);
+    subgraph_cache_.erase(caller->id());
+  }
 
   // Iterates through each basic block.
   BasicBlockSubGraph::BBCollection::iterator bb_iter =
@@ -596,20 +605,49 @@ bool InliningTransform::TransformBasicBlockSubGraph(
 
       // Look in the subgraph cache for an already decomposed subgraph size for
       // an optimized version of the callee block.
-      SubGraphCache::iterator look = subgraph_cache_.find(callee->id());
-      if (look != subgraph_cache_.end()) {
-        subgraph_size = look->second;
-      } else {
-        // Decompose it. This cannot fail because
-        // BlockIsSafeToBasicBlockDecompose is performed before.
-        CHECK(DecomposeCalleeBlock(callee, &callee_subgraph));
+      bool cached = false;
+      {
+        base::AutoLock lock(lock_);
+        SubGraphCache::iterator look = subgraph_cache_.find(callee->id());
+        if (look != subgraph_cache_.end()) {
+          subgraph_size = look->second;
+          cached = true;
+        }
+      }
+
+      if (!cached) {
+        // Next, look in the summary cache, keyed by the callee contents.
+        // Summaries saved by a previous run are still valid as long as the
+        // callee is unchanged. The hash is computed outside the lock.
+        BlockHash callee_hash(callee);
+        bool summarized = false;
+        {
+          base::AutoLock lock(lock_);
+          SummaryCache::iterator summary = summary_cache_.find(callee_hash);
+          if (summary != summary_cache_.end()) {
+            subgraph_size = summary->second.unsafe_to_inline ?
+                kHugeBlockSize : summary->second.subgraph_size;
+            summarized = true;
+          }
+        }
 
-        // Heuristic to determine the callee size after inlining.
-        DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL),
-                  callee_subgraph.get());
-        subgraph_size = EstimateSubgraphSize(callee_subgraph.get());
+        if (!summarized) {
+          // Decompose it. This cannot fail because
+          // BlockIsSafeToBasicBlockDecompose is performed before. The lock
+          // is not held while decomposing: two threads that miss on the
+          // same callee simply both analyze it and store identical results.
+          CHECK(DecomposeCalleeBlock(callee, &callee_subgraph));
+
+          // Heuristic to determine the callee size after inlining.
+          DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL),
+                    callee_subgraph.get());
+          subgraph_size = EstimateSubgraphSize(callee_subgraph.get());
+        }
 
-        // Cache the resulting size.
+        // Cache the resulting size, for this run and for subsequent runs.
+        base::AutoLock lock(lock_);
+        if (!summarized)
+          summary_cache_[callee_hash].subgraph_size = subgraph_size;
         subgraph_cache_[callee->id()] = subgraph_size;
       }
 
@@ -640,7 +678,10 @@ bool InliningTransform::TransformBasicBlockSubGraph(
         bb->instructions().erase(call_iter);
       } else {
         // Inlining was unsuccessful, avoid any further inlining of this block.
+        BlockHash callee_hash(callee);
+        base::AutoLock lock(lock_);
         subgraph_cache_[callee->id()] = kHugeBlockSize;
+        summary_cache_[callee_hash].unsafe_to_inline = true;
       }
     }
   }
@@ -648,5 +689,68 @@ bool InliningTransform::TransformBasicBlockSubGraph(
   return true;
 }
 
+bool InliningTransform::LoadSummaryCache(const base::FilePath& path) {
+  std::string contents;
+  if (!base::ReadFileToString(path, &contents)) {
+    LOG(ERROR) << "Unable to read summary cache file: " << path.value();
+    return false;
+  }
+
+  // Each line holds one summary: the base16 content hash of the callee, the
+  // estimated subgraph size and the unsafe-to-inline flag.
+  base::AutoLock lock(lock_);
+  std::vector<std::string> lines;
+  base::SplitString(contents, '\n', &lines);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    if (lines[i].empty())
+      continue;
+
+    std::vector<std::string> fields;
+    base::SplitString(lines[i], ' ', &fields);
+    BlockHash hash;
+    std::vector<uint8> digest;
+    size_t subgraph_size = 0;
+    size_t unsafe_to_inline = 0;
+    if (fields.size() != 3 ||
+        !base::HexStringToBytes(fields[0], &digest) ||
+        digest.size() != sizeof(hash.md5_digest) ||
+        !base::StringToSizeT(fields[1], &subgraph_size) ||
+        !base::StringToSizeT(fields[2], &unsafe_to_inline) ||
+        unsafe_to_inline > 1) {
+      LOG(ERROR) << "Invalid summary cache entry: " << lines[i];
+      return false;
+    }
+
+    ::memcpy(&hash.md5_digest, &digest[0], sizeof(hash.md5_digest));
+    CalleeSummary& summary = summary_cache_[hash];
+    summary.subgraph_size = subgraph_size;
+    summary.unsafe_to_inline = (unsafe_to_inline != 0);
+  }
+
+  return true;
+}
+
+bool InliningTransform::SaveSummaryCache(const base::FilePath& path) const {
+  std::string contents;
+  {
+    base::AutoLock lock(lock_);
+    SummaryCache::const_iterator it = summary_cache_.begin();
+    for (; it != summary_cache_.end(); ++it) {
+      base::StringAppendF(&contents, "%s %u %u\n",
+                          base::MD5DigestToBase16(it->first.md5_digest).c_str(),
+                          static_cast<unsigned>(it->second.subgraph_size),
+                          it->second.unsafe_to_inline ? 1 : 0);
+    }
+  }
+
+  if (base::WriteFile(path, contents.data(), contents.size()) !=
+      static_cast<int>(contents.size())) {
+    LOG(ERROR) << "Unable to write summary cache file: " << path.value();
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace transforms
 }  // namespace optimize
@@ -25,6 +25,9 @@
 #ifndef SYZYGY_OPTIMIZE_TRANSFORMS_INLINING_TRANSFORM_H_
 #define SYZYGY_OPTIMIZE_TRANSFORMS_INLINING_TRANSFORM_H_
 
+#include "base/files/file_path.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/block_graph/block_hash.h"
 #include "syzygy/block_graph/filterable.h"
 #include "syzygy/block_graph/transform_policy.h"
 #include "syzygy/optimize/application_profile.h"
@@ -38,13 +41,34 @@ class InliningTransform : public SubGraphTransformInterface {
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::BlockGraph::BlockId BlockId;
+  typedef block_graph::BlockHash BlockHash;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
   typedef std::map<BlockId, size_t> SubGraphCache;
 
+  // The summary of the analysis of a callee. Summaries are keyed by the
+  // content hash of the callee block, so they remain valid from one run to
+  // the next as long as the callee is unchanged.
+  struct CalleeSummary {
+    CalleeSummary() : subgraph_size(0), unsafe_to_inline(false) {
+    }
+
+    // The estimated size of the callee after decomposition and
+    // simplification.
+    size_t subgraph_size;
+
+    // Set when a previous inlining attempt found the callee body to be
+    // non-trivial (e.g. it has control flow or manipulates the stack frame).
+    // Such callees are never re-analyzed.
+    bool unsafe_to_inline;
+  };
+  typedef std::map<BlockHash, CalleeSummary> SummaryCache;
+
   // Constructor.
   InliningTransform() { }
 
-  // @name SubGraphTransformInterface implementation.
+  // @name SubGraphTransformInterface implementation. This implementation
+  //     may be invoked concurrently on distinct subgraphs; accesses to the
+  //     shared caches are serialized on lock_.
   // @{
   virtual bool TransformBasicBlockSubGraph(
       const TransformPolicyInterface* policy,
@@ -54,10 +78,34 @@ class InliningTransform : public SubGraphTransformInterface {
       SubGraphProfile* subgraph_profile) OVERRIDE;
   // @}
 
+  // Load the callee summaries saved by a previous run. Entries for callees
+  // whose content changed since are simply never consulted. Takes lock_, so
+  // this may be called even while the transform is running.
+  // @param path the file to load the summaries from.
+  // @returns true on success, false otherwise.
+  bool LoadSummaryCache(const base::FilePath& path);
+
+  // Save the callee summaries accumulated during this run, to be reused by
+  // subsequent runs. Takes lock_, so this may be called even while the
+  // transform is running.
+  // @param path the file to save the summaries to.
+  // @returns true on success, false otherwise.
+  bool SaveSummaryCache(const base::FilePath& path) const;
+
  protected:
-  // A cache of decomposed subgraph sizes.
+  // Serializes access to the caches below, as the transform may run
+  // concurrently on several subgraphs. Mutable so that the caches can be
+  // read from const member functions.
+  mutable base::Lock lock_;
+
+  // A cache of decomposed subgraph sizes, keyed by block id. Only valid
+  // within a single run. Under lock_.
   SubGraphCache subgraph_cache_;
 
+  // A cache of callee summaries, keyed by block content hash. May be
+  // persisted across runs. Under lock_.
+  SummaryCache summary_cache_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(InliningTransform);
 };
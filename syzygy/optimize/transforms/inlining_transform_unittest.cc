@@ -14,6 +14,7 @@
 
 #include "syzygy/optimize/transforms/inlining_transform.h"
 
+#include "base/files/scoped_temp_dir.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/basic_block.h"
@@ -138,6 +139,7 @@ const uint8 kStackCst[] = { 0x6A, 0x02, 0x58, 0xC3 };
 class TestInliningTransform : public InliningTransform {
  public:
   using InliningTransform::subgraph_cache_;
+  using InliningTransform::summary_cache_;
 };
 
 class InliningTransformTest : public testing::Test {
@@ -343,6 +345,45 @@ TEST_F(InliningTransformTest, SubgraphCache) {
   EXPECT_EQ(1U, tx.subgraph_cache_.size());
 }
 
+TEST_F(InliningTransformTest, SummaryCachePersistence) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath cache_path = temp_dir.path().Append(L"summaries.txt");
+
+  TestInliningTransform tx;
+
+  // Create a valid inlining candidate.
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRet42, sizeof(kCodeRet42), &callee_));
+  ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+
+  // Decompose to subgraph.
+  BasicBlockSubGraph subgraph;
+  BasicBlockDecomposer decomposer(caller_, &subgraph);
+  ASSERT_TRUE(decomposer.Decompose());
+
+  // Apply inlining transform.
+  ASSERT_TRUE(
+      tx.TransformBasicBlockSubGraph(&policy_, &block_graph_, &subgraph,
+                                     &profile_, &subgraph_profile_));
+
+  // Expect a summary to be cached for the callee, keyed by its content hash.
+  block_graph::BlockHash callee_hash(callee_);
+  ASSERT_EQ(1U, tx.summary_cache_.size());
+  ASSERT_EQ(1U, tx.summary_cache_.count(callee_hash));
+  EXPECT_LT(0U, tx.summary_cache_[callee_hash].subgraph_size);
+  EXPECT_FALSE(tx.summary_cache_[callee_hash].unsafe_to_inline);
+
+  // The summaries must survive a round-trip through a file.
+  ASSERT_TRUE(tx.SaveSummaryCache(cache_path));
+  TestInliningTransform reloaded;
+  ASSERT_TRUE(reloaded.LoadSummaryCache(cache_path));
+  ASSERT_EQ(1U, reloaded.summary_cache_.count(callee_hash));
+  EXPECT_EQ(tx.summary_cache_[callee_hash].subgraph_size,
+            reloaded.summary_cache_[callee_hash].subgraph_size);
+  EXPECT_FALSE(reloaded.summary_cache_[callee_hash].unsafe_to_inline);
+}
+
 TEST_F(InliningTransformTest, PreTransformValidation) {
   ASSERT_NO_FATAL_FAILURE(
       AddBlockFromBuffer(kCodeRet, sizeof(kCodeRet), &callee_));
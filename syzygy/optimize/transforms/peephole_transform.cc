@@ -185,12 +185,25 @@ bool SimplifyBasicBlock(BasicBlock* basic_block) {
 bool PeepholeTransform::SimplifySubgraph(BasicBlockSubGraph* subgraph) {
   DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
 
+  LivenessAnalysis::BasicBlockSet modified;
+  return SimplifySubgraph(subgraph, &modified);
+}
+
+bool PeepholeTransform::SimplifySubgraph(
+    BasicBlockSubGraph* subgraph,
+    LivenessAnalysis::BasicBlockSet* modified) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<LivenessAnalysis::BasicBlockSet*>(NULL),
+            modified);
+
   bool changed = false;
   BBCollection& basic_blocks = subgraph->basic_blocks();
   BBCollection::iterator it = basic_blocks.begin();
   for (; it != basic_blocks.end(); ++it) {
-    if (SimplifyBasicBlock(*it))
+    if (SimplifyBasicBlock(*it)) {
+      modified->insert(*it);
       changed = true;
+    }
   }
 
   return changed;
@@ -199,14 +212,26 @@ bool PeepholeTransform::SimplifySubgraph(BasicBlockSubGraph* subgraph) {
 bool PeepholeTransform::RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph) {
   DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
 
-  bool changed = false;
-  BBCollection& basic_blocks = subgraph->basic_blocks();
-  BBCollection::iterator it = basic_blocks.begin();
-
   // Perform a global liveness analysis.
   LivenessAnalysis liveness;
   liveness.Analyze(subgraph);
 
+  LivenessAnalysis::BasicBlockSet modified;
+  return RemoveDeadCodeSubgraph(subgraph, liveness, &modified);
+}
+
+bool PeepholeTransform::RemoveDeadCodeSubgraph(
+    BasicBlockSubGraph* subgraph,
+    const LivenessAnalysis& liveness,
+    LivenessAnalysis::BasicBlockSet* modified) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<LivenessAnalysis::BasicBlockSet*>(NULL),
+            modified);
+
+  bool changed = false;
+  BBCollection& basic_blocks = subgraph->basic_blocks();
+  BBCollection::iterator it = basic_blocks.begin();
+
   // For each basic block, remove dead instructions.
   for (; it != basic_blocks.end(); ++it) {
     BasicCodeBlock* basic_block = BasicCodeBlock::Cast(*it);
@@ -300,6 +325,7 @@ bool PeepholeTransform::RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph) {
         Instructions::const_iterator it = rev_iter_inst.base();
         rev_iter_inst = Instructions::reverse_iterator(
             basic_block->instructions().erase(it));
+        modified->insert(basic_block);
         changed = true;
 
         // Do not propagate liveness backward.
@@ -326,13 +352,22 @@ bool PeepholeTransform::TransformBasicBlockSubGraph(
   DCHECK_NE(reinterpret_cast<ApplicationProfile*>(NULL), profile);
   DCHECK_NE(reinterpret_cast<SubGraphProfile*>(NULL), subgraph_profile);
 
+  LivenessAnalysis liveness;
+  LivenessAnalysis::BasicBlockSet modified;
   bool changed = false;
   do {
     changed = false;
 
-    if (SimplifySubgraph(subgraph))
+    if (SimplifySubgraph(subgraph, &modified))
       changed = true;
-    if (RemoveDeadCodeSubgraph(subgraph))
+
+    // Bring the liveness information up to date. The first round performs a
+    // full analysis; subsequent rounds only re-solve the basic blocks
+    // modified since the previous one, and their transitive predecessors.
+    liveness.AnalyzeModified(subgraph, modified);
+    modified.clear();
+
+    if (RemoveDeadCodeSubgraph(subgraph, liveness, &modified))
       changed = true;
   } while (changed);
 
@@ -20,6 +20,7 @@
 #ifndef SYZYGY_OPTIMIZE_TRANSFORMS_PEEPHOLE_TRANSFORM_H_
 #define SYZYGY_OPTIMIZE_TRANSFORMS_PEEPHOLE_TRANSFORM_H_
 
+#include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/block_graph/filterable.h"
 #include "syzygy/block_graph/transform_policy.h"
 #include "syzygy/optimize/application_profile.h"
@@ -35,6 +36,7 @@ class PeepholeTransform : public SubGraphTransformInterface {
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+  typedef block_graph::analysis::LivenessAnalysis LivenessAnalysis;
 
   // Constructor.
   PeepholeTransform() { }
@@ -57,12 +59,31 @@ class PeepholeTransform : public SubGraphTransformInterface {
   // @returns true if the subgraph has been simplified, false otherwise.
   static bool SimplifySubgraph(BasicBlockSubGraph* subgraph);
 
+  // Apply a sequence of patterns to simplify the contents of a subgraph. The
+  // sequence of patterns is applied once.
+  // @param subgraph the subgraph to simplify.
+  // @param modified receives the basic blocks that have been simplified.
+  // @returns true if the subgraph has been simplified, false otherwise.
+  static bool SimplifySubgraph(BasicBlockSubGraph* subgraph,
+                               LivenessAnalysis::BasicBlockSet* modified);
+
   // Remove dead instructions in the contents of a subgraph. The dead code
   // elimination is applied once.
   // @param subgraph the subgraph to simplify.
   // @returns true if the subgraph has been simplified, false otherwise.
   static bool RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph);
 
+  // Remove dead instructions in the contents of a subgraph, reusing a
+  // previously computed liveness analysis. The dead code elimination is
+  // applied once.
+  // @param subgraph the subgraph to simplify.
+  // @param liveness the up-to-date liveness information for @p subgraph.
+  // @param modified receives the basic blocks that have been simplified.
+  // @returns true if the subgraph has been simplified, false otherwise.
+  static bool RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph,
+                                     const LivenessAnalysis& liveness,
+                                     LivenessAnalysis::BasicBlockSet* modified);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(PeepholeTransform);
 };
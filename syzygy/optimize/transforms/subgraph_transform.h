@@ -36,6 +36,12 @@ class SubGraphTransformInterface {
 
   // Applies this transform to the provided block.
   //
+  // When ChainedSubgraphTransforms runs with multiple threads this method
+  // is invoked concurrently, each invocation with a distinct subgraph.
+  // Implementations must therefore only read the block-graph, never mutate
+  // it, and must serialize access to any state they share between
+  // invocations (caches, statistics, etc).
+  //
   // @param policy The policy object restricting how the transform is applied.
   // @param block_graph the block-graph of which the basic block subgraph
   //     is a part.
@@ -16,8 +16,6 @@
 
 #include "syzygy/optimize/transforms/unreachable_block_transform.h"
 
-#include <stack>
-
 namespace optimize {
 namespace transforms {
 
@@ -28,8 +26,7 @@ struct SubTreeInformation;
 
 using block_graph::BlockGraph;
 typedef BlockGraph::Block::ReferenceMap ReferenceMap;
-typedef std::set<const BlockGraph::Block*> ReachableSet;
-typedef std::stack<const BlockGraph::Block*> ReachableStack;
+typedef std::set<const BlockGraph::Block*> VisitedSet;
 typedef std::map<const BlockGraph::Block*, SubTreeInformation> RecursiveSizeMap;
 
 struct SubTreeInformation {
@@ -41,11 +38,11 @@ struct SubTreeInformation {
 // from the given root |block|.
 void ComputeSubTreeInformation(const BlockGraph::Block* block,
                                const BlockGraph::BlockMap& blocks,
-                               const ReachableSet& reachable,
+                               const ReachabilityCache& reachable,
                                SubTreeInformation* subtree,
-                               ReachableSet* visited) {
+                               VisitedSet* visited) {
   DCHECK_NE(reinterpret_cast<SubTreeInformation*>(NULL), subtree);
-  DCHECK_NE(reinterpret_cast<ReachableSet*>(NULL), visited);
+  DCHECK_NE(reinterpret_cast<VisitedSet*>(NULL), visited);
 
   // Avoid repeatedly visiting the same block within a sub-tree. Even if a block
   // is reachable via multiple paths, it contributes only once to the size of
@@ -62,7 +59,7 @@ void ComputeSubTreeInformation(const BlockGraph::Block* block,
   ReferenceMap::const_iterator reference = references.begin();
   for (; reference != references.end(); ++reference) {
     const BlockGraph::Block* reference_block = reference->second.referenced();
-    if (reachable.find(reference_block) != reachable.end())
+    if (reachable.IsReachable(reference_block))
       continue;
     ComputeSubTreeInformation(
         reference_block, blocks, reachable, subtree, visited);
@@ -71,7 +68,7 @@ void ComputeSubTreeInformation(const BlockGraph::Block* block,
 
 bool DumpUnreachableCallgraph(const base::FilePath& path,
                               const BlockGraph::BlockMap& blocks,
-                              const ReachableSet& reachable) {
+                              const ReachabilityCache& reachable) {
 
   // A cache of computed sizes.
   RecursiveSizeMap subtrees;
@@ -88,21 +85,21 @@ bool DumpUnreachableCallgraph(const base::FilePath& path,
   BlockGraph::BlockMap::const_iterator block_iter = blocks.begin();
   for (block_iter = blocks.begin(); block_iter != blocks.end(); ++block_iter) {
     const BlockGraph::Block* block = &block_iter->second;
-    if (reachable.find(block) != reachable.end())
+    if (reachable.IsReachable(block))
       continue;
 
     ::fprintf(file.get(), "ob=%s\n", block->compiland_name().c_str());
     ::fprintf(file.get(), "fn=%s\n", block->name().c_str());
     ::fprintf(file.get(), "%u %u %u\n", block->id(), block->size(), 1);
 
-    ReachableSet subtree_visited;
+    VisitedSet subtree_visited;
     subtree_visited.insert(block);
 
     const ReferenceMap& references = block->references();
     ReferenceMap::const_iterator reference = references.begin();
     for (; reference != references.end(); ++reference) {
       const BlockGraph::Block* reference_block = reference->second.referenced();
-      if (reachable.find(reference_block) != reachable.end())
+      if (reachable.IsReachable(reference_block))
         continue;
       if (subtree_visited.find(reference_block) != subtree_visited.end())
         continue;
@@ -146,48 +143,29 @@ bool UnreachableBlockTransform::TransformBlockGraph(
     BlockGraph* block_graph,
     BlockGraph::Block* header_block) {
 
-  ReachableSet reachable;
-  ReachableStack working;
-
-  // Mark roots as reachable.
-  reachable.insert(header_block);
-  working.push(header_block);
+  // Use the shared reachability cache when one was provided, computing it
+  // only if no upstream pass has done so already. Without a shared cache the
+  // reachable set is computed into a local one.
+  ReachabilityCache local_cache;
+  ReachabilityCache* reachable = reachability_cache_;
+  if (reachable == NULL)
+    reachable = &local_cache;
+  if (!reachable->is_valid())
+    reachable->Compute(*block_graph, header_block);
 
   BlockGraph::BlockMap& blocks = block_graph->blocks_mutable();
-  BlockGraph::BlockMap::iterator block_iter = blocks.begin();
-  for (block_iter = blocks.begin(); block_iter != blocks.end(); ++block_iter) {
-    BlockGraph::Block* block = &block_iter->second;
-    if ((block->attributes() & BlockGraph::PE_PARSED) == 0)
-      continue;
-    reachable.insert(block);
-    working.push(block);
-  }
-
-  // Follow the reachable graph.
-  while (!working.empty()) {
-    const BlockGraph::Block* block = working.top();
-    working.pop();
-
-    const ReferenceMap& references = block->references();
-    ReferenceMap::const_iterator reference = references.begin();
-    for (; reference != references.end(); ++reference) {
-      const BlockGraph::Block* reference_block = reference->second.referenced();
-      if (reachable.insert(reference_block).second)
-        working.push(reference_block);
-    }
-  }
 
   // Dump a cachegrind graph of unreachable blocks.
   if (!unreachable_graph_path_.empty())
-    DumpUnreachableCallgraph(unreachable_graph_path_, blocks, reachable);
+    DumpUnreachableCallgraph(unreachable_graph_path_, blocks, *reachable);
 
   // Remove references of unreachable blocks. This pass is needed because blocks
   // with references cannot be removed.
-  block_iter = blocks.begin();
+  BlockGraph::BlockMap::iterator block_iter = blocks.begin();
   std::vector<BlockGraph::BlockId> to_remove;
   for (block_iter = blocks.begin(); block_iter != blocks.end(); ++block_iter) {
     BlockGraph::Block* block = &block_iter->second;
-    if (reachable.find(block) == reachable.end()) {
+    if (!reachable->IsReachable(block)) {
       block->RemoveAllReferences();
       to_remove.push_back(block->id());
     }
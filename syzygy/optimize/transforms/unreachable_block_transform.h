@@ -28,6 +28,7 @@
 
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
+#include "syzygy/optimize/reachability_cache.h"
 
 namespace optimize {
 namespace transforms {
@@ -40,7 +41,7 @@ class UnreachableBlockTransform
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
 
   // Constructor.
-  UnreachableBlockTransform() {
+  UnreachableBlockTransform() : reachability_cache_(NULL) {
   }
 
   // Apply the transform on a given block graph.
@@ -62,10 +63,23 @@ class UnreachableBlockTransform
     unreachable_graph_path_ = path;
   }
 
+  // Set a reachability cache to share with other passes of the pipeline.
+  // When the cache is already valid, the transform reuses it instead of
+  // recomputing the reachable set; otherwise it computes into the cache so
+  // that downstream passes may reuse the result.
+  // @param cache the cache to use. The caller retains ownership and the
+  //     cache must outlive the transform.
+  void set_reachability_cache(ReachabilityCache* cache) {
+    reachability_cache_ = cache;
+  }
+
  private:
   // The path to dump a cachegrind file of the unreachable blocks.
   base::FilePath unreachable_graph_path_;
 
+  // The shared reachability cache, or NULL to compute locally.
+  ReachabilityCache* reachability_cache_;
+
   DISALLOW_COPY_AND_ASSIGN(UnreachableBlockTransform);
 };
 
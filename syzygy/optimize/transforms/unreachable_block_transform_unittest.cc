@@ -132,6 +132,43 @@ TEST_F(UnreachableBlockTransformTest, UsedPEParsedBlock) {
   EXPECT_EQ(code3_, block_graph_.GetBlockById(code3_id_));
 }
 
+TEST_F(UnreachableBlockTransformTest, SharedReachabilityCache) {
+  DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), code1_);
+  DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), code2_);
+  DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), code3_);
+
+  // Compute the reachability cache up front, as an upstream pass would.
+  ReachabilityCache cache;
+  cache.Compute(block_graph_, code1_);
+  tx_.set_reachability_cache(&cache);
+
+  // Apply the unreachable transform. It reuses the cache rather than
+  // recomputing the reachable set.
+  EXPECT_TRUE(tx_.TransformBlockGraph(&policy_, &block_graph_, code1_));
+
+  // Validates that code1_ and code2_ are still present and code3_ has been
+  // removed by the transform.
+  EXPECT_EQ(code1_, block_graph_.GetBlockById(code1_id_));
+  EXPECT_EQ(code2_, block_graph_.GetBlockById(code2_id_));
+  EXPECT_EQ(NULL, block_graph_.GetBlockById(code3_id_));
+}
+
+TEST_F(UnreachableBlockTransformTest, PopulatesSharedReachabilityCache) {
+  DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), code1_);
+
+  // Hand the transform an empty cache; it computes into it so downstream
+  // passes may reuse the result.
+  ReachabilityCache cache;
+  tx_.set_reachability_cache(&cache);
+
+  EXPECT_TRUE(tx_.TransformBlockGraph(&policy_, &block_graph_, code1_));
+
+  EXPECT_TRUE(cache.is_valid());
+  EXPECT_TRUE(cache.IsReachable(code1_));
+  EXPECT_TRUE(cache.IsReachable(code2_));
+  EXPECT_EQ(NULL, block_graph_.GetBlockById(code3_id_));
+}
+
 TEST_F(UnreachableBlockTransformTest, UnreachableGraphProduced) {
   DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), code1_);
   DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), code2_);
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 
+#include "base/logging.h"
 #include "syzygy/pdb/pdb_util.h"
 
 namespace pdb {
@@ -57,6 +58,64 @@ core::RelativeAddress TranslateAddressViaOmap(const std::vector<OMAP>& omaps,
       (address - core::RelativeAddress(it->rva));
 }
 
+void OmapTable::Init(const std::vector<OMAP>& omaps) {
+  DCHECK(OmapVectorIsValid(omaps));
+
+  omaps_ = omaps;
+  page_index_.clear();
+
+  if (omaps_.empty())
+    return;
+
+  // Record, for each page, the index of the first entry at or beyond the
+  // start of that page. The entries are sorted, so this is a single merged
+  // walk of the pages and the entries.
+  size_t num_pages = (omaps_.back().rva >> kPageShift) + 1;
+  page_index_.resize(num_pages + 1);
+  size_t entry = 0;
+  for (size_t page = 0; page <= num_pages; ++page) {
+    uint64 page_start = static_cast<uint64>(page) << kPageShift;
+    while (entry < omaps_.size() && omaps_[entry].rva < page_start)
+      ++entry;
+    page_index_[page] = entry;
+  }
+  DCHECK_EQ(omaps_.size(), static_cast<size_t>(page_index_.back()));
+}
+
+core::RelativeAddress OmapTable::Translate(
+    core::RelativeAddress address) const {
+  if (omaps_.empty())
+    return address;
+
+  // Find the first element that is > than the address, searching only the
+  // entries of the page it falls in. Entries in earlier pages all precede
+  // the address and entries in later pages all follow it, so this agrees
+  // with a search of the full vector.
+  std::vector<OMAP>::const_iterator it;
+  size_t page = address.value() >> kPageShift;
+  if (page + 1 >= page_index_.size()) {
+    // The address lies beyond the page holding the last entry, so every
+    // entry precedes it.
+    it = omaps_.end();
+  } else {
+    OMAP omap_address = CreateOmap(address.value(), 0);
+    it = std::upper_bound(omaps_.begin() + page_index_[page],
+                          omaps_.begin() + page_index_[page + 1],
+                          omap_address,
+                          OmapLess);
+  }
+
+  // If we are at the first OMAP entry, the address is before any addresses
+  // that are OMAPped. Thus, we return the same address.
+  if (it == omaps_.begin())
+    return address;
+
+  // Otherwise, the previous OMAP entry tells us where we lie.
+  --it;
+  return core::RelativeAddress(it->rvaTo) +
+      (address - core::RelativeAddress(it->rva));
+}
+
 bool ReadOmapsFromPdbFile(const PdbFile& pdb_file,
                           std::vector<OMAP>* omap_to,
                           std::vector<OMAP>* omap_from) {
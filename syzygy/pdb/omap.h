@@ -53,6 +53,46 @@ bool OmapVectorIsValid(const std::vector<OMAP>& omaps);
 core::RelativeAddress TranslateAddressViaOmap(const std::vector<OMAP>& omaps,
                                               core::RelativeAddress address);
 
+// A precomputed page-indexed lookup table over a set of OMAP entries. The
+// table costs a single pass over the entries to build plus 4 bytes per 4KB
+// page of the mapped address space, and confines each subsequent lookup to
+// the handful of entries covering one page. Use this in preference to
+// TranslateAddressViaOmap when translating addresses in bulk, as the latter
+// binary-searches the full vector on every call.
+class OmapTable {
+ public:
+  OmapTable() { }
+
+  // Builds the table for the given OMAP entries. May be called again to
+  // rebuild the table for a different set of entries.
+  //
+  // @param omaps the vector of OMAPs to apply. A copy is kept, so the
+  //     vector need not outlive this table.
+  // @pre OmapVectorIsValid(omaps) is true.
+  void Init(const std::vector<OMAP>& omaps);
+
+  // Maps an address through the OMAP information this table was built for.
+  // This returns exactly the same addresses as TranslateAddressViaOmap does
+  // for the same entries.
+  //
+  // @param address the address to map.
+  // @returns the mapped address.
+  core::RelativeAddress Translate(core::RelativeAddress address) const;
+
+ private:
+  // The base-2 logarithm of the page size the table is indexed by.
+  static const uint32 kPageShift = 12;
+
+  // The OMAP entries this table was built for.
+  std::vector<OMAP> omaps_;
+
+  // For each page of the address space up to and including the one holding
+  // the last OMAP entry, the index of the first entry with an 'rva' at or
+  // beyond the start of the page. The final element is the total number of
+  // entries, so that consecutive elements bound the entries of each page.
+  std::vector<uint32> page_index_;
+};
+
 // Reads OMAP tables from a PdbFile. The destination vectors may be NULL if
 // they are not required to be read. Even if neither stream is read they will be
 // checked for existence.
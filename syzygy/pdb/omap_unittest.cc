@@ -82,6 +82,36 @@ TEST(OmapTest, Translate) {
             TranslateAddressViaOmap(omaps, RelativeAddress(3500)));
 }
 
+TEST(OmapTest, OmapTableTranslate) {
+  // A table over no entries maps every address to itself.
+  std::vector<OMAP> omaps;
+  OmapTable table;
+  table.Init(omaps);
+  EXPECT_EQ(RelativeAddress(500), table.Translate(RelativeAddress(500)));
+
+  // The same mapping as the Translate test above, extended with a densely
+  // mapped page and a distant final entry so that several pages lie between
+  // entries.
+  omaps.push_back(CreateOmap(1000, 2000));
+  omaps.push_back(CreateOmap(2000, 1000));
+  omaps.push_back(CreateOmap(3000, 3000));
+  omaps.push_back(CreateOmap(0x5000, 0x9000));
+  omaps.push_back(CreateOmap(0x5010, 0x8000));
+  omaps.push_back(CreateOmap(0x5020, 0x7000));
+  omaps.push_back(CreateOmap(0x20000, 0x30000));
+  ASSERT_TRUE(OmapVectorIsValid(omaps));
+
+  table.Init(omaps);
+
+  // The table agrees with the direct search everywhere: within densely
+  // mapped pages, in pages with no entries of their own, before the first
+  // entry and beyond the last one.
+  for (uint32 address = 0; address < 0x22000; address += 7) {
+    RelativeAddress rva(address);
+    EXPECT_EQ(TranslateAddressViaOmap(omaps, rva), table.Translate(rva));
+  }
+}
+
 TEST(OmapTest, ReadOmapsFromPdbFile) {
   std::vector<OMAP> omap_to, omap_from;
 
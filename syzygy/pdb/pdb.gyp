@@ -50,12 +50,15 @@
         'pdb_type_info_stream.h',
         'pdb_util.cc',
         'pdb_util.h',
+        'pdb_view_stream.cc',
+        'pdb_view_stream.h',
         'pdb_writer.cc',
         'pdb_writer.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
       ],
     },
     {
@@ -87,6 +90,7 @@
         'pdb_symbol_record_unittest.cc',
         'pdb_type_info_stream_unittest.cc',
         'pdb_util_unittest.cc',
+        'pdb_view_stream_unittest.cc',
         'pdb_writer_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
       ],
@@ -27,6 +27,9 @@
 
 namespace pdb {
 
+// A map of names to stream IDs, stored in the header stream.
+typedef std::map<std::string, uint32> NameStreamMap;
+
 // Pdb Info Stream Header, this is at the start of stream #1.
 struct PdbInfoHeader70 {
   // Equal to kPdbCurrentVersion for PDBs seen from VS 9.0.
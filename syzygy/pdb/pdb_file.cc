@@ -14,9 +14,16 @@
 
 #include "syzygy/pdb/pdb_file.h"
 
+#include "base/logging.h"
+#include "syzygy/pdb/pdb_type_info_stream.h"
+#include "syzygy/pdb/pdb_util.h"
+
 namespace pdb {
 
-PdbFile::PdbFile() {
+PdbFile::PdbFile()
+    : header_info_valid_(false), type_info_header_valid_(false) {
+  ::memset(&pdb_header_, 0, sizeof(pdb_header_));
+  ::memset(&type_info_header_, 0, sizeof(type_info_header_));
 }
 
 PdbFile::~PdbFile() {
@@ -25,6 +32,9 @@ PdbFile::~PdbFile() {
 
 void PdbFile::Clear() {
   streams_.clear();
+  header_info_valid_ = false;
+  name_stream_map_.clear();
+  type_info_header_valid_ = false;
 }
 
 scoped_refptr<PdbStream> PdbFile::GetStream(uint32 index) const {
@@ -35,12 +45,14 @@ scoped_refptr<PdbStream> PdbFile::GetStream(uint32 index) const {
 size_t PdbFile::AppendStream(PdbStream* pdb_stream) {
   size_t index = streams_.size();
   streams_.push_back(pdb_stream);
+  InvalidateIndexes(index);
   return index;
 }
 
 void PdbFile::ReplaceStream(uint32 index, PdbStream* pdb_stream) {
   DCHECK_LT(index, streams_.size());
   streams_[index] = pdb_stream;
+  InvalidateIndexes(index);
 }
 
 void PdbFile::SetStream(uint32 index, PdbStream* pdb_stream) {
@@ -48,6 +60,68 @@ void PdbFile::SetStream(uint32 index, PdbStream* pdb_stream) {
     streams_.resize(index + 1);
 
   streams_[index] = pdb_stream;
+  InvalidateIndexes(index);
+}
+
+bool PdbFile::GetHeaderInfo(PdbInfoHeader70* pdb_header,
+                            const NameStreamMap** name_stream_map) const {
+  if (!header_info_valid_) {
+    if (kPdbHeaderInfoStream >= streams_.size() ||
+        streams_[kPdbHeaderInfoStream].get() == NULL) {
+      LOG(ERROR) << "No header info stream found.";
+      return false;
+    }
+    name_stream_map_.clear();
+    if (!ReadHeaderInfoStream(streams_[kPdbHeaderInfoStream].get(),
+                              &pdb_header_, &name_stream_map_)) {
+      LOG(ERROR) << "Failed to read header info stream.";
+      return false;
+    }
+    header_info_valid_ = true;
+  }
+
+  if (pdb_header != NULL)
+    *pdb_header = pdb_header_;
+  if (name_stream_map != NULL)
+    *name_stream_map = &name_stream_map_;
+  return true;
+}
+
+void PdbFile::SetHeaderInfo(const PdbInfoHeader70& pdb_header,
+                            const NameStreamMap& name_stream_map) {
+  pdb_header_ = pdb_header;
+  name_stream_map_ = name_stream_map;
+  header_info_valid_ = true;
+}
+
+bool PdbFile::GetTypeInfoHeader(TypeInfoHeader* type_info_header) const {
+  DCHECK(type_info_header != NULL);
+
+  if (!type_info_header_valid_) {
+    if (kTpiStream >= streams_.size() ||
+        streams_[kTpiStream].get() == NULL) {
+      LOG(ERROR) << "No type info stream found.";
+      return false;
+    }
+    if (!ReadTypeInfoHeader(streams_[kTpiStream].get(),
+                            &type_info_header_)) {
+      LOG(ERROR) << "Failed to read type info stream header.";
+      return false;
+    }
+    type_info_header_valid_ = true;
+  }
+
+  *type_info_header = type_info_header_;
+  return true;
+}
+
+void PdbFile::InvalidateIndexes(uint32 index) {
+  if (index == kPdbHeaderInfoStream) {
+    header_info_valid_ = false;
+    name_stream_map_.clear();
+  } else if (index == kTpiStream) {
+    type_info_header_valid_ = false;
+  }
 }
 
 }  // namespace pdb
@@ -22,6 +22,7 @@
 
 #include <vector>
 
+#include "syzygy/pdb/pdb_data.h"
 #include "syzygy/pdb/pdb_stream.h"
 
 namespace pdb {
@@ -70,10 +71,61 @@ class PdbFile {
   // @returns the number of streams in the PDB file.
   size_t StreamCount() const { return streams_.size(); }
 
+  // @name Lazily built indexes.
+  // These are parsed from the well-known streams the first time they are
+  // queried and then cached, so that the many consumers of a PdbFile (PDB
+  // mutators in particular) don't each reparse the streams. An index is
+  // invalidated automatically when the stream it is built from is replaced;
+  // code that rewrites such a stream in place must keep the index up to
+  // date, either via SetHeaderInfo or by replacing the stream.
+  // @{
+
+  // Gets the header record and named stream map of this PDB, parsing the
+  // header info stream on first use.
+  // @param pdb_header receives the header record. May be NULL.
+  // @param name_stream_map receives a pointer to the cached name-stream
+  //     map, valid until the index is invalidated. May be NULL.
+  // @returns true on success, false if the header info stream is missing
+  //     or malformed.
+  bool GetHeaderInfo(PdbInfoHeader70* pdb_header,
+                     const NameStreamMap** name_stream_map) const;
+
+  // Replaces the cached header info index. Intended for use by code that
+  // rewrites the header info stream in place (see WriteHeaderInfoStream),
+  // keeping the index warm rather than forcing a reparse.
+  // @param pdb_header the header record that was written.
+  // @param name_stream_map the name-stream map that was written.
+  void SetHeaderInfo(const PdbInfoHeader70& pdb_header,
+                     const NameStreamMap& name_stream_map);
+
+  // Gets the type info stream header of this PDB, whose type_min and
+  // type_max fields bound the range of type indexes in use, parsing the
+  // type info stream on first use.
+  // @param type_info_header receives the type info stream header.
+  // @returns true on success, false if the type info stream is missing
+  //     or malformed.
+  bool GetTypeInfoHeader(TypeInfoHeader* type_info_header) const;
+
+  // @}
+
  private:
+  // Invalidates any lazily built index that is derived from the stream
+  // with the given ID.
+  void InvalidateIndexes(uint32 index);
+
   // The streams are implicitly numbered simply by their position in this
   // vector.
   std::vector<scoped_refptr<PdbStream>> streams_;
+
+  // @name Lazily built indexes, built on demand by the const getters above
+  //     (hence mutable).
+  // @{
+  mutable bool header_info_valid_;
+  mutable PdbInfoHeader70 pdb_header_;
+  mutable NameStreamMap name_stream_map_;
+  mutable bool type_info_header_valid_;
+  mutable TypeInfoHeader type_info_header_;
+  // @}
 };
 
 }  // namespace pdb
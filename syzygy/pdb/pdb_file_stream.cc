@@ -83,4 +83,66 @@ bool PdbFileStream::ReadFromPage(void* dest, uint32 page_num, size_t offset,
   return true;
 }
 
+PdbMappedFileStream::PdbMappedFileStream(RefCountedMappedFile* file,
+                                         size_t length,
+                                         const uint32* pages,
+                                         size_t page_size)
+    : PdbStream(length),
+      file_(file),
+      page_size_(page_size) {
+  DCHECK(file->mapping().IsValid());
+  size_t num_pages = (length + page_size - 1) / page_size;
+  pages_.assign(pages, pages + num_pages);
+}
+
+PdbMappedFileStream::~PdbMappedFileStream() {
+}
+
+bool PdbMappedFileStream::ReadBytes(void* dest, size_t count,
+                                    size_t* bytes_read) {
+  DCHECK(dest != NULL);
+  DCHECK(bytes_read != NULL);
+
+  // Return 0 once we've reached the end of the stream.
+  if (pos() == length()) {
+    *bytes_read = 0;
+    return true;
+  }
+
+  // Don't read beyond the end of the known stream length.
+  count = std::min(count, length() - pos());
+  *bytes_read = count;
+
+  // Copy the stream out of the mapping, coalescing runs of pages that are
+  // contiguous in the file into a single copy each.
+  while (count > 0) {
+    size_t page_index = pos() / page_size_;
+    size_t offset = pos() % page_size_;
+
+    // Extend the run for as long as the stream's pages are adjacent in the
+    // file.
+    size_t run_end = page_index + 1;
+    size_t run_size = page_size_ - offset;
+    while (run_size < count && run_end < pages_.size() &&
+           pages_[run_end] == pages_[run_end - 1] + 1) {
+      run_size += page_size_;
+      ++run_end;
+    }
+    size_t chunk_size = std::min(count, run_size);
+
+    size_t file_offset = page_size_ * pages_[page_index] + offset;
+    if (file_offset + chunk_size > file_->mapping().length()) {
+      LOG(ERROR) << "Page read beyond end of mapped file.";
+      return false;
+    }
+    ::memcpy(dest, file_->mapping().data() + file_offset, chunk_size);
+
+    count -= chunk_size;
+    Seek(pos() + chunk_size);
+    dest = reinterpret_cast<uint8*>(dest) + chunk_size;
+  }
+
+  return true;
+}
+
 }  // namespace pdb
@@ -18,6 +18,7 @@
 #include <stdio.h>
 
 #include "base/basictypes.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/memory/ref_counted.h"
 #include "syzygy/pdb/pdb_stream.h"
 
@@ -88,6 +89,68 @@ class PdbFileStream : public PdbStream {
   DISALLOW_COPY_AND_ASSIGN(PdbFileStream);
 };
 
+// A reference counted memory-mapped file object.
+// NOTE: This is not thread safe for a variety of reasons.
+class RefCountedMappedFile : public base::RefCounted<RefCountedMappedFile> {
+ public:
+  RefCountedMappedFile() { }
+
+  // @returns the file mapping being reference counted.
+  base::MemoryMappedFile& mapping() { return mapping_; }
+
+ private:
+  friend base::RefCounted<RefCountedMappedFile>;
+
+  // We disallow access to the destructor to enforce the use of reference
+  // counting pointers.
+  ~RefCountedMappedFile() { }
+
+  base::MemoryMappedFile mapping_;
+
+  DISALLOW_COPY_AND_ASSIGN(RefCountedMappedFile);
+};
+
+// This class represents a PDB stream backed by a mapping of the entire PDB
+// file. Reads resolve directly against the mapping, and runs of pages that
+// are contiguous in the file are copied out in a single pass rather than
+// page by page.
+class PdbMappedFileStream : public PdbStream {
+ public:
+  // Constructor.
+  // @param file the reference counted file mapping housing this stream. The
+  //     mapping must already be initialized.
+  // @param length the length of this stream.
+  // @param pages the indices of the pages that make up this stream in the file.
+  //     A copy is made of the data so the pointer need not remain valid
+  //     beyond the constructor. The length of this array is implicit in the
+  //     stream length and the page size.
+  // @param page_size the size of the pages, in bytes.
+  PdbMappedFileStream(RefCountedMappedFile* file,
+                      size_t length,
+                      const uint32* pages,
+                      size_t page_size);
+
+  // PdbStream implementation.
+  bool ReadBytes(void* dest, size_t count, size_t* bytes_read);
+
+ protected:
+  // Protected to enforce reference counted pointers at compile time.
+  virtual ~PdbMappedFileStream();
+
+ private:
+  // The mapping of the PDB file. This is reference counted so that the
+  // streams can outlive the PdbReader that created them.
+  scoped_refptr<RefCountedMappedFile> file_;
+
+  // The list of pages in the PDB file that make up this stream.
+  std::vector<uint32> pages_;
+
+  // The size of pages within the stream.
+  size_t page_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(PdbMappedFileStream);
+};
+
 }  // namespace pdb
 
 #endif  // SYZYGY_PDB_PDB_FILE_STREAM_H_
@@ -53,6 +53,18 @@ class PdbFileStreamTest : public testing::Test {
   scoped_refptr<RefCountedFILE> file_;
 };
 
+class PdbMappedFileStreamTest : public testing::Test {
+ public:
+  virtual void SetUp() {
+    mapped_file_ = new RefCountedMappedFile();
+    ASSERT_TRUE(mapped_file_->mapping().Initialize(
+        testing::GetSrcRelativePath(testing::kTestPdbFilePath)));
+  }
+
+ protected:
+  scoped_refptr<RefCountedMappedFile> mapped_file_;
+};
+
 }  // namespace
 
 TEST_F(PdbFileStreamTest, Constructor) {
@@ -127,4 +139,70 @@ TEST_F(PdbFileStreamTest, ReadBytes) {
   }
 }
 
+TEST_F(PdbMappedFileStreamTest, Constructor) {
+  uint32 pages[] = {1, 2, 3};
+  scoped_refptr<PdbMappedFileStream> stream(new PdbMappedFileStream(
+      mapped_file_.get(), 10, pages, 8));
+  EXPECT_EQ(10, stream->length());
+}
+
+TEST_F(PdbMappedFileStreamTest, ReadBytes) {
+  // Different sections of the pdb header magic string.
+  char* test_cases[] = {
+    "Mic",
+    "roso",
+    "ft",
+    " C/C+",
+    "+ MS",
+    "F 7.00"
+  };
+
+  // Test that we can read varying sizes of bytes from the header of the
+  // file with varying page sizes.
+  char buffer[8] = {0};
+  for (size_t page_size = 4; page_size <= 32; page_size *= 2) {
+    uint32 pages[] = {0, 1, 2, 3, 4, 5, 6, 7};
+    scoped_refptr<PdbMappedFileStream> stream(new PdbMappedFileStream(
+        mapped_file_.get(), sizeof(PdbHeader), pages, page_size));
+
+    for (uint32 j = 0; j < arraysize(test_cases); ++j) {
+      char* test_case = test_cases[j];
+      size_t len = strlen(test_case);
+      size_t bytes_read = 0;
+      EXPECT_TRUE(stream->ReadBytes(&buffer, len, &bytes_read));
+      EXPECT_EQ(0, memcmp(buffer, test_case, len));
+      EXPECT_EQ(len, bytes_read);
+    }
+  }
+}
+
+TEST_F(PdbMappedFileStreamTest, ReadBytesAcrossContiguousPages) {
+  // Read a run that spans several pages that are contiguous in the file, and
+  // one where the page order is permuted, and compare the results against the
+  // mapping itself.
+  const size_t kPageSize = 4;
+  uint32 contiguous_pages[] = {0, 1, 2, 3};
+  scoped_refptr<PdbMappedFileStream> stream(new PdbMappedFileStream(
+      mapped_file_.get(), 4 * kPageSize, contiguous_pages, kPageSize));
+
+  char buffer[16] = {0};
+  size_t bytes_read = 0;
+  EXPECT_TRUE(stream->ReadBytes(&buffer, sizeof(buffer), &bytes_read));
+  EXPECT_EQ(sizeof(buffer), bytes_read);
+  EXPECT_EQ(0,
+            memcmp(buffer, mapped_file_->mapping().data(), sizeof(buffer)));
+
+  uint32 permuted_pages[] = {2, 3, 0, 1};
+  stream = new PdbMappedFileStream(
+      mapped_file_.get(), 4 * kPageSize, permuted_pages, kPageSize);
+  EXPECT_TRUE(stream->ReadBytes(&buffer, sizeof(buffer), &bytes_read));
+  EXPECT_EQ(sizeof(buffer), bytes_read);
+  EXPECT_EQ(0, memcmp(buffer,
+                      mapped_file_->mapping().data() + 2 * kPageSize,
+                      2 * kPageSize));
+  EXPECT_EQ(0, memcmp(buffer + 2 * kPageSize,
+                      mapped_file_->mapping().data(),
+                      2 * kPageSize));
+}
+
 }  // namespace pdb
@@ -17,6 +17,9 @@
 #include "base/memory/scoped_ptr.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/unittest_util.h"
 
 namespace pdb {
 
@@ -44,6 +47,14 @@ class DummyPdbStream : public PdbStream {
 
 size_t DummyPdbStream::instance_count_;
 
+// Reads the test PDB into @p pdb_file.
+void ReadTestPdb(PdbFile* pdb_file) {
+  const base::FilePath pdb_path = testing::GetSrcRelativePath(
+      testing::kTestPdbFilePath);
+  PdbReader pdb_reader;
+  ASSERT_TRUE(pdb_reader.Read(pdb_path, pdb_file));
+}
+
 }  // namespace
 
 TEST(PdbFileTest, Clear) {
@@ -105,4 +116,71 @@ TEST(PdbFileTest, WorksAsExpected) {
   EXPECT_EQ(0u, DummyPdbStream::instance_count());
 }
 
+TEST(PdbFileTest, GetHeaderInfo) {
+  PdbFile pdb_file;
+  EXPECT_FALSE(pdb_file.GetHeaderInfo(NULL, NULL));
+
+  ASSERT_NO_FATAL_FAILURE(ReadTestPdb(&pdb_file));
+
+  PdbInfoHeader70 pdb_header = {};
+  const NameStreamMap* name_stream_map = NULL;
+  ASSERT_TRUE(pdb_file.GetHeaderInfo(&pdb_header, &name_stream_map));
+  ASSERT_TRUE(name_stream_map != NULL);
+
+  // Repeated queries are served from the cached index.
+  const NameStreamMap* name_stream_map2 = NULL;
+  ASSERT_TRUE(pdb_file.GetHeaderInfo(NULL, &name_stream_map2));
+  EXPECT_EQ(name_stream_map, name_stream_map2);
+
+  // Adding an unrelated stream must not invalidate the index.
+  pdb_file.AppendStream(new DummyPdbStream());
+  EXPECT_TRUE(pdb_file.GetHeaderInfo(&pdb_header, &name_stream_map));
+
+  // Replacing the header info stream invalidates the index; with an
+  // unreadable stream in place the query must now fail.
+  pdb_file.ReplaceStream(kPdbHeaderInfoStream, new DummyPdbStream());
+  EXPECT_FALSE(pdb_file.GetHeaderInfo(&pdb_header, &name_stream_map));
+}
+
+TEST(PdbFileTest, SetHeaderInfo) {
+  PdbFile pdb_file;
+  ASSERT_NO_FATAL_FAILURE(ReadTestPdb(&pdb_file));
+
+  PdbInfoHeader70 pdb_header = {};
+  const NameStreamMap* name_stream_map = NULL;
+  ASSERT_TRUE(pdb_file.GetHeaderInfo(&pdb_header, &name_stream_map));
+
+  NameStreamMap new_name_stream_map(*name_stream_map);
+  new_name_stream_map["/NewStream"] = 42;
+  pdb_header.pdb_age++;
+  pdb_file.SetHeaderInfo(pdb_header, new_name_stream_map);
+
+  PdbInfoHeader70 pdb_header2 = {};
+  ASSERT_TRUE(pdb_file.GetHeaderInfo(&pdb_header2, &name_stream_map));
+  EXPECT_EQ(pdb_header.pdb_age, pdb_header2.pdb_age);
+  EXPECT_THAT(*name_stream_map, testing::ContainerEq(new_name_stream_map));
+}
+
+TEST(PdbFileTest, GetTypeInfoHeader) {
+  PdbFile pdb_file;
+  TypeInfoHeader type_info_header = {};
+  EXPECT_FALSE(pdb_file.GetTypeInfoHeader(&type_info_header));
+
+  ASSERT_NO_FATAL_FAILURE(ReadTestPdb(&pdb_file));
+  ASSERT_TRUE(pdb_file.GetTypeInfoHeader(&type_info_header));
+  EXPECT_LE(type_info_header.type_min, type_info_header.type_max);
+
+  // Repeated queries are served from the cached index.
+  TypeInfoHeader type_info_header2 = {};
+  ASSERT_TRUE(pdb_file.GetTypeInfoHeader(&type_info_header2));
+  EXPECT_EQ(0, ::memcmp(&type_info_header,
+                        &type_info_header2,
+                        sizeof(type_info_header)));
+
+  // Replacing the type info stream invalidates the index; with an
+  // unreadable stream in place the query must now fail.
+  pdb_file.ReplaceStream(kTpiStream, new DummyPdbStream());
+  EXPECT_FALSE(pdb_file.GetTypeInfoHeader(&type_info_header));
+}
+
 }  // namespace pdb
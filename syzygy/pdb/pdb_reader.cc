@@ -46,6 +46,22 @@ uint32 GetNumPages(const PdbHeader& header, uint32 num_bytes) {
   return (num_bytes + header.page_size - 1) / header.page_size;
 }
 
+// Creates a stream over @p pages, backed by the file mapping @p mapped_file
+// if one is provided, and by paged reads through @p file otherwise.
+scoped_refptr<PdbStream> CreateStream(RefCountedFILE* file,
+                                      RefCountedMappedFile* mapped_file,
+                                      size_t length,
+                                      const uint32* pages,
+                                      size_t page_size) {
+  if (mapped_file != NULL) {
+    return scoped_refptr<PdbStream>(
+        new PdbMappedFileStream(mapped_file, length, pages, page_size));
+  }
+  DCHECK(file != NULL);
+  return scoped_refptr<PdbStream>(
+      new PdbFileStream(file, length, pages, page_size));
+}
+
 }  // namespace
 
 bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
@@ -53,18 +69,30 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
 
   pdb_file->Clear();
 
-  scoped_refptr<RefCountedFILE> file(new RefCountedFILE(
-      base::OpenFile(pdb_path, "rb")));
-  if (!file->file()) {
-    LOG(ERROR) << "Unable to open '" << pdb_path.value() << "'.";
-    return false;
-  }
-
-  // Get the file size.
+  // Prefer to map the whole file up front: this turns the many small paged
+  // reads performed while walking streams into simple memory copies. If the
+  // mapping fails (e.g. address space is exhausted) fall back to paged reads
+  // through a FILE handle.
+  scoped_refptr<RefCountedMappedFile> mapped_file(new RefCountedMappedFile());
+  scoped_refptr<RefCountedFILE> file;
   uint32 file_size = 0;
-  if (!GetFileSize(file->file(), &file_size)) {
-    LOG(ERROR) << "Unable to determine size of '" << pdb_path.value() << "'.";
-    return false;
+  if (mapped_file->mapping().Initialize(pdb_path)) {
+    file_size = mapped_file->mapping().length();
+  } else {
+    mapped_file = NULL;
+
+    file = new RefCountedFILE(base::OpenFile(pdb_path, "rb"));
+    if (!file->file()) {
+      LOG(ERROR) << "Unable to open '" << pdb_path.value() << "'.";
+      return false;
+    }
+
+    // Get the file size.
+    if (!GetFileSize(file->file(), &file_size)) {
+      LOG(ERROR) << "Unable to determine size of '" << pdb_path.value()
+                 << "'.";
+      return false;
+    }
   }
 
   PdbHeader header = { 0 };
@@ -73,8 +101,9 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
   // is irrelevant as after reading the header we get the actual page size in
   // use by the PDB and from then on use that.
   uint32 header_page = 0;
-  scoped_refptr<PdbFileStream> header_stream(new PdbFileStream(
-      file, sizeof(header), &header_page, kPdbPageSize));
+  scoped_refptr<PdbStream> header_stream(CreateStream(
+      file.get(), mapped_file.get(), sizeof(header), &header_page,
+      kPdbPageSize));
   if (!header_stream->Read(&header, 1)) {
     LOG(ERROR) << "Failed to read PDB file header.";
     return false;
@@ -98,8 +127,8 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
   // containing that many page pointers from the root pages array.
   int num_dir_pages = static_cast<int>(GetNumPages(header,
                                                    header.directory_size));
-  scoped_refptr<PdbFileStream> dir_page_stream(new PdbFileStream(
-      file, num_dir_pages * sizeof(uint32),
+  scoped_refptr<PdbStream> dir_page_stream(CreateStream(
+      file.get(), mapped_file.get(), num_dir_pages * sizeof(uint32),
       header.root_pages, header.page_size));
   scoped_ptr<uint32[]> dir_pages(new uint32[num_dir_pages]);
   if (dir_pages.get() == NULL) {
@@ -113,8 +142,9 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
 
   // Load the actual directory.
   int dir_size = static_cast<int>(header.directory_size / sizeof(uint32));
-  scoped_refptr<PdbFileStream> dir_stream(new PdbFileStream(
-      file, header.directory_size, dir_pages.get(), header.page_size));
+  scoped_refptr<PdbStream> dir_stream(CreateStream(
+      file.get(), mapped_file.get(), header.directory_size, dir_pages.get(),
+      header.page_size));
   std::vector<uint32> directory(dir_size);
   if (!dir_stream->Read(&directory[0], dir_size)) {
     LOG(ERROR) << "Failed to read directory stream.";
@@ -128,10 +158,11 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
 
   uint32 page_index = 0;
   for (uint32 stream_index = 0; stream_index < num_streams; ++stream_index) {
-    pdb_file->AppendStream(new PdbFileStream(file,
-                                             stream_lengths[stream_index],
-                                             stream_pages + page_index,
-                                             header.page_size));
+    pdb_file->AppendStream(CreateStream(file.get(),
+                                        mapped_file.get(),
+                                        stream_lengths[stream_index],
+                                        stream_pages + page_index,
+                                        header.page_size).get());
     page_index += GetNumPages(header, stream_lengths[stream_index]);
   }
 
@@ -21,12 +21,10 @@
 
 namespace pdb {
 
-bool ReadTypeInfoStream(PdbStream* stream,
-                        TypeInfoHeader* type_info_header,
-                        TypeInfoRecordMap* type_info_record_map) {
+bool ReadTypeInfoHeader(PdbStream* stream,
+                        TypeInfoHeader* type_info_header) {
   DCHECK(stream != NULL);
   DCHECK(type_info_header != NULL);
-  DCHECK(type_info_record_map != NULL);
 
   // Reads the header of the stream.
   if (!stream->Seek(0) || !stream->Read(type_info_header, 1)) {
@@ -48,6 +46,22 @@ bool ReadTypeInfoStream(PdbStream* stream,
     return false;
   }
 
+  return true;
+}
+
+bool ReadTypeInfoStream(PdbStream* stream,
+                        TypeInfoHeader* type_info_header,
+                        TypeInfoRecordMap* type_info_record_map) {
+  DCHECK(stream != NULL);
+  DCHECK(type_info_header != NULL);
+  DCHECK(type_info_record_map != NULL);
+
+  if (!ReadTypeInfoHeader(stream, type_info_header))
+    return false;
+
+  size_t type_info_data_end =
+      type_info_header->len + type_info_header->type_info_data_size;
+
   // The type ID of each entry is not present in the stream, instead of that we
   // know the first and the last type ID and we know that the type records are
   // ordered in increasing order in the stream.
@@ -28,6 +28,11 @@ namespace pdb {
 // Forward declarations.
 class PdbStream;
 
+// Read and validate @p type_info_header from @p stream. On success the
+// stream is positioned at the first type info record.
+bool ReadTypeInfoHeader(PdbStream* stream,
+                        TypeInfoHeader* type_info_header);
+
 // Read @p type_info_header and @p type_info_record_map from @p stream.
 bool ReadTypeInfoStream(PdbStream* stream,
                         TypeInfoHeader* type_info_header,
@@ -34,6 +34,26 @@ TEST(PdbTypeInfoStreamTest, ReadValidTypeInfoStream) {
                                  &types_map));
 }
 
+TEST(PdbTypeInfoStreamTest, ReadValidTypeInfoHeader) {
+  base::FilePath valid_type_info_path = testing::GetSrcRelativePath(
+      testing::kValidPdbTypeInfoStreamPath);
+
+  scoped_refptr<pdb::PdbFileStream> valid_type_info_stream =
+      testing::GetStreamFromFile(valid_type_info_path);
+  TypeInfoHeader header;
+  EXPECT_TRUE(ReadTypeInfoHeader(valid_type_info_stream.get(), &header));
+}
+
+TEST(PdbTypeInfoStreamTest, ReadInvalidTypeInfoHeader) {
+  base::FilePath invalid_type_info_path = testing::GetSrcRelativePath(
+      testing::kInvalidHeaderPdbTypeInfoStreamPath);
+
+  scoped_refptr<pdb::PdbFileStream> invalid_type_info_stream =
+      testing::GetStreamFromFile(invalid_type_info_path);
+  TypeInfoHeader header;
+  EXPECT_FALSE(ReadTypeInfoHeader(invalid_type_info_stream.get(), &header));
+}
+
 TEST(PdbTypeInfoStreamTest, ReadInvalidDataTypeInfoStream) {
   base::FilePath invalid_type_info_path = testing::GetSrcRelativePath(
       testing::kInvalidDataPdbTypeInfoStreamPath);
@@ -446,25 +446,13 @@ bool ReadHeaderInfoStream(const PdbFile& pdb_file,
   DCHECK(pdb_header != NULL);
   DCHECK(name_stream_map != NULL);
 
-  // Get the stream reader.
-  if (kPdbHeaderInfoStream >= pdb_file.StreamCount()) {
-    LOG(ERROR) << "No header info stream found.";
-    return false;
-  }
-  scoped_refptr<PdbStream> header_reader(
-      pdb_file.GetStream(kPdbHeaderInfoStream));
-  if (header_reader.get() == NULL) {
-    LOG(ERROR) << "No header info stream found.";
-    return false;
-  }
-
-  // Read the header.
-  if (!pdb::ReadHeaderInfoStream(header_reader.get(), pdb_header,
-                                 name_stream_map)) {
-    LOG(ERROR) << "Failed to read header info stream.";
+  // This is served from the index cached by the PdbFile, which parses the
+  // header info stream at most once.
+  const NameStreamMap* cached_name_stream_map = NULL;
+  if (!pdb_file.GetHeaderInfo(pdb_header, &cached_name_stream_map))
     return false;
-  }
 
+  *name_stream_map = *cached_name_stream_map;
   return true;
 }
 
@@ -589,6 +577,10 @@ bool WriteHeaderInfoStream(const PdbInfoHeader70& header,
     return false;
   }
 
+  // Keep the index cached by the PdbFile in sync with the written values so
+  // that subsequent readers don't have to reparse the stream.
+  pdb_file->SetHeaderInfo(header, name_stream_map);
+
   return true;
 }
 
@@ -684,14 +676,22 @@ bool WriteHeaderInfoStream(const PdbInfoHeader70& pdb_header,
   return true;
 }
 
-bool ReadStringTable(PdbStream* stream,
-                     const char* table_name,
-                     size_t table_start,
-                     size_t table_end,
-                     OffsetStringMap* string_map) {
+namespace {
+
+// Common implementation of the two ReadStringTable variants. Exactly one of
+// @p string_map and @p interned_string_map must be non-NULL; @p string_table
+// must be non-NULL iff @p interned_string_map is.
+bool ReadStringTableImpl(PdbStream* stream,
+                         const char* table_name,
+                         size_t table_start,
+                         size_t table_end,
+                         core::StringTable* string_table,
+                         OffsetStringMap* string_map,
+                         OffsetInternedStringMap* interned_string_map) {
   DCHECK(stream != NULL);
   DCHECK(table_name != NULL);
-  DCHECK(string_map != NULL);
+  DCHECK((string_map != NULL) ^ (interned_string_map != NULL));
+  DCHECK_EQ(string_table != NULL, interned_string_map != NULL);
 
   uint32 string_table_signature = 0;
   uint32 string_table_version = 0;
@@ -749,7 +749,12 @@ bool ReadStringTable(PdbStream* stream,
       return false;
     }
 
-    string_map->insert(std::make_pair(string_offset, temp_string));
+    if (string_map != NULL) {
+      string_map->insert(std::make_pair(string_offset, temp_string));
+    } else {
+      interned_string_map->insert(std::make_pair(
+          string_offset, &string_table->InternString(temp_string)));
+    }
   }
 
   uint32 string_count = 0;
@@ -771,6 +776,30 @@ bool ReadStringTable(PdbStream* stream,
   return true;
 }
 
+}  // namespace
+
+bool ReadStringTable(PdbStream* stream,
+                     const char* table_name,
+                     size_t table_start,
+                     size_t table_end,
+                     OffsetStringMap* string_map) {
+  DCHECK(string_map != NULL);
+  return ReadStringTableImpl(stream, table_name, table_start, table_end,
+                             NULL, string_map, NULL);
+}
+
+bool ReadStringTable(PdbStream* stream,
+                     const char* table_name,
+                     size_t table_start,
+                     size_t table_end,
+                     core::StringTable* string_table,
+                     OffsetInternedStringMap* string_map) {
+  DCHECK(string_table != NULL);
+  DCHECK(string_map != NULL);
+  return ReadStringTableImpl(stream, table_name, table_start, table_end,
+                             string_table, NULL, string_map);
+}
+
 bool LoadNamedStreamFromPdbFile(
     const base::StringPiece& stream_name,
     PdbFile* pdb_file,
@@ -779,20 +808,18 @@ bool LoadNamedStreamFromPdbFile(
   DCHECK(stream != NULL);
   DCHECK(stream->get() == NULL);
 
-  // Get the PDB header and try to get the named stream ID from it.
-  pdb::PdbInfoHeader70 pdb_header = {0};
-  pdb::NameStreamMap name_stream_map;
-  if (!ReadHeaderInfoStream(pdb_file->GetStream(pdb::kPdbHeaderInfoStream),
-                            &pdb_header,
-                            &name_stream_map)) {
+  // Try to get the named stream ID from the name-stream map cached by the
+  // PdbFile.
+  const pdb::NameStreamMap* name_stream_map = NULL;
+  if (!pdb_file->GetHeaderInfo(NULL, &name_stream_map)) {
     LOG(ERROR) << "Failed to read header info stream.";
     return false;
   }
 
   // The stream with the given name does not exist.
-  pdb::NameStreamMap::const_iterator name_it = name_stream_map.find(
+  pdb::NameStreamMap::const_iterator name_it = name_stream_map->find(
       stream_name.as_string());
-  if (name_it == name_stream_map.end())
+  if (name_it == name_stream_map->end())
     return true;
 
   // Get the named stream and ensure that it's not empty.
@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "syzygy/core/string_table.h"
 #include "syzygy/pdb/pdb_data.h"
 #include "syzygy/pdb/pdb_stream.h"
 
@@ -31,12 +32,14 @@ class PdbFile;
 class PdbStream;
 class WritablePdbStream;
 
-// A map of names to stream IDs, stored in the header stream.
-typedef std::map<std::string, uint32> NameStreamMap;
-
 // A map of position offset to strings, stored in some streams of the Pdb.
 typedef std::map<size_t, std::string> OffsetStringMap;
 
+// A map of position offset to interned strings, as produced by the interning
+// version of ReadStringTable. The pointed-to strings are owned by the
+// core::StringTable they were interned in.
+typedef std::map<size_t, const std::string*> OffsetInternedStringMap;
+
 // Used for parsing a variable sized bitset as found in PDB streams.
 class PdbBitSet {
  public:
@@ -126,7 +129,9 @@ bool SetGuid(const GUID& guid, PdbFile* pdb_file);
 // @returns true on success, false otherwise.
 bool ReadPdbHeader(const base::FilePath& pdb_path, PdbInfoHeader70* pdb_header);
 
-// Reads the header info from the given PDB file.
+// Reads the header info from the given PDB file. This is served from the
+// lazily built index maintained by the PdbFile, so repeated calls (from
+// successive PDB mutators, for example) only parse the stream once.
 // @param pdb_file the file to read from.
 // @param pdb_header the header to be filled in.
 // @param name_stream_map the name-stream map to be filled in.
@@ -145,7 +150,8 @@ bool ReadHeaderInfoStream(PdbStream* pdb_stream,
                           NameStreamMap* name_stream_map);
 
 // Writes the header info the given PDB file. Will look up the header stream
-// and convert it to a writable stream type if necessary.
+// and convert it to a writable stream type if necessary. The lazily built
+// index maintained by the PdbFile is updated with the written values.
 // @param pdb_header the header to write.
 // @param name_stream_map the name-stream map to write.
 // @param pdb_file the file to be written to.
@@ -190,6 +196,27 @@ bool ReadStringTable(PdbStream* stream,
                      size_t string_table_end,
                      OffsetStringMap* string_map);
 
+// Reads a string table from a given PDB stream at a given position, interning
+// the strings in @p string_table. When several tables contain the same names
+// (as the name tables of the various compiland streams of an image typically
+// do) each distinct name is only stored once, where the non-interning version
+// of this function allocates a fresh copy per table.
+// @param stream the stream containing the string table.
+// @param table_name the name of the table to be read (used in the error
+//     messages).
+// @param string_table_start start position of the name table.
+// @param string_table_end end position of the name table.
+// @param string_table the table in which to intern the strings. The pointers
+//     stored in @p string_map are valid until its destruction.
+// @param string_map the string map to be filled.
+// @returns true on success, false on error.
+bool ReadStringTable(PdbStream* stream,
+                     const char* table_name,
+                     size_t string_table_start,
+                     size_t string_table_end,
+                     core::StringTable* string_table,
+                     OffsetInternedStringMap* string_map);
+
 // Loads a named stream from the given PDB file.
 // @param stream_name the name of the stream to load.
 // @param pdb_file the PDB file from which to read the stream.
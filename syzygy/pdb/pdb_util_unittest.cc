@@ -184,6 +184,30 @@ bool AreEqual(const PdbInfoHeader70& header1,
   return ::memcmp(&header1, &header2, sizeof(header1)) == 0;
 }
 
+// Appends the bytes of a 32-bit value to a byte vector. Used for building
+// string tables in memory.
+void AppendUint32(uint32 value, std::vector<uint8>* bytes) {
+  const uint8* value_bytes = reinterpret_cast<const uint8*>(&value);
+  bytes->insert(bytes->end(), value_bytes, value_bytes + sizeof(value));
+}
+
+// Builds a string table containing the strings "foo" and "bar" in the format
+// parsed by ReadStringTable.
+void BuildSampleStringTable(std::vector<uint8>* bytes) {
+  // The string blob, containing the empty string, "foo" and "bar".
+  static const char kStrings[] = "\0foo\0bar";
+
+  AppendUint32(kPdbStringTableSignature, bytes);
+  AppendUint32(kPdbStringTableVersion, bytes);
+  AppendUint32(sizeof(kStrings), bytes);
+  bytes->insert(bytes->end(), kStrings, kStrings + sizeof(kStrings));
+  AppendUint32(3, bytes);  // Entry count.
+  AppendUint32(1, bytes);  // Offset of "foo".
+  AppendUint32(5, bytes);  // Offset of "bar".
+  AppendUint32(0, bytes);  // Offset of the empty string.
+  AppendUint32(2, bytes);  // String count.
+}
+
 }  // namespace
 
 TEST(PdbBitSetTest, ReadEmptyStream) {
@@ -734,6 +758,47 @@ TEST(WriteHeaderInfoStreamTest, WriteNonEmpty) {
   EXPECT_THAT(name_stream_map, testing::ContainerEq(read_name_stream_map));
 }
 
+TEST(ReadStringTableTest, ReadSampleTable) {
+  std::vector<uint8> bytes;
+  BuildSampleStringTable(&bytes);
+
+  scoped_refptr<PdbByteStream> stream(new PdbByteStream());
+  ASSERT_TRUE(stream->Init(&bytes[0], bytes.size()));
+
+  OffsetStringMap string_map;
+  ASSERT_TRUE(ReadStringTable(stream.get(), "test", 0, bytes.size(),
+                              &string_map));
+  ASSERT_EQ(3u, string_map.size());
+  EXPECT_EQ("", string_map[0]);
+  EXPECT_EQ("foo", string_map[1]);
+  EXPECT_EQ("bar", string_map[5]);
+}
+
+TEST(ReadStringTableTest, InternedReadSharesStrings) {
+  std::vector<uint8> bytes;
+  BuildSampleStringTable(&bytes);
+
+  scoped_refptr<PdbByteStream> stream(new PdbByteStream());
+  ASSERT_TRUE(stream->Init(&bytes[0], bytes.size()));
+
+  core::StringTable string_table;
+  OffsetInternedStringMap string_map;
+  ASSERT_TRUE(ReadStringTable(stream.get(), "test", 0, bytes.size(),
+                              &string_table, &string_map));
+  ASSERT_EQ(3u, string_map.size());
+  EXPECT_EQ("", *string_map[0]);
+  EXPECT_EQ("foo", *string_map[1]);
+  EXPECT_EQ("bar", *string_map[5]);
+
+  // Reading the same table a second time yields pointers to the very same
+  // interned strings rather than fresh allocations.
+  OffsetInternedStringMap other_map;
+  ASSERT_TRUE(ReadStringTable(stream.get(), "test", 0, bytes.size(),
+                              &string_table, &other_map));
+  EXPECT_EQ(string_map[1], other_map[1]);
+  EXPECT_EQ(string_map[5], other_map[5]);
+}
+
 TEST_F(PdbUtilTest, NamedStreamsWorkWithPdbStr) {
   // We start by creating a PDB file (a copy of a checked in sample one) and
   // adding a new stream to it using our named-stream implementation.
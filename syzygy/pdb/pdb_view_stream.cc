@@ -0,0 +1,65 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pdb/pdb_view_stream.h"
+
+#include <algorithm>
+#include "base/logging.h"
+
+namespace pdb {
+
+PdbViewStream::PdbViewStream() : PdbStream(0), data_(NULL) {
+}
+
+PdbViewStream::~PdbViewStream() {
+}
+
+bool PdbViewStream::Init(const uint8* data, size_t length) {
+  DCHECK(data != NULL || length == 0);
+  set_length(length);
+  data_ = data;
+  owner_ = NULL;
+  return true;
+}
+
+bool PdbViewStream::Init(const uint8* data, size_t length, PdbStream* owner) {
+  DCHECK(owner != NULL);
+  if (!Init(data, length))
+    return false;
+  owner_ = owner;
+  return true;
+}
+
+bool PdbViewStream::ReadBytes(void* dest, size_t count, size_t* bytes_read) {
+  DCHECK(dest != NULL);
+  DCHECK(bytes_read != NULL);
+
+  // Return 0 once we've reached the end of the stream.
+  if (pos() == length()) {
+    *bytes_read = 0;
+    return true;
+  }
+
+  // Don't read beyond the end of the known stream length.
+  count = std::min(count, length() - pos());
+
+  // Read the stream.
+  memcpy(dest, data_ + pos(), count);
+  Seek(pos() + count);
+  *bytes_read = count;
+
+  return true;
+}
+
+}  // namespace pdb
@@ -0,0 +1,72 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SYZYGY_PDB_PDB_VIEW_STREAM_H_
+#define SYZYGY_PDB_PDB_VIEW_STREAM_H_
+
+#include "syzygy/pdb/pdb_stream.h"
+
+namespace pdb {
+
+// This class represents a read-only PDB stream backed by a range of bytes
+// that is owned by another object. It is a drop-in replacement for
+// PdbByteStream at sites that only ever read a stream, saving the copy of
+// the stream contents that PdbByteStream::Init makes. The viewed bytes must
+// outlive the stream; an owning stream may optionally be provided, in which
+// case a reference to it is held to keep the bytes alive.
+class PdbViewStream : public PdbStream {
+ public:
+  PdbViewStream();
+
+  // Initializes the stream as a view of the given byte range. The caller is
+  // responsible for ensuring that @p data outlives this stream.
+  // @param data the bytes to be viewed.
+  // @param length the number of bytes in @p data.
+  // @returns true on success.
+  bool Init(const uint8* data, size_t length);
+
+  // Initializes the stream as a view of the given byte range, holding a
+  // reference to the stream that owns the bytes.
+  // @param data the bytes to be viewed. These must be owned by @p owner and
+  //     remain valid for its lifetime; in particular, @p owner must not be
+  //     resized while this view exists.
+  // @param length the number of bytes in @p data.
+  // @param owner the stream owning @p data.
+  // @returns true on success.
+  bool Init(const uint8* data, size_t length, PdbStream* owner);
+
+  // @name PdbStream implementation.
+  // @{
+  virtual bool ReadBytes(void* dest, size_t count, size_t* bytes_read) OVERRIDE;
+  // @}
+
+  // Gets the stream's data pointer.
+  const uint8* data() const { return data_; }
+
+ protected:
+  // This is protected to enforce use of reference counted pointers.
+  virtual ~PdbViewStream();
+
+  // The viewed bytes. Not owned by us.
+  const uint8* data_;
+
+  // Keeps the object that owns data_ alive, if one was provided.
+  scoped_refptr<PdbStream> owner_;
+
+  DISALLOW_COPY_AND_ASSIGN(PdbViewStream);
+};
+
+}  // namespace pdb
+
+#endif  // SYZYGY_PDB_PDB_VIEW_STREAM_H_
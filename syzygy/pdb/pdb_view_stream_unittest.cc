@@ -0,0 +1,100 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pdb/pdb_view_stream.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
+
+namespace pdb {
+
+namespace {
+
+class TestPdbViewStream : public PdbViewStream {
+ public:
+  TestPdbViewStream() : PdbViewStream() {
+  }
+
+  using PdbViewStream::ReadBytes;
+};
+
+}  // namespace
+
+TEST(PdbViewStreamTest, InitFromByteArray) {
+  uint8 data[] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+  scoped_refptr<PdbViewStream> stream(new PdbViewStream());
+  EXPECT_TRUE(stream->Init(data, arraysize(data)));
+  EXPECT_EQ(arraysize(data), stream->length());
+
+  // The view refers to the original bytes rather than a copy of them.
+  EXPECT_EQ(data, stream->data());
+
+  for (size_t i = 0; i < stream->length(); ++i) {
+    uint8 num = 0;
+    EXPECT_TRUE(stream->Read(&num, 1));
+    EXPECT_EQ(data[i], num);
+  }
+}
+
+TEST(PdbViewStreamTest, InitWithOwnerKeepsBytesAlive) {
+  uint8 data[] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+  scoped_refptr<PdbByteStream> byte_stream(new PdbByteStream());
+  ASSERT_TRUE(byte_stream->Init(data, arraysize(data)));
+
+  scoped_refptr<PdbViewStream> stream(new PdbViewStream());
+  EXPECT_TRUE(stream->Init(byte_stream->data(), byte_stream->length(),
+                           byte_stream.get()));
+  EXPECT_EQ(byte_stream->length(), stream->length());
+  EXPECT_EQ(byte_stream->data(), stream->data());
+
+  // Drop our reference to the byte stream. The view holds its own reference,
+  // so the bytes remain readable.
+  byte_stream = NULL;
+
+  for (size_t i = 0; i < stream->length(); ++i) {
+    uint8 num = 0;
+    EXPECT_TRUE(stream->Read(&num, 1));
+    EXPECT_EQ(data[i], num);
+  }
+}
+
+TEST(PdbViewStreamTest, ReadBytes) {
+  uint8 data[17] = {};
+
+  scoped_refptr<TestPdbViewStream> stream(new TestPdbViewStream);
+  EXPECT_TRUE(stream->Init(data, arraysize(data)));
+
+  int total_bytes = 0;
+  while (true) {
+    uint8 buffer[4];
+    size_t bytes_read = 0;
+    EXPECT_TRUE(stream->ReadBytes(buffer, sizeof(buffer), &bytes_read));
+    if (bytes_read == 0)
+      break;
+    total_bytes += bytes_read;
+  }
+
+  EXPECT_EQ(arraysize(data), total_bytes);
+}
+
+TEST(PdbViewStreamTest, GetWritablePdbStream) {
+  // The stream is read-only, so there is no writable counterpart.
+  scoped_refptr<PdbStream> stream(new PdbViewStream);
+  scoped_refptr<WritablePdbStream> writer = stream->GetWritablePdbStream();
+  EXPECT_TRUE(writer.get() == NULL);
+}
+
+}  // namespace pdb
@@ -14,6 +14,8 @@
 
 #include "syzygy/pdb/pdb_writer.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "syzygy/pdb/pdb_constants.h"
 #include "syzygy/pdb/pdb_data.h"
@@ -236,16 +238,10 @@ bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
       directory.push_back(stream->length());
   }
 
-  // Reserve space for the header page, the two free page map pages, and a
-  // fourth empty page. The fourth empty page doesn't appear to be strictly
-  // necessary but MSF/PDB files produced by MS tools always contain it.
-  uint32 page_count = 4;
-  for (uint32 i = 0; i < page_count; ++i) {
-    if (::fwrite(kZeroBuffer, 1, kPdbPageSize, file_.get()) != kPdbPageSize) {
-      LOG(ERROR) << "Failed to allocate preamble page.";
-      return false;
-    }
-  }
+  // Reserve space for the preamble pages.
+  uint32 page_count = 0;
+  if (!WritePreamble(&page_count))
+    return false;
 
   // Append all the streams after the preamble and build the directory while
   // we're at it. We keep track of which pages host stream 0 for some free page
@@ -270,6 +266,76 @@ bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
   }
   DCHECK_LE(stream0_start, stream0_end);
 
+  return WriteDirectoryAndHeader(directory, stream0_start, stream0_end,
+                                 page_count);
+}
+
+bool PdbWriter::WriteStreaming(const base::FilePath& pdb_path,
+                               const std::vector<StreamProducer>& producers) {
+  file_.reset(base::OpenFile(pdb_path, "wb"));
+  if (!file_.get()) {
+    LOG(ERROR) << "Failed to create '" << pdb_path.value() << "'.";
+    return false;
+  }
+
+  // Reserve space for the preamble pages.
+  uint32 page_count = 0;
+  if (!WritePreamble(&page_count))
+    return false;
+
+  // Write the streams as their contents are produced, keeping track of their
+  // lengths and the pages they span. The directory is only assembled once all
+  // of the content has been written.
+  std::vector<uint32> stream_lengths(producers.size());
+  std::vector<uint32> stream_pages;
+  size_t stream0_page_count = 0;
+  for (size_t i = 0; i < producers.size(); ++i) {
+    if (!AppendStreamFromProducer(producers[i], &stream_pages, &page_count,
+                                  &stream_lengths[i])) {
+      LOG(ERROR) << "Failed to write stream " << i << ".";
+      return false;
+    }
+
+    if (i == 0)
+      stream0_page_count = stream_pages.size();
+  }
+
+  // Assemble the directory: the stream count, then the stream lengths, then
+  // the pages of each stream in order.
+  std::vector<uint32> directory;
+  directory.reserve(1 + producers.size() + stream_pages.size());
+  directory.push_back(producers.size());
+  directory.insert(directory.end(), stream_lengths.begin(),
+                   stream_lengths.end());
+  size_t stream0_start = directory.size();
+  size_t stream0_end = stream0_start + stream0_page_count;
+  directory.insert(directory.end(), stream_pages.begin(), stream_pages.end());
+
+  return WriteDirectoryAndHeader(directory, stream0_start, stream0_end,
+                                 page_count);
+}
+
+bool PdbWriter::WritePreamble(uint32* page_count) {
+  DCHECK(page_count != NULL);
+
+  // Reserve space for the header page, the two free page map pages, and a
+  // fourth empty page. The fourth empty page doesn't appear to be strictly
+  // necessary but MSF/PDB files produced by MS tools always contain it.
+  *page_count = 4;
+  for (uint32 i = 0; i < *page_count; ++i) {
+    if (::fwrite(kZeroBuffer, 1, kPdbPageSize, file_.get()) != kPdbPageSize) {
+      LOG(ERROR) << "Failed to allocate preamble page.";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool PdbWriter::WriteDirectoryAndHeader(const std::vector<uint32>& directory,
+                                        size_t stream0_start,
+                                        size_t stream0_end,
+                                        uint32 page_count) {
   // Write the directory, and keep track of the pages it is written to.
   std::vector<uint32> directory_pages;
   scoped_refptr<PdbStream> directory_stream(new ReadOnlyPdbStream(
@@ -375,6 +441,60 @@ bool PdbWriter::AppendStream(PdbStream* stream,
   return true;
 }
 
+bool PdbWriter::AppendStreamFromProducer(const StreamProducer& producer,
+                                         std::vector<uint32>* pages_written,
+                                         uint32* page_count,
+                                         uint32* stream_length) {
+  DCHECK(pages_written != NULL);
+  DCHECK(page_count != NULL);
+  DCHECK(stream_length != NULL);
+
+  // Pull chunks from the producer and write them out a page at a time. The
+  // chunks themselves may straddle page boundaries, so we accumulate them in
+  // a page-sized buffer and flush it as it fills up.
+  uint8 buffer[kPdbPageSize] = { 0 };
+  size_t buffer_used = 0;
+  size_t length = 0;
+  std::vector<uint8> chunk;
+  while (true) {
+    chunk.clear();
+    if (!producer.Run(&chunk)) {
+      LOG(ERROR) << "Stream producer failed at offset " << length << ".";
+      return false;
+    }
+
+    // An empty chunk signals the end of the stream.
+    if (chunk.empty())
+      break;
+    length += chunk.size();
+
+    size_t offset = 0;
+    while (offset < chunk.size()) {
+      size_t bytes_to_copy = std::min(chunk.size() - offset,
+                                      sizeof(buffer) - buffer_used);
+      ::memcpy(buffer + buffer_used, chunk.data() + offset, bytes_to_copy);
+      buffer_used += bytes_to_copy;
+      offset += bytes_to_copy;
+
+      if (buffer_used == sizeof(buffer)) {
+        if (!AppendPage(buffer, pages_written, page_count, file_.get()))
+          return false;
+        buffer_used = 0;
+      }
+    }
+  }
+
+  // Flush the final partial page, padded with zeros.
+  if (buffer_used > 0) {
+    ::memset(buffer + buffer_used, 0, sizeof(buffer) - buffer_used);
+    if (!AppendPage(buffer, pages_written, page_count, file_.get()))
+      return false;
+  }
+
+  *stream_length = length;
+  return true;
+}
+
 bool PdbWriter::WriteHeader(const std::vector<uint32>& root_directory_pages,
                             size_t directory_size,
                             uint32 page_count) {
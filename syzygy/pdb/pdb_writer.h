@@ -17,6 +17,7 @@
 
 #include <vector>
 
+#include "base/callback.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "syzygy/pdb/pdb_file.h"
@@ -29,6 +30,14 @@ namespace pdb {
 // the page layout of the streams in the file.
 class PdbWriter {
  public:
+  // A callback that produces the content of a stream in chunks. Each
+  // invocation appends the next chunk of the stream to @p chunk (which is
+  // handed to the callback empty); producing an empty chunk signals the end
+  // of the stream. The callback returns false on error. Chunks may be of any
+  // size, and the stream length is implied by the total number of bytes
+  // produced.
+  typedef base::Callback<bool(std::vector<uint8>* chunk)> StreamProducer;
+
   PdbWriter();
   ~PdbWriter();
 
@@ -38,7 +47,23 @@ class PdbWriter {
   // @returns true on success, false otherwise.
   bool Write(const base::FilePath& pdb_path, const PdbFile& pdb_file);
 
+  // Writes a PDB file to disk, pulling the content of each stream from the
+  // corresponding producer callback. Stream contents are paged out to disk as
+  // they are produced and the directory is only assembled once all of the
+  // content has been written, so peak memory use is bounded by a few pages
+  // per stream rather than the whole stream set.
+  // @param pdb_path the path of the PDB file to write.
+  // @param producers one producer callback per stream, in stream order.
+  // @returns true on success, false otherwise.
+  bool WriteStreaming(const base::FilePath& pdb_path,
+                      const std::vector<StreamProducer>& producers);
+
  protected:
+  // Writes the preamble pages reserved at the beginning of the file (the
+  // header page, the two free page map pages and an empty fourth page),
+  // setting @p page_count to the number of pages written.
+  bool WritePreamble(uint32* page_count);
+
   // Append the contents of the stream onto the file handle at the offset. The
   // contents of the file are padded to reach the next page boundary in the
   // output stream. The indices of the written pages are appended to
@@ -48,6 +73,27 @@ class PdbWriter {
                     std::vector<uint32>* pages_written,
                     uint32* page_count);
 
+  // Appends the content produced by @p producer onto the file handle,
+  // buffering it a page at a time. The contents are padded to reach the next
+  // page boundary in the output stream. The indices of the written pages are
+  // appended to @p pages_written, @p page_count is updated to reflect the
+  // total number of pages written to disk, and the total number of bytes
+  // produced is returned via @p stream_length.
+  bool AppendStreamFromProducer(const StreamProducer& producer,
+                                std::vector<uint32>* pages_written,
+                                uint32* page_count,
+                                uint32* stream_length);
+
+  // Writes the directory and root directory streams, then the MSF header and
+  // the free page map. @p directory holds the assembled directory contents,
+  // and [@p stream0_start, @p stream0_end) delimits the entries of
+  // @p directory holding the pages of stream 0, which are marked as free.
+  // This closes the file on success.
+  bool WriteDirectoryAndHeader(const std::vector<uint32>& directory,
+                               size_t stream0_start,
+                               size_t stream0_end,
+                               uint32 page_count);
+
   // Writes the MSF header after the directory has been written.
   bool WriteHeader(const std::vector<uint32>& root_directory_pages,
                    size_t directory_size,
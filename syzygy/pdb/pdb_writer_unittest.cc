@@ -14,6 +14,7 @@
 
 #include "syzygy/pdb/pdb_writer.h"
 
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/file_util.h"
 #include "base/files/scoped_temp_dir.h"
@@ -123,6 +124,22 @@ void EnsurePdbContentsAreIdentical(const PdbFile& pdb_file,
   }
 }
 
+// Produces the contents of @p stream in chunks of at most @p chunk_size
+// bytes, using the stream's own cursor to keep track of its position.
+bool ProducePdbStreamChunk(PdbStream* stream,
+                           size_t chunk_size,
+                           std::vector<uint8>* chunk) {
+  DCHECK(stream != NULL);
+  DCHECK(chunk != NULL);
+
+  chunk->resize(chunk_size);
+  size_t bytes_read = 0;
+  if (!stream->ReadBytes(chunk->data(), chunk_size, &bytes_read))
+    return false;
+  chunk->resize(bytes_read);
+  return true;
+}
+
 }  // namespace
 
 using pdb::kPdbHeaderMagicString;
@@ -230,6 +247,38 @@ TEST(PdbWriterTest, WritePdbFile) {
       EnsurePdbContentsAreIdentical(pdb_file, pdb_file_read));
 }
 
+TEST(PdbWriterTest, WriteStreaming) {
+  PdbFile pdb_file;
+  for (uint32 i = 0; i < 4; ++i)
+    pdb_file.AppendStream(new TestPdbStream(1 << (8 + i), (i << 24)));
+
+  // Produce each stream in odd-sized chunks so that the chunks straddle page
+  // boundaries.
+  std::vector<PdbWriter::StreamProducer> producers;
+  for (size_t i = 0; i < pdb_file.StreamCount(); ++i) {
+    PdbStream* stream = pdb_file.GetStream(i);
+    stream->Seek(0);
+    producers.push_back(base::Bind(&ProducePdbStreamChunk,
+                                   base::Unretained(stream),
+                                   100 + 13 * i));
+  }
+
+  // Test that we can stream out a pdb file and then read it successfully.
+  testing::ScopedTempFile file;
+  {
+    // Create a scope so that the file gets closed.
+    TestPdbWriter writer;
+    EXPECT_TRUE(writer.WriteStreaming(file.path(), producers));
+  }
+
+  PdbFile pdb_file_read;
+  PdbReader reader;
+  EXPECT_TRUE(reader.Read(file.path(), &pdb_file_read));
+
+  ASSERT_NO_FATAL_FAILURE(
+      EnsurePdbContentsAreIdentical(pdb_file, pdb_file_read));
+}
+
 TEST(PdbWriterTest, PdbStrCompatible) {
   base::FilePath test_dll_pdb =
       testing::GetSrcRelativePath(testing::kTestPdbFilePath);
@@ -14,6 +14,8 @@
 
 #include "syzygy/pe/coff_decomposer.h"
 
+#include <vector>
+
 #include "base/auto_reset.h"
 #include "base/strings/string_split.h"
 #include "syzygy/block_graph/typed_block.h"
@@ -40,6 +42,14 @@ typedef BlockGraph::ReferenceType ReferenceType;
 
 typedef std::map<size_t, const char*> ComdatMap;
 
+// The precomputed target of a symbol: the block the symbol resolves to,
+// and the offset of the target within that block. Symbols that cannot be
+// resolved ahead of time have a NULL block.
+struct SymbolTarget {
+  Block* block;
+  BlockGraph::Offset offset;
+};
+
 const char kHeadersBlockName[] = "<headers>";
 const char kSymbolsBlockName[] = "<symbols>";
 const char kStringsBlockName[] = "<strings>";
@@ -816,29 +826,107 @@ bool CoffDecomposer::CreateReferencesFromDebugInfo() {
 bool CoffDecomposer::CreateReferencesFromRelocations() {
   DCHECK(image_ != NULL);
 
-  CoffFile::RelocMap reloc_map;
-  image_file_.DecodeRelocs(&reloc_map);
+  // Resolve the symbol table block once; external symbols are represented
+  // as references into it.
+  Block* symbols_block = NULL;
+  BlockGraph::Offset symbols_offset = -1;
+  if (!FileOffsetToBlockOffset(image_file_.symbols_address(),
+                               &symbols_block, &symbols_offset)) {
+    return false;
+  }
+  DCHECK(symbols_block != NULL);
 
-  CoffFile::RelocMap::iterator it = reloc_map.begin();
-  for (; it != reloc_map.end(); ++it) {
-    DCHECK(it->second != NULL);
-    const IMAGE_SYMBOL* symbol =
-        image_file_.symbol(it->second->SymbolTableIndex);
+  // Precompute the target of every symbol. Relocations vastly outnumber
+  // symbols, so resolving each symbol once and indexing into a flat array
+  // during the relocation pass is much cheaper than the map and address
+  // space queries this would otherwise cost for every relocation.
+  size_t num_symbols = image_file_.file_header()->NumberOfSymbols;
+  std::vector<SymbolTarget> symbol_targets(num_symbols);
+  const IMAGE_SYMBOL* symbol = NULL;
+  for (size_t i = 0; i < num_symbols; i += 1 + symbol->NumberOfAuxSymbols) {
+    symbol = image_file_.symbol(i);
     DCHECK(symbol != NULL);
 
-    // Compute reference attributes.
-    ReferenceType ref_type = BlockGraph::REFERENCE_TYPE_MAX;
-    BlockGraph::Size ref_size = 0;
-    if (!GetRelocationTypeAndSize(*it->second, &ref_type, &ref_size))
+    if (symbol->SectionNumber > 0) {
+      // Section symbol. The target is the block of the section the symbol
+      // lies in.
+      SectionBlockMap::iterator it =
+          section_block_map_.find(symbol->SectionNumber - 1);
+      if (it == section_block_map_.end())
+        continue;
+      DCHECK(it->second != NULL);
+      DCHECK_LE(symbol->Value, it->second->size());
+      symbol_targets[i].block = it->second;
+      symbol_targets[i].offset = symbol->Value;
+    } else if (symbol->SectionNumber == 0) {
+      // External symbol. As a convention, we use a reference to the symbol
+      // table, since there is no corresponding block. The offset is ignored
+      // (will be inferred from the symbol value and reference type).
+      symbol_targets[i].block = symbols_block;
+      symbol_targets[i].offset = symbols_offset + i * sizeof(*symbol);
+    }
+    // Symbols with a negative section number cannot be converted to a
+    // reference; their target is left NULL so that relocations against
+    // them are diagnosed through the generic path below.
+  }
+
+  // Walk the relocation table of each section linearly, resolving targets
+  // through the precomputed symbol array.
+  size_t num_sections = image_file_.file_header()->NumberOfSections;
+  for (size_t section_index = 0; section_index < num_sections;
+       ++section_index) {
+    size_t num_relocs = image_file_.num_section_relocs(section_index);
+    if (num_relocs == 0)
       continue;
-    DCHECK_LT(ref_type, BlockGraph::REFERENCE_TYPE_MAX);
-    DCHECK_GT(ref_size, 0u);
+    const IMAGE_RELOCATION* relocs = image_file_.section_relocs(section_index);
+    DCHECK(relocs != NULL);
 
-    // Add reference.
-    size_t offset = symbol->SectionNumber == 0 ? 0 : symbol->Value;
-    if (!CreateSymbolOffsetReference(it->first, ref_type, ref_size,
-                                     symbol, offset)) {
-      return false;
+    const IMAGE_SECTION_HEADER* header =
+        image_file_.section_header(section_index);
+    DCHECK(header != NULL);
+
+    // All relocations of a section originate from the block of that
+    // section.
+    SectionBlockMap::iterator it = section_block_map_.find(section_index);
+    DCHECK(it != section_block_map_.end());
+    Block* source = it->second;
+    DCHECK(source != NULL);
+
+    for (size_t i = 0; i < num_relocs; ++i) {
+      const IMAGE_RELOCATION* reloc = relocs + i;
+      DCHECK_LT(reloc->SymbolTableIndex, num_symbols);
+
+      // Compute reference attributes.
+      ReferenceType ref_type = BlockGraph::REFERENCE_TYPE_MAX;
+      BlockGraph::Size ref_size = 0;
+      if (!GetRelocationTypeAndSize(*reloc, &ref_type, &ref_size))
+        continue;
+      DCHECK_LT(ref_type, BlockGraph::REFERENCE_TYPE_MAX);
+      DCHECK_GT(ref_size, 0u);
+
+      BlockGraph::Offset src_offset =
+          reloc->VirtualAddress - header->VirtualAddress;
+
+      const SymbolTarget& target = symbol_targets[reloc->SymbolTableIndex];
+      if (target.block == NULL) {
+        // Fall back on generic symbol resolution for the cases the
+        // precomputed array does not cover, preserving its diagnostics.
+        symbol = image_file_.symbol(reloc->SymbolTableIndex);
+        DCHECK(symbol != NULL);
+        size_t offset = symbol->SectionNumber == 0 ? 0 : symbol->Value;
+        FileOffsetAddress src_addr(header->PointerToRawData + src_offset);
+        if (!CreateSymbolOffsetReference(src_addr, ref_type, ref_size,
+                                         symbol, offset)) {
+          return false;
+        }
+        continue;
+      }
+
+      // Add reference.
+      if (!CreateReference(source, src_offset, ref_type, ref_size,
+                           target.block, target.offset)) {
+        return false;
+      }
     }
   }
 
@@ -966,6 +1054,20 @@ bool CoffDecomposer::CreateReference(FileOffsetAddress src_addr,
   DCHECK(source != NULL);
   DCHECK_GE(src_offset, 0);
 
+  return CreateReference(source, src_offset, ref_type, ref_size,
+                         target, offset);
+}
+
+bool CoffDecomposer::CreateReference(Block* source,
+                                     BlockGraph::Offset src_offset,
+                                     ReferenceType ref_type,
+                                     BlockGraph::Size ref_size,
+                                     Block* target,
+                                     BlockGraph::Offset offset) {
+  DCHECK(image_ != NULL);
+  DCHECK(source != NULL);
+  DCHECK_GE(src_offset, 0);
+
   // Read additional offset for relocations.
   BlockGraph::Offset extra_offset = 0;
   if ((ref_type & BlockGraph::RELOC_REF_BIT) != 0) {
@@ -162,7 +162,9 @@ class CoffDecomposer {
 
   // Add references to section blocks created with
   // CreateBlocksFromSections(), computed from the relocation table
-  // associated with each section.
+  // associated with each section. The target of every symbol is resolved
+  // once into a flat array, which a single linear pass over each
+  // relocation table then indexes into.
   //
   // @returns true on success, false on failure.
   bool CreateReferencesFromRelocations();
@@ -213,6 +215,25 @@ class CoffDecomposer {
                        BlockGraph::Block* target,
                        BlockGraph::Offset offset);
 
+  // Create a reference as specified, ignoring any existing identical
+  // reference at the same source offset. This variant takes an
+  // already-resolved source block and offset.
+  //
+  // @param source the block the reference originates from.
+  // @param src_offset the offset within @p source where the reference is
+  //     located.
+  // @param ref_type the type of reference to create.
+  // @param ref_size the size of the reference to create.
+  // @param target the destination block of the reference.
+  // @param offset the offset within @p target to the destination.
+  // @returns true on success, false on failure.
+  bool CreateReference(BlockGraph::Block* source,
+                       BlockGraph::Offset src_offset,
+                       BlockGraph::ReferenceType ref_type,
+                       BlockGraph::Size ref_size,
+                       BlockGraph::Block* target,
+                       BlockGraph::Offset offset);
+
   // Create a reference to the specified file offset, ignoring any existing
   // identical reference at the same source offset.
   //
@@ -311,19 +311,19 @@ TEST_F(CoffDecomposerTest, RoundTripBasicBlockTest) {
     BlockGraph::Block* new_block = builder.new_blocks()[0];
 
     // Throw away any PC relative self-references. These aren't produced
-    // by the decomposer, but *are* produced by the block builder.
-    BlockGraph::Block::ReferenceMap::const_iterator ref_it;
-    BlockGraph::Block::ReferenceMap::const_iterator next_ref_it =
+    // by the decomposer, but *are* produced by the block builder. Removing
+    // a reference invalidates iterators into the map, so restart past the
+    // removed offset after each removal.
+    BlockGraph::Block::ReferenceMap::const_iterator ref_it =
         new_block->references().begin();
-    while (true) {
-      ref_it = next_ref_it;
-      if (ref_it == new_block->references().end())
-        break;
-      ++next_ref_it;
-
+    while (ref_it != new_block->references().end()) {
       if (ref_it->second.type() == BlockGraph::PC_RELATIVE_REF &&
           ref_it->second.referenced() == new_block) {
-        new_block->RemoveReference(ref_it->first);
+        BlockGraph::Offset ref_offset = ref_it->first;
+        new_block->RemoveReference(ref_offset);
+        ref_it = new_block->references().upper_bound(ref_offset);
+      } else {
+        ++ref_it;
       }
     }
 
@@ -143,6 +143,29 @@ class CoffFile : public PECoffFile<CoffAddressSpaceTraits> {
   // @returns true on success, false on error.
   bool DecodeSectionRelocs(size_t section_index, RelocMap* reloc_map) const;
 
+  // Retrieve a pointer to the relocation table of the specified section.
+  //
+  // @param section_index the index of the section.
+  // @returns a pointer to the first relocation of the section, or NULL if
+  //     the section has no relocations or @p section_index is invalid.
+  const IMAGE_RELOCATION* section_relocs(size_t section_index) const {
+    if (section_index >= reloc_infos_.size())
+      return NULL;
+    return reloc_infos_[section_index].relocs_;
+  }
+
+  // Retrieve the number of relocations in the relocation table of the
+  // specified section.
+  //
+  // @param section_index the index of the section.
+  // @returns the number of relocations, or zero if the section has no
+  //     relocations or @p section_index is invalid.
+  size_t num_section_relocs(size_t section_index) const {
+    if (section_index >= reloc_infos_.size())
+      return 0;
+    return reloc_infos_[section_index].num_relocs_;
+  }
+
   // Test whether the specified section is mapped into the address
   // space of this object. BSS sections are not mapped and must be
   // handled specially.
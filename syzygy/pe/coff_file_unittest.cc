@@ -123,6 +123,28 @@ TEST_F(CoffFileTest, DecodeRelocs) {
   }
 }
 
+TEST_F(CoffFileTest, SectionRelocs) {
+  ASSERT_TRUE(image_file_.Init(test_dll_obj_path_));
+
+  CoffFile::RelocMap reloc_map;
+  image_file_.DecodeRelocs(&reloc_map);
+
+  // The raw per-section relocation tables must agree with the decoded map.
+  size_t num_relocs = 0;
+  size_t num_sections = image_file_.file_header()->NumberOfSections;
+  for (size_t i = 0; i < num_sections; ++i) {
+    size_t num_section_relocs = image_file_.num_section_relocs(i);
+    if (num_section_relocs > 0)
+      EXPECT_TRUE(image_file_.section_relocs(i) != NULL);
+    num_relocs += num_section_relocs;
+  }
+  EXPECT_EQ(reloc_map.size(), num_relocs);
+
+  // Out-of-range section indexes must be handled gracefully.
+  EXPECT_TRUE(image_file_.section_relocs(num_sections) == NULL);
+  EXPECT_EQ(0u, image_file_.num_section_relocs(num_sections));
+}
+
 TEST_F(CoffFileTest, GetSymbolName) {
   ASSERT_TRUE(image_file_.Init(test_dll_obj_path_));
 
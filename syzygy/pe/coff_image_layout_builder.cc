@@ -42,6 +42,7 @@
 
 #include "syzygy/pe/coff_image_layout_builder.h"
 
+#include <hash_map>
 #include <vector>
 
 #include "base/auto_reset.h"
@@ -64,13 +65,35 @@ using core::FileOffsetAddress;
 // relocation blocks.
 typedef std::vector<IMAGE_RELOCATION> RelocVector;
 
+// The key under which a symbol is looked up: the block and base offset its
+// resolved reference points at.
+typedef std::pair<BlockGraph::Block*, BlockGraph::Offset> SymbolKey;
+
+// Hash functor for symbol keys.
+class HashSymbolKey {
+ public:
+  static const size_t bucket_size = 4;
+  static const size_t min_buckets = 8;
+
+  size_t operator()(const SymbolKey& key) const {
+    return reinterpret_cast<size_t>(key.first) ^
+        static_cast<size_t>(key.second);
+  }
+
+  bool operator()(const SymbolKey& a, const SymbolKey& b) const {
+    return a < b;
+  }
+};
+
 // A map from references to symbol indexes, in order to translate references
-// to relocations, which are symbol-based.
-typedef std::map<std::pair<BlockGraph::Block*, BlockGraph::Offset>, size_t>
-    SymbolMap;
+// to relocations, which are symbol-based. It is built in a single pass over
+// the symbol table and then queried once per relocation, so it is hashed
+// rather than tree-based.
+typedef stdext::hash_map<SymbolKey, size_t, HashSymbolKey> SymbolMap;
 
-// A map from section IDs to their (new) position in the resulting layout.
-typedef std::map<BlockGraph::SectionId, size_t> SectionIndexMap;
+// The value marking sections absent from the new layout in the section
+// remap table.
+const size_t kInvalidSectionIndex = static_cast<size_t>(-1);
 
 // Microsoft specifications recommend 4-byte alignment for object files.
 const size_t kFileAlignment = 4;
@@ -498,8 +521,12 @@ bool CoffImageLayoutBuilder::LayoutSymbolAndStringTables(
   if (!LayoutBlockImpl(strings_block_))
     return false;
 
-  // Compute the section index map, used to remap symbol section references.
-  SectionIndexMap section_index_map;
+  // Compute the section remap table (old section ID to new section index),
+  // used to remap symbol section references. Section IDs are dense, so the
+  // table is a flat vector built in a single pass, and each reference below
+  // is remapped with an indexed load rather than a map lookup.
+  std::vector<size_t> section_index_map(
+      image_layout_->blocks.graph()->sections().size(), kInvalidSectionIndex);
   OrderedBlockGraph::SectionList::const_iterator section_it =
       ordered_graph.ordered_sections().begin();
   OrderedBlockGraph::SectionList::const_iterator section_end =
@@ -508,7 +535,8 @@ bool CoffImageLayoutBuilder::LayoutSymbolAndStringTables(
   for (; section_it != section_end; ++section_it) {
     BlockGraph::Section* section = (*section_it)->section();
     DCHECK(section != NULL);
-    section_index_map.insert(std::make_pair(section->id(), section_index));
+    DCHECK_LT(section->id(), section_index_map.size());
+    section_index_map[section->id()] = section_index;
     ++section_index;
   }
 
@@ -528,13 +556,14 @@ bool CoffImageLayoutBuilder::LayoutSymbolAndStringTables(
           return false;
         }
 
-        SectionIndexMap::iterator section_index_it =
-            section_index_map.find(it->second.referenced()->section());
-        if (section_index_it == section_index_map.end()) {
+        BlockGraph::SectionId section_id =
+            it->second.referenced()->section();
+        if (section_id >= section_index_map.size() ||
+            section_index_map[section_id] == kInvalidSectionIndex) {
           LOG(ERROR) << "Reference to unmapped section.";
           return false;
         }
-        *section_number = section_index_it->second + 1;
+        *section_number = section_index_map[section_id] + 1;
         DCHECK_EQ(*section_number, symbols[symbol_index].SectionNumber);
         break;
       }
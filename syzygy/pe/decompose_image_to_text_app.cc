@@ -14,10 +14,19 @@
 
 #include "syzygy/pe/decompose_image_to_text_app.h"
 
+#include <algorithm>
+
+#include "base/file_util.h"
+#include "base/memory/scoped_vector.h"
+#include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/pe/pe_transform_policy.h"
+#include "syzygy/pe/serialization.h"
 
 #include "distorm.h"  // NOLINT
 
@@ -41,6 +50,11 @@ const char kUsageFormatStr[] =
   "Available options\n"
   "  --basic-blocks\n"
   "    Breaks each function down to basic blocks and dumps it at that level.\n"
+  "  --binary-dump=<file>\n"
+  "    Writes a stable binary serialization of the decomposition to the\n"
+  "    given file instead of a textual dump. Binary dumps of images with\n"
+  "    identical layouts are identical, and they are considerably faster\n"
+  "    to generate and to diff than text dumps.\n"
   "  --image=<image file>\n";
 
 using block_graph::BlockGraph;
@@ -49,24 +63,28 @@ using block_graph::BasicCodeBlock;
 using block_graph::BasicDataBlock;
 using block_graph::BasicBlockReference;
 
-void DumpReference(const BasicBlockReference& ref, FILE* out) {
+void DumpReference(const BasicBlockReference& ref, std::string* out) {
   DCHECK(out != NULL);
 
   switch (ref.referred_type()) {
     case BasicBlockReference::REFERRED_TYPE_BLOCK: {
         const BlockGraph::Block* block = ref.block();
         if (ref.offset() == 0) {
-          ::fprintf(out, " ; (%s)", block->name().c_str());
+          base::StringAppendF(out, " ; (%s)", block->name().c_str());
         } else if (ref.offset() < 0) {
-          ::fprintf(out, " ; (%s%d)", block->name().c_str(), ref.offset());
+          base::StringAppendF(out, " ; (%s%d)",
+                              block->name().c_str(),
+                              ref.offset());
         } else {
           BlockGraph::Label label;
           if (block->GetLabel(ref.offset(), &label)) {
-            ::fprintf(out, " ; (%s:%s)",
-                      block->name().c_str(),
-                      label.ToString().c_str());
+            base::StringAppendF(out, " ; (%s:%s)",
+                                block->name().c_str(),
+                                label.ToString().c_str());
           } else {
-            ::fprintf(out, " ; (%s+%d)", block->name().c_str(), ref.offset());
+            base::StringAppendF(out, " ; (%s+%d)",
+                                block->name().c_str(),
+                                ref.offset());
           }
         }
       }
@@ -76,7 +94,7 @@ void DumpReference(const BasicBlockReference& ref, FILE* out) {
         const BasicBlock* bb = ref.basic_block();
         DCHECK_EQ(0, ref.offset());
 
-        ::fprintf(out, " ; (%s)", bb->name().c_str());
+        base::StringAppendF(out, " ; (%s)", bb->name().c_str());
       }
       break;
 
@@ -87,13 +105,45 @@ void DumpReference(const BasicBlockReference& ref, FILE* out) {
   }
 }
 
-void HexDump(const uint8* data, size_t size, FILE* out) {
+void HexDump(const uint8* data, size_t size, std::string* out) {
   for (size_t i = 0; i < size; ++i)
-    ::fprintf(out, "%02x", data[i]);
+    base::StringAppendF(out, "%02x", data[i]);
 }
 
 }  // namespace
 
+// A worker that dumps every num_workers'th chunk, starting at chunk
+// worker_index. The chunks are disjoint, so the workers share no mutable
+// state and need no locking.
+class DecomposeImageToTextApp::DumpChunkWorker
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  DumpChunkWorker(DecomposeImageToTextApp* app,
+                  std::vector<DumpChunk>* chunks,
+                  size_t worker_index,
+                  size_t num_workers)
+      : app_(app),
+        chunks_(chunks),
+        worker_index_(worker_index),
+        num_workers_(num_workers) {
+    DCHECK(app != NULL);
+    DCHECK(chunks != NULL);
+    DCHECK_LT(worker_index, num_workers);
+  }
+
+  virtual void Run() OVERRIDE {
+    app_->DumpChunks(chunks_, worker_index_, num_workers_);
+  }
+
+ private:
+  DecomposeImageToTextApp* app_;
+  std::vector<DumpChunk>* chunks_;
+  size_t worker_index_;
+  size_t num_workers_;
+
+  DISALLOW_COPY_AND_ASSIGN(DumpChunkWorker);
+};
+
 
 DecomposeImageToTextApp::DecomposeImageToTextApp()
     : common::AppImplBase("Image To Text Decomposer"),
@@ -120,6 +170,7 @@ bool DecomposeImageToTextApp::ParseCommandLine(
     return false;
   }
 
+  binary_dump_path_ = cmd_line->GetSwitchValuePath("binary-dump");
   dump_basic_blocks_ = cmd_line->HasSwitch("basic-blocks");
 
   return true;
@@ -141,16 +192,69 @@ void DecomposeImageToTextApp::DumpAddressSpaceToText(
   BlockGraph::AddressSpace::RangeMap::const_iterator block_end(
     address_space.address_space_impl().ranges().end());
 
+  // Partition the address space into ordered chunks, one per section. The
+  // blocks of a chunk are dumped to an in-memory buffer, which lets the
+  // chunks be generated on worker threads and streamed out in order.
+  std::vector<DumpChunk> chunks;
+  BlockGraph::SectionId prev_section = BlockGraph::kInvalidSectionId;
   for (; block_it != block_end; ++block_it) {
     const BlockGraph::Block* block = block_it->second;
     RelativeAddress addr = block_it->first.start();
 
-    DumpBlockToText(addr, block);
+    if (chunks.empty() || block->section() != prev_section) {
+      chunks.push_back(DumpChunk());
+      prev_section = block->section();
+    }
+    chunks.back().blocks.push_back(DumpChunk::BlockPair(addr, block));
+  }
+
+  // Fan the formatting out across worker threads. With a single thread the
+  // work is done inline to avoid the thread start/join overhead.
+  size_t num_workers = std::min(
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()),
+      chunks.size());
+  if (num_workers <= 1) {
+    DumpChunks(&chunks, 0, 1);
+  } else {
+    ScopedVector<DumpChunkWorker> workers;
+    ScopedVector<base::DelegateSimpleThread> threads;
+    for (size_t i = 0; i < num_workers; ++i) {
+      workers.push_back(new DumpChunkWorker(this, &chunks, i, num_workers));
+      threads.push_back(new base::DelegateSimpleThread(
+          workers.back(), "DumpChunkWorker"));
+      threads.back()->Start();
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Join();
+  }
+
+  // Stream the buffered chunks out in address order.
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    ::fwrite(chunks[i].text.data(), 1, chunks[i].text.size(), out());
+    num_refs_ += chunks[i].num_refs;
+  }
+}
+
+void DecomposeImageToTextApp::DumpChunks(std::vector<DumpChunk>* chunks,
+                                         size_t worker_index,
+                                         size_t num_workers) {
+  DCHECK(chunks != NULL);
+  DCHECK_LT(worker_index, num_workers);
+
+  for (size_t i = worker_index; i < chunks->size(); i += num_workers) {
+    DumpChunk* chunk = &(*chunks)[i];
+    for (size_t j = 0; j < chunk->blocks.size(); ++j) {
+      DumpBlockToText(chunk->blocks[j].first,
+                      chunk->blocks[j].second,
+                      &chunk->text,
+                      &chunk->num_refs);
+    }
   }
 }
 
 void DecomposeImageToTextApp::DumpSubGraphToText(
-    BasicBlockSubGraph& subgraph) {
+    BasicBlockSubGraph& subgraph, std::string* text) {
+  DCHECK(text != NULL);
   typedef BasicBlockSubGraph::BlockDescription BlockDescription;
   typedef BasicBlockSubGraph::BasicBlockOrdering BasicBlockOrdering;
   typedef block_graph::BasicBlock BasicBlock;
@@ -168,15 +272,15 @@ void DecomposeImageToTextApp::DumpSubGraphToText(
     DCHECK(bb != NULL);
 
     // Print the BB's name for an identifying label.
-    ::fprintf(out(), "%s:\n", bb->name().c_str());
+    base::StringAppendF(text, "%s:\n", bb->name().c_str());
 
     switch (bb->type()) {
       case BasicBlock::BASIC_CODE_BLOCK:
-        DumpCodeBBToText(block, BasicCodeBlock::Cast(bb));
+        DumpCodeBBToText(block, BasicCodeBlock::Cast(bb), text);
         break;
 
       case BasicBlock::BASIC_DATA_BLOCK:
-        DumpDataBBToText(block, BasicDataBlock::Cast(bb));
+        DumpDataBBToText(block, BasicDataBlock::Cast(bb), text);
         break;
 
       default:
@@ -187,7 +291,10 @@ void DecomposeImageToTextApp::DumpSubGraphToText(
 }
 
 void DecomposeImageToTextApp::DumpCodeBBToText(
-    const BlockGraph::Block* block, const BasicCodeBlock* bb) {
+    const BlockGraph::Block* block,
+    const BasicCodeBlock* bb,
+    std::string* text) {
+  DCHECK(text != NULL);
   BasicBlock::Instructions::const_iterator instr_it(
       bb->instructions().begin());
   for (; instr_it != bb->instructions().end(); ++instr_it) {
@@ -203,17 +310,17 @@ void DecomposeImageToTextApp::DumpCodeBBToText(
 
     dinst.addr = 0;
     distorm_format(&code, &dinst, &decoded);
-    ::fprintf(out(), "  %-14s %s %s",
-              decoded.instructionHex.p,
-              decoded.mnemonic.p,
-              decoded.operands.p);
+    base::StringAppendF(text, "  %-14s %s %s",
+                        decoded.instructionHex.p,
+                        decoded.mnemonic.p,
+                        decoded.operands.p);
 
     BasicBlock::BasicBlockReferenceMap::const_iterator ref_it(
         instr_it->references().begin());
     for (; ref_it != instr_it->references().end(); ++ref_it) {
-      DumpReference(ref_it->second, out());
+      DumpReference(ref_it->second, text);
     }
-    ::fprintf(out(), "\n");
+    text->append("\n");
   }
 
   BasicBlock::Successors::const_iterator succ_it(bb->successors().begin());
@@ -237,19 +344,23 @@ void DecomposeImageToTextApp::DumpCodeBBToText(
       distorm_decompose64(&code, &instr, 1, &count);
       instr.addr = 0;
       distorm_format(&code, &instr, &decoded);
-      ::fprintf(out(), "  %-14s %s %s",
-                decoded.instructionHex.p,
-                decoded.mnemonic.p,
-                decoded.operands.p);
+      base::StringAppendF(text, "  %-14s %s %s",
+                          decoded.instructionHex.p,
+                          decoded.mnemonic.p,
+                          decoded.operands.p);
 
-      DumpReference(succ.reference(), out());
-      ::fprintf(out(), "\n");
+      DumpReference(succ.reference(), text);
+      text->append("\n");
     }
   }
 }
 
 void DecomposeImageToTextApp::DumpDataBBToText(
-    const BlockGraph::Block* block, const BasicDataBlock* bb) {
+    const BlockGraph::Block* block,
+    const BasicDataBlock* bb,
+    std::string* text) {
+  DCHECK(text != NULL);
+
   // Here we proceed by dumping a hex chunk up to the next reference, then
   // the reference and so on.
   size_t curr_start = 0;
@@ -265,30 +376,30 @@ void DecomposeImageToTextApp::DumpDataBBToText(
       // We're on a reference, dump it and it's reference.
       switch (it->second.size()) {
         case 1:
-          ::fprintf(out(), "  DB ");
+          text->append("  DB ");
           break;
         case 2:
-          ::fprintf(out(), "  DW ");
+          text->append("  DW ");
           break;
         case 4:
-          ::fprintf(out(), "  DD ");
+          text->append("  DD ");
           break;
         default:
           NOTREACHED();
           break;
       }
-      HexDump(bb->data() + curr_start, it->second.size(), out());
-      DumpReference(it->second, out());
-      ::fprintf(out(), "\n");
+      HexDump(bb->data() + curr_start, it->second.size(), text);
+      DumpReference(it->second, text);
+      text->append("\n");
 
       curr_start += it->second.size();
     } else {
       if (next_chunk_end - curr_start > 16)
         next_chunk_end = curr_start + 16;
 
-      ::fprintf(out(), "  DB ");
-      HexDump(bb->data() + curr_start, next_chunk_end - curr_start, out());
-      ::fprintf(out(), "\n");
+      text->append("  DB ");
+      HexDump(bb->data() + curr_start, next_chunk_end - curr_start, text);
+      text->append("\n");
 
       curr_start = next_chunk_end;
     }
@@ -296,11 +407,17 @@ void DecomposeImageToTextApp::DumpDataBBToText(
 }
 
 void DecomposeImageToTextApp::DumpBlockToText(
-    core::RelativeAddress addr, const BlockGraph::Block* block) {
-  ::fprintf(out(), "0x%08X(%d): %s\n",
-            addr.value(),
-            block->size(),
-            block->name().c_str());
+    core::RelativeAddress addr,
+    const BlockGraph::Block* block,
+    std::string* text,
+    size_t* num_refs) {
+  DCHECK(text != NULL);
+  DCHECK(num_refs != NULL);
+
+  base::StringAppendF(text, "0x%08X(%d): %s\n",
+                      addr.value(),
+                      block->size(),
+                      block->name().c_str());
 
   pe::PETransformPolicy policy;
 
@@ -311,7 +428,7 @@ void DecomposeImageToTextApp::DumpBlockToText(
     BasicBlockDecomposer decomposer(block, &subgraph);
 
     if (decomposer.Decompose()) {
-      DumpSubGraphToText(subgraph);
+      DumpSubGraphToText(subgraph, text);
       return;
     }
     // Fall through on failure to decompose.
@@ -320,38 +437,38 @@ void DecomposeImageToTextApp::DumpBlockToText(
   BlockGraph::Block::LabelMap::const_iterator
       label_it(block->labels().begin());
   for (; label_it != block->labels().end(); ++label_it) {
-    ::fprintf(out(), "\t+0x%04X: %s\n",
-              label_it->first,
-              label_it->second.ToString().c_str());
+    base::StringAppendF(text, "\t+0x%04X: %s\n",
+                        label_it->first,
+                        label_it->second.ToString().c_str());
   }
 
   BlockGraph::Block::ReferenceMap::const_iterator ref_it(
       block->references().begin());
   for (; ref_it != block->references().end(); ++ref_it) {
-    ++num_refs_;
+    ++(*num_refs);
     const BlockGraph::Reference& ref = ref_it->second;
     if (ref.offset() == 0) {
-      ::fprintf(out(), "\t+0x%04X->%s(%d)\n",
-                ref_it->first,
-                ref.referenced()->name().c_str(),
-                ref.size());
+      base::StringAppendF(text, "\t+0x%04X->%s(%d)\n",
+                          ref_it->first,
+                          ref.referenced()->name().c_str(),
+                          ref.size());
     } else {
       // See if there's a label at the destination's offset, and if so
       // use that in preference to a raw numeric offset.
       BlockGraph::Block::LabelMap::const_iterator label =
           ref.referenced()->labels().find(ref.offset());
       if (label != ref.referenced()->labels().end()) {
-        ::fprintf(out(), "\t+0x%04X->%s:%s[%d]\n",
-                  ref_it->first,
-                  ref.referenced()->name().c_str(),
-                  label->second.ToString().c_str(),
-                  ref.size());
+        base::StringAppendF(text, "\t+0x%04X->%s:%s[%d]\n",
+                            ref_it->first,
+                            ref.referenced()->name().c_str(),
+                            label->second.ToString().c_str(),
+                            ref.size());
       } else {
-        ::fprintf(out(), "\t+0x%04X->%s+0x%04X(%d)\n",
-                  ref_it->first,
-                  ref.referenced()->name().c_str(),
-                  ref.offset(),
-                  ref.size());
+        base::StringAppendF(text, "\t+0x%04X->%s+0x%04X(%d)\n",
+                            ref_it->first,
+                            ref.referenced()->name().c_str(),
+                            ref.offset(),
+                            ref.size());
       }
     }
   }
@@ -377,6 +494,10 @@ bool DecomposeImageToTextApp::DumpImageToText(
     return false;
   }
 
+  // A binary dump, if requested, replaces the textual one.
+  if (!binary_dump_path_.empty())
+    return DumpImageToBinary(image_file, image_layout);
+
   num_refs_ = 0;
   DumpAddressSpaceToText(image_layout.blocks);
 
@@ -387,4 +508,29 @@ bool DecomposeImageToTextApp::DumpImageToText(
   return true;
 }
 
+bool DecomposeImageToTextApp::DumpImageToBinary(
+    const PEFile& image_file, const ImageLayout& image_layout) {
+  DCHECK(!binary_dump_path_.empty());
+
+  base::ScopedFILE out_file(base::OpenFile(binary_dump_path_, "wb"));
+  if (out_file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << binary_dump_path_.value()
+               << "\" for writing.";
+    return false;
+  }
+
+  core::FileOutStream out_stream(out_file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  if (!SaveBlockGraphAndImageLayout(image_file, 0, image_layout,
+                                    &out_archive)) {
+    LOG(ERROR) << "Unable to serialize image decomposition.";
+    return false;
+  }
+
+  if (!out_archive.Flush())
+    return false;
+
+  return true;
+}
+
 }  // namespace pe
@@ -18,6 +18,10 @@
 #ifndef SYZYGY_PE_DECOMPOSE_IMAGE_TO_TEXT_APP_H_
 #define SYZYGY_PE_DECOMPOSE_IMAGE_TO_TEXT_APP_H_
 
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -25,6 +29,10 @@
 
 namespace pe {
 
+// Forward declarations.
+class PEFile;
+struct ImageLayout;
+
 // This class implements the decompose image to text command-line utility.
 //
 // See the description given in PrintUsage() for information about running
@@ -47,32 +55,81 @@ class DecomposeImageToTextApp : public common::AppImplBase {
   typedef block_graph::BasicDataBlock BasicDataBlock;
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
 
+  // An ordered run of blocks from a single section of the image, along
+  // with the text its dump produces and the number of references it
+  // contains.
+  struct DumpChunk {
+    typedef std::pair<core::RelativeAddress, const BlockGraph::Block*>
+        BlockPair;
+
+    DumpChunk() : num_refs(0) {
+    }
+
+    // The blocks of the chunk, in address order.
+    std::vector<BlockPair> blocks;
+
+    // The formatted dump of the blocks.
+    std::string text;
+
+    // The number of references dumped in this chunk.
+    size_t num_refs;
+  };
+
+  // A worker that dumps a strided subset of the chunks, defined in the
+  // implementation file.
+  class DumpChunkWorker;
+
   void PrintUsage(const base::FilePath& program,
                   const base::StringPiece& message);
 
-  // Given @p address_space, dump it in text format to out().
+  // Given @p address_space, dump it in text format to out(). The dump is
+  // generated in per-section chunks on worker threads and streamed out in
+  // address order.
   void DumpAddressSpaceToText(const BlockGraph::AddressSpace& address_space);
 
-  // Given @p subgraph, dump it in text format to out().
-  void DumpSubGraphToText(BasicBlockSubGraph& subgraph);
+  // Dumps every @p num_workers'th chunk of @p chunks to its text buffer,
+  // starting with the chunk at @p worker_index. Safe to call concurrently
+  // for distinct worker indices; only reads the shared state of this class.
+  void DumpChunks(std::vector<DumpChunk>* chunks,
+                  size_t worker_index,
+                  size_t num_workers);
+
+  // Given @p subgraph, dump it in text format to @p text.
+  void DumpSubGraphToText(BasicBlockSubGraph& subgraph, std::string* text);
 
-  // Given the code basic block @p bb, dump it in text format to out().
+  // Given the code basic block @p bb, dump it in text format to @p text.
   void DumpCodeBBToText(const BlockGraph::Block* block,
-                        const BasicCodeBlock* bb);
-  // Given the data basic block @p bb, dump it in text format to out().
+                        const BasicCodeBlock* bb,
+                        std::string* text);
+  // Given the data basic block @p bb, dump it in text format to @p text.
   void DumpDataBBToText(const BlockGraph::Block* block,
-                        const BasicDataBlock* bb);
+                        const BasicDataBlock* bb,
+                        std::string* text);
 
-  // Dump @p block at @p addr in text format to out().
+  // Dump @p block at @p addr in text format to @p text, counting the
+  // references dumped into @p num_refs.
   void DumpBlockToText(core::RelativeAddress addr,
-                       const BlockGraph::Block* block);
+                       const BlockGraph::Block* block,
+                       std::string* text,
+                       size_t* num_refs);
 
-  // Dump the image at @p image_path to out().
+  // Dump the image at @p image_path to out(), or to binary_dump_path_ if
+  // a binary dump was requested.
   bool DumpImageToText(const base::FilePath& image_path);
 
+  // Serializes the decomposition of @p image_file to binary_dump_path_.
+  // The serialization is deterministic, so two images with the same layout
+  // produce identical files.
+  bool DumpImageToBinary(const PEFile& image_file,
+                         const ImageLayout& image_layout);
+
   // The image to decompose.
   base::FilePath image_path_;
 
+  // If non-empty, the decomposition is serialized to this path in a stable
+  // binary format instead of being dumped as text to out().
+  base::FilePath binary_dump_path_;
+
   // True if we're to dump basic block information.
   bool dump_basic_blocks_;
 
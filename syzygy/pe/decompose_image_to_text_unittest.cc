@@ -14,6 +14,7 @@
 
 #include "syzygy/pe/decompose_image_to_text_app.h"  // NOLINT
 
+#include "base/file_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/unittest_util.h"
@@ -38,6 +39,7 @@ class TestDecomposeImageToTextApp : public DecomposeImageToTextApp {
 
   // Member variables
   using DecomposeImageToTextApp::image_path_;
+  using DecomposeImageToTextApp::binary_dump_path_;
   using DecomposeImageToTextApp::dump_basic_blocks_;
   using DecomposeImageToTextApp::num_refs_;
 };
@@ -131,4 +133,19 @@ TEST_F(DecomposeImageToTextAppTest, RunOnTestDll) {
   ASSERT_EQ(0, app_.Run());
 }
 
+TEST_F(DecomposeImageToTextAppTest, RunOnTestDllWithBinaryDump) {
+  ScopedLogLevelSaver log_level_saver;
+  logging::SetMinLogLevel(logging::LOG_FATAL);
+
+  base::FilePath binary_dump_path = temp_dir_.Append(L"test_dll.bin");
+  cmd_line_.AppendSwitchPath("image", image_path_);
+  cmd_line_.AppendSwitchPath("binary-dump", binary_dump_path);
+
+  ASSERT_EQ(0, app_.Run());
+
+  int64 binary_dump_size = 0;
+  ASSERT_TRUE(base::GetFileSize(binary_dump_path, &binary_dump_size));
+  EXPECT_LT(0, binary_dump_size);
+}
+
 }  // namespace pe
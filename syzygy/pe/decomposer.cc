@@ -16,9 +16,12 @@
 
 #include "pcrecpp.h"  // NOLINT
 #include "base/bind.h"
+#include "base/file_util.h"
+#include "base/memory/scoped_vector.h"
 #include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_comptr.h"
 #include "syzygy/core/zstream.h"
@@ -32,6 +35,7 @@
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/pe/find.h"
+#include "syzygy/pe/pdb_info.h"
 #include "syzygy/pe/pe_file_parser.h"
 #include "syzygy/pe/pe_utils.h"
 #include "syzygy/pe/serialization.h"
@@ -133,6 +137,53 @@ struct Decomposer::IntermediateReference {
   RelativeAddress dst_addr;
 };
 
+// A plain representation of a single entry of the DIA section contribution
+// table. Enumerating the table requires DIA and is inherently serial, but
+// once the raw data has been extracted the remaining work (string conversion
+// and name derivation) is CPU bound and safe to process on worker threads.
+struct Decomposer::SectionContrib {
+  // Extracted from DIA on the main thread.
+  DWORD rva;
+  DWORD length;
+  bool code;
+  bool is_built_by_supported_compiler;
+  std::wstring compiland_name;
+
+  // Computed from compiland_name, potentially on a worker thread.
+  std::string utf8_compiland_name;
+  std::string block_name;
+
+  // @name Serialization, for the per-PDB section-contribution cache. Only
+  //     records whose names have been computed are serialized, so the wide
+  //     compiland name need not be persisted.
+  // @{
+  template<class OutArchive> bool Save(OutArchive* out_archive) const {
+    return out_archive->Save(static_cast<uint32>(rva)) &&
+        out_archive->Save(static_cast<uint32>(length)) &&
+        out_archive->Save(code) &&
+        out_archive->Save(is_built_by_supported_compiler) &&
+        out_archive->Save(utf8_compiland_name) &&
+        out_archive->Save(block_name);
+  }
+  template<class InArchive> bool Load(InArchive* in_archive) {
+    uint32 rva32 = 0;
+    uint32 length32 = 0;
+    if (!in_archive->Load(&rva32) ||
+        !in_archive->Load(&length32) ||
+        !in_archive->Load(&code) ||
+        !in_archive->Load(&is_built_by_supported_compiler) ||
+        !in_archive->Load(&utf8_compiland_name) ||
+        !in_archive->Load(&block_name)) {
+      return false;
+    }
+    rva = rva32;
+    length = length32;
+    compiland_name.clear();
+    return true;
+  }
+  // @}
+};
+
 namespace {
 
 using base::win::ScopedBstr;
@@ -150,6 +201,8 @@ typedef BlockGraph::ReferenceType ReferenceType;
 typedef core::AddressRange<RelativeAddress, size_t> RelativeRange;
 typedef Decomposer::IntermediateReference IntermediateReference;
 typedef Decomposer::IntermediateReferences IntermediateReferences;
+typedef Decomposer::SectionContrib SectionContrib;
+typedef Decomposer::SectionContribs SectionContribs;
 typedef pcrecpp::RE RE;
 typedef std::vector<OMAP> OMAPs;
 typedef std::vector<pdb::PdbFixup> PdbFixups;
@@ -157,6 +210,10 @@ typedef std::vector<pdb::PdbFixup> PdbFixups;
 const char kJumpTable[] = "<jump-table>";
 const char kCaseTable[] = "<case-table>";
 
+// The version of the per-PDB section-contribution cache format. Bump this
+// whenever the serialized representation of SectionContrib changes.
+const uint32 kSectionContribCacheVersion = 1;
+
 // The MS linker pads between code blocks with int3s.
 static const uint8 kInt3 = 0xCC;
 static const size_t kPointerSize = BlockGraph::Reference::kMaximumSize;
@@ -306,6 +363,78 @@ bool AddIntermediateReference(IntermediateReferences* references,
   return true;
 }
 
+// Computes the UTF-8 compiland name and derived block name of @p contrib.
+// This touches no DIA state and no shared state, so disjoint contributions
+// may be processed concurrently.
+// @param contrib the section contribution to process.
+// @returns true on success, false otherwise.
+bool ComputeSectionContribNames(SectionContrib* contrib) {
+  DCHECK_NE(reinterpret_cast<SectionContrib*>(NULL), contrib);
+
+  if (!base::WideToUTF8(contrib->compiland_name.c_str(),
+                        contrib->compiland_name.size(),
+                        &contrib->utf8_compiland_name)) {
+    LOG(ERROR) << "Failed to convert compiland name to UTF8.";
+    return false;
+  }
+
+  // Give a name to the block based on the basename of the object file. This
+  // will eventually be replaced by the full symbol name, if one exists for
+  // the block.
+  const std::string& compiland_name = contrib->utf8_compiland_name;
+  size_t last_component = compiland_name.find_last_of('\\');
+  size_t extension = compiland_name.find_last_of('.');
+  if (last_component == std::string::npos) {
+    last_component = 0;
+  } else {
+    // We don't want to include the last slash.
+    ++last_component;
+  }
+  if (extension < last_component)
+    extension = compiland_name.size();
+  contrib->block_name = compiland_name.substr(last_component,
+                                              extension - last_component);
+
+  return true;
+}
+
+// A worker that computes the names of every max_threads'th section
+// contribution, starting at contribution worker_index. The strided
+// decomposition keeps workers independent without any locking; the work per
+// contribution is uniform enough that this balances well.
+class SectionContribNameWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  SectionContribNameWorker(SectionContribs* contribs,
+                           size_t worker_index,
+                           size_t stride)
+      : contribs_(contribs),
+        worker_index_(worker_index),
+        stride_(stride),
+        success_(false) {
+    DCHECK_NE(reinterpret_cast<SectionContribs*>(NULL), contribs);
+    DCHECK_LT(worker_index, stride);
+  }
+
+  virtual void Run() OVERRIDE {
+    for (size_t i = worker_index_; i < contribs_->size(); i += stride_) {
+      if (!ComputeSectionContribNames(&contribs_->at(i)))
+        return;
+    }
+    success_ = true;
+  }
+
+  // @returns true iff the worker processed all of its contributions.
+  bool success() const { return success_; }
+
+ private:
+  SectionContribs* contribs_;
+  size_t worker_index_;
+  size_t stride_;
+  bool success_;
+
+  DISALLOW_COPY_AND_ASSIGN(SectionContribNameWorker);
+};
+
 // Create a reference as specified. Ignores existing references if they are of
 // the exact same type.
 bool CreateReference(RelativeAddress src_addr,
@@ -463,6 +592,12 @@ bool CreateReferencesFromFixupsImpl(
   DCHECK_NE(reinterpret_cast<BlockGraph::AddressSpace*>(NULL), image);
 
   bool have_omap = !omap_from.empty();
+
+  // Build a lookup table for the OMAP translations; one is applied per
+  // fixup, of which there are typically hundreds of thousands.
+  pdb::OmapTable omap_from_table;
+  if (have_omap)
+    omap_from_table.Init(omap_from);
   size_t fixups_used = 0;
 
   // The resource section in Chrome is modified post-link by a tool that adds a
@@ -503,8 +638,8 @@ bool CreateReferencesFromFixupsImpl(
     RelativeAddress src_addr(pdb_fixups[i].rva_location);
     RelativeAddress base_addr(pdb_fixups[i].rva_base);
     if (have_omap) {
-      src_addr = pdb::TranslateAddressViaOmap(omap_from, src_addr);
-      base_addr = pdb::TranslateAddressViaOmap(omap_from, base_addr);
+      src_addr = omap_from_table.Translate(src_addr);
+      base_addr = omap_from_table.Translate(base_addr);
     }
 
     // If the reference originates beyond the .rsrc section then we can't
@@ -879,8 +1014,8 @@ struct Decomposer::VisitLinkerSymbolContext {
 };
 
 Decomposer::Decomposer(const PEFile& image_file)
-    : image_file_(image_file), image_layout_(NULL), image_(NULL),
-      current_block_(NULL), current_scope_count_(0) {
+    : image_file_(image_file), max_threads_(1), image_layout_(NULL),
+      image_(NULL), current_block_(NULL), current_scope_count_(0) {
 }
 
 bool Decomposer::Decompose(ImageLayout* image_layout) {
@@ -910,6 +1045,11 @@ bool Decomposer::Decompose(ImageLayout* image_layout) {
     return false;
   }
 
+  // Try the decomposition cache, if one has been configured. A hit lets us
+  // bypass DIA entirely.
+  if (!cache_dir_.empty() && LoadImageLayoutFromCache(image_layout))
+    return true;
+
   // At this point a full decomposition needs to be performed.
   image_layout_ = image_layout;
   image_ = &(image_layout->blocks);
@@ -917,9 +1057,213 @@ bool Decomposer::Decompose(ImageLayout* image_layout) {
   image_layout_ = NULL;
   image_ = NULL;
 
+  // Populate the cache so that subsequent decompositions of this image are
+  // cheap. Failure to write the cache is not fatal.
+  if (success && !cache_dir_.empty()) {
+    if (!SaveImageLayoutToCache(*image_layout))
+      LOG(WARNING) << "Failed to cache decomposition; continuing anyway.";
+  }
+
   return success;
 }
 
+void Decomposer::GetCachePath(base::FilePath* cache_path) const {
+  DCHECK_NE(reinterpret_cast<base::FilePath*>(NULL), cache_path);
+  DCHECK(!cache_dir_.empty());
+
+  PEFile::Signature signature;
+  image_file_.GetSignature(&signature);
+
+  // Encode the full signature (modulo the path, which has no bearing on the
+  // image contents) in the file name. A change to the image produces a
+  // different file name, so a stale entry can never be returned.
+  std::string basename =
+      base::FilePath(signature.path).BaseName().AsUTF8Unsafe();
+  std::string cache_name = base::StringPrintf(
+      "%s-%08X-%08X-%08X.dcache",
+      basename.c_str(),
+      static_cast<unsigned int>(signature.module_size),
+      static_cast<unsigned int>(signature.module_checksum),
+      static_cast<unsigned int>(signature.module_time_date_stamp));
+
+  *cache_path = cache_dir_.AppendASCII(cache_name);
+}
+
+bool Decomposer::LoadImageLayoutFromCache(ImageLayout* image_layout) {
+  DCHECK_NE(reinterpret_cast<ImageLayout*>(NULL), image_layout);
+
+  base::FilePath cache_path;
+  GetCachePath(&cache_path);
+
+  base::ScopedFILE file(base::OpenFile(cache_path, "rb"));
+  if (file.get() == NULL)
+    return false;
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  if (!LoadBlockGraphAndImageLayout(
+          image_file_, NULL, image_layout, &in_archive)) {
+    // A corrupt or incompatible cache entry. Remove it so it isn't
+    // rediscovered on every run, and fall through to a full decomposition.
+    LOG(WARNING) << "Ignoring invalid decomposition cache entry: "
+                 << cache_path.value();
+    file.reset();
+    base::DeleteFile(cache_path, false);
+    return false;
+  }
+
+  VLOG(1) << "Loaded cached decomposition: " << cache_path.value();
+  return true;
+}
+
+bool Decomposer::SaveImageLayoutToCache(const ImageLayout& image_layout) {
+  base::FilePath cache_path;
+  GetCachePath(&cache_path);
+
+  if (!base::CreateDirectory(cache_dir_)) {
+    LOG(ERROR) << "Failed to create cache directory: " << cache_dir_.value();
+    return false;
+  }
+
+  // Serialize to a temporary file and move it into place so that concurrent
+  // decompositions of the same image never observe a partial cache entry.
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(cache_dir_, &temp_path)) {
+    LOG(ERROR) << "Failed to create temporary cache file.";
+    return false;
+  }
+
+  {
+    base::ScopedFILE file(base::OpenFile(temp_path, "wb"));
+    if (file.get() == NULL) {
+      LOG(ERROR) << "Failed to open temporary cache file: "
+                 << temp_path.value();
+      return false;
+    }
+    core::FileOutStream out_stream(file.get());
+    core::NativeBinaryOutArchive out_archive(&out_stream);
+    if (!SaveBlockGraphAndImageLayout(image_file_, 0, image_layout,
+                                      &out_archive) ||
+        !out_archive.Flush()) {
+      LOG(ERROR) << "Failed to serialize decomposition to cache.";
+      base::DeleteFile(temp_path, false);
+      return false;
+    }
+  }
+
+  if (!base::ReplaceFileW(temp_path, cache_path, NULL)) {
+    LOG(ERROR) << "Failed to commit cache file: " << cache_path.value();
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  VLOG(1) << "Wrote decomposition cache entry: " << cache_path.value();
+  return true;
+}
+
+bool Decomposer::GetSectionContribCachePath(
+    base::FilePath* cache_path) const {
+  DCHECK_NE(reinterpret_cast<base::FilePath*>(NULL), cache_path);
+  DCHECK(!cache_dir_.empty());
+  DCHECK(!pdb_path_.empty());
+
+  // The section contribution table depends only on the PDB, so key the
+  // cache entry on the PDB GUID and age.
+  PdbInfo pdb_info;
+  if (!pdb_info.Init(image_file_))
+    return false;
+  const GUID& guid = pdb_info.signature();
+
+  std::string basename = pdb_path_.BaseName().AsUTF8Unsafe();
+  std::string cache_name = base::StringPrintf(
+      "%s-%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X-%u.scache",
+      basename.c_str(),
+      guid.Data1, guid.Data2, guid.Data3,
+      guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+      guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7],
+      pdb_info.pdb_age());
+
+  *cache_path = cache_dir_.AppendASCII(cache_name);
+  return true;
+}
+
+bool Decomposer::LoadSectionContribsFromCache(SectionContribs* contribs) {
+  DCHECK_NE(reinterpret_cast<SectionContribs*>(NULL), contribs);
+
+  base::FilePath cache_path;
+  if (!GetSectionContribCachePath(&cache_path))
+    return false;
+
+  base::ScopedFILE file(base::OpenFile(cache_path, "rb"));
+  if (file.get() == NULL)
+    return false;
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  uint32 version = 0;
+  if (!in_archive.Load(&version) ||
+      version != kSectionContribCacheVersion ||
+      !in_archive.Load(contribs)) {
+    // A corrupt or incompatible cache entry. Remove it so it isn't
+    // rediscovered on every run, and fall through to a DIA enumeration.
+    LOG(WARNING) << "Ignoring invalid section-contribution cache entry: "
+                 << cache_path.value();
+    contribs->clear();
+    file.reset();
+    base::DeleteFile(cache_path, false);
+    return false;
+  }
+
+  VLOG(1) << "Loaded cached section contributions: " << cache_path.value();
+  return true;
+}
+
+bool Decomposer::SaveSectionContribsToCache(const SectionContribs& contribs) {
+  base::FilePath cache_path;
+  if (!GetSectionContribCachePath(&cache_path))
+    return false;
+
+  if (!base::CreateDirectory(cache_dir_)) {
+    LOG(ERROR) << "Failed to create cache directory: " << cache_dir_.value();
+    return false;
+  }
+
+  // As with the decomposition cache, serialize to a temporary file and move
+  // it into place so that a partial entry is never observed.
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(cache_dir_, &temp_path)) {
+    LOG(ERROR) << "Failed to create temporary cache file.";
+    return false;
+  }
+
+  {
+    base::ScopedFILE file(base::OpenFile(temp_path, "wb"));
+    if (file.get() == NULL) {
+      LOG(ERROR) << "Failed to open temporary cache file: "
+                 << temp_path.value();
+      return false;
+    }
+    core::FileOutStream out_stream(file.get());
+    core::NativeBinaryOutArchive out_archive(&out_stream);
+    if (!out_archive.Save(kSectionContribCacheVersion) ||
+        !out_archive.Save(contribs) ||
+        !out_archive.Flush()) {
+      LOG(ERROR) << "Failed to serialize section contributions to cache.";
+      base::DeleteFile(temp_path, false);
+      return false;
+    }
+  }
+
+  if (!base::ReplaceFileW(temp_path, cache_path, NULL)) {
+    LOG(ERROR) << "Failed to commit cache file: " << cache_path.value();
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  VLOG(1) << "Wrote section-contribution cache entry: " << cache_path.value();
+  return true;
+}
+
 bool Decomposer::FindAndValidatePdbPath() {
   // Manually find the PDB path if it is not specified.
   if (pdb_path_.empty()) {
@@ -1186,6 +1530,87 @@ bool Decomposer::CreateBlocksFromCoffGroups() {
 }
 
 bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
+  // The extracted table depends only on the PDB, so a cached copy lets us
+  // skip both the DIA enumeration and the name computation.
+  SectionContribs contribs;
+  bool from_cache =
+      !cache_dir_.empty() && LoadSectionContribsFromCache(&contribs);
+
+  if (!from_cache) {
+    // Extract the raw table on this thread; DIA is apartment threaded and
+    // may not be touched from the workers.
+    if (!HarvestSectionContribs(session, &contribs))
+      return false;
+
+    // Fan the CPU-bound name computation out across worker threads. With a
+    // single thread we do the work inline and avoid the thread start/join
+    // overhead.
+    size_t num_workers = std::min(max_threads_, contribs.size());
+    if (num_workers <= 1) {
+      for (size_t i = 0; i < contribs.size(); ++i) {
+        if (!ComputeSectionContribNames(&contribs[i]))
+          return false;
+      }
+    } else {
+      ScopedVector<SectionContribNameWorker> workers;
+      ScopedVector<base::DelegateSimpleThread> threads;
+      for (size_t i = 0; i < num_workers; ++i) {
+        workers.push_back(
+            new SectionContribNameWorker(&contribs, i, num_workers));
+        threads.push_back(new base::DelegateSimpleThread(
+            workers.back(), "SectionContribWorker"));
+        threads.back()->Start();
+      }
+      bool success = true;
+      for (size_t i = 0; i < num_workers; ++i) {
+        threads[i]->Join();
+        success = success && workers[i]->success();
+      }
+      if (!success)
+        return false;
+    }
+
+    // Populate the cache so that subsequent decompositions of any image
+    // sharing this PDB skip the extraction. Failure to write the cache is
+    // not fatal.
+    if (!cache_dir_.empty() && !SaveSectionContribsToCache(contribs)) {
+      LOG(WARNING) << "Failed to cache section contributions; "
+                   << "continuing anyway.";
+    }
+  }
+
+  // Finally, serially populate the block-graph. Block creation mutates the
+  // image address space and must happen on a single thread.
+  for (size_t i = 0; i < contribs.size(); ++i) {
+    const SectionContrib& contrib = contribs[i];
+
+    BlockType block_type =
+        contrib.code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
+    Block* block = CreateBlockOrFindCoveringPeBlock(
+        block_type, RelativeAddress(contrib.rva), contrib.length,
+        contrib.block_name);
+    if (block == NULL) {
+      LOG(ERROR) << "Unable to create block for compiland \""
+                 << contrib.utf8_compiland_name << "\".";
+      return false;
+    }
+
+    // Set the block compiland name.
+    block->set_compiland_name(contrib.utf8_compiland_name);
+
+    // Set the block attributes.
+    block->set_attribute(BlockGraph::SECTION_CONTRIB);
+    if (!contrib.is_built_by_supported_compiler)
+      block->set_attribute(BlockGraph::BUILT_BY_UNSUPPORTED_COMPILER);
+  }
+
+  return true;
+}
+
+bool Decomposer::HarvestSectionContribs(IDiaSession* session,
+                                        SectionContribs* contribs) {
+  DCHECK_NE(reinterpret_cast<SectionContribs*>(NULL), contribs);
+
   ScopedComPtr<IDiaEnumSectionContribs> section_contribs;
   SearchResult search_result = FindDiaTable(session,
                                             section_contribs.Receive());
@@ -1251,52 +1676,21 @@ bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
     if (section_id == rsrc_id)
       continue;
 
-    std::string compiland_name;
-    if (!base::WideToUTF8(bstr_compiland_name, bstr_compiland_name.Length(),
-                          &compiland_name)) {
-      LOG(ERROR) << "Failed to convert compiland name to UTF8.";
-      return false;
-    }
-
-    // Give a name to the block based on the basename of the object file. This
-    // will eventually be replaced by the full symbol name, if one exists for
-    // the block.
-    size_t last_component = compiland_name.find_last_of('\\');
-    size_t extension = compiland_name.find_last_of('.');
-    if (last_component == std::string::npos) {
-      last_component = 0;
-    } else {
-      // We don't want to include the last slash.
-      ++last_component;
-    }
-    if (extension < last_component)
-      extension = compiland_name.size();
-    std::string name = compiland_name.substr(last_component,
-                                             extension - last_component);
-
     // TODO(chrisha): We see special section contributions with the name
     //     "* CIL *". These are concatenations of data symbols and can very
     //     likely be chunked using symbols directly. A cursory visual inspection
     //     of symbol names hints that these might be related to WPO.
 
-    // Create the block.
-    BlockType block_type =
-        code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
-    Block* block = CreateBlockOrFindCoveringPeBlock(
-        block_type, RelativeAddress(rva), length, name);
-    if (block == NULL) {
-      LOG(ERROR) << "Unable to create block for compiland \""
-                 << compiland_name << "\".";
-      return false;
-    }
-
-    // Set the block compiland name.
-    block->set_compiland_name(compiland_name);
-
-    // Set the block attributes.
-    block->set_attribute(BlockGraph::SECTION_CONTRIB);
-    if (!is_built_by_supported_compiler)
-      block->set_attribute(BlockGraph::BUILT_BY_UNSUPPORTED_COMPILER);
+    // Store the raw record. Name processing happens after the enumeration,
+    // potentially on worker threads.
+    contribs->push_back(SectionContrib());
+    SectionContrib& contrib = contribs->back();
+    contrib.rva = rva;
+    contrib.length = length;
+    contrib.code = code != FALSE;
+    contrib.is_built_by_supported_compiler = is_built_by_supported_compiler;
+    contrib.compiland_name.assign(bstr_compiland_name,
+                                  bstr_compiland_name.Length());
   }
 
   return true;
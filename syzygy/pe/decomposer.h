@@ -39,6 +39,9 @@ class Decomposer {
   struct IntermediateReference;
   typedef std::vector<IntermediateReference> IntermediateReferences;
 
+  struct SectionContrib;
+  typedef std::vector<SectionContrib> SectionContribs;
+
   // The separator that is used between the multiple symbol names that can be
   // associated with a single label.
   static const char kLabelNameSep[];
@@ -63,6 +66,25 @@ class Decomposer {
   // @param pdb_path the path to the PDB file to be used in decomposing the
   //     image.
   void set_pdb_path(const base::FilePath& pdb_path) { pdb_path_ = pdb_path; }
+  // Sets the maximum number of worker threads that will be used for the
+  // CPU-bound portions of decomposition. DIA itself is apartment threaded so
+  // all DIA accesses remain on the calling thread; only the post-processing
+  // of data already extracted from DIA is farmed out. A value of 1 (the
+  // default) makes decomposition fully serial.
+  // @param max_threads the maximum number of threads to use. Must be > 0.
+  void set_max_threads(size_t max_threads) {
+    DCHECK_LT(0u, max_threads);
+    max_threads_ = max_threads;
+  }
+  // Sets the directory in which serialized decompositions are cached. If a
+  // cached decomposition matching the signature of the image is found in this
+  // directory it is loaded directly, bypassing DIA entirely; otherwise a full
+  // decomposition is performed and its result is written to the cache. If
+  // this is not set (the default) no caching is performed.
+  // @param cache_dir the directory to use as a decomposition cache.
+  void set_cache_dir(const base::FilePath& cache_dir) {
+    cache_dir_ = cache_dir;
+  }
   // @}
 
   // @name Accessors
@@ -72,6 +94,11 @@ class Decomposer {
   // decomposition.
   // @returns the PDB path.
   const base::FilePath& pdb_path() const { return pdb_path_; }
+  // @returns the maximum number of worker threads used for CPU-bound
+  //     decomposition work.
+  size_t max_threads() const { return max_threads_; }
+  // @returns the decomposition cache directory. Empty if caching is disabled.
+  const base::FilePath& cache_dir() const { return cache_dir_; }
   // @}
 
  protected:
@@ -82,6 +109,52 @@ class Decomposer {
   // and validates that the file exists and matches the module.
   bool FindAndValidatePdbPath();
 
+  // @name Decomposition cache implementation. Only used if a cache directory
+  //     has been configured.
+  // @{
+  // Computes the path of the cache file for the image being decomposed. The
+  // file name encodes the image signature so that a stale cache entry can
+  // never match.
+  // @param cache_path receives the path of the cache file.
+  void GetCachePath(base::FilePath* cache_path) const;
+  // Attempts to load a cached decomposition of the image. A missing or
+  // invalid cache entry is a cache miss, not an error.
+  // @param image_layout the layout to be populated.
+  // @returns true if a valid cached decomposition was loaded.
+  bool LoadImageLayoutFromCache(ImageLayout* image_layout);
+  // Writes the decomposition to the cache. The write is made atomic via a
+  // rename so that concurrent decompositions of the same image are safe.
+  // @param image_layout the layout to be cached.
+  // @returns true on success, false otherwise.
+  bool SaveImageLayoutToCache(const ImageLayout& image_layout);
+  // @}
+
+  // @name Per-PDB section-contribution cache. The facts extracted from the
+  //     section contribution table depend only on the PDB, so they are
+  //     cached keyed on the PDB GUID and age. This lets repeat
+  //     decompositions skip the DIA table enumeration and name computation
+  //     even when the full decomposition cache misses. Only used if a cache
+  //     directory has been configured.
+  // @{
+  // Computes the path of the section-contribution cache file for the PDB
+  // being used. The file name encodes the PDB GUID and age, so a stale
+  // entry can never match.
+  // @param cache_path receives the path of the cache file.
+  // @returns true on success, false if the PDB identity could not be
+  //     determined.
+  bool GetSectionContribCachePath(base::FilePath* cache_path) const;
+  // Attempts to load cached section contributions. A missing or invalid
+  // cache entry is a cache miss, not an error.
+  // @param contribs receives the cached records, names already computed.
+  // @returns true if a valid cache entry was loaded.
+  bool LoadSectionContribsFromCache(SectionContribs* contribs);
+  // Writes the section contributions to the cache, atomically via a rename.
+  // @param contribs the records to cache. Their names must have been
+  //     computed.
+  // @returns true on success, false otherwise.
+  bool SaveSectionContribsToCache(const SectionContribs& contribs);
+  // @}
+
   // @name Used for round-trip decomposition when a serialized block graph is
   //     in the PDB. Exposed here for unittesting.
   // @{
@@ -102,8 +175,15 @@ class Decomposer {
   bool CreatePEImageBlocksAndReferences(IntermediateReferences* references);
   // Creates blocks from the COFF group symbols in the linker symbol stream.
   bool CreateBlocksFromCoffGroups();
-  // Processes the SectionContribution table, creating code/data blocks from it.
+  // Processes the SectionContribution table, creating code/data blocks from
+  // it. This enumerates the table on the calling thread (DIA is apartment
+  // threaded), computes block names on up to max_threads() workers, then
+  // serially populates the block-graph.
   bool CreateBlocksFromSectionContribs(IDiaSession* session);
+  // Enumerates the SectionContribution table into plain records, freeing us
+  // from DIA for the remainder of section contribution processing. Helper of
+  // CreateBlocksFromSectionContribs.
+  bool HarvestSectionContribs(IDiaSession* session, SectionContribs* contribs);
  // Processes the Compiland table and finds cold blocks.
   bool FindColdBlocksFromCompilands(IDiaSession* session);
   // Creates gap blocks to flesh out the image. After this has been run all
@@ -197,6 +277,12 @@ class Decomposer {
   const PEFile& image_file_;
   // The path to corresponding PDB file.
   base::FilePath pdb_path_;
+  // The maximum number of worker threads to use for CPU-bound decomposition
+  // work. Defaults to 1.
+  size_t max_threads_;
+  // The directory housing cached decompositions. Empty if caching is
+  // disabled.
+  base::FilePath cache_dir_;
 
   // @name Temporaries that are only valid while inside DecomposeImpl.
   //     Prevents us from having to pass these around everywhere.
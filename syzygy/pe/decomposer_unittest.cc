@@ -14,6 +14,7 @@
 
 #include "syzygy/pe/decomposer.h"
 
+#include "base/files/file_enumerator.h"
 #include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "gmock/gmock.h"
@@ -84,6 +85,120 @@ TEST_F(DecomposerTest, MutatorsAndAccessors) {
 
   decomposer.set_pdb_path(pdb_path);
   EXPECT_EQ(pdb_path, decomposer.pdb_path());
+
+  EXPECT_EQ(1u, decomposer.max_threads());
+  decomposer.set_max_threads(4);
+  EXPECT_EQ(4u, decomposer.max_threads());
+}
+
+TEST_F(DecomposerTest, DecomposeCacheRoundTrip) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  // The first decomposition misses the cache and populates it.
+  BlockGraph block_graph1;
+  ImageLayout image_layout1(&block_graph1);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(temp_dir_);
+    EXPECT_TRUE(decomposer.Decompose(&image_layout1));
+  }
+
+  // A cache entry should have been written.
+  base::FileEnumerator enumerator(temp_dir_, false,
+                                  base::FileEnumerator::FILES,
+                                  L"*.dcache");
+  EXPECT_FALSE(enumerator.Next().empty());
+
+  // The second decomposition hits the cache and must produce an identical
+  // result.
+  BlockGraph block_graph2;
+  ImageLayout image_layout2(&block_graph2);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(temp_dir_);
+    EXPECT_TRUE(decomposer.Decompose(&image_layout2));
+  }
+
+  block_graph::BlockGraphSerializer bgs;
+  EXPECT_TRUE(testing::BlockGraphsEqual(block_graph1, block_graph2, bgs));
+  EXPECT_THAT(image_layout1.sections, ContainerEq(image_layout2.sections));
+}
+
+TEST_F(DecomposerTest, DecomposeSectionContribCacheRoundTrip) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  // The first decomposition populates both the decomposition cache and the
+  // section-contribution cache.
+  BlockGraph block_graph1;
+  ImageLayout image_layout1(&block_graph1);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(temp_dir_);
+    EXPECT_TRUE(decomposer.Decompose(&image_layout1));
+  }
+
+  // A section-contribution cache entry should have been written.
+  base::FileEnumerator scache_enumerator(temp_dir_, false,
+                                         base::FileEnumerator::FILES,
+                                         L"*.scache");
+  EXPECT_FALSE(scache_enumerator.Next().empty());
+
+  // Remove the decomposition cache entries so that the second decomposition
+  // exercises the section-contribution cache.
+  base::FileEnumerator dcache_enumerator(temp_dir_, false,
+                                         base::FileEnumerator::FILES,
+                                         L"*.dcache");
+  for (base::FilePath path = dcache_enumerator.Next(); !path.empty();
+       path = dcache_enumerator.Next()) {
+    EXPECT_TRUE(base::DeleteFile(path, false));
+  }
+
+  // The second decomposition consumes the cached section contributions and
+  // must produce an identical result.
+  BlockGraph block_graph2;
+  ImageLayout image_layout2(&block_graph2);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(temp_dir_);
+    EXPECT_TRUE(decomposer.Decompose(&image_layout2));
+  }
+
+  block_graph::BlockGraphSerializer bgs;
+  EXPECT_TRUE(testing::BlockGraphsEqual(block_graph1, block_graph2, bgs));
+  EXPECT_THAT(image_layout1.sections, ContainerEq(image_layout2.sections));
+}
+
+TEST_F(DecomposerTest, DecomposeWithMultipleThreadsIsIdentical) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  // Decompose serially.
+  BlockGraph serial_block_graph;
+  ImageLayout serial_image_layout(&serial_block_graph);
+  {
+    Decomposer decomposer(image_file);
+    EXPECT_TRUE(decomposer.Decompose(&serial_image_layout));
+  }
+
+  // Decompose with a handful of worker threads.
+  BlockGraph parallel_block_graph;
+  ImageLayout parallel_image_layout(&parallel_block_graph);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_max_threads(4);
+    EXPECT_TRUE(decomposer.Decompose(&parallel_image_layout));
+  }
+
+  // The results must not depend on the number of threads used.
+  block_graph::BlockGraphSerializer bgs;
+  EXPECT_TRUE(testing::BlockGraphsEqual(serial_block_graph,
+                                        parallel_block_graph,
+                                        bgs));
 }
 
 TEST_F(DecomposerTest, Decompose) {
@@ -15,6 +15,9 @@
 #include "syzygy/pe/dia_browser.h"
 
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/platform_thread.h"
+#include "base/win/scoped_com_initializer.h"
 
 namespace {
 
@@ -451,9 +454,66 @@ class DiaBrowser::PatternBuilder {
   DISALLOW_COPY_AND_ASSIGN(PatternBuilder);
 };
 
+// Runs a worker browser over its slice of the subtrees below @p root, on a
+// dedicated thread.
+class DiaBrowser::BrowseWorker : public base::PlatformThread::Delegate {
+ public:
+  BrowseWorker(const DiaBrowser* owner,
+               IDiaSymbol* root,
+               size_t partition_index,
+               size_t partition_count,
+               base::Lock* callback_lock)
+      : browser_(owner, partition_index, partition_count, callback_lock),
+        root_(root),
+        succeeded_(false) {
+    DCHECK(root != NULL);
+  }
+
+  virtual void ThreadMain() OVERRIDE {
+    // DIA is a COM component, so each worker thread needs its own
+    // apartment.
+    base::win::ScopedCOMInitializer com_initializer;
+    succeeded_ = browser_.Browse(root_);
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  DiaBrowser browser_;
+  IDiaSymbol* root_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(BrowseWorker);
+};
+
+DiaBrowser::DiaBrowser()
+    : owns_patterns_(true),
+      partition_index_(0),
+      partition_count_(1),
+      root_children_visited_(0),
+      callback_lock_(NULL) {
+}
+
+DiaBrowser::DiaBrowser(const DiaBrowser* owner,
+                       size_t partition_index,
+                       size_t partition_count,
+                       base::Lock* callback_lock)
+    : patterns_(owner->patterns_),
+      owns_patterns_(false),
+      partition_index_(partition_index),
+      partition_count_(partition_count),
+      root_children_visited_(0),
+      callback_lock_(callback_lock) {
+  DCHECK(owner != NULL);
+  DCHECK_LT(partition_index, partition_count);
+  DCHECK(callback_lock != NULL);
+}
+
 DiaBrowser::~DiaBrowser() {
-  for (size_t i = 0; i < patterns_.size(); ++i)
-    delete [] patterns_[i];
+  if (owns_patterns_) {
+    for (size_t i = 0; i < patterns_.size(); ++i)
+      delete [] patterns_[i];
+  }
 }
 
 bool DiaBrowser::AddPattern(const builder::Proxy& pattern_builder_proxy,
@@ -594,6 +654,25 @@ void DiaBrowser::Reset() {
   front_size_.clear();
   stopped_.clear();
   sym_tags_.clear();
+  root_children_visited_ = 0;
+}
+
+DiaBrowser::BrowserDirective DiaBrowser::CallPushCallback(
+    const PatternElement* element) {
+  DCHECK(element != NULL);
+  if (callback_lock_ == NULL)
+    return element->InvokePushCallback(*this, tag_lineage_, symbol_lineage_);
+  base::AutoLock lock(*callback_lock_);
+  return element->InvokePushCallback(*this, tag_lineage_, symbol_lineage_);
+}
+
+DiaBrowser::BrowserDirective DiaBrowser::CallPopCallback(
+    const PatternElement* element) {
+  DCHECK(element != NULL);
+  if (callback_lock_ == NULL)
+    return element->InvokePopCallback(*this, tag_lineage_, symbol_lineage_);
+  base::AutoLock lock(*callback_lock_);
+  return element->InvokePopCallback(*this, tag_lineage_, symbol_lineage_);
 }
 
 DiaBrowser::BrowserDirective DiaBrowser::PushMatch(
@@ -626,9 +705,7 @@ DiaBrowser::BrowserDirective DiaBrowser::PushMatch(
 
       // Invoke the callback for each valid destination, and truncate the
       // search if necessary.
-      BrowserDirective directive = elem->InvokePushCallback(*this,
-                                                            tag_lineage_,
-                                                            symbol_lineage_);
+      BrowserDirective directive = CallPushCallback(elem);
 
       bool need_pop_callback = false;
       switch (directive) {
@@ -672,9 +749,7 @@ DiaBrowser::BrowserDirective DiaBrowser::PushMatch(
       // of InvokeCallback and the logic in this routine, BrowseImpl and
       // PopMatch. Handling terminated paths here is far simpler.
       if (need_pop_callback) {
-        directive = elem->InvokePopCallback(*this,
-                                            tag_lineage_,
-                                            symbol_lineage_);
+        directive = CallPopCallback(elem);
         if (directive == kBrowserTerminateAll || directive == kBrowserAbort)
           return directive;
         if (directive == kBrowserTerminatePattern) {
@@ -702,10 +777,7 @@ DiaBrowser::BrowserDirective DiaBrowser::PopMatch(bool do_callbacks) {
         continue;
 
       // Call the pop callback.
-      BrowserDirective directive =
-          front_[i]->InvokePopCallback(*this,
-                                       tag_lineage_,
-                                       symbol_lineage_);
+      BrowserDirective directive = CallPopCallback(front_[i]);
 
       switch (directive) {
         // The path can't be stopped during a 'pop' notification, as its already
@@ -742,6 +814,43 @@ bool DiaBrowser::Browse(IDiaSymbol* root) {
   return directive != kBrowserAbort;
 }
 
+bool DiaBrowser::BrowseInParallel(const std::vector<IDiaSymbol*>& roots) {
+  DCHECK(!roots.empty());
+
+  // With a single root there is nothing to parallelize.
+  if (roots.size() == 1)
+    return Browse(roots[0]);
+
+  base::Lock callback_lock;
+
+  // Create one worker per root. Each worker shares our patterns but walks
+  // only its own slice of the subtrees below its root.
+  ScopedVector<BrowseWorker> workers;
+  for (size_t i = 0; i < roots.size(); ++i) {
+    workers.push_back(
+        new BrowseWorker(this, roots[i], i, roots.size(), &callback_lock));
+  }
+
+  std::vector<base::PlatformThreadHandle> handles(workers.size());
+  for (size_t i = 0; i < workers.size(); ++i) {
+    if (!base::PlatformThread::Create(0, workers[i], &handles[i])) {
+      LOG(ERROR) << "Failed to create DIA browser worker thread.";
+      // Wait for any workers that did get started before bailing.
+      for (size_t j = 0; j < i; ++j)
+        base::PlatformThread::Join(handles[j]);
+      return false;
+    }
+  }
+
+  bool succeeded = true;
+  for (size_t i = 0; i < workers.size(); ++i) {
+    base::PlatformThread::Join(handles[i]);
+    succeeded = succeeded && workers[i]->succeeded();
+  }
+
+  return succeeded;
+}
+
 DiaBrowser::BrowserDirective DiaBrowser::BrowseImpl(IDiaSymbol* root,
                                                     size_t depth) {
   if (sym_tags_[depth].none())
@@ -818,6 +927,13 @@ DiaBrowser::BrowserDirective DiaBrowser::BrowseEnum(
     if (sym_tag != SymTagNull)
       DCHECK_EQ(sym_tag, actual_sym_tag);
 
+    // When browsing in parallel each worker only walks its own slice of the
+    // subtrees immediately below the root.
+    if (depth == 0 && partition_count_ > 1 &&
+        (root_children_visited_++ % partition_count_) != partition_index_) {
+      continue;
+    }
+
     tag_lineage_.back() = actual_sym_tag;
     symbol_lineage_.back() = symbol;
 
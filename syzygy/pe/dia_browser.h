@@ -38,6 +38,7 @@
 
 #include "base/callback.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/synchronization/lock.h"
 #include "base/win/scoped_comptr.h"
 
 namespace pe {
@@ -105,6 +106,7 @@ class DiaBrowser {
   // a tree of IDiaSymbols.
   class PatternBuilder;
 
+  DiaBrowser();
   ~DiaBrowser();
 
   // Adds a pattern to the DiaBrowser. Returns false if the given pattern
@@ -142,6 +144,23 @@ class DiaBrowser {
   // callback.)
   bool Browse(IDiaSymbol* root);
 
+  // Browses through the DIA trees rooted at each element of @p roots
+  // concurrently, with one worker thread per root. Each worker walks a
+  // disjoint subset of the subtrees immediately below its root, so the roots
+  // must all refer to the same scope of the same debug stream. However, each
+  // root must have been obtained via a distinct IDiaSession, as DIA objects
+  // may not be used from multiple threads at once. Callbacks are serialized
+  // by a lock and need not be thread-safe, but they may be invoked from any
+  // of the worker threads and receive the worker's DiaBrowser rather than
+  // this one. Note two semantic differences from Browse: symbols reachable
+  // from more than one partition may be visited once per worker rather than
+  // once overall, and the kBrowserTerminateAll and kBrowserTerminatePattern
+  // directives only affect the worker whose callback returned them.
+  // @param roots The global scopes to browse, one per worker thread.
+  // @returns true if all workers terminated naturally, false if any errors
+  //     were encountered.
+  bool BrowseInParallel(const std::vector<IDiaSymbol*>& roots);
+
  protected:
   // The following protected functions are intended for use by the GTest
   // fixture only.
@@ -151,6 +170,20 @@ class DiaBrowser {
   size_t TestMatch(const SymTagVector& sym_tags) const;
 
  private:
+  // Browses a partition of the tree on behalf of BrowseInParallel, on its
+  // own worker thread.
+  class BrowseWorker;
+
+  // Constructs a worker browser that shares the patterns of @p owner, but
+  // only walks every @p partition_count-th subtree below the root, starting
+  // with subtree @p partition_index. Callbacks are serialized across workers
+  // using @p callback_lock. The worker does not take ownership of the
+  // patterns, and must not outlive @p owner.
+  DiaBrowser(const DiaBrowser* owner,
+             size_t partition_index,
+             size_t partition_count,
+             base::Lock* callback_lock);
+
   // This initializes the search front and other bookkeeping structures.
   void PrepareForBrowse();
 
@@ -172,6 +205,14 @@ class DiaBrowser {
   // This rolls back our search stack by one level, calling pop callbacks.
   DiaBrowser::BrowserDirective PopMatch(bool do_callbacks);
 
+  // Invokes the push or pop callback of @p element with the current
+  // lineages, serializing with respect to the other workers when browsing
+  // in parallel.
+  // @{
+  BrowserDirective CallPushCallback(const PatternElement* element);
+  BrowserDirective CallPopCallback(const PatternElement* element);
+  // @}
+
   // The actual implementation of Browse, modulo some startup stuff.
   // This can return a reduced subset of BrowserDirective, namely:
   // kBrowserContinue, kBrowserTerminateAll, or kBrowserAbort.
@@ -197,6 +238,23 @@ class DiaBrowser {
   // scoped_ptr is unsuitable for use in a std::vector.
   std::vector<PatternElement*> patterns_;
 
+  // False for worker browsers, which borrow the patterns of the browser
+  // that spawned them.
+  bool owns_patterns_;
+
+  // The slice of the subtrees below the root that this browser walks. A
+  // regular browser has a partition count of 1, and walks everything.
+  size_t partition_index_;
+  size_t partition_count_;
+
+  // The number of children of the root that have been enumerated so far,
+  // used to assign subtrees to partitions.
+  size_t root_children_visited_;
+
+  // If this is not NULL, callbacks are invoked with this lock held. This is
+  // how BrowseInParallel serializes callbacks across its workers.
+  base::Lock* callback_lock_;
+
   // Stores the path of matched symbol tags.
   SymTagVector tag_lineage_;
   // Stores the path of matched symbols.
@@ -398,6 +398,31 @@ TEST_F(DiaBrowserTest, AllCompilandSymbolsExplored) {
   dia_browser.Browse(global_.get());
 }
 
+TEST_F(DiaBrowserTest, BrowseInParallelVisitsAllCompilands) {
+  TestDiaBrowser dia_browser;
+
+  dia_browser.AddPattern(Tag(SymTagCompiland), on_full_match_);
+
+  // Open a separate session, and thus a separate global scope, for each
+  // worker thread.
+  static const size_t kNumWorkers = 4;
+  ScopedComPtr<IDiaSession> sessions[kNumWorkers];
+  ScopedComPtr<IDiaSymbol> globals[kNumWorkers];
+  std::vector<IDiaSymbol*> roots;
+  for (size_t i = 0; i < kNumWorkers; ++i) {
+    ASSERT_HRESULT_SUCCEEDED(dia_source_->openSession(sessions[i].Receive()));
+    ASSERT_HRESULT_SUCCEEDED(
+        sessions[i]->get_globalScope(globals[i].Receive()));
+    roots.push_back(globals[i].get());
+  }
+
+  // Each compiland lies immediately below the root and is assigned to
+  // exactly one partition, so the full set is visited exactly once.
+  EXPECT_CALL(*this, OnFullMatch(_, _, _)).Times(154).
+      WillRepeatedly(Return(DiaBrowser::kBrowserContinue));
+  EXPECT_TRUE(dia_browser.BrowseInParallel(roots));
+}
+
 TEST_F(DiaBrowserTest, AllDataSymbolsExplored) {
   TestDiaBrowser dia_browser;
 
@@ -17,6 +17,7 @@
 #include <errno.h>
 
 #include "base/file_util.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/json/json_reader.h"
 #include "base/strings/stringprintf.h"
 
@@ -37,6 +38,38 @@ const char kSignature[] = "signature";
 const char kSize[] = "size";
 const char kTimeDateStamp[] = "time_date_stamp";
 
+// The magic number identifying a compiled binary image filter. Spells
+// 'SZIF' when viewed in a hex dump.
+const uint32 kBinaryFilterMagic = 0x46495A53;
+
+// The current version of the compiled binary image filter format.
+const uint32 kBinaryFilterVersion = 1;
+
+// The fixed-size header of a compiled binary image filter. This is followed
+// in the file by |path_length| wide characters containing the module path,
+// and then by |range_count| BinaryFilterRange records sorted by ascending
+// RVA.
+struct BinaryFilterHeader {
+  uint32 magic;
+  uint32 version;
+  uint32 base_address;
+  uint32 module_size;
+  uint32 module_checksum;
+  uint32 module_time_date_stamp;
+  uint32 path_length;
+  uint32 range_count;
+};
+COMPILE_ASSERT(sizeof(BinaryFilterHeader) == 32,
+               binary_filter_header_has_unexpected_size);
+
+// A single marked interval of a compiled binary image filter.
+struct BinaryFilterRange {
+  uint32 rva;
+  uint32 length;
+};
+COMPILE_ASSERT(sizeof(BinaryFilterRange) == 8,
+               binary_filter_range_has_unexpected_size);
+
 // Outputs |value| as a hex-coded string. Returns true on succes, false on
 // failure.
 bool OutputHexUint32(uint32 value, core::JSONFileWriter* json) {
@@ -398,4 +431,130 @@ bool ImageFilter::LoadFromJSON(const base::FilePath& path) {
   return true;
 }
 
+bool ImageFilter::SaveToBinary(FILE* file) const {
+  DCHECK(file != NULL);
+
+  BinaryFilterHeader header = {};
+  header.magic = kBinaryFilterMagic;
+  header.version = kBinaryFilterVersion;
+  header.base_address = signature.base_address.value();
+  header.module_size = signature.module_size;
+  header.module_checksum = signature.module_checksum;
+  header.module_time_date_stamp = signature.module_time_date_stamp;
+  header.path_length = signature.path.size();
+  header.range_count = filter.marked_ranges().size();
+  if (::fwrite(&header, sizeof(header), 1, file) != 1) {
+    LOG(ERROR) << "Failed to write binary filter header.";
+    return false;
+  }
+
+  if (!signature.path.empty() &&
+      ::fwrite(signature.path.data(), sizeof(wchar_t),
+               signature.path.size(), file) != signature.path.size()) {
+    LOG(ERROR) << "Failed to write binary filter module path.";
+    return false;
+  }
+
+  // The marked ranges are kept sorted by address, so simply emitting them in
+  // iteration order produces the sorted interval array.
+  RelativeAddressFilter::RangeSet::const_iterator it =
+      filter.marked_ranges().begin();
+  for (; it != filter.marked_ranges().end(); ++it) {
+    BinaryFilterRange range = {};
+    range.rva = it->start().value();
+    range.length = it->size();
+    if (::fwrite(&range, sizeof(range), 1, file) != 1) {
+      LOG(ERROR) << "Failed to write binary filter range.";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ImageFilter::SaveToBinary(const base::FilePath& path) const {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open file for writing: " << path.value();
+    return false;
+  }
+
+  if (!SaveToBinary(file.get()))
+    return false;
+
+  return true;
+}
+
+bool ImageFilter::LoadFromBinary(const base::FilePath& path) {
+  base::MemoryMappedFile mapped_file;
+  if (!mapped_file.Initialize(path)) {
+    LOG(ERROR) << "Unable to map file: " << path.value();
+    return false;
+  }
+
+  if (mapped_file.length() < sizeof(BinaryFilterHeader)) {
+    LOG(ERROR) << "File too small to be a binary filter: " << path.value();
+    return false;
+  }
+  const BinaryFilterHeader* header =
+      reinterpret_cast<const BinaryFilterHeader*>(mapped_file.data());
+  if (header->magic != kBinaryFilterMagic) {
+    LOG(ERROR) << "File is not a binary filter: " << path.value();
+    return false;
+  }
+  if (header->version != kBinaryFilterVersion) {
+    LOG(ERROR) << "Unsupported binary filter version " << header->version
+               << ": " << path.value();
+    return false;
+  }
+
+  size_t expected_length = sizeof(BinaryFilterHeader) +
+      header->path_length * sizeof(wchar_t) +
+      header->range_count * sizeof(BinaryFilterRange);
+  if (mapped_file.length() != expected_length) {
+    LOG(ERROR) << "Binary filter has inconsistent size: " << path.value();
+    return false;
+  }
+
+  signature.base_address.set_value(header->base_address);
+  signature.module_size = header->module_size;
+  signature.module_checksum = header->module_checksum;
+  signature.module_time_date_stamp = header->module_time_date_stamp;
+  signature.path.assign(
+      reinterpret_cast<const wchar_t*>(header + 1), header->path_length);
+
+  filter = RelativeAddressFilter(
+      Range(RelativeAddress(0), signature.module_size));
+
+  // The range array follows the module path and need not be 4-byte aligned,
+  // so each record is copied out of the mapping before use.
+  const uint8* range_data = reinterpret_cast<const uint8*>(header + 1) +
+      header->path_length * sizeof(wchar_t);
+  for (size_t i = 0; i < header->range_count; ++i) {
+    BinaryFilterRange range = {};
+    ::memcpy(&range, range_data + i * sizeof(range), sizeof(range));
+    if (range.length == 0) {
+      LOG(ERROR) << "Binary filter contains an empty range: " << path.value();
+      return false;
+    }
+    filter.Mark(Range(RelativeAddress(range.rva), range.length));
+  }
+
+  return true;
+}
+
+bool ImageFilter::Load(const base::FilePath& path) {
+  // Sniff the leading magic bytes to determine the format.
+  uint32 magic = 0;
+  if (base::ReadFile(path, reinterpret_cast<char*>(&magic), sizeof(magic)) !=
+          static_cast<int>(sizeof(magic))) {
+    LOG(ERROR) << "Unable to read file: " << path.value();
+    return false;
+  }
+
+  if (magic == kBinaryFilterMagic)
+    return LoadFromBinary(path);
+  return LoadFromJSON(path);
+}
+
 }  // namespace pe
@@ -77,6 +77,31 @@ struct ImageFilter {
   bool LoadFromJSON(const base::DictionaryValue& dict);
   bool LoadFromJSON(FILE* file);
   bool LoadFromJSON(const base::FilePath& path);
+
+  // Saves this image filter to file in compiled binary form: a fixed header
+  // containing the module signature, followed by a sorted array of
+  // [rva, length] intervals. This form can be loaded without parsing.
+  // @param file The file to be written to.
+  // @param path The path of the file to be written to.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  bool SaveToBinary(FILE* file) const;
+  bool SaveToBinary(const base::FilePath& path) const;
+
+  // Loads an image filter from a file in compiled binary form, as written by
+  // SaveToBinary. The file is memory-mapped and the intervals are consumed
+  // directly from the mapping.
+  // @param path The path of the file to be read.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  bool LoadFromBinary(const base::FilePath& path);
+
+  // Loads an image filter from a file in either compiled binary or JSON
+  // form, detecting the format from the file's leading magic bytes.
+  // @param path The path of the file to be read.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  bool Load(const base::FilePath& path);
 };
 
 }  // namespace pe
@@ -124,4 +124,43 @@ TEST_F(ImageFilterTest, SaveToAndLoadFromJSON) {
   EXPECT_EQ(f1.filter, f3.filter);
 }
 
+TEST_F(ImageFilterTest, SaveToAndLoadFromBinary) {
+  ImageFilter f1;
+  EXPECT_TRUE(f1.Init(test_dll_path));
+
+  // Mark some ranges so that the filter isn't empty.
+  f1.filter.Mark(ImageFilter::Range(
+      ImageFilter::RelativeAddress(0), 1024));
+  f1.filter.Mark(ImageFilter::Range(
+      ImageFilter::RelativeAddress(4096), 4096));
+  f1.filter.Mark(ImageFilter::Range(
+      ImageFilter::RelativeAddress(10240), 256));
+
+  base::FilePath temp_dir;
+  CreateTemporaryDir(&temp_dir);
+  base::FilePath binary_path = temp_dir.Append(L"test_dll.filter");
+  base::FilePath json_path = temp_dir.Append(L"test_dll.json");
+
+  EXPECT_TRUE(f1.SaveToBinary(binary_path));
+  EXPECT_TRUE(f1.SaveToJSON(false, json_path));
+
+  ImageFilter f2;
+  EXPECT_FALSE(f2.LoadFromBinary(dummy_path));
+  EXPECT_FALSE(f2.LoadFromBinary(json_path));
+  EXPECT_TRUE(f2.LoadFromBinary(binary_path));
+  EXPECT_EQ(f1.signature, f2.signature);
+  EXPECT_EQ(f1.filter, f2.filter);
+
+  // Load should transparently handle both formats.
+  ImageFilter f3;
+  EXPECT_TRUE(f3.Load(binary_path));
+  EXPECT_EQ(f1.signature, f3.signature);
+  EXPECT_EQ(f1.filter, f3.filter);
+
+  ImageFilter f4;
+  EXPECT_TRUE(f4.Load(json_path));
+  EXPECT_EQ(f1.signature, f4.signature);
+  EXPECT_EQ(f1.filter, f4.filter);
+}
+
 }  // namespace pe
@@ -17,6 +17,8 @@
 #include <time.h>
 
 #include "base/command_line.h"
+#include "base/file_util.h"
+#include "base/md5.h"
 #include "base/values.h"
 #include "base/json/json_reader.h"
 #include "base/json/string_escape.h"
@@ -40,6 +42,7 @@ const char kCommandLineKey[] = "command_line";
 const char kCreationTimeKey[] = "creation_time";
 const char kToolchainVersionKey[] = "toolchain_version";
 const char kModuleSignatureKey[] = "module_signature";
+const char kContentHashKey[] = "content_hash";
 
 // SyzygyVersion JSON keys.
 const char kMajorKey[] = "major";
@@ -55,6 +58,35 @@ const char kModuleSizeKey[] = "module_size";
 const char kModuleTimeDateStampKey[] = "module_time_date_stamp";
 const char kModuleChecksumKey[] = "module_checksum";
 
+// The number of bytes that are digested per read while hashing a file.
+const size_t kHashBufferSize = 1 << 16;
+
+// Digests the contents of the file at @p path into the given MD5 @p context.
+bool HashFileContents(const base::FilePath& path, base::MD5Context* context) {
+  DCHECK(context != NULL);
+
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open file for hashing: " << path.value();
+    return false;
+  }
+
+  char buffer[kHashBufferSize];
+  while (true) {
+    size_t bytes_read = ::fread(buffer, 1, sizeof(buffer), file.get());
+    if (bytes_read == 0)
+      break;
+    base::MD5Update(context, base::StringPiece(buffer, bytes_read));
+  }
+
+  if (::ferror(file.get())) {
+    LOG(ERROR) << "Error reading file for hashing: " << path.value();
+    return false;
+  }
+
+  return true;
+}
+
 std::string TimeToString(const Time& time) {
   // Want the output format to be consistent with what Time::FromString
   // accepts as input. An example follows:
@@ -219,6 +251,23 @@ bool Metadata::Init(const PEFile::Signature& module_signature) {
   return true;
 }
 
+bool Metadata::InitContentHash(const base::FilePath& module_path) {
+  base::MD5Context context;
+  base::MD5Init(&context);
+
+  // The stamp covers the contents of the pre-transform module and the
+  // command line, which captures the transform configuration.
+  if (!HashFileContents(module_path, &context))
+    return false;
+  base::MD5Update(&context, command_line_);
+
+  base::MD5Digest digest;
+  base::MD5Final(&digest, &context);
+  content_hash_ = base::MD5DigestToBase16(digest);
+
+  return true;
+}
+
 bool Metadata::IsConsistent(const PEFile::Signature& module_signature) const {
   if (!common::kSyzygyVersion.IsCompatible(toolchain_version_)) {
     LOG(ERROR) << "Metadata is not compatible with current toolchain version.";
@@ -245,6 +294,8 @@ bool Metadata::SaveToJSON(core::JSONFileWriter* json_file) const {
       OutputSyzygyVersion(toolchain_version_, json_file) &&
       json_file->OutputKey(kModuleSignatureKey) &&
       OutputPEFileSignature(module_signature_, json_file) &&
+      json_file->OutputKey(kContentHashKey) &&
+      json_file->OutputString(content_hash_) &&
       json_file->CloseDict();
 }
 
@@ -264,6 +315,11 @@ bool Metadata::LoadFromJSON(const DictionaryValue& metadata) {
       !LoadPEFileSignature(*module_signature_dict, &module_signature_))
     return false;
 
+  // The content hash is optional so that metadata that was serialized before
+  // its introduction still parses.
+  content_hash_.clear();
+  metadata.GetString(kContentHashKey, &content_hash_);
+
   // Parse the creation time from its string representation.
   return StringToTime(creation_time, &creation_time_);
 }
@@ -294,6 +350,8 @@ bool Metadata::SaveToBlock(BlockGraph::Block* block) const {
   text.append(toolchain_version_.GetVersionString());
   text.append("\nModule path: ");
   text.append(path);
+  text.append("\nContent hash: ");
+  text.append(content_hash_);
   text.append("\n");
   if (!out_archive.Save(text))
     return false;
@@ -359,7 +417,8 @@ bool Metadata::operator==(const Metadata& rhs) const {
   return command_line_ == rhs.command_line_ &&
       creation_time_ == rhs.creation_time_ &&
       toolchain_version_ == rhs.toolchain_version_ &&
-      module_signature_ == rhs.module_signature_;
+      module_signature_ == rhs.module_signature_ &&
+      content_hash_ == rhs.content_hash_;
 }
 
 // Serialization 'Save' implementation.
@@ -368,7 +427,8 @@ bool Metadata::Save(core::OutArchive* out_archive) const {
   return out_archive->Save(command_line_) &&
       out_archive->Save(creation_time_) &&
       out_archive->Save(toolchain_version_) &&
-      out_archive->Save(module_signature_);
+      out_archive->Save(module_signature_) &&
+      out_archive->Save(content_hash_);
 }
 
 // Serialization 'Load' implementation.
@@ -377,7 +437,8 @@ bool Metadata::Load(core::InArchive* in_archive) {
   return in_archive->Load(&command_line_) &&
       in_archive->Load(&creation_time_) &&
       in_archive->Load(&toolchain_version_) &&
-      in_archive->Load(&module_signature_);
+      in_archive->Load(&module_signature_) &&
+      in_archive->Load(&content_hash_);
 }
 
 }  // namespace pe
@@ -51,6 +51,15 @@ class Metadata {
   // that the singleton CommandLine has already been initialized.
   bool Init(const PEFile::Signature& module_signature);
 
+  // Computes and sets the content hash stamp for this metadata. The stamp is
+  // a digest of the contents of the pre-transform module and of the command
+  // line, which captures the transform configuration. Downstream caches can
+  // thus key on this one small value rather than rehashing the image. Expects
+  // Init to have been called first so that the command line is populated.
+  // @param module_path the path to the pre-transform module.
+  // @returns true on success, false otherwise.
+  bool InitContentHash(const base::FilePath& module_path);
+
   // Confirms the metadata is consistent with the given module and current
   // toolchain version.
   bool IsConsistent(const PEFile::Signature& module_signature) const;
@@ -83,6 +92,7 @@ class Metadata {
   const PEFile::Signature& module_signature() const {
     return module_signature_;
   }
+  const std::string& content_hash() const { return content_hash_; }
 
   // Mutators. These are mainly for explicit testing.
   void set_command_line(const std::string& command_line) {
@@ -97,6 +107,9 @@ class Metadata {
   void set_module_signature(const PEFile::Signature& module_signature) {
     module_signature_ = module_signature;
   }
+  void set_content_hash(const std::string& content_hash) {
+    content_hash_ = content_hash;
+  }
 
  private:
   // The command-line that was used to produce the output.
@@ -107,6 +120,9 @@ class Metadata {
   SyzygyVersion toolchain_version_;
   // The original module from/for which the output was produced.
   PEFile::Signature module_signature_;
+  // A digest of the pre-transform module contents and of the command line.
+  // Empty if no content hash stamp was computed.
+  std::string content_hash_;
 
   DISALLOW_COPY_AND_ASSIGN(Metadata);
 };
@@ -50,6 +50,7 @@ void InitMetadata(Metadata* metadata) {
   metadata->set_creation_time(creation_time);
   metadata->set_toolchain_version(toolchain_version);
   metadata->set_module_signature(module_signature);
+  metadata->set_content_hash("0123456789abcdef0123456789abcdef");
 }
 
 bool TestJSONSerialization(bool pretty_print) {
@@ -104,6 +105,32 @@ bool TestJSONSerialization(bool pretty_print) {
 
 }  // namespace
 
+TEST(MetadataTest, InitContentHash) {
+  base::FilePath temp_file_path;
+  FILE* temp_file = base::CreateAndOpenTemporaryFile(&temp_file_path);
+  ASSERT_TRUE(temp_file != NULL);
+  ASSERT_EQ(11u, ::fwrite("hello world", 1, 11, temp_file));
+  ::fclose(temp_file);
+
+  Metadata metadata1;
+  InitMetadata(&metadata1);
+  EXPECT_TRUE(metadata1.InitContentHash(temp_file_path));
+  EXPECT_EQ(32u, metadata1.content_hash().size());
+
+  // The stamp is deterministic for fixed inputs.
+  Metadata metadata2;
+  InitMetadata(&metadata2);
+  EXPECT_TRUE(metadata2.InitContentHash(temp_file_path));
+  EXPECT_EQ(metadata1.content_hash(), metadata2.content_hash());
+
+  // And changes when the configuration changes.
+  metadata2.set_command_line("foo.exe --qux");
+  EXPECT_TRUE(metadata2.InitContentHash(temp_file_path));
+  EXPECT_NE(metadata1.content_hash(), metadata2.content_hash());
+
+  EXPECT_TRUE(base::DeleteFile(temp_file_path, false));
+}
+
 TEST(MetadataTest, Equality) {
   Metadata metadata1;
   Metadata metadata2;
@@ -229,6 +229,7 @@
         'pe_relinker_util_unittest.cc',
         'pe_transform_policy_unittest.cc',
         'serialization_unittest.cc',
+        'unittest_util_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
       ],
       'dependencies': [
@@ -25,6 +25,8 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/memory/scoped_ptr.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
 #include "syzygy/core/serialization.h"
@@ -216,10 +218,43 @@ class PECoffFile {
   typedef std::vector<uint8> SectionBuffer;
 
   struct SectionInfo {
-    SectionInfo() : id(kInvalidSection) {
+    SectionInfo() : id(kInvalidSection), mapped_data(NULL), mapped_size(0) {
     }
+
+    // @returns a pointer to the section's bytes, whether they are owned by
+    //     buffer or a view into the file mapping. NULL if the section has no
+    //     data.
+    const uint8* data() const {
+      if (mapped_data != NULL)
+        return mapped_data;
+      return buffer.empty() ? NULL : &buffer[0];
+    }
+
+    // @returns the number of bytes of section data.
+    size_t data_size() const {
+      return mapped_data != NULL ? mapped_size : buffer.size();
+    }
+
+    // Returns the section's private mutable buffer, first copying the mapped
+    // view into it if necessary. This is the copy-on-demand half of the
+    // memory-mapped mode: sections that are never mutated are never copied.
+    // @returns the mutable section buffer.
+    SectionBuffer& mutable_buffer() {
+      if (mapped_data != NULL) {
+        buffer.assign(mapped_data, mapped_data + mapped_size);
+        mapped_data = NULL;
+        mapped_size = 0;
+      }
+      return buffer;
+    }
+
     size_t id;
     SectionBuffer buffer;
+
+    // When the image is memory mapped and the section has not been mutated
+    // these describe a read-only view into the mapping, and buffer is empty.
+    const uint8* mapped_data;
+    size_t mapped_size;
   };
 
   typedef core::AddressSpace<AddressType, SizeType, SectionInfo>
@@ -239,6 +274,18 @@ class PECoffFile {
   // @param path the path to the input file.
   void Init(const base::FilePath& path);
 
+  // Memory-maps the input file. Once this has succeeded, section data is
+  // served as views into the mapping rather than being copied into private
+  // buffers; a mutable data access makes a private copy of the touched
+  // section only. Must be called after Init and before the sections are
+  // read.
+  //
+  // @returns true on success, false on error.
+  bool MapImage();
+
+  // @returns true iff the image has been memory-mapped via MapImage.
+  bool is_mapped() const { return image_mapping_.get() != NULL; }
+
   // Read headers common to both PE and COFF. Insert a range covering
   // all headers, including unread headers; the range spans from the
   // beginning of the file to the end of the known fixed headers (the
@@ -275,10 +322,25 @@ class PECoffFile {
   // @param len the number of bytes to read.
   static bool ReadAt(FILE* file, size_t pos, void* buf, size_t len);
 
+  // Inserts a range into the address map whose data is a view into the file
+  // mapping. The image must have been mapped with MapImage.
+  //
+  // @param start the file offset the view starts at.
+  // @param size the number of bytes in the view.
+  // @param range the range to insert.
+  // @returns true on success, false on error.
+  bool InsertRangeMapped(FileOffsetAddress start, size_t size,
+                         const typename ImageAddressSpace::Range& range);
+
   base::FilePath path_;
   const IMAGE_FILE_HEADER* file_header_;
   const IMAGE_SECTION_HEADER* section_headers_;
 
+  // The file mapping backing zero-copy section views, if MapImage has been
+  // called. Declared before image_data_ so that the views it serves are
+  // destroyed first.
+  scoped_ptr<base::MemoryMappedFile> image_mapping_;
+
   // Contains all data in the image. The address space has a range defined
   // for the header and each section in the image, with its associated
   // SectionBuffer as the data.
@@ -25,6 +25,21 @@ void PECoffFile<AddressSpaceTraits>::Init(const base::FilePath& path) {
   path_ = path;
 }
 
+template <typename AddressSpaceTraits>
+bool PECoffFile<AddressSpaceTraits>::MapImage() {
+  DCHECK(!path_.empty());
+  DCHECK(image_mapping_.get() == NULL);
+
+  scoped_ptr<base::MemoryMappedFile> mapping(new base::MemoryMappedFile());
+  if (!mapping->Initialize(path_)) {
+    LOG(ERROR) << "Failed to map image: " << path_.value();
+    return false;
+  }
+
+  image_mapping_ = mapping.Pass();
+  return true;
+}
+
 template <typename AddressSpaceTraits>
 bool PECoffFile<AddressSpaceTraits>::Contains(AddressType addr,
                                               SizeType len) const {
@@ -167,10 +182,24 @@ bool PECoffFile<AddressSpaceTraits>::ReadSections(FILE* file) {
     }
 
     it->second.id = i;
-    SectionBuffer& buf = it->second.buffer;
     if (hdr->SizeOfRawData == 0)
       continue;
 
+    // In mapped mode the section is served as a view into the mapping;
+    // otherwise its raw data is copied into a private buffer.
+    if (is_mapped()) {
+      if (hdr->PointerToRawData + hdr->SizeOfRawData >
+          image_mapping_->length()) {
+        LOG(ERROR) << "Section data lies outside the mapped image: "
+                   << hdr->Name << ".";
+        return false;
+      }
+      it->second.mapped_data = image_mapping_->data() + hdr->PointerToRawData;
+      it->second.mapped_size = hdr->SizeOfRawData;
+      continue;
+    }
+
+    SectionBuffer& buf = it->second.buffer;
     buf.resize(hdr->SizeOfRawData);
     if (!ReadAt(file, hdr->PointerToRawData, &buf.at(0), hdr->SizeOfRawData)) {
       LOG(ERROR) << "Unable to read data for section " << hdr->Name << ".";
@@ -202,6 +231,29 @@ bool PECoffFile<AddressSpaceTraits>::InsertRangeReadAt(
   return true;
 }
 
+template <typename AddressSpaceTraits>
+bool PECoffFile<AddressSpaceTraits>::InsertRangeMapped(
+    FileOffsetAddress start, size_t size,
+    const typename ImageAddressSpace::Range& range) {
+  DCHECK(is_mapped());
+
+  if (start.value() + size > image_mapping_->length()) {
+    LOG(ERROR) << "Range lies outside the mapped image.";
+    return false;
+  }
+
+  ImageAddressSpace::RangeMap::iterator it;
+  bool inserted = image_data_.Insert(range, SectionInfo(), &it);
+  if (!inserted) {
+    LOG(ERROR) << "Unable to create new range in address space.";
+    return false;
+  }
+
+  it->second.mapped_data = image_mapping_->data() + start.value();
+  it->second.mapped_size = size;
+  return true;
+}
+
 template <typename AddressSpaceTraits>
 bool PECoffFile<AddressSpaceTraits>::ReadAt(FILE* file, size_t pos,
                                             void* buf, size_t len) {
@@ -226,9 +278,8 @@ const uint8* PECoffFile<AddressSpaceTraits>::GetImageData(AddressType addr,
     ptrdiff_t offs = addr - it->first.start();
     DCHECK_GE(offs, 0);
 
-    const SectionBuffer& buf = it->second.buffer;
-    if (offs + len <= buf.size())
-      return &buf.at(offs);
+    if (offs + len <= it->second.data_size())
+      return it->second.data() + offs;
   }
 
   return NULL;
@@ -237,8 +288,22 @@ const uint8* PECoffFile<AddressSpaceTraits>::GetImageData(AddressType addr,
 template <typename AddressSpaceTraits>
 uint8* PECoffFile<AddressSpaceTraits>::GetImageData(AddressType addr,
                                                     SizeType len) {
-  return const_cast<uint8*>(
-      static_cast<const PECoffFile*>(this)->GetImageData(addr, len));
+  ImageAddressSpace::Range range(addr, len);
+  ImageAddressSpace::RangeMap::iterator it = image_data_.FindContaining(range);
+
+  if (it != image_data_.ranges().end()) {
+    ptrdiff_t offs = addr - it->first.start();
+    DCHECK_GE(offs, 0);
+
+    if (offs + len <= it->second.data_size()) {
+      // Mutable access to a mapped view makes a private copy of the range's
+      // data (copy-on-demand).
+      SectionBuffer& buf = it->second.mutable_buffer();
+      return &buf.at(offs);
+    }
+  }
+
+  return NULL;
 }
 
 template <typename AddressSpaceTraits>
@@ -290,15 +355,16 @@ bool PECoffFile<AddressSpaceTraits>::ReadImageString(AddressType addr,
     ptrdiff_t offs = addr - it->first.start();
     DCHECK_GE(offs, 0);
     // Stash the start position.
-    const SectionBuffer& buf = it->second.buffer;
-    const char* begin = reinterpret_cast<const char*>(&buf.at(offs));
+    const uint8* data = it->second.data();
+    size_t data_size = it->second.data_size();
+    const char* begin = reinterpret_cast<const char*>(data + offs);
     // And loop through until we find a zero-terminating byte,
     // or run off the end.
-    for (; static_cast<size_t>(offs) < buf.size() && buf.at(offs); ++offs) {
+    for (; static_cast<size_t>(offs) < data_size && data[offs]; ++offs) {
       // Intentionally empty.
     }
 
-    if (static_cast<size_t>(offs) == buf.size())
+    if (static_cast<size_t>(offs) == data_size)
       return false;
 
     str->assign(begin);
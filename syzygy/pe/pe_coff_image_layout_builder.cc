@@ -14,6 +14,9 @@
 
 #include "syzygy/pe/pe_coff_image_layout_builder.h"
 
+#include <utility>
+#include <vector>
+
 #include "base/strings/string_util.h"
 #include "syzygy/common/align.h"
 #include "syzygy/pe/pe_utils.h"
@@ -110,6 +113,50 @@ bool PECoffImageLayoutBuilder::LayoutBlock(size_t alignment,
   return true;
 }
 
+bool PECoffImageLayoutBuilder::LayoutBlocks(
+    const OrderedBlockGraph::BlockList& blocks) {
+  DCHECK_NE(0u, section_start_.value());
+
+  // First pass: compute every block's address, applying the same padding and
+  // alignment decisions as LayoutBlock, without touching the address space.
+  std::vector<std::pair<RelativeAddress, BlockGraph::Block*>> layout;
+  layout.reserve(blocks.size());
+
+  OrderedBlockGraph::BlockList::const_iterator it = blocks.begin();
+  for (; it != blocks.end(); ++it) {
+    BlockGraph::Block* block = *it;
+    DCHECK(block != NULL);
+
+    // If this is not the first block of the section and we have padding,
+    // then output the padding.
+    if (padding_ > 0 && cursor_ > section_start_)
+      cursor_ += padding_;
+
+    // Keep the larger alignment.
+    size_t alignment = block->alignment();
+    if (block->type() == BlockGraph::CODE_BLOCK && alignment < code_alignment_)
+      alignment = code_alignment_;
+    cursor_ = cursor_.AlignUp(alignment);
+
+    // If we have explicit data, advance the explicit data cursor.
+    if (block->data_size() > 0)
+      section_auto_init_end_ = cursor_ + block->data_size();
+
+    layout.push_back(std::make_pair(cursor_, block));
+    cursor_ += block->size();
+  }
+
+  // Second pass: insert the blocks into the address space in bulk. The
+  // addresses are strictly increasing, so each insertion is a constant-time
+  // append.
+  if (!image_layout_->blocks.InsertBlocks(layout)) {
+    LOG(ERROR) << "InsertBlocks failed.";
+    return false;
+  }
+
+  return true;
+}
+
 void PECoffImageLayoutBuilder::CloseExplicitSectionData() {
   DCHECK_NE(0u, section_start_.value());
   section_init_end_ = cursor_;
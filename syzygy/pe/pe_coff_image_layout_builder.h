@@ -111,6 +111,18 @@ class PECoffImageLayoutBuilder {
   // @see LayoutBlock(BlockGraph::Block*)
   bool LayoutBlock(size_t alignment, BlockGraph::Block* block);
 
+  // Lay out the provided blocks in order, exactly as repeated calls to
+  // LayoutBlock would. The layout is computed in two phases: a first pass
+  // computes every block's address with pure cursor arithmetic over the
+  // block list, and a second pass inserts the blocks into the address space
+  // in bulk. The bulk insertion is a linear append, so this is O(n) in the
+  // number of blocks versus the O(n lg n) of laying the blocks out one at a
+  // time.
+  //
+  // @param blocks the blocks to lay out, in layout order.
+  // @returns true on success, false on failure.
+  bool LayoutBlocks(const OrderedBlockGraph::BlockList& blocks);
+
   // Mark the end of the initialized data portion of the section that is
   // currently being laid out. If not explicitly called for a given section,
   // the span of initialized data will be automatically determined based on
@@ -194,4 +194,57 @@ TEST_F(PECoffImageLayoutBuilderTest, Padding) {
   EXPECT_EQ(kCharacteristics, sections[1].characteristics);
 }
 
+TEST_F(PECoffImageLayoutBuilderTest, LayoutBlocks) {
+  // Create a few dummy blocks with mixed alignments for populating a
+  // section.
+  BlockGraph::Block* b1 = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                                0x1234, "b1");
+  BlockGraph::Block* b2 = block_graph_.AddBlock(BlockGraph::DATA_BLOCK,
+                                                0x321, "b2");
+  BlockGraph::Block* b3 = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                                0x123, "b3");
+  b1->AllocateData(0x1000);
+  b2->AllocateData(0x100);
+  memset(b1->GetMutableData(), 0xCC, 0x1000);
+  memset(b2->GetMutableData(), 0xCC, 0x100);
+  b2->set_alignment(16);
+
+  block_graph::OrderedBlockGraph::BlockList blocks;
+  blocks.push_back(b1);
+  blocks.push_back(b2);
+  blocks.push_back(b3);
+
+  // Lay out the blocks one at a time.
+  ImageLayout expected_layout(&block_graph_);
+  TestImageLayoutBuilder expected_builder(&expected_layout, 1, 1);
+  expected_builder.set_padding(10);
+  expected_builder.set_code_alignment(4);
+  const uint32 kCharacteristics = IMAGE_SCN_CNT_CODE;
+  EXPECT_TRUE(expected_builder.OpenSection("foo", kCharacteristics));
+  EXPECT_TRUE(expected_builder.LayoutBlock(b1));
+  EXPECT_TRUE(expected_builder.LayoutBlock(b2));
+  EXPECT_TRUE(expected_builder.LayoutBlock(b3));
+  EXPECT_TRUE(expected_builder.CloseSection());
+
+  // Laying out the same blocks in bulk must produce the same layout.
+  ImageLayout layout(&block_graph_);
+  TestImageLayoutBuilder builder(&layout, 1, 1);
+  builder.set_padding(10);
+  builder.set_code_alignment(4);
+  EXPECT_TRUE(builder.OpenSection("foo", kCharacteristics));
+  EXPECT_TRUE(builder.LayoutBlocks(blocks));
+  EXPECT_TRUE(builder.CloseSection());
+
+  EXPECT_EQ(expected_layout.sections, layout.sections);
+  block_graph::OrderedBlockGraph::BlockList::const_iterator it =
+      blocks.begin();
+  for (; it != blocks.end(); ++it) {
+    RelativeAddress expected_addr;
+    RelativeAddress addr;
+    EXPECT_TRUE(expected_layout.blocks.GetAddressOf(*it, &expected_addr));
+    EXPECT_TRUE(layout.blocks.GetAddressOf(*it, &addr));
+    EXPECT_EQ(expected_addr, addr);
+  }
+}
+
 }  // namespace pe
@@ -25,6 +25,9 @@
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/files/file_path.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_piece.h"
+#include "base/strings/string_util.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
 #include "syzygy/core/section_offset_address.h"
@@ -115,7 +118,12 @@ class PEFileBase : public PECoffFile<PEAddressSpaceTraits> {
   using PECoffFile<PEAddressSpaceTraits>::GetSectionHeader;
 
   // Construct a PEFileBase object not yet bound to any file.
-  PEFileBase() : dos_header_(NULL), nt_headers_(NULL) {}
+  PEFileBase()
+      : dos_header_(NULL),
+        nt_headers_(NULL),
+        imports_decode_failed_(false),
+        exports_decode_failed_(false) {
+  }
 
   // Destroy this PEFileBase object, invalidating all pointers obtained
   // through GetImageData(), or headers returned by corresponding
@@ -129,6 +137,17 @@ class PEFileBase : public PECoffFile<PEAddressSpaceTraits> {
   // @returns true on success, false on error.
   bool Init(const base::FilePath& path);
 
+  // As Init(path), but with an optional zero-copy mode. When
+  // @p memory_mapped is true the file is memory-mapped and section data
+  // accessors return pointers into the mapping; a private copy of a section
+  // is only made if a caller asks for mutable data. This roughly halves both
+  // I/O and peak working set for read-mostly batch workloads.
+  //
+  // @param path the path to the file to read.
+  // @param memory_mapped if true, serve section data from a file mapping.
+  // @returns true on success, false on error.
+  bool Init(const base::FilePath& path, bool memory_mapped);
+
   // Retrieve the signature of this PE file. May only be called after
   // a file has been read with Init().
   //
@@ -165,6 +184,48 @@ class PEFileBase : public PECoffFile<PEAddressSpaceTraits> {
   // @returns true on success, false on error.
   bool DecodeExports(ExportInfoVector* exports) const;
 
+  // Retrieve the decoded imports of this image, decoding them and building
+  // a name index on first use. Subsequent calls return the cached tables
+  // without re-parsing the image. The returned vector lives as long as this
+  // object. Building and accessing the cache is not thread-safe.
+  //
+  // @param imports receives a pointer to the cached imports.
+  // @returns true on success, false on error.
+  bool GetDecodedImports(const ImportDllVector** imports) const;
+
+  // As GetDecodedImports(), but for exports.
+  //
+  // @param exports receives a pointer to the cached exports.
+  // @returns true on success, false on error.
+  bool GetDecodedExports(const ExportInfoVector** exports) const;
+
+  // Retrieve the cached import descriptor for the given DLL. The comparison
+  // is case-insensitive, as module names are on Windows.
+  //
+  // @param dll_name the name of the imported DLL.
+  // @returns a pointer to the descriptor, valid as long as this object, or
+  // NULL if the DLL is not imported or the import tables could not be
+  // decoded.
+  const ImportDll* FindImportDll(const base::StringPiece& dll_name) const;
+
+  // Retrieve the cached export with the given name.
+  //
+  // @param name the name of the export.
+  // @returns a pointer to the export, valid as long as this object, or
+  // NULL if there is no export with that name or the export table could
+  // not be decoded.
+  const ExportInfo* FindExport(const base::StringPiece& name) const;
+
+  // Batch variant of FindExport(), resolving @p names against the cached
+  // name index in one call.
+  //
+  // @param names the names of the exports to find.
+  // @param exports receives one entry per name, NULL where the name is not
+  // exported.
+  // @returns true if the export table could be decoded, false otherwise.
+  bool FindExports(const std::vector<std::string>& names,
+                   std::vector<const ExportInfo*>* exports) const;
+
   // Translate a relative address to an absolute address, based on the
   // preferred loading address of this PE file.
   //
@@ -262,6 +323,19 @@ class PEFileBase : public PECoffFile<PEAddressSpaceTraits> {
   const IMAGE_DOS_HEADER* dos_header_;
   const ImageNtHeaders* nt_headers_;
 
+  // The lazily decoded import/export tables and the name indices over them,
+  // built by GetDecodedImports() and GetDecodedExports(). The failure flags
+  // keep a failed decode from being retried on every query. These are
+  // caches, hence mutable.
+  // @{
+  mutable scoped_ptr<ImportDllVector> decoded_imports_;
+  mutable std::map<std::string, size_t> import_dll_index_;
+  mutable bool imports_decode_failed_;
+  mutable scoped_ptr<ExportInfoVector> decoded_exports_;
+  mutable std::map<std::string, size_t> export_name_index_;
+  mutable bool exports_decode_failed_;
+  // @}
+
   DISALLOW_COPY_AND_ASSIGN(PEFileBase);
 };
 
@@ -341,6 +415,14 @@ struct PEFileBase<ImageNtHeaders, MagicValidation>::Signature {
   // for the signature, false otherwise.
   bool IsConsistentExceptForChecksum(const Signature& signature) const;
 
+  // Computes a hash over the four signature components. The path does not
+  // contribute, so signatures that are consistent with one another hash
+  // identically. This is useful as a precomputed fast-compare key when
+  // matching or indexing a large number of signatures.
+  //
+  // @returns a hash of the four signature components.
+  size_t GetHash() const;
+
   // Compare the specified signature with this one. Signatures are
   // equal if their paths are the same and they are consistent.
   //
@@ -20,14 +20,25 @@ namespace pe {
 template <class ImageNtHeaders, DWORD MagicValidation>
 bool PEFileBase<ImageNtHeaders, MagicValidation>::Init(
     const base::FilePath& path) {
+  return Init(path, false);
+}
+
+template <class ImageNtHeaders, DWORD MagicValidation>
+bool PEFileBase<ImageNtHeaders, MagicValidation>::Init(
+    const base::FilePath& path, bool memory_mapped) {
   PECoffFile::Init(path);
 
+  if (memory_mapped && !MapImage())
+    return false;
+
   FILE* file = base::OpenFile(path, "rb");
   if (file == NULL) {
     LOG(ERROR) << "Failed to open file " << path.value() << ".";
     return false;
   }
 
+  // The headers are always copied, as they are tiny and commonly mutated;
+  // in mapped mode the section data becomes views into the mapping.
   bool success = ReadHeaders(file);
   if (success)
     success = ReadSections(file);
@@ -285,6 +296,120 @@ bool PEFileBase<ImageNtHeaders, MagicValidation>::DecodeExports(
   return true;
 }
 
+template <class ImageNtHeaders, DWORD MagicValidation>
+bool PEFileBase<ImageNtHeaders, MagicValidation>::GetDecodedImports(
+    const ImportDllVector** imports) const {
+  DCHECK_NE(static_cast<const ImportDllVector**>(NULL), imports);
+
+  if (decoded_imports_.get() == NULL) {
+    if (imports_decode_failed_)
+      return false;
+
+    scoped_ptr<ImportDllVector> decoded(new ImportDllVector());
+    if (!DecodeImports(decoded.get())) {
+      imports_decode_failed_ = true;
+      return false;
+    }
+    decoded_imports_.reset(decoded.release());
+
+    // Build the name index. Imported module names are matched
+    // case-insensitively, as the loader does.
+    for (size_t i = 0; i < decoded_imports_->size(); ++i) {
+      std::string name = (*decoded_imports_)[i].name;
+      StringToLowerASCII(&name);
+      import_dll_index_.insert(std::make_pair(name, i));
+    }
+  }
+
+  *imports = decoded_imports_.get();
+  return true;
+}
+
+template <class ImageNtHeaders, DWORD MagicValidation>
+bool PEFileBase<ImageNtHeaders, MagicValidation>::GetDecodedExports(
+    const ExportInfoVector** exports) const {
+  DCHECK_NE(static_cast<const ExportInfoVector**>(NULL), exports);
+
+  if (decoded_exports_.get() == NULL) {
+    if (exports_decode_failed_)
+      return false;
+
+    scoped_ptr<ExportInfoVector> decoded(new ExportInfoVector());
+    if (!DecodeExports(decoded.get())) {
+      exports_decode_failed_ = true;
+      return false;
+    }
+    decoded_exports_.reset(decoded.release());
+
+    // Build the name index. Exports by ordinal only have no name and are
+    // not indexed.
+    for (size_t i = 0; i < decoded_exports_->size(); ++i) {
+      const ExportInfo& info = (*decoded_exports_)[i];
+      if (!info.name.empty())
+        export_name_index_.insert(std::make_pair(info.name, i));
+    }
+  }
+
+  *exports = decoded_exports_.get();
+  return true;
+}
+
+template <class ImageNtHeaders, DWORD MagicValidation>
+const typename PEFileBase<ImageNtHeaders, MagicValidation>::ImportDll*
+PEFileBase<ImageNtHeaders, MagicValidation>::FindImportDll(
+    const base::StringPiece& dll_name) const {
+  const ImportDllVector* imports = NULL;
+  if (!GetDecodedImports(&imports))
+    return NULL;
+
+  std::string name = dll_name.as_string();
+  StringToLowerASCII(&name);
+  std::map<std::string, size_t>::const_iterator it =
+      import_dll_index_.find(name);
+  if (it == import_dll_index_.end())
+    return NULL;
+
+  return &(*imports)[it->second];
+}
+
+template <class ImageNtHeaders, DWORD MagicValidation>
+const typename PEFileBase<ImageNtHeaders, MagicValidation>::ExportInfo*
+PEFileBase<ImageNtHeaders, MagicValidation>::FindExport(
+    const base::StringPiece& name) const {
+  const ExportInfoVector* exports = NULL;
+  if (!GetDecodedExports(&exports))
+    return NULL;
+
+  std::map<std::string, size_t>::const_iterator it =
+      export_name_index_.find(name.as_string());
+  if (it == export_name_index_.end())
+    return NULL;
+
+  return &(*exports)[it->second];
+}
+
+template <class ImageNtHeaders, DWORD MagicValidation>
+bool PEFileBase<ImageNtHeaders, MagicValidation>::FindExports(
+    const std::vector<std::string>& names,
+    std::vector<const ExportInfo*>* exports) const {
+  DCHECK_NE(static_cast<std::vector<const ExportInfo*>*>(NULL), exports);
+
+  const ExportInfoVector* decoded = NULL;
+  if (!GetDecodedExports(&decoded))
+    return false;
+
+  exports->clear();
+  exports->resize(names.size());
+  for (size_t i = 0; i < names.size(); ++i) {
+    std::map<std::string, size_t>::const_iterator it =
+        export_name_index_.find(names[i]);
+    if (it != export_name_index_.end())
+      (*exports)[i] = &(*decoded)[it->second];
+  }
+
+  return true;
+}
+
 template <class ImageNtHeaders, DWORD MagicValidation>
 bool PEFileBase<ImageNtHeaders, MagicValidation>::Translate(
     RelativeAddress rel, AbsoluteAddress* abs) const {
@@ -554,6 +679,19 @@ bool PEFileBase<ImageNtHeaders,
       module_time_date_stamp == signature.module_time_date_stamp;
 }
 
+template<class ImageNtHeaders, DWORD MagicValidation>
+size_t PEFileBase<ImageNtHeaders, MagicValidation>::Signature::GetHash()
+    const {
+  // Mixes the components with distinct small odd multipliers. Collisions
+  // only cost an extra IsConsistent comparison wherever the hash is used as
+  // an index key.
+  size_t hash = static_cast<size_t>(base_address.value());
+  hash = hash * 3 + module_size;
+  hash = hash * 7 + module_checksum;
+  hash = hash * 31 + module_time_date_stamp;
+  return hash;
+}
+
 template<class ImageNtHeaders, DWORD MagicValidation>
 bool PEFileBase<ImageNtHeaders, MagicValidation>::Signature::operator==(
     const Signature& signature) const {
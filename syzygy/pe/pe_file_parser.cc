@@ -262,8 +262,10 @@ PEFileParser::PEFileParser(const PEFile& image_file,
     : image_file_(image_file),
       address_space_(address_space),
       add_reference_(add_reference),
-      on_import_thunk_(base::Bind(&DummyOnImportThunk)) {
+      on_import_thunk_(base::Bind(&DummyOnImportThunk)),
+      deferred_parsing_(false) {
   DCHECK(!add_reference.is_null());
+  memset(deferred_blocks_, 0, sizeof(deferred_blocks_));
 }
 
 const PEFileParser::DataDirParseEntry PEFileParser::parsers_[] = {
@@ -1207,12 +1209,44 @@ BlockGraph::Block* PEFileParser::ParseResourceDir(
   if (resource_block == NULL)
     return NULL;
 
+  // When parsing on demand the resource tree is left as an opaque data
+  // range; walking it accounts for the bulk of the parsing time on
+  // resource-heavy binaries, and its structure is purely internal to the
+  // block just chunked. ParseDeferredDirectory recovers the structure if
+  // and when a consumer asks for it.
+  if (deferred_parsing_) {
+    deferred_blocks_[IMAGE_DIRECTORY_ENTRY_RESOURCE] = resource_block;
+    return resource_block;
+  }
+
   if (!ParseResourceDirImpl(resource_block, 0))
     return NULL;
 
   return resource_block;
 }
 
+bool PEFileParser::ParseDeferredDirectory(size_t entry) {
+  DCHECK_LT(entry,
+            static_cast<size_t>(IMAGE_NUMBEROF_DIRECTORY_ENTRIES));
+
+  // Directories that are absent, were parsed eagerly, or have already been
+  // refined have nothing left to parse.
+  BlockGraph::Block* block = deferred_blocks_[entry];
+  if (block == NULL)
+    return true;
+
+  // The resource directory is the only directory for which parsing is ever
+  // deferred.
+  DCHECK_EQ(static_cast<size_t>(IMAGE_DIRECTORY_ENTRY_RESOURCE), entry);
+  if (!ParseResourceDirImpl(block, 0)) {
+    LOG(ERROR) << "Unable to parse deferred resource directory.";
+    return false;
+  }
+
+  deferred_blocks_[entry] = NULL;
+  return true;
+}
+
 bool PEFileParser::ParseResourceDirImpl(BlockGraph::Block* resource_block,
                                         size_t root_offset) {
   DCHECK(resource_block != NULL);
@@ -75,6 +75,33 @@ class PEFileParser {
     on_import_thunk_ = on_import_thunk;
   }
 
+  // @name On-demand data directory parsing.
+  // When enabled, eligible data directories are chunked as opaque data
+  // blocks during ParseImage, and their internal structure (references) is
+  // only recovered by an explicit call to ParseDeferredDirectory. Only
+  // directories whose structure is wholly contained in the directory block
+  // itself are eligible for deferral; currently this is only the resource
+  // directory, which is by far the most expensive directory to parse in
+  // resource-heavy binaries and is rarely modified.
+  // @note A deferred directory that is never refined carries no internal
+  //     references, so its contents will not be fixed up should the image
+  //     layout change. Consumers that modify the image must refine every
+  //     deferred directory before laying out the image.
+  // @{
+  void set_deferred_parsing(bool deferred_parsing) {
+    deferred_parsing_ = deferred_parsing;
+  }
+  bool deferred_parsing() const { return deferred_parsing_; }
+
+  // Recovers the structure of a data directory whose parsing was deferred
+  // by ParseImage. This is a no-op for directories that are absent, were
+  // parsed eagerly, or have already been refined.
+  // @param entry the data directory entry to parse, e.g.
+  //     IMAGE_DIRECTORY_ENTRY_RESOURCE.
+  // @returns true on success, false on failure.
+  bool ParseDeferredDirectory(size_t entry);
+  // @}
+
   // Parses the image, chunks the various blocks it decomposes into and
   // invokes the AddReferenceCallback for all references encountered.
   bool ParseImage(PEHeader* pe_header);
@@ -233,6 +260,14 @@ class PEFileParser {
   BlockGraph::AddressSpace* address_space_;
   AddReferenceCallback add_reference_;
   OnImportThunkCallback on_import_thunk_;
+
+  // True if eligible data directories are to be chunked as opaque blocks,
+  // to be refined on demand (see set_deferred_parsing).
+  bool deferred_parsing_;
+
+  // The blocks of the directories whose parsing has been deferred and not
+  // yet refined, indexed by data directory entry; NULL elsewhere.
+  BlockGraph::Block* deferred_blocks_[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
 };
 
 }  // namespace pe
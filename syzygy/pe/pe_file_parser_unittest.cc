@@ -148,6 +148,17 @@ class PEFileParserTest: public testing::PELibUnitTest {
     ASSERT_TRUE(block->data() != NULL);
   }
 
+  // Counts the references collected so far that originate within @p block.
+  size_t CountReferencesFromBlock(BlockGraph::Block* block) {
+    size_t num_references = 0;
+    ReferenceMap::const_iterator it(references_.begin());
+    for (; it != references_.end(); ++it) {
+      if (block->Contains(it->first, it->second.size))
+        ++num_references;
+    }
+    return num_references;
+  }
+
   // Locate block pointed to by the reference at @p offset into @p block.
   // @returns the block in question, or NULL if no such block.
   BlockGraph::Block* FindReferencedBlock(BlockGraph::Block* block,
@@ -508,4 +519,32 @@ TEST_F(PEFileParserTest, ParseImage) {
       header.data_directory[IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT]));
 }
 
+TEST_F(PEFileParserTest, ParseImageDeferred) {
+  TestPEFileParser parser(image_file_, &address_space_, add_reference_);
+  parser.set_deferred_parsing(true);
+
+  PEFileParser::PEHeader header;
+  EXPECT_TRUE(parser.ParseImage(&header));
+
+  // The resource directory is chunked as usual.
+  BlockGraph::Block* resource_block =
+      header.data_directory[IMAGE_DIRECTORY_ENTRY_RESOURCE];
+  ASSERT_NO_FATAL_FAILURE(AssertDataDirectoryEntryValid(resource_block));
+
+  // But it is left opaque: no references originate within it.
+  EXPECT_EQ(0u, CountReferencesFromBlock(resource_block));
+
+  // Refining the directory on demand recovers its internal references.
+  EXPECT_TRUE(parser.ParseDeferredDirectory(IMAGE_DIRECTORY_ENTRY_RESOURCE));
+  EXPECT_LT(0u, CountReferencesFromBlock(resource_block));
+
+  // Refining it a second time is a no-op.
+  size_t num_references = references_.size();
+  EXPECT_TRUE(parser.ParseDeferredDirectory(IMAGE_DIRECTORY_ENTRY_RESOURCE));
+  EXPECT_EQ(num_references, references_.size());
+
+  // Directories that were parsed eagerly have nothing left to parse.
+  EXPECT_TRUE(parser.ParseDeferredDirectory(IMAGE_DIRECTORY_ENTRY_EXPORT));
+}
+
 }  // namespace pe
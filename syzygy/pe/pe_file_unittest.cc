@@ -126,6 +126,40 @@ TEST_F(PEFileTest, Init) {
   EXPECT_TRUE(image_file_.section_headers() != NULL);
 }
 
+TEST_F(PEFileTest, InitMemoryMapped) {
+  PEFile mapped_file;
+  ASSERT_TRUE(mapped_file.Init(
+      testing::GetExeRelativePath(testing::kTestDllName), true));
+
+  // Every section's data must be byte-identical with the copying reader.
+  size_t num_sections = image_file_.file_header()->NumberOfSections;
+  ASSERT_EQ(num_sections, mapped_file.file_header()->NumberOfSections);
+  for (size_t i = 0; i < num_sections; ++i) {
+    const IMAGE_SECTION_HEADER* hdr = image_file_.section_header(i);
+    if (hdr->SizeOfRawData == 0)
+      continue;
+    RelativeAddress addr(hdr->VirtualAddress);
+    size_t len = std::min(hdr->SizeOfRawData, hdr->Misc.VirtualSize);
+    const uint8* expected = image_file_.GetImageData(addr, len);
+    const uint8* actual = mapped_file.GetImageData(addr, len);
+    ASSERT_TRUE(expected != NULL);
+    ASSERT_TRUE(actual != NULL);
+    EXPECT_EQ(0, ::memcmp(expected, actual, len));
+  }
+
+  // A mutable access must make a private copy that is subsequently served
+  // for const accesses too.
+  const PEFile& const_file = mapped_file;
+  const IMAGE_SECTION_HEADER* hdr = mapped_file.section_header(0);
+  RelativeAddress addr(hdr->VirtualAddress);
+  const uint8* before = const_file.GetImageData(addr, 1);
+  uint8* mutable_data = mapped_file.GetImageData(addr, 1);
+  ASSERT_TRUE(mutable_data != NULL);
+  EXPECT_NE(before, mutable_data);
+  const uint8* after = const_file.GetImageData(addr, 1);
+  EXPECT_EQ(mutable_data, after);
+}
+
 TEST_F(PEFileTest, GetImageData) {
   const IMAGE_NT_HEADERS* nt_headers = image_file_.nt_headers();
   ASSERT_TRUE(nt_headers != NULL);
@@ -401,6 +435,53 @@ TEST_F(PEFileTest, DecodeImportsX64) {
   EXPECT_EQ(2, expected_imports);
 }
 
+TEST_F(PEFileTest, GetDecodedImports) {
+  const PEFile::ImportDllVector* imports = NULL;
+  ASSERT_TRUE(image_file_.GetDecodedImports(&imports));
+  ASSERT_TRUE(imports != NULL);
+  ASSERT_LE(2U, imports->size());
+
+  // A second query must return the cached vector.
+  const PEFile::ImportDllVector* imports2 = NULL;
+  ASSERT_TRUE(image_file_.GetDecodedImports(&imports2));
+  EXPECT_EQ(imports, imports2);
+
+  // Imported module names are matched case-insensitively.
+  const PEFile::ImportDll* dll = image_file_.FindImportDll("EXPORT_DLL.dll");
+  ASSERT_TRUE(dll != NULL);
+  EXPECT_EQ(0, base::strcasecmp("export_dll.dll", dll->name.c_str()));
+  EXPECT_EQ(4U, dll->functions.size());
+
+  EXPECT_TRUE(image_file_.FindImportDll("no_such_dll.dll") == NULL);
+}
+
+TEST_F(PEFileTest, FindExports) {
+  const PEFile::ExportInfoVector* exports = NULL;
+  ASSERT_TRUE(image_file_.GetDecodedExports(&exports));
+  ASSERT_TRUE(exports != NULL);
+
+  const PEFile::ExportInfo* info = image_file_.FindExport("TestExport");
+  ASSERT_TRUE(info != NULL);
+  EXPECT_EQ("TestExport", info->name);
+  EXPECT_EQ(3, info->ordinal);
+
+  EXPECT_TRUE(image_file_.FindExport("NoSuchExport") == NULL);
+
+  // Batch lookup fills in NULL for missing names.
+  std::vector<std::string> names;
+  names.push_back("TestExport");
+  names.push_back("NoSuchExport");
+  names.push_back("DllMain");
+  std::vector<const PEFile::ExportInfo*> found;
+  ASSERT_TRUE(image_file_.FindExports(names, &found));
+  ASSERT_EQ(3U, found.size());
+  ASSERT_TRUE(found[0] != NULL);
+  EXPECT_EQ("TestExport", found[0]->name);
+  EXPECT_TRUE(found[1] == NULL);
+  ASSERT_TRUE(found[2] != NULL);
+  EXPECT_EQ("DllMain", found[2]->name);
+}
+
 TEST_F(PEFileTest, GetSectionIndexByRelativeAddress) {
   size_t num_sections = image_file_.nt_headers()->FileHeader.NumberOfSections;
   for (size_t i = 0; i < num_sections; ++i) {
@@ -520,4 +601,34 @@ TEST(PEFileSignatureTest, Consistency) {
   EXPECT_FALSE(sig1.IsConsistentExceptForChecksum(sig2));
 }
 
+TEST(PEFileSignatureTest, GetHash) {
+  PEFile::Signature sig1;
+  sig1.path = L"C:\\foo\\bar.dll";
+  sig1.base_address = AbsoluteAddress(0x1000000);
+  sig1.module_size = 12345;
+  sig1.module_time_date_stamp = 9999999;
+  sig1.module_checksum = 0xbaadf00d;
+
+  // Consistent signatures hash identically; the path does not contribute.
+  PEFile::Signature sig2(sig1);
+  sig2.path = L"C:\\foo\\bar.exe";
+  EXPECT_EQ(sig1.GetHash(), sig2.GetHash());
+
+  // Each signature component contributes to the hash.
+  sig2.module_checksum = sig1.module_checksum + 100;
+  EXPECT_NE(sig1.GetHash(), sig2.GetHash());
+  sig2.module_checksum = sig1.module_checksum;
+
+  sig2.base_address = sig1.base_address + 0x1000;
+  EXPECT_NE(sig1.GetHash(), sig2.GetHash());
+  sig2.base_address = sig1.base_address;
+
+  sig2.module_size = sig2.module_size + 0x1000;
+  EXPECT_NE(sig1.GetHash(), sig2.GetHash());
+  sig2.module_size = sig1.module_size;
+
+  sig2.module_time_date_stamp = sig1.module_time_date_stamp + 1;
+  EXPECT_NE(sig1.GetHash(), sig2.GetHash());
+}
+
 }  // namespace pe
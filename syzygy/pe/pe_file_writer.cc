@@ -18,8 +18,14 @@
 #include <winnt.h>
 #include <imagehlp.h>  // NOLINT
 
+#include <algorithm>
+
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/sys_info.h"
+#include "base/memory/scoped_vector.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/common/buffer_parser.h"
 #include "syzygy/common/com_utils.h"
@@ -37,8 +43,11 @@ using pe::ImageLayout;
 namespace {
 
 template <class Type>
-bool UpdateReference(size_t start, Type new_value, std::vector<uint8>* data) {
-  BinaryBufferParser parser(&data->at(0), data->size());
+bool UpdateReference(size_t start,
+                     Type new_value,
+                     uint8* data,
+                     size_t data_size) {
+  BinaryBufferParser parser(data, data_size);
 
   Type* ref_ptr = NULL;
   if (!parser.GetAt(start, const_cast<const Type**>(&ref_ptr))) {
@@ -92,6 +101,61 @@ size_t GetBlockInitializedDataSize(const BlockGraph::Block* block) {
   return length;
 }
 
+// Folds the carries of a partial PE checksum back into its low 16 bits.
+uint32 FoldChecksum(uint32 sum) {
+  while ((sum >> 16) != 0)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  return sum;
+}
+
+// Computes the ones-complement 16-bit word sum of @p size bytes at @p data,
+// the composable core of the PE checksum. Partial sums over consecutive
+// chunks combine with FoldChecksum(a + b), provided the chunk boundaries are
+// word aligned. @p size may only be odd for the final chunk of an image.
+uint32 PartialImageChecksum(const uint8* data, size_t size) {
+  uint32 sum = 0;
+  const uint16* words = reinterpret_cast<const uint16*>(data);
+  size_t num_words = size / 2;
+  for (size_t i = 0; i < num_words; ++i) {
+    sum += words[i];
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  if ((size & 1) != 0)
+    sum = FoldChecksum(sum + data[size - 1]);
+  return sum;
+}
+
+// A worker that computes the partial checksum of one chunk of an image.
+class ChecksumWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  ChecksumWorker(const uint8* data, size_t size)
+      : data_(data), size_(size), sum_(0) {
+  }
+
+  uint32 sum() const { return sum_; }
+
+  virtual void Run() OVERRIDE {
+    sum_ = PartialImageChecksum(data_, size_);
+  }
+
+ private:
+  const uint8* data_;
+  size_t size_;
+  uint32 sum_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChecksumWorker);
+};
+
+// Returns a pointer to the NT headers of the assembled image in @p buffer.
+IMAGE_NT_HEADERS* GetNtHeadersInBuffer(uint8* buffer, size_t buffer_size) {
+  DCHECK(buffer != NULL);
+  DCHECK_LE(sizeof(IMAGE_DOS_HEADER), buffer_size);
+  const IMAGE_DOS_HEADER* dos_header =
+      reinterpret_cast<const IMAGE_DOS_HEADER*>(buffer);
+  DCHECK_LE(dos_header->e_lfanew + sizeof(IMAGE_NT_HEADERS), buffer_size);
+  return reinterpret_cast<IMAGE_NT_HEADERS*>(buffer + dos_header->e_lfanew);
+}
+
 size_t GetSectionOffset(const ImageLayout& image_layout,
                         const RelativeAddress rel_addr,
                         size_t section_index) {
@@ -109,35 +173,73 @@ size_t GetSectionOffset(const ImageLayout& image_layout,
 }  // namespace
 
 PEFileWriter::PEFileWriter(const ImageLayout& image_layout)
-    : image_layout_(image_layout), nt_headers_(NULL) {
+    : image_layout_(image_layout),
+      incremental_(false),
+      mapped_output_(false),
+      nt_headers_(NULL) {
 }
 
 bool PEFileWriter::WriteImage(const base::FilePath& path) {
-  // Start by attempting to open the destination file.
-  base::ScopedFILE file(base::OpenFile(path, "wb"));
-  if (file.get() == NULL) {
-    LOG(ERROR) << "Unable to open " << path.value();
-    return false;
-  }
-
   if (!ValidateHeaders())
     return false;
 
   DCHECK(nt_headers_ != NULL);
 
-  bool success = CalculateSectionRanges();
-  if (success)
-    success = WriteBlocks(file.get());
+  if (!CalculateSectionRanges()) {
+    nt_headers_ = NULL;
+    return false;
+  }
+
+  // The size of the image on disk is the end of the last section's data.
+  DCHECK(!image_layout_.sections.empty());
+  size_t last_section_index = image_layout_.sections.size() - 1;
+  size_t image_size = section_file_range_map_[last_section_index].end().value();
+
+  // In mapped output mode assemble the image directly in a mapping of the
+  // output file; there is no in-memory copy of the image to diff against a
+  // previous output, so incremental mode takes precedence.
+  if (mapped_output_ && !incremental_) {
+    bool success = WriteImageToMapping(path, image_size);
+    nt_headers_ = NULL;
+    return success;
+  }
+
+  // Assemble the image in memory.
+  std::vector<uint8> buffer(image_size);
+  bool success = WriteBlocks(&buffer[0], buffer.size());
 
   nt_headers_ = NULL;
 
-  // Close the file.
-  file.reset();
+  if (!success)
+    return false;
 
-  if (success)
-    success = UpdateFileChecksum(path);
+  // Stamp the checksum, computed in parallel from the in-memory buffer, into
+  // the headers. This replaces the serial checksum pass that used to be made
+  // over the written file.
+  IMAGE_NT_HEADERS* buffer_nt_headers =
+      GetNtHeadersInBuffer(&buffer[0], buffer.size());
+  buffer_nt_headers->OptionalHeader.CheckSum =
+      ComputeImageChecksum(&buffer[0], buffer.size());
+
+  // In incremental mode try to patch the previous output in place, only
+  // rewriting the sections whose contents have changed. If there is no
+  // compatible previous output fall through to a full write.
+  if (!incremental_ || !PatchImage(path, buffer)) {
+    base::ScopedFILE file(base::OpenFile(path, "wb"));
+    if (file.get() == NULL) {
+      LOG(ERROR) << "Unable to open " << path.value();
+      return false;
+    }
 
-  return success;
+    // Write the whole image to disk in one go.
+    if (::fwrite(&buffer[0], sizeof(buffer[0]), buffer.size(), file.get()) !=
+            buffer.size()) {
+      LOG(ERROR) << "Failed to write image to file.";
+      return false;
+    }
+  }
+
+  return true;
 }
 
 bool PEFileWriter::UpdateFileChecksum(const base::FilePath& path) {
@@ -198,6 +300,56 @@ bool PEFileWriter::UpdateFileChecksum(const base::FilePath& path) {
   return nt_headers != NULL;
 }
 
+uint32 PEFileWriter::ComputeImageChecksum(const uint8* buffer,
+                                          size_t buffer_size) {
+  DCHECK(buffer != NULL);
+
+  // The checksum field itself is counted as zero, which is achieved by
+  // summing around it. The header prefix is summed inline; it is tiny.
+  const IMAGE_NT_HEADERS* nt_headers =
+      GetNtHeadersInBuffer(const_cast<uint8*>(buffer), buffer_size);
+  size_t checksum_offset =
+      reinterpret_cast<const uint8*>(&nt_headers->OptionalHeader.CheckSum) -
+      buffer;
+  size_t body_offset =
+      checksum_offset + sizeof(nt_headers->OptionalHeader.CheckSum);
+  DCHECK_EQ(0u, checksum_offset % 2);
+  uint32 sum = PartialImageChecksum(buffer, checksum_offset);
+
+  // Sum the rest of the image on one worker per processor, in chunks no
+  // smaller than 1MB; small images are summed inline.
+  size_t body_size = buffer_size - body_offset;
+  const size_t kMinChunkSize = 1 << 20;
+  size_t num_chunks = std::min(
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()),
+      body_size / kMinChunkSize);
+  if (num_chunks <= 1) {
+    sum = FoldChecksum(sum + PartialImageChecksum(buffer + body_offset,
+                                                  body_size));
+  } else {
+    // Chunk boundaries must be word aligned for the sums to compose.
+    size_t chunk_size = (body_size / num_chunks + 1) & ~1;
+    ScopedVector<ChecksumWorker> workers;
+    ScopedVector<base::DelegateSimpleThread> threads;
+    for (size_t start = 0; start < body_size; start += chunk_size) {
+      workers.push_back(new ChecksumWorker(
+          buffer + body_offset + start,
+          std::min(chunk_size, body_size - start)));
+      threads.push_back(new base::DelegateSimpleThread(
+          workers.back(),
+          base::StringPrintf("checksum-worker-%u",
+                             static_cast<unsigned>(threads.size()))));
+      threads.back()->Start();
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Join();
+    for (size_t i = 0; i < workers.size(); ++i)
+      sum = FoldChecksum(sum + workers[i]->sum());
+  }
+
+  return sum + buffer_size;
+}
+
 bool PEFileWriter::ValidateHeaders() {
   DCHECK(nt_headers_ == NULL);
 
@@ -324,17 +476,18 @@ bool PEFileWriter::CalculateSectionRanges() {
   return true;
 }
 
-bool PEFileWriter::WriteBlocks(FILE* file) {
-  DCHECK(file != NULL);
+bool PEFileWriter::WriteBlocks(uint8* buffer, size_t buffer_size) {
+  DCHECK(buffer != NULL);
 
   AbsoluteAddress image_base(nt_headers_->OptionalHeader.ImageBase);
 
-  // Create the output buffer, reserving enough room for the whole file.
   DCHECK(!image_layout_.sections.empty());
   size_t last_section_index = image_layout_.sections.size() - 1;
-  size_t image_size = section_file_range_map_[last_section_index].end().value();
-  std::vector<uint8> buffer;
-  buffer.reserve(image_size);
+  DCHECK_EQ(section_file_range_map_[last_section_index].end().value(),
+            buffer_size);
+
+  // The cursor tracks how far into the buffer the image has been assembled.
+  size_t cursor = 0;
 
   // Iterate through all blocks in the address space writing them as we go.
   BlockGraph::AddressSpace::RangeMap::const_iterator block_it(
@@ -354,46 +507,154 @@ bool PEFileWriter::WriteBlocks(FILE* file) {
 
     // If we're jumping to a new section output the necessary padding.
     if (block->section() != section_id) {
-      FlushSection(section_index, &buffer);
+      FlushSection(section_index, buffer, &cursor);
       section_id = block->section();
       section_index++;
       DCHECK_GT(image_layout_.sections.size(), section_index);
     }
 
-    if (!WriteOneBlock(image_base, section_index, block, &buffer)) {
+    if (!WriteOneBlock(image_base, section_index, block, buffer, buffer_size,
+                       &cursor)) {
       LOG(ERROR) << "Failed to write block \"" << block->name() << "\".";
       return false;
     }
   }
 
-  FlushSection(last_section_index, &buffer);
-  DCHECK_EQ(image_size, buffer.size());
+  FlushSection(last_section_index, buffer, &cursor);
+  DCHECK_EQ(buffer_size, cursor);
+
+  return true;
+}
+
+bool PEFileWriter::WriteImageToMapping(const base::FilePath& path,
+                                       size_t image_size) {
+  // Create the output file. Creating the mapping below grows it to the full
+  // image size.
+  base::win::ScopedHandle file(
+      ::CreateFile(path.value().c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                   NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+  if (!file.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create " << path.value() << ": "
+               << common::LogWe(error);
+    return false;
+  }
+
+  base::win::ScopedHandle mapping(::CreateFileMapping(
+      file.Get(), NULL, PAGE_READWRITE, 0, image_size, NULL));
+  if (!mapping.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create file mapping: " << common::LogWe(error);
+    return false;
+  }
+
+  uint8* image_ptr = reinterpret_cast<uint8*>(
+      ::MapViewOfFile(mapping.Get(), FILE_MAP_WRITE, 0, 0, image_size));
+  if (image_ptr == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map view of file: " << common::LogWe(error);
+    return false;
+  }
+
+  // Assemble the image directly in the mapping. Blocks whose data is
+  // deferred to a mapped source image are copied mapping to mapping here,
+  // without being staged through an intermediate user-space buffer.
+  bool success = WriteBlocks(image_ptr, image_size);
+
+  // Stamp the checksum directly into the mapping; see WriteImage.
+  if (success) {
+    IMAGE_NT_HEADERS* mapped_nt_headers =
+        GetNtHeadersInBuffer(image_ptr, image_size);
+    mapped_nt_headers->OptionalHeader.CheckSum =
+        ComputeImageChecksum(image_ptr, image_size);
+  }
+
+  CHECK(::UnmapViewOfFile(image_ptr));
+
+  return success;
+}
+
+bool PEFileWriter::PatchImage(const base::FilePath& path,
+                              const std::vector<uint8>& buffer) {
+  // Read the previous output. For the patch to be valid the previous image
+  // must have exactly the same section layout as the new one, which we
+  // approximate by requiring identical file sizes; any mismatch in the
+  // section geometry will additionally show up as a difference in the header
+  // region and cause the headers to be rewritten.
+  std::string old_image;
+  if (!base::ReadFileToString(path, &old_image)) {
+    LOG(INFO) << "No previous image to patch; writing a full image.";
+    return false;
+  }
+  if (old_image.size() != buffer.size()) {
+    LOG(INFO) << "Previous image has a different layout; writing a full "
+              << "image.";
+    return false;
+  }
 
-  // Write the whole image to disk in one go.
-  if (::fwrite(&buffer[0], sizeof(buffer[0]), buffer.size(), file) !=
-          buffer.size()) {
-    LOG(ERROR) << "Failed to write image to file.";
+  base::ScopedFILE file(base::OpenFile(path, "r+b"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open " << path.value();
     return false;
   }
 
+  // Visit the headers and each of the sections in file order. Each region
+  // runs to the start of the next one so that the inter-section padding is
+  // attributed to the preceding region.
+  size_t sections_patched = 0;
+  for (size_t i = 0; i < image_layout_.sections.size() + 1; ++i) {
+    size_t region_start = 0;
+    if (i > 0)
+      region_start = section_file_range_map_[i - 1].start().value();
+    size_t region_end = buffer.size();
+    if (i < image_layout_.sections.size())
+      region_end = section_file_range_map_[i].start().value();
+    DCHECK_LE(region_start, region_end);
+
+    if (region_start == region_end ||
+        ::memcmp(old_image.data() + region_start,
+                 &buffer[region_start],
+                 region_end - region_start) == 0) {
+      continue;
+    }
+
+    if (::fseek(file.get(), region_start, SEEK_SET) != 0 ||
+        ::fwrite(&buffer[region_start],
+                 sizeof(buffer[0]),
+                 region_end - region_start,
+                 file.get()) != region_end - region_start) {
+      LOG(ERROR) << "Failed to patch image file.";
+      return false;
+    }
+
+    if (i > 0)
+      ++sections_patched;
+  }
+
+  LOG(INFO) << "Patched " << sections_patched << " of "
+            << image_layout_.sections.size() << " sections in place.";
+
   return true;
 }
 
 void PEFileWriter::FlushSection(size_t section_index,
-                                std::vector<uint8>* buffer) {
+                                uint8* buffer,
+                                size_t* cursor) {
   DCHECK(buffer != NULL);
+  DCHECK(cursor != NULL);
 
   size_t section_file_end =
       section_file_range_map_[section_index].end().value();
 
   // We've already sanity checked this in CalculateSectionFileRanges, so this
   // should be true.
-  DCHECK_GE(section_file_end, buffer->size());
-  if (section_file_end == buffer->size())
+  DCHECK_GE(section_file_end, *cursor);
+  if (section_file_end == *cursor)
     return;
 
   uint8 padding_byte = GetSectionPaddingByte(image_layout_, section_index);
-  buffer->resize(section_file_end, padding_byte);
+  ::memset(buffer + *cursor, padding_byte, section_file_end - *cursor);
+  *cursor = section_file_end;
 
   return;
 }
@@ -401,12 +662,15 @@ void PEFileWriter::FlushSection(size_t section_index,
 bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
                                  size_t section_index,
                                  const BlockGraph::Block* block,
-                                 std::vector<uint8>* buffer) {
+                                 uint8* buffer,
+                                 size_t buffer_size,
+                                 size_t* cursor) {
   // This function walks through the data referred by the input block, and
   // patches it to reflect the addresses and offsets of the blocks
   // referenced before writing the block's data to the file.
   DCHECK(block != NULL);
   DCHECK(buffer != NULL);
+  DCHECK(cursor != NULL);
 
   RelativeAddress addr;
   if (!image_layout_.blocks.GetAddressOf(block, &addr)) {
@@ -442,7 +706,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
   // We shouldn't have written anything to the spot where the block belongs.
   // This is only a DCHECK because the address space of the image layout and
   // the consistency of the sections guarantees this for us.
-  DCHECK_LE(buffer->size(), file_offs.value());
+  DCHECK_LE(*cursor, file_offs.value());
 
   size_t inited_data_size = GetBlockInitializedDataSize(block);
 
@@ -466,13 +730,14 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
   }
 
   // Add any necessary padding to get us to the block offset.
-  if (buffer->size() < file_offs.value())
-    buffer->resize(file_offs.value(), padding_byte);
+  if (*cursor < file_offs.value()) {
+    ::memset(buffer + *cursor, padding_byte, file_offs.value() - *cursor);
+    *cursor = file_offs.value();
+  }
 
   // Copy the block data into the buffer.
-  buffer->insert(buffer->end(),
-                 block->data(),
-                 block->data() + block->data_size());
+  ::memcpy(buffer + *cursor, block->data(), block->data_size());
+  *cursor += block->data_size();
 
   // We now want to append zeros for the implicit portion of the block data.
   size_t trailing_zeros = block->size() - block->data_size();
@@ -491,7 +756,8 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     }
 
     // Write the implicit trailing zeros.
-    buffer->insert(buffer->end(), trailing_zeros, 0);
+    ::memset(buffer + *cursor, 0, trailing_zeros);
+    *cursor += trailing_zeros;
   }
 
   // Patch up all the references.
@@ -563,18 +829,24 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     BlockGraph::Offset ref_offset = file_offs.value() + start;
     switch (ref.size()) {
       case sizeof(uint8):
-        if (!UpdateReference(ref_offset, static_cast<uint8>(value), buffer))
+        if (!UpdateReference(ref_offset, static_cast<uint8>(value), buffer,
+                             buffer_size)) {
           return false;
+        }
         break;
 
       case sizeof(uint16):
-        if (!UpdateReference(ref_offset, static_cast<uint16>(value), buffer))
+        if (!UpdateReference(ref_offset, static_cast<uint16>(value), buffer,
+                             buffer_size)) {
           return false;
+        }
         break;
 
       case sizeof(uint32):
-        if (!UpdateReference(ref_offset, static_cast<uint32>(value), buffer))
+        if (!UpdateReference(ref_offset, static_cast<uint32>(value), buffer,
+                             buffer_size)) {
           return false;
+        }
         break;
 
       default:
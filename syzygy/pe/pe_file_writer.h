@@ -36,12 +36,48 @@ class PEFileWriter {
   // @param image_layout the image layout to write.
   explicit PEFileWriter(const ImageLayout& image_layout);
 
+  // @name Accessors and mutators.
+  // @{
+  // Controls incremental writing. When enabled and the output path already
+  // contains an image with the same section layout (typically the product of
+  // a previous relink of the same input), only the headers and the sections
+  // whose contents have changed are rewritten in place. When the previous
+  // output can't be reused a full image is written, as usual. Defaults to
+  // false.
+  bool incremental() const { return incremental_; }
+  void set_incremental(bool incremental) { incremental_ = incremental; }
+
+  // Controls mapped output. When enabled the image is assembled directly in
+  // a memory mapping of the output file rather than in an in-memory buffer
+  // that is then written out in one go. Blocks whose data is deferred to a
+  // mapped source image (see Block::SetDeferredData) are then copied mapping
+  // to mapping, without being staged through an intermediate user-space
+  // buffer; since most bytes of a relinked image are verbatim source bytes
+  // this saves a copy of nearly the whole image. Ignored when incremental()
+  // is set, as incremental writing needs the assembled image in memory to
+  // diff against the previous output. Defaults to false.
+  bool mapped_output() const { return mapped_output_; }
+  void set_mapped_output(bool mapped_output) { mapped_output_ = mapped_output; }
+  // @}
+
   // Writes the image to path.
   bool WriteImage(const base::FilePath& path);
 
   // Updates the checksum for the image @p path.
   static bool UpdateFileChecksum(const base::FilePath& path);
 
+  // Computes the PE checksum of the in-memory image in @p buffer, treating
+  // the checksum field of the optional header as zero, as is done when
+  // computing the value to store there. The ones-complement sum at the
+  // heart of the PE checksum composes across chunks, so large images are
+  // summed on one worker thread per processor. This produces the same value
+  // as imagehlp's CheckSumMappedFile, without a separate pass over the
+  // written file.
+  // @param buffer the image, as laid out on disk.
+  // @param buffer_size the size of the image, in bytes.
+  // @returns the PE checksum of the image.
+  static uint32 ComputeImageChecksum(const uint8* buffer, size_t buffer_size);
+
  protected:
   // Validates the DOS header and the NT headers in the image.
   // On success, sets the nt_headers_ pointer.
@@ -51,22 +87,41 @@ class PEFileWriter {
   // section_file_range_map_ and section_index_space_.
   bool CalculateSectionRanges();
 
-  // Writes the entire image to the given file. Delegates to FlushSection and
-  // WriteOneBlock.
-  bool WriteBlocks(FILE* file);
-
-  // Closes off the writing of a section by adding any necessary padding to the
-  // output buffer.
+  // Assembles the entire image in the given buffer, which must be
+  // @p buffer_size bytes long, the size of the image on disk. Delegates to
+  // FlushSection and WriteOneBlock.
+  bool WriteBlocks(uint8* buffer, size_t buffer_size);
+
+  // Creates the output file at @p path, sized to @p image_size bytes, and
+  // assembles the image directly in a writable mapping of it via
+  // WriteBlocks.
+  bool WriteImageToMapping(const base::FilePath& path, size_t image_size);
+
+  // Patches the previously written image at @p path in place, rewriting only
+  // the headers and the sections whose contents differ from @p buffer. Fails
+  // (without logging an error) if there is no previous image at @p path, or
+  // if its sections are not laid out identically; the caller is expected to
+  // fall back to a full write.
+  bool PatchImage(const base::FilePath& path,
+                  const std::vector<uint8>& buffer);
+
+  // Closes off the writing of a section by adding any necessary padding to
+  // the output buffer, advancing @p cursor to the end of the section's data
+  // on disk.
   void FlushSection(size_t section_index,
-                    std::vector<uint8>* buffer);
+                    uint8* buffer,
+                    size_t* cursor);
 
   // Writes a single block to the buffer, first writing any necessary padding
   // (the content of which depends on the section type), followed by the
-  // block data (containing finalized references).
+  // block data (containing finalized references). Advances @p cursor past
+  // the written bytes.
   bool WriteOneBlock(AbsoluteAddress image_base,
                      size_t section_index,
                      const BlockGraph::Block* block,
-                     std::vector<uint8>* buffer);
+                     uint8* buffer,
+                     size_t buffer_size,
+                     size_t* cursor);
 
   // The file ranges of each section. This is populated by
   // CalculateSectionRanges and is a map from section index (as ordered in
@@ -86,6 +141,14 @@ class PEFileWriter {
   // Our image layout as provided to the constructor.
   const ImageLayout& image_layout_;
 
+  // If true the writer will patch a compatible previous output in place
+  // rather than rewriting the whole image. Defaults to false.
+  bool incremental_;
+
+  // If true the writer will assemble the image directly in a memory mapping
+  // of the output file. Defaults to false.
+  bool mapped_output_;
+
   // Refers to the nt headers from the image during WriteImage.
   const IMAGE_NT_HEADERS* nt_headers_;
 
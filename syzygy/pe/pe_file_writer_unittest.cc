@@ -14,6 +14,9 @@
 
 #include "syzygy/pe/pe_file_writer.h"
 
+#include <windows.h>
+#include <imagehlp.h>  // NOLINT
+
 #include "base/file_util.h"
 #include "base/path_service.h"
 #include "gmock/gmock.h"
@@ -66,6 +69,155 @@ TEST_F(PEFileWriterTest, RewriteAndLoadImage) {
   ASSERT_NO_FATAL_FAILURE(CheckTestDll(temp_file));
 }
 
+TEST_F(PEFileWriterTest, MappedRewriteAndLoadImage) {
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+  base::FilePath mapped_file = temp_dir.Append(testing::kTestDllName);
+  base::FilePath buffered_file = temp_dir.Append(L"buffered.dll");
+
+  // Decompose the original test image.
+  PEFile image_file;
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  Decomposer decomposer(image_file);
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  // Write the image via a mapping of the output file.
+  {
+    PEFileWriter writer(image_layout);
+    writer.set_mapped_output(true);
+    ASSERT_TRUE(writer.WriteImage(mapped_file));
+  }
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(mapped_file));
+
+  // The mapped output must be byte for byte identical to a buffered write.
+  {
+    PEFileWriter writer(image_layout);
+    ASSERT_TRUE(writer.WriteImage(buffered_file));
+  }
+  EXPECT_TRUE(base::ContentsEqual(mapped_file, buffered_file));
+}
+
+TEST_F(PEFileWriterTest, IncrementalRewriteAndLoadImage) {
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+  base::FilePath incremental_file = temp_dir.Append(testing::kTestDllName);
+  base::FilePath full_file = temp_dir.Append(L"full.dll");
+
+  // Decompose the original test image.
+  PEFile image_file;
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  Decomposer decomposer(image_file);
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  // An incremental write with no previous output falls back to a full write.
+  {
+    PEFileWriter writer(image_layout);
+    writer.set_incremental(true);
+    ASSERT_TRUE(writer.WriteImage(incremental_file));
+  }
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(incremental_file));
+
+  // An incremental write over an identical previous output patches nothing
+  // and leaves a loadable image behind.
+  {
+    PEFileWriter writer(image_layout);
+    writer.set_incremental(true);
+    ASSERT_TRUE(writer.WriteImage(incremental_file));
+  }
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(incremental_file));
+
+  // Modify the contents of a block that carries no references, taking care
+  // not to change the layout of the image.
+  BlockGraph::Block* target_block = NULL;
+  BlockGraph::BlockMap::iterator block_it =
+      block_graph.blocks_mutable().begin();
+  for (; block_it != block_graph.blocks_mutable().end(); ++block_it) {
+    BlockGraph::Block* block = &block_it->second;
+    if (block->section() != BlockGraph::kInvalidSectionId &&
+        block->data_size() > 0 && block->references().empty()) {
+      target_block = block;
+      break;
+    }
+  }
+  ASSERT_TRUE(target_block != NULL);
+  target_block->GetMutableData()[0] ^= 0xFF;
+
+  // Patching the previous output in place must produce the same bytes as a
+  // full write of the modified image.
+  {
+    PEFileWriter writer(image_layout);
+    writer.set_incremental(true);
+    ASSERT_TRUE(writer.WriteImage(incremental_file));
+  }
+  {
+    PEFileWriter writer(image_layout);
+    ASSERT_TRUE(writer.WriteImage(full_file));
+  }
+
+  std::string incremental_contents;
+  std::string full_contents;
+  ASSERT_TRUE(base::ReadFileToString(incremental_file,
+                                     &incremental_contents));
+  ASSERT_TRUE(base::ReadFileToString(full_file, &full_contents));
+  EXPECT_EQ(full_contents, incremental_contents);
+}
+
+TEST_F(PEFileWriterTest, ComputeImageChecksumMatchesImageHlp) {
+  // Read the test DLL into memory.
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  std::string image;
+  ASSERT_TRUE(base::ReadFileToString(image_path, &image));
+
+  uint32 checksum = PEFileWriter::ComputeImageChecksum(
+      reinterpret_cast<const uint8*>(image.data()), image.size());
+
+  // The in-process checksum must agree with the imagehlp implementation.
+  DWORD original_checksum = 0;
+  DWORD expected_checksum = 0;
+  ASSERT_TRUE(::CheckSumMappedFile(const_cast<char*>(image.data()),
+                                   image.size(),
+                                   &original_checksum,
+                                   &expected_checksum) != NULL);
+  EXPECT_EQ(expected_checksum, checksum);
+}
+
+TEST_F(PEFileWriterTest, WriteImageStampsValidChecksum) {
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+  base::FilePath temp_file = temp_dir.Append(testing::kTestDllName);
+
+  PEFile image_file;
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  Decomposer decomposer(image_file);
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  PEFileWriter writer(image_layout);
+  ASSERT_TRUE(writer.WriteImage(temp_file));
+
+  // The written image must carry the checksum of its own contents.
+  std::string image;
+  ASSERT_TRUE(base::ReadFileToString(temp_file, &image));
+  DWORD original_checksum = 0;
+  DWORD expected_checksum = 0;
+  ASSERT_TRUE(::CheckSumMappedFile(const_cast<char*>(image.data()),
+                                   image.size(),
+                                   &original_checksum,
+                                   &expected_checksum) != NULL);
+  EXPECT_EQ(expected_checksum, original_checksum);
+}
+
 TEST_F(PEFileWriterTest, UpdateFileChecksum) {
   base::FilePath temp_dir;
   ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
@@ -238,16 +238,9 @@ bool PEImageLayoutBuilder::LayoutOrderedBlockGraph(
     if (!OpenSection(*section))
       return false;
 
-    // Iterate over the blocks.
-    OrderedBlockGraph::BlockList::const_iterator block_it =
-        (*section_it)->ordered_blocks().begin();
-    OrderedBlockGraph::BlockList::const_iterator block_end =
-        (*section_it)->ordered_blocks().end();
-    for (; block_it != block_end; ++block_it) {
-      BlockGraph::Block* block = *block_it;
-      if (!LayoutBlock(block))
-        return false;
-    }
+    // Lay out the section's blocks in bulk.
+    if (!LayoutBlocks((*section_it)->ordered_blocks()))
+      return false;
 
     if (!CloseSection())
       return false;
@@ -14,7 +14,15 @@
 
 #include "syzygy/pe/pe_relinker.h"
 
+#include <windows.h>  // NOLINT
+#include <psapi.h>
+
+#include "base/bind.h"
+#include "base/callback.h"
 #include "base/file_util.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/common/phase_profiler.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -89,8 +97,10 @@ bool Decompose(const PEFile& pe_file,
 
 // Writes the image.
 bool WriteImage(const ImageLayout& image_layout,
-                const base::FilePath& output_path) {
+                const base::FilePath& output_path,
+                bool incremental) {
   PEFileWriter writer(image_layout);
+  writer.set_incremental(incremental);
 
   LOG(INFO) << "Writing image: " << output_path.value();
   if (!writer.WriteImage(output_path)) {
@@ -101,17 +111,74 @@ bool WriteImage(const ImageLayout& image_layout,
   return true;
 }
 
+// Asks the OS to trim the process working set if it has grown beyond
+// @p budget_mb megabytes. The pages are not freed; they are made eligible
+// for reclamation so that concurrently scheduled relinks can use the
+// memory. Failures are logged but not fatal, as the budget is advisory.
+void TrimWorkingSetToBudget(size_t budget_mb) {
+  DCHECK_NE(0u, budget_mb);
+
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "GetProcessMemoryInfo failed: " << ::common::LogWe(error)
+                 << ".";
+    return;
+  }
+
+  uint64 budget = static_cast<uint64>(budget_mb) * 1024 * 1024;
+  if (counters.WorkingSetSize <= budget)
+    return;
+
+  LOG(INFO) << "Working set (" << counters.WorkingSetSize
+            << " bytes) exceeds the memory budget (" << budget
+            << " bytes); trimming.";
+  if (!::SetProcessWorkingSetSize(::GetCurrentProcess(),
+                                  static_cast<SIZE_T>(-1),
+                                  static_cast<SIZE_T>(-1))) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "SetProcessWorkingSetSize failed: "
+                 << ::common::LogWe(error) << ".";
+  }
+}
+
+// Runs a callback on a background thread, remembering its return value. Used
+// to overlap the PDB phase of a relink with writing the image.
+class PdbPhaseRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  typedef base::Callback<bool()> PdbPhase;
+
+  explicit PdbPhaseRunner(const PdbPhase& pdb_phase)
+      : pdb_phase_(pdb_phase), succeeded_(false) {
+  }
+
+  virtual void Run() OVERRIDE {
+    succeeded_ = pdb_phase_.Run();
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  PdbPhase pdb_phase_;
+  bool succeeded_;
+};
+
 }  // namespace
 
 PERelinker::PERelinker(const PETransformPolicy* pe_transform_policy)
     : PECoffRelinker(pe_transform_policy),
       pe_transform_policy_(pe_transform_policy),
       add_metadata_(true), augment_pdb_(true),
-      compress_pdb_(false), strip_strings_(false),
-      padding_(0), code_alignment_(1), output_guid_(GUID_NULL) {
+      compress_pdb_(false), pipeline_pdb_(false), incremental_write_(false),
+      strip_strings_(false), padding_(0), code_alignment_(1),
+      memory_budget_mb_(0), output_guid_(GUID_NULL) {
   DCHECK(pe_transform_policy != NULL);
 }
 
+PERelinker::~PERelinker() {
+}
+
 bool PERelinker::AppendPdbMutator(PdbMutatorInterface* pdb_mutator) {
   DCHECK(pdb_mutator != NULL);
   pdb_mutators_.push_back(pdb_mutator);
@@ -153,9 +220,12 @@ bool PERelinker::Init() {
   }
 
   // Decompose the image.
-  if (!Decompose(input_pe_file_, input_pdb_path_, &input_image_layout_,
-                 &headers_block_)) {
-    return false;
+  {
+    ::common::ScopedPhaseTimer phase("Decomposing image");
+    if (!Decompose(input_pe_file_, input_pdb_path_, &input_image_layout_,
+                   &headers_block_)) {
+      return false;
+    }
   }
 
   inited_ = true;
@@ -170,39 +240,116 @@ bool PERelinker::Relink() {
   }
 
   // Apply the user supplied transforms.
-  if (!ApplyUserTransforms())
-    return false;
+  {
+    ::common::ScopedPhaseTimer phase("Applying user transforms");
+    if (!ApplyUserTransforms())
+      return false;
+  }
 
   // Finalize the block-graph. This applies PE and Syzygy specific transforms.
-  if (!FinalizeBlockGraph(input_path_, output_pdb_path_, output_guid_,
-                          add_metadata_, pe_transform_policy_, &block_graph_,
-                          headers_block_)) {
-    return false;
+  {
+    ::common::ScopedPhaseTimer phase("Finalizing block graph");
+    if (!FinalizeBlockGraph(input_path_, output_pdb_path_, output_guid_,
+                            add_metadata_, pe_transform_policy_, &block_graph_,
+                            headers_block_)) {
+      return false;
+    }
   }
 
   // Apply the user supplied orderers.
   OrderedBlockGraph ordered_block_graph(&block_graph_);
-  if (!ApplyUserOrderers(&ordered_block_graph))
-    return false;
+  {
+    ::common::ScopedPhaseTimer phase("Applying user orderers");
+    if (!ApplyUserOrderers(&ordered_block_graph))
+      return false;
+  }
 
   // Finalize the ordered block graph. This applies PE specific orderers.
-  if (!FinalizeOrderedBlockGraph(&ordered_block_graph, headers_block_))
-    return false;
+  {
+    ::common::ScopedPhaseTimer phase("Finalizing ordered block graph");
+    if (!FinalizeOrderedBlockGraph(&ordered_block_graph, headers_block_))
+      return false;
+  }
 
   // Lay it out.
   ImageLayout output_image_layout(&block_graph_);
-  if (!BuildImageLayout(padding_, code_alignment_,
-                        ordered_block_graph, headers_block_,
-                        &output_image_layout)) {
-    return false;
+  {
+    ::common::ScopedPhaseTimer phase("Building image layout");
+    if (!BuildImageLayout(padding_, code_alignment_,
+                          ordered_block_graph, headers_block_,
+                          &output_image_layout)) {
+      return false;
+    }
   }
 
-  // Write the image.
-  if (!WriteImage(output_image_layout, output_path_))
-    return false;
+  // In memory-budgeted mode the address space of the original image layout
+  // is no longer needed by the remaining stages (the OMAP range is computed
+  // from its resident section table), so spill it and trim the working set
+  // before the write phases begin.
+  if (memory_budget_mb_ != 0) {
+    input_layout_spill_.reset(new ImageLayoutSpill());
+    if (!input_layout_spill_->Spill(&input_image_layout_))
+      return false;
+    TrimWorkingSetToBudget(memory_budget_mb_);
+  }
+
+  // Write the image and the PDB. When pipelining is enabled the PDB phase
+  // runs on a background thread, overlapped with writing the image; the two
+  // phases touch disjoint data. Pipelining holds the peak memory of both
+  // phases simultaneously, so it is disabled when running under a memory
+  // budget.
+  bool pipeline_pdb = pipeline_pdb_;
+  if (pipeline_pdb && memory_budget_mb_ != 0) {
+    LOG(INFO) << "Memory-budgeted mode disables PDB pipelining.";
+    pipeline_pdb = false;
+  }
+  if (pipeline_pdb) {
+    // The phase profiler is single threaded, so the overlapped phases are
+    // timed as one from the main thread.
+    ::common::ScopedPhaseTimer phase("Writing image and PDB (pipelined)");
+    PdbPhaseRunner pdb_phase_runner(base::Bind(&PERelinker::RelinkPdb,
+                                               base::Unretained(this),
+                                               base::ConstRef(
+                                                   output_image_layout)));
+    base::DelegateSimpleThread pdb_thread(&pdb_phase_runner, "pdb-phase");
+    pdb_thread.Start();
+    bool image_written = WriteImage(output_image_layout, output_path_,
+                                    incremental_write_);
+    pdb_thread.Join();
+    if (!image_written || !pdb_phase_runner.succeeded())
+      return false;
+  } else {
+    {
+      ::common::ScopedPhaseTimer phase("Writing image");
+      if (!WriteImage(output_image_layout, output_path_, incremental_write_))
+        return false;
+    }
+
+    if (memory_budget_mb_ != 0)
+      TrimWorkingSetToBudget(memory_budget_mb_);
+
+    {
+      ::common::ScopedPhaseTimer phase("Writing PDB");
+      if (!RelinkPdb(output_image_layout))
+        return false;
+    }
+  }
 
-  // From here on down we are processing the PDB file.
+  // Reload the original image layout so that the relinker's accessors remain
+  // valid for the caller. Both output artifacts are on disk by this point,
+  // so the reloaded layout no longer contributes to the peak.
+  if (input_layout_spill_.get() != NULL) {
+    if (!input_layout_spill_->Reload(&input_image_layout_))
+      return false;
+    input_layout_spill_.reset();
+  }
 
+  LOG(INFO) << "PE relinker finished.";
+
+  return true;
+}
+
+bool PERelinker::RelinkPdb(const ImageLayout& output_image_layout) {
   // Read the PDB file.
   LOG(INFO) << "Reading PDB file: " << input_pdb_path_.value();
   pdb::PdbReader pdb_reader;
@@ -234,8 +381,6 @@ bool PERelinker::Relink() {
     return false;
   }
 
-  LOG(INFO) << "PE relinker finished.";
-
   return true;
 }
 
@@ -62,6 +62,7 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "base/memory/scoped_ptr.h"
 #include "syzygy/block_graph/orderer.h"
 #include "syzygy/block_graph/transform.h"
 #include "syzygy/pdb/pdb_mutator.h"
@@ -72,6 +73,9 @@
 
 namespace pe {
 
+// Forward declaration.
+class ImageLayoutSpill;
+
 // Embodies a transformation on a PE image, from decomposing an original image
 // to applying some transform(s) to it, to generating the layout and finally
 // writing the image and accompanying PDB to disk.
@@ -106,6 +110,8 @@ class PERelinker : public PECoffRelinker {
   //     transforms.
   explicit PERelinker(const PETransformPolicy* pe_transform_policy);
 
+  ~PERelinker();
+
   // @see RelinkerInterface::image_format()
   virtual ImageFormat image_format() const OVERRIDE {
     return BlockGraph::PE_IMAGE;
@@ -118,9 +124,12 @@ class PERelinker : public PECoffRelinker {
   bool add_metadata() const { return add_metadata_; }
   bool augment_pdb() const { return augment_pdb_; }
   bool compress_pdb() const { return compress_pdb_; }
+  bool pipeline_pdb() const { return pipeline_pdb_; }
+  bool incremental_write() const { return incremental_write_; }
   bool strip_strings() const { return strip_strings_; }
   size_t padding() const { return padding_; }
   size_t code_alignment() const { return code_alignment_; }
+  size_t memory_budget_mb() const { return memory_budget_mb_; }
   // @}
 
   // @name Mutators for controlling relinker behaviour.
@@ -140,6 +149,12 @@ class PERelinker : public PECoffRelinker {
   void set_compress_pdb(bool compress_pdb) {
     compress_pdb_ = compress_pdb;
   }
+  void set_pipeline_pdb(bool pipeline_pdb) {
+    pipeline_pdb_ = pipeline_pdb;
+  }
+  void set_incremental_write(bool incremental_write) {
+    incremental_write_ = incremental_write;
+  }
   void set_strip_strings(bool strip_strings) {
     strip_strings_ = strip_strings;
   }
@@ -149,6 +164,9 @@ class PERelinker : public PECoffRelinker {
   void set_code_alignment(size_t alignment) {
     code_alignment_ = alignment;
   }
+  void set_memory_budget_mb(size_t memory_budget_mb) {
+    memory_budget_mb_ = memory_budget_mb;
+  }
   // @}
 
   // @see RelinkerInterface::AppendPdbMutator()
@@ -192,6 +210,14 @@ class PERelinker : public PECoffRelinker {
   // @}
 
  protected:
+  // Runs the PDB phase of the relink: reading the input PDB, applying the
+  // mutators, finalizing and writing the output PDB. Called from Relink,
+  // possibly on a background thread when pipeline_pdb is enabled.
+  //
+  // @param output_image_layout The layout of the image being written.
+  // @returns true on success, false otherwise.
+  bool RelinkPdb(const ImageLayout& output_image_layout);
+
   // The transform policy used by this relinker.
   const PETransformPolicy* pe_transform_policy_;
 
@@ -206,6 +232,14 @@ class PERelinker : public PECoffRelinker {
   // If true, then the augmented PDB stream will be compressed as it is written.
   // Defaults to false.
   bool compress_pdb_;
+  // If true, the PDB phase of the relink is run on a background thread,
+  // overlapped with writing the image. The two phases touch disjoint data.
+  // Defaults to false.
+  bool pipeline_pdb_;
+  // If true, and the output image of a previous relink with an identical
+  // section layout exists at the output path, only the sections whose
+  // contents changed are rewritten in place. Defaults to false.
+  bool incremental_write_;
   // If true, strings associated with a block-graph will not be serialized into
   // the PDB. Defaults to false.
   bool strip_strings_;
@@ -214,6 +248,14 @@ class PERelinker : public PECoffRelinker {
   size_t padding_;
   // Minimal code block alignment.
   size_t code_alignment_;
+  // The memory budget of the relink, in megabytes. When non-zero the relink
+  // runs in memory-budgeted mode: artifacts that a completed stage no longer
+  // needs (currently the address space of the original image layout) are
+  // spilled to a temporary file and reloaded on demand, the PDB phase is
+  // never pipelined with the image write, and the working set is trimmed
+  // whenever it exceeds the budget at a stage boundary. Zero (the default)
+  // disables the mode.
+  size_t memory_budget_mb_;
 
   // The vectors of user supplied transforms, orderers and mutators to be
   // applied.
@@ -228,6 +270,11 @@ class PERelinker : public PECoffRelinker {
 
   // These are for the new image that will be produced at the end of Relink.
   GUID output_guid_;
+
+  // The spilled address space of the original image layout, when running in
+  // memory-budgeted mode. Only live during Relink; the layout is reloaded
+  // before Relink returns.
+  scoped_ptr<ImageLayoutSpill> input_layout_spill_;
 };
 
 }  // namespace pe
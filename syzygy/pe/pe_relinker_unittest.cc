@@ -144,6 +144,12 @@ TEST_F(PERelinkerTest, Properties) {
   relinker.set_compress_pdb(false);
   EXPECT_FALSE(relinker.compress_pdb());
 
+  EXPECT_FALSE(relinker.pipeline_pdb());
+  relinker.set_pipeline_pdb(true);
+  EXPECT_TRUE(relinker.pipeline_pdb());
+  relinker.set_pipeline_pdb(false);
+  EXPECT_FALSE(relinker.pipeline_pdb());
+
   EXPECT_FALSE(relinker.strip_strings());
   relinker.set_strip_strings(true);
   EXPECT_TRUE(relinker.strip_strings());
@@ -161,6 +167,12 @@ TEST_F(PERelinkerTest, Properties) {
   EXPECT_EQ(10u, relinker.code_alignment());
   relinker.set_code_alignment(1);
   EXPECT_EQ(1u, relinker.code_alignment());
+
+  EXPECT_EQ(0u, relinker.memory_budget_mb());
+  relinker.set_memory_budget_mb(4096);
+  EXPECT_EQ(4096u, relinker.memory_budget_mb());
+  relinker.set_memory_budget_mb(0);
+  EXPECT_EQ(0u, relinker.memory_budget_mb());
 }
 
 TEST_F(PERelinkerTest, AppendPdbMutators) {
@@ -283,6 +295,59 @@ TEST_F(PERelinkerTest, Success) {
   EXPECT_TRUE(relinker.Relink());
 }
 
+TEST_F(PERelinkerTest, PipelinedRelink) {
+  TestPERelinker relinker(&policy_);
+
+  relinker.set_input_path(input_dll_);
+  relinker.set_output_path(temp_dll_);
+  relinker.set_pipeline_pdb(true);
+
+  EXPECT_TRUE(relinker.Init());
+  EXPECT_TRUE(relinker.Relink());
+
+  EXPECT_TRUE(base::PathExists(relinker.output_path()));
+  EXPECT_TRUE(base::PathExists(relinker.output_pdb_path()));
+
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(relinker.output_path()));
+
+  // The PDB must be findable from the module even though the two were
+  // written concurrently.
+  base::FilePath pdb_path;
+  ASSERT_TRUE(FindPdbForModule(relinker.output_path(), &pdb_path));
+  EXPECT_EQ(pdb_path, relinker.output_pdb_path());
+}
+
+TEST_F(PERelinkerTest, MemoryBudgetedRelink) {
+  TestPERelinker relinker(&policy_);
+
+  relinker.set_input_path(input_dll_);
+  relinker.set_output_path(temp_dll_);
+
+  // A tiny budget guarantees that the working set trimming path runs.
+  relinker.set_memory_budget_mb(1);
+
+  // Pipelining is requested but must be overridden by the budgeted mode.
+  relinker.set_pipeline_pdb(true);
+
+  EXPECT_TRUE(relinker.Init());
+
+  size_t input_blocks = relinker.input_image_layout().blocks.size();
+  EXPECT_LT(0u, input_blocks);
+
+  EXPECT_TRUE(relinker.Relink());
+
+  EXPECT_TRUE(base::PathExists(relinker.output_path()));
+  EXPECT_TRUE(base::PathExists(relinker.output_pdb_path()));
+
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(relinker.output_path()));
+
+  // The input image layout must have been reloaded from its spill before
+  // Relink returned. Blocks removed from the block-graph by the pipeline
+  // are dropped from the reloaded layout, hence the upper bound.
+  EXPECT_LT(0u, relinker.input_image_layout().blocks.size());
+  EXPECT_GE(input_blocks, relinker.input_image_layout().blocks.size());
+}
+
 TEST_F(PERelinkerTest, IdentityRelink) {
   TestPERelinker relinker(&policy_);
 
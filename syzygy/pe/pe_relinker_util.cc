@@ -14,6 +14,10 @@
 
 #include "syzygy/pe/pe_relinker_util.h"
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
 #include "base/file_util.h"
 #include "syzygy/block_graph/transform.h"
 #include "syzygy/core/file_util.h"
@@ -496,6 +500,116 @@ void GetOmapRange(const std::vector<ImageLayout::SectionInfo>& sections,
   *range = RelativeAddressRange(start_of_image, end_of_image - start_of_image);
 }
 
+ImageLayoutSpill::ImageLayoutSpill() : spilled_(false) {
+}
+
+ImageLayoutSpill::~ImageLayoutSpill() {
+  if (!temp_path_.empty())
+    base::DeleteFile(temp_path_, false);
+}
+
+bool ImageLayoutSpill::Spill(ImageLayout* image_layout) {
+  DCHECK(image_layout != NULL);
+  DCHECK(!spilled_);
+
+  if (temp_path_.empty() && !base::CreateTemporaryFile(&temp_path_)) {
+    LOG(ERROR) << "Failed to create image layout spill file.";
+    return false;
+  }
+
+  // Gather the blocks and their addresses, sorted by address so that the
+  // reload can rebuild the address space with a single linear insertion.
+  // The map of block addresses is used rather than address-space iteration
+  // as the latter does not visit zero-sized blocks.
+  std::vector<std::pair<RelativeAddress, const BlockGraph::Block*>> blocks;
+  blocks.reserve(image_layout->blocks.size());
+  BlockGraph::AddressSpace::BlockAddressMap::const_iterator block_it =
+      image_layout->blocks.block_addresses().begin();
+  for (; block_it != image_layout->blocks.block_addresses().end(); ++block_it)
+    blocks.push_back(std::make_pair(block_it->second, block_it->first));
+  std::sort(blocks.begin(), blocks.end());
+
+  {
+    base::ScopedFILE file(base::OpenFile(temp_path_, "wb"));
+    if (file.get() == NULL) {
+      LOG(ERROR) << "Failed to open image layout spill file: "
+                 << temp_path_.value();
+      return false;
+    }
+
+    core::FileOutStream out_stream(file.get());
+    core::NativeBinaryOutArchive out_archive(&out_stream);
+    if (!out_archive.Save(blocks.size())) {
+      LOG(ERROR) << "Failed to write image layout spill file.";
+      return false;
+    }
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      if (!out_archive.Save(blocks[i].first) ||
+          !out_archive.Save(blocks[i].second->id())) {
+        LOG(ERROR) << "Failed to write image layout spill file.";
+        return false;
+      }
+    }
+    if (!out_archive.Flush())
+      return false;
+  }
+
+  image_layout->blocks.Clear();
+  spilled_ = true;
+
+  return true;
+}
+
+bool ImageLayoutSpill::Reload(ImageLayout* image_layout) {
+  DCHECK(image_layout != NULL);
+  DCHECK(spilled_);
+
+  base::ScopedFILE file(base::OpenFile(temp_path_, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open image layout spill file: "
+               << temp_path_.value();
+    return false;
+  }
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+
+  size_t num_blocks = 0;
+  if (!in_archive.Load(&num_blocks)) {
+    LOG(ERROR) << "Failed to read image layout spill file.";
+    return false;
+  }
+
+  BlockGraph* block_graph = image_layout->blocks.graph();
+  std::vector<std::pair<RelativeAddress, BlockGraph::Block*>> blocks;
+  blocks.reserve(num_blocks);
+  for (size_t i = 0; i < num_blocks; ++i) {
+    RelativeAddress addr;
+    BlockGraph::BlockId id = 0;
+    if (!in_archive.Load(&addr) || !in_archive.Load(&id)) {
+      LOG(ERROR) << "Failed to read image layout spill file.";
+      return false;
+    }
+
+    // Blocks that have been removed from the block-graph since the spill
+    // are dropped from the reloaded layout.
+    BlockGraph::Block* block = block_graph->GetBlockById(id);
+    if (block == NULL)
+      continue;
+
+    blocks.push_back(std::make_pair(addr, block));
+  }
+
+  if (!image_layout->blocks.InsertBlocks(blocks)) {
+    LOG(ERROR) << "Failed to rebuild the spilled image layout.";
+    return false;
+  }
+
+  spilled_ = false;
+
+  return true;
+}
+
 bool FinalizePdbFile(const base::FilePath input_module,
                      const base::FilePath output_module,
                      const RelativeAddressRange input_range,
@@ -102,6 +102,46 @@ bool BuildImageLayout(size_t padding,
 void GetOmapRange(const std::vector<ImageLayout::SectionInfo>& sections,
                   RelativeAddressRange* range);
 
+// Spills the address space of an image layout to a temporary file so that
+// the memory it holds can be released once a relink stage has committed and
+// no longer needs it, reloading it on demand. The blocks themselves remain
+// owned by the block-graph and are not touched; only the block-to-address
+// mapping, which dominates the layout's memory footprint, is spilled. The
+// section table is small and stays resident. This is used by the relinker's
+// memory-budgeted execution mode.
+class ImageLayoutSpill {
+ public:
+  ImageLayoutSpill();
+
+  // Deletes the temporary spill file, if any.
+  ~ImageLayoutSpill();
+
+  // Serializes the address space of @p image_layout to a temporary file and
+  // empties it.
+  // @param image_layout The layout to be spilled.
+  // @returns true on success, false otherwise.
+  bool Spill(ImageLayout* image_layout);
+
+  // Reloads a previously spilled address space into @p image_layout, which
+  // must be backed by the same block-graph that was spilled. Blocks that
+  // have since been removed from the block-graph are silently dropped from
+  // the reloaded layout.
+  // @param image_layout The layout to be repopulated.
+  // @returns true on success, false otherwise.
+  bool Reload(ImageLayout* image_layout);
+
+  // @returns true if a layout is currently spilled to disk.
+  bool spilled() const { return spilled_; }
+
+ private:
+  // The temporary file holding the spilled address space.
+  base::FilePath temp_path_;
+  // True between a successful Spill and the Reload that consumes it.
+  bool spilled_;
+
+  DISALLOW_COPY_AND_ASSIGN(ImageLayoutSpill);
+};
+
 // Given a transformed PDB file, finalizes it in preparation for writing. This
 // performs the following tasks:
 // - Sets the new GUID and clears the age count of the PDB to 1.
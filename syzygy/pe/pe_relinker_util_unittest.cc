@@ -321,4 +321,39 @@ TEST_F(PERelinkerUtilTest, GetOmapRangeAndFinalizePdb) {
   EXPECT_EQ(guid, pdb_header.signature);
 }
 
+TEST_F(PERelinkerUtilTest, ImageLayoutSpillRoundTrip) {
+  BlockGraph block_graph;
+  ImageLayout layout(&block_graph);
+
+  BlockGraph::Block* block1 = layout.blocks.AddBlock(
+      BlockGraph::CODE_BLOCK, core::RelativeAddress(0x1000), 0x10, "code1");
+  BlockGraph::Block* block2 = layout.blocks.AddBlock(
+      BlockGraph::DATA_BLOCK, core::RelativeAddress(0x2000), 0x20, "data");
+  BlockGraph::Block* block3 = layout.blocks.AddBlock(
+      BlockGraph::CODE_BLOCK, core::RelativeAddress(0x3000), 0x10, "code2");
+  ASSERT_TRUE(block1 != NULL);
+  ASSERT_TRUE(block2 != NULL);
+  ASSERT_TRUE(block3 != NULL);
+
+  ImageLayoutSpill spill;
+  EXPECT_FALSE(spill.spilled());
+  ASSERT_TRUE(spill.Spill(&layout));
+  EXPECT_TRUE(spill.spilled());
+  EXPECT_EQ(0u, layout.blocks.size());
+
+  // Remove a block from the block-graph while the layout is spilled; it
+  // must be dropped from the reloaded layout.
+  ASSERT_TRUE(block_graph.RemoveBlock(block2));
+
+  ASSERT_TRUE(spill.Reload(&layout));
+  EXPECT_FALSE(spill.spilled());
+  EXPECT_EQ(2u, layout.blocks.size());
+  EXPECT_EQ(block1,
+            layout.blocks.GetBlockByAddress(core::RelativeAddress(0x1000)));
+  EXPECT_EQ(NULL,
+            layout.blocks.GetBlockByAddress(core::RelativeAddress(0x2000)));
+  EXPECT_EQ(block3,
+            layout.blocks.GetBlockByAddress(core::RelativeAddress(0x3000)));
+}
+
 }  // namespace pe
@@ -133,8 +133,7 @@ bool IsValidExternalReferenceDataBlockToCode(
 }  // namespace
 
 PETransformPolicy::PETransformPolicy()
-    : block_result_cache_(new BlockResultCache()),
-      allow_inline_assembly_(false) {
+    : allow_inline_assembly_(false) {
 }
 
 bool PETransformPolicy::BlockIsSafeToBasicBlockDecompose(
@@ -144,15 +143,20 @@ bool PETransformPolicy::BlockIsSafeToBasicBlockDecompose(
   if (block->type() != BlockGraph::CODE_BLOCK)
     return false;
 
-  // Look for a cached result. This prevents repeated (expensive) calculations
-  // and inspections over the block.
-  BlockResultCache::const_iterator it = block_result_cache_->find(
-      block->id());
-  if (it != block_result_cache_->end())
-    return it->second;
+  // Look for a cached result. This prevents repeated (expensive)
+  // calculations and inspections over the block. The cache lives on the
+  // block-graph so that it is shared by every pipeline stage operating on
+  // the graph, and it drops a block's entry whenever the block is mutated.
+  block_graph::PolicyDecisionCache& cache =
+      block->block_graph()->policy_decision_cache();
+  cache.SetConfiguration(allow_inline_assembly_ ? 1 : 0);
 
-  bool result = CodeBlockIsSafeToBasicBlockDecompose(block);
-  block_result_cache_->insert(std::make_pair(block->id(), result));
+  bool result = false;
+  if (cache.Lookup(block->id(), &result))
+    return result;
+
+  result = CodeBlockIsSafeToBasicBlockDecompose(block);
+  cache.Store(block->id(), result);
   return result;
 }
 
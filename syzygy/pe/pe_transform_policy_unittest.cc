@@ -27,9 +27,6 @@ using block_graph::BlockGraph;
 
 class TestPETransformPolicy : public PETransformPolicy {
  public:
-  typedef PETransformPolicy::BlockResultCache BlockResultCache;
-
-  using PETransformPolicy::block_result_cache_;
   using PETransformPolicy::allow_inline_assembly_;
 };
 
@@ -525,26 +522,26 @@ TEST_F(PETransformPolicyTest, DataBlockIsNotSafeToBasicBlockDecompose) {
 
 TEST_F(PETransformPolicyTest, CodeBlockIsSafeToBasicBlockDecomposeCache) {
   TestPETransformPolicy policy;
-  EXPECT_EQ(0u, policy.block_result_cache_->size());
 
   BlockGraph::Block* code = image_.AddBlock(BlockGraph::CODE_BLOCK, 2, "c");
   code->SetLabel(0, "code", BlockGraph::CODE_LABEL);
   ASSERT_TRUE(policy.BlockIsSafeToBasicBlockDecompose(code));
-  EXPECT_EQ(1u, policy.block_result_cache_->size());
 
-  TestPETransformPolicy::BlockResultCache::const_iterator it =
-      policy.block_result_cache_->find(code->id());
-  ASSERT_NE(policy.block_result_cache_->end(), it);
-  EXPECT_EQ(code->id(), it->first);
-  EXPECT_TRUE(it->second);
+  // The decision is cached on the block-graph, where any policy instance
+  // (and thus any pipeline stage) can see it.
+  bool decision = false;
+  ASSERT_TRUE(image_.policy_decision_cache().Lookup(code->id(), &decision));
+  EXPECT_TRUE(decision);
+  TestPETransformPolicy second_policy;
+  ASSERT_TRUE(second_policy.BlockIsSafeToBasicBlockDecompose(code));
 
-  // Add an unreferenced data label. This should make the analysis fail.
-  // However, it should be looked up in the cache and return true.
+  // Add an unreferenced data label. This mutation drops the cached decision
+  // and the analysis is re-run, and now fails.
   ASSERT_TRUE(code->SetLabel(1, BlockGraph::Label(
       "data", BlockGraph::DATA_LABEL)));
+  ASSERT_FALSE(image_.policy_decision_cache().Lookup(code->id(), &decision));
   ASSERT_FALSE(policy.CodeBlockIsSafeToBasicBlockDecompose(code));
-  ASSERT_TRUE(policy.BlockIsSafeToBasicBlockDecompose(code));
-  EXPECT_EQ(1u, policy.block_result_cache_->size());
+  ASSERT_FALSE(policy.BlockIsSafeToBasicBlockDecompose(code));
 }
 
 TEST_F(PETransformPolicyTest, ReferenceIsSafeToRedirect) {
@@ -56,6 +56,14 @@ bool AddMetadataTransform::TransformBlockGraph(
     return false;
   }
 
+  // Stamp the metadata with a content hash of the pre-transform image and the
+  // transform configuration, so that downstream caches can key on the stamp
+  // rather than rehashing the image themselves.
+  if (!metadata.InitContentHash(module_path_)) {
+    LOG(ERROR) << "Unable to compute metadata content hash.";
+    return false;
+  }
+
   const BlockGraph::Section* section = NULL;
   BlockGraph::Block* block = NULL;
 
@@ -80,6 +80,7 @@ TEST_F(AddMetadataTransformTest, SucceedsWhenNoMetadata) {
   Metadata metadata;
   EXPECT_TRUE(metadata.LoadFromBlock(transform.metadata_block()));
   EXPECT_EQ(module_path_.value(), metadata.module_signature().path);
+  EXPECT_FALSE(metadata.content_hash().empty());
 }
 
 TEST_F(AddMetadataTransformTest, ReplaceSucceeds) {
@@ -17,6 +17,7 @@
 
 #include "syzygy/pe/transforms/explode_basic_blocks_transform.h"
 
+#include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_builder.h"
 
@@ -25,6 +26,7 @@ namespace transforms {
 namespace {
 
 using block_graph::BasicBlock;
+using block_graph::BasicBlockDecomposer;
 using block_graph::BlockBuilder;
 using block_graph::BlockGraph;
 using block_graph::BasicBlockSubGraph;
@@ -116,6 +118,7 @@ const char ExplodeBasicBlocksTransform::kTransformName[] =
 
 ExplodeBasicBlocksTransform::ExplodeBasicBlocksTransform()
     : exclude_padding_(false),
+      batch_size_(kDefaultBatchSize),
       non_decomposable_code_blocks_(0),
       skipped_code_blocks_(0),
       input_code_blocks_(0),
@@ -152,24 +155,24 @@ bool ExplodeBasicBlocksTransform::OnBlock(
     return true;
   }
 
-  ExplodeBasicBlockSubGraphTransform transform(exclude_padding_);
-
-  if (!ApplyBasicBlockSubGraphTransform(
-          &transform, policy, block_graph, block, NULL)) {
+  // Accumulate the block for a batched rebuild. The block is left intact
+  // until the batch is flushed, which happens once it has been visited, so
+  // deferring its rebuild doesn't disturb the iteration.
+  batch_.push_back(block);
+  if (batch_.size() >= batch_size_ && !FlushBatch(policy, block_graph))
     return false;
-  }
-
-  ++input_code_blocks_;
-  output_code_blocks_ += transform.output_code_blocks();
-  output_data_blocks_ += transform.output_data_blocks();
 
   return true;
 }
 
 bool ExplodeBasicBlocksTransform::PostBlockGraphIteration(
-    const TransformPolicyInterface* unused_policy,
-    BlockGraph* unused_block_graph,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
     BlockGraph::Block* unused_header_block) {
+  // Rebuild any blocks left over in a partial batch.
+  if (!FlushBatch(policy, block_graph))
+    return false;
+
   LOG(INFO) << "Exploded " << input_code_blocks_ << " input code blocks to";
   LOG(INFO) << "  Code blocks: " << output_code_blocks_;
   LOG(INFO) << "  Data blocks: " << output_data_blocks_;
@@ -183,5 +186,39 @@ bool ExplodeBasicBlocksTransform::SkipThisBlock(const Block* candidate) {
   return false;
 }
 
+bool ExplodeBasicBlocksTransform::FlushBatch(
+    const TransformPolicyInterface* policy, BlockGraph* block_graph) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+
+  // All of the batched blocks are rebuilt through a single BlockBuilder,
+  // amortizing its bookkeeping across the batch. Each block is decomposed
+  // immediately before its merge so that its references reflect any blocks
+  // already rebuilt earlier in the batch.
+  BlockBuilder builder(block_graph);
+  for (size_t i = 0; i < batch_.size(); ++i) {
+    Block* block = batch_[i];
+
+    BasicBlockSubGraph subgraph;
+    BasicBlockDecomposer bb_decomposer(block, &subgraph);
+    if (!bb_decomposer.Decompose())
+      return false;
+
+    ExplodeBasicBlockSubGraphTransform transform(exclude_padding_);
+    if (!transform.TransformBasicBlockSubGraph(policy, block_graph, &subgraph))
+      return false;
+
+    if (!builder.Merge(&subgraph))
+      return false;
+
+    ++input_code_blocks_;
+    output_code_blocks_ += transform.output_code_blocks();
+    output_data_blocks_ += transform.output_data_blocks();
+  }
+  batch_.clear();
+
+  return true;
+}
+
 }  // namespace transforms
 }  // namespace pe
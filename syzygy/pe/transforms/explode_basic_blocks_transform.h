@@ -21,6 +21,8 @@
 #ifndef SYZYGY_PE_TRANSFORMS_EXPLODE_BASIC_BLOCKS_TRANSFORM_H_
 #define SYZYGY_PE_TRANSFORMS_EXPLODE_BASIC_BLOCKS_TRANSFORM_H_
 
+#include <vector>
+
 #include "syzygy/block_graph/transforms/iterative_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
 
@@ -78,11 +80,15 @@ class ExplodeBasicBlocksTransform
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
 
+  // The default number of blocks that are exploded and rebuilt as a batch.
+  static const size_t kDefaultBatchSize = 100;
+
   // Initialize a new ExplodeBasicBlocksTransform instance.
   ExplodeBasicBlocksTransform();
 
   // Explodes each basic code block in @p block referenced by into separate
-  // blocks, then erases @p block from @p block_graph.
+  // blocks, then erases @p block from @p block_graph. Eligible blocks are
+  // accumulated and rebuilt a batch at a time; see set_batch_size.
   // @param policy The policy object restricting how the transform is applied.
   // @param block_graph The block graph being modified.
   // @param block The block to explode, this must be in @p block_graph.
@@ -91,7 +97,8 @@ class ExplodeBasicBlocksTransform
                BlockGraph* block_graph,
                BlockGraph::Block* block);
 
-  // Logs metrics about the performed transform.
+  // Rebuilds any blocks left in the batch and logs metrics about the
+  // performed transform.
   // @param policy The policy object restricting how the transform is applied.
   // @param block_graph The block graph being modified.
   // @param header_block The header block associated with the image.
@@ -103,6 +110,15 @@ class ExplodeBasicBlocksTransform
   // @{
   bool exclude_padding() const { return exclude_padding_; }
   void set_exclude_padding(bool value) { exclude_padding_ = value; }
+  size_t batch_size() const { return batch_size_; }
+  // Sets the number of blocks that are exploded and rebuilt as a batch,
+  // sharing a single BlockBuilder. A value of 1 rebuilds each block
+  // individually.
+  // @param value the batch size to use. Must be at least 1.
+  void set_batch_size(size_t value) {
+    DCHECK_LE(1u, value);
+    batch_size_ = value;
+  }
   // @}
 
   // The transform name.
@@ -112,10 +128,26 @@ class ExplodeBasicBlocksTransform
   // Hooks for unit-testing.
   virtual bool SkipThisBlock(const BlockGraph::Block* candidate);
 
+  // Explodes and rebuilds the accumulated batch of blocks through a single
+  // BlockBuilder. The batched blocks have already been visited by the
+  // iteration, so erasing them here does not disturb it.
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block_graph The block graph being modified.
+  // @returns true on success, false otherwise.
+  bool FlushBatch(const TransformPolicyInterface* policy,
+                  BlockGraph* block_graph);
+
   // A flag for whether padding (and dead code) basic-blocks should be excluded
   // when reconstituting the exploded blocks.
   bool exclude_padding_;
 
+  // The number of blocks that are exploded and rebuilt as a batch.
+  size_t batch_size_;
+
+  // The eligible blocks accumulated so far, awaiting a batched rebuild. The
+  // blocks remain intact in the block graph until the batch is flushed.
+  std::vector<BlockGraph::Block*> batch_;
+
   // Statistics on blocks encountered and generated.
   size_t non_decomposable_code_blocks_;
   size_t skipped_code_blocks_;
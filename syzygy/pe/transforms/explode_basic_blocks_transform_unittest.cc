@@ -97,5 +97,12 @@ TEST_F(ExplodeBasicBlocksTransformTest, RandomizeAllBasicBlocksNoPadding) {
   PerformRandomizationTest(&transform);
 }
 
+TEST_F(ExplodeBasicBlocksTransformTest, RandomizeAllBasicBlocksUnbatched) {
+  ExplodeBasicBlocksTransform transform;
+  transform.set_batch_size(1);
+  EXPECT_EQ(1u, transform.batch_size());
+  PerformRandomizationTest(&transform);
+}
+
 }  // namespace transforms
 }  // namespace pe
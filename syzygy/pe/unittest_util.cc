@@ -16,6 +16,8 @@
 
 #include <imagehlp.h>
 #include <functional>
+#include <string>
+#include <vector>
 
 #include "base/command_line.h"
 #include "base/file_util.h"
@@ -37,6 +39,7 @@
 #include "syzygy/pe/coff_image_layout_builder.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/pe_data.h"
+#include "syzygy/pe/pe_utils.h"
 
 namespace testing {
 
@@ -307,6 +310,108 @@ void TwiddlePdbGuidAndPath(BlockGraph::Block* dos_header_block) {
   }
 }
 
+BlockGraph::Block* GenerateSyntheticImage(const SyntheticImageParams& params,
+                                          BlockGraph* block_graph) {
+  DCHECK(block_graph != NULL);
+  DCHECK(block_graph->sections().empty());
+  DCHECK(block_graph->blocks().empty());
+  DCHECK_LT(0u, params.num_code_sections + params.num_data_sections);
+  DCHECK_LT(0u, params.num_blocks);
+  DCHECK_LE(4 * params.references_per_block, params.block_size);
+
+  block_graph->set_image_format(BlockGraph::PE_IMAGE);
+
+  // Create the sections, code sections first.
+  std::vector<BlockGraph::SectionId> section_ids;
+  for (size_t i = 0; i < params.num_code_sections; ++i) {
+    std::string name = base::StringPrintf(".text%u", static_cast<unsigned>(i));
+    BlockGraph::Section* section =
+        block_graph->AddSection(name, pe::kCodeCharacteristics);
+    DCHECK(section != NULL);
+    section_ids.push_back(section->id());
+  }
+  for (size_t i = 0; i < params.num_data_sections; ++i) {
+    std::string name = base::StringPrintf(".data%u", static_cast<unsigned>(i));
+    BlockGraph::Section* section =
+        block_graph->AddSection(name, pe::kReadWriteDataCharacteristics);
+    DCHECK(section != NULL);
+    section_ids.push_back(section->id());
+  }
+
+  // Build the NT headers block. Only the fields that the toolchain's
+  // validity checks consult are populated.
+  size_t nt_headers_size = sizeof(IMAGE_NT_HEADERS) +
+      section_ids.size() * sizeof(IMAGE_SECTION_HEADER);
+  BlockGraph::Block* nt_headers_block = block_graph->AddBlock(
+      BlockGraph::DATA_BLOCK, nt_headers_size, "NT Headers");
+  DCHECK(nt_headers_block != NULL);
+  if (nt_headers_block->AllocateData(nt_headers_size) == NULL)
+    return NULL;
+
+  NtHeaders nt_headers;
+  if (!nt_headers.Init(0, nt_headers_block))
+    return NULL;
+  nt_headers->Signature = IMAGE_NT_SIGNATURE;
+  nt_headers->FileHeader.Machine = IMAGE_FILE_MACHINE_I386;
+  nt_headers->FileHeader.NumberOfSections =
+      static_cast<WORD>(section_ids.size());
+  nt_headers->FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER);
+  nt_headers->FileHeader.Characteristics =
+      IMAGE_FILE_32BIT_MACHINE | IMAGE_FILE_EXECUTABLE_IMAGE | IMAGE_FILE_DLL;
+  nt_headers->OptionalHeader.Magic = IMAGE_NT_OPTIONAL_HDR_MAGIC;
+  nt_headers->OptionalHeader.ImageBase = 0x10000000;
+  nt_headers->OptionalHeader.SectionAlignment = 0x1000;
+  nt_headers->OptionalHeader.FileAlignment = 0x200;
+
+  // Build the DOS header block and point it at the NT headers.
+  BlockGraph::Block* dos_header_block = block_graph->AddBlock(
+      BlockGraph::DATA_BLOCK, sizeof(IMAGE_DOS_HEADER), "DOS Header");
+  DCHECK(dos_header_block != NULL);
+  if (dos_header_block->AllocateData(dos_header_block->size()) == NULL)
+    return NULL;
+  dos_header_block->SetReference(
+      offsetof(IMAGE_DOS_HEADER, e_lfanew),
+      BlockGraph::Reference(BlockGraph::RELATIVE_REF,
+                            sizeof(RelativeAddress),
+                            nt_headers_block,
+                            0, 0));
+  if (!pe::UpdateDosHeader(dos_header_block))
+    return NULL;
+
+  // Create the blocks, distributed round-robin over the sections. All
+  // blocks share one interned name and carry no explicit data, so the cost
+  // per block is constant.
+  std::vector<BlockGraph::Block*> blocks;
+  blocks.reserve(params.num_blocks);
+  for (size_t i = 0; i < params.num_blocks; ++i) {
+    size_t section_index = i % section_ids.size();
+    bool is_code = section_index < params.num_code_sections;
+    BlockGraph::Block* block = block_graph->AddBlock(
+        is_code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK,
+        params.block_size,
+        is_code ? "synthetic_code" : "synthetic_data");
+    DCHECK(block != NULL);
+    block->set_section(section_ids[section_index]);
+    blocks.push_back(block);
+  }
+
+  // Wire the blocks together with pseudo-random references, using a simple
+  // linear congruential generator so a given seed always produces the same
+  // image.
+  uint32 state = params.seed;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    for (size_t j = 0; j < params.references_per_block; ++j) {
+      state = state * 1103515245 + 12345;
+      BlockGraph::Block* target = blocks[state % blocks.size()];
+      blocks[i]->SetReference(
+          j * 4,
+          BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, target, 0, 0));
+    }
+  }
+
+  return dos_header_block;
+}
+
 void PELibUnitTest::LoadTestDll(const base::FilePath& path,
                                 ScopedHMODULE* module) {
   DCHECK(module != NULL);
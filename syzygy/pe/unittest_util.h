@@ -112,6 +112,56 @@ class ScopedHMODULE {
 // @note Meant to be called from within an ASSERT_NO_FATAL_FAILURE block.
 void TwiddlePdbGuidAndPath(block_graph::BlockGraph::Block* dos_header_block);
 
+// Parameters controlling GenerateSyntheticImage. The defaults produce a
+// small image suitable for smoke tests; benchmarks scale num_blocks well
+// beyond what the checked-in test images provide.
+struct SyntheticImageParams {
+  SyntheticImageParams()
+      : num_code_sections(1),
+        num_data_sections(1),
+        num_blocks(100),
+        block_size(64),
+        references_per_block(4),
+        seed(0) {
+  }
+
+  // The number of code and data sections to create. There must be at least
+  // one section in total.
+  size_t num_code_sections;
+  size_t num_data_sections;
+
+  // The number of blocks to create. Blocks are distributed round-robin over
+  // the sections, with their type matching their section.
+  size_t num_blocks;
+
+  // The size of each block, in bytes. Must be large enough to hold
+  // references_per_block 4-byte references.
+  size_t block_size;
+
+  // The number of references each block makes to pseudo-randomly chosen
+  // target blocks. This controls the density of the reference graph.
+  size_t references_per_block;
+
+  // The seed for the pseudo-random reference targets. Generation is
+  // deterministic for a given set of parameters, so benchmark runs are
+  // reproducible.
+  uint32 seed;
+};
+
+// Generates a synthetic PE image in @p block_graph, as described by
+// @p params. The image gets valid DOS and NT header blocks (such that
+// pe::IsValidDosHeaderBlock and pe::IsValidNtHeadersBlock are satisfied),
+// the requested sections, and params.num_blocks blocks wired together with
+// pseudo-random references. Block data is left implicit so that generation
+// cost and memory use stay proportional to the block count, letting
+// benchmarks sweep image sizes into the millions of blocks.
+// @param params The parameters describing the image to generate.
+// @param block_graph The block-graph to populate. This must be empty.
+// @returns the DOS header block of the generated image, or NULL on failure.
+block_graph::BlockGraph::Block* GenerateSyntheticImage(
+    const SyntheticImageParams& params,
+    block_graph::BlockGraph* block_graph);
+
 class PELibUnitTest : public testing::ApplicationTestBase {
  public:
   // Decomposes test_dll, populating the given PE file and image layout.
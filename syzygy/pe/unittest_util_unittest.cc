@@ -0,0 +1,114 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/unittest_util.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/pe/pe_utils.h"
+
+namespace testing {
+
+namespace {
+
+using block_graph::BlockGraph;
+
+}  // namespace
+
+TEST(PEUnittestUtils, GenerateSyntheticImageDefaultParams) {
+  BlockGraph block_graph;
+  SyntheticImageParams params;
+  BlockGraph::Block* dos_header_block =
+      GenerateSyntheticImage(params, &block_graph);
+  ASSERT_TRUE(dos_header_block != NULL);
+
+  // The generated headers must pass the toolchain's validity checks.
+  EXPECT_TRUE(pe::IsValidDosHeaderBlock(dos_header_block));
+  BlockGraph::Block* nt_headers_block =
+      pe::GetNtHeadersBlockFromDosHeaderBlock(dos_header_block);
+  ASSERT_TRUE(nt_headers_block != NULL);
+  EXPECT_TRUE(pe::IsValidNtHeadersBlock(nt_headers_block));
+
+  // The requested sections and blocks must exist, plus the two header
+  // blocks.
+  EXPECT_EQ(params.num_code_sections + params.num_data_sections,
+            block_graph.sections().size());
+  EXPECT_EQ(params.num_blocks + 2, block_graph.blocks().size());
+}
+
+TEST(PEUnittestUtils, GenerateSyntheticImageIsParameterizedAndDeterministic) {
+  SyntheticImageParams params;
+  params.num_code_sections = 2;
+  params.num_data_sections = 1;
+  params.num_blocks = 30;
+  params.block_size = 24;
+  params.references_per_block = 6;
+  params.seed = 42;
+
+  BlockGraph block_graph;
+  BlockGraph::Block* dos_header_block =
+      GenerateSyntheticImage(params, &block_graph);
+  ASSERT_TRUE(dos_header_block != NULL);
+  EXPECT_EQ(3u, block_graph.sections().size());
+
+  // Every synthetic block carries the requested reference density, lands in
+  // a valid section, and has a type matching its section.
+  size_t num_code_blocks = 0;
+  size_t num_data_blocks = 0;
+  BlockGraph::BlockMap::const_iterator it = block_graph.blocks().begin();
+  for (; it != block_graph.blocks().end(); ++it) {
+    const BlockGraph::Block& block = it->second;
+    if (&block == dos_header_block || block.name() == "NT Headers")
+      continue;
+
+    EXPECT_EQ(params.block_size, block.size());
+    EXPECT_EQ(params.references_per_block, block.references().size());
+
+    const BlockGraph::Section* section =
+        block_graph.GetSectionById(block.section());
+    ASSERT_TRUE(section != NULL);
+    bool is_code = (section->characteristics() & IMAGE_SCN_MEM_EXECUTE) != 0;
+    EXPECT_EQ(is_code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK,
+              block.type());
+    if (is_code) {
+      ++num_code_blocks;
+    } else {
+      ++num_data_blocks;
+    }
+  }
+  EXPECT_EQ(20u, num_code_blocks);
+  EXPECT_EQ(10u, num_data_blocks);
+
+  // A second generation with the same parameters must produce an identical
+  // reference structure.
+  BlockGraph other_graph;
+  ASSERT_TRUE(GenerateSyntheticImage(params, &other_graph) != NULL);
+  ASSERT_EQ(block_graph.blocks().size(), other_graph.blocks().size());
+  for (it = block_graph.blocks().begin(); it != block_graph.blocks().end();
+       ++it) {
+    const BlockGraph::Block* other = other_graph.GetBlockById(it->first);
+    ASSERT_TRUE(other != NULL);
+    ASSERT_EQ(it->second.references().size(), other->references().size());
+    BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+        it->second.references().begin();
+    for (; ref_it != it->second.references().end(); ++ref_it) {
+      BlockGraph::Reference other_ref;
+      ASSERT_TRUE(other->GetReference(ref_it->first, &other_ref));
+      EXPECT_EQ(ref_it->second.referenced()->id(),
+                other_ref.referenced()->id());
+    }
+  }
+}
+
+}  // namespace testing
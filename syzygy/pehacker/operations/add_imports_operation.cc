@@ -124,7 +124,10 @@ bool AddImportsOperation::Init(const TransformPolicyInterface* policy,
     }
 
     // Get the imported module with this name. ImportModule objects aren't
-    // copyable so we have to go out of our way to build a map of them.
+    // copyable so we have to go out of our way to build a map of them. Each
+    // module is registered with the transform exactly once, when it is
+    // created; this keeps Init safe to invoke repeatedly so that multiple
+    // operations can accumulate in a single instance.
     ImportedModuleMap::iterator mod_it =
         imported_module_map_.find(module_name);
     if (mod_it == imported_module_map_.end()) {
@@ -132,6 +135,7 @@ bool AddImportsOperation::Init(const TransformPolicyInterface* policy,
       imported_modules_.push_back(imported_module);
       mod_it = imported_module_map_.insert(std::make_pair(
           module_name, imported_module)).first;
+      add_imports_tx_.AddModule(imported_module);
     }
 
     // Iterate over the imports to be added from this module.
@@ -166,11 +170,6 @@ bool AddImportsOperation::Init(const TransformPolicyInterface* policy,
     }
   }
 
-  // Configure the transform itself.
-  ImportedModuleMap::iterator it = imported_module_map_.begin();
-  for (; it != imported_module_map_.end(); ++it)
-    add_imports_tx_.AddModule(it->second);
-
   return true;
 }
 
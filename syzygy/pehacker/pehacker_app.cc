@@ -159,6 +159,9 @@ int PEHackerApp::Run() {
   if (!ProcessConfigurationFile(false))
     return 1;
 
+  if (!ApplyPendingOperations())
+    return 1;
+
   if (!WriteImages())
     return 1;
 
@@ -393,41 +396,78 @@ bool PEHackerApp::ProcessOperation(bool dry_run,
     return false;
   }
 
-  // Dispatch to the appropriate operation implementation.
-  scoped_ptr<OperationInterface> operation_impl;
-  if (type == "none") {
-    // The 'none' operation is always defined, and does nothing. This is
-    // mainly there for simple unittesting of configuration files.
+  // The 'none' operation is always defined, and does nothing. This is
+  // mainly there for simple unittesting of configuration files.
+  if (type == "none")
+    return true;
+
+  // In a dry-run each operation is validated with a throwaway instance.
+  if (dry_run) {
+    scoped_ptr<OperationInterface> operation_impl(CreateOperation(type));
+    if (operation_impl.get() == NULL)
+      return false;
+    if (!operation_impl->Init(&policy_, operation)) {
+      LOG(ERROR) << "Failed to initialize \"" << operation_impl->name()
+                 << "\".";
+      return false;
+    }
     return true;
-  } else if (type == "add_imports") {
-    operation_impl.reset(new operations::AddImportsOperation());
-  } else if (type == "redirect_imports") {
-    operation_impl.reset(new operations::RedirectImportsOperation());
+  }
+
+  // Otherwise operations are coalesced by type: the configuration of every
+  // operation of a given type accumulates in a single instance per image,
+  // which will be applied in one pass by ApplyPendingOperations once the
+  // entire configuration has been processed.
+  OperationInterface* operation_impl = NULL;
+  std::map<std::string, OperationInterface*>::iterator op_it =
+      image_info->pending_operation_map.find(type);
+  if (op_it != image_info->pending_operation_map.end()) {
+    operation_impl = op_it->second;
   } else {
-    LOG(ERROR) << "Unrecognized operation type \"" << type << "\".";
-    return false;
+    operation_impl = CreateOperation(type);
+    if (operation_impl == NULL)
+      return false;
+    image_info->pending_operations.push_back(operation_impl);
+    image_info->pending_operation_map.insert(
+        std::make_pair(type, operation_impl));
   }
 
-  // Initialize the operation.
-  DCHECK_NE(reinterpret_cast<OperationInterface*>(NULL), operation_impl.get());
+  VLOG(1) << "Scheduling operation \"" << type << "\" for \""
+          << image_info->input_module.value() << "\".";
   if (!operation_impl->Init(&policy_, operation)) {
     LOG(ERROR) << "Failed to initialize \"" << operation_impl->name()
                << "\".";
     return false;
   }
 
-  // If not in a dry-run then apply the operation.
-  if (!dry_run) {
-    LOG(INFO) << "Applying operation \"" << type << "\" to \""
-              << image_info->input_module.value() << "\".";
-    if (!operation_impl->Apply(&policy_,
-                               &image_info->block_graph,
-                               image_info->header_block)) {
-      LOG(ERROR) << "Failed to apply \"" << operation_impl->name() << "\".";
-      return false;
+  return true;
+}
+
+OperationInterface* PEHackerApp::CreateOperation(const std::string& type) {
+  if (type == "add_imports")
+    return new operations::AddImportsOperation();
+  if (type == "redirect_imports")
+    return new operations::RedirectImportsOperation();
+  LOG(ERROR) << "Unrecognized operation type \"" << type << "\".";
+  return NULL;
+}
+
+bool PEHackerApp::ApplyPendingOperations() {
+  ImageInfoMap::iterator it = image_info_map_.begin();
+  for (; it != image_info_map_.end(); ++it) {
+    ImageInfo* image_info = it->second;
+    for (size_t i = 0; i < image_info->pending_operations.size(); ++i) {
+      OperationInterface* operation_impl = image_info->pending_operations[i];
+      LOG(INFO) << "Applying operation \"" << operation_impl->name()
+                << "\" to \"" << image_info->input_module.value() << "\".";
+      if (!operation_impl->Apply(&policy_,
+                                 &image_info->block_graph,
+                                 image_info->header_block)) {
+        LOG(ERROR) << "Failed to apply \"" << operation_impl->name() << "\".";
+        return false;
+      }
     }
   }
-
   return true;
 }
 
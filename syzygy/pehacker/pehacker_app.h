@@ -29,6 +29,7 @@
 #include "syzygy/pe/image_source_map.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/pe/pe_transform_policy.h"
+#include "syzygy/pehacker/operation.h"
 
 namespace pehacker {
 
@@ -72,6 +73,13 @@ class PEHackerApp : public common::AppImplBase {
     BlockGraph block_graph;
     BlockGraph::Block* header_block;
     pe::RelativeAddressRange input_omap_range;
+
+    // The operations scheduled against this image, coalesced by type. Each
+    // operation type is instantiated once per image and accumulates the
+    // settings of every matching operation in the configuration, so that it
+    // can be applied in a single pass over the image before it is written.
+    ScopedVector<OperationInterface> pending_operations;
+    std::map<std::string, OperationInterface*> pending_operation_map;
   };
 
   typedef std::map<ImageId, ImageInfo*> ImageInfoMap;
@@ -122,6 +130,19 @@ class PEHackerApp : public common::AppImplBase {
                         ImageInfo* image_info);
   // @}
 
+  // Creates an operation implementation of the given type.
+  // @param type The type of the operation to create.
+  // @returns a newly created operation, or NULL (with a logged error) if the
+  //     type is not recognized. Ownership is passed to the caller.
+  OperationInterface* CreateOperation(const std::string& type);
+
+  // Applies the scheduled operations to their respective images. This is
+  // called as part of Run(), after the entire configuration has been
+  // processed, so that all operations of a given type are applied to an
+  // image in a single pass.
+  // @returns true on success, false otherwise.
+  bool ApplyPendingOperations();
+
   // Looks up the already decomposed image, or loads and decomposes it for the
   // first time.
   // @param input_module The path to the input module.
@@ -24,6 +24,29 @@ namespace playback {
 
 using trace::parser::Parser;
 
+// Runs Playback::DecomposeImage on a background thread, remembering its
+// result.
+class Playback::DecomposeImageRunner
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit DecomposeImageRunner(Playback* playback)
+      : playback_(playback), succeeded_(false) {
+    DCHECK(playback != NULL);
+  }
+
+  virtual void Run() OVERRIDE {
+    succeeded_ = playback_->DecomposeImage();
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  Playback* playback_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(DecomposeImageRunner);
+};
+
 Playback::Playback(const base::FilePath& module_path,
                    const base::FilePath& instrumented_path,
                    const TraceFileList& trace_files)
@@ -32,10 +55,14 @@ Playback::Playback(const base::FilePath& module_path,
       trace_files_(trace_files),
       pe_file_(NULL),
       image_(NULL),
-      parser_(NULL) {
+      parser_(NULL),
+      decompose_succeeded_(false) {
 }
 
 Playback::~Playback() {
+  // Join the decomposition prefetch thread if it is still running.
+  EnsureImageDecomposed();
+
   pe_file_ = NULL;
   image_ = NULL;
   parser_ = NULL;
@@ -56,17 +83,48 @@ bool Playback::Init(PEFile* pe_file, ImageLayout* image, Parser* parser) {
   image_ = image;
   parser_ = parser;
 
-  // Load and decompose the module.
+  // Load the module information.
   if (!LoadModuleInformation())
     return false;
-  if (!InitializeParser())
-    return false;
-  if (!LoadInstrumentedOmap())
-    return false;
-  if (!DecomposeImage())
-    return false;
 
-  return true;
+  // Start decomposing the module in the background. Decomposition is CPU
+  // bound, while the remaining initialization and the leading portion of
+  // trace parsing (everything up to the first function entry event) are
+  // I/O bound, so the two overlap well.
+  StartDecomposePrefetch();
+
+  bool success = InitializeParser() && LoadInstrumentedOmap();
+
+  // When there are no trace files to overlap with the caller expects a
+  // fully decomposed image as soon as this returns, and on failure the
+  // caller may tear things down right away. Either way the prefetch has to
+  // be joined here.
+  if (!success || trace_files_.empty()) {
+    if (!EnsureImageDecomposed())
+      success = false;
+  }
+
+  return success;
+}
+
+void Playback::StartDecomposePrefetch() {
+  DCHECK(decompose_runner_.get() == NULL);
+  DCHECK(decompose_thread_.get() == NULL);
+
+  decompose_runner_.reset(new DecomposeImageRunner(this));
+  decompose_thread_.reset(new base::DelegateSimpleThread(
+      decompose_runner_.get(), "playback-decompose"));
+  decompose_thread_->Start();
+}
+
+bool Playback::EnsureImageDecomposed() {
+  if (decompose_thread_.get() != NULL) {
+    decompose_thread_->Join();
+    decompose_succeeded_ = decompose_runner_->succeeded();
+    decompose_thread_.reset();
+    decompose_runner_.reset();
+  }
+  return decompose_succeeded_;
 }
 
 bool Playback::LoadModuleInformation() {
@@ -143,6 +201,10 @@ bool Playback::LoadInstrumentedOmap() {
   }
   LOG(INFO) << "Read OMAP data from instrumented module PDB.";
 
+  // Build the lookup table used to translate event addresses; there are
+  // typically millions of them per trace.
+  omap_to_table_.Init(omap_to_);
+
   return true;
 }
 
@@ -230,6 +292,12 @@ const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
 
   *error = false;
 
+  // Make sure the image decomposition has caught up with the parsing.
+  if (!EnsureImageDecomposed()) {
+    *error = true;
+    return NULL;
+  }
+
   AbsoluteAddress64 abs_address =
       reinterpret_cast<AbsoluteAddress64>(function);
 
@@ -257,7 +325,7 @@ const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
 
   // Convert the address from one in the instrumented module to one in the
   // original module using the OMAP data.
-  rva = pdb::TranslateAddressViaOmap(omap_to(), rva);
+  rva = omap_to_table_.Translate(rva);
 
   // Get the block that this function call refers to.
   const BlockGraph::Block* block = image_->blocks.GetBlockByAddress(rva);
@@ -28,6 +28,8 @@
 
 #include <windows.h>
 
+#include "base/memory/scoped_ptr.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/event_trace_consumer.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/pdb/omap.h"
@@ -56,7 +58,12 @@ class Playback {
 
   ~Playback();
 
-  // Initializes the playback class and decomposes the given image.
+  // Initializes the playback class and starts decomposing the given image.
+  // Decomposition is CPU bound, so it proceeds on a background thread,
+  // overlapped with the I/O bound remainder of the initialization and with
+  // the leading portion of trace parsing. It is completed by the first call
+  // to FindFunctionBlock or EnsureImageDecomposed; when there are no trace
+  // files to overlap with it completes before this function returns.
   // This function is virtual to aid testing of classes that may own Playback.
   // @param pe_file The PE file to be initialized.
   // @param image The image that will receive the decomposed module.
@@ -64,6 +71,12 @@ class Playback {
   // @returns true on success, false on failure.
   virtual bool Init(PEFile* pe_file, ImageLayout* image, Parser* parser);
 
+  // Ensures that the image decomposition started by Init has completed.
+  // This is called implicitly by FindFunctionBlock; callers that access the
+  // decomposed image through other means must call it explicitly first.
+  // @returns true if the decomposition succeeded, false otherwise.
+  bool EnsureImageDecomposed();
+
   // @returns true if the given ModuleInformation matches the instrumented
   // module signature, false otherwise.
   bool MatchesInstrumentedModuleSignature(
@@ -98,6 +111,9 @@ class Playback {
   typedef uint64 AbsoluteAddress64;
   typedef uint64 Size64;
 
+  // Runs DecomposeImage on the background prefetch thread.
+  class DecomposeImageRunner;
+
   // Loads information from the instrumented and original modules.
   bool LoadModuleInformation();
   // Initializes the parser.
@@ -107,6 +123,10 @@ class Playback {
   // Decomposes the original image.
   bool DecomposeImage();
 
+  // Starts decomposing the original image on a background thread. The
+  // thread is joined by EnsureImageDecomposed.
+  void StartDecomposePrefetch();
+
   // Parses the instrumented DLL headers, validating that it was produced
   // by a compatible version of the toolchain, and extracting signature
   // information and metadata.
@@ -138,8 +158,18 @@ class Playback {
   std::vector<OMAP> omap_to_;
   std::vector<OMAP> omap_from_;
 
+  // A page-indexed lookup table over omap_to_. Every call-trace event is
+  // translated through this, so the O(1) table lookups matter.
+  pdb::OmapTable omap_to_table_;
+
   // Signature of the instrumented DLL. Used for filtering call-trace events.
   PEFile::Signature instr_signature_;
+
+  // The background image decomposition, while it is in flight, and its
+  // result once the thread has been joined.
+  scoped_ptr<DecomposeImageRunner> decompose_runner_;
+  scoped_ptr<base::DelegateSimpleThread> decompose_thread_;
+  bool decompose_succeeded_;
 };
 
 }  // namespace playback
@@ -122,6 +122,27 @@ TEST_F(PlaybackTest, SuccessfulInit) {
   EXPECT_TRUE(playback_->Init(&input_dll_, &image_layout_, parser_.get()));
 }
 
+TEST_F(PlaybackTest, EnsureImageDecomposed) {
+  EXPECT_TRUE(Init());
+  EXPECT_TRUE(playback_->Init(&input_dll_, &image_layout_, parser_.get()));
+
+  // Completing the prefetch produces the decomposed image, and doing so
+  // again is a no-op.
+  EXPECT_TRUE(playback_->EnsureImageDecomposed());
+  EXPECT_FALSE(block_graph_.blocks().empty());
+  EXPECT_TRUE(playback_->EnsureImageDecomposed());
+}
+
+TEST_F(PlaybackTest, InitWithoutTraceFilesDecomposesInline) {
+  trace_files_.clear();
+
+  // With no trace files to overlap with, the image is fully decomposed by
+  // the time Init returns.
+  EXPECT_TRUE(Init());
+  EXPECT_TRUE(playback_->Init(&input_dll_, &image_layout_, parser_.get()));
+  EXPECT_FALSE(block_graph_.blocks().empty());
+}
+
 TEST_F(PlaybackTest, ConsumeCallTraceEvents) {
   EXPECT_TRUE(Init());
   EXPECT_TRUE(playback_->Init(&input_dll_, &image_layout_, parser_.get()));
@@ -14,7 +14,17 @@
 
 #include "syzygy/relink/relink_app.h"
 
+#include <algorithm>
+
+#include "base/file_util.h"
+#include "base/memory/scoped_vector.h"
 #include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_com_initializer.h"
 #include "syzygy/block_graph/orderers/original_orderer.h"
 #include "syzygy/block_graph/orderers/random_orderer.h"
 #include "syzygy/block_graph/transforms/fuzzing_transform.h"
@@ -35,6 +45,17 @@ const char kUsageFormatStr[] =
     "  Options:\n"
     "    --basic-blocks        Reorder at the basic-block level. At present,\n"
     "                          this is only supported for random reorderings.\n"
+    "    --batch=<path>        Relink multiple images in one invocation.\n"
+    "                          Each non-empty line of the file names one\n"
+    "                          target as a comma-separated list of paths:\n"
+    "                            input-image,output-image\n"
+    "                                [,input-pdb[,output-pdb]]\n"
+    "                          Lines starting with '#' are ignored. Omitted\n"
+    "                          PDB paths are inferred, as in single mode.\n"
+    "    --batch-threads=<integer>\n"
+    "                          The number of targets to relink concurrently\n"
+    "                          in batch mode. Defaults to the number of\n"
+    "                          processors.\n"
     "    --code-alignment=<integer>\n"
     "                          Force a minimal alignment for code blocks.\n"
     "                          Default value is 1.\n"
@@ -52,7 +73,8 @@ const char kUsageFormatStr[] =
     "    --no-strip-strings    Causes strings to be output in the augmented\n"
     "                          PDB stream. The default is to omit these to\n"
     "                          make smaller PDBs.\n"
-    "    --order-file=<path>   Reorder based on a JSON ordering file.\n"
+    "    --order-file=<path>   Reorder based on an ordering file, in either\n"
+    "                          the JSON or the binary format.\n"
     "    --output-pdb=<path>   Output path for the rewritten PDB file.\n"
     "                          Default is inferred from output-image.\n"
     "    --overwrite           Allow output files to be overwritten.\n"
@@ -68,6 +90,9 @@ const char kUsageFormatStr[] =
     "    --output-dll=<path>   Aliased to --output-image.\n"
     "\n"
     "  Notes:\n"
+    "    * The --batch option is mutually exclusive with --input-image,\n"
+    "      --output-image and --order-file; all remaining options apply to\n"
+    "      every target of the batch.\n"
     "    * The --seed and --order-file options are mutually exclusive\n"
     "    * If --order-file is specified, --input-image is optional.\n"
     "    * The --compress-pdb and --no-strip-strings options are only\n"
@@ -91,6 +116,47 @@ void GuessPdbPath(const base::FilePath& module_path, base::FilePath* pdb_path) {
 
 }  // namespace
 
+// A worker that relinks every num_workers'th batch target, starting at
+// target worker_index. The targets are disjoint and the transform policy
+// is stateless, so the workers share no mutable state and need no locking.
+class RelinkApp::RelinkTargetWorker
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  RelinkTargetWorker(RelinkApp* app,
+                     const pe::PETransformPolicy* policy,
+                     size_t worker_index,
+                     size_t num_workers)
+      : app_(app),
+        policy_(policy),
+        worker_index_(worker_index),
+        num_workers_(num_workers),
+        succeeded_(false) {
+    DCHECK(app != NULL);
+    DCHECK(policy != NULL);
+    DCHECK_LT(worker_index, num_workers);
+  }
+
+  virtual void Run() OVERRIDE {
+    // The relinker reads the input PDB via DIA, so each worker needs its
+    // own COM apartment.
+    base::win::ScopedCOMInitializer com_initializer;
+    succeeded_ = app_->RelinkBatchTargets(policy_,
+                                          worker_index_,
+                                          num_workers_);
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  RelinkApp* app_;
+  const pe::PETransformPolicy* policy_;
+  size_t worker_index_;
+  size_t num_workers_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(RelinkTargetWorker);
+};
+
 bool RelinkApp::ParseCommandLine(const CommandLine* cmd_line) {
   if (cmd_line->HasSwitch("help"))
     return Usage(cmd_line, "");
@@ -122,6 +188,7 @@ bool RelinkApp::ParseCommandLine(const CommandLine* cmd_line) {
 
   output_pdb_path_ = cmd_line->GetSwitchValuePath("output-pdb");
   order_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("order-file"));
+  batch_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("batch"));
   no_augment_pdb_ = cmd_line->HasSwitch("no-augment-pdb");
   compress_pdb_ = cmd_line->HasSwitch("compress-pdb");
   no_strip_strings_ = cmd_line->HasSwitch("no-strip-strings");
@@ -131,14 +198,37 @@ bool RelinkApp::ParseCommandLine(const CommandLine* cmd_line) {
   exclude_bb_padding_ = cmd_line->HasSwitch("exclude-bb-padding");
   fuzz_ = cmd_line->HasSwitch("fuzz");
 
-  // The --output-image argument is required.
-  if (output_image_path_.empty()) {
+  // In batch mode the input and output paths come from the batch file, and
+  // order files are specific to a single image.
+  if (!batch_file_path_.empty()) {
+    if (!input_image_path_.empty() || !output_image_path_.empty() ||
+        !order_file_path_.empty()) {
+      return Usage(cmd_line,
+                   "The batch argument is mutually exclusive with the "
+                   "input-image, output-image and order-file arguments.");
+    }
+  }
+
+  // Parse the batch thread-count argument.
+  if (cmd_line->HasSwitch("batch-threads")) {
+    if (batch_file_path_.empty())
+      return Usage(cmd_line, "The batch-threads argument requires --batch.");
+    std::wstring threads_str(cmd_line->GetSwitchValueNative("batch-threads"));
+    uint32 batch_threads = 0;
+    if (!ParseUInt32(threads_str, &batch_threads) || batch_threads == 0)
+      return Usage(cmd_line, "Invalid batch-threads value.");
+    batch_threads_ = batch_threads;
+  }
+
+  // The --output-image argument is required outside of batch mode.
+  if (output_image_path_.empty() && batch_file_path_.empty()) {
     return Usage(cmd_line, "You must specify --output-image.");
   }
 
   // Ensure that we have an input-image, either explicitly specified, or to be
-  // taken from an order file.
-  if (input_image_path_.empty() && order_file_path_.empty()) {
+  // taken from an order file or a batch file.
+  if (input_image_path_.empty() && order_file_path_.empty() &&
+      batch_file_path_.empty()) {
     return Usage(
         cmd_line,
         "You must specify --input-image if --order-file is not given.");
@@ -176,6 +266,11 @@ bool RelinkApp::ParseCommandLine(const CommandLine* cmd_line) {
 }
 
 bool RelinkApp::SetUp() {
+  if (!batch_file_path_.empty()) {
+    DCHECK(order_file_path_.empty());
+    return LoadBatchFile();
+  }
+
   if (input_image_path_.empty()) {
     DCHECK(!order_file_path_.empty());
     if (!reorder::Reorderer::Order::GetOriginalModulePath(order_file_path_,
@@ -196,12 +291,85 @@ bool RelinkApp::SetUp() {
 }
 
 int RelinkApp::Run() {
+  // The transform policy carries no mutable state, so a single instance is
+  // safely shared by every relink this invocation performs.
   pe::PETransformPolicy policy;
-  pe::PERelinker relinker(&policy);
-  relinker.set_input_path(input_image_path_);
-  relinker.set_input_pdb_path(input_pdb_path_);
-  relinker.set_output_path(output_image_path_);
-  relinker.set_output_pdb_path(output_pdb_path_);
+
+  if (!batch_file_path_.empty())
+    return RunBatch(&policy) ? 0 : 1;
+
+  BatchTarget target;
+  target.input_image_path = input_image_path_;
+  target.input_pdb_path = input_pdb_path_;
+  target.output_image_path = output_image_path_;
+  target.output_pdb_path = output_pdb_path_;
+  if (!RelinkOneImage(&policy, target))
+    return 1;
+
+  return 0;
+}
+
+bool RelinkApp::LoadBatchFile() {
+  DCHECK(!batch_file_path_.empty());
+
+  std::string contents;
+  if (!base::ReadFileToString(batch_file_path_, &contents)) {
+    LOG(ERROR) << "Unable to read batch file: " << batch_file_path_.value();
+    return false;
+  }
+
+  std::vector<std::string> lines;
+  base::SplitString(contents, '\n', &lines);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    std::string line;
+    base::TrimWhitespace(lines[i], base::TRIM_ALL, &line);
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::vector<std::string> fields;
+    base::SplitString(line, ',', &fields);
+    if (fields.size() < 2 || fields.size() > 4) {
+      LOG(ERROR) << "Invalid line " << (i + 1) << " in batch file: " << line;
+      return false;
+    }
+
+    BatchTarget target;
+    target.input_image_path = AbsolutePath(
+        base::FilePath(base::UTF8ToWide(fields[0])));
+    target.output_image_path = base::FilePath(base::UTF8ToWide(fields[1]));
+    if (fields.size() > 2) {
+      target.input_pdb_path = AbsolutePath(
+          base::FilePath(base::UTF8ToWide(fields[2])));
+    }
+    if (fields.size() > 3)
+      target.output_pdb_path = base::FilePath(base::UTF8ToWide(fields[3]));
+
+    if (target.input_image_path.empty() || target.output_image_path.empty()) {
+      LOG(ERROR) << "Invalid line " << (i + 1) << " in batch file: " << line;
+      return false;
+    }
+
+    batch_targets_.push_back(target);
+  }
+
+  if (batch_targets_.empty()) {
+    LOG(ERROR) << "Batch file contains no targets: "
+               << batch_file_path_.value();
+    return false;
+  }
+
+  return true;
+}
+
+bool RelinkApp::RelinkOneImage(const pe::PETransformPolicy* policy,
+                               const BatchTarget& target) {
+  DCHECK(policy != NULL);
+
+  pe::PERelinker relinker(policy);
+  relinker.set_input_path(target.input_image_path);
+  relinker.set_input_pdb_path(target.input_pdb_path);
+  relinker.set_output_path(target.output_image_path);
+  relinker.set_output_pdb_path(target.output_pdb_path);
   relinker.set_padding(padding_);
   relinker.set_code_alignment(code_alignment_);
   relinker.set_add_metadata(output_metadata_);
@@ -213,7 +381,7 @@ int RelinkApp::Run() {
   // Initialize the relinker. This does the decomposition, etc.
   if (!relinker.Init()) {
     LOG(ERROR) << "Failed to initialize relinker.";
-    return 1;
+    return false;
   }
 
   // Transforms that may be used.
@@ -234,11 +402,11 @@ int RelinkApp::Run() {
 
   // If an order file is provided we are performing an explicit ordering.
   if (!order_file_path_.empty()) {
-    if (!order.LoadFromJSON(relinker.input_pe_file(),
+    if (!order.LoadFromFile(relinker.input_pe_file(),
                             relinker.input_image_layout(),
                             order_file_path_)) {
       LOG(ERROR) << "Failed to load order file: " << order_file_path_.value();
-      return 1;
+      return false;
     }
 
     // Allocate a BB layout transform. This applies the basic block portion of
@@ -278,10 +446,68 @@ int RelinkApp::Run() {
   // Perform the actual relink.
   if (!relinker.Relink()) {
     LOG(ERROR) << "Unable to relink input image.";
-    return 1;
+    return false;
   }
 
-  return 0;
+  return true;
+}
+
+bool RelinkApp::RelinkBatchTargets(const pe::PETransformPolicy* policy,
+                                   size_t worker_index,
+                                   size_t num_workers) {
+  DCHECK(policy != NULL);
+  DCHECK_LT(worker_index, num_workers);
+
+  bool success = true;
+  for (size_t i = worker_index; i < batch_targets_.size(); i += num_workers) {
+    const BatchTarget& target = batch_targets_[i];
+    LOG(INFO) << "Relinking \"" << target.input_image_path.value()
+              << "\" to \"" << target.output_image_path.value() << "\".";
+    if (!RelinkOneImage(policy, target)) {
+      LOG(ERROR) << "Failed to relink \"" << target.input_image_path.value()
+                 << "\".";
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+bool RelinkApp::RunBatch(const pe::PETransformPolicy* policy) {
+  DCHECK(policy != NULL);
+  DCHECK(!batch_targets_.empty());
+
+  size_t num_workers = batch_threads_;
+  if (num_workers == 0)
+    num_workers = static_cast<size_t>(base::SysInfo::NumberOfProcessors());
+  num_workers = std::min(num_workers, batch_targets_.size());
+
+  LOG(INFO) << "Relinking " << batch_targets_.size() << " image(s) on "
+            << num_workers << " thread(s).";
+
+  // With a single worker the targets are relinked inline to avoid the
+  // thread start/join overhead.
+  if (num_workers <= 1)
+    return RelinkBatchTargets(policy, 0, 1);
+
+  ScopedVector<RelinkTargetWorker> workers;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers.push_back(new RelinkTargetWorker(this, policy, i, num_workers));
+    threads.push_back(new base::DelegateSimpleThread(
+        workers.back(), "RelinkTargetWorker"));
+    threads.back()->Start();
+  }
+
+  // Failed targets have already been logged by the workers; relinking
+  // continues past them so one bad target doesn't abort the whole batch.
+  bool success = true;
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->Join();
+    success = success && workers[i]->succeeded();
+  }
+
+  return success;
 }
 
 bool RelinkApp::Usage(const CommandLine* cmd_line,
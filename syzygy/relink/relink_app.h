@@ -17,22 +17,37 @@
 #ifndef SYZYGY_RELINK_RELINK_APP_H_
 #define SYZYGY_RELINK_RELINK_APP_H_
 
+#include <vector>
+
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
 #include "base/time/time.h"
 #include "syzygy/common/application.h"
 
+namespace pe {
+class PETransformPolicy;
+}  // namespace pe
+
 namespace relink {
 
 // This class implements the command-line relink utility.
 class RelinkApp : public common::AppImplBase {
  public:
+  // A single input/output image pair to be relinked in batch mode.
+  struct BatchTarget {
+    base::FilePath input_image_path;
+    base::FilePath input_pdb_path;
+    base::FilePath output_image_path;
+    base::FilePath output_pdb_path;
+  };
+
   RelinkApp()
       : AppImplBase("Relinker"),
         seed_(0),
         padding_(0),
         code_alignment_(1),
+        batch_threads_(0),
         no_augment_pdb_(false),
         compress_pdb_(false),
         no_strip_strings_(false),
@@ -51,10 +66,43 @@ class RelinkApp : public common::AppImplBase {
   // @}
 
  protected:
+  // Forward declaration.
+  class RelinkTargetWorker;
+  friend class RelinkTargetWorker;
+
   // @name Utility members.
   // @{
   bool Usage(const CommandLine* command_line,
              const base::StringPiece& message) const;
+
+  // Parses the batch file, populating batch_targets_. Each non-empty,
+  // non-comment line describes one relink as a comma-separated list of
+  // 2 to 4 paths: input-image,output-image[,input-pdb[,output-pdb]].
+  // Omitted PDB paths are inferred by the relinker, as in single mode.
+  // @returns true on success, false otherwise.
+  bool LoadBatchFile();
+
+  // Relinks a single input/output image pair using the shared transform
+  // @p policy. This applies the orderers and transforms configured on the
+  // command-line; it is used both for single-image runs and for each
+  // target of a batch run.
+  // @returns true on success, false otherwise.
+  bool RelinkOneImage(const pe::PETransformPolicy* policy,
+                      const BatchTarget& target);
+
+  // Relinks every batch_threads_'th target of batch_targets_, starting at
+  // target @p worker_index. Invoked on worker threads by Run() in batch
+  // mode. Relinking continues past individual failures so that one bad
+  // target doesn't abort the whole batch.
+  // @returns true iff all of the worker's targets relinked successfully.
+  bool RelinkBatchTargets(const pe::PETransformPolicy* policy,
+                          size_t worker_index,
+                          size_t num_workers);
+
+  // Runs the batch relink, fanning batch_targets_ out across a pool of
+  // worker threads that share @p policy.
+  // @returns true iff all targets relinked successfully.
+  bool RunBatch(const pe::PETransformPolicy* policy);
   // @}
 
   // @name Command-line parameters.
@@ -64,9 +112,11 @@ class RelinkApp : public common::AppImplBase {
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
   base::FilePath order_file_path_;
+  base::FilePath batch_file_path_;
   uint32 seed_;
   size_t padding_;
   size_t code_alignment_;
+  size_t batch_threads_;
   bool no_augment_pdb_;
   bool compress_pdb_;
   bool no_strip_strings_;
@@ -77,6 +127,9 @@ class RelinkApp : public common::AppImplBase {
   bool fuzz_;
   // @}
 
+  // The targets parsed from the batch file, if any.
+  std::vector<BatchTarget> batch_targets_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(RelinkApp);
 };
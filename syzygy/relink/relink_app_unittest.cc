@@ -14,7 +14,9 @@
 
 #include "syzygy/relink/relink_app.h"
 
+#include "base/file_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
@@ -43,6 +45,9 @@ class TestRelinkApp : public RelinkApp {
   using RelinkApp::output_image_path_;
   using RelinkApp::output_pdb_path_;
   using RelinkApp::order_file_path_;
+  using RelinkApp::batch_file_path_;
+  using RelinkApp::batch_threads_;
+  using RelinkApp::batch_targets_;
   using RelinkApp::seed_;
   using RelinkApp::padding_;
   using RelinkApp::code_alignment_;
@@ -97,6 +102,7 @@ class RelinkAppTest : public testing::PELibUnitTest {
     output_image_path_ = temp_dir_.Append(input_image_path_.BaseName());
     output_pdb_path_ = temp_dir_.Append(input_pdb_path_.BaseName());
     order_file_path_ = temp_dir_.Append(L"order.json");
+    batch_file_path_ = temp_dir_.Append(L"batch.txt");
 
     // Point the application at the test's command-line and IO streams.
     test_app_.set_command_line(&cmd_line_);
@@ -124,6 +130,14 @@ class RelinkAppTest : public testing::PELibUnitTest {
     *dll_main = dll_main_ref.referenced();
   }
 
+  // Writes @p contents to batch_file_path_.
+  void WriteBatchFile(const std::string& contents) {
+    ASSERT_EQ(static_cast<int>(contents.size()),
+              base::WriteFile(batch_file_path_,
+                              contents.data(),
+                              contents.size()));
+  }
+
   // Stashes the current log-level before each test instance and restores it
   // after each test completes.
   ScopedLogLevelSaver log_level_saver;
@@ -146,6 +160,7 @@ class RelinkAppTest : public testing::PELibUnitTest {
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
   base::FilePath order_file_path_;
+  base::FilePath batch_file_path_;
   uint32 seed_;
   size_t padding_;
   size_t code_alignment_;
@@ -216,6 +231,85 @@ TEST_F(RelinkAppTest, ParseWithInvalidPaddingFails) {
   ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(RelinkAppTest, ParseWithBatchAndInputFails) {
+  cmd_line_.AppendSwitchPath("batch", batch_file_path_);
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(RelinkAppTest, ParseWithBatchAndOrderFails) {
+  cmd_line_.AppendSwitchPath("batch", batch_file_path_);
+  cmd_line_.AppendSwitchPath("order-file", order_file_path_);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(RelinkAppTest, ParseWithBatchThreadsWithoutBatchFails) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("batch-threads", "2");
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(RelinkAppTest, ParseWithInvalidBatchThreadsFails) {
+  cmd_line_.AppendSwitchPath("batch", batch_file_path_);
+  cmd_line_.AppendSwitchASCII("batch-threads", "0");
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(RelinkAppTest, ParseMinimalCommandLineWithBatch) {
+  cmd_line_.AppendSwitchPath("batch", batch_file_path_);
+  cmd_line_.AppendSwitchASCII("batch-threads", "2");
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(batch_file_path_, test_impl_.batch_file_path_);
+  EXPECT_EQ(2u, test_impl_.batch_threads_);
+
+  // The batch file doesn't exist yet, so setup should fail to load it.
+  EXPECT_FALSE(test_impl_.SetUp());
+}
+
+TEST_F(RelinkAppTest, SetUpLoadsBatchFile) {
+  std::string input = base::WideToUTF8(input_image_path_.value());
+  std::string output = base::WideToUTF8(output_image_path_.value());
+  std::string input_pdb = base::WideToUTF8(input_pdb_path_.value());
+  std::string output_pdb = base::WideToUTF8(output_pdb_path_.value());
+  ASSERT_NO_FATAL_FAILURE(WriteBatchFile(
+      "# A comment, followed by a blank line.\n"
+      "\n" +
+      input + "," + output + "\n" +
+      input + "," + output + "," + input_pdb + "," + output_pdb + "\n"));
+
+  cmd_line_.AppendSwitchPath("batch", batch_file_path_);
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(test_impl_.SetUp());
+
+  ASSERT_EQ(2u, test_impl_.batch_targets_.size());
+  EXPECT_EQ(abs_input_image_path_,
+            test_impl_.batch_targets_[0].input_image_path);
+  EXPECT_EQ(output_image_path_,
+            test_impl_.batch_targets_[0].output_image_path);
+  EXPECT_TRUE(test_impl_.batch_targets_[0].input_pdb_path.empty());
+  EXPECT_TRUE(test_impl_.batch_targets_[0].output_pdb_path.empty());
+  EXPECT_EQ(abs_input_pdb_path_,
+            test_impl_.batch_targets_[1].input_pdb_path);
+  EXPECT_EQ(output_pdb_path_,
+            test_impl_.batch_targets_[1].output_pdb_path);
+}
+
+TEST_F(RelinkAppTest, SetUpFailsOnMalformedBatchFile) {
+  ASSERT_NO_FATAL_FAILURE(WriteBatchFile("just-one-path\n"));
+
+  cmd_line_.AppendSwitchPath("batch", batch_file_path_);
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_FALSE(test_impl_.SetUp());
+}
+
 TEST_F(RelinkAppTest, ParseMinimalCommandLineWithInputDll) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
@@ -384,6 +478,25 @@ TEST_F(RelinkAppTest, RandomRelinkBasicBlocksWithFuzzing) {
   ASSERT_NO_FATAL_FAILURE(CheckTestDll(output_image_path_));
 }
 
+TEST_F(RelinkAppTest, BatchRandomRelink) {
+  // Relink the test DLL to two distinct outputs in one batch invocation.
+  base::FilePath output_image_path2 = temp_dir_.Append(L"test_dll_2.dll");
+  std::string input = base::WideToUTF8(input_image_path_.value());
+  ASSERT_NO_FATAL_FAILURE(WriteBatchFile(
+      input + "," + base::WideToUTF8(output_image_path_.value()) + "\n" +
+      input + "," + base::WideToUTF8(output_image_path2.value()) + "\n"));
+
+  cmd_line_.AppendSwitchPath("batch", batch_file_path_);
+  cmd_line_.AppendSwitchASCII("batch-threads", "2");
+  cmd_line_.AppendSwitchASCII("seed", base::StringPrintf("%d", seed_));
+  cmd_line_.AppendSwitchASCII("padding", base::StringPrintf("%d", padding_));
+  cmd_line_.AppendSwitch("overwrite");
+
+  ASSERT_EQ(0, test_app_.Run());
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(output_image_path_));
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(output_image_path2));
+}
+
 TEST_F(RelinkAppTest, RelinkBlockOrder) {
   pe::PEFile pe_file;
   ASSERT_TRUE(pe_file.Init(input_image_path_));
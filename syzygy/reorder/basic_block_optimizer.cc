@@ -41,7 +41,6 @@ using block_graph::BasicBlockSubGraph;
 using block_graph::Successor;
 using grinder::basic_block_util::EntryCountType;
 using grinder::basic_block_util::IndexedFrequencyInformation;
-using grinder::basic_block_util::IndexedFrequencyOffset;
 using grinder::basic_block_util::IndexedFrequencyMap;
 using grinder::basic_block_util::ModuleInformation;
 using grinder::basic_block_util::RelativeAddress;
@@ -51,7 +50,6 @@ using pe::PEFile;
 using pe::ImageLayout;
 
 typedef Reorderer::Order Order;
-typedef BlockGraph::Offset Offset;
 typedef BlockGraph::Size Size;
 typedef BlockGraph::AddressSpace::RangeMapConstIter RangeMapConstIter;
 typedef BlockGraph::AddressSpace::RangeMapConstIterPair RangeMapConstIterPair;
@@ -157,43 +155,87 @@ bool HasHigherEntryCount(const CountForBasicBlock& lhs,
   return lhs.first > rhs.first;
 }
 
-bool GetEntryCountByOffset(const IndexedFrequencyInformation& entry_counts,
-                           const RelativeAddress& base_rva,
-                           Offset offset,
-                           EntryCountType* entry_count) {
-  DCHECK_LE(0, offset);
-  DCHECK(entry_count != NULL);
-
-  *entry_count = 0;
-  IndexedFrequencyOffset key = std::make_pair(base_rva + offset, 0);
-  IndexedFrequencyMap::const_iterator it =
-      entry_counts.frequency_map.find(key);
-  if (it != entry_counts.frequency_map.end())
-    *entry_count = it->second;
-  return true;
+// A comparator suitable for lower_bound searches of the entry count index.
+bool IndexEntryPrecedesAddress(
+    const std::pair<RelativeAddress, EntryCountType>& entry,
+    const RelativeAddress& addr) {
+  return entry.first < addr;
 }
 
 }  // namespace
 
+EntryCountIndex::EntryCountIndex(
+    const IndexedFrequencyInformation& entry_counts) {
+  counts_.reserve(entry_counts.frequency_map.size());
+
+  // The frequency map is keyed by (address, column) pairs, so iterating it
+  // visits addresses in ascending order. Only the entry count column (the
+  // first column) is retained, leaving the flattened vector sorted by
+  // address.
+  IndexedFrequencyMap::const_iterator it = entry_counts.frequency_map.begin();
+  for (; it != entry_counts.frequency_map.end(); ++it) {
+    if (it->first.second == 0)
+      counts_.push_back(std::make_pair(it->first.first, it->second));
+  }
+}
+
+EntryCountIndex::EntryCountType EntryCountIndex::GetEntryCount(
+    const RelativeAddress& addr) const {
+  return GetEntryCountInRange(0, counts_.size(), addr);
+}
+
+void EntryCountIndex::GetBlockRange(const RelativeAddress& addr,
+                                    Size size,
+                                    size_t* begin,
+                                    size_t* end) const {
+  DCHECK(begin != NULL);
+  DCHECK(end != NULL);
+
+  std::vector<IndexEntry>::const_iterator begin_it = std::lower_bound(
+      counts_.begin(), counts_.end(), addr, &IndexEntryPrecedesAddress);
+  std::vector<IndexEntry>::const_iterator end_it = std::lower_bound(
+      begin_it, counts_.end(), addr + size, &IndexEntryPrecedesAddress);
+  *begin = begin_it - counts_.begin();
+  *end = end_it - counts_.begin();
+}
+
+EntryCountIndex::EntryCountType EntryCountIndex::GetEntryCountInRange(
+    size_t begin, size_t end, const RelativeAddress& addr) const {
+  DCHECK_LE(begin, end);
+  DCHECK_LE(end, counts_.size());
+
+  std::vector<IndexEntry>::const_iterator end_it = counts_.begin() + end;
+  std::vector<IndexEntry>::const_iterator it = std::lower_bound(
+      counts_.begin() + begin, end_it, addr, &IndexEntryPrecedesAddress);
+  if (it != end_it && it->first == addr)
+    return it->second;
+  return 0;
+}
+
 BasicBlockOptimizer::BasicBlockOrderer::BasicBlockOrderer(
     const BasicBlockSubGraph& subgraph,
     const RelativeAddress& addr,
     Size size,
-    const IndexedFrequencyInformation& entry_counts)
+    const EntryCountIndex& entry_count_index)
         : subgraph_(subgraph),
           addr_(addr),
           size_(size),
-          entry_counts_(entry_counts) {
+          entry_count_index_(entry_count_index),
+          count_begin_(0),
+          count_end_(0) {
   DCHECK_LT(0U, size);
+
+  // Carve out the slice of the index covering this block. All subsequent
+  // lookups are restricted to this range.
+  entry_count_index_.GetBlockRange(addr, size, &count_begin_, &count_end_);
 }
 
 bool BasicBlockOptimizer::BasicBlockOrderer::GetBlockEntryCount(
     EntryCountType* entry_count) const {
   DCHECK(entry_count != NULL);
 
-  if (!GetEntryCountByOffset(entry_counts_, addr_, 0, entry_count))
-    return false;
-
+  *entry_count =
+      entry_count_index_.GetEntryCountInRange(count_begin_, count_end_, addr_);
   return true;
 }
 
@@ -348,11 +390,8 @@ bool BasicBlockOptimizer::BasicBlockOrderer::GetBasicBlockEntryCount(
   DCHECK(code_bb != NULL);
   DCHECK(entry_count != NULL);
 
-  if (!GetEntryCountByOffset(
-          entry_counts_, addr_, code_bb->offset(), entry_count)) {
-    return false;
-  }
-
+  *entry_count = entry_count_index_.GetEntryCountInRange(
+      count_begin_, count_end_, addr_ + code_bb->offset());
   return true;
 }
 
@@ -613,6 +652,10 @@ bool BasicBlockOptimizer::Optimize(
 
   pe::PETransformPolicy policy;
 
+  // Build the flat entry count index once for the whole image. All of the
+  // entry count lookups performed below are binary searches over it.
+  EntryCountIndex entry_count_index(entry_counts);
+
   // Iterate over the sections in the original order and update their basic-
   // block orderings.
   for (size_t i = 0; i < num_sections; ++i) {
@@ -623,7 +666,7 @@ bool BasicBlockOptimizer::Optimize(
     // Get the collection of warm and cold block spec for this section.
     if (!OptimizeSection(policy,
                          image_layout,
-                         entry_counts,
+                         entry_count_index,
                          explicit_blocks,
                          section_spec,
                          &warm_block_specs,
@@ -647,7 +690,7 @@ bool BasicBlockOptimizer::OptimizeBlock(
     const pe::PETransformPolicy& policy,
     const BlockGraph::Block* block,
     const ImageLayout& image_layout,
-    const IndexedFrequencyInformation& entry_counts,
+    const EntryCountIndex& entry_count_index,
     Order::BlockSpecVector* warm_block_specs,
     Order::BlockSpecVector* cold_block_specs) {
   DCHECK(block != NULL);
@@ -669,11 +712,7 @@ bool BasicBlockOptimizer::OptimizeBlock(
 
   // Determine the number of times the block has been entered. We use the
   // start of the block (with a zero offset) to find it's entry count.
-  EntryCountType entry_count = 0;
-  if (!GetEntryCountByOffset(entry_counts, addr, 0, &entry_count)) {
-    LOG(ERROR) << "Failed to find entry count for '" << block->name() << "'.";
-    return false;
-  }
+  EntryCountType entry_count = entry_count_index.GetEntryCount(addr);
 
   // If the function was never invoked, we just move it as is to the cold set.
   // We have no information on which to base a basic-block optimization.
@@ -697,7 +736,7 @@ bool BasicBlockOptimizer::OptimizeBlock(
     return false;
 
   // Create the basic-block orderer.
-  BasicBlockOrderer orderer(subgraph, addr, block->size(), entry_counts);
+  BasicBlockOrderer orderer(subgraph, addr, block->size(), entry_count_index);
   Order::OffsetVector warm_basic_blocks;
   Order::OffsetVector cold_basic_blocks;
   if (!orderer.GetBasicBlockOrderings(&warm_basic_blocks,
@@ -738,7 +777,7 @@ bool BasicBlockOptimizer::OptimizeBlock(
 bool BasicBlockOptimizer::OptimizeSection(
     const pe::PETransformPolicy& policy,
     const ImageLayout& image_layout,
-    const IndexedFrequencyInformation& entry_counts,
+    const EntryCountIndex& entry_count_index,
     const ConstBlockVector& explicit_blocks,
     Order::SectionSpec* orig_section_spec,
     Order::BlockSpecVector* warm_block_specs,
@@ -757,7 +796,7 @@ bool BasicBlockOptimizer::OptimizeSection(
     if (!OptimizeBlock(policy,
                        block_spec->block,
                        image_layout,
-                       entry_counts,
+                       entry_count_index,
                        warm_block_specs,
                        cold_block_specs)) {
       return false;
@@ -788,7 +827,7 @@ bool BasicBlockOptimizer::OptimizeSection(
       if (!OptimizeBlock(policy,
                          it->second,
                          image_layout,
-                         entry_counts,
+                         entry_count_index,
                          warm_block_specs,
                          cold_block_specs)) {
         return false;
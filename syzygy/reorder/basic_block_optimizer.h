@@ -16,6 +16,8 @@
 #define SYZYGY_REORDER_BASIC_BLOCK_OPTIMIZER_H_
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/basic_block.h"
@@ -29,6 +31,61 @@
 
 namespace reorder {
 
+// A flat, address-sorted index over basic-block entry count data. The
+// optimizer performs a large number of entry count lookups while ordering
+// basic-blocks; probing the underlying frequency map for each of them is
+// costly with chrome-scale count data. This index is built once per image
+// and thereafter answers lookups by binary search over a contiguous vector,
+// and lets a per-block range of counts be carved out once per block.
+class EntryCountIndex {
+ public:
+  typedef grinder::basic_block_util::EntryCountType EntryCountType;
+  typedef grinder::basic_block_util::IndexedFrequencyInformation
+      IndexedFrequencyInformation;
+  typedef grinder::basic_block_util::RelativeAddress RelativeAddress;
+  typedef block_graph::BlockGraph::Size Size;
+
+  // Builds the index from @p entry_counts. Only the entry count column of
+  // the frequency data is indexed.
+  explicit EntryCountIndex(const IndexedFrequencyInformation& entry_counts);
+
+  // @returns the number of entries in the index.
+  size_t size() const { return counts_.size(); }
+
+  // Looks up the entry count recorded at @p addr.
+  // @param addr the address of a basic-block.
+  // @returns the entry count for @p addr, or zero if none was recorded.
+  EntryCountType GetEntryCount(const RelativeAddress& addr) const;
+
+  // Computes the range of index entries falling within a block.
+  // @param addr the address of the block.
+  // @param size the size of the block, in bytes.
+  // @param begin receives the index of the first entry in the block.
+  // @param end receives the index one past the last entry in the block.
+  void GetBlockRange(const RelativeAddress& addr,
+                     Size size,
+                     size_t* begin,
+                     size_t* end) const;
+
+  // Looks up the entry count recorded at @p addr within the index range
+  // [@p begin, @p end), as previously computed by GetBlockRange.
+  // @param begin the first index entry to consider.
+  // @param end one past the last index entry to consider.
+  // @param addr the address of a basic-block.
+  // @returns the entry count for @p addr, or zero if none was recorded.
+  EntryCountType GetEntryCountInRange(size_t begin,
+                                      size_t end,
+                                      const RelativeAddress& addr) const;
+
+ private:
+  typedef std::pair<RelativeAddress, EntryCountType> IndexEntry;
+
+  // The entry counts, sorted by ascending address.
+  std::vector<IndexEntry> counts_;
+
+  DISALLOW_COPY_AND_ASSIGN(EntryCountIndex);
+};
+
 // A class to optimize the basic-block placement of a block ordering, given
 // basic-block entry count data.
 class BasicBlockOptimizer {
@@ -67,7 +124,7 @@ class BasicBlockOptimizer {
   static bool OptimizeBlock(const pe::PETransformPolicy& policy,
                             const BlockGraph::Block* block,
                             const ImageLayout& image_layout,
-                            const IndexedFrequencyInformation& entry_counts,
+                            const EntryCountIndex& entry_count_index,
                             Order::BlockSpecVector* warm_block_specs,
                             Order::BlockSpecVector* cold_block_specs);
 
@@ -75,7 +132,7 @@ class BasicBlockOptimizer {
   // given @p section_spec and the original @p image_layout.
   static bool OptimizeSection(const pe::PETransformPolicy& policy,
                               const ImageLayout& image_layout,
-                              const IndexedFrequencyInformation& entry_counts,
+                              const EntryCountIndex& entry_count_index,
                               const ConstBlockVector& explicit_blocks,
                               Order::SectionSpec* orig_section_spec,
                               Order::BlockSpecVector* warm_block_specs,
@@ -108,7 +165,7 @@ class BasicBlockOptimizer::BasicBlockOrderer {
   BasicBlockOrderer(const BasicBlockSubGraph& subgraph,
                     const RelativeAddress& addr,
                     Size size,
-                    const IndexedFrequencyInformation& entry_counts);
+                    const EntryCountIndex& entry_count_index);
 
   // Get the number of times the block itself was entered. This assumes that
   // the entry point of the block is its first basic block.
@@ -153,7 +210,12 @@ class BasicBlockOptimizer::BasicBlockOrderer {
   const BasicBlockSubGraph& subgraph_;
   const RelativeAddress& addr_;
   const Size size_;
-  const IndexedFrequencyInformation& entry_counts_;
+  const EntryCountIndex& entry_count_index_;
+
+  // The range of entries in entry_count_index_ falling within this block,
+  // computed once at construction.
+  size_t count_begin_;
+  size_t count_end_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(BasicBlockOrderer);
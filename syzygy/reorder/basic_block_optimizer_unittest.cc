@@ -55,9 +55,9 @@ class TestBasicBlockOrderer : public BasicBlockOptimizer::BasicBlockOrderer {
       const BasicBlockSubGraph& subgraph,
       const RelativeAddress& addr,
       Size size,
-      const IndexedFrequencyInformation& entry_counts)
+      const EntryCountIndex& entry_count_index)
           : BasicBlockOptimizer::BasicBlockOrderer(
-                subgraph, addr, size, entry_counts) {
+                subgraph, addr, size, entry_count_index) {
   }
 };
 
@@ -68,10 +68,6 @@ class BasicBlockOrdererTest : public testing::BasicBlockTest {
     ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
     ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
     ASSERT_NO_FATAL_FAILURE(SetEntryCounts(0, 0, 0, 0, 0, 0, 0, 0));
-    orderer_.reset(new TestBasicBlockOrderer(subgraph_,
-                                             start_addr_,
-                                             assembly_func_->size(),
-                                             entry_counts_));
     ASSERT_TRUE(orderer_.get() != NULL);
   }
 
@@ -112,11 +108,21 @@ class BasicBlockOrdererTest : public testing::BasicBlockTest {
     frequency_map[std::make_pair(start_addr_ + kBasicBlockOffsets[6], 0)] = bb6;
     frequency_map[std::make_pair(start_addr_ + kBasicBlockOffsets[7], 0)] = bb7;
     ASSERT_EQ(kNumCodeBasicBlocks, frequency_map.size());
+
+    // The index takes a snapshot of the frequency map when it is built, so
+    // it (and the orderer over it) must be rebuilt whenever the entry counts
+    // change.
+    entry_count_index_.reset(new EntryCountIndex(entry_counts_));
+    orderer_.reset(new TestBasicBlockOrderer(subgraph_,
+                                             start_addr_,
+                                             assembly_func_->size(),
+                                             *entry_count_index_));
   }
 
   static const size_t kBasicBlockOffsets[kNumCodeBasicBlocks];
 
   IndexedFrequencyInformation entry_counts_;
+  scoped_ptr<EntryCountIndex> entry_count_index_;
   scoped_ptr<TestBasicBlockOrderer> orderer_;
 };
 
@@ -190,6 +196,27 @@ class BasicBlockOptimizerTest : public testing::OrderGeneratorTest {
 
 }  // namespace
 
+TEST_F(BasicBlockOrdererTest, EntryCountIndexLookup) {
+  ASSERT_NO_FATAL_FAILURE(SetEntryCounts(1, 0, 2, 5, 1, 0, 3, 0));
+  EXPECT_EQ(kNumCodeBasicBlocks, entry_count_index_->size());
+
+  // Lookups hit recorded addresses and miss unrecorded ones.
+  EXPECT_EQ(1, entry_count_index_->GetEntryCount(start_addr_));
+  EXPECT_EQ(5, entry_count_index_->GetEntryCount(start_addr_ + 31));
+  EXPECT_EQ(0, entry_count_index_->GetEntryCount(start_addr_ + 1));
+
+  // The block range covers all of the recorded basic-blocks, and in-range
+  // lookups agree with whole-index lookups.
+  size_t begin = 0;
+  size_t end = 0;
+  entry_count_index_->GetBlockRange(
+      start_addr_, assembly_func_->size(), &begin, &end);
+  EXPECT_EQ(0U, begin);
+  EXPECT_EQ(kNumCodeBasicBlocks, end);
+  EXPECT_EQ(2, entry_count_index_->GetEntryCountInRange(
+      begin, end, start_addr_ + 24));
+}
+
 TEST_F(BasicBlockOrdererTest, GetBlockEntryCount) {
   ASSERT_NO_FATAL_FAILURE(SetEntryCounts(1, 0, 1, 5, 1, 0, 0, 0));
   EntryCountType entry_count = 0;
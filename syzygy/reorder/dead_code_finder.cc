@@ -28,7 +28,12 @@ bool DeadCodeFinder::OnCodeBlockEntry(const Block* block,
                                       uint32 /*process_id*/,
                                       uint32 /*thread_id*/,
                                       const UniqueTime& /*time*/) {
-  visited_blocks_.insert(block);
+  DCHECK(block != NULL);
+
+  // Grow the bitmap on demand; the trace may mention blocks in any order.
+  if (block->id() >= visited_blocks_.size())
+    visited_blocks_.resize(block->id() + 1, false);
+  visited_blocks_[block->id()] = true;
   return true;
 }
 
@@ -38,7 +43,8 @@ bool DeadCodeFinder::IsDead(const Block* block) const {
   // just being noise (not easily actionable) for the consumer of the dead code
   // finder's output.
   return ((block->attributes() & BlockGraph::GAP_BLOCK) == 0)
-      && (visited_blocks_.find(block) == visited_blocks_.end());
+      && (block->id() >= visited_blocks_.size()
+          || !visited_blocks_[block->id()]);
 }
 
 bool DeadCodeFinder::CalculateReordering(const PEFile& pe_file,
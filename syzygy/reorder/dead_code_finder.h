@@ -15,7 +15,7 @@
 #ifndef SYZYGY_REORDER_DEAD_CODE_FINDER_H_
 #define SYZYGY_REORDER_DEAD_CODE_FINDER_H_
 
-#include <set>
+#include <vector>
 
 #include "syzygy/reorder/reorderer.h"
 
@@ -47,8 +47,12 @@ class DeadCodeFinder : public Reorderer::OrderGenerator {
   // @}
 
  protected:
-  // The set of blocks observed while reading the call trace.
-  std::set<const Block*> visited_blocks_;
+  // The set of blocks observed while reading the call trace, stored as a
+  // bitmap keyed by block id. Block ids are densely allocated so this is
+  // far more compact than a set of block pointers, and both marking blocks
+  // while reading chrome-scale traces and the per-block liveness queries
+  // made while calculating the reordering become constant time.
+  std::vector<bool> visited_blocks_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(DeadCodeFinder);
@@ -85,9 +85,11 @@ bool ExplicitOrderer::OrderBlockGraph(
     LOG(INFO) << "Applying order to section " << section->id()
               << " (" << section->name() << ").";
 
-    // We walk through these in reverse order so that we can use PlaceAtHead.
-    for (size_t i = section_spec.blocks.size(); i > 0;) {
-      const Reorderer::Order::BlockSpec& block_spec = section_spec.blocks[--i];
+    // Resolve the blocks named by the section specification, in order.
+    BlockVector section_blocks;
+    section_blocks.reserve(section_spec.blocks.size());
+    for (size_t i = 0; i < section_spec.blocks.size(); ++i) {
+      const Reorderer::Order::BlockSpec& block_spec = section_spec.blocks[i];
 
       // Ensure the block-spec specifies a block without BB information. Any
       // BB ordering must already have been applied.
@@ -110,10 +112,12 @@ bool ExplicitOrderer::OrderBlockGraph(
         return false;
       }
 
-      // At this point we have a single unique block that we've found, so
-      // place it at the beginning of the section.
-      ordered_block_graph->PlaceAtHead(section, *block_it);
+      section_blocks.push_back(*block_it);
     }
+
+    // Move the blocks to the head of the section in one pass. Blocks that
+    // are not named by the order retain their relative order after them.
+    ordered_block_graph->ReorderSection(section, section_blocks);
   }
 
   return true;
@@ -57,11 +57,15 @@ static const char kUsageFormatStr[] =
     "    --seed=INT generates a random ordering; don't specify ETW log files.\n"
     "    --list-dead-code instead of an ordering, output the set of functions\n"
     "        not visited during the trace.\n"
+    "    --output-binary outputs the order file in the binary format rather\n"
+    "        than as JSON. Binary order files are much faster to load.\n"
     "    --pretty-print enables pretty printing of the JSON output file.\n"
     "    --reorderer-flags=<comma separated reorderer flags>\n"
     "  Reorderer Flags:\n"
     "    no-code: Do not reorder code sections.\n"
     "    no-data: Do not reorder data sections.\n"
+    "    stop-when-saturated: Stop consuming trace events once new blocks\n"
+    "        are no longer being discovered.\n"
     "  Deprecated Options:\n"
     "    --instrumented-dll=<path> aliases to --instrumented-image.\n"
     "    --input-dll=<path> aliases to --input-image.\n";
@@ -86,6 +90,8 @@ bool ParseFlags(const std::string& flags_str, Reorderer::Flags* flags) {
         out_flags &= ~Reorderer::kFlagReorderData;
       } else if (*flag_iter == "no-code") {
         out_flags &= ~Reorderer::kFlagReorderCode;
+      } else if (*flag_iter == "stop-when-saturated") {
+        out_flags |= Reorderer::kFlagStopWhenSaturated;
       } else if (!flag_iter->empty()) {
         LOG(ERROR) << "Unknown reorderer flag: " << *flag_iter << ".";
         return false;
@@ -107,6 +113,7 @@ const char ReorderApp::kInputImage[] = "input-image";
 const char ReorderApp::kBasicBlockEntryCounts[] = "basic-block-entry-counts";
 const char ReorderApp::kSeed[] = "seed";
 const char ReorderApp::kListDeadCode[] = "list-dead-code";
+const char ReorderApp::kOutputBinary[] = "output-binary";
 const char ReorderApp::kPrettyPrint[] = "pretty-print";
 const char ReorderApp::kReordererFlags[] = "reorderer-flags";
 const char ReorderApp::kInstrumentedDll[] = "instrumented-dll";
@@ -116,6 +123,7 @@ ReorderApp::ReorderApp()
     : AppImplBase("Reorder"),
       mode_(kInvalidMode),
       seed_(0),
+      output_binary_(false),
       pretty_print_(false),
       flags_(0) {
 }
@@ -158,7 +166,8 @@ bool ReorderApp::ParseCommandLine(const CommandLine* command_line) {
     return Usage(command_line, "Invalid reorderer flags");
   }
 
-  // Parse the pretty-print switch.
+  // Parse the output format switches.
+  output_binary_ = command_line->HasSwitch(kOutputBinary);
   pretty_print_ = command_line->HasSwitch(kPrettyPrint);
 
   // Make all of the input paths absolute.
@@ -279,8 +288,11 @@ int ReorderApp::Run() {
     }
   }
 
-  // Serialize the order to JSON.
-  if (!order.SerializeToJSON(input_image, output_file_path_, pretty_print_)) {
+  // Serialize the order.
+  bool saved = output_binary_ ?
+      order.SerializeToBinary(input_image, output_file_path_) :
+      order.SerializeToJSON(input_image, output_file_path_, pretty_print_);
+  if (!saved) {
     LOG(ERROR) << "Unable to output order.";
     return 1;
   }
@@ -313,8 +325,8 @@ bool ReorderApp::OptimizeBasicBlocks(const pe::PEFile::Signature& signature,
   // Load the basic-block entry count data.
   ModuleIndexedFrequencyMap module_entry_count_map;
   IndexedFrequencyDataSerializer serializer;
-  if (!serializer.LoadFromJson(bb_entry_count_file_path_,
-                               &module_entry_count_map)) {
+  if (!serializer.Load(bb_entry_count_file_path_,
+                       &module_entry_count_map)) {
     LOG(ERROR) << "Failed to load basic-block entry count data";
     return false;
   }
@@ -68,6 +68,7 @@ class ReorderApp : public common::AppImplBase {
   base::FilePath bb_entry_count_file_path_;
   FilePathVector trace_file_paths_;
   uint32 seed_;
+  bool output_binary_;
   bool pretty_print_;
   Reorderer::Flags flags_;
   // @}
@@ -80,6 +81,7 @@ class ReorderApp : public common::AppImplBase {
   static const char kBasicBlockEntryCounts[];
   static const char kSeed[];
   static const char kListDeadCode[];
+  static const char kOutputBinary[];
   static const char kPrettyPrint[];
   static const char kReordererFlags[];
   static const char kInstrumentedDll[];
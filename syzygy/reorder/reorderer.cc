@@ -49,6 +49,16 @@ const char kSectionNameKey[] = "name";
 const char kSectionCharacteristicsKey[] = "characteristics";
 const char kBlocksKey[] = "blocks";
 
+// A binary order file starts with this magic number and a version, followed
+// by the serialized metadata and section specifications.
+const uint32 kBinaryOrderMagic = 0x4F5A5953;  // Appears as "SYZO" on disk.
+const uint32 kBinaryOrderVersion = 1;
+
+// The default number of consecutive code block entry events that must be
+// observed without discovering a previously unseen block before a trace is
+// considered saturated. Only relevant when kFlagStopWhenSaturated is set.
+const size_t kDefaultSaturationEventWindow = 100000;
+
 bool OutputTrailingBlockComment(const BlockGraph::Block* block,
                                 core::JSONFileWriter* json_file) {
   DCHECK(block != NULL);
@@ -172,6 +182,51 @@ bool OutputSectionSpec(const Reorderer::Order::SectionSpec& section_spec,
   return true;
 }
 
+// Resolves the block at the given address in the original image and
+// validates the basic-block offsets of @p block_spec against it. On success
+// block_spec->block is populated. This is shared by the JSON and binary
+// loaders.
+bool ResolveBlockSpec(const pe::ImageLayout& image,
+                      uint32 address,
+                      Reorderer::Order::BlockSpec* block_spec) {
+  DCHECK(block_spec != NULL);
+
+  // Resolve the referenced block.
+  core::RelativeAddress rva(address);
+  const BlockGraph::Block* block = image.blocks.GetBlockByAddress(rva);
+  if (block == NULL) {
+    LOG(ERROR) << "Block address not found in decomposed image: "
+                << address;
+    return false;
+  }
+
+  // Validate the basic-block offsets.
+  bool seen_end_block = false;
+  for (size_t i = 0; i < block_spec->basic_block_offsets.size(); ++i) {
+    int offset = block_spec->basic_block_offsets[i];
+    if (offset < 0 ||
+        static_cast<BlockGraph::Size>(offset) > block->size()) {
+      LOG(ERROR) << "Offset " << offset << " falls outside block range [0-"
+                 << block->size() << "] for " << block->name();
+      return false;
+    }
+
+    // The basic-end block must be last in the block specification. The
+    // block builder will catch this error but we can meaningfully catch this
+    // earlier and avoid a lot of computation for nothing.
+    if (static_cast<BlockGraph::Size>(offset) == block->size()) {
+      seen_end_block = true;
+    } else if (seen_end_block) {
+      LOG(ERROR) << "Encountered basic-end block that is not last in the "
+                 << "specified ordering.";
+      return false;
+    }
+  }
+
+  block_spec->block = block;
+  return true;
+}
+
 bool LoadBlockSpec(const pe::ImageLayout& image,
                    const Value* block_value,
                    Reorderer::Order::BlockSpec* block_spec) {
@@ -197,50 +252,22 @@ bool LoadBlockSpec(const pe::ImageLayout& image,
     }
   }
 
-  // Resolve the referenced block.
-  core::RelativeAddress rva(address);
-  const BlockGraph::Block* block = image.blocks.GetBlockByAddress(rva);
-  if (block == NULL) {
-    LOG(ERROR) << "Block address not found in decomposed image: "
-                << address;
-    return false;
-  }
-
   // Read in the basic_block offsets.
-  bool seen_end_block = false;
   if (rva_list != NULL && !rva_list->empty()) {
     block_spec->basic_block_offsets.reserve(rva_list->GetSize());
     for (size_t i = 0; i < rva_list->GetSize(); ++i) {
       int offset = 0;
       if (!rva_list->GetInteger(i, &offset)) {
         LOG(ERROR) << "Unexpected value for basic-block offset #" << i
-                   << " of " << address << " [" << block->name() << "].";
+                   << " of " << address << ".";
         block_spec->basic_block_offsets.clear();
         return false;
       }
-      if (offset < 0 ||
-          static_cast<BlockGraph::Size>(offset) > block->size()) {
-        LOG(ERROR) << "Offset " << offset << " falls outside block range [0-"
-                   << block->size() << "] for " << block->name();
-        return false;
-      }
-
-      // The basic-end block must be last in the block specification. The
-      // block builder will catch this error but we can meaningfully catch this
-      // earlier and avoid a lot of computation for nothing.
-      if (static_cast<BlockGraph::Size>(offset) == block->size()) {
-        seen_end_block = true;
-      } else if (seen_end_block) {
-        LOG(ERROR) << "Encountered basic-end block that is not last in the "
-                   << "specified ordering.";
-        return false;
-      }
       block_spec->basic_block_offsets.push_back(offset);
     }
   }
 
-  block_spec->block = block;
-  return true;
+  return ResolveBlockSpec(image, address, block_spec);
 }
 
 bool LoadSectionSpec(const pe::ImageLayout& image,
@@ -356,6 +383,9 @@ Reorderer::Reorderer(const base::FilePath& module_path,
     : playback_(module_path, instrumented_path, trace_files),
       flags_(flags),
       code_block_entry_events_(0),
+      saturation_event_window_(kDefaultSaturationEventWindow),
+      events_since_new_block_(0),
+      saturated_(false),
       order_generator_(NULL) {
 }
 
@@ -414,6 +444,11 @@ bool Reorderer::CalculateReordering(Order* order) {
   DCHECK(order != NULL);
   DCHECK(order_generator_ != NULL);
 
+  // The decomposition prefetch has normally been joined by the event
+  // handlers by now; make sure of it before touching the image.
+  if (!playback_.EnsureImageDecomposed())
+    return false;
+
   LOG(INFO) << "Calculating new order.";
   if (!order_generator_->CalculateReordering(*playback_.pe_file(),
                                              *playback_.image(),
@@ -453,6 +488,12 @@ void Reorderer::OnFunctionEntry(base::Time time,
                                 const TraceEnterExitEventData* data) {
   DCHECK(data != NULL);
 
+  // Once the trace is saturated the remaining events are ignored: they
+  // overwhelmingly revisit blocks that have already been placed in the
+  // ordering.
+  if (saturated_)
+    return;
+
   bool error = false;
   const BlockGraph::Block* block = playback_.FindFunctionBlock(process_id,
                                                                data->function,
@@ -469,6 +510,23 @@ void Reorderer::OnFunctionEntry(base::Time time,
   if (block == NULL)
     return;
 
+  // Track the rate at which new blocks are being discovered, declaring
+  // saturation once too many events pass without one. The event that tips
+  // the scale is still forwarded to the order generator.
+  if ((flags_ & kFlagStopWhenSaturated) != 0) {
+    if (block->id() >= visited_blocks_.size())
+      visited_blocks_.resize(block->id() + 1, false);
+    if (!visited_blocks_[block->id()]) {
+      visited_blocks_[block->id()] = true;
+      events_since_new_block_ = 0;
+    } else if (++events_since_new_block_ >= saturation_event_window_) {
+      saturated_ = true;
+      LOG(INFO) << "No new blocks discovered in the last "
+                << saturation_event_window_ << " events; ignoring the "
+                << "remainder of the trace.";
+    }
+  }
+
   // Get the time of the call. Since batched function calls come in with the
   // same time stamp, we rely on their relative ordering and UniqueTime's
   // incrementing ID to maintain relative order.
@@ -492,7 +550,7 @@ void Reorderer::OnBatchFunctionEntry(base::Time time,
                                      const TraceBatchEnterData* data) {
   // Explode the batch event into individual function entry events.
   TraceEnterExitEventData new_data = {};
-  for (size_t i = 0; i < data->num_calls; ++i) {
+  for (size_t i = 0; i < data->num_calls && !saturated_; ++i) {
     new_data.function = data->calls[i].function;
     OnFunctionEntry(time, process_id, thread_id, &new_data);
   }
@@ -627,8 +685,224 @@ bool Reorderer::Order::LoadFromJSON(const PEFile& pe,
   return true;
 }
 
+bool Reorderer::Order::SerializeToBinary(const PEFile& pe,
+                                         const base::FilePath& path) const {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\" for writing.";
+    return false;
+  }
+
+  core::FileOutStream out_stream(file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+
+  // Write the header. The metadata contains the module signature, which
+  // allows a loader to validate the order against an image without reading
+  // the body of the file.
+  PEFile::Signature orig_sig;
+  pe.GetSignature(&orig_sig);
+  pe::Metadata metadata;
+  if (!metadata.Init(orig_sig) ||
+      !out_archive.Save(kBinaryOrderMagic) ||
+      !out_archive.Save(kBinaryOrderVersion) ||
+      !metadata.Save(&out_archive) ||
+      !out_archive.Save(comment)) {
+    return false;
+  }
+
+  // As with the JSON format, section specifications without any blocks are
+  // omitted.
+  uint32 section_count = 0;
+  SectionSpecVector::const_iterator it = sections.begin();
+  for (; it != sections.end(); ++it) {
+    if (!it->blocks.empty())
+      ++section_count;
+  }
+  if (!out_archive.Save(section_count))
+    return false;
+
+  // Write the individual section specifications.
+  for (it = sections.begin(); it != sections.end(); ++it) {
+    const SectionSpec& section_spec = *it;
+    if (section_spec.blocks.empty())
+      continue;
+
+    if (!out_archive.Save(static_cast<uint32>(section_spec.id)) ||
+        !out_archive.Save(section_spec.name) ||
+        !out_archive.Save(static_cast<uint32>(section_spec.characteristics)) ||
+        !out_archive.Save(static_cast<uint32>(section_spec.blocks.size()))) {
+      return false;
+    }
+
+    // Write the block specifications as (address, basic-block offsets)
+    // tuples.
+    BlockSpecVector::const_iterator block_it = section_spec.blocks.begin();
+    for (; block_it != section_spec.blocks.end(); ++block_it) {
+      DCHECK(block_it->block != NULL);
+      if (!out_archive.Save(block_it->block->addr().value()) ||
+          !out_archive.Save(block_it->basic_block_offsets)) {
+        return false;
+      }
+    }
+  }
+
+  return out_archive.Flush();
+}
+
+bool Reorderer::Order::LoadFromBinary(const PEFile& pe,
+                                      const ImageLayout& image,
+                                      const base::FilePath& path) {
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\" for reading.";
+    return false;
+  }
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+
+  // Read and validate the header.
+  uint32 magic = 0;
+  uint32 version = 0;
+  if (!in_archive.Load(&magic) || magic != kBinaryOrderMagic) {
+    LOG(ERROR) << "Not a binary order file: " << path.value() << ".";
+    return false;
+  }
+  if (!in_archive.Load(&version) || version != kBinaryOrderVersion) {
+    LOG(ERROR) << "Unsupported binary order file version.";
+    return false;
+  }
+
+  // Ensure the metadata is consistent with the signature of the module the
+  // ordering is being applied to before reading the body of the file.
+  pe::Metadata metadata;
+  PEFile::Signature pe_sig;
+  pe.GetSignature(&pe_sig);
+  if (!metadata.Load(&in_archive) || !metadata.IsConsistent(pe_sig)) {
+    LOG(ERROR) << "Invalid or inconsistent metadata.";
+    return false;
+  }
+
+  // Load the comment.
+  if (!in_archive.Load(&comment)) {
+    LOG(ERROR) << "Failed to read order file comment.";
+    return false;
+  }
+
+  // Load the section specifications.
+  uint32 section_count = 0;
+  if (!in_archive.Load(&section_count)) {
+    LOG(ERROR) << "Failed to read section count.";
+    return false;
+  }
+
+  sections.clear();
+  sections.resize(section_count);
+  std::set<size_t> seen_section_ids;
+  for (size_t i = 0; i < sections.size(); ++i) {
+    SectionSpec* section_spec = &sections[i];
+
+    uint32 section_id = 0;
+    uint32 characteristics = 0;
+    uint32 block_count = 0;
+    if (!in_archive.Load(&section_id) ||
+        !in_archive.Load(&section_spec->name) ||
+        !in_archive.Load(&characteristics) ||
+        !in_archive.Load(&block_count)) {
+      LOG(ERROR) << "Failed to read section specification #" << i << ".";
+      return false;
+    }
+    section_spec->id = section_id;
+    section_spec->characteristics = characteristics;
+
+    if (section_spec->id != SectionSpec::kNewSectionId) {
+      // Lookup the section in the original image layout.
+      if (section_spec->id >= image.sections.size()) {
+        LOG(ERROR) << "Invalid section id: " << section_spec->id << ".";
+        return false;
+      }
+
+      // Make sure this section id does not already exist.
+      if (!seen_section_ids.insert(section_spec->id).second) {
+        LOG(ERROR) << "Section ID " << section_spec->id << " redefined.";
+        return false;
+      }
+
+      if (section_spec->name.empty())
+        section_spec->name = image.sections[section_spec->id].name;
+    }
+
+    if (section_spec->name.empty()) {
+      LOG(ERROR) << "Missing a value for the section name.";
+      return false;
+    }
+
+    // Load the block specifications.
+    section_spec->blocks.resize(block_count);
+    for (size_t j = 0; j < section_spec->blocks.size(); ++j) {
+      BlockSpec* block_spec = &section_spec->blocks[j];
+      uint32 address = 0;
+      if (!in_archive.Load(&address) ||
+          !in_archive.Load(&block_spec->basic_block_offsets)) {
+        LOG(ERROR) << "Failed to read block specification #" << j
+                   << " of section #" << i << ".";
+        return false;
+      }
+
+      if (!ResolveBlockSpec(image, address, block_spec))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+bool Reorderer::Order::LoadFromFile(const PEFile& pe,
+                                    const ImageLayout& image,
+                                    const base::FilePath& path) {
+  if (IsBinaryOrderFile(path))
+    return LoadFromBinary(pe, image, path);
+  return LoadFromJSON(pe, image, path);
+}
+
+bool Reorderer::Order::IsBinaryOrderFile(const base::FilePath& path) {
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL)
+    return false;
+
+  uint32 magic = 0;
+  if (::fread(&magic, sizeof(magic), 1, file.get()) != 1)
+    return false;
+
+  return magic == kBinaryOrderMagic;
+}
+
 bool Reorderer::Order::GetOriginalModulePath(const base::FilePath& path,
                                              base::FilePath* module) {
+  // Binary order files carry their metadata in the file header.
+  if (IsBinaryOrderFile(path)) {
+    base::ScopedFILE file(base::OpenFile(path, "rb"));
+    if (file.get() == NULL)
+      return false;
+
+    core::FileInStream in_stream(file.get());
+    core::NativeBinaryInArchive in_archive(&in_stream);
+
+    uint32 magic = 0;
+    uint32 version = 0;
+    pe::Metadata metadata;
+    if (!in_archive.Load(&magic) ||
+        !in_archive.Load(&version) ||
+        version != kBinaryOrderVersion ||
+        !metadata.Load(&in_archive)) {
+      LOG(ERROR) << "Unable to read binary order file metadata.";
+      return false;
+    }
+
+    *module = base::FilePath(metadata.module_signature().path);
+    return true;
+  }
+
   std::string file_string;
   if (!base::ReadFileToString(path, &file_string)) {
     LOG(ERROR) << "Unable to read order file to string.";
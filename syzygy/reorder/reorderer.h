@@ -63,6 +63,10 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   enum FlagsEnum {
     kFlagReorderCode = 1 << 0,
     kFlagReorderData = 1 << 1,
+    // Stop consuming trace events once the rate at which previously unseen
+    // blocks are discovered drops below a threshold. Long captures spend
+    // most of their tail revisiting blocks that are already ordered.
+    kFlagStopWhenSaturated = 1 << 2,
   };
   typedef uint32 Flags;
 
@@ -138,6 +142,23 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   // Number of CodeBlockEntry events processed.
   size_t code_block_entry_events_;
 
+  // The number of consecutive code block entry events that may be observed
+  // without discovering a previously unseen block before the trace is
+  // considered saturated. Only consulted when kFlagStopWhenSaturated is set.
+  size_t saturation_event_window_;
+
+  // Tracks which blocks have already been observed, keyed by block ID. Only
+  // maintained when kFlagStopWhenSaturated is set.
+  std::vector<bool> visited_blocks_;
+
+  // The number of code block entry events observed since the last new block
+  // was discovered.
+  size_t events_since_new_block_;
+
+  // Set to true once the new-block discovery rate has dropped below the
+  // threshold. Any further trace events are ignored.
+  bool saturated_;
+
   // The following three variables are only valid while Reorder is executing.
   // A pointer to our order generator delegate.
   OrderGenerator* order_generator_;
@@ -195,6 +216,10 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
 // are also specified in addition to the id, they will over-ride the values in
 // the original image. If the id is not specified, then name and characteristics
 // are required and denote a newly created section.
+//
+// An order may alternatively be serialized to and from a versioned binary
+// format, which carries the same information but avoids the cost of JSON
+// parsing for pipelines that round-trip order files frequently.
 struct Reorderer::Order {
   typedef BlockGraph::Block Block;
   typedef BlockGraph::Offset Offset;
@@ -282,6 +307,29 @@ struct Reorderer::Order {
                     const ImageLayout& image,
                     const base::FilePath& path);
 
+  // Serializes the order to a versioned binary file. This holds the same
+  // information as the JSON format but is significantly faster to write and
+  // to load, at the expense of being neither human readable nor editable.
+  bool SerializeToBinary(const PEFile& pe, const base::FilePath& path) const;
+
+  // Loads an ordering from a binary order file, as produced by
+  // SerializeToBinary. The embedded metadata is validated against @p pe
+  // before the body of the file is read.
+  // @note @p pe and @p image must already be populated prior to calling this.
+  bool LoadFromBinary(const PEFile& pe,
+                      const ImageLayout& image,
+                      const base::FilePath& path);
+
+  // Loads an ordering from a file, auto-detecting whether it is in the JSON
+  // or the binary format.
+  // @note @p pe and @p image must already be populated prior to calling this.
+  bool LoadFromFile(const PEFile& pe,
+                    const ImageLayout& image,
+                    const base::FilePath& path);
+
+  // Determines whether the file at @p path is a binary order file.
+  static bool IsBinaryOrderFile(const base::FilePath& path);
+
   // Extracts the name of the original module from an order file. This is
   // used to guess the value of --input-image.
   static bool GetOriginalModulePath(const base::FilePath& path,
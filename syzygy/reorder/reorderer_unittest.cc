@@ -58,6 +58,10 @@ class TestReorderer : public Reorderer {
 
   Parser& parser() { return parser_; }
   Playback* playback() { return &playback_; }
+
+  void set_saturation_event_window(size_t window) {
+    saturation_event_window_ = window;
+  }
 };
 
 // A dummy order generator that does nothing but record events fed to it via
@@ -128,6 +132,7 @@ class TestParseEngine : public ParseEngine {
 
   explicit TestParseEngine(TestReorderer* reorderer)
       : ParseEngine("TestParseEngine", true),
+        revisit_count(0),
         reorderer_(reorderer) {
   }
 
@@ -154,6 +159,11 @@ class TestParseEngine : public ParseEngine {
   // build.
   ConstBlockVector blocks;
 
+  // The number of additional entry events to replay for the first block
+  // after all of the blocks have been visited once. This is used to
+  // exercise the saturation heuristic.
+  size_t revisit_count;
+
  private:
   // The parser needs to have a pointer to the reorderer in order to get image
   // data from it for producing false events.
@@ -287,6 +297,24 @@ bool TestParseEngine::ConsumeAllEvents() {
       return false;
   }
 
+  // Revisit the first block the requested number of times. None of these
+  // events discover a new block.
+  for (size_t j = 0; j < revisit_count; ++j) {
+    RelativeAddress rva = blocks[0]->addr();
+    rva = pdb::TranslateAddressViaOmap(reorderer_->playback()->omap_from(),
+                                       rva);
+    uint64 abs = dll_info.base_address.value() + rva.value();
+
+    TraceEnterEventData event_data = {};
+    event_data.function = reinterpret_cast<void*>(abs);
+
+    event_record.Header.Class.Type = TRACE_ENTER_EVENT;
+    event_record.MofData = &event_data;
+    event_record.MofLength = sizeof(event_data);
+    if (!DispatchEvent(&event_record))
+      return false;
+  }
+
   // Simulate the thread and process detaching from the DLL.
   event_record.Header.Class.Type = TRACE_THREAD_DETACH_EVENT;
   event_record.MofData = &dll_data;
@@ -326,14 +354,12 @@ class ReordererTest : public testing::PELibUnitTest {
     // Set up the reorderer. These tests rely on
     // call_trace_instrumented_test_dll.dll, as generated by the test_data
     // project.
-    const Reorderer::Flags kFlags = Reorderer::kFlagReorderCode |
-                                    Reorderer::kFlagReorderData;
     test_reorderer_.reset(new TestReorderer(
         testing::GetExeTestDataRelativePath(testing::kTestDllName),
         testing::GetExeTestDataRelativePath(
             testing::kCallTraceInstrumentedTestDllName),
         trace_file_list,
-        kFlags));
+        flags()));
 
     // Setup the test parse engine and register it with the parser used
     // by the test reorderer. Note that ownership of the pointer is also
@@ -344,6 +370,12 @@ class ReordererTest : public testing::PELibUnitTest {
     test_reorderer_->parser().AddParseEngine(test_parse_engine_);
   }
 
+  // Returns the flags the reorderer is constructed with. Derived fixtures
+  // may override this.
+  virtual Reorderer::Flags flags() const {
+    return Reorderer::kFlagReorderCode | Reorderer::kFlagReorderData;
+  }
+
   // A reorderer will be initialized, in SetUp(), for each test run.
   scoped_ptr<TestReorderer> test_reorderer_;
 
@@ -353,6 +385,13 @@ class ReordererTest : public testing::PELibUnitTest {
   TestParseEngine* test_parse_engine_;
 };
 
+class SaturatedReordererTest : public ReordererTest {
+ public:
+  virtual Reorderer::Flags flags() const OVERRIDE {
+    return Super::flags() | Reorderer::kFlagStopWhenSaturated;
+  }
+};
+
 }  // namespace
 
 TEST_F(ReordererTest, ValidateCallbacks) {
@@ -399,6 +438,30 @@ TEST_F(ReordererTest, Reorder) {
             test_order_generator.blocks);
 }
 
+TEST_F(SaturatedReordererTest, StopsConsumingWhenSaturated) {
+  static const size_t kEventWindow = 5;
+  static const size_t kRevisits = 20;
+  test_reorderer_->set_saturation_event_window(kEventWindow);
+  test_parse_engine_->revisit_count = kRevisits;
+
+  TestOrderGenerator test_order_generator;
+
+  // Run the reorderer.
+  Reorderer::Order order;
+  PEFile pe_file;
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  EXPECT_TRUE(test_reorderer_->Reorder(&test_order_generator,
+                                       &order,
+                                       &pe_file,
+                                       &image_layout));
+
+  // The unique blocks and the revisits up to the saturation window made it
+  // through to the order generator; the remainder of the trace was ignored.
+  EXPECT_EQ(test_parse_engine_->blocks.size() + kEventWindow,
+            test_order_generator.blocks.size());
+}
+
 TEST(OrderTest, OrderConstructor) {
   Reorderer::Order order;
   EXPECT_TRUE(order.sections.empty());
@@ -468,59 +531,72 @@ TEST(OrderTest, BlockSpecConstructorsAndCopier) {
   EXPECT_TRUE(BlockSpecsAreEqual(copied_block_spec, explicit_block_spec));
 }
 
-TEST(OrderTest, SerializeToJsonRoundTrip) {
+namespace {
+
+// Builds a dummy image layout and an ordering over it, for round-trip
+// testing of the order file serialization. The layout must have been
+// constructed over @p block_graph.
+void BuildDummyOrder(BlockGraph* block_graph,
+                     pe::ImageLayout* layout,
+                     Reorderer::Order* order) {
   // Build a dummy block graph.
-  BlockGraph block_graph;
-  BlockGraph::Section* section1 = block_graph.AddSection(".text", 0);
-  BlockGraph::Section* section2 = block_graph.AddSection(".rdata", 0);
-  BlockGraph::Block* block1 = block_graph.AddBlock(BlockGraph::CODE_BLOCK, 10,
-                                                   "block1");
-  BlockGraph::Block* block2 = block_graph.AddBlock(BlockGraph::DATA_BLOCK, 10,
-                                                   "block2");
-  BlockGraph::Block* block3 = block_graph.AddBlock(BlockGraph::DATA_BLOCK, 10,
-                                                   "block3");
+  BlockGraph::Section* section1 = block_graph->AddSection(".text", 0);
+  BlockGraph::Section* section2 = block_graph->AddSection(".rdata", 0);
+  BlockGraph::Block* block1 = block_graph->AddBlock(BlockGraph::CODE_BLOCK, 10,
+                                                    "block1");
+  BlockGraph::Block* block2 = block_graph->AddBlock(BlockGraph::DATA_BLOCK, 10,
+                                                    "block2");
+  BlockGraph::Block* block3 = block_graph->AddBlock(BlockGraph::DATA_BLOCK, 10,
+                                                    "block3");
   block1->set_section(section1->id());
   block2->set_section(section2->id());
   block3->set_section(section2->id());
 
   // Build a dummy image layout.
-  pe::ImageLayout layout(&block_graph);
   pe::ImageLayout::SectionInfo section_info1 = {};
   section_info1.name = section1->name();
   section_info1.addr = core::RelativeAddress(0x1000);
   section_info1.size = 0x1000;
   section_info1.data_size = 0x1000;
-  layout.sections.push_back(section_info1);
+  layout->sections.push_back(section_info1);
 
   pe::ImageLayout::SectionInfo section_info2 = {};
   section_info2.name = section2->name();
   section_info2.addr = core::RelativeAddress(0x2000);
   section_info2.size = 0x1000;
   section_info2.data_size = 0x1000;
-  layout.sections.push_back(section_info2);
+  layout->sections.push_back(section_info2);
 
-  layout.blocks.InsertBlock(section_info1.addr,
-                            block1);
-  layout.blocks.InsertBlock(section_info2.addr,
-                            block2);
-  layout.blocks.InsertBlock(section_info2.addr + block2->size(),
-                            block3);
+  layout->blocks.InsertBlock(section_info1.addr,
+                             block1);
+  layout->blocks.InsertBlock(section_info2.addr,
+                             block2);
+  layout->blocks.InsertBlock(section_info2.addr + block2->size(),
+                             block3);
 
   // Build a dummy order.
+  order->comment = "This is a comment.";
+  order->sections.resize(2);
+  order->sections[0].id = section1->id();
+  order->sections[0].name = section1->name();
+  order->sections[0].characteristics = section1->characteristics();
+  order->sections[0].blocks.push_back(BlockSpec(block1));
+  order->sections[0].blocks.back().basic_block_offsets.push_back(0);
+  order->sections[0].blocks.back().basic_block_offsets.push_back(8);
+  order->sections[1].id = section2->id();
+  order->sections[1].name = section2->name();
+  order->sections[1].characteristics = section2->characteristics();
+  order->sections[1].blocks.push_back(BlockSpec(block2));
+  order->sections[1].blocks.push_back(BlockSpec(block3));
+}
+
+}  // namespace
+
+TEST(OrderTest, SerializeToJsonRoundTrip) {
+  BlockGraph block_graph;
+  pe::ImageLayout layout(&block_graph);
   Reorderer::Order order;
-  order.comment = "This is a comment.";
-  order.sections.resize(2);
-  order.sections[0].id = section1->id();
-  order.sections[0].name = section1->name();
-  order.sections[0].characteristics = section1->characteristics();
-  order.sections[0].blocks.push_back(BlockSpec(block1));
-  order.sections[0].blocks.back().basic_block_offsets.push_back(0);
-  order.sections[0].blocks.back().basic_block_offsets.push_back(8);
-  order.sections[1].id = section2->id();
-  order.sections[1].name = section2->name();
-  order.sections[1].characteristics = section2->characteristics();
-  order.sections[1].blocks.push_back(BlockSpec(block2));
-  order.sections[1].blocks.push_back(BlockSpec(block3));
+  BuildDummyOrder(&block_graph, &layout, &order);
 
   base::FilePath module = testing::GetExeTestDataRelativePath(
       testing::kTestDllName);
@@ -548,4 +624,37 @@ TEST(OrderTest, SerializeToJsonRoundTrip) {
   EXPECT_TRUE(base::DeleteFile(temp_file, false));
 }
 
+TEST(OrderTest, SerializeToBinaryRoundTrip) {
+  BlockGraph block_graph;
+  pe::ImageLayout layout(&block_graph);
+  Reorderer::Order order;
+  BuildDummyOrder(&block_graph, &layout, &order);
+
+  base::FilePath module = testing::GetExeTestDataRelativePath(
+      testing::kTestDllName);
+  pe::PEFile pe_file;
+  ASSERT_TRUE(pe_file.Init(module));
+
+  // Serialize the order.
+  base::FilePath temp_file;
+  ASSERT_TRUE(base::CreateTemporaryFile(&temp_file));
+  EXPECT_TRUE(order.SerializeToBinary(pe_file, temp_file));
+  EXPECT_TRUE(Reorderer::Order::IsBinaryOrderFile(temp_file));
+
+  // Get the original module from the file.
+  base::FilePath orig_module;
+  EXPECT_TRUE(Reorderer::Order::GetOriginalModulePath(temp_file, &orig_module));
+  EXPECT_EQ(module, orig_module);
+
+  // Deserialize it via the format detecting entry point.
+  Reorderer::Order order2;
+  EXPECT_FALSE(OrdersAreEqual(order, order2));
+  EXPECT_TRUE(order2.LoadFromFile(pe_file, layout, temp_file));
+
+  // Expect them to be the same.
+  EXPECT_TRUE(OrdersAreEqual(order, order2));
+
+  EXPECT_TRUE(base::DeleteFile(temp_file, false));
+}
+
 }  // namespace reorder
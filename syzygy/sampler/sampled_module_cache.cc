@@ -277,6 +277,7 @@ SampledModuleCache::Module::Module(Process* process,
       log2_bucket_size_(log2_bucket_size),
       profiling_start_time_(0),
       profiling_stop_time_(0),
+      last_flush_time_(0),
       alive_(true) {
   DCHECK(process != NULL);
   DCHECK(module_ != INVALID_HANDLE_VALUE);
@@ -391,15 +392,29 @@ bool SampledModuleCache::Module::Init() {
                << " of process " << process_->pid() << ".";
     return false;
   }
-  DCHECK_EQ(bucket_count, profiler_.buckets().size());
+  DCHECK_EQ(bucket_count, profiler_.num_buckets());
 
   return true;
 }
 
+void SampledModuleCache::Module::MarkFlushed(const std::vector<ULONG>& deltas,
+                                             uint64 flush_time) {
+  DCHECK_EQ(profiler_.num_buckets(), deltas.size());
+
+  if (flushed_buckets_.empty())
+    flushed_buckets_.resize(deltas.size());
+
+  for (size_t i = 0; i < deltas.size(); ++i)
+    flushed_buckets_[i] += deltas[i];
+
+  last_flush_time_ = flush_time;
+}
+
 bool SampledModuleCache::Module::Start() {
   if (!profiler_.Start())
     return false;
   profiling_start_time_ = trace::common::GetTsc();
+  last_flush_time_ = profiling_start_time_;
   return true;
 }
 
@@ -51,6 +51,7 @@
 #define SYZYGY_SAMPLER_SAMPLED_MODULE_CACHE_H_
 
 #include <map>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "base/callback.h"
@@ -278,6 +279,27 @@ class SampledModuleCache::Module {
   const SamplingProfiler& profiler() const { return profiler_; }
   // @}
 
+  // @name Support for incremental flushing of sample data.
+  // @{
+  // @returns the per-bucket sample counts that have already been flushed to
+  //     disk. This is empty if the module has never been flushed.
+  const std::vector<ULONG>& flushed_buckets() const {
+    return flushed_buckets_;
+  }
+
+  // @returns the time of the last flush of this module's sample data, as
+  //     reported by RDTSC. Prior to the first flush this is the time at
+  //     which profiling started.
+  uint64 last_flush_time() const { return last_flush_time_; }
+
+  // Records that the sample counts in @p deltas have been flushed to disk.
+  // The counts are added to the running total of flushed samples so that the
+  // next flush only covers samples gathered from this point on.
+  // @param deltas The per-bucket sample counts that were just written.
+  // @param flush_time The time of the flush, as reported by RDTSC.
+  void MarkFlushed(const std::vector<ULONG>& deltas, uint64 flush_time);
+  // @}
+
  protected:
   friend class SampledModuleCache;
 
@@ -337,6 +359,13 @@ class SampledModuleCache::Module {
   // The sampling profiler instance that is profiling this module.
   SamplingProfiler profiler_;
 
+  // The per-bucket sample counts that have already been flushed to disk, and
+  // the time of the last flush. Together these allow the sample data to be
+  // written out incrementally while profiling continues; each flush only
+  // covers the samples gathered since the previous one.
+  std::vector<ULONG> flushed_buckets_;
+  uint64 last_flush_time_;
+
   // This is used for cleaning up no longer loaded modules using a mark and
   // sweep technique.
   bool alive_;
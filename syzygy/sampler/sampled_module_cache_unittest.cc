@@ -141,4 +141,44 @@ TEST_F(SampledModuleCacheTest, EndToEnd) {
   EXPECT_EQ(0u, cache.module_count());
 }
 
+TEST_F(SampledModuleCacheTest, MarkFlushed) {
+  SampledModuleCache cache(2);
+
+  static const DWORD kAccess =
+      PROCESS_DUP_HANDLE | PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
+  base::win::ScopedHandle proc(
+      ::OpenProcess(kAccess, FALSE, ::GetCurrentProcessId()));
+  ASSERT_TRUE(proc.IsValid());
+
+  SampledModuleCache::ProfilingStatus status =
+      SampledModuleCache::kProfilingStarted;
+  const SampledModuleCache::Module* module = NULL;
+  ASSERT_TRUE(cache.AddModule(proc.Get(), ::GetModuleHandle(NULL), &status,
+                              &module));
+  ASSERT_TRUE(module != NULL);
+
+  // Prior to any flush the module reports no flushed samples and the flush
+  // time is the time at which profiling started.
+  EXPECT_TRUE(module->flushed_buckets().empty());
+  EXPECT_EQ(module->profiling_start_time(), module->last_flush_time());
+
+  SampledModuleCache::Module* m =
+      cache.processes().begin()->second->modules().begin()->second;
+  ASSERT_EQ(module, m);
+
+  // Simulate a flush of a single sample in the first bucket.
+  std::vector<ULONG> deltas(m->profiler().num_buckets());
+  ASSERT_LT(0u, deltas.size());
+  deltas[0] = 1;
+  m->MarkFlushed(deltas, m->last_flush_time() + 1);
+  ASSERT_EQ(deltas.size(), m->flushed_buckets().size());
+  EXPECT_EQ(1u, m->flushed_buckets()[0]);
+  EXPECT_EQ(m->profiling_start_time() + 1, m->last_flush_time());
+
+  // A second flush accumulates into the running totals.
+  m->MarkFlushed(deltas, m->last_flush_time() + 1);
+  EXPECT_EQ(2u, m->flushed_buckets()[0]);
+  EXPECT_EQ(m->profiling_start_time() + 2, m->last_flush_time());
+}
+
 }  // namespace sampler
@@ -51,6 +51,15 @@ const char kUsageFormatStr[] =
     "                        the list is a whitelist.\n"
     "  --bucket-size=POSINT  Specifies the bucket size. This must be a power\n"
     "                        of two, and must be >= 4. Defaults to 4.\n"
+    "  --flush-interval=POSINT\n"
+    "                        If specified, sample data is written to the\n"
+    "                        trace files periodically at the given interval\n"
+    "                        (in seconds) rather than only when a module is\n"
+    "                        unloaded. Each record only contains the samples\n"
+    "                        gathered since the previous one, allowing\n"
+    "                        long-running processes to be profiled with\n"
+    "                        bounded memory and without interrupting\n"
+    "                        sampling.\n"
     "  --output-dir=DIR      The path to write trace-files. Will be created\n"
     "                        if it doesn't exist. Defaults to the current\n"
     "                        working directory.\n"
@@ -104,6 +113,29 @@ bool ParseBucketSize(const CommandLine* command_line,
   return true;
 }
 
+// Parses the flush interval. Leaves the value unchanged if it is not
+// specified.
+bool ParseFlushInterval(const CommandLine* command_line,
+                        base::TimeDelta* flush_interval) {
+  DCHECK(command_line != NULL);
+  DCHECK(flush_interval != NULL);
+
+  if (!command_line->HasSwitch(SamplerApp::kFlushInterval))
+    return true;
+
+  std::string s = command_line->GetSwitchValueASCII(
+      SamplerApp::kFlushInterval);
+  size_t seconds = 0;
+  if (!base::StringToSizeT(s, &seconds) || seconds == 0) {
+    LOG(ERROR) << "--" << SamplerApp::kFlushInterval
+               << " must be a positive integer number of seconds.";
+    return false;
+  }
+
+  *flush_interval = base::TimeDelta::FromSeconds(seconds);
+  return true;
+}
+
 // Parses the sampling interval. Leaves the value unchanged if it is not
 // specified.
 bool ParseSamplingInterval(const CommandLine* command_line,
@@ -525,16 +557,21 @@ bool WriteTraceModuleDataRecord(const SampledModuleCache::Module* module,
   return true;
 }
 
-// Converts the sample data in |module| to a TraceSampleData buffer and outputs
-// it to the provided TraceFileWriter.
+// Converts the given sample counts for |module| to a TraceSampleData buffer
+// and outputs it to the provided TraceFileWriter. The counts in |buckets| are
+// those gathered between |start_time| and |end_time|. When sample data is
+// flushed incrementally these are deltas relative to the previous record for
+// the same module, which the grinder accumulates.
 bool WriteTraceSampleDataRecord(uint64 sampling_interval_in_cycles,
                                 const SampledModuleCache::Module* module,
+                                const std::vector<ULONG>& buckets,
+                                uint64 start_time,
+                                uint64 end_time,
                                 TraceFileWriter* writer) {
   DCHECK(module != NULL);
   DCHECK(writer != NULL);
 
-  const ULONG* buckets = module->profiler().buckets().data();
-  size_t bucket_count = module->profiler().buckets().size();
+  size_t bucket_count = buckets.size();
   DCHECK_LT(0u, bucket_count);
 
   // Calculate the size of the buffer required to store the samples.
@@ -555,12 +592,12 @@ bool WriteTraceSampleDataRecord(uint64 sampling_interval_in_cycles,
   data->bucket_size = 1 << module->log2_bucket_size();
   data->bucket_start = reinterpret_cast<ModuleAddr>(module->buckets_begin());
   data->bucket_count = bucket_count;
-  data->sampling_start_time = module->profiling_start_time();
-  data->sampling_end_time = module->profiling_stop_time();
+  data->sampling_start_time = start_time;
+  data->sampling_end_time = end_time;
   data->sampling_interval = sampling_interval_in_cycles;
 
   // Copy the samples into the buffer.
-  ::memcpy(data->buckets, buckets, sizeof(buckets[0]) * bucket_count);
+  ::memcpy(data->buckets, buckets.data(), sizeof(buckets[0]) * bucket_count);
 
   if (!WriteTraceRecord(data, size, TRACE_SAMPLE_DATA, writer))
     return false;
@@ -568,10 +605,38 @@ bool WriteTraceSampleDataRecord(uint64 sampling_interval_in_cycles,
   return true;
 }
 
+// Computes the per-bucket sample counts that |module| has gathered since its
+// sample data was last flushed. The live per-core bucket counts are merged
+// while the profiler may still be updating them; any samples that land
+// mid-merge are simply picked up by a subsequent flush. Returns true if any
+// of the deltas are non-zero.
+bool GetBucketDeltas(const SampledModuleCache::Module* module,
+                     std::vector<ULONG>* deltas) {
+  DCHECK(module != NULL);
+  DCHECK(deltas != NULL);
+
+  module->profiler().GetBuckets(deltas);
+
+  const std::vector<ULONG>& flushed = module->flushed_buckets();
+  if (!flushed.empty())
+    DCHECK_EQ(deltas->size(), flushed.size());
+
+  bool have_samples = false;
+  for (size_t i = 0; i < deltas->size(); ++i) {
+    if (i < flushed.size())
+      (*deltas)[i] -= flushed[i];
+    if ((*deltas)[i] != 0)
+      have_samples = true;
+  }
+
+  return have_samples;
+}
+
 }  // namespace
 
 const char SamplerApp::kBlacklistPids[] = "blacklist-pids";
 const char SamplerApp::kBucketSize[] = "bucket-size";
+const char SamplerApp::kFlushInterval[] = "flush-interval";
 const char SamplerApp::kPids[] = "pids";
 const char SamplerApp::kSamplingInterval[] = "sampling-interval";
 const char SamplerApp::kOutputDir[] = "output-dir";
@@ -586,11 +651,14 @@ SamplerApp::SamplerApp()
       blacklist_pids_(true),
       log2_bucket_size_(kDefaultLog2BucketSize),
       sampling_interval_(),
+      flush_interval_(),
       running_(true),
       sampling_interval_in_cycles_(0) {
 }
 
 SamplerApp::~SamplerApp() {
+  // All trace file writers should have been torn down as their modules died.
+  DCHECK(writers_.empty());
 }
 
 bool SamplerApp::ParseCommandLine(const CommandLine* command_line) {
@@ -601,6 +669,7 @@ bool SamplerApp::ParseCommandLine(const CommandLine* command_line) {
 
   // Parse the profiler parameters.
   if (!ParseBucketSize(command_line, &log2_bucket_size_) ||
+      !ParseFlushInterval(command_line, &flush_interval_) ||
       !ParseSamplingInterval(command_line, &sampling_interval_)) {
     return PrintUsage(command_line->GetProgram(), "");
   }
@@ -702,6 +771,10 @@ int SamplerApp::RunImpl() {
   size_t process_count = 0;
   size_t module_count = 0;
 
+  // Keeps track of when sample data was last flushed for still-loaded
+  // modules.
+  base::Time last_flush_time = base::Time::Now();
+
   // Sit in a loop, actively monitoring running processes.
   while (running()) {
     // Mark all profiling module as dead. If they aren't remarked as alive after
@@ -760,6 +833,16 @@ int SamplerApp::RunImpl() {
     // and causes the profile information to be written to a trace file.
     cache.RemoveDeadModules();
 
+    // Periodically flush the sample data of modules that are still loaded.
+    // This writes delta-encoded records so that long-running processes can
+    // be profiled indefinitely, with the data gathered so far surviving a
+    // crash of the process or of the sampler itself.
+    if (flush_interval_ != base::TimeDelta() &&
+        base::Time::Now() - last_flush_time >= flush_interval_) {
+      FlushLiveModules(&cache);
+      last_flush_time = base::Time::Now();
+    }
+
     // Count the number of actively profiled modules and processes.
     size_t new_process_count = cache.processes().size();
     size_t new_module_count = cache.module_count();
@@ -837,6 +920,70 @@ void SamplerApp::OnDeadModule(const SampledModuleCache::Module* module) {
   // Invoke our testing seam callback.
   OnStopProfiling(module);
 
+  // Compute the samples gathered since the last flush. The final record is
+  // written unconditionally so that modules that gathered no samples at all
+  // still produce a trace file.
+  std::vector<ULONG> deltas;
+  GetBucketDeltas(module, &deltas);
+
+  TraceFileWriter* writer = GetTraceFileWriter(module);
+  if (writer != NULL) {
+    WriteTraceSampleDataRecord(sampling_interval_in_cycles_, module, deltas,
+                               module->last_flush_time(),
+                               module->profiling_stop_time(), writer);
+  }
+
+  // The module is about to be destroyed, so tear down its writer.
+  CloseTraceFileWriter(module);
+}
+
+void SamplerApp::FlushLiveModules(SampledModuleCache* cache) {
+  DCHECK(cache != NULL);
+
+  uint64 flush_time = trace::common::GetTsc();
+
+  SampledModuleCache::ProcessMap::const_iterator proc_it =
+      cache->processes().begin();
+  for (; proc_it != cache->processes().end(); ++proc_it) {
+    SampledModuleCache::Process::ModuleMap::iterator mod_it =
+        proc_it->second->modules().begin();
+    for (; mod_it != proc_it->second->modules().end(); ++mod_it)
+      FlushModule(mod_it->second, flush_time);
+  }
+}
+
+bool SamplerApp::FlushModule(SampledModuleCache::Module* module,
+                             uint64 flush_time) {
+  DCHECK(module != NULL);
+
+  // Don't write a record if no samples have been gathered since the last
+  // flush. This keeps trace files from growing while a process sits idle.
+  std::vector<ULONG> deltas;
+  if (!GetBucketDeltas(module, &deltas))
+    return true;
+
+  TraceFileWriter* writer = GetTraceFileWriter(module);
+  if (writer == NULL)
+    return false;
+
+  if (!WriteTraceSampleDataRecord(sampling_interval_in_cycles_, module, deltas,
+                                  module->last_flush_time(), flush_time,
+                                  writer)) {
+    return false;
+  }
+
+  module->MarkFlushed(deltas, flush_time);
+  return true;
+}
+
+TraceFileWriter* SamplerApp::GetTraceFileWriter(
+    const SampledModuleCache::Module* module) {
+  DCHECK(module != NULL);
+
+  TraceFileWriterMap::iterator it = writers_.find(module);
+  if (it != writers_.end())
+    return it->second;
+
   const SampledModuleCache::Process* process = module->process();
   DCHECK(process != NULL);
 
@@ -847,26 +994,31 @@ void SamplerApp::OnDeadModule(const SampledModuleCache::Module* module) {
   LOG(INFO) << "Writing module samples to \"" << trace_file_path.value()
             << "\".";
 
-  // TODO(chrisha): If we deal with processes with multiple profiled modules
-  //     or repeatedly loaded and unloaded modules, we could persist a trace
-  //     file writer for each process and use it repeatedly.
+  scoped_ptr<TraceFileWriter> writer(new TraceFileWriter());
 
-  TraceFileWriter writer;
-  if (!writer.Open(trace_file_path))
-    return;
+  if (!writer->Open(trace_file_path))
+    return NULL;
 
-  if (!writer.WriteHeader(process->process_info()))
-    return;
+  if (!writer->WriteHeader(process->process_info()))
+    return NULL;
 
-  if (!WriteTraceModuleDataRecord(module, &writer))
-    return;
+  if (!WriteTraceModuleDataRecord(module, writer.get()))
+    return NULL;
+
+  it = writers_.insert(std::make_pair(module, writer.release())).first;
+  return it->second;
+}
 
-  if (!WriteTraceSampleDataRecord(sampling_interval_in_cycles_, module,
-                                  &writer)) {
+void SamplerApp::CloseTraceFileWriter(
+    const SampledModuleCache::Module* module) {
+  DCHECK(module != NULL);
+
+  TraceFileWriterMap::iterator it = writers_.find(module);
+  if (it == writers_.end())
     return;
-  }
 
-  return;
+  delete it->second;
+  writers_.erase(it);
 }
 
 bool SamplerApp::GetModuleSignature(
@@ -18,12 +18,14 @@
 #ifndef SYZYGY_SAMPLER_SAMPLER_APP_H_
 #define SYZYGY_SAMPLER_SAMPLER_APP_H_
 
+#include <map>
 #include <set>
 
 #include "base/files/file_path.h"
 #include "base/time/time.h"
 #include "syzygy/common/application.h"
 #include "syzygy/sampler/sampled_module_cache.h"
+#include "syzygy/trace/service/trace_file_writer.h"
 
 namespace sampler {
 
@@ -45,6 +47,7 @@ class SamplerApp : public common::AppImplBase {
   // @{
   static const char kBlacklistPids[];
   static const char kBucketSize[];
+  static const char kFlushInterval[];
   static const char kPids[];
   static const char kSamplingInterval[];
   static const char kOutputDir[];
@@ -87,6 +90,34 @@ class SamplerApp : public common::AppImplBase {
   // @param module The module that has just finished profiling.
   void OnDeadModule(const SampledModuleCache::Module* module);
 
+  // Flushes the sample data accumulated since the previous flush for all
+  // modules that are still being profiled. Each flush writes a delta-encoded
+  // TraceSampleData record, which the grinder accumulates. This allows
+  // long-running processes to be profiled with bounded memory and without
+  // interrupting sampling.
+  // @param cache The cache of modules currently being profiled.
+  void FlushLiveModules(SampledModuleCache* cache);
+
+  // Flushes the sample data accumulated since the previous flush for the
+  // given module. Does nothing if no new samples have been gathered.
+  // @param module The module whose sample data is to be flushed.
+  // @param flush_time The time of the flush, as reported by RDTSC.
+  // @returns true on success, false otherwise.
+  bool FlushModule(SampledModuleCache::Module* module, uint64 flush_time);
+
+  // Returns the trace file writer associated with the given module, creating
+  // it and writing the trace file header and module data record if it does
+  // not yet exist.
+  // @param module The module whose writer is to be returned.
+  // @returns a pointer to the writer, or NULL if it could not be created.
+  trace::service::TraceFileWriter* GetTraceFileWriter(
+      const SampledModuleCache::Module* module);
+
+  // Closes and destroys the trace file writer associated with the given
+  // module, if one exists.
+  // @param module The module whose writer is to be closed.
+  void CloseTraceFileWriter(const SampledModuleCache::Module* module);
+
   // Initializes a ModuleSignature given a path. Logs an error on failure.
   // @param module The path to the module.
   // @param sig The signature object to be initialized.
@@ -118,6 +149,11 @@ class SamplerApp : public common::AppImplBase {
   size_t log2_bucket_size_;
   base::TimeDelta sampling_interval_;
 
+  // The interval at which sample data is flushed for modules that are still
+  // loaded. If zero (the default) sample data is only written when a module
+  // is unloaded.
+  base::TimeDelta flush_interval_;
+
   // The output directory where trace files will be written.
   base::FilePath output_dir_;
 
@@ -126,6 +162,13 @@ class SamplerApp : public common::AppImplBase {
   // filter) will be profiled.
   ModuleSignatureSet module_sigs_;
 
+  // The trace file writers for the modules whose sample data has been at
+  // least partially written, keyed by module. Entries are created lazily on
+  // first flush and destroyed when the module dies.
+  typedef std::map<const SampledModuleCache::Module*,
+                   trace::service::TraceFileWriter*> TraceFileWriterMap;
+  TraceFileWriterMap writers_;
+
   // Used to indicate whether or not the sampler should continue running.
   base::Lock lock_;
   bool running_;  // Under lock.
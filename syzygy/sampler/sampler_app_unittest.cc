@@ -60,6 +60,7 @@ class TestSamplerApp : public SamplerApp {
   using SamplerApp::module_sigs_;
   using SamplerApp::log2_bucket_size_;
   using SamplerApp::sampling_interval_;
+  using SamplerApp::flush_interval_;
   using SamplerApp::running_;
 
   void WaitUntilStartProfiling() {
@@ -95,8 +96,10 @@ class TestSamplerApp : public SamplerApp {
 
     // Count up the number of samples.
     on_stop_profiling_sample_count_ = 0;
-    for (size_t i = 0; i < module->profiler().buckets().size(); ++i)
-      on_stop_profiling_sample_count_ += module->profiler().buckets()[i];
+    std::vector<ULONG> buckets;
+    module->profiler().GetBuckets(&buckets);
+    for (size_t i = 0; i < buckets.size(); ++i)
+      on_stop_profiling_sample_count_ += buckets[i];
 
     ++stop_profiling_counter_;
     stop_profiling_.Signal();
@@ -305,6 +308,32 @@ TEST_F(SamplerAppTest, ParseValidBucketSizeMinimal) {
   EXPECT_TRUE(impl_.output_dir_.empty());
 }
 
+TEST_F(SamplerAppTest, ParseInvalidFlushIntervalFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kFlushInterval, "yay");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseZeroFlushIntervalFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kFlushInterval, "0");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseValidFlushInterval) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kFlushInterval, "30");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_TRUE(impl_.pids_.empty());
+  EXPECT_TRUE(impl_.blacklist_pids_);
+  EXPECT_THAT(impl_.module_sigs_, testing::ElementsAre(test_dll_sig));
+  EXPECT_EQ(SamplerApp::kDefaultLog2BucketSize, impl_.log2_bucket_size_);
+  EXPECT_EQ(kDefaultSamplingInterval, impl_.sampling_interval_);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(30), impl_.flush_interval_);
+  EXPECT_TRUE(impl_.output_dir_.empty());
+}
+
 TEST_F(SamplerAppTest, ParseTooSmallSamplingIntervalFails) {
   cmd_line_.AppendSwitchASCII(TestSamplerApp::kSamplingInterval, "1e-7");
   cmd_line_.AppendArgPath(test_dll_path);
@@ -17,6 +17,7 @@
 #include <winternl.h>  // for NTSTATUS.
 
 #include "base/lazy_instance.h"
+#include "base/memory/scoped_ptr.h"
 
 // Copied from wdm.h in the WDK as we don't want to take
 // a dependency on the WDK.
@@ -121,7 +122,8 @@ base::LazyInstance<ProfilerFuncs>::Leaky funcs = LAZY_INSTANCE_INITIALIZER;
 
 namespace sampler {
 
-SamplingProfiler::SamplingProfiler() : is_started_(false) {
+SamplingProfiler::SamplingProfiler()
+    : num_buckets_(0), is_started_(false) {
 }
 
 SamplingProfiler::~SamplingProfiler() {
@@ -136,7 +138,7 @@ bool SamplingProfiler::Initialize(HANDLE process,
                                   size_t size,
                                   size_t log2_bucket_size) {
   // You only get to initialize each instance once.
-  DCHECK(!profile_handle_.IsValid());
+  DCHECK(profiles_.empty());
   DCHECK(!is_started_);
   DCHECK(start != NULL);
   DCHECK_NE(0U, size);
@@ -148,11 +150,10 @@ bool SamplingProfiler::Initialize(HANDLE process,
     return false;
 
   size_t bucket_size = 1 << log2_bucket_size;
-  size_t num_buckets = (size + bucket_size - 1) / bucket_size;
-  DCHECK(num_buckets != 0);
-  buckets_.resize(num_buckets);
+  num_buckets_ = (size + bucket_size - 1) / bucket_size;
+  DCHECK(num_buckets_ != 0);
 
-  // Get our affinity mask for the call below.
+  // Get our affinity mask for the calls below.
   DWORD_PTR process_affinity = 0;
   DWORD_PTR system_affinity = 0;
   if (!::GetProcessAffinityMask(process, &process_affinity, &system_affinity)) {
@@ -160,6 +161,47 @@ bool SamplingProfiler::Initialize(HANDLE process,
     return false;
   }
 
+  // Create one profile per processor the process may run on, each with its
+  // own bucket array. Samples taken on distinct cores then land in distinct
+  // allocations, which avoids the cache-line contention that a single shared
+  // bucket array suffers from on multi-core machines.
+  bool success = true;
+  for (size_t cpu = 0; cpu < sizeof(process_affinity) * 8; ++cpu) {
+    DWORD_PTR cpu_mask = static_cast<DWORD_PTR>(1) << cpu;
+    if ((process_affinity & cpu_mask) == 0)
+      continue;
+    if (!CreateProfile(process, start, size, log2_bucket_size, cpu_mask)) {
+      success = false;
+      break;
+    }
+  }
+
+  // Some kernels refuse per-processor profile objects. Fall back to a single
+  // bucket array covering the whole affinity mask.
+  if (!success) {
+    LOG(WARNING) << "Failed to create per-core profiles, falling back to a "
+                 << "single shared bucket array.";
+    profiles_.clear();
+    if (!CreateProfile(process, start, size, log2_bucket_size,
+                       process_affinity)) {
+      num_buckets_ = 0;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool SamplingProfiler::CreateProfile(HANDLE process,
+                                     void* start,
+                                     size_t size,
+                                     size_t log2_bucket_size,
+                                     DWORD_PTR processor_mask) {
+  DCHECK_NE(0u, num_buckets_);
+
+  scoped_ptr<CoreProfile> core_profile(new CoreProfile());
+  core_profile->buckets.resize(num_buckets_);
+
   HANDLE profile = NULL;
   NTSTATUS status =
       funcs.Get().ZwCreateProfile(&profile,
@@ -167,33 +209,39 @@ bool SamplingProfiler::Initialize(HANDLE process,
                                   start,
                                   static_cast<ULONG>(size),
                                   static_cast<ULONG>(log2_bucket_size),
-                                  &buckets_[0],
+                                  &core_profile->buckets[0],
                                   static_cast<ULONG>(
-                                      sizeof(buckets_[0]) * num_buckets),
+                                      sizeof(core_profile->buckets[0]) *
+                                          num_buckets_),
                                   ProfileTime,
-                                  process_affinity);
+                                  processor_mask);
 
   if (!NT_SUCCESS(status)) {
-    // Might as well deallocate the buckets.
-    buckets_.resize(0);
     LOG(ERROR) << "Failed to create profile, error 0x" << std::hex << status;
     return false;
   }
 
   DCHECK(profile != NULL);
-  profile_handle_.Set(profile);
+  core_profile->handle.Set(profile);
+  profiles_.push_back(core_profile.release());
 
   return true;
 }
 
 bool SamplingProfiler::Start() {
-  DCHECK(profile_handle_.IsValid());
+  DCHECK(!profiles_.empty());
   DCHECK(!is_started_);
   DCHECK(funcs.Get().initialized_);
 
-  NTSTATUS status = funcs.Get().ZwStartProfile(profile_handle_.Get());
-  if (!NT_SUCCESS(status))
-    return false;
+  for (size_t i = 0; i < profiles_.size(); ++i) {
+    NTSTATUS status = funcs.Get().ZwStartProfile(profiles_[i]->handle.Get());
+    if (!NT_SUCCESS(status)) {
+      // Stop the profiles that were already started.
+      for (size_t j = 0; j < i; ++j)
+        funcs.Get().ZwStopProfile(profiles_[j]->handle.Get());
+      return false;
+    }
+  }
 
   is_started_ = true;
 
@@ -201,18 +249,35 @@ bool SamplingProfiler::Start() {
 }
 
 bool SamplingProfiler::Stop() {
-  DCHECK(profile_handle_.IsValid());
+  DCHECK(!profiles_.empty());
   DCHECK(is_started_);
   DCHECK(funcs.Get().initialized_);
 
-  NTSTATUS status = funcs.Get().ZwStopProfile(profile_handle_.Get());
-  if (!NT_SUCCESS(status))
+  bool success = true;
+  for (size_t i = 0; i < profiles_.size(); ++i) {
+    NTSTATUS status = funcs.Get().ZwStopProfile(profiles_[i]->handle.Get());
+    if (!NT_SUCCESS(status))
+      success = false;
+  }
+  if (!success)
     return false;
   is_started_ = false;
 
   return true;
 }
 
+void SamplingProfiler::GetBuckets(std::vector<ULONG>* buckets) const {
+  DCHECK(buckets != NULL);
+
+  buckets->assign(num_buckets_, 0);
+  for (size_t i = 0; i < profiles_.size(); ++i) {
+    const std::vector<ULONG>& core_buckets = profiles_[i]->buckets;
+    DCHECK_EQ(num_buckets_, core_buckets.size());
+    for (size_t j = 0; j < num_buckets_; ++j)
+      (*buckets)[j] += core_buckets[j];
+  }
+}
+
 bool SamplingProfiler::SetSamplingInterval(base::TimeDelta sampling_interval) {
   if (!funcs.Get().initialized_)
     return false;
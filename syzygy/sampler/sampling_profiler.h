@@ -18,6 +18,7 @@
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/memory/scoped_vector.h"
 #include "base/time/time.h"
 #include "base/win/scoped_handle.h"
 
@@ -27,6 +28,9 @@ namespace sampler {
 // Each profiler instance covers a range of memory, and while the profiler is
 // running, its buckets will count the number of times the instruction counter
 // lands in the associated range of memory on a sample.
+// To keep samples taken on distinct cores from contending on the same cache
+// lines, each processor samples into its own bucket array; the per-core
+// arrays are merged when the counts are read.
 // The sampling interval is settable, but the setting is system-wide.
 class SamplingProfiler {
  public:
@@ -59,19 +63,42 @@ class SamplingProfiler {
 
   // Accessors.
   bool is_started() const { return is_started_; }
+  size_t num_buckets() const { return num_buckets_; }
 
-  // It is safe to read the counts in the sampling buckets at any time.
+  // Merges the per-core sample counts into |buckets|.
+  // It is safe to merge the counts in the sampling buckets at any time.
   // Note however that there's no guarantee that you'll read consistent counts
-  // until the profiler has been stopped, as the counts may be updating on other
-  // CPU cores.
-  const std::vector<ULONG>& buckets() const { return buckets_; }
+  // until the profiler has been stopped, as the counts may be updating on
+  // other CPU cores.
+  void GetBuckets(std::vector<ULONG>* buckets) const;
 
  private:
-  // Handle to the corresponding kernel object.
-  base::win::ScopedHandle profile_handle_;
+  // The kernel profile object and sample buckets for a single processor.
+  // Each processor samples into its own separately allocated bucket array,
+  // so no cache line is ever written to by more than one core.
+  struct CoreProfile {
+    base::win::ScopedHandle handle;
+    std::vector<ULONG> buckets;
+  };
+  typedef ScopedVector<CoreProfile> CoreProfiles;
+
+  // Creates a kernel profile object that samples the processors in
+  // |processor_mask| into a freshly allocated bucket array, and appends it to
+  // profiles_. Returns true on success.
+  bool CreateProfile(HANDLE process,
+                     void* start,
+                     size_t size,
+                     size_t log2_bucket_size,
+                     DWORD_PTR processor_mask);
+
+  // One profile per processor in the process affinity mask, or a single
+  // profile covering the whole mask when per-core profile objects are not
+  // available.
+  CoreProfiles profiles_;
+  // The number of buckets in each per-core bucket array.
+  size_t num_buckets_;
   // True iff this profiler is started.
   bool is_started_;
-  std::vector<ULONG> buckets_;
 
   DISALLOW_COPY_AND_ASSIGN(SamplingProfiler);
 };
@@ -79,8 +79,12 @@ TEST_F(SamplingProfilerTest, Sample) {
   ASSERT_TRUE(
       profiler.Initialize(process.Get(), code_start, code_size, 31));
 
-  ASSERT_EQ(1, profiler.buckets().size());
-  ASSERT_EQ(0, profiler.buckets()[0]);
+  ASSERT_EQ(1, profiler.num_buckets());
+
+  std::vector<ULONG> buckets;
+  profiler.GetBuckets(&buckets);
+  ASSERT_EQ(1, buckets.size());
+  ASSERT_EQ(0, buckets[0]);
 
   // We use a roomy timeout to make sure this test is not flaky.
   // On the buildbots, there may not be a whole lot of CPU time
@@ -102,18 +106,16 @@ TEST_F(SamplingProfilerTest, Sample) {
   // Start the profiler.
   ASSERT_TRUE(profiler.Start());
 
-  // Get a volatile pointer to our bucket to make sure that the compiler
-  // doesn't optimize out the test in the loop that follows.
-  volatile const ULONG* bucket_ptr = &profiler.buckets()[0];
-
   // Spin for spin_time wall-clock seconds, or until we get some samples.
   // Note that sleeping isn't going to do us any good, the samples only
-  // accrue while we're executing code.
+  // accrue while we're executing code. The per-core bucket arrays are merged
+  // on every iteration to observe the counts as they update.
   base::Time start = base::Time::Now();
   base::TimeDelta elapsed;
   do {
     elapsed = base::Time::Now() - start;
-  } while ((elapsed < spin_time) && *bucket_ptr == 0);
+    profiler.GetBuckets(&buckets);
+  } while ((elapsed < spin_time) && buckets[0] == 0);
 
   // Stop the profiler.
   ASSERT_TRUE(profiler.Stop());
@@ -122,7 +124,8 @@ TEST_F(SamplingProfilerTest, Sample) {
   ASSERT_TRUE(SamplingProfiler::SetSamplingInterval(save_sampling_interval));
 
   // Check that we got some samples.
-  ASSERT_NE(0U, profiler.buckets()[0]);
+  profiler.GetBuckets(&buckets);
+  ASSERT_NE(0U, buckets[0]);
 }
 
 }  // namespace sampler
@@ -23,7 +23,8 @@ HeatMapSimulation::HeatMapSimulation()
       memory_slice_bytes_(kDefaultMemorySliceSize),
       max_time_slice_usecs_(0),
       max_memory_slice_bytes_(0),
-      output_individual_functions_(false) {
+      output_individual_functions_(false),
+      num_block_ids_(0) {
 }
 
 bool HeatMapSimulation::TimeSlice::PrintJSONFunctions(
@@ -67,6 +68,9 @@ bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
 
   DCHECK(output != NULL);
 
+  // Make sure any dense counters make it into time_memory_map_.
+  FlushDenseCounts();
+
   core::JSONFileWriter json_file(output, pretty_print);
 
   if (!json_file.OpenDict() ||
@@ -132,6 +136,16 @@ bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
   return json_file.Finished();
 }
 
+void HeatMapSimulation::OnImageDecomposed(size_t num_block_ids) {
+  // Dense counters accumulated with a previous id space would be folded
+  // with the wrong blocks.
+  DCHECK(dense_counts_.empty());
+
+  num_block_ids_ = num_block_ids;
+  blocks_by_id_.clear();
+  blocks_by_id_.resize(num_block_ids);
+}
+
 void HeatMapSimulation::OnProcessStarted(base::Time time,
                                          size_t /*default_page_size*/) {
   // Set the entry time of this process.
@@ -140,19 +154,37 @@ void HeatMapSimulation::OnProcessStarted(base::Time time,
 
 void HeatMapSimulation::OnFunctionEntry(base::Time time,
                                         const Block* block) {
+  DCHECK(block != NULL);
+
   // Get the time when this function was called since the process start.
   time_t relative_time = (time - process_start_time_).InMicroseconds();
 
+  TimeSliceId time_slice = relative_time / time_slice_usecs_;
+  max_time_slice_usecs_ = std::max(max_time_slice_usecs_, time_slice);
+
+  if (block->id() < num_block_ids_) {
+    // Dense mode: bump a single per-block counter and defer splitting the
+    // block over memory slices to FlushDenseCounts.
+    DenseCounts& counts = dense_counts_[time_slice];
+    if (counts.empty())
+      counts.resize(num_block_ids_, 0);
+    counts[block->id()]++;
+    blocks_by_id_[block->id()] = block;
+    return;
+  }
+
   // Since we will insert to a map many TimeSlices with the same entry time,
   // we can pass RegisterFunction a reference to the TimeSlice in the map.
   // This way, RegisterFunction doesn't have to search for that position
   // every time it gets called and the time complexity gets reduced
   // in a logarithmic scale.
-  TimeSliceId time_slice = relative_time / time_slice_usecs_;
-  TimeSlice& slice = time_memory_map_[time_slice];
-
-  max_time_slice_usecs_ = std::max(max_time_slice_usecs_, time_slice);
+  RegisterFunction(&time_memory_map_[time_slice], block, 1);
+}
 
+void HeatMapSimulation::RegisterFunction(TimeSlice* time_slice,
+                                         const Block* block,
+                                         uint32 count) {
+  DCHECK(time_slice != NULL);
   DCHECK(block != NULL);
   DCHECK(memory_slice_bytes_ != 0);
   const uint32 block_start = block->addr().value();
@@ -163,7 +195,7 @@ void HeatMapSimulation::OnFunctionEntry(base::Time time,
   const uint32 last_slice = (block_start + size - 1) / memory_slice_bytes_;
   if (first_slice == last_slice) {
     // This function fits in a single memory slice. Add it to our time slice.
-    slice.AddSlice(first_slice, name, size);
+    time_slice->AddSlice(first_slice, name, count * size);
   } else {
     // This function takes several memory slices. Add the first and last
     // slices to our time slice only with the part of the slice they use,
@@ -175,17 +207,34 @@ void HeatMapSimulation::OnFunctionEntry(base::Time time,
         ((block_start + size - 1 + memory_slice_bytes_) %
             memory_slice_bytes_) + 1;
 
-    slice.AddSlice(first_slice, name, leading_bytes);
-    slice.AddSlice(last_slice, name, trailing_bytes);
+    time_slice->AddSlice(first_slice, name, count * leading_bytes);
+    time_slice->AddSlice(last_slice, name, count * trailing_bytes);
 
     const uint32 kStartIndex = block_start / memory_slice_bytes_ + 1;
     const uint32 kEndIndex = (block_start + size - 1) / memory_slice_bytes_;
 
     for (uint32 i = kStartIndex; i < kEndIndex; i++)
-      slice.AddSlice(i, name, memory_slice_bytes_);
+      time_slice->AddSlice(i, name, count * memory_slice_bytes_);
   }
 
   max_memory_slice_bytes_ = std::max(max_memory_slice_bytes_, last_slice);
 }
 
+void HeatMapSimulation::FlushDenseCounts() {
+  DenseCountsMap::const_iterator counts_iter = dense_counts_.begin();
+  for (; counts_iter != dense_counts_.end(); ++counts_iter) {
+    TimeSlice& slice = time_memory_map_[counts_iter->first];
+    const DenseCounts& counts = counts_iter->second;
+
+    for (size_t id = 0; id < counts.size(); ++id) {
+      if (counts[id] == 0)
+        continue;
+      DCHECK(blocks_by_id_[id] != NULL);
+      RegisterFunction(&slice, blocks_by_id_[id], counts[id]);
+    }
+  }
+
+  dense_counts_.clear();
+}
+
 }  // namespace simulate
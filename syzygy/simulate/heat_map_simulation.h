@@ -19,6 +19,7 @@
 #define SYZYGY_SIMULATE_HEAT_MAP_SIMULATION_H_
 
 #include <map>
+#include <vector>
 
 #include "base/strings/string_piece.h"
 #include "syzygy/core/json_file_writer.h"
@@ -44,6 +45,12 @@ namespace simulate {
 //
 // If the time slice size or the memory slice size are not set, the default
 // values of 1 and 0x8000, respectively, are used.
+//
+// If OnImageDecomposed reports the number of block ids in the image, the
+// function entry events are accumulated in dense per-time-slice counter
+// arrays indexed by block id, and only folded into the sparse maps when the
+// output is serialized. This avoids the per-event map lookups and string
+// copies, which dominate the cost of simulating big traces.
 class HeatMapSimulation : public SimulationEventHandler {
  public:
   class TimeSlice;
@@ -94,8 +101,19 @@ class HeatMapSimulation : public SimulationEventHandler {
   }
   // @}
 
+  // Folds any dense per-block counters accumulated so far into
+  // time_memory_map(). Called automatically by SerializeToJSON; only needs
+  // to be called explicitly if time_memory_map() is read directly.
+  void FlushDenseCounts();
+
   // @name SimulationEventHandler implementation
   // @{
+  // Enables dense accumulation, with per-time-slice counter arrays indexed
+  // by block id.
+  // @param num_block_ids The number of block ids in the image, or 0 to
+  //     accumulate directly in the sparse maps.
+  void OnImageDecomposed(size_t num_block_ids) OVERRIDE;
+
   // Sets the entry time of the trace file.
   // @param time The startup time of the execution.
   void OnProcessStarted(base::Time time, size_t default_page_size) OVERRIDE;
@@ -178,6 +196,20 @@ class HeatMapSimulation : public SimulationEventHandler {
   // @}
 
  protected:
+  // The number of function entries of each block during a time slice,
+  // indexed by block id.
+  typedef std::vector<uint32> DenseCounts;
+  typedef std::map<TimeSliceId, DenseCounts> DenseCountsMap;
+
+  // Registers count entries of the given block in a time slice, splitting
+  // the block over the memory slices it covers.
+  // @param time_slice The time slice the block was entered in.
+  // @param block The function block that was entered.
+  // @param count The number of times the block was entered.
+  void RegisterFunction(TimeSlice* time_slice,
+                        const Block* block,
+                        uint32 count);
+
   // The size of each time block on the heat map, in microseconds.
   uint32 time_slice_usecs_;
 
@@ -201,6 +233,19 @@ class HeatMapSimulation : public SimulationEventHandler {
   // in each time/memory block. This gives more information and is useful
   // for analysis, but may make the output files excessively big.
   bool output_individual_functions_;
+
+  // The number of block ids in the image, or 0 if it is unknown. Non-zero
+  // values enable the dense accumulation mode.
+  size_t num_block_ids_;
+
+  // The dense per-time-slice function entry counters. Only used when
+  // num_block_ids_ is non-zero; folded into time_memory_map_ by
+  // FlushDenseCounts.
+  DenseCountsMap dense_counts_;
+
+  // The function blocks seen so far, indexed by block id. Used to recover
+  // the block of each dense counter when the counters are folded.
+  std::vector<const Block*> blocks_by_id_;
 };
 
 // Stores the respective memory slices of a particular time slice in a map.
@@ -401,6 +401,55 @@ TEST_F(HeatMapSimulationTest, BigTimeSliceSizeSmallMemorySliceSize) {
   EXPECT_EQ(simulation_->max_memory_slice_bytes(), 13);
 }
 
+TEST_F(HeatMapSimulationTest, DenseModeMatchesSparseMode) {
+  // Run the same events through a sparse simulation and through one with
+  // dense accumulation enabled; both must end up with the same heat map.
+  HeatMapSimulation dense_simulation;
+  size_t num_block_ids = block_graph_.blocks().rbegin()->first + 1;
+  dense_simulation.OnImageDecomposed(num_block_ids);
+
+  simulation_->set_memory_slice_bytes(2);
+  dense_simulation.set_memory_slice_bytes(2);
+
+  simulation_->OnProcessStarted(time, 1);
+  dense_simulation.OnProcessStarted(time, 1);
+
+  for (uint32 i = 0; i < arraysize(blocks_); i++) {
+    simulation_->OnFunctionEntry(Time::FromTimeT(blocks_[i].time),
+                                 blocks_[i].block);
+    dense_simulation.OnFunctionEntry(Time::FromTimeT(blocks_[i].time),
+                                     blocks_[i].block);
+  }
+
+  // The dense counters aren't visible in the map until they are folded.
+  EXPECT_TRUE(dense_simulation.time_memory_map().empty());
+  dense_simulation.FlushDenseCounts();
+
+  EXPECT_EQ(simulation_->max_time_slice_usecs(),
+            dense_simulation.max_time_slice_usecs());
+  EXPECT_EQ(simulation_->max_memory_slice_bytes(),
+            dense_simulation.max_memory_slice_bytes());
+
+  ASSERT_EQ(simulation_->time_memory_map().size(),
+            dense_simulation.time_memory_map().size());
+
+  HeatMapSimulation::TimeMemoryMap::const_iterator sparse_iter =
+      simulation_->time_memory_map().begin();
+  HeatMapSimulation::TimeMemoryMap::const_iterator dense_iter =
+      dense_simulation.time_memory_map().begin();
+  for (; sparse_iter != simulation_->time_memory_map().end();
+       ++sparse_iter, ++dense_iter) {
+    EXPECT_EQ(sparse_iter->first, dense_iter->first);
+    EXPECT_EQ(sparse_iter->second.total(), dense_iter->second.total());
+    ASSERT_EQ(sparse_iter->second.slices().size(),
+              dense_iter->second.slices().size());
+    EXPECT_TRUE(std::equal(sparse_iter->second.slices().begin(),
+                           sparse_iter->second.slices().end(),
+                           dense_iter->second.slices().begin(),
+                           CompareMemorySlices<true>()));
+  }
+}
+
 TEST_F(HeatMapSimulationTest, RandomInput) {
   // Using a blocks_ and its respective output,
   // generate several other random inputs that should result in the
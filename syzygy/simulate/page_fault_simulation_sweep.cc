@@ -0,0 +1,181 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/page_fault_simulation_sweep.h"
+
+#include <algorithm>
+
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace simulate {
+
+namespace {
+
+// Replays a batch of buffered events against the configurations whose index
+// is congruent to worker_index modulo num_workers. The configurations are
+// independent of one another, so the workers share no mutable state.
+class ReplayEventsWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  typedef PageFaultSimulationSweep::Event Event;
+
+  ReplayEventsWorker(const std::vector<Event>* events,
+                     const ScopedVector<PageFaultSimulation>* simulations,
+                     size_t worker_index,
+                     size_t num_workers)
+      : events_(events),
+        simulations_(simulations),
+        worker_index_(worker_index),
+        num_workers_(num_workers) {
+    DCHECK(events != NULL);
+    DCHECK(simulations != NULL);
+    DCHECK_LT(worker_index, num_workers);
+  }
+
+  virtual void Run() OVERRIDE {
+    for (size_t i = worker_index_; i < simulations_->size();
+         i += num_workers_) {
+      PageFaultSimulation* simulation = (*simulations_)[i];
+      for (size_t j = 0; j < events_->size(); ++j) {
+        const Event& event = (*events_)[j];
+        simulation->OnFunctionEntry(event.time, event.block);
+      }
+    }
+  }
+
+ private:
+  const std::vector<Event>* events_;
+  const ScopedVector<PageFaultSimulation>* simulations_;
+  size_t worker_index_;
+  size_t num_workers_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayEventsWorker);
+};
+
+}  // namespace
+
+PageFaultSimulationSweep::PageFaultSimulationSweep() {
+}
+
+PageFaultSimulation* PageFaultSimulationSweep::AddSimulation(
+    size_t page_size, size_t pages_per_code_fault) {
+  // Configurations added after events have been received would miss the
+  // events already replayed.
+  DCHECK(events_.empty());
+
+  PageFaultSimulation* simulation = new PageFaultSimulation();
+  if (page_size != 0)
+    simulation->set_page_size(page_size);
+  if (pages_per_code_fault != 0)
+    simulation->set_pages_per_code_fault(pages_per_code_fault);
+  simulations_.push_back(simulation);
+
+  return simulation;
+}
+
+void PageFaultSimulationSweep::OnProcessStarted(base::Time time,
+                                                size_t default_page_size) {
+  for (size_t i = 0; i < simulations_.size(); ++i)
+    simulations_[i]->OnProcessStarted(time, default_page_size);
+}
+
+void PageFaultSimulationSweep::OnFunctionEntry(base::Time time,
+                                               const Block* block) {
+  DCHECK(block != NULL);
+
+  Event event = { time, block };
+  events_.push_back(event);
+
+  if (events_.size() >= kEventBatchSize)
+    FlushEvents();
+}
+
+void PageFaultSimulationSweep::FlushEvents() {
+  if (events_.empty())
+    return;
+
+  size_t num_workers = std::min(
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()),
+      simulations_.size());
+
+  if (num_workers <= 1) {
+    // Not enough work to parallelize; replay on this thread.
+    ReplayEventsWorker worker(&events_, &simulations_, 0, 1);
+    worker.Run();
+  } else {
+    ScopedVector<ReplayEventsWorker> workers;
+    ScopedVector<base::DelegateSimpleThread> threads;
+    for (size_t i = 0; i < num_workers; ++i) {
+      workers.push_back(
+          new ReplayEventsWorker(&events_, &simulations_, i, num_workers));
+      threads.push_back(new base::DelegateSimpleThread(
+          workers.back(), "SimulationSweepWorker"));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Start();
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Join();
+  }
+
+  events_.clear();
+}
+
+bool PageFaultSimulationSweep::SerializeToJSON(FILE* output,
+                                               bool pretty_print) {
+  DCHECK(output != NULL);
+
+  // Replay any events still buffered before reporting.
+  FlushEvents();
+
+  core::JSONFileWriter json_file(output, pretty_print);
+
+  if (!json_file.OpenList())
+    return false;
+
+  for (size_t i = 0; i < simulations_.size(); ++i) {
+    const PageFaultSimulation* simulation = simulations_[i];
+    if (!json_file.OpenDict() ||
+        !json_file.OutputKey("page_size") ||
+        !json_file.OutputInteger(simulation->page_size()) ||
+        !json_file.OutputKey("pages_per_code_fault") ||
+        !json_file.OutputInteger(simulation->pages_per_code_fault()) ||
+        !json_file.OutputKey("fault_count") ||
+        !json_file.OutputInteger(simulation->fault_count()) ||
+        !json_file.OutputKey("loaded_pages") ||
+        !json_file.OpenList()) {
+      return false;
+    }
+
+    PageFaultSimulation::PageSet::const_iterator page =
+        simulation->pages().begin();
+    for (; page != simulation->pages().end(); ++page) {
+      if (!json_file.OutputInteger(*page))
+        return false;
+    }
+
+    if (!json_file.CloseList() ||
+        !json_file.CloseDict()) {
+      return false;
+    }
+  }
+
+  if (!json_file.CloseList())
+    return false;
+
+  DCHECK(json_file.Finished());
+  return true;
+}
+
+}  // namespace simulate
@@ -0,0 +1,104 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file provides the PageFaultSimulationSweep class.
+
+#ifndef SYZYGY_SIMULATE_PAGE_FAULT_SIMULATION_SWEEP_H_
+#define SYZYGY_SIMULATE_PAGE_FAULT_SIMULATION_SWEEP_H_
+
+#include <vector>
+
+#include "base/memory/scoped_vector.h"
+#include "syzygy/simulate/page_fault_simulation.h"
+#include "syzygy/simulate/simulation_event_handler.h"
+
+namespace simulate {
+
+// A SimulationEventHandler that evaluates several PageFaultSimulation
+// configurations in a single replay of the trace files. Function entry
+// events are buffered and periodically replayed against all the
+// configurations, with each worker thread updating a disjoint subset of
+// them, so sweeping N parameter sets costs one trace parse instead of N.
+// Sample usage:
+//
+// PageFaultSimulationSweep sweep;
+//
+// sweep.AddSimulation(0x1000, 8);
+// sweep.AddSimulation(0x2000, 8);
+// sweep.OnProcessStarted(time, 0);
+// sweep.OnFunctionEntry(time, block);
+// sweep.SerializeToJSON(file, pretty_print);
+class PageFaultSimulationSweep : public SimulationEventHandler {
+ public:
+  typedef PageFaultSimulation::Block Block;
+
+  // The number of buffered function entry events replayed at a time.
+  static const size_t kEventBatchSize = 4096;
+
+  // A buffered function entry event.
+  struct Event {
+    base::Time time;
+    const Block* block;
+  };
+
+  // Constructs a new PageFaultSimulationSweep instance with no
+  // configurations.
+  PageFaultSimulationSweep();
+
+  // Adds a configuration to the sweep. All the configurations must be added
+  // before the first event is received.
+  // @param page_size The page size of this configuration, in bytes, or 0 to
+  //     deduce it from the trace file data.
+  // @param pages_per_code_fault The number of pages loaded on each
+  //     code-fault, or 0 to use the default value.
+  // @returns the newly added simulation, owned by this class.
+  PageFaultSimulation* AddSimulation(size_t page_size,
+                                     size_t pages_per_code_fault);
+
+  // @name Accessors
+  // @{
+  const ScopedVector<PageFaultSimulation>& simulations() const {
+    return simulations_;
+  }
+  // @}
+
+  // @name SimulationEventHandler implementation
+  // @{
+  void OnProcessStarted(base::Time time, size_t default_page_size) OVERRIDE;
+
+  // Buffers the event, replaying the buffered batch against every
+  // configuration once it's full.
+  void OnFunctionEntry(base::Time time, const Block* block) OVERRIDE;
+
+  // The serialization consists of a list with one dictionary per
+  // configuration, in the order the configurations were added.
+  bool SerializeToJSON(FILE* output, bool pretty_print) OVERRIDE;
+  // @}
+
+ protected:
+  // Replays the buffered events against every configuration and clears the
+  // buffer. The configurations are updated on as many workers as there are
+  // processors, each owning a disjoint subset of them.
+  void FlushEvents();
+
+  // The simulations of the sweep, one per configuration.
+  ScopedVector<PageFaultSimulation> simulations_;
+
+  // The function entry events received since the last flush.
+  std::vector<Event> events_;
+};
+
+}  // namespace simulate
+
+#endif  // SYZYGY_SIMULATE_PAGE_FAULT_SIMULATION_SWEEP_H_
@@ -0,0 +1,169 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/page_fault_simulation_sweep.h"
+
+#include "base/values.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace simulate {
+
+namespace {
+
+using base::ListValue;
+using base::Value;
+using block_graph::BlockGraph;
+
+// Exposes the protected bits of PageFaultSimulationSweep for testing.
+class TestPageFaultSimulationSweep : public PageFaultSimulationSweep {
+ public:
+  using PageFaultSimulationSweep::FlushEvents;
+};
+
+class PageFaultSimulationSweepTest : public testing::PELibUnitTest {
+ public:
+  struct MockBlockInfo {
+    uint32 start;
+    size_t size;
+    BlockGraph::Block* block;
+
+    MockBlockInfo(uint32 start_, size_t size_, BlockGraph* block_graph)
+        : start(start_), size(size_), block(NULL) {
+      DCHECK(block_graph != NULL);
+      block = block_graph->AddBlock(BlockGraph::CODE_BLOCK, size_, "block");
+      block->set_addr(core::RelativeAddress(start));
+      block->set_size(size);
+    }
+
+    MockBlockInfo()
+        : start(0U), size(0U), block(NULL) {
+    }
+  };
+
+  void SetUp() {
+    ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir_));
+
+    blocks_[0] = MockBlockInfo(0x0, 0x50, &block_graph_);
+    blocks_[1] = MockBlockInfo(0x0, 0x100, &block_graph_);
+    blocks_[2] = MockBlockInfo(0x350, 0x100, &block_graph_);
+    blocks_[3] = MockBlockInfo(0x1000, 0x50, &block_graph_);
+  }
+
+ protected:
+  base::FilePath temp_dir_;
+  MockBlockInfo blocks_[4];
+  const base::Time time_;
+
+  BlockGraph block_graph_;
+};
+
+}  // namespace
+
+TEST_F(PageFaultSimulationSweepTest, MatchesIndividualSimulations) {
+  static const size_t kPageSizes[] = { 0x20, 0x1000 };
+  static const size_t kPagesPerCodeFaults[] = { 1, 8 };
+
+  TestPageFaultSimulationSweep sweep;
+  ScopedVector<PageFaultSimulation> references;
+
+  // Build the cross product of the two parameter lists, both in the sweep
+  // and as individually driven reference simulations.
+  for (size_t i = 0; i < arraysize(kPageSizes); ++i) {
+    for (size_t j = 0; j < arraysize(kPagesPerCodeFaults); ++j) {
+      sweep.AddSimulation(kPageSizes[i], kPagesPerCodeFaults[j]);
+
+      PageFaultSimulation* reference = new PageFaultSimulation();
+      reference->set_page_size(kPageSizes[i]);
+      reference->set_pages_per_code_fault(kPagesPerCodeFaults[j]);
+      references.push_back(reference);
+    }
+  }
+  ASSERT_EQ(references.size(), sweep.simulations().size());
+
+  sweep.OnProcessStarted(time_, 1);
+  for (size_t i = 0; i < references.size(); ++i)
+    references[i]->OnProcessStarted(time_, 1);
+
+  // Feed the same event sequence to the sweep and to each reference.
+  for (size_t i = 0; i < arraysize(blocks_); ++i) {
+    sweep.OnFunctionEntry(time_, blocks_[i].block);
+    for (size_t j = 0; j < references.size(); ++j)
+      references[j]->OnFunctionEntry(time_, blocks_[i].block);
+  }
+  sweep.FlushEvents();
+
+  // Every configuration of the sweep must end up in the same state as its
+  // individually driven twin.
+  for (size_t i = 0; i < references.size(); ++i) {
+    const PageFaultSimulation* simulation = sweep.simulations()[i];
+    EXPECT_EQ(references[i]->page_size(), simulation->page_size());
+    EXPECT_EQ(references[i]->pages_per_code_fault(),
+              simulation->pages_per_code_fault());
+    EXPECT_EQ(references[i]->fault_count(), simulation->fault_count());
+    EXPECT_EQ(references[i]->pages(), simulation->pages());
+  }
+}
+
+TEST_F(PageFaultSimulationSweepTest, JSONSucceeds) {
+  PageFaultSimulationSweep sweep;
+  sweep.AddSimulation(0x1000, 8);
+  sweep.AddSimulation(0x8000, 8);
+
+  sweep.OnProcessStarted(time_, 1);
+  for (size_t i = 0; i < arraysize(blocks_); ++i)
+    sweep.OnFunctionEntry(time_, blocks_[i].block);
+
+  // Output JSON data to a file.
+  base::FilePath path;
+  base::ScopedFILE temp_file;
+  temp_file.reset(base::CreateAndOpenTemporaryFileInDir(
+      temp_dir_, &path));
+
+  ASSERT_TRUE(temp_file.get() != NULL);
+  ASSERT_TRUE(sweep.SerializeToJSON(temp_file.get(), false));
+  temp_file.reset();
+
+  // Read the JSON file we just wrote.
+  std::string file_string;
+  ASSERT_TRUE(base::ReadFileToString(path, &file_string));
+
+  scoped_ptr<Value> value(base::JSONReader::Read(file_string));
+  ASSERT_TRUE(value.get() != NULL);
+  ASSERT_TRUE(value->IsType(Value::TYPE_LIST));
+
+  // There should be one dictionary per configuration, in order.
+  const ListValue* outer_list = static_cast<const ListValue*>(value.get());
+  ASSERT_EQ(2u, outer_list->GetSize());
+
+  static const size_t kExpectedPageSizes[] = { 0x1000, 0x8000 };
+  for (size_t i = 0; i < arraysize(kExpectedPageSizes); ++i) {
+    const base::DictionaryValue* dict = NULL;
+    ASSERT_TRUE(outer_list->GetDictionary(i, &dict));
+
+    int page_size = 0, pages_per_code_fault = 0, fault_count = 0;
+    EXPECT_TRUE(dict->GetInteger("page_size", &page_size));
+    EXPECT_TRUE(dict->GetInteger("pages_per_code_fault",
+                                 &pages_per_code_fault));
+    EXPECT_TRUE(dict->GetInteger("fault_count", &fault_count));
+
+    EXPECT_EQ(kExpectedPageSizes[i], implicit_cast<size_t>(page_size));
+    EXPECT_EQ(8, pages_per_code_fault);
+    EXPECT_EQ(sweep.simulations()[i]->fault_count(),
+              implicit_cast<size_t>(fault_count));
+  }
+}
+
+}  // namespace simulate
@@ -25,6 +25,8 @@
         'heat_map_simulation.h',
         'page_fault_simulation.cc',
         'page_fault_simulation.h',
+        'page_fault_simulation_sweep.cc',
+        'page_fault_simulation_sweep.h',
         'simulation_event_handler.h',
         'simulator.cc',
         'simulator.h',
@@ -53,6 +55,7 @@
       'type': 'executable',
       'sources': [
         'heat_map_simulation_unittest.cc',
+        'page_fault_simulation_sweep_unittest.cc',
         'page_fault_simulation_unittest.cc',
         'simulator_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
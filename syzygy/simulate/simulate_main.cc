@@ -22,14 +22,17 @@
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
 #include "syzygy/simulate/heat_map_simulation.h"
 #include "syzygy/simulate/page_fault_simulation.h"
+#include "syzygy/simulate/page_fault_simulation_sweep.h"
 #include "syzygy/simulate/simulator.h"
 
 namespace {
 
 using simulate::HeatMapSimulation;
 using simulate::PageFaultSimulation;
+using simulate::PageFaultSimulationSweep;
 using simulate::SimulationEventHandler;
 using simulate::Simulator;
 
@@ -47,6 +50,13 @@ const char kUsage[] =
     "      --pages-per-code-fault=INT The number of pages loaded by each\n"
     "          page-fault (default 8)\n"
     "      --page-size=INT the size of each page, in bytes (default 4KB).\n"
+    "      --page-sizes=INT,INT,... evaluate several page sizes in a single\n"
+    "          replay of the trace files (0 deduces the size from the\n"
+    "          traces). May be combined with --pages-per-code-faults; the\n"
+    "          cross product of both lists is simulated.\n"
+    "      --pages-per-code-faults=INT,INT,... evaluate several\n"
+    "          pages-per-code-fault values in a single replay of the trace\n"
+    "          files (0 uses the default value).\n"
     "    For heat map method:\n"
     "      --time-slice-usecs=INT the size of each time slice in the heatmap,\n"
     "          in microseconds (default 1).\n"
@@ -60,6 +70,26 @@ int Usage(const char* message) {
   return 1;
 }
 
+// Parses a comma-separated list of non-negative integers. An empty string
+// parses to an empty list.
+bool ParseIntList(const std::string& value, std::vector<int>* values) {
+  DCHECK(values != NULL);
+
+  if (value.empty())
+    return true;
+
+  std::vector<std::string> parts;
+  base::SplitString(value, ',', &parts);
+  for (size_t i = 0; i < parts.size(); ++i) {
+    int parsed = 0;
+    if (!base::StringToInt(parts[i], &parsed) || parsed < 0)
+      return false;
+    values->push_back(parsed);
+  }
+
+  return true;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -97,7 +127,37 @@ int main(int argc, char** argv) {
 
   scoped_ptr<SimulationEventHandler> simulation;
 
-  if (simulate_method == "pagefault") {
+  if (simulate_method == "pagefault" &&
+      (cmd_line->HasSwitch("page-sizes") ||
+       cmd_line->HasSwitch("pages-per-code-faults"))) {
+    PageFaultSimulationSweep* sweep = new PageFaultSimulationSweep();
+    DCHECK(sweep != NULL);
+    simulation.reset(sweep);
+
+    std::vector<int> page_sizes;
+    std::vector<int> pages_per_code_faults;
+    if (!ParseIntList(cmd_line->GetSwitchValueASCII("page-sizes"),
+                      &page_sizes)) {
+      return Usage("Invalid page-sizes value.");
+    }
+    if (!ParseIntList(cmd_line->GetSwitchValueASCII("pages-per-code-faults"),
+                      &pages_per_code_faults)) {
+      return Usage("Invalid pages-per-code-faults value.");
+    }
+
+    // An absent list simply means that parameter isn't being swept, so use
+    // the single default value for it.
+    if (page_sizes.empty())
+      page_sizes.push_back(0);
+    if (pages_per_code_faults.empty())
+      pages_per_code_faults.push_back(0);
+
+    // Simulate the cross product of both parameter lists in one replay.
+    for (size_t i = 0; i < page_sizes.size(); ++i) {
+      for (size_t j = 0; j < pages_per_code_faults.size(); ++j)
+        sweep->AddSimulation(page_sizes[i], pages_per_code_faults[j]);
+    }
+  } else if (simulate_method == "pagefault") {
     PageFaultSimulation* page_fault_simulation = new PageFaultSimulation();
     DCHECK(page_fault_simulation != NULL);
     simulation.reset(page_fault_simulation);
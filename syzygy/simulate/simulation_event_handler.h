@@ -29,6 +29,14 @@ namespace simulate {
 // in ParseEventHandler.
 class SimulationEventHandler {
  public:
+  // Issued once, when the image has been decomposed and before any trace
+  // event is dispatched. Simulations may use this to size dense data
+  // structures. The default implementation ignores the notification.
+  // @param num_block_ids The number of block ids in the image's block-graph;
+  //     the id of every block passed to OnFunctionEntry is smaller than
+  //     this value.
+  virtual void OnImageDecomposed(size_t num_block_ids) { }
+
   // Issued once, prior to the first OnFunctionEntry event in each
   // instrumented module.
   // @param time The entry time of this process.
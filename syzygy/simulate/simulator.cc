@@ -53,6 +53,21 @@ bool Simulator::ParseTraceFiles() {
     return false;
   }
 
+  // The simulation sizes its data structures from the decomposed image
+  // before any events are consumed, so complete the decomposition
+  // prefetch here.
+  if (!playback_->EnsureImageDecomposed()) {
+    playback_.reset();
+    return false;
+  }
+
+  // Now that the image has been decomposed, let the simulation size any
+  // dense data structures it may want to use.
+  size_t num_block_ids = 0;
+  if (!block_graph_.blocks().empty())
+    num_block_ids = block_graph_.blocks().rbegin()->first + 1;
+  simulation_->OnImageDecomposed(num_block_ids);
+
   if (!parser_->Consume()) {
     playback_.reset();
     return false;
@@ -17,9 +17,13 @@
 
 #include "syzygy/swapimport/swapimport_app.h"
 
+#include <windows.h>
+
 #include "base/file_util.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/common/com_utils.h"
 #include "syzygy/core/file_util.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/pe/pe_file_writer.h"
@@ -33,14 +37,118 @@ static const char kUsageFormatStr[] = "Usage: %ls [options] IMPORT\n"
     "    --input-image=PATH    Path of the input image.\n"
     "    --output-image=PATH   Path where the output image will be written.\n"
     "                          The generated image will still be paired to\n"
-    "                          the original PDB file.\n"
+    "                          the original PDB file. Must not be specified\n"
+    "                          when patching in place.\n"
     "    --x64                 Decompose a 64-bit binary rather than a\n"
     "                          32-bit one.\n"
     "  Options:\n"
+    "    --in-place            Patch the input image directly rather than\n"
+    "                          writing a copy of it. Only the pages\n"
+    "                          containing the import directory are\n"
+    "                          rewritten.\n"
     "    --overwrite           Allow output files to be overwritten.\n"
     "    --verbose             Log verbosely.\n"
     "\n";
 
+// Walks the import descriptors of @p pe_file within the raw image contents
+// @p image and swaps the import named @p import_name into the first
+// position. On success sets @p dirty_start and @p dirty_size to the file
+// offset extent of the bytes that may have been modified; this extent is
+// empty if the import was already in the first position. Returns 0 on
+// success, 1 otherwise, mirroring the process exit codes of the tool.
+template <typename PEFileType>
+int SwapImportsInImage(const PEFileType& pe_file,
+                       const std::string& import_name,
+                       unsigned char* image,
+                       size_t* dirty_start,
+                       size_t* dirty_size) {
+  DCHECK_NE(reinterpret_cast<unsigned char*>(NULL), image);
+  DCHECK_NE(reinterpret_cast<size_t*>(NULL), dirty_start);
+  DCHECK_NE(reinterpret_cast<size_t*>(NULL), dirty_size);
+
+  *dirty_start = 0;
+  *dirty_size = 0;
+
+  // Keeps track of matched imports, and how many have been swapped.
+  size_t imports_swapped = 0;
+  size_t imports_matched = 0;
+
+  // Look up the import directory.
+  LOG(INFO) << "Processing NT headers.";
+  const IMAGE_DATA_DIRECTORY* data_dir =
+      pe_file.nt_headers()->OptionalHeader.DataDirectory +
+          IMAGE_DIRECTORY_ENTRY_IMPORT;
+  if (data_dir->Size != 0) {
+    LOG(INFO) << "Processing imports.";
+
+    pe::PEFile::FileOffsetAddress import_offset;
+    if (!pe_file.Translate(
+            pe::PEFile::RelativeAddress(data_dir->VirtualAddress),
+            &import_offset)) {
+      LOG(ERROR) << "Failed to translate import directory address.";
+      return 1;
+    }
+
+    // Walk over the imports.
+    IMAGE_IMPORT_DESCRIPTOR* imports_begin =
+        reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR*>(
+            image + import_offset.value());
+    IMAGE_IMPORT_DESCRIPTOR* imports_end =
+        reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR*>(
+            image + import_offset.value() + data_dir->Size);
+    IMAGE_IMPORT_DESCRIPTOR* imports = imports_begin;
+    size_t import_index = 0;
+    while (imports < imports_end && imports->Characteristics != 0) {
+      // Look up the import name.
+      pe::PEFile::FileOffsetAddress name_offset;
+      if (!pe_file.Translate(
+              pe::PEFile::RelativeAddress(imports->Name),
+              &name_offset)) {
+        LOG(ERROR) << "Failed to translate import name.";
+        return 1;
+      }
+
+      // Compare the import name.
+      const char* name = reinterpret_cast<const char*>(
+          image + name_offset.value());
+      VLOG(1) << "Processing import " << import_index << " \""
+              << name << "\".";
+      if (base::strcasecmp(import_name.c_str(), name) == 0) {
+        VLOG(1) << "Import " << import_index << " matches import name.";
+        ++imports_matched;
+
+        if (import_index > imports_swapped) {
+          // Do the actual swapping of the imports.
+          LOG(INFO) << "Swapping imports " << imports_swapped << " and "
+                    << import_index;
+
+          IMAGE_IMPORT_DESCRIPTOR temp_iid = *imports;
+          *imports = imports_begin[imports_swapped];
+          imports_begin[imports_swapped] = temp_iid;
+
+          ++imports_swapped;
+        }
+      }
+
+      ++imports;
+      ++import_index;
+    }
+
+    if (imports_swapped > 0) {
+      *dirty_start = import_offset.value();
+      *dirty_size = data_dir->Size;
+    }
+  }
+
+  // We expect to have matched the specified import at least once.
+  if (imports_matched == 0) {
+    LOG(ERROR) << "Did not find an import matching \"" << import_name << "\".";
+    return 1;
+  }
+
+  return 0;
+}
+
 }  // namespace
 
 bool SwapImportApp::ParseCommandLine(const CommandLine* cmd_line) {
@@ -62,8 +170,17 @@ bool SwapImportApp::ParseCommandLine(const CommandLine* cmd_line) {
     return false;
   }
 
+  in_place_ = cmd_line->HasSwitch("in-place");
+  if (in_place_)
+    VLOG(1) << "Parsed --in-place switch.";
+
   output_image_ = cmd_line->GetSwitchValuePath("output-image");
-  if (output_image_.empty()) {
+  if (in_place_) {
+    if (!output_image_.empty()) {
+      LOG(ERROR) << "Cannot specify both --in-place and --output-image!";
+      return false;
+    }
+  } else if (output_image_.empty()) {
     LOG(ERROR) << "Must specify --output-image!";
     return false;
   }
@@ -111,77 +228,12 @@ int SwapImportApp::SwapImports() {
     return 1;
   }
 
-  // Keeps track of matched imports, and how many have been swapped.
-  size_t imports_swapped = 0;
-  size_t imports_matched = 0;
-
-  // Look up the import directory.
-  LOG(INFO) << "Processing NT headers.";
-  const IMAGE_DATA_DIRECTORY* data_dir =
-      pe_file.nt_headers()->OptionalHeader.DataDirectory +
-          IMAGE_DIRECTORY_ENTRY_IMPORT;
-  if (data_dir->Size != 0) {
-    LOG(INFO) << "Processing imports.";
-
-    pe::PEFile::FileOffsetAddress import_offset;
-    if (!pe_file.Translate(
-            pe::PEFile::RelativeAddress(data_dir->VirtualAddress),
-            &import_offset)) {
-      LOG(ERROR) << "Failed to translate import directory address.";
-      return 1;
-    }
-
-    // Walk over the imports.
-    IMAGE_IMPORT_DESCRIPTOR* imports_begin =
-        reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR*>(
-            image.data() + import_offset.value());
-    IMAGE_IMPORT_DESCRIPTOR* imports_end =
-        reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR*>(
-            image.data() + import_offset.value() + data_dir->Size);
-    IMAGE_IMPORT_DESCRIPTOR* imports = imports_begin;
-    size_t import_index = 0;
-    while (imports < imports_end && imports->Characteristics != 0) {
-      // Look up the import name.
-      pe::PEFile::FileOffsetAddress name_offset;
-      if (!pe_file.Translate(
-              pe::PEFile::RelativeAddress(imports->Name),
-              &name_offset)) {
-        LOG(ERROR) << "Failed to translate import name.";
-        return 1;
-      }
-
-      // Compare the import name.
-      const char* name = reinterpret_cast<const char*>(
-          image.data() + name_offset.value());
-      VLOG(1) << "Processing import " << import_index << " \""
-              << name << "\".";
-      if (base::strcasecmp(import_name_.c_str(), name) == 0) {
-        VLOG(1) << "Import " << import_index << " matches import name.";
-        ++imports_matched;
-
-        if (import_index > imports_swapped) {
-          // Do the actual swapping of the imports.
-          LOG(INFO) << "Swapping imports " << imports_swapped << " and "
-                    << import_index;
-
-          IMAGE_IMPORT_DESCRIPTOR temp_iid = *imports;
-          *imports = imports_begin[imports_swapped];
-          imports_begin[imports_swapped] = temp_iid;
-
-          ++imports_swapped;
-        }
-      }
-
-      ++imports;
-      ++import_index;
-    }
-  }
-
-  // We expect to have matched the specified import at least once.
-  if (imports_matched == 0) {
-    LOG(ERROR) << "Did not find an import matching \"" << import_name_ << "\".";
-    return 1;
-  }
+  size_t dirty_start = 0;
+  size_t dirty_size = 0;
+  int result = SwapImportsInImage(pe_file, import_name_, image.data(),
+                                  &dirty_start, &dirty_size);
+  if (result != 0)
+    return result;
 
   // Write the actual output.
   LOG(INFO) << "Writing output to \"" << output_image_.value() << "\".";
@@ -208,6 +260,87 @@ int SwapImportApp::SwapImports() {
   return 0;
 }
 
+template <typename PEFileType>
+int SwapImportApp::SwapImportsInPlace() {
+  // Parse the input file as a PE image.
+  PEFileType pe_file;
+  if (!pe_file.Init(input_image_)) {
+    LOG(ERROR) << "Failed to parse image as a PE file: "
+               << input_image_.value();
+      return 1;
+  }
+
+  // Map the file read/write rather than reading it into memory; only the
+  // pages we actually modify will be written back to disk.
+  VLOG(1) << "Mapping \"" << input_image_.value() << "\".";
+  base::win::ScopedHandle file_handle(
+      ::CreateFile(input_image_.value().c_str(), GENERIC_READ | GENERIC_WRITE,
+                   0, NULL, OPEN_EXISTING, 0, NULL));
+  if (!file_handle.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to open \"" << input_image_.value() << "\": "
+               << common::LogWe(error);
+    return 1;
+  }
+
+  size_t file_size = ::GetFileSize(file_handle.Get(), NULL);
+
+  base::win::ScopedHandle file_mapping(::CreateFileMapping(
+      file_handle.Get(), NULL, PAGE_READWRITE, 0, 0, NULL));
+  unsigned char* image = NULL;
+  if (file_mapping.IsValid()) {
+    image = reinterpret_cast<unsigned char*>(::MapViewOfFile(
+        file_mapping.Get(), FILE_MAP_WRITE, 0, 0, file_size));
+  }
+  if (image == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map \"" << input_image_.value() << "\": "
+               << common::LogWe(error);
+    return 1;
+  }
+
+  size_t dirty_start = 0;
+  size_t dirty_size = 0;
+  int result = SwapImportsInImage(pe_file, import_name_, image,
+                                  &dirty_start, &dirty_size);
+
+  // Flush only the modified extent of the view. FlushViewOfFile rounds the
+  // range out to page boundaries and only writes the dirty pages it covers.
+  if (result == 0 && dirty_size != 0) {
+    LOG(INFO) << "Flushing " << dirty_size << " bytes at offset "
+              << dirty_start << ".";
+    if (::FlushViewOfFile(image + dirty_start, dirty_size) == FALSE) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to flush view of file: " << common::LogWe(error);
+      result = 1;
+    }
+  }
+
+  CHECK(::UnmapViewOfFile(image));
+
+  if (result != 0)
+    return result;
+
+  // If nothing was modified then the checksum is still valid and the file
+  // need not be touched at all.
+  if (dirty_size == 0) {
+    LOG(INFO) << "Import already in first position; image left untouched.";
+    return 0;
+  }
+
+  // Finalize the image by updating the checksum. This only dirties the page
+  // containing the NT headers.
+  LOG(INFO) << "Updating image checksum.";
+  file_mapping.Close();
+  file_handle.Close();
+  if (!pe::PEFileWriter::UpdateFileChecksum(input_image_)) {
+    LOG(ERROR) << "Failed to update image checksum.";
+    return 1;
+  }
+
+  return 0;
+}
+
 int SwapImportApp::Run() {
   // Check the input.
   if (!base::PathExists(input_image_)) {
@@ -215,8 +348,8 @@ int SwapImportApp::Run() {
     return 1;
   }
 
-  // Check the output unless we're overwriting.
-  if (!overwrite_) {
+  // Check the output unless we're overwriting or patching in place.
+  if (!in_place_ && !overwrite_) {
     if (base::PathExists(output_image_)) {
       LOG(ERROR) << "Output path exists: " << output_image_.value();
       LOG(ERROR) << "Did you mean to specify --overwrite?";
@@ -232,8 +365,12 @@ int SwapImportApp::Run() {
   }
 
   if (x64_) {
+    if (in_place_)
+      return SwapImportsInPlace<pe::PEFile64>();
     return SwapImports<pe::PEFile64>();
   } else {
+    if (in_place_)
+      return SwapImportsInPlace<pe::PEFile>();
     return SwapImports<pe::PEFile>();
   }
 }
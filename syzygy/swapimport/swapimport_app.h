@@ -31,7 +31,10 @@ namespace swapimport {
 class SwapImportApp : public common::AppImplBase {
  public:
   SwapImportApp()
-      : common::AppImplBase("SwapImport"), overwrite_(false), verbose_(false) {
+      : common::AppImplBase("SwapImport"),
+        in_place_(false),
+        overwrite_(false),
+        verbose_(false) {
   }
 
   // @name Implementation of the AppImplBase interface.
@@ -49,12 +52,18 @@ class SwapImportApp : public common::AppImplBase {
 
   // @name Implementation of import swapping.
   // @{
+  // Reads the input image into memory, swaps the imports and writes the
+  // result to the output path.
   template <typename PEFileType> int SwapImports();
+  // Maps the input image and patches only the pages containing the import
+  // directory, leaving the rest of the file untouched.
+  template <typename PEFileType> int SwapImportsInPlace();
   // @}
 
   std::string import_name_;
   base::FilePath input_image_;
   base::FilePath output_image_;
+  bool in_place_;
   bool overwrite_;
   bool verbose_;
   bool x64_;
@@ -28,6 +28,7 @@ class TestSwapImportApp : public SwapImportApp {
   using SwapImportApp::import_name_;
   using SwapImportApp::input_image_;
   using SwapImportApp::output_image_;
+  using SwapImportApp::in_place_;
   using SwapImportApp::overwrite_;
   using SwapImportApp::verbose_;
 };
@@ -177,6 +178,22 @@ TEST_F(SwapImportAppTest, ParseEmptyCommandMaximal) {
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(SwapImportAppTest, ParseFailsInPlaceWithOutputImage) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_);
+  cmd_line_.AppendSwitch("in-place");
+  cmd_line_.AppendArg("kernel32.dll");
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SwapImportAppTest, ParseInPlaceNoOutputImage) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_);
+  cmd_line_.AppendSwitch("in-place");
+  cmd_line_.AppendArg("kernel32.dll");
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(test_impl_.in_place_);
+}
+
 TEST_F(SwapImportAppTest, RunFailsInputAndOutputSame) {
   cmd_line_.AppendSwitchPath("input-image", input_image_);
   cmd_line_.AppendSwitchPath("output-image", input_image_);
@@ -226,6 +243,35 @@ TEST_F(SwapImportAppTest, RunSucceedsOverwrite) {
   ASSERT_NO_FATAL_FAILURE(ValidateImportsSwapped());
 }
 
+TEST_F(SwapImportAppTest, RunSucceedsInPlace) {
+  // Patch a copy of the input image in place.
+  ASSERT_TRUE(base::CopyFile(input_image_, output_image_));
+
+  cmd_line_.AppendSwitchPath("input-image", output_image_);
+  cmd_line_.AppendSwitch("in-place");
+  cmd_line_.AppendArg("kernel32.dll");
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(0, test_impl_.Run());
+
+  ASSERT_NO_FATAL_FAILURE(ValidateImportsSwapped());
+}
+
+TEST_F(SwapImportAppTest, RunInPlaceIsIdempotent) {
+  ASSERT_TRUE(base::CopyFile(input_image_, output_image_));
+
+  cmd_line_.AppendSwitchPath("input-image", output_image_);
+  cmd_line_.AppendSwitch("in-place");
+  cmd_line_.AppendArg("kernel32.dll");
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(0, test_impl_.Run());
+
+  // A second run finds the import already in first position and leaves the
+  // image untouched.
+  EXPECT_EQ(0, test_impl_.Run());
+
+  ASSERT_NO_FATAL_FAILURE(ValidateImportsSwapped());
+}
+
 TEST_F(SwapImportAppTest, RunSucceeds64) {
   cmd_line_.AppendSwitch("x64");
   cmd_line_.AppendSwitchPath("input-image", input_image_64_);
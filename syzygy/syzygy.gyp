@@ -33,6 +33,7 @@
         'agent/profiler/profiler.gyp:*',
         'ar/ar.gyp:*',
         'assm/assm.gyp:*',
+        'benchmarks/benchmarks.gyp:*',
         'block_graph/analysis/block_graph_analysis.gyp:*',
         'block_graph/block_graph.gyp:*',
         'block_graph/transforms/block_graph_transforms.gyp:*',
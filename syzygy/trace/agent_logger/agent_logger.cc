@@ -21,13 +21,18 @@
 #include <dbghelp.h>
 #include <psapi.h>
 
+#include <map>
+
 #include "base/bind.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/dbghelp_util.h"
 #include "syzygy/common/rpc/helpers.h"
+#include "syzygy/common/shared_symbol_cache.h"
 #include "syzygy/pe/find.h"
 
 namespace trace {
@@ -101,6 +106,91 @@ void GetLineInfo(HANDLE process, DWORD_PTR frame, std::string* line_info) {
   }
 }
 
+// The tag mixed into shared symbol cache keys for the logger's frame
+// resolutions. These must not collide with the tags other tools publish
+// under, as the value encodings differ.
+const uint64 kSharedFrameKeyTag = 3ULL << 32;
+
+// Encodes the resolution of a stack frame as a shared symbol cache value:
+// the symbol displacement, the symbol name and the line info.
+void EncodeFrameInfo(DWORD64 offset,
+                     const std::string& symbol_name,
+                     const std::string& line_info,
+                     std::string* value) {
+  DCHECK(value != NULL);
+  value->assign(reinterpret_cast<const char*>(&offset), sizeof(offset));
+  value->append(symbol_name);
+  value->push_back('\0');
+  value->append(line_info);
+}
+
+bool DecodeFrameInfo(const std::string& value,
+                     DWORD64* offset,
+                     std::string* symbol_name,
+                     std::string* line_info) {
+  DCHECK(offset != NULL);
+  DCHECK(symbol_name != NULL);
+  DCHECK(line_info != NULL);
+
+  if (value.size() < sizeof(*offset) + 1)
+    return false;
+  ::memcpy(offset, value.data(), sizeof(*offset));
+  size_t terminator = value.find('\0', sizeof(*offset));
+  if (terminator == std::string::npos)
+    return false;
+  symbol_name->assign(value, sizeof(*offset), terminator - sizeof(*offset));
+  line_info->assign(value, terminator + 1, std::string::npos);
+  return true;
+}
+
+// Retrieves the shared symbol cache for the module enclosing @p frame_ptr,
+// attaching to it on first use, and translates the frame to a module
+// relative address. Returns NULL if the module (or its PDB) can't be
+// identified, or if attaching to the cache failed; failures are recorded so
+// they aren't retried per frame. Note that under deferred symbol loading
+// the module's PDB identity is only known once dbghelp has actually loaded
+// its symbols, so the first resolved frame of a module is always a miss.
+::common::SharedSymbolCache* GetCacheForFrame(
+    HANDLE process,
+    DWORD frame_ptr,
+    std::map<DWORD64, ::common::SharedSymbolCache*>* caches,
+    ScopedVector<::common::SharedSymbolCache>* owned_caches,
+    uint32* rva) {
+  DCHECK(caches != NULL);
+  DCHECK(owned_caches != NULL);
+  DCHECK(rva != NULL);
+
+  IMAGEHLP_MODULE64 module = {};
+  module.SizeOfStruct = sizeof(module);
+  if (!::SymGetModuleInfo64(process, frame_ptr, &module))
+    return NULL;
+  *rva = static_cast<uint32>(frame_ptr - module.BaseOfImage);
+
+  std::map<DWORD64, ::common::SharedSymbolCache*>::const_iterator it =
+      caches->find(module.BaseOfImage);
+  if (it != caches->end())
+    return it->second;
+
+  // The PDB identity isn't known until the module's symbols have actually
+  // been loaded; don't record the outcome yet in that case.
+  if (module.SymType == SymDeferred)
+    return NULL;
+
+  // Only share resolutions made against an actual PDB, as the cache is
+  // keyed by PDB identity.
+  ::common::SharedSymbolCache* cache = NULL;
+  if (module.SymType == SymPdb) {
+    scoped_ptr<::common::SharedSymbolCache> new_cache(
+        new ::common::SharedSymbolCache());
+    if (new_cache->Init(module.PdbSig70, module.PdbAge)) {
+      cache = new_cache.release();
+      owned_caches->push_back(cache);
+    }
+  }
+  (*caches)[module.BaseOfImage] = cache;
+  return cache;
+}
+
 // A callback function used with the StackWalk64 function. It is called when
 // StackWalk64 needs to read memory from the address space of the process.
 // http://msdn.microsoft.com/en-us/library/windows/desktop/ms680559.aspx
@@ -132,7 +222,10 @@ BOOL CALLBACK ReadProcessMemoryProc64(HANDLE process,
 AgentLogger::AgentLogger()
     : trace::common::Service(L"Logger"),
       destination_(NULL),
-      symbolize_stack_traces_(true) {
+      symbolize_stack_traces_(true),
+      asynchronous_writes_(false),
+      queue_is_non_empty_(&queue_lock_),
+      writer_stopped_(false) {
 }
 
 AgentLogger::~AgentLogger() {
@@ -145,6 +238,16 @@ AgentLogger::~AgentLogger() {
 bool AgentLogger::StartImpl() {
   LOG(INFO) << "Starting the logging service.";
 
+  // Spin up the background writer thread before accepting any RPC calls so
+  // that no message can be queued without a consumer.
+  if (asynchronous_writes_) {
+    DCHECK(writer_thread_.get() == NULL);
+    writer_stopped_ = false;
+    writer_thread_.reset(
+        new base::DelegateSimpleThread(this, "Logger writer thread"));
+    writer_thread_->Start();
+  }
+
   if (!InitRpc())
     return false;
 
@@ -165,10 +268,21 @@ bool AgentLogger::JoinImpl() {
   // this will simply ensure that all outstanding requests are handled. If
   // Stop has not been called, this will continue (i.e., block) handling events
   // until someone else calls Stop() in another thread.
-  if (!FinishRpc())
-    return false;
+  bool error = !FinishRpc();
+
+  // With the RPC server shut down no new messages can arrive. Ask the writer
+  // thread to drain the queue and exit.
+  if (writer_thread_.get() != NULL) {
+    {
+      base::AutoLock auto_lock(queue_lock_);
+      writer_stopped_ = true;
+    }
+    queue_is_non_empty_.Signal();
+    writer_thread_->Join();
+    writer_thread_.reset();
+  }
 
-  return true;
+  return !error;
 }
 
 bool AgentLogger::AppendTrace(HANDLE process,
@@ -231,6 +345,12 @@ bool AgentLogger::AppendTrace(HANDLE process,
     }
   }
 
+  // The shared symbol caches attached to for the modules of this trace.
+  // Concurrently running tools resolving against the same PDBs share their
+  // answers through these.
+  std::map<DWORD64, ::common::SharedSymbolCache*> caches;
+  ScopedVector<::common::SharedSymbolCache> owned_caches;
+
   // Append each line of the trace to the message string.
   for (size_t i = 0; i < trace_length; ++i) {
     DWORD frame_ptr = trace_data[i];
@@ -238,8 +358,29 @@ bool AgentLogger::AppendTrace(HANDLE process,
     std::string symbol_name;
     std::string line_info;
 
-    GetSymbolInfo(process, frame_ptr, &symbol_name, &offset);
-    GetLineInfo(process, frame_ptr, &line_info);
+    // Serve the frame from the shared symbol cache if another process has
+    // already resolved it, resolving and publishing it otherwise.
+    uint32 rva = 0;
+    ::common::SharedSymbolCache* cache =
+        GetCacheForFrame(process, frame_ptr, &caches, &owned_caches, &rva);
+    std::string value;
+    if (cache == NULL ||
+        !cache->Lookup(kSharedFrameKeyTag | rva, &value) ||
+        !DecodeFrameInfo(value, &offset, &symbol_name, &line_info)) {
+      GetSymbolInfo(process, frame_ptr, &symbol_name, &offset);
+      GetLineInfo(process, frame_ptr, &line_info);
+
+      if (cache == NULL) {
+        // Symbol loading may have been deferred until the resolution above;
+        // the module's PDB identity is known now.
+        cache = GetCacheForFrame(process, frame_ptr, &caches, &owned_caches,
+                                 &rva);
+      }
+      if (cache != NULL) {
+        EncodeFrameInfo(offset, symbol_name, line_info, &value);
+        cache->Insert(kSharedFrameKeyTag | rva, value);
+      }
+    }
 
     base::StringAppendF(message,
                         "    #%d 0x%012llx in %s%s%s\n",
@@ -336,6 +477,93 @@ bool AgentLogger::Write(const base::StringPiece& message) {
   if (message.empty())
     return true;
 
+  if (writer_thread_.get() != NULL) {
+    scoped_ptr<PendingMessage> pending(new PendingMessage());
+    message.CopyToString(&pending->message);
+    EnqueuePendingMessage(pending.release());
+    return true;
+  }
+
+  return WriteMessage(message, true);
+}
+
+bool AgentLogger::WriteWithTrace(HANDLE process,
+                                 const base::StringPiece& message,
+                                 const DWORD* trace_data,
+                                 size_t trace_length) {
+  if (writer_thread_.get() != NULL) {
+    // Duplicate the process handle, as the caller's handle is closed when
+    // the RPC call that produced this message is acknowledged.
+    HANDLE duplicate = NULL;
+    if (!::DuplicateHandle(::GetCurrentProcess(), process,
+                           ::GetCurrentProcess(), &duplicate, 0, FALSE,
+                           DUPLICATE_SAME_ACCESS)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to duplicate process handle: "
+                 << ::common::LogWe(error) << ".";
+      return false;
+    }
+
+    scoped_ptr<PendingMessage> pending(new PendingMessage());
+    message.CopyToString(&pending->message);
+    pending->process.Set(duplicate);
+    pending->trace_data.assign(trace_data, trace_data + trace_length);
+    EnqueuePendingMessage(pending.release());
+    return true;
+  }
+
+  std::string trace_message = message.as_string();
+  if (!AppendTrace(process, trace_data, trace_length, &trace_message))
+    return false;
+
+  return Write(trace_message);
+}
+
+void AgentLogger::Run() {
+  while (true) {
+    // Claim the entire queue of pending messages in one shot.
+    PendingMessages batch;
+    {
+      base::AutoLock auto_lock(queue_lock_);
+      while (pending_messages_.empty() && !writer_stopped_)
+        queue_is_non_empty_.Wait();
+      if (pending_messages_.empty() && writer_stopped_)
+        return;
+      batch.swap(pending_messages_);
+    }
+
+    // Symbolization happens here, after the RPC calls that produced these
+    // messages have already been acknowledged, so that clients aren't blocked
+    // on symbol resolution. The destination is only flushed once per batch.
+    // Failures can no longer be reported to the caller so they are simply
+    // logged.
+    for (size_t i = 0; i < batch.size(); ++i) {
+      PendingMessage* pending = batch[i];
+      if (pending->process.IsValid() && !pending->trace_data.empty() &&
+          !AppendTrace(pending->process, pending->trace_data.data(),
+                       pending->trace_data.size(), &pending->message)) {
+        LOG(ERROR) << "Failed to append trace to log message.";
+      }
+      if (!pending->message.empty())
+        ignore_result(WriteMessage(pending->message, i + 1 == batch.size()));
+    }
+  }
+}
+
+void AgentLogger::EnqueuePendingMessage(PendingMessage* pending) {
+  DCHECK(pending != NULL);
+
+  {
+    base::AutoLock auto_lock(queue_lock_);
+    pending_messages_.push_back(pending);
+  }
+  queue_is_non_empty_.Signal();
+}
+
+bool AgentLogger::WriteMessage(const base::StringPiece& message, bool flush) {
+  DCHECK(destination_ != NULL);
+  DCHECK(!message.empty());
+
   base::AutoLock auto_lock(write_lock_);
 
   size_t chars_written = ::fwrite(message.data(),
@@ -354,7 +582,8 @@ bool AgentLogger::Write(const base::StringPiece& message) {
     return false;
   }
 
-  ::fflush(destination_);
+  if (flush)
+    ::fflush(destination_);
 
   return true;
 }
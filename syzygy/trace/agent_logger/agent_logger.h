@@ -18,12 +18,21 @@
 #ifndef SYZYGY_TRACE_AGENT_LOGGER_AGENT_LOGGER_H_
 #define SYZYGY_TRACE_AGENT_LOGGER_AGENT_LOGGER_H_
 
+#include <string>
+#include <vector>
+
 #include "base/callback.h"
 #include "base/file_util.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
 #include "base/message_loop/message_loop.h"
 #include "base/process/process.h"
 #include "base/strings/string_piece.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/trace/common/service.h"
 #include "syzygy/trace/rpc/logger_rpc.h"
 
@@ -33,7 +42,8 @@ namespace agent_logger {
 // Implements the Logger interface (see "logger_rpc.idl").
 //
 // Note: The Logger expects to be the only RPC service running in the process.
-class AgentLogger : public trace::common::Service {
+class AgentLogger : public trace::common::Service,
+                    public base::DelegateSimpleThread::Delegate {
  public:
   AgentLogger();
   virtual ~AgentLogger();
@@ -59,6 +69,19 @@ class AgentLogger : public trace::common::Service {
   }
   // @}
 
+  // Get/Set the asynchronous_writes_ flag. When enabled, log messages are
+  // queued and consumed by a background writer thread, and the calling RPC is
+  // acknowledged without waiting for symbolization or file I/O; failures are
+  // then only reported to the logger's own log. This must be configured
+  // before the logger is started.
+  // @{
+  bool asynchronous_writes() { return asynchronous_writes_; }
+  void set_asynchronous_writes(bool value) {
+    DCHECK_EQ(kUnused, state());
+    asynchronous_writes_ = value;
+  }
+  // @}
+
   // Append a trace dump for @p process, given @p trace_data containing
   // @p trace_length elements. The output will be appended to @p message.
   //
@@ -81,9 +104,26 @@ class AgentLogger : public trace::common::Service {
                           std::vector<DWORD>* trace_data);
 
   // Write @p message to the log destination. Note that calls to this method
-  // are serialized using write_lock_.
+  // are serialized using write_lock_. In asynchronous mode the message is
+  // queued for the background writer thread and this returns immediately.
   bool Write(const base::StringPiece& message);
 
+  // Write @p message to the log destination with a stack trace for
+  // @p process appended to it. In synchronous mode this is equivalent to
+  // AppendTrace followed by Write. In asynchronous mode the raw frame
+  // addresses and a duplicate of @p process are queued, and symbolization is
+  // deferred to the background writer thread so the caller is not blocked
+  // on symbol resolution.
+  // @param process An open handle to the running process.
+  // @param message The message to be written.
+  // @param trace_data The frame pointers of a call stack in @p process.
+  // @param trace_length The number of elements in @p trace_data.
+  // @returns true on success, false otherwise.
+  bool WriteWithTrace(HANDLE process,
+                      const base::StringPiece& message,
+                      const DWORD* trace_data,
+                      size_t trace_length);
+
   // Generate a minidump for the calling process.
   // @param process An open handle to the running process.
   // @param pid The process id of the process to dump.
@@ -101,6 +141,16 @@ class AgentLogger : public trace::common::Service {
                     DWORD flags);
 
  protected:
+  // A log message that has been queued for the background writer thread. If
+  // |process| is valid then |trace_data| contains raw frame addresses that
+  // are to be symbolized and appended to |message| before it is written.
+  struct PendingMessage {
+    std::string message;
+    base::win::ScopedHandle process;
+    std::vector<DWORD> trace_data;
+  };
+  typedef ScopedVector<PendingMessage> PendingMessages;
+
   // @name Implementation of Service.
   // @{
   virtual bool StartImpl();
@@ -108,6 +158,22 @@ class AgentLogger : public trace::common::Service {
   virtual bool JoinImpl();
   // @}
 
+  // Implementation of DelegateSimpleThread::Delegate. This is the main
+  // function of the background writer thread, which drains the queue of
+  // pending messages in batches until the logger is joined.
+  virtual void Run();
+
+  // Appends @p pending to the queue of messages to be consumed by the
+  // background writer thread, taking ownership of it. May be called from any
+  // thread.
+  void EnqueuePendingMessage(PendingMessage* pending);
+
+  // Writes @p message to destination_, appending a trailing newline if
+  // necessary, and flushes the destination if @p flush is true. Grabs
+  // write_lock_.
+  // @returns true on success, false otherwise.
+  bool WriteMessage(const base::StringPiece& message, bool flush);
+
   // @name RPC Server Management Functions.
   // These functions, unless otherwise noted, are single threaded and must
   // all be called from the thread that created this instance.
@@ -136,6 +202,29 @@ class AgentLogger : public trace::common::Service {
   // Indicates if we should symbolize the stack traces. Defaults to true.
   bool symbolize_stack_traces_;
 
+  // Indicates if messages are written by a background writer thread rather
+  // than by the caller. Defaults to false.
+  bool asynchronous_writes_;
+
+  // The lock protecting the queue of pending messages and the writer
+  // shutdown flag.
+  base::Lock queue_lock_;
+
+  // Signaled when a message is queued or the writer thread is asked to shut
+  // down.
+  base::ConditionVariable queue_is_non_empty_;  // Under queue_lock_.
+
+  // The messages waiting to be consumed by the background writer thread.
+  PendingMessages pending_messages_;  // Under queue_lock_.
+
+  // Set when the logger is being joined, telling the writer thread to drain
+  // the queue and exit.
+  bool writer_stopped_;  // Under queue_lock_.
+
+  // The background writer thread. Only non-NULL when running in asynchronous
+  // mode.
+  scoped_ptr<base::DelegateSimpleThread> writer_thread_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AgentLogger);
 };
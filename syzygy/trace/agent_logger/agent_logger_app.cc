@@ -60,6 +60,11 @@ const char kUsageFormatStr[] =
     "    --append             Append to (instead of truncating) the output\n"
     "                         file. This option is valid for the start and\n"
     "                         spawn actions.\n"
+    "    --async-writes       Acknowledge log requests as soon as they are\n"
+    "                         received, deferring symbolization and file\n"
+    "                         I/O to a background writer thread. This\n"
+    "                         option is valid for the start and spawn\n"
+    "                         actions.\n"
     "    --instance-id=ID     A unique (up to 16 character) ID to identify\n"
     "                         the logger instance.\n"
     "    --minidump-dir=PATH  The directory path in which minidumps, if any,\n"
@@ -189,6 +194,7 @@ const char LoggerApp::kUniqueInstanceId[] = "unique-instance-id";
 const char LoggerApp::kOutputFile[] = "output-file";
 const char LoggerApp::kMiniDumpDir[] = "minidump-dir";
 const char LoggerApp::kAppend[] = "append";
+const char LoggerApp::kAsyncWrites[] = "async-writes";
 const wchar_t LoggerApp::kStdOut[] = L"stdout";
 const wchar_t LoggerApp::kStdErr[] = L"stderr";
 
@@ -204,7 +210,8 @@ LoggerApp::LoggerApp()
     : ::common::AppImplBase("AgentLogger"),
       logger_command_line_(CommandLine::NO_PROGRAM),
       action_handler_(NULL),
-      append_(false) {
+      append_(false),
+      async_writes_(false) {
 }
 
 LoggerApp::~LoggerApp() {
@@ -270,6 +277,9 @@ bool LoggerApp::ParseCommandLine(const CommandLine* command_line) {
   // Check for the append flag.
   append_ = command_line->HasSwitch(kAppend);
 
+  // Check for the asynchronous writes flag.
+  async_writes_ = command_line->HasSwitch(kAsyncWrites);
+
   // Parse the action.
   action_ = command_line->GetArgs()[0];
   const ActionTableEntry* entry = FindActionHandler(action_);
@@ -367,6 +377,7 @@ bool LoggerApp::Start() {
   logger.set_destination(output_file);
   logger.set_minidump_dir(mini_dump_dir_);
   logger.set_instance_id(instance_id_);
+  logger.set_asynchronous_writes(async_writes_);
   logger.set_started_callback(
       base::Bind(&SignalEvent, start_event.Get()));
   logger.set_stopped_callback(
@@ -125,6 +125,7 @@ class LoggerApp : public common::AppImplBase {
   static const char kUniqueInstanceId[];
   static const char kOutputFile[];
   static const char kAppend[];
+  static const char kAsyncWrites[];
   static const char kMiniDumpDir[];
   // @}
 
@@ -148,6 +149,7 @@ class LoggerApp : public common::AppImplBase {
   base::FilePath output_file_path_;
   base::FilePath mini_dump_dir_;
   bool append_;
+  bool async_writes_;
   // @}
 
  private:
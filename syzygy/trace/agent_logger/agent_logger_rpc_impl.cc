@@ -150,17 +150,14 @@ boolean LoggerService_WriteWithContext(
     return false;
   }
 
-  // Create the log message.
+  // Write the log message. In asynchronous mode this queues the raw trace
+  // and defers symbolization until after this call has been acknowledged.
   std::string message(reinterpret_cast<const char*>(text));
-  if (!instance->AppendTrace(
-          handle, trace_data.data(), trace_data.size(), &message)) {
+  if (!instance->WriteWithTrace(
+          handle, message, trace_data.data(), trace_data.size())) {
     return false;
   }
 
-  // Write the log message.
-  if (!instance->Write(message))
-    return false;
-
   // And we're done.
   return true;
 }
@@ -184,13 +181,10 @@ boolean LoggerService_WriteWithTrace(
   // Get the logger instance.
   AgentLogger* instance = RpcLoggerInstanceManager::GetInstance();
 
-  // Create the log message.
+  // Write the log message. In asynchronous mode this queues the raw trace
+  // and defers symbolization until after this call has been acknowledged.
   std::string message(reinterpret_cast<const char*>(text));
-  if (!instance->AppendTrace(handle, trace_data, trace_length, &message))
-    return false;
-
-  // Write the log message.
-  if (!instance->Write(message))
+  if (!instance->WriteWithTrace(handle, message, trace_data, trace_length))
     return false;
 
   // And we're done.
@@ -172,6 +172,16 @@ class LoggerTest : public testing::Test {
   RpcLoggerInstanceManager instance_manager_;
 };
 
+// Runs the logger with asynchronous writes enabled, which must be configured
+// before the logger is started.
+class AsyncLoggerTest : public LoggerTest {
+ public:
+  virtual void SetUp() OVERRIDE {
+    logger_.set_asynchronous_writes(true);
+    ASSERT_NO_FATAL_FAILURE(LoggerTest::SetUp());
+  }
+};
+
 void DoRpcWriteWithContext(handle_t rpc_binding, const unsigned char* message) {
   CONTEXT rtl_context = {};
   ::RtlCaptureContext(&rtl_context);
@@ -370,6 +380,75 @@ TEST_F(LoggerTest, RpcWriteWithContext) {
   ASSERT_TRUE(TextContainsKnownStack(text, line_2));
 }
 
+TEST_F(AsyncLoggerTest, Write) {
+  // Write the lines. In asynchronous mode these are queued and written by
+  // the background writer thread.
+  ASSERT_TRUE(logger_.Write(kLine1));
+  ASSERT_TRUE(logger_.Write(kLine2));
+  ASSERT_TRUE(logger_.Write(kLine3));
+
+  // Stop the logger. Joining it drains the queue of pending messages.
+  ASSERT_TRUE(logger_.Stop());
+  ASSERT_NO_FATAL_FAILURE(WaitForLoggerToFinish());
+
+  // Close the log file.
+  log_file_.reset(NULL);
+
+  // Read in the log contents.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(log_file_path_, &contents));
+
+  // Build the expected contents (append a newline to line2). The messages
+  // must have been written in the order they were queued.
+  std::string expected_contents(kLine1);
+  expected_contents += kLine2;
+  expected_contents += '\n';
+  expected_contents += kLine3;
+
+  // Compare the log contents.
+  EXPECT_EQ(expected_contents, contents);
+}
+
+TEST_F(AsyncLoggerTest, RpcWriteWithStack) {
+  // Connect to the logger over RPC.
+  ScopedRpcBinding rpc_binding;
+  std::wstring endpoint(
+      GetInstanceString(kLoggerRpcEndpointRoot, instance_id_));
+  ASSERT_TRUE(rpc_binding.Open(kLoggerRpcProtocol, endpoint));
+
+  HANDLE process = ::GetCurrentProcess();
+  std::vector<DWORD> trace_data;
+  ASSERT_NO_FATAL_FAILURE(ExecuteCallbackWithKnownStack(base::Bind(
+      &LoggerTest::DoCaptureRemoteTrace,
+      base::Unretained(this),
+      process,
+      &trace_data)));
+
+  // Write to and stop the logger via RPC. The write is acknowledged before
+  // symbolization, which is deferred to the background writer thread.
+  ASSERT_TRUE(LoggerClient_WriteWithTrace(rpc_binding.Get(),
+                                          MakeUnsigned(kLine1),
+                                          trace_data.data(),
+                                          trace_data.size()));
+  ASSERT_TRUE(LoggerClient_Stop(rpc_binding.Get()));
+  ASSERT_TRUE(rpc_binding.Close());
+
+  // Wait for the logger to finish shutting down.
+  EXPECT_NO_FATAL_FAILURE(WaitForLoggerToFinish());
+
+  // Close the log file.
+  log_file_.reset(NULL);
+
+  // Read in the log contents.
+  std::string text;
+  ASSERT_TRUE(base::ReadFileToString(log_file_path_, &text));
+
+  // Validate that we see the expected function chain.
+  size_t line_1 = text.find(kLine1, 0);
+  ASSERT_TRUE(line_1 != std::string::npos);
+  ASSERT_TRUE(TextContainsKnownStack(text, line_1));
+}
+
 TEST_F(LoggerTest, RpcGenerateMiniDump) {
   // Connect to the logger over RPC.
   ScopedRpcBinding rpc_binding;
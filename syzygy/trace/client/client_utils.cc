@@ -235,6 +235,9 @@ void TraceFileSegment::WriteSegmentHeader(SessionHandle session_handle) {
 
   header = reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
   header->thread_id = ::GetCurrentThreadId();
+  // The sequence number is assigned when the buffer is handed to the call
+  // trace service; until then the segment is unsequenced.
+  header->sequence_number = 0;
   header->segment_length = 0;
 
   write_ptr = reinterpret_cast<uint8*>(header + 1);
@@ -267,6 +270,39 @@ void* TraceFileSegment::AllocateTraceRecordImpl(int record_type,
   return prefix + 1;
 }
 
+// The process-wide segment journal. This has a constant initializer so that
+// it is fully formed from the moment the image is mapped, and its magic
+// bracket makes it discoverable by scanning the memory of a crash dump.
+TraceSegmentJournal segment_journal = {
+    { TraceSegmentJournal::kJournalMagic0,
+      TraceSegmentJournal::kJournalMagic1 },
+    0, 0 };
+
+TraceSegmentJournal* GetSegmentJournal() {
+  return &segment_journal;
+}
+
+uint32 AllocateSegmentSequenceNumber() {
+  return static_cast<uint32>(
+      ::InterlockedIncrement(&segment_journal.last_allocated_sequence));
+}
+
+void CommitSegmentSequenceNumber(uint32 sequence_number) {
+  // Raise the last committed sequence to the given value if it exceeds it.
+  // Buffers are returned concurrently and may complete out of order, so the
+  // update has to be a compare-and-swap loop rather than a blind store.
+  LONG current = segment_journal.last_committed_sequence;
+  while (static_cast<uint32>(current) < sequence_number) {
+    LONG previous = ::InterlockedCompareExchange(
+        &segment_journal.last_committed_sequence,
+        static_cast<LONG>(sequence_number),
+        current);
+    if (previous == current)
+      break;
+    current = previous;
+  }
+}
+
 bool GetModuleBaseAddress(void* address_in_module, void** module_base) {
   DCHECK(address_in_module != NULL);
   DCHECK(module_base != NULL);
@@ -353,11 +389,152 @@ bool IsRpcSessionMandatoryForThisModule() {
   return false;
 }
 
+bool IsRpcSessionLazy(const base::FilePath& module_path) {
+  int value = 0;
+  if (!GetModuleValueFromEnvVar(kSyzygyRpcSessionLazyEnvVar, module_path,
+                                value, ToInt(), &value)) {
+    return false;
+  }
+
+  if (value == 0)
+    return false;
+
+  // Anything non-zero is treated as 'true'.
+  return true;
+}
+
+bool IsRpcSessionLazyForThisModule() {
+  base::FilePath module_path;
+  CHECK(GetModulePath(&__ImageBase, &module_path));
+
+  if (IsRpcSessionLazy(module_path))
+    return true;
+
+  return false;
+}
+
+bool IsRpcSessionShared(const base::FilePath& module_path) {
+  int value = 0;
+  if (!GetModuleValueFromEnvVar(kSyzygyRpcSessionSharedEnvVar, module_path,
+                                value, ToInt(), &value)) {
+    return false;
+  }
+
+  if (value == 0)
+    return false;
+
+  // Anything non-zero is treated as 'true'.
+  return true;
+}
+
+bool IsRpcSessionSharedForThisModule() {
+  base::FilePath module_path;
+  CHECK(GetModulePath(&__ImageBase, &module_path));
+
+  if (IsRpcSessionShared(module_path))
+    return true;
+
+  return false;
+}
+
+bool IsRpcSessionAttachable(const base::FilePath& module_path) {
+  int value = 0;
+  if (!GetModuleValueFromEnvVar(kSyzygyRpcSessionAttachableEnvVar,
+                                module_path, value, ToInt(), &value)) {
+    return false;
+  }
+
+  if (value == 0)
+    return false;
+
+  // Anything non-zero is treated as 'true'.
+  return true;
+}
+
+bool IsRpcSessionAttachableForThisModule() {
+  base::FilePath module_path;
+  CHECK(GetModulePath(&__ImageBase, &module_path));
+
+  if (IsRpcSessionAttachable(module_path))
+    return true;
+
+  return false;
+}
+
+bool IsEntryCoalescingEnabled(const base::FilePath& module_path) {
+  int value = 0;
+  if (!GetModuleValueFromEnvVar(kSyzygyCoalesceEntriesEnvVar, module_path,
+                                value, ToInt(), &value)) {
+    return false;
+  }
+
+  if (value == 0)
+    return false;
+
+  // Anything non-zero is treated as 'true'.
+  return true;
+}
+
+bool IsEntryCoalescingEnabledForThisModule() {
+  base::FilePath module_path;
+  CHECK(GetModulePath(&__ImageBase, &module_path));
+
+  if (IsEntryCoalescingEnabled(module_path))
+    return true;
+
+  return false;
+}
+
+bool IsProfileCountOnlyEnabled(const base::FilePath& module_path) {
+  int value = 0;
+  if (!GetModuleValueFromEnvVar(kSyzygyProfileCountOnlyEnvVar, module_path,
+                                value, ToInt(), &value)) {
+    return false;
+  }
+
+  if (value == 0)
+    return false;
+
+  // Anything non-zero is treated as 'true'.
+  return true;
+}
+
+bool IsProfileCountOnlyEnabledForThisModule() {
+  base::FilePath module_path;
+  CHECK(GetModulePath(&__ImageBase, &module_path));
+
+  if (IsProfileCountOnlyEnabled(module_path))
+    return true;
+
+  return false;
+}
+
 bool InitializeRpcSession(RpcSession* rpc_session, TraceFileSegment* segment) {
   DCHECK(rpc_session != NULL);
 
   std::string id = trace::client::GetInstanceIdForThisModule();
   rpc_session->set_instance_id(base::UTF8ToWide(id));
+
+  // A mandatory session must fail fast, so lazy connection is not honoured
+  // for it; deferring the handshake would also defer the failure detection
+  // below past process startup.
+  if (IsRpcSessionLazyForThisModule() &&
+      !IsRpcSessionMandatoryForThisModule()) {
+    rpc_session->set_lazy(true);
+  }
+
+  // Collapse the per-module sessions of this process onto a single RPC
+  // connection, if so configured.
+  if (IsRpcSessionSharedForThisModule())
+    rpc_session->set_shared(true);
+
+  // A mandatory session must fail fast, so mid-run attachment makes no
+  // sense for it either.
+  if (IsRpcSessionAttachableForThisModule() &&
+      !IsRpcSessionMandatoryForThisModule()) {
+    rpc_session->set_attachable(true);
+  }
+
   if (rpc_session->CreateSession(segment))
     return true;
 
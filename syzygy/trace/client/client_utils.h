@@ -110,6 +110,51 @@ class TraceFileSegment {
   uint8* end_ptr;
 };
 
+// A small journal of segment sequencing state, kept in the client process.
+// Sequence numbers are allocated from here as buffers are handed to the
+// call trace service, and the last committed sequence is recorded once the
+// hand-over succeeds. The journal is bracketed by magic values so that
+// it can be located in a crash dump by a memory scan, allowing a postmortem
+// consumer to recover the sequence state (and from it, which segments never
+// made it to the service) from a process that died with buffers in flight.
+struct TraceSegmentJournal {
+  // The magic values bracketing the journal. The second is the bitwise
+  // complement of the first so that the pattern doesn't occur as literal
+  // data elsewhere in the image.
+  enum {
+    kJournalMagic0 = 0x4A547A53,  // Appears as "SzTJ" in memory.
+    kJournalMagic1 = ~0x4A547A53,
+  };
+
+  // The magic values identifying the journal. These are always
+  // kJournalMagic0 and kJournalMagic1.
+  uint32 magic[2];
+
+  // The most recently allocated segment sequence number. Updated with an
+  // interlocked increment as buffers are handed to the service.
+  volatile LONG last_allocated_sequence;
+
+  // The highest sequence number among segments that have been successfully
+  // handed back to the call trace service. Buffers are returned on multiple
+  // threads and may complete out of order, so individual sequence numbers
+  // below this may still be in flight; anything above it certainly is.
+  volatile LONG last_committed_sequence;
+};
+
+// @returns the process-wide trace segment journal.
+TraceSegmentJournal* GetSegmentJournal();
+
+// Allocates the next segment sequence number from the process-wide journal.
+// @returns the allocated sequence number. The first allocation returns 1;
+//     0 is never allocated, as it marks unsequenced segments.
+uint32 AllocateSegmentSequenceNumber();
+
+// Records that the segment bearing @p sequence_number has been handed back
+// to the call trace service, raising the journal's last committed sequence
+// if @p sequence_number exceeds it.
+// @param sequence_number the sequence number of the committed segment.
+void CommitSegmentSequenceNumber(uint32 sequence_number);
+
 // Helper function to transform a DllMain reason to a call trace event type.
 int ReasonToEventType(DWORD reason);
 
@@ -184,6 +229,106 @@ bool IsRpcSessionMandatory(const base::FilePath& module_path);
 //     function is found.
 bool IsRpcSessionMandatoryForThisModule();
 
+// Given the path to a module, determines whether or not the RPC session for
+// it should be created lazily. This works by looking at the
+// SYZYGY_RPC_SESSION_LAZY environment variable, which has the same format
+// as SYZYGY_RPC_SESSION_MANDATORY as described in IsRpcSessionMandatory.
+// When a non-zero value matches, the agent defers the service handshake off
+// the process startup path; early events are queued in a small local buffer
+// and delivered when the session first connects.
+//
+// @param module_path the path to the module for which we wish to determine
+//     if the RPC session should be created lazily.
+// @returns true if the session should be created lazily, false otherwise.
+bool IsRpcSessionLazy(const base::FilePath& module_path);
+
+// Encapsulates calls to GetModuleBaseAddress, GetModulePath and
+// IsRpcSessionLazy.
+// @returns true if the RPC session for the module in which this function is
+//     found should be created lazily.
+bool IsRpcSessionLazyForThisModule();
+
+// Given the path to a module, determines whether or not it should share a
+// single process-wide RPC session with the other modules of its process.
+// This works by looking at the SYZYGY_RPC_SESSION_SHARED environment
+// variable, which has the same format as SYZYGY_RPC_SESSION_MANDATORY as
+// described in IsRpcSessionMandatory. When a non-zero value matches, the
+// agent reuses a session already created in this process if there is one,
+// collapsing the per-module sessions and their buffer sets onto a single
+// RPC connection; events remain attributable to their module via the
+// segments each module writes.
+//
+// @param module_path the path to the module for which we wish to determine
+//     if the RPC session should be shared.
+// @returns true if the session should be shared, false otherwise.
+bool IsRpcSessionShared(const base::FilePath& module_path);
+
+// Encapsulates calls to GetModuleBaseAddress, GetModulePath and
+// IsRpcSessionShared.
+// @returns true if the RPC session for the module in which this function is
+//     found should be shared process-wide.
+bool IsRpcSessionSharedForThisModule();
+
+// Given the path to a module, determines whether or not its RPC session
+// should attach to a late-starting call-trace service. This works by
+// looking at the SYZYGY_RPC_SESSION_ATTACHABLE environment variable, which
+// has the same format as SYZYGY_RPC_SESSION_MANDATORY as described in
+// IsRpcSessionMandatory. When a non-zero value matches and no service is
+// reachable, the agent waits in the background for a service to come up
+// and establishes its session mid-run, rather than disabling itself for
+// the life of the process.
+//
+// @param module_path the path to the module for which we wish to determine
+//     if the RPC session should be attachable.
+// @returns true if the session should be attachable, false otherwise.
+bool IsRpcSessionAttachable(const base::FilePath& module_path);
+
+// Encapsulates calls to GetModuleBaseAddress, GetModulePath and
+// IsRpcSessionAttachable.
+// @returns true if the RPC session for the module in which this function is
+//     found should attach to a late-starting service.
+bool IsRpcSessionAttachableForThisModule();
+
+// Given the path to a module, determines whether or not the call-trace
+// client should coalesce repeated function entries into counted entry
+// records. This works by looking at the SYZYGY_COALESCE_ENTRIES
+// environment variable, which has the same format as
+// SYZYGY_RPC_SESSION_MANDATORY as described in IsRpcSessionMandatory. When
+// a non-zero value matches, back-to-back entries to the same function from
+// the same call site are accumulated into a single
+// TraceCountedEnterEventData record rather than emitted individually.
+//
+// @param module_path the path to the module for which we wish to determine
+//     if entry coalescing should be enabled.
+// @returns true if entry coalescing should be enabled, false otherwise.
+bool IsEntryCoalescingEnabled(const base::FilePath& module_path);
+
+// Encapsulates calls to GetModuleBaseAddress, GetModulePath and
+// IsEntryCoalescingEnabled.
+// @returns true if entry coalescing should be enabled for the module in
+//     which this function is found.
+bool IsEntryCoalescingEnabledForThisModule();
+
+// Given the path to a module, determines whether or not the profiler should
+// run in entry-count-only mode. This works by looking at the
+// SYZYGY_PROFILE_COUNT_ONLY environment variable, which has the same format
+// as SYZYGY_RPC_SESSION_MANDATORY as described in IsRpcSessionMandatory.
+// When a non-zero value matches, the profiler only tallies the number of
+// calls to each function; it records no cycle timings and does not swizzle
+// return addresses to observe function exits.
+//
+// @param module_path the path to the module for which we wish to determine
+//     if entry-count-only profiling should be enabled.
+// @returns true if entry-count-only profiling should be enabled, false
+//     otherwise.
+bool IsProfileCountOnlyEnabled(const base::FilePath& module_path);
+
+// Encapsulates calls to GetModuleBaseAddress, GetModulePath and
+// IsProfileCountOnlyEnabled.
+// @returns true if entry-count-only profiling should be enabled for the
+//     module in which this function is found.
+bool IsProfileCountOnlyEnabledForThisModule();
+
 // Initializes an RPC session, automatically getting the instance ID and
 // determining if the session is mandatory. If the session is mandatory and it
 // is unable to be connected this will raise an exception and cause the process
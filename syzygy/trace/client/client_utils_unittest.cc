@@ -17,6 +17,7 @@
 #include "base/environment.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/win/scoped_handle.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/file_util.h"
 #include "syzygy/core/unittest_util.h"
@@ -73,6 +74,98 @@ class IsRpcSessionMandatoryTest : public testing::Test {
   scoped_ptr<base::Environment> env_;
 };
 
+class IsRpcSessionLazyTest : public testing::Test {
+ public:
+  IsRpcSessionLazyTest() : path_(L"C:\\path\\foo.exe") { }
+
+  virtual void SetUp() OVERRIDE {
+    testing::Test::SetUp();
+    env_.reset(base::Environment::Create());
+  }
+
+  void SetEnvVar(const base::StringPiece& string) {
+    ASSERT_TRUE(env_->SetVar(::kSyzygyRpcSessionLazyEnvVar,
+                             string.as_string()));
+  }
+
+  void UnsetEnvVar() {
+    ASSERT_TRUE(env_->UnSetVar(::kSyzygyRpcSessionLazyEnvVar));
+  }
+
+  base::FilePath path_;
+  scoped_ptr<base::Environment> env_;
+};
+
+class IsRpcSessionSharedTest : public testing::Test {
+ public:
+  IsRpcSessionSharedTest() : path_(L"C:\\path\\foo.exe") { }
+
+  virtual void SetUp() OVERRIDE {
+    testing::Test::SetUp();
+    env_.reset(base::Environment::Create());
+  }
+
+  void SetEnvVar(const base::StringPiece& string) {
+    ASSERT_TRUE(env_->SetVar(::kSyzygyRpcSessionSharedEnvVar,
+                             string.as_string()));
+  }
+
+  void UnsetEnvVar() {
+    ASSERT_TRUE(env_->UnSetVar(::kSyzygyRpcSessionSharedEnvVar));
+  }
+
+  base::FilePath path_;
+  scoped_ptr<base::Environment> env_;
+};
+
+class IsRpcSessionAttachableTest : public testing::Test {
+ public:
+  IsRpcSessionAttachableTest() : path_(L"C:\\path\\foo.exe") { }
+
+  virtual void SetUp() OVERRIDE {
+    testing::Test::SetUp();
+    env_.reset(base::Environment::Create());
+  }
+
+  void SetEnvVar(const base::StringPiece& string) {
+    ASSERT_TRUE(env_->SetVar(::kSyzygyRpcSessionAttachableEnvVar,
+                             string.as_string()));
+  }
+
+  void UnsetEnvVar() {
+    ASSERT_TRUE(env_->UnSetVar(::kSyzygyRpcSessionAttachableEnvVar));
+  }
+
+  base::FilePath path_;
+  scoped_ptr<base::Environment> env_;
+};
+
+// An RpcSession with a canned buffer allocator, used for exercising the
+// shared session registration without a running call-trace service.
+class TestSharedRpcSession : public RpcSession {
+ public:
+  using RpcSession::session_handle_;
+  using RpcSession::PublishSharedSession;
+  using RpcSession::ReleaseSharedSession;
+  using RpcSession::TryAdoptSharedSession;
+
+  TestSharedRpcSession() : allocations_(0) {
+  }
+
+  virtual bool AllocateBuffer(TraceFileSegment* segment) OVERRIDE {
+    ++allocations_;
+    segment->base_ptr = buffer_;
+    segment->header = NULL;
+    segment->write_ptr = segment->base_ptr;
+    segment->end_ptr = segment->base_ptr + sizeof(buffer_);
+    segment->WriteSegmentHeader(session_handle_);
+    return true;
+  }
+
+  size_t allocations_;
+  uint8 buffer_[32 * 1024];
+};
+
 }  // namespace
 
 TEST(GetModuleBaseAddressTest, WorksOnSelf) {
@@ -93,6 +186,31 @@ TEST(GetModulePath, WorksOnSelf) {
   EXPECT_SAME_FILE(self_path, module_path);
 }
 
+TEST(TraceSegmentJournalTest, AllocateAndCommit) {
+  TraceSegmentJournal* journal = GetSegmentJournal();
+  ASSERT_TRUE(journal != NULL);
+  EXPECT_EQ(static_cast<uint32>(TraceSegmentJournal::kJournalMagic0),
+            journal->magic[0]);
+  EXPECT_EQ(static_cast<uint32>(TraceSegmentJournal::kJournalMagic1),
+            journal->magic[1]);
+
+  uint32 first = AllocateSegmentSequenceNumber();
+  EXPECT_LT(0u, first);
+  uint32 second = AllocateSegmentSequenceNumber();
+  EXPECT_EQ(first + 1, second);
+  EXPECT_EQ(second,
+            static_cast<uint32>(journal->last_allocated_sequence));
+
+  // Commits raise the committed sequence monotonically; a commit that
+  // completes out of order doesn't lower it.
+  CommitSegmentSequenceNumber(second);
+  EXPECT_EQ(second,
+            static_cast<uint32>(journal->last_committed_sequence));
+  CommitSegmentSequenceNumber(first);
+  EXPECT_EQ(second,
+            static_cast<uint32>(journal->last_committed_sequence));
+}
+
 TEST_F(GetInstanceIdForModuleTest, ReturnsEmptyForNoEnvVar) {
   ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
   EXPECT_EQ(std::string(), GetInstanceIdForModule(path_));
@@ -188,6 +306,164 @@ TEST(IsRpcSessionMandatoryThisModuleTest, WorksAsExpected) {
   EXPECT_TRUE(IsRpcSessionMandatoryForThisModule());
 }
 
+TEST_F(IsRpcSessionLazyTest, ReturnsFalseForNoEnvVar) {
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+  EXPECT_FALSE(IsRpcSessionLazy(path_));
+}
+
+TEST_F(IsRpcSessionLazyTest, ReturnsFalseForNoMatch) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("bar.exe,1;baz.exe,1"));
+  EXPECT_FALSE(IsRpcSessionLazy(path_));
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+}
+
+TEST_F(IsRpcSessionLazyTest, ReturnsGlobalValueWhenNoPathMatches) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("1 ; bar.exe,0"));
+  EXPECT_TRUE(IsRpcSessionLazy(path_));
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+}
+
+TEST_F(IsRpcSessionLazyTest, ReturnsExactPathValue) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("0;foo.exe,0;C:\\path\\foo.exe, 1 "));
+  EXPECT_TRUE(IsRpcSessionLazy(path_));
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+}
+
+TEST_F(IsRpcSessionSharedTest, ReturnsFalseForNoEnvVar) {
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+  EXPECT_FALSE(IsRpcSessionShared(path_));
+}
+
+TEST_F(IsRpcSessionSharedTest, ReturnsFalseForNoMatch) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("bar.exe,1;baz.exe,1"));
+  EXPECT_FALSE(IsRpcSessionShared(path_));
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+}
+
+TEST_F(IsRpcSessionSharedTest, ReturnsGlobalValueWhenNoPathMatches) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("1 ; bar.exe,0"));
+  EXPECT_TRUE(IsRpcSessionShared(path_));
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+}
+
+TEST_F(IsRpcSessionSharedTest, ReturnsExactPathValue) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("0;foo.exe,0;C:\\path\\foo.exe, 1 "));
+  EXPECT_TRUE(IsRpcSessionShared(path_));
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+}
+
+TEST_F(IsRpcSessionAttachableTest, ReturnsFalseForNoEnvVar) {
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+  EXPECT_FALSE(IsRpcSessionAttachable(path_));
+}
+
+TEST_F(IsRpcSessionAttachableTest, ReturnsFalseForNoMatch) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("bar.exe,1;baz.exe,1"));
+  EXPECT_FALSE(IsRpcSessionAttachable(path_));
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+}
+
+TEST_F(IsRpcSessionAttachableTest, ReturnsGlobalValueWhenNoPathMatches) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("1 ; bar.exe,0"));
+  EXPECT_TRUE(IsRpcSessionAttachable(path_));
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+}
+
+TEST_F(IsRpcSessionAttachableTest, ReturnsExactPathValue) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("0;foo.exe,0;C:\\path\\foo.exe, 1 "));
+  EXPECT_TRUE(IsRpcSessionAttachable(path_));
+  ASSERT_NO_FATAL_FAILURE(UnsetEnvVar());
+}
+
+TEST(RpcSessionSharedTest, AdoptsRegisteredSession) {
+  // Stand in for the module that creates the process' session: register as
+  // the candidate owner and publish a (canned) created session.
+  TestSharedRpcSession owner;
+  owner.set_instance_id(L"shared-dummy-id");
+  owner.set_shared(true);
+  owner.session_handle_ = &owner;
+
+  TraceFileSegment owner_segment;
+  EXPECT_FALSE(owner.TryAdoptSharedSession(&owner_segment));
+  owner.PublishSharedSession();
+
+  // A second session with the same instance id adopts the registered
+  // session rather than connecting on its own, and draws its first buffer
+  // from it.
+  RpcSession borrower;
+  borrower.set_instance_id(L"shared-dummy-id");
+  borrower.set_shared(true);
+
+  TraceFileSegment segment;
+  ASSERT_TRUE(borrower.CreateSession(&segment));
+  EXPECT_TRUE(borrower.IsTracing());
+  EXPECT_FALSE(borrower.IsDisabled());
+  EXPECT_EQ(1u, owner.allocations_);
+  EXPECT_TRUE(segment.CanAllocate(sizeof(TraceFileSegmentHeader)));
+
+  // Closing the borrowed session severs the link without disturbing the
+  // registered session.
+  EXPECT_TRUE(borrower.CloseSession());
+  EXPECT_FALSE(borrower.IsTracing());
+  EXPECT_TRUE(owner.IsTracing());
+}
+
+TEST(RpcSessionLazyTest, LazyCreateSessionDefersHandshake) {
+  RpcSession session;
+  session.set_instance_id(L"dummy-id");
+  session.set_lazy(true);
+  EXPECT_TRUE(session.lazy());
+
+  // No service is running, yet session creation succeeds and events can be
+  // accumulated in the deferred buffer.
+  TraceFileSegment segment;
+  ASSERT_TRUE(session.CreateSession(&segment));
+  EXPECT_TRUE(session.IsTracing());
+  EXPECT_FALSE(session.IsDisabled());
+  EXPECT_TRUE(segment.CanAllocate(sizeof(TraceFileSegmentHeader)));
+
+  // The deferred handshake happens on the first buffer operation. With no
+  // service to connect to it fails and the session becomes disabled.
+  EXPECT_FALSE(session.ExchangeBuffer(&segment));
+  EXPECT_TRUE(session.IsDisabled());
+  EXPECT_FALSE(session.IsTracing());
+}
+
+TEST(RpcSessionAttachTest, ReenablesWhenServiceEventSignalled) {
+  RpcSession session;
+  session.set_instance_id(L"attach-dummy-id");
+  session.set_attachable(true);
+  EXPECT_TRUE(session.attachable());
+
+  // With no service running the handshake fails and the session disables
+  // itself, arming the watcher.
+  TraceFileSegment segment;
+  EXPECT_FALSE(session.CreateSession(&segment));
+  EXPECT_TRUE(session.IsDisabled());
+
+  // Stand in for a late-starting service by signalling its named ready
+  // event. The watcher should notice and re-enable the session.
+  std::wstring event_name;
+  ::GetSyzygyCallTraceRpcEventName(L"attach-dummy-id", &event_name);
+  base::win::ScopedHandle service_event(
+      ::CreateEvent(NULL, TRUE, FALSE, event_name.c_str()));
+  ASSERT_TRUE(service_event.IsValid());
+  ASSERT_TRUE(::SetEvent(service_event));
+
+  // The transition happens on the watcher thread; give it a generous
+  // deadline.
+  bool reenabled = false;
+  for (size_t i = 0; i < 1000; ++i) {
+    if (!session.IsDisabled()) {
+      reenabled = true;
+      break;
+    }
+    ::Sleep(10);
+  }
+  EXPECT_TRUE(reenabled);
+  EXPECT_FALSE(session.IsTracing());
+}
+
 TEST(InitializeRpcSessionTest, FailureSessionNotMandatory) {
   base::FilePath self_path =
       ::testing::GetExeRelativePath(L"rpc_client_lib_unittests.exe");
@@ -15,6 +15,7 @@
 // A utility class to manage the RPC session and the associated memory mappings.
 #include "syzygy/trace/client/rpc_session.h"
 
+#include "base/basictypes.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/rpc/helpers.h"
 #include "syzygy/trace/client/client_utils.h"
@@ -27,14 +28,41 @@ extern "C" IMAGE_DOS_HEADER __ImageBase;
 namespace trace {
 namespace client {
 
+namespace {
+
+// The size of the process-local buffer used to accumulate events while the
+// service handshake is deferred. This must be comfortably smaller than the
+// smallest buffer the service will hand out (see
+// trace::service::Service::kDefaultBufferSize), so that the accumulated
+// events can always be replayed into a real buffer.
+const size_t kDeferredBufferSize = 32 * 1024;
+
+}  // namespace
+
 RpcSession::RpcSession()
     : rpc_binding_(NULL),
       session_handle_(NULL),
       flags_(0),
-      is_disabled_(false) {
+      channel_(NULL),
+      channel_handle_(NULL),
+      channel_doorbell_(NULL),
+      lazy_(false),
+      shared_(false),
+      shared_session_(NULL),
+      shared_mapping_(NULL),
+      shared_record_(NULL),
+      deferred_(false),
+      deferred_segment_(NULL),
+      is_disabled_(false),
+      attachable_(false),
+      attach_thread_(NULL),
+      attach_stop_event_(NULL),
+      attach_service_event_(NULL) {
 }
 
 RpcSession::~RpcSession() {
+  DisarmAttachWatcher();
+  ReleaseSharedSession();
   FreeSharedMemory();
 }
 
@@ -86,6 +114,87 @@ bool RpcSession::MapSegmentBuffer(TraceFileSegment* segment) {
 bool RpcSession::CreateSession(TraceFileSegment* segment) {
   DCHECK(session_handle_ == NULL);
   DCHECK(rpc_binding_ == NULL);
+  DCHECK(segment != NULL);
+
+  if (lazy_) {
+    DCHECK(!deferred_);
+    InitializeDeferredSegment(segment);
+    return true;
+  }
+
+  return DoCreateSession(segment);
+}
+
+void RpcSession::InitializeDeferredSegment(TraceFileSegment* segment) {
+  DCHECK(segment != NULL);
+  DCHECK(deferred_buffer_.empty());
+
+  // Point the segment at a process-local buffer. The buffer_info is left
+  // zeroed, as it is never handed to the service; the deferred handshake
+  // replaces it wholesale.
+  deferred_buffer_.resize(kDeferredBufferSize);
+  segment->base_ptr = &deferred_buffer_[0];
+  segment->header = NULL;
+  segment->write_ptr = segment->base_ptr;
+  segment->end_ptr = segment->base_ptr + deferred_buffer_.size();
+  segment->WriteSegmentHeader(session_handle_);
+
+  deferred_segment_ = segment;
+  deferred_ = true;
+}
+
+bool RpcSession::ConnectDeferredSession() {
+  DCHECK(deferred_);
+  DCHECK(deferred_segment_ != NULL);
+  DCHECK_EQ(&deferred_buffer_[0], deferred_segment_->base_ptr);
+
+  deferred_ = false;
+
+  // Capture the extent of the events accumulated so far; the handshake
+  // points the segment at a shared-memory buffer.
+  size_t event_bytes = deferred_segment_->header->segment_length;
+  uint8* event_start =
+      reinterpret_cast<uint8*>(deferred_segment_->header + 1);
+
+  TraceFileSegment real_segment;
+  if (!DoCreateSession(&real_segment)) {
+    deferred_segment_ = NULL;
+    deferred_buffer_.clear();
+    return false;
+  }
+
+  // Replay the early events into the real buffer. The deferred buffer is
+  // deliberately smaller than any buffer the service hands out, so this
+  // always fits.
+  if (event_bytes != 0) {
+    CHECK(real_segment.CanAllocateRaw(event_bytes));
+    ::memcpy(real_segment.write_ptr, event_start, event_bytes);
+    real_segment.write_ptr += event_bytes;
+    real_segment.header->segment_length += event_bytes;
+  }
+
+  // Migrate the deferred segment to the real buffer, taking care not to
+  // clobber any testing callback it may be carrying.
+  deferred_segment_->buffer_info = real_segment.buffer_info;
+  deferred_segment_->header = real_segment.header;
+  deferred_segment_->base_ptr = real_segment.base_ptr;
+  deferred_segment_->write_ptr = real_segment.write_ptr;
+  deferred_segment_->end_ptr = real_segment.end_ptr;
+
+  deferred_segment_ = NULL;
+  deferred_buffer_.clear();
+
+  return true;
+}
+
+bool RpcSession::DoCreateSession(TraceFileSegment* segment) {
+  DCHECK(session_handle_ == NULL);
+  DCHECK(rpc_binding_ == NULL);
+
+  // When sharing is enabled, prefer a session that another module in this
+  // process has already created.
+  if (shared_ && TryAdoptSharedSession(segment))
+    return true;
 
   std::wstring protocol;
   std::wstring endpoint;
@@ -94,6 +203,9 @@ bool RpcSession::CreateSession(TraceFileSegment* segment) {
 
   if (!::common::rpc::CreateRpcBinding(protocol, endpoint, &rpc_binding_)) {
     is_disabled_ = true;
+    ReleaseSharedSession();
+    if (attachable_)
+      ArmAttachWatcher();
     return false;
   }
 
@@ -114,6 +226,14 @@ bool RpcSession::CreateSession(TraceFileSegment* segment) {
     LOG(ERROR) << "  instance_id = \"" << instance_id_ << "\"";
     LOG(ERROR) << "  module = \"" << module_path.value() << "\"";
     is_disabled_ = true;
+    ReleaseSharedSession();
+    if (attachable_) {
+      // Release the binding so that the re-attempted handshake starts from
+      // a clean slate.
+      ignore_result(::RpcBindingFree(&rpc_binding_));
+      rpc_binding_ = NULL;
+      ArmAttachWatcher();
+    }
     return false;
   }
 
@@ -124,16 +244,362 @@ bool RpcSession::CreateSession(TraceFileSegment* segment) {
 
   if (!MapSegmentBuffer(segment)) {
     is_disabled_ = true;
+    ReleaseSharedSession();
     return false;
   }
 
+  // Ask the service for a shared-memory buffer channel. This is purely an
+  // optimization for the buffer-exchange hot path; if the service doesn't
+  // provide one the RPCs are used throughout.
+  CreateBufferChannel();
+
+  // Register the session for other modules in this process to reuse.
+  if (shared_)
+    PublishSharedSession();
+
   return true;
 }
 
+bool RpcSession::TryAdoptSharedSession(TraceFileSegment* segment) {
+  DCHECK(shared_);
+  DCHECK(segment != NULL);
+  DCHECK(shared_mapping_ == NULL);
+
+  std::wstring name;
+  ::GetSyzygyCallTraceRpcSharedSessionName(instance_id_, &name);
+
+  // Create or open the process-wide registration. CreateFileMapping is
+  // atomic, so exactly one module in the process creates the registration
+  // and every other one opens it.
+  HANDLE mapping = ::CreateFileMapping(INVALID_HANDLE_VALUE, NULL,
+                                       PAGE_READWRITE, 0, sizeof(RpcSession*),
+                                       name.c_str());
+  if (mapping == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to create shared session registration: "
+                 << ::common::LogWe(error) << ".";
+    return false;
+  }
+  bool already_exists = ::GetLastError() == ERROR_ALREADY_EXISTS;
+
+  void* view = ::MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0,
+                               sizeof(RpcSession*));
+  if (view == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to map shared session registration: "
+                 << ::common::LogWe(error) << ".";
+    ignore_result(::CloseHandle(mapping));
+    return false;
+  }
+
+  shared_mapping_ = mapping;
+  shared_record_ = reinterpret_cast<RpcSession* volatile*>(view);
+
+  // If we created the registration, we are the candidate owner; proceed
+  // with a normal handshake, after which the session is published.
+  if (!already_exists)
+    return false;
+
+  // Module initialization is serialized under the loader lock, so the
+  // module that created the registration has by now either published its
+  // session or failed to create one. In the latter case, fall back to a
+  // session of our own.
+  RpcSession* session = *shared_record_;
+  if (session == NULL)
+    return false;
+  DCHECK(session->IsTracing());
+
+  // Take our first buffer from the adopted session. If that fails, fall
+  // back to a session of our own.
+  if (!session->AllocateBuffer(segment))
+    return false;
+
+  shared_session_ = session;
+  flags_ = session->flags();
+  return true;
+}
+
+void RpcSession::PublishSharedSession() {
+  DCHECK(session_handle_ != NULL);
+  if (shared_record_ == NULL)
+    return;
+
+  // Only fill an empty registration; another module may have raced us to
+  // a fallback session of its own.
+  ::InterlockedCompareExchangePointer(
+      reinterpret_cast<PVOID volatile*>(shared_record_), this, NULL);
+}
+
+void RpcSession::ReleaseSharedSession() {
+  if (shared_record_ != NULL) {
+    // Withdraw our registration, if the registered session is ours.
+    ::InterlockedCompareExchangePointer(
+        reinterpret_cast<PVOID volatile*>(shared_record_), NULL, this);
+    ignore_result(::UnmapViewOfFile(
+        const_cast<RpcSession**>(shared_record_)));
+    shared_record_ = NULL;
+  }
+
+  if (shared_mapping_ != NULL) {
+    ignore_result(::CloseHandle(shared_mapping_));
+    shared_mapping_ = NULL;
+  }
+}
+
+void RpcSession::ArmAttachWatcher() {
+  DCHECK(attachable_);
+  DCHECK(is_disabled_);
+
+  if (attach_thread_ != NULL) {
+    // A watcher from a previous failed handshake may still be waiting;
+    // leave it in place. If it has already fired, tear it down and arm a
+    // fresh one.
+    if (::WaitForSingleObject(attach_thread_, 0) == WAIT_TIMEOUT)
+      return;
+    DisarmAttachWatcher();
+  }
+
+  // Create (or open) the service's named ready event. The service signals
+  // this manual-reset event once it is accepting requests, and creating it
+  // by name here works whether or not the service exists yet.
+  std::wstring event_name;
+  ::GetSyzygyCallTraceRpcEventName(instance_id_, &event_name);
+  attach_service_event_ = ::CreateEvent(NULL, TRUE, FALSE, event_name.c_str());
+  if (attach_service_event_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to create service ready event: "
+                 << ::common::LogWe(error) << ".";
+    return;
+  }
+
+  attach_stop_event_ = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (attach_stop_event_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to create watcher stop event: "
+                 << ::common::LogWe(error) << ".";
+    ignore_result(::CloseHandle(attach_service_event_));
+    attach_service_event_ = NULL;
+    return;
+  }
+
+  attach_thread_ = ::CreateThread(NULL, 0, &AttachWatcherThreadProc, this,
+                                  0, NULL);
+  if (attach_thread_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to create attach watcher thread: "
+                 << ::common::LogWe(error) << ".";
+    ignore_result(::CloseHandle(attach_stop_event_));
+    attach_stop_event_ = NULL;
+    ignore_result(::CloseHandle(attach_service_event_));
+    attach_service_event_ = NULL;
+  }
+}
+
+void RpcSession::DisarmAttachWatcher() {
+  if (attach_thread_ != NULL) {
+    ignore_result(::SetEvent(attach_stop_event_));
+    ignore_result(::WaitForSingleObject(attach_thread_, INFINITE));
+    ignore_result(::CloseHandle(attach_thread_));
+    attach_thread_ = NULL;
+  }
+
+  if (attach_stop_event_ != NULL) {
+    ignore_result(::CloseHandle(attach_stop_event_));
+    attach_stop_event_ = NULL;
+  }
+
+  if (attach_service_event_ != NULL) {
+    ignore_result(::CloseHandle(attach_service_event_));
+    attach_service_event_ = NULL;
+  }
+}
+
+DWORD WINAPI RpcSession::AttachWatcherThreadProc(void* param) {
+  DCHECK(param != NULL);
+  reinterpret_cast<RpcSession*>(param)->AttachWatcherMain();
+  return 0;
+}
+
+void RpcSession::AttachWatcherMain() {
+  HANDLE handles[] = { attach_stop_event_, attach_service_event_ };
+  DWORD wait = ::WaitForMultipleObjects(arraysize(handles), handles, FALSE,
+                                        INFINITE);
+  if (wait != WAIT_OBJECT_0 + 1)
+    return;
+
+  // The service has come up. Re-enable the session; the agent's lazy
+  // initialization path notices this on the next instrumented call and
+  // performs the handshake, allocating buffers at that point. The
+  // transition is a benign unsynchronized write: the handshake itself is
+  // serialized by the agent's initialization lock.
+  VLOG(1) << "Call-trace service is up; re-enabling the session.";
+  is_disabled_ = false;
+}
+
+void RpcSession::CreateBufferChannel() {
+  DCHECK(channel_ == NULL);
+
+  unsigned long channel_handle = 0;
+  unsigned long doorbell_handle = 0;
+  bool succeeded =
+      ::common::rpc::InvokeRpc(CallTraceClient_GetBufferChannel,
+                               session_handle_, &channel_handle,
+                               &doorbell_handle).succeeded();
+  if (!succeeded) {
+    VLOG(1) << "The call-trace service did not provide a buffer channel.";
+    return;
+  }
+
+  HANDLE mapping = reinterpret_cast<HANDLE>(channel_handle);
+  CallTraceBufferChannel* channel = reinterpret_cast<CallTraceBufferChannel*>(
+      ::MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0,
+                      sizeof(CallTraceBufferChannel)));
+  if (channel == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to map buffer channel: "
+                 << ::common::LogWe(error) << ".";
+    ignore_result(::CloseHandle(mapping));
+    ignore_result(::CloseHandle(reinterpret_cast<HANDLE>(doorbell_handle)));
+    return;
+  }
+
+  channel_handle_ = mapping;
+  channel_doorbell_ = reinterpret_cast<HANDLE>(doorbell_handle);
+  channel_ = channel;
+}
+
+void RpcSession::FreeBufferChannel() {
+  if (channel_ == NULL)
+    return;
+
+  // The per-slot completion events belong to this process; close them before
+  // tearing down the mapping their handle values are recorded in.
+  for (size_t i = 0; i < CallTraceBufferChannel::kNumSlots; ++i) {
+    HANDLE done_event =
+        reinterpret_cast<HANDLE>(channel_->slots[i].done_event);
+    if (done_event != NULL)
+      ignore_result(::CloseHandle(done_event));
+  }
+
+  if (::UnmapViewOfFile(channel_) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to unmap buffer channel: "
+                 << ::common::LogWe(error);
+  }
+  channel_ = NULL;
+
+  ignore_result(::CloseHandle(channel_handle_));
+  channel_handle_ = NULL;
+  ignore_result(::CloseHandle(channel_doorbell_));
+  channel_doorbell_ = NULL;
+}
+
+bool RpcSession::TryChannelCommand(uint32 command,
+                                   CallTraceBuffer* buffer,
+                                   bool* result) {
+  DCHECK(buffer != NULL);
+  DCHECK(result != NULL);
+
+  if (channel_ == NULL || channel_->closed != 0)
+    return false;
+
+  // Claim a free slot. If every slot is in use, let the RPC fallback handle
+  // the overflow rather than waiting here.
+  CallTraceBufferChannelSlot* slot = NULL;
+  for (size_t i = 0; i < CallTraceBufferChannel::kNumSlots; ++i) {
+    CallTraceBufferChannelSlot* candidate = &channel_->slots[i];
+    if (::InterlockedCompareExchange(
+            &candidate->state,
+            CallTraceBufferChannelSlot::kSlotClientOwned,
+            CallTraceBufferChannelSlot::kSlotFree) ==
+        CallTraceBufferChannelSlot::kSlotFree) {
+      slot = candidate;
+      break;
+    }
+  }
+  if (slot == NULL)
+    return false;
+
+  slot->command = command;
+  slot->result = 0;
+  slot->buffer = *buffer;
+  HANDLE done_event = reinterpret_cast<HANDLE>(slot->done_event);
+
+  // Publish the command and ring the doorbell.
+  ::InterlockedExchange(&slot->state,
+                        CallTraceBufferChannelSlot::kSlotCommandPending);
+  if (::SetEvent(channel_doorbell_) == 0) {
+    // The service end has gone away. Take the command back if the service
+    // hasn't claimed it off the back of an earlier doorbell; either way the
+    // slot resolves and we fall through to the wait below if we must.
+    if (::InterlockedCompareExchange(
+            &slot->state,
+            CallTraceBufferChannelSlot::kSlotFree,
+            CallTraceBufferChannelSlot::kSlotCommandPending) ==
+        CallTraceBufferChannelSlot::kSlotCommandPending) {
+      return false;
+    }
+  }
+
+  while (true) {
+    DWORD wait = ::WaitForSingleObject(done_event, INFINITE);
+    if (wait != WAIT_OBJECT_0) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to wait on buffer channel slot: "
+                 << ::common::LogWe(error) << ".";
+      // Take the command back if it hasn't been claimed yet. If it has, the
+      // completion is imminent; spin for it, as the event can no longer be
+      // waited on.
+      if (::InterlockedCompareExchange(
+              &slot->state,
+              CallTraceBufferChannelSlot::kSlotFree,
+              CallTraceBufferChannelSlot::kSlotCommandPending) ==
+          CallTraceBufferChannelSlot::kSlotCommandPending) {
+        return false;
+      }
+      while (slot->state != CallTraceBufferChannelSlot::kSlotCommandDone)
+        ::Sleep(0);
+    }
+
+    // The usual case: the command has completed. Consume the response and
+    // release the slot.
+    if (::InterlockedCompareExchange(
+            &slot->state,
+            CallTraceBufferChannelSlot::kSlotClientOwned,
+            CallTraceBufferChannelSlot::kSlotCommandDone) ==
+        CallTraceBufferChannelSlot::kSlotCommandDone) {
+      *result = slot->result != 0;
+      *buffer = slot->buffer;
+      ::InterlockedExchange(&slot->state,
+                            CallTraceBufferChannelSlot::kSlotFree);
+      return true;
+    }
+
+    // If the command was never picked up then the channel has been closed
+    // under us (service shutdown); reclaim the slot and fall back to RPC.
+    if (::InterlockedCompareExchange(
+            &slot->state,
+            CallTraceBufferChannelSlot::kSlotFree,
+            CallTraceBufferChannelSlot::kSlotCommandPending) ==
+        CallTraceBufferChannelSlot::kSlotCommandPending) {
+      return false;
+    }
+
+    // Otherwise the service is mid-execution; wait for the completion
+    // signal again.
+  }
+}
+
 bool RpcSession::AllocateBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  if (deferred_ && !ConnectDeferredSession())
+    return false;
+
+  if (shared_session_ != NULL)
+    return shared_session_->AllocateBuffer(segment);
+
   bool succeeded =
       ::common::rpc::InvokeRpc(CallTraceClient_AllocateBuffer, session_handle_,
                                &segment->buffer_info).succeeded();
@@ -145,6 +611,12 @@ bool RpcSession::AllocateBuffer(size_t min_size, TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  if (deferred_ && !ConnectDeferredSession())
+    return false;
+
+  if (shared_session_ != NULL)
+    return shared_session_->AllocateBuffer(min_size, segment);
+
   // We want the actual buffer to have the provided minimum size. The call is
   // going to prepend the buffer with a RecordPrefix and a
   // TraceFileSegmentHeader, so we make room for those.
@@ -171,24 +643,94 @@ bool RpcSession::ExchangeBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
-  bool succeeded =
-      ::common::rpc::InvokeRpc(CallTraceClient_ExchangeBuffer, session_handle_,
-                               &segment->buffer_info).succeeded();
+  if (deferred_ && !ConnectDeferredSession())
+    return false;
 
-  return succeeded ? MapSegmentBuffer(segment) : false;
+  if (shared_session_ != NULL)
+    return shared_session_->ExchangeBuffer(segment);
+
+  // Sequence the outgoing segment. The number is allocated here rather than
+  // when the segment header is written so that segments that never reach
+  // the service (such as a discarded deferred buffer) don't punch holes in
+  // the sequence; note it before the exchange, as the segment is remapped
+  // to the new buffer on success.
+  DCHECK(segment->header != NULL);
+  uint32 committed_sequence = AllocateSegmentSequenceNumber();
+  segment->header->sequence_number = committed_sequence;
+
+  // Prefer the shared-memory buffer channel; fall back to the RPC when no
+  // channel or no free slot is available.
+  bool succeeded = false;
+  if (!TryChannelCommand(
+          CallTraceBufferChannelSlot::kSlotCommandExchangeBuffer,
+          &segment->buffer_info, &succeeded)) {
+    succeeded =
+        ::common::rpc::InvokeRpc(CallTraceClient_ExchangeBuffer,
+                                 session_handle_,
+                                 &segment->buffer_info).succeeded();
+  }
+
+  if (!succeeded)
+    return false;
+
+  CommitSegmentSequenceNumber(committed_sequence);
+  return MapSegmentBuffer(segment);
 }
 
 bool RpcSession::ReturnBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
-  return ::common::rpc::InvokeRpc(CallTraceClient_ReturnBuffer, session_handle_,
-                                  &segment->buffer_info).succeeded();
+  if (deferred_ && !ConnectDeferredSession())
+    return false;
+
+  if (shared_session_ != NULL)
+    return shared_session_->ReturnBuffer(segment);
+
+  // Sequence the outgoing segment; see ExchangeBuffer for why this happens
+  // here rather than when the segment header is written.
+  DCHECK(segment->header != NULL);
+  uint32 committed_sequence = AllocateSegmentSequenceNumber();
+  segment->header->sequence_number = committed_sequence;
+
+  // Prefer the shared-memory buffer channel; fall back to the RPC when no
+  // channel or no free slot is available.
+  bool succeeded = false;
+  if (!TryChannelCommand(CallTraceBufferChannelSlot::kSlotCommandReturnBuffer,
+                         &segment->buffer_info, &succeeded)) {
+    succeeded = ::common::rpc::InvokeRpc(CallTraceClient_ReturnBuffer,
+                                         session_handle_,
+                                         &segment->buffer_info).succeeded();
+  }
+
+  if (succeeded)
+    CommitSegmentSequenceNumber(committed_sequence);
+
+  return succeeded;
 }
 
 bool RpcSession::CloseSession() {
   DCHECK(IsTracing());
 
+  // If the handshake is still deferred perform it now so that any events
+  // accumulated in the deferred buffer make it to the service; buffers
+  // outstanding at session close are flushed by the service.
+  if (deferred_ && !ConnectDeferredSession())
+    return false;
+
+  // A borrowed session belongs to another module; sever the link and
+  // release the registration. Buffers this module still holds are flushed
+  // when the owning module closes the session.
+  if (shared_session_ != NULL) {
+    shared_session_ = NULL;
+    ReleaseSharedSession();
+    return true;
+  }
+
+  // Withdraw the shared session registration, if any, so that no module
+  // adopts a session that is going away.
+  ReleaseSharedSession();
+
   bool succeeded = ::common::rpc::InvokeRpc(CallTraceClient_CloseSession,
                                             &session_handle_).succeeded();
 
@@ -199,6 +741,8 @@ bool RpcSession::CloseSession() {
 }
 
 void RpcSession::FreeSharedMemory() {
+  FreeBufferChannel();
+
   base::AutoLock scoped_lock_(shared_memory_lock_);
 
   if (shared_memory_handles_.empty())
@@ -18,11 +18,13 @@
 #define SYZYGY_TRACE_CLIENT_RPC_SESSION_H_
 
 #include <map>
+#include <vector>
 
 #include "base/logging.h"
 #include "base/synchronization/lock.h"
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/rpc/buffer_channel.h"
 
 namespace trace {
 namespace client {
@@ -41,6 +43,54 @@ class RpcSession {
   // @returns the instance ID for this session.
   const std::wstring instance_id() const { return instance_id_; }
 
+  // Enables lazy session creation. When enabled, CreateSession does not
+  // contact the call-trace service; early events instead accumulate in a
+  // small process-local buffer, and the actual handshake is performed on the
+  // first subsequent buffer operation. This keeps the expensive RPC
+  // connection off the critical path of process startup, which typically
+  // runs under the loader lock.
+  // @param lazy true to defer the service handshake.
+  // @note This must be set prior to calling CreateSession. Until the
+  //     deferred handshake has completed, buffer operations must be
+  //     serialized by the caller, as they are during agent initialization.
+  void set_lazy(bool lazy) {
+    DCHECK(!IsTracing());
+    lazy_ = lazy;
+  }
+  bool lazy() const { return lazy_; }
+
+  // Enables process-wide session sharing. When enabled, session creation
+  // first looks for a session already registered by another module in this
+  // process and reuses it, so that a process with several instrumented
+  // modules runs a single RPC session and a single set of shared-memory
+  // buffers. If no session has been registered yet, a session is created
+  // normally and registered for later modules to find. Each module keeps
+  // writing its own trace segments, so its events remain attributable to it.
+  // @param shared true to discover and reuse an in-process session.
+  // @note This must be set prior to calling CreateSession. The module that
+  //     ends up owning the shared session must remain loaded, and its
+  //     session open, for as long as any borrowing module is tracing.
+  void set_shared(bool shared) {
+    DCHECK(!IsTracing());
+    shared_ = shared;
+  }
+  bool shared() const { return shared_; }
+
+  // Enables attachment to a late-starting call-trace service. When no
+  // service is reachable at handshake time the session normally disables
+  // itself for the life of the process. With attachment enabled a
+  // background watcher instead waits on the service's named ready event
+  // and re-enables the session once a service comes up; the next
+  // instrumented call then performs the handshake and allocates buffers,
+  // exactly as in lazy mode.
+  // @param attachable true to watch for a late-starting service.
+  // @note This must be set prior to calling CreateSession.
+  void set_attachable(bool attachable) {
+    DCHECK(!IsTracing());
+    attachable_ = attachable;
+  }
+  bool attachable() const { return attachable_; }
+
   // @name Wrapper and helper functions for the RPC and shared memory calls made
   // by the call-trace client. These are virtual for ease of unittesting.
   // @{
@@ -62,7 +112,7 @@ class RpcSession {
   }
 
   bool IsTracing() const {
-    return session_handle_ != NULL;
+    return deferred_ || session_handle_ != NULL || shared_session_ != NULL;
   }
 
   bool IsDisabled() const {
@@ -75,6 +125,67 @@ class RpcSession {
   // Map a tracefile segment buffer into local memory.
   bool MapSegmentBuffer(TraceFileSegment* segment);
 
+  // Performs the actual service handshake, as deferred by lazy mode.
+  bool DoCreateSession(TraceFileSegment* segment);
+
+  // Requests and maps the session's shared-memory buffer channel. The
+  // channel is purely an optimization, so failure is not propagated; the
+  // buffer-exchange RPCs are used for everything when no channel is
+  // available.
+  void CreateBufferChannel();
+
+  // Releases the buffer channel's mapping and handles, if any.
+  void FreeBufferChannel();
+
+  // Attempts to execute a buffer command over the shared-memory channel.
+  // @param command the CallTraceBufferChannelSlot command to post.
+  // @param buffer the buffer to commit; for an exchange, receives the fresh
+  //     buffer on success.
+  // @param result receives the outcome of the command.
+  // @returns true if the channel executed the command, with its outcome in
+  //     @p result; false if the caller should fall back to the RPC.
+  bool TryChannelCommand(uint32 command,
+                         CallTraceBuffer* buffer,
+                         bool* result);
+
+  // Points @p segment at the process-local deferred buffer, into which early
+  // events accumulate until the deferred handshake is performed.
+  void InitializeDeferredSegment(TraceFileSegment* segment);
+
+  // Creates or opens the process-wide shared session registration. If
+  // another module has already registered a session this adopts it, records
+  // it in shared_session_ and allocates @p segment from it. Otherwise this
+  // session becomes the candidate owner and proceeds with a normal
+  // handshake, after which PublishSharedSession is used to register it.
+  // @param segment receives a buffer from the adopted session.
+  // @returns true if an existing session was adopted.
+  bool TryAdoptSharedSession(TraceFileSegment* segment);
+
+  // Registers this fully created session for other modules to adopt.
+  void PublishSharedSession();
+
+  // Withdraws the shared session registration, if any, and releases the
+  // mapping backing it.
+  void ReleaseSharedSession();
+
+  // Performs the deferred handshake and replays the events accumulated in
+  // the deferred buffer into the newly allocated shared-memory buffer.
+  bool ConnectDeferredSession();
+
+  // Starts the background watcher that waits for the service's named ready
+  // event and clears is_disabled_ when it is signalled. Called when a
+  // handshake fails because no service is reachable and attachment is
+  // enabled. Failure to arm the watcher is not fatal; the session simply
+  // stays disabled.
+  void ArmAttachWatcher();
+
+  // Stops the watcher thread, if any, and releases its resources.
+  void DisarmAttachWatcher();
+
+  // The entry point and body of the watcher thread.
+  static DWORD WINAPI AttachWatcherThreadProc(void* param);
+  void AttachWatcherMain();
+
   // The call trace RPC binding.
   handle_t rpc_binding_;
 
@@ -95,11 +206,62 @@ class RpcSession {
   base::Lock shared_memory_lock_;
   SharedMemoryHandleMap shared_memory_handles_;
 
+  // The session's shared-memory buffer channel, or NULL if the service did
+  // not provide one. When a channel is present, ExchangeBuffer and
+  // ReturnBuffer post their commands here whenever a slot is free, avoiding
+  // an RPC round trip on the buffer-exchange hot path. Slot claiming is
+  // lock-free, so no additional synchronization is needed.
+  CallTraceBufferChannel* channel_;
+
+  // The handles backing the channel: its shared-memory mapping and the
+  // doorbell event signalled after posting a command.
+  HANDLE channel_handle_;
+  HANDLE channel_doorbell_;
+
+  // True if the session handshake is to be deferred (see set_lazy).
+  bool lazy_;
+
+  // True if process-wide session sharing is enabled (see set_shared).
+  bool shared_;
+
+  // The in-process session adopted from another module, or NULL if this
+  // session is not borrowing one. All buffer operations are forwarded to
+  // the adopted session.
+  RpcSession* shared_session_;
+
+  // The mapping backing the process-wide shared session registration, and
+  // its view. These are held both by the owning session, which registers
+  // itself, and by borrowing sessions, which keep the registration alive.
+  HANDLE shared_mapping_;
+  RpcSession* volatile* shared_record_;
+
+  // True between a lazy CreateSession and the deferred handshake.
+  bool deferred_;
+
+  // The segment handed to the lazy CreateSession. It points into
+  // deferred_buffer_ until the deferred handshake migrates it to a
+  // shared-memory buffer.
+  TraceFileSegment* deferred_segment_;
+
+  // The process-local buffer backing the deferred segment. This is kept
+  // deliberately smaller than any buffer the service hands out, so that its
+  // contents can always be replayed into a real buffer.
+  std::vector<uint8> deferred_buffer_;
+
   // This becomes true if the client fails to attach to a call trace service.
   // This is used to allow the application to run even if no call trace
   // service is available.
   bool is_disabled_;
 
+  // True if mid-run attachment is enabled (see set_attachable).
+  bool attachable_;
+
+  // The watcher thread armed when a handshake finds no service, the event
+  // used to stop it, and the service's named ready event it waits on.
+  HANDLE attach_thread_;
+  HANDLE attach_stop_event_;
+  HANDLE attach_service_event_;
+
   // The (optional) unique id used to differentiate concurrent instances of the
   // RPC call-trace logging service.
   std::wstring instance_id_;
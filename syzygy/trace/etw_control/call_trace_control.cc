@@ -34,6 +34,10 @@ static const wchar_t kChromeSessionName[] = L"Chrome Event Logger";
 static const wchar_t kDefaultCallTraceFile[] = L"call_trace.etl";
 static const wchar_t kDefaultKernelFile[] = L"kernel.etl";
 
+// The default amount of in-memory buffer space for a ring-buffer session,
+// in MB. Buffers are 1 MB each, so this is also a buffer count.
+static const int kDefaultRingBufferSize = 32;
+
 enum FileMode {
   kFileOverwrite,
   kFileAppend
@@ -46,6 +50,12 @@ struct CallTraceOptions {
   FileMode file_mode;
   int flags;
   int min_buffers;
+  // If true the sessions log to a circular set of in-memory buffers rather
+  // than to the files above, and events only reach disk when a snapshot is
+  // taken.
+  bool ring_buffer;
+  // The size of the in-memory ring, in MB.
+  int ring_buffer_size;
 };
 
 // Initializes the command-line and logging for functions called via rundll32.
@@ -105,6 +115,18 @@ static bool ParseOptions(CallTraceOptions* options) {
   else
     options->file_mode = kFileOverwrite;
 
+  options->ring_buffer = cmd_line->HasSwitch("ring-buffer");
+  if (!base::StringToInt(cmd_line->GetSwitchValueASCII("ring-buffer-size"),
+                         &options->ring_buffer_size) ||
+      options->ring_buffer_size <= 0) {
+    options->ring_buffer_size = kDefaultRingBufferSize;
+  }
+
+  if (options->ring_buffer && options->file_mode == kFileAppend) {
+    LOG(ERROR) << "append is incompatible with ring-buffer.";
+    return false;
+  }
+
   return true;
 }
 
@@ -134,7 +156,8 @@ static void SetupEtwProperties(EtwTraceType trace_type,
 
   switch (trace_type) {
     case kKernelType: {
-      properties->SetLoggerFileName(options.kernel_file.value().c_str());
+      if (!options.ring_buffer)
+        properties->SetLoggerFileName(options.kernel_file.value().c_str());
 
       p->Wnode.Guid = kSystemTraceControlGuid;
       p->EnableFlags = options.flags;
@@ -148,7 +171,8 @@ static void SetupEtwProperties(EtwTraceType trace_type,
     }
 
     case kCallTraceType: {
-      properties->SetLoggerFileName(options.call_trace_file.value().c_str());
+      if (!options.ring_buffer)
+        properties->SetLoggerFileName(options.call_trace_file.value().c_str());
 
       p->EnableFlags = 0;
 
@@ -170,7 +194,8 @@ static void SetupEtwProperties(EtwTraceType trace_type,
       // This should never be called with an empty file name.
       DCHECK(!options.chrome_file.empty());
 
-      properties->SetLoggerFileName(options.chrome_file.value().c_str());
+      if (!options.ring_buffer)
+        properties->SetLoggerFileName(options.chrome_file.value().c_str());
 
       // Chrome is quite low volume.
       p->EnableFlags = 0;
@@ -185,7 +210,17 @@ static void SetupEtwProperties(EtwTraceType trace_type,
     }
   }
 
-  // Set the logging mode.
+  // Set the logging mode. In ring-buffer mode events accumulate in a fixed
+  // circular set of in-memory buffers, overwriting the oldest as needed, and
+  // only reach disk when a snapshot is taken. The ring size caps how far
+  // back a snapshot can see.
+  if (options.ring_buffer) {
+    p->LogFileMode = EVENT_TRACE_BUFFERING_MODE;
+    p->MinimumBuffers = options.ring_buffer_size;
+    p->MaximumBuffers = options.ring_buffer_size;
+    return;
+  }
+
   switch (options.file_mode) {
     case kFileAppend: {
       p->LogFileMode = EVENT_TRACE_FILE_MODE_APPEND;
@@ -303,6 +338,15 @@ static bool FlushAndStopSession(const wchar_t* session_name,
 
   *file_name = props.GetLoggerFileName();
 
+  // Ring-buffer sessions have no log file bound to them; any events that
+  // have not been committed to disk by a snapshot are discarded with the
+  // session.
+  if ((props.get()->LogFileMode & EVENT_TRACE_BUFFERING_MODE) != 0) {
+    LOG(INFO) << "Session '" << session_name << "' is a ring-buffer session; "
+        << "events not previously snapshotted are discarded.";
+    return StopSession(session_name, &props);
+  }
+
   LOG(INFO) << "Flushing session '" << session_name << "'.";
   hr = EtwTraceController::Flush(session_name, &props);
   if (FAILED(hr)) {
@@ -320,6 +364,45 @@ static bool FlushAndStopSession(const wchar_t* session_name,
   return true;
 }
 
+// Commits the in-memory buffers of the ring-buffer session with the given
+// name to @p file_path, leaving the session running. Returns true on
+// success, false otherwise.
+static bool SnapshotSession(const wchar_t* session_name,
+                            const base::FilePath& file_path) {
+  EtwTraceProperties props;
+  LOG(INFO) << "Querying session '" << session_name << "'.";
+  HRESULT hr = EtwTraceController::Query(session_name, &props);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to query '" << session_name << "' session: "
+        << ::common::LogHr(hr) << ".";
+    return false;
+  }
+
+  if ((props.get()->LogFileMode & EVENT_TRACE_BUFFERING_MODE) == 0) {
+    LOG(ERROR) << "Session '" << session_name << "' is not a ring-buffer "
+        "session; snapshot only applies to sessions started with "
+        "--ring-buffer.";
+    return false;
+  }
+
+  // For a buffering-mode session a flush with a log file name set writes the
+  // current contents of the ring to that file.
+  props.SetLoggerFileName(file_path.value().c_str());
+
+  LOG(INFO) << "Snapshotting session '" << session_name << "' to '"
+      << file_path.value() << "'.";
+  hr = EtwTraceController::Flush(session_name, &props);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to snapshot '" << session_name << "' session: "
+        << ::common::LogHr(hr) << ".";
+    return false;
+  }
+
+  DumpEtwTraceProperties(session_name, props);
+
+  return true;
+}
+
 class ScopedSession {
  public:
   ScopedSession(const wchar_t* session_name,
@@ -459,6 +542,36 @@ bool QueryCallTraceImpl() {
   return success;
 }
 
+bool SnapshotCallTraceImpl() {
+  CallTraceOptions options;
+  if (!ParseOptions(&options))
+    return false;
+
+  // Always try snapshotting every session before exiting on error; they are
+  // independent and one may have been stopped manually.
+  bool success = true;
+  if (!SnapshotSession(kCallTraceSessionName, options.call_trace_file))
+    success = false;
+  if (!SnapshotSession(KERNEL_LOGGER_NAMEW, options.kernel_file))
+    success = false;
+
+  // The Chrome session is optional, only snapshot it if it's running.
+  EtwTraceProperties props;
+  HRESULT hr = EtwTraceController::Query(kChromeSessionName, &props);
+  if (SUCCEEDED(hr)) {
+    LOG(INFO) << "Detected optional session: '" << kChromeSessionName << "'.";
+    if (options.chrome_file.empty()) {
+      LOG(ERROR) << "Must specify chrome-file to snapshot '"
+          << kChromeSessionName << "'.";
+      success = false;
+    } else if (!SnapshotSession(kChromeSessionName, options.chrome_file)) {
+      success = false;
+    }
+  }
+
+  return success;
+}
+
 bool StopCallTraceImpl() {
   // Always try stopping both traces before exiting on error. It may be that
   // one of them was already stopped manually and FlushAndStopSession will
@@ -34,6 +34,7 @@ void CALLBACK StopCallTrace(HWND unused_window,
 // These are used by call_trace_control.exe
 bool StartCallTraceImpl();
 bool QueryCallTraceImpl();
+bool SnapshotCallTraceImpl();
 bool StopCallTraceImpl();
 
 #endif  // SYZYGY_TRACE_ETW_CONTROL_CALL_TRACE_CONTROL_H_
@@ -24,7 +24,12 @@ static const char kUsage[] =
     "Commands:\n"
     "  start: start the call-trace, creating the ETW logs.\n"
     "  query: query the call-trace status.\n"
-    "  stop: stop the call-trace, flushing and closing the ETW logs.\n"
+    "  snapshot: commit the in-memory ring buffers to the ETW log files,\n"
+    "      leaving the sessions running. Only valid for sessions started\n"
+    "      with --ring-buffer.\n"
+    "  stop: stop the call-trace, flushing and closing the ETW logs. For\n"
+    "      ring-buffer sessions events not previously snapshotted are\n"
+    "      discarded.\n"
     "\n"
     "Options to 'start':\n"
     "  --append: Append to the ETW log files rather than overwriting them.\n"
@@ -38,7 +43,17 @@ static const char kUsage[] =
     "      Defaults to 'kernel.etl' in the current working directory.\n"
     "  --kernel-flags: Flags to pass to kernel ETW logger (numeric).\n"
     "      Defaults to PROCESS|THREAD|IMAGE_LOAD|DISK_IO|DISK_FILE_IO|\n"
-    "                  MEMORY_PAGE_FAULTS|MEMORY_HARD_FAULTS|FILE_IO.\n";
+    "                  MEMORY_PAGE_FAULTS|MEMORY_HARD_FAULTS|FILE_IO.\n"
+    "  --ring-buffer: Log to a circular set of in-memory buffers rather\n"
+    "      than to the ETW log files. Events only reach disk when\n"
+    "      'snapshot' is invoked, so the sessions can stay armed\n"
+    "      continuously without paying full-rate file logging.\n"
+    "  --ring-buffer-size: The size of each session's ring, in MB.\n"
+    "      Bounds how far back a snapshot can see. Defaults to 32.\n"
+    "\n"
+    "Options to 'snapshot':\n"
+    "  --call-trace-file, --kernel-file, --chrome-file: As for 'start';\n"
+    "      name the files that receive the snapshots.\n";
 
 int Usage() {
   std::cout << kUsage;
@@ -48,6 +63,7 @@ int Usage() {
 enum Command {
   kStart,
   kQuery,
+  kSnapshot,
   kStop,
 };
 
@@ -79,6 +95,8 @@ bool ParseOptions(Options* options) {
     options->command = kStart;
   } else if (cmd_line->GetArgs()[0] == L"query") {
     options->command = kQuery;
+  } else if (cmd_line->GetArgs()[0] == L"snapshot") {
+    options->command = kSnapshot;
   } else if (cmd_line->GetArgs()[0] == L"stop") {
     options->command = kStop;
   } else {
@@ -117,6 +135,11 @@ int main(int argc, char** argv) {
       break;
     }
 
+    case kSnapshot: {
+      success = SnapshotCallTraceImpl();
+      break;
+    }
+
     case kStop: {
       success = StopCallTraceImpl();
       break;
@@ -244,6 +244,35 @@ class TraceFileDumper : public ParseEventHandler {
     indentation_ = "";
   }
 
+  virtual void OnBatchCountedFunctionEntry(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceBatchCountedEnterData* data) {
+    DCHECK(data != NULL);
+    DCHECK_EQ(thread_id, data->thread_id);
+    ::fprintf(file_,
+              "[%012lld] OnBatchCountedFunctionEntry: " \
+                  "process-id=%d; thread-id=%d; num-entries=%d\n",
+              time.ToInternalValue(),
+              process_id,
+              thread_id,
+              data->num_entries);
+
+    // Print the counted entries individually, rather than exploding them
+    // into their constituent function entry events.
+    indentation_ = "    ";
+    for (size_t i = 0; i < data->num_entries; ++i) {
+      ::fprintf(file_,
+                "[%012lld] %sFunctionEntry: function=0x%08X; count=%d\n",
+                time.ToInternalValue(),
+                indentation_,
+                data->entries[i].function,
+                data->entries[i].count);
+    }
+    indentation_ = "";
+  }
+
   virtual void OnProcessAttach(base::Time time,
                                DWORD process_id,
                                DWORD thread_id,
@@ -478,6 +507,33 @@ class TraceFileDumper : public ParseEventHandler {
     }
   }
 
+  // Issued for function call summary records.
+  virtual void OnFunctionCallSummary(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceFunctionCallSummary* data) OVERRIDE {
+    DCHECK_NE(static_cast<TraceFunctionCallSummary*>(nullptr), data);
+    ::fprintf(file_,
+              "[%012lld] OnFunctionCallSummary: process-id=%d;\n"
+              "    thread-id=%d; function-id=%d; stack-trace-id=0x%08X;\n"
+              "    call-count=%llu; total-bytes=%llu; max-bytes=%llu\n",
+              time.ToInternalValue(),
+              process_id,
+              thread_id,
+              data->function_id,
+              data->stack_trace_id,
+              data->call_count,
+              data->total_bytes,
+              data->max_bytes);
+
+    // Output the function name if we've seen it.
+    auto it = function_names_.find(
+        ProcessIdFunctionIdPair(process_id, data->function_id));
+    if (it != function_names_.end())
+      ::fprintf(file_, "    function_name='%s';\n", it->second.c_str());
+  }
+
   virtual void OnComment(
       base::Time time,
       DWORD process_id,
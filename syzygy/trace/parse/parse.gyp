@@ -34,6 +34,7 @@
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
+        '<(src)/third_party/zlib/zlib.gyp:zlib',
       ],
     },
     {
@@ -29,8 +29,11 @@ namespace parser {
 
 using ::common::BinaryBufferReader;
 
+const ParseEngine::EventTypeMask ParseEngine::kAllEventTypes;
+
 ParseEngine::ParseEngine(const char* name, bool fail_on_module_conflict)
     : event_handler_(NULL),
+      event_type_mask_(kAllEventTypes),
       error_occurred_(false),
       fail_on_module_conflict_(fail_on_module_conflict) {
   DCHECK(name != NULL);
@@ -59,6 +62,32 @@ void ParseEngine::set_event_handler(ParseEventHandler* event_handler) {
   event_handler_ = event_handler;
 }
 
+void ParseEngine::set_event_type_mask(EventTypeMask event_type_mask) {
+  event_type_mask_ = event_type_mask;
+}
+
+bool ParseEngine::ShouldDispatchEventType(TraceEventType type) const {
+  // Unrecognized event types are dispatched so that DispatchEvent() can
+  // report them.
+  if (static_cast<size_t>(type) >= 8 * sizeof(EventTypeMask))
+    return true;
+
+  // Module and process lifetime events drive the module tracking most event
+  // handlers rely on, so they are never filtered out.
+  switch (type) {
+    case TRACE_PROCESS_ENDED:
+    case TRACE_PROCESS_ATTACH_EVENT:
+    case TRACE_PROCESS_DETACH_EVENT:
+    case TRACE_THREAD_ATTACH_EVENT:
+    case TRACE_THREAD_DETACH_EVENT:
+      return true;
+    default:
+      break;
+  }
+
+  return (event_type_mask_ & EventTypeToMask(type)) != 0;
+}
+
 const ModuleInformation* ParseEngine::GetModuleInformation(
     uint32 process_id, AbsoluteAddress64 addr) const {
   ProcessMap::const_iterator processes_it = processes_.find(process_id);
@@ -215,6 +244,10 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
       success = DispatchBatchEnterEvent(event);
       break;
 
+    case TRACE_BATCH_COUNTED_ENTER:
+      success = DispatchBatchCountedEnterEvent(event);
+      break;
+
     case TRACE_PROCESS_ATTACH_EVENT:
     case TRACE_PROCESS_DETACH_EVENT:
     case TRACE_THREAD_ATTACH_EVENT:
@@ -262,6 +295,10 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
       success = DispatchDetailedFunctionCall(event);
       break;
 
+    case TRACE_FUNCTION_CALL_SUMMARY:
+      success = DispatchFunctionCallSummary(event);
+      break;
+
     case TRACE_COMMENT:
       success = DispatchComment(event);
       break;
@@ -278,12 +315,85 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
   return true;
 }
 
-bool ParseEngine::DispatchEntryExitEvent(EVENT_TRACE* event,
-                                         TraceEventType type) {
+bool ParseEngine::DispatchEventBatched(EVENT_TRACE* event) {
   DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
   DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
   DCHECK(!error_occurred_);
-  DCHECK(type == TRACE_ENTER_EVENT || type == TRACE_EXIT_EVENT);
+
+  if (kCallTraceEventClass != event->Header.Guid)
+    return false;
+
+  bool success = false;
+  TraceEventType type = static_cast<TraceEventType>(event->Header.Class.Type);
+
+  // Only runs of a single event type are coalesced, so that the relative
+  // ordering of dispatched events is preserved. An event of another type
+  // flushes any pending run before it is itself deferred or dispatched.
+  switch (type) {
+    case TRACE_ENTER_EVENT:
+    case TRACE_EXIT_EVENT: {
+      FunctionEventRecord record;
+      success = DecodeEntryExitEvent(event, &record);
+      if (success) {
+        std::vector<FunctionEventRecord>* pending =
+            (type == TRACE_ENTER_EVENT) ? &pending_entry_events_
+                                        : &pending_exit_events_;
+        if (pending->empty())
+          FlushEventBatch();
+        pending->push_back(record);
+      }
+      break;
+    }
+
+    case TRACE_BATCH_INVOCATION: {
+      InvocationBatchRecord record;
+      success = DecodeBatchInvocationEvent(event, &record);
+      if (success) {
+        if (pending_invocation_batches_.empty())
+          FlushEventBatch();
+        pending_invocation_batches_.push_back(record);
+      }
+      break;
+    }
+
+    default:
+      FlushEventBatch();
+      return DispatchEvent(event);
+  }
+
+  if (!success) {
+    error_occurred_ = true;
+  }
+
+  return true;
+}
+
+void ParseEngine::FlushEventBatch() {
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+
+  if (!pending_entry_events_.empty()) {
+    event_handler_->OnFunctionEntryBatch(&pending_entry_events_[0],
+                                         pending_entry_events_.size());
+    pending_entry_events_.clear();
+  }
+
+  if (!pending_exit_events_.empty()) {
+    event_handler_->OnFunctionExitBatch(&pending_exit_events_[0],
+                                        pending_exit_events_.size());
+    pending_exit_events_.clear();
+  }
+
+  if (!pending_invocation_batches_.empty()) {
+    event_handler_->OnInvocationBatches(&pending_invocation_batches_[0],
+                                        pending_invocation_batches_.size());
+    pending_invocation_batches_.clear();
+  }
+}
+
+bool ParseEngine::DecodeEntryExitEvent(EVENT_TRACE* event,
+                                       FunctionEventRecord* record) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<FunctionEventRecord*>(nullptr), record);
 
   BinaryBufferReader reader(event->MofData, event->MofLength);
   const TraceEnterExitEventData* data = NULL;
@@ -293,18 +403,63 @@ bool ParseEngine::DispatchEntryExitEvent(EVENT_TRACE* event,
     return false;
   }
 
-  base::Time time(base::Time::FromFileTime(
-      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
-  DWORD process_id = event->Header.ProcessId;
-  DWORD thread_id = event->Header.ThreadId;
+  record->time = base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp));
+  record->process_id = event->Header.ProcessId;
+  record->thread_id = event->Header.ThreadId;
+  record->data = data;
+
+  return true;
+}
+
+bool ParseEngine::DecodeBatchInvocationEvent(EVENT_TRACE* event,
+                                             InvocationBatchRecord* record) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<InvocationBatchRecord*>(nullptr), record);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  if (event->MofLength % sizeof(InvocationInfo) != 0) {
+    LOG(ERROR) << "Invocation batch length off.";
+    return false;
+  }
+
+  const TraceBatchInvocationInfo* data = NULL;
+  if (!reader.Read(event->MofLength, &data)) {
+    LOG(ERROR) << "Short or empty batch event.";
+    return false;
+  }
+
+  // TODO(rogerm): Ensure this is robust in the presence of incomplete write.
+  record->time = base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp));
+  record->process_id = event->Header.ProcessId;
+  record->thread_id = event->Header.ThreadId;
+  record->num_invocations = event->MofLength / sizeof(InvocationInfo);
+  record->data = data;
+
+  return true;
+}
+
+bool ParseEngine::DispatchEntryExitEvent(EVENT_TRACE* event,
+                                         TraceEventType type) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+  DCHECK(type == TRACE_ENTER_EVENT || type == TRACE_EXIT_EVENT);
+
+  FunctionEventRecord record;
+  if (!DecodeEntryExitEvent(event, &record))
+    return false;
 
   switch (type) {
     case TRACE_ENTER_EVENT:
-      event_handler_->OnFunctionEntry(time, process_id, thread_id, data);
+      event_handler_->OnFunctionEntry(record.time, record.process_id,
+                                      record.thread_id, record.data);
       break;
 
     case TRACE_EXIT_EVENT:
-      event_handler_->OnFunctionExit(time, process_id, thread_id, data);
+      event_handler_->OnFunctionExit(record.time, record.process_id,
+                                     record.thread_id, record.data);
       break;
 
     default:
@@ -356,6 +511,49 @@ bool ParseEngine::DispatchBatchEnterEvent(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchBatchCountedEnterEvent(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceBatchCountedEnterData* data = NULL;
+  size_t offset_to_entries = FIELD_OFFSET(TraceBatchCountedEnterData, entries);
+  if (!reader.Read(offset_to_entries, &data)) {
+    LOG(ERROR) << "Short or empty counted batch event.";
+    return false;
+  }
+
+  size_t bytes_needed = data->num_entries * sizeof(data->entries[0]);
+  if (!reader.Consume(bytes_needed)) {
+    LOG(ERROR) << "Short counted batch event data. Expected "
+               << data->num_entries << " entries ("
+               << (offset_to_entries + bytes_needed)
+               << " bytes) but batch record was only " << event->MofLength
+               << " bytes.";
+    return false;
+  }
+
+  // Trim the batch entries if the last one has a NULL function, indicating
+  // that the reporting thread was interrupted mid-write.
+  if (data->num_entries != 0 &&
+      data->entries[data->num_entries - 1].function == NULL) {
+    // Yuck! Cast away constness because the BinaryBufferReader only likes
+    // to deal with const output pointers.
+    const_cast<TraceBatchCountedEnterData*>(data)->num_entries -= 1;
+  }
+  DCHECK(data->num_entries == 0 ||
+         data->entries[data->num_entries - 1].function != NULL);
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = data->thread_id;
+  event_handler_->OnBatchCountedFunctionEntry(time, process_id, thread_id,
+                                              data);
+  return true;
+}
+
 bool ParseEngine::DispatchProcessEndedEvent(EVENT_TRACE* event) {
   DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
   DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
@@ -376,29 +574,15 @@ bool ParseEngine::DispatchBatchInvocationEvent(EVENT_TRACE* event) {
   DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
   DCHECK(!error_occurred_);
 
-  BinaryBufferReader reader(event->MofData, event->MofLength);
-  if (event->MofLength % sizeof(InvocationInfo) != 0) {
-    LOG(ERROR) << "Invocation batch length off.";
+  InvocationBatchRecord record;
+  if (!DecodeBatchInvocationEvent(event, &record))
     return false;
-  }
 
-  const TraceBatchInvocationInfo* data = NULL;
-  if (!reader.Read(event->MofLength, &data)) {
-    LOG(ERROR) << "Short or empty batch event.";
-    return false;
-  }
-
-  // TODO(rogerm): Ensure this is robust in the presence of incomplete write.
-  size_t num_invocations = event->MofLength / sizeof(InvocationInfo);
-  base::Time time(base::Time::FromFileTime(
-      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
-  DWORD process_id = event->Header.ProcessId;
-  DWORD thread_id = event->Header.ThreadId;
-  event_handler_->OnInvocationBatch(time,
-                                    process_id,
-                                    thread_id,
-                                    num_invocations,
-                                    data);
+  event_handler_->OnInvocationBatch(record.time,
+                                    record.process_id,
+                                    record.thread_id,
+                                    record.num_invocations,
+                                    record.data);
 
   return true;
 }
@@ -409,9 +593,8 @@ bool ParseEngine::DispatchThreadNameEvent(EVENT_TRACE* event) {
   DCHECK(!error_occurred_);
 
   BinaryBufferReader reader(event->MofData, event->MofLength);
-  const char* thread_name = NULL;
-  size_t thread_name_len = 0;
-  if (!reader.ReadString(&thread_name, &thread_name_len)) {
+  base::StringPiece thread_name;
+  if (!reader.ReadStringPiece(&thread_name)) {
     LOG(ERROR) << "Unable to read string.";
     return false;
   }
@@ -420,10 +603,7 @@ bool ParseEngine::DispatchThreadNameEvent(EVENT_TRACE* event) {
       reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
   DWORD process_id = event->Header.ProcessId;
   DWORD thread_id = event->Header.ThreadId;
-  event_handler_->OnThreadName(time,
-                               process_id,
-                               thread_id,
-                               base::StringPiece(thread_name, thread_name_len));
+  event_handler_->OnThreadName(time, process_id, thread_id, thread_name);
 
   return true;
 }
@@ -471,18 +651,15 @@ bool ParseEngine::DispatchDynamicSymbolEvent(EVENT_TRACE* event) {
 
   BinaryBufferReader reader(event->MofData, event->MofLength);
   const TraceDynamicSymbol* symbol = NULL;
-  const char* symbol_name = NULL;
-  size_t symbol_name_len = 0;
+  base::StringPiece symbol_name;
   if (!reader.Read(FIELD_OFFSET(TraceDynamicSymbol, symbol_name), &symbol) ||
-      !reader.ReadString(&symbol_name, &symbol_name_len)) {
+      !reader.ReadStringPiece(&symbol_name)) {
     LOG(ERROR) << "Short or empty coverage data event.";
     return false;
   }
 
   DWORD process_id = event->Header.ProcessId;
-  event_handler_->OnDynamicSymbol(
-      process_id, symbol->symbol_id,
-      base::StringPiece(symbol_name, symbol_name_len));
+  event_handler_->OnDynamicSymbol(process_id, symbol->symbol_id, symbol_name);
 
   return true;
 }
@@ -612,6 +789,28 @@ bool ParseEngine::DispatchDetailedFunctionCall(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchFunctionCallSummary(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceFunctionCallSummary* data = NULL;
+  if (!reader.Read(&data)) {
+    LOG(ERROR) << "Short or empty TraceFunctionCallSummary event.";
+    return false;
+  }
+  DCHECK(data != NULL);
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = event->Header.ThreadId;
+  event_handler_->OnFunctionCallSummary(time, process_id, thread_id, data);
+
+  return true;
+}
+
 bool ParseEngine::DispatchComment(EVENT_TRACE* event) {
   DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
   DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
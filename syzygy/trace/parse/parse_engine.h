@@ -20,6 +20,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/trace/parse/parser.h"
@@ -32,8 +33,21 @@ namespace parser {
 // abstract interface a parse engine exposes to its clients.
 class ParseEngine {
  public:
+  // A bitmask over TraceEventType values, where event type @p t corresponds
+  // to bit (1 << t).
+  typedef uint64 EventTypeMask;
+
+  // The mask that subscribes to every event type. This is the default.
+  static const EventTypeMask kAllEventTypes = ~0ULL;
+
   virtual ~ParseEngine();
 
+  // Returns the mask bit corresponding to @p type.
+  static EventTypeMask EventTypeToMask(TraceEventType type) {
+    DCHECK_GT(8 * sizeof(EventTypeMask), static_cast<size_t>(type));
+    return 1ULL << type;
+  }
+
   // Returns a short human readable name by which this parse engine can be
   // recognized.
   const char* name() const;
@@ -47,6 +61,19 @@ class ParseEngine {
   // Registers an event handler with this trace-file parse engine.
   void set_event_handler(ParseEventHandler* event_handler);
 
+  // @name Event-type filtering.
+  //
+  // Restricts the event types that are decoded and dispatched to the event
+  // handler. Parse engines apply the mask as early as possible - ideally
+  // while scanning the raw event buffers - so that unsubscribed records are
+  // skipped without being decoded. Module and process lifetime events are
+  // always dispatched regardless of the mask, as the module tracking that
+  // most handlers rely on is driven by them. Defaults to kAllEventTypes.
+  // @{
+  EventTypeMask event_type_mask() const { return event_type_mask_; }
+  void set_event_type_mask(EventTypeMask event_type_mask);
+  // @}
+
   // Returns true if the file given by @p trace_file_path is parseable by this
   // parse engine.
   virtual bool IsRecognizedTraceFile(const base::FilePath& trace_file_path) = 0;
@@ -120,6 +147,16 @@ class ParseEngine {
   // @returns true on success.
   bool RemoveProcessInformation(DWORD process_id);
 
+  // Determines whether an event of @p type should be dispatched to the event
+  // handler under the current event-type mask. Module and process lifetime
+  // events and unrecognized event types are always dispatched; the latter so
+  // that the dispatcher can report them.
+  //
+  // @param type The type of the event under consideration.
+  //
+  // @returns true if the event should be dispatched.
+  bool ShouldDispatchEventType(TraceEventType type) const;
+
   // The main entry point by which trace events are dispatched to the
   // event handler.
   //
@@ -131,6 +168,45 @@ class ParseEngine {
   //     true.
   bool DispatchEvent(EVENT_TRACE* event);
 
+  // The batched counterpart to DispatchEvent(). Function entry, function
+  // exit and invocation batch events - the types that dominate dense
+  // traces - are decoded into typed records and deferred, so that runs of a
+  // single event type can be handed to the event handler in bulk. All other
+  // event types first flush any deferred events, preserving the relative
+  // ordering of dispatched events, and are then dispatched through
+  // DispatchEvent(). Callers must invoke FlushEventBatch() before the
+  // underlying event buffer is released or reused, as the deferred records
+  // point into it.
+  //
+  // @param event The event to dispatch.
+  //
+  // @returns true if the event was recognized and handled in some way; false
+  //     if the event must be handled elsewhere. If an error occurs during
+  //     the handling of the event, the error_occurred_ flag will be set to
+  //     true.
+  bool DispatchEventBatched(EVENT_TRACE* event);
+
+  // Hands any events deferred by DispatchEventBatched() to the event handler
+  // in bulk.
+  void FlushEventBatch();
+
+  // Decodes a function entry or exit event into @p record.
+  //
+  // @param event The event to decode.
+  // @param record The decoded event record.
+  //
+  // @returns true if the event was successfully decoded, false otherwise.
+  bool DecodeEntryExitEvent(EVENT_TRACE* event, FunctionEventRecord* record);
+
+  // Decodes an invocation batch event into @p record.
+  //
+  // @param event The event to decode.
+  // @param record The decoded invocation batch record.
+  //
+  // @returns true if the event was successfully decoded, false otherwise.
+  bool DecodeBatchInvocationEvent(EVENT_TRACE* event,
+                                  InvocationBatchRecord* record);
+
   // Parses and dispatches function entry and exit events. Called from
   // DispatchEvent().
   //
@@ -152,6 +228,16 @@ class ParseEngine {
   //     true.
   bool DispatchBatchEnterEvent(EVENT_TRACE* event);
 
+  // Parses and dispatches counted batch function entry events. Called from
+  // DispatchEvent().
+  //
+  // @param event The event to dispatch.
+  //
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     If an error occurred, the error_occurred_ flag will be set to
+  //     true.
+  bool DispatchBatchCountedEnterEvent(EVENT_TRACE* event);
+
   // Parses and dispatches a process ended event. Called from DispatchEvent().
   //
   // @param event The event to dispatch.
@@ -233,6 +319,12 @@ class ParseEngine {
   //     Does not explicitly set error occurred.
   bool DispatchDetailedFunctionCall(EVENT_TRACE* event);
 
+  // Parses and dispatches function call summary data.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchFunctionCallSummary(EVENT_TRACE* event);
+
   // Parses and dispatches a call-trace comment.
   // @param event the event to dispatch.
   // @returns true if the event was successfully dispatched, false otherwise.
@@ -245,6 +337,9 @@ class ParseEngine {
   // The event handler to be notified on trace events.
   ParseEventHandler* event_handler_;
 
+  // The set of event types that are dispatched to the event handler.
+  EventTypeMask event_type_mask_;
+
   // For each process, we store its point of view of the world.
   ProcessMap processes_;
 
@@ -258,6 +353,13 @@ class ParseEngine {
   // conflicting module information.
   bool fail_on_module_conflict_;
 
+  // Events deferred by DispatchEventBatched(), awaiting bulk dispatch. As
+  // only runs of a single event type are coalesced, at most one of these is
+  // non-empty at any given time.
+  std::vector<FunctionEventRecord> pending_entry_events_;
+  std::vector<FunctionEventRecord> pending_exit_events_;
+  std::vector<InvocationBatchRecord> pending_invocation_batches_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ParseEngine);
 };
@@ -16,11 +16,16 @@
 
 #include "syzygy/trace/parse/parse_engine_rpc.h"
 
+#include <deque>
+
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/trace/parse/parse_utils.h"
+#include "third_party/zlib/zlib.h"
 
 using common::AlignUp;
 using common::AlignUp64;
@@ -28,6 +33,327 @@ using common::AlignUp64;
 namespace trace {
 namespace parser {
 
+namespace {
+
+// Attempts to read the index footer from the trace file. Returns true and
+// populates @p entries if a valid footer is present. Files that were not
+// closed cleanly lack the footer, in which case this returns false and the
+// caller falls back to a sequential scan. The file cursor position is
+// unspecified on return.
+bool ReadIndexFooter(FILE* trace_file, std::vector<TraceIndexEntry>* entries) {
+  DCHECK(trace_file != NULL);
+  DCHECK(entries != NULL);
+
+  // The file offset of the footer record is stored in the last eight bytes
+  // of the file.
+  if (::_fseeki64(trace_file, 0, SEEK_END) != 0)
+    return false;
+  int64 file_length = ::_ftelli64(trace_file);
+  if (file_length < static_cast<int64>(sizeof(uint64)))
+    return false;
+  uint64 footer_offset = 0;
+  if (::_fseeki64(trace_file, file_length - sizeof(uint64), SEEK_SET) != 0 ||
+      ::fread(&footer_offset, sizeof(footer_offset), 1, trace_file) != 1) {
+    return false;
+  }
+
+  const size_t kHeaderLength = sizeof(RecordPrefix) + sizeof(TraceIndexFooter);
+  if (footer_offset + kHeaderLength > static_cast<uint64>(file_length))
+    return false;
+
+  RecordPrefix prefix = {};
+  TraceIndexFooter footer = {};
+  if (::_fseeki64(trace_file, footer_offset, SEEK_SET) != 0 ||
+      ::fread(&prefix, sizeof(prefix), 1, trace_file) != 1 ||
+      ::fread(&footer, sizeof(footer), 1, trace_file) != 1) {
+    return false;
+  }
+  if (prefix.type != TraceIndexFooter::kTypeId ||
+      prefix.version.hi != TRACE_VERSION_HI ||
+      prefix.version.lo != TRACE_VERSION_LO ||
+      prefix.size != sizeof(TraceIndexFooter) +
+          static_cast<uint64>(footer.num_entries) * sizeof(TraceIndexEntry)) {
+    return false;
+  }
+
+  entries->resize(footer.num_entries);
+  if (footer.num_entries != 0 &&
+      ::fread(&entries->at(0), sizeof(TraceIndexEntry), footer.num_entries,
+              trace_file) != footer.num_entries) {
+    entries->clear();
+    return false;
+  }
+
+  return true;
+}
+
+// The length of the fixed-size header of a raw segment record.
+const size_t kSegmentRecordHeaderLength =
+    sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+
+// Reads and inflates a compressed segment. The trace file cursor must be
+// positioned immediately after the compressed segment header. On success
+// @p record contains the embedded raw segment record, whose header has been
+// validated.
+bool InflateCompressedSegment(
+    const TraceCompressedSegmentHeader& compressed_header,
+    FILE* trace_file,
+    std::vector<uint8>* record) {
+  DCHECK(trace_file != NULL);
+  DCHECK(record != NULL);
+
+  if (compressed_header.compressed_length == 0 ||
+      compressed_header.uncompressed_length < kSegmentRecordHeaderLength) {
+    LOG(ERROR) << "Invalid compressed segment header.";
+    return false;
+  }
+
+  std::vector<uint8> compressed(compressed_header.compressed_length);
+  if (::fread(&compressed[0], compressed.size(), 1, trace_file) != 1) {
+    LOG(ERROR) << "Failed to read compressed segment.";
+    return false;
+  }
+
+  // Inflate the segment. It must decompress to exactly the advertised
+  // length.
+  record->resize(compressed_header.uncompressed_length);
+  uLongf uncompressed_length = record->size();
+  if (::uncompress(&record->at(0), &uncompressed_length, &compressed[0],
+                   compressed.size()) != Z_OK ||
+      uncompressed_length != record->size()) {
+    LOG(ERROR) << "Failed to decompress segment.";
+    return false;
+  }
+
+  // The inflated data is an ordinary raw segment record.
+  const RecordPrefix* prefix =
+      reinterpret_cast<const RecordPrefix*>(&record->at(0));
+  if (prefix->type != TraceFileSegmentHeader::kTypeId ||
+      prefix->size != sizeof(TraceFileSegmentHeader) ||
+      prefix->version.hi != TRACE_VERSION_HI ||
+      prefix->version.lo != TRACE_VERSION_LO) {
+    LOG(ERROR) << "Unrecognized record prefix for inflated segment header.";
+    return false;
+  }
+
+  const TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(prefix + 1);
+  if (kSegmentRecordHeaderLength + segment_header->segment_length >
+      record->size()) {
+    LOG(ERROR) << "Inflated segment length exceeds its contents.";
+    return false;
+  }
+
+  return true;
+}
+
+// The maximum number of segments each file buffers ahead of the merge point
+// in merged replay mode.
+const size_t kMaxReadAheadSegments = 4;
+
+// A segment that has been read off disk (and inflated, if need be) but not
+// yet dispatched by the merged replay.
+struct MergedSegment {
+  // The segment's header.
+  TraceFileSegmentHeader header;
+
+  // The segment's event data.
+  std::vector<uint8> data;
+
+  // The segment's timestamp converted to file time, which is the merge key.
+  // Timestamps are raw timer values relative to each file's own clock
+  // information, so they must be converted to a common time base before
+  // they can be compared across files.
+  uint64 file_time;
+};
+
+// The per-file replay state for merged consumption.
+struct MergedFileState {
+  MergedFileState()
+      : has_index(false),
+        next_index_entry(0),
+        next_segment(0),
+        exhausted(false) {
+  }
+
+  ~MergedFileState() {
+    while (!read_ahead.empty()) {
+      delete read_ahead.front();
+      read_ahead.pop_front();
+    }
+  }
+
+  const TraceFileHeader* header() const {
+    DCHECK(!raw_header.empty());
+    return reinterpret_cast<const TraceFileHeader*>(&raw_header[0]);
+  }
+
+  // The opened trace file.
+  base::ScopedFILE file;
+
+  // The file's variable-length header record.
+  std::vector<uint8> raw_header;
+
+  // The file's index footer entries, if it has any, and the next entry to
+  // be read.
+  bool has_index;
+  std::vector<TraceIndexEntry> index_entries;
+  size_t next_index_entry;
+
+  // The file offset of the next segment record, for files without an index.
+  uint64 next_segment;
+
+  // True once the file's last segment has been read.
+  bool exhausted;
+
+  // The segments read ahead of the merge point, in file order. Owned.
+  std::deque<MergedSegment*> read_ahead;
+};
+
+// Reads the next segment record of @p state into @p segment. On end of file
+// (or on reaching the index footer) @p segment is left NULL and the state is
+// marked exhausted.
+// @returns false on error.
+bool ReadNextSegment(MergedFileState* state,
+                     scoped_ptr<MergedSegment>* segment) {
+  DCHECK(state != NULL);
+  DCHECK(!state->exhausted);
+  DCHECK(segment != NULL);
+  segment->reset();
+
+  const TraceFileHeader* file_header = state->header();
+
+  uint64 offset = 0;
+  if (state->has_index) {
+    if (state->next_index_entry == state->index_entries.size()) {
+      state->exhausted = true;
+      return true;
+    }
+    offset = state->index_entries[state->next_index_entry++].offset;
+  } else {
+    offset = state->next_segment;
+  }
+
+  if (::_fseeki64(state->file.get(), offset, SEEK_SET) != 0) {
+    LOG(ERROR) << "Failed to seek segment boundary " << offset << ".";
+    return false;
+  }
+
+  RecordPrefix prefix;
+  if (::fread(&prefix, sizeof(prefix), 1, state->file.get()) != 1) {
+    if (::feof(state->file.get())) {
+      state->exhausted = true;
+      return true;
+    }
+    LOG(ERROR) << "Failed to read segment header prefix.";
+    return false;
+  }
+
+  // The index footer is the last record in the file and carries no events.
+  if (prefix.type == TraceIndexFooter::kTypeId) {
+    state->exhausted = true;
+    return true;
+  }
+
+  scoped_ptr<MergedSegment> result(new MergedSegment());
+  trace::common::TscToFileTime(
+      file_header->clock_info,
+      prefix.timestamp,
+      reinterpret_cast<FILETIME*>(&result->file_time));
+
+  if (prefix.type == TraceCompressedSegmentHeader::kTypeId) {
+    if (prefix.size != sizeof(TraceCompressedSegmentHeader) ||
+        prefix.version.hi != TRACE_VERSION_HI ||
+        prefix.version.lo != TRACE_VERSION_LO) {
+      LOG(ERROR) << "Unrecognized record prefix for compressed segment "
+                 << "header.";
+      return false;
+    }
+
+    TraceCompressedSegmentHeader compressed_header;
+    if (::fread(&compressed_header,
+                sizeof(compressed_header),
+                1,
+                state->file.get()) != 1) {
+      LOG(ERROR) << "Failed to read compressed segment header.";
+      return false;
+    }
+
+    std::vector<uint8> record;
+    if (!InflateCompressedSegment(compressed_header, state->file.get(),
+                                  &record)) {
+      return false;
+    }
+
+    const TraceFileSegmentHeader* segment_header =
+        reinterpret_cast<const TraceFileSegmentHeader*>(
+            &record[sizeof(RecordPrefix)]);
+    result->header = *segment_header;
+    result->data.assign(
+        record.begin() + kSegmentRecordHeaderLength,
+        record.begin() + kSegmentRecordHeaderLength +
+            segment_header->segment_length);
+
+    state->next_segment = AlignUp64(
+        offset + sizeof(prefix) + sizeof(compressed_header) +
+            compressed_header.compressed_length,
+        file_header->block_size);
+  } else {
+    if (prefix.type != TraceFileSegmentHeader::kTypeId ||
+        prefix.size != sizeof(TraceFileSegmentHeader) ||
+        prefix.version.hi != TRACE_VERSION_HI ||
+        prefix.version.lo != TRACE_VERSION_LO) {
+      LOG(ERROR) << "Unrecognized record prefix for segment header.";
+      return false;
+    }
+
+    TraceFileSegmentHeader segment_header;
+    if (::fread(&segment_header,
+                sizeof(segment_header),
+                1,
+                state->file.get()) != 1) {
+      LOG(ERROR) << "Failed to read segment header.";
+      return false;
+    }
+
+    result->header = segment_header;
+    result->data.resize(segment_header.segment_length);
+    if (segment_header.segment_length != 0 &&
+        ::fread(&result->data[0], segment_header.segment_length, 1,
+                state->file.get()) != 1) {
+      LOG(ERROR) << "Failed to read segment.";
+      return false;
+    }
+
+    state->next_segment = AlignUp64(
+        offset + sizeof(prefix) + sizeof(segment_header) +
+            segment_header.segment_length,
+        file_header->block_size);
+  }
+
+  *segment = result.Pass();
+  return true;
+}
+
+// Tops up @p state's read-ahead queue to the bounded depth.
+// @returns false on error.
+bool FillReadAhead(MergedFileState* state) {
+  DCHECK(state != NULL);
+
+  while (!state->exhausted &&
+         state->read_ahead.size() < kMaxReadAheadSegments) {
+    scoped_ptr<MergedSegment> segment;
+    if (!ReadNextSegment(state, &segment))
+      return false;
+    if (segment.get() != NULL)
+      state->read_ahead.push_back(segment.release());
+  }
+
+  return true;
+}
+
+}  // namespace
+
 ParseEngineRpc::ParseEngineRpc() : ParseEngine("RPC", true) {
 }
 
@@ -70,6 +396,12 @@ bool ParseEngineRpc::CloseAllTraceFiles() {
 }
 
 bool ParseEngineRpc::ConsumeAllEvents() {
+  // When more than one file is being replayed, merge them into a single
+  // time-sorted stream. Playback consumers (the reorderer in particular)
+  // depend on cross-file event order.
+  if (trace_file_set_.size() > 1)
+    return ConsumeAllEventsMerged();
+
   TraceFileIter it = trace_file_set_.begin();
   for (; it != trace_file_set_.end(); ++it) {
     if (!ConsumeTraceFile(*it)) {
@@ -81,11 +413,207 @@ bool ParseEngineRpc::ConsumeAllEvents() {
   return true;
 }
 
+bool ParseEngineRpc::ConsumeAllEventsMerged() {
+  DCHECK_LT(1u, trace_file_set_.size());
+
+  // Open all of the files and dispatch their process-started events up
+  // front.
+  ScopedVector<MergedFileState> states;
+  TraceFileIter it = trace_file_set_.begin();
+  for (; it != trace_file_set_.end(); ++it) {
+    LOG(INFO) << "Processing '" << it->BaseName().value() << "'.";
+
+    scoped_ptr<MergedFileState> state(new MergedFileState());
+    if (!ConsumeFileHeader(*it, &state->file, &state->raw_header)) {
+      LOG(ERROR) << "Failed to consume '" << it->value() << "'.";
+      return false;
+    }
+
+    state->has_index = ReadIndexFooter(state->file.get(),
+                                       &state->index_entries);
+    state->next_segment = AlignUp64(state->header()->header_size,
+                                    state->header()->block_size);
+    states.push_back(state.release());
+  }
+
+  // Prime each file's read-ahead queue.
+  for (size_t i = 0; i < states.size(); ++i) {
+    if (!FillReadAhead(states[i]))
+      return false;
+  }
+
+  // Repeatedly dispatch the pending segment with the earliest timestamp.
+  // The file count is small, so a linear scan beats maintaining a heap.
+  for (;;) {
+    MergedFileState* best = NULL;
+    for (size_t i = 0; i < states.size(); ++i) {
+      if (states[i]->read_ahead.empty())
+        continue;
+      if (best == NULL ||
+          states[i]->read_ahead.front()->file_time <
+              best->read_ahead.front()->file_time) {
+        best = states[i];
+      }
+    }
+    if (best == NULL)
+      break;
+
+    scoped_ptr<MergedSegment> segment(best->read_ahead.front());
+    best->read_ahead.pop_front();
+    if (!FillReadAhead(best))
+      return false;
+
+    if (!segment->data.empty() &&
+        !ConsumeSegmentEvents(*best->header(),
+                              segment->header,
+                              &segment->data[0],
+                              segment->data.size())) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
 bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
   DCHECK(!trace_file_path.empty());
 
   LOG(INFO) << "Processing '" << trace_file_path.BaseName().value() << "'.";
 
+  base::ScopedFILE trace_file;
+  std::vector<uint8> raw_buffer;
+  if (!ConsumeFileHeader(trace_file_path, &trace_file, &raw_buffer))
+    return false;
+
+  const TraceFileHeader* file_header =
+      reinterpret_cast<const TraceFileHeader*>(&raw_buffer[0]);
+
+  // If the file carries an index footer then it enumerates the segment
+  // records directly; otherwise the file is scanned sequentially. Files that
+  // were not closed cleanly (a crashed client, for example) lack the footer.
+  std::vector<TraceIndexEntry> index_entries;
+  bool has_index = ReadIndexFooter(trace_file.get(), &index_entries);
+  size_t next_index_entry = 0;
+
+  // Consume the body of the trace file.
+  uint64 next_segment = AlignUp64(file_header->header_size,
+                                  file_header->block_size);
+  scoped_ptr<uint8> buffer;
+  size_t buffer_size = 0;
+  while (true) {
+    if (has_index) {
+      if (next_index_entry == index_entries.size())
+        break;
+      next_segment = index_entries[next_index_entry++].offset;
+    }
+
+    if (::_fseeki64(trace_file.get(), next_segment, SEEK_SET) != 0) {
+      LOG(ERROR) << "Failed to seek segment boundary " << next_segment << ".";
+      return false;
+    }
+
+    RecordPrefix segment_prefix;
+    if (::fread(&segment_prefix,
+                sizeof(segment_prefix),
+                1,
+                trace_file.get()) != 1) {
+      if (::feof(trace_file.get()))
+        break;
+
+      LOG(ERROR) << "Failed to read segment header prefix.";
+      return false;
+    }
+
+    // The index footer is the last record in the file and carries no events.
+    if (segment_prefix.type == TraceIndexFooter::kTypeId)
+      break;
+
+    // Compressed segments carry their own embedded segment record; inflate
+    // and consume them in place.
+    if (segment_prefix.type == TraceCompressedSegmentHeader::kTypeId) {
+      if (segment_prefix.size != sizeof(TraceCompressedSegmentHeader) ||
+          segment_prefix.version.hi != TRACE_VERSION_HI ||
+          segment_prefix.version.lo != TRACE_VERSION_LO) {
+        LOG(ERROR) << "Unrecognized record prefix for compressed segment "
+                   << "header.";
+        return false;
+      }
+
+      TraceCompressedSegmentHeader compressed_header;
+      if (::fread(&compressed_header,
+                  sizeof(compressed_header),
+                  1,
+                  trace_file.get()) != 1) {
+        LOG(ERROR) << "Failed to read compressed segment header.";
+        return false;
+      }
+
+      if (!ConsumeCompressedSegment(*file_header, compressed_header,
+                                    trace_file.get())) {
+        return false;
+      }
+
+      next_segment = AlignUp64(
+          next_segment + sizeof(segment_prefix) + sizeof(compressed_header) +
+              compressed_header.compressed_length,
+          file_header->block_size);
+      continue;
+    }
+
+    if (segment_prefix.type != TraceFileSegmentHeader::kTypeId ||
+        segment_prefix.size != sizeof(TraceFileSegmentHeader) ||
+        segment_prefix.version.hi != TRACE_VERSION_HI ||
+        segment_prefix.version.lo != TRACE_VERSION_LO) {
+      LOG(ERROR) << "Unrecognized record prefix for segment header.";
+      return false;
+    }
+
+    TraceFileSegmentHeader segment_header;
+    if (::fread(&segment_header,
+                sizeof(segment_header),
+                1,
+                trace_file.get()) != 1) {
+      LOG(ERROR) << "Failed to read segment header.";
+      return false;
+    }
+
+    size_t aligned_size = AlignUp(segment_header.segment_length,
+                                  file_header->block_size);
+
+    if (aligned_size > buffer_size) {
+      buffer.reset(reinterpret_cast<uint8*>(::malloc(aligned_size)));
+      buffer_size = aligned_size;
+    }
+
+    if (::fread(buffer.get(), segment_header.segment_length, 1,
+                trace_file.get()) != 1) {
+      LOG(ERROR) << "Failed to read segment.";
+      return false;
+    }
+
+    if (!ConsumeSegmentEvents(*file_header,
+                              segment_header,
+                              buffer.get(),
+                              segment_header.segment_length)) {
+      return false;
+    }
+
+    next_segment = AlignUp64(
+        next_segment + sizeof(segment_prefix) + sizeof(segment_header) +
+            segment_header.segment_length,
+        file_header->block_size);
+  }
+
+  return true;
+}
+
+bool ParseEngineRpc::ConsumeFileHeader(const base::FilePath& trace_file_path,
+                                       base::ScopedFILE* out_trace_file,
+                                       std::vector<uint8>* out_raw_header) {
+  DCHECK(!trace_file_path.empty());
+  DCHECK(out_trace_file != NULL);
+  DCHECK(out_raw_header != NULL);
+
   base::ScopedFILE trace_file(base::OpenFile(trace_file_path, "rb"));
   if (!trace_file.get()) {
     DWORD error = ::GetLastError();
@@ -173,74 +701,30 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
   event_handler_->OnProcessStarted(start_time, file_header->process_id,
                                    &system_info);
 
-  // Consume the body of the trace file.
-  uint64 next_segment = AlignUp64(file_header->header_size,
-                                  file_header->block_size);
-  scoped_ptr<uint8> buffer;
-  size_t buffer_size = 0;
-  while (true) {
-    if (::_fseeki64(trace_file.get(), next_segment, SEEK_SET) != 0) {
-      LOG(ERROR) << "Failed to seek segment boundary " << next_segment << ".";
-      return false;
-    }
-
-    RecordPrefix segment_prefix;
-    if (::fread(&segment_prefix,
-                sizeof(segment_prefix),
-                1,
-                trace_file.get()) != 1) {
-      if (::feof(trace_file.get()))
-        break;
-
-      LOG(ERROR) << "Failed to read segment header prefix.";
-      return false;
-    }
-
-    if (segment_prefix.type != TraceFileSegmentHeader::kTypeId ||
-        segment_prefix.size != sizeof(TraceFileSegmentHeader) ||
-        segment_prefix.version.hi != TRACE_VERSION_HI ||
-        segment_prefix.version.lo != TRACE_VERSION_LO) {
-      LOG(ERROR) << "Unrecognized record prefix for segment header.";
-      return false;
-    }
-
-    TraceFileSegmentHeader segment_header;
-    if (::fread(&segment_header,
-                sizeof(segment_header),
-                1,
-                trace_file.get()) != 1) {
-      LOG(ERROR) << "Failed to read segment header.";
-      return false;
-    }
+  out_raw_header->swap(raw_buffer);
+  out_trace_file->reset(trace_file.release());
 
-    size_t aligned_size = AlignUp(segment_header.segment_length,
-                                  file_header->block_size);
-
-    if (aligned_size > buffer_size) {
-      buffer.reset(reinterpret_cast<uint8*>(::malloc(aligned_size)));
-      buffer_size = aligned_size;
-    }
+  return true;
+}
 
-    if (::fread(buffer.get(), segment_header.segment_length, 1,
-                trace_file.get()) != 1) {
-      LOG(ERROR) << "Failed to read segment.";
-      return false;
-    }
+bool ParseEngineRpc::ConsumeCompressedSegment(
+    const TraceFileHeader& file_header,
+    const TraceCompressedSegmentHeader& compressed_header,
+    FILE* trace_file) {
+  DCHECK(trace_file != NULL);
 
-    if (!ConsumeSegmentEvents(*file_header,
-                              segment_header,
-                              buffer.get(),
-                              segment_header.segment_length)) {
-      return false;
-    }
+  std::vector<uint8> record;
+  if (!InflateCompressedSegment(compressed_header, trace_file, &record))
+    return false;
 
-    next_segment = AlignUp64(
-        next_segment + sizeof(segment_prefix) + sizeof(segment_header) +
-            segment_header.segment_length,
-        file_header->block_size);
-  }
+  const TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(
+          &record[sizeof(RecordPrefix)]);
 
-  return true;
+  return ConsumeSegmentEvents(file_header,
+                              *segment_header,
+                              &record[kSegmentRecordHeaderLength],
+                              segment_header->segment_length);
 }
 
 bool ParseEngineRpc::ConsumeSegmentEvents(
@@ -273,6 +757,11 @@ bool ParseEngineRpc::ConsumeSegmentEvents(
       continue;
     }
 
+    // Skip records the event handler has not subscribed to without decoding
+    // them any further.
+    if (!ShouldDispatchEventType(static_cast<TraceEventType>(prefix->type)))
+      continue;
+
     event_record.Header.Class.Type = prefix->type;
 
     // The TimeStamp is interpreted as a FILETIME, so we convert the timer
@@ -284,7 +773,7 @@ bool ParseEngineRpc::ConsumeSegmentEvents(
 
     event_record.MofData = prefix + 1;
     event_record.MofLength = prefix->size;
-    if (!DispatchEvent(&event_record)) {
+    if (!DispatchEventBatched(&event_record)) {
       LOG(ERROR) << "Failed to process event of type " << prefix->type << ".";
       return false;
     }
@@ -294,6 +783,10 @@ bool ParseEngineRpc::ConsumeSegmentEvents(
     }
   }
 
+  // The deferred events point into |buffer|, so they must be handed to the
+  // event handler before the segment buffer is reused.
+  FlushEventBatch();
+
   return true;
 }
 
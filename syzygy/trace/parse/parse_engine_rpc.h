@@ -17,6 +17,7 @@
 #ifndef SYZYGY_TRACE_PARSE_PARSE_ENGINE_RPC_H_
 #define SYZYGY_TRACE_PARSE_PARSE_ENGINE_RPC_H_
 
+#include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/time/time.h"
 #include "syzygy/trace/parse/parse_engine.h"
@@ -54,6 +55,43 @@ class ParseEngineRpc : public ParseEngine {
   // @returns true on success
   bool ConsumeTraceFile(const base::FilePath& trace_file_path);
 
+  // Replays all of the files in trace_file_set_ as a single stream,
+  // dispatching segments across files in timestamp order. Each file is read
+  // through a bounded read-ahead queue, so memory use is limited regardless
+  // of file count and sizes. This is used whenever more than one trace file
+  // is being consumed, as Playback consumers depend on cross-file event
+  // order.
+  //
+  // @returns true on success.
+  bool ConsumeAllEventsMerged();
+
+  // Opens @p trace_file_path, reads and validates its header, registers the
+  // executable's module information and dispatches the process-started
+  // event. On success @p trace_file holds the opened file and @p raw_header
+  // holds the full variable-length header record. The file cursor position
+  // is unspecified on return.
+  //
+  // @param trace_file_path the trace file to open.
+  // @param trace_file receives the opened file.
+  // @param raw_header receives the variable-length header record.
+  // @returns true on success.
+  bool ConsumeFileHeader(const base::FilePath& trace_file_path,
+                         base::ScopedFILE* trace_file,
+                         std::vector<uint8>* raw_header);
+
+  // Reads, inflates and dispatches a compressed segment. The trace file
+  // cursor must be positioned immediately after the compressed segment
+  // header.
+  //
+  // @param file_header the header information describing the trace file.
+  // @param compressed_header the header describing the compressed segment.
+  // @param trace_file the trace file being consumed.
+  // @return true on success.
+  bool ConsumeCompressedSegment(
+      const TraceFileHeader& file_header,
+      const TraceCompressedSegmentHeader& compressed_header,
+      FILE* trace_file);
+
   // Dispatches all of the events in the given segment buffer.
   //
   // @param file_header the header information describing the trace file.
@@ -35,10 +35,12 @@
 #include "base/win/windows_version.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "syzygy/common/align.h"
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/trace/common/unittest_util.h"
 #include "syzygy/trace/parse/parser.h"
 #include "syzygy/trace/service/process_info.h"
+#include "third_party/zlib/zlib.h"
 
 namespace trace {
 namespace service {
@@ -475,6 +477,202 @@ class IndirectFunctionThread : public base::DelegateSimpleThread::Delegate {
 // through hoops to copy-initialize arrays of them.
 typedef ScopedVector<IndirectFunctionThread> IndirectFunctionThreads;
 
+// The block size used by the synthetic trace files written below.
+const size_t kSyntheticBlockSize = 512;
+
+// The file time both synthetic clocks are anchored at. This is kept below
+// 2^53 so that the double arithmetic of the timestamp conversion is exact
+// and converted event times can be compared for equality.
+const uint64 kSyntheticBaseFileTime = 0x0010000000000000ULL;
+
+// Builds clock information for a synthetic trace file: a TSC timer running
+// at @p tsc_frequency counts per second whose value was @p tsc_reference at
+// the common base file time.
+trace::common::ClockInfo MakeSyntheticClockInfo(uint64 tsc_reference,
+                                                uint64 tsc_frequency) {
+  trace::common::ClockInfo clock_info = {};
+  clock_info.file_time.dwLowDateTime =
+      static_cast<DWORD>(kSyntheticBaseFileTime);
+  clock_info.file_time.dwHighDateTime =
+      static_cast<DWORD>(kSyntheticBaseFileTime >> 32);
+  clock_info.tsc_reference = tsc_reference;
+  clock_info.tsc_info.frequency = tsc_frequency;
+  clock_info.tsc_info.resolution = 1;
+  clock_info.ticks_info.frequency = 1000;
+  clock_info.ticks_info.resolution = 16;
+  return clock_info;
+}
+
+// @returns the expected time of an event stamped @p intervals_past_base
+//     100ns intervals past the common base file time.
+base::Time ExpectedSyntheticEventTime(uint64 intervals_past_base) {
+  uint64 t = kSyntheticBaseFileTime + intervals_past_base;
+  FILETIME file_time = {};
+  file_time.dwLowDateTime = static_cast<DWORD>(t);
+  file_time.dwHighDateTime = static_cast<DWORD>(t >> 32);
+  return base::Time::FromFileTime(file_time);
+}
+
+// Writes a minimal but well-formed trace file from scratch, with full
+// control over the clock information and the segment timestamps. The
+// end-to-end tests above necessarily produce a single trace file with
+// wall-clock timestamps; replaying several files merged by converted
+// timestamp needs files whose clocks and event order are known exactly.
+class SyntheticTraceFileWriter {
+ public:
+  SyntheticTraceFileWriter(uint32 process_id,
+                           const trace::common::ClockInfo& clock_info)
+      : process_id_(process_id) {
+    // Build the variable-length header record: the fixed fields followed by
+    // the blob carrying the module path, the command line and a doubly
+    // NULL-terminated environment block.
+    buffer_.resize(offsetof(TraceFileHeader, blob_data), 0);
+    AppendWideString(L"synthetic_module.dll");
+    AppendWideString(L"synthetic.exe");
+    AppendWideString(L"key=value");
+    AppendWideString(L"");
+
+    TraceFileHeader* header = reinterpret_cast<TraceFileHeader*>(&buffer_[0]);
+    ::memcpy(&header->signature, &TraceFileHeader::kSignatureValue,
+             sizeof(header->signature));
+    header->server_version.lo = TRACE_VERSION_LO;
+    header->server_version.hi = TRACE_VERSION_HI;
+    header->header_size = buffer_.size();
+    header->block_size = kSyntheticBlockSize;
+    header->process_id = process_id;
+    header->module_base_address = 0x10000000 + process_id * 0x100000;
+    header->module_size = 0x1000;
+    header->module_checksum = 0;
+    header->module_time_date_stamp = 0;
+    header->clock_info = clock_info;
+
+    buffer_.resize(::common::AlignUp(buffer_.size(), kSyntheticBlockSize), 0);
+  }
+
+  // Appends a segment holding a single batch function-entry event for
+  // @p function, stamped with the raw TSC value @p timestamp. When
+  // @p compressed is true the segment record is deflated and wrapped in a
+  // compressed segment record.
+  void AppendBatchEnterSegment(uint32 thread_id,
+                               uint64 timestamp,
+                               FuncAddr function,
+                               bool compressed) {
+    // Build the event record.
+    std::vector<uint8> events(
+        sizeof(RecordPrefix) + FIELD_OFFSET(TraceBatchEnterData, calls) +
+            sizeof(TraceEnterEventData),
+        0);
+    RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(&events[0]);
+    InitPrefix(timestamp, TRACE_BATCH_ENTER,
+               events.size() - sizeof(RecordPrefix), prefix);
+    TraceBatchEnterData* batch =
+        reinterpret_cast<TraceBatchEnterData*>(prefix + 1);
+    batch->thread_id = thread_id;
+    batch->num_calls = 1;
+    batch->calls[0].retaddr = NULL;
+    batch->calls[0].function = function;
+
+    // Build the raw segment record around it.
+    std::vector<uint8> record(
+        sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader), 0);
+    prefix = reinterpret_cast<RecordPrefix*>(&record[0]);
+    InitPrefix(timestamp, TraceFileSegmentHeader::kTypeId,
+               sizeof(TraceFileSegmentHeader), prefix);
+    TraceFileSegmentHeader* segment =
+        reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+    segment->thread_id = thread_id;
+    segment->sequence_number = index_.size() + 1;
+    segment->segment_length = events.size();
+    record.insert(record.end(), events.begin(), events.end());
+
+    if (compressed) {
+      // Wrap the raw record in a compressed segment record.
+      uLongf compressed_length = ::compressBound(record.size());
+      std::vector<uint8> deflated(compressed_length);
+      ASSERT_EQ(Z_OK, ::compress(&deflated[0], &compressed_length,
+                                 &record[0], record.size()));
+      deflated.resize(compressed_length);
+
+      std::vector<uint8> wrapper(
+          sizeof(RecordPrefix) + sizeof(TraceCompressedSegmentHeader), 0);
+      prefix = reinterpret_cast<RecordPrefix*>(&wrapper[0]);
+      InitPrefix(timestamp, TraceCompressedSegmentHeader::kTypeId,
+                 sizeof(TraceCompressedSegmentHeader), prefix);
+      TraceCompressedSegmentHeader* compressed_header =
+          reinterpret_cast<TraceCompressedSegmentHeader*>(prefix + 1);
+      compressed_header->compressed_length = deflated.size();
+      compressed_header->uncompressed_length = record.size();
+      wrapper.insert(wrapper.end(), deflated.begin(), deflated.end());
+      record.swap(wrapper);
+    }
+
+    TraceIndexEntry entry = {};
+    entry.offset = buffer_.size();
+    entry.length = ::common::AlignUp(record.size(), kSyntheticBlockSize);
+    entry.thread_id = thread_id;
+    index_.push_back(entry);
+
+    buffer_.insert(buffer_.end(), record.begin(), record.end());
+    buffer_.resize(::common::AlignUp(buffer_.size(), kSyntheticBlockSize), 0);
+  }
+
+  // Writes the accumulated contents to @p path, appending an index footer
+  // enumerating the segments when @p with_index is true.
+  void Write(const base::FilePath& path, bool with_index) {
+    std::vector<uint8> contents(buffer_);
+    if (with_index) {
+      uint64 footer_offset = contents.size();
+      std::vector<uint8> record(
+          sizeof(RecordPrefix) + sizeof(TraceIndexFooter), 0);
+      RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(&record[0]);
+      InitPrefix(0, TraceIndexFooter::kTypeId,
+                 sizeof(TraceIndexFooter) +
+                     index_.size() * sizeof(TraceIndexEntry),
+                 prefix);
+      TraceIndexFooter* footer =
+          reinterpret_cast<TraceIndexFooter*>(prefix + 1);
+      footer->num_entries = index_.size();
+      const uint8* entries = reinterpret_cast<const uint8*>(&index_[0]);
+      record.insert(record.end(), entries,
+                    entries + index_.size() * sizeof(TraceIndexEntry));
+      contents.insert(contents.end(), record.begin(), record.end());
+
+      // The last eight bytes of the file locate the footer record.
+      const uint8* offset_bytes =
+          reinterpret_cast<const uint8*>(&footer_offset);
+      contents.insert(contents.end(), offset_bytes,
+                      offset_bytes + sizeof(footer_offset));
+    }
+
+    ASSERT_EQ(static_cast<int>(contents.size()),
+              base::WriteFile(path,
+                              reinterpret_cast<const char*>(&contents[0]),
+                              contents.size()));
+  }
+
+ private:
+  static void InitPrefix(uint64 timestamp,
+                         uint16 type,
+                         size_t size,
+                         RecordPrefix* prefix) {
+    prefix->timestamp = timestamp;
+    prefix->size = size;
+    prefix->type = type;
+    prefix->version.hi = TRACE_VERSION_HI;
+    prefix->version.lo = TRACE_VERSION_LO;
+  }
+
+  void AppendWideString(const wchar_t* value) {
+    const uint8* bytes = reinterpret_cast<const uint8*>(value);
+    size_t length = (::wcslen(value) + 1) * sizeof(wchar_t);
+    buffer_.insert(buffer_.end(), bytes, bytes + length);
+  }
+
+  uint32 process_id_;
+  std::vector<uint8> buffer_;
+  std::vector<TraceIndexEntry> index_;
+};
+
 }  // namespace
 
 TEST_F(ParseEngineRpcTest, LoadUnload) {
@@ -802,5 +1000,71 @@ TEST_F(ParseEngineRpcTest, MultiThreadWithStopCallTrace) {
   ASSERT_EQ(77, entered_addresses_.count(IndirectFunctionB));
 }
 
+TEST_F(ParseEngineRpcTest, MultiFileMergedReplay) {
+  // Two synthetic trace files with deliberately different clocks. File 1
+  // has no index footer, so it must be scanned sequentially, and holds more
+  // segments than the merged replay's read-ahead depth so the queue has to
+  // be refilled. Its TSC runs at 10MHz from a reference of 0, making each
+  // count one 100ns interval past the base file time.
+  SyntheticTraceFileWriter file1(42, MakeSyntheticClockInfo(0, 10000000));
+  const uint64 kFile1Times[] = { 100, 300, 500, 700, 900, 1100 };
+  for (size_t i = 0; i < arraysize(kFile1Times); ++i) {
+    ASSERT_NO_FATAL_FAILURE(file1.AppendBatchEnterSegment(
+        1, kFile1Times[i], reinterpret_cast<FuncAddr>(0x1000 + 0x10 * i),
+        false));
+  }
+  base::FilePath file1_path = temp_dir_.Append(L"trace-f1.bin");
+  ASSERT_NO_FATAL_FAILURE(file1.Write(file1_path, false));
+
+  // File 2 carries an index footer, counts its TSC at twice the rate from
+  // a non-zero reference (a count of 1000 + 2n lies n 100ns intervals past
+  // the base file time) and holds its middle segment compressed.
+  SyntheticTraceFileWriter file2(43, MakeSyntheticClockInfo(1000, 20000000));
+  ASSERT_NO_FATAL_FAILURE(file2.AppendBatchEnterSegment(
+      2, 1000 + 2 * 150, reinterpret_cast<FuncAddr>(0x2000), false));
+  ASSERT_NO_FATAL_FAILURE(file2.AppendBatchEnterSegment(
+      2, 1000 + 2 * 650, reinterpret_cast<FuncAddr>(0x2010), true));
+  ASSERT_NO_FATAL_FAILURE(file2.AppendBatchEnterSegment(
+      2, 1000 + 2 * 1150, reinterpret_cast<FuncAddr>(0x2020), false));
+  base::FilePath file2_path = temp_dir_.Append(L"trace-f2.bin");
+  ASSERT_NO_FATAL_FAILURE(file2.Write(file2_path, true));
+
+  TestParseEventHandler consumer;
+  Parser parser;
+  ASSERT_TRUE(parser.Init(&consumer));
+  ASSERT_TRUE(parser.OpenTraceFile(file1_path));
+  ASSERT_TRUE(parser.OpenTraceFile(file2_path));
+  ASSERT_TRUE(parser.Consume());
+
+  RawCalls raw_calls;
+  consumer.GetRawCalls(&raw_calls);
+
+  // The events must come back interleaved across the two files, ordered by
+  // their timestamps converted to the common file-time base, not in file
+  // order.
+  const struct {
+    FuncAddr address;
+    uint64 file_time_offset;
+  } kExpectedCalls[] = {
+    { reinterpret_cast<FuncAddr>(0x1000), 100 },
+    { reinterpret_cast<FuncAddr>(0x2000), 150 },
+    { reinterpret_cast<FuncAddr>(0x1010), 300 },
+    { reinterpret_cast<FuncAddr>(0x1020), 500 },
+    { reinterpret_cast<FuncAddr>(0x2010), 650 },
+    { reinterpret_cast<FuncAddr>(0x1030), 700 },
+    { reinterpret_cast<FuncAddr>(0x1040), 900 },
+    { reinterpret_cast<FuncAddr>(0x1050), 1100 },
+    { reinterpret_cast<FuncAddr>(0x2020), 1150 },
+  };
+  ASSERT_EQ(arraysize(kExpectedCalls), raw_calls.size());
+  for (size_t i = 0; i < arraysize(kExpectedCalls); ++i) {
+    EXPECT_EQ(kExpectedCalls[i].address, raw_calls[i].address)
+        << "Mismatched call " << i << ".";
+    EXPECT_EQ(ExpectedSyntheticEventTime(kExpectedCalls[i].file_time_offset),
+              raw_calls[i].entry)
+        << "Mismatched timestamp for call " << i << ".";
+  }
+}
+
 }  // namespace service
 }  // namespace trace
@@ -30,6 +30,8 @@
 namespace {
 
 using testing::_;
+using trace::parser::FunctionEventRecord;
+using trace::parser::InvocationBatchRecord;
 using trace::parser::Parser;
 using trace::parser::ParseEngine;
 using trace::parser::ParseEventHandler;
@@ -66,6 +68,20 @@ class ParseEngineUnitTest
     ASSERT_TRUE(DispatchEvent(&event_record_));
   }
 
+  void DispatchBatchedEventData(TraceEventType type,
+                                const void* data,
+                                size_t size) {
+    ::memset(&event_record_, 0, sizeof(event_record_));
+    event_record_.Header.ProcessId = kProcessId;
+    event_record_.Header.ThreadId = kThreadId;
+    event_record_.Header.Guid = kCallTraceEventClass;
+    event_record_.Header.Class.Type = type;
+    event_record_.MofData = const_cast<void*>(data);
+    event_record_.MofLength = size;
+
+    ASSERT_TRUE(DispatchEventBatched(&event_record_));
+  }
+
   bool IsRecognizedTraceFile(const base::FilePath& trace_file_path) OVERRIDE {
     return true;
   }
@@ -128,6 +144,20 @@ class ParseEngineUnitTest
     }
   }
 
+  virtual void OnBatchCountedFunctionEntry(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceBatchCountedEnterData* data) OVERRIDE {
+    ASSERT_EQ(process_id, kProcessId);
+    ASSERT_EQ(thread_id, kThreadId);
+    ASSERT_TRUE(reinterpret_cast<const void*>(data) == expected_data);
+    for (size_t i = 0; i < data->num_entries; ++i) {
+      for (uint32 j = 0; j < data->entries[i].count; ++j)
+        function_entries.insert(data->entries[i].function);
+    }
+  }
+
   virtual void OnProcessAttach(base::Time time,
                                DWORD process_id,
                                DWORD thread_id,
@@ -175,6 +205,27 @@ class ParseEngineUnitTest
     // TODO(anyone): Test this.
   }
 
+  // Record the size of each batch handed to us, then forward to the default
+  // implementations so the per-event handlers above still fire.
+
+  virtual void OnFunctionEntryBatch(const FunctionEventRecord* events,
+                                    size_t num_events) OVERRIDE {
+    entry_batch_sizes.push_back(num_events);
+    ParseEventHandler::OnFunctionEntryBatch(events, num_events);
+  }
+
+  virtual void OnFunctionExitBatch(const FunctionEventRecord* events,
+                                   size_t num_events) OVERRIDE {
+    exit_batch_sizes.push_back(num_events);
+    ParseEventHandler::OnFunctionExitBatch(events, num_events);
+  }
+
+  virtual void OnInvocationBatches(const InvocationBatchRecord* batches,
+                                   size_t num_batches) OVERRIDE {
+    invocation_batch_sizes.push_back(num_batches);
+    ParseEventHandler::OnInvocationBatches(batches, num_batches);
+  }
+
   virtual void OnIndexedFrequency(
       base::Time time,
       DWORD process_id,
@@ -209,6 +260,11 @@ class ParseEngineUnitTest
                     DWORD process_id,
                     DWORD thread_id,
                     const TraceDetailedFunctionCall* data));
+  MOCK_METHOD4(OnFunctionCallSummary,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceFunctionCallSummary* data));
   MOCK_METHOD3(OnComment,
                void(base::Time time,
                     DWORD process_id,
@@ -231,6 +287,9 @@ class ParseEngineUnitTest
   ModuleSet thread_attaches;
   ModuleSet thread_detaches;
   size_t basic_block_frequencies;
+  std::vector<size_t> entry_batch_sizes;
+  std::vector<size_t> exit_batch_sizes;
+  std::vector<size_t> invocation_batch_sizes;
 
   const void* expected_data;
 };
@@ -403,6 +462,33 @@ TEST_F(ParseEngineUnitTest, UnhandledEvent) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, EventTypeMask) {
+  // By default every event type is dispatched.
+  EXPECT_EQ(kAllEventTypes, event_type_mask());
+  EXPECT_TRUE(ShouldDispatchEventType(TRACE_ENTER_EVENT));
+  EXPECT_TRUE(ShouldDispatchEventType(TRACE_INDEXED_FREQUENCY));
+
+  set_event_type_mask(EventTypeToMask(TRACE_INDEXED_FREQUENCY));
+
+  // Only the subscribed event type remains dispatched.
+  EXPECT_TRUE(ShouldDispatchEventType(TRACE_INDEXED_FREQUENCY));
+  EXPECT_FALSE(ShouldDispatchEventType(TRACE_ENTER_EVENT));
+  EXPECT_FALSE(ShouldDispatchEventType(TRACE_EXIT_EVENT));
+  EXPECT_FALSE(ShouldDispatchEventType(TRACE_BATCH_ENTER));
+  EXPECT_FALSE(ShouldDispatchEventType(TRACE_BATCH_COUNTED_ENTER));
+
+  // Module and process lifetime events are dispatched regardless of the
+  // mask, as they drive module tracking.
+  EXPECT_TRUE(ShouldDispatchEventType(TRACE_PROCESS_ENDED));
+  EXPECT_TRUE(ShouldDispatchEventType(TRACE_PROCESS_ATTACH_EVENT));
+  EXPECT_TRUE(ShouldDispatchEventType(TRACE_PROCESS_DETACH_EVENT));
+  EXPECT_TRUE(ShouldDispatchEventType(TRACE_THREAD_ATTACH_EVENT));
+  EXPECT_TRUE(ShouldDispatchEventType(TRACE_THREAD_DETACH_EVENT));
+
+  // So are unrecognized event types, so that the dispatcher can report them.
+  EXPECT_TRUE(ShouldDispatchEventType(static_cast<TraceEventType>(0xFF)));
+}
+
 TEST_F(ParseEngineUnitTest, FunctionEntryEvents) {
   TraceEnterEventData event_data = {};
   event_data.function = &TestFunc1;
@@ -487,6 +573,132 @@ TEST_F(ParseEngineUnitTest, BatchFunctionEntry) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, BatchCountedFunctionEntry) {
+  uint8 raw_data[sizeof(TraceBatchCountedEnterData) +
+                     2 * sizeof(TraceCountedEnterEventData)] = {};
+  TraceBatchCountedEnterData& event_data =
+     *reinterpret_cast<TraceBatchCountedEnterData*>(&raw_data);
+  event_data.thread_id = kThreadId;
+  event_data.num_entries = 3;
+  event_data.entries[0].function = &TestFunc1;
+  event_data.entries[0].count = 3;
+  event_data.entries[1].function = &TestFunc2;
+  event_data.entries[1].count = 1;
+  // The last entry has a NULL function, simulating a reporting thread that
+  // was interrupted mid-write; it should be trimmed.
+  event_data.entries[2].function = NULL;
+  expected_data = &raw_data;
+
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_BATCH_COUNTED_ENTER, &raw_data, sizeof(raw_data)));
+  ASSERT_FALSE(error_occurred());
+  ASSERT_EQ(function_entries.size(), 4);
+  ASSERT_EQ(function_entries.count(&TestFunc1), 3);
+  ASSERT_EQ(function_entries.count(&TestFunc2), 1);
+
+  // Check for short event header.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_BATCH_COUNTED_ENTER,
+      &raw_data,
+      FIELD_OFFSET(TraceBatchCountedEnterData, num_entries)));
+  ASSERT_TRUE(error_occurred());
+
+  // Check for short event tail (remove the trimmed record + one byte).
+  set_error_occurred(false);
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_BATCH_COUNTED_ENTER,
+      &raw_data,
+      sizeof(raw_data) - sizeof(TraceCountedEnterEventData) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
+TEST_F(ParseEngineUnitTest, BatchedDispatch) {
+  TraceEnterEventData entry_data = {};
+  entry_data.function = &TestFunc1;
+  TraceExitEventData exit_data = {};
+  exit_data.function = &TestFunc2;
+
+  // Entry events are deferred until their run is broken or flushed.
+  expected_data = &entry_data;
+  ASSERT_NO_FATAL_FAILURE(DispatchBatchedEventData(
+      TRACE_ENTER_EVENT, &entry_data, sizeof(entry_data)));
+  ASSERT_NO_FATAL_FAILURE(DispatchBatchedEventData(
+      TRACE_ENTER_EVENT, &entry_data, sizeof(entry_data)));
+  ASSERT_FALSE(error_occurred());
+  ASSERT_EQ(0u, function_entries.size());
+
+  // An exit event breaks the run of entries, causing them to be handed over
+  // as a single batch. The exit event itself is deferred.
+  ASSERT_NO_FATAL_FAILURE(DispatchBatchedEventData(
+      TRACE_EXIT_EVENT, &exit_data, sizeof(exit_data)));
+  ASSERT_FALSE(error_occurred());
+  ASSERT_EQ(2u, function_entries.size());
+  ASSERT_EQ(2u, function_entries.count(&TestFunc1));
+  ASSERT_EQ(1u, entry_batch_sizes.size());
+  ASSERT_EQ(2u, entry_batch_sizes[0]);
+  ASSERT_EQ(0u, function_exits.size());
+
+  // Flushing delivers the pending exit event.
+  expected_data = &exit_data;
+  FlushEventBatch();
+  ASSERT_EQ(1u, function_exits.size());
+  ASSERT_EQ(1u, exit_batch_sizes.size());
+  ASSERT_EQ(1u, exit_batch_sizes[0]);
+
+  // Flushing with nothing pending is a no-op.
+  FlushEventBatch();
+  ASSERT_EQ(1u, entry_batch_sizes.size());
+  ASSERT_EQ(1u, exit_batch_sizes.size());
+}
+
+TEST_F(ParseEngineUnitTest, BatchedDispatchFlushesOnOtherEvents) {
+  TraceEnterEventData entry_data = {};
+  entry_data.function = &TestFunc1;
+  expected_data = &entry_data;
+  ASSERT_NO_FATAL_FAILURE(DispatchBatchedEventData(
+      TRACE_ENTER_EVENT, &entry_data, sizeof(entry_data)));
+  ASSERT_EQ(0u, function_entries.size());
+
+  // A non-coalesced event type flushes the pending run before being
+  // dispatched itself.
+  const char kDummyComment[] = "This is a comment!";
+  char buffer[FIELD_OFFSET(TraceComment, comment) +
+      arraysize(kDummyComment)] = {};
+  TraceComment* comment_data = reinterpret_cast<TraceComment*>(buffer);
+  comment_data->comment_size = arraysize(kDummyComment);
+  ::memcpy(comment_data->comment, kDummyComment, arraysize(kDummyComment));
+
+  EXPECT_CALL(*this, OnComment(_, kProcessId, comment_data));
+  ASSERT_NO_FATAL_FAILURE(DispatchBatchedEventData(
+      TRACE_COMMENT, comment_data, sizeof(buffer)));
+  ASSERT_FALSE(error_occurred());
+  ASSERT_EQ(1u, function_entries.size());
+  ASSERT_EQ(1u, entry_batch_sizes.size());
+  ASSERT_EQ(1u, entry_batch_sizes[0]);
+}
+
+TEST_F(ParseEngineUnitTest, BatchedDispatchInvocationBatches) {
+  InvocationInfo invocations[2] = {};
+  expected_data = &invocations;
+
+  // Runs of invocation batches are deferred and handed over in bulk.
+  ASSERT_NO_FATAL_FAILURE(DispatchBatchedEventData(
+      TRACE_BATCH_INVOCATION, &invocations, sizeof(invocations)));
+  ASSERT_NO_FATAL_FAILURE(DispatchBatchedEventData(
+      TRACE_BATCH_INVOCATION, &invocations, sizeof(invocations)));
+  ASSERT_FALSE(error_occurred());
+  ASSERT_EQ(0u, invocation_batch_sizes.size());
+
+  FlushEventBatch();
+  ASSERT_EQ(1u, invocation_batch_sizes.size());
+  ASSERT_EQ(2u, invocation_batch_sizes[0]);
+
+  // A malformed invocation batch still sets the error flag.
+  ASSERT_NO_FATAL_FAILURE(DispatchBatchedEventData(
+      TRACE_BATCH_INVOCATION, &invocations, sizeof(invocations) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
 TEST_F(ParseEngineUnitTest, ProcessAttachIncomplete) {
   TraceModuleData incomplete(kModuleData);
   incomplete.module_base_addr = NULL;
@@ -735,6 +947,25 @@ TEST_F(ParseEngineUnitTest, DetailedFunctionCall) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, FunctionCallSummary) {
+  TraceFunctionCallSummary data = {};
+  data.function_id = 37;
+  data.stack_trace_id = 0xDEADBEEF;
+  data.call_count = 1024;
+  data.total_bytes = 1024 * 512;
+  data.max_bytes = 4096;
+
+  EXPECT_CALL(*this, OnFunctionCallSummary(_, kProcessId, kThreadId, &data));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_FUNCTION_CALL_SUMMARY, &data, sizeof(data)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a malformed record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_FUNCTION_CALL_SUMMARY, &data, sizeof(data) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
 TEST_F(ParseEngineUnitTest, Comment) {
   const char kDummyComment[] = "This is a comment!";
   char buffer[FIELD_OFFSET(TraceComment, comment) +
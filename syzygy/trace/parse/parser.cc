@@ -25,7 +25,9 @@ namespace parser {
 
 using ::common::BinaryBufferParser;
 
-Parser::Parser() : active_parse_engine_(NULL) {
+Parser::Parser()
+    : active_parse_engine_(NULL),
+      event_type_mask_(ParseEngine::kAllEventTypes) {
 }
 
 Parser::~Parser() {
@@ -40,6 +42,7 @@ Parser::~Parser() {
 
 void Parser::AddParseEngine(ParseEngine* parse_engine) {
   DCHECK(parse_engine != NULL);
+  parse_engine->set_event_type_mask(event_type_mask_);
   parse_engine_set_.push_front(parse_engine);
 }
 
@@ -58,15 +61,24 @@ bool Parser::Init(ParseEventHandler* event_handler) {
   }
   parse_engine_set_.push_back(engine);
 
-  // Setup the event handler for all of the engines.
+  // Setup the event handler and event-type mask for all of the engines.
   ParseEngineIter it = parse_engine_set_.begin();
   for (; it != parse_engine_set_.end(); ++it) {
     (*it)->set_event_handler(event_handler);
+    (*it)->set_event_type_mask(event_type_mask_);
   }
 
   return true;
 }
 
+void Parser::set_event_type_mask(uint64 event_type_mask) {
+  event_type_mask_ = event_type_mask;
+  ParseEngineIter it = parse_engine_set_.begin();
+  for (; it != parse_engine_set_.end(); ++it) {
+    (*it)->set_event_type_mask(event_type_mask_);
+  }
+}
+
 bool Parser::error_occurred() const {
   DCHECK(active_parse_engine_ != NULL);
   return active_parse_engine_->error_occurred();
@@ -132,6 +144,48 @@ bool Parser::SetActiveParseEngine(const base::FilePath& trace_file_path) {
   return false;
 }
 
+void ParseEventHandler::OnBatchCountedFunctionEntry(
+    base::Time time,
+    DWORD process_id,
+    DWORD thread_id,
+    const TraceBatchCountedEnterData* data) {
+  // Expand each counted entry into the equivalent run of individual entry
+  // events, so that handlers unaware of counted records see the same stream
+  // of calls they would have seen without coalescing.
+  TraceEnterEventData entry = {};
+  for (size_t i = 0; i < data->num_entries; ++i) {
+    entry.retaddr = data->entries[i].retaddr;
+    entry.function = data->entries[i].function;
+    for (uint32 j = 0; j < data->entries[i].count; ++j)
+      OnFunctionEntry(time, process_id, thread_id, &entry);
+  }
+}
+
+void ParseEventHandler::OnFunctionEntryBatch(const FunctionEventRecord* events,
+                                             size_t num_events) {
+  for (size_t i = 0; i < num_events; ++i) {
+    OnFunctionEntry(events[i].time, events[i].process_id, events[i].thread_id,
+                    events[i].data);
+  }
+}
+
+void ParseEventHandler::OnFunctionExitBatch(const FunctionEventRecord* events,
+                                            size_t num_events) {
+  for (size_t i = 0; i < num_events; ++i) {
+    OnFunctionExit(events[i].time, events[i].process_id, events[i].thread_id,
+                   events[i].data);
+  }
+}
+
+void ParseEventHandler::OnInvocationBatches(
+    const InvocationBatchRecord* batches, size_t num_batches) {
+  for (size_t i = 0; i < num_batches; ++i) {
+    OnInvocationBatch(batches[i].time, batches[i].process_id,
+                      batches[i].thread_id, batches[i].num_invocations,
+                      batches[i].data);
+  }
+}
+
 void ParseEventHandlerImpl::OnProcessStarted(base::Time time,
                                              DWORD process_id,
                                              const TraceSystemInfo* data) {
@@ -238,6 +292,13 @@ void ParseEventHandlerImpl::OnDetailedFunctionCall(
     const TraceDetailedFunctionCall* data) {
 }
 
+void ParseEventHandlerImpl::OnFunctionCallSummary(
+    base::Time time,
+    DWORD process_id,
+    DWORD thread_id,
+    const TraceFunctionCallSummary* data) {
+}
+
 void ParseEventHandlerImpl::OnComment(
     base::Time time,
     DWORD process_id,
@@ -77,6 +77,16 @@ class Parser {
   // Initialize the parser implementation.
   bool Init(ParseEventHandler* event_handler);
 
+  // Restricts the event types that are dispatched to the event handler. The
+  // mask is a bitmask over TraceEventType values, as produced by
+  // ParseEngine::EventTypeToMask(), and is propagated to every parse engine,
+  // including engines added after this call. Module and process lifetime
+  // events are always dispatched regardless of the mask. By default all
+  // event types are dispatched.
+  //
+  // @param event_type_mask The mask of event types to dispatch.
+  void set_event_type_mask(uint64 event_type_mask);
+
   // Returns true if an error occurred while parsing the trace files.
   bool error_occurred() const;
 
@@ -116,9 +126,33 @@ class Parser {
   // will be set based on the first trace file that gets opened.
   ParseEngine* active_parse_engine_;
 
+  // The mask of event types to dispatch, applied to every parse engine.
+  uint64 event_type_mask_;
+
   DISALLOW_COPY_AND_ASSIGN(Parser);
 };
 
+// A function entry or exit event decoded from a trace buffer, as handed to
+// the batch dispatch callbacks. The data pointer points into the trace
+// buffer being consumed and is only valid for the duration of the callback.
+struct FunctionEventRecord {
+  base::Time time;
+  DWORD process_id;
+  DWORD thread_id;
+  const TraceEnterExitEventData* data;
+};
+
+// An invocation batch decoded from a trace buffer, as handed to the batch
+// dispatch callbacks. The data pointer points into the trace buffer being
+// consumed and is only valid for the duration of the callback.
+struct InvocationBatchRecord {
+  base::Time time;
+  DWORD process_id;
+  DWORD thread_id;
+  size_t num_invocations;
+  const TraceBatchInvocationInfo* data;
+};
+
 // Implemented by clients of Parser to receive trace event notifications.
 class ParseEventHandler {
  public:
@@ -225,11 +259,46 @@ class ParseEventHandler {
       DWORD thread_id,
       const TraceDetailedFunctionCall* data) = 0;
 
+  // Issued for function call summary records.
+  virtual void OnFunctionCallSummary(
+      base::Time Time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceFunctionCallSummary* data) = 0;
+
   // Issued for comment records.
   virtual void OnComment(
       base::Time time,
       DWORD process_id,
       const TraceComment* data) = 0;
+
+  // Issued for counted batch function entry traces, produced by clients
+  // with entry coalescing enabled. The default implementation expands each
+  // counted entry into the equivalent run of OnFunctionEntry() calls;
+  // handlers that aggregate call counts may override this to consume the
+  // counts natively.
+  virtual void OnBatchCountedFunctionEntry(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceBatchCountedEnterData* data);
+
+  // Issued for a run of function entry events decoded from a trace buffer.
+  // The default implementation forwards each event to OnFunctionEntry();
+  // handlers that grind entry-dense traces may override this to process the
+  // whole batch in a tight loop.
+  virtual void OnFunctionEntryBatch(const FunctionEventRecord* events,
+                                    size_t num_events);
+
+  // Issued for a run of function exit events decoded from a trace buffer.
+  // The default implementation forwards each event to OnFunctionExit().
+  virtual void OnFunctionExitBatch(const FunctionEventRecord* events,
+                                   size_t num_events);
+
+  // Issued for a run of invocation batches decoded from a trace buffer. The
+  // default implementation forwards each batch to OnInvocationBatch().
+  virtual void OnInvocationBatches(const InvocationBatchRecord* batches,
+                                   size_t num_batches);
 };
 
 // A default implementation of the ParseEventHandler interface. Provides
@@ -304,6 +373,11 @@ class ParseEventHandlerImpl : public ParseEventHandler {
       DWORD process_id,
       DWORD thread_id,
       const TraceDetailedFunctionCall* data) OVERRIDE;
+  virtual void OnFunctionCallSummary(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceFunctionCallSummary* data) OVERRIDE;
   virtual void OnComment(
       base::Time time,
       DWORD process_id,
@@ -40,6 +40,11 @@ class MockParseEventHandler : public trace::parser::ParseEventHandler {
                                           DWORD process_id,
                                           DWORD thread_id,
                                           const TraceBatchEnterData* data));
+  MOCK_METHOD4(OnBatchCountedFunctionEntry,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceBatchCountedEnterData* data));
   MOCK_METHOD4(OnProcessAttach, void(base::Time time,
                                      DWORD process_id,
                                      DWORD thread_id,
@@ -91,6 +96,11 @@ class MockParseEventHandler : public trace::parser::ParseEventHandler {
                     DWORD process_id,
                     DWORD thread_id,
                     const TraceDetailedFunctionCall* data));
+  MOCK_METHOD4(OnFunctionCallSummary,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceFunctionCallSummary* data));
   MOCK_METHOD3(OnComment,
                void(base::Time time,
                     DWORD process_id,
@@ -18,6 +18,7 @@
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 #include "base/logging.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 
 // ETW Unique Identifiers.
@@ -53,6 +54,22 @@ const char kSyzygyRpcInstanceIdEnvVar[] = "SYZYGY_RPC_INSTANCE_ID";
 // Environment variable used to indicate that an RPC session is mandatory.
 const char kSyzygyRpcSessionMandatoryEnvVar[] =
     "SYZYGY_RPC_SESSION_MANDATORY";
+// Environment variable used to indicate that an RPC session should be
+// created lazily.
+const char kSyzygyRpcSessionLazyEnvVar[] = "SYZYGY_RPC_SESSION_LAZY";
+// Environment variable used to indicate that modules in a process should
+// share a single process-wide RPC session.
+const char kSyzygyRpcSessionSharedEnvVar[] = "SYZYGY_RPC_SESSION_SHARED";
+// Environment variable used to indicate that a client should attach to a
+// late-starting call-trace service mid-run.
+const char kSyzygyRpcSessionAttachableEnvVar[] =
+    "SYZYGY_RPC_SESSION_ATTACHABLE";
+// Environment variable used to indicate that the client should coalesce
+// repeated function entries into counted entry records.
+const char kSyzygyCoalesceEntriesEnvVar[] = "SYZYGY_COALESCE_ENTRIES";
+// Environment variable used to indicate that the profiler should only
+// count function entries.
+const char kSyzygyProfileCountOnlyEnvVar[] = "SYZYGY_PROFILE_COUNT_ONLY";
 
 namespace {
 
@@ -61,6 +78,8 @@ const wchar_t* const kCallTraceRpcProtocol = L"ncalrpc";
 const wchar_t* const kCallTraceRpcEndpoint = L"syzygy-call-trace-svc";
 const wchar_t* const kCallTraceRpcMutex = L"syzygy-call-trace-svc-mutex";
 const wchar_t* const kCallTraceRpcEvent = L"syzygy-call-trace-svc-event";
+const wchar_t* const kCallTraceRpcSharedSession =
+    L"syzygy-call-trace-svc-shared-session";
 
 void MakeInstanceString(const base::StringPiece16& prefix,
                         const base::StringPiece16& id,
@@ -99,3 +118,10 @@ void GetSyzygyCallTraceRpcEventName(const base::StringPiece16& id,
                                     std::wstring* event_name) {
   MakeInstanceString(kCallTraceRpcEvent, id, event_name);
 }
+
+void GetSyzygyCallTraceRpcSharedSessionName(const base::StringPiece16& id,
+                                            std::wstring* name) {
+  MakeInstanceString(kCallTraceRpcSharedSession, id, name);
+  // The shared session registration is scoped to a single process.
+  base::StringAppendF(name, L"-%u", ::GetCurrentProcessId());
+}
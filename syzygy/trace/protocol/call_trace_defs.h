@@ -59,14 +59,41 @@ void GetSyzygyCallTraceRpcMutexName(const base::StringPiece16& id,
                                     std::wstring* mutex_name);
 void GetSyzygyCallTraceRpcEventName(const base::StringPiece16& id,
                                     std::wstring* event_name);
+void GetSyzygyCallTraceRpcSharedSessionName(const base::StringPiece16& id,
+                                            std::wstring* name);
 
 // Environment variable used to indicate that an RPC session is mandatory.
 extern const char kSyzygyRpcSessionMandatoryEnvVar[];
 
+// Environment variable used to indicate that an RPC session should be
+// created lazily, deferring the service handshake off the critical path of
+// process startup.
+extern const char kSyzygyRpcSessionLazyEnvVar[];
+
+// Environment variable used to indicate that modules in a process should
+// share a single process-wide RPC session rather than each opening their
+// own.
+extern const char kSyzygyRpcSessionSharedEnvVar[];
+
+// Environment variable used to indicate that a client unable to reach a
+// call-trace service should wait for one to start and attach to it mid-run,
+// rather than disabling itself for the life of the process.
+extern const char kSyzygyRpcSessionAttachableEnvVar[];
+
+// Environment variable used to indicate that the client should coalesce
+// back-to-back entry events for the same function into counted entry
+// records. See TraceBatchCountedEnterData.
+extern const char kSyzygyCoalesceEntriesEnvVar[];
+
+// Environment variable used to indicate that the profiler should only count
+// function entries, recording no cycle timings and performing no return
+// address swizzling.
+extern const char kSyzygyProfileCountOnlyEnvVar[];
+
 // This must be bumped anytime the file format is changed.
 enum {
   TRACE_VERSION_HI = 1,
-  TRACE_VERSION_LO = 4,
+  TRACE_VERSION_LO = 7,
 };
 
 enum TraceEventType {
@@ -92,6 +119,10 @@ enum TraceEventType {
   TRACE_STACK_TRACE,
   TRACE_DETAILED_FUNCTION_CALL,
   TRACE_COMMENT,
+  TRACE_COMPRESSED_SEGMENT,
+  TRACE_FUNCTION_CALL_SUMMARY,
+  TRACE_INDEX_FOOTER,
+  TRACE_BATCH_COUNTED_ENTER,
 };
 
 // All traces are emitted at this trace level.
@@ -243,6 +274,17 @@ struct TraceFileSegmentHeader {
   // of the trace file.
   uint32 thread_id;
 
+  // The position of this segment in the stream of segments committed by
+  // the reporting process. Sequence numbers are allocated from a single
+  // process-wide counter starting at 1 as buffers are handed to the call
+  // trace service, so the segments of a complete trace bear a dense set of
+  // sequence numbers and a consumer can tell exactly which segments went
+  // missing when a process died with buffers in flight. A value of 0 marks
+  // an unsequenced segment (one never handed over by the client, such as
+  // the synthetic process-ended segment), which is exempt from sequence
+  // accounting.
+  uint32 sequence_number;
+
   // The number of data bytes in this segment of the trace file. This
   // value does not include the size of the record prefix nor the size
   // of the segment header.
@@ -250,6 +292,73 @@ struct TraceFileSegmentHeader {
 };
 COMPILE_ASSERT_IS_POD(TraceFileSegmentHeader);
 
+// Written in place of a raw segment record when a trace file is written with
+// segment compression enabled. The record is immediately followed by
+// compressed_length bytes of zlib-deflated data, which inflate to an ordinary
+// segment record: a RecordPrefix, a TraceFileSegmentHeader and the segment
+// data. Each segment is compressed independently, and the next record starts
+// at the following block boundary, so a compressed trace file remains
+// seekable segment by segment. Raw and compressed segments may be freely
+// interleaved in a single trace file; segments that don't shrink by at least
+// a block are written raw.
+struct TraceCompressedSegmentHeader {
+  // Type identifiers used for these headers.
+  enum { kTypeId = TRACE_COMPRESSED_SEGMENT };
+
+  // The number of compressed data bytes following this record.
+  uint32 compressed_length;
+
+  // The size of the contained segment record once inflated.
+  uint32 uncompressed_length;
+};
+COMPILE_ASSERT_IS_POD(TraceCompressedSegmentHeader);
+
+// An entry in the trace file index footer, describing a single segment
+// record in the file.
+struct TraceIndexEntry {
+  // The file offset of the segment record's prefix.
+  uint64 offset;
+
+  // The length of the record on disk, aligned to the block size. The record
+  // at the given offset may be a raw or a compressed segment.
+  uint32 length;
+
+  // The identity of the thread that produced the segment.
+  uint32 thread_id;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(TraceIndexEntry, 16);
+
+// Written as the last record of a trace file, describing every segment
+// record that precedes it. This lets a reader enumerate and seek to
+// segments of interest without scanning the file, and decide from the event
+// type counts whether the file contains anything it cares about at all. The
+// record is immediately followed by num_entries TraceIndexEntry structs and
+// padded out to the block size; the last eight bytes of the file hold the
+// file offset of this record's prefix, which is how a reader locates the
+// footer. Trace files that were not closed cleanly have no footer, in which
+// case the trailing offset fails to validate and readers fall back to a
+// sequential scan.
+struct TraceIndexFooter {
+  // Type identifiers used for these headers.
+  enum { kTypeId = TRACE_INDEX_FOOTER };
+
+  // The number of event types for which counts are recorded in
+  // event_type_counts.
+  static const size_t kNumEventTypeCounts = 64;
+
+  // The number of TraceIndexEntry structs following this record.
+  uint32 num_entries;
+
+  // The number of events of each type contained in the file's segments,
+  // indexed by TraceEventType. Events with types beyond the array are not
+  // counted.
+  uint32 event_type_counts[kNumEventTypeCounts];
+};
+COMPILE_ASSERT_IS_POD(TraceIndexFooter);
+COMPILE_ASSERT(
+    TRACE_BATCH_COUNTED_ENTER < TraceIndexFooter::kNumEventTypeCounts,
+    event_type_count_array_too_small);
+
 // The structure traced on function entry or exit.
 template<int TypeId>
 struct TraceEnterExitEventDataTempl {
@@ -310,6 +419,35 @@ struct TraceBatchEnterData {
 };
 COMPILE_ASSERT_IS_POD(TraceBatchEnterData);
 
+// A single coalesced function entry: |count| back-to-back calls of
+// |function| from the same return address.
+struct TraceCountedEnterEventData {
+  RetAddr retaddr;
+  FuncAddr function;
+  uint32 count;
+};
+COMPILE_ASSERT_IS_POD(TraceCountedEnterEventData);
+
+// The structure traced for batch entry traces when entry coalescing is
+// enabled (see kSyzygyCoalesceEntriesEnvVar). This is the counted analogue
+// of TraceBatchEnterData: repeated calls to the same function from the same
+// call site occupy a single entry whose count is incremented in place.
+struct TraceBatchCountedEnterData {
+  enum { kTypeId = TRACE_BATCH_COUNTED_ENTER };
+
+  // The thread ID from which these traces originate. This can differ
+  // from the logging thread ID when a process exits, and the exiting
+  // thread flushes the trace buffers from its expired brethren.
+  DWORD thread_id;
+
+  // Number of counted entries.
+  size_t num_entries;
+
+  // Back-to-back counted entry events.
+  TraceCountedEnterEventData entries[1];
+};
+COMPILE_ASSERT_IS_POD(TraceBatchCountedEnterData);
+
 enum InvocationInfoFlags {
   // If this bit is set in InvocationInfo flags, the caller is a dynamic
   // symbol id, and caller_offset is the offset of the return site, relative to
@@ -498,6 +636,33 @@ struct TraceDetailedFunctionCall {
 };
 COMPILE_ASSERT_IS_POD(TraceDetailedFunctionCall);
 
+// Records aggregate information about the calls made from a single call
+// site. These are emitted in lieu of individual TraceDetailedFunctionCall
+// records when a producer is running in an aggregating mode, trading
+// per-call detail for drastically reduced trace volume.
+struct TraceFunctionCallSummary {
+  enum { kTypeId = TRACE_FUNCTION_CALL_SUMMARY };
+
+  // The ID of the function. This is an entry in the global
+  // function table.
+  uint32 function_id;
+
+  // The ID of the stack trace of the call site.
+  uint32 stack_trace_id;
+
+  // The number of calls made from this call site.
+  uint64 call_count;
+
+  // The sum of the byte counts reported by the producer for these calls,
+  // for functions with a size-like argument (eg. allocation functions).
+  // Zero for functions without one.
+  uint64 total_bytes;
+
+  // The largest single byte count reported for these calls.
+  uint64 max_bytes;
+};
+COMPILE_ASSERT_IS_POD(TraceFunctionCallSummary);
+
 // Records a comment in a trace file. These are output via the call-trace
 // service and act as delimiters in a call-trace log.
 struct TraceComment {
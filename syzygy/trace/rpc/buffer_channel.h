@@ -0,0 +1,107 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the shared-memory buffer channel over which the call-trace client
+// posts its high-frequency buffer-exchange commands to the service.
+//
+// The channel is a small shared-memory mapping holding a fixed set of command
+// slots, negotiated per session via the GetBufferChannel RPC (see
+// call_trace_rpc.idl). A client thread claims a free slot with an interlocked
+// operation, fills in the command, publishes it and signals the channel's
+// doorbell event; a worker thread in the service executes the command and
+// signals the slot's completion event. This replaces an RPC round trip per
+// buffer swap with a pair of kernel event operations on memory both processes
+// have already mapped. Control operations (session creation and teardown,
+// buffer allocation) remain on RPC, which also serves as the fallback path
+// whenever no channel or no free slot is available.
+
+#ifndef SYZYGY_TRACE_RPC_BUFFER_CHANNEL_H_
+#define SYZYGY_TRACE_RPC_BUFFER_CHANNEL_H_
+
+#include <windows.h>
+
+#include "base/basictypes.h"
+#include "syzygy/common/assertions.h"
+#include "syzygy/trace/rpc/call_trace_rpc.h"
+
+// A single command slot in a buffer channel. Ownership of a slot passes back
+// and forth between the client and the service through interlocked
+// transitions of |state|; the remaining fields are only ever accessed by the
+// side that currently owns the slot.
+struct CallTraceBufferChannelSlot {
+  // The life-cycle of a slot.
+  enum SlotState {
+    // The slot carries no command and may be claimed by a client thread.
+    kSlotFree,
+    // A client thread has claimed the slot and is filling in the command,
+    // or is consuming the response to a completed command.
+    kSlotClientOwned,
+    // The command is published and awaits pickup by the service.
+    kSlotCommandPending,
+    // The service is executing the command.
+    kSlotServiceOwned,
+    // The command has completed; |result| and |buffer| are valid and the
+    // slot awaits consumption by the posting thread.
+    kSlotCommandDone,
+  };
+
+  // The commands that may be posted to a slot.
+  enum SlotCommand {
+    // Commit |buffer| and receive a fresh buffer in its place. The
+    // equivalent of the ExchangeBuffer RPC.
+    kSlotCommandExchangeBuffer,
+    // Commit |buffer| without receiving a fresh one. The equivalent of the
+    // ReturnBuffer RPC.
+    kSlotCommandReturnBuffer,
+  };
+
+  // A SlotState value. Only ever modified with interlocked operations.
+  volatile LONG state;
+
+  // A SlotCommand value. Written by the client along with |buffer|.
+  uint32 command;
+
+  // Nonzero if the command succeeded. Written by the service.
+  uint32 result;
+
+  // The value, in the client process, of the handle to the auto-reset event
+  // the service signals when the command completes. The service records this
+  // when the channel is created; the client closes the handle when it tears
+  // the channel down.
+  uint32 done_event;
+
+  // The buffer being committed and, for an exchange, the fresh buffer handed
+  // back by the service.
+  CallTraceBuffer buffer;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(CallTraceBufferChannelSlot, 32);
+
+// The shared-memory layout of a buffer channel.
+struct CallTraceBufferChannel {
+  // The number of command slots. This bounds the number of threads that can
+  // have channel commands in flight simultaneously; when every slot is busy
+  // the client simply falls back to the buffer-exchange RPCs.
+  enum { kNumSlots = 4 };
+
+  // Nonzero once the service has stopped servicing the channel. Posting to a
+  // closed channel would wait forever, so clients must check this before
+  // claiming a slot, and again when a posted command is never picked up.
+  volatile LONG closed;
+
+  // The command slots.
+  CallTraceBufferChannelSlot slots[kNumSlots];
+};
+COMPILE_ASSERT_IS_POD(CallTraceBufferChannel);
+
+#endif  // SYZYGY_TRACE_RPC_BUFFER_CHANNEL_H_
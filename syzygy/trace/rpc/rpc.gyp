@@ -34,7 +34,10 @@
         'prefix': 'CallTrace',
       },
       'includes': ['../../build/midl_rpc.gypi'],
-      'sources': ['call_trace_rpc.idl'],
+      'sources': [
+        'buffer_channel.h',
+        'call_trace_rpc.idl',
+      ],
       'dependencies': [
         '<(src)/syzygy/common/rpc/rpc.gyp:common_rpc_lib',
         '<(src)/syzygy/trace/protocol/protocol.gyp:protocol_lib',
@@ -0,0 +1,248 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file implements the trace::service::BufferChannel class, the service
+// side of a session's shared-memory buffer channel.
+
+#include "syzygy/trace/service/buffer_channel.h"
+
+#include "base/logging.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/trace/service/session.h"
+
+namespace trace {
+namespace service {
+
+namespace {
+
+// Duplicates @p local_handle into the given client process, returning the
+// handle value it has over there.
+bool CopyHandleToClient(HANDLE client_process_handle,
+                        HANDLE local_handle,
+                        uint32* client_copy) {
+  DCHECK(client_process_handle != NULL);
+  DCHECK(local_handle != NULL);
+  DCHECK(client_copy != NULL);
+
+  HANDLE copy = NULL;
+  if (!::DuplicateHandle(::GetCurrentProcess(),
+                         local_handle,
+                         client_process_handle,
+                         &copy,
+                         0,
+                         FALSE,
+                         DUPLICATE_SAME_ACCESS)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to copy handle into client process: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  *client_copy = reinterpret_cast<uint32>(copy);
+  return true;
+}
+
+}  // namespace
+
+BufferChannel::BufferChannel(Session* session)
+    : session_(session),
+      channel_(NULL),
+      client_channel_handle_(0),
+      client_doorbell_handle_(0),
+      shutting_down_(0) {
+  DCHECK(session != NULL);
+}
+
+BufferChannel::~BufferChannel() {
+  Stop();
+
+  if (channel_ != NULL) {
+    ::UnmapViewOfFile(channel_);
+    channel_ = NULL;
+  }
+}
+
+bool BufferChannel::Init(HANDLE client_process_handle) {
+  DCHECK(client_process_handle != NULL);
+  DCHECK(channel_ == NULL);
+  DCHECK(worker_thread_.get() == NULL);
+
+  // Create and map the shared-memory section backing the channel. A fresh
+  // section is zero-initialized, so all slots start out free.
+  mapping_handle_.Set(
+      ::CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                          sizeof(CallTraceBufferChannel), NULL));
+  if (!mapping_handle_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create buffer channel mapping: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  channel_ = reinterpret_cast<CallTraceBufferChannel*>(
+      ::MapViewOfFile(mapping_handle_.Get(), FILE_MAP_WRITE, 0, 0,
+                      sizeof(CallTraceBufferChannel)));
+  if (channel_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map buffer channel: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  // Create the channel events and record the client-side handle values of
+  // the per-slot completion events in the channel itself.
+  doorbell_event_.Set(::CreateEvent(NULL, FALSE, FALSE, NULL));
+  if (!doorbell_event_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create doorbell event: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  for (size_t i = 0; i < CallTraceBufferChannel::kNumSlots; ++i) {
+    done_events_[i].Set(::CreateEvent(NULL, FALSE, FALSE, NULL));
+    if (!done_events_[i].IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to create completion event: "
+                 << ::common::LogWe(error) << ".";
+      return false;
+    }
+
+    if (!CopyHandleToClient(client_process_handle,
+                            done_events_[i].Get(),
+                            &channel_->slots[i].done_event)) {
+      return false;
+    }
+  }
+
+  if (!CopyHandleToClient(client_process_handle,
+                          mapping_handle_.Get(),
+                          &client_channel_handle_) ||
+      !CopyHandleToClient(client_process_handle,
+                          doorbell_event_.Get(),
+                          &client_doorbell_handle_)) {
+    return false;
+  }
+
+  // Start servicing the channel.
+  worker_thread_.reset(
+      new base::DelegateSimpleThread(this, "Buffer channel thread"));
+  worker_thread_->Start();
+
+  return true;
+}
+
+void BufferChannel::Stop() {
+  if (worker_thread_.get() != NULL) {
+    ::InterlockedExchange(&shutting_down_, 1);
+    ::SetEvent(doorbell_event_.Get());
+    worker_thread_->Join();
+    worker_thread_.reset();
+  }
+
+  if (channel_ == NULL)
+    return;
+
+  // Mark the channel closed and release any client threads still waiting on
+  // a posted command. Signalling every completion event also banks a wake-up
+  // for a thread that read |closed| just before it was set and is about to
+  // wait; it will find its command unclaimed and reclaim the slot.
+  if (::InterlockedExchange(&channel_->closed, 1) == 0) {
+    for (size_t i = 0; i < CallTraceBufferChannel::kNumSlots; ++i) {
+      if (done_events_[i].IsValid())
+        ::SetEvent(done_events_[i].Get());
+    }
+  }
+}
+
+void BufferChannel::Run() {
+  while (true) {
+    DWORD wait = ::WaitForSingleObject(doorbell_event_.Get(), INFINITE);
+    if (wait != WAIT_OBJECT_0) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to wait on buffer channel doorbell: "
+                 << ::common::LogWe(error) << ".";
+      return;
+    }
+
+    if (shutting_down_ != 0)
+      return;
+
+    // The doorbell is an auto-reset event, so back-to-back commands can
+    // coalesce into a single wake-up. Service every pending slot before
+    // going back to sleep; an extra pass over an already-serviced slot is
+    // harmless.
+    for (size_t i = 0; i < CallTraceBufferChannel::kNumSlots; ++i) {
+      if (::InterlockedCompareExchange(
+              &channel_->slots[i].state,
+              CallTraceBufferChannelSlot::kSlotServiceOwned,
+              CallTraceBufferChannelSlot::kSlotCommandPending) ==
+          CallTraceBufferChannelSlot::kSlotCommandPending) {
+        ProcessSlot(i);
+      }
+    }
+  }
+}
+
+void BufferChannel::ProcessSlot(size_t slot_index) {
+  DCHECK_GT(static_cast<size_t>(CallTraceBufferChannel::kNumSlots),
+            slot_index);
+  CallTraceBufferChannelSlot* slot = &channel_->slots[slot_index];
+  DCHECK_EQ(static_cast<LONG>(CallTraceBufferChannelSlot::kSlotServiceOwned),
+            static_cast<LONG>(slot->state));
+
+  // Take a local copy of the command, as the client owns the slot contents
+  // again the moment the completion event is signalled.
+  uint32 command = slot->command;
+  CallTraceBuffer call_trace_buffer = slot->buffer;
+
+  // What follows mirrors Service::CommitAndExchangeBuffer(), which backs
+  // the ExchangeBuffer and ReturnBuffer RPCs.
+  bool result = true;
+  Buffer* buffer = NULL;
+  if (!session_->FindBuffer(&call_trace_buffer, &buffer)) {
+    result = false;
+  } else {
+    DCHECK(buffer != NULL);
+    if (!session_->ReturnBuffer(buffer)) {
+      LOG(ERROR) << "Unable to return buffer to session.";
+      result = false;
+    }
+  }
+
+  ZeroMemory(&call_trace_buffer, sizeof(call_trace_buffer));
+
+  if (result &&
+      command == CallTraceBufferChannelSlot::kSlotCommandExchangeBuffer) {
+    // Request a fresh buffer for the client.
+    Buffer* client_buffer = NULL;
+    if (!session_->GetNextBuffer(&client_buffer)) {
+      result = false;
+    } else {
+      // Copy buffer info into the slot, slicing off the private bits.
+      DCHECK(client_buffer != NULL);
+      call_trace_buffer = *client_buffer;
+    }
+  }
+
+  // Publish the outcome and wake the posting thread.
+  slot->buffer = call_trace_buffer;
+  slot->result = result ? 1 : 0;
+  ::InterlockedExchange(&slot->state,
+                        CallTraceBufferChannelSlot::kSlotCommandDone);
+  ::SetEvent(done_events_[slot_index].Get());
+}
+
+}  // namespace service
+}  // namespace trace
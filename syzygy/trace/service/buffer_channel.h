@@ -0,0 +1,106 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the trace::service::BufferChannel class, the service
+// side of a session's shared-memory buffer channel.
+
+#ifndef SYZYGY_TRACE_SERVICE_BUFFER_CHANNEL_H_
+#define SYZYGY_TRACE_SERVICE_BUFFER_CHANNEL_H_
+
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/trace/rpc/buffer_channel.h"
+
+namespace trace {
+namespace service {
+
+// Forward declaration.
+class Session;
+
+// The service side of a session's shared-memory buffer channel; see
+// "syzygy/trace/rpc/buffer_channel.h" for the shared layout and the slot
+// hand-off protocol. The channel owns a worker thread which waits on the
+// channel's doorbell event and executes posted buffer-exchange commands
+// against the session, exactly as the corresponding RPCs would.
+//
+// A channel is owned by its session and must be stopped before the session
+// starts tearing down its buffers; Session::Close() takes care of this.
+class BufferChannel : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit BufferChannel(Session* session);
+  virtual ~BufferChannel();
+
+  // Creates the shared-memory mapping and the channel events, duplicates
+  // their handles into the client process and starts the worker thread.
+  // @param client_process_handle a valid handle to the client process.
+  // @returns true on success, false otherwise.
+  bool Init(HANDLE client_process_handle);
+
+  // Stops the worker thread, marks the channel closed and releases any
+  // client threads still waiting on a posted command. Idempotent.
+  void Stop();
+
+  // @name The channel handle values valid in the client process, as returned
+  //     by the GetBufferChannel RPC. Only valid after a successful Init().
+  // @{
+  uint32 client_channel_handle() const { return client_channel_handle_; }
+  uint32 client_doorbell_handle() const { return client_doorbell_handle_; }
+  // @}
+
+ protected:
+  // The worker thread's main function; implementation of the
+  // base::DelegateSimpleThread::Delegate interface.
+  virtual void Run() OVERRIDE;
+
+  // Executes the command posted in the given slot and signals the slot's
+  // completion event.
+  // @param slot_index the index of the slot to service.
+  // @pre The slot is in the kSlotServiceOwned state.
+  void ProcessSlot(size_t slot_index);
+
+  // The session this channel belongs to. The session owns this object, so
+  // the raw pointer cannot go stale.
+  Session* const session_;
+
+  // The shared-memory mapping backing the channel, and its mapped view.
+  base::win::ScopedHandle mapping_handle_;
+  CallTraceBufferChannel* channel_;
+
+  // The doorbell event the client signals after posting a command, and the
+  // per-slot events signalled as commands complete. These are the service
+  // side handles; the client-side values live in client_doorbell_handle_
+  // and in the slots themselves.
+  base::win::ScopedHandle doorbell_event_;
+  base::win::ScopedHandle done_events_[CallTraceBufferChannel::kNumSlots];
+
+  // The handle values duplicated into the client process.
+  uint32 client_channel_handle_;
+  uint32 client_doorbell_handle_;
+
+  // Set to ask the worker thread to exit; checked after each doorbell.
+  volatile LONG shutting_down_;
+
+  // The worker thread servicing the channel.
+  scoped_ptr<base::DelegateSimpleThread> worker_thread_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BufferChannel);
+};
+
+}  // namespace service
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_SERVICE_BUFFER_CHANNEL_H_
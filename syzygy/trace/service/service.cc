@@ -21,6 +21,8 @@
 
 #include "syzygy/trace/service/service.h"
 
+#include <vector>
+
 #include "base/bind.h"
 #include "base/callback.h"
 #include "base/memory/scoped_ptr.h"
@@ -400,6 +402,28 @@ bool Service::RequestShutdown() {
   return true;
 }
 
+bool Service::FlushAllSessions() {
+  VLOG(1) << "Flushing all open call trace sessions.";
+
+  // Snapshot the set of open sessions so that the flushing itself is done
+  // without holding the service lock.
+  std::vector<scoped_refptr<Session>> sessions;
+  {
+    base::AutoLock scoped_lock(lock_);
+    SessionMap::iterator it = sessions_.begin();
+    for (; it != sessions_.end(); ++it)
+      sessions.push_back(it->second);
+  }
+
+  bool success = true;
+  for (size_t i = 0; i < sessions.size(); ++i) {
+    if (!sessions[i]->Flush())
+      success = false;
+  }
+
+  return success;
+}
+
 // RPC entry point.
 bool Service::CreateSession(handle_t binding,
                             SessionHandle* session_handle,
@@ -552,6 +576,71 @@ bool Service::CommitAndExchangeBuffer(SessionHandle session_handle,
   return result;
 }
 
+// RPC entry point.
+bool Service::ReturnBuffers(SessionHandle session_handle,
+                            unsigned long num_buffers,
+                            CallTraceBuffer* call_trace_buffers) {
+  if (session_handle == NULL || call_trace_buffers == NULL ||
+      num_buffers == 0) {
+    LOG(WARNING) << "Invalid RPC parameters.";
+    return false;
+  }
+
+  scoped_refptr<Session> session;
+  if (!GetExistingSession(session_handle, &session))
+    return false;
+  DCHECK(session.get() != NULL);
+
+  // Resolve all of the buffers up front, so that an invalid entry is
+  // detected before any part of the batch has been committed.
+  std::vector<Buffer*> buffers(num_buffers);
+  for (size_t i = 0; i < num_buffers; ++i) {
+    if (!session->FindBuffer(&call_trace_buffers[i], &buffers[i]))
+      return false;
+    DCHECK(buffers[i] != NULL);
+  }
+
+  // Return the whole batch to the session in one shot. The session transitions
+  // the batch under a single acquisition of its lock before scheduling the
+  // buffers for writing.
+  if (!session->ReturnBuffers(&buffers[0], buffers.size())) {
+    LOG(ERROR) << "Unable to return buffers to session.";
+    return false;
+  }
+
+  ZeroMemory(call_trace_buffers, num_buffers * sizeof(call_trace_buffers[0]));
+
+  return true;
+}
+
+// RPC entry point.
+bool Service::GetBufferChannel(SessionHandle session_handle,
+                               unsigned long* channel_handle,
+                               unsigned long* doorbell_handle) {
+  if (session_handle == NULL || channel_handle == NULL ||
+      doorbell_handle == NULL) {
+    LOG(WARNING) << "Invalid RPC parameters.";
+    return false;
+  }
+
+  scoped_refptr<Session> session;
+  if (!GetExistingSession(session_handle, &session))
+    return false;
+  DCHECK(session.get() != NULL);
+
+  uint32 client_channel_handle = 0;
+  uint32 client_doorbell_handle = 0;
+  if (!session->GetOrCreateBufferChannel(&client_channel_handle,
+                                         &client_doorbell_handle)) {
+    return false;
+  }
+
+  *channel_handle = client_channel_handle;
+  *doorbell_handle = client_doorbell_handle;
+
+  return true;
+}
+
 // RPC entry-point.
 bool Service::CloseSession(SessionHandle* session_handle) {
   if (session_handle == NULL || *session_handle == NULL) {
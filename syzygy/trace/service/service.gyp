@@ -21,6 +21,8 @@
       'target_name': 'rpc_service_lib',
       'type': 'static_library',
       'sources': [
+        'buffer_channel.cc',
+        'buffer_channel.h',
         'buffer_consumer.h',
         'buffer_pool.cc',
         'buffer_pool.h',
@@ -45,6 +47,7 @@
         '<(src)/base/base.gyp:base',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
+        '<(src)/third_party/zlib/zlib.gyp:zlib',
       ],
     },
     {
@@ -171,6 +171,11 @@ class Service {
   // See call_trace_rpc.idl for further info.
   bool RequestShutdown();
 
+  // RPC implementation of CallTraceControl::Flush(). Flushes every open
+  // session, blocking until all buffers returned to the service so far
+  // have been written out. See call_trace_rpc.idl for further info.
+  bool FlushAllSessions();
+
   // RPC implementation of CallTraceService::CreateSession().
   // See call_trace_rpc.idl for further info.
   bool CreateSession(handle_t binding,
@@ -196,6 +201,18 @@ class Service {
                                CallTraceBuffer* call_trace_buffer,
                                ExchangeFlag perform_exchange);
 
+  // RPC implementation of CallTraceService::ReturnBuffers().
+  // See call_trace_rpc.idl for further info.
+  bool ReturnBuffers(SessionHandle session_handle,
+                     unsigned long num_buffers,
+                     CallTraceBuffer* call_trace_buffers);
+
+  // RPC implementation of CallTraceService::GetBufferChannel().
+  // See call_trace_rpc.idl for further info.
+  bool GetBufferChannel(SessionHandle session_handle,
+                        unsigned long* channel_handle,
+                        unsigned long* doorbell_handle);
+
   // RPC implementation of CallTraceService::CloseSession().
   // See call_trace_rpc.idl for further info.
   bool CloseSession(SessionHandle* session_handle);
@@ -28,7 +28,6 @@
 #include "base/strings/string_piece.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
-#include "base/threading/thread.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/rpc/helpers.h"
 #include "syzygy/trace/common/service_util.h"
@@ -80,6 +79,10 @@ const char kUsage[] =
     "                     for it to be ready, and returns. The call trace\n"
     "                     service continues running in the background.\n"
     "  stop               Stop the call trace service.\n"
+    "  flush              Flush all open sessions of a running call trace\n"
+    "                     service, capturing a snapshot of the trace data\n"
+    "                     collected so far without stopping the service or\n"
+    "                     the processes being traced.\n"
     "\n"
     "Options:\n"
     "  --help             Show this help message.\n"
@@ -89,6 +92,13 @@ const char kUsage[] =
     "                     The number of buffers by which to grow the buffer\n"
     "                     pool each time the client exhausts its available\n"
     "                     buffer space.\n"
+    "  --writer-threads=NUM\n"
+    "                     The number of trace file writer threads to run.\n"
+    "                     Sessions are distributed across the pool, so that\n"
+    "                     one busy client does not delay the others. Use 0\n"
+    "                     to run one writer thread per CPU. Defaults to 1.\n"
+    "  --compress         Compress each segment of the trace files as they\n"
+    "                     are written (off by default).\n"
     "  --enable-exits     Enable exit tracing (off by default).\n"
     "  --verbose          Increase the logging verbosity to also include\n"
     "                     debug-level information.\n"
@@ -158,15 +168,24 @@ bool RunService(const CommandLine* cmd_line,
   DCHECK(cmd_line != NULL);
   DCHECK(app_cmd_line != NULL);
 
-  base::Thread writer_thread("trace-file-writer");
-  if (!writer_thread.StartWithOptions(
-          base::Thread::Options(base::MessageLoop::TYPE_IO, 0))) {
-    LOG(ERROR) << "Failed to start call trace service writer thread.";
-    return 1;
+  // Setup the writer thread pool. By default a single writer thread is used;
+  // under heavy multi-process loads more threads keep one busy client from
+  // starving the others' buffer recycling.
+  size_t num_writer_threads = 1;
+  std::wstring writer_threads_str(
+      cmd_line->GetSwitchValueNative("writer-threads"));
+  if (!writer_threads_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(writer_threads_str, &num) || num < 0) {
+      LOG(ERROR) << "Invalid number of writer threads.";
+      return false;
+    }
+    // Zero requests one writer thread per CPU.
+    num_writer_threads = num;
   }
 
-  base::MessageLoop* message_loop = writer_thread.message_loop();
-  SessionTraceFileWriterFactory session_trace_file_writer_factory(message_loop);
+  SessionTraceFileWriterFactory session_trace_file_writer_factory(
+      num_writer_threads);
   Service call_trace_service(&session_trace_file_writer_factory);
   RpcServiceInstanceManager rpc_instance(&call_trace_service);
 
@@ -187,6 +206,9 @@ bool RunService(const CommandLine* cmd_line,
   if (!session_trace_file_writer_factory.SetTraceFileDirectory(trace_directory))
     return false;
 
+  if (cmd_line->HasSwitch("compress"))
+    session_trace_file_writer_factory.set_compress_segments(true);
+
   // Setup the buffer size.
   std::wstring buffer_size_str(cmd_line->GetSwitchValueNative("buffer-size"));
   if (!buffer_size_str.empty()) {
@@ -336,6 +358,31 @@ bool StopService(const base::StringPiece16& instance_id) {
   return true;
 }
 
+bool FlushService(const base::StringPiece16& instance_id) {
+  std::wstring protocol;
+  std::wstring endpoint;
+
+  ::GetSyzygyCallTraceRpcProtocol(&protocol);
+  ::GetSyzygyCallTraceRpcEndpoint(instance_id, &endpoint);
+
+  LOG(INFO) << "Flushing call trace logging service instance at '"
+            << endpoint << "' via " << protocol << '.';
+
+  handle_t binding = NULL;
+  if (!CreateRpcBinding(protocol, endpoint, &binding)) {
+    LOG(ERROR) << "Failed to connect to call trace logging service.";
+    return false;
+  }
+
+  if (!InvokeRpc(CallTraceClient_Flush, binding).succeeded()) {
+    LOG(ERROR) << "Failed to flush call trace logging service.";
+    return false;
+  }
+
+  LOG(INFO) << "Call trace service sessions have been flushed.";
+  return true;
+}
+
 extern "C" int main(int argc, char** argv) {
   base::AtExitManager at_exit_manager;
   CommandLine::Init(argc, argv);
@@ -379,6 +426,11 @@ extern "C" int main(int argc, char** argv) {
     return (GetInstanceId(cmd_line, &id) && StopService(id)) ? 0 : 1;
   }
 
+  if (LowerCaseEqualsASCII(cmd_line->GetArgs()[0], "flush")) {
+    std::wstring id;
+    return (GetInstanceId(cmd_line, &id) && FlushService(id)) ? 0 : 1;
+  }
+
   if (LowerCaseEqualsASCII(cmd_line->GetArgs()[0], "start")) {
     return RunService(cmd_line, &app_command_line) ? 0 : 1;
   }
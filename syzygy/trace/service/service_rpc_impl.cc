@@ -76,6 +76,28 @@ boolean CallTraceService_ReturnBuffer(
                                            Service::DO_NOT_PERFORM_EXCHANGE);
 }
 
+// RPC entrypoint for CallTraceService::ReturnBuffers().
+boolean CallTraceService_ReturnBuffers(
+    /* [in] */ SessionHandle session_handle,
+    /* [in] */ unsigned long num_buffers,
+    /* [out][in][size_is(num_buffers)] */ CallTraceBuffer* call_trace_buffers) {
+  Service* instance = RpcServiceInstanceManager::GetInstance();
+  return instance->ReturnBuffers(session_handle,
+                                 num_buffers,
+                                 call_trace_buffers);
+}
+
+// RPC entrypoint for CallTraceService::GetBufferChannel().
+boolean CallTraceService_GetBufferChannel(
+    /* [in] */ SessionHandle session_handle,
+    /* [out] */ unsigned long* channel_handle,
+    /* [out] */ unsigned long* doorbell_handle) {
+  Service* instance = RpcServiceInstanceManager::GetInstance();
+  return instance->GetBufferChannel(session_handle,
+                                    channel_handle,
+                                    doorbell_handle);
+}
+
 // RPC entrypoint for CallTraceService::CloseSession().
 boolean CallTraceService_CloseSession(
     /* [out][in] */ SessionHandle* session_handle) {
@@ -90,6 +112,12 @@ boolean CallTraceService_Stop(/* [in] */ handle_t /* binding */) {
   return instance->RequestShutdown();
 }
 
+// RPC entrypoint for CallTraceControl::Flush().
+boolean CallTraceService_Flush(/* [in] */ handle_t /* binding */) {
+  Service* instance = RpcServiceInstanceManager::GetInstance();
+  return instance->FlushAllSessions();
+}
+
 // This callback is invoked if the RPC mechanism detects that a client
 // has ceased to exist, but the service still has resources allocated
 // on the client's behalf.
@@ -17,6 +17,8 @@
 #include <psapi.h>
 #include <userenv.h>
 
+#include <vector>
+
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/file_util.h"
@@ -36,6 +38,7 @@
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/parse/parse_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/rpc/buffer_channel.h"
 #include "syzygy/trace/service/service_rpc_impl.h"
 #include "syzygy/trace/service/session_trace_file_writer_factory.h"
 
@@ -101,7 +104,10 @@ class CallTraceServiceTest : public testing::Test {
         session_trace_file_writer_factory_(consumer_thread_.message_loop()),
         call_trace_service_(&session_trace_file_writer_factory_),
         rpc_service_instance_manager_(&call_trace_service_),
-        client_rpc_binding_(NULL) {
+        client_rpc_binding_(NULL),
+        channel_(NULL),
+        channel_mapping_(NULL),
+        channel_doorbell_(NULL) {
   }
 
   // Sets up each test invocation.
@@ -133,6 +139,7 @@ class CallTraceServiceTest : public testing::Test {
 
   // Cleans up after each test invocation.
   virtual void TearDown() OVERRIDE {
+    FreeBufferChannel();
     FreeMappings();
 
     if (client_rpc_binding_) {
@@ -271,6 +278,107 @@ class CallTraceServiceTest : public testing::Test {
     segment->header = NULL;
   }
 
+  void ReturnBuffers(SessionHandle session_handle,
+                     TraceFileSegment** segments,
+                     size_t num_segments) {
+    // Gather the buffer descriptions into a contiguous array, as the batched
+    // RPC expects.
+    std::vector<CallTraceBuffer> buffers(num_segments);
+    for (size_t i = 0; i < num_segments; ++i)
+      buffers[i] = segments[i]->buffer_info;
+
+    RpcStatus status = InvokeRpc(CallTraceClient_ReturnBuffers,
+                                 session_handle,
+                                 num_segments,
+                                 &buffers[0]);
+
+    ASSERT_FALSE(status.exception_occurred);
+    ASSERT_TRUE(status.result);
+
+    CallTraceBuffer zeroes;
+    ZeroMemory(&zeroes, sizeof(zeroes));
+    for (size_t i = 0; i < num_segments; ++i) {
+      ASSERT_EQ(0, ::memcmp(&buffers[i], &zeroes, sizeof(zeroes)));
+
+      segments[i]->buffer_info = zeroes;
+      segments[i]->write_ptr = NULL;
+      segments[i]->end_ptr = NULL;
+      segments[i]->header = NULL;
+    }
+  }
+
+  void GetBufferChannel(SessionHandle session_handle) {
+    unsigned long channel_handle = 0;
+    unsigned long doorbell_handle = 0;
+    RpcStatus status = InvokeRpc(CallTraceClient_GetBufferChannel,
+                                 session_handle,
+                                 &channel_handle,
+                                 &doorbell_handle);
+
+    ASSERT_FALSE(status.exception_occurred);
+    ASSERT_TRUE(status.result);
+
+    channel_mapping_ = reinterpret_cast<HANDLE>(channel_handle);
+    channel_doorbell_ = reinterpret_cast<HANDLE>(doorbell_handle);
+    channel_ = reinterpret_cast<CallTraceBufferChannel*>(
+        ::MapViewOfFile(channel_mapping_, FILE_MAP_WRITE, 0, 0,
+                        sizeof(CallTraceBufferChannel)));
+    ASSERT_TRUE(channel_ != NULL);
+  }
+
+  void FreeBufferChannel() {
+    if (channel_ == NULL)
+      return;
+
+    for (size_t i = 0; i < CallTraceBufferChannel::kNumSlots; ++i) {
+      HANDLE done_event =
+          reinterpret_cast<HANDLE>(channel_->slots[i].done_event);
+      if (done_event != NULL)
+        ::CloseHandle(done_event);
+    }
+
+    ::UnmapViewOfFile(channel_);
+    channel_ = NULL;
+    ::CloseHandle(channel_mapping_);
+    channel_mapping_ = NULL;
+    ::CloseHandle(channel_doorbell_);
+    channel_doorbell_ = NULL;
+  }
+
+  // Posts @p command to slot zero of the buffer channel, waits for the
+  // service to complete it and harvests the response, following the slot
+  // hand-off protocol a real client would use.
+  void PostChannelCommand(uint32 command, TraceFileSegment* segment) {
+    ASSERT_TRUE(channel_ != NULL);
+    ASSERT_EQ(0, static_cast<LONG>(channel_->closed));
+
+    CallTraceBufferChannelSlot* slot = &channel_->slots[0];
+    ASSERT_EQ(CallTraceBufferChannelSlot::kSlotFree,
+              ::InterlockedCompareExchange(
+                  &slot->state,
+                  CallTraceBufferChannelSlot::kSlotClientOwned,
+                  CallTraceBufferChannelSlot::kSlotFree));
+
+    slot->command = command;
+    slot->result = 0;
+    slot->buffer = segment->buffer_info;
+    HANDLE done_event = reinterpret_cast<HANDLE>(slot->done_event);
+
+    ::InterlockedExchange(&slot->state,
+                          CallTraceBufferChannelSlot::kSlotCommandPending);
+    ASSERT_TRUE(::SetEvent(channel_doorbell_));
+
+    static const DWORD kTimeoutMs = 10 * 1000;
+    ASSERT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(done_event, kTimeoutMs));
+    ASSERT_EQ(CallTraceBufferChannelSlot::kSlotCommandDone,
+              static_cast<LONG>(slot->state));
+    ASSERT_NE(0u, slot->result);
+
+    segment->buffer_info = slot->buffer;
+    ::InterlockedExchange(&slot->state,
+                          CallTraceBufferChannelSlot::kSlotFree);
+  }
+
   void CloseSession(SessionHandle* session_handle) {
     // Free all outstanding mappings associated with this session.
     FreeMappings();
@@ -363,6 +471,11 @@ class CallTraceServiceTest : public testing::Test {
   // trace service.
   typedef std::map<HANDLE, uint8*> BasePtrMap;
   BasePtrMap base_ptr_map_;
+
+  // The session's buffer channel, as returned by GetBufferChannel().
+  CallTraceBufferChannel* channel_;
+  HANDLE channel_mapping_;
+  HANDLE channel_doorbell_;
 };
 
 template<typename T1, typename T2>
@@ -612,6 +725,164 @@ TEST_F(CallTraceServiceTest, Allocate) {
   ASSERT_STREQ(record->message, "Message 1");
 }
 
+TEST_F(CallTraceServiceTest, ReturnBuffersInOneCall) {
+  SessionHandle session_handle = NULL;
+  TraceFileSegment segment1;
+  TraceFileSegment segment2;
+
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  // Simulate some work on the main thread.
+  ASSERT_NO_FATAL_FAILURE(CreateSession(&session_handle, &segment1));
+  segment1.WriteSegmentHeader(session_handle);
+  MyRecordType* record1 = segment1.AllocateTraceRecord<MyRecordType>();
+  base::strlcpy(record1->message, "Message 1", arraysize(record1->message));
+  size_t length1 = segment1.header->segment_length;
+
+  // Simulate some work on a second thread.
+  ASSERT_NO_FATAL_FAILURE(AllocateBuffer(session_handle, &segment2));
+  segment2.WriteSegmentHeader(session_handle);
+  segment2.header->thread_id += 1;
+  MyRecordType* record2 = segment2.AllocateTraceRecord<MyRecordType>();
+  base::strlcpy(record2->message, "Message 2", arraysize(record2->message));
+  size_t length2 = segment2.header->segment_length;
+
+  // Commit both buffers with a single RPC invocation.
+  TraceFileSegment* segments[] = { &segment1, &segment2 };
+  ASSERT_NO_FATAL_FAILURE(
+      ReturnBuffers(session_handle, segments, arraysize(segments)));
+  ASSERT_NO_FATAL_FAILURE(CloseSession(&session_handle));
+
+  // Make sure everything is flushed.
+  ASSERT_TRUE(call_trace_service_.Stop());
+
+  std::string trace_file_contents;
+  ASSERT_NO_FATAL_FAILURE(ReadTraceFile(&trace_file_contents));
+
+  TraceFileHeader* header =
+      reinterpret_cast<TraceFileHeader*>(&trace_file_contents[0]);
+
+  ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
+  ASSERT_EQ(trace_file_contents.length(),
+            RoundedSize(*header) + 3 * header->block_size);
+
+  // The batch is committed in order, so segment 1 comes first.
+  size_t offset = AlignUp(header->header_size, header->block_size);
+  RecordPrefix* prefix =
+      reinterpret_cast<RecordPrefix*>(&trace_file_contents[0] + offset);
+  ASSERT_EQ(prefix->type, TraceFileSegmentHeader::kTypeId);
+  ASSERT_EQ(prefix->size, sizeof(TraceFileSegmentHeader));
+  TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+  ASSERT_EQ(segment_header->segment_length, length1);
+  ASSERT_EQ(segment_header->thread_id, ::GetCurrentThreadId());
+
+  prefix = reinterpret_cast<RecordPrefix*>(segment_header + 1);
+  ASSERT_EQ(prefix->type, MyRecordType::kTypeId);
+  MyRecordType* record = reinterpret_cast<MyRecordType*>(prefix + 1);
+  ASSERT_STREQ(record->message, "Message 1");
+
+  // And segment 2 follows in the next block.
+  offset = AlignUp(RawPtrDiff(record + 1, &trace_file_contents[0]),
+                   header->block_size);
+  prefix = reinterpret_cast<RecordPrefix*>(&trace_file_contents[0] + offset);
+  ASSERT_EQ(prefix->type, TraceFileSegmentHeader::kTypeId);
+  ASSERT_EQ(prefix->size, sizeof(TraceFileSegmentHeader));
+  segment_header = reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+  ASSERT_EQ(segment_header->segment_length, length2);
+  ASSERT_EQ(segment_header->thread_id, 1 + ::GetCurrentThreadId());
+
+  prefix = reinterpret_cast<RecordPrefix*>(segment_header + 1);
+  ASSERT_EQ(prefix->type, MyRecordType::kTypeId);
+  record = reinterpret_cast<MyRecordType*>(prefix + 1);
+  ASSERT_STREQ(record->message, "Message 2");
+}
+
+TEST_F(CallTraceServiceTest, ExchangeBufferViaChannel) {
+  SessionHandle session_handle = NULL;
+  TraceFileSegment segment;
+
+  ASSERT_TRUE(call_trace_service_.Start(true));
+  ASSERT_NO_FATAL_FAILURE(CreateSession(&session_handle, &segment));
+
+  // Fetch and map the session's buffer channel.
+  ASSERT_NO_FATAL_FAILURE(GetBufferChannel(session_handle));
+  ASSERT_EQ(0, static_cast<LONG>(channel_->closed));
+
+  // Write a record, then commit the buffer over the channel, receiving a
+  // fresh one in exchange.
+  segment.WriteSegmentHeader(session_handle);
+  MyRecordType* record1 = segment.AllocateTraceRecord<MyRecordType>();
+  base::strlcpy(record1->message, "Message 1", arraysize(record1->message));
+  size_t length1 = segment.header->segment_length;
+  CallTraceBuffer old_buffer = segment.buffer_info;
+  ASSERT_NO_FATAL_FAILURE(PostChannelCommand(
+      CallTraceBufferChannelSlot::kSlotCommandExchangeBuffer, &segment));
+  ASSERT_NE(0, ::memcmp(&old_buffer, &segment.buffer_info,
+                        sizeof(old_buffer)));
+  MapSegmentBuffer(&segment);
+
+  // Write a second record and release the buffer over the channel.
+  segment.WriteSegmentHeader(session_handle);
+  MyRecordType* record2 = segment.AllocateTraceRecord<MyRecordType>();
+  base::strlcpy(record2->message, "Message 2", arraysize(record2->message));
+  size_t length2 = segment.header->segment_length;
+  ASSERT_NO_FATAL_FAILURE(PostChannelCommand(
+      CallTraceBufferChannelSlot::kSlotCommandReturnBuffer, &segment));
+
+  // A returned buffer comes back zeroed, exactly as it does over RPC.
+  CallTraceBuffer zeroes;
+  ZeroMemory(&zeroes, sizeof(zeroes));
+  ASSERT_EQ(0, ::memcmp(&segment.buffer_info, &zeroes, sizeof(zeroes)));
+
+  ASSERT_NO_FATAL_FAILURE(CloseSession(&session_handle));
+
+  // Make sure everything is flushed.
+  ASSERT_TRUE(call_trace_service_.Stop());
+
+  std::string trace_file_contents;
+  ASSERT_NO_FATAL_FAILURE(ReadTraceFile(&trace_file_contents));
+
+  TraceFileHeader* header =
+      reinterpret_cast<TraceFileHeader*>(&trace_file_contents[0]);
+
+  // We expect the two committed segments plus the process ended event.
+  ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
+  ASSERT_EQ(trace_file_contents.length(),
+            RoundedSize(*header) + 3 * header->block_size);
+
+  // The exchanged segment comes first.
+  size_t offset = AlignUp(header->header_size, header->block_size);
+  RecordPrefix* prefix =
+      reinterpret_cast<RecordPrefix*>(&trace_file_contents[0] + offset);
+  ASSERT_EQ(prefix->type, TraceFileSegmentHeader::kTypeId);
+  ASSERT_EQ(prefix->size, sizeof(TraceFileSegmentHeader));
+  TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+  ASSERT_EQ(segment_header->segment_length, length1);
+  ASSERT_EQ(segment_header->thread_id, ::GetCurrentThreadId());
+
+  prefix = reinterpret_cast<RecordPrefix*>(segment_header + 1);
+  ASSERT_EQ(prefix->type, MyRecordType::kTypeId);
+  MyRecordType* record = reinterpret_cast<MyRecordType*>(prefix + 1);
+  ASSERT_STREQ(record->message, "Message 1");
+
+  // And the returned segment follows in the next block.
+  offset = AlignUp(RawPtrDiff(record + 1, &trace_file_contents[0]),
+                   header->block_size);
+  prefix = reinterpret_cast<RecordPrefix*>(&trace_file_contents[0] + offset);
+  ASSERT_EQ(prefix->type, TraceFileSegmentHeader::kTypeId);
+  ASSERT_EQ(prefix->size, sizeof(TraceFileSegmentHeader));
+  segment_header = reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+  ASSERT_EQ(segment_header->segment_length, length2);
+  ASSERT_EQ(segment_header->thread_id, ::GetCurrentThreadId());
+
+  prefix = reinterpret_cast<RecordPrefix*>(segment_header + 1);
+  ASSERT_EQ(prefix->type, MyRecordType::kTypeId);
+  record = reinterpret_cast<MyRecordType*>(prefix + 1);
+  ASSERT_STREQ(record->message, "Message 2");
+}
+
 TEST_F(CallTraceServiceTest, AllocateLargeBuffer) {
   SessionHandle session_handle = NULL;
   TraceFileSegment segment1;
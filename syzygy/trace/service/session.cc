@@ -34,6 +34,7 @@
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/path_util.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/service/buffer_channel.h"
 #include "syzygy/trace/service/mapped_buffer.h"
 #include "syzygy/trace/service/service.h"
 
@@ -50,12 +51,28 @@ std::ostream& operator << (std::ostream& stream, const Buffer::ID& buffer_id) {
                 << ", buffer_offset=0x" << std::hex << buffer_id.second;
 }
 
+// The length of the window over which the buffer exchange rate is measured.
+const int64 kExchangeRateWindowMs = 1000;
+
+// The number of buffers handed out per window at or above which the session
+// doubles the size of the buffers it allocates, and at or below which it
+// halves them again. The gap between the two keeps sessions hovering around
+// either threshold from resizing on every window.
+const size_t kHighExchangesPerWindow = 64;
+const size_t kLowExchangesPerWindow = 8;
+
+// The maximum factor by which buffer sizes may exceed the size configured
+// in the service.
+const size_t kMaxBufferSizeMultiplier = 8;
+
 }  // namespace
 
 Session::Session(Service* call_trace_service)
     : call_trace_service_(call_trace_service),
       is_closing_(false),
       buffer_consumer_(NULL),
+      buffer_size_multiplier_(1),
+      exchanges_in_window_(0),
       buffer_requests_waiting_for_recycle_(0),
       buffer_is_available_(&lock_),
       buffer_id_(0),
@@ -67,6 +84,13 @@ Session::Session(Service* call_trace_service)
 }
 
 Session::~Session() {
+  // The write queue may have recycled buffers that nobody has asked for
+  // since; bring the bookkeeping up to date before checking it.
+  {
+    base::AutoLock lock(lock_);
+    RecoverRecycledBuffers();
+  }
+
   // We expect all of the buffers to be available, and none of them to be
   // outstanding.
   DCHECK(call_trace_service_ != NULL);
@@ -110,6 +134,15 @@ bool Session::Init(ProcessId client_process_id) {
 }
 
 bool Session::Close() {
+  // Stop the buffer channel (if any) before doing anything else: its worker
+  // thread calls back into this session, and once we start closing there is
+  // nothing left to exchange. Client threads with channel commands still in
+  // flight are released and fail over to the buffer-exchange RPCs, which
+  // fail cleanly against a closing session. Note that this must happen
+  // outside of lock_, as the worker thread acquires it.
+  if (buffer_channel_.get() != NULL)
+    buffer_channel_->Stop();
+
   std::vector<Buffer*> buffers;
   base::AutoLock lock(lock_);
 
@@ -212,6 +245,13 @@ bool Session::ReturnBuffer(Buffer* buffer) {
   DCHECK(buffer != NULL);
   DCHECK(buffer->session == this);
 
+  return ReturnBuffers(&buffer, 1);
+}
+
+bool Session::ReturnBuffers(Buffer* const* buffers, size_t num_buffers) {
+  DCHECK(buffers != NULL);
+  DCHECK_GT(num_buffers, 0u);
+
   {
     base::AutoLock lock(lock_);
 
@@ -220,15 +260,68 @@ bool Session::ReturnBuffer(Buffer* buffer) {
     if (is_closing_)
       return true;
 
-    ChangeBufferState(Buffer::kPendingWrite, buffer);
+    // Transition the entire batch under a single lock acquisition.
+    for (size_t i = 0; i < num_buffers; ++i) {
+      DCHECK(buffers[i] != NULL);
+      DCHECK(buffers[i]->session == this);
+      ChangeBufferState(Buffer::kPendingWrite, buffers[i]);
+    }
+  }
+
+  // Hand the buffers over to the consumer.
+  for (size_t i = 0; i < num_buffers; ++i) {
+    if (!buffer_consumer_->ConsumeBuffer(buffers[i])) {
+      LOG(ERROR) << "Unable to schedule buffer for writing.";
+      return false;
+    }
   }
 
-  // Hand the buffer over to the consumer.
-  if (!buffer_consumer_->ConsumeBuffer(buffer)) {
-    LOG(ERROR) << "Unable to schedule buffer for writing.";
+  return true;
+}
+
+bool Session::Flush() {
+  base::AutoLock lock(lock_);
+
+  // Wait until every buffer that has been returned to this session has been
+  // written out and recycled by the write queue. Buffers still being filled
+  // by client threads are not covered; a flush captures what has been
+  // committed to the service so far.
+  while (true) {
+    RecoverRecycledBuffers();
+    if (buffer_state_counts_[Buffer::kPendingWrite] == 0)
+      break;
+    buffer_is_available_.Wait();
+  }
+
+  return true;
+}
+
+bool Session::GetOrCreateBufferChannel(uint32* client_channel_handle,
+                                       uint32* client_doorbell_handle) {
+  DCHECK(client_channel_handle != NULL);
+  DCHECK(client_doorbell_handle != NULL);
+
+  base::AutoLock lock(lock_);
+
+  // Once we're closing there is nothing left to exchange.
+  if (is_closing_) {
+    LOG(ERROR) << "Session is closing but someone is requesting a buffer "
+               << "channel.";
     return false;
   }
 
+  if (buffer_channel_.get() == NULL) {
+    scoped_ptr<BufferChannel> channel(new BufferChannel(this));
+    if (!channel->Init(client_.process_handle.Get())) {
+      LOG(ERROR) << "Failed to initialize buffer channel.";
+      return false;
+    }
+    buffer_channel_.reset(channel.release());
+  }
+
+  *client_channel_handle = buffer_channel_->client_channel_handle();
+  *client_doorbell_handle = buffer_channel_->client_doorbell_handle();
+
   return true;
 }
 
@@ -249,12 +342,126 @@ bool Session::RecycleBuffer(Buffer* buffer) {
     return true;
   }
 
-  base::AutoLock lock(lock_);
+  // Park the buffer on the recycled list. This deliberately only involves
+  // recycle_lock_ so that the write queue is never stalled behind a buffer
+  // allocation, which can hold lock_ for a relatively long time.
+  {
+    base::AutoLock recycle_lock(recycle_lock_);
+    recycled_buffers_.push_back(buffer);
+  }
 
-  ChangeBufferState(Buffer::kAvailable, buffer);
-  buffers_available_.push_front(buffer);
+  // Wake up anybody waiting for a buffer. The signal has to be raised under
+  // lock_, otherwise it can race with a waiter that has already inspected
+  // the recycled list and is about to go to sleep.
+  base::AutoLock lock(lock_);
   buffer_is_available_.Signal();
 
+  return true;
+}
+
+void Session::UpdateExchangeRate(base::TimeTicks now) {
+  lock_.AssertAcquired();
+
+  ++exchanges_in_window_;
+
+  if (exchange_window_start_.is_null()) {
+    exchange_window_start_ = now;
+    return;
+  }
+
+  base::TimeDelta elapsed = now - exchange_window_start_;
+  if (elapsed < base::TimeDelta::FromMilliseconds(kExchangeRateWindowMs))
+    return;
+
+  // A thread that burns through buffers spends its time exchanging them
+  // rather than tracing, so grant it larger ones. Quiet sessions drop back
+  // down and release whatever idle memory they hold.
+  if (exchanges_in_window_ >= kHighExchangesPerWindow) {
+    if (buffer_size_multiplier_ < kMaxBufferSizeMultiplier)
+      buffer_size_multiplier_ *= 2;
+  } else if (exchanges_in_window_ <= kLowExchangesPerWindow) {
+    if (buffer_size_multiplier_ > 1)
+      buffer_size_multiplier_ /= 2;
+    ReclaimIdleBufferPools();
+  }
+
+  exchange_window_start_ = now;
+  exchanges_in_window_ = 0;
+}
+
+void Session::ReclaimIdleBufferPools() {
+  lock_.AssertAcquired();
+
+  // Bring any buffers parked by the write queue back into circulation, so
+  // that fully idle pools are visible as such.
+  RecoverRecycledBuffers();
+
+  SharedMemoryBufferCollection::iterator it = shared_memory_buffers_.begin();
+  while (it != shared_memory_buffers_.end() &&
+         shared_memory_buffers_.size() > 1) {
+    BufferPool* pool = *it;
+
+    // A pool can only be freed if no client or writer holds any of its
+    // buffers.
+    bool all_available = true;
+    for (Buffer* buf = pool->begin(); buf != pool->end(); ++buf) {
+      if (buf->state != Buffer::kAvailable) {
+        all_available = false;
+        break;
+      }
+    }
+    if (!all_available) {
+      ++it;
+      continue;
+    }
+
+    // Drop the pool's buffers from the bookkeeping.
+    for (Buffer* buf = pool->begin(); buf != pool->end(); ++buf) {
+      CHECK_EQ(1u, buffers_.erase(Buffer::GetID(*buf)));
+      buffer_state_counts_[Buffer::kAvailable]--;
+    }
+
+    // Rebuild the available queue without the pool's buffers.
+    BufferQueue remaining;
+    while (!buffers_available_.empty()) {
+      Buffer* buf = buffers_available_.front();
+      buffers_available_.pop_front();
+      if (buf < pool->begin() || buf >= pool->end())
+        remaining.push_back(buf);
+    }
+    buffers_available_.swap(remaining);
+
+    // Free the pool. Note that the handle previously duplicated into the
+    // client process keeps the client-side mapping valid; only the service's
+    // view of the memory is released here.
+    it = shared_memory_buffers_.erase(it);
+    delete pool;
+  }
+
+  DCHECK(BufferBookkeepingIsConsistent());
+}
+
+size_t Session::adaptive_buffer_size() const {
+  lock_.AssertAcquired();
+  return call_trace_service_->buffer_size_in_bytes() * buffer_size_multiplier_;
+}
+
+void Session::RecoverRecycledBuffers() {
+  lock_.AssertAcquired();
+
+  BufferQueue recycled;
+  {
+    base::AutoLock recycle_lock(recycle_lock_);
+    recycled.swap(recycled_buffers_);
+  }
+
+  while (!recycled.empty()) {
+    Buffer* buffer = recycled.front();
+    recycled.pop_front();
+    ChangeBufferState(Buffer::kAvailable, buffer);
+    buffers_available_.push_front(buffer);
+  }
+
   // If the session is closing and all outstanding buffers have been recycled
   // then it's safe to destroy this session.
   if (is_closing_ && buffer_state_counts_[Buffer::kInUse] == 0 &&
@@ -266,8 +473,6 @@ bool Session::RecycleBuffer(Buffer* buffer) {
     DCHECK_EQ(buffers_available_.size(),
               buffer_state_counts_[Buffer::kAvailable]);
   }
-
-  return true;
 }
 
 void Session::ChangeBufferState(BufferState new_state, Buffer* buffer) {
@@ -441,6 +646,13 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
 
   *out_buffer = NULL;
 
+  // Each hand-out counts towards the exchange rate, which governs the size
+  // of the buffers allocated below.
+  UpdateExchangeRate(base::TimeTicks::Now());
+
+  // Pick up any buffers the write queue has recycled since the last request.
+  RecoverRecycledBuffers();
+
   // If we have too many pending writes, let's wait until one of those has
   // been completed and recycle that buffer. This provides some back-pressure
   // on our allocation mechanism.
@@ -480,12 +692,15 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
       buffer_is_available_.Wait();
       --buffer_requests_waiting_for_recycle_;
     } else {
-      // Otherwise, force an allocation.
+      // Otherwise, force an allocation, at the size warranted by the
+      // session's current exchange rate.
       if (!AllocateBuffers(call_trace_service_->num_incremental_buffers(),
-                           call_trace_service_->buffer_size_in_bytes())) {
+                           adaptive_buffer_size())) {
         return false;
       }
     }
+
+    RecoverRecycledBuffers();
   }
   DCHECK(!buffers_available_.empty());
 
@@ -539,6 +754,11 @@ bool Session::DestroySingletonBuffer(Buffer* buffer) {
   buffer_state_counts_[Buffer::kPendingWrite]--;
   DCHECK(BufferBookkeepingIsConsistent());
 
+  // Wake up any Flush() that may be waiting on the pending-write count to
+  // drain; singleton buffers never pass through the recycled list, so this
+  // is the only notification it would get.
+  buffer_is_available_.Signal();
+
   // Finally, delete the pool. This will clean up the buffer.
   delete pool;
 
@@ -606,6 +826,9 @@ bool Session::CreateProcessEndedEvent(Buffer** buffer) {
   TraceFileSegmentHeader* segment_header =
       reinterpret_cast<TraceFileSegmentHeader*>(segment_prefix + 1);
   segment_header->thread_id = 0;
+  // This segment is synthesized by the service rather than handed over by
+  // the client, so it carries no sequence number.
+  segment_header->sequence_number = 0;
   segment_header->segment_length = sizeof(RecordPrefix);
 
   RecordPrefix* event_prefix =
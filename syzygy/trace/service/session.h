@@ -28,6 +28,7 @@
 #include "base/process/process.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
+#include "base/time/time.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
 #include "syzygy/trace/service/buffer_pool.h"
@@ -36,7 +37,8 @@
 namespace trace {
 namespace service {
 
-// Forward declaration.
+// Forward declarations.
+class BufferChannel;
 class Service;
 
 // Holds all of the data associated with a given client session.
@@ -85,6 +87,34 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // @returns true on success, false otherwise.
   bool ReturnBuffer(Buffer* buffer);
 
+  // Returns a batch of full buffers back to the session in one shot. This is
+  // the group-commit equivalent of ReturnBuffer(): the entire batch is
+  // transitioned to the pending-write state under a single acquisition of the
+  // session lock before the buffers are scheduled for writing.
+  // @param buffers the full buffers to return.
+  // @param num_buffers the number of buffers in @p buffers.
+  // @returns true on success, false otherwise.
+  bool ReturnBuffers(Buffer* const* buffers, size_t num_buffers);
+
+  // Flushes the session, blocking until every buffer that has been returned
+  // to the session has been written out by the write queue. Buffers still
+  // held by client threads are not covered; a flush captures a snapshot of
+  // the trace data committed to the service so far.
+  // @returns true on success, false otherwise.
+  bool Flush();
+
+  // Gets (creating it on first request) the session's shared-memory buffer
+  // channel, returning the channel's handle values as they appear in the
+  // client process. The channel carries ExchangeBuffer/ReturnBuffer commands
+  // without an RPC round trip; see "syzygy/trace/rpc/buffer_channel.h".
+  // @param client_channel_handle receives the client-side handle of the
+  //     channel's shared-memory mapping.
+  // @param client_doorbell_handle receives the client-side handle of the
+  //     channel's doorbell event.
+  // @returns true on success, false otherwise.
+  bool GetOrCreateBufferChannel(uint32* client_channel_handle,
+                                uint32* client_doorbell_handle);
+
   // Returns a buffer to the pool of available buffers to be handed out to
   // clients. This is to be called by the write queue thread after the buffer
   // has been written to disk.
@@ -211,6 +241,34 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // @pre Under lock_.
   bool CreateProcessEndedEvent(Buffer** buffer);
 
+  // Updates the buffer exchange-rate bookkeeping and adapts the size of
+  // subsequently allocated buffers to it. Sessions that exchange buffers at
+  // a high rate are granted progressively larger buffers (up to a cap), as
+  // the exchange itself is their throughput ceiling; quiet sessions drop
+  // back down to the configured size and release any idle pools they hold.
+  // @param now the current time.
+  // @pre Under lock_.
+  void UpdateExchangeRate(base::TimeTicks now);
+
+  // Frees buffer pools whose buffers are all available, keeping at least one
+  // pool so that a subsequent buffer request doesn't immediately reallocate.
+  // This is how memory is reclaimed from sessions that have gone quiet.
+  // @pre Under lock_.
+  void ReclaimIdleBufferPools();
+
+  // @returns the size of the buffers this session currently allocates; the
+  //     configured buffer size scaled by the adaptive multiplier.
+  // @pre Under lock_.
+  size_t adaptive_buffer_size() const;
+
+  // Moves any buffers parked on recycled_buffers_ by the write queue into
+  // buffers_available_, updating their state. This is how recycled buffers
+  // re-enter circulation; the write queue itself only ever touches
+  // recycle_lock_, so that it is never stalled behind a buffer allocation
+  // made while holding lock_.
+  // @pre Under lock_.
+  void RecoverRecycledBuffers();
+
   // Returns true if the buffer book-keeping is self-consistent.
   // @pre Under lock_.
   bool BufferBookkeepingIsConsistent() const;
@@ -240,9 +298,30 @@ class Session : public base::RefCountedThreadSafe<Session> {
   typedef std::deque<Buffer*> BufferQueue;
   BufferQueue buffers_available_;  // Under lock_.
 
+  // Buffers that have been written to disk and recycled by the write queue,
+  // but not yet returned to buffers_available_. These are kept under their
+  // own lock so that RecycleBuffer() never contends with the allocation path,
+  // which can hold lock_ for a long time.
+  BufferQueue recycled_buffers_;  // Under recycle_lock_.
+
+  // This lock protects recycled_buffers_. It is leaf-level: it must never be
+  // held while acquiring lock_, although lock_ may be held while acquiring it
+  // (as RecoverRecycledBuffers() does).
+  base::Lock recycle_lock_;
+
   // Tracks whether this session is in the process of shutting down.
   bool is_closing_;  // Under lock_.
 
+  // The factor by which the size of newly allocated buffers exceeds the
+  // service's configured buffer size. Doubled when the session exchanges
+  // buffers at a high rate, halved again when it goes quiet.
+  size_t buffer_size_multiplier_;  // Under lock_.
+
+  // The number of buffers handed out since the start of the current
+  // measurement window, and when that window started.
+  size_t exchanges_in_window_;  // Under lock_.
+  base::TimeTicks exchange_window_start_;  // Under lock_.
+
   // This is used to count the number of GetNextBuffer requests that are
   // currently applying back-pressure. There can only be as many of them as
   // there are buffers to be recycled until we fall below the back-pressure cap.
@@ -265,6 +344,11 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // follow-on occurrences that we don't want to log.
   bool input_error_already_logged_;  // Under lock_.
 
+  // The shared-memory buffer channel for this session, created on demand by
+  // GetOrCreateBufferChannel(). The channel's worker thread calls back into
+  // this session, so the channel is stopped as the first step of Close().
+  scoped_ptr<BufferChannel> buffer_channel_;  // Created under lock_.
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Session);
 };
@@ -21,6 +21,7 @@
 
 #include "base/bind.h"
 #include "base/file_util.h"
+#include "syzygy/common/align.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/buffer_pool.h"
 #include "syzygy/trace/service/mapped_buffer.h"
@@ -32,7 +33,8 @@ namespace service {
 SessionTraceFileWriter::SessionTraceFileWriter(
     base::MessageLoop* message_loop, const base::FilePath& trace_directory)
     : message_loop_(message_loop),
-      trace_file_path_(trace_directory) {
+      trace_file_path_(trace_directory),
+      flush_posted_(false) {
   DCHECK(message_loop != NULL);
   DCHECK(!trace_directory.empty());
 }
@@ -52,8 +54,11 @@ bool SessionTraceFileWriter::Open(Session* session) {
       session->client_info());
   trace_file_path_ = trace_file_path_.Append(basename);
 
-  // Open the trace file and write the header.
-  if (!writer_.Open(trace_file_path_) ||
+  // Open the trace file for asynchronous writing and write the header. Using
+  // asynchronous writes lets us return buffers to the client as soon as their
+  // contents have been copied, rather than waiting out the disk latency.
+  if (!writer_.Open(trace_file_path_,
+                    TraceFileWriter::kDefaultMaxPendingWrites) ||
       !writer_.WriteHeader(session->client_info())) {
     return false;
   }
@@ -90,25 +95,75 @@ void SessionTraceFileWriter::WriteBuffer(Session* session, Buffer* buffer) {
   DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
   DCHECK_EQ(base::MessageLoop::current(), message_loop_);
 
-  MappedBuffer mapped_buffer(buffer);
-  if (!mapped_buffer.Map())
+  scoped_ptr<MappedBuffer> mapped_buffer(new MappedBuffer(buffer));
+  if (!mapped_buffer->Map())
     return;
 
-  // We deliberately ignore the return status. However, this will log if
-  // anything goes wrong.
-  writer_.WriteRecord(mapped_buffer.data(), buffer->buffer_size);
+  // If the mapped view is sector-aligned the shared-memory buffer may be
+  // queued for disk I/O as is, saving a copy. The mapping is held, and the
+  // buffer kept out of circulation, until the write has retired. We
+  // deliberately ignore the return status; the retirement callback is always
+  // invoked, and the writer will log if anything goes wrong.
+  uint8* data = mapped_buffer->data();
+  if (::common::IsAligned(data, writer_.block_size())) {
+    writer_.WriteRecordNoCopy(
+        data, buffer->buffer_size,
+        base::Bind(&SessionTraceFileWriter::OnBufferWritten,
+                   this,
+                   base::Passed(&mapped_buffer),
+                   scoped_refptr<Session>(session),
+                   base::Unretained(buffer)));
+
+    // Schedule a flush so that the write retires even if no further buffers
+    // arrive. As this goes to the back of the queue it only runs once the
+    // backlog of incoming buffers has drained, preserving the overlap of
+    // disk latency with buffer processing.
+    if (!flush_posted_) {
+      flush_posted_ = true;
+      message_loop_->PostTask(
+          FROM_HERE,
+          base::Bind(&SessionTraceFileWriter::FlushBuffers, this));
+    }
+    return;
+  }
+
+  // Otherwise fall back to the copying path. We deliberately ignore the
+  // return status. However, this will log if anything goes wrong. The writer
+  // copies the record before returning, so it is safe to scribble over the
+  // buffer and recycle it immediately.
+  writer_.WriteRecord(data, buffer->buffer_size);
+
+  OnBufferWritten(mapped_buffer.Pass(), session, buffer);
+}
+
+void SessionTraceFileWriter::OnBufferWritten(
+    scoped_ptr<MappedBuffer> mapped_buffer, Session* session, Buffer* buffer) {
+  DCHECK(mapped_buffer->IsMapped());
+  DCHECK(session != NULL);
+  DCHECK(buffer != NULL);
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
 
   // It's entirely possible for this buffer to be handed out to another client
   // and for the service to be forcibly shutdown before the client has had a
   // chance to even touch the buffer. In that case, we'll end up writing the
   // buffer again. We clear the RecordPrefix and the TraceFileSegmentHeader so
   // that we'll at least see the buffer as empty and write nothing.
-  ::memset(mapped_buffer.data(), 0,
+  ::memset(mapped_buffer->data(), 0,
            sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
 
-  mapped_buffer.Unmap();
+  mapped_buffer->Unmap();
   session->RecycleBuffer(buffer);
 }
 
+void SessionTraceFileWriter::FlushBuffers() {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  flush_posted_ = false;
+
+  // We deliberately ignore the return status; the writer will have logged
+  // any failures, and the retirement callbacks run regardless.
+  writer_.FlushPendingWrites();
+}
+
 }  // namespace service
 }  // namespace trace
@@ -20,6 +20,7 @@
 #define SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_H_
 
 #include "base/files/file_path.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/threading/thread.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
@@ -29,6 +30,7 @@ namespace trace {
 namespace service {
 
 // Forward Declaration.
+class MappedBuffer;
 class Session;
 class SessionTraceFileWriterFactory;
 
@@ -54,10 +56,29 @@ class SessionTraceFileWriter : public BufferConsumer {
   virtual size_t block_size() const OVERRIDE;
   // @}
 
+  // Sets whether the underlying trace file writer compresses the segments it
+  // writes. This must be called before Open.
+  void set_compress_segments(bool compress_segments) {
+    writer_.set_compress_segments(compress_segments);
+  }
+
  protected:
   // Commit a trace buffer to disk. This will be called on message_loop_.
   void WriteBuffer(Session* session, Buffer* buffer);
 
+  // Invoked once a zero-copy write of a trace buffer has retired. Scrubs and
+  // unmaps the buffer and returns it to the session. This will be called on
+  // message_loop_.
+  void OnBufferWritten(scoped_ptr<MappedBuffer> mapped_buffer,
+                       Session* session,
+                       Buffer* buffer);
+
+  // Waits on any in-flight zero-copy writes, retiring their buffers. This is
+  // posted to message_loop_ whenever a zero-copy write is queued, and thus
+  // runs once the backlog of incoming buffers has drained, guaranteeing that
+  // queued buffers are eventually recycled even if no further buffers arrive.
+  void FlushBuffers();
+
   // The message loop on which this trace file writer will do IO.
   base::MessageLoop* const message_loop_;
 
@@ -69,6 +90,10 @@ class SessionTraceFileWriter : public BufferConsumer {
   // This is used for committing actual buffers to disk.
   TraceFileWriter writer_;
 
+  // Indicates whether a FlushBuffers task is already queued on message_loop_.
+  // Only accessed from message_loop_.
+  bool flush_posted_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SessionTraceFileWriter);
 };
@@ -15,7 +15,11 @@
 #include "syzygy/trace/service/session_trace_file_writer_factory.h"
 
 #include "base/file_util.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/message_loop/message_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/threading/thread.h"
 #include "syzygy/trace/service/session_trace_file_writer.h"
 
 namespace trace {
@@ -23,11 +27,32 @@ namespace service {
 
 SessionTraceFileWriterFactory::SessionTraceFileWriterFactory(
     base::MessageLoop* message_loop)
-    : message_loop_(message_loop), trace_file_directory_(L".") {
+    : message_loop_(message_loop),
+      num_writer_threads_(0),
+      next_writer_thread_(0),
+      trace_file_directory_(L"."),
+      compress_segments_(false) {
   DCHECK(message_loop != NULL);
   DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop->type());
 }
 
+SessionTraceFileWriterFactory::SessionTraceFileWriterFactory(
+    size_t num_writer_threads)
+    : message_loop_(NULL),
+      num_writer_threads_(num_writer_threads != 0 ?
+          num_writer_threads :
+          static_cast<size_t>(base::SysInfo::NumberOfProcessors())),
+      next_writer_thread_(0),
+      trace_file_directory_(L"."),
+      compress_segments_(false) {
+  DCHECK_LT(0u, num_writer_threads_);
+}
+
+SessionTraceFileWriterFactory::~SessionTraceFileWriterFactory() {
+  // The writer threads, if any, are stopped and joined on destruction by
+  // the ScopedVector.
+}
+
 bool SessionTraceFileWriterFactory::SetTraceFileDirectory(
     const base::FilePath& path) {
   DCHECK(!path.empty());
@@ -44,10 +69,49 @@ bool SessionTraceFileWriterFactory::SetTraceFileDirectory(
 bool SessionTraceFileWriterFactory::CreateConsumer(
     scoped_refptr<BufferConsumer>* consumer) {
   DCHECK(consumer != NULL);
-  DCHECK(message_loop_ != NULL);
+
+  // Use the externally provided message loop if there is one, otherwise
+  // draw the next loop from the writer thread pool.
+  base::MessageLoop* message_loop = message_loop_;
+  if (message_loop == NULL && !GetNextWriterMessageLoop(&message_loop))
+    return false;
+  DCHECK(message_loop != NULL);
 
   // Allocate a new trace file writer.
-  *consumer = new SessionTraceFileWriter(message_loop_, trace_file_directory_);
+  SessionTraceFileWriter* writer =
+      new SessionTraceFileWriter(message_loop, trace_file_directory_);
+  writer->set_compress_segments(compress_segments_);
+  *consumer = writer;
+  return true;
+}
+
+bool SessionTraceFileWriterFactory::GetNextWriterMessageLoop(
+    base::MessageLoop** message_loop) {
+  DCHECK(message_loop != NULL);
+  DCHECK(message_loop_ == NULL);
+  DCHECK_LT(0u, num_writer_threads_);
+
+  base::AutoLock lock(lock_);
+
+  // Start the writer threads on first use.
+  if (writer_threads_.empty()) {
+    for (size_t i = 0; i < num_writer_threads_; ++i) {
+      scoped_ptr<base::Thread> thread(new base::Thread(
+          base::StringPrintf("trace-file-writer-%d", static_cast<int>(i))));
+      if (!thread->StartWithOptions(
+              base::Thread::Options(base::MessageLoop::TYPE_IO, 0))) {
+        LOG(ERROR) << "Failed to start trace file writer thread " << i << ".";
+        return false;
+      }
+      writer_threads_.push_back(thread.release());
+    }
+  }
+
+  // Hand out the writer threads round-robin so that sessions are spread
+  // evenly across the pool.
+  *message_loop = writer_threads_[next_writer_thread_]->message_loop();
+  next_writer_thread_ = (next_writer_thread_ + 1) % writer_threads_.size();
+  DCHECK(*message_loop != NULL);
   return true;
 }
 
@@ -21,12 +21,16 @@
 #include <set>
 
 #include "base/files/file_path.h"
+#include "base/memory/scoped_vector.h"
 #include "base/synchronization/lock.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
 
-// Forward declaration.
-namespace base { class MessageLoop; }
+// Forward declarations.
+namespace base {
+class MessageLoop;
+class Thread;
+}  // namespace base
 
 namespace trace {
 namespace service {
@@ -44,6 +48,18 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   //     must outlive the factory instance.
   explicit SessionTraceFileWriterFactory(base::MessageLoop* message_loop);
 
+  // Construct a SessionTraceFileWriterFactory instance that owns a pool of
+  // writer threads. SessionTraceFileWriter instances created by this factory
+  // are distributed round-robin across the pool, so that a single busy
+  // session cannot starve the others of buffer recycling.
+  // @param num_writer_threads The number of writer threads to run. Use zero
+  //     to run one writer thread per logical CPU. The threads are started
+  //     lazily, when the first consumer is created.
+  explicit SessionTraceFileWriterFactory(size_t num_writer_threads);
+
+  // Tears down this factory, stopping any writer threads it owns.
+  virtual ~SessionTraceFileWriterFactory();
+
   // @name BufferConsumerFactory implementation.
   // @{
   virtual bool CreateConsumer(scoped_refptr<BufferConsumer>* consumer) OVERRIDE;
@@ -53,16 +69,46 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   // file writers will output trace files.
   bool SetTraceFileDirectory(const base::FilePath& path);
 
+  // Sets whether subsequently created trace file writers will compress the
+  // segments they write.
+  void set_compress_segments(bool compress_segments) {
+    compress_segments_ = compress_segments;
+  }
+
   // Get the message loop the trace file writers should use for IO.
   base::MessageLoop* message_loop() { return message_loop_; }
 
  protected:
-  // The message loop the trace file writers should use for IO.
+  // Returns the message loop the next trace file writer should use for IO,
+  // starting the writer thread pool on first use. Only valid when this
+  // factory owns its writer threads.
+  // @param message_loop Receives the message loop to use.
+  // @returns true on success, false if the pool could not be started.
+  bool GetNextWriterMessageLoop(base::MessageLoop** message_loop);
+
+  // The message loop the trace file writers should use for IO. This is NULL
+  // when the factory owns a pool of writer threads.
   base::MessageLoop* const message_loop_;
 
+  // The number of writer threads to run when this factory owns its writer
+  // threads. This is zero when an external message loop is in use.
+  size_t num_writer_threads_;
+
+  // The pool of writer threads across which trace file writers are
+  // distributed. Empty when an external message loop is in use. Protected
+  // by lock_.
+  ScopedVector<base::Thread> writer_threads_;
+
+  // The index of the writer thread to which the next trace file writer will
+  // be assigned. Protected by lock_.
+  size_t next_writer_thread_;
+
   // The directory into which trace file writers will write.
   base::FilePath trace_file_directory_;
 
+  // Indicates whether created trace file writers compress their segments.
+  bool compress_segments_;
+
   // The set of currently active buffer consumer objects. Protected by lock_.
   std::set<scoped_refptr<BufferConsumer>> active_consumers_;
 
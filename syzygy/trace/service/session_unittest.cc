@@ -197,6 +197,38 @@ class TestSession : public Session {
     return buffer_requests_waiting_for_recycle_;
   }
 
+  size_t buffer_size_multiplier() {
+    base::AutoLock lock(lock_);
+    return buffer_size_multiplier_;
+  }
+
+  size_t num_buffer_pools() {
+    base::AutoLock lock(lock_);
+    return shared_memory_buffers_.size();
+  }
+
+  // Feeds the adaptive sizing machinery a complete measurement window with
+  // @p exchanges buffer exchanges in it, without having to wait it out in
+  // real time.
+  void SimulateExchangeWindow(size_t exchanges) {
+    base::AutoLock lock(lock_);
+    base::TimeTicks now = base::TimeTicks::Now();
+    exchange_window_start_ = now - base::TimeDelta::FromSeconds(2);
+    exchanges_in_window_ = exchanges;
+    UpdateExchangeRate(now);
+  }
+
+  // Blocks until the write queue has recycled all pending-write buffers.
+  void WaitUntilNoPendingWrites() {
+    base::AutoLock lock(lock_);
+    for (;;) {
+      RecoverRecycledBuffers();
+      if (buffer_state_counts_[Buffer::kPendingWrite] == 0)
+        return;
+      buffer_is_available_.Wait();
+    }
+  }
+
   virtual void OnWaitingForBufferToBeRecycled() OVERRIDE {
     lock_.AssertAcquired();
     waiting_for_buffer_to_be_recycled_state_ = true;
@@ -381,6 +413,12 @@ void GetNextBuffer(Session* session, Buffer** buffer, bool* result) {
   *result = session->GetNextBuffer(buffer);
 }
 
+void FlushSession(Session* session, bool* result) {
+  DCHECK(session != NULL);
+  DCHECK(result != NULL);
+  *result = session->Flush();
+}
+
 }  // namespace
 
 TEST_F(SessionTest, ReturnBufferWorksAfterSessionClose) {
@@ -412,6 +450,34 @@ TEST_F(SessionTest, ReturnBufferWorksAfterSessionClose) {
   session->AllowBuffersToBeRecycled(9999);
 }
 
+TEST_F(SessionTest, ReturnBuffersGroupCommit) {
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  Buffer* buffers[2] = {};
+  ASSERT_TRUE(session->GetNextBuffer(&buffers[0]));
+  ASSERT_TRUE(buffers[0] != NULL);
+  ASSERT_TRUE(session->GetNextBuffer(&buffers[1]));
+  ASSERT_TRUE(buffers[1] != NULL);
+
+  // Returning the batch should schedule both buffers for writing.
+  ASSERT_TRUE(session->ReturnBuffers(buffers, arraysize(buffers)));
+  ASSERT_EQ(Buffer::kPendingWrite, buffers[0]->state);
+  ASSERT_EQ(Buffer::kPendingWrite, buffers[1]->state);
+
+  // Let's allow the outstanding buffers to be written.
+  session->AllowBuffersToBeRecycled(9999);
+
+  // A recycled buffer must come back into circulation.
+  Buffer* buffer3 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer3));
+  ASSERT_TRUE(buffer3 != NULL);
+  ASSERT_TRUE(session->ReturnBuffer(buffer3));
+  session->AllowBuffersToBeRecycled(9999);
+}
+
 TEST_F(SessionTest, BackPressureWorks) {
   // Configure things so that back-pressure will be easily forced.
   call_trace_service_.set_max_buffers_pending_write(1);
@@ -577,5 +643,92 @@ TEST_F(SessionTest, LargeBufferRequestAvoidsBackPressure) {
   ASSERT_EQ(buffer3, session->last_singleton_buffer_destroyed_);
 }
 
+TEST_F(SessionTest, AdaptiveBufferSizing) {
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+  ASSERT_EQ(1u, session->buffer_size_multiplier());
+
+  // Busy windows double the size of subsequently allocated buffers, up to
+  // the cap.
+  session->SimulateExchangeWindow(100);
+  ASSERT_EQ(2u, session->buffer_size_multiplier());
+  session->SimulateExchangeWindow(100);
+  session->SimulateExchangeWindow(100);
+  session->SimulateExchangeWindow(100);
+  ASSERT_EQ(8u, session->buffer_size_multiplier());
+
+  // The first allocation happens at the scaled size.
+  Buffer* buffer1 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer1));
+  ASSERT_TRUE(buffer1 != NULL);
+  ASSERT_EQ(8u * 8192, buffer1->buffer_size);
+  ASSERT_EQ(1u, session->num_buffer_pools());
+
+  // Drain the first pool and force a second one into existence.
+  Buffer* buffer2 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer2));
+  Buffer* buffer3 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer3));
+  ASSERT_EQ(2u, session->num_buffer_pools());
+
+  // Return everything and let it all be written and recycled.
+  ASSERT_TRUE(session->ReturnBuffer(buffer1));
+  ASSERT_TRUE(session->ReturnBuffer(buffer2));
+  ASSERT_TRUE(session->ReturnBuffer(buffer3));
+  session->AllowBuffersToBeRecycled(9999);
+  session->WaitUntilNoPendingWrites();
+
+  // A quiet window halves the multiplier and reclaims idle pools, always
+  // keeping one pool around.
+  session->SimulateExchangeWindow(0);
+  ASSERT_EQ(4u, session->buffer_size_multiplier());
+  ASSERT_EQ(1u, session->num_buffer_pools());
+
+  // The session keeps working with the remaining pool.
+  Buffer* buffer4 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer4));
+  ASSERT_TRUE(buffer4 != NULL);
+  ASSERT_TRUE(session->ReturnBuffer(buffer4));
+  session->AllowBuffersToBeRecycled(9999);
+}
+
+TEST_F(SessionTest, FlushWaitsForPendingWrites) {
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  // A flush with nothing outstanding returns immediately.
+  ASSERT_TRUE(session->Flush());
+
+  // Return a buffer; it becomes pending write but is not consumed until we
+  // allow it to be.
+  Buffer* buffer1 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer1));
+  ASSERT_TRUE(buffer1 != NULL);
+  ASSERT_TRUE(session->ReturnBuffer(buffer1));
+  ASSERT_EQ(Buffer::kPendingWrite, buffer1->state);
+
+  // Start a flush on a worker thread; it must block on the pending write.
+  bool result = false;
+  base::Closure flusher = base::Bind(&FlushSession, session, &result);
+  worker1_.message_loop()->PostTask(FROM_HERE, flusher);
+
+  // Let the outstanding buffer be written, then wait for the flusher to
+  // complete.
+  session->AllowBuffersToBeRecycled(9999);
+  worker1_.Stop();
+  ASSERT_TRUE(result);
+
+  // The flushed buffer has been recycled and is available again.
+  Buffer* buffer2 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer2));
+  ASSERT_TRUE(buffer2 != NULL);
+  ASSERT_TRUE(session->ReturnBuffer(buffer2));
+  session->AllowBuffersToBeRecycled(9999);
+}
+
 }  // namespace service
 }  // namespace trace
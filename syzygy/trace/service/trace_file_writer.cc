@@ -21,7 +21,9 @@
 #include "syzygy/common/buffer_writer.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/path_util.h"
+#include "syzygy/trace/common/clock.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
+#include "third_party/zlib/zlib.h"
 
 namespace trace {
 namespace service {
@@ -29,10 +31,15 @@ namespace service {
 namespace {
 
 bool OpenTraceFile(const base::FilePath& file_path,
+                   bool overlapped,
                    base::win::ScopedHandle* file_handle) {
   DCHECK(!file_path.empty());
   DCHECK(file_handle != NULL);
 
+  DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING;
+  if (overlapped)
+    flags |= FILE_FLAG_OVERLAPPED;
+
   // Create a new trace file.
   base::win::ScopedHandle new_file_handle(
       ::CreateFile(file_path.value().c_str(),
@@ -40,7 +47,7 @@ bool OpenTraceFile(const base::FilePath& file_path,
                    FILE_SHARE_DELETE | FILE_SHARE_READ,
                    NULL, /* lpSecurityAttributes */
                    CREATE_ALWAYS,
-                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING,
+                   flags,
                    NULL /* hTemplateFile */));
   if (!new_file_handle.IsValid()) {
     DWORD error = ::GetLastError();
@@ -54,6 +61,34 @@ bool OpenTraceFile(const base::FilePath& file_path,
   return true;
 }
 
+// Attempts to enable the manage-volume privilege on the process token, which
+// SetFileValidData requires. This typically only succeeds for elevated
+// processes; the caller falls back gracefully when it does not.
+bool EnableManageVolumePrivilege() {
+  HANDLE token = NULL;
+  if (!::OpenProcessToken(::GetCurrentProcess(),
+                          TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY,
+                          &token)) {
+    return false;
+  }
+
+  TOKEN_PRIVILEGES privileges = {};
+  privileges.PrivilegeCount = 1;
+  privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+  bool success = ::LookupPrivilegeValue(
+      NULL, SE_MANAGE_VOLUME_NAME, &privileges.Privileges[0].Luid) != FALSE;
+  if (success) {
+    // AdjustTokenPrivileges returns success even if the privilege was not
+    // granted; the last error distinguishes the two.
+    success = ::AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL,
+                                      NULL) != FALSE &&
+        ::GetLastError() == ERROR_SUCCESS;
+  }
+
+  ::CloseHandle(token);
+  return success;
+}
+
 bool GetBlockSize(const base::FilePath& path, size_t* block_size) {
   wchar_t volume[MAX_PATH];
 
@@ -83,10 +118,23 @@ bool GetBlockSize(const base::FilePath& path, size_t* block_size) {
 
 }  // namespace
 
-TraceFileWriter::TraceFileWriter() : block_size_(0) {
+TraceFileWriter::TraceFileWriter()
+    : block_size_(0),
+      next_offset_(0),
+      growth_chunk_size_(kDefaultGrowthChunkSize),
+      allocated_length_(0),
+      set_valid_data_(false),
+      compress_segments_(false),
+      max_sequence_number_(0),
+      sequenced_segment_count_(0),
+      next_pending_write_(0) {
+  ::memset(event_type_counts_, 0, sizeof(event_type_counts_));
 }
 
 TraceFileWriter::~TraceFileWriter() {
+  if (handle_.IsValid())
+    FlushPendingWrites();
+  ReleasePendingWrites();
 }
 
 base::FilePath TraceFileWriter::GenerateTraceFileBaseName(
@@ -112,9 +160,14 @@ base::FilePath TraceFileWriter::GenerateTraceFileBaseName(
 }
 
 bool TraceFileWriter::Open(const base::FilePath& path) {
+  return Open(path, 0);
+}
+
+bool TraceFileWriter::Open(const base::FilePath& path,
+                           size_t max_pending_writes) {
   // Open the trace file.
   base::win::ScopedHandle temp_handle;
-  if (!OpenTraceFile(path, &temp_handle)) {
+  if (!OpenTraceFile(path, max_pending_writes > 0, &temp_handle)) {
     LOG(ERROR) << "Failed to open trace file: '"
                << path_.value() << "'.";
     return false;
@@ -127,9 +180,38 @@ bool TraceFileWriter::Open(const base::FilePath& path) {
     return false;
   }
 
+  // Set up the ring of asynchronous write slots. The buffers themselves are
+  // allocated lazily, as the record size isn't known yet.
+  std::vector<PendingWrite> pending_writes(max_pending_writes);
+  for (size_t i = 0; i < pending_writes.size(); ++i) {
+    ::memset(&pending_writes[i].overlapped, 0,
+             sizeof(pending_writes[i].overlapped));
+    pending_writes[i].data = NULL;
+    pending_writes[i].capacity = 0;
+    pending_writes[i].length = 0;
+    pending_writes[i].pending = false;
+    pending_writes[i].overlapped.hEvent =
+        ::CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (pending_writes[i].overlapped.hEvent == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to create event: " << ::common::LogWe(error)
+                 << ".";
+      for (size_t j = 0; j < i; ++j)
+        ::CloseHandle(pending_writes[j].overlapped.hEvent);
+      return false;
+    }
+  }
+
   path_ = path;
   handle_.Set(temp_handle.Take());
   block_size_ = block_size;
+  next_offset_ = 0;
+  allocated_length_ = 0;
+  set_valid_data_ = EnableManageVolumePrivilege();
+  pending_writes_.swap(pending_writes);
+  next_pending_write_ = 0;
+  index_entries_.clear();
+  ::memset(event_type_counts_, 0, sizeof(event_type_counts_));
 
   return true;
 }
@@ -181,20 +263,319 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
   writer.Align(block_size_);
 
   // Commit the header page to disk.
-  DWORD bytes_written = 0;
-  if (!::WriteFile(handle_.Get(), &buffer[0], buffer.size(), &bytes_written,
-                   NULL) || bytes_written != buffer.size() ) {
+  if (!WriteData(&buffer[0], buffer.size())) {
+    LOG(ERROR) << "Failed writing trace file header.";
+    return false;
+  }
+
+  return true;
+}
+
+bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
+  DCHECK(data != NULL);
+
+  size_t bytes_to_write = 0;
+  if (!ParseRecord(data, length, &bytes_to_write))
+    return false;
+
+  // If the segment itself is empty we simply skip writing the buffer.
+  if (bytes_to_write == 0) {
+    LOG(INFO) << "Not writing empty buffer.";
+    return true;
+  }
+
+  // Deflate the record if segment compression is enabled and it pays for
+  // itself; otherwise fall through and write the record raw.
+  const void* raw_data = data;
+  if (compress_segments_ && CompressRecord(data, bytes_to_write)) {
+    data = &compressed_record_[0];
+    bytes_to_write = compressed_record_.size();
+  }
+
+  // Account for the record in the index footer. The index is built from the
+  // raw record, but describes the on-disk length of the write.
+  IndexSegment(raw_data, bytes_to_write);
+
+  // Commit the buffer to disk. In asynchronous mode the record is copied and
+  // the write is queued, overlapping the disk latency with the caller's
+  // progress; otherwise the write completes before returning.
+  if (!pending_writes_.empty())
+    return WriteDataAsync(data, bytes_to_write);
+
+  if (!WriteData(data, bytes_to_write)) {
+    LOG(ERROR) << "Failed writing to '" << path_.value() << "'.";
+    return false;
+  }
+
+  return true;
+}
+
+bool TraceFileWriter::WriteRecordNoCopy(const void* data,
+                                        size_t length,
+                                        const base::Closure& on_retired) {
+  DCHECK(data != NULL);
+  DCHECK(!on_retired.is_null());
+  DCHECK(!pending_writes_.empty());
+  DCHECK(::common::IsAligned(data, block_size_));
+
+  // Compression requires a copy anyway, so route the record through the
+  // copying path and return the caller's buffer right away.
+  if (compress_segments_) {
+    bool success = WriteRecord(data, length);
+    on_retired.Run();
+    return success;
+  }
+
+  // However the record is disposed of, the caller gets its buffer back.
+  size_t bytes_to_write = 0;
+  if (!ParseRecord(data, length, &bytes_to_write)) {
+    on_retired.Run();
+    return false;
+  }
+
+  // If the segment itself is empty we simply skip writing the buffer.
+  if (bytes_to_write == 0) {
+    LOG(INFO) << "Not writing empty buffer.";
+    on_retired.Run();
+    return true;
+  }
+
+  IndexSegment(data, bytes_to_write);
+  return WriteDataNoCopyAsync(data, bytes_to_write, on_retired);
+}
+
+bool TraceFileWriter::Close() {
+  bool success = FlushPendingWrites();
+
+  // Report segments that were sequenced by the client but never made it to
+  // the service. This typically means the client died with buffers in
+  // flight; the lost segments may be salvageable from a crash dump of the
+  // client process.
+  size_t missing = missing_sequence_count();
+  if (missing != 0) {
+    LOG(WARNING) << "Trace file '" << path_.value() << "' is missing "
+                 << missing << " segment(s) of " << max_sequence_number_
+                 << " committed by the client.";
+  }
+
+  // Append the index footer. If any write failed the index would not
+  // faithfully describe the file, so it is omitted and readers will fall
+  // back to a sequential scan.
+  if (success && !WriteIndexFooter()) {
+    LOG(ERROR) << "Failed writing index footer to '" << path_.value() << "'.";
+    success = false;
+  }
+  ReleasePendingWrites();
+
+  // Trim the unused tail of the last preallocated chunk, so the file ends
+  // at the last byte written. This also keeps the footer-offset trailer in
+  // the last eight bytes of the file, where readers look for it.
+  if (allocated_length_ > next_offset_) {
+    LARGE_INTEGER end_position = {};
+    end_position.QuadPart = next_offset_;
+    if (!::SetFilePointerEx(handle_.Get(), end_position, NULL, FILE_BEGIN) ||
+        !::SetEndOfFile(handle_.Get())) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to trim trace file '" << path_.value()
+                 << "': " << ::common::LogWe(error) << ".";
+      success = false;
+    }
+  }
+
+  if (::CloseHandle(handle_.Take()) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CloseHandle failed: " << ::common::LogWe(error) << ".";
+    return false;
+  }
+  return success;
+}
+
+void TraceFileWriter::IndexSegment(const void* data, size_t bytes_to_write) {
+  DCHECK(data != NULL);
+  DCHECK_LT(0u, bytes_to_write);
+
+  // The record has already been validated by ParseRecord.
+  const RecordPrefix* record = reinterpret_cast<const RecordPrefix*>(data);
+  const TraceFileSegmentHeader* segment =
+      reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
+
+  TraceIndexEntry entry = {};
+  entry.offset = next_offset_;
+  entry.length = static_cast<uint32>(bytes_to_write);
+  entry.thread_id = segment->thread_id;
+  index_entries_.push_back(entry);
+
+  // Account for the segment's sequence number. Clients sequence the
+  // segments they commit with a dense set of numbers starting at 1, so if
+  // fewer distinct sequence numbers than the maximum have been seen at
+  // close, segments were lost in flight. Unsequenced segments (sequence
+  // number 0) are exempt.
+  if (segment->sequence_number != 0) {
+    ++sequenced_segment_count_;
+    if (segment->sequence_number > max_sequence_number_)
+      max_sequence_number_ = segment->sequence_number;
+  }
+
+  // Tally the events in the segment. A truncated trailing record is ignored,
+  // as readers will do the same when consuming the segment.
+  const uint8* read_ptr = reinterpret_cast<const uint8*>(segment + 1);
+  const uint8* end_ptr = read_ptr + segment->segment_length;
+  while (read_ptr + sizeof(RecordPrefix) <= end_ptr) {
+    const RecordPrefix* prefix =
+        reinterpret_cast<const RecordPrefix*>(read_ptr);
+    read_ptr += sizeof(RecordPrefix) + prefix->size;
+    if (read_ptr > end_ptr)
+      break;
+    if (prefix->type < TraceIndexFooter::kNumEventTypeCounts)
+      ++event_type_counts_[prefix->type];
+  }
+}
+
+bool TraceFileWriter::WriteIndexFooter() {
+  // The index describes the segment records preceding it, and is in turn
+  // discoverable via the file offset of its prefix, which is stored in the
+  // last eight bytes of the file.
+  size_t entries_length = index_entries_.size() * sizeof(TraceIndexEntry);
+  size_t footer_length =
+      sizeof(RecordPrefix) + sizeof(TraceIndexFooter) + entries_length;
+  size_t total_length =
+      ::common::AlignUp(footer_length + sizeof(uint64), block_size_);
+  std::vector<uint8> buffer(total_length, 0);
+
+  RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(&buffer[0]);
+  prefix->timestamp = trace::common::GetTsc();
+  prefix->size = footer_length - sizeof(RecordPrefix);
+  prefix->type = TraceIndexFooter::kTypeId;
+  prefix->version.hi = TRACE_VERSION_HI;
+  prefix->version.lo = TRACE_VERSION_LO;
+
+  TraceIndexFooter* footer = reinterpret_cast<TraceIndexFooter*>(prefix + 1);
+  footer->num_entries = index_entries_.size();
+  ::memcpy(footer->event_type_counts, event_type_counts_,
+           sizeof(footer->event_type_counts));
+  if (entries_length != 0) {
+    ::memcpy(footer + 1, &index_entries_[0], entries_length);
+  }
+
+  uint64* footer_offset =
+      reinterpret_cast<uint64*>(&buffer[0] + total_length - sizeof(uint64));
+  *footer_offset = next_offset_;
+
+  return WriteData(&buffer[0], total_length);
+}
+
+bool TraceFileWriter::CompressRecord(const void* data, size_t max_length) {
+  DCHECK(data != NULL);
+
+  // Determine the extent of the meaningful data in the record: the headers
+  // plus the segment payload. The trailing alignment padding need not be
+  // compressed. The record has already been validated by ParseRecord.
+  const RecordPrefix* record = reinterpret_cast<const RecordPrefix*>(data);
+  const TraceFileSegmentHeader* segment =
+      reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
+  size_t raw_length = sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) +
+      segment->segment_length;
+  if (raw_length > max_length)
+    raw_length = max_length;
+
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceCompressedSegmentHeader);
+  uLongf compressed_length = ::compressBound(raw_length);
+  compressed_record_.resize(kHeaderLength + compressed_length);
+  if (::compress2(&compressed_record_[kHeaderLength], &compressed_length,
+                  reinterpret_cast<const Bytef*>(data), raw_length,
+                  Z_BEST_SPEED) != Z_OK) {
+    LOG(WARNING) << "Failed to compress record; writing it raw.";
+    return false;
+  }
+
+  // Only use the compressed form if it actually saves disk blocks.
+  size_t total_length = ::common::AlignUp(kHeaderLength + compressed_length,
+                                          block_size_);
+  if (total_length >= max_length)
+    return false;
+
+  // Trim the scratch buffer to the compressed data and grow it back out to
+  // the block size, zeroing the alignment padding.
+  compressed_record_.resize(kHeaderLength + compressed_length);
+  compressed_record_.resize(total_length);
+
+  // Populate the headers.
+  RecordPrefix* prefix =
+      reinterpret_cast<RecordPrefix*>(&compressed_record_[0]);
+  prefix->timestamp = record->timestamp;
+  prefix->size = sizeof(TraceCompressedSegmentHeader);
+  prefix->type = TraceCompressedSegmentHeader::kTypeId;
+  prefix->version.hi = TRACE_VERSION_HI;
+  prefix->version.lo = TRACE_VERSION_LO;
+  TraceCompressedSegmentHeader* header =
+      reinterpret_cast<TraceCompressedSegmentHeader*>(prefix + 1);
+  header->compressed_length = compressed_length;
+  header->uncompressed_length = raw_length;
+
+  return true;
+}
+
+bool TraceFileWriter::EnsureCapacity(uint64 required_length) {
+  if (growth_chunk_size_ == 0 || required_length <= allocated_length_)
+    return true;
+
+  uint64 new_length = ::common::AlignUp64(required_length,
+                                          growth_chunk_size_);
+
+  // Remember the current file position, as in synchronous mode it tracks
+  // the writes.
+  LARGE_INTEGER zero = {};
+  LARGE_INTEGER old_position = {};
+  if (!::SetFilePointerEx(handle_.Get(), zero, &old_position, FILE_CURRENT)) {
     DWORD error = ::GetLastError();
-    LOG(ERROR) << "Failed writing trace file header: " << ::common::LogWe(error)
+    LOG(ERROR) << "Failed to get file position: " << ::common::LogWe(error)
                << ".";
     return false;
   }
 
+  // Extend the file by a whole chunk, reserving its extents in one go. A
+  // failure here (say, a full disk) disables preallocation; the write
+  // itself is left to succeed or fail on its own.
+  LARGE_INTEGER end_position = {};
+  end_position.QuadPart = new_length;
+  if (!::SetFilePointerEx(handle_.Get(), end_position, NULL, FILE_BEGIN) ||
+      !::SetEndOfFile(handle_.Get())) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to preallocate trace file '" << path_.value()
+                 << "' to " << new_length << " bytes: "
+                 << ::common::LogWe(error) << ". Growing write-by-write.";
+    growth_chunk_size_ = 0;
+    ::SetFilePointerEx(handle_.Get(), old_position, NULL, FILE_BEGIN);
+    return true;
+  }
+
+  // Mark the preallocated region valid so the filesystem need not zero-fill
+  // it ahead of the writes. This requires the manage-volume privilege; when
+  // it is unavailable the zero-filling simply remains.
+  if (set_valid_data_ && !::SetFileValidData(handle_.Get(), new_length)) {
+    DWORD error = ::GetLastError();
+    LOG(INFO) << "SetFileValidData failed: " << ::common::LogWe(error)
+              << ". Trace file preallocation will be zero-filled.";
+    set_valid_data_ = false;
+  }
+
+  if (!::SetFilePointerEx(handle_.Get(), old_position, NULL, FILE_BEGIN)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to restore file position: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  allocated_length_ = new_length;
   return true;
 }
 
-bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
+bool TraceFileWriter::ParseRecord(const void* data,
+                                  size_t length,
+                                  size_t* bytes_to_write) {
   DCHECK(data != NULL);
+  DCHECK(bytes_to_write != NULL);
 
   const size_t kHeaderLength =
       sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
@@ -215,54 +596,234 @@ bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
   }
 
   // Let's not trust the client to stop playing with the buffer while
-  // we're writing. Whatever the length is now, is what we'll use. If the
-  // segment itself is empty we simply skip writing the buffer.
+  // we're writing. Whatever the length is now, is what we'll use.
   const TraceFileSegmentHeader* header =
       reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
   size_t segment_length = header->segment_length;
   if (segment_length == 0) {
-    LOG(INFO) << "Not writing empty buffer.";
+    *bytes_to_write = 0;
     return true;
   }
 
   // Figure out the total size that we'll write to disk.
-  size_t bytes_to_write = ::common::AlignUp(kHeaderLength + segment_length,
-                                            block_size_);
+  *bytes_to_write = ::common::AlignUp(kHeaderLength + segment_length,
+                                      block_size_);
 
   // Ensure that the total number of bytes to write does not exceed the
   // maximum record length.
-  if (bytes_to_write > length) {
+  if (*bytes_to_write > length) {
     LOG(ERROR) << "Dropped buffer: bytes written exceeds buffer size.";
     return false;
   }
 
-  // Commit the buffer to disk.
-  // TODO(rogerm): Use overlapped I/O.
-  DCHECK_LT(0u, bytes_to_write);
+  return true;
+}
+
+bool TraceFileWriter::WriteData(const void* data, size_t length) {
+  DCHECK(data != NULL);
+
+  if (!EnsureCapacity(next_offset_ + length))
+    return false;
+
+  if (pending_writes_.empty()) {
+    // Synchronous mode. The file pointer tracks the writes.
+    DWORD bytes_written = 0;
+    if (!::WriteFile(handle_.Get(), data, length, &bytes_written, NULL) ||
+        bytes_written != length) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed writing data: " << ::common::LogWe(error) << ".";
+      return false;
+    }
+    next_offset_ += length;
+    return true;
+  }
+
+  // Asynchronous mode. The handle requires overlapped I/O, so issue the
+  // write with an explicit offset and wait for it to complete.
+  OVERLAPPED overlapped = {};
+  overlapped.Offset = static_cast<DWORD>(next_offset_);
+  overlapped.OffsetHigh = static_cast<DWORD>(next_offset_ >> 32);
+  overlapped.hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (overlapped.hEvent == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create event: " << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  bool success = true;
+  if (!::WriteFile(handle_.Get(), data, length, NULL, &overlapped) &&
+      ::GetLastError() != ERROR_IO_PENDING) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed writing data: " << ::common::LogWe(error) << ".";
+    success = false;
+  }
+
   DWORD bytes_written = 0;
-  if (!::WriteFile(handle_.Get(),
-                   record,
-                   bytes_to_write,
-                   &bytes_written,
-                   NULL) ||
-      bytes_written != bytes_to_write) {
+  if (success &&
+      (!::GetOverlappedResult(handle_.Get(), &overlapped, &bytes_written,
+                              TRUE) ||
+       bytes_written != length)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed completing write: " << ::common::LogWe(error)
+               << ".";
+    success = false;
+  }
+
+  ::CloseHandle(overlapped.hEvent);
+  if (!success)
+    return false;
+
+  next_offset_ += length;
+  return true;
+}
+
+bool TraceFileWriter::WriteDataAsync(const void* data, size_t length) {
+  DCHECK(data != NULL);
+  DCHECK(!pending_writes_.empty());
+
+  // Wait for the oldest write in the ring to complete before reusing its
+  // slot. If it failed then this record is dropped, but later writes may
+  // still succeed.
+  PendingWrite* pending_write = &pending_writes_[next_pending_write_];
+  if (!CompletePendingWrite(pending_write))
+    return false;
+
+  if (!EnsureCapacity(next_offset_ + length))
+    return false;
+
+  // Grow the slot's buffer if necessary. The buffer must be sector-aligned
+  // as the file is opened with FILE_FLAG_NO_BUFFERING; VirtualAlloc returns
+  // page-aligned memory, which is sufficient.
+  if (pending_write->capacity < length) {
+    if (pending_write->data != NULL)
+      ::VirtualFree(pending_write->data, 0, MEM_RELEASE);
+    pending_write->data = reinterpret_cast<uint8*>(
+        ::VirtualAlloc(NULL, length, MEM_COMMIT | MEM_RESERVE,
+                       PAGE_READWRITE));
+    if (pending_write->data == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to allocate write buffer: "
+                 << ::common::LogWe(error) << ".";
+      pending_write->capacity = 0;
+      return false;
+    }
+    pending_write->capacity = length;
+  }
+
+  // Take a copy of the record so that the caller's buffer may be reused
+  // immediately, and queue the write.
+  ::memcpy(pending_write->data, data, length);
+  pending_write->overlapped.Offset = static_cast<DWORD>(next_offset_);
+  pending_write->overlapped.OffsetHigh = static_cast<DWORD>(next_offset_ >> 32);
+  if (!::WriteFile(handle_.Get(), pending_write->data, length, NULL,
+                   &pending_write->overlapped) &&
+      ::GetLastError() != ERROR_IO_PENDING) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "Failed writing to '" << path_.value()
                << "': " << ::common::LogWe(error) << ".";
     return false;
   }
 
+  pending_write->length = length;
+  pending_write->pending = true;
+  next_offset_ += length;
+  next_pending_write_ = (next_pending_write_ + 1) % pending_writes_.size();
+
   return true;
 }
 
-bool TraceFileWriter::Close() {
-  if (::CloseHandle(handle_.Take()) == 0) {
+bool TraceFileWriter::WriteDataNoCopyAsync(const void* data,
+                                           size_t length,
+                                           const base::Closure& on_retired) {
+  DCHECK(data != NULL);
+  DCHECK(!on_retired.is_null());
+  DCHECK(!pending_writes_.empty());
+
+  // Wait for the oldest write in the ring to complete before reusing its
+  // slot. If it failed then this record is dropped, but later writes may
+  // still succeed.
+  PendingWrite* pending_write = &pending_writes_[next_pending_write_];
+  if (!CompletePendingWrite(pending_write)) {
+    on_retired.Run();
+    return false;
+  }
+
+  if (!EnsureCapacity(next_offset_ + length)) {
+    on_retired.Run();
+    return false;
+  }
+
+  // Queue the write directly from the caller's buffer. The slot's internal
+  // buffer, if any, is left untouched for reuse by copying writes.
+  pending_write->overlapped.Offset = static_cast<DWORD>(next_offset_);
+  pending_write->overlapped.OffsetHigh = static_cast<DWORD>(next_offset_ >> 32);
+  if (!::WriteFile(handle_.Get(), data, length, NULL,
+                   &pending_write->overlapped) &&
+      ::GetLastError() != ERROR_IO_PENDING) {
     DWORD error = ::GetLastError();
-    LOG(ERROR) << "CloseHandle failed: " << ::common::LogWe(error) << ".";
+    LOG(ERROR) << "Failed writing to '" << path_.value()
+               << "': " << ::common::LogWe(error) << ".";
+    on_retired.Run();
     return false;
   }
+
+  pending_write->length = length;
+  pending_write->pending = true;
+  pending_write->on_retired = on_retired;
+  next_offset_ += length;
+  next_pending_write_ = (next_pending_write_ + 1) % pending_writes_.size();
+
   return true;
 }
 
+bool TraceFileWriter::CompletePendingWrite(PendingWrite* pending_write) {
+  DCHECK(pending_write != NULL);
+
+  if (!pending_write->pending)
+    return true;
+  pending_write->pending = false;
+
+  bool success = true;
+  DWORD bytes_written = 0;
+  if (!::GetOverlappedResult(handle_.Get(), &pending_write->overlapped,
+                             &bytes_written, TRUE) ||
+      bytes_written != pending_write->length) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed completing write to '" << path_.value()
+               << "': " << ::common::LogWe(error) << ".";
+    success = false;
+  }
+
+  // The caller's buffer is retired whether or not the write succeeded.
+  if (!pending_write->on_retired.is_null()) {
+    base::Closure on_retired = pending_write->on_retired;
+    pending_write->on_retired.Reset();
+    on_retired.Run();
+  }
+
+  return success;
+}
+
+bool TraceFileWriter::FlushPendingWrites() {
+  bool success = true;
+  for (size_t i = 0; i < pending_writes_.size(); ++i) {
+    if (!CompletePendingWrite(&pending_writes_[i]))
+      success = false;
+  }
+  return success;
+}
+
+void TraceFileWriter::ReleasePendingWrites() {
+  for (size_t i = 0; i < pending_writes_.size(); ++i) {
+    DCHECK(!pending_writes_[i].pending);
+    if (pending_writes_[i].data != NULL)
+      ::VirtualFree(pending_writes_[i].data, 0, MEM_RELEASE);
+    if (pending_writes_[i].overlapped.hEvent != NULL)
+      ::CloseHandle(pending_writes_[i].overlapped.hEvent);
+  }
+  pending_writes_.clear();
+  next_pending_write_ = 0;
+}
+
 }  // namespace service
 }  // namespace trace
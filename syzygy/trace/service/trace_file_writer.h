@@ -35,12 +35,47 @@
 //
 //   if (!w.Close())
 //     ...
+//
+// The writer may also be opened in asynchronous mode, in which case records
+// are copied to an internal ring of sector-aligned buffers and committed to
+// disk using overlapped I/O. In this mode WriteRecord returns as soon as the
+// copy has been made, with up to a fixed number of writes in flight at once,
+// decoupling the caller from disk latency. The caller's buffer may be reused
+// immediately.
+//
+// In asynchronous mode the copy may also be elided entirely via
+// WriteRecordNoCopy, which queues the caller's buffer directly for disk I/O
+// and invokes a callback once the write has retired and the buffer may be
+// reused. This requires the buffer to be aligned to the disk sector size, as
+// the file is opened with FILE_FLAG_NO_BUFFERING.
+//
+// The writer may optionally compress each segment record independently (see
+// set_compress_segments), trading CPU on the writing thread for substantially
+// smaller trace files. The file header is always written raw, and segments
+// that do not shrink are also written raw, so compressed and raw segments
+// coexist in the same file.
+//
+// At close the writer appends a TraceIndexFooter record describing every
+// segment record in the file, allowing readers to enumerate and seek to
+// segments without scanning the file. Files that are not closed cleanly
+// simply lack the footer, and readers fall back to a sequential scan.
+//
+// The writer grows the file in large preallocated chunks (see
+// set_growth_chunk_size) rather than write-by-write, keeping the file's
+// extents contiguous on disk. When the process holds the manage-volume
+// privilege the preallocated region is also marked valid via
+// SetFileValidData, sparing the filesystem from zero-filling it ahead of
+// the writes. The unused tail of the last chunk is trimmed at close.
 
 #ifndef SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 #define SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 
+#include <vector>
+
+#include "base/callback.h"
 #include "base/files/file_path.h"
 #include "base/win/scoped_handle.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/process_info.h"
 
 namespace trace {
@@ -50,10 +85,17 @@ namespace service {
 // writing a trace file. It is not thread-safe.
 class TraceFileWriter {
  public:
+  // The default number of asynchronous writes that may be in flight at once
+  // when the writer is opened in asynchronous mode.
+  static const size_t kDefaultMaxPendingWrites = 4;
+
+  // The default size of the chunks by which the file is grown.
+  static const size_t kDefaultGrowthChunkSize = 16 * 1024 * 1024;
+
   // Constructor.
   TraceFileWriter();
 
-  // Destructor.
+  // Destructor. Waits on any in-flight asynchronous writes.
   ~TraceFileWriter();
 
   // Given information about a process, generates a suggested base filename for
@@ -64,11 +106,20 @@ class TraceFileWriter {
   static base::FilePath GenerateTraceFileBaseName(
       const ProcessInfo& process_info);
 
-  // Opens a trace file at the given path.
+  // Opens a trace file at the given path for synchronous writing.
   // @param path The path of the trace file to write.
   // @returns true on success, false otherwise.
   bool Open(const base::FilePath& path);
 
+  // Opens a trace file at the given path, optionally for asynchronous
+  // writing.
+  // @param path The path of the trace file to write.
+  // @param max_pending_writes If non-zero the file will be written using
+  //     overlapped I/O, with up to this many writes in flight at any given
+  //     time. If zero the file is written synchronously.
+  // @returns true on success, false otherwise.
+  bool Open(const base::FilePath& path, size_t max_pending_writes);
+
   // Writes the header to the trace file. A trace file is associated with a
   // single running process, so we require a populated process-info struct.
   // @param process_info Information about the process to which this trace file
@@ -76,7 +127,10 @@ class TraceFileWriter {
   // @returns true on success, false otherwise.
   bool WriteHeader(const ProcessInfo& process_info);
 
-  // Writes a record of data to disk.
+  // Writes a record of data to disk. In asynchronous mode the record is
+  // copied to an internal buffer and queued for writing, and |data| may be
+  // reused as soon as this returns; a failure of a previously queued write
+  // may be reported by a later call to WriteRecord or Close.
   // @param data The record to be written. This must contain a RecordPrefix.
   //     This currently only supports records that contain a
   //     TraceFileSegmenHeader.
@@ -86,7 +140,36 @@ class TraceFileWriter {
   // @returns true on success, false otherwise.
   bool WriteRecord(const void* data, size_t length);
 
-  // Closes the trace file.
+  // Writes a record of data to disk without taking a copy. The record is
+  // queued for writing directly from @p data, which must remain valid and
+  // unmodified until @p on_retired has been invoked. Only valid in
+  // asynchronous mode. If segment compression is enabled the zero-copy
+  // optimization does not apply: the record is compressed into an internal
+  // buffer and @p on_retired is invoked before this returns.
+  // @param data The record to be written, subject to the same requirements as
+  //     in WriteRecord. Additionally, the record must be aligned to the block
+  //     size, as it is handed to the OS as is.
+  // @param length The maximum length of continuous data that may be
+  //     contained in the record.
+  // @param on_retired A callback that will be invoked exactly once when the
+  //     buffer is no longer in use by the writer, whether or not the write
+  //     succeeded. This is invoked from within a subsequent call to
+  //     WriteRecord, WriteRecordNoCopy or Close, on the caller's thread. If
+  //     the record is rejected or the write fails to issue it is invoked
+  //     before this function returns.
+  // @returns true on success, false otherwise.
+  bool WriteRecordNoCopy(const void* data,
+                         size_t length,
+                         const base::Closure& on_retired);
+
+  // Waits for all in-flight asynchronous writes to complete, invoking their
+  // retirement callbacks. A failure of any previously queued write is
+  // reported here.
+  // @returns true if all writes succeeded, false otherwise.
+  bool FlushPendingWrites();
+
+  // Closes the trace file, first waiting on any in-flight asynchronous
+  // writes.
   // @returns true on success, false otherwise.
   // @note If this is not called manually the trace-file will close itself when
   //     the writer goes out of scope.
@@ -100,7 +183,150 @@ class TraceFileWriter {
   // @note This is only valid after Open has returned successfully.
   size_t block_size() const { return block_size_; }
 
+  // @returns true if segment records are being compressed.
+  bool compress_segments() const { return compress_segments_; }
+
+  // @returns the number of segments that were sequenced by the client but
+  //     have not been written to this file. Clients number the segments
+  //     they commit densely from 1, so this is the number of sequence
+  //     numbers missing below the highest one seen. A non-zero value after
+  //     the last record has been written means segments were lost in
+  //     flight, typically because the client died before flushing them.
+  size_t missing_sequence_count() const {
+    return max_sequence_number_ - sequenced_segment_count_;
+  }
+
+  // Enables or disables segment compression. When enabled each record is
+  // deflated independently and written as a TraceCompressedSegmentHeader
+  // record; records that do not shrink by at least a block are written raw.
+  // This may be toggled at any time, and only affects subsequent records.
+  // @param compress_segments true to compress subsequent records.
+  void set_compress_segments(bool compress_segments) {
+    compress_segments_ = compress_segments;
+  }
+
+  // @returns the size of the chunks by which the file is grown, or zero if
+  //     the file grows write-by-write.
+  size_t growth_chunk_size() const { return growth_chunk_size_; }
+
+  // Sets the size of the chunks by which the file is grown. A write landing
+  // beyond the allocated length extends the file to the next multiple of
+  // this size, and the unused tail is trimmed at close.
+  // @param growth_chunk_size the growth chunk size, in bytes. Zero disables
+  //     preallocation and grows the file write-by-write.
+  void set_growth_chunk_size(size_t growth_chunk_size) {
+    growth_chunk_size_ = growth_chunk_size;
+  }
+
  protected:
+  // An in-flight asynchronous write. The writer cycles through a ring of
+  // these, waiting for the oldest write to complete before reusing its slot.
+  struct PendingWrite {
+    // The overlapped structure used to track the write. Holds an event that
+    // is signaled when the write completes.
+    OVERLAPPED overlapped;
+    // A sector-aligned buffer into which the record is copied before being
+    // queued for writing, and its capacity.
+    uint8* data;
+    size_t capacity;
+    // The length of the write in progress.
+    size_t length;
+    // Indicates if a write is currently in flight for this slot.
+    bool pending;
+    // A callback to be invoked when the write retires. This is only set for
+    // zero-copy writes, which are issued directly from the caller's buffer
+    // rather than from |data|.
+    base::Closure on_retired;
+  };
+
+  // Tallies a segment record for the index footer, recording its offset,
+  // on-disk length and thread id, counting the events it contains and
+  // accounting for its sequence number. Must
+  // be called with the raw (uncompressed) record, after it has been
+  // validated and immediately before its write is issued, as the entry's
+  // offset is taken from the write cursor.
+  // @param data The raw record being written. This must contain a valid
+  //     RecordPrefix and TraceFileSegmentHeader.
+  // @param bytes_to_write The length the record will occupy on disk, after
+  //     any compression.
+  void IndexSegment(const void* data, size_t bytes_to_write);
+
+  // Writes the index footer record describing all segments written so far.
+  // This should be the last write to the file.
+  // @returns true on success, false otherwise.
+  bool WriteIndexFooter();
+
+  // Compresses a record into compressed_record_, wrapping it in a
+  // TraceCompressedSegmentHeader record aligned to the block size.
+  // @param data The record to be compressed. This must contain a valid
+  //     RecordPrefix and TraceFileSegmentHeader.
+  // @param max_length The length that the record would occupy on disk if
+  //     written raw.
+  // @returns true if the compressed record should be written in place of the
+  //     raw one, false if compression failed or did not save any blocks.
+  bool CompressRecord(const void* data, size_t max_length);
+
+  // Extends the file so that at least @p required_length bytes are
+  // allocated, rounding up to the next multiple of the growth chunk size.
+  // When preallocation is disabled or the file is already large enough this
+  // is a no-op. A failure to extend the file disables preallocation for the
+  // remainder of the session rather than failing the write.
+  // @param required_length The file length the next write requires.
+  // @returns true on success, false if the file could not be extended and
+  //     subsequent writes are expected to fail as well.
+  bool EnsureCapacity(uint64 required_length);
+
+  // Validates a record and determines how many bytes of it will be committed
+  // to disk.
+  // @param data The record to be validated. This must contain a RecordPrefix.
+  // @param length The maximum length of continuous data that may be
+  //     contained in the record.
+  // @param bytes_to_write Receives the length of the write, aligned to the
+  //     block size. This is set to zero if the contained segment is empty and
+  //     nothing need be written.
+  // @returns true if the record is valid, false otherwise.
+  bool ParseRecord(const void* data, size_t length, size_t* bytes_to_write);
+
+  // Writes a block of data at the current file offset, waiting for the write
+  // to complete. Handles both synchronous and asynchronous modes.
+  // @param data The data to be written.
+  // @param length The length of the data, which must be a multiple of the
+  //     block size.
+  // @returns true on success, false otherwise.
+  bool WriteData(const void* data, size_t length);
+
+  // Queues an asynchronous write of a record at the current file offset,
+  // copying it to an internal buffer first. Only valid in asynchronous mode.
+  // @param data The data to be written.
+  // @param length The length of the data, which must be a multiple of the
+  //     block size.
+  // @returns true on success, false otherwise.
+  bool WriteDataAsync(const void* data, size_t length);
+
+  // Queues an asynchronous write of a record at the current file offset,
+  // directly from the caller's buffer. Only valid in asynchronous mode.
+  // @param data The data to be written. This must be aligned to the block
+  //     size and remain valid until @p on_retired is invoked.
+  // @param length The length of the data, which must be a multiple of the
+  //     block size.
+  // @param on_retired A callback to be invoked when the write retires. If the
+  //     write fails to issue this is invoked before returning.
+  // @returns true on success, false otherwise.
+  bool WriteDataNoCopyAsync(const void* data,
+                            size_t length,
+                            const base::Closure& on_retired);
+
+  // Waits for the write in flight on the given slot, if any, to complete,
+  // invoking the slot's retirement callback if one is set.
+  // @param pending_write The slot to be completed.
+  // @returns true if the slot is free and the write (if any) succeeded,
+  //     false otherwise.
+  bool CompletePendingWrite(PendingWrite* pending_write);
+
+  // Releases the buffers and events associated with the asynchronous write
+  // slots. Any in-flight writes must have been completed first.
+  void ReleasePendingWrites();
+
   // The path to the trace file being written.
   base::FilePath path_;
 
@@ -110,6 +336,49 @@ class TraceFileWriter {
   // The block size being used by the trace file writer.
   size_t block_size_;
 
+  // The file offset at which the next write will occur.
+  uint64 next_offset_;
+
+  // The size of the chunks by which the file is grown, or zero if the file
+  // grows write-by-write.
+  size_t growth_chunk_size_;
+
+  // The length to which the file has been preallocated. The tail beyond
+  // next_offset_ is trimmed at close.
+  uint64 allocated_length_;
+
+  // Indicates whether preallocated regions may be marked valid via
+  // SetFileValidData. This requires the manage-volume privilege, and is
+  // disabled after the first failure.
+  bool set_valid_data_;
+
+  // Indicates whether segment records are compressed before being written.
+  bool compress_segments_;
+
+  // Scratch buffer into which records are compressed. Reused across records
+  // to avoid churning allocations.
+  std::vector<uint8> compressed_record_;
+
+  // The index entries gathered so far, one per segment record written.
+  // These are emitted as the index footer when the file is closed.
+  std::vector<TraceIndexEntry> index_entries_;
+
+  // The number of events of each type written so far, indexed by
+  // TraceEventType. Emitted in the index footer.
+  uint32 event_type_counts_[TraceIndexFooter::kNumEventTypeCounts];
+
+  // The highest segment sequence number seen so far, and the number of
+  // sequenced segments written. The difference between the two is the
+  // number of sequenced segments lost in flight.
+  uint32 max_sequence_number_;
+  size_t sequenced_segment_count_;
+
+  // The ring of asynchronous write slots. This is empty in synchronous mode.
+  std::vector<PendingWrite> pending_writes_;
+
+  // The index of the next slot to be used in the ring.
+  size_t next_pending_write_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(TraceFileWriter);
 };
@@ -14,12 +14,14 @@
 
 #include "syzygy/trace/service/trace_file_writer.h"
 
+#include "base/bind.h"
 #include "base/file_util.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/align.h"
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/process_info.h"
+#include "third_party/zlib/zlib.h"
 
 namespace trace {
 namespace service {
@@ -43,6 +45,11 @@ class TraceFileWriterTest : public testing::PELibUnitTest {
   base::FilePath trace_path;
 };
 
+void IncrementCounter(size_t* counter) {
+  DCHECK(counter != NULL);
+  ++(*counter);
+}
+
 }  // namespace
 
 TEST_F(TraceFileWriterTest, GenerateTraceFileBaseName) {
@@ -180,5 +187,379 @@ TEST_F(TraceFileWriterTest, WriteRecordSucceeds) {
   EXPECT_EQ(0, trace_file_size % w.block_size());
 }
 
+TEST_F(TraceFileWriterTest, MissingSequenceCount) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+  EXPECT_EQ(0u, w.missing_sequence_count());
+
+  std::vector<uint8> data;
+  data.resize(sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + 1);
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type= TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->segment_length = 1;
+  data.resize(::common::AlignUp(data.size(), w.block_size()));
+
+  // An unsequenced segment is exempt from the accounting.
+  header->sequence_number = 0;
+  EXPECT_TRUE(w.WriteRecord(data.data(), data.size()));
+  EXPECT_EQ(0u, w.missing_sequence_count());
+
+  // Sequences 1 and 3 arrive, but 2 never does.
+  header->sequence_number = 1;
+  EXPECT_TRUE(w.WriteRecord(data.data(), data.size()));
+  EXPECT_EQ(0u, w.missing_sequence_count());
+
+  header->sequence_number = 3;
+  EXPECT_TRUE(w.WriteRecord(data.data(), data.size()));
+  EXPECT_EQ(1u, w.missing_sequence_count());
+
+  ASSERT_TRUE(w.Close());
+}
+
+TEST_F(TraceFileWriterTest, WriteRecordCompressed) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+  EXPECT_FALSE(w.compress_segments());
+  w.set_compress_segments(true);
+  EXPECT_TRUE(w.compress_segments());
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+
+  // Build a highly compressible record spanning several blocks.
+  size_t segment_length = 4 * w.block_size();
+  size_t raw_length = sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) +
+      segment_length;
+  std::vector<uint8> data;
+  data.resize(raw_length);
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type= TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->segment_length = segment_length;
+
+  data.resize(::common::AlignUp(data.size(), w.block_size()));
+  EXPECT_TRUE(w.WriteRecord(data.data(), data.size()));
+  ASSERT_TRUE(w.Close());
+
+  // Read the file back and validate the compressed container.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_path, &contents));
+  const TraceFileHeader* trace_header =
+      reinterpret_cast<const TraceFileHeader*>(contents.data());
+  size_t offset = ::common::AlignUp(trace_header->header_size,
+                                    w.block_size());
+  const RecordPrefix* prefix =
+      reinterpret_cast<const RecordPrefix*>(contents.data() + offset);
+  EXPECT_EQ(TraceCompressedSegmentHeader::kTypeId, prefix->type);
+  EXPECT_EQ(sizeof(TraceCompressedSegmentHeader), prefix->size);
+  const TraceCompressedSegmentHeader* compressed =
+      reinterpret_cast<const TraceCompressedSegmentHeader*>(prefix + 1);
+  EXPECT_EQ(raw_length, compressed->uncompressed_length);
+
+  // The record should have shrunk: the compressed record fills the rest of
+  // the file, and takes fewer blocks than the raw record would have.
+  size_t compressed_record_size = ::common::AlignUp(
+      sizeof(RecordPrefix) + sizeof(TraceCompressedSegmentHeader) +
+          compressed->compressed_length,
+      w.block_size());
+  EXPECT_LT(compressed_record_size, data.size());
+
+  // The index footer follows the compressed record.
+  const RecordPrefix* footer_prefix = reinterpret_cast<const RecordPrefix*>(
+      contents.data() + offset + compressed_record_size);
+  EXPECT_EQ(TraceIndexFooter::kTypeId, footer_prefix->type);
+
+  // Inflating the payload should reproduce the original record.
+  std::vector<uint8> inflated(compressed->uncompressed_length);
+  uLongf inflated_length = inflated.size();
+  ASSERT_EQ(Z_OK, ::uncompress(
+      &inflated[0], &inflated_length,
+      reinterpret_cast<const Bytef*>(compressed + 1),
+      compressed->compressed_length));
+  ASSERT_EQ(inflated.size(), inflated_length);
+  EXPECT_EQ(0, ::memcmp(&inflated[0], data.data(), raw_length));
+}
+
+TEST_F(TraceFileWriterTest, WriteIndexFooter) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+
+  // Build a segment record containing two event records.
+  const size_t kEventDataSize = 4;
+  size_t segment_length = 2 * (sizeof(RecordPrefix) + kEventDataSize);
+  std::vector<uint8> data;
+  data.resize(sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) +
+      segment_length);
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type= TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->thread_id = 42;
+  header->segment_length = segment_length;
+  RecordPrefix* event = reinterpret_cast<RecordPrefix*>(header + 1);
+  event->type = TRACE_PROCESS_ENDED;
+  event->size = kEventDataSize;
+  event = reinterpret_cast<RecordPrefix*>(
+      reinterpret_cast<uint8*>(event + 1) + kEventDataSize);
+  event->type = TRACE_PROCESS_ENDED;
+  event->size = kEventDataSize;
+
+  data.resize(::common::AlignUp(data.size(), w.block_size()));
+  EXPECT_TRUE(w.WriteRecord(data.data(), data.size()));
+  ASSERT_TRUE(w.Close());
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_path, &contents));
+
+  // The last eight bytes of the file hold the offset of the footer record,
+  // which immediately follows the segment record.
+  ASSERT_LE(sizeof(uint64), contents.size());
+  uint64 footer_offset = *reinterpret_cast<const uint64*>(
+      contents.data() + contents.size() - sizeof(uint64));
+  const TraceFileHeader* trace_header =
+      reinterpret_cast<const TraceFileHeader*>(contents.data());
+  size_t record_offset = ::common::AlignUp(trace_header->header_size,
+                                           w.block_size());
+  EXPECT_EQ(record_offset + data.size(), footer_offset);
+
+  const RecordPrefix* prefix =
+      reinterpret_cast<const RecordPrefix*>(contents.data() + footer_offset);
+  EXPECT_EQ(TraceIndexFooter::kTypeId, prefix->type);
+  EXPECT_EQ(TRACE_VERSION_HI, prefix->version.hi);
+  EXPECT_EQ(TRACE_VERSION_LO, prefix->version.lo);
+  EXPECT_EQ(sizeof(TraceIndexFooter) + sizeof(TraceIndexEntry), prefix->size);
+
+  // The footer should describe the single segment record and tally its two
+  // events.
+  const TraceIndexFooter* footer =
+      reinterpret_cast<const TraceIndexFooter*>(prefix + 1);
+  ASSERT_EQ(1u, footer->num_entries);
+  EXPECT_EQ(2u, footer->event_type_counts[TRACE_PROCESS_ENDED]);
+
+  const TraceIndexEntry* entry =
+      reinterpret_cast<const TraceIndexEntry*>(footer + 1);
+  EXPECT_EQ(record_offset, entry->offset);
+  EXPECT_EQ(data.size(), entry->length);
+  EXPECT_EQ(42u, entry->thread_id);
+}
+
+TEST_F(TraceFileWriterTest, PreallocationTrimsAtClose) {
+  TestTraceFileWriter w;
+  EXPECT_EQ(TraceFileWriter::kDefaultGrowthChunkSize, w.growth_chunk_size());
+
+  // Use a small growth chunk so the test doesn't touch much disk.
+  const size_t kChunkSize = 1024 * 1024;
+  w.set_growth_chunk_size(kChunkSize);
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+
+  // The file is grown a whole chunk at a time.
+  int64 trace_file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &trace_file_size));
+  EXPECT_EQ(kChunkSize, static_cast<size_t>(trace_file_size));
+
+  std::vector<uint8> data;
+  data.resize(sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + 1);
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type= TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->segment_length = 1;
+  data.resize(::common::AlignUp(data.size(), w.block_size()));
+
+  // A write landing within the chunk does not grow the file.
+  EXPECT_TRUE(w.WriteRecord(data.data(), data.size()));
+  ASSERT_TRUE(base::GetFileSize(trace_path, &trace_file_size));
+  EXPECT_EQ(kChunkSize, static_cast<size_t>(trace_file_size));
+
+  // At close the unused tail of the chunk is trimmed, leaving the file
+  // ending at the last byte written.
+  ASSERT_TRUE(w.Close());
+  ASSERT_TRUE(base::GetFileSize(trace_path, &trace_file_size));
+  EXPECT_LT(0, trace_file_size);
+  EXPECT_GT(kChunkSize, static_cast<size_t>(trace_file_size));
+  EXPECT_EQ(0, trace_file_size % w.block_size());
+
+  // The footer-offset trailer is in the last eight bytes of the file, as
+  // readers expect.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_path, &contents));
+  ASSERT_LE(sizeof(uint64), contents.size());
+  uint64 footer_offset = *reinterpret_cast<const uint64*>(
+      contents.data() + contents.size() - sizeof(uint64));
+  ASSERT_LT(footer_offset, contents.size());
+  const RecordPrefix* footer_prefix =
+      reinterpret_cast<const RecordPrefix*>(contents.data() + footer_offset);
+  EXPECT_EQ(TraceIndexFooter::kTypeId, footer_prefix->type);
+}
+
+TEST_F(TraceFileWriterTest, OpenAsyncSucceeds) {
+  TestTraceFileWriter w;
+  EXPECT_TRUE(w.Open(trace_path, TraceFileWriter::kDefaultMaxPendingWrites));
+  EXPECT_EQ(trace_path, w.path());
+  EXPECT_TRUE(w.handle_.IsValid());
+  EXPECT_LT(0u, w.block_size());
+  EXPECT_TRUE(base::PathExists(trace_path));
+
+  // Closing with no writes in flight should succeed.
+  EXPECT_TRUE(w.Close());
+}
+
+TEST_F(TraceFileWriterTest, WriteRecordAsyncSucceeds) {
+  TestTraceFileWriter w;
+
+  // Use a small ring of pending writes so that slots get reused.
+  ASSERT_TRUE(w.Open(trace_path, 2));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+
+  std::vector<uint8> data;
+  data.resize(sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + 1);
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type= TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->segment_length = 1;
+
+  data.resize(::common::AlignUp(data.size(), w.block_size()));
+
+  // Write enough records to cycle through the ring several times, marking
+  // each of them so that they may be recognized afterwards. Scribbling over
+  // the marker after the write ensures that the writer took a copy.
+  static const size_t kNumRecords = 10;
+  size_t marker_offset = sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  for (size_t i = 0; i < kNumRecords; ++i) {
+    data[marker_offset] = static_cast<uint8>(i + 1);
+    EXPECT_TRUE(w.WriteRecord(data.data(), data.size()));
+    data[marker_offset] = 0;
+  }
+
+  ASSERT_TRUE(w.Close());
+  EXPECT_TRUE(base::PathExists(trace_path));
+
+  int64 trace_file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &trace_file_size));
+  EXPECT_LT(0, trace_file_size);
+  EXPECT_EQ(0, trace_file_size % w.block_size());
+
+  // Read the trace file back and check that the records landed in order at
+  // the expected offsets.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_path, &contents));
+  const TraceFileHeader* trace_header =
+      reinterpret_cast<const TraceFileHeader*>(contents.data());
+  size_t offset = ::common::AlignUp(trace_header->header_size,
+                                    w.block_size());
+  for (size_t i = 0; i < kNumRecords; ++i) {
+    ASSERT_LE(offset + data.size(), contents.size());
+    EXPECT_EQ(static_cast<uint8>(i + 1),
+              static_cast<uint8>(contents[offset + marker_offset]));
+    offset += data.size();
+  }
+
+  // The index footer follows the records.
+  const RecordPrefix* footer_prefix =
+      reinterpret_cast<const RecordPrefix*>(contents.data() + offset);
+  EXPECT_EQ(TraceIndexFooter::kTypeId, footer_prefix->type);
+}
+
+TEST_F(TraceFileWriterTest, WriteRecordNoCopySucceeds) {
+  TestTraceFileWriter w;
+
+  // Use a small ring of pending writes so that slots get reused.
+  ASSERT_TRUE(w.Open(trace_path, 2));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+
+  size_t record_size = ::common::AlignUp(
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + 1,
+      w.block_size());
+
+  // Allocate a block-aligned buffer per record, as the records are handed
+  // to the OS as is and must live until their writes retire.
+  static const size_t kNumRecords = 10;
+  std::vector<std::vector<uint8> > buffers(kNumRecords);
+  size_t marker_offset = sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  size_t retired = 0;
+  for (size_t i = 0; i < kNumRecords; ++i) {
+    buffers[i].resize(record_size + w.block_size());
+    uint8* data = ::common::AlignUp(buffers[i].data(), w.block_size());
+    RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data);
+    TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+        record + 1);
+    record->size = sizeof(TraceFileSegmentHeader);
+    record->type= TraceFileSegmentHeader::kTypeId;
+    record->version.hi = TRACE_VERSION_HI;
+    record->version.lo = TRACE_VERSION_LO;
+    header->segment_length = 1;
+    data[marker_offset] = static_cast<uint8>(i + 1);
+
+    EXPECT_TRUE(w.WriteRecordNoCopy(
+        data, record_size, base::Bind(&IncrementCounter, &retired)));
+  }
+
+  // With a ring of 2 slots at most 2 writes may still be in flight.
+  EXPECT_LE(kNumRecords - 2, retired);
+
+  // Closing waits on the in-flight writes and retires them.
+  ASSERT_TRUE(w.Close());
+  EXPECT_EQ(kNumRecords, retired);
+  EXPECT_TRUE(base::PathExists(trace_path));
+
+  // Read the trace file back and check that the records landed in order at
+  // the expected offsets.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_path, &contents));
+  const TraceFileHeader* trace_header =
+      reinterpret_cast<const TraceFileHeader*>(contents.data());
+  size_t offset = ::common::AlignUp(trace_header->header_size,
+                                    w.block_size());
+  for (size_t i = 0; i < kNumRecords; ++i) {
+    ASSERT_LE(offset + record_size, contents.size());
+    EXPECT_EQ(static_cast<uint8>(i + 1),
+              static_cast<uint8>(contents[offset + marker_offset]));
+    offset += record_size;
+  }
+
+  // The index footer follows the records.
+  const RecordPrefix* footer_prefix =
+      reinterpret_cast<const RecordPrefix*>(contents.data() + offset);
+  EXPECT_EQ(TraceIndexFooter::kTypeId, footer_prefix->type);
+}
+
 }  // namespace service
 }  // namespace trace
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <iostream>
 #include <list>
 
@@ -19,8 +20,13 @@
 #include "base/command_line.h"
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
 #include "base/process/process_iterator.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
 #include "pcrecpp.h"  // NOLINT
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/wsdump/process_working_set.h"
@@ -67,11 +73,15 @@ bool RegexpProcessFilter::Includes(const base::ProcessEntry& entry) const {
 }
 
 const char kUsage[] =
-"Usage: wsdump [--process-name=<process_re>]\n"
+"Usage: wsdump [--process-name=<process_re>] [--num-workers=<N>]\n"
 "\n"
 "    Captures and outputs working set statistics for all processes,\n"
 "    or only for processess whose executable name matches <process_re>.\n"
 "\n"
+"    Working sets are captured concurrently by <N> worker threads to\n"
+"    keep the sweep as close as possible to a point-in-time snapshot.\n"
+"    <N> defaults to the number of processors.\n"
+"\n"
 "    The output is JSON encoded array, where each element of the array\n"
 "    is a dictionary describing a process. Each process has the following\n"
 "    items:\n"
@@ -114,15 +124,46 @@ int Usage() {
 }
 
 struct ProcessInfo {
-  ProcessInfo() : pid(0), parent_pid(0) {
+  ProcessInfo() : pid(0), parent_pid(0), captured(false) {
   }
 
   std::wstring exe_file;
   base::ProcessId pid;
   base::ProcessId parent_pid;
+  bool captured;
   ProcessWorkingSet ws;
 };
 
+// A worker that captures the working sets of the processes assigned to it.
+// The per-process captures are independent, so spreading them across a
+// bounded pool of workers shortens the sweep and with it the window during
+// which the working sets can drift apart.
+class CaptureWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  CaptureWorker() { }
+
+  void AddProcess(ProcessInfo* info) {
+    DCHECK(info != NULL);
+    processes_.push_back(info);
+  }
+
+  virtual void Run() OVERRIDE {
+    for (size_t i = 0; i < processes_.size(); ++i) {
+      ProcessInfo* info = processes_[i];
+      info->captured = info->ws.Initialize(info->pid);
+      if (!info->captured) {
+        LOG(ERROR) << "Unable to capture working set information for pid: "
+                   << info->pid;
+      }
+    }
+  }
+
+ private:
+  std::vector<ProcessInfo*> processes_;
+
+  DISALLOW_COPY_AND_ASSIGN(CaptureWorker);
+};
+
 void OutputModule(const std::wstring& module_name,
                   const ProcessWorkingSet::Stats& stats,
                   core::JSONFileWriter* json) {
@@ -201,22 +242,64 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  // Parse the number of capture workers to use.
+  size_t num_workers = base::SysInfo::NumberOfProcessors();
+  if (cmd_line->HasSwitch("num-workers")) {
+    std::string value = cmd_line->GetSwitchValueASCII("num-workers");
+    int parsed_workers = 0;
+    if (!base::StringToInt(value, &parsed_workers) || parsed_workers < 1) {
+      LOG(ERROR) << "Invalid num-workers value: " << value << ".";
+      return 1;
+    }
+    num_workers = parsed_workers;
+  }
+
   typedef std::list<ProcessInfo> WorkingSets;
   WorkingSets working_sets;
 
+  // Enumerate the matching processes.
   const base::ProcessEntry* entry = NULL;
   base::ProcessIterator process_iterator(&filter);
   while (entry = process_iterator.NextProcessEntry()) {
     working_sets.push_back(ProcessInfo());
     ProcessInfo& info = working_sets.back();
-    if (info.ws.Initialize(entry->pid())) {
-      info.exe_file = entry->exe_file();
-      info.pid = entry->pid();
-      info.parent_pid = entry->parent_pid();
+    info.exe_file = entry->exe_file();
+    info.pid = entry->pid();
+    info.parent_pid = entry->parent_pid();
+  }
+
+  // Distribute the processes across the workers and capture their working
+  // sets concurrently.
+  num_workers = std::min(num_workers, working_sets.size());
+  if (num_workers > 0) {
+    ScopedVector<CaptureWorker> workers;
+    for (size_t i = 0; i < num_workers; ++i)
+      workers.push_back(new CaptureWorker());
+
+    size_t next_worker = 0;
+    WorkingSets::iterator info_it = working_sets.begin();
+    for (; info_it != working_sets.end(); ++info_it)
+      workers[next_worker++ % num_workers]->AddProcess(&*info_it);
+
+    ScopedVector<base::DelegateSimpleThread> threads;
+    for (size_t i = 0; i < workers.size(); ++i) {
+      threads.push_back(new base::DelegateSimpleThread(
+          workers[i], base::StringPrintf("wsdump-worker-%u", i)));
+      threads.back()->Start();
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->Join();
+  }
+
+  // Drop the processes whose working set could not be captured, e.g.
+  // because they exited during the sweep. The workers have already logged
+  // the failures.
+  WorkingSets::iterator info_it = working_sets.begin();
+  while (info_it != working_sets.end()) {
+    if (!info_it->captured) {
+      info_it = working_sets.erase(info_it);
     } else {
-      LOG(ERROR) << "Unable to capture working set information for pid: "
-                 << entry->pid();
-      working_sets.pop_back();
+      ++info_it;
     }
   }
 
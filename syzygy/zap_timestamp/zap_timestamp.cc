@@ -31,14 +31,20 @@
 
 #include "syzygy/zap_timestamp/zap_timestamp.h"
 
+#include <string.h>
+
+#include <vector>
+
 #include "base/at_exit.h"
 #include "base/bind.h"
+#include "base/callback.h"
 #include "base/command_line.h"
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/md5.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/typed_block.h"
 #include "syzygy/core/file_util.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
@@ -265,6 +271,26 @@ bool MarkDataDirectoryTimestamps(const PEFile& pe_file,
   return true;
 }
 
+// Runs a boolean-returning member task on a background thread, recording its
+// result for inspection after the thread has been joined.
+class BackgroundTask : public base::DelegateSimpleThread::Delegate {
+ public:
+  typedef base::Callback<bool(void)> Task;
+
+  explicit BackgroundTask(const Task& task) : task_(task), succeeded_(false) {
+  }
+
+  virtual void Run() OVERRIDE {
+    succeeded_ = task_.Run();
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  Task task_;
+  bool succeeded_;
+};
+
 bool Md5Consume(size_t bytes, FILE* file, base::MD5Context* context) {
   char buffer[4096] = { 0 };
 
@@ -329,6 +355,54 @@ bool UpdateFileInPlace(const base::FilePath& path,
   return true;
 }
 
+// Determines whether every marked range of the file at @p path already holds
+// its replacement data, which is the case when the file was normalized by a
+// previous run. Ranges with no replacement data (the PE checksum) are
+// skipped; the checksum is derived from the rest of the file contents, so it
+// is up to date whenever the other ranges are. Returns true on success,
+// setting @p already_updated; returns false if the file could not be read.
+bool FileAlreadyUpdated(const base::FilePath& path,
+                        const PatchAddressSpace& updates,
+                        bool* already_updated) {
+  DCHECK(already_updated != NULL);
+  *already_updated = false;
+
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open file for reading: " << path.value();
+    return false;
+  }
+
+  std::vector<uint8> buffer;
+  PatchAddressSpace::const_iterator it = updates.begin();
+  for (; it != updates.end(); ++it) {
+    if (it->second.data == NULL)
+      continue;
+
+    if (::fseek(file.get(), it->first.start().value(), SEEK_SET) != 0) {
+      LOG(ERROR) << "Failed to seek to " << it->first.start() << " of file: "
+                 << path.value();
+      return false;
+    }
+
+    buffer.resize(it->first.size());
+    size_t bytes_read = ::fread(&buffer[0], 1, buffer.size(), file.get());
+    if (bytes_read != buffer.size()) {
+      LOG(ERROR) << "Failed to read " << it->first.size() << " bytes at "
+                 << "position " << it->first.start() << " of file: "
+                 << path.value();
+      return false;
+    }
+
+    // The file still needs patching.
+    if (::memcmp(&buffer[0], it->second.data, buffer.size()) != 0)
+      return true;
+  }
+
+  *already_updated = true;
+  return true;
+}
+
 // Ensures that the stream with the given ID is writable, returning a scoped
 // pointer to it.
 scoped_refptr<PdbStream> GetWritablePdbStream(size_t index,
@@ -490,6 +564,7 @@ bool NormalizeSymbolRecordStream(PdbByteStream* stream) {
 ZapTimestamp::ZapTimestamp()
     : image_layout_(&block_graph_),
       dos_header_block_(NULL),
+      pdb_already_zapped_(false),
       write_image_(true),
       write_pdb_(true),
       overwrite_(false) {
@@ -519,10 +594,21 @@ bool ZapTimestamp::Init() {
     return false;
 
   if (!input_pdb_.empty()) {
-    if (!CalculatePdbGuid())
+    // Calculating the new PDB GUID scans the entire PE file and loading the
+    // PDB reads the entire PDB file. The two are independent so we overlap
+    // them; updating the PDB contents needs the GUID and thus waits for both.
+    BackgroundTask calculate_pdb_guid(base::Bind(
+        &ZapTimestamp::CalculatePdbGuid, base::Unretained(this)));
+    base::DelegateSimpleThread thread(&calculate_pdb_guid,
+                                      "CalculatePdbGuid");
+    thread.Start();
+    bool loaded_pdb = LoadPdbFile();
+    thread.Join();
+
+    if (!loaded_pdb || !calculate_pdb_guid.succeeded())
       return false;
 
-    if (!LoadAndUpdatePdbFile())
+    if (!UpdatePdbFile())
       return false;
   }
 
@@ -530,13 +616,33 @@ bool ZapTimestamp::Init() {
 }
 
 bool ZapTimestamp::Zap() {
+  bool write_pdb = !input_pdb_.empty() && write_pdb_;
+
+  if (write_image_ && write_pdb) {
+    // The PE and PDB outputs are independent files, so write them in
+    // parallel.
+    BackgroundTask write_pdb_file(base::Bind(
+        &ZapTimestamp::WritePdbFile, base::Unretained(this)));
+    base::DelegateSimpleThread thread(&write_pdb_file, "WritePdbFile");
+    thread.Start();
+    bool wrote_image = WritePeFile();
+    thread.Join();
+
+    if (!wrote_image || !write_pdb_file.succeeded())
+      return false;
+
+    OutputSummaryStats(input_image_);
+    OutputSummaryStats(input_pdb_);
+    return true;
+  }
+
   if (write_image_) {
     if (!WritePeFile())
       return false;
     OutputSummaryStats(input_image_);
   }
 
-  if (!input_pdb_.empty() && write_pdb_) {
+  if (write_pdb) {
     if (!WritePdbFile())
       return false;
     OutputSummaryStats(input_pdb_);
@@ -837,7 +943,7 @@ bool ZapTimestamp::CalculatePdbGuid() {
   return true;
 }
 
-bool ZapTimestamp::LoadAndUpdatePdbFile() {
+bool ZapTimestamp::LoadPdbFile() {
   DCHECK(!input_pdb_.empty());
   DCHECK(pdb_file_.get() == NULL);
 
@@ -853,13 +959,38 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
   // will no longer exist.
   pdb_file_->ReplaceStream(pdb::kPdbOldDirectoryStream, NULL);
 
-  scoped_refptr<PdbStream> header_reader =
-      GetWritablePdbStream(pdb::kPdbHeaderInfoStream, pdb_file_.get());
-  if (header_reader.get() == NULL) {
+  return true;
+}
+
+bool ZapTimestamp::UpdatePdbFile() {
+  DCHECK(pdb_file_.get() != NULL);
+
+  scoped_refptr<PdbStream> header_stream =
+      pdb_file_->GetStream(pdb::kPdbHeaderInfoStream);
+  if (header_stream.get() == NULL) {
     LOG(ERROR) << "No header info stream in PDB file: " << input_pdb_.value();
     return false;
   }
 
+  // If the header already carries the timestamp, age and GUID that we would
+  // write then the PDB was normalized by a previous run, and rewriting it
+  // canonically would reproduce it byte for byte. Detect this up front so
+  // that WritePdbFile can skip the rewrite altogether.
+  pdb::PdbInfoHeader70 header = {};
+  if (header_stream->Seek(0) && header_stream->Read(&header, 1) &&
+      header.timestamp == static_cast<uint32>(timestamp_data_) &&
+      header.pdb_age == static_cast<uint32>(pdb_age_data_) &&
+      ::memcmp(&header.signature, &pdb_guid_data_,
+               sizeof(pdb_guid_data_)) == 0) {
+    LOG(INFO) << "PDB file is already normalized: " << input_pdb_.value();
+    pdb_already_zapped_ = true;
+    return true;
+  }
+
+  scoped_refptr<PdbStream> header_reader =
+      GetWritablePdbStream(pdb::kPdbHeaderInfoStream, pdb_file_.get());
+  DCHECK(header_reader.get() != NULL);
+
   scoped_refptr<WritablePdbStream> header_writer =
       header_reader->GetWritablePdbStream();
   DCHECK(header_writer.get() != NULL);
@@ -918,6 +1049,19 @@ bool ZapTimestamp::WritePeFile() {
     }
   }
 
+  // If every marked range already holds its replacement data then a previous
+  // run normalized this file; that run also updated the checksum, so there is
+  // nothing left to do.
+  bool already_updated = false;
+  if (!FileAlreadyUpdated(output_image_, pe_file_addr_space_,
+                          &already_updated)) {
+    return false;
+  }
+  if (already_updated) {
+    LOG(INFO) << "PE file is already normalized: " << output_image_.value();
+    return true;
+  }
+
   if (!UpdateFileInPlace(output_image_, pe_file_addr_space_))
     return false;
 
@@ -933,6 +1077,30 @@ bool ZapTimestamp::WritePeFile() {
 
 bool ZapTimestamp::WritePdbFile() {
   DCHECK(!input_pdb_.empty());
+  DCHECK(pdb_file_.get() != NULL);
+
+  if (pdb_already_zapped_) {
+    // The input PDB is already in its canonical normalized form, so a full
+    // rewrite would reproduce it byte for byte. A simple copy (or nothing at
+    // all when zapping in place) suffices. Free up the PDB file first as it
+    // has an open handle to the original PDB.
+    pdb_file_.reset(NULL);
+
+    if (core::CompareFilePaths(input_pdb_, output_pdb_) ==
+            core::kEquivalentFilePaths) {
+      LOG(INFO) << "PDB file is already normalized: " << output_pdb_.value();
+      return true;
+    }
+
+    if (::CopyFileW(input_pdb_.value().c_str(),
+                    output_pdb_.value().c_str(),
+                    FALSE) == FALSE) {
+      LOG(ERROR) << "Failed to write output PDB: " << output_pdb_.value();
+      return false;
+    }
+
+    return true;
+  }
 
   // We actually completely rewrite the PDB file to a temporary location, and
   // then move it over top of the existing one. This is because pdb_file_
@@ -115,8 +115,14 @@ class ZapTimestamp {
   // Calculates a PDB GUID using the non-changing parts of the PE file.
   bool CalculatePdbGuid();
 
-  // Loads the PDB file and updates its in-memory representation.
-  bool LoadAndUpdatePdbFile();
+  // Loads the PDB file into its in-memory representation. This is independent
+  // of CalculatePdbGuid, and Init runs the two concurrently.
+  bool LoadPdbFile();
+
+  // Updates the in-memory representation of the PDB file. If the PDB on disk
+  // already carries the values that would be written then this sets
+  // pdb_already_zapped_ and leaves the streams untouched.
+  bool UpdatePdbFile();
 
   // @{
   // These do the actual writing of the individual files.
@@ -136,6 +142,10 @@ class ZapTimestamp {
   // Populated by LoadPdbFile and modified by UpdatePdbFile.
   scoped_ptr<pdb::PdbFile> pdb_file_;
 
+  // Set by UpdatePdbFile when the input PDB was already normalized by a
+  // previous run, in which case WritePdbFile degenerates to a simple copy.
+  bool pdb_already_zapped_;
+
   // These house the new values to be written when the image is zapped.
   DWORD timestamp_data_;
   DWORD pdb_age_data_;